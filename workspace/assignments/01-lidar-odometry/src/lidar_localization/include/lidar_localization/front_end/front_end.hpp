@@ -18,8 +18,11 @@
 #include <yaml-cpp/yaml.h>
 
 #include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/tools/key_frame_writer.hpp"
 
 #include "lidar_localization/models/cloud_filter/voxel_filter.hpp"
+#include "lidar_localization/models/local_map/voxel_hash_map.hpp"
+#include "lidar_localization/models/global_map/streaming_map_builder.hpp"
 
 #include "lidar_localization/models/registration/icp_registration.hpp"
 #include "lidar_localization/models/registration/ndt_registration.hpp"
@@ -29,6 +32,7 @@ namespace lidar_localization {
 class FrontEnd {
   public:
     struct Frame { 
+        int id = 0;
         Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
         CloudData cloud_data;
     };
@@ -50,10 +54,14 @@ class FrontEnd {
     bool InitDataPath(const YAML::Node& config_node);
     bool InitRegistration(std::shared_ptr<RegistrationInterface>& registration_ptr, const YAML::Node& config_node);
     bool InitFilter(std::string filter_user, std::shared_ptr<CloudFilterInterface>& filter_ptr, const YAML::Node& config_node);
+    bool InitLocalMap(const YAML::Node& config_node);
+    bool InitSaveMap(const YAML::Node& config_node);
     bool UpdateWithNewFrame(const Frame& new_key_frame);
+    bool SaveStreamingMap();
 
   private:
     std::string data_path_ = "";
+    std::shared_ptr<KeyFrameWriter> key_frame_writer_ptr_;
 
     std::shared_ptr<CloudFilterInterface> frame_filter_ptr_;
     std::shared_ptr<CloudFilterInterface> local_map_filter_ptr_;
@@ -65,6 +73,8 @@ class FrontEnd {
 
     bool has_new_local_map_ = false;
     bool has_new_global_map_ = false;
+    std::shared_ptr<VoxelHashMap> local_map_voxels_ptr_;
+    std::shared_ptr<StreamingMapBuilder> streaming_map_builder_ptr_;
     CloudData::CLOUD_PTR local_map_ptr_;
     CloudData::CLOUD_PTR global_map_ptr_;
     CloudData::CLOUD_PTR result_cloud_ptr_;
@@ -72,6 +82,12 @@ class FrontEnd {
 
     Eigen::Matrix4f init_pose_ = Eigen::Matrix4f::Identity();
 
+    // odometry state for the prediction of the next scan, reset by the first scan:
+    Eigen::Matrix4f step_pose_ = Eigen::Matrix4f::Identity();
+    Eigen::Matrix4f last_pose_ = Eigen::Matrix4f::Identity();
+    Eigen::Matrix4f predict_pose_ = Eigen::Matrix4f::Identity();
+    Eigen::Matrix4f last_key_frame_pose_ = Eigen::Matrix4f::Identity();
+
     float key_frame_distance_ = 2.0;
     int local_frame_num_ = 20;
 };
@@ -0,0 +1,54 @@
+/*
+ * @Description: sliding window local map, kept as frame-tagged voxel centroids
+ * @Author: Ge Yao
+ * @Date: 2020-12-05 19:37:49
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_LOCAL_MAP_VOXEL_HASH_MAP_HPP_
+#define LIDAR_LOCALIZATION_MODELS_LOCAL_MAP_VOXEL_HASH_MAP_HPP_
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+#include <yaml-cpp/yaml.h>
+#include <Eigen/Dense>
+
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+
+namespace lidar_localization {
+class VoxelHashMap {
+  public:
+    VoxelHashMap(const YAML::Node& node);
+    VoxelHashMap(float leaf_size_x, float leaf_size_y, float leaf_size_z);
+
+    // frame cloud must be in map frame:
+    bool AddFrame(int frame_id, const CloudData::CLOUD_PTR& frame_cloud_ptr);
+    bool RemoveFrame(int frame_id);
+    void Clear(void);
+
+    // one centroid per voxel, same as pcl::VoxelGrid on the union of all frames:
+    bool GetMap(CloudData::CLOUD_PTR& map_ptr) const;
+
+    size_t GetFrameNum(void) const { return frame_voxels_.size(); }
+    size_t GetVoxelNum(void) const { return voxels_.size(); }
+
+  private:
+    // contribution of one frame to one voxel:
+    struct FrameVoxel {
+      int frame_id;
+      int num_points;
+      Eigen::Vector3f sum;
+    };
+
+    bool SetMapParam(float leaf_size_x, float leaf_size_y, float leaf_size_z);
+    int64_t GetVoxelKey(const CloudData::POINT &point) const;
+
+  private:
+    Eigen::Vector3f inverse_leaf_size_;
+
+    std::unordered_map<int64_t, std::vector<FrameVoxel>> voxels_;
+    std::unordered_map<int, std::vector<int64_t>> frame_voxels_;
+};
+}
+
+#endif
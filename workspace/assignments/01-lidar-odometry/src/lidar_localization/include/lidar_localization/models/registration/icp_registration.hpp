@@ -25,6 +25,7 @@ class ICPRegistration: public RegistrationInterface {
                    const Eigen::Matrix4f& predict_pose, 
                    CloudData::CLOUD_PTR& result_cloud_ptr,
                    Eigen::Matrix4f& result_pose) override;
+    float GetFitnessScore() override;
   
   private:
     bool SetRegistrationParam(
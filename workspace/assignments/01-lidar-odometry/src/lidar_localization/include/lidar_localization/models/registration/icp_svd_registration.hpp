@@ -8,6 +8,8 @@
 
 #include "lidar_localization/models/registration/registration_interface.hpp"
 
+#include <vector>
+
 #include <pcl/kdtree/kdtree_flann.h>
 
 namespace lidar_localization {
@@ -18,9 +20,18 @@ class ICPSVDRegistration: public RegistrationInterface {
       float max_corr_dist, 
       float trans_eps, 
       float euc_fitness_eps, 
-      int max_iter
+      int max_iter,
+      int num_threads = 1
     );
 
+    // statistics of the last ScanMatch call:
+    struct MatchStats {
+      int num_iter = 0;
+      size_t num_corr = 0;
+      double total_time = 0.0;
+      double time_per_iter = 0.0;
+    };
+
     bool SetInputTarget(const CloudData::CLOUD_PTR& input_target) override;
     bool ScanMatch(
       const CloudData::CLOUD_PTR& input_source, 
@@ -28,25 +39,57 @@ class ICPSVDRegistration: public RegistrationInterface {
       CloudData::CLOUD_PTR& result_cloud_ptr,
       Eigen::Matrix4f& result_pose
     ) override;
+    float GetFitnessScore() override;
+    int GetNumIterations() override { return match_stats_.num_iter; }
+
+    const MatchStats& GetMatchStats(void) const { return match_stats_; }
   
   private:
     bool SetRegistrationParam(
       float max_corr_dist, 
       float trans_eps, 
       float euc_fitness_eps, 
-      int max_iter
+      int max_iter,
+      int num_threads
     );
 
   private:
+    // sufficient statistics of the correspondence set, x is target and y is source.
+    // accumulated in double since H is recovered as sum_yx - N * mu_y * mu_x^T:
+    struct CorrespondenceStats {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      void Reset(void);
+      void Add(const Eigen::Vector3f &x, const Eigen::Vector3f &y);
+      void Merge(const CorrespondenceStats &other);
+
+      Eigen::Vector3d sum_x = Eigen::Vector3d::Zero();
+      Eigen::Vector3d sum_y = Eigen::Vector3d::Zero();
+      Eigen::Matrix3d sum_yx = Eigen::Matrix3d::Zero();
+      size_t count = 0;
+    };
+
+    // per-thread correspondence buffers, allocated once and reused across iterations:
+    struct CorrespondenceBuffer {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      std::vector<int> corr_ind;
+      std::vector<float> corr_sq_dis;
+      CorrespondenceStats stats;
+    };
+
+    void SetInputSource(
+      const CloudData::CLOUD_PTR &input_source,
+      const Eigen::Matrix4f &predict_pose
+    );
+
     size_t GetCorrespondence(
-      const CloudData::CLOUD_PTR &input_source, 
-      std::vector<Eigen::Vector3f> &xs,
-      std::vector<Eigen::Vector3f> &ys
+      const Eigen::Matrix4f &transformation,
+      CorrespondenceStats &stats
     );
 
     void GetTransform(
-      const std::vector<Eigen::Vector3f> &xs,
-      const std::vector<Eigen::Vector3f> &ys,
+      const CorrespondenceStats &stats,
       Eigen::Matrix4f &transformation_
     );
 
@@ -59,11 +102,23 @@ class ICPSVDRegistration: public RegistrationInterface {
     float trans_eps_; 
     float euc_fitness_eps_; 
     int max_iter_;
+    int num_threads_;
+
+    std::vector<CorrespondenceBuffer, Eigen::aligned_allocator<CorrespondenceBuffer>> corr_buffers_;
+    CorrespondenceStats corr_stats_;
+
+    MatchStats match_stats_;
 
     CloudData::CLOUD_PTR input_target_;
     pcl::KdTreeFLANN<pcl::PointXYZ>::Ptr input_target_kdtree_;
     CloudData::CLOUD_PTR input_source_;
 
+    // input source transformed by predict pose, kept as SoA scratch buffers.
+    // the buffers only grow so that iterations are allocation-free once warm:
+    std::vector<float> input_source_x_;
+    std::vector<float> input_source_y_;
+    std::vector<float> input_source_z_;
+
     Eigen::Matrix4f transformation_;
 };
 }
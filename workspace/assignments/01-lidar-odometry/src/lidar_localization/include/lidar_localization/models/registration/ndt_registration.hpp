@@ -20,6 +20,8 @@ class NDTRegistration: public RegistrationInterface {
                    const Eigen::Matrix4f& predict_pose, 
                    CloudData::CLOUD_PTR& result_cloud_ptr,
                    Eigen::Matrix4f& result_pose) override;
+    float GetFitnessScore() override;
+    int GetNumIterations() override;
   
   private:
     bool SetRegistrationParam(float res, float step_size, float trans_eps, int max_iter);
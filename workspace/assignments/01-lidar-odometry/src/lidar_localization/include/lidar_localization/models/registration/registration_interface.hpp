@@ -20,6 +20,10 @@ class RegistrationInterface {
                           const Eigen::Matrix4f& predict_pose, 
                           CloudData::CLOUD_PTR& result_cloud_ptr,
                           Eigen::Matrix4f& result_pose) = 0;
+    // mean squared distance to the nearest target point of the last ScanMatch result:
+    virtual float GetFitnessScore() = 0;
+    // iterations used by the last ScanMatch, -1 if not available:
+    virtual int GetNumIterations() { return -1; }
 };
 } 
 
@@ -6,6 +6,7 @@
 #include "lidar_localization/front_end/front_end.hpp"
 
 #include <fstream>
+#include <algorithm>
 #include <boost/filesystem.hpp>
 #include <pcl/common/transforms.h>
 #include <pcl/io/pcd_io.h>
@@ -31,6 +32,8 @@ bool FrontEnd::InitWithConfig() {
     InitFilter("local_map", local_map_filter_ptr_, config_node);
     InitFilter("frame", frame_filter_ptr_, config_node);
     InitFilter("display", display_filter_ptr_, config_node);
+    InitLocalMap(config_node);
+    InitSaveMap(config_node);
 
     return true;
 }
@@ -70,6 +73,13 @@ bool FrontEnd::InitDataPath(const YAML::Node& config_node) {
         LOG(INFO) << "Key Frames Output Path: " << key_frame_path << std::endl << std::endl;
     }
 
+    // 关键帧点云由后台线程写盘，队列满时才阻塞
+    int key_frame_queue_size = config_node["key_frame_queue_size"].as<int>();
+    key_frame_writer_ptr_ = std::make_shared<KeyFrameWriter>(
+        static_cast<size_t>(std::max(key_frame_queue_size, 1))
+    );
+    LOG(INFO) << "Key Frame Queue Size: " << key_frame_queue_size;
+
     return true;
 }
 
@@ -105,6 +115,38 @@ bool FrontEnd::InitFilter(std::string filter_user, std::shared_ptr<CloudFilterIn
     return true;
 }
 
+bool FrontEnd::InitLocalMap(const YAML::Node& config_node) {
+    std::string local_map_update = config_node["local_map_update"].as<std::string>();
+    LOG(INFO) << "Local Map Update Method: " << local_map_update;
+
+    if (local_map_update == "incremental") {
+        if (config_node["local_map_filter"].as<std::string>() != "voxel_filter") {
+            LOG(WARNING) << "Incremental local map requires voxel_filter as local_map_filter. Fall back to full_rebuild.";
+            return false;
+        }
+        local_map_voxels_ptr_ = std::make_shared<VoxelHashMap>(config_node["voxel_filter"]["local_map"]);
+    } else if (local_map_update != "full_rebuild") {
+        LOG(ERROR) << "Local map update method " << local_map_update << " NOT FOUND!";
+        return false;
+    }
+
+    return true;
+}
+
+bool FrontEnd::InitSaveMap(const YAML::Node& config_node) {
+    std::string save_map_method = config_node["save_map_method"].as<std::string>();
+    LOG(INFO) << "Save Map Method: " << save_map_method;
+
+    if (save_map_method == "streaming") {
+        streaming_map_builder_ptr_ = std::make_shared<StreamingMapBuilder>(config_node["streaming_map"]);
+    } else if (save_map_method != "in_memory") {
+        LOG(ERROR) << "Save map method " << save_map_method << " NOT FOUND!";
+        return false;
+    }
+
+    return true;
+}
+
 bool FrontEnd::Update(const CloudData& cloud_data, Eigen::Matrix4f& cloud_pose) {
     current_frame_.cloud_data.time = cloud_data.time;
     std::vector<int> indices;
@@ -113,14 +155,12 @@ bool FrontEnd::Update(const CloudData& cloud_data, Eigen::Matrix4f& cloud_pose)
     CloudData::CLOUD_PTR filtered_cloud_ptr(new CloudData::CLOUD());
     frame_filter_ptr_->Filter(current_frame_.cloud_data.cloud_ptr, filtered_cloud_ptr);
 
-    static Eigen::Matrix4f step_pose = Eigen::Matrix4f::Identity();
-    static Eigen::Matrix4f last_pose = init_pose_;
-    static Eigen::Matrix4f predict_pose = init_pose_;
-    static Eigen::Matrix4f last_key_frame_pose = init_pose_;
-
     // 局部地图容器中没有关键帧，代表是第一帧数据
     // 此时把当前帧数据作为第一个关键帧，并更新局部地图容器和全局地图容器
     if (local_map_frames_.size() == 0) {
+        step_pose_ = Eigen::Matrix4f::Identity();
+        last_pose_ = predict_pose_ = last_key_frame_pose_ = init_pose_;
+
         current_frame_.pose = init_pose_;
         UpdateWithNewFrame(current_frame_);
         cloud_pose = current_frame_.pose;
@@ -128,20 +168,20 @@ bool FrontEnd::Update(const CloudData& cloud_data, Eigen::Matrix4f& cloud_pose)
     }
 
     // 不是第一帧，就正常匹配
-    registration_ptr_->ScanMatch(filtered_cloud_ptr, predict_pose, result_cloud_ptr_, current_frame_.pose);
+    registration_ptr_->ScanMatch(filtered_cloud_ptr, predict_pose_, result_cloud_ptr_, current_frame_.pose);
     cloud_pose = current_frame_.pose;
 
     // 更新相邻两帧的相对运动
-    step_pose = last_pose.inverse() * current_frame_.pose;
-    predict_pose = current_frame_.pose * step_pose;
-    last_pose = current_frame_.pose;
+    step_pose_ = last_pose_.inverse() * current_frame_.pose;
+    predict_pose_ = current_frame_.pose * step_pose_;
+    last_pose_ = current_frame_.pose;
 
     // 匹配之后根据距离判断是否需要生成新的关键帧，如果需要，则做相应更新
-    if (fabs(last_key_frame_pose(0,3) - current_frame_.pose(0,3)) + 
-        fabs(last_key_frame_pose(1,3) - current_frame_.pose(1,3)) +
-        fabs(last_key_frame_pose(2,3) - current_frame_.pose(2,3)) > key_frame_distance_) {
+    if (fabs(last_key_frame_pose_(0,3) - current_frame_.pose(0,3)) + 
+        fabs(last_key_frame_pose_(1,3) - current_frame_.pose(1,3)) +
+        fabs(last_key_frame_pose_(2,3) - current_frame_.pose(2,3)) > key_frame_distance_) {
         UpdateWithNewFrame(current_frame_);
-        last_key_frame_pose = current_frame_.pose;
+        last_key_frame_pose_ = current_frame_.pose;
     }
 
     return true;
@@ -153,39 +193,65 @@ bool FrontEnd::SetInitPose(const Eigen::Matrix4f& init_pose) {
 }
 
 bool FrontEnd::UpdateWithNewFrame(const Frame& new_key_frame) {
-    // 把关键帧点云存储到硬盘里，节省内存
-    std::string file_path = data_path_ + "/key_frames/key_frame_" + std::to_string(global_map_frames_.size()) + ".pcd";
-    pcl::io::savePCDFileBinary(file_path, *new_key_frame.cloud_data.cloud_ptr);
-
     Frame key_frame = new_key_frame;
+    key_frame.id = static_cast<int>(global_map_frames_.size());
     // 这一步的目的是为了把关键帧的点云保存下来
     // 由于用的是共享指针，所以直接复制只是复制了一个指针而已
     // 此时无论你放多少个关键帧在容器里，这些关键帧点云指针都是指向的同一个点云
     key_frame.cloud_data.cloud_ptr.reset(new CloudData::CLOUD(*new_key_frame.cloud_data.cloud_ptr));
+
+    // 把关键帧点云存储到硬盘里，节省内存
+    // 写盘交给后台线程，它和局部地图共享这份拷贝，之后不能再修改这份点云
+    std::string file_path = data_path_ + "/key_frames/key_frame_" + std::to_string(key_frame.id) + ".pcd";
+    key_frame_writer_ptr_->Write(file_path, key_frame.cloud_data.cloud_ptr);
     CloudData::CLOUD_PTR transformed_cloud_ptr(new CloudData::CLOUD());
     
     // 更新局部地图
     local_map_frames_.push_back(key_frame);
+    std::deque<Frame> evicted_frames;
     while (local_map_frames_.size() > static_cast<size_t>(local_frame_num_)) {
+        evicted_frames.push_back(local_map_frames_.front());
         local_map_frames_.pop_front();
     }
-    local_map_ptr_.reset(new CloudData::CLOUD());
-    for (size_t i = 0; i < local_map_frames_.size(); ++i) {
-        pcl::transformPointCloud(*local_map_frames_.at(i).cloud_data.cloud_ptr, 
+
+    if (local_map_voxels_ptr_) {
+        // 增量更新：只变换新关键帧，移出滑窗的关键帧按编号删除，其余关键帧不动
+        pcl::transformPointCloud(*key_frame.cloud_data.cloud_ptr, 
                                  *transformed_cloud_ptr, 
-                                 local_map_frames_.at(i).pose);
-        *local_map_ptr_ += *transformed_cloud_ptr;
-    }
-    has_new_local_map_ = true;
+                                 key_frame.pose);
+        for (const auto &evicted_frame: evicted_frames) {
+            local_map_voxels_ptr_->RemoveFrame(evicted_frame.id);
+        }
+        local_map_voxels_ptr_->AddFrame(key_frame.id, transformed_cloud_ptr);
+
+        // 关键帧数量还比较少的时候不滤波，直接拼接
+        if (local_map_frames_.size() < 10 && evicted_frames.empty()) {
+            *local_map_ptr_ += *transformed_cloud_ptr;
+        } else {
+            local_map_voxels_ptr_->GetMap(local_map_ptr_);
+        }
+        has_new_local_map_ = true;
 
-    // 更新ndt匹配的目标点云
-    // 关键帧数量还比较少的时候不滤波，因为点云本来就不多，太稀疏影响匹配效果
-    if (local_map_frames_.size() < 10) {
         registration_ptr_->SetInputTarget(local_map_ptr_);
     } else {
-        CloudData::CLOUD_PTR filtered_local_map_ptr(new CloudData::CLOUD());
-        local_map_filter_ptr_->Filter(local_map_ptr_, filtered_local_map_ptr);
-        registration_ptr_->SetInputTarget(filtered_local_map_ptr);
+        local_map_ptr_.reset(new CloudData::CLOUD());
+        for (size_t i = 0; i < local_map_frames_.size(); ++i) {
+            pcl::transformPointCloud(*local_map_frames_.at(i).cloud_data.cloud_ptr, 
+                                     *transformed_cloud_ptr, 
+                                     local_map_frames_.at(i).pose);
+            *local_map_ptr_ += *transformed_cloud_ptr;
+        }
+        has_new_local_map_ = true;
+
+        // 更新ndt匹配的目标点云
+        // 关键帧数量还比较少的时候不滤波，因为点云本来就不多，太稀疏影响匹配效果
+        if (local_map_frames_.size() < 10) {
+            registration_ptr_->SetInputTarget(local_map_ptr_);
+        } else {
+            CloudData::CLOUD_PTR filtered_local_map_ptr(new CloudData::CLOUD());
+            local_map_filter_ptr_->Filter(local_map_ptr_, filtered_local_map_ptr);
+            registration_ptr_->SetInputTarget(filtered_local_map_ptr);
+        }
     }
 
     // 保存所有关键帧信息在容器里
@@ -197,6 +263,19 @@ bool FrontEnd::UpdateWithNewFrame(const Frame& new_key_frame) {
 }
 
 bool FrontEnd::SaveMap() {
+    // 等待所有关键帧写盘完成
+    key_frame_writer_ptr_->Flush();
+
+    KeyFrameWriter::Stats stats = key_frame_writer_ptr_->GetStats();
+    LOG(INFO) << "Key frame writer: " 
+              << stats.num_written << " written, " 
+              << stats.num_failed << " failed, "
+              << stats.num_blocked << " blocked, "
+              << "max queue depth " << stats.max_queue_depth;
+
+    if (streaming_map_builder_ptr_)
+        return SaveStreamingMap();
+
     global_map_ptr_.reset(new CloudData::CLOUD());
 
     std::string key_frame_path = "";
@@ -220,6 +299,30 @@ bool FrontEnd::SaveMap() {
     return true;
 }
 
+bool FrontEnd::SaveStreamingMap() {
+    // 分块体素累积，内存中只保留扫描范围内的分块，输出的 map.pcd 已按 streaming_map 体素降采样
+    std::vector<Eigen::Matrix4f> key_frame_poses;
+    for (const Frame& frame: global_map_frames_) {
+        key_frame_poses.push_back(frame.pose);
+    }
+    auto load_scan = [this](size_t index, CloudData::CLOUD_PTR& scan_ptr) {
+        std::string key_frame_path = data_path_ + "/key_frames/key_frame_" + std::to_string(index) + ".pcd";
+        scan_ptr.reset(new CloudData::CLOUD());
+        return pcl::io::loadPCDFile(key_frame_path, *scan_ptr) == 0;
+    };
+
+    std::string map_file_path = data_path_ + "/map.pcd";
+    if (!streaming_map_builder_ptr_->Build(key_frame_poses, load_scan, data_path_ + "/map_tiles", map_file_path))
+        return false;
+
+    // rviz 显示用降采样后的地图，点数受体素大小限制
+    global_map_ptr_.reset(new CloudData::CLOUD());
+    pcl::io::loadPCDFile(map_file_path, *global_map_ptr_);
+    has_new_global_map_ = true;
+
+    return true;
+}
+
 bool FrontEnd::GetNewLocalMap(CloudData::CLOUD_PTR& local_map_ptr) {
     if (has_new_local_map_) {
         display_filter_ptr_->Filter(local_map_ptr_, local_map_ptr);
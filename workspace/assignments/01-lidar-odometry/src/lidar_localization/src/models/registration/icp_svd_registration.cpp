@@ -7,14 +7,22 @@
 
 #include <pcl/common/transforms.h>
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
 #include <vector>
 
 #include <Eigen/Dense>
 #include <Eigen/SVD>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "glog/logging.h"
 
+#include "lidar_localization/tools/tic_toc.hpp"
+
 namespace lidar_localization {
 
 ICPSVDRegistration::ICPSVDRegistration(
@@ -25,24 +33,27 @@ ICPSVDRegistration::ICPSVDRegistration(
     float trans_eps = node["trans_eps"].as<float>();
     float euc_fitness_eps = node["euc_fitness_eps"].as<float>();
     int max_iter = node["max_iter"].as<int>();
+    int num_threads = node["num_threads"].as<int>();
 
-    SetRegistrationParam(max_corr_dist, trans_eps, euc_fitness_eps, max_iter);
+    SetRegistrationParam(max_corr_dist, trans_eps, euc_fitness_eps, max_iter, num_threads);
 }
 
 ICPSVDRegistration::ICPSVDRegistration(
     float max_corr_dist, 
     float trans_eps, 
     float euc_fitness_eps, 
-    int max_iter
+    int max_iter,
+    int num_threads
 ) : input_target_kdtree_(new pcl::KdTreeFLANN<pcl::PointXYZ>()) {
-    SetRegistrationParam(max_corr_dist, trans_eps, euc_fitness_eps, max_iter);
+    SetRegistrationParam(max_corr_dist, trans_eps, euc_fitness_eps, max_iter, num_threads);
 }
 
 bool ICPSVDRegistration::SetRegistrationParam(
     float max_corr_dist, 
     float trans_eps, 
     float euc_fitness_eps, 
-    int max_iter
+    int max_iter,
+    int num_threads
 ) {
     // set params:
     max_corr_dist_ = max_corr_dist;
@@ -50,11 +61,20 @@ bool ICPSVDRegistration::SetRegistrationParam(
     euc_fitness_eps_ = euc_fitness_eps;
     max_iter_ = max_iter;
 
+    // num_threads <= 0 means use all available cores:
+#ifdef _OPENMP
+    num_threads_ = (num_threads > 0) ? num_threads : omp_get_max_threads();
+#else
+    num_threads_ = 1;
+#endif
+    corr_buffers_.resize(num_threads_);
+
     LOG(INFO) << "ICP SVD params:" << std::endl
               << "max_corr_dist: " << max_corr_dist_ << ", "
               << "trans_eps: " << trans_eps_ << ", "
               << "euc_fitness_eps: " << euc_fitness_eps_ << ", "
-              << "max_iter: " << max_iter_ 
+              << "max_iter: " << max_iter_ << ", "
+              << "num_threads: " << num_threads_
               << std::endl << std::endl;
 
     return true;
@@ -73,11 +93,10 @@ bool ICPSVDRegistration::ScanMatch(
     CloudData::CLOUD_PTR& result_cloud_ptr,
     Eigen::Matrix4f& result_pose
 ) {
-    input_source_ = input_source;
+    TicToc match_timer;
 
     // pre-process input source:
-    CloudData::CLOUD_PTR transformed_input_source(new CloudData::CLOUD());
-    pcl::transformPointCloud(*input_source_, *transformed_input_source, predict_pose);
+    SetInputSource(input_source, predict_pose);
 
     // init estimation:
     transformation_.setIdentity();
@@ -85,21 +104,13 @@ bool ICPSVDRegistration::ScanMatch(
     // do estimation:
     int curr_iter = 0;
     while (curr_iter < max_iter_) {
-        // apply current estimation:
-        CloudData::CLOUD_PTR curr_input_source(new CloudData::CLOUD());
-        pcl::transformPointCloud(*transformed_input_source, *curr_input_source, transformation_);
-
-        // get correspondence:
-        std::vector<Eigen::Vector3f> xs;
-        std::vector<Eigen::Vector3f> ys;
-
-        // do not have enough correspondence -- break:
-        if (GetCorrespondence(curr_input_source, xs, ys) < 3)
+        // get correspondence under current estimation -- do not have enough correspondence -- break:
+        if (GetCorrespondence(transformation_, corr_stats_) < 3)
             break;
 
         // update current transform:
         Eigen::Matrix4f delta_transformation;
-        GetTransform(xs, ys, delta_transformation);
+        GetTransform(corr_stats_, delta_transformation);
 
         // whether the transformation update is significant:
         if (!IsSignificant(delta_transformation, trans_eps_))
@@ -113,86 +124,155 @@ bool ICPSVDRegistration::ScanMatch(
     // set output:
     result_pose = transformation_ * predict_pose;
     pcl::transformPointCloud(*input_source_, *result_cloud_ptr, result_pose);
+
+    // update stats:
+    match_stats_.num_iter = curr_iter;
+    match_stats_.num_corr = corr_stats_.count;
+    match_stats_.total_time = match_timer.toc();
+    match_stats_.time_per_iter = match_stats_.total_time / std::max(curr_iter, 1);
     
     return true;
 }
 
+float ICPSVDRegistration::GetFitnessScore() {
+    // same as pcl::Registration::getFitnessScore, over all points of the last result:
+    const int N = static_cast<int>(input_source_x_.size());
+    if (0 == N) {
+        return std::numeric_limits<float>::max();
+    }
+
+    const Eigen::Matrix3f R = transformation_.block<3, 3>(0, 0);
+    const Eigen::Vector3f t = transformation_.block<3, 1>(0, 3);
+
+    double sum_sq_dis = 0.0;
+#pragma omp parallel num_threads(num_threads_) reduction(+:sum_sq_dis)
+    {
+#ifdef _OPENMP
+        CorrespondenceBuffer &buffer = corr_buffers_.at(omp_get_thread_num());
+#else
+        CorrespondenceBuffer &buffer = corr_buffers_.at(0);
+#endif
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < N; ++i) {
+            const Eigen::Vector3f y = R * Eigen::Vector3f(
+                input_source_x_[i], input_source_y_[i], input_source_z_[i]
+            ) + t;
+            const CloudData::POINT query(y.x(), y.y(), y.z());
+
+            input_target_kdtree_->nearestKSearch(
+                query, 
+                1, 
+                buffer.corr_ind, buffer.corr_sq_dis
+            ); 
+
+            sum_sq_dis += buffer.corr_sq_dis.at(0);
+        }
+    }
+
+    return static_cast<float>(sum_sq_dis / N);
+}
+
+void ICPSVDRegistration::SetInputSource(
+    const CloudData::CLOUD_PTR &input_source,
+    const Eigen::Matrix4f &predict_pose
+) {
+    input_source_ = input_source;
+
+    const size_t N = input_source_->points.size();
+    input_source_x_.resize(N);
+    input_source_y_.resize(N);
+    input_source_z_.resize(N);
+
+    const Eigen::Matrix3f R = predict_pose.block<3, 3>(0, 0);
+    const Eigen::Vector3f t = predict_pose.block<3, 1>(0, 3);
+    for (size_t i = 0; i < N; ++i) {
+        const Eigen::Vector3f y = R * input_source_->points[i].getVector3fMap() + t;
+
+        input_source_x_[i] = y.x();
+        input_source_y_[i] = y.y();
+        input_source_z_[i] = y.z();
+    }
+}
+
 size_t ICPSVDRegistration::GetCorrespondence(
-    const CloudData::CLOUD_PTR &input_source, 
-    std::vector<Eigen::Vector3f> &xs,
-    std::vector<Eigen::Vector3f> &ys
+    const Eigen::Matrix4f &transformation,
+    CorrespondenceStats &stats
 ) {
     const float MAX_CORR_DIST_SQR = max_corr_dist_ * max_corr_dist_;
+    const int N = static_cast<int>(input_source_x_.size());
+
+    const Eigen::Matrix3f R = transformation.block<3, 3>(0, 0);
+    const Eigen::Vector3f t = transformation.block<3, 1>(0, 3);
+
+    // each thread searches a contiguous chunk of the source and accumulates its own stats:
+#pragma omp parallel num_threads(num_threads_)
+    {
+#ifdef _OPENMP
+        CorrespondenceBuffer &buffer = corr_buffers_.at(omp_get_thread_num());
+#else
+        CorrespondenceBuffer &buffer = corr_buffers_.at(0);
+#endif
+        buffer.stats.Reset();
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < N; ++i) {
+            // apply current estimation:
+            const Eigen::Vector3f y = R * Eigen::Vector3f(
+                input_source_x_[i], input_source_y_[i], input_source_z_[i]
+            ) + t;
+            const CloudData::POINT query(y.x(), y.y(), y.z());
+
+            input_target_kdtree_->nearestKSearch(
+                query, 
+                1, 
+                buffer.corr_ind, buffer.corr_sq_dis
+            ); 
+
+            if (buffer.corr_sq_dis.at(0) > MAX_CORR_DIST_SQR)
+                continue;
+            
+            // add correspondence:
+            buffer.stats.Add(
+                input_target_->at(buffer.corr_ind.at(0)).getVector3fMap(),
+                y
+            );
+        }
+    }
 
-    size_t num_corr = 0;
-
-    for (size_t i = 0; i < input_source->points.size(); ++i) {
-        std::vector<int> corr_ind;
-        std::vector<float> corr_sq_dis;
-        input_target_kdtree_->nearestKSearch(
-            input_source->at(i), 
-            1, 
-            corr_ind, corr_sq_dis
-        ); 
-
-        if (corr_sq_dis.at(0) > MAX_CORR_DIST_SQR)
-            continue;
-        
-        // add correspondence:
-        Eigen::Vector3f x(
-            input_target_->at(corr_ind.at(0)).x,
-            input_target_->at(corr_ind.at(0)).y,
-            input_target_->at(corr_ind.at(0)).z
-        );
-        Eigen::Vector3f y(
-            input_source->at(i).x,
-            input_source->at(i).y,
-            input_source->at(i).z
-        );
-
-        xs.push_back(x);
-        ys.push_back(y);
-
-        ++num_corr;
+    // merge per-thread stats in thread order, so the output is deterministic:
+    stats.Reset();
+    for (const auto &buffer: corr_buffers_) {
+        stats.Merge(buffer.stats);
     }
 
-    return num_corr;
+    return stats.count;
 }
 
 void ICPSVDRegistration::GetTransform(
-    const std::vector<Eigen::Vector3f> &xs,
-    const std::vector<Eigen::Vector3f> &ys,
+    const CorrespondenceStats &stats,
     Eigen::Matrix4f &transformation_
 ) {
-    const size_t N = xs.size();
+    const double N = static_cast<double>(stats.count);
 
     // find centroids of mu_x and mu_y:
-    Eigen::Vector3f mu_x = Eigen::Vector3f::Zero();
-    Eigen::Vector3f mu_y = Eigen::Vector3f::Zero();
-    for (size_t i = 0; i < N; ++i) {
-        mu_x += xs.at(i);
-        mu_y += ys.at(i);
-    }
-    mu_x /= N; 
-    mu_y /= N;
+    const Eigen::Vector3d mu_x = stats.sum_x / N;
+    const Eigen::Vector3d mu_y = stats.sum_y / N;
 
-    // build H:
-    Eigen::Matrix3f H = Eigen::Matrix3f::Zero();
-    for (size_t i = 0; i < N; ++i) {
-        H += (ys.at(i) - mu_y) * (xs.at(i) - mu_x).transpose();
-    }
+    // build H -- sum of (y - mu_y)(x - mu_x)^T in closed form:
+    const Eigen::Matrix3d H = stats.sum_yx - N * mu_y * mu_x.transpose();
 
     // solve R:
-    Eigen::JacobiSVD<Eigen::MatrixXf> svd(H, Eigen::ComputeThinU | Eigen::ComputeThinV);
-    Eigen::Matrix3f R = svd.matrixV() * svd.matrixU().transpose();
+    Eigen::JacobiSVD<Eigen::Matrix3d> svd(H, Eigen::ComputeFullU | Eigen::ComputeFullV);
+    const Eigen::Matrix3d R = svd.matrixV() * svd.matrixU().transpose();
 
     // solve t:
-    Eigen::Vector3f t = mu_x - R * mu_y;
+    const Eigen::Vector3d t = mu_x - R * mu_y;
 
     // set output:
     transformation_.setIdentity();
-    transformation_.block<3, 3>(0, 0) = R;
-    transformation_.block<3, 1>(0, 3) = t;
+    transformation_.block<3, 3>(0, 0) = R.cast<float>();
+    transformation_.block<3, 1>(0, 3) = t.cast<float>();
 }
 
 bool ICPSVDRegistration::IsSignificant(
@@ -214,4 +294,31 @@ bool ICPSVDRegistration::IsSignificant(
     );
 }
 
+void ICPSVDRegistration::CorrespondenceStats::Reset(void) {
+    sum_x.setZero();
+    sum_y.setZero();
+    sum_yx.setZero();
+    count = 0;
+}
+
+void ICPSVDRegistration::CorrespondenceStats::Add(
+    const Eigen::Vector3f &x, 
+    const Eigen::Vector3f &y
+) {
+    const Eigen::Vector3d x_d = x.cast<double>();
+    const Eigen::Vector3d y_d = y.cast<double>();
+
+    sum_x += x_d;
+    sum_y += y_d;
+    sum_yx.noalias() += y_d * x_d.transpose();
+    ++count;
+}
+
+void ICPSVDRegistration::CorrespondenceStats::Merge(const CorrespondenceStats &other) {
+    sum_x += other.sum_x;
+    sum_y += other.sum_y;
+    sum_yx += other.sum_yx;
+    count += other.count;
+}
+
 }
\ No newline at end of file
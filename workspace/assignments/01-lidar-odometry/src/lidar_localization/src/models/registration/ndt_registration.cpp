@@ -58,4 +58,12 @@ bool NDTRegistration::ScanMatch(const CloudData::CLOUD_PTR& input_source,
 
     return true;
 }
+
+float NDTRegistration::GetFitnessScore() {
+    return ndt_ptr_->getFitnessScore();
+}
+
+int NDTRegistration::GetNumIterations() {
+    return ndt_ptr_->getFinalNumIteration();
+}
 }
\ No newline at end of file
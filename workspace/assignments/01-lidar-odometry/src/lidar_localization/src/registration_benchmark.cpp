@@ -0,0 +1,419 @@
+/*
+ * @Description: benchmark of the point cloud registration backends on KITTI odometry scan pairs
+ * @Author: Ge Yao
+ * @Date: 2020-12-07 21:36:12
+ */
+#include <cmath>
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+
+#include <yaml-cpp/yaml.h>
+#include <Eigen/Dense>
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/models/cloud_filter/voxel_filter.hpp"
+#include "lidar_localization/models/registration/ndt_registration.hpp"
+#include "lidar_localization/models/registration/icp_registration.hpp"
+#include "lidar_localization/models/registration/icp_svd_registration.hpp"
+
+using namespace lidar_localization;
+
+struct ScanPair {
+    int target_index;
+    int source_index;
+    CloudData::CLOUD_PTR target_cloud_ptr;
+    CloudData::CLOUD_PTR source_cloud_ptr;
+    // source pose in target frame, lidar frame:
+    bool has_ground_truth;
+    Eigen::Matrix4f ground_truth;
+};
+
+struct MatchRecord {
+    std::string method;
+    int num_threads;
+    int pair_index;
+    int run;
+    double target_time;
+    double match_time;
+    int num_iterations;
+    float fitness_score;
+    double translation_error;
+    double rotation_error;
+};
+
+bool LoadCalibration(const std::string& calib_path, Eigen::Matrix4f& velo_to_cam) {
+    std::ifstream ifs(calib_path);
+    if (!ifs) {
+        LOG(ERROR) << "Cannot open calibration " << calib_path;
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(ifs, line)) {
+        std::istringstream iss(line);
+        std::string key;
+        iss >> key;
+        // the lidar extrinsic is Tr in KITTI odometry calib.txt:
+        if (key == "Tr:") {
+            velo_to_cam.setIdentity();
+            for (int i = 0; i < 12; ++i) {
+                iss >> velo_to_cam(i / 4, i % 4);
+            }
+            return true;
+        }
+    }
+
+    LOG(ERROR) << "No Tr found in calibration " << calib_path;
+    return false;
+}
+
+bool LoadPoses(const std::string& poses_path, std::vector<Eigen::Matrix4f>& poses) {
+    std::ifstream ifs(poses_path);
+    if (!ifs) {
+        LOG(ERROR) << "Cannot open ground truth " << poses_path;
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(ifs, line)) {
+        std::istringstream iss(line);
+        Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
+        for (int i = 0; i < 12; ++i) {
+            iss >> pose(i / 4, i % 4);
+        }
+        poses.push_back(pose);
+    }
+
+    return true;
+}
+
+bool LoadScan(const std::string& sequence_path, int index, CloudData::CLOUD_PTR& cloud_ptr) {
+    std::ostringstream oss;
+    oss << sequence_path << "/velodyne/" << std::setw(6) << std::setfill('0') << index << ".bin";
+
+    std::ifstream ifs(oss.str(), std::ios::binary);
+    if (!ifs) {
+        LOG(ERROR) << "Cannot open scan " << oss.str();
+        return false;
+    }
+
+    // x, y, z & reflectance as float:
+    ifs.seekg(0, std::ios::end);
+    const size_t N = static_cast<size_t>(ifs.tellg()) / (4 * sizeof(float));
+    ifs.seekg(0, std::ios::beg);
+
+    std::vector<float> buffer(4 * N);
+    ifs.read(reinterpret_cast<char*>(buffer.data()), buffer.size() * sizeof(float));
+
+    cloud_ptr.reset(new CloudData::CLOUD());
+    cloud_ptr->points.resize(N);
+    for (size_t i = 0; i < N; ++i) {
+        cloud_ptr->points[i] = CloudData::POINT(buffer[4 * i + 0], buffer[4 * i + 1], buffer[4 * i + 2]);
+    }
+    cloud_ptr->width = N;
+    cloud_ptr->height = 1;
+    cloud_ptr->is_dense = true;
+
+    return true;
+}
+
+bool LoadScanPairs(const YAML::Node& config_node, const YAML::Node& front_end_config_node, std::vector<ScanPair>& scan_pairs) {
+    const std::string sequence_path = config_node["sequence_path"].as<std::string>();
+    const std::string poses_path = config_node["poses_path"].as<std::string>();
+    const int start_index = config_node["start_index"].as<int>();
+    const int num_pairs = config_node["num_pairs"].as<int>();
+    const int pair_stride = config_node["pair_stride"].as<int>();
+    const int frame_gap = config_node["frame_gap"].as<int>();
+
+    // ground truth is camera pose, move it to lidar frame:
+    Eigen::Matrix4f velo_to_cam = Eigen::Matrix4f::Identity();
+    std::vector<Eigen::Matrix4f> poses;
+    bool has_ground_truth = !poses_path.empty() &&
+                            LoadCalibration(sequence_path + "/calib.txt", velo_to_cam) &&
+                            LoadPoses(poses_path, poses);
+    if (!has_ground_truth) {
+        LOG(WARNING) << "No ground truth, pose errors will not be evaluated.";
+    }
+
+    // same preprocessing as front end, target as local map and source as current frame:
+    VoxelFilter local_map_filter(front_end_config_node["voxel_filter"]["local_map"]);
+    VoxelFilter frame_filter(front_end_config_node["voxel_filter"]["frame"]);
+
+    for (int i = 0; i < num_pairs; ++i) {
+        ScanPair scan_pair;
+        scan_pair.target_index = start_index + i * pair_stride;
+        scan_pair.source_index = scan_pair.target_index + frame_gap;
+
+        CloudData::CLOUD_PTR target_cloud_ptr, source_cloud_ptr;
+        if (
+            !LoadScan(sequence_path, scan_pair.target_index, target_cloud_ptr) ||
+            !LoadScan(sequence_path, scan_pair.source_index, source_cloud_ptr)
+        ) {
+            break;
+        }
+
+        scan_pair.target_cloud_ptr.reset(new CloudData::CLOUD());
+        scan_pair.source_cloud_ptr.reset(new CloudData::CLOUD());
+        local_map_filter.Filter(target_cloud_ptr, scan_pair.target_cloud_ptr);
+        frame_filter.Filter(source_cloud_ptr, scan_pair.source_cloud_ptr);
+
+        scan_pair.has_ground_truth = has_ground_truth && (scan_pair.source_index < static_cast<int>(poses.size()));
+        if (scan_pair.has_ground_truth) {
+            scan_pair.ground_truth = velo_to_cam.inverse() *
+                                     poses.at(scan_pair.target_index).inverse() * poses.at(scan_pair.source_index) *
+                                     velo_to_cam;
+        }
+
+        scan_pairs.push_back(scan_pair);
+    }
+
+    LOG(INFO) << "Loaded " << scan_pairs.size() << " scan pairs from " << sequence_path;
+
+    return !scan_pairs.empty();
+}
+
+std::shared_ptr<RegistrationInterface> CreateRegistration(const std::string& registration_method, const YAML::Node& config_node) {
+    std::shared_ptr<RegistrationInterface> registration_ptr;
+
+    // same as FrontEnd::InitRegistration:
+    if (registration_method == "NDT") {
+        registration_ptr = std::make_shared<NDTRegistration>(config_node);
+    } else if (registration_method == "ICP") {
+        registration_ptr = std::make_shared<ICPRegistration>(config_node);
+    } else if (registration_method == "ICP_SVD") {
+        registration_ptr = std::make_shared<ICPSVDRegistration>(config_node);
+    } else {
+        LOG(ERROR) << "Point cloud registration method " << registration_method << " NOT FOUND!";
+    }
+
+    return registration_ptr;
+}
+
+double GetElapsedTime(const std::chrono::steady_clock::time_point& start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void RunBenchmark(
+    const std::string& registration_method, int num_threads,
+    const YAML::Node& registration_config_node,
+    const std::vector<ScanPair>& scan_pairs, int num_warmups, int num_runs,
+    std::vector<MatchRecord>& records
+) {
+    std::shared_ptr<RegistrationInterface> registration_ptr = CreateRegistration(registration_method, registration_config_node);
+    if (!registration_ptr) {
+        return;
+    }
+
+    CloudData::CLOUD_PTR result_cloud_ptr(new CloudData::CLOUD());
+    for (size_t i = 0; i < scan_pairs.size(); ++i) {
+        const ScanPair& scan_pair = scan_pairs.at(i);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        registration_ptr->SetInputTarget(scan_pair.target_cloud_ptr);
+        double target_time = GetElapsedTime(start);
+
+        for (int run = -num_warmups; run < num_runs; ++run) {
+            // front end starts from the identity as well:
+            Eigen::Matrix4f result_pose = Eigen::Matrix4f::Identity();
+
+            start = std::chrono::steady_clock::now();
+            registration_ptr->ScanMatch(scan_pair.source_cloud_ptr, Eigen::Matrix4f::Identity(), result_cloud_ptr, result_pose);
+            double match_time = GetElapsedTime(start);
+
+            if (run < 0) {
+                continue;
+            }
+
+            MatchRecord record;
+            record.method = registration_method;
+            record.num_threads = num_threads;
+            record.pair_index = static_cast<int>(i);
+            record.run = run;
+            record.target_time = target_time;
+            record.match_time = match_time;
+            record.num_iterations = registration_ptr->GetNumIterations();
+            record.fitness_score = registration_ptr->GetFitnessScore();
+            record.translation_error = record.rotation_error = -1.0;
+            if (scan_pair.has_ground_truth) {
+                Eigen::Matrix4f error = scan_pair.ground_truth.inverse() * result_pose;
+                record.translation_error = error.block<3, 1>(0, 3).norm();
+                double cos_angle = std::max(-1.0, std::min(1.0, (error.block<3, 3>(0, 0).trace() - 1.0) / 2.0));
+                record.rotation_error = std::acos(cos_angle) * 180.0 / M_PI;
+            }
+
+            records.push_back(record);
+        }
+    }
+}
+
+double GetPercentile(const std::vector<double>& sorted_values, double percentile) {
+    if (sorted_values.empty()) {
+        return 0.0;
+    }
+
+    // nearest rank:
+    size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0 * sorted_values.size()));
+    return sorted_values.at(std::min(std::max(rank, static_cast<size_t>(1)), sorted_values.size()) - 1);
+}
+
+double GetMean(const std::vector<double>& values) {
+    double sum = 0.0;
+    for (double value: values) {
+        sum += value;
+    }
+    return values.empty() ? 0.0 : sum / values.size();
+}
+
+bool SaveRecords(const std::string& csv_path, const std::vector<MatchRecord>& records) {
+    std::ofstream ofs(csv_path);
+    if (!ofs) {
+        LOG(ERROR) << "Cannot create " << csv_path;
+        return false;
+    }
+
+    ofs << "method,num_threads,pair_index,run,target_ms,match_ms,num_iterations,fitness_score,translation_error,rotation_error_deg" << std::endl;
+    ofs << std::setprecision(9);
+    for (const MatchRecord& record: records) {
+        ofs << record.method << "," << record.num_threads << "," << record.pair_index << "," << record.run << ","
+            << record.target_time << "," << record.match_time << ","
+            << record.num_iterations << "," << record.fitness_score << ","
+            << record.translation_error << "," << record.rotation_error << std::endl;
+    }
+
+    return true;
+}
+
+bool SaveSummary(const std::string& json_path, const std::vector<MatchRecord>& records) {
+    std::ofstream ofs(json_path);
+    if (!ofs) {
+        LOG(ERROR) << "Cannot create " << json_path;
+        return false;
+    }
+
+    // one entry per method & thread count, in benchmark order:
+    std::vector<std::pair<std::string, int>> configs;
+    for (const MatchRecord& record: records) {
+        std::pair<std::string, int> config(record.method, record.num_threads);
+        if (std::find(configs.begin(), configs.end(), config) == configs.end()) {
+            configs.push_back(config);
+        }
+    }
+
+    ofs << std::setprecision(9) << "[" << std::endl;
+    for (size_t i = 0; i < configs.size(); ++i) {
+        std::vector<double> match_times, target_times, num_iterations, fitness_scores, translation_errors, rotation_errors;
+        for (const MatchRecord& record: records) {
+            if (record.method != configs.at(i).first || record.num_threads != configs.at(i).second) {
+                continue;
+            }
+
+            match_times.push_back(record.match_time);
+            fitness_scores.push_back(record.fitness_score);
+            if (0 == record.run) {
+                target_times.push_back(record.target_time);
+            }
+            if (record.num_iterations >= 0) {
+                num_iterations.push_back(record.num_iterations);
+            }
+            if (record.translation_error >= 0.0) {
+                translation_errors.push_back(record.translation_error);
+                rotation_errors.push_back(record.rotation_error);
+            }
+        }
+        std::sort(match_times.begin(), match_times.end());
+        std::sort(translation_errors.begin(), translation_errors.end());
+        std::sort(rotation_errors.begin(), rotation_errors.end());
+
+        LOG(INFO) << configs.at(i).first << ", " << configs.at(i).second << " threads: "
+                  << "match p50 " << GetPercentile(match_times, 50.0) << " ms, "
+                  << "p99 " << GetPercentile(match_times, 99.0) << " ms, "
+                  << "translation error " << GetMean(translation_errors) << " m, "
+                  << "rotation error " << GetMean(rotation_errors) << " deg";
+
+        ofs << "  {" << std::endl
+            << "    \"method\": \"" << configs.at(i).first << "\"," << std::endl
+            << "    \"num_threads\": " << configs.at(i).second << "," << std::endl
+            << "    \"num_matches\": " << match_times.size() << "," << std::endl
+            << "    \"match_ms\": {"
+            << "\"mean\": " << GetMean(match_times) << ", "
+            << "\"p50\": " << GetPercentile(match_times, 50.0) << ", "
+            << "\"p90\": " << GetPercentile(match_times, 90.0) << ", "
+            << "\"p99\": " << GetPercentile(match_times, 99.0) << ", "
+            << "\"max\": " << GetPercentile(match_times, 100.0) << "}," << std::endl
+            << "    \"target_ms\": {\"mean\": " << GetMean(target_times) << "}," << std::endl
+            << "    \"num_iterations\": {\"mean\": " << (num_iterations.empty() ? -1.0 : GetMean(num_iterations)) << "}," << std::endl
+            << "    \"fitness_score\": {\"mean\": " << GetMean(fitness_scores) << "}," << std::endl
+            << "    \"translation_error\": {"
+            << "\"mean\": " << GetMean(translation_errors) << ", "
+            << "\"p90\": " << GetPercentile(translation_errors, 90.0) << ", "
+            << "\"max\": " << GetPercentile(translation_errors, 100.0) << "}," << std::endl
+            << "    \"rotation_error_deg\": {"
+            << "\"mean\": " << GetMean(rotation_errors) << ", "
+            << "\"p90\": " << GetPercentile(rotation_errors, 90.0) << ", "
+            << "\"max\": " << GetPercentile(rotation_errors, 100.0) << "}" << std::endl
+            << "  }" << (i + 1 < configs.size() ? "," : "") << std::endl;
+    }
+    ofs << "]" << std::endl;
+
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_log_dir = WORK_SPACE_PATH + "/Log";
+    FLAGS_alsologtostderr = 1;
+
+    std::string config_file_path = (argc > 1) ? argv[1] : WORK_SPACE_PATH + "/config/benchmark/registration_benchmark.yaml";
+    YAML::Node config_node = YAML::LoadFile(config_file_path);
+    YAML::Node front_end_config_node = YAML::LoadFile(WORK_SPACE_PATH + "/config/front_end/config.yaml");
+
+    std::vector<ScanPair> scan_pairs;
+    if (!LoadScanPairs(config_node, front_end_config_node, scan_pairs)) {
+        return 1;
+    }
+
+    const int num_warmups = config_node["num_warmups"].as<int>();
+    const int num_runs = config_node["num_runs"].as<int>();
+    const std::vector<std::string> registration_methods = config_node["registration_methods"].as<std::vector<std::string>>();
+    const std::vector<int> thread_counts = config_node["num_threads"].as<std::vector<int>>();
+
+    std::vector<MatchRecord> records;
+    for (const std::string& registration_method: registration_methods) {
+        YAML::Node registration_config_node = YAML::Clone(front_end_config_node[registration_method]);
+
+        // backends without num_threads are single-threaded and only run once:
+        if (!registration_config_node["num_threads"]) {
+            RunBenchmark(registration_method, 1, registration_config_node, scan_pairs, num_warmups, num_runs, records);
+            continue;
+        }
+
+        for (int num_threads: thread_counts) {
+            registration_config_node["num_threads"] = num_threads;
+            RunBenchmark(registration_method, num_threads, registration_config_node, scan_pairs, num_warmups, num_runs, records);
+        }
+    }
+
+    std::string output_path = config_node["output_path"].as<std::string>();
+    if (output_path == "./") {
+        output_path = WORK_SPACE_PATH;
+    }
+
+    if (
+        !SaveRecords(output_path + "/registration_benchmark.csv", records) ||
+        !SaveSummary(output_path + "/registration_benchmark.json", records)
+    ) {
+        return 1;
+    }
+
+    LOG(INFO) << "Benchmark results saved to " << output_path;
+
+    return 0;
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <pcl/point_cloud.h>
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+
+namespace loam {
+
+// Batched deskew of the points of a scan, header-only and shared by A-LOAM
+// (aloam_velodyne/deskew_table.h) and LINS (DeskewTable.h). The catkin
+// workspaces are independent, so the two copies must be kept identical.
+//
+// The motion over a scan is a constant velocity one: at the relative time s in
+// [0, 1] of a point, kept in the fractional part of its intensity, the pose is
+// slerp(I, q, s) and s * t. All these rotations share the axis k of q, so a
+// point p is moved to
+//
+//   p + sin(u * angle) * k x p + (1 - cos(u * angle)) * k x (k x p) + u * v
+//
+// with u = s for the start of the scan, and u = s - 1 and v = q^-1 * t for its
+// end. Instead of a slerp per point the two coefficients are sampled at
+// NUM_BINS + 1 times and blended linearly within each bin, which is exact for
+// the translation and off by about (angle / NUM_BINS)^2 / 8 for the rotation.
+// Points are transformed in blocks laid out as structures of arrays so that
+// the compiler vectorizes the transform.
+template <typename PointT>
+class DeskewTable {
+ public:
+  typedef pcl::PointCloud<PointT> PointCloud;
+
+  static const int NUM_BINS = 64;
+  static const int BLOCK_SIZE = 256;
+
+  // Points are deskewed to the start of the scan, or to its end
+  enum Target { START = 0, END = 1 };
+
+  // Motion from the start to the end of a scan of scanPeriod seconds
+  void setMotion(const Eigen::Quaterniond& q, const Eigen::Vector3d& t,
+                 double scanPeriod, Target target) {
+    const Eigen::AngleAxisd rotation(q.normalized());
+    timeScale_ = static_cast<float>(1.0 / scanPeriod);
+    timeOffset_ = (target == END) ? -1.0f : 0.0f;
+    setVector(axis_, rotation.axis());
+    const Eigen::Vector3d v = (target == END) ? q.conjugate() * t : t;
+    setVector(velocity_, v);
+    setVector(offset_, Eigen::Vector3d::Zero());
+
+    // the angle is at most pi, the rotation of slerp
+    const double angle = rotation.angle();
+    double sinPrev = 0.0, cosPrev = 0.0;
+    for (int k = 0; k <= NUM_BINS; k++) {
+      const double u = static_cast<double>(k) / NUM_BINS + timeOffset_;
+      const double sinCurr = std::sin(u * angle);
+      const double cosCurr = 1.0 - std::cos(u * angle);
+      if (k > 0) {
+        sin_[k - 1] = static_cast<float>(sinPrev);
+        sinSlope_[k - 1] = static_cast<float>(sinCurr - sinPrev);
+        cos_[k - 1] = static_cast<float>(cosPrev);
+        cosSlope_[k - 1] = static_cast<float>(cosCurr - cosPrev);
+      }
+      sinPrev = sinCurr;
+      cosPrev = cosCurr;
+    }
+  }
+
+  // Same pose for every point, whatever its time
+  void setTransform(const Eigen::Quaterniond& q, const Eigen::Vector3d& t) {
+    const Eigen::AngleAxisd rotation(q.normalized());
+    timeScale_ = 1.0f;
+    timeOffset_ = 0.0f;
+    setVector(axis_, rotation.axis());
+    setVector(velocity_, Eigen::Vector3d::Zero());
+    setVector(offset_, t);
+
+    std::fill(sin_, sin_ + NUM_BINS,
+              static_cast<float>(std::sin(rotation.angle())));
+    std::fill(cos_, cos_ + NUM_BINS,
+              static_cast<float>(1.0 - std::cos(rotation.angle())));
+    std::fill(sinSlope_, sinSlope_ + NUM_BINS, 0.0f);
+    std::fill(cosSlope_, cosSlope_ + NUM_BINS, 0.0f);
+  }
+
+  // Deskews in into out, which may be the same cloud. With stripTime the
+  // relative times are dropped from the intensity of the output points
+  void apply(const PointCloud& in, PointCloud& out,
+             bool stripTime = false) const {
+    const int size = static_cast<int>(in.points.size());
+    if (&in != &out) {
+      out.header = in.header;
+      out.points.resize(size);
+      out.width = in.width;
+      out.height = in.height;
+      out.is_dense = in.is_dense;
+    }
+
+    const int numBlocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+#pragma omp parallel for schedule(static) if (numBlocks > 4)
+    for (int b = 0; b < numBlocks; b++) {
+      const int begin = b * BLOCK_SIZE;
+      const int n = std::min(BLOCK_SIZE, size - begin);
+      applyBlock(&in.points[begin], &out.points[begin], n, stripTime);
+    }
+  }
+
+ private:
+  static void setVector(float* dst, const Eigen::Vector3d& src) {
+    for (int i = 0; i < 3; i++) dst[i] = static_cast<float>(src(i));
+  }
+
+  void applyBlock(const PointT* in, PointT* out, int n, bool stripTime) const {
+    alignas(32) float x[BLOCK_SIZE], y[BLOCK_SIZE], z[BLOCK_SIZE];
+    alignas(32) float intensity[BLOCK_SIZE];
+
+    const float kx = axis_[0], ky = axis_[1], kz = axis_[2];
+    const float vx = velocity_[0], vy = velocity_[1], vz = velocity_[2];
+    const float cx = offset_[0], cy = offset_[1], cz = offset_[2];
+    const float strip = stripTime ? 1.0f : 0.0f;
+
+    // a. structure of arrays
+    for (int i = 0; i < n; i++) {
+      x[i] = in[i].x;
+      y[i] = in[i].y;
+      z[i] = in[i].z;
+      intensity[i] = in[i].intensity;
+    }
+
+    // b. coefficients of the bin of each point and transform
+#pragma omp simd
+    for (int i = 0; i < n; i++) {
+      const float time = intensity[i] - static_cast<int>(intensity[i]);
+      const float s = time * timeScale_;
+      const float w = s * NUM_BINS;
+      const int k = std::min(std::max(static_cast<int>(w), 0), NUM_BINS - 1);
+      // past the last sample the motion is extrapolated
+      const float f = w - k;
+      const float a = sin_[k] + f * sinSlope_[k];
+      const float c = cos_[k] + f * cosSlope_[k];
+      const float u = s + timeOffset_;
+
+      const float px = x[i], py = y[i], pz = z[i];
+      // k x p, then k x (k x p)
+      const float ax = ky * pz - kz * py;
+      const float ay = kz * px - kx * pz;
+      const float az = kx * py - ky * px;
+      const float bx = ky * az - kz * ay;
+      const float by = kz * ax - kx * az;
+      const float bz = kx * ay - ky * ax;
+
+      x[i] = px + a * ax + c * bx + u * vx + cx;
+      y[i] = py + a * ay + c * by + u * vy + cy;
+      z[i] = pz + a * az + c * bz + u * vz + cz;
+      intensity[i] -= strip * time;
+    }
+
+    for (int i = 0; i < n; i++) {
+      out[i].x = x[i];
+      out[i].y = y[i];
+      out[i].z = z[i];
+      out[i].intensity = intensity[i];
+    }
+  }
+
+ private:
+  float timeScale_ = 1.0f;
+  float timeOffset_ = 0.0f;
+  float axis_[3] = {1.0f, 0.0f, 0.0f};
+  float velocity_[3] = {0.0f, 0.0f, 0.0f};
+  float offset_[3] = {0.0f, 0.0f, 0.0f};
+  // sin and 1 - cos of the rotation at the start of each bin, and their change
+  // over the bin
+  float sin_[NUM_BINS];
+  float sinSlope_[NUM_BINS];
+  float cos_[NUM_BINS];
+  float cosSlope_[NUM_BINS];
+};
+
+template <typename PointT>
+const int DeskewTable<PointT>::NUM_BINS;
+template <typename PointT>
+const int DeskewTable<PointT>::BLOCK_SIZE;
+
+}  // namespace loam
@@ -0,0 +1,233 @@
+// Single-process pipeline of scanRegistration, laserOdometry and laserMapping.
+// Each stage runs in its own thread and hands frames to the next one through a bounded queue.
+
+#pragma once
+
+#include <cstdio>
+#include <cstddef>
+#include <string>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+
+#include <ros/ros.h>
+#include <nav_msgs/Odometry.h>
+#include <sensor_msgs/PointCloud2.h>
+
+// what push does when the queue is full:
+enum class QueuePolicy
+{
+    BLOCK,          // wait for the consumer, back-pressure on the producer
+    DROP_OLDEST,    // make room by dropping the oldest frame, stay real time
+    DROP_NEWEST     // drop the frame being pushed
+};
+
+inline bool stringToQueuePolicy(const std::string &name, QueuePolicy &policy)
+{
+    if (name == "block")
+        policy = QueuePolicy::BLOCK;
+    else if (name == "drop_oldest")
+        policy = QueuePolicy::DROP_OLDEST;
+    else if (name == "drop_newest")
+        policy = QueuePolicy::DROP_NEWEST;
+    else
+        return false;
+    return true;
+}
+
+// bounded queue between exactly one producer and one consumer stage
+template <typename T>
+class BoundedQueue
+{
+  public:
+    BoundedQueue(size_t capacity, QueuePolicy policy)
+        : capacity(std::max<size_t>(capacity, 1)), policy(policy), dropped(0), closed(false)
+    {
+    }
+
+    // returns false if the frame was dropped or the queue is closed
+    bool push(const T &item)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        if (policy == QueuePolicy::BLOCK)
+        {
+            notFull.wait(lock, [this] { return closed || items.size() < capacity; });
+        }
+        else if (items.size() >= capacity)
+        {
+            dropped++;
+            if (policy == QueuePolicy::DROP_NEWEST)
+                return false;
+            items.pop_front();
+        }
+        if (closed)
+            return false;
+
+        items.push_back(item);
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // waits for the next frame, returns false once the queue is closed and empty
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty())
+            return false;
+
+        item = items.front();
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    // wakes up both sides, used on shutdown
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        closed = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+    size_t size()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return items.size();
+    }
+
+    size_t droppedNum()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return dropped;
+    }
+
+  private:
+    const size_t capacity;
+    const QueuePolicy policy;
+
+    std::mutex mtx;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::deque<T> items;
+    size_t dropped;
+    bool closed;
+};
+
+// latency histogram with power of two buckets from 0.25ms to 1s.
+// not thread-safe, each stage owns its own.
+class LatencyHistogram
+{
+  public:
+    LatencyHistogram() : buckets(BUCKET_NUM, 0), count(0), sum(0), max(0)
+    {
+    }
+
+    void add(double ms)
+    {
+        size_t i = 0;
+        while (i + 1 < BUCKET_NUM && ms > bucketBound(i))
+            i++;
+        buckets[i]++;
+        count++;
+        sum += ms;
+        max = std::max(max, ms);
+    }
+
+    // upper bound of the bucket holding the given percentile
+    double percentile(double p) const
+    {
+        if (count == 0)
+            return 0;
+        size_t target = std::max<size_t>(1, size_t(p / 100.0 * count + 0.5));
+        size_t seen = 0;
+        for (size_t i = 0; i < BUCKET_NUM; i++)
+        {
+            seen += buckets[i];
+            if (seen >= target)
+                return std::min(bucketBound(i), max);
+        }
+        return max;
+    }
+
+    void print(const char *name) const
+    {
+        printf("%s: frames %zu mean %.2f p50 <%.2f p90 <%.2f p99 <%.2f max %.2f ms\n",
+               name, count, count ? sum / count : 0.0, percentile(50), percentile(90), percentile(99), max);
+    }
+
+    void clear()
+    {
+        std::fill(buckets.begin(), buckets.end(), 0);
+        count = 0;
+        sum = 0;
+        max = 0;
+    }
+
+  private:
+    static const size_t BUCKET_NUM = 14;
+
+    static double bucketBound(size_t i)
+    {
+        return 0.25 * double(size_t(1) << i);
+    }
+
+    std::vector<size_t> buckets;
+    size_t count;
+    double sum;
+    double max;
+};
+
+// features of one scan, scanRegistration -> laserOdometry
+struct ScanFrame
+{
+    sensor_msgs::PointCloud2ConstPtr fullRes;
+    sensor_msgs::PointCloud2ConstPtr cornerSharp;
+    sensor_msgs::PointCloud2ConstPtr cornerLessSharp;
+    sensor_msgs::PointCloud2ConstPtr surfFlat;
+    sensor_msgs::PointCloud2ConstPtr surfLessFlat;
+    double pushTime;
+};
+
+// odometry of every scan, laserOdometry -> laserMapping.
+// the clouds are only set on the frames sent to the mapping, see mapping_skip_frame.
+struct OdometryFrame
+{
+    nav_msgs::Odometry::ConstPtr odometry;
+    sensor_msgs::PointCloud2ConstPtr cornerLast;
+    sensor_msgs::PointCloud2ConstPtr surfLast;
+    sensor_msgs::PointCloud2ConstPtr fullRes;
+    double pushTime;
+};
+
+// stage entry points, the standalone nodes call the same functions from their main().
+// setup reads the parameters and advertises the outputs, it does not subscribe.
+namespace scan_registration
+{
+bool setup(ros::NodeHandle &nh);
+void laserCloudHandler(const sensor_msgs::PointCloud2ConstPtr &laserCloudMsg);
+// called with the features of every scan, if set
+extern std::function<void(const ScanFrame &)> scanFrameSink;
+}
+
+namespace laser_odometry
+{
+bool setup(ros::NodeHandle &nh);
+void pushScanFrame(const ScanFrame &frame);
+// processes the buffered frame if a complete one is there
+void odometryStep();
+extern std::function<void(const OdometryFrame &)> odometryFrameSink;
+}
+
+namespace laser_mapping
+{
+bool setup(ros::NodeHandle &nh);
+void laserOdometryHandler(const nav_msgs::Odometry::ConstPtr &laserOdometry);
+void pushOdometryFrame(const OdometryFrame &frame);
+// processes all buffered frames
+void mappingStep();
+}
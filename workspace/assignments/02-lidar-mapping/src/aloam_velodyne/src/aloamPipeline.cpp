@@ -0,0 +1,190 @@
+// Runs scanRegistration, laserOdometry and laserMapping in one process, one thread per stage.
+// Frames are handed over through bounded queues, the topics are still published for rviz.
+//
+// queue policies, see pipeline_*_queue_policy:
+//   input:   /velodyne_points -> scanRegistration, drop_oldest keeps the latency bounded
+//   feature: scanRegistration -> laserOdometry, block since scan-to-scan odometry needs every frame
+//   mapping: laserOdometry -> laserMapping, drop_oldest like the frame dropping of the mapping node
+
+#include <cstdio>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include "aloam_velodyne/tic_toc.h"
+#include "aloam_velodyne/pipeline.h"
+
+struct InputFrame
+{
+    sensor_msgs::PointCloud2ConstPtr laserCloud;
+    double pushTime;
+};
+
+std::unique_ptr<BoundedQueue<InputFrame>> inputQueue;
+std::unique_ptr<BoundedQueue<ScanFrame>> featureQueue;
+std::unique_ptr<BoundedQueue<OdometryFrame>> mappingQueue;
+
+int reportFrames = 100;
+
+double nowMs()
+{
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// queue wait and processing time of one stage, printed every reportFrames frames
+struct StageStats
+{
+    explicit StageStats(const std::string &name) : name(name), frames(0)
+    {
+    }
+
+    void add(double waitMs, double processMs, size_t queueSize, size_t droppedNum)
+    {
+        wait.add(waitMs);
+        process.add(processMs);
+        if (++frames < reportFrames)
+            return;
+
+        printf("pipeline %s: queue size %zu, dropped %zu \n", name.c_str(), queueSize, droppedNum);
+        wait.print(("  " + name + " queue wait").c_str());
+        process.print(("  " + name + " process").c_str());
+        wait.clear();
+        process.clear();
+        frames = 0;
+    }
+
+    std::string name;
+    LatencyHistogram wait;
+    LatencyHistogram process;
+    int frames;
+};
+
+bool readQueueParams(ros::NodeHandle &nh, const std::string &name, int defaultSize,
+                     const std::string &defaultPolicy, size_t &size, QueuePolicy &policy)
+{
+    int queueSize;
+    std::string policyName;
+    nh.param<int>("pipeline_" + name + "_queue_size", queueSize, defaultSize);
+    nh.param<std::string>("pipeline_" + name + "_queue_policy", policyName, defaultPolicy);
+    if (!stringToQueuePolicy(policyName, policy))
+    {
+        printf("unknown policy %s of the %s queue, use block, drop_oldest or drop_newest \n", policyName.c_str(), name.c_str());
+        return false;
+    }
+    size = std::max(queueSize, 1);
+    printf("%s queue size %zu policy %s \n", name.c_str(), size, policyName.c_str());
+    return true;
+}
+
+void laserCloudHandler(const sensor_msgs::PointCloud2ConstPtr &laserCloudMsg)
+{
+    InputFrame frame;
+    frame.laserCloud = laserCloudMsg;
+    frame.pushTime = nowMs();
+    inputQueue->push(frame);
+}
+
+void scanRegistrationThread()
+{
+    StageStats stats("scanRegistration");
+    InputFrame frame;
+    while (inputQueue->pop(frame))
+    {
+        double waitMs = nowMs() - frame.pushTime;
+        TicToc t_stage;
+        scan_registration::laserCloudHandler(frame.laserCloud);
+        stats.add(waitMs, t_stage.toc(), inputQueue->size(), inputQueue->droppedNum());
+    }
+}
+
+void laserOdometryThread()
+{
+    StageStats stats("laserOdometry");
+    ScanFrame frame;
+    while (featureQueue->pop(frame))
+    {
+        double waitMs = nowMs() - frame.pushTime;
+        TicToc t_stage;
+        laser_odometry::pushScanFrame(frame);
+        laser_odometry::odometryStep();
+        stats.add(waitMs, t_stage.toc(), featureQueue->size(), featureQueue->droppedNum());
+    }
+}
+
+void laserMappingThread()
+{
+    StageStats stats("laserMapping");
+    OdometryFrame frame;
+    while (mappingQueue->pop(frame))
+    {
+        double waitMs = nowMs() - frame.pushTime;
+        TicToc t_stage;
+        laser_mapping::pushOdometryFrame(frame);
+        laser_mapping::mappingStep();
+        stats.add(waitMs, t_stage.toc(), mappingQueue->size(), mappingQueue->droppedNum());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    ros::init(argc, argv, "aloamPipeline");
+    ros::NodeHandle nh;
+
+    if (!scan_registration::setup(nh) || !laser_odometry::setup(nh) || !laser_mapping::setup(nh))
+        return 0;
+
+    size_t inputQueueSize, featureQueueSize, mappingQueueSize;
+    QueuePolicy inputPolicy, featurePolicy, mappingPolicy;
+    if (!readQueueParams(nh, "input", 2, "drop_oldest", inputQueueSize, inputPolicy) ||
+        !readQueueParams(nh, "feature", 4, "block", featureQueueSize, featurePolicy) ||
+        !readQueueParams(nh, "mapping", 1, "drop_oldest", mappingQueueSize, mappingPolicy))
+        return 0;
+    nh.param<int>("pipeline_report_frames", reportFrames, 100);
+    reportFrames = std::max(reportFrames, 1);
+
+    inputQueue.reset(new BoundedQueue<InputFrame>(inputQueueSize, inputPolicy));
+    featureQueue.reset(new BoundedQueue<ScanFrame>(featureQueueSize, featurePolicy));
+    mappingQueue.reset(new BoundedQueue<OdometryFrame>(mappingQueueSize, mappingPolicy));
+
+    scan_registration::scanFrameSink = [](const ScanFrame &scanFrame)
+    {
+        ScanFrame frame = scanFrame;
+        frame.pushTime = nowMs();
+        featureQueue->push(frame);
+    };
+
+    // the high frequency odometry output of the mapping is updated on every frame,
+    // only the clouds wait for the mapping thread
+    laser_odometry::odometryFrameSink = [](const OdometryFrame &odometryFrame)
+    {
+        laser_mapping::laserOdometryHandler(odometryFrame.odometry);
+        if (!odometryFrame.cornerLast)
+            return;
+
+        OdometryFrame frame = odometryFrame;
+        frame.pushTime = nowMs();
+        mappingQueue->push(frame);
+    };
+
+    ros::Subscriber subLaserCloud = nh.subscribe<sensor_msgs::PointCloud2>("/velodyne_points", 100, laserCloudHandler);
+
+    std::thread scanRegistrationProcess{scanRegistrationThread};
+    std::thread laserOdometryProcess{laserOdometryThread};
+    std::thread laserMappingProcess{laserMappingThread};
+
+    ros::spin();
+
+    inputQueue->close();
+    featureQueue->close();
+    mappingQueue->close();
+    scanRegistrationProcess.join();
+    laserOdometryProcess.join();
+    laserMappingProcess.join();
+
+    return 0;
+}
@@ -3,9 +3,20 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <iomanip>
 #include <iterator>
 #include <string>
 #include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <opencv2/opencv.hpp>
 #include <image_transport/image_transport.h>
 #include <opencv2/highgui/highgui.hpp>
@@ -16,24 +27,182 @@
 #include <geometry_msgs/PoseStamped.h>
 #include <cv_bridge/cv_bridge.h>
 #include <sensor_msgs/image_encodings.h>
+#include <sensor_msgs/PointField.h>
 #include <eigen3/Eigen/Dense>
-#include <pcl/point_cloud.h>
-#include <pcl/point_types.h>
-#include <pcl_conversions/pcl_conversions.h>
 #include <sensor_msgs/PointCloud2.h>
 
-std::vector<float> read_lidar_data(const std::string lidar_data_path)
+// a KITTI scan is a packed array of x, y, z, intensity floats, it is mapped and copied as is into the
+// data of the message, whose fields describe that layout
+bool read_lidar_data(const std::string &lidar_data_path, sensor_msgs::PointCloud2 &laser_cloud_msg)
 {
-    std::ifstream lidar_data_file(lidar_data_path, std::ifstream::in | std::ifstream::binary);
-    lidar_data_file.seekg(0, std::ios::end);
-    const size_t num_elements = lidar_data_file.tellg() / sizeof(float);
-    lidar_data_file.seekg(0, std::ios::beg);
-
-    std::vector<float> lidar_data_buffer(num_elements);
-    lidar_data_file.read(reinterpret_cast<char*>(&lidar_data_buffer[0]), num_elements*sizeof(float));
-    return lidar_data_buffer;
+    const int fd = open(lidar_data_path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    const size_t num_points = file_stat.st_size / (4 * sizeof(float));
+    const size_t num_bytes = num_points * 4 * sizeof(float);
+
+    void *data = MAP_FAILED;
+    if (num_bytes > 0)
+    {
+        data = mmap(NULL, num_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            return false;
+        }
+        madvise(data, num_bytes, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    const char *field_names[4] = {"x", "y", "z", "intensity"};
+    laser_cloud_msg.fields.resize(4);
+    for (int i = 0; i < 4; ++i)
+    {
+        laser_cloud_msg.fields[i].name = field_names[i];
+        laser_cloud_msg.fields[i].offset = i * sizeof(float);
+        laser_cloud_msg.fields[i].datatype = sensor_msgs::PointField::FLOAT32;
+        laser_cloud_msg.fields[i].count = 1;
+    }
+    laser_cloud_msg.height = 1;
+    laser_cloud_msg.width = num_points;
+    laser_cloud_msg.is_bigendian = false;
+    laser_cloud_msg.point_step = 4 * sizeof(float);
+    laser_cloud_msg.row_step = num_bytes;
+    laser_cloud_msg.is_dense = true;
+    laser_cloud_msg.data.resize(num_bytes);
+    if (num_bytes > 0)
+    {
+        std::memcpy(&laser_cloud_msg.data[0], data, num_bytes);
+        munmap(data, num_bytes);
+    }
+    return true;
 }
 
+// sensor data of one frame, as read by the prefetcher
+struct KittiFrame
+{
+    sensor_msgs::PointCloud2 laser_cloud_msg;
+    cv::Mat left_image;
+    cv::Mat right_image;
+    bool has_laser_cloud = false;
+};
+
+// frames are read ahead by a pool of threads, at most lookahead frames past the one being played,
+// so that decoding of the images and reading of the scans overlap with the publishing
+class KittiPrefetcher
+{
+  public:
+    KittiPrefetcher(const std::string &dataset_folder, const std::string &sequence_number, size_t num_frames,
+                    bool skip_images, int num_threads, int lookahead)
+        : dataset_folder(dataset_folder), sequence_number(sequence_number), num_frames(num_frames),
+          skip_images(skip_images), slots(std::max(lookahead, 1)), next_to_read(0), next_to_play(0), stop(false)
+    {
+        for (int i = 0; i < std::max(num_threads, 1); ++i)
+            workers.emplace_back(&KittiPrefetcher::run, this);
+    }
+
+    ~KittiPrefetcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stop = true;
+        }
+        cond.notify_all();
+        for (size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+    }
+
+    // waits for frame index, frames must be taken in order
+    void get(size_t index, KittiFrame &frame)
+    {
+        Slot &slot = slots[index % slots.size()];
+
+        std::unique_lock<std::mutex> lock(mtx);
+        cond.wait(lock, [&slot, index] { return slot.index == index && slot.ready; });
+        std::swap(frame, slot.frame);
+        slot.ready = false;
+        next_to_play = index + 1;
+        lock.unlock();
+        cond.notify_all();
+    }
+
+  private:
+    struct Slot
+    {
+        size_t index = static_cast<size_t>(-1);
+        bool ready = false;
+        KittiFrame frame;
+    };
+
+    void run()
+    {
+        while (true)
+        {
+            size_t index;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cond.wait(lock, [this] {
+                    return stop || (next_to_read < num_frames && next_to_read < next_to_play + slots.size());
+                });
+                if (stop)
+                    return;
+                index = next_to_read++;
+            }
+
+            KittiFrame frame;
+            read(index, frame);
+
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                Slot &slot = slots[index % slots.size()];
+                std::swap(slot.frame, frame);
+                slot.index = index;
+                slot.ready = true;
+            }
+            cond.notify_all();
+        }
+    }
+
+    void read(size_t index, KittiFrame &frame) const
+    {
+        if (!skip_images)
+        {
+            std::stringstream left_image_path, right_image_path;
+            left_image_path << dataset_folder << "sequences/" + sequence_number + "/image_0/" << std::setfill('0') << std::setw(6) << index << ".png";
+            frame.left_image = cv::imread(left_image_path.str(), CV_LOAD_IMAGE_GRAYSCALE);
+            right_image_path << dataset_folder << "sequences/" + sequence_number + "/image_1/" << std::setfill('0') << std::setw(6) << index << ".png";
+            frame.right_image = cv::imread(right_image_path.str(), CV_LOAD_IMAGE_GRAYSCALE);
+        }
+
+        // read lidar point cloud
+        std::stringstream lidar_data_path;
+        lidar_data_path << dataset_folder << "velodyne/sequences/" + sequence_number + "/velodyne/"
+                        << std::setfill('0') << std::setw(6) << index << ".bin";
+        frame.has_laser_cloud = read_lidar_data(lidar_data_path.str(), frame.laser_cloud_msg);
+    }
+
+  private:
+    const std::string dataset_folder;
+    const std::string sequence_number;
+    const size_t num_frames;
+    const bool skip_images;
+
+    std::mutex mtx;
+    std::condition_variable cond;
+    std::vector<Slot> slots;
+    size_t next_to_read;
+    size_t next_to_play;
+    bool stop;
+    std::vector<std::thread> workers;
+};
+
 int main(int argc, char** argv)
 {
     ros::init(argc, argv, "kitti_helper");
@@ -50,6 +219,15 @@ int main(int argc, char** argv)
     n.getParam("publish_delay", publish_delay);
     publish_delay = publish_delay <= 0 ? 1 : publish_delay;
 
+    // bag_only writes the bag as fast as the frames are read, without publishing
+    bool bag_only, skip_images;
+    int reader_threads, reader_lookahead;
+    n.param<bool>("bag_only", bag_only, false);
+    n.param<bool>("skip_images", skip_images, false);
+    n.param<int>("reader_threads", reader_threads, 4);
+    n.param<int>("reader_lookahead", reader_lookahead, 16);
+    bag_only = bag_only && to_bag;
+
     ros::Publisher pub_laser_cloud = n.advertise<sensor_msgs::PointCloud2>("/velodyne_points", 2);
 
     image_transport::ImageTransport it(n);
@@ -71,26 +249,33 @@ int main(int argc, char** argv)
     std::string ground_truth_path = "results/" + sequence_number + ".txt";
     std::ifstream ground_truth_file(dataset_folder + ground_truth_path, std::ifstream::in);
 
+    // the time stamps tell the number of frames to read ahead
+    std::vector<std::string> timestamp_lines;
+    std::string line;
+    while (std::getline(timestamp_file, line))
+        timestamp_lines.push_back(line);
+
     rosbag::Bag bag_out;
     if (to_bag)
         bag_out.open(output_bag_file, rosbag::bagmode::Write);
-    
+    // without real-time playback the bag is written at the time stamps of the data
+    const ros::Time bag_start_time = ros::Time::now();
+
     Eigen::Matrix3d R_transform;
     R_transform << 0, 0, 1, -1, 0, 0, 0, -1, 0;
     Eigen::Quaterniond q_transform(R_transform);
 
-    std::string line;
+    KittiPrefetcher prefetcher(dataset_folder, sequence_number, timestamp_lines.size(),
+                               skip_images, reader_threads, reader_lookahead);
+    KittiFrame frame;
+
     std::size_t line_num = 0;
 
     ros::Rate r(10.0 / publish_delay);
-    while (std::getline(timestamp_file, line) && ros::ok())
+    while (line_num < timestamp_lines.size() && ros::ok())
     {
-        float timestamp = stof(line);
-        std::stringstream left_image_path, right_image_path;
-        left_image_path << dataset_folder << "sequences/" + sequence_number + "/image_0/" << std::setfill('0') << std::setw(6) << line_num << ".png";
-        cv::Mat left_image = cv::imread(left_image_path.str(), CV_LOAD_IMAGE_GRAYSCALE);
-        right_image_path << dataset_folder << "sequences/" + sequence_number + "/image_1/" << std::setfill('0') << std::setw(6) << line_num << ".png";
-        cv::Mat right_image = cv::imread(left_image_path.str(), CV_LOAD_IMAGE_GRAYSCALE);
+        float timestamp = stof(timestamp_lines[line_num]);
+        prefetcher.get(line_num, frame);
 
         std::getline(ground_truth_file, line);
         std::stringstream pose_stream(line);
@@ -118,64 +303,61 @@ int main(int argc, char** argv)
         odomGT.pose.pose.position.x = t(0);
         odomGT.pose.pose.position.y = t(1);
         odomGT.pose.pose.position.z = t(2);
-        pubOdomGT.publish(odomGT);
 
         geometry_msgs::PoseStamped poseGT;
         poseGT.header = odomGT.header;
         poseGT.pose = odomGT.pose.pose;
         pathGT.header.stamp = odomGT.header.stamp;
         pathGT.poses.push_back(poseGT);
-        pubPathGT.publish(pathGT);
 
-        // read lidar point cloud
-        std::stringstream lidar_data_path;
-        lidar_data_path << dataset_folder << "velodyne/sequences/" + sequence_number + "/velodyne/" 
-                        << std::setfill('0') << std::setw(6) << line_num << ".bin";
-        std::vector<float> lidar_data = read_lidar_data(lidar_data_path.str());
-        std::cout << "totally " << lidar_data.size() / 4.0 << " points in this lidar frame \n";
-
-        std::vector<Eigen::Vector3d> lidar_points;
-        std::vector<float> lidar_intensities;
-        pcl::PointCloud<pcl::PointXYZI> laser_cloud;
-        for (std::size_t i = 0; i < lidar_data.size(); i += 4)
-        {
-            lidar_points.emplace_back(lidar_data[i], lidar_data[i+1], lidar_data[i+2]);
-            lidar_intensities.push_back(lidar_data[i+3]);
-
-            pcl::PointXYZI point;
-            point.x = lidar_data[i];
-            point.y = lidar_data[i + 1];
-            point.z = lidar_data[i + 2];
-            point.intensity = lidar_data[i + 3];
-            laser_cloud.push_back(point);
-        }
+        if (!frame.has_laser_cloud)
+            ROS_WARN("no lidar data in frame %zu", line_num);
+        else
+            std::cout << "totally " << frame.laser_cloud_msg.width << " points in this lidar frame \n";
 
-        sensor_msgs::PointCloud2 laser_cloud_msg;
-        pcl::toROSMsg(laser_cloud, laser_cloud_msg);
+        sensor_msgs::PointCloud2 &laser_cloud_msg = frame.laser_cloud_msg;
         laser_cloud_msg.header.stamp = ros::Time().fromSec(timestamp);
         laser_cloud_msg.header.frame_id = "/camera_init";
-        pub_laser_cloud.publish(laser_cloud_msg);
 
-        sensor_msgs::ImagePtr image_left_msg = cv_bridge::CvImage(laser_cloud_msg.header, "mono8", left_image).toImageMsg();
-        sensor_msgs::ImagePtr image_right_msg = cv_bridge::CvImage(laser_cloud_msg.header, "mono8", right_image).toImageMsg();
-        pub_image_left.publish(image_left_msg);
-        pub_image_right.publish(image_right_msg);
+        sensor_msgs::ImagePtr image_left_msg, image_right_msg;
+        if (!skip_images)
+        {
+            image_left_msg = cv_bridge::CvImage(laser_cloud_msg.header, "mono8", frame.left_image).toImageMsg();
+            image_right_msg = cv_bridge::CvImage(laser_cloud_msg.header, "mono8", frame.right_image).toImageMsg();
+        }
+
+        if (!bag_only)
+        {
+            pubOdomGT.publish(odomGT);
+            pubPathGT.publish(pathGT);
+            pub_laser_cloud.publish(laser_cloud_msg);
+            if (!skip_images)
+            {
+                pub_image_left.publish(image_left_msg);
+                pub_image_right.publish(image_right_msg);
+            }
+        }
 
         if (to_bag)
         {
-            bag_out.write("/image_left", ros::Time::now(), image_left_msg);
-            bag_out.write("/image_right", ros::Time::now(), image_right_msg);
-            bag_out.write("/velodyne_points", ros::Time::now(), laser_cloud_msg);
-            bag_out.write("/path_gt", ros::Time::now(), pathGT);
-            bag_out.write("/odometry_gt", ros::Time::now(), odomGT);
+            const ros::Time bag_time = bag_only ? bag_start_time + ros::Duration(timestamp) : ros::Time::now();
+            if (!skip_images)
+            {
+                bag_out.write("/image_left", bag_time, image_left_msg);
+                bag_out.write("/image_right", bag_time, image_right_msg);
+            }
+            bag_out.write("/velodyne_points", bag_time, laser_cloud_msg);
+            bag_out.write("/path_gt", bag_time, pathGT);
+            bag_out.write("/odometry_gt", bag_time, odomGT);
         }
 
         line_num ++;
-        r.sleep();
+        if (!bag_only)
+            r.sleep();
     }
     bag_out.close();
     std::cout << "Done \n";
 
 
     return 0;
-}
\ No newline at end of file
+}
@@ -44,7 +44,6 @@
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 #include <pcl/filters/voxel_grid.h>
-#include <pcl/kdtree/kdtree_flann.h>
 #include <ros/ros.h>
 #include <sensor_msgs/Imu.h>
 #include <sensor_msgs/PointCloud2.h>
@@ -57,11 +56,16 @@
 #include <thread>
 #include <iostream>
 #include <string>
+#include <memory>
 
 #include "lidarFactor.hpp"
+#include "voxelMap.hpp"
 #include "aloam_velodyne/common.h"
 #include "aloam_velodyne/tic_toc.h"
+#include "aloam_velodyne/pipeline.h"
 
+namespace laser_mapping
+{
 
 int frameCount = 0;
 
@@ -71,19 +75,16 @@ double timeLaserCloudFullRes = 0;
 double timeLaserOdometry = 0;
 
 
-int laserCloudCenWidth = 10;
-int laserCloudCenHeight = 10;
-int laserCloudCenDepth = 5;
-const int laserCloudWidth = 21;
-const int laserCloudHeight = 21;
-const int laserCloudDepth = 11;
-
-
-const int laserCloudNum = laserCloudWidth * laserCloudHeight * laserCloudDepth; //4851
-
+// the map keeps the same extent around the current position as the old 21x21x11 cubes of 50m:
+const Eigen::Vector3d mapHalfSize(525.0, 525.0, 275.0);
+// and the surround map the same as the 5x5x3 cubes around the center cube:
+const Eigen::Vector3d surroundHalfSize(125.0, 125.0, 75.0);
+// far voxels are deleted once the position moved this far:
+const double mapTrimDistance = 50.0;
+// largest neighbour distance used by the data association:
+const float mapSearchRadius = 1.0;
 
-int laserCloudValidInd[125];
-int laserCloudSurroundInd[125];
+Eigen::Vector3d mapTrimCenter(0, 0, 0);
 
 // input: from odom
 pcl::PointCloud<PointType>::Ptr laserCloudCornerLast(new pcl::PointCloud<PointType>());
@@ -92,20 +93,12 @@ pcl::PointCloud<PointType>::Ptr laserCloudSurfLast(new pcl::PointCloud<PointType
 // ouput: all visualble cube points
 pcl::PointCloud<PointType>::Ptr laserCloudSurround(new pcl::PointCloud<PointType>());
 
-// surround points in map to build tree
-pcl::PointCloud<PointType>::Ptr laserCloudCornerFromMap(new pcl::PointCloud<PointType>());
-pcl::PointCloud<PointType>::Ptr laserCloudSurfFromMap(new pcl::PointCloud<PointType>());
-
 //input & output: points in one frame. local --> global
 pcl::PointCloud<PointType>::Ptr laserCloudFullRes(new pcl::PointCloud<PointType>());
 
-// points in every cube
-pcl::PointCloud<PointType>::Ptr laserCloudCornerArray[laserCloudNum];
-pcl::PointCloud<PointType>::Ptr laserCloudSurfArray[laserCloudNum];
-
-//kd-tree
-pcl::KdTreeFLANN<PointType>::Ptr kdtreeCornerFromMap(new pcl::KdTreeFLANN<PointType>());
-pcl::KdTreeFLANN<PointType>::Ptr kdtreeSurfFromMap(new pcl::KdTreeFLANN<PointType>());
+// map points, downsampled on insertion
+std::unique_ptr<VoxelMap> laserCloudCornerMap;
+std::unique_ptr<VoxelMap> laserCloudSurfMap;
 
 double parameters[7] = {0, 0, 0, 1, 0, 0, 0};
 Eigen::Map<Eigen::Quaterniond> q_w_curr(parameters);
@@ -129,7 +122,7 @@ std::mutex mBuf;
 pcl::VoxelGrid<PointType> downSizeFilterCorner;
 pcl::VoxelGrid<PointType> downSizeFilterSurf;
 
-std::vector<int> pointSearchInd;
+std::vector<PointType> pointSearchNear;
 std::vector<float> pointSearchSqDis;
 
 PointType pointOri, pointSel;
@@ -228,675 +221,401 @@ void laserOdometryHandler(const nav_msgs::Odometry::ConstPtr &laserOdometry)
 	pubOdomAftMappedHighFrec.publish(odomAftMapped);
 }
 
-void process()
+void pushOdometryFrame(const OdometryFrame &frame)
 {
-	while(1)
+	laserCloudCornerLastHandler(frame.cornerLast);
+	laserCloudSurfLastHandler(frame.surfLast);
+	laserCloudFullResHandler(frame.fullRes);
+}
+
+void mappingStep()
+{
+	while (!cornerLastBuf.empty() && !surfLastBuf.empty() &&
+		!fullResBuf.empty() && !odometryBuf.empty())
 	{
-		while (!cornerLastBuf.empty() && !surfLastBuf.empty() &&
-			!fullResBuf.empty() && !odometryBuf.empty())
+		mBuf.lock();
+		while (!odometryBuf.empty() && odometryBuf.front()->header.stamp.toSec() < cornerLastBuf.front()->header.stamp.toSec())
+			odometryBuf.pop();
+		if (odometryBuf.empty())
 		{
-			mBuf.lock();
-			while (!odometryBuf.empty() && odometryBuf.front()->header.stamp.toSec() < cornerLastBuf.front()->header.stamp.toSec())
-				odometryBuf.pop();
-			if (odometryBuf.empty())
-			{
-				mBuf.unlock();
-				break;
-			}
-
-			while (!surfLastBuf.empty() && surfLastBuf.front()->header.stamp.toSec() < cornerLastBuf.front()->header.stamp.toSec())
-				surfLastBuf.pop();
-			if (surfLastBuf.empty())
-			{
-				mBuf.unlock();
-				break;
-			}
+			mBuf.unlock();
+			break;
+		}
 
-			while (!fullResBuf.empty() && fullResBuf.front()->header.stamp.toSec() < cornerLastBuf.front()->header.stamp.toSec())
-				fullResBuf.pop();
-			if (fullResBuf.empty())
-			{
-				mBuf.unlock();
-				break;
-			}
+		while (!surfLastBuf.empty() && surfLastBuf.front()->header.stamp.toSec() < cornerLastBuf.front()->header.stamp.toSec())
+			surfLastBuf.pop();
+		if (surfLastBuf.empty())
+		{
+			mBuf.unlock();
+			break;
+		}
 
-			timeLaserCloudCornerLast = cornerLastBuf.front()->header.stamp.toSec();
-			timeLaserCloudSurfLast = surfLastBuf.front()->header.stamp.toSec();
-			timeLaserCloudFullRes = fullResBuf.front()->header.stamp.toSec();
-			timeLaserOdometry = odometryBuf.front()->header.stamp.toSec();
+		while (!fullResBuf.empty() && fullResBuf.front()->header.stamp.toSec() < cornerLastBuf.front()->header.stamp.toSec())
+			fullResBuf.pop();
+		if (fullResBuf.empty())
+		{
+			mBuf.unlock();
+			break;
+		}
 
-			if (timeLaserCloudCornerLast != timeLaserOdometry ||
-				timeLaserCloudSurfLast != timeLaserOdometry ||
-				timeLaserCloudFullRes != timeLaserOdometry)
-			{
-				printf("time corner %f surf %f full %f odom %f \n", timeLaserCloudCornerLast, timeLaserCloudSurfLast, timeLaserCloudFullRes, timeLaserOdometry);
-				printf("unsync messeage!");
-				mBuf.unlock();
-				break;
-			}
+		timeLaserCloudCornerLast = cornerLastBuf.front()->header.stamp.toSec();
+		timeLaserCloudSurfLast = surfLastBuf.front()->header.stamp.toSec();
+		timeLaserCloudFullRes = fullResBuf.front()->header.stamp.toSec();
+		timeLaserOdometry = odometryBuf.front()->header.stamp.toSec();
 
-			laserCloudCornerLast->clear();
-			pcl::fromROSMsg(*cornerLastBuf.front(), *laserCloudCornerLast);
-			cornerLastBuf.pop();
+		if (timeLaserCloudCornerLast != timeLaserOdometry ||
+			timeLaserCloudSurfLast != timeLaserOdometry ||
+			timeLaserCloudFullRes != timeLaserOdometry)
+		{
+			printf("time corner %f surf %f full %f odom %f \n", timeLaserCloudCornerLast, timeLaserCloudSurfLast, timeLaserCloudFullRes, timeLaserOdometry);
+			printf("unsync messeage!");
+			mBuf.unlock();
+			break;
+		}
 
-			laserCloudSurfLast->clear();
-			pcl::fromROSMsg(*surfLastBuf.front(), *laserCloudSurfLast);
-			surfLastBuf.pop();
+		laserCloudCornerLast->clear();
+		pcl::fromROSMsg(*cornerLastBuf.front(), *laserCloudCornerLast);
+		cornerLastBuf.pop();
 
-			laserCloudFullRes->clear();
-			pcl::fromROSMsg(*fullResBuf.front(), *laserCloudFullRes);
-			fullResBuf.pop();
+		laserCloudSurfLast->clear();
+		pcl::fromROSMsg(*surfLastBuf.front(), *laserCloudSurfLast);
+		surfLastBuf.pop();
 
-			q_wodom_curr.x() = odometryBuf.front()->pose.pose.orientation.x;
-			q_wodom_curr.y() = odometryBuf.front()->pose.pose.orientation.y;
-			q_wodom_curr.z() = odometryBuf.front()->pose.pose.orientation.z;
-			q_wodom_curr.w() = odometryBuf.front()->pose.pose.orientation.w;
-			t_wodom_curr.x() = odometryBuf.front()->pose.pose.position.x;
-			t_wodom_curr.y() = odometryBuf.front()->pose.pose.position.y;
-			t_wodom_curr.z() = odometryBuf.front()->pose.pose.position.z;
-			odometryBuf.pop();
+		laserCloudFullRes->clear();
+		pcl::fromROSMsg(*fullResBuf.front(), *laserCloudFullRes);
+		fullResBuf.pop();
 
-			while(!cornerLastBuf.empty())
-			{
-				cornerLastBuf.pop();
-				printf("drop lidar frame in mapping for real time performance \n");
-			}
+		q_wodom_curr.x() = odometryBuf.front()->pose.pose.orientation.x;
+		q_wodom_curr.y() = odometryBuf.front()->pose.pose.orientation.y;
+		q_wodom_curr.z() = odometryBuf.front()->pose.pose.orientation.z;
+		q_wodom_curr.w() = odometryBuf.front()->pose.pose.orientation.w;
+		t_wodom_curr.x() = odometryBuf.front()->pose.pose.position.x;
+		t_wodom_curr.y() = odometryBuf.front()->pose.pose.position.y;
+		t_wodom_curr.z() = odometryBuf.front()->pose.pose.position.z;
+		odometryBuf.pop();
 
-			mBuf.unlock();
+		while(!cornerLastBuf.empty())
+		{
+			cornerLastBuf.pop();
+			printf("drop lidar frame in mapping for real time performance \n");
+		}
 
-			TicToc t_whole;
+		mBuf.unlock();
 
-			transformAssociateToMap();
+		TicToc t_whole;
 
-			TicToc t_shift;
-			int centerCubeI = int((t_w_curr.x() + 25.0) / 50.0) + laserCloudCenWidth;
-			int centerCubeJ = int((t_w_curr.y() + 25.0) / 50.0) + laserCloudCenHeight;
-			int centerCubeK = int((t_w_curr.z() + 25.0) / 50.0) + laserCloudCenDepth;
+		transformAssociateToMap();
 
-			if (t_w_curr.x() + 25.0 < 0)
-				centerCubeI--;
-			if (t_w_curr.y() + 25.0 < 0)
-				centerCubeJ--;
-			if (t_w_curr.z() + 25.0 < 0)
-				centerCubeK--;
+		TicToc t_shift;
+		Eigen::Vector3d t_map_curr(t_w_curr);
+		if ((t_map_curr - mapTrimCenter).norm() > mapTrimDistance)
+		{
+			mapTrimCenter = t_map_curr;
+			laserCloudCornerMap->deleteOutsideBox(mapTrimCenter - mapHalfSize, mapTrimCenter + mapHalfSize);
+			laserCloudSurfMap->deleteOutsideBox(mapTrimCenter - mapHalfSize, mapTrimCenter + mapHalfSize);
+		}
+		int laserCloudCornerFromMapNum = laserCloudCornerMap->size();
+		int laserCloudSurfFromMapNum = laserCloudSurfMap->size();
 
-			while (centerCubeI < 3)
-			{
-				for (int j = 0; j < laserCloudHeight; j++)
-				{
-					for (int k = 0; k < laserCloudDepth; k++)
-					{ 
-						int i = laserCloudWidth - 1;
-						pcl::PointCloud<PointType>::Ptr laserCloudCubeCornerPointer =
-							laserCloudCornerArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k]; 
-						pcl::PointCloud<PointType>::Ptr laserCloudCubeSurfPointer =
-							laserCloudSurfArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k];
-						for (; i >= 1; i--)
-						{
-							laserCloudCornerArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-								laserCloudCornerArray[i - 1 + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k];
-							laserCloudSurfArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-								laserCloudSurfArray[i - 1 + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k];
-						}
-						laserCloudCornerArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-							laserCloudCubeCornerPointer;
-						laserCloudSurfArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-							laserCloudCubeSurfPointer;
-						laserCloudCubeCornerPointer->clear();
-						laserCloudCubeSurfPointer->clear();
-					}
-				}
 
-				centerCubeI++;
-				laserCloudCenWidth++;
-			}
+		pcl::PointCloud<PointType>::Ptr laserCloudCornerStack(new pcl::PointCloud<PointType>());
+		downSizeFilterCorner.setInputCloud(laserCloudCornerLast);
+		downSizeFilterCorner.filter(*laserCloudCornerStack);
+		int laserCloudCornerStackNum = laserCloudCornerStack->points.size();
 
-			while (centerCubeI >= laserCloudWidth - 3)
-			{ 
-				for (int j = 0; j < laserCloudHeight; j++)
-				{
-					for (int k = 0; k < laserCloudDepth; k++)
-					{
-						int i = 0;
-						pcl::PointCloud<PointType>::Ptr laserCloudCubeCornerPointer =
-							laserCloudCornerArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k];
-						pcl::PointCloud<PointType>::Ptr laserCloudCubeSurfPointer =
-							laserCloudSurfArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k];
-						for (; i < laserCloudWidth - 1; i++)
-						{
-							laserCloudCornerArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-								laserCloudCornerArray[i + 1 + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k];
-							laserCloudSurfArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-								laserCloudSurfArray[i + 1 + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k];
-						}
-						laserCloudCornerArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-							laserCloudCubeCornerPointer;
-						laserCloudSurfArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-							laserCloudCubeSurfPointer;
-						laserCloudCubeCornerPointer->clear();
-						laserCloudCubeSurfPointer->clear();
-					}
-				}
+		pcl::PointCloud<PointType>::Ptr laserCloudSurfStack(new pcl::PointCloud<PointType>());
+		downSizeFilterSurf.setInputCloud(laserCloudSurfLast);
+		downSizeFilterSurf.filter(*laserCloudSurfStack);
+		int laserCloudSurfStackNum = laserCloudSurfStack->points.size();
 
-				centerCubeI--;
-				laserCloudCenWidth--;
-			}
+		printf("map prepare time %f ms\n", t_shift.toc());
+		printf("map corner num %d  surf num %d \n", laserCloudCornerFromMapNum, laserCloudSurfFromMapNum);
+		if (laserCloudCornerFromMapNum > 10 && laserCloudSurfFromMapNum > 50)
+		{
+			TicToc t_opt;
 
-			while (centerCubeJ < 3)
+			for (int iterCount = 0; iterCount < 2; iterCount++)
 			{
-				for (int i = 0; i < laserCloudWidth; i++)
-				{
-					for (int k = 0; k < laserCloudDepth; k++)
-					{
-						int j = laserCloudHeight - 1;
-						pcl::PointCloud<PointType>::Ptr laserCloudCubeCornerPointer =
-							laserCloudCornerArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k];
-						pcl::PointCloud<PointType>::Ptr laserCloudCubeSurfPointer =
-							laserCloudSurfArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k];
-						for (; j >= 1; j--)
-						{
-							laserCloudCornerArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-								laserCloudCornerArray[i + laserCloudWidth * (j - 1) + laserCloudWidth * laserCloudHeight * k];
-							laserCloudSurfArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-								laserCloudSurfArray[i + laserCloudWidth * (j - 1) + laserCloudWidth * laserCloudHeight * k];
-						}
-						laserCloudCornerArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-							laserCloudCubeCornerPointer;
-						laserCloudSurfArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-							laserCloudCubeSurfPointer;
-						laserCloudCubeCornerPointer->clear();
-						laserCloudCubeSurfPointer->clear();
-					}
-				}
+				//ceres::LossFunction *loss_function = NULL;
+				ceres::LossFunction *loss_function = new ceres::HuberLoss(0.1);
+				ceres::LocalParameterization *q_parameterization =
+					new ceres::EigenQuaternionParameterization();
+				ceres::Problem::Options problem_options;
 
-				centerCubeJ++;
-				laserCloudCenHeight++;
-			}
+				ceres::Problem problem(problem_options);
+				problem.AddParameterBlock(parameters, 4, q_parameterization);
+				problem.AddParameterBlock(parameters + 4, 3);
 
-			while (centerCubeJ >= laserCloudHeight - 3)
-			{
-				for (int i = 0; i < laserCloudWidth; i++)
-				{
-					for (int k = 0; k < laserCloudDepth; k++)
-					{
-						int j = 0;
-						pcl::PointCloud<PointType>::Ptr laserCloudCubeCornerPointer =
-							laserCloudCornerArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k];
-						pcl::PointCloud<PointType>::Ptr laserCloudCubeSurfPointer =
-							laserCloudSurfArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k];
-						for (; j < laserCloudHeight - 1; j++)
-						{
-							laserCloudCornerArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-								laserCloudCornerArray[i + laserCloudWidth * (j + 1) + laserCloudWidth * laserCloudHeight * k];
-							laserCloudSurfArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-								laserCloudSurfArray[i + laserCloudWidth * (j + 1) + laserCloudWidth * laserCloudHeight * k];
-						}
-						laserCloudCornerArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-							laserCloudCubeCornerPointer;
-						laserCloudSurfArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-							laserCloudCubeSurfPointer;
-						laserCloudCubeCornerPointer->clear();
-						laserCloudCubeSurfPointer->clear();
-					}
-				}
+				TicToc t_data;
+				int corner_num = 0;
 
-				centerCubeJ--;
-				laserCloudCenHeight--;
-			}
-
-			while (centerCubeK < 3)
-			{
-				for (int i = 0; i < laserCloudWidth; i++)
+				for (int i = 0; i < laserCloudCornerStackNum; i++)
 				{
-					for (int j = 0; j < laserCloudHeight; j++)
-					{
-						int k = laserCloudDepth - 1;
-						pcl::PointCloud<PointType>::Ptr laserCloudCubeCornerPointer =
-							laserCloudCornerArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k];
-						pcl::PointCloud<PointType>::Ptr laserCloudCubeSurfPointer =
-							laserCloudSurfArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k];
-						for (; k >= 1; k--)
+					pointOri = laserCloudCornerStack->points[i];
+					//double sqrtDis = pointOri.x * pointOri.x + pointOri.y * pointOri.y + pointOri.z * pointOri.z;
+					pointAssociateToMap(&pointOri, &pointSel);
+					int nearNum = laserCloudCornerMap->nearestKSearch(pointSel, 5, mapSearchRadius * mapSearchRadius, pointSearchNear, pointSearchSqDis);
+
+					if (nearNum == 5)
+					{ 
+						std::vector<Eigen::Vector3d> nearCorners;
+						Eigen::Vector3d center(0, 0, 0);
+						for (int j = 0; j < 5; j++)
 						{
-							laserCloudCornerArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-								laserCloudCornerArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * (k - 1)];
-							laserCloudSurfArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-								laserCloudSurfArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * (k - 1)];
+							Eigen::Vector3d tmp(pointSearchNear[j].x,
+												pointSearchNear[j].y,
+												pointSearchNear[j].z);
+							center = center + tmp;
+							nearCorners.push_back(tmp);
 						}
-						laserCloudCornerArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-							laserCloudCubeCornerPointer;
-						laserCloudSurfArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-							laserCloudCubeSurfPointer;
-						laserCloudCubeCornerPointer->clear();
-						laserCloudCubeSurfPointer->clear();
-					}
-				}
+						center = center / 5.0;
 
-				centerCubeK++;
-				laserCloudCenDepth++;
-			}
-
-			while (centerCubeK >= laserCloudDepth - 3)
-			{
-				for (int i = 0; i < laserCloudWidth; i++)
-				{
-					for (int j = 0; j < laserCloudHeight; j++)
-					{
-						int k = 0;
-						pcl::PointCloud<PointType>::Ptr laserCloudCubeCornerPointer =
-							laserCloudCornerArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k];
-						pcl::PointCloud<PointType>::Ptr laserCloudCubeSurfPointer =
-							laserCloudSurfArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k];
-						for (; k < laserCloudDepth - 1; k++)
+						Eigen::Matrix3d covMat = Eigen::Matrix3d::Zero();
+						for (int j = 0; j < 5; j++)
 						{
-							laserCloudCornerArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-								laserCloudCornerArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * (k + 1)];
-							laserCloudSurfArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-								laserCloudSurfArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * (k + 1)];
+							Eigen::Matrix<double, 3, 1> tmpZeroMean = nearCorners[j] - center;
+							covMat = covMat + tmpZeroMean * tmpZeroMean.transpose();
 						}
-						laserCloudCornerArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-							laserCloudCubeCornerPointer;
-						laserCloudSurfArray[i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k] =
-							laserCloudCubeSurfPointer;
-						laserCloudCubeCornerPointer->clear();
-						laserCloudCubeSurfPointer->clear();
-					}
-				}
 
-				centerCubeK--;
-				laserCloudCenDepth--;
-			}
+						Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> saes(covMat);
 
-			int laserCloudValidNum = 0;
-			int laserCloudSurroundNum = 0;
+						// if is indeed line feature
+						// note Eigen library sort eigenvalues in increasing order
+						Eigen::Vector3d unit_direction = saes.eigenvectors().col(2);
+						Eigen::Vector3d curr_point(pointOri.x, pointOri.y, pointOri.z);
+						if (saes.eigenvalues()[2] > 3 * saes.eigenvalues()[1])
+						{ 
+							Eigen::Vector3d point_on_line = center;
+							Eigen::Vector3d point_a, point_b;
+							point_a = 0.1 * unit_direction + point_on_line;
+							point_b = -0.1 * unit_direction + point_on_line;
 
-			for (int i = centerCubeI - 2; i <= centerCubeI + 2; i++)
-			{
-				for (int j = centerCubeJ - 2; j <= centerCubeJ + 2; j++)
-				{
-					for (int k = centerCubeK - 1; k <= centerCubeK + 1; k++)
+							ceres::CostFunction *cost_function = LidarEdgeFactor::Create(curr_point, point_a, point_b, 1.0);
+							problem.AddResidualBlock(cost_function, loss_function, parameters, parameters + 4);
+							corner_num++;	
+						}							
+					}
+					/*
+					else if(pointSearchSqDis[4] < 0.01 * sqrtDis)
 					{
-						if (i >= 0 && i < laserCloudWidth &&
-							j >= 0 && j < laserCloudHeight &&
-							k >= 0 && k < laserCloudDepth)
-						{ 
-							laserCloudValidInd[laserCloudValidNum] = i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k;
-							laserCloudValidNum++;
-							laserCloudSurroundInd[laserCloudSurroundNum] = i + laserCloudWidth * j + laserCloudWidth * laserCloudHeight * k;
-							laserCloudSurroundNum++;
+						Eigen::Vector3d center(0, 0, 0);
+						for (int j = 0; j < 5; j++)
+						{
+							Eigen::Vector3d tmp(pointSearchNear[j].x,
+												pointSearchNear[j].y,
+												pointSearchNear[j].z);
+							center = center + tmp;
 						}
+						center = center / 5.0;	
+						Eigen::Vector3d curr_point(pointOri.x, pointOri.y, pointOri.z);
+						ceres::CostFunction *cost_function = LidarDistanceFactor::Create(curr_point, center);
+						problem.AddResidualBlock(cost_function, loss_function, parameters, parameters + 4);
 					}
+					*/
 				}
-			}
 
-			laserCloudCornerFromMap->clear();
-			laserCloudSurfFromMap->clear();
-			for (int i = 0; i < laserCloudValidNum; i++)
-			{
-				*laserCloudCornerFromMap += *laserCloudCornerArray[laserCloudValidInd[i]];
-				*laserCloudSurfFromMap += *laserCloudSurfArray[laserCloudValidInd[i]];
-			}
-			int laserCloudCornerFromMapNum = laserCloudCornerFromMap->points.size();
-			int laserCloudSurfFromMapNum = laserCloudSurfFromMap->points.size();
-
-
-			pcl::PointCloud<PointType>::Ptr laserCloudCornerStack(new pcl::PointCloud<PointType>());
-			downSizeFilterCorner.setInputCloud(laserCloudCornerLast);
-			downSizeFilterCorner.filter(*laserCloudCornerStack);
-			int laserCloudCornerStackNum = laserCloudCornerStack->points.size();
-
-			pcl::PointCloud<PointType>::Ptr laserCloudSurfStack(new pcl::PointCloud<PointType>());
-			downSizeFilterSurf.setInputCloud(laserCloudSurfLast);
-			downSizeFilterSurf.filter(*laserCloudSurfStack);
-			int laserCloudSurfStackNum = laserCloudSurfStack->points.size();
-
-			printf("map prepare time %f ms\n", t_shift.toc());
-			printf("map corner num %d  surf num %d \n", laserCloudCornerFromMapNum, laserCloudSurfFromMapNum);
-			if (laserCloudCornerFromMapNum > 10 && laserCloudSurfFromMapNum > 50)
-			{
-				TicToc t_opt;
-				TicToc t_tree;
-				kdtreeCornerFromMap->setInputCloud(laserCloudCornerFromMap);
-				kdtreeSurfFromMap->setInputCloud(laserCloudSurfFromMap);
-				printf("build tree time %f ms \n", t_tree.toc());
-
-				for (int iterCount = 0; iterCount < 2; iterCount++)
+				int surf_num = 0;
+				for (int i = 0; i < laserCloudSurfStackNum; i++)
 				{
-					//ceres::LossFunction *loss_function = NULL;
-					ceres::LossFunction *loss_function = new ceres::HuberLoss(0.1);
-					ceres::LocalParameterization *q_parameterization =
-						new ceres::EigenQuaternionParameterization();
-					ceres::Problem::Options problem_options;
-
-					ceres::Problem problem(problem_options);
-					problem.AddParameterBlock(parameters, 4, q_parameterization);
-					problem.AddParameterBlock(parameters + 4, 3);
-
-					TicToc t_data;
-					int corner_num = 0;
-
-					for (int i = 0; i < laserCloudCornerStackNum; i++)
+					pointOri = laserCloudSurfStack->points[i];
+					//double sqrtDis = pointOri.x * pointOri.x + pointOri.y * pointOri.y + pointOri.z * pointOri.z;
+					pointAssociateToMap(&pointOri, &pointSel);
+					int nearNum = laserCloudSurfMap->nearestKSearch(pointSel, 5, mapSearchRadius * mapSearchRadius, pointSearchNear, pointSearchSqDis);
+
+					Eigen::Matrix<double, 5, 3> matA0;
+					Eigen::Matrix<double, 5, 1> matB0 = -1 * Eigen::Matrix<double, 5, 1>::Ones();
+					if (nearNum == 5)
 					{
-						pointOri = laserCloudCornerStack->points[i];
-						//double sqrtDis = pointOri.x * pointOri.x + pointOri.y * pointOri.y + pointOri.z * pointOri.z;
-						pointAssociateToMap(&pointOri, &pointSel);
-						kdtreeCornerFromMap->nearestKSearch(pointSel, 5, pointSearchInd, pointSearchSqDis); 
-
-						if (pointSearchSqDis[4] < 1.0)
-						{ 
-							std::vector<Eigen::Vector3d> nearCorners;
-							Eigen::Vector3d center(0, 0, 0);
-							for (int j = 0; j < 5; j++)
-							{
-								Eigen::Vector3d tmp(laserCloudCornerFromMap->points[pointSearchInd[j]].x,
-													laserCloudCornerFromMap->points[pointSearchInd[j]].y,
-													laserCloudCornerFromMap->points[pointSearchInd[j]].z);
-								center = center + tmp;
-								nearCorners.push_back(tmp);
-							}
-							center = center / 5.0;
-
-							Eigen::Matrix3d covMat = Eigen::Matrix3d::Zero();
-							for (int j = 0; j < 5; j++)
-							{
-								Eigen::Matrix<double, 3, 1> tmpZeroMean = nearCorners[j] - center;
-								covMat = covMat + tmpZeroMean * tmpZeroMean.transpose();
-							}
-
-							Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> saes(covMat);
-
-							// if is indeed line feature
-							// note Eigen library sort eigenvalues in increasing order
-							Eigen::Vector3d unit_direction = saes.eigenvectors().col(2);
-							Eigen::Vector3d curr_point(pointOri.x, pointOri.y, pointOri.z);
-							if (saes.eigenvalues()[2] > 3 * saes.eigenvalues()[1])
-							{ 
-								Eigen::Vector3d point_on_line = center;
-								Eigen::Vector3d point_a, point_b;
-								point_a = 0.1 * unit_direction + point_on_line;
-								point_b = -0.1 * unit_direction + point_on_line;
-
-								ceres::CostFunction *cost_function = LidarEdgeFactor::Create(curr_point, point_a, point_b, 1.0);
-								problem.AddResidualBlock(cost_function, loss_function, parameters, parameters + 4);
-								corner_num++;	
-							}							
+						
+						for (int j = 0; j < 5; j++)
+						{
+							matA0(j, 0) = pointSearchNear[j].x;
+							matA0(j, 1) = pointSearchNear[j].y;
+							matA0(j, 2) = pointSearchNear[j].z;
+							//printf(" pts %f %f %f ", matA0(j, 0), matA0(j, 1), matA0(j, 2));
 						}
-						/*
-						else if(pointSearchSqDis[4] < 0.01 * sqrtDis)
+						// find the norm of plane
+						Eigen::Vector3d norm = matA0.colPivHouseholderQr().solve(matB0);
+						double negative_OA_dot_norm = 1 / norm.norm();
+						norm.normalize();
+
+						// Here n(pa, pb, pc) is unit norm of plane
+						bool planeValid = true;
+						for (int j = 0; j < 5; j++)
 						{
-							Eigen::Vector3d center(0, 0, 0);
-							for (int j = 0; j < 5; j++)
+							// if OX * n > 0.2, then plane is not fit well
+							if (fabs(norm(0) * pointSearchNear[j].x +
+									 norm(1) * pointSearchNear[j].y +
+									 norm(2) * pointSearchNear[j].z + negative_OA_dot_norm) > 0.2)
 							{
-								Eigen::Vector3d tmp(laserCloudCornerFromMap->points[pointSearchInd[j]].x,
-													laserCloudCornerFromMap->points[pointSearchInd[j]].y,
-													laserCloudCornerFromMap->points[pointSearchInd[j]].z);
-								center = center + tmp;
+								planeValid = false;
+								break;
 							}
-							center = center / 5.0;	
-							Eigen::Vector3d curr_point(pointOri.x, pointOri.y, pointOri.z);
-							ceres::CostFunction *cost_function = LidarDistanceFactor::Create(curr_point, center);
+						}
+						Eigen::Vector3d curr_point(pointOri.x, pointOri.y, pointOri.z);
+						if (planeValid)
+						{
+							ceres::CostFunction *cost_function = LidarPlaneNormFactor::Create(curr_point, norm, negative_OA_dot_norm);
 							problem.AddResidualBlock(cost_function, loss_function, parameters, parameters + 4);
+							surf_num++;
 						}
-						*/
 					}
-
-					int surf_num = 0;
-					for (int i = 0; i < laserCloudSurfStackNum; i++)
+					/*
+					else if(pointSearchSqDis[4] < 0.01 * sqrtDis)
 					{
-						pointOri = laserCloudSurfStack->points[i];
-						//double sqrtDis = pointOri.x * pointOri.x + pointOri.y * pointOri.y + pointOri.z * pointOri.z;
-						pointAssociateToMap(&pointOri, &pointSel);
-						kdtreeSurfFromMap->nearestKSearch(pointSel, 5, pointSearchInd, pointSearchSqDis);
-
-						Eigen::Matrix<double, 5, 3> matA0;
-						Eigen::Matrix<double, 5, 1> matB0 = -1 * Eigen::Matrix<double, 5, 1>::Ones();
-						if (pointSearchSqDis[4] < 1.0)
+						Eigen::Vector3d center(0, 0, 0);
+						for (int j = 0; j < 5; j++)
 						{
-							
-							for (int j = 0; j < 5; j++)
-							{
-								matA0(j, 0) = laserCloudSurfFromMap->points[pointSearchInd[j]].x;
-								matA0(j, 1) = laserCloudSurfFromMap->points[pointSearchInd[j]].y;
-								matA0(j, 2) = laserCloudSurfFromMap->points[pointSearchInd[j]].z;
-								//printf(" pts %f %f %f ", matA0(j, 0), matA0(j, 1), matA0(j, 2));
-							}
-							// find the norm of plane
-							Eigen::Vector3d norm = matA0.colPivHouseholderQr().solve(matB0);
-							double negative_OA_dot_norm = 1 / norm.norm();
-							norm.normalize();
-
-							// Here n(pa, pb, pc) is unit norm of plane
-							bool planeValid = true;
-							for (int j = 0; j < 5; j++)
-							{
-								// if OX * n > 0.2, then plane is not fit well
-								if (fabs(norm(0) * laserCloudSurfFromMap->points[pointSearchInd[j]].x +
-										 norm(1) * laserCloudSurfFromMap->points[pointSearchInd[j]].y +
-										 norm(2) * laserCloudSurfFromMap->points[pointSearchInd[j]].z + negative_OA_dot_norm) > 0.2)
-								{
-									planeValid = false;
-									break;
-								}
-							}
-							Eigen::Vector3d curr_point(pointOri.x, pointOri.y, pointOri.z);
-							if (planeValid)
-							{
-								ceres::CostFunction *cost_function = LidarPlaneNormFactor::Create(curr_point, norm, negative_OA_dot_norm);
-								problem.AddResidualBlock(cost_function, loss_function, parameters, parameters + 4);
-								surf_num++;
-							}
+							Eigen::Vector3d tmp(pointSearchNear[j].x,
+												pointSearchNear[j].y,
+												pointSearchNear[j].z);
+							center = center + tmp;
 						}
-						/*
-						else if(pointSearchSqDis[4] < 0.01 * sqrtDis)
-						{
-							Eigen::Vector3d center(0, 0, 0);
-							for (int j = 0; j < 5; j++)
-							{
-								Eigen::Vector3d tmp(laserCloudSurfFromMap->points[pointSearchInd[j]].x,
-													laserCloudSurfFromMap->points[pointSearchInd[j]].y,
-													laserCloudSurfFromMap->points[pointSearchInd[j]].z);
-								center = center + tmp;
-							}
-							center = center / 5.0;	
-							Eigen::Vector3d curr_point(pointOri.x, pointOri.y, pointOri.z);
-							ceres::CostFunction *cost_function = LidarDistanceFactor::Create(curr_point, center);
-							problem.AddResidualBlock(cost_function, loss_function, parameters, parameters + 4);
-						}
-						*/
+						center = center / 5.0;	
+						Eigen::Vector3d curr_point(pointOri.x, pointOri.y, pointOri.z);
+						ceres::CostFunction *cost_function = LidarDistanceFactor::Create(curr_point, center);
+						problem.AddResidualBlock(cost_function, loss_function, parameters, parameters + 4);
 					}
-
-					//printf("corner num %d used corner num %d \n", laserCloudCornerStackNum, corner_num);
-					//printf("surf num %d used surf num %d \n", laserCloudSurfStackNum, surf_num);
-
-					printf("mapping data assosiation time %f ms \n", t_data.toc());
-
-					TicToc t_solver;
-					ceres::Solver::Options options;
-					options.linear_solver_type = ceres::DENSE_QR;
-					options.max_num_iterations = 4;
-					options.minimizer_progress_to_stdout = false;
-					options.check_gradients = false;
-					options.gradient_check_relative_precision = 1e-4;
-					ceres::Solver::Summary summary;
-					ceres::Solve(options, &problem, &summary);
-					printf("mapping solver time %f ms \n", t_solver.toc());
-
-					//printf("time %f \n", timeLaserOdometry);
-					//printf("corner factor num %d surf factor num %d\n", corner_num, surf_num);
-					//printf("result q %f %f %f %f result t %f %f %f\n", parameters[3], parameters[0], parameters[1], parameters[2],
-					//	   parameters[4], parameters[5], parameters[6]);
+					*/
 				}
-				printf("mapping optimization time %f \n", t_opt.toc());
-			}
-			else
-			{
-				ROS_WARN("time Map corner and surf num are not enough");
-			}
-			transformUpdate();
 
-			TicToc t_add;
-			for (int i = 0; i < laserCloudCornerStackNum; i++)
-			{
-				pointAssociateToMap(&laserCloudCornerStack->points[i], &pointSel);
-
-				int cubeI = int((pointSel.x + 25.0) / 50.0) + laserCloudCenWidth;
-				int cubeJ = int((pointSel.y + 25.0) / 50.0) + laserCloudCenHeight;
-				int cubeK = int((pointSel.z + 25.0) / 50.0) + laserCloudCenDepth;
-
-				if (pointSel.x + 25.0 < 0)
-					cubeI--;
-				if (pointSel.y + 25.0 < 0)
-					cubeJ--;
-				if (pointSel.z + 25.0 < 0)
-					cubeK--;
-
-				if (cubeI >= 0 && cubeI < laserCloudWidth &&
-					cubeJ >= 0 && cubeJ < laserCloudHeight &&
-					cubeK >= 0 && cubeK < laserCloudDepth)
-				{
-					int cubeInd = cubeI + laserCloudWidth * cubeJ + laserCloudWidth * laserCloudHeight * cubeK;
-					laserCloudCornerArray[cubeInd]->push_back(pointSel);
-				}
+				//printf("corner num %d used corner num %d \n", laserCloudCornerStackNum, corner_num);
+				//printf("surf num %d used surf num %d \n", laserCloudSurfStackNum, surf_num);
+
+				printf("mapping data assosiation time %f ms \n", t_data.toc());
+
+				TicToc t_solver;
+				ceres::Solver::Options options;
+				options.linear_solver_type = ceres::DENSE_QR;
+				options.max_num_iterations = 4;
+				options.minimizer_progress_to_stdout = false;
+				options.check_gradients = false;
+				options.gradient_check_relative_precision = 1e-4;
+				ceres::Solver::Summary summary;
+				ceres::Solve(options, &problem, &summary);
+				printf("mapping solver time %f ms \n", t_solver.toc());
+
+				//printf("time %f \n", timeLaserOdometry);
+				//printf("corner factor num %d surf factor num %d\n", corner_num, surf_num);
+				//printf("result q %f %f %f %f result t %f %f %f\n", parameters[3], parameters[0], parameters[1], parameters[2],
+				//	   parameters[4], parameters[5], parameters[6]);
 			}
+			printf("mapping optimization time %f \n", t_opt.toc());
+		}
+		else
+		{
+			ROS_WARN("time Map corner and surf num are not enough");
+		}
+		transformUpdate();
 
-			for (int i = 0; i < laserCloudSurfStackNum; i++)
-			{
-				pointAssociateToMap(&laserCloudSurfStack->points[i], &pointSel);
-
-				int cubeI = int((pointSel.x + 25.0) / 50.0) + laserCloudCenWidth;
-				int cubeJ = int((pointSel.y + 25.0) / 50.0) + laserCloudCenHeight;
-				int cubeK = int((pointSel.z + 25.0) / 50.0) + laserCloudCenDepth;
-
-				if (pointSel.x + 25.0 < 0)
-					cubeI--;
-				if (pointSel.y + 25.0 < 0)
-					cubeJ--;
-				if (pointSel.z + 25.0 < 0)
-					cubeK--;
-
-				if (cubeI >= 0 && cubeI < laserCloudWidth &&
-					cubeJ >= 0 && cubeJ < laserCloudHeight &&
-					cubeK >= 0 && cubeK < laserCloudDepth)
-				{
-					int cubeInd = cubeI + laserCloudWidth * cubeJ + laserCloudWidth * laserCloudHeight * cubeK;
-					laserCloudSurfArray[cubeInd]->push_back(pointSel);
-				}
-			}
-			printf("add points time %f ms\n", t_add.toc());
-
-			
-			TicToc t_filter;
-			for (int i = 0; i < laserCloudValidNum; i++)
-			{
-				int ind = laserCloudValidInd[i];
-
-				pcl::PointCloud<PointType>::Ptr tmpCorner(new pcl::PointCloud<PointType>());
-				downSizeFilterCorner.setInputCloud(laserCloudCornerArray[ind]);
-				downSizeFilterCorner.filter(*tmpCorner);
-				laserCloudCornerArray[ind] = tmpCorner;
+		TicToc t_add;
+		for (int i = 0; i < laserCloudCornerStackNum; i++)
+		{
+			pointAssociateToMap(&laserCloudCornerStack->points[i], &pointSel);
+			laserCloudCornerMap->addPoint(pointSel);
+		}
 
-				pcl::PointCloud<PointType>::Ptr tmpSurf(new pcl::PointCloud<PointType>());
-				downSizeFilterSurf.setInputCloud(laserCloudSurfArray[ind]);
-				downSizeFilterSurf.filter(*tmpSurf);
-				laserCloudSurfArray[ind] = tmpSurf;
-			}
-			printf("filter time %f ms \n", t_filter.toc());
-			
-			TicToc t_pub;
-			//publish surround map for every 5 frame
-			if (frameCount % 5 == 0)
-			{
-				laserCloudSurround->clear();
-				for (int i = 0; i < laserCloudSurroundNum; i++)
-				{
-					int ind = laserCloudSurroundInd[i];
-					*laserCloudSurround += *laserCloudCornerArray[ind];
-					*laserCloudSurround += *laserCloudSurfArray[ind];
-				}
+		for (int i = 0; i < laserCloudSurfStackNum; i++)
+		{
+			pointAssociateToMap(&laserCloudSurfStack->points[i], &pointSel);
+			laserCloudSurfMap->addPoint(pointSel);
+		}
+		printf("add points time %f ms\n", t_add.toc());
+		
+		TicToc t_pub;
+		//publish surround map for every 5 frame
+		if (frameCount % 5 == 0)
+		{
+			t_map_curr = t_w_curr;
+			laserCloudSurround->clear();
+			laserCloudCornerMap->getPointsInBox(t_map_curr - surroundHalfSize, t_map_curr + surroundHalfSize, *laserCloudSurround);
+			laserCloudSurfMap->getPointsInBox(t_map_curr - surroundHalfSize, t_map_curr + surroundHalfSize, *laserCloudSurround);
+
+			sensor_msgs::PointCloud2 laserCloudSurround3;
+			pcl::toROSMsg(*laserCloudSurround, laserCloudSurround3);
+			laserCloudSurround3.header.stamp = ros::Time().fromSec(timeLaserOdometry);
+			laserCloudSurround3.header.frame_id = "/camera_init";
+			pubLaserCloudSurround.publish(laserCloudSurround3);
+		}
 
-				sensor_msgs::PointCloud2 laserCloudSurround3;
-				pcl::toROSMsg(*laserCloudSurround, laserCloudSurround3);
-				laserCloudSurround3.header.stamp = ros::Time().fromSec(timeLaserOdometry);
-				laserCloudSurround3.header.frame_id = "/camera_init";
-				pubLaserCloudSurround.publish(laserCloudSurround3);
-			}
+		if (frameCount % 20 == 0)
+		{
+			pcl::PointCloud<PointType> laserCloudMap;
+			laserCloudCornerMap->getAllPoints(laserCloudMap);
+			laserCloudSurfMap->getAllPoints(laserCloudMap);
+			sensor_msgs::PointCloud2 laserCloudMsg;
+			pcl::toROSMsg(laserCloudMap, laserCloudMsg);
+			laserCloudMsg.header.stamp = ros::Time().fromSec(timeLaserOdometry);
+			laserCloudMsg.header.frame_id = "/camera_init";
+			pubLaserCloudMap.publish(laserCloudMsg);
+		}
 
-			if (frameCount % 20 == 0)
-			{
-				pcl::PointCloud<PointType> laserCloudMap;
-				for (int i = 0; i < 4851; i++)
-				{
-					laserCloudMap += *laserCloudCornerArray[i];
-					laserCloudMap += *laserCloudSurfArray[i];
-				}
-				sensor_msgs::PointCloud2 laserCloudMsg;
-				pcl::toROSMsg(laserCloudMap, laserCloudMsg);
-				laserCloudMsg.header.stamp = ros::Time().fromSec(timeLaserOdometry);
-				laserCloudMsg.header.frame_id = "/camera_init";
-				pubLaserCloudMap.publish(laserCloudMsg);
-			}
+		int laserCloudFullResNum = laserCloudFullRes->points.size();
+		for (int i = 0; i < laserCloudFullResNum; i++)
+		{
+			pointAssociateToMap(&laserCloudFullRes->points[i], &laserCloudFullRes->points[i]);
+		}
 
-			int laserCloudFullResNum = laserCloudFullRes->points.size();
-			for (int i = 0; i < laserCloudFullResNum; i++)
-			{
-				pointAssociateToMap(&laserCloudFullRes->points[i], &laserCloudFullRes->points[i]);
-			}
+		sensor_msgs::PointCloud2 laserCloudFullRes3;
+		pcl::toROSMsg(*laserCloudFullRes, laserCloudFullRes3);
+		laserCloudFullRes3.header.stamp = ros::Time().fromSec(timeLaserOdometry);
+		laserCloudFullRes3.header.frame_id = "/camera_init";
+		pubLaserCloudFullRes.publish(laserCloudFullRes3);
+
+		printf("mapping pub time %f ms \n", t_pub.toc());
+
+		printf("whole mapping time %f ms +++++\n", t_whole.toc());
+
+		nav_msgs::Odometry odomAftMapped;
+		odomAftMapped.header.frame_id = "/camera_init";
+		odomAftMapped.child_frame_id = "/aft_mapped";
+		odomAftMapped.header.stamp = ros::Time().fromSec(timeLaserOdometry);
+		odomAftMapped.pose.pose.orientation.x = q_w_curr.x();
+		odomAftMapped.pose.pose.orientation.y = q_w_curr.y();
+		odomAftMapped.pose.pose.orientation.z = q_w_curr.z();
+		odomAftMapped.pose.pose.orientation.w = q_w_curr.w();
+		odomAftMapped.pose.pose.position.x = t_w_curr.x();
+		odomAftMapped.pose.pose.position.y = t_w_curr.y();
+		odomAftMapped.pose.pose.position.z = t_w_curr.z();
+		pubOdomAftMapped.publish(odomAftMapped);
+
+		geometry_msgs::PoseStamped laserAfterMappedPose;
+		laserAfterMappedPose.header = odomAftMapped.header;
+		laserAfterMappedPose.pose = odomAftMapped.pose.pose;
+		laserAfterMappedPath.header.stamp = odomAftMapped.header.stamp;
+		laserAfterMappedPath.header.frame_id = "/camera_init";
+		laserAfterMappedPath.poses.push_back(laserAfterMappedPose);
+		pubLaserAfterMappedPath.publish(laserAfterMappedPath);
+
+		static tf::TransformBroadcaster br;
+		tf::Transform transform;
+		tf::Quaternion q;
+		transform.setOrigin(tf::Vector3(t_w_curr(0),
+										t_w_curr(1),
+										t_w_curr(2)));
+		q.setW(q_w_curr.w());
+		q.setX(q_w_curr.x());
+		q.setY(q_w_curr.y());
+		q.setZ(q_w_curr.z());
+		transform.setRotation(q);
+		br.sendTransform(tf::StampedTransform(transform, odomAftMapped.header.stamp, "/camera_init", "/aft_mapped"));
+
+		frameCount++;
+	}
+}
 
-			sensor_msgs::PointCloud2 laserCloudFullRes3;
-			pcl::toROSMsg(*laserCloudFullRes, laserCloudFullRes3);
-			laserCloudFullRes3.header.stamp = ros::Time().fromSec(timeLaserOdometry);
-			laserCloudFullRes3.header.frame_id = "/camera_init";
-			pubLaserCloudFullRes.publish(laserCloudFullRes3);
-
-			printf("mapping pub time %f ms \n", t_pub.toc());
-
-			printf("whole mapping time %f ms +++++\n", t_whole.toc());
-
-			nav_msgs::Odometry odomAftMapped;
-			odomAftMapped.header.frame_id = "/camera_init";
-			odomAftMapped.child_frame_id = "/aft_mapped";
-			odomAftMapped.header.stamp = ros::Time().fromSec(timeLaserOdometry);
-			odomAftMapped.pose.pose.orientation.x = q_w_curr.x();
-			odomAftMapped.pose.pose.orientation.y = q_w_curr.y();
-			odomAftMapped.pose.pose.orientation.z = q_w_curr.z();
-			odomAftMapped.pose.pose.orientation.w = q_w_curr.w();
-			odomAftMapped.pose.pose.position.x = t_w_curr.x();
-			odomAftMapped.pose.pose.position.y = t_w_curr.y();
-			odomAftMapped.pose.pose.position.z = t_w_curr.z();
-			pubOdomAftMapped.publish(odomAftMapped);
-
-			geometry_msgs::PoseStamped laserAfterMappedPose;
-			laserAfterMappedPose.header = odomAftMapped.header;
-			laserAfterMappedPose.pose = odomAftMapped.pose.pose;
-			laserAfterMappedPath.header.stamp = odomAftMapped.header.stamp;
-			laserAfterMappedPath.header.frame_id = "/camera_init";
-			laserAfterMappedPath.poses.push_back(laserAfterMappedPose);
-			pubLaserAfterMappedPath.publish(laserAfterMappedPath);
-
-			static tf::TransformBroadcaster br;
-			tf::Transform transform;
-			tf::Quaternion q;
-			transform.setOrigin(tf::Vector3(t_w_curr(0),
-											t_w_curr(1),
-											t_w_curr(2)));
-			q.setW(q_w_curr.w());
-			q.setX(q_w_curr.x());
-			q.setY(q_w_curr.y());
-			q.setZ(q_w_curr.z());
-			transform.setRotation(q);
-			br.sendTransform(tf::StampedTransform(transform, odomAftMapped.header.stamp, "/camera_init", "/aft_mapped"));
-
-			frameCount++;
-		}
+void process()
+{
+	while(1)
+	{
+		mappingStep();
 		std::chrono::milliseconds dura(2);
         std::this_thread::sleep_for(dura);
 	}
 }
 
-int main(int argc, char **argv)
+bool setup(ros::NodeHandle &nh)
 {
-	ros::init(argc, argv, "laserMapping");
-	ros::NodeHandle nh;
-
 	float lineRes = 0;
 	float planeRes = 0;
 	nh.param<float>("mapping_line_resolution", lineRes, 0.4);
@@ -905,14 +624,6 @@ int main(int argc, char **argv)
 	downSizeFilterCorner.setLeafSize(lineRes, lineRes,lineRes);
 	downSizeFilterSurf.setLeafSize(planeRes, planeRes, planeRes);
 
-	ros::Subscriber subLaserCloudCornerLast = nh.subscribe<sensor_msgs::PointCloud2>("/laser_cloud_corner_last", 100, laserCloudCornerLastHandler);
-
-	ros::Subscriber subLaserCloudSurfLast = nh.subscribe<sensor_msgs::PointCloud2>("/laser_cloud_surf_last", 100, laserCloudSurfLastHandler);
-
-	ros::Subscriber subLaserOdometry = nh.subscribe<nav_msgs::Odometry>("/laser_odom_to_init", 100, laserOdometryHandler);
-
-	ros::Subscriber subLaserCloudFullRes = nh.subscribe<sensor_msgs::PointCloud2>("/velodyne_cloud_3", 100, laserCloudFullResHandler);
-
 	pubLaserCloudSurround = nh.advertise<sensor_msgs::PointCloud2>("/laser_cloud_surround", 100);
 
 	pubLaserCloudMap = nh.advertise<sensor_msgs::PointCloud2>("/laser_cloud_map", 100);
@@ -925,15 +636,35 @@ int main(int argc, char **argv)
 
 	pubLaserAfterMappedPath = nh.advertise<nav_msgs::Path>("/aft_mapped_path", 100);
 
-	for (int i = 0; i < laserCloudNum; i++)
-	{
-		laserCloudCornerArray[i].reset(new pcl::PointCloud<PointType>());
-		laserCloudSurfArray[i].reset(new pcl::PointCloud<PointType>());
-	}
+	laserCloudCornerMap.reset(new VoxelMap(lineRes, mapSearchRadius));
+	laserCloudSurfMap.reset(new VoxelMap(planeRes, mapSearchRadius));
+
+	return true;
+}
 
-	std::thread mapping_process{process};
+} // namespace laser_mapping
+
+#ifndef ALOAM_PIPELINE
+int main(int argc, char **argv)
+{
+	ros::init(argc, argv, "laserMapping");
+	ros::NodeHandle nh;
+
+	if (!laser_mapping::setup(nh))
+		return 0;
+
+	ros::Subscriber subLaserCloudCornerLast = nh.subscribe<sensor_msgs::PointCloud2>("/laser_cloud_corner_last", 100, laser_mapping::laserCloudCornerLastHandler);
+
+	ros::Subscriber subLaserCloudSurfLast = nh.subscribe<sensor_msgs::PointCloud2>("/laser_cloud_surf_last", 100, laser_mapping::laserCloudSurfLastHandler);
+
+	ros::Subscriber subLaserOdometry = nh.subscribe<nav_msgs::Odometry>("/laser_odom_to_init", 100, laser_mapping::laserOdometryHandler);
+
+	ros::Subscriber subLaserCloudFullRes = nh.subscribe<sensor_msgs::PointCloud2>("/velodyne_cloud_3", 100, laser_mapping::laserCloudFullResHandler);
+
+	std::thread mapping_process{laser_mapping::process};
 
 	ros::spin();
 
 	return 0;
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
@@ -51,13 +51,20 @@
 #include <eigen3/Eigen/Dense>
 #include <mutex>
 #include <queue>
+#include <string>
+#include <vector>
+#include <algorithm>
 
 #include "aloam_velodyne/common.h"
+#include "aloam_velodyne/deskew_table.h"
 #include "aloam_velodyne/tic_toc.h"
+#include "aloam_velodyne/pipeline.h"
 #include "lidarFactor.hpp"
 
 #define DISTORTION 0
 
+namespace laser_odometry
+{
 
 int corner_correspondence = 0, plane_correspondence = 0;
 
@@ -66,6 +73,8 @@ constexpr double DISTANCE_SQ_THRESHOLD = 25;
 constexpr double NEARBY_SCAN = 2.5;
 
 int skipFrameNum = 5;
+int numThreads = 1;
+ceres::LinearSolverType linearSolverType = ceres::DENSE_QR;
 bool systemInited = false;
 
 double timeCornerPointsSharp = 0;
@@ -107,44 +116,233 @@ std::queue<sensor_msgs::PointCloud2ConstPtr> surfLessFlatBuf;
 std::queue<sensor_msgs::PointCloud2ConstPtr> fullPointsBuf;
 std::mutex mBuf;
 
-// undistort lidar point
-void TransformToStart(PointType const *const pi, PointType *const po)
+ros::Publisher pubLaserCloudCornerLast, pubLaserCloudSurfLast, pubLaserCloudFullRes, pubLaserOdometry, pubLaserPath;
+
+nav_msgs::Path laserPath;
+
+int frameCount = 0;
+
+std::function<void(const OdometryFrame &)> odometryFrameSink;
+
+// undistort lidar points, in blocks through the pose table of the frame motion
+loam::DeskewTable<PointType> deskewTable;
+pcl::PointCloud<PointType> cornerPointsSel;
+pcl::PointCloud<PointType> surfPointsSel;
+
+void TransformToStart(const pcl::PointCloud<PointType> &cloud_in, pcl::PointCloud<PointType> &cloud_out)
 {
-    //interpolation ratio
-    double s;
     if (DISTORTION)
-        s = (pi->intensity - int(pi->intensity)) / SCAN_PERIOD;
+        deskewTable.setMotion(q_last_curr, t_last_curr, SCAN_PERIOD, loam::DeskewTable<PointType>::START);
     else
-        s = 1.0;
-    //s = 1;
-    Eigen::Quaterniond q_point_last = Eigen::Quaterniond::Identity().slerp(s, q_last_curr);
-    Eigen::Vector3d t_point_last = s * t_last_curr;
-    Eigen::Vector3d point(pi->x, pi->y, pi->z);
-    Eigen::Vector3d un_point = q_point_last * point + t_point_last;
-
-    po->x = un_point.x();
-    po->y = un_point.y();
-    po->z = un_point.z();
-    po->intensity = pi->intensity;
+        deskewTable.setTransform(q_last_curr, t_last_curr);
+    deskewTable.apply(cloud_in, cloud_out);
 }
 
 // transform all lidar points to the start of the next frame
 
-void TransformToEnd(PointType const *const pi, PointType *const po)
+void TransformToEnd(pcl::PointCloud<PointType> &cloud)
 {
-    // undistort point first
-    pcl::PointXYZI un_point_tmp;
-    TransformToStart(pi, &un_point_tmp);
+    // without distortion the points already are at the end of the frame
+    if (DISTORTION)
+        deskewTable.setMotion(q_last_curr, t_last_curr, SCAN_PERIOD, loam::DeskewTable<PointType>::END);
+    else
+        deskewTable.setTransform(Eigen::Quaterniond::Identity(), Eigen::Vector3d::Zero());
 
-    Eigen::Vector3d un_point(un_point_tmp.x, un_point_tmp.y, un_point_tmp.z);
-    Eigen::Vector3d point_end = q_last_curr.inverse() * (un_point - t_last_curr);
+    //Remove distortion time info
+    deskewTable.apply(cloud, cloud, true);
+}
 
-    po->x = point_end.x();
-    po->y = point_end.y();
-    po->z = point_end.z();
+struct EdgeCorrespondence
+{
+    Eigen::Vector3d curr_point, last_point_a, last_point_b;
+    double s;
+};
 
-    //Remove distortion time info
-    po->intensity = int(pi->intensity);
+struct PlaneCorrespondence
+{
+    Eigen::Vector3d curr_point, last_point_a, last_point_b, last_point_c;
+    double s;
+};
+
+// closest edge line in the last sweep, two points on nearby scan lines
+bool findEdgeCorrespondence(const PointType &point, const PointType &pointSel, EdgeCorrespondence &correspondence)
+{
+    std::vector<int> pointSearchInd;
+    std::vector<float> pointSearchSqDis;
+
+    kdtreeCornerLast->nearestKSearch(pointSel, 1, pointSearchInd, pointSearchSqDis);
+
+    int closestPointInd = -1, minPointInd2 = -1;
+    if (pointSearchSqDis[0] < DISTANCE_SQ_THRESHOLD)
+    {
+        closestPointInd = pointSearchInd[0];
+        int closestPointScanID = int(laserCloudCornerLast->points[closestPointInd].intensity);
+
+        double minPointSqDis2 = DISTANCE_SQ_THRESHOLD;
+        // search in the direction of increasing scan line
+        for (int j = closestPointInd + 1; j < (int)laserCloudCornerLast->points.size(); ++j)
+        {
+            // if in the same scan line, continue
+            if (int(laserCloudCornerLast->points[j].intensity) <= closestPointScanID)
+                continue;
+
+            // if not in nearby scans, end the loop
+            if (int(laserCloudCornerLast->points[j].intensity) > (closestPointScanID + NEARBY_SCAN))
+                break;
+
+            double pointSqDis = (laserCloudCornerLast->points[j].x - pointSel.x) *
+                                    (laserCloudCornerLast->points[j].x - pointSel.x) +
+                                (laserCloudCornerLast->points[j].y - pointSel.y) *
+                                    (laserCloudCornerLast->points[j].y - pointSel.y) +
+                                (laserCloudCornerLast->points[j].z - pointSel.z) *
+                                    (laserCloudCornerLast->points[j].z - pointSel.z);
+
+            if (pointSqDis < minPointSqDis2)
+            {
+                // find nearer point
+                minPointSqDis2 = pointSqDis;
+                minPointInd2 = j;
+            }
+        }
+
+        // search in the direction of decreasing scan line
+        for (int j = closestPointInd - 1; j >= 0; --j)
+        {
+            // if in the same scan line, continue
+            if (int(laserCloudCornerLast->points[j].intensity) >= closestPointScanID)
+                continue;
+
+            // if not in nearby scans, end the loop
+            if (int(laserCloudCornerLast->points[j].intensity) < (closestPointScanID - NEARBY_SCAN))
+                break;
+
+            double pointSqDis = (laserCloudCornerLast->points[j].x - pointSel.x) *
+                                    (laserCloudCornerLast->points[j].x - pointSel.x) +
+                                (laserCloudCornerLast->points[j].y - pointSel.y) *
+                                    (laserCloudCornerLast->points[j].y - pointSel.y) +
+                                (laserCloudCornerLast->points[j].z - pointSel.z) *
+                                    (laserCloudCornerLast->points[j].z - pointSel.z);
+
+            if (pointSqDis < minPointSqDis2)
+            {
+                // find nearer point
+                minPointSqDis2 = pointSqDis;
+                minPointInd2 = j;
+            }
+        }
+    }
+    if (minPointInd2 < 0) // both closestPointInd and minPointInd2 must be valid
+        return false;
+
+    correspondence.curr_point = Eigen::Vector3d(point.x, point.y, point.z);
+    correspondence.last_point_a = Eigen::Vector3d(laserCloudCornerLast->points[closestPointInd].x,
+                                                  laserCloudCornerLast->points[closestPointInd].y,
+                                                  laserCloudCornerLast->points[closestPointInd].z);
+    correspondence.last_point_b = Eigen::Vector3d(laserCloudCornerLast->points[minPointInd2].x,
+                                                  laserCloudCornerLast->points[minPointInd2].y,
+                                                  laserCloudCornerLast->points[minPointInd2].z);
+
+    if (DISTORTION)
+        correspondence.s = (point.intensity - int(point.intensity)) / SCAN_PERIOD;
+    else
+        correspondence.s = 1.0;
+
+    return true;
+}
+
+// closest plane in the last sweep, one point on the same or lower and one on a higher scan line
+bool findPlaneCorrespondence(const PointType &point, const PointType &pointSel, PlaneCorrespondence &correspondence)
+{
+    std::vector<int> pointSearchInd;
+    std::vector<float> pointSearchSqDis;
+
+    kdtreeSurfLast->nearestKSearch(pointSel, 1, pointSearchInd, pointSearchSqDis);
+
+    int closestPointInd = -1, minPointInd2 = -1, minPointInd3 = -1;
+    if (pointSearchSqDis[0] < DISTANCE_SQ_THRESHOLD)
+    {
+        closestPointInd = pointSearchInd[0];
+
+        // get closest point's scan ID
+        int closestPointScanID = int(laserCloudSurfLast->points[closestPointInd].intensity);
+        double minPointSqDis2 = DISTANCE_SQ_THRESHOLD, minPointSqDis3 = DISTANCE_SQ_THRESHOLD;
+
+        // search in the direction of increasing scan line
+        for (int j = closestPointInd + 1; j < (int)laserCloudSurfLast->points.size(); ++j)
+        {
+            // if not in nearby scans, end the loop
+            if (int(laserCloudSurfLast->points[j].intensity) > (closestPointScanID + NEARBY_SCAN))
+                break;
+
+            double pointSqDis = (laserCloudSurfLast->points[j].x - pointSel.x) *
+                                    (laserCloudSurfLast->points[j].x - pointSel.x) +
+                                (laserCloudSurfLast->points[j].y - pointSel.y) *
+                                    (laserCloudSurfLast->points[j].y - pointSel.y) +
+                                (laserCloudSurfLast->points[j].z - pointSel.z) *
+                                    (laserCloudSurfLast->points[j].z - pointSel.z);
+
+            // if in the same or lower scan line
+            if (int(laserCloudSurfLast->points[j].intensity) <= closestPointScanID && pointSqDis < minPointSqDis2)
+            {
+                minPointSqDis2 = pointSqDis;
+                minPointInd2 = j;
+            }
+            // if in the higher scan line
+            else if (int(laserCloudSurfLast->points[j].intensity) > closestPointScanID && pointSqDis < minPointSqDis3)
+            {
+                minPointSqDis3 = pointSqDis;
+                minPointInd3 = j;
+            }
+        }
+
+        // search in the direction of decreasing scan line
+        for (int j = closestPointInd - 1; j >= 0; --j)
+        {
+            // if not in nearby scans, end the loop
+            if (int(laserCloudSurfLast->points[j].intensity) < (closestPointScanID - NEARBY_SCAN))
+                break;
+
+            double pointSqDis = (laserCloudSurfLast->points[j].x - pointSel.x) *
+                                    (laserCloudSurfLast->points[j].x - pointSel.x) +
+                                (laserCloudSurfLast->points[j].y - pointSel.y) *
+                                    (laserCloudSurfLast->points[j].y - pointSel.y) +
+                                (laserCloudSurfLast->points[j].z - pointSel.z) *
+                                    (laserCloudSurfLast->points[j].z - pointSel.z);
+
+            // if in the same or higher scan line
+            if (int(laserCloudSurfLast->points[j].intensity) >= closestPointScanID && pointSqDis < minPointSqDis2)
+            {
+                minPointSqDis2 = pointSqDis;
+                minPointInd2 = j;
+            }
+            else if (int(laserCloudSurfLast->points[j].intensity) < closestPointScanID && pointSqDis < minPointSqDis3)
+            {
+                // find nearer point
+                minPointSqDis3 = pointSqDis;
+                minPointInd3 = j;
+            }
+        }
+    }
+    if (minPointInd2 < 0 || minPointInd3 < 0)
+        return false;
+
+    correspondence.curr_point = Eigen::Vector3d(point.x, point.y, point.z);
+    correspondence.last_point_a = Eigen::Vector3d(laserCloudSurfLast->points[closestPointInd].x,
+                                                  laserCloudSurfLast->points[closestPointInd].y,
+                                                  laserCloudSurfLast->points[closestPointInd].z);
+    correspondence.last_point_b = Eigen::Vector3d(laserCloudSurfLast->points[minPointInd2].x,
+                                                  laserCloudSurfLast->points[minPointInd2].y,
+                                                  laserCloudSurfLast->points[minPointInd2].z);
+    correspondence.last_point_c = Eigen::Vector3d(laserCloudSurfLast->points[minPointInd3].x,
+                                                  laserCloudSurfLast->points[minPointInd3].y,
+                                                  laserCloudSurfLast->points[minPointInd3].z);
+
+    if (DISTORTION)
+        correspondence.s = (point.intensity - int(point.intensity)) / SCAN_PERIOD;
+    else
+        correspondence.s = 1.0;
+
+    return true;
 }
 
 void laserCloudSharpHandler(const sensor_msgs::PointCloud2ConstPtr &cornerPointsSharp2)
@@ -183,420 +381,317 @@ void laserCloudFullResHandler(const sensor_msgs::PointCloud2ConstPtr &laserCloud
     mBuf.unlock();
 }
 
-int main(int argc, char **argv)
+void pushScanFrame(const ScanFrame &frame)
 {
-    ros::init(argc, argv, "laserOdometry");
-    ros::NodeHandle nh;
+    laserCloudSharpHandler(frame.cornerSharp);
+    laserCloudLessSharpHandler(frame.cornerLessSharp);
+    laserCloudFlatHandler(frame.surfFlat);
+    laserCloudLessFlatHandler(frame.surfLessFlat);
+    laserCloudFullResHandler(frame.fullRes);
+}
 
-    nh.param<int>("mapping_skip_frame", skipFrameNum, 2);
+void odometryStep()
+{
+    if (!cornerSharpBuf.empty() && !cornerLessSharpBuf.empty() &&
+        !surfFlatBuf.empty() && !surfLessFlatBuf.empty() &&
+        !fullPointsBuf.empty())
+    {
+        timeCornerPointsSharp = cornerSharpBuf.front()->header.stamp.toSec();
+        timeCornerPointsLessSharp = cornerLessSharpBuf.front()->header.stamp.toSec();
+        timeSurfPointsFlat = surfFlatBuf.front()->header.stamp.toSec();
+        timeSurfPointsLessFlat = surfLessFlatBuf.front()->header.stamp.toSec();
+        timeLaserCloudFullRes = fullPointsBuf.front()->header.stamp.toSec();
+
+        if (timeCornerPointsSharp != timeLaserCloudFullRes ||
+            timeCornerPointsLessSharp != timeLaserCloudFullRes ||
+            timeSurfPointsFlat != timeLaserCloudFullRes ||
+            timeSurfPointsLessFlat != timeLaserCloudFullRes)
+        {
+            printf("unsync messeage!");
+            ROS_BREAK();
+        }
 
-    printf("Mapping %d Hz \n", 10 / skipFrameNum);
+        mBuf.lock();
+        cornerPointsSharp->clear();
+        pcl::fromROSMsg(*cornerSharpBuf.front(), *cornerPointsSharp);
+        cornerSharpBuf.pop();
 
-    ros::Subscriber subCornerPointsSharp = nh.subscribe<sensor_msgs::PointCloud2>("/laser_cloud_sharp", 100, laserCloudSharpHandler);
+        cornerPointsLessSharp->clear();
+        pcl::fromROSMsg(*cornerLessSharpBuf.front(), *cornerPointsLessSharp);
+        cornerLessSharpBuf.pop();
 
-    ros::Subscriber subCornerPointsLessSharp = nh.subscribe<sensor_msgs::PointCloud2>("/laser_cloud_less_sharp", 100, laserCloudLessSharpHandler);
+        surfPointsFlat->clear();
+        pcl::fromROSMsg(*surfFlatBuf.front(), *surfPointsFlat);
+        surfFlatBuf.pop();
 
-    ros::Subscriber subSurfPointsFlat = nh.subscribe<sensor_msgs::PointCloud2>("/laser_cloud_flat", 100, laserCloudFlatHandler);
+        surfPointsLessFlat->clear();
+        pcl::fromROSMsg(*surfLessFlatBuf.front(), *surfPointsLessFlat);
+        surfLessFlatBuf.pop();
 
-    ros::Subscriber subSurfPointsLessFlat = nh.subscribe<sensor_msgs::PointCloud2>("/laser_cloud_less_flat", 100, laserCloudLessFlatHandler);
+        laserCloudFullRes->clear();
+        pcl::fromROSMsg(*fullPointsBuf.front(), *laserCloudFullRes);
+        fullPointsBuf.pop();
+        mBuf.unlock();
 
-    ros::Subscriber subLaserCloudFullRes = nh.subscribe<sensor_msgs::PointCloud2>("/velodyne_cloud_2", 100, laserCloudFullResHandler);
+        TicToc t_whole;
+        // initializing
+        if (!systemInited)
+        {
+            systemInited = true;
+            std::cout << "Initialization finished \n";
+        }
+        else
+        {
+            int cornerPointsSharpNum = cornerPointsSharp->points.size();
+            int surfPointsFlatNum = surfPointsFlat->points.size();
 
-    ros::Publisher pubLaserCloudCornerLast = nh.advertise<sensor_msgs::PointCloud2>("/laser_cloud_corner_last", 100);
+            TicToc t_opt;
+            for (size_t opti_counter = 0; opti_counter < 2; ++opti_counter)
+            {
+                corner_correspondence = 0;
+                plane_correspondence = 0;
+
+                //ceres::LossFunction *loss_function = NULL;
+                ceres::LossFunction *loss_function = new ceres::HuberLoss(0.1);
+                ceres::LocalParameterization *q_parameterization =
+                    new ceres::EigenQuaternionParameterization();
+                ceres::Problem::Options problem_options;
+
+                ceres::Problem problem(problem_options);
+                problem.AddParameterBlock(para_q, 4, q_parameterization);
+                problem.AddParameterBlock(para_t, 3);
+
+                TicToc t_data;
+                // feature points at the start of the frame, with the current estimate of its motion
+                TransformToStart(*cornerPointsSharp, cornerPointsSel);
+                TransformToStart(*surfPointsFlat, surfPointsSel);
+
+                // find correspondences in parallel, one slot per feature point keeps the residual order of the serial search
+                std::vector<EdgeCorrespondence> edgeCorrespondences(cornerPointsSharpNum);
+                std::vector<char> hasEdgeCorrespondence(cornerPointsSharpNum, 0);
+                #pragma omp parallel for num_threads(numThreads) schedule(static)
+                for (int i = 0; i < cornerPointsSharpNum; ++i)
+                {
+                    hasEdgeCorrespondence[i] = findEdgeCorrespondence(cornerPointsSharp->points[i], cornerPointsSel.points[i], edgeCorrespondences[i]);
+                }
 
-    ros::Publisher pubLaserCloudSurfLast = nh.advertise<sensor_msgs::PointCloud2>("/laser_cloud_surf_last", 100);
+                std::vector<PlaneCorrespondence> planeCorrespondences(surfPointsFlatNum);
+                std::vector<char> hasPlaneCorrespondence(surfPointsFlatNum, 0);
+                #pragma omp parallel for num_threads(numThreads) schedule(static)
+                for (int i = 0; i < surfPointsFlatNum; ++i)
+                {
+                    hasPlaneCorrespondence[i] = findPlaneCorrespondence(surfPointsFlat->points[i], surfPointsSel.points[i], planeCorrespondences[i]);
+                }
 
-    ros::Publisher pubLaserCloudFullRes = nh.advertise<sensor_msgs::PointCloud2>("/velodyne_cloud_3", 100);
+                for (int i = 0; i < cornerPointsSharpNum; ++i)
+                {
+                    if (!hasEdgeCorrespondence[i])
+                        continue;
+
+                    const EdgeCorrespondence &c = edgeCorrespondences[i];
+                    ceres::CostFunction *cost_function;
+                    // jacobians of the interpolated pose are left to autodiff
+                    if (c.s == 1.0)
+                        cost_function = new LidarEdgeAnalyticFactor(c.curr_point, c.last_point_a, c.last_point_b);
+                    else
+                        cost_function = LidarEdgeFactor::Create(c.curr_point, c.last_point_a, c.last_point_b, c.s);
+                    problem.AddResidualBlock(cost_function, loss_function, para_q, para_t);
+                    corner_correspondence++;
+                }
 
-    ros::Publisher pubLaserOdometry = nh.advertise<nav_msgs::Odometry>("/laser_odom_to_init", 100);
+                for (int i = 0; i < surfPointsFlatNum; ++i)
+                {
+                    if (!hasPlaneCorrespondence[i])
+                        continue;
+
+                    const PlaneCorrespondence &c = planeCorrespondences[i];
+                    ceres::CostFunction *cost_function;
+                    if (c.s == 1.0)
+                        cost_function = new LidarPlaneAnalyticFactor(c.curr_point, c.last_point_a, c.last_point_b, c.last_point_c);
+                    else
+                        cost_function = LidarPlaneFactor::Create(c.curr_point, c.last_point_a, c.last_point_b, c.last_point_c, c.s);
+                    problem.AddResidualBlock(cost_function, loss_function, para_q, para_t);
+                    plane_correspondence++;
+                }
 
-    ros::Publisher pubLaserPath = nh.advertise<nav_msgs::Path>("/laser_odom_path", 100);
+                //printf("coner_correspondance %d, plane_correspondence %d \n", corner_correspondence, plane_correspondence);
+                printf("data association time %f ms \n", t_data.toc());
 
-    nav_msgs::Path laserPath;
+                if ((corner_correspondence + plane_correspondence) < 10)
+                {
+                    printf("less correspondence! *************************************************\n");
+                }
 
-    int frameCount = 0;
-    ros::Rate rate(100);
+                TicToc t_solver;
+                ceres::Solver::Options options;
+                options.linear_solver_type = linearSolverType;
+                options.num_threads = numThreads;
+                options.max_num_iterations = 4;
+                options.minimizer_progress_to_stdout = false;
+                ceres::Solver::Summary summary;
+                ceres::Solve(options, &problem, &summary);
+                printf("solver time %f ms \n", t_solver.toc());
+            }
+            printf("optimization twice time %f \n", t_opt.toc());
 
-    while (ros::ok())
-    {
-        ros::spinOnce();
+            t_w_curr = t_w_curr + q_w_curr * t_last_curr;
+            q_w_curr = q_w_curr * q_last_curr;
+        }
 
-        if (!cornerSharpBuf.empty() && !cornerLessSharpBuf.empty() &&
-            !surfFlatBuf.empty() && !surfLessFlatBuf.empty() &&
-            !fullPointsBuf.empty())
+        TicToc t_pub;
+
+        // publish odometry
+        nav_msgs::OdometryPtr laserOdometry(new nav_msgs::Odometry());
+        laserOdometry->header.frame_id = "/camera_init";
+        laserOdometry->child_frame_id = "/laser_odom";
+        laserOdometry->header.stamp = ros::Time().fromSec(timeSurfPointsLessFlat);
+        laserOdometry->pose.pose.orientation.x = q_w_curr.x();
+        laserOdometry->pose.pose.orientation.y = q_w_curr.y();
+        laserOdometry->pose.pose.orientation.z = q_w_curr.z();
+        laserOdometry->pose.pose.orientation.w = q_w_curr.w();
+        laserOdometry->pose.pose.position.x = t_w_curr.x();
+        laserOdometry->pose.pose.position.y = t_w_curr.y();
+        laserOdometry->pose.pose.position.z = t_w_curr.z();
+        pubLaserOdometry.publish(laserOdometry);
+
+        geometry_msgs::PoseStamped laserPose;
+        laserPose.header = laserOdometry->header;
+        laserPose.pose = laserOdometry->pose.pose;
+        laserPath.header.stamp = laserOdometry->header.stamp;
+        laserPath.poses.push_back(laserPose);
+        laserPath.header.frame_id = "/camera_init";
+        pubLaserPath.publish(laserPath);
+
+        // transform corner features and plane features to the scan end point
+        if (0)
         {
-            timeCornerPointsSharp = cornerSharpBuf.front()->header.stamp.toSec();
-            timeCornerPointsLessSharp = cornerLessSharpBuf.front()->header.stamp.toSec();
-            timeSurfPointsFlat = surfFlatBuf.front()->header.stamp.toSec();
-            timeSurfPointsLessFlat = surfLessFlatBuf.front()->header.stamp.toSec();
-            timeLaserCloudFullRes = fullPointsBuf.front()->header.stamp.toSec();
-
-            if (timeCornerPointsSharp != timeLaserCloudFullRes ||
-                timeCornerPointsLessSharp != timeLaserCloudFullRes ||
-                timeSurfPointsFlat != timeLaserCloudFullRes ||
-                timeSurfPointsLessFlat != timeLaserCloudFullRes)
-            {
-                printf("unsync messeage!");
-                ROS_BREAK();
-            }
+            TransformToEnd(*cornerPointsLessSharp);
+            TransformToEnd(*surfPointsLessFlat);
+            TransformToEnd(*laserCloudFullRes);
+        }
 
-            mBuf.lock();
-            cornerPointsSharp->clear();
-            pcl::fromROSMsg(*cornerSharpBuf.front(), *cornerPointsSharp);
-            cornerSharpBuf.pop();
+        pcl::PointCloud<PointType>::Ptr laserCloudTemp = cornerPointsLessSharp;
+        cornerPointsLessSharp = laserCloudCornerLast;
+        laserCloudCornerLast = laserCloudTemp;
 
-            cornerPointsLessSharp->clear();
-            pcl::fromROSMsg(*cornerLessSharpBuf.front(), *cornerPointsLessSharp);
-            cornerLessSharpBuf.pop();
+        laserCloudTemp = surfPointsLessFlat;
+        surfPointsLessFlat = laserCloudSurfLast;
+        laserCloudSurfLast = laserCloudTemp;
 
-            surfPointsFlat->clear();
-            pcl::fromROSMsg(*surfFlatBuf.front(), *surfPointsFlat);
-            surfFlatBuf.pop();
+        laserCloudCornerLastNum = laserCloudCornerLast->points.size();
+        laserCloudSurfLastNum = laserCloudSurfLast->points.size();
 
-            surfPointsLessFlat->clear();
-            pcl::fromROSMsg(*surfLessFlatBuf.front(), *surfPointsLessFlat);
-            surfLessFlatBuf.pop();
+        // std::cout << "the size of corner last is " << laserCloudCornerLastNum << ", and the size of surf last is " << laserCloudSurfLastNum << '\n';
 
-            laserCloudFullRes->clear();
-            pcl::fromROSMsg(*fullPointsBuf.front(), *laserCloudFullRes);
-            fullPointsBuf.pop();
-            mBuf.unlock();
+        kdtreeCornerLast->setInputCloud(laserCloudCornerLast);
+        kdtreeSurfLast->setInputCloud(laserCloudSurfLast);
 
-            TicToc t_whole;
-            // initializing
-            if (!systemInited)
-            {
-                systemInited = true;
-                std::cout << "Initialization finished \n";
-            }
-            else
-            {
-                int cornerPointsSharpNum = cornerPointsSharp->points.size();
-                int surfPointsFlatNum = surfPointsFlat->points.size();
+        OdometryFrame frame;
+        frame.odometry = laserOdometry;
 
-                TicToc t_opt;
-                for (size_t opti_counter = 0; opti_counter < 2; ++opti_counter)
-                {
-                    corner_correspondence = 0;
-                    plane_correspondence = 0;
-
-                    //ceres::LossFunction *loss_function = NULL;
-                    ceres::LossFunction *loss_function = new ceres::HuberLoss(0.1);
-                    ceres::LocalParameterization *q_parameterization =
-                        new ceres::EigenQuaternionParameterization();
-                    ceres::Problem::Options problem_options;
-
-                    ceres::Problem problem(problem_options);
-                    problem.AddParameterBlock(para_q, 4, q_parameterization);
-                    problem.AddParameterBlock(para_t, 3);
-
-                    pcl::PointXYZI pointSel;
-                    std::vector<int> pointSearchInd;
-                    std::vector<float> pointSearchSqDis;
-
-                    TicToc t_data;
-                    // find correspondence for corner features
-                    for (int i = 0; i < cornerPointsSharpNum; ++i)
-                    {
-                        TransformToStart(&(cornerPointsSharp->points[i]), &pointSel);
-                        kdtreeCornerLast->nearestKSearch(pointSel, 1, pointSearchInd, pointSearchSqDis);
-
-                        int closestPointInd = -1, minPointInd2 = -1;
-                        if (pointSearchSqDis[0] < DISTANCE_SQ_THRESHOLD)
-                        {
-                            closestPointInd = pointSearchInd[0];
-                            int closestPointScanID = int(laserCloudCornerLast->points[closestPointInd].intensity);
-
-                            double minPointSqDis2 = DISTANCE_SQ_THRESHOLD;
-                            // search in the direction of increasing scan line
-                            for (int j = closestPointInd + 1; j < (int)laserCloudCornerLast->points.size(); ++j)
-                            {
-                                // if in the same scan line, continue
-                                if (int(laserCloudCornerLast->points[j].intensity) <= closestPointScanID)
-                                    continue;
-
-                                // if not in nearby scans, end the loop
-                                if (int(laserCloudCornerLast->points[j].intensity) > (closestPointScanID + NEARBY_SCAN))
-                                    break;
-
-                                double pointSqDis = (laserCloudCornerLast->points[j].x - pointSel.x) *
-                                                        (laserCloudCornerLast->points[j].x - pointSel.x) +
-                                                    (laserCloudCornerLast->points[j].y - pointSel.y) *
-                                                        (laserCloudCornerLast->points[j].y - pointSel.y) +
-                                                    (laserCloudCornerLast->points[j].z - pointSel.z) *
-                                                        (laserCloudCornerLast->points[j].z - pointSel.z);
-
-                                if (pointSqDis < minPointSqDis2)
-                                {
-                                    // find nearer point
-                                    minPointSqDis2 = pointSqDis;
-                                    minPointInd2 = j;
-                                }
-                            }
-
-                            // search in the direction of decreasing scan line
-                            for (int j = closestPointInd - 1; j >= 0; --j)
-                            {
-                                // if in the same scan line, continue
-                                if (int(laserCloudCornerLast->points[j].intensity) >= closestPointScanID)
-                                    continue;
-
-                                // if not in nearby scans, end the loop
-                                if (int(laserCloudCornerLast->points[j].intensity) < (closestPointScanID - NEARBY_SCAN))
-                                    break;
-
-                                double pointSqDis = (laserCloudCornerLast->points[j].x - pointSel.x) *
-                                                        (laserCloudCornerLast->points[j].x - pointSel.x) +
-                                                    (laserCloudCornerLast->points[j].y - pointSel.y) *
-                                                        (laserCloudCornerLast->points[j].y - pointSel.y) +
-                                                    (laserCloudCornerLast->points[j].z - pointSel.z) *
-                                                        (laserCloudCornerLast->points[j].z - pointSel.z);
-
-                                if (pointSqDis < minPointSqDis2)
-                                {
-                                    // find nearer point
-                                    minPointSqDis2 = pointSqDis;
-                                    minPointInd2 = j;
-                                }
-                            }
-                        }
-                        if (minPointInd2 >= 0) // both closestPointInd and minPointInd2 is valid
-                        {
-                            Eigen::Vector3d curr_point(cornerPointsSharp->points[i].x,
-                                                       cornerPointsSharp->points[i].y,
-                                                       cornerPointsSharp->points[i].z);
-                            Eigen::Vector3d last_point_a(laserCloudCornerLast->points[closestPointInd].x,
-                                                         laserCloudCornerLast->points[closestPointInd].y,
-                                                         laserCloudCornerLast->points[closestPointInd].z);
-                            Eigen::Vector3d last_point_b(laserCloudCornerLast->points[minPointInd2].x,
-                                                         laserCloudCornerLast->points[minPointInd2].y,
-                                                         laserCloudCornerLast->points[minPointInd2].z);
-
-                            double s;
-                            if (DISTORTION)
-                                s = (cornerPointsSharp->points[i].intensity - int(cornerPointsSharp->points[i].intensity)) / SCAN_PERIOD;
-                            else
-                                s = 1.0;
-                            ceres::CostFunction *cost_function = LidarEdgeFactor::Create(curr_point, last_point_a, last_point_b, s);
-                            problem.AddResidualBlock(cost_function, loss_function, para_q, para_t);
-                            corner_correspondence++;
-                        }
-                    }
-
-                    // find correspondence for plane features
-                    for (int i = 0; i < surfPointsFlatNum; ++i)
-                    {
-                        TransformToStart(&(surfPointsFlat->points[i]), &pointSel);
-                        kdtreeSurfLast->nearestKSearch(pointSel, 1, pointSearchInd, pointSearchSqDis);
-
-                        int closestPointInd = -1, minPointInd2 = -1, minPointInd3 = -1;
-                        if (pointSearchSqDis[0] < DISTANCE_SQ_THRESHOLD)
-                        {
-                            closestPointInd = pointSearchInd[0];
-
-                            // get closest point's scan ID
-                            int closestPointScanID = int(laserCloudSurfLast->points[closestPointInd].intensity);
-                            double minPointSqDis2 = DISTANCE_SQ_THRESHOLD, minPointSqDis3 = DISTANCE_SQ_THRESHOLD;
-
-                            // search in the direction of increasing scan line
-                            for (int j = closestPointInd + 1; j < (int)laserCloudSurfLast->points.size(); ++j)
-                            {
-                                // if not in nearby scans, end the loop
-                                if (int(laserCloudSurfLast->points[j].intensity) > (closestPointScanID + NEARBY_SCAN))
-                                    break;
-
-                                double pointSqDis = (laserCloudSurfLast->points[j].x - pointSel.x) *
-                                                        (laserCloudSurfLast->points[j].x - pointSel.x) +
-                                                    (laserCloudSurfLast->points[j].y - pointSel.y) *
-                                                        (laserCloudSurfLast->points[j].y - pointSel.y) +
-                                                    (laserCloudSurfLast->points[j].z - pointSel.z) *
-                                                        (laserCloudSurfLast->points[j].z - pointSel.z);
-
-                                // if in the same or lower scan line
-                                if (int(laserCloudSurfLast->points[j].intensity) <= closestPointScanID && pointSqDis < minPointSqDis2)
-                                {
-                                    minPointSqDis2 = pointSqDis;
-                                    minPointInd2 = j;
-                                }
-                                // if in the higher scan line
-                                else if (int(laserCloudSurfLast->points[j].intensity) > closestPointScanID && pointSqDis < minPointSqDis3)
-                                {
-                                    minPointSqDis3 = pointSqDis;
-                                    minPointInd3 = j;
-                                }
-                            }
-
-                            // search in the direction of decreasing scan line
-                            for (int j = closestPointInd - 1; j >= 0; --j)
-                            {
-                                // if not in nearby scans, end the loop
-                                if (int(laserCloudSurfLast->points[j].intensity) < (closestPointScanID - NEARBY_SCAN))
-                                    break;
-
-                                double pointSqDis = (laserCloudSurfLast->points[j].x - pointSel.x) *
-                                                        (laserCloudSurfLast->points[j].x - pointSel.x) +
-                                                    (laserCloudSurfLast->points[j].y - pointSel.y) *
-                                                        (laserCloudSurfLast->points[j].y - pointSel.y) +
-                                                    (laserCloudSurfLast->points[j].z - pointSel.z) *
-                                                        (laserCloudSurfLast->points[j].z - pointSel.z);
-
-                                // if in the same or higher scan line
-                                if (int(laserCloudSurfLast->points[j].intensity) >= closestPointScanID && pointSqDis < minPointSqDis2)
-                                {
-                                    minPointSqDis2 = pointSqDis;
-                                    minPointInd2 = j;
-                                }
-                                else if (int(laserCloudSurfLast->points[j].intensity) < closestPointScanID && pointSqDis < minPointSqDis3)
-                                {
-                                    // find nearer point
-                                    minPointSqDis3 = pointSqDis;
-                                    minPointInd3 = j;
-                                }
-                            }
-
-                            if (minPointInd2 >= 0 && minPointInd3 >= 0)
-                            {
-
-                                Eigen::Vector3d curr_point(surfPointsFlat->points[i].x,
-                                                            surfPointsFlat->points[i].y,
-                                                            surfPointsFlat->points[i].z);
-                                Eigen::Vector3d last_point_a(laserCloudSurfLast->points[closestPointInd].x,
-                                                                laserCloudSurfLast->points[closestPointInd].y,
-                                                                laserCloudSurfLast->points[closestPointInd].z);
-                                Eigen::Vector3d last_point_b(laserCloudSurfLast->points[minPointInd2].x,
-                                                                laserCloudSurfLast->points[minPointInd2].y,
-                                                                laserCloudSurfLast->points[minPointInd2].z);
-                                Eigen::Vector3d last_point_c(laserCloudSurfLast->points[minPointInd3].x,
-                                                                laserCloudSurfLast->points[minPointInd3].y,
-                                                                laserCloudSurfLast->points[minPointInd3].z);
-
-                                double s;
-                                if (DISTORTION)
-                                    s = (surfPointsFlat->points[i].intensity - int(surfPointsFlat->points[i].intensity)) / SCAN_PERIOD;
-                                else
-                                    s = 1.0;
-                                ceres::CostFunction *cost_function = LidarPlaneFactor::Create(curr_point, last_point_a, last_point_b, last_point_c, s);
-                                problem.AddResidualBlock(cost_function, loss_function, para_q, para_t);
-                                plane_correspondence++;
-                            }
-                        }
-                    }
-
-                    //printf("coner_correspondance %d, plane_correspondence %d \n", corner_correspondence, plane_correspondence);
-                    printf("data association time %f ms \n", t_data.toc());
-
-                    if ((corner_correspondence + plane_correspondence) < 10)
-                    {
-                        printf("less correspondence! *************************************************\n");
-                    }
-
-                    TicToc t_solver;
-                    ceres::Solver::Options options;
-                    options.linear_solver_type = ceres::DENSE_QR;
-                    options.max_num_iterations = 4;
-                    options.minimizer_progress_to_stdout = false;
-                    ceres::Solver::Summary summary;
-                    ceres::Solve(options, &problem, &summary);
-                    printf("solver time %f ms \n", t_solver.toc());
-                }
-                printf("optimization twice time %f \n", t_opt.toc());
+        if (frameCount % skipFrameNum == 0)
+        {
+            frameCount = 0;
+
+            sensor_msgs::PointCloud2Ptr laserCloudCornerLast2(new sensor_msgs::PointCloud2());
+            pcl::toROSMsg(*laserCloudCornerLast, *laserCloudCornerLast2);
+            laserCloudCornerLast2->header.stamp = ros::Time().fromSec(timeSurfPointsLessFlat);
+            laserCloudCornerLast2->header.frame_id = "/camera";
+            pubLaserCloudCornerLast.publish(laserCloudCornerLast2);
+
+            sensor_msgs::PointCloud2Ptr laserCloudSurfLast2(new sensor_msgs::PointCloud2());
+            pcl::toROSMsg(*laserCloudSurfLast, *laserCloudSurfLast2);
+            laserCloudSurfLast2->header.stamp = ros::Time().fromSec(timeSurfPointsLessFlat);
+            laserCloudSurfLast2->header.frame_id = "/camera";
+            pubLaserCloudSurfLast.publish(laserCloudSurfLast2);
+
+            sensor_msgs::PointCloud2Ptr laserCloudFullRes3(new sensor_msgs::PointCloud2());
+            pcl::toROSMsg(*laserCloudFullRes, *laserCloudFullRes3);
+            laserCloudFullRes3->header.stamp = ros::Time().fromSec(timeSurfPointsLessFlat);
+            laserCloudFullRes3->header.frame_id = "/camera";
+            pubLaserCloudFullRes.publish(laserCloudFullRes3);
+
+            frame.cornerLast = laserCloudCornerLast2;
+            frame.surfLast = laserCloudSurfLast2;
+            frame.fullRes = laserCloudFullRes3;
+        }
 
-                t_w_curr = t_w_curr + q_w_curr * t_last_curr;
-                q_w_curr = q_w_curr * q_last_curr;
-            }
+        // in the pipeline the same messages go straight to the mapping
+        if (odometryFrameSink)
+            odometryFrameSink(frame);
+        printf("publication time %f ms \n", t_pub.toc());
+        printf("whole laserOdometry time %f ms \n \n", t_whole.toc());
+        if(t_whole.toc() > 100)
+            ROS_WARN("odometry process over 100ms");
 
-            TicToc t_pub;
-
-            // publish odometry
-            nav_msgs::Odometry laserOdometry;
-            laserOdometry.header.frame_id = "/camera_init";
-            laserOdometry.child_frame_id = "/laser_odom";
-            laserOdometry.header.stamp = ros::Time().fromSec(timeSurfPointsLessFlat);
-            laserOdometry.pose.pose.orientation.x = q_w_curr.x();
-            laserOdometry.pose.pose.orientation.y = q_w_curr.y();
-            laserOdometry.pose.pose.orientation.z = q_w_curr.z();
-            laserOdometry.pose.pose.orientation.w = q_w_curr.w();
-            laserOdometry.pose.pose.position.x = t_w_curr.x();
-            laserOdometry.pose.pose.position.y = t_w_curr.y();
-            laserOdometry.pose.pose.position.z = t_w_curr.z();
-            pubLaserOdometry.publish(laserOdometry);
-
-            geometry_msgs::PoseStamped laserPose;
-            laserPose.header = laserOdometry.header;
-            laserPose.pose = laserOdometry.pose.pose;
-            laserPath.header.stamp = laserOdometry.header.stamp;
-            laserPath.poses.push_back(laserPose);
-            laserPath.header.frame_id = "/camera_init";
-            pubLaserPath.publish(laserPath);
-
-            // transform corner features and plane features to the scan end point
-            if (0)
-            {
-                int cornerPointsLessSharpNum = cornerPointsLessSharp->points.size();
-                for (int i = 0; i < cornerPointsLessSharpNum; i++)
-                {
-                    TransformToEnd(&cornerPointsLessSharp->points[i], &cornerPointsLessSharp->points[i]);
-                }
+        frameCount++;
+    }
+}
 
-                int surfPointsLessFlatNum = surfPointsLessFlat->points.size();
-                for (int i = 0; i < surfPointsLessFlatNum; i++)
-                {
-                    TransformToEnd(&surfPointsLessFlat->points[i], &surfPointsLessFlat->points[i]);
-                }
+bool setup(ros::NodeHandle &nh)
+{
+    nh.param<int>("mapping_skip_frame", skipFrameNum, 2);
 
-                int laserCloudFullResNum = laserCloudFullRes->points.size();
-                for (int i = 0; i < laserCloudFullResNum; i++)
-                {
-                    TransformToEnd(&laserCloudFullRes->points[i], &laserCloudFullRes->points[i]);
-                }
-            }
+    printf("Mapping %d Hz \n", 10 / skipFrameNum);
+
+    // used by both correspondence search and the solver
+    nh.param<int>("odometry_num_threads", numThreads, 1);
+    numThreads = std::max(numThreads, 1);
 
-            pcl::PointCloud<PointType>::Ptr laserCloudTemp = cornerPointsLessSharp;
-            cornerPointsLessSharp = laserCloudCornerLast;
-            laserCloudCornerLast = laserCloudTemp;
+    // with only the pose blocks, DENSE_QR is usually fastest, SPARSE_SCHUR etc. are there for comparison
+    std::string linearSolver;
+    nh.param<std::string>("odometry_linear_solver", linearSolver, "DENSE_QR");
+    if (!ceres::StringToLinearSolverType(linearSolver, &linearSolverType))
+    {
+        printf("unknown linear solver %s, use DENSE_QR \n", linearSolver.c_str());
+        linearSolverType = ceres::DENSE_QR;
+    }
+    printf("odometry threads %d, linear solver %s \n", numThreads, ceres::LinearSolverTypeToString(linearSolverType));
 
-            laserCloudTemp = surfPointsLessFlat;
-            surfPointsLessFlat = laserCloudSurfLast;
-            laserCloudSurfLast = laserCloudTemp;
+    pubLaserCloudCornerLast = nh.advertise<sensor_msgs::PointCloud2>("/laser_cloud_corner_last", 100);
 
-            laserCloudCornerLastNum = laserCloudCornerLast->points.size();
-            laserCloudSurfLastNum = laserCloudSurfLast->points.size();
+    pubLaserCloudSurfLast = nh.advertise<sensor_msgs::PointCloud2>("/laser_cloud_surf_last", 100);
 
-            // std::cout << "the size of corner last is " << laserCloudCornerLastNum << ", and the size of surf last is " << laserCloudSurfLastNum << '\n';
+    pubLaserCloudFullRes = nh.advertise<sensor_msgs::PointCloud2>("/velodyne_cloud_3", 100);
 
-            kdtreeCornerLast->setInputCloud(laserCloudCornerLast);
-            kdtreeSurfLast->setInputCloud(laserCloudSurfLast);
+    pubLaserOdometry = nh.advertise<nav_msgs::Odometry>("/laser_odom_to_init", 100);
 
-            if (frameCount % skipFrameNum == 0)
-            {
-                frameCount = 0;
-
-                sensor_msgs::PointCloud2 laserCloudCornerLast2;
-                pcl::toROSMsg(*laserCloudCornerLast, laserCloudCornerLast2);
-                laserCloudCornerLast2.header.stamp = ros::Time().fromSec(timeSurfPointsLessFlat);
-                laserCloudCornerLast2.header.frame_id = "/camera";
-                pubLaserCloudCornerLast.publish(laserCloudCornerLast2);
-
-                sensor_msgs::PointCloud2 laserCloudSurfLast2;
-                pcl::toROSMsg(*laserCloudSurfLast, laserCloudSurfLast2);
-                laserCloudSurfLast2.header.stamp = ros::Time().fromSec(timeSurfPointsLessFlat);
-                laserCloudSurfLast2.header.frame_id = "/camera";
-                pubLaserCloudSurfLast.publish(laserCloudSurfLast2);
-
-                sensor_msgs::PointCloud2 laserCloudFullRes3;
-                pcl::toROSMsg(*laserCloudFullRes, laserCloudFullRes3);
-                laserCloudFullRes3.header.stamp = ros::Time().fromSec(timeSurfPointsLessFlat);
-                laserCloudFullRes3.header.frame_id = "/camera";
-                pubLaserCloudFullRes.publish(laserCloudFullRes3);
-            }
-            printf("publication time %f ms \n", t_pub.toc());
-            printf("whole laserOdometry time %f ms \n \n", t_whole.toc());
-            if(t_whole.toc() > 100)
-                ROS_WARN("odometry process over 100ms");
+    pubLaserPath = nh.advertise<nav_msgs::Path>("/laser_odom_path", 100);
+
+    return true;
+}
+
+} // namespace laser_odometry
+
+#ifndef ALOAM_PIPELINE
+int main(int argc, char **argv)
+{
+    ros::init(argc, argv, "laserOdometry");
+    ros::NodeHandle nh;
+
+    if (!laser_odometry::setup(nh))
+        return 0;
+
+    ros::Subscriber subCornerPointsSharp = nh.subscribe<sensor_msgs::PointCloud2>("/laser_cloud_sharp", 100, laser_odometry::laserCloudSharpHandler);
+
+    ros::Subscriber subCornerPointsLessSharp = nh.subscribe<sensor_msgs::PointCloud2>("/laser_cloud_less_sharp", 100, laser_odometry::laserCloudLessSharpHandler);
+
+    ros::Subscriber subSurfPointsFlat = nh.subscribe<sensor_msgs::PointCloud2>("/laser_cloud_flat", 100, laser_odometry::laserCloudFlatHandler);
+
+    ros::Subscriber subSurfPointsLessFlat = nh.subscribe<sensor_msgs::PointCloud2>("/laser_cloud_less_flat", 100, laser_odometry::laserCloudLessFlatHandler);
+
+    ros::Subscriber subLaserCloudFullRes = nh.subscribe<sensor_msgs::PointCloud2>("/velodyne_cloud_2", 100, laser_odometry::laserCloudFullResHandler);
+
+    ros::Rate rate(100);
+
+    while (ros::ok())
+    {
+        ros::spinOnce();
+
+        laser_odometry::odometryStep();
 
-            frameCount++;
-        }
         rate.sleep();
     }
     return 0;
-}
\ No newline at end of file
+}
+#endif
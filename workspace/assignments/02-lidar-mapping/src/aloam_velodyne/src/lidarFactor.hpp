@@ -103,6 +103,113 @@ struct LidarPlaneFactor
 	double s;
 };
 
+// derivative of Eigen's q * v (which assumes a unit quaternion) w.r.t. q stored as (x, y, z, w)
+inline Eigen::Matrix<double, 3, 4> QuaternionRotationJacobian(const Eigen::Quaterniond &q, const Eigen::Vector3d &v)
+{
+	const Eigen::Vector3d u = q.vec();
+	const double w = q.w();
+
+	Eigen::Matrix3d v_hat;
+	v_hat << 0, -v.z(), v.y(),
+		v.z(), 0, -v.x(),
+		-v.y(), v.x(), 0;
+
+	Eigen::Matrix<double, 3, 4> J;
+	J.leftCols<3>() = -2.0 * w * v_hat +
+					  2.0 * (u.dot(v) * Eigen::Matrix3d::Identity() + u * v.transpose() - 2.0 * v * u.transpose());
+	J.col(3) = 2.0 * u.cross(v);
+
+	return J;
+}
+
+// same residual as LidarEdgeFactor with s = 1, with analytic jacobians
+class LidarEdgeAnalyticFactor : public ceres::SizedCostFunction<3, 4, 3>
+{
+  public:
+	LidarEdgeAnalyticFactor(Eigen::Vector3d curr_point_, Eigen::Vector3d last_point_a_,
+							Eigen::Vector3d last_point_b_)
+		: curr_point(curr_point_), last_point_a(last_point_a_), last_point_b(last_point_b_) {}
+
+	virtual bool Evaluate(double const *const *parameters, double *residuals, double **jacobians) const
+	{
+		Eigen::Quaterniond q_last_curr{parameters[0][3], parameters[0][0], parameters[0][1], parameters[0][2]};
+		Eigen::Map<const Eigen::Vector3d> t_last_curr(parameters[1]);
+
+		Eigen::Vector3d lp = q_last_curr * curr_point + t_last_curr;
+
+		const double de_norm = (last_point_a - last_point_b).norm();
+		Eigen::Map<Eigen::Vector3d> residual(residuals);
+		residual = (lp - last_point_a).cross(lp - last_point_b) / de_norm;
+
+		if (jacobians)
+		{
+			// d((lp - a) x (lp - b)) / d(lp) = [b - a]x:
+			const Eigen::Vector3d ba = last_point_b - last_point_a;
+			Eigen::Matrix3d J_lp;
+			J_lp << 0, -ba.z(), ba.y(),
+				ba.z(), 0, -ba.x(),
+				-ba.y(), ba.x(), 0;
+			J_lp /= de_norm;
+
+			if (jacobians[0])
+			{
+				Eigen::Map<Eigen::Matrix<double, 3, 4, Eigen::RowMajor>> J_q(jacobians[0]);
+				J_q = J_lp * QuaternionRotationJacobian(q_last_curr, curr_point);
+			}
+			if (jacobians[1])
+			{
+				Eigen::Map<Eigen::Matrix<double, 3, 3, Eigen::RowMajor>> J_t(jacobians[1]);
+				J_t = J_lp;
+			}
+		}
+
+		return true;
+	}
+
+	Eigen::Vector3d curr_point, last_point_a, last_point_b;
+};
+
+// same residual as LidarPlaneFactor with s = 1, with analytic jacobians
+class LidarPlaneAnalyticFactor : public ceres::SizedCostFunction<1, 4, 3>
+{
+  public:
+	LidarPlaneAnalyticFactor(Eigen::Vector3d curr_point_, Eigen::Vector3d last_point_j_,
+							 Eigen::Vector3d last_point_l_, Eigen::Vector3d last_point_m_)
+		: curr_point(curr_point_), last_point_j(last_point_j_)
+	{
+		ljm_norm = (last_point_j_ - last_point_l_).cross(last_point_j_ - last_point_m_);
+		ljm_norm.normalize();
+	}
+
+	virtual bool Evaluate(double const *const *parameters, double *residuals, double **jacobians) const
+	{
+		Eigen::Quaterniond q_last_curr{parameters[0][3], parameters[0][0], parameters[0][1], parameters[0][2]};
+		Eigen::Map<const Eigen::Vector3d> t_last_curr(parameters[1]);
+
+		Eigen::Vector3d lp = q_last_curr * curr_point + t_last_curr;
+		residuals[0] = (lp - last_point_j).dot(ljm_norm);
+
+		if (jacobians)
+		{
+			if (jacobians[0])
+			{
+				Eigen::Map<Eigen::Matrix<double, 1, 4, Eigen::RowMajor>> J_q(jacobians[0]);
+				J_q = ljm_norm.transpose() * QuaternionRotationJacobian(q_last_curr, curr_point);
+			}
+			if (jacobians[1])
+			{
+				Eigen::Map<Eigen::Matrix<double, 1, 3, Eigen::RowMajor>> J_t(jacobians[1]);
+				J_t = ljm_norm.transpose();
+			}
+		}
+
+		return true;
+	}
+
+	Eigen::Vector3d curr_point, last_point_j;
+	Eigen::Vector3d ljm_norm;
+};
+
 struct LidarPlaneNormFactor
 {
 
@@ -38,8 +38,11 @@
 #include <cmath>
 #include <vector>
 #include <string>
+#include <algorithm>
 #include "aloam_velodyne/common.h"
+#include "aloam_velodyne/feature_extractor.h"
 #include "aloam_velodyne/tic_toc.h"
+#include "aloam_velodyne/pipeline.h"
 #include <nav_msgs/Odometry.h>
 #include <opencv/cv.h>
 #include <pcl_conversions/pcl_conversions.h>
@@ -57,18 +60,15 @@ using std::atan2;
 using std::cos;
 using std::sin;
 
+namespace scan_registration
+{
+
 const double scanPeriod = 0.1;
 
 const int systemDelay = 0; 
 int systemInitCount = 0;
 bool systemInited = false;
 int N_SCANS = 0;
-float cloudCurvature[400000];
-int cloudSortInd[400000];
-int cloudNeighborPicked[400000];
-int cloudLabel[400000];
-
-bool comp (int i,int j) { return (cloudCurvature[i]<cloudCurvature[j]); }
 
 ros::Publisher pubLaserCloud;
 ros::Publisher pubCornerPointsSharp;
@@ -82,6 +82,8 @@ bool PUB_EACH_LINE = false;
 
 double MINIMUM_RANGE = 0.1; 
 
+std::function<void(const ScanFrame &)> scanFrameSink;
+
 template <typename PointT>
 void removeClosedPointCloud(const pcl::PointCloud<PointT> &cloud_in,
                               pcl::PointCloud<PointT> &cloud_out, float thres)
@@ -111,6 +113,10 @@ void removeClosedPointCloud(const pcl::PointCloud<PointT> &cloud_in,
     cloud_out.is_dense = true;
 }
 
+// per-point state kept from scan to scan, see feature_extractor.h
+loam::FeatureExtractor<PointType> featureExtractor;
+loam::FeatureExtractor<PointType>::Features scanFeatures;
+
 void laserCloudHandler(const sensor_msgs::PointCloud2ConstPtr &laserCloudMsg)
 {
     if (!systemInited)
@@ -253,193 +259,73 @@ void laserCloudHandler(const sensor_msgs::PointCloud2ConstPtr &laserCloudMsg)
 
     printf("prepare time %f \n", t_prepare.toc());
 
-    for (int i = 5; i < cloudSize - 5; i++)
-    { 
-        float diffX = laserCloud->points[i - 5].x + laserCloud->points[i - 4].x + laserCloud->points[i - 3].x + laserCloud->points[i - 2].x + laserCloud->points[i - 1].x - 10 * laserCloud->points[i].x + laserCloud->points[i + 1].x + laserCloud->points[i + 2].x + laserCloud->points[i + 3].x + laserCloud->points[i + 4].x + laserCloud->points[i + 5].x;
-        float diffY = laserCloud->points[i - 5].y + laserCloud->points[i - 4].y + laserCloud->points[i - 3].y + laserCloud->points[i - 2].y + laserCloud->points[i - 1].y - 10 * laserCloud->points[i].y + laserCloud->points[i + 1].y + laserCloud->points[i + 2].y + laserCloud->points[i + 3].y + laserCloud->points[i + 4].y + laserCloud->points[i + 5].y;
-        float diffZ = laserCloud->points[i - 5].z + laserCloud->points[i - 4].z + laserCloud->points[i - 3].z + laserCloud->points[i - 2].z + laserCloud->points[i - 1].z - 10 * laserCloud->points[i].z + laserCloud->points[i + 1].z + laserCloud->points[i + 2].z + laserCloud->points[i + 3].z + laserCloud->points[i + 4].z + laserCloud->points[i + 5].z;
-
-        cloudCurvature[i] = diffX * diffX + diffY * diffY + diffZ * diffZ;
-        cloudSortInd[i] = i;
-        cloudNeighborPicked[i] = 0;
-        cloudLabel[i] = 0;
-    }
-
+    featureExtractor.reset(cloudSize);
+    featureExtractor.computeCurvature(*laserCloud);
 
     TicToc t_pts;
 
-    pcl::PointCloud<PointType> cornerPointsSharp;
-    pcl::PointCloud<PointType> cornerPointsLessSharp;
-    pcl::PointCloud<PointType> surfPointsFlat;
-    pcl::PointCloud<PointType> surfPointsLessFlat;
-
-    float t_q_sort = 0;
-    for (int i = 0; i < N_SCANS; i++)
-    {
-        if( scanEndInd[i] - scanStartInd[i] < 6)
-            continue;
-        pcl::PointCloud<PointType>::Ptr surfPointsLessFlatScan(new pcl::PointCloud<PointType>);
-        for (int j = 0; j < 6; j++)
-        {
-            int sp = scanStartInd[i] + (scanEndInd[i] - scanStartInd[i]) * j / 6; 
-            int ep = scanStartInd[i] + (scanEndInd[i] - scanStartInd[i]) * (j + 1) / 6 - 1;
-
-            TicToc t_tmp;
-            std::sort (cloudSortInd + sp, cloudSortInd + ep + 1, comp);
-            t_q_sort += t_tmp.toc();
-
-            int largestPickedNum = 0;
-            for (int k = ep; k >= sp; k--)
-            {
-                int ind = cloudSortInd[k]; 
-
-                if (cloudNeighborPicked[ind] == 0 &&
-                    cloudCurvature[ind] > 0.1)
-                {
-
-                    largestPickedNum++;
-                    if (largestPickedNum <= 2)
-                    {                        
-                        cloudLabel[ind] = 2;
-                        cornerPointsSharp.push_back(laserCloud->points[ind]);
-                        cornerPointsLessSharp.push_back(laserCloud->points[ind]);
-                    }
-                    else if (largestPickedNum <= 20)
-                    {                        
-                        cloudLabel[ind] = 1; 
-                        cornerPointsLessSharp.push_back(laserCloud->points[ind]);
-                    }
-                    else
-                    {
-                        break;
-                    }
-
-                    cloudNeighborPicked[ind] = 1; 
-
-                    for (int l = 1; l <= 5; l++)
-                    {
-                        float diffX = laserCloud->points[ind + l].x - laserCloud->points[ind + l - 1].x;
-                        float diffY = laserCloud->points[ind + l].y - laserCloud->points[ind + l - 1].y;
-                        float diffZ = laserCloud->points[ind + l].z - laserCloud->points[ind + l - 1].z;
-                        if (diffX * diffX + diffY * diffY + diffZ * diffZ > 0.05)
-                        {
-                            break;
-                        }
-
-                        cloudNeighborPicked[ind + l] = 1;
-                    }
-                    for (int l = -1; l >= -5; l--)
-                    {
-                        float diffX = laserCloud->points[ind + l].x - laserCloud->points[ind + l + 1].x;
-                        float diffY = laserCloud->points[ind + l].y - laserCloud->points[ind + l + 1].y;
-                        float diffZ = laserCloud->points[ind + l].z - laserCloud->points[ind + l + 1].z;
-                        if (diffX * diffX + diffY * diffY + diffZ * diffZ > 0.05)
-                        {
-                            break;
-                        }
-
-                        cloudNeighborPicked[ind + l] = 1;
-                    }
-                }
-            }
-
-            int smallestPickedNum = 0;
-            for (int k = sp; k <= ep; k++)
-            {
-                int ind = cloudSortInd[k];
-
-                if (cloudNeighborPicked[ind] == 0 &&
-                    cloudCurvature[ind] < 0.1)
-                {
-
-                    cloudLabel[ind] = -1; 
-                    surfPointsFlat.push_back(laserCloud->points[ind]);
-
-                    smallestPickedNum++;
-                    if (smallestPickedNum >= 4)
-                    { 
-                        break;
-                    }
-
-                    cloudNeighborPicked[ind] = 1;
-                    for (int l = 1; l <= 5; l++)
-                    { 
-                        float diffX = laserCloud->points[ind + l].x - laserCloud->points[ind + l - 1].x;
-                        float diffY = laserCloud->points[ind + l].y - laserCloud->points[ind + l - 1].y;
-                        float diffZ = laserCloud->points[ind + l].z - laserCloud->points[ind + l - 1].z;
-                        if (diffX * diffX + diffY * diffY + diffZ * diffZ > 0.05)
-                        {
-                            break;
-                        }
-
-                        cloudNeighborPicked[ind + l] = 1;
-                    }
-                    for (int l = -1; l >= -5; l--)
-                    {
-                        float diffX = laserCloud->points[ind + l].x - laserCloud->points[ind + l + 1].x;
-                        float diffY = laserCloud->points[ind + l].y - laserCloud->points[ind + l + 1].y;
-                        float diffZ = laserCloud->points[ind + l].z - laserCloud->points[ind + l + 1].z;
-                        if (diffX * diffX + diffY * diffY + diffZ * diffZ > 0.05)
-                        {
-                            break;
-                        }
-
-                        cloudNeighborPicked[ind + l] = 1;
-                    }
-                }
-            }
-
-            for (int k = sp; k <= ep; k++)
-            {
-                if (cloudLabel[k] <= 0)
-                {
-                    surfPointsLessFlatScan->push_back(laserCloud->points[k]);
-                }
-            }
-        }
-
-        pcl::PointCloud<PointType> surfPointsLessFlatScanDS;
-        pcl::VoxelGrid<PointType> downSizeFilter;
-        downSizeFilter.setInputCloud(surfPointsLessFlatScan);
-        downSizeFilter.setLeafSize(0.2, 0.2, 0.2);
-        downSizeFilter.filter(surfPointsLessFlatScanDS);
-
-        surfPointsLessFlat += surfPointsLessFlatScanDS;
-    }
-    printf("sort q time %f \n", t_q_sort);
+    // neighbors are not marked across a depth discontinuity:
+    featureExtractor.extract(*laserCloud, scanStartInd, scanEndInd,
+                             [&laserCloud](int i, int j)
+                             {
+                                 float diffX = laserCloud->points[i].x - laserCloud->points[j].x;
+                                 float diffY = laserCloud->points[i].y - laserCloud->points[j].y;
+                                 float diffZ = laserCloud->points[i].z - laserCloud->points[j].z;
+                                 return diffX * diffX + diffY * diffY + diffZ * diffZ > 0.05;
+                             },
+                             [](int i) { return featureExtractor.curvature(i) > 0.1; },
+                             [](int i) { return featureExtractor.curvature(i) < 0.1; },
+                             scanFeatures);
+
+    pcl::PointCloud<PointType> &cornerPointsSharp = scanFeatures.cornerPointsSharp;
+    pcl::PointCloud<PointType> &cornerPointsLessSharp = scanFeatures.cornerPointsLessSharp;
+    pcl::PointCloud<PointType> &surfPointsFlat = scanFeatures.surfPointsFlat;
+    pcl::PointCloud<PointType> &surfPointsLessFlat = scanFeatures.surfPointsLessFlat;
     printf("seperate points time %f \n", t_pts.toc());
 
 
-    sensor_msgs::PointCloud2 laserCloudOutMsg;
-    pcl::toROSMsg(*laserCloud, laserCloudOutMsg);
-    laserCloudOutMsg.header.stamp = laserCloudMsg->header.stamp;
-    laserCloudOutMsg.header.frame_id = "/camera_init";
+    sensor_msgs::PointCloud2Ptr laserCloudOutMsg(new sensor_msgs::PointCloud2());
+    pcl::toROSMsg(*laserCloud, *laserCloudOutMsg);
+    laserCloudOutMsg->header.stamp = laserCloudMsg->header.stamp;
+    laserCloudOutMsg->header.frame_id = "/camera_init";
     pubLaserCloud.publish(laserCloudOutMsg);
 
-    sensor_msgs::PointCloud2 cornerPointsSharpMsg;
-    pcl::toROSMsg(cornerPointsSharp, cornerPointsSharpMsg);
-    cornerPointsSharpMsg.header.stamp = laserCloudMsg->header.stamp;
-    cornerPointsSharpMsg.header.frame_id = "/camera_init";
+    sensor_msgs::PointCloud2Ptr cornerPointsSharpMsg(new sensor_msgs::PointCloud2());
+    pcl::toROSMsg(cornerPointsSharp, *cornerPointsSharpMsg);
+    cornerPointsSharpMsg->header.stamp = laserCloudMsg->header.stamp;
+    cornerPointsSharpMsg->header.frame_id = "/camera_init";
     pubCornerPointsSharp.publish(cornerPointsSharpMsg);
 
-    sensor_msgs::PointCloud2 cornerPointsLessSharpMsg;
-    pcl::toROSMsg(cornerPointsLessSharp, cornerPointsLessSharpMsg);
-    cornerPointsLessSharpMsg.header.stamp = laserCloudMsg->header.stamp;
-    cornerPointsLessSharpMsg.header.frame_id = "/camera_init";
+    sensor_msgs::PointCloud2Ptr cornerPointsLessSharpMsg(new sensor_msgs::PointCloud2());
+    pcl::toROSMsg(cornerPointsLessSharp, *cornerPointsLessSharpMsg);
+    cornerPointsLessSharpMsg->header.stamp = laserCloudMsg->header.stamp;
+    cornerPointsLessSharpMsg->header.frame_id = "/camera_init";
     pubCornerPointsLessSharp.publish(cornerPointsLessSharpMsg);
 
-    sensor_msgs::PointCloud2 surfPointsFlat2;
-    pcl::toROSMsg(surfPointsFlat, surfPointsFlat2);
-    surfPointsFlat2.header.stamp = laserCloudMsg->header.stamp;
-    surfPointsFlat2.header.frame_id = "/camera_init";
+    sensor_msgs::PointCloud2Ptr surfPointsFlat2(new sensor_msgs::PointCloud2());
+    pcl::toROSMsg(surfPointsFlat, *surfPointsFlat2);
+    surfPointsFlat2->header.stamp = laserCloudMsg->header.stamp;
+    surfPointsFlat2->header.frame_id = "/camera_init";
     pubSurfPointsFlat.publish(surfPointsFlat2);
 
-    sensor_msgs::PointCloud2 surfPointsLessFlat2;
-    pcl::toROSMsg(surfPointsLessFlat, surfPointsLessFlat2);
-    surfPointsLessFlat2.header.stamp = laserCloudMsg->header.stamp;
-    surfPointsLessFlat2.header.frame_id = "/camera_init";
+    sensor_msgs::PointCloud2Ptr surfPointsLessFlat2(new sensor_msgs::PointCloud2());
+    pcl::toROSMsg(surfPointsLessFlat, *surfPointsLessFlat2);
+    surfPointsLessFlat2->header.stamp = laserCloudMsg->header.stamp;
+    surfPointsLessFlat2->header.frame_id = "/camera_init";
     pubSurfPointsLessFlat.publish(surfPointsLessFlat2);
 
+    // in the pipeline the same messages go straight to the odometry
+    if (scanFrameSink)
+    {
+        ScanFrame frame;
+        frame.fullRes = laserCloudOutMsg;
+        frame.cornerSharp = cornerPointsSharpMsg;
+        frame.cornerLessSharp = cornerPointsLessSharpMsg;
+        frame.surfFlat = surfPointsFlat2;
+        frame.surfLessFlat = surfPointsLessFlat2;
+        scanFrameSink(frame);
+    }
+
     // pub each scam
     if(PUB_EACH_LINE)
     {
@@ -458,11 +344,8 @@ void laserCloudHandler(const sensor_msgs::PointCloud2ConstPtr &laserCloudMsg)
         ROS_WARN("scan registration process over 100ms");
 }
 
-int main(int argc, char **argv)
+bool setup(ros::NodeHandle &nh)
 {
-    ros::init(argc, argv, "scanRegistration");
-    ros::NodeHandle nh;
-
     nh.param<int>("scan_line", N_SCANS, 16);
 
     nh.param<double>("minimum_range", MINIMUM_RANGE, 0.1);
@@ -472,10 +355,11 @@ int main(int argc, char **argv)
     if(N_SCANS != 16 && N_SCANS != 32 && N_SCANS != 64)
     {
         printf("only support velodyne with 16, 32 or 64 scan line!");
-        return 0;
+        return false;
     }
 
-    ros::Subscriber subLaserCloud = nh.subscribe<sensor_msgs::PointCloud2>("/velodyne_points", 100, laserCloudHandler);
+    // rings shorter than this yield no features:
+    featureExtractor.params().minRingPoints = 7;
 
     pubLaserCloud = nh.advertise<sensor_msgs::PointCloud2>("/velodyne_cloud_2", 100);
 
@@ -497,7 +381,25 @@ int main(int argc, char **argv)
             pubEachScan.push_back(tmp);
         }
     }
+
+    return true;
+}
+
+} // namespace scan_registration
+
+#ifndef ALOAM_PIPELINE
+int main(int argc, char **argv)
+{
+    ros::init(argc, argv, "scanRegistration");
+    ros::NodeHandle nh;
+
+    if (!scan_registration::setup(nh))
+        return 0;
+
+    ros::Subscriber subLaserCloud = nh.subscribe<sensor_msgs::PointCloud2>("/velodyne_points", 100, scan_registration::laserCloudHandler);
+
     ros::spin();
 
     return 0;
 }
+#endif
@@ -0,0 +1,213 @@
+// Rolling hash-voxel map for laserMapping.
+// Points are kept in voxels of a hash map, so insertion and deletion are incremental and
+// nearest neighbour search only visits the 27 voxels around the query point.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+#include <eigen3/Eigen/Dense>
+#include <pcl/point_cloud.h>
+
+#include "aloam_velodyne/common.h"
+
+class VoxelMap
+{
+  public:
+	// resolution is the leaf size of the downsampled insertion, one point is kept per leaf.
+	// searchRadius is the largest distance nearestKSearch has to answer exactly.
+	VoxelMap(float resolution, float searchRadius)
+		: leafSize(resolution),
+		  leafNum(std::max(1, int(std::ceil(searchRadius / resolution - 1e-6)))),
+		  voxelSize(resolution * leafNum),
+		  pointNum(0)
+	{
+	}
+
+	size_t size() const
+	{
+		return pointNum;
+	}
+
+	// keep the point closest to the leaf center, like the downsampling of ikd-tree:
+	void addPoint(const PointType &point)
+	{
+		int leafX, leafY, leafZ;
+		getLeaf(point, leafX, leafY, leafZ);
+		VoxelKey key{floorDiv(leafX, leafNum), floorDiv(leafY, leafNum), floorDiv(leafZ, leafNum)};
+		int leaf = (leafX - key.x * leafNum) + leafNum * ((leafY - key.y * leafNum) + leafNum * (leafZ - key.z * leafNum));
+
+		Voxel &voxel = voxels[key];
+		for (size_t i = 0; i < voxel.leafs.size(); i++)
+		{
+			if (voxel.leafs[i] == leaf)
+			{
+				if (leafCenterSqDis(point, leafX, leafY, leafZ) < leafCenterSqDis(voxel.points[i], leafX, leafY, leafZ))
+					voxel.points[i] = point;
+				return;
+			}
+		}
+
+		voxel.points.push_back(point);
+		voxel.leafs.push_back(leaf);
+		pointNum++;
+	}
+
+	// drop every voxel whose center lies outside of the box:
+	void deleteOutsideBox(const Eigen::Vector3d &minPt, const Eigen::Vector3d &maxPt)
+	{
+		for (auto it = voxels.begin(); it != voxels.end();)
+		{
+			if (!isVoxelInBox(it->first, minPt, maxPt))
+			{
+				pointNum -= it->second.points.size();
+				it = voxels.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+
+	void getPointsInBox(const Eigen::Vector3d &minPt, const Eigen::Vector3d &maxPt, pcl::PointCloud<PointType> &cloud) const
+	{
+		for (auto it = voxels.begin(); it != voxels.end(); ++it)
+		{
+			if (isVoxelInBox(it->first, minPt, maxPt))
+				cloud.points.insert(cloud.points.end(), it->second.points.begin(), it->second.points.end());
+		}
+		cloud.width = cloud.points.size();
+		cloud.height = 1;
+	}
+
+	void getAllPoints(pcl::PointCloud<PointType> &cloud) const
+	{
+		for (auto it = voxels.begin(); it != voxels.end(); ++it)
+			cloud.points.insert(cloud.points.end(), it->second.points.begin(), it->second.points.end());
+		cloud.width = cloud.points.size();
+		cloud.height = 1;
+	}
+
+	// k nearest points closer than sqrt(maxSqDis), sorted by distance. returns how many were found.
+	// exact as long as maxSqDis is not larger than the squared search radius.
+	int nearestKSearch(const PointType &point, int k, float maxSqDis,
+					   std::vector<PointType> &nearPoints, std::vector<float> &nearSqDis) const
+	{
+		nearPoints.clear();
+		nearSqDis.clear();
+
+		int leafX, leafY, leafZ;
+		getLeaf(point, leafX, leafY, leafZ);
+		VoxelKey center{floorDiv(leafX, leafNum), floorDiv(leafY, leafNum), floorDiv(leafZ, leafNum)};
+
+		for (int dx = -1; dx <= 1; dx++)
+		{
+			for (int dy = -1; dy <= 1; dy++)
+			{
+				for (int dz = -1; dz <= 1; dz++)
+				{
+					auto it = voxels.find(VoxelKey{center.x + dx, center.y + dy, center.z + dz});
+					if (it == voxels.end())
+						continue;
+
+					const std::vector<PointType> &points = it->second.points;
+					for (size_t i = 0; i < points.size(); i++)
+					{
+						float sqDis = (points[i].x - point.x) * (points[i].x - point.x) +
+									  (points[i].y - point.y) * (points[i].y - point.y) +
+									  (points[i].z - point.z) * (points[i].z - point.z);
+						if (sqDis >= maxSqDis)
+							continue;
+						if ((int)nearSqDis.size() == k && sqDis >= nearSqDis.back())
+							continue;
+
+						// insertion into the sorted k best:
+						if ((int)nearSqDis.size() < k)
+						{
+							nearSqDis.push_back(sqDis);
+							nearPoints.push_back(points[i]);
+						}
+						int j = nearSqDis.size() - 1;
+						for (; j > 0 && nearSqDis[j - 1] > sqDis; j--)
+						{
+							nearSqDis[j] = nearSqDis[j - 1];
+							nearPoints[j] = nearPoints[j - 1];
+						}
+						nearSqDis[j] = sqDis;
+						nearPoints[j] = points[i];
+					}
+				}
+			}
+		}
+
+		return nearSqDis.size();
+	}
+
+  private:
+	struct VoxelKey
+	{
+		int x, y, z;
+
+		bool operator==(const VoxelKey &other) const
+		{
+			return x == other.x && y == other.y && z == other.z;
+		}
+	};
+
+	struct VoxelKeyHash
+	{
+		size_t operator()(const VoxelKey &key) const
+		{
+			return size_t(((int64_t)key.x * 73856093) ^ ((int64_t)key.y * 19349663) ^ ((int64_t)key.z * 83492791));
+		}
+	};
+
+	struct Voxel
+	{
+		std::vector<PointType> points;
+		// leaf of each point inside of the voxel:
+		std::vector<int> leafs;
+	};
+
+	static int floorDiv(int a, int b)
+	{
+		return (a >= 0) ? a / b : -((-a + b - 1) / b);
+	}
+
+	void getLeaf(const PointType &point, int &leafX, int &leafY, int &leafZ) const
+	{
+		leafX = int(std::floor(point.x / leafSize));
+		leafY = int(std::floor(point.y / leafSize));
+		leafZ = int(std::floor(point.z / leafSize));
+	}
+
+	float leafCenterSqDis(const PointType &point, int leafX, int leafY, int leafZ) const
+	{
+		float dx = point.x - (leafX + 0.5f) * leafSize;
+		float dy = point.y - (leafY + 0.5f) * leafSize;
+		float dz = point.z - (leafZ + 0.5f) * leafSize;
+		return dx * dx + dy * dy + dz * dz;
+	}
+
+	bool isVoxelInBox(const VoxelKey &key, const Eigen::Vector3d &minPt, const Eigen::Vector3d &maxPt) const
+	{
+		double x = (key.x + 0.5) * voxelSize;
+		double y = (key.y + 0.5) * voxelSize;
+		double z = (key.z + 0.5) * voxelSize;
+		return x >= minPt.x() && x <= maxPt.x() &&
+			   y >= minPt.y() && y <= maxPt.y() &&
+			   z >= minPt.z() && z <= maxPt.z();
+	}
+
+	const float leafSize;
+	const int leafNum;
+	const float voxelSize;
+
+	std::unordered_map<VoxelKey, Voxel, VoxelKeyHash> voxels;
+	size_t pointNum;
+};
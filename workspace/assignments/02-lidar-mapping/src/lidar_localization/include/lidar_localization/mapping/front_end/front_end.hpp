@@ -13,11 +13,13 @@
 #include "lidar_localization/sensor_data/cloud_data.hpp"
 #include "lidar_localization/models/registration/registration_interface.hpp"
 #include "lidar_localization/models/cloud_filter/cloud_filter_interface.hpp"
+#include "lidar_localization/models/local_map/voxel_hash_map.hpp"
 
 namespace lidar_localization {
 class FrontEnd {
   public:
     struct Frame { 
+        int id = 0;
         Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
         CloudData cloud_data;
     };
@@ -33,6 +35,7 @@ class FrontEnd {
     bool InitParam(const YAML::Node& config_node);
     bool InitRegistration(std::shared_ptr<RegistrationInterface>& registration_ptr, const YAML::Node& config_node);
     bool InitFilter(std::string filter_user, std::shared_ptr<CloudFilterInterface>& filter_ptr, const YAML::Node& config_node);
+    bool InitLocalMap(const YAML::Node& config_node);
     bool UpdateWithNewFrame(const Frame& new_key_frame);
 
   private:
@@ -47,11 +50,20 @@ class FrontEnd {
 
     std::deque<Frame> local_map_frames_;
 
+    // incremental local map, null when local map is fully rebuilt for every key frame:
+    std::shared_ptr<VoxelHashMap> local_map_voxels_ptr_;
     CloudData::CLOUD_PTR local_map_ptr_;
     Frame current_frame_;
+    int num_key_frames_ = 0;
 
     Eigen::Matrix4f init_pose_ = Eigen::Matrix4f::Identity();
 
+    // odometry state for the prediction of the next scan, reset by the first scan:
+    Eigen::Matrix4f step_pose_ = Eigen::Matrix4f::Identity();
+    Eigen::Matrix4f last_pose_ = Eigen::Matrix4f::Identity();
+    Eigen::Matrix4f predict_pose_ = Eigen::Matrix4f::Identity();
+    Eigen::Matrix4f last_key_frame_pose_ = Eigen::Matrix4f::Identity();
+
     float key_frame_distance_ = 2.0;
     int local_frame_num_ = 20;
 };
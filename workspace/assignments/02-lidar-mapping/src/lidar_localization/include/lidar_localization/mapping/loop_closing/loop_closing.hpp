@@ -79,6 +79,8 @@ class LoopClosing {
 
     std::deque<KeyFrame> all_key_frames_;
     std::deque<KeyFrame> all_key_gnss_;
+    // latest key scan, it may not be on disk yet:
+    CloudData current_key_scan_;
 
     LoopPose current_loop_pose_;
     bool has_new_loop_pose_ = false;
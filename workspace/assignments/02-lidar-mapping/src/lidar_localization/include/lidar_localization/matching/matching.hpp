@@ -7,26 +7,50 @@
 #define LIDAR_LOCALIZATION_MATCHING_MATCHING_HPP_
 
 #include <deque>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
 #include <Eigen/Dense>
 #include <yaml-cpp/yaml.h>
 
 #include "lidar_localization/sensor_data/cloud_data.hpp"
 #include "lidar_localization/sensor_data/pose_data.hpp"
+#include "lidar_localization/sensor_data/imu_data.hpp"
 
 #include "lidar_localization/models/scan_context_manager/scan_context_manager.hpp"
 #include "lidar_localization/models/registration/registration_interface.hpp"
 #include "lidar_localization/models/cloud_filter/cloud_filter_interface.hpp"
 #include "lidar_localization/models/cloud_filter/box_filter.hpp"
+#include "lidar_localization/models/tiled_map/tiled_map.hpp"
+#include "lidar_localization/models/local_map/grid_map.hpp"
+#include "lidar_localization/models/imu_mechanization/imu_motion_prior.hpp"
+
+#include "lidar_localization/matching/tracking_monitor.hpp"
 
 namespace lidar_localization {
+// the global map & the scan context index are loaded on their own threads with async_init, so the flow
+// takes scans right away. the first fix waits for what it needs: the map for every init, and the index
+// for scan context proposals, which a scan with a GNSS prior may go without, verified against GNSS only.
+// once tracking, the health of every scan match is monitored. a degraded match is not published, & once tracking
+// is lost the scan is relocalized on a thread of its own with the hypotheses of SetScanContextPose, the scan
+// context proposals gated to the region around the GNSS pose. the verified pose is taken over with a later scan.
 class Matching {
   public:
     Matching();
+    // waits for the loaders & the relocalization in progress:
+    ~Matching();
 
+    // false if the match is not to be published, e.g. a degraded one:
     bool Update(const CloudData& cloud_data, Eigen::Matrix4f& cloud_pose);
+    // GNSS pose at the time of the next scan, the center of the region a relocalization is gated to:
+    void SetGNSSPrior(const Eigen::Matrix4f& gnss_pose);
 
     bool SetGNSSPose(const Eigen::Matrix4f& init_pose);
     bool SetScanContextPose(const CloudData& init_scan);
+    // the GNSS pose at the scan time is verified along with the scan context proposals:
+    bool SetScanContextPose(const CloudData& init_scan, const Eigen::Matrix4f& init_gnss_pose);
 
     Eigen::Matrix4f GetInitPose(void);
     void GetGlobalMap(CloudData::CLOUD_PTR& global_map);
@@ -36,46 +60,190 @@ class Matching {
     bool HasNewGlobalMap();
     bool HasNewLocalMap();
 
+    // readiness, the Set*Pose calls fail until the map is ready:
+    bool IsMapReady() const { return is_map_ready_.load(); }
+    bool IsIndexReady() const { return is_index_ready_.load(); }
+    // blocks until the map & the index are ready:
+    void WaitUntilReady(void);
+
+    // IMU motion prior, the flow only needs to feed IMU measurements & extrinsics when it is used:
+    bool HasIMUMotionPrior(void) const { return static_cast<bool>(imu_motion_prior_ptr_); }
+    bool HasLidarToIMU(void) const { return imu_motion_prior_ptr_ && imu_motion_prior_ptr_->HasLidarToIMU(); }
+    bool HasIMUData(double time) const { return imu_motion_prior_ptr_ && imu_motion_prior_ptr_->HasIMUData(time); }
+    bool SetLidarToIMU(const Eigen::Matrix4f& lidar_to_imu);
+    bool AddIMUData(const IMUData& imu_data);
+
+    // degraded levels of scan matching under load, 0 for full quality:
+    int GetNumLoadLevels(void) const { return static_cast<int>(load_max_iters_.size()); }
+    bool SetLoadLevel(int load_level);
+
   private:
     bool InitWithConfig();
     bool InitDataPath(const YAML::Node& config_node);
-    bool InitScanContextManager(const YAML::Node& config_node);
+    // runs load on loader with async_init, inline otherwise, then marks it ready:
+    void StartLoader(
+      const std::string& name, const std::function<void(void)>& load, bool async_init,
+      std::thread& loader, std::atomic<bool>& is_ready
+    );
+    // the index is loaded on the index loader thread with async_init:
+    bool InitScanContextManager(const YAML::Node& config_node, bool async_init);
     bool InitRegistration(std::shared_ptr<RegistrationInterface>& registration_ptr, const YAML::Node& config_node);
     bool InitFilter(std::string filter_user, std::shared_ptr<CloudFilterInterface>& filter_ptr, const YAML::Node& config_node);
     bool InitBoxFilter(const YAML::Node& config_node);
+    bool InitRelocalization(const YAML::Node& config_node);
+    bool InitLoadShedding(const YAML::Node& config_node);
+    bool InitMotionPrior(const YAML::Node& config_node);
 
     bool SetInitPose(const Eigen::Matrix4f& init_pose);
+    bool SetInitScan(
+      const CloudData& init_scan, 
+      const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& prior_poses
+    );
+    // scan context proposals among the key frames passing is_candidate, best first, then the priors:
+    bool GetInitHypotheses(
+      const CloudData& init_scan, 
+      const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& prior_poses,
+      const ScanContextManager::CandidateFilter& is_candidate,
+      std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& hypotheses
+    );
+    // coarse registration of each init pose hypothesis in parallel, the best one within fitness limit wins:
+    bool Relocalize(
+      const CloudData& init_scan, 
+      const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& hypotheses,
+      Eigen::Matrix4f& init_pose
+    );
+    // as above, with the scan already filtered. only touches the relocalization instances & the map:
+    bool Relocalize(
+      const CloudData::CLOUD_PTR& scan_ptr, 
+      const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& hypotheses,
+      Eigen::Matrix4f& init_pose
+    );
+    // per-level iterations of a pyramid registration, empty for other backends:
+    static std::string GetLevelReport(const std::shared_ptr<RegistrationInterface>& registration_ptr);
+    // on the map loader thread with async_init:
     bool InitGlobalMap();
+    // rebuild the local map if pose is within 50 meters of its edge:
+    bool UpdateLocalMap(const Eigen::Matrix4f& pose);
+    // edge of the local map centered at pose, without moving the box filter, e.g. off the flow thread:
+    std::vector<float> GetLocalMapEdge(const Eigen::Matrix4f& pose) const;
+    // blocks until the new local map is built, and its target unless registration is async:
     bool ResetLocalMap(float x, float y, float z);
+    // queue a local map rebuild on the worker thread, false if one is still pending:
+    bool RequestLocalMap(float x, float y, float z);
+    // take over the local map built by the worker thread, if any, & set it as the target:
+    bool SwapLocalMap(void);
+    bool BuildLocalMap(const std::vector<float>& edge, CloudData::CLOUD_PTR& local_map_ptr);
+    void RunLocalMap(void);
+    // load the tiles of the next local map ahead of the vehicle:
+    bool PrefetchLocalMap(const Eigen::Matrix4f& pose, const Eigen::Vector3f& motion);
+
+    // tracking recovery. false if the match of cloud_pose is not to be published:
+    bool CheckTracking(
+      const CloudData& cloud_data, 
+      const CloudData::CLOUD_PTR& filtered_cloud_ptr,
+      const Eigen::Matrix4f& cloud_pose
+    );
+    // relocalize the scan on the relocalizer thread, false if one is in progress:
+    bool StartRelocalization(const CloudData& cloud_data, const CloudData::CLOUD_PTR& filtered_cloud_ptr);
+    // move the scan matching prediction onto the relocalized pose, once the relocalizer is done:
+    bool ApplyRelocalization(void);
 
   private:
     std::string scan_context_path_ = "";
+    std::string map_format_ = "pcd";
     std::string map_path_ = "";
+    std::string tiles_path_ = "";
+    size_t tiles_cache_size_ = 1024;
+    float prefetch_distance_ = 100.0f;
+    // read through tiles.bin instead of the tile files:
+    bool tiles_mapped_ = false;
+    MappedTileStore::HugePages tiles_huge_pages_ = MappedTileStore::HugePages::NONE;
+    // mapped tiles up to this far beyond the prefetched ones are read ahead by the kernel:
+    float will_need_distance_ = 0.0f;
 
     std::string loop_closure_method_ = "";
 
     std::shared_ptr<ScanContextManager> scan_context_manager_ptr_;
+    // an AsyncRegistration with async_registration_target, so Update never waits for a new target:
     std::shared_ptr<RegistrationInterface> registration_ptr_; 
+    // relocalization, one coarse registration instance per hypothesis:
+    int num_relocalization_candidates_ = 1;
+    bool use_gnss_for_relocalization_ = true;
+    float relocalization_fitness_score_limit_ = 1.0f;
+    std::vector<std::shared_ptr<RegistrationInterface>> relocalization_registration_ptrs_;
+    // tracking recovery, nullptr if disabled. scan context proposals are gated to this radius around the GNSS pose,
+    // or the last healthy pose without one:
+    std::shared_ptr<TrackingMonitor> tracking_monitor_ptr_;
+    float relocalization_gate_radius_ = 50.0f;
+    bool has_gnss_prior_ = false;
+    Eigen::Matrix4f last_healthy_pose_ = Eigen::Matrix4f::Identity();
+    // pose of the relocalized scan as predicted on the flow thread, to carry the motion since over:
+    Eigen::Matrix4f relocalization_scan_pose_ = Eigen::Matrix4f::Identity();
+    // the relocalizer & the relocalization instances are only used by the relocalizer until it is done:
+    std::thread relocalizer_;
+    std::atomic<bool> is_relocalization_done_{false};
+    bool is_relocalized_ = false;
+    Eigen::Matrix4f relocalized_pose_ = Eigen::Matrix4f::Identity();
 
     std::shared_ptr<CloudFilterInterface> global_map_filter_ptr_;
+    // only set for tiled map, global_map_ptr_ stays empty then:
+    std::shared_ptr<TiledMap> tiled_map_ptr_;
+    // only set for pcd map, holds the points of global_map_ptr_ bucketed by cell:
+    float local_map_grid_size_ = 10.0f;
+    std::shared_ptr<GridMap> grid_map_ptr_;
 
     std::shared_ptr<BoxFilter> box_filter_ptr_;
+    // box_filter_size, the local map edge around the origin:
+    std::vector<float> local_map_box_;
+    Eigen::Vector3f local_map_origin_ = Eigen::Vector3f::Zero();
     std::shared_ptr<CloudFilterInterface> local_map_filter_ptr_;
 
     std::shared_ptr<CloudFilterInterface> frame_filter_ptr_;
+    // load shedding, level i > 0 adds the (i - 1)-th coarser scan filter & caps the iterations of scan matching:
+    std::vector<std::shared_ptr<CloudFilterInterface>> load_frame_filter_ptrs_;
+    std::vector<int> load_max_iters_;
+    int load_level_ = 0;
 
     CloudData::CLOUD_PTR global_map_ptr_;
     CloudData::CLOUD_PTR local_map_ptr_;
+    CloudData::CLOUD_PTR next_local_map_ptr_;
     CloudData::CLOUD_PTR current_scan_ptr_;
 
     Eigen::Matrix4f current_pose_ = Eigen::Matrix4f::Identity();
+    // scan matching, the next scan is matched from predict_pose_ at the last motion step_pose_:
+    Eigen::Matrix4f step_pose_ = Eigen::Matrix4f::Identity();
+    Eigen::Matrix4f last_pose_ = Eigen::Matrix4f::Identity();
+    Eigen::Matrix4f predict_pose_ = Eigen::Matrix4f::Identity();
+    // registration initial guess from IMU, from the last pose at last_time_ & velocity, null for constant velocity:
+    std::shared_ptr<IMUMotionPrior> imu_motion_prior_ptr_;
+    double last_time_ = -1.0;
+    Eigen::Vector3f last_vel_ = Eigen::Vector3f::Zero();
 
     Eigen::Matrix4f init_pose_ = Eigen::Matrix4f::Identity();
     Eigen::Matrix4f current_gnss_pose_ = Eigen::Matrix4f::Identity();
+    // num. of GNSS poses received, the first sets the init pose:
+    int gnss_cnt_ = 0;
+
+    // startup, members set by a loader are only accessed once it is ready:
+    std::thread map_loader_;
+    std::thread index_loader_;
+    std::atomic<bool> is_map_ready_{false};
+    std::atomic<bool> is_index_ready_{false};
 
     bool has_inited_ = false;
     bool has_new_global_map_ = false;
     bool has_new_local_map_ = false;
+
+    // local map worker, the next_* members above are only touched by it while a rebuild is requested:
+    bool async_local_map_ = false;
+    std::mutex local_map_mutex_;
+    std::condition_variable has_local_map_task_;
+    std::condition_variable has_local_map_done_;
+    std::vector<float> next_local_map_edge_;
+    bool is_local_map_requested_ = false;
+    bool is_next_local_map_ready_ = false;
+    bool stop_ = false;
+    std::thread local_map_thread_;
 };
 }
 
@@ -10,12 +10,16 @@
 // subscriber
 #include "lidar_localization/subscriber/cloud_subscriber.hpp"
 #include "lidar_localization/subscriber/odometry_subscriber.hpp"
+#include "lidar_localization/subscriber/imu_subscriber.hpp"
+#include "lidar_localization/tf_listener/tf_listener.hpp"
 // publisher
 #include "lidar_localization/publisher/cloud_publisher.hpp"
 #include "lidar_localization/publisher/odometry_publisher.hpp"
 #include "lidar_localization/publisher/tf_broadcaster.hpp"
 // matching
 #include "lidar_localization/matching/matching.hpp"
+// load shedding
+#include "lidar_localization/tools/deadline_policy.hpp"
 
 namespace lidar_localization {
 class MatchingFlow {
@@ -26,6 +30,7 @@ class MatchingFlow {
 
   private:
     bool ReadData();
+    bool InitCalibration();
     bool HasData();
     bool ValidData();
     bool UpdateMatching();
@@ -35,6 +40,9 @@ class MatchingFlow {
     // subscriber 
     std::shared_ptr<CloudSubscriber> cloud_sub_ptr_;
     std::shared_ptr<OdometrySubscriber> gnss_sub_ptr_;
+    // raw IMU & lidar-IMU extrinsics, only for the IMU motion prior:
+    std::shared_ptr<IMUSubscriber> imu_sub_ptr_;
+    std::shared_ptr<TFListener> lidar_to_imu_ptr_;
     // publisher
     std::shared_ptr<CloudPublisher> global_map_pub_ptr_;
     std::shared_ptr<CloudPublisher> local_map_pub_ptr_;
@@ -43,9 +51,11 @@ class MatchingFlow {
     std::shared_ptr<TFBroadCaster> laser_tf_pub_ptr_;
     // matching
     std::shared_ptr<Matching> matching_ptr_;
+    std::shared_ptr<DeadlinePolicy> deadline_policy_ptr_;
 
     std::deque<CloudData> cloud_data_buff_;
     std::deque<PoseData> gnss_data_buff_;
+    std::deque<IMUData> imu_data_buff_;
 
     CloudData current_cloud_data_;
     PoseData current_gnss_data_;
@@ -0,0 +1,170 @@
+/*
+ * @Description: header-only IMU mechanization, mid-value integration of unbiased IMU measurements
+ * @Author: Ge Yao
+ * @Date: 2020-12-22 09:31:05
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_IMU_MECHANIZATION_IMU_MECHANIZATION_HPP_
+#define LIDAR_LOCALIZATION_MODELS_IMU_MECHANIZATION_IMU_MECHANIZATION_HPP_
+
+#include <cmath>
+
+#include <Eigen/Dense>
+
+namespace lidar_localization {
+
+namespace imu_mechanization {
+
+// unbiased IMU measurement, angular velocity & linear acceleration in body frame:
+struct IMUSample {
+    double time = 0.0;
+    Eigen::Vector3d angular_vel = Eigen::Vector3d::Zero();
+    Eigen::Vector3d linear_acc = Eigen::Vector3d::Zero();
+};
+
+/**
+ * @brief  get mid-value angular delta
+ * @param  sample_prev, previous IMU measurement
+ * @param  sample_curr, current IMU measurement
+ * @return angular delta
+ */
+inline Eigen::Vector3d GetAngularDelta(const IMUSample &sample_prev, const IMUSample &sample_curr) {
+    double delta_t = sample_curr.time - sample_prev.time;
+
+    return 0.5*delta_t*(sample_curr.angular_vel + sample_prev.angular_vel);
+}
+
+/**
+ * @brief  get effective rotation of two consecutive angular deltas, with coning correction
+ * @param  angular_delta_1, first angular delta
+ * @param  angular_delta_2, second angular delta
+ * @return effective rotation
+ */
+inline Eigen::Vector3d GetEffectiveAngularDelta(
+    const Eigen::Vector3d &angular_delta_1, const Eigen::Vector3d &angular_delta_2
+) {
+    return angular_delta_1 + angular_delta_2 + 2.0/3.0*angular_delta_1.cross(angular_delta_2);
+}
+
+/**
+ * @brief  get delta quaternion of effective rotation angular_delta
+ * @param  angular_delta, effective rotation
+ * @return delta quaternion
+ */
+inline Eigen::Quaterniond GetDeltaQuaternion(const Eigen::Vector3d &angular_delta) {
+    // magnitude:
+    double angular_delta_mag = angular_delta.norm();
+    // direction:
+    Eigen::Vector3d angular_delta_dir = angular_delta.normalized();
+
+    // build delta q:
+    double angular_delta_cos = cos(angular_delta_mag/2.0);
+    double angular_delta_sin = sin(angular_delta_mag/2.0);
+
+    return Eigen::Quaterniond(
+        angular_delta_cos,
+        angular_delta_sin*angular_delta_dir.x(),
+        angular_delta_sin*angular_delta_dir.y(),
+        angular_delta_sin*angular_delta_dir.z()
+    );
+}
+
+/**
+ * @brief  update orientation with delta quaternion dq
+ * @param  dq, delta quaternion
+ * @param  pose, pose to update
+ * @param  R_curr, current orientation
+ * @param  R_prev, previous orientation
+ * @return void
+ */
+inline void UpdateOrientation(
+    const Eigen::Quaterniond &dq,
+    Eigen::Matrix4d &pose,
+    Eigen::Matrix3d &R_curr, Eigen::Matrix3d &R_prev
+) {
+    Eigen::Quaterniond q(pose.block<3, 3>(0, 0));
+
+    // update:
+    q = q*dq;
+
+    // write back:
+    R_prev = pose.block<3, 3>(0, 0);
+    pose.block<3, 3>(0, 0) = q.normalized().toRotationMatrix();
+    R_curr = pose.block<3, 3>(0, 0);
+}
+
+/**
+ * @brief  update position & velocity with effective velocity change velocity_delta
+ * @param  T, timestamp delta
+ * @param  velocity_delta, effective velocity change
+ * @param  pose, pose to update
+ * @param  vel, velocity to update
+ * @return void
+ */
+inline void UpdatePosition(
+    const double T, const Eigen::Vector3d &velocity_delta,
+    Eigen::Matrix4d &pose, Eigen::Vector3d &vel
+) {
+    pose.block<3, 1>(0, 3) += T*vel + 0.5*T*velocity_delta;
+    vel += velocity_delta;
+}
+
+/**
+ * @brief  propagate pose & velocity from sample_prev to sample_curr
+ * @param  dq, delta quaternion of the rotation from sample_prev to sample_curr
+ * @param  sample_prev, previous IMU measurement
+ * @param  sample_curr, current IMU measurement
+ * @param  g, gravity in navigation frame
+ * @param  pose, pose to update
+ * @param  vel, velocity to update
+ * @return mid-value linear acceleration in navigation frame
+ */
+inline Eigen::Vector3d Propagate(
+    const Eigen::Quaterniond &dq,
+    const IMUSample &sample_prev, const IMUSample &sample_curr,
+    const Eigen::Vector3d &g,
+    Eigen::Matrix4d &pose, Eigen::Vector3d &vel
+) {
+    // update orientation:
+    Eigen::Matrix3d R_curr, R_prev;
+    UpdateOrientation(dq, pose, R_curr, R_prev);
+
+    // get velocity delta:
+    double T = sample_curr.time - sample_prev.time;
+    Eigen::Vector3d linear_acc_mid = 0.5*(
+        (R_curr*sample_curr.linear_acc - g) + (R_prev*sample_prev.linear_acc - g)
+    );
+    Eigen::Vector3d velocity_delta = T*linear_acc_mid;
+
+    // update position:
+    UpdatePosition(T, velocity_delta, pose, vel);
+
+    return linear_acc_mid;
+}
+
+/**
+ * @brief  mid-value integration of one IMU measurement
+ * @param  sample_prev, previous IMU measurement
+ * @param  sample_curr, current IMU measurement
+ * @param  g, gravity in navigation frame
+ * @param  pose, pose to update
+ * @param  vel, velocity to update
+ * @return mid-value linear acceleration in navigation frame
+ */
+inline Eigen::Vector3d IntegrateStep(
+    const IMUSample &sample_prev, const IMUSample &sample_curr,
+    const Eigen::Vector3d &g,
+    Eigen::Matrix4d &pose, Eigen::Vector3d &vel
+) {
+    return Propagate(
+        GetDeltaQuaternion(GetAngularDelta(sample_prev, sample_curr)),
+        sample_prev, sample_curr,
+        g,
+        pose, vel
+    );
+}
+
+} // namespace imu_mechanization
+
+} // namespace lidar_localization
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ * @Description: global map bucketed into x-y cells, for ROI cropping in O(points in ROI)
+ * @Author: Ge Yao
+ * @Date: 2020-12-20 16:05:38
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_LOCAL_MAP_GRID_MAP_HPP_
+#define LIDAR_LOCALIZATION_MODELS_LOCAL_MAP_GRID_MAP_HPP_
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+
+namespace lidar_localization {
+// points of the map are reordered so that each cell is one contiguous range.
+// the map is never modified afterwards, so GetMap can be called from any thread.
+class GridMap {
+  public:
+    GridMap(const CloudData::CLOUD_PTR& map_ptr, float cell_size);
+
+    // points inside the box, same as BoxFilter. edge is ordered as BoxFilter::GetEdge:
+    bool GetMap(const std::vector<float>& edge, CloudData::CLOUD_PTR& map_ptr) const;
+
+    // points of input inside the box appended to output, edge ordered as above:
+    static void Crop(const CloudData::CLOUD& input, const std::vector<float>& edge, CloudData::CLOUD& output);
+
+  private:
+    struct Cell {
+      size_t begin;
+      size_t end;
+      float min_z;
+      float max_z;
+    };
+
+    static int64_t GetCellKey(int ix, int iy);
+    int GetCellIndex(float value) const;
+
+  private:
+    CloudData::CLOUD_PTR map_ptr_;
+    float cell_size_;
+
+    std::unordered_map<int64_t, Cell> cells_;
+};
+}
+
+#endif
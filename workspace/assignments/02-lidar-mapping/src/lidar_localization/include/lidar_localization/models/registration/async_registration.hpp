@@ -0,0 +1,63 @@
+/*
+ * @Description: registration wrapper, the next target is built on a worker thread
+ * @Author: Ge Yao
+ * @Date: 2020-12-21 20:13:46
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_REGISTRATION_ASYNC_REGISTRATION_HPP_
+#define LIDAR_LOCALIZATION_MODELS_REGISTRATION_ASYNC_REGISTRATION_HPP_
+
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "lidar_localization/models/registration/registration_interface.hpp"
+
+namespace lidar_localization {
+// two instances of the same backend. ScanMatch keeps matching against the current target
+// while the next one is built, and swaps them before the first match after it is ready.
+// only the latest pending target is built. until the first ScanMatch, targets are set in place.
+class AsyncRegistration: public RegistrationInterface {
+  public:
+    AsyncRegistration(
+      const std::shared_ptr<RegistrationInterface>& registration_ptr,
+      const std::shared_ptr<RegistrationInterface>& next_registration_ptr
+    );
+    ~AsyncRegistration();
+
+    bool SetInputTarget(const CloudData::CLOUD_PTR& input_target) override;
+    bool ScanMatch(const CloudData::CLOUD_PTR& input_source, 
+                   const Eigen::Matrix4f& predict_pose, 
+                   CloudData::CLOUD_PTR& result_cloud_ptr,
+                   Eigen::Matrix4f& result_pose) override;
+    float GetFitnessScore() override;
+    bool SetMaxIterationLimit(int max_iteration_limit) override;
+    int GetNumIterations() override;
+    Result GetResult() override;
+
+  private:
+    // before the first match after the next target is ready:
+    void SwapInNext(void);
+    void Run(void);
+
+  private:
+    // only used by the caller thread:
+    std::shared_ptr<RegistrationInterface> registration_ptr_;
+    bool has_matched_ = false;
+    // applied to the next instance as well once it is swapped in:
+    int max_iteration_limit_ = -1;
+
+    std::mutex mutex_;
+    std::condition_variable has_task_;
+    // owned by the worker thread, handed over to the caller thread by is_next_ready_:
+    std::shared_ptr<RegistrationInterface> next_registration_ptr_;
+    CloudData::CLOUD_PTR pending_target_ptr_;
+    bool is_next_ready_ = false;
+    bool stop_ = false;
+
+    // declared last, so Run only starts once the instances above are set:
+    std::thread thread_;
+};
+}
+
+#endif
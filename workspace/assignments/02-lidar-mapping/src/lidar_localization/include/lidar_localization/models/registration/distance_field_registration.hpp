@@ -0,0 +1,131 @@
+/*
+ * @Description: registration against a truncated distance field of the target, in sparse voxel blocks
+ * @Author: Ge Yao
+ * @Date: 2021-01-06 20:41:17
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_REGISTRATION_DISTANCE_FIELD_REGISTRATION_HPP_
+#define LIDAR_LOCALIZATION_MODELS_REGISTRATION_DISTANCE_FIELD_REGISTRATION_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <pcl/kdtree/kdtree_flann.h>
+
+#include "lidar_localization/models/registration/registration_interface.hpp"
+
+namespace lidar_localization {
+// every cell within truncation of a target point keeps the signed distance of its center to the tangent plane
+// of the nearest target point and the plane normal as gradient, so the residual of a source point is
+// distance + gradient * (point - center), looked up in O(1) without any nearest neighbor search.
+// the field is built from each input target, unless it is precomputed for the whole map, e.g. by
+// build_distance_field_node, in which case setting the target costs nothing:
+class DistanceFieldRegistration: public RegistrationInterface {
+  public:
+    DistanceFieldRegistration(const YAML::Node& node);
+    DistanceFieldRegistration(
+      float res, float truncation, int num_neighbors, float trans_eps, int max_iter,
+      int num_threads = 0
+    );
+
+    bool SetInputTarget(const CloudData::CLOUD_PTR& input_target) override;
+    bool ScanMatch(const CloudData::CLOUD_PTR& input_source,
+                   const Eigen::Matrix4f& predict_pose,
+                   CloudData::CLOUD_PTR& result_cloud_ptr,
+                   Eigen::Matrix4f& result_pose) override;
+    float GetFitnessScore() override;
+    bool SetMaxIterationLimit(int max_iteration_limit) override;
+    int GetNumIterations() override;
+    // from the linear system of the last iteration, i.e., before its final step:
+    Result GetResult() override;
+
+    // field precomputed offline, e.g. of the whole map. once loaded, it is matched against instead of
+    // the field of each input target, which is only kept for GetFitnessScore. instances loading the
+    // same file share one copy:
+    bool SaveTarget(const std::string& file_path) const;
+    bool LoadTarget(const std::string& file_path);
+
+  private:
+    using Vector6d = Eigen::Matrix<double, 6, 1>;
+    using Matrix6d = Eigen::Matrix<double, 6, 6>;
+
+    // cells per block edge:
+    static const int BLOCK_SIZE = 8;
+    static const int NUM_BLOCK_CELLS = BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE;
+
+    // distance is NaN for cells beyond truncation:
+    struct Cell {
+      float distance;
+      float gradient[3];
+    };
+
+    struct Block {
+      Cell cells[NUM_BLOCK_CELLS];
+    };
+
+    struct Field {
+      float res;
+      float truncation;
+      std::vector<Block> blocks;
+      std::unordered_map<int64_t, int> block_index;
+    };
+
+    struct LinearSystem {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      void Reset(void);
+
+      double error = 0.0;
+      int num_corr = 0;
+      Vector6d b = Vector6d::Zero();
+      Matrix6d H = Matrix6d::Zero();
+    };
+
+    bool SetRegistrationParam(
+      float res, float truncation, int num_neighbors, float trans_eps, int max_iter,
+      int num_threads
+    );
+
+    void BuildField(const CloudData::CLOUD_PTR& input_target, Field& field) const;
+    // tangent planes of the target points, false for those without a planar neighborhood:
+    void ComputeNormals(
+      const CloudData::CLOUD_PTR& input_target,
+      std::vector<Eigen::Vector3f>& normals, std::vector<char>& is_valid
+    ) const;
+    static int64_t GetBlockKey(const Eigen::Vector3i &index);
+    // cell of the point and its center, nullptr if beyond truncation:
+    const Cell* GetCell(const Eigen::Vector3f &point, Eigen::Vector3f &center) const;
+
+    void BuildLinearSystem(const Eigen::Matrix4d &pose, LinearSystem &system);
+    static Eigen::Matrix4d UpdatePose(const Eigen::Matrix4d &pose, const Vector6d &delta);
+
+  private:
+    float res_;
+    float truncation_;
+    int num_neighbors_;
+    float trans_eps_;
+    int max_iter_;
+    int max_iteration_limit_ = -1;
+    int num_threads_;
+
+    // either built from the input target or loaded:
+    std::shared_ptr<const Field> field_ptr_;
+    bool is_prebuilt_ = false;
+
+    CloudData::CLOUD_PTR input_source_;
+    Eigen::Matrix4f final_transformation_ = Eigen::Matrix4f::Identity();
+    int num_iterations_ = 0;
+    Result result_;
+
+    // only built when fitness score is queried:
+    bool has_target_kdtree_ = false;
+    CloudData::CLOUD_PTR input_target_;
+    pcl::KdTreeFLANN<CloudData::POINT>::Ptr input_target_kdtree_;
+
+    std::vector<LinearSystem, Eigen::aligned_allocator<LinearSystem>> thread_systems_;
+};
+}
+
+#endif
@@ -0,0 +1,117 @@
+/*
+ * @Description: distribution-to-distribution NDT registration, the scan is matched as voxel Gaussians
+ * @Author: Ge Yao
+ * @Date: 2021-01-22 20:51:40
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_REGISTRATION_NDT_D2D_REGISTRATION_HPP_
+#define LIDAR_LOCALIZATION_MODELS_REGISTRATION_NDT_D2D_REGISTRATION_HPP_
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+#include <pcl/kdtree/kdtree_flann.h>
+
+#include "lidar_localization/models/registration/registration_interface.hpp"
+#include "lidar_localization/models/registration/ndt_voxel.hpp"
+
+namespace lidar_localization {
+// D2D-NDT, see Stoyanov et al. 2012. the source is voxelized once per ScanMatch, and every iteration has one term
+// per pair of a source voxel and a target voxel containing its transformed mean or a face neighbor of it,
+// instead of one per source point as NDTOMPRegistration. the derivatives of the rotated source covariance are
+// left out of the Gauss-Newton step
+class NDTD2DRegistration: public RegistrationInterface {
+  public:
+    NDTD2DRegistration(const YAML::Node& node);
+    NDTD2DRegistration(
+      float res, float source_res, int min_source_points,
+      float step_size, float trans_eps, int max_iter,
+      int num_threads = 0
+    );
+
+    bool SetInputTarget(const CloudData::CLOUD_PTR& input_target) override;
+    bool ScanMatch(const CloudData::CLOUD_PTR& input_source,
+                   const Eigen::Matrix4f& predict_pose,
+                   CloudData::CLOUD_PTR& result_cloud_ptr,
+                   Eigen::Matrix4f& result_pose) override;
+    float GetFitnessScore() override;
+    bool SetMaxIterationLimit(int max_iteration_limit) override;
+    int GetNumIterations() override;
+    // from the derivatives at the result pose, inliers are the points of source voxels with a neighbor voxel:
+    Result GetResult() override;
+
+  private:
+    using Vector6d = Eigen::Matrix<double, 6, 1>;
+    using Matrix6d = Eigen::Matrix<double, 6, 6>;
+
+    using Voxel = NDTVoxel::Distribution;
+    using VoxelVector = std::vector<Voxel, Eigen::aligned_allocator<Voxel>>;
+
+    // per-thread partial sums of score, gradient and Gauss-Newton Hessian:
+    struct Derivatives {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      void Reset(void);
+
+      double score = 0.0;
+      Vector6d g = Vector6d::Zero();
+      Matrix6d H = Matrix6d::Zero();
+
+      // squared distance of source voxel means to the plane of their most likely neighbor voxel, by num. of points:
+      double sum_sq_dis = 0.0;
+      int num_matched_points = 0;
+    };
+
+    bool SetRegistrationParam(
+      float res, float source_res, int min_source_points,
+      float step_size, float trans_eps, int max_iter,
+      int num_threads
+    );
+
+    // distributions of the valid voxels of cloud, with the key & the num. of points of each:
+    void BuildVoxels(
+      const CloudData::CLOUD& cloud, float res, int min_num_points,
+      VoxelVector& voxels, std::vector<int64_t>& keys, std::vector<int>& num_points
+    ) const;
+    int GetNeighborVoxels(const Eigen::Vector3f &point, const Voxel *neighbors[]) const;
+
+    double ComputeDerivatives(const Eigen::Matrix4d &pose, Derivatives &derivatives);
+    static Eigen::Matrix4d UpdatePose(const Eigen::Matrix4d &pose, const Vector6d &delta);
+
+  private:
+    float res_;
+    float source_res_;
+    int min_source_points_;
+    float step_size_;
+    float trans_eps_;
+    int max_iter_;
+    int max_iteration_limit_ = -1;
+    int num_threads_;
+
+    // NDT score function constants, see Magnusson 2009, eq. 6.8:
+    double gauss_d1_;
+    double gauss_d2_;
+
+    // target voxel grid:
+    VoxelVector voxels_;
+    std::unordered_map<int64_t, int> voxel_index_;
+
+    // source voxels of the current ScanMatch:
+    VoxelVector source_voxels_;
+    std::vector<int> source_num_points_;
+
+    CloudData::CLOUD_PTR input_target_;
+    CloudData::CLOUD_PTR input_source_;
+    Eigen::Matrix4f final_transformation_ = Eigen::Matrix4f::Identity();
+    int num_iterations_ = 0;
+    Result result_;
+
+    // only built when fitness score is queried:
+    bool has_target_kdtree_ = false;
+    pcl::KdTreeFLANN<CloudData::POINT>::Ptr input_target_kdtree_;
+
+    std::vector<Derivatives, Eigen::aligned_allocator<Derivatives>> thread_derivatives_;
+};
+}
+
+#endif
@@ -21,12 +21,16 @@ class NDTRegistration: public RegistrationInterface {
                    CloudData::CLOUD_PTR& result_cloud_ptr,
                    Eigen::Matrix4f& result_pose) override;
     float GetFitnessScore() override;
+    int GetNumIterations() override;
+    Result GetResult() override;
+    bool SetMaxIterationLimit(int max_iteration_limit) override;
   
   private:
     bool SetRegistrationParam(float res, float step_size, float trans_eps, int max_iter);
 
   private:
     pcl::NormalDistributionsTransform<CloudData::POINT, CloudData::POINT>::Ptr ndt_ptr_;
+    int max_iter_;
 };
 }
 
@@ -0,0 +1,76 @@
+/*
+ * @Description: coarse-to-fine registration over a pyramid of NDT resolutions
+ * @Author: Ge Yao
+ * @Date: 2020-12-13 19:52:30
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_REGISTRATION_PYRAMID_REGISTRATION_HPP_
+#define LIDAR_LOCALIZATION_MODELS_REGISTRATION_PYRAMID_REGISTRATION_HPP_
+
+#include <memory>
+#include <vector>
+
+#include <pcl/kdtree/kdtree_flann.h>
+
+#include "lidar_localization/models/registration/registration_interface.hpp"
+#include "lidar_localization/models/cloud_filter/cloud_filter_interface.hpp"
+
+namespace lidar_localization {
+// each level refines the pose of the previous one, on a source downsampled for that level.
+// finer levels are skipped once the fitness score is below the threshold:
+class PyramidRegistration: public RegistrationInterface {
+  public:
+    struct LevelStats {
+      float res = 0.0f;
+      // accumulated over all ScanMatch calls:
+      size_t num_runs = 0;
+      size_t num_iterations = 0;
+      size_t num_early_stops = 0;
+      double time_consumption = 0.0;
+      // last ScanMatch call, -1 if the level was skipped:
+      int last_num_iterations = -1;
+      float last_fitness_score = 0.0f;
+    };
+
+    PyramidRegistration(const YAML::Node& node);
+
+    bool SetInputTarget(const CloudData::CLOUD_PTR& input_target) override;
+    bool ScanMatch(const CloudData::CLOUD_PTR& input_source,
+                   const Eigen::Matrix4f& predict_pose,
+                   CloudData::CLOUD_PTR& result_cloud_ptr,
+                   Eigen::Matrix4f& result_pose) override;
+    float GetFitnessScore() override;
+    bool SetMaxIterationLimit(int max_iteration_limit) override;
+    // summed over the levels run:
+    int GetNumIterations() override;
+    // from the last level run, with the fitness score and iterations of the pyramid:
+    Result GetResult() override;
+
+    const std::vector<LevelStats>& GetLevelStats() const { return level_stats_; }
+
+  private:
+    struct Level {
+      std::shared_ptr<RegistrationInterface> registration_ptr;
+      // no downsampling if empty:
+      std::shared_ptr<CloudFilterInterface> filter_ptr;
+    };
+
+    // same definition as pcl::Registration::getFitnessScore, with one target kd-tree for all levels:
+    float ComputeFitnessScore(const CloudData::CLOUD_PTR& input_source, const Eigen::Matrix4f& pose);
+
+  private:
+    std::vector<Level> levels_;
+    std::vector<LevelStats> level_stats_;
+    float fitness_score_thresh_;
+
+    CloudData::CLOUD_PTR input_target_;
+    bool has_target_kdtree_ = false;
+    pcl::KdTreeFLANN<CloudData::POINT>::Ptr input_target_kdtree_;
+
+    float fitness_score_ = 0.0f;
+    int num_iterations_ = 0;
+    // -1 if no level was run:
+    int last_level_ = -1;
+};
+}
+
+#endif
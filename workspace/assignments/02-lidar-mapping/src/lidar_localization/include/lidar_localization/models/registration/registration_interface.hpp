@@ -6,6 +6,7 @@
 #ifndef LIDAR_LOCALIZATION_MODELS_REGISTRATION_INTERFACE_HPP_
 #define LIDAR_LOCALIZATION_MODELS_REGISTRATION_INTERFACE_HPP_
 
+#include <limits>
 #include <yaml-cpp/yaml.h>
 #include <Eigen/Dense>
 #include "lidar_localization/sensor_data/cloud_data.hpp"
@@ -13,6 +14,20 @@
 namespace lidar_localization {
 class RegistrationInterface {
   public:
+    // summary of the last ScanMatch, fields a backend does not report keep their defaults:
+    struct Result {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      float fitness_score = std::numeric_limits<float>::max();
+      // ratio of source points with a correspondence, -1 if not available:
+      float inlier_ratio = -1.0f;
+      int num_iterations = -1;
+      bool has_converged = false;
+      // Gauss-Newton Hessian w.r.t. [delta_t, delta_theta] of the result pose, small eigenvalues mark degenerate directions:
+      bool has_hessian = false;
+      Eigen::Matrix<double, 6, 6> hessian = Eigen::Matrix<double, 6, 6>::Zero();
+    };
+
     virtual ~RegistrationInterface() = default;
 
     virtual bool SetInputTarget(const CloudData::CLOUD_PTR& input_target) = 0;
@@ -21,6 +36,17 @@ class RegistrationInterface {
                           CloudData::CLOUD_PTR& result_cloud_ptr,
                           Eigen::Matrix4f& result_pose) = 0;
     virtual float GetFitnessScore() = 0;
+    // iterations used by the last ScanMatch, -1 if not available:
+    virtual int GetNumIterations() { return -1; }
+    virtual Result GetResult() {
+        Result result;
+        result.fitness_score = GetFitnessScore();
+        result.num_iterations = GetNumIterations();
+        return result;
+    }
+    // cap the iterations of the following matches below the configured max., negative to lift the cap.
+    // false if the backend has no such limit:
+    virtual bool SetMaxIterationLimit(int max_iteration_limit) { return false; }
 };
 } 
 
@@ -10,6 +10,7 @@
 #include <yaml-cpp/yaml.h>
 
 #include <vector>
+#include <functional>
 
 #include <Eigen/Core>
 #include <Eigen/Dense>
@@ -29,6 +30,9 @@ public:
     typedef KDTreeVectorOfVectorsAdaptor<RingKeys, float> RingKeyIndex;
 
     static const int NONE = -1;
+
+    // false for key frames not to be scored, e.g., those too far away by GNSS:
+    typedef std::function<bool(int key_frame_id)> CandidateFilter;
     
     ScanContextManager(const YAML::Node& node);
 
@@ -50,6 +54,36 @@ public:
      * @return true for success match otherwise false
      */
     bool DetectLoopClosure(const CloudData &scan,Eigen::Matrix4f &pose);
+    /**
+     * @brief  get up to N loop closure proposals using the given key scan
+     * @param  scan, query key scan
+     * @param  N, max. num. of proposals
+     * @param  poses, matched poses, best first
+     * @return true if any proposal is found
+     */
+    bool DetectLoopClosure(
+        const CloudData &scan, 
+        const int N, 
+        std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> &poses
+    );
+    /**
+     * @brief  get up to N loop closure proposals using the given key scan, among the ones passing the filter,
+     *         e.g. the key frames within the GNSS-gated region
+     * @param  scan, query key scan
+     * @param  N, max. num. of proposals
+     * @param  is_candidate, ring key neighbors failing it are dropped before scan context comparison
+     * @param  poses, matched poses, best first
+     * @return true if any proposal is found
+     */
+    bool DetectLoopClosure(
+        const CloudData &scan, 
+        const int N, 
+        const CandidateFilter &is_candidate,
+        std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> &poses
+    );
+
+    // by key frame id within the loaded index:
+    const KeyFrame &GetKeyFrame(const int key_frame_id) const { return state_.index_.data_.key_frame_.at(key_frame_id); }
 
     /**
      * @brief  save scan context index & data to persistent storage
@@ -179,6 +213,22 @@ private:
         const ScanContext &query_scan_context,
         const RingKey &query_ring_key
     );
+    /**
+     * @brief  get loop closure match results for given scan context and ring key 
+     * @param  query_scan_context, query scan context 
+     * @param  query_ring_key, query ring key
+     * @param  N, max. num. of matches
+     * @param  is_candidate, ring key neighbors failing it are not scored, none are dropped if empty
+     * @param  matches, matches below distance thresh, best first
+     * @return void
+     */
+    void GetLoopClosureMatches(
+        const ScanContext &query_scan_context,
+        const RingKey &query_ring_key,
+        const int N,
+        const CandidateFilter &is_candidate,
+        std::vector<std::pair<int, float>> &matches
+    );
 
     /**
      * @brief  save scan context index
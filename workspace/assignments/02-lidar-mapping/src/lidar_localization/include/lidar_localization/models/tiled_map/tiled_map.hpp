@@ -0,0 +1,125 @@
+/*
+ * @Description: global map split into x-y tiles, loaded on demand
+ * @Author: Ge Yao
+ * @Date: 2020-12-14 20:17:52
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_TILED_MAP_TILED_MAP_HPP_
+#define LIDAR_LOCALIZATION_MODELS_TILED_MAP_TILED_MAP_HPP_
+
+#include <cstdint>
+#include <list>
+#include <deque>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/models/tiled_map/mapped_tile_store.hpp"
+
+namespace lidar_localization {
+// layout:
+//   index.yaml          -- tile size and the num. of points of every non-empty tile
+//   tile_<ix>_<iy>.pcd  -- points with x in [ix, ix + 1) * tile_size, y likewise, already filtered
+//   tiles.bin           -- optional, the points of all tiles for the mapped store, see MappedTileStore
+// tiles are kept in an LRU cache, prefetched ones are loaded on a worker thread.
+// mapped, the tiles are read from tiles.bin instead, which then is the cache, and prefetched ones are faulted in.
+class TiledMap {
+  public:
+    struct Stats {
+      size_t num_hits = 0;
+      size_t num_misses = 0;
+      size_t num_prefetched = 0;
+      size_t num_tiles = 0;
+      size_t size_in_bytes = 0;
+    };
+
+    // split map into tiles under tiles_path:
+    static bool Save(const std::string& tiles_path, const CloudData::CLOUD& map, float tile_size);
+    // pack the tiles saved under tiles_path into tiles.bin:
+    static bool SaveMapped(const std::string& tiles_path);
+
+    // max_size_in_mb is ignored if mapped, tiles.bin is packed first if it does not match the tiles:
+    TiledMap(
+      const std::string& tiles_path, size_t max_size_in_mb, 
+      bool is_mapped = false, MappedTileStore::HugePages huge_pages = MappedTileStore::HugePages::NONE
+    );
+    ~TiledMap();
+
+    bool IsValid(void) const { return tile_size_ > 0.0f; }
+    // false if the mapped store is not available either:
+    bool IsMapped(void) const { return mapped_store_ptr_ != nullptr; }
+    MappedTileStore::HugePages GetHugePages(void) const { 
+      return mapped_store_ptr_ ? mapped_store_ptr_->GetHugePages() : MappedTileStore::HugePages::NONE; 
+    }
+
+    // all tiles overlapping the x-y range of edge, which is ordered as BoxFilter::GetEdge:
+    bool GetMap(const std::vector<float>& edge, CloudData::CLOUD_PTR& map_ptr);
+    // queue the tiles overlapping edge for background loading:
+    void Prefetch(const std::vector<float>& edge);
+    // asynchronous read-ahead of the tiles overlapping edge by the kernel, mapped only:
+    void WillNeed(const std::vector<float>& edge);
+    // tiles in cache, for visualization:
+    void GetCachedMap(CloudData::CLOUD_PTR& map_ptr);
+
+    Stats GetStats(void);
+
+  private:
+    struct Entry {
+      CloudData::CLOUD::ConstPtr tile_ptr;
+      size_t size_in_bytes;
+      std::list<int64_t>::iterator lru_it;
+    };
+
+    static int64_t GetTileKey(int ix, int iy);
+    static std::string GetTileFileName(int ix, int iy);
+
+    bool LoadIndex(void);
+    bool InitMappedStore(MappedTileStore::HugePages huge_pages);
+    void GetTileKeys(const std::vector<float>& edge, std::vector<int64_t>& tile_keys) const;
+    bool LoadTile(int64_t tile_key, CloudData::CLOUD_PTR& tile_ptr);
+    // both below must be called with mutex_ held:
+    void Insert(int64_t tile_key, const CloudData::CLOUD::ConstPtr& tile_ptr);
+    void Evict(void);
+
+    void Run(void);
+
+  private:
+    std::string tiles_path_;
+    float tile_size_ = 0.0f;
+    size_t max_size_in_bytes_;
+
+    // tile key to file name, only non-empty tiles are indexed:
+    std::unordered_map<int64_t, std::string> tile_files_;
+    // tile key to index order, and the num. of points of every tile in index order:
+    std::unordered_map<int64_t, size_t> tile_indices_;
+    std::vector<size_t> tile_num_points_;
+    // nullptr unless mapped:
+    std::shared_ptr<MappedTileStore> mapped_store_ptr_;
+
+    std::mutex mutex_;
+    std::condition_variable has_task_;
+    std::condition_variable has_loaded_;
+
+    // most recently used first:
+    std::list<int64_t> lru_;
+    std::unordered_map<int64_t, Entry> entries_;
+
+    // tiles taken over by GetMap are only removed from queued_:
+    std::deque<int64_t> queue_;
+    std::unordered_set<int64_t> queued_;
+    bool is_loading_ = false;
+    int64_t loading_tile_key_ = 0;
+    bool stop_ = false;
+    Stats stats_;
+
+    // loads the tiles in queue_:
+    std::thread thread_;
+};
+}
+
+#endif
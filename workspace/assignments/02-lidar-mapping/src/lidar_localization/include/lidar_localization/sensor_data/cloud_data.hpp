@@ -20,6 +20,10 @@ class CloudData {
     CloudData()
       :cloud_ptr(new CLOUD()) {
     }
+    // e.g. a recycled cloud from CloudPool:
+    explicit CloudData(const CLOUD_PTR& cloud_ptr)
+      :cloud_ptr(cloud_ptr) {
+    }
 
   public:
     double time = 0.0;
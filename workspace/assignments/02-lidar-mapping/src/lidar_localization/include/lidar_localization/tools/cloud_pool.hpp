@@ -0,0 +1,55 @@
+/*
+ * @Description: process-wide pool of per-frame point clouds, recycled with their point storage
+ * @Author: Ge Yao
+ * @Date: 2020-12-28 09:12:45
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_CLOUD_POOL_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_CLOUD_POOL_HPP_
+
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+
+namespace lidar_localization {
+// a cloud from Get goes back to the free list once its last reference is dropped, from any thread,
+// so the point vectors of the scans, filtered & matched clouds keep their capacity from frame to frame.
+// clouds outliving the pool, or too large to keep, e.g. maps, are freed as usual
+class CloudPool {
+  public:
+    static CloudPool& GetInstance(void);
+
+    // empty cloud, with the point capacity of a recycled one if any:
+    CloudData::CLOUD_PTR Get(void);
+    size_t GetNumFreeClouds(void);
+
+    size_t GetNumReused(void) const { return num_reused_.load(std::memory_order_relaxed); }
+    size_t GetNumAllocated(void) const { return num_allocated_.load(std::memory_order_relaxed); }
+
+  private:
+    struct FreeList {
+      ~FreeList();
+
+      std::mutex mutex;
+      std::vector<CloudData::CLOUD*> clouds;
+    };
+
+    CloudPool();
+    CloudPool(const CloudPool&) = delete;
+    CloudPool& operator=(const CloudPool&) = delete;
+
+    static void Release(const std::weak_ptr<FreeList>& free_list_ptr, CloudData::CLOUD* cloud);
+
+  private:
+    // shared with the deleters of the clouds handed out:
+    std::shared_ptr<FreeList> free_list_ptr_;
+
+    std::atomic<size_t> num_reused_{0};
+    std::atomic<size_t> num_allocated_{0};
+};
+} // namespace lidar_localization
+
+#endif
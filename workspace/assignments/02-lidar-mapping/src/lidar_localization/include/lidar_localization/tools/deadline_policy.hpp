@@ -0,0 +1,60 @@
+/*
+ * @Description: load shedding decisions of a flow, to keep its output latency bounded on a busy CPU
+ * @Author: Ge Yao
+ * @Date: 2020-12-30 15:32:09
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_DEADLINE_POLICY_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_DEADLINE_POLICY_HPP_
+
+#include <cstddef>
+
+#include <yaml-cpp/yaml.h>
+
+namespace lidar_localization {
+// a measurement older than the latest received one by more than max_delay is stale, and is skipped.
+// the load level follows the smoothed processing time of the measurements that are not: one level up over
+// the budget, one level down under half of it, at least min_dwell measurements apart. level 0 is full quality,
+// what a level degrades is up to the flow. every decision is counted, see Stats
+class DeadlinePolicy {
+  public:
+    struct Stats {
+      size_t num_stale = 0;
+      size_t num_level_ups = 0;
+      size_t num_level_downs = 0;
+      size_t num_degraded = 0;
+    };
+
+    /**
+     * @brief  load shedding policy of a flow
+     * @param  node, config with enabled, max_delay, processing_budget & min_dwell
+     * @param  num_levels, num. of degraded levels
+     */
+    DeadlinePolicy(const YAML::Node& node, int num_levels);
+
+    // stale measurements are counted:
+    bool IsStale(double time, double latest_time);
+    // processing time of a measurement in seconds, true if the load level changed:
+    bool Update(double processing_time);
+
+    bool IsEnabled(void) const { return enabled_; }
+    int GetLevel(void) const { return level_; }
+    const Stats& GetStats(void) const { return stats_; }
+
+  private:
+    bool enabled_ = false;
+    double max_delay_ = 0.0;
+    double processing_budget_ = 0.0;
+    int min_dwell_ = 0;
+    int num_levels_ = 0;
+
+    int level_ = 0;
+    // measurements since the last level change:
+    int dwell_ = 0;
+    bool has_processing_time_ = false;
+    double smoothed_processing_time_ = 0.0;
+
+    Stats stats_;
+};
+} // namespace lidar_localization
+
+#endif
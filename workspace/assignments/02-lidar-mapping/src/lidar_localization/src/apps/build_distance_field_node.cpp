@@ -0,0 +1,65 @@
+/*
+ * @Description: precompute the distance field of the global map, so setting a local map builds nothing
+ * @Author: Ge Yao
+ * @Date: 2021-01-06 21:17:52
+ */
+#include <string>
+#include <iostream>
+
+#include <yaml-cpp/yaml.h>
+#include <pcl/io/pcd_io.h>
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/models/cloud_filter/voxel_filter.hpp"
+#include "lidar_localization/models/registration/distance_field_registration.hpp"
+
+using namespace lidar_localization;
+
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_alsologtostderr = 1;
+
+    std::string config_file_path = WORK_SPACE_PATH + "/config/matching/matching.yaml";
+    YAML::Node config_node = YAML::LoadFile(config_file_path);
+
+    std::string map_path = config_node["map_path"].as<std::string>();
+    const YAML::Node& field_node = config_node["DISTANCE_FIELD"];
+    std::string target_path = field_node["target_path"].as<std::string>();
+    if (target_path.empty()) {
+        LOG(ERROR) << "DISTANCE_FIELD.target_path is not set in " << config_file_path;
+        return 1;
+    }
+
+    CloudData::CLOUD_PTR map_ptr(new CloudData::CLOUD());
+    if (pcl::io::loadPCDFile(map_path, *map_ptr) != 0) {
+        LOG(ERROR) << "Failed to load global map " << map_path;
+        return 1;
+    }
+    LOG(INFO) << "Load global map, size:" << map_ptr->points.size();
+
+    // same as what matching applies to the whole map in pcd format:
+    if (config_node["local_map_filter"].as<std::string>() == "voxel_filter") {
+        VoxelFilter local_map_filter(config_node["voxel_filter"]["local_map"]);
+        local_map_filter.Filter(map_ptr, map_ptr);
+        LOG(INFO) << "Filtered global map, size:" << map_ptr->points.size();
+    }
+
+    // the field of the whole map, with the matching parameters of localization:
+    DistanceFieldRegistration registration(
+        field_node["res"].as<float>(), field_node["truncation"].as<float>(),
+        field_node["num_neighbors"].as<int>(),
+        field_node["trans_eps"].as<float>(), field_node["max_iter"].as<int>(),
+        field_node["num_threads"].as<int>()
+    );
+    registration.SetInputTarget(map_ptr);
+
+    if (!registration.SaveTarget(target_path)) {
+        LOG(ERROR) << "Failed to save distance field " << target_path;
+        return 1;
+    }
+    LOG(INFO) << "Save distance field " << target_path;
+
+    return 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * @Description: split the global map into tiles for on-demand loading in localization
+ * @Author: Ge Yao
+ * @Date: 2020-12-14 20:17:52
+ */
+#include <string>
+#include <iostream>
+
+#include <yaml-cpp/yaml.h>
+#include <pcl/io/pcd_io.h>
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/models/cloud_filter/voxel_filter.hpp"
+#include "lidar_localization/models/tiled_map/tiled_map.hpp"
+
+using namespace lidar_localization;
+
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_alsologtostderr = 1;
+
+    std::string config_file_path = WORK_SPACE_PATH + "/config/matching/matching.yaml";
+    YAML::Node config_node = YAML::LoadFile(config_file_path);
+
+    std::string map_path = config_node["map_path"].as<std::string>();
+    std::string tiles_path = config_node["tiled_map"]["tiles_path"].as<std::string>();
+    float tile_size = config_node["tiled_map"]["tile_size"].as<float>();
+
+    CloudData::CLOUD_PTR map_ptr(new CloudData::CLOUD());
+    if (pcl::io::loadPCDFile(map_path, *map_ptr) != 0) {
+        LOG(ERROR) << "Failed to load global map " << map_path;
+        return 1;
+    }
+    LOG(INFO) << "Load global map, size:" << map_ptr->points.size();
+
+    // same as what matching applies to the whole map in pcd format:
+    if (config_node["local_map_filter"].as<std::string>() == "voxel_filter") {
+        VoxelFilter local_map_filter(config_node["voxel_filter"]["local_map"]);
+        local_map_filter.Filter(map_ptr, map_ptr);
+        LOG(INFO) << "Filtered global map, size:" << map_ptr->points.size();
+    }
+
+    if (!TiledMap::Save(tiles_path, *map_ptr, tile_size))
+        return 1;
+
+    // otherwise packed by matching at startup:
+    const YAML::Node& storage_node = config_node["tiled_map"]["storage"];
+    if (storage_node && storage_node.as<std::string>() == "mapped" && !TiledMap::SaveMapped(tiles_path))
+        return 1;
+
+    return 0;
+}
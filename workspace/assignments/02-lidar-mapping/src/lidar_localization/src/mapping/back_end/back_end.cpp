@@ -5,6 +5,8 @@
  */
 #include "lidar_localization/mapping/back_end/back_end.hpp"
 
+#include <algorithm>
+
 #include <Eigen/Dense>
 #include <pcl/io/pcd_io.h>
 #include "glog/logging.h"
@@ -94,6 +96,12 @@ bool BackEnd::InitDataPath(const YAML::Node& config_node) {
     if (!FileManager::CreateFile(laser_odom_ofs_, trajectory_path_ + "/laser_odom.txt"))
         return false;
 
+    int key_frame_queue_size = config_node["key_frame_queue_size"].as<int>();
+    key_frame_writer_ptr_ = std::make_shared<KeyFrameWriter>(
+        static_cast<size_t>(std::max(key_frame_queue_size, 1))
+    );
+    std::cout << "\tKey Frame Queue Size:" << key_frame_queue_size << std::endl << std::endl;
+
     return true;
 }
 
@@ -173,13 +181,13 @@ bool BackEnd::MaybeNewKeyFrame(const CloudData& cloud_data, const PoseData& lase
 
     // if so:
     if (has_new_key_frame_) {
-        // a. first write new key scan to disk:
+        // a. first queue new key scan for disk write, the writer shares the copy kept as current key scan:
         std::string file_path = key_frames_path_ + "/key_frame_" + std::to_string(key_frames_deque_.size()) + ".pcd";
-        pcl::io::savePCDFileBinary(file_path, *cloud_data.cloud_ptr);
         current_key_scan_.time = cloud_data.time;
         current_key_scan_.cloud_ptr.reset(
             new CloudData::CLOUD(*cloud_data.cloud_ptr)
         );
+        key_frame_writer_ptr_->Write(file_path, current_key_scan_.cloud_ptr);
 
         // b. create key frame index for lidar scan:
         KeyFrame key_frame;
@@ -274,6 +282,16 @@ bool BackEnd::SaveOptimizedPose() {
 }
 
 bool BackEnd::ForceOptimize() {
+    // make sure all key scans are on disk before the optimized key frames go out:
+    key_frame_writer_ptr_->Flush();
+
+    KeyFrameWriter::Stats stats = key_frame_writer_ptr_->GetStats();
+    LOG(INFO) << "Key frame writer: " 
+              << stats.num_written << " written, " 
+              << stats.num_failed << " failed, "
+              << stats.num_blocked << " blocked, "
+              << "max queue depth " << stats.max_queue_depth << std::endl;
+
     if (graph_optimizer_ptr_->Optimize())
         has_new_optimized_ = true;
 
@@ -13,9 +13,11 @@
 
 #include "lidar_localization/global_defination/global_defination.h"
 #include "lidar_localization/tools/print_info.hpp"
+#include "lidar_localization/tools/cloud_pool.hpp"
 #include "lidar_localization/models/registration/ndt_registration.hpp"
 #include "lidar_localization/models/cloud_filter/voxel_filter.hpp"
 #include "lidar_localization/models/cloud_filter/no_filter.hpp"
+#include "lidar_localization/models/local_map/voxel_hash_map.hpp"
 
 namespace lidar_localization {
 FrontEnd::FrontEnd()
@@ -33,6 +35,7 @@ bool FrontEnd::InitWithConfig() {
     InitRegistration(registration_ptr_, config_node);
     InitFilter("local_map", local_map_filter_ptr_, config_node);
     InitFilter("frame", frame_filter_ptr_, config_node);
+    InitLocalMap(config_node);
 
     return true;
 }
@@ -74,17 +77,30 @@ bool FrontEnd::InitFilter(std::string filter_user, std::shared_ptr<CloudFilterIn
     return true;
 }
 
+bool FrontEnd::InitLocalMap(const YAML::Node& config_node) {
+    std::string local_map_update = config_node["local_map_update"].as<std::string>();
+    std::cout << "\tLocal Map Update Method: " << local_map_update << std::endl;
+
+    if (local_map_update == "incremental") {
+        if (config_node["local_map_filter"].as<std::string>() != "voxel_filter") {
+            LOG(WARNING) << "Incremental local map requires voxel_filter as local_map_filter. Fall back to full_rebuild.";
+            return false;
+        }
+        local_map_voxels_ptr_ = std::make_shared<VoxelHashMap>(config_node["voxel_filter"]["local_map"]);
+    } else if (local_map_update != "full_rebuild") {
+        LOG(ERROR) << "Local map update method " << local_map_update << " NOT FOUND!";
+        return false;
+    }
+
+    return true;
+}
+
 bool FrontEnd::SetInitPose(const Eigen::Matrix4f& init_pose) {
     init_pose_ = init_pose;
     return true;
 }
 
 bool FrontEnd::Update(const CloudData& cloud_data, Eigen::Matrix4f& cloud_pose) {
-    static Eigen::Matrix4f step_pose = Eigen::Matrix4f::Identity();
-    static Eigen::Matrix4f last_pose = init_pose_;
-    static Eigen::Matrix4f predict_pose = init_pose_;
-    static Eigen::Matrix4f last_key_frame_pose = init_pose_;
-
     // 
     // set up current scan:
     // 
@@ -93,13 +109,16 @@ bool FrontEnd::Update(const CloudData& cloud_data, Eigen::Matrix4f& cloud_pose)
     std::vector<int> indices;
     pcl::removeNaNFromPointCloud(*cloud_data.cloud_ptr, *current_frame_.cloud_data.cloud_ptr, indices);
     // b. apply filter to current scan:
-    CloudData::CLOUD_PTR filtered_cloud_ptr(new CloudData::CLOUD());
+    CloudData::CLOUD_PTR filtered_cloud_ptr = CloudPool::GetInstance().Get();
     frame_filter_ptr_->Filter(current_frame_.cloud_data.cloud_ptr, filtered_cloud_ptr);
 
     //
     // set up local map:
     //
     if (local_map_frames_.size() == 0) {
+        step_pose_ = Eigen::Matrix4f::Identity();
+        last_pose_ = predict_pose_ = last_key_frame_pose_ = init_pose_;
+
         current_frame_.pose = init_pose_;
         UpdateWithNewFrame(current_frame_);
         cloud_pose = current_frame_.pose;
@@ -109,25 +128,25 @@ bool FrontEnd::Update(const CloudData& cloud_data, Eigen::Matrix4f& cloud_pose)
     // 
     // update lidar odometry using scan match result:
     // 
-    CloudData::CLOUD_PTR result_cloud_ptr(new CloudData::CLOUD());
-    registration_ptr_->ScanMatch(filtered_cloud_ptr, predict_pose, result_cloud_ptr, current_frame_.pose);
+    CloudData::CLOUD_PTR result_cloud_ptr = CloudPool::GetInstance().Get();
+    registration_ptr_->ScanMatch(filtered_cloud_ptr, predict_pose_, result_cloud_ptr, current_frame_.pose);
     cloud_pose = current_frame_.pose;
 
     //
     // update init pose for next scan match:
     //
-    step_pose = last_pose.inverse() * current_frame_.pose;
-    predict_pose = current_frame_.pose * step_pose;
-    last_pose = current_frame_.pose;
+    step_pose_ = last_pose_.inverse() * current_frame_.pose;
+    predict_pose_ = current_frame_.pose * step_pose_;
+    last_pose_ = current_frame_.pose;
 
     // 
     // shall the key frame set be updated:
     //
-    if (fabs(last_key_frame_pose(0,3) - current_frame_.pose(0,3)) + 
-        fabs(last_key_frame_pose(1,3) - current_frame_.pose(1,3)) +
-        fabs(last_key_frame_pose(2,3) - current_frame_.pose(2,3)) > key_frame_distance_) {
+    if (fabs(last_key_frame_pose_(0,3) - current_frame_.pose(0,3)) + 
+        fabs(last_key_frame_pose_(1,3) - current_frame_.pose(1,3)) +
+        fabs(last_key_frame_pose_(2,3) - current_frame_.pose(2,3)) > key_frame_distance_) {
         UpdateWithNewFrame(current_frame_);
-        last_key_frame_pose = current_frame_.pose;
+        last_key_frame_pose_ = current_frame_.pose;
     }
 
     return true;
@@ -135,6 +154,7 @@ bool FrontEnd::Update(const CloudData& cloud_data, Eigen::Matrix4f& cloud_pose)
 
 bool FrontEnd::UpdateWithNewFrame(const Frame& new_key_frame) {
     Frame key_frame = new_key_frame;
+    key_frame.id = num_key_frames_++;
     // 这一步的目的是为了把关键帧的点云保存下来
     // 由于用的是共享指针，所以直接复制只是复制了一个指针而已
     // 此时无论你放多少个关键帧在容器里，这些关键帧点云指针都是指向的同一个点云
@@ -142,14 +162,43 @@ bool FrontEnd::UpdateWithNewFrame(const Frame& new_key_frame) {
     
     // keep only the latest local_frame_num_ frames:
     local_map_frames_.push_back(key_frame);
+    std::deque<Frame> evicted_frames;
     while (local_map_frames_.size() > static_cast<size_t>(local_frame_num_)) {
+        evicted_frames.push_back(local_map_frames_.front());
         local_map_frames_.pop_front();
     }
 
+    // the new key frame in map frame:
+    CloudData::CLOUD_PTR transformed_cloud_ptr = CloudPool::GetInstance().Get();
+    pcl::transformPointCloud(
+        *key_frame.cloud_data.cloud_ptr, 
+        *transformed_cloud_ptr, 
+        key_frame.pose
+    );
+
+    // incremental local map, only the new and the evicted frames are touched:
+    if (local_map_voxels_ptr_) {
+        for (const auto &evicted_frame: evicted_frames) {
+            local_map_voxels_ptr_->RemoveFrame(evicted_frame.id);
+        }
+        local_map_voxels_ptr_->AddFrame(key_frame.id, transformed_cloud_ptr);
+
+        // scan-to-map matching:
+        // set target as local map, unfiltered while the window is still short:
+        if (local_map_frames_.size() < 10 && evicted_frames.empty()) {
+            *local_map_ptr_ += *transformed_cloud_ptr;
+            registration_ptr_->SetInputTarget(local_map_ptr_);
+        } else {
+            local_map_voxels_ptr_->GetMap(local_map_ptr_);
+            registration_ptr_->SetInputTarget(local_map_ptr_);
+        }
+
+        return true;
+    }
+
     // transform all local frame measurements to map frame
     // to create local map:
     local_map_ptr_.reset(new CloudData::CLOUD());
-    CloudData::CLOUD_PTR transformed_cloud_ptr(new CloudData::CLOUD());
     for (size_t i = 0; i < local_map_frames_.size(); ++i) {
         pcl::transformPointCloud(
             *local_map_frames_.at(i).cloud_data.cloud_ptr, 
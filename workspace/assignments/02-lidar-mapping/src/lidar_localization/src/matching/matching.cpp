@@ -5,12 +5,22 @@
  */
 #include "lidar_localization/matching/matching.hpp"
 
+#include <limits>
+#include <chrono>
+#include <algorithm>
+#include <sstream>
+
 #include <pcl/common/transforms.h>
 #include <pcl/io/pcd_io.h>
 #include "glog/logging.h"
 
 #include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/cloud_pool.hpp"
 #include "lidar_localization/models/registration/ndt_registration.hpp"
+#include "lidar_localization/models/registration/pyramid_registration.hpp"
+#include "lidar_localization/models/registration/distance_field_registration.hpp"
+#include "lidar_localization/models/registration/ndt_d2d_registration.hpp"
+#include "lidar_localization/models/registration/async_registration.hpp"
 #include "lidar_localization/models/cloud_filter/voxel_filter.hpp"
 #include "lidar_localization/models/cloud_filter/no_filter.hpp"
 
@@ -18,14 +28,46 @@ namespace lidar_localization {
 Matching::Matching()
     : global_map_ptr_(new CloudData::CLOUD()),
       local_map_ptr_(new CloudData::CLOUD()),
+      next_local_map_ptr_(new CloudData::CLOUD()),
       current_scan_ptr_(new CloudData::CLOUD()) 
 {
     
+    // the global map & the scan context index may still be loading when this returns:
     InitWithConfig();
 
-    InitGlobalMap();
+    // the local map for scan matching is built at the init pose, once the map is ready.
+
+    // later local maps are built in the background unless configured otherwise:
+    if (async_local_map_) {
+        local_map_thread_ = std::thread(&Matching::RunLocalMap, this);
+    }
+}
+
+Matching::~Matching() {
+    if (relocalizer_.joinable()) {
+        relocalizer_.join();
+    }
+    WaitUntilReady();
+
+    if (!local_map_thread_.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(local_map_mutex_);
+        stop_ = true;
+    }
+    has_local_map_task_.notify_one();
+
+    local_map_thread_.join();
+}
 
-    ResetLocalMap(0.0, 0.0, 0.0);
+void Matching::WaitUntilReady(void) {
+    if (map_loader_.joinable()) {
+        map_loader_.join();
+    }
+    if (index_loader_.joinable()) {
+        index_loader_.join();
+    }
 }
 
 bool Matching::InitWithConfig() {
@@ -36,29 +78,96 @@ bool Matching::InitWithConfig() {
               << "-----------------Init Localization-------------------" 
               << std::endl;
 
+    // the global map & the scan context index are loaded in the background, while the rest is set up:
+    const bool async_init = config_node["async_init"] ? config_node["async_init"].as<bool>() : false;
+    std::cout << "\tAsync Init: " << (async_init ? "true" : "false") << std::endl;
+
     InitDataPath(config_node);
 
-    InitScanContextManager(config_node);
+    InitScanContextManager(config_node, async_init);
     InitRegistration(registration_ptr_, config_node);
+    // the next target is built on a worker thread while scans are matched against the current one:
+    if (config_node["async_registration_target"].as<bool>()) {
+        std::shared_ptr<RegistrationInterface> next_registration_ptr;
+        InitRegistration(next_registration_ptr, config_node);
+        registration_ptr_ = std::make_shared<AsyncRegistration>(registration_ptr_, next_registration_ptr);
+    }
+    async_local_map_ = config_node["async_local_map"].as<bool>();
 
     // a. global map filter -- downsample point cloud map for visualization:
     InitFilter("global_map", global_map_filter_ptr_, config_node);
     // b. local map filter -- downsample & ROI filtering for scan-map matching:
     InitBoxFilter(config_node);
+    local_map_grid_size_ = config_node["local_map_grid_size"].as<float>();
     InitFilter("local_map", local_map_filter_ptr_, config_node);
     // c. scan filter -- 
     InitFilter("frame", frame_filter_ptr_, config_node);
+    // d. relocalization -- verify several init pose hypotheses:
+    InitRelocalization(config_node);
+    // e. load shedding -- coarser scan & fewer iterations when matching falls behind:
+    InitLoadShedding(config_node);
+    // f. motion prior -- initial guess of scan matching:
+    InitMotionPrior(config_node);
+
+    // g. global map -- the local map filter above is used by the map loader:
+    StartLoader(
+        "Global map", [this]() { InitGlobalMap(); }, async_init,
+        map_loader_, is_map_ready_
+    );
 
     return true;
 }
 
+void Matching::StartLoader(
+    const std::string& name, const std::function<void(void)>& load, bool async_init,
+    std::thread& loader, std::atomic<bool>& is_ready
+) {
+    auto run = [name, load, &is_ready]() {
+        const auto begin_time = std::chrono::steady_clock::now();
+        load();
+        // a failed load is ready too, the Set*Pose calls then fail as without async_init:
+        is_ready = true;
+
+        LOG(INFO) << name << " ready in " 
+                  << std::chrono::duration<double>(std::chrono::steady_clock::now() - begin_time).count() 
+                  << " s." << std::endl;
+    };
+
+    if (async_init) {
+        loader = std::thread(run);
+    } else {
+        run();
+    }
+}
+
 bool Matching::InitDataPath(const YAML::Node& config_node) {
+    map_format_ = config_node["map_format"].as<std::string>();
     map_path_ = config_node["map_path"].as<std::string>();
 
+    if (map_format_ == "tiled") {
+        const YAML::Node& tiled_map_node = config_node["tiled_map"];
+
+        tiles_path_ = tiled_map_node["tiles_path"].as<std::string>();
+        tiles_cache_size_ = static_cast<size_t>(std::max(tiled_map_node["cache_size"].as<int>(), 1));
+        prefetch_distance_ = tiled_map_node["prefetch_distance"].as<float>();
+        will_need_distance_ = tiled_map_node["will_need_distance"] ? tiled_map_node["will_need_distance"].as<float>() : 0.0f;
+
+        tiles_mapped_ = (
+            tiled_map_node["storage"] && tiled_map_node["storage"].as<std::string>() == "mapped"
+        );
+        if (
+            tiles_mapped_ && tiled_map_node["huge_pages"] && 
+            !MappedTileStore::GetHugePages(tiled_map_node["huge_pages"].as<std::string>(), tiles_huge_pages_)
+        ) {
+            LOG(ERROR) << "Huge pages " << tiled_map_node["huge_pages"].as<std::string>() << " NOT FOUND!";
+            return false;
+        }
+    }
+
     return true;
 }
 
-bool Matching::InitScanContextManager(const YAML::Node& config_node) {
+bool Matching::InitScanContextManager(const YAML::Node& config_node, bool async_init) {
     // get loop closure config:
     loop_closure_method_ = config_node["loop_closure_method"].as<std::string>();
 
@@ -67,7 +176,10 @@ bool Matching::InitScanContextManager(const YAML::Node& config_node) {
 
     // load pre-built index:
     scan_context_path_ = config_node["scan_context_path"].as<std::string>();
-    scan_context_manager_ptr_->Load(scan_context_path_);
+    StartLoader(
+        "Scan context index", [this]() { scan_context_manager_ptr_->Load(scan_context_path_); }, async_init,
+        index_loader_, is_index_ready_
+    );
 
     return true;
 }
@@ -78,6 +190,12 @@ bool Matching::InitRegistration(std::shared_ptr<RegistrationInterface>& registra
 
     if (registration_method == "NDT") {
         registration_ptr = std::make_shared<NDTRegistration>(config_node[registration_method]);
+    } else if (registration_method == "PYRAMID") {
+        registration_ptr = std::make_shared<PyramidRegistration>(config_node[registration_method]);
+    } else if (registration_method == "DISTANCE_FIELD") {
+        registration_ptr = std::make_shared<DistanceFieldRegistration>(config_node[registration_method]);
+    } else if (registration_method == "NDT_D2D") {
+        registration_ptr = std::make_shared<NDTD2DRegistration>(config_node[registration_method]);
     } else {
         LOG(ERROR) << "Registration method " << registration_method << " NOT FOUND!";
         return false;
@@ -104,10 +222,134 @@ bool Matching::InitFilter(std::string filter_user, std::shared_ptr<CloudFilterIn
 
 bool Matching::InitBoxFilter(const YAML::Node& config_node) {
     box_filter_ptr_ = std::make_shared<BoxFilter>(config_node);
+    local_map_box_ = config_node["box_filter_size"].as<std::vector<float>>();
+    return true;
+}
+
+bool Matching::InitRelocalization(const YAML::Node& config_node) {
+    const YAML::Node& relocalization_node = config_node["relocalization"];
+
+    num_relocalization_candidates_ = std::max(relocalization_node["num_candidates"].as<int>(), 1);
+    use_gnss_for_relocalization_ = relocalization_node["use_gnss"].as<bool>();
+    relocalization_fitness_score_limit_ = relocalization_node["fitness_score_limit"].as<float>();
+
+    std::cout << "\tNum. Relocalization Candidates: " << num_relocalization_candidates_ 
+              << (use_gnss_for_relocalization_ ? " + GNSS" : "") << std::endl;
+
+    relocalization_registration_ptrs_.resize(
+        num_relocalization_candidates_ + (use_gnss_for_relocalization_ ? 1 : 0)
+    );
+    for (auto &registration_ptr: relocalization_registration_ptrs_) {
+        if (!InitRegistration(registration_ptr, relocalization_node)) {
+            return false;
+        }
+    }
+
+    // tracking recovery, once tracking:
+    const YAML::Node& tracking_monitor_node = relocalization_node["tracking_monitor"];
+    if (tracking_monitor_node && tracking_monitor_node["enabled"].as<bool>()) {
+        tracking_monitor_ptr_ = std::make_shared<TrackingMonitor>(tracking_monitor_node);
+        relocalization_gate_radius_ = tracking_monitor_node["gate_radius"].as<float>();
+
+        std::cout << "\tRelocalization Gate Radius: " << relocalization_gate_radius_ << std::endl;
+    }
+
+    return true;
+}
+
+bool Matching::InitLoadShedding(const YAML::Node& config_node) {
+    const YAML::Node& load_shedding_node = config_node["load_shedding"];
+
+    load_frame_filter_ptrs_.clear();
+    load_max_iters_.clear();
+    if (!load_shedding_node || !load_shedding_node["enabled"].as<bool>())
+        return true;
+
+    const std::vector<float> leaf_sizes = load_shedding_node["leaf_sizes"].as<std::vector<float>>();
+    const std::vector<int> max_iters = load_shedding_node["max_iters"].as<std::vector<int>>();
+    if (leaf_sizes.size() != max_iters.size()) {
+        LOG(ERROR) << "Load shedding has " << leaf_sizes.size() << " leaf sizes but "
+                   << max_iters.size() << " max. iterations!";
+        return false;
+    }
+
+    for (size_t i = 0; i < leaf_sizes.size(); ++i) {
+        load_frame_filter_ptrs_.push_back(
+            std::make_shared<VoxelFilter>(leaf_sizes.at(i), leaf_sizes.at(i), leaf_sizes.at(i))
+        );
+        load_max_iters_.push_back(max_iters.at(i));
+
+        std::cout << "\tLoad Level " << i + 1 << ": frame leaf size " << leaf_sizes.at(i)
+                  << ", max. iterations " << max_iters.at(i) << std::endl;
+    }
+
+    return true;
+}
+
+bool Matching::InitMotionPrior(const YAML::Node& config_node) {
+    std::string motion_prior = config_node["motion_prior"].as<std::string>();
+    std::cout << "\tMotion Prior: " << motion_prior << std::endl;
+
+    if (motion_prior == "imu") {
+        imu_motion_prior_ptr_ = std::make_shared<IMUMotionPrior>(config_node[motion_prior]);
+    } else if (motion_prior != "constant_velocity") {
+        LOG(ERROR) << "Motion prior " << motion_prior << " NOT FOUND!";
+        return false;
+    }
+
+    return true;
+}
+
+bool Matching::SetLidarToIMU(const Eigen::Matrix4f& lidar_to_imu) {
+    if (!imu_motion_prior_ptr_)
+        return false;
+
+    imu_motion_prior_ptr_->SetLidarToIMU(lidar_to_imu);
+    return true;
+}
+
+bool Matching::AddIMUData(const IMUData& imu_data) {
+    if (!imu_motion_prior_ptr_)
+        return false;
+
+    imu_motion_prior_ptr_->AddIMUData(imu_data);
+    return true;
+}
+
+bool Matching::SetLoadLevel(int load_level) {
+    if (load_level < 0 || load_level > GetNumLoadLevels()) {
+        LOG(WARNING) << "Load level " << load_level << " out of range [0, " << GetNumLoadLevels() << "].";
+        return false;
+    }
+
+    load_level_ = load_level;
+    // with async registration, the instance building the next target gets the cap once it is swapped in:
+    registration_ptr_->SetMaxIterationLimit(load_level_ > 0 ? load_max_iters_.at(load_level_ - 1) : -1);
+
     return true;
 }
 
 bool Matching::InitGlobalMap() {
+    std::cout << "\tGlobal Map Format: " << map_format_ << std::endl;
+
+    if (map_format_ == "tiled") {
+        // tiles are filtered when the tiled map is built:
+        tiled_map_ptr_ = std::make_shared<TiledMap>(
+            tiles_path_, tiles_cache_size_, 
+            tiles_mapped_, tiles_huge_pages_
+        );
+
+        if (!tiled_map_ptr_->IsValid()) {
+            LOG(ERROR) << "Tiled map is not available, run build_tiled_map_node first.";
+            return false;
+        }
+
+        return true;
+    } else if (map_format_ != "pcd") {
+        LOG(ERROR) << "Global map format " << map_format_ << " NOT FOUND!";
+        return false;
+    }
+
     pcl::io::loadPCDFile(map_path_, *global_map_ptr_);
     LOG(INFO) << "Load global map, size:" << global_map_ptr_->points.size();
 
@@ -115,88 +357,376 @@ bool Matching::InitGlobalMap() {
     local_map_filter_ptr_->Filter(global_map_ptr_, global_map_ptr_);
     LOG(INFO) << "Filtered global map, size:" << global_map_ptr_->points.size();
 
+    // bucket once, so each local map only visits the cells around it:
+    grid_map_ptr_ = std::make_shared<GridMap>(global_map_ptr_, local_map_grid_size_);
+
     has_new_global_map_ = true;
 
     return true;
 }
 
 bool Matching::ResetLocalMap(float x, float y, float z) {
-    std::vector<float> origin = {x, y, z};
+    // a pending rebuild would be swapped in over this one:
+    {
+        std::unique_lock<std::mutex> lock(local_map_mutex_);
+        has_local_map_done_.wait(lock, [this]{ return !is_local_map_requested_; });
+        is_next_local_map_ready_ = false;
+    }
 
     // use ROI filtering for local map segmentation:
+    std::vector<float> origin = {x, y, z};
     box_filter_ptr_->SetOrigin(origin);
-    box_filter_ptr_->Filter(global_map_ptr_, local_map_ptr_);
+    local_map_origin_ = Eigen::Vector3f(x, y, z);
 
+    BuildLocalMap(box_filter_ptr_->GetEdge(), local_map_ptr_);
+    // set in place before the first match, built in the background after with async registration:
     registration_ptr_->SetInputTarget(local_map_ptr_);
 
+    // new tiles may have been loaded:
+    if (tiled_map_ptr_) {
+        has_new_global_map_ = true;
+    }
     has_new_local_map_ = true;
 
-    std::vector<float> edge = box_filter_ptr_->GetEdge();
+    return true;
+}
+
+bool Matching::RequestLocalMap(float x, float y, float z) {
+    {
+        std::lock_guard<std::mutex> lock(local_map_mutex_);
+        if (is_local_map_requested_ || is_next_local_map_ready_)
+            return false;
+
+        // the edge moves right away, so the same rebuild is not requested again:
+        std::vector<float> origin = {x, y, z};
+        box_filter_ptr_->SetOrigin(origin);
+        local_map_origin_ = Eigen::Vector3f(x, y, z);
+
+        next_local_map_edge_ = box_filter_ptr_->GetEdge();
+        is_local_map_requested_ = true;
+    }
+    has_local_map_task_.notify_one();
+
+    return true;
+}
+
+bool Matching::SwapLocalMap(void) {
+    {
+        std::lock_guard<std::mutex> lock(local_map_mutex_);
+        if (!is_next_local_map_ready_)
+            return false;
+        is_next_local_map_ready_ = false;
+    }
+
+    // the worker only touches the next_* members again after the next request:
+    std::swap(local_map_ptr_, next_local_map_ptr_);
+    // with async registration, matching goes on against the old target until the new one is built:
+    registration_ptr_->SetInputTarget(local_map_ptr_);
+
+    if (tiled_map_ptr_) {
+        has_new_global_map_ = true;
+    }
+    has_new_local_map_ = true;
+
+    return true;
+}
+
+bool Matching::BuildLocalMap(const std::vector<float>& edge, CloudData::CLOUD_PTR& local_map_ptr) {
+    if (tiled_map_ptr_) {
+        // only the tiles around the new origin are loaded:
+        CloudData::CLOUD_PTR tiles_ptr;
+        tiled_map_ptr_->GetMap(edge, tiles_ptr);
+        local_map_ptr = CloudPool::GetInstance().Get();
+        GridMap::Crop(*tiles_ptr, edge, *local_map_ptr);
+
+        TiledMap::Stats stats = tiled_map_ptr_->GetStats();
+        LOG(INFO) << "Tiled map: " 
+                  << stats.num_hits << " hits, " 
+                  << stats.num_misses << " misses, "
+                  << stats.num_prefetched << " prefetched, "
+                  << stats.num_tiles << " tiles in cache" << std::endl;
+    } else if (grid_map_ptr_) {
+        grid_map_ptr_->GetMap(edge, local_map_ptr);
+    } else {
+        local_map_ptr.reset(new CloudData::CLOUD());
+    }
+
     LOG(INFO) << "New local map:" << edge.at(0) << ","
                                   << edge.at(1) << ","
                                   << edge.at(2) << ","
                                   << edge.at(3) << ","
                                   << edge.at(4) << ","
-                                  << edge.at(5) << std::endl << std::endl;
+                                  << edge.at(5) << ", "
+                                  << "size: " << local_map_ptr->points.size() << std::endl << std::endl;
 
     return true;
 }
 
+void Matching::RunLocalMap(void) {
+    std::unique_lock<std::mutex> lock(local_map_mutex_);
+
+    while (true) {
+        has_local_map_task_.wait(lock, [this]{ return stop_ || is_local_map_requested_; });
+        if (stop_)
+            break;
+
+        std::vector<float> edge = next_local_map_edge_;
+        lock.unlock();
+
+        // a fresh cloud, the previous one may still be referenced by a published message:
+        BuildLocalMap(edge, next_local_map_ptr_);
+
+        lock.lock();
+        is_local_map_requested_ = false;
+        is_next_local_map_ready_ = true;
+        has_local_map_done_.notify_all();
+    }
+}
+
 bool Matching::Update(const CloudData& cloud_data, Eigen::Matrix4f& cloud_pose) {
-    static Eigen::Matrix4f step_pose = Eigen::Matrix4f::Identity();
-    static Eigen::Matrix4f last_pose = init_pose_;
-    static Eigen::Matrix4f predict_pose = init_pose_;
+    // match against the new local map as soon as the worker has built it:
+    SwapLocalMap();
 
     // remove invalid measurements:
     std::vector<int> indices;
     pcl::removeNaNFromPointCloud(*cloud_data.cloud_ptr, *cloud_data.cloud_ptr, indices);
 
     // downsample:
-    CloudData::CLOUD_PTR filtered_cloud_ptr(new CloudData::CLOUD());
+    CloudData::CLOUD_PTR filtered_cloud_ptr = CloudPool::GetInstance().Get();
     frame_filter_ptr_->Filter(cloud_data.cloud_ptr, filtered_cloud_ptr);
+    if (load_level_ > 0) {
+        CloudData::CLOUD_PTR degraded_cloud_ptr = CloudPool::GetInstance().Get();
+        load_frame_filter_ptrs_.at(load_level_ - 1)->Filter(filtered_cloud_ptr, degraded_cloud_ptr);
+        filtered_cloud_ptr = degraded_cloud_ptr;
+    }
 
     if (!has_inited_) {
-        predict_pose = current_gnss_pose_;
+        predict_pose_ = current_gnss_pose_;
+    }
+
+    // a relocalization done in the background moves the prediction onto the verified pose:
+    if (tracking_monitor_ptr_) {
+        ApplyRelocalization();
+    }
+
+    // IMU mechanization since the last scan, constant velocity if the measurements are not available:
+    if (has_inited_ && imu_motion_prior_ptr_ && last_time_ >= 0.0) {
+        imu_motion_prior_ptr_->Predict(last_time_, last_pose_, last_vel_, cloud_data.time, predict_pose_);
     }
 
     // matching:
-    CloudData::CLOUD_PTR result_cloud_ptr(new CloudData::CLOUD());
-    registration_ptr_->ScanMatch(filtered_cloud_ptr, predict_pose, result_cloud_ptr, cloud_pose);
+    CloudData::CLOUD_PTR result_cloud_ptr = CloudPool::GetInstance().Get();
+    registration_ptr_->ScanMatch(filtered_cloud_ptr, predict_pose_, result_cloud_ptr, cloud_pose);
+    // current_scan_ptr_ is assigned in place, so it keeps its capacity:
     pcl::transformPointCloud(*cloud_data.cloud_ptr, *current_scan_ptr_, cloud_pose);
 
+    // a degraded match is not published, scan matching goes on at the last motion:
+    if (tracking_monitor_ptr_ && has_inited_ && !CheckTracking(cloud_data, filtered_cloud_ptr, cloud_pose)) {
+        last_pose_ = predict_pose_;
+        predict_pose_ = last_pose_ * step_pose_;
+        last_time_ = cloud_data.time;
+
+        UpdateLocalMap(last_pose_);
+
+        return false;
+    }
+
+    PrefetchLocalMap(cloud_pose, cloud_pose.block<3, 1>(0, 3) - last_pose_.block<3, 1>(0, 3));
+
     // update predicted pose:
-    step_pose = last_pose.inverse() * cloud_pose;
-    predict_pose = cloud_pose * step_pose;
-    last_pose = cloud_pose;
+    step_pose_ = last_pose_.inverse() * cloud_pose;
+    predict_pose_ = cloud_pose * step_pose_;
+    if (last_time_ >= 0.0 && cloud_data.time > last_time_) {
+        last_vel_ = (cloud_pose.block<3, 1>(0, 3) - last_pose_.block<3, 1>(0, 3)) / (cloud_data.time - last_time_);
+    }
+    last_pose_ = cloud_pose;
+    last_time_ = cloud_data.time;
 
+    UpdateLocalMap(cloud_pose);
+
+    return true;
+}
+
+bool Matching::UpdateLocalMap(const Eigen::Matrix4f& pose) {
     // 匹配之后判断是否需要更新局部地图
     std::vector<float> edge = box_filter_ptr_->GetEdge();
     for (int i = 0; i < 3; i++) {
         if (
-            fabs(cloud_pose(i, 3) - edge.at(2 * i)) > 50.0 &&
-            fabs(cloud_pose(i, 3) - edge.at(2 * i + 1)) > 50.0
+            fabs(pose(i, 3) - edge.at(2 * i)) > 50.0 &&
+            fabs(pose(i, 3) - edge.at(2 * i + 1)) > 50.0
         ) {
             continue;
         }
             
-        ResetLocalMap(cloud_pose(0,3), cloud_pose(1,3), cloud_pose(2,3));
-        break;
+        if (async_local_map_) {
+            RequestLocalMap(pose(0,3), pose(1,3), pose(2,3));
+        } else {
+            ResetLocalMap(pose(0,3), pose(1,3), pose(2,3));
+        }
+        return true;
+    }
+
+    return false;
+}
+
+std::vector<float> Matching::GetLocalMapEdge(const Eigen::Matrix4f& pose) const {
+    std::vector<float> edge = local_map_box_;
+    for (int i = 0; i < 3; ++i) {
+        edge.at(2 * i) += pose(i, 3);
+        edge.at(2 * i + 1) += pose(i, 3);
+    }
+
+    return edge;
+}
+
+void Matching::SetGNSSPrior(const Eigen::Matrix4f& gnss_pose) {
+    current_gnss_pose_ = gnss_pose;
+    has_gnss_prior_ = true;
+}
+
+bool Matching::CheckTracking(
+    const CloudData& cloud_data, 
+    const CloudData::CLOUD_PTR& filtered_cloud_ptr,
+    const Eigen::Matrix4f& cloud_pose
+) {
+    const TrackingMonitor::State state = tracking_monitor_ptr_->Update(registration_ptr_->GetResult());
+
+    if (TrackingMonitor::State::HEALTHY == state) {
+        last_healthy_pose_ = cloud_pose;
+    } else if (TrackingMonitor::State::LOST == state) {
+        StartRelocalization(cloud_data, filtered_cloud_ptr);
+    }
+
+    // the GNSS pose is of this scan only:
+    has_gnss_prior_ = false;
+
+    return TrackingMonitor::State::HEALTHY == state;
+}
+
+bool Matching::StartRelocalization(const CloudData& cloud_data, const CloudData::CLOUD_PTR& filtered_cloud_ptr) {
+    if (relocalizer_.joinable()) {
+        return false;
+    }
+
+    // the same hypotheses as SetScanContextPose, with the scan context proposals gated to the region
+    // around the GNSS pose if there is one, or around the last healthy pose:
+    const bool use_gnss = use_gnss_for_relocalization_ && has_gnss_prior_;
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> prior_poses;
+    if (use_gnss) {
+        prior_poses.push_back(current_gnss_pose_);
+    }
+    const Eigen::Vector2f center = (has_gnss_prior_ ? current_gnss_pose_ : last_healthy_pose_).block<2, 1>(0, 3);
+
+    LOG(WARNING) << "Tracking lost after " << tracking_monitor_ptr_->GetNumDegradedFrames() << " degraded matches, "
+                 << "relocalize within " << relocalization_gate_radius_ << " m of the "
+                 << (has_gnss_prior_ ? "GNSS" : "last healthy") << " pose." << std::endl;
+
+    // copies, the scans of the flow are reused:
+    CloudData scan;
+    scan.time = cloud_data.time;
+    *scan.cloud_ptr = *cloud_data.cloud_ptr;
+    CloudData::CLOUD_PTR scan_ptr(new CloudData::CLOUD(*filtered_cloud_ptr));
+
+    relocalization_scan_pose_ = predict_pose_;
+    is_relocalization_done_ = false;
+    relocalizer_ = std::thread(
+        [this, scan, scan_ptr, prior_poses, center]() {
+            std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> hypotheses;
+            GetInitHypotheses(
+                scan, prior_poses,
+                [this, &center](int key_frame_id) {
+                    const Eigen::Matrix4f& pose = scan_context_manager_ptr_->GetKeyFrame(key_frame_id).pose;
+                    return (pose.block<2, 1>(0, 3) - center).norm() <= relocalization_gate_radius_;
+                },
+                hypotheses
+            );
+
+            is_relocalized_ = Relocalize(scan_ptr, hypotheses, relocalized_pose_);
+            is_relocalization_done_ = true;
+        }
+    );
+
+    return true;
+}
+
+bool Matching::ApplyRelocalization(void) {
+    if (!relocalizer_.joinable() || !is_relocalization_done_.load()) {
+        return false;
+    }
+    relocalizer_.join();
+
+    if (TrackingMonitor::State::HEALTHY == tracking_monitor_ptr_->GetState()) {
+        LOG(INFO) << "Tracking recovered during relocalization, the relocalized pose is dropped." << std::endl;
+        return false;
+    }
+    // still lost, the next degraded match starts another one:
+    if (!is_relocalized_) {
+        return false;
+    }
+
+    // scan matching moved on since the relocalized scan, the motion is carried over:
+    const Eigen::Matrix4f correction = relocalized_pose_ * relocalization_scan_pose_.inverse();
+    last_pose_ = correction * last_pose_;
+    predict_pose_ = last_pose_ * step_pose_;
+
+    ResetLocalMap(predict_pose_(0,3), predict_pose_(1,3), predict_pose_(2,3));
+
+    LOG(INFO) << std::endl
+              << "[Tracking] Relocalized" << std::endl
+              << "\tCorrection " << correction.block<3, 1>(0, 3).norm() << " m" << std::endl
+              << std::endl;
+
+    tracking_monitor_ptr_->Reset();
+
+    return true;
+}
+
+bool Matching::PrefetchLocalMap(const Eigen::Matrix4f& pose, const Eigen::Vector3f& motion) {
+    if (!tiled_map_ptr_)
+        return false;
+
+    const float distance = motion.head<2>().norm();
+    if (distance < 1.0e-3f)
+        return false;
+
+    // the local map box, moved prefetch_distance ahead along the direction of travel:
+    Eigen::Vector3f ahead = pose.block<3, 1>(0, 3);
+    ahead.head<2>() += prefetch_distance_ / distance * motion.head<2>();
+
+    std::vector<float> edge = box_filter_ptr_->GetEdge();
+    for (int i = 0; i < 3; ++i) {
+        edge.at(2 * i) += ahead(i) - local_map_origin_(i);
+        edge.at(2 * i + 1) += ahead(i) - local_map_origin_(i);
+    }
+    tiled_map_ptr_->Prefetch(edge);
+
+    // further along the direction of travel, only hinted, so a change of course costs nothing:
+    if (will_need_distance_ > 0.0f) {
+        const float step = will_need_distance_ / distance;
+        for (int i = 0; i < 2; ++i) {
+            edge.at(2 * i) += step * motion(i);
+            edge.at(2 * i + 1) += step * motion(i);
+        }
+        tiled_map_ptr_->WillNeed(edge);
     }
 
     return true;
 }
 
 bool Matching::SetGNSSPose(const Eigen::Matrix4f& gnss_pose) {
-    static int gnss_cnt = 0;
+    // the local map is built at the init pose:
+    if (!IsMapReady()) {
+        return false;
+    }
 
     current_gnss_pose_ = gnss_pose;
 
-    if (gnss_cnt == 0) {
+    if (gnss_cnt_ == 0) {
         SetInitPose(gnss_pose);
-    } else if (gnss_cnt > 3) {
+    } else if (gnss_cnt_ > 3) {
         has_inited_ = true;
     }
-    gnss_cnt++;
+    gnss_cnt_++;
 
     return true;
 }
@@ -207,10 +737,53 @@ bool Matching::SetGNSSPose(const Eigen::Matrix4f& gnss_pose) {
  * @return true if success otherwise false
  */
 bool Matching::SetScanContextPose(const CloudData& init_scan) {
-    // get init pose proposal using scan context match:
+    // the scan context proposals are the only hypotheses:
+    if (!IsMapReady() || !IsIndexReady()) {
+        return false;
+    }
+
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> prior_poses;
+
+    return SetInitScan(init_scan, prior_poses);
+}
+
+/**
+ * @brief  get init pose using scan context matching, with GNSS pose as another hypothesis
+ * @param  init_scan, init key scan
+ * @param  init_gnss_pose, GNSS pose at the scan time
+ * @return true if success otherwise false
+ */
+bool Matching::SetScanContextPose(const CloudData& init_scan, const Eigen::Matrix4f& init_gnss_pose) {
+    // without the index, the GNSS pose is the only hypothesis:
+    if (!IsMapReady() || (!IsIndexReady() && !use_gnss_for_relocalization_)) {
+        return false;
+    }
+
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> prior_poses;
+    if (use_gnss_for_relocalization_) {
+        prior_poses.push_back(init_gnss_pose);
+    }
+
+    return SetInitScan(init_scan, prior_poses);
+}
+
+/**
+ * @brief  get init pose using scan context matching
+ * @param  init_scan, init key scan
+ * @param  prior_poses, init pose hypotheses besides scan context proposals, e.g. GNSS
+ * @return true if success otherwise false
+ */
+bool Matching::SetInitScan(
+    const CloudData& init_scan, 
+    const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& prior_poses
+) {
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> hypotheses;
+    GetInitHypotheses(init_scan, prior_poses, ScanContextManager::CandidateFilter(), hypotheses);
+
+    // verify them all within this scan:
     Eigen::Matrix4f init_pose =  Eigen::Matrix4f::Identity();
     if (
-        !scan_context_manager_ptr_->DetectLoopClosure(init_scan, init_pose)
+        !Relocalize(init_scan, hypotheses, init_pose)
     ) {
         return false;
     }
@@ -222,8 +795,150 @@ bool Matching::SetScanContextPose(const CloudData& init_scan) {
     return true;
 }
 
+/**
+ * @brief  get init pose hypotheses, scan context proposals best first, then the priors
+ * @param  init_scan, init key scan
+ * @param  prior_poses, init pose hypotheses besides scan context proposals, e.g. GNSS
+ * @param  is_candidate, key frames failing it are not proposed, none are dropped if empty
+ * @param  hypotheses, init pose hypotheses
+ * @return true if there is any hypothesis
+ */
+bool Matching::GetInitHypotheses(
+    const CloudData& init_scan, 
+    const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& prior_poses,
+    const ScanContextManager::CandidateFilter& is_candidate,
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& hypotheses
+) {
+    hypotheses.clear();
+    if (IsIndexReady()) {
+        scan_context_manager_ptr_->DetectLoopClosure(init_scan, num_relocalization_candidates_, is_candidate, hypotheses);
+    } else {
+        LOG(INFO) << "Scan context index not ready, verify the prior poses only." << std::endl;
+    }
+    hypotheses.insert(hypotheses.end(), prior_poses.begin(), prior_poses.end());
+
+    return !hypotheses.empty();
+}
+
+/**
+ * @brief  verify init pose hypotheses using coarse scan-map matching
+ * @param  init_scan, init key scan
+ * @param  hypotheses, init pose hypotheses
+ * @param  init_pose, refined pose of the best hypothesis
+ * @return true if the best hypothesis is within fitness limit otherwise false
+ */
+bool Matching::Relocalize(
+    const CloudData& init_scan, 
+    const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& hypotheses,
+    Eigen::Matrix4f& init_pose
+) {
+    if (hypotheses.empty()) {
+        return false;
+    }
+
+    // downsampled scan, shared by all hypotheses:
+    CloudData::CLOUD_PTR scan_ptr = CloudPool::GetInstance().Get();
+    std::vector<int> indices;
+    pcl::removeNaNFromPointCloud(*init_scan.cloud_ptr, *scan_ptr, indices);
+    frame_filter_ptr_->Filter(scan_ptr, scan_ptr);
+
+    return Relocalize(scan_ptr, hypotheses, init_pose);
+}
+
+/**
+ * @brief  verify pose hypotheses using coarse scan-map matching, e.g. on the relocalizer thread
+ * @param  scan_ptr, filtered scan
+ * @param  hypotheses, pose hypotheses
+ * @param  init_pose, refined pose of the best hypothesis
+ * @return true if the best hypothesis is within fitness limit otherwise false
+ */
+bool Matching::Relocalize(
+    const CloudData::CLOUD_PTR& scan_ptr, 
+    const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& hypotheses,
+    Eigen::Matrix4f& init_pose
+) {
+    const int N = std::min(
+        static_cast<int>(hypotheses.size()), 
+        static_cast<int>(relocalization_registration_ptrs_.size())
+    );
+    if (0 == N) {
+        return false;
+    }
+
+    // local maps, built in order. the box of the current local map is left as is:
+    std::vector<CloudData::CLOUD_PTR> map_ptrs(N);
+    for (int i = 0; i < N; ++i) {
+        BuildLocalMap(GetLocalMapEdge(hypotheses.at(i)), map_ptrs.at(i));
+    }
+
+    // coarse matching, each hypothesis with its own registration instance:
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> result_poses(
+        N, Eigen::Matrix4f::Identity()
+    );
+    std::vector<float> fitness_scores(N, std::numeric_limits<float>::max());
+#pragma omp parallel for schedule(dynamic) if(N > 1)
+    for (int i = 0; i < N; ++i) {
+        if (map_ptrs.at(i)->points.empty())
+            continue;
+
+        const std::shared_ptr<RegistrationInterface>& registration_ptr = relocalization_registration_ptrs_.at(i);
+        CloudData::CLOUD_PTR result_cloud_ptr = CloudPool::GetInstance().Get();
+        registration_ptr->SetInputTarget(map_ptrs.at(i));
+        if (registration_ptr->ScanMatch(scan_ptr, hypotheses.at(i), result_cloud_ptr, result_poses.at(i))) {
+            fitness_scores.at(i) = registration_ptr->GetFitnessScore();
+        }
+    }
+
+    int best_index = 0;
+    for (int i = 1; i < N; ++i) {
+        if (fitness_scores.at(i) < fitness_scores.at(best_index))
+            best_index = i;
+    }
+
+    if (fitness_scores.at(best_index) > relocalization_fitness_score_limit_) {
+        LOG(WARNING) << "Relocalization failed, best fitness score " << fitness_scores.at(best_index) 
+                     << " of " << N << " hypotheses, retry with next scan." << std::endl;
+        return false;
+    }
+
+    init_pose = result_poses.at(best_index);
+
+    LOG(INFO) << std::endl
+              << "[Relocalization] Hypothesis " << best_index + 1 << " of " << N << std::endl
+              << "\tFitness Score " << fitness_scores.at(best_index) << std::endl
+              << "\tRegistration Iterations " << relocalization_registration_ptrs_.at(best_index)->GetNumIterations()
+              << GetLevelReport(relocalization_registration_ptrs_.at(best_index)) << std::endl
+              << std::endl;
+
+    return true;
+}
+
+std::string Matching::GetLevelReport(const std::shared_ptr<RegistrationInterface>& registration_ptr) {
+    auto pyramid_registration_ptr = std::dynamic_pointer_cast<PyramidRegistration>(registration_ptr);
+    if (!pyramid_registration_ptr)
+        return "";
+
+    // iterations & fitness of each level run, coarse to fine:
+    std::ostringstream report;
+    for (const PyramidRegistration::LevelStats& level_stats: pyramid_registration_ptr->GetLevelStats()) {
+        if (level_stats.last_num_iterations < 0)
+            break;
+
+        report << ", res " << level_stats.res << ": " 
+               << level_stats.last_num_iterations << " (" << level_stats.last_fitness_score << ")";
+    }
+
+    return report.str();
+}
+
 bool Matching::SetInitPose(const Eigen::Matrix4f& init_pose) {
     init_pose_ = init_pose;
+    // scan matching starts from the init pose:
+    step_pose_ = Eigen::Matrix4f::Identity();
+    last_pose_ = predict_pose_ = init_pose;
+    // the init pose has no time, the first scan after it is matched at constant velocity:
+    last_time_ = -1.0;
+    last_vel_ = Eigen::Vector3f::Zero();
     ResetLocalMap(init_pose(0,3), init_pose(1,3), init_pose(2,3));
 
     return true;
@@ -235,7 +950,14 @@ Eigen::Matrix4f Matching::GetInitPose(void) {
 
 void Matching::GetGlobalMap(CloudData::CLOUD_PTR& global_map) {
     // downsample global map for visualization:
-    global_map_filter_ptr_->Filter(global_map_ptr_, global_map);
+    if (tiled_map_ptr_) {
+        // only the tiles loaded so far:
+        CloudData::CLOUD_PTR cached_map_ptr;
+        tiled_map_ptr_->GetCachedMap(cached_map_ptr);
+        global_map_filter_ptr_->Filter(cached_map_ptr, global_map);
+    } else {
+        global_map_filter_ptr_->Filter(global_map_ptr_, global_map);
+    }
 
     has_new_global_map_ = false;
 }
@@ -253,7 +975,7 @@ bool Matching::HasInited() {
 }
 
 bool Matching::HasNewGlobalMap() {
-    return has_new_global_map_;
+    return IsMapReady() && has_new_global_map_;
 }
 
 bool Matching::HasNewLocalMap() {
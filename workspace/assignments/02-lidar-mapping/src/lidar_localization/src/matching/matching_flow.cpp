@@ -4,6 +4,7 @@
  * @Date: 2020-02-10 08:38:42
  */
 #include "lidar_localization/matching/matching_flow.hpp"
+#include <chrono>
 #include "glog/logging.h"
 #include "lidar_localization/global_defination/global_defination.h"
 
@@ -26,7 +27,18 @@ MatchingFlow::MatchingFlow(ros::NodeHandle& nh) {
     laser_odom_pub_ptr_ = std::make_shared<OdometryPublisher>(nh, "/laser_localization", "/map", "/lidar", 100);
     laser_tf_pub_ptr_ = std::make_shared<TFBroadCaster>("/map", "/vehicle_link");
 
+    // the map & the scan context index may still be loading, scans are taken meanwhile:
     matching_ptr_ = std::make_shared<Matching>();
+    if (matching_ptr_->HasIMUMotionPrior()) {
+        std::string imu_topic;
+        nh.param<std::string>("imu_topic", imu_topic, "/kitti/oxts/imu");
+        imu_sub_ptr_ = std::make_shared<IMUSubscriber>(nh, imu_topic, 1000000);
+        lidar_to_imu_ptr_ = std::make_shared<TFListener>(nh, "/imu_link", "/velo_link");
+    }
+    deadline_policy_ptr_ = std::make_shared<DeadlinePolicy>(
+        YAML::LoadFile(WORK_SPACE_PATH + "/config/matching/matching.yaml")["load_shedding"],
+        matching_ptr_->GetNumLoadLevels()
+    );
 }
 
 bool MatchingFlow::Run() {
@@ -41,12 +53,26 @@ bool MatchingFlow::Run() {
 
     ReadData();
 
+    if (!InitCalibration())
+        return false;
+
     while(HasData()) {
         if (!ValidData()) {
             LOG(INFO) << "Invalid data. Skip matching" << std::endl;
             continue;
         }
 
+        // behind the latest scan by more than max_delay, the scan is dropped. never before init:
+        if (
+            matching_ptr_->HasInited() && 
+            deadline_policy_ptr_->IsStale(
+                current_cloud_data_.time, 
+                cloud_data_buff_.empty() ? current_cloud_data_.time : cloud_data_buff_.back().time
+            )
+        ) {
+            continue;
+        }
+
         if (UpdateMatching()) {
             PublishData();
         }
@@ -59,15 +85,45 @@ bool MatchingFlow::ReadData() {
     // pipe lidar measurements and pose into buffer:
     cloud_sub_ptr_->ParseData(cloud_data_buff_);
     gnss_sub_ptr_->ParseData(gnss_data_buff_);
+
+    if (imu_sub_ptr_) {
+        imu_sub_ptr_->ParseData(imu_data_buff_);
+        while (imu_data_buff_.size() > 0) {
+            matching_ptr_->AddIMUData(imu_data_buff_.front());
+            imu_data_buff_.pop_front();
+        }
+    }
+
     return true;
 }
 
+bool MatchingFlow::InitCalibration() {
+    if (!lidar_to_imu_ptr_ || matching_ptr_->HasLidarToIMU())
+        return true;
+
+    Eigen::Matrix4f lidar_to_imu = Eigen::Matrix4f::Identity();
+    if (lidar_to_imu_ptr_->LookupData(lidar_to_imu)) {
+        matching_ptr_->SetLidarToIMU(lidar_to_imu);
+        return true;
+    }
+
+    return false;
+}
+
 bool MatchingFlow::HasData() {
     if (cloud_data_buff_.size() == 0)
         return false;
     
-    if (matching_ptr_->HasInited())
-        return true;
+    if (matching_ptr_->HasInited()) {
+        // wait for the IMU measurements after the scan, only briefly, so that a lost IMU
+        // doesn't stall localization, matching falls back to constant velocity then:
+        const size_t MAX_WAITING_CLOUDS = 5;
+        return !(
+            imu_sub_ptr_ && 
+            !matching_ptr_->HasIMUData(cloud_data_buff_.front().time) &&
+            cloud_data_buff_.size() < MAX_WAITING_CLOUDS
+        );
+    }
     
     if (gnss_data_buff_.size() == 0)
         return false;
@@ -80,7 +136,16 @@ bool MatchingFlow::ValidData() {
 
     if (matching_ptr_->HasInited()) {
         cloud_data_buff_.pop_front();
-        gnss_data_buff_.clear();
+
+        // a relocalization on tracking loss is gated to the region around the GNSS pose, if there is one:
+        while (!gnss_data_buff_.empty() && gnss_data_buff_.front().time < current_cloud_data_.time - 0.05) {
+            gnss_data_buff_.pop_front();
+        }
+        if (!gnss_data_buff_.empty() && gnss_data_buff_.front().time < current_cloud_data_.time + 0.05) {
+            matching_ptr_->SetGNSSPrior(gnss_data_buff_.front().pose);
+            gnss_data_buff_.pop_front();
+        }
+
         return true;
     }
 
@@ -105,9 +170,15 @@ bool MatchingFlow::ValidData() {
 
 bool MatchingFlow::UpdateMatching() {
     if (!matching_ptr_->HasInited()) {
-        // first try to init using scan context query:
+        // every init verifies the scan against the map, scans are taken & dropped until it is loaded:
+        if (!matching_ptr_->IsMapReady()) {
+            LOG_EVERY_N(INFO, 10) << "Global map not ready, skip matching." << std::endl;
+            return false;
+        }
+
+        // first try to init using scan context query, verified along with GNSS pose:
         if (
-            matching_ptr_->SetScanContextPose(current_cloud_data_)
+            matching_ptr_->SetScanContextPose(current_cloud_data_, current_gnss_data_.pose)
         ) {
             Eigen::Matrix4f init_pose = matching_ptr_->GetInitPose();
 
@@ -130,7 +201,14 @@ bool MatchingFlow::UpdateMatching() {
         }
     }
 
-    return matching_ptr_->Update(current_cloud_data_, laser_odometry_);
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool is_matching_succeeded = matching_ptr_->Update(current_cloud_data_, laser_odometry_);
+    const double processing_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (deadline_policy_ptr_->Update(processing_time)) {
+        matching_ptr_->SetLoadLevel(deadline_policy_ptr_->GetLevel());
+    }
+
+    return is_matching_succeeded;
 }
 
 bool MatchingFlow::PublishData() {
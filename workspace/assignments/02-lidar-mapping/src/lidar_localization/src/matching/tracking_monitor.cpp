@@ -0,0 +1,72 @@
+/*
+ * @Description: tracking health of map-based localization, from the summary of each scan-map registration
+ * @Author: Ge Yao
+ * @Date: 2021-02-02 21:37:15
+ */
+#include "lidar_localization/matching/tracking_monitor.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace lidar_localization {
+namespace {
+// ratio of the smallest to the largest eigenvalue of a positive semi-definite block, 0 if it is all zero:
+double GetEigenvalueRatio(const Eigen::Matrix3d& block) {
+    const Eigen::Vector3d eigenvalues = Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d>(
+        block, Eigen::EigenvaluesOnly
+    ).eigenvalues();
+
+    return (eigenvalues(2) > 0.0) ? std::max(eigenvalues(0), 0.0) / eigenvalues(2) : 0.0;
+}
+}
+
+TrackingMonitor::TrackingMonitor(const YAML::Node& node)
+    : max_fitness_score_(node["max_fitness_score"].as<float>()),
+      min_inlier_ratio_(node["min_inlier_ratio"].as<float>()),
+      min_conditioning_(node["min_conditioning"].as<double>()),
+      max_num_degraded_frames_(std::max(node["num_degraded_frames"].as<int>(), 1)) {
+    std::cout << "\tTracking Monitor: max. fitness score " << max_fitness_score_
+              << ", min. inlier ratio " << min_inlier_ratio_
+              << ", min. conditioning " << min_conditioning_
+              << ", lost after " << max_num_degraded_frames_ << " degraded frames" << std::endl;
+}
+
+TrackingMonitor::State TrackingMonitor::Update(const RegistrationInterface::Result& result) {
+    if (IsHealthy(result)) {
+        num_degraded_frames_ = 0;
+    } else {
+        ++num_degraded_frames_;
+    }
+
+    return GetState();
+}
+
+void TrackingMonitor::Reset(void) {
+    num_degraded_frames_ = 0;
+    conditioning_ = 1.0;
+}
+
+TrackingMonitor::State TrackingMonitor::GetState(void) const {
+    if (0 == num_degraded_frames_)
+        return State::HEALTHY;
+
+    return (num_degraded_frames_ < max_num_degraded_frames_) ? State::DEGRADED : State::LOST;
+}
+
+bool TrackingMonitor::IsHealthy(const RegistrationInterface::Result& result) {
+    conditioning_ = 1.0;
+    if (result.has_hessian) {
+        conditioning_ = std::min(
+            GetEigenvalueRatio(result.hessian.block<3, 3>(0, 0)),
+            GetEigenvalueRatio(result.hessian.block<3, 3>(3, 3))
+        );
+    }
+
+    return (
+        result.fitness_score <= max_fitness_score_ &&
+        (result.inlier_ratio < 0.0f || result.inlier_ratio >= min_inlier_ratio_) &&
+        conditioning_ >= min_conditioning_
+    );
+}
+
+} // namespace lidar_localization
@@ -4,6 +4,7 @@
  * @Date: 2020-02-09 19:53:20
  */
 #include "lidar_localization/models/cloud_filter/no_filter.hpp"
+#include "lidar_localization/tools/cloud_pool.hpp"
 #include "glog/logging.h"
 
 namespace lidar_localization {
@@ -11,7 +12,13 @@ NoFilter::NoFilter() {
 }
 
 bool NoFilter::Filter(const CloudData::CLOUD_PTR& input_cloud_ptr, CloudData::CLOUD_PTR& filtered_cloud_ptr) {
-    filtered_cloud_ptr.reset(new CloudData::CLOUD(*input_cloud_ptr));
+    // assigned, so that a recycled output keeps its capacity:
+    if (filtered_cloud_ptr != input_cloud_ptr) {
+        if (!filtered_cloud_ptr) {
+            filtered_cloud_ptr = CloudPool::GetInstance().Get();
+        }
+        *filtered_cloud_ptr = *input_cloud_ptr;
+    }
     return true;
 }
 } 
\ No newline at end of file
@@ -0,0 +1,135 @@
+/*
+ * @Description: global map bucketed into x-y cells, for ROI cropping in O(points in ROI)
+ * @Author: Ge Yao
+ * @Date: 2020-12-20 16:05:38
+ */
+#include "lidar_localization/models/local_map/grid_map.hpp"
+
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <algorithm>
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+GridMap::GridMap(const CloudData::CLOUD_PTR& map_ptr, float cell_size)
+    : map_ptr_(map_ptr), cell_size_(cell_size) {
+    CloudData::CLOUD& map = *map_ptr_;
+    const size_t N = map.points.size();
+
+    // a. sort points by cell:
+    std::vector<std::pair<int64_t, size_t>> cell_keys(N);
+    for (size_t i = 0; i < N; ++i) {
+        const CloudData::POINT& point = map.points[i];
+        cell_keys[i] = std::make_pair(GetCellKey(GetCellIndex(point.x), GetCellIndex(point.y)), i);
+    }
+    std::sort(cell_keys.begin(), cell_keys.end());
+
+    CloudData::CLOUD sorted_map;
+    sorted_map.points.reserve(N);
+    for (const auto& cell_key: cell_keys) {
+        sorted_map.points.push_back(map.points[cell_key.second]);
+    }
+    map.points.swap(sorted_map.points);
+
+    // b. index cell ranges:
+    for (size_t i = 0; i < N; ++i) {
+        const float z = map.points[i].z;
+
+        auto result = cells_.emplace(
+            cell_keys[i].first, 
+            Cell{i, i, std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest()}
+        );
+        Cell& cell = result.first->second;
+        cell.end = i + 1;
+        cell.min_z = std::min(cell.min_z, z);
+        cell.max_z = std::max(cell.max_z, z);
+    }
+
+    std::cout << "Grid Map params:" << std::endl
+              << "cell size: " << cell_size_ << ", "
+              << "num. of points: " << N << ", "
+              << "num. of cells: " << cells_.size()
+              << std::endl << std::endl;
+}
+
+bool GridMap::GetMap(const std::vector<float>& edge, CloudData::CLOUD_PTR& map_ptr) const {
+    map_ptr.reset(new CloudData::CLOUD());
+    CloudData::CLOUD& local_map = *map_ptr;
+    const CloudData::CLOUD& map = *map_ptr_;
+
+    const int min_ix = GetCellIndex(edge.at(0));
+    const int max_ix = GetCellIndex(edge.at(1));
+    const int min_iy = GetCellIndex(edge.at(2));
+    const int max_iy = GetCellIndex(edge.at(3));
+
+    for (int ix = min_ix; ix <= max_ix; ++ix) {
+        for (int iy = min_iy; iy <= max_iy; ++iy) {
+            auto it = cells_.find(GetCellKey(ix, iy));
+            if (it == cells_.end())
+                continue;
+
+            const Cell& cell = it->second;
+            const bool is_inside = (
+                ix > min_ix && ix < max_ix &&
+                iy > min_iy && iy < max_iy &&
+                cell.min_z >= edge.at(4) && cell.max_z <= edge.at(5)
+            );
+
+            if (is_inside) {
+                // cells strictly inside the box are copied as a whole:
+                local_map.points.insert(
+                    local_map.points.end(), 
+                    map.points.begin() + cell.begin, map.points.begin() + cell.end
+                );
+            } else {
+                for (size_t i = cell.begin; i < cell.end; ++i) {
+                    const CloudData::POINT& point = map.points[i];
+                    if (
+                        point.x >= edge.at(0) && point.x <= edge.at(1) &&
+                        point.y >= edge.at(2) && point.y <= edge.at(3) &&
+                        point.z >= edge.at(4) && point.z <= edge.at(5)
+                    ) {
+                        local_map.points.push_back(point);
+                    }
+                }
+            }
+        }
+    }
+
+    local_map.header = map.header;
+    local_map.width = local_map.points.size();
+    local_map.height = 1;
+    local_map.is_dense = map.is_dense;
+
+    return true;
+}
+
+void GridMap::Crop(const CloudData::CLOUD& input, const std::vector<float>& edge, CloudData::CLOUD& output) {
+    for (const CloudData::POINT& point: input.points) {
+        if (
+            point.x >= edge.at(0) && point.x <= edge.at(1) &&
+            point.y >= edge.at(2) && point.y <= edge.at(3) &&
+            point.z >= edge.at(4) && point.z <= edge.at(5)
+        ) {
+            output.points.push_back(point);
+        }
+    }
+
+    output.header = input.header;
+    output.width = output.points.size();
+    output.height = 1;
+    output.is_dense = input.is_dense;
+}
+
+int64_t GridMap::GetCellKey(int ix, int iy) {
+    return (static_cast<int64_t>(ix) << 32) | static_cast<uint32_t>(iy);
+}
+
+int GridMap::GetCellIndex(float value) const {
+    return static_cast<int>(std::floor(value / cell_size_));
+}
+
+}
@@ -0,0 +1,115 @@
+/*
+ * @Description: registration wrapper, the next target is built on a worker thread
+ * @Author: Ge Yao
+ * @Date: 2020-12-21 20:13:46
+ */
+#include "lidar_localization/models/registration/async_registration.hpp"
+
+#include <utility>
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+AsyncRegistration::AsyncRegistration(
+    const std::shared_ptr<RegistrationInterface>& registration_ptr,
+    const std::shared_ptr<RegistrationInterface>& next_registration_ptr
+) : registration_ptr_(registration_ptr),
+    next_registration_ptr_(next_registration_ptr),
+    thread_(&AsyncRegistration::Run, this) {
+    std::cout << "Async Registration: next target is built on a worker thread" << std::endl << std::endl;
+}
+
+AsyncRegistration::~AsyncRegistration() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    has_task_.notify_one();
+
+    thread_.join();
+}
+
+bool AsyncRegistration::SetInputTarget(const CloudData::CLOUD_PTR& input_target) {
+    // nothing to overlap with yet:
+    if (!has_matched_) {
+        return registration_ptr_->SetInputTarget(input_target);
+    }
+
+    // the caller may keep modifying its cloud, so the worker gets a copy:
+    CloudData::CLOUD_PTR target_ptr(new CloudData::CLOUD(*input_target));
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // a target not yet picked up is replaced, a finished one is dropped:
+        pending_target_ptr_ = target_ptr;
+        is_next_ready_ = false;
+    }
+    has_task_.notify_one();
+
+    return true;
+}
+
+bool AsyncRegistration::ScanMatch(
+    const CloudData::CLOUD_PTR& input_source, 
+    const Eigen::Matrix4f& predict_pose, 
+    CloudData::CLOUD_PTR& result_cloud_ptr,
+    Eigen::Matrix4f& result_pose
+) {
+    SwapInNext();
+
+    return registration_ptr_->ScanMatch(input_source, predict_pose, result_cloud_ptr, result_pose);
+}
+
+void AsyncRegistration::SwapInNext(void) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (is_next_ready_) {
+            std::swap(registration_ptr_, next_registration_ptr_);
+            is_next_ready_ = false;
+        }
+    }
+    registration_ptr_->SetMaxIterationLimit(max_iteration_limit_);
+    has_matched_ = true;
+}
+
+float AsyncRegistration::GetFitnessScore() {
+    return registration_ptr_->GetFitnessScore();
+}
+
+bool AsyncRegistration::SetMaxIterationLimit(int max_iteration_limit) {
+    // the other instance belongs to the worker until it is swapped in:
+    max_iteration_limit_ = max_iteration_limit;
+
+    return registration_ptr_->SetMaxIterationLimit(max_iteration_limit);
+}
+
+int AsyncRegistration::GetNumIterations() {
+    return registration_ptr_->GetNumIterations();
+}
+
+RegistrationInterface::Result AsyncRegistration::GetResult() {
+    return registration_ptr_->GetResult();
+}
+
+void AsyncRegistration::Run(void) {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        has_task_.wait(lock, [this]{ return stop_ || pending_target_ptr_; });
+        // pending targets are dropped on exit:
+        if (stop_)
+            break;
+
+        CloudData::CLOUD_PTR target_ptr;
+        target_ptr.swap(pending_target_ptr_);
+        lock.unlock();
+
+        next_registration_ptr_->SetInputTarget(target_ptr);
+
+        lock.lock();
+        // a newer target arrived meanwhile, so this one is already stale:
+        is_next_ready_ = !pending_target_ptr_;
+    }
+}
+
+}
@@ -0,0 +1,399 @@
+/*
+ * @Description: distribution-to-distribution NDT registration, the scan is matched as voxel Gaussians
+ * @Author: Ge Yao
+ * @Date: 2021-01-22 20:51:40
+ */
+#include "lidar_localization/models/registration/ndt_d2d_registration.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include <pcl/common/transforms.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+// expected ratio of outliers in the source scan:
+static const double OUTLIER_RATIO = 0.55;
+// max. number of step halvings when the score does not improve:
+static const int MAX_BACKTRACKING = 4;
+
+NDTD2DRegistration::NDTD2DRegistration(const YAML::Node& node)
+    : input_target_kdtree_(new pcl::KdTreeFLANN<CloudData::POINT>()) {
+
+    float res = node["res"].as<float>();
+    float source_res = node["source_res"].as<float>();
+    int min_source_points = node["min_source_points"].as<int>();
+    float step_size = node["step_size"].as<float>();
+    float trans_eps = node["trans_eps"].as<float>();
+    int max_iter = node["max_iter"].as<int>();
+    int num_threads = node["num_threads"].as<int>();
+
+    SetRegistrationParam(res, source_res, min_source_points, step_size, trans_eps, max_iter, num_threads);
+}
+
+NDTD2DRegistration::NDTD2DRegistration(
+    float res, float source_res, int min_source_points,
+    float step_size, float trans_eps, int max_iter,
+    int num_threads
+) : input_target_kdtree_(new pcl::KdTreeFLANN<CloudData::POINT>()) {
+    SetRegistrationParam(res, source_res, min_source_points, step_size, trans_eps, max_iter, num_threads);
+}
+
+bool NDTD2DRegistration::SetRegistrationParam(
+    float res, float source_res, int min_source_points,
+    float step_size, float trans_eps, int max_iter,
+    int num_threads
+) {
+    res_ = res;
+    source_res_ = source_res;
+    min_source_points_ = min_source_points;
+    step_size_ = step_size;
+    trans_eps_ = trans_eps;
+    max_iter_ = max_iter;
+
+    // num_threads <= 0 means use all available cores:
+#ifdef _OPENMP
+    num_threads_ = (num_threads > 0) ? num_threads : omp_get_max_threads();
+#else
+    num_threads_ = 1;
+#endif
+    thread_derivatives_.resize(num_threads_);
+
+    // score function constants, follow pcl::NormalDistributionsTransform:
+    const double gauss_c1 = 10.0 * (1.0 - OUTLIER_RATIO);
+    const double gauss_c2 = OUTLIER_RATIO / std::pow(res_, 3);
+    const double gauss_d3 = -std::log(gauss_c2);
+    gauss_d1_ = -std::log(gauss_c1 + gauss_c2) - gauss_d3;
+    gauss_d2_ = -2.0 * std::log((-std::log(gauss_c1 * std::exp(-0.5) + gauss_c2) - gauss_d3) / gauss_d1_);
+
+    std::cout << "NDT D2D params:" << std::endl
+              << "res: " << res_ << ", "
+              << "source_res: " << source_res_ << ", "
+              << "min_source_points: " << min_source_points_ << ", "
+              << "step_size: " << step_size_ << ", "
+              << "trans_eps: " << trans_eps_ << ", "
+              << "max_iter: " << max_iter_ << ", "
+              << "num_threads: " << num_threads_
+              << std::endl << std::endl;
+
+    return true;
+}
+
+bool NDTD2DRegistration::SetInputTarget(const CloudData::CLOUD_PTR& input_target) {
+    input_target_ = input_target;
+    has_target_kdtree_ = false;
+
+    std::vector<int64_t> keys;
+    std::vector<int> num_points;
+    BuildVoxels(*input_target_, res_, NDTVoxel::MIN_POINTS_PER_VOXEL, voxels_, keys, num_points);
+
+    voxel_index_.clear();
+    voxel_index_.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        voxel_index_.emplace(keys[i], static_cast<int>(i));
+    }
+
+    return true;
+}
+
+bool NDTD2DRegistration::ScanMatch(const CloudData::CLOUD_PTR& input_source,
+                                   const Eigen::Matrix4f& predict_pose,
+                                   CloudData::CLOUD_PTR& result_cloud_ptr,
+                                   Eigen::Matrix4f& result_pose) {
+    input_source_ = input_source;
+
+    // the source is voxelized once, in its own frame:
+    std::vector<int64_t> source_keys;
+    BuildVoxels(*input_source_, source_res_, min_source_points_, source_voxels_, source_keys, source_num_points_);
+
+    Eigen::Matrix4d pose = predict_pose.cast<double>();
+    Derivatives derivatives, candidate_derivatives;
+    double score = ComputeDerivatives(pose, derivatives);
+
+    num_iterations_ = 0;
+    bool has_converged = false;
+    const int max_iter = max_iteration_limit_ < 0 ? max_iter_ : std::min(max_iter_, max_iteration_limit_);
+    for (int curr_iter = 0; curr_iter < max_iter; ++curr_iter) {
+        ++num_iterations_;
+        // Gauss-Newton step:
+        Vector6d delta = derivatives.H.ldlt().solve(-derivatives.g);
+        if (!delta.allFinite()) {
+            break;
+        }
+
+        // limit step length, as step_size does for pcl::NormalDistributionsTransform:
+        const double delta_norm = delta.norm();
+        if (delta_norm > step_size_) {
+            delta *= step_size_ / delta_norm;
+        }
+
+        // backtrack until the score improves:
+        bool is_improved = false;
+        for (int i = 0; i < MAX_BACKTRACKING; ++i) {
+            const Eigen::Matrix4d candidate_pose = UpdatePose(pose, delta);
+            const double candidate_score = ComputeDerivatives(candidate_pose, candidate_derivatives);
+
+            if (candidate_score >= score) {
+                pose = candidate_pose;
+                score = candidate_score;
+                std::swap(derivatives, candidate_derivatives);
+                is_improved = true;
+                break;
+            }
+
+            delta *= 0.5;
+        }
+
+        // converged once the step is small, or when no shorter step improves the score either:
+        if (!is_improved || delta.norm() < trans_eps_) {
+            has_converged = true;
+            break;
+        }
+    }
+
+    final_transformation_ = pose.cast<float>();
+
+    // derivatives are always those of the current pose:
+    const int N = static_cast<int>(input_source_->points.size());
+    result_ = Result();
+    result_.num_iterations = num_iterations_;
+    result_.has_converged = has_converged;
+    result_.inlier_ratio = (N > 0) ? static_cast<float>(derivatives.num_matched_points) / N : 0.0f;
+    if (derivatives.num_matched_points > 0) {
+        result_.fitness_score = static_cast<float>(derivatives.sum_sq_dis / derivatives.num_matched_points);
+    }
+    result_.has_hessian = true;
+    result_.hessian = derivatives.H;
+
+    result_pose = final_transformation_;
+    pcl::transformPointCloud(*input_source_, *result_cloud_ptr, result_pose);
+
+    return true;
+}
+
+bool NDTD2DRegistration::SetMaxIterationLimit(int max_iteration_limit) {
+    max_iteration_limit_ = max_iteration_limit;
+
+    return true;
+}
+
+int NDTD2DRegistration::GetNumIterations() {
+    return num_iterations_;
+}
+
+RegistrationInterface::Result NDTD2DRegistration::GetResult() {
+    return result_;
+}
+
+float NDTD2DRegistration::GetFitnessScore() {
+    // same definition as pcl::Registration::getFitnessScore,
+    // i.e., mean squared distance from aligned source to nearest target point:
+    if (!has_target_kdtree_) {
+        input_target_kdtree_->setInputCloud(input_target_);
+        has_target_kdtree_ = true;
+    }
+
+    const Eigen::Matrix3f R = final_transformation_.block<3, 3>(0, 0);
+    const Eigen::Vector3f t = final_transformation_.block<3, 1>(0, 3);
+    const int N = static_cast<int>(input_source_->points.size());
+
+    double sum_sq_dis = 0.0;
+    int num_corr = 0;
+#pragma omp parallel num_threads(num_threads_) reduction(+:sum_sq_dis, num_corr)
+    {
+        std::vector<int> corr_ind(1);
+        std::vector<float> corr_sq_dis(1);
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < N; ++i) {
+            CloudData::POINT point = input_source_->points[i];
+            point.getVector3fMap() = R * point.getVector3fMap() + t;
+
+            if (input_target_kdtree_->nearestKSearch(point, 1, corr_ind, corr_sq_dis) > 0) {
+                sum_sq_dis += corr_sq_dis.at(0);
+                ++num_corr;
+            }
+        }
+    }
+
+    return (num_corr > 0) ? static_cast<float>(sum_sq_dis / num_corr) : std::numeric_limits<float>::max();
+}
+
+void NDTD2DRegistration::BuildVoxels(
+    const CloudData::CLOUD& cloud, float res, int min_num_points,
+    VoxelVector& voxels, std::vector<int64_t>& keys, std::vector<int>& num_points
+) const {
+    // a. point statistics by voxel:
+    NDTVoxel::StatsMap stats_map;
+    NDTVoxel::GetStats(cloud, res, stats_map);
+
+    std::vector<std::pair<int64_t, const NDTVoxel::Stats*>> keyed_stats;
+    keyed_stats.reserve(stats_map.size());
+    for (const auto &voxel_stats: stats_map) {
+        if (voxel_stats.second.num_points >= min_num_points) {
+            keyed_stats.emplace_back(voxel_stats.first, &voxel_stats.second);
+        }
+    }
+    // in key order, so the result does not depend on the hash map:
+    std::sort(
+        keyed_stats.begin(), keyed_stats.end(), 
+        [](const std::pair<int64_t, const NDTVoxel::Stats*> &a, const std::pair<int64_t, const NDTVoxel::Stats*> &b) {
+            return a.first < b.first;
+        }
+    );
+
+    // b. estimate voxel distributions in parallel:
+    const int M = static_cast<int>(keyed_stats.size());
+    VoxelVector candidate_voxels(M);
+    std::vector<char> is_valid(M, 0);
+
+#pragma omp parallel for num_threads(num_threads_) schedule(dynamic, 64)
+    for (int j = 0; j < M; ++j) {
+        is_valid[j] = NDTVoxel::ComputeDistribution(*keyed_stats[j].second, candidate_voxels[j], min_num_points) ? 1 : 0;
+    }
+
+    // c. keep valid voxels:
+    voxels.clear();
+    voxels.reserve(M);
+    keys.clear();
+    keys.reserve(M);
+    num_points.clear();
+    num_points.reserve(M);
+    for (int j = 0; j < M; ++j) {
+        if (is_valid[j]) {
+            voxels.push_back(candidate_voxels[j]);
+            keys.push_back(keyed_stats[j].first);
+            num_points.push_back(keyed_stats[j].second->num_points);
+        }
+    }
+}
+
+int NDTD2DRegistration::GetNeighborVoxels(const Eigen::Vector3f &point, const Voxel *neighbors[]) const {
+    static const int OFFSETS[7][3] = {
+        { 0,  0,  0},
+        {+1,  0,  0}, {-1,  0,  0},
+        { 0, +1,  0}, { 0, -1,  0},
+        { 0,  0, +1}, { 0,  0, -1}
+    };
+
+    const Eigen::Vector3i index = NDTVoxel::GetIndex(point, res_);
+
+    int num_neighbors = 0;
+    for (int i = 0; i < 7; ++i) {
+        const Eigen::Vector3i neighbor_index = index + Eigen::Vector3i(OFFSETS[i][0], OFFSETS[i][1], OFFSETS[i][2]);
+
+        auto it = voxel_index_.find(NDTVoxel::GetKey(neighbor_index));
+        if (it != voxel_index_.end()) {
+            neighbors[num_neighbors++] = &voxels_[it->second];
+        }
+    }
+
+    return num_neighbors;
+}
+
+double NDTD2DRegistration::ComputeDerivatives(const Eigen::Matrix4d &pose, Derivatives &derivatives) {
+    const Eigen::Matrix3d R = pose.block<3, 3>(0, 0);
+    const Eigen::Vector3d t = pose.block<3, 1>(0, 3);
+    const int M = static_cast<int>(source_voxels_.size());
+
+#pragma omp parallel num_threads(num_threads_)
+    {
+#ifdef _OPENMP
+        Derivatives &partial = thread_derivatives_.at(omp_get_thread_num());
+#else
+        Derivatives &partial = thread_derivatives_.at(0);
+#endif
+        partial.Reset();
+
+        const Voxel *neighbors[7];
+        Eigen::Matrix<double, 3, 6> J;
+        J.block<3, 3>(0, 0).setIdentity();
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < M; ++i) {
+            const Voxel &source_voxel = source_voxels_[i];
+            const Eigen::Vector3d mean = R * source_voxel.mean + t;
+            const int num_neighbors = GetNeighborVoxels(mean.cast<float>(), neighbors);
+            if (num_neighbors == 0) {
+                continue;
+            }
+
+            // jacobian of transformed mean w.r.t. left perturbation [delta_t, delta_theta]:
+            J.block<3, 3>(0, 3) <<         0.0,  mean.z(), -mean.y(),
+                                     -mean.z(),       0.0,  mean.x(),
+                                      mean.y(), -mean.x(),       0.0;
+
+            const Eigen::Matrix3d cov = R * source_voxel.cov * R.transpose();
+
+            double max_e = -1.0;
+            double sq_dis = 0.0;
+            for (int k = 0; k < num_neighbors; ++k) {
+                // the two distributions combined:
+                const Eigen::Vector3d q = mean - neighbors[k]->mean;
+                const Eigen::Matrix3d icov = (cov + neighbors[k]->cov).inverse();
+                const Eigen::Vector3d icov_q = icov * q;
+                const double e = std::exp(-0.5 * gauss_d2_ * q.dot(icov_q));
+                if (e > max_e) {
+                    max_e = e;
+                    sq_dis = std::pow(neighbors[k]->normal.dot(q), 2);
+                }
+
+                // score contribution and its Gauss-Newton derivatives, the weight is positive as d1 < 0:
+                const double w = -gauss_d1_ * gauss_d2_ * e;
+
+                partial.score += -gauss_d1_ * e;
+                partial.g.noalias() += w * J.transpose() * icov_q;
+                partial.H.noalias() += w * J.transpose() * icov * J;
+            }
+
+            partial.sum_sq_dis += source_num_points_[i] * sq_dis;
+            partial.num_matched_points += source_num_points_[i];
+        }
+    }
+
+    // reduce in thread order, so the result is deterministic:
+    derivatives.Reset();
+    for (const auto &partial: thread_derivatives_) {
+        derivatives.score += partial.score;
+        derivatives.g += partial.g;
+        derivatives.H += partial.H;
+        derivatives.sum_sq_dis += partial.sum_sq_dis;
+        derivatives.num_matched_points += partial.num_matched_points;
+    }
+
+    return derivatives.score;
+}
+
+Eigen::Matrix4d NDTD2DRegistration::UpdatePose(const Eigen::Matrix4d &pose, const Vector6d &delta) {
+    const Eigen::Vector3d delta_theta = delta.tail<3>();
+    const double angle = delta_theta.norm();
+
+    Eigen::Matrix3d delta_R = Eigen::Matrix3d::Identity();
+    if (angle > 1.0e-10) {
+        delta_R = Eigen::AngleAxisd(angle, delta_theta / angle).toRotationMatrix();
+    }
+
+    Eigen::Matrix4d updated_pose = Eigen::Matrix4d::Identity();
+    updated_pose.block<3, 3>(0, 0) = delta_R * pose.block<3, 3>(0, 0);
+    updated_pose.block<3, 1>(0, 3) = delta_R * pose.block<3, 1>(0, 3) + delta.head<3>();
+
+    return updated_pose;
+}
+
+void NDTD2DRegistration::Derivatives::Reset(void) {
+    score = 0.0;
+    g.setZero();
+    H.setZero();
+    sum_sq_dis = 0.0;
+    num_matched_points = 0;
+}
+
+}
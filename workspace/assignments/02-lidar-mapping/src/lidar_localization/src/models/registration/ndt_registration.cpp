@@ -5,6 +5,8 @@
  */
 #include "lidar_localization/models/registration/ndt_registration.hpp"
 
+#include <algorithm>
+
 #include "glog/logging.h"
 
 namespace lidar_localization {
@@ -30,6 +32,7 @@ bool NDTRegistration::SetRegistrationParam(float res, float step_size, float tra
     ndt_ptr_->setResolution(res);
     ndt_ptr_->setStepSize(step_size);
     ndt_ptr_->setTransformationEpsilon(trans_eps);
+    max_iter_ = max_iter;
     ndt_ptr_->setMaximumIterations(max_iter);
 
     std::cout << "NDT params:" << std::endl
@@ -62,4 +65,25 @@ bool NDTRegistration::ScanMatch(const CloudData::CLOUD_PTR& input_source,
 float NDTRegistration::GetFitnessScore() {
     return ndt_ptr_->getFitnessScore();
 }
+
+int NDTRegistration::GetNumIterations() {
+    return ndt_ptr_->getFinalNumIteration();
+}
+
+RegistrationInterface::Result NDTRegistration::GetResult() {
+    Result result;
+    result.fitness_score = GetFitnessScore();
+    result.num_iterations = GetNumIterations();
+    result.has_converged = ndt_ptr_->hasConverged();
+
+    return result;
+}
+
+bool NDTRegistration::SetMaxIterationLimit(int max_iteration_limit) {
+    ndt_ptr_->setMaximumIterations(
+        max_iteration_limit < 0 ? max_iter_ : std::min(max_iter_, max_iteration_limit)
+    );
+
+    return true;
+}
 }
\ No newline at end of file
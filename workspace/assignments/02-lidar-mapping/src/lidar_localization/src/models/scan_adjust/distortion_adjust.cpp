@@ -4,6 +4,7 @@
  * @Date: 2020-02-25 14:39:00
  */
 #include "lidar_localization/models/scan_adjust/distortion_adjust.hpp"
+#include "lidar_localization/tools/cloud_pool.hpp"
 #include "glog/logging.h"
 
 namespace lidar_localization {
@@ -14,8 +15,9 @@ void DistortionAdjust::SetMotionInfo(float scan_period, VelocityData velocity_da
 }
 
 bool DistortionAdjust::AdjustCloud(CloudData::CLOUD_PTR& input_cloud_ptr, CloudData::CLOUD_PTR& output_cloud_ptr) {
-    CloudData::CLOUD_PTR origin_cloud_ptr(new CloudData::CLOUD(*input_cloud_ptr));
-    output_cloud_ptr.reset(new CloudData::CLOUD());
+    CloudData::CLOUD_PTR origin_cloud_ptr = CloudPool::GetInstance().Get();
+    *origin_cloud_ptr = *input_cloud_ptr;
+    output_cloud_ptr = CloudPool::GetInstance().Get();
 
     float orientation_space = 2.0 * M_PI;
     float delete_space = 5.0 * M_PI / 180.0;
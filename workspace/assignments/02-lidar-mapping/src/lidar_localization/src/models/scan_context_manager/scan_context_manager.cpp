@@ -4,6 +4,7 @@
  * @Date: 2020-10-28 15:43:03
  */
 #include <limits>
+#include <algorithm>
 
 #include <math.h>
 #include <ctime>
@@ -114,32 +115,69 @@ std::pair<int, float> ScanContextManager::DetectLoopClosure(void) {
 bool ScanContextManager::DetectLoopClosure(
     const CloudData &scan,
     Eigen::Matrix4f &pose
+) {
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> poses;
+    if (!DetectLoopClosure(scan, 1, poses)) {
+        return false;
+    }
+
+    pose = poses.front();
+
+    return true;
+}
+
+/**
+ * @brief  get up to N loop closure proposals using the given key scan
+ * @param  scan, query key scan
+ * @param  N, max. num. of proposals
+ * @param  poses, matched poses, best first
+ * @return true if any proposal is found
+ */
+bool ScanContextManager::DetectLoopClosure(
+    const CloudData &scan,
+    const int N,
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> &poses
+) {
+    return DetectLoopClosure(scan, N, CandidateFilter(), poses);
+}
+
+/**
+ * @brief  get up to N loop closure proposals using the given key scan, among the ones passing the filter
+ * @param  scan, query key scan
+ * @param  N, max. num. of proposals
+ * @param  is_candidate, ring key neighbors failing it are dropped before scan context comparison
+ * @param  poses, matched poses, best first
+ * @return true if any proposal is found
+ */
+bool ScanContextManager::DetectLoopClosure(
+    const CloudData &scan,
+    const int N,
+    const CandidateFilter &is_candidate,
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> &poses
 ) {
     // extract scan context and corresponding ring key:
     ScanContext query_scan_context = GetScanContext(scan);
     RingKey query_ring_key = GetRingKey(query_scan_context);
 
-    // get proposal:
-    std::pair<int, float> proposal = GetLoopClosureMatch(
-        query_scan_context, query_ring_key
-    );
+    // get proposals:
+    std::vector<std::pair<int, float>> proposals;
+    GetLoopClosureMatches(query_scan_context, query_ring_key, N, is_candidate, proposals);
 
-    const int key_frame_id = proposal.first;
-    const float yaw_change_in_rad = proposal.second;
+    poses.clear();
+    for (const auto &proposal: proposals) {
+        const int key_frame_id = proposal.first;
+        const float yaw_change_in_rad = proposal.second;
 
-    // check proposal validity:
-    if (ScanContextManager::NONE == key_frame_id) {
-        return false;
-    }
+        // set matched pose:
+        Eigen::Matrix4f pose = state_.index_.data_.key_frame_.at(key_frame_id).pose;
+        // apply orientation change estimation:
+        Eigen::AngleAxisf orientation_change(yaw_change_in_rad, Eigen::Vector3f::UnitZ());
+        pose.block<3, 3>(0, 0) = pose.block<3, 3>(0, 0) * orientation_change.toRotationMatrix();
 
-    // set matched pose:
-    pose = state_.index_.data_.key_frame_.at(key_frame_id).pose;
-    // apply orientation change estimation:
-    Eigen::AngleAxisf orientation_change(yaw_change_in_rad, Eigen::Vector3f::UnitZ());
-    pose.block<3, 3>(0, 0) = pose.block<3, 3>(0, 0) * orientation_change.toRotationMatrix();
+        poses.push_back(pose);
+    }
 
-    // finally:
-    return true;
+    return !poses.empty();
 }
 
 /**
@@ -657,7 +695,34 @@ std::pair<int, float> ScanContextManager::GetLoopClosureMatch(
     const ScanContext &query_scan_context,
     const RingKey &query_ring_key
 ) {
-    int match_id = NONE;
+    std::vector<std::pair<int, float>> matches;
+    GetLoopClosureMatches(query_scan_context, query_ring_key, 1, CandidateFilter(), matches);
+
+    if (matches.empty()) {
+        std::pair<int, float> result {NONE, 0.0};
+        return result;
+    }
+
+    return matches.front();
+}
+
+/**
+ * @brief  get loop closure match results for given scan context and ring key 
+ * @param  query_scan_context, query scan context 
+ * @param  query_ring_key, query ring key
+ * @param  N, max. num. of matches
+ * @param  is_candidate, ring key neighbors failing it are not scored, none are dropped if empty
+ * @param  matches, matches below distance thresh, best first
+ * @return void
+ */
+void ScanContextManager::GetLoopClosureMatches(
+    const ScanContext &query_scan_context,
+    const RingKey &query_ring_key,
+    const int N,
+    const CandidateFilter &is_candidate,
+    std::vector<std::pair<int, float>> &matches
+) {
+    matches.clear();
 
     //
     // step 1: loop closure detection criteria check -- only perform loop closure detection when
@@ -666,8 +731,7 @@ std::pair<int, float> ScanContextManager::GetLoopClosureMatch(
     if(
         state_.ring_key_.size() <= (static_cast<size_t>(MIN_KEY_FRAME_SEQ_DISTANCE_))
     ) {
-        std::pair<int, float> result {match_id, 0.0};
-        return result; 
+        return;
     }
 
     //
@@ -681,52 +745,61 @@ std::pair<int, float> ScanContextManager::GetLoopClosureMatch(
     );
 
     // 
-    // step 3: find optimal match
+    // step 3: score candidates
     // 
-    int optimal_index = 0;
-    int optimal_shift = 0;
-    float optimal_dist = std::numeric_limits<float>::max();
+    std::vector<std::pair<int, float>> match_results(
+        NUM_CANDIDATES_, std::pair<int, float>(0, std::numeric_limits<float>::max())
+    );
     for (int i = 0; i < NUM_CANDIDATES_; ++i)
     {   
+        if (is_candidate && !is_candidate(static_cast<int>(candidate_indices.at(i)))) {
+            continue;
+        }
+
         const ScanContext &candidate_scan_context = state_.scan_context_.at(
             candidate_indices.at(i)
         );
 
-        std::pair<int, float> match_result = GetScanContextMatch(
+        match_results.at(i) = GetScanContextMatch(
             candidate_scan_context, query_scan_context
         ); 
-        
-        int candidate_shift = match_result.first;
-        float candidate_dist = match_result.second;
-        
-        if(candidate_dist < optimal_dist)
-        {
-            optimal_dist = candidate_dist;
-            optimal_shift = candidate_shift;
-            optimal_index = candidate_indices.at(i);
-        }
     }
 
     // 
-    // step 4: loop closure threshold check:
+    // step 4: loop closure threshold check, keep the best N:
     //
-    float yaw_change_in_deg = optimal_shift * DEG_PER_SECTOR_;
-    float yaw_change_in_rad = yaw_change_in_deg / 180.0f * M_PI;
-    if(optimal_dist < SCAN_CONTEXT_DISTANCE_THRESH_)
-    {
-        match_id = optimal_index; 
+    std::vector<int> orders;
+    for (int i = 0; i < NUM_CANDIDATES_; ++i) {
+        if (match_results.at(i).second < SCAN_CONTEXT_DISTANCE_THRESH_) {
+            orders.push_back(i);
+        }
+    }
+    std::stable_sort(
+        orders.begin(), orders.end(), 
+        [&match_results](const int a, const int b) {
+            return match_results.at(a).second < match_results.at(b).second;
+        }
+    );
+    if (orders.size() > static_cast<size_t>(std::max(N, 0))) {
+        orders.resize(std::max(N, 0));
+    }
+
+    for (size_t k = 0; k < orders.size(); ++k) {
+        const int i = orders.at(k);
+        const int match_id = candidate_indices.at(i);
+        const float match_dist = match_results.at(i).second;
+        float yaw_change_in_deg = match_results.at(i).first * DEG_PER_SECTOR_;
+        float yaw_change_in_rad = yaw_change_in_deg / 180.0f * M_PI;
 
         LOG(INFO) << std::endl
                   << "[Scan Context] Loop-Closure Detected " 
-                  << state_.scan_context_.size() - 1 << "<-->" << optimal_index << std::endl 
-                  << "\tDistance " << optimal_dist << std::endl 
+                  << state_.scan_context_.size() - 1 << "<-->" << match_id << std::endl 
+                  << "\tDistance " << match_dist << std::endl 
                   << "\tHeading Change " << yaw_change_in_deg << " deg." << std::endl
                   << std::endl;
-    }
-
-    std::pair<int, float> result{match_id, yaw_change_in_rad};
 
-    return result;
+        matches.emplace_back(match_id, yaw_change_in_rad);
+    }
 }
 
 /**
@@ -0,0 +1,328 @@
+/*
+ * @Description: the points of all map tiles in one memory-mapped file, optionally on huge pages
+ * @Author: Ge Yao
+ * @Date: 2021-01-22 20:03:41
+ */
+#include "lidar_localization/models/tiled_map/mapped_tile_store.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <pcl/io/pcd_io.h>
+
+#include "glog/logging.h"
+
+
+namespace lidar_localization {
+
+namespace {
+const char MAGIC[8] = {'L', 'L', 'T', 'I', 'L', 'E', 'S', '\0'};
+const uint32_t MAPPED_TILE_STORE_VERSION = 1;
+const size_t HUGE_PAGE_SIZE = size_t(2) << 20;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t point_size;
+    uint64_t num_points;
+    char reserved[40];
+};
+static_assert(sizeof(FileHeader) == 64, "tiles.bin header must stay 64 bytes");
+
+size_t RoundUp(size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+}
+
+bool MappedTileStore::GetHugePages(const std::string& name, HugePages& huge_pages) {
+    if (name == "none") {
+        huge_pages = HugePages::NONE;
+    } else if (name == "thp") {
+        huge_pages = HugePages::THP;
+    } else if (name == "hugetlb") {
+        huge_pages = HugePages::HUGETLB;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+std::string MappedTileStore::GetHugePagesName(HugePages huge_pages) {
+    switch (huge_pages) {
+        case HugePages::THP:
+            return "thp";
+        case HugePages::HUGETLB:
+            return "hugetlb";
+        default:
+            return "none";
+    }
+}
+
+bool MappedTileStore::Save(const std::string& file_path, const std::vector<std::string>& tile_file_paths) {
+    std::ofstream ofs(file_path, std::ios::binary | std::ios::trunc);
+    if (!ofs) {
+        LOG(ERROR) << "Cannot create mapped tile store " << file_path;
+        return false;
+    }
+
+    // the header is written again once the num. of points is known:
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = MAPPED_TILE_STORE_VERSION;
+    header.point_size = sizeof(CloudData::POINT);
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    // one tile in memory at a time:
+    CloudData::CLOUD tile;
+    for (const std::string& tile_file_path: tile_file_paths) {
+        if (pcl::io::loadPCDFile(tile_file_path, tile) != 0) {
+            LOG(ERROR) << "Failed to load map tile " << tile_file_path;
+            return false;
+        }
+
+        ofs.write(reinterpret_cast<const char*>(tile.points.data()), tile.points.size() * sizeof(CloudData::POINT));
+        header.num_points += tile.points.size();
+    }
+
+    ofs.seekp(0);
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!ofs) {
+        LOG(ERROR) << "Failed to save mapped tile store " << file_path;
+        return false;
+    }
+
+    return true;
+}
+
+MappedTileStore::MappedTileStore(
+    const std::string& file_path, const std::vector<size_t>& tile_num_points, HugePages huge_pages
+) : file_path_(file_path), huge_pages_(huge_pages) {
+    tile_offsets_.reserve(tile_num_points.size() + 1);
+    tile_offsets_.push_back(sizeof(FileHeader));
+    for (size_t num_points: tile_num_points) {
+        tile_offsets_.push_back(tile_offsets_.back() + num_points * sizeof(CloudData::POINT));
+    }
+    is_resident_.resize(tile_num_points.size(), 0);
+
+    fd_ = open(file_path_.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+        LOG(WARNING) << "Cannot open mapped tile store " << file_path_;
+        return;
+    }
+
+    // the store must match the index & the point type of this build:
+    struct stat file_stat;
+    FileHeader header;
+    if (
+        fstat(fd_, &file_stat) != 0 ||
+        pread(fd_, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+        std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header.version != MAPPED_TILE_STORE_VERSION ||
+        header.point_size != sizeof(CloudData::POINT) ||
+        static_cast<size_t>(file_stat.st_size) != tile_offsets_.back()
+    ) {
+        LOG(WARNING) << "Mapped tile store " << file_path_ << " does not match the tiled map index.";
+        return;
+    }
+
+    Map(tile_offsets_.back());
+}
+
+MappedTileStore::~MappedTileStore() {
+    if (mapping_ != nullptr) {
+        munmap(mapping_, mapping_size_);
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+const CloudData::POINT* MappedTileStore::GetTile(size_t tile, size_t& num_points, bool& was_resident) {
+    num_points = 0;
+    was_resident = false;
+    if (!IsValid() || tile >= is_resident_.size())
+        return nullptr;
+
+    // file-backed pages are faulted in by the caller reading them:
+    was_resident = IsResident(tile);
+    if (!was_resident) {
+        if (HugePages::NONE == huge_pages_) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!is_resident_.at(tile)) {
+                is_resident_.at(tile) = 1;
+                ++num_resident_tiles_;
+                resident_size_in_bytes_ += tile_offsets_.at(tile + 1) - tile_offsets_.at(tile);
+            }
+        } else if (!Prefault(tile)) {
+            return nullptr;
+        }
+    }
+
+    num_points = (tile_offsets_.at(tile + 1) - tile_offsets_.at(tile)) / sizeof(CloudData::POINT);
+    return reinterpret_cast<const CloudData::POINT*>(data_ + tile_offsets_.at(tile));
+}
+
+bool MappedTileStore::IsResident(size_t tile) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return tile < is_resident_.size() && is_resident_.at(tile);
+}
+
+bool MappedTileStore::Prefault(size_t tile) {
+    if (!IsValid() || tile >= is_resident_.size())
+        return false;
+
+    std::lock_guard<std::mutex> populate_lock(populate_mutex_);
+    if (IsResident(tile))
+        return true;
+
+    if (!Populate(tile))
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    is_resident_.at(tile) = 1;
+    ++num_resident_tiles_;
+    resident_size_in_bytes_ += tile_offsets_.at(tile + 1) - tile_offsets_.at(tile);
+
+    return true;
+}
+
+void MappedTileStore::WillNeed(size_t tile) {
+    if (!IsValid() || tile >= is_resident_.size() || IsResident(tile))
+        return;
+
+    const size_t begin = tile_offsets_.at(tile);
+    const size_t end = tile_offsets_.at(tile + 1);
+    if (begin == end)
+        return;
+
+    if (HugePages::NONE == huge_pages_) {
+        // madvise needs a page-aligned start:
+        const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        const size_t aligned_begin = begin / page_size * page_size;
+        madvise(data_ + aligned_begin, end - aligned_begin, MADV_WILLNEED);
+    } else {
+        // into the page cache, for the read of the tile:
+        posix_fadvise(fd_, static_cast<off_t>(begin), static_cast<off_t>(end - begin), POSIX_FADV_WILLNEED);
+    }
+}
+
+size_t MappedTileStore::GetNumResidentTiles(void) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return num_resident_tiles_;
+}
+
+size_t MappedTileStore::GetResidentSizeInBytes(void) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return resident_size_in_bytes_;
+}
+
+void MappedTileStore::GetResidentTiles(std::vector<size_t>& tiles) {
+    tiles.clear();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t tile = 0; tile < is_resident_.size(); ++tile) {
+        if (is_resident_.at(tile))
+            tiles.push_back(tile);
+    }
+}
+
+bool MappedTileStore::Map(size_t size) {
+    if (HugePages::NONE == huge_pages_) {
+        void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (mapping == MAP_FAILED) {
+            LOG(ERROR) << "Cannot map mapped tile store " << file_path_ << ": " << std::strerror(errno);
+            return false;
+        }
+
+        mapping_ = mapping;
+        mapping_size_ = size;
+        data_ = static_cast<char*>(mapping);
+        data_size_ = size;
+
+        return true;
+    }
+
+    const size_t huge_size = RoundUp(size, HUGE_PAGE_SIZE);
+
+    // reserved at mapping, so a short pool fails here instead of at the first access:
+    if (HugePages::HUGETLB == huge_pages_) {
+        void *mapping = mmap(
+            nullptr, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0
+        );
+        if (mapping != MAP_FAILED) {
+            mapping_ = mapping;
+            mapping_size_ = huge_size;
+            data_ = static_cast<char*>(mapping);
+            data_size_ = size;
+
+            return true;
+        }
+
+        LOG(WARNING) << "Cannot map " << (huge_size >> 20) << " MB of huge pages for " << file_path_
+                     << ": " << std::strerror(errno) << ", transparent huge pages are used.";
+        huge_pages_ = HugePages::THP;
+    }
+
+    // one more huge page, so the data can start on a huge page boundary:
+    void *mapping = mmap(
+        nullptr, huge_size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0
+    );
+    if (mapping == MAP_FAILED) {
+        LOG(ERROR) << "Cannot map " << (huge_size >> 20) << " MB for " << file_path_ << ": " << std::strerror(errno);
+        return false;
+    }
+
+    mapping_ = mapping;
+    mapping_size_ = huge_size + HUGE_PAGE_SIZE;
+    data_ = reinterpret_cast<char*>(RoundUp(reinterpret_cast<uintptr_t>(mapping), HUGE_PAGE_SIZE));
+    data_size_ = size;
+
+    if (madvise(data_, huge_size, MADV_HUGEPAGE) != 0) {
+        LOG(WARNING) << "Transparent huge pages are not available for " << file_path_ << ": " << std::strerror(errno);
+    }
+
+    return true;
+}
+
+bool MappedTileStore::Populate(size_t tile) {
+    const size_t begin = tile_offsets_.at(tile);
+    const size_t end = tile_offsets_.at(tile + 1);
+
+    if (HugePages::NONE == huge_pages_) {
+        // one read per page faults it in:
+        const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        volatile char sum = 0;
+        for (size_t offset = begin; offset < end; offset += page_size) {
+            sum += data_[offset];
+        }
+        if (end > begin) {
+            sum += data_[end - 1];
+        }
+
+        return true;
+    }
+
+    size_t offset = begin;
+    while (offset < end) {
+        ssize_t num_read = pread(fd_, data_ + offset, end - offset, static_cast<off_t>(offset));
+        if (num_read < 0 && errno == EINTR)
+            continue;
+        if (num_read <= 0) {
+            LOG(WARNING) << "Failed to read tile " << tile << " of " << file_path_;
+            return false;
+        }
+        offset += static_cast<size_t>(num_read);
+    }
+
+    return true;
+}
+
+} // namespace lidar_localization
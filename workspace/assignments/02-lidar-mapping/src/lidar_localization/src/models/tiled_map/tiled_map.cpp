@@ -0,0 +1,420 @@
+/*
+ * @Description: global map split into x-y tiles, loaded on demand
+ * @Author: Ge Yao
+ * @Date: 2020-12-14 20:17:52
+ */
+#include "lidar_localization/models/tiled_map/tiled_map.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <algorithm>
+
+#include <yaml-cpp/yaml.h>
+#include <pcl/io/pcd_io.h>
+
+#include "glog/logging.h"
+
+#include "lidar_localization/tools/file_manager.hpp"
+
+namespace lidar_localization {
+
+namespace {
+const int TILED_MAP_VERSION = 1;
+const std::string MAPPED_TILE_STORE_FILE_NAME = "tiles.bin";
+}
+
+bool TiledMap::Save(const std::string& tiles_path, const CloudData::CLOUD& map, float tile_size) {
+    if (tile_size <= 0.0f) {
+        LOG(ERROR) << "Invalid tile size " << tile_size;
+        return false;
+    }
+
+    if (!FileManager::InitDirectory(tiles_path, "Tiled Map"))
+        return false;
+
+    // bucket points by tile:
+    std::unordered_map<int64_t, CloudData::CLOUD> tiles;
+    for (const CloudData::POINT& point: map.points) {
+        int ix = static_cast<int>(std::floor(point.x / tile_size));
+        int iy = static_cast<int>(std::floor(point.y / tile_size));
+        tiles[GetTileKey(ix, iy)].push_back(point);
+    }
+
+    YAML::Node index;
+    index["version"] = TILED_MAP_VERSION;
+    index["tile_size"] = tile_size;
+    for (auto& tile: tiles) {
+        int ix = static_cast<int>(tile.first >> 32);
+        int iy = static_cast<int>(static_cast<int32_t>(tile.first & 0xffffffff));
+
+        if (pcl::io::savePCDFileBinary(tiles_path + "/" + GetTileFileName(ix, iy), tile.second) != 0) {
+            LOG(ERROR) << "Failed to save tile " << ix << "," << iy;
+            return false;
+        }
+
+        YAML::Node tile_node;
+        tile_node.push_back(ix);
+        tile_node.push_back(iy);
+        tile_node.push_back(tile.second.size());
+        index["tiles"].push_back(tile_node);
+    }
+
+    std::ofstream ofs(tiles_path + "/index.yaml");
+    ofs << index;
+    if (!ofs) {
+        LOG(ERROR) << "Failed to save tiled map index in " << tiles_path;
+        return false;
+    }
+
+    LOG(INFO) << "Saved tiled map, " << tiles.size() << " tiles, " << map.size() << " points.";
+
+    return true;
+}
+
+bool TiledMap::SaveMapped(const std::string& tiles_path) {
+    // the tile files in index order, which is the order of the points in tiles.bin:
+    TiledMap tiled_map(tiles_path, 0);
+    if (!tiled_map.IsValid())
+        return false;
+
+    std::vector<std::string> tile_file_paths(tiled_map.tile_indices_.size());
+    for (const auto& tile_index: tiled_map.tile_indices_) {
+        tile_file_paths.at(tile_index.second) = tiles_path + "/" + tiled_map.tile_files_.at(tile_index.first);
+    }
+
+    if (!MappedTileStore::Save(tiles_path + "/" + MAPPED_TILE_STORE_FILE_NAME, tile_file_paths))
+        return false;
+
+    LOG(INFO) << "Saved mapped tile store, " << tile_file_paths.size() << " tiles.";
+
+    return true;
+}
+
+TiledMap::TiledMap(
+    const std::string& tiles_path, size_t max_size_in_mb, 
+    bool is_mapped, MappedTileStore::HugePages huge_pages
+) : tiles_path_(tiles_path),
+    max_size_in_bytes_(max_size_in_mb << 20),
+    thread_(&TiledMap::Run, this) {
+    LoadIndex();
+    if (is_mapped && IsValid()) {
+        InitMappedStore(huge_pages);
+    }
+
+    std::cout << "Tiled Map params:" << std::endl
+              << "tiles path: " << tiles_path_ << ", "
+              << "tile size: " << tile_size_ << ", "
+              << "num. of tiles: " << tile_files_.size() << ", ";
+    if (mapped_store_ptr_) {
+        std::cout << "mapped, huge pages: " << MappedTileStore::GetHugePagesName(mapped_store_ptr_->GetHugePages());
+    } else {
+        std::cout << "max size in MB: " << max_size_in_mb;
+    }
+    std::cout << std::endl << std::endl;
+}
+
+TiledMap::~TiledMap() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    has_task_.notify_one();
+
+    thread_.join();
+}
+
+bool TiledMap::GetMap(const std::vector<float>& edge, CloudData::CLOUD_PTR& map_ptr) {
+    map_ptr.reset(new CloudData::CLOUD());
+
+    std::vector<int64_t> tile_keys;
+    GetTileKeys(edge, tile_keys);
+
+    // copied straight from the mapping, a tile being prefaulted is waited for by the store:
+    if (mapped_store_ptr_) {
+        for (int64_t tile_key: tile_keys) {
+            size_t num_points = 0;
+            bool was_resident = false;
+            const CloudData::POINT* points = mapped_store_ptr_->GetTile(
+                tile_indices_.at(tile_key), num_points, was_resident
+            );
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                queued_.erase(tile_key);
+                ++(was_resident ? stats_.num_hits : stats_.num_misses);
+            }
+
+            if (points != nullptr) {
+                map_ptr->insert(map_ptr->end(), points, points + num_points);
+            }
+        }
+
+        return !tile_keys.empty();
+    }
+
+    for (int64_t tile_key: tile_keys) {
+        CloudData::CLOUD::ConstPtr tile_ptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+
+            // a tile already being prefetched is waited for, a queued one is taken over:
+            has_loaded_.wait(lock, [this, tile_key]{ return !is_loading_ || loading_tile_key_ != tile_key; });
+            queued_.erase(tile_key);
+
+            auto it = entries_.find(tile_key);
+            if (it != entries_.end()) {
+                ++stats_.num_hits;
+                lru_.splice(lru_.begin(), lru_, it->second.lru_it);
+                tile_ptr = it->second.tile_ptr;
+            } else {
+                ++stats_.num_misses;
+            }
+        }
+
+        if (!tile_ptr) {
+            CloudData::CLOUD_PTR loaded_tile_ptr(new CloudData::CLOUD());
+            if (!LoadTile(tile_key, loaded_tile_ptr))
+                continue;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            Insert(tile_key, loaded_tile_ptr);
+            tile_ptr = loaded_tile_ptr;
+        }
+
+        *map_ptr += *tile_ptr;
+    }
+
+    return !tile_keys.empty();
+}
+
+void TiledMap::Prefetch(const std::vector<float>& edge) {
+    std::vector<int64_t> tile_keys;
+    GetTileKeys(edge, tile_keys);
+
+    bool has_new_task = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        for (int64_t tile_key: tile_keys) {
+            if (
+                (mapped_store_ptr_ ? mapped_store_ptr_->IsResident(tile_indices_.at(tile_key)) : entries_.count(tile_key) > 0) ||
+                queued_.count(tile_key) > 0 ||
+                (is_loading_ && loading_tile_key_ == tile_key)
+            ) {
+                continue;
+            }
+
+            queue_.push_back(tile_key);
+            queued_.insert(tile_key);
+            has_new_task = true;
+        }
+    }
+
+    if (has_new_task)
+        has_task_.notify_one();
+}
+
+void TiledMap::WillNeed(const std::vector<float>& edge) {
+    if (!mapped_store_ptr_)
+        return;
+
+    std::vector<int64_t> tile_keys;
+    GetTileKeys(edge, tile_keys);
+    for (int64_t tile_key: tile_keys) {
+        mapped_store_ptr_->WillNeed(tile_indices_.at(tile_key));
+    }
+}
+
+void TiledMap::GetCachedMap(CloudData::CLOUD_PTR& map_ptr) {
+    map_ptr.reset(new CloudData::CLOUD());
+
+    if (mapped_store_ptr_) {
+        std::vector<size_t> tiles;
+        mapped_store_ptr_->GetResidentTiles(tiles);
+        for (size_t tile: tiles) {
+            size_t num_points = 0;
+            bool was_resident = false;
+            const CloudData::POINT* points = mapped_store_ptr_->GetTile(tile, num_points, was_resident);
+            if (points != nullptr) {
+                map_ptr->insert(map_ptr->end(), points, points + num_points);
+            }
+        }
+
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& entry: entries_) {
+        *map_ptr += *entry.second.tile_ptr;
+    }
+}
+
+TiledMap::Stats TiledMap::GetStats(void) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    Stats stats = stats_;
+    if (mapped_store_ptr_) {
+        stats.num_tiles = mapped_store_ptr_->GetNumResidentTiles();
+        stats.size_in_bytes = mapped_store_ptr_->GetResidentSizeInBytes();
+    }
+
+    return stats;
+}
+
+int64_t TiledMap::GetTileKey(int ix, int iy) {
+    return (static_cast<int64_t>(ix) << 32) | static_cast<uint32_t>(iy);
+}
+
+std::string TiledMap::GetTileFileName(int ix, int iy) {
+    return "tile_" + std::to_string(ix) + "_" + std::to_string(iy) + ".pcd";
+}
+
+bool TiledMap::LoadIndex(void) {
+    std::string index_file_path = tiles_path_ + "/index.yaml";
+
+    YAML::Node index;
+    try {
+        index = YAML::LoadFile(index_file_path);
+    } catch (const YAML::Exception &e) {
+        LOG(ERROR) << "Failed to load tiled map index " << index_file_path << ": " << e.what();
+        return false;
+    }
+
+    if (index["version"].as<int>() != TILED_MAP_VERSION) {
+        LOG(ERROR) << "Unsupported tiled map version " << index["version"].as<int>() << " in " << index_file_path;
+        return false;
+    }
+
+    for (const YAML::Node& tile_node: index["tiles"]) {
+        int ix = tile_node[0].as<int>();
+        int iy = tile_node[1].as<int>();
+        tile_files_.emplace(GetTileKey(ix, iy), GetTileFileName(ix, iy));
+        tile_indices_.emplace(GetTileKey(ix, iy), tile_num_points_.size());
+        tile_num_points_.push_back(tile_node[2].as<size_t>());
+    }
+    tile_size_ = index["tile_size"].as<float>();
+
+    return true;
+}
+
+bool TiledMap::InitMappedStore(MappedTileStore::HugePages huge_pages) {
+    const std::string file_path = tiles_path_ + "/" + MAPPED_TILE_STORE_FILE_NAME;
+
+    mapped_store_ptr_ = std::make_shared<MappedTileStore>(file_path, tile_num_points_, huge_pages);
+    if (mapped_store_ptr_->IsValid())
+        return true;
+
+    // maps tiled before the store existed, or tiled again since:
+    LOG(INFO) << "Packing the tiles of " << tiles_path_ << " into " << file_path << "...";
+    mapped_store_ptr_.reset();
+    if (SaveMapped(tiles_path_)) {
+        mapped_store_ptr_ = std::make_shared<MappedTileStore>(file_path, tile_num_points_, huge_pages);
+        if (mapped_store_ptr_->IsValid())
+            return true;
+    }
+
+    LOG(ERROR) << "Mapped tile store is not available, tiles are loaded from " << tiles_path_;
+    mapped_store_ptr_.reset();
+
+    return false;
+}
+
+void TiledMap::GetTileKeys(const std::vector<float>& edge, std::vector<int64_t>& tile_keys) const {
+    tile_keys.clear();
+    if (!IsValid())
+        return;
+
+    int min_ix = static_cast<int>(std::floor(edge.at(0) / tile_size_));
+    int max_ix = static_cast<int>(std::floor(edge.at(1) / tile_size_));
+    int min_iy = static_cast<int>(std::floor(edge.at(2) / tile_size_));
+    int max_iy = static_cast<int>(std::floor(edge.at(3) / tile_size_));
+
+    for (int ix = min_ix; ix <= max_ix; ++ix) {
+        for (int iy = min_iy; iy <= max_iy; ++iy) {
+            int64_t tile_key = GetTileKey(ix, iy);
+            if (tile_files_.count(tile_key) > 0)
+                tile_keys.push_back(tile_key);
+        }
+    }
+}
+
+bool TiledMap::LoadTile(int64_t tile_key, CloudData::CLOUD_PTR& tile_ptr) {
+    std::string tile_file_path = tiles_path_ + "/" + tile_files_.at(tile_key);
+
+    if (pcl::io::loadPCDFile(tile_file_path, *tile_ptr) != 0) {
+        LOG(WARNING) << "Failed to load map tile " << tile_file_path;
+        return false;
+    }
+
+    return true;
+}
+
+void TiledMap::Insert(int64_t tile_key, const CloudData::CLOUD::ConstPtr& tile_ptr) {
+    if (entries_.count(tile_key) > 0)
+        return;
+
+    lru_.push_front(tile_key);
+
+    Entry entry;
+    entry.tile_ptr = tile_ptr;
+    entry.size_in_bytes = tile_ptr->points.size() * sizeof(CloudData::POINT);
+    entry.lru_it = lru_.begin();
+    entries_.emplace(tile_key, entry);
+
+    ++stats_.num_tiles;
+    stats_.size_in_bytes += entry.size_in_bytes;
+
+    Evict();
+}
+
+void TiledMap::Evict(void) {
+    // always keep the tile just inserted, even if it alone exceeds the budget:
+    while (stats_.size_in_bytes > max_size_in_bytes_ && lru_.size() > 1) {
+        auto it = entries_.find(lru_.back());
+
+        --stats_.num_tiles;
+        stats_.size_in_bytes -= it->second.size_in_bytes;
+
+        entries_.erase(it);
+        lru_.pop_back();
+    }
+}
+
+void TiledMap::Run(void) {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        has_task_.wait(lock, [this]{ return stop_ || !queue_.empty(); });
+        // prefetching is best effort, pending tiles are dropped on exit:
+        if (stop_)
+            break;
+
+        int64_t tile_key = queue_.front();
+        queue_.pop_front();
+        if (queued_.erase(tile_key) == 0 || entries_.count(tile_key) > 0)
+            continue;
+
+        is_loading_ = true;
+        loading_tile_key_ = tile_key;
+
+        lock.unlock();
+        CloudData::CLOUD_PTR tile_ptr(new CloudData::CLOUD());
+        bool is_loaded = (
+            mapped_store_ptr_ ? 
+            mapped_store_ptr_->Prefault(tile_indices_.at(tile_key)) : 
+            LoadTile(tile_key, tile_ptr)
+        );
+        lock.lock();
+
+        is_loading_ = false;
+        if (is_loaded) {
+            if (!mapped_store_ptr_) {
+                Insert(tile_key, tile_ptr);
+            }
+            ++stats_.num_prefetched;
+        }
+        has_loaded_.notify_all();
+    }
+}
+
+} // namespace lidar_localization
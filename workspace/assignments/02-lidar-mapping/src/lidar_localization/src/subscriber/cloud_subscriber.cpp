@@ -5,6 +5,7 @@
  */
 
 #include "lidar_localization/subscriber/cloud_subscriber.hpp"
+#include "lidar_localization/tools/cloud_pool.hpp"
 
 #include "glog/logging.h"
 
@@ -18,7 +19,7 @@ void CloudSubscriber::msg_callback(const sensor_msgs::PointCloud2::ConstPtr& clo
     buff_mutex_.lock();
 
     // convert ROS PointCloud2 to pcl::PointCloud<pcl::PointXYZ>:
-    CloudData cloud_data;
+    CloudData cloud_data(CloudPool::GetInstance().Get());
     cloud_data.time = cloud_msg_ptr->header.stamp.toSec();
     pcl::fromROSMsg(*cloud_msg_ptr, *(cloud_data.cloud_ptr));
     // add new message to buffer:
@@ -0,0 +1,90 @@
+/*
+ * @Description: process-wide pool of per-frame point clouds, recycled with their point storage
+ * @Author: Ge Yao
+ * @Date: 2020-12-28 09:12:45
+ */
+#include "lidar_localization/tools/cloud_pool.hpp"
+
+namespace lidar_localization {
+
+namespace {
+// about the clouds in flight across the flows of one process:
+const size_t MAX_NUM_FREE_CLOUDS = 64;
+// a few HDL-64 sweeps, larger clouds are maps and are not kept:
+const size_t MAX_NUM_POOLED_POINTS = 1 << 20;
+}
+
+CloudPool::FreeList::~FreeList() {
+    for (CloudData::CLOUD* cloud: clouds) {
+        delete cloud;
+    }
+}
+
+CloudPool& CloudPool::GetInstance(void) {
+    static CloudPool instance;
+
+    return instance;
+}
+
+CloudPool::CloudPool()
+    : free_list_ptr_(std::make_shared<FreeList>()) {
+}
+
+CloudData::CLOUD_PTR CloudPool::Get(void) {
+    CloudData::CLOUD* cloud = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(free_list_ptr_->mutex);
+        if (!free_list_ptr_->clouds.empty()) {
+            cloud = free_list_ptr_->clouds.back();
+            free_list_ptr_->clouds.pop_back();
+        }
+    }
+
+    if (cloud) {
+        num_reused_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        cloud = new CloudData::CLOUD();
+        num_allocated_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::weak_ptr<FreeList> free_list_ptr = free_list_ptr_;
+    return CloudData::CLOUD_PTR(
+        cloud,
+        [free_list_ptr](CloudData::CLOUD* cloud) { Release(free_list_ptr, cloud); }
+    );
+}
+
+size_t CloudPool::GetNumFreeClouds(void) {
+    std::lock_guard<std::mutex> lock(free_list_ptr_->mutex);
+
+    return free_list_ptr_->clouds.size();
+}
+
+void CloudPool::Release(const std::weak_ptr<FreeList>& free_list_ptr, CloudData::CLOUD* cloud) {
+    std::shared_ptr<FreeList> free_list = free_list_ptr.lock();
+    if (!free_list || cloud->points.capacity() > MAX_NUM_POOLED_POINTS) {
+        delete cloud;
+        return;
+    }
+
+    // same as a new cloud, except for the capacity:
+    cloud->points.clear();
+    cloud->header = pcl::PCLHeader();
+    cloud->width = 0;
+    cloud->height = 0;
+    cloud->is_dense = true;
+    cloud->sensor_origin_ = Eigen::Vector4f::Zero();
+    cloud->sensor_orientation_ = Eigen::Quaternionf::Identity();
+
+    {
+        std::lock_guard<std::mutex> lock(free_list->mutex);
+        if (free_list->clouds.size() < MAX_NUM_FREE_CLOUDS) {
+            free_list->clouds.push_back(cloud);
+            return;
+        }
+    }
+
+    delete cloud;
+}
+
+} // namespace lidar_localization
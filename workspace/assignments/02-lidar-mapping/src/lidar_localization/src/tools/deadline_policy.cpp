@@ -0,0 +1,85 @@
+/*
+ * @Description: load shedding decisions of a flow, to keep its output latency bounded on a busy CPU
+ * @Author: Ge Yao
+ * @Date: 2020-12-30 15:32:09
+ */
+#include "lidar_localization/tools/deadline_policy.hpp"
+
+#include <iostream>
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+namespace {
+// weight of the latest processing time:
+const double SMOOTHING_FACTOR = 0.2;
+}
+
+DeadlinePolicy::DeadlinePolicy(const YAML::Node& node, int num_levels) {
+    // without a config block the flow runs at full quality:
+    if (node) {
+        enabled_ = node["enabled"].as<bool>();
+        max_delay_ = node["max_delay"].as<double>();
+        processing_budget_ = node["processing_budget"].as<double>();
+        min_dwell_ = node["min_dwell"].as<int>();
+    }
+    num_levels_ = num_levels;
+
+    std::cout << "Deadline Policy params:" << std::endl
+              << "\tenabled: " << (enabled_ ? "true" : "false") << std::endl
+              << "\tmax. delay: " << max_delay_ << std::endl
+              << "\tprocessing budget: " << processing_budget_ << std::endl
+              << "\tmin. dwell: " << min_dwell_ << std::endl
+              << "\tnum. levels: " << num_levels_ << std::endl
+              << std::endl;
+}
+
+bool DeadlinePolicy::IsStale(double time, double latest_time) {
+    if (!enabled_ || latest_time - time <= max_delay_)
+        return false;
+
+    ++stats_.num_stale;
+
+    return true;
+}
+
+bool DeadlinePolicy::Update(double processing_time) {
+    if (!enabled_)
+        return false;
+
+    if (level_ > 0) {
+        ++stats_.num_degraded;
+    }
+
+    if (has_processing_time_) {
+        smoothed_processing_time_ = SMOOTHING_FACTOR * processing_time + (1.0 - SMOOTHING_FACTOR) * smoothed_processing_time_;
+    } else {
+        smoothed_processing_time_ = processing_time;
+        has_processing_time_ = true;
+    }
+    if (++dwell_ < min_dwell_)
+        return false;
+
+    int level = level_;
+    if (smoothed_processing_time_ > processing_budget_ && level_ < num_levels_) {
+        ++level;
+        ++stats_.num_level_ups;
+    } else if (smoothed_processing_time_ < 0.5 * processing_budget_ && level_ > 0) {
+        --level;
+        ++stats_.num_level_downs;
+    } else {
+        return false;
+    }
+
+    LOG(INFO) << "Load level " << level_ << " -> " << level 
+              << ", smoothed processing time " << smoothed_processing_time_ << " s, "
+              << stats_.num_stale << " stale, "
+              << stats_.num_degraded << " degraded measurements so far";
+    level_ = level;
+    dwell_ = 0;
+
+    return true;
+}
+
+} // namespace lidar_localization
@@ -7,11 +7,13 @@
 #include <map>
 
 #include <sensor_msgs/Imu.h>
+#include <std_msgs/Float64MultiArray.h>
 #include <boost/thread/thread.hpp>
 
 #include "node_constants.h"
 
 #include "allan_variance.h"
+#include "power_spectral_density.h"
 
 
 namespace imu {
@@ -28,14 +30,24 @@ struct Config {
 
     int min_collection_time_in_mins;
     int max_num_clusters;
+    bool streaming;
+    double streaming_publish_interval_in_secs;
+
+    // welch PSD estimate next to the allan variance one, as <output_filename>_psd.json:
+    bool psd;
+    int psd_segment_length;
+    int psd_max_num_bands;
 };
 
 struct State {
     double timestamp_start;
+    double timestamp_published;
     allan_variance::AllanVariance estimator;
+    power_spectral_density::PowerSpectralDensity psd_estimator;
+    bool psd_estimated;
     boost::thread* thread;
 
-    State(std::string name, int max_num_clusters) : estimator(false, name, max_num_clusters), thread(nullptr){}
+    State(std::string name, int max_num_clusters, int segment_length) : timestamp_start(-1.0), timestamp_published(-1.0), estimator(false, name, max_num_clusters), psd_estimator(false, name, segment_length), psd_estimated(false), thread(nullptr){}
 };
 
 class Activity {
@@ -48,7 +60,10 @@ public:
     void DoEstimate(void);
     void WriteResults(void); 
 private:
+    void PublishCurveObserved(void);
+
     ros::NodeHandle private_nh_;
+    ros::Publisher curve_pub_;
 
     Config config_;
     State state_;
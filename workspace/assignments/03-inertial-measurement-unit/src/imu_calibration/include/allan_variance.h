@@ -25,6 +25,8 @@ struct Config {
     bool debug_mode;
     std::string name;
     int max_num_clusters;
+    // keep octave accumulators instead of all observations:
+    bool streaming;
 };
 
 enum Field {
@@ -55,14 +57,42 @@ struct Curve {
     std::vector<Point> point;
 };
 
+/*
+    streaming accumulator of one octave, cluster size 2^level
+ */
+struct Octave {
+    // number of completed clusters:
+    size_t num_clusters;
+    double last_average[NUM_FIELDS];
+    double sum_squared_difference[NUM_FIELDS];
+
+    // first half of the pending cluster of the next octave:
+    bool has_pending;
+    double pending_sum[NUM_FIELDS];
+
+    Octave() : num_clusters(0), has_pending(false) {
+        for (int field = 0; field < NUM_FIELDS; ++field) {
+            last_average[field] = sum_squared_difference[field] = pending_sum[field] = 0.0;
+        }
+    }
+};
+
 /*
     estimator state
  */
 struct State {
     double tau;
 
+    size_t num_observations;
+    double time_first;
+    double time_last;
+
     std::vector<Data> data;
-    std::map<Field, std::vector<double>> theta; 
+    // streaming mode only, index is the octave level:
+    std::vector<Octave> octave;
+    // integrated observations, field-major so that each field is contiguous:
+    // theta[field * data.size() + k]
+    std::vector<double> theta;
     
     std::vector<int> averaging_factor;
     size_t num_clusters_built;
@@ -71,13 +101,12 @@ struct State {
     State() {
         tau = 0.0;
 
+        num_observations = 0;
+        time_first = time_last = -1.0;
+
         data.clear();
-        // initialize theta:
-        for (int field = WX; field < NUM_FIELDS; ++field) {
-            theta.insert(
-                std::map<Field, std::vector<double>>::value_type (static_cast<Field>(field), std::vector<double>())
-            );
-        }
+        octave.clear();
+        theta.clear();
 
         // initialize curve:
         averaging_factor.clear();
@@ -88,11 +117,12 @@ struct State {
     void Reset(void) {
         tau = 0.0;
 
+        num_observations = 0;
+        time_first = time_last = -1.0;
+
         data.clear();
-        // reset theta:
-        for (int field = WX; field < NUM_FIELDS; ++field) {
-            theta.at(static_cast<Field>(field)).clear();
-        }
+        octave.clear();
+        theta.clear();
 
         // reset curve:
         averaging_factor.clear();
@@ -200,12 +230,15 @@ public:
     void SetDebugMode(bool debug_mode) { config_.debug_mode = debug_mode; }
     void SetName(std::string name) { config_.name = name; }
     void SetMaxNumClusters(int max_num_clusters) { config_.max_num_clusters = max_num_clusters; }
+    // must be set before the first observation is added:
+    void SetStreaming(bool streaming) { config_.streaming = streaming; }
 
     // get latest observation timestamp:
     double GetT(void) { 
-        if (state_.data.empty()) { return -1.0; }
-        return state_.data.back().time; 
+        return state_.time_last; 
     }
+    // streaming mode only, allan variance curve of the observations so far:
+    const Curve &GetCurveObserved(void);
     // get allan variance curve building progress:
     double GetAllanCurveBuildingProgress(void) {
         return 100.0 * state_.num_clusters_built / state_.averaging_factor.size();
@@ -233,6 +266,10 @@ private:
     void SetStateAveragingFactor(void);
     void SetStateCurveObserved(void);
     void SetState(void);
+    // streaming mode:
+    void AddToOctaves(const double *value);
+    void SetStateTau(void);
+    void SetStateCurveObservedFromOctaves(void);
 
     double GetCovariance(Field field, const double &tau);
     // fast estimate using least square:
@@ -0,0 +1,99 @@
+#ifndef IMU_CALIBRATOR_BATCH_ACTIVITY_H
+#define IMU_CALIBRATOR_BATCH_ACTIVITY_H
+
+#include <ros/ros.h>
+
+#include <string>
+#include <vector>
+
+#include "allan_variance.h"
+#include "power_spectral_density.h"
+
+
+namespace imu {
+
+namespace calibrator {
+
+/*
+    binary IMU log, one file per device named <device_name>.bin,
+    records of 7 little-endian doubles:
+    time [s], angular velocity x y z [rad/s], linear acceleration x y z [m/s^2]
+ */
+constexpr char kIMULogExtension[] = ".bin";
+constexpr int kIMULogRecordSize = 7;
+
+struct BatchConfig {
+    bool debug_mode;
+
+    std::string log_dir;
+    std::string output_dir;
+    // devices calibrated at the same time, hardware concurrency if not positive:
+    int max_num_threads;
+
+    int min_collection_time_in_mins;
+    int max_num_clusters;
+    bool streaming;
+
+    bool psd;
+    int psd_segment_length;
+    int psd_max_num_bands;
+};
+
+struct BatchResult {
+    std::string device_name;
+    std::string status;
+
+    size_t num_observations;
+    double duration_in_mins;
+    // wall time of estimation & curve fitting:
+    double time_consumption_in_secs;
+
+    double measurement_noise[allan_variance::NUM_FIELDS];
+    double random_walk[allan_variance::NUM_FIELDS];
+    double bias_instability[allan_variance::NUM_FIELDS];
+
+    // welch PSD estimate, if enabled. wall time of the spectrum fit only, the FFTs run while loading:
+    bool psd_estimated;
+    double psd_time_consumption_in_secs;
+
+    double psd_measurement_noise[allan_variance::NUM_FIELDS];
+    double psd_random_walk[allan_variance::NUM_FIELDS];
+    double psd_bias_instability[allan_variance::NUM_FIELDS];
+
+    BatchResult() : num_observations(0), duration_in_mins(0.0), time_consumption_in_secs(0.0), psd_estimated(false), psd_time_consumption_in_secs(0.0) {
+        for (int field = allan_variance::WX; field < allan_variance::NUM_FIELDS; ++field) {
+            measurement_noise[field] = random_walk[field] = bias_instability[field] = 0.0;
+            psd_measurement_noise[field] = psd_random_walk[field] = psd_bias_instability[field] = 0.0;
+        }
+    }
+};
+
+/*
+    calibrate a fleet of IMUs from their binary logs in one run, devices in parallel
+ */
+class BatchActivity {
+public:
+    BatchActivity();
+    ~BatchActivity();
+
+    void Init(void);
+    // number of devices failed, -1 if the logs cannot be listed:
+    int Run(void);
+    // combined report, <output_dir>/fleet_calibration.json:
+    void WriteResults(void);
+private:
+    bool ListLogs(void);
+    void Calibrate(BatchResult &result, const std::string &log_path);
+
+    ros::NodeHandle private_nh_;
+
+    BatchConfig config_;
+    std::vector<std::string> log_path_;
+    std::vector<BatchResult> result_;
+};
+
+}  // namespace calibrator
+
+}  // namespace imu
+
+#endif  // IMU_CALIBRATOR_BATCH_ACTIVITY_H
@@ -9,6 +9,8 @@ namespace calibrator {
     constexpr char kCalibrateIMUActionName[] = "/imu/calibrator/action";
     // services:
     constexpr char kGetIMUCalibrationResults[] = "/imu/calibrator/get_results";
+    // topics:
+    constexpr char kAllanVarianceCurveTopicName[] = "/imu/calibrator/allan_variance_curve";
 } // namespace calibrator
 
 } // namespace imu
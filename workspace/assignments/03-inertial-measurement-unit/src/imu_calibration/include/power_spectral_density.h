@@ -0,0 +1,208 @@
+#ifndef IMU_CALIBRATOR_POWER_SPECTRAL_DENSITY_H
+#define IMU_CALIBRATOR_POWER_SPECTRAL_DENSITY_H
+
+#include <math.h>
+#include <string>
+#include <vector>
+#include <complex>
+
+#include <geometry_msgs/Vector3.h>
+
+#include "allan_variance.h"
+
+namespace imu {
+
+namespace calibrator {
+
+namespace power_spectral_density {
+
+using allan_variance::Field;
+using allan_variance::WX;
+using allan_variance::WY;
+using allan_variance::WZ;
+using allan_variance::AX;
+using allan_variance::AY;
+using allan_variance::AZ;
+using allan_variance::NUM_FIELDS;
+
+/*
+    estimator configuration
+ */
+struct Config {
+    bool debug_mode;
+    std::string name;
+    // samples per welch segment, rounded up to a power of 2.
+    // the lowest frequency resolved is 1 / (segment_length * tau):
+    int segment_length;
+    // log-spaced frequency bands the periodogram is averaged into before fitting:
+    int max_num_bands;
+};
+
+/*
+    two-sided power spectral density at positive frequencies, averaged over a frequency band
+ */
+struct Point {
+    double frequency;
+    double density[NUM_FIELDS];
+    // periodogram bins averaged:
+    size_t num_bins;
+};
+
+struct Curve {
+    std::vector<Point> point;
+};
+
+/*
+    estimator state, bounded by the segment length whatever the test duration
+ */
+struct State {
+    double tau;
+
+    size_t num_observations;
+    double time_first;
+    double time_last;
+
+    // observations of the pending segment, field-major:
+    // segment[field * segment_length + k]
+    std::vector<double> segment;
+    size_t segment_size;
+
+    // sum of the periodograms of the completed segments, field-major:
+    // periodogram_sum[field * (segment_length / 2 + 1) + k]
+    size_t num_segments;
+    std::vector<double> periodogram_sum;
+
+    Curve curve_observed;
+
+    State() {
+        Reset();
+    }
+
+    void Reset(void) {
+        tau = 0.0;
+
+        num_observations = 0;
+        time_first = time_last = -1.0;
+
+        segment.clear();
+        segment_size = 0;
+
+        num_segments = 0;
+        periodogram_sum.clear();
+
+        curve_observed.point.clear();
+    }
+};
+
+struct Params {
+    // number of observations:
+    size_t num_observations;
+    // number of welch segments:
+    size_t num_segments;
+
+    // angle random walk, white noise floor S(f) = N^2:
+    double N[NUM_FIELDS];
+    // bias instability, flicker noise S(f) = B^2 / (2 pi f):
+    double B[NUM_FIELDS];
+    // rate random walk, S(f) = K^2 / (2 pi f)^2:
+    double K[NUM_FIELDS];
+
+    Curve curve_smoothed;
+
+    // same definitions as the allan variance result, so that both can be compared directly:
+    double measurement_noise[NUM_FIELDS];
+    double random_walk[NUM_FIELDS];
+    double bias_instability[NUM_FIELDS];
+
+    void Reset(void) {
+        num_observations = num_segments = 0;
+
+        for (int field = WX; field < NUM_FIELDS; ++field) {
+            N[field] = B[field] = K[field] = 0.0;
+            measurement_noise[field] = random_walk[field] = bias_instability[field] = 0.0;
+        }
+
+        curve_smoothed.point.clear();
+    }
+};
+
+/*
+    fast noise characterization with welch's method, O(N log N) per axis:
+    hann windowed segments with 50% overlap are transformed as they are filled,
+    so a day-long log is estimated in seconds and in the memory of a single segment.
+    complements, not replaces, the allan variance analysis -- a quick check of the white noise floor
+    and of the low frequency terms before the full curve is built
+ */
+class PowerSpectralDensity {
+public:
+    PowerSpectralDensity(bool debug_mode, std::string name, int segment_length);
+    ~PowerSpectralDensity(void);
+
+    void Reset(void);
+    void Add(
+        double time,
+        const geometry_msgs::Vector3 &angular_velocity,
+        const geometry_msgs::Vector3 &linear_acceleration
+    );
+    // false if not a single segment has been completed:
+    bool Estimate(void);
+
+    void SetDebugMode(bool debug_mode) { config_.debug_mode = debug_mode; }
+    void SetName(std::string name) { config_.name = name; }
+    // must be set before the first observation is added:
+    void SetSegmentLength(int segment_length);
+    void SetMaxNumBands(int max_num_bands) { config_.max_num_bands = max_num_bands; }
+
+    // get latest observation timestamp:
+    double GetT(void) {
+        return state_.time_last;
+    }
+    // get angle random walk:
+    double GetN(Field field) { return params_.N[field]; }
+    // get bias instability:
+    double GetB(Field field) { return params_.B[field]; }
+    // get rate random walk:
+    double GetK(Field field) { return params_.K[field]; }
+    // get measurement noise:
+    double GetMeasurementNoise(Field field) { return params_.measurement_noise[field]; }
+    // get random walk:
+    double GetRandomWalk(Field field) { return params_.random_walk[field]; }
+    // get bias instability:
+    double GetBiasInstability(Field field) { return params_.bias_instability[field]; }
+
+    // show IMU params, as <output_filename>_psd.json & the spectrum as <output_filename>_psd.csv:
+    void WriteIMUCalibrationResult(const std::string &output_filename);
+private:
+    // welch:
+    void SetStateWindow(void);
+    void AddSegment(void);
+    void FFT(std::vector<std::complex<double>> &x) const;
+    void SetStateTau(void);
+    void SetStateCurveObserved(void);
+
+    // fit of S(f) = N^2 + B^2 / (2 pi f) + K^2 / (2 pi f)^2 over the bands:
+    void SetParamsNoiseTerms(void);
+    void SetParamsCurveSmoothed(void);
+    void SetParamsMeasurementNoise(void);
+    void SetParamsRandomWalk(void);
+    void SetParamsBiasInstability(void);
+    void SetParams(void);
+
+    Config config_;
+    State state_;
+    Params params_;
+
+    // hann window & its power, sum of w^2:
+    std::vector<double> window_;
+    double window_power_;
+    // FFT twiddle factors, exp(-2 pi i k / segment_length):
+    std::vector<std::complex<double>> twiddle_;
+};
+
+}  // namespace power_spectral_density
+
+}  // namespace calibrator
+
+}  // namespace imu
+
+#endif  // IMU_CALIBRATOR_POWER_SPECTRAL_DENSITY_H
@@ -6,7 +6,7 @@ namespace calibrator {
 
 Activity::Activity()
     : private_nh_("~"),
-    state_("VIO_IMU", 10000) {
+    state_("VIO_IMU", 10000, 65536) {
 }
 
 Activity::~Activity() {}
@@ -21,6 +21,11 @@ void Activity::Init(void) {
     private_nh_.param("imu/allan_variance_curve/output_filename", config_.output_filename, std::string("."));
     private_nh_.param("imu/allan_variance_curve/min_collection_time_in_mins", config_.min_collection_time_in_mins, 120);
     private_nh_.param("imu/allan_variance_curve/max_num_clusters", config_.max_num_clusters, 10000);
+    private_nh_.param("imu/allan_variance_curve/streaming", config_.streaming, false);
+    private_nh_.param("imu/allan_variance_curve/streaming_publish_interval_in_secs", config_.streaming_publish_interval_in_secs, 60.0);
+    private_nh_.param("imu/power_spectral_density/enable", config_.psd, false);
+    private_nh_.param("imu/power_spectral_density/segment_length", config_.psd_segment_length, 65536);
+    private_nh_.param("imu/power_spectral_density/max_num_bands", config_.psd_max_num_bands, 100);
 
     if (config_.debug_mode) {
         ROS_WARN(
@@ -38,6 +43,17 @@ void Activity::Init(void) {
     state_.estimator.SetDebugMode(config_.debug_mode);
     state_.estimator.SetName(config_.device_name);
     state_.estimator.SetMaxNumClusters(config_.max_num_clusters);
+    state_.estimator.SetStreaming(config_.streaming);
+
+    state_.psd_estimator.SetDebugMode(config_.debug_mode);
+    state_.psd_estimator.SetName(config_.device_name);
+    state_.psd_estimator.SetSegmentLength(config_.psd_segment_length);
+    state_.psd_estimator.SetMaxNumBands(config_.psd_max_num_bands);
+
+    if (config_.streaming) {
+        ros::NodeHandle nh;
+        curve_pub_ = nh.advertise<std_msgs::Float64MultiArray>(kAllanVarianceCurveTopicName, 10, true);
+    }
 }
 
 void Activity::AddMeasurement(const sensor_msgs::ImuConstPtr &msg) {
@@ -46,6 +62,7 @@ void Activity::AddMeasurement(const sensor_msgs::ImuConstPtr &msg) {
     
     if (state_.timestamp_start < 0.0) {
         state_.timestamp_start = time;
+        state_.timestamp_published = time;
     }
 
     // add IMU record:
@@ -54,9 +71,53 @@ void Activity::AddMeasurement(const sensor_msgs::ImuConstPtr &msg) {
         msg->angular_velocity,
         msg->linear_acceleration
     );
+    if (config_.psd) {
+        state_.psd_estimator.Add(time, msg->angular_velocity, msg->linear_acceleration);
+    }
+
+    // intermediate curve, to watch convergence and stop a long test early:
+    if (config_.streaming && time - state_.timestamp_published >= config_.streaming_publish_interval_in_secs) {
+        state_.timestamp_published = time;
+        PublishCurveObserved();
+    }
+}
+
+void Activity::PublishCurveObserved(void) {
+    const allan_variance::Curve &curve = state_.estimator.GetCurveObserved();
+
+    // one row per cluster size: tau, gyro_x, gyro_y, gyro_z, acc_x, acc_y, acc_z
+    const int num_columns = allan_variance::NUM_FIELDS + 1;
+    std_msgs::Float64MultiArray msg;
+    msg.layout.dim.resize(2);
+    msg.layout.dim[0].label = "cluster";
+    msg.layout.dim[0].size = curve.point.size();
+    msg.layout.dim[0].stride = curve.point.size() * num_columns;
+    msg.layout.dim[1].label = "tau_covariance";
+    msg.layout.dim[1].size = num_columns;
+    msg.layout.dim[1].stride = num_columns;
+
+    msg.data.reserve(curve.point.size() * num_columns);
+    for (const allan_variance::Point &point: curve.point) {
+        msg.data.push_back(point.tau);
+        for (int field = allan_variance::WX; field < allan_variance::NUM_FIELDS; ++field) {
+            msg.data.push_back(point.covariance[field]);
+        }
+    }
+    curve_pub_.publish(msg);
+
+    ROS_INFO(
+        "[IMU Calibration]: %.1f mins collected, allan variance curve up to tau %.1f s",
+        (state_.estimator.GetT() - state_.timestamp_start) / 60.0,
+        curve.point.empty() ? 0.0 : curve.point.back().tau
+    );
 }
 
 void Activity::DoEstimate(void) {
+    // fast estimate first, available in seconds whatever the test duration:
+    if (config_.psd) {
+        state_.psd_estimated = state_.psd_estimator.Estimate();
+    }
+
     // estimate:
     state_.estimator.Estimate();
 }
@@ -64,6 +125,10 @@ void Activity::DoEstimate(void) {
 void Activity::WriteResults(void) {
     // write results as json file:
     state_.estimator.WriteIMUCalibrationResult(config_.output_filename);
+
+    if (state_.psd_estimated) {
+        state_.psd_estimator.WriteIMUCalibrationResult(config_.output_filename);
+    }
 }
 
 }  // namespace calibrator
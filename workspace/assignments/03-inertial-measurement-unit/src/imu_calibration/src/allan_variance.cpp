@@ -23,6 +23,7 @@ AllanVariance::AllanVariance(bool debug_mode, std::string name, int max_num_clus
     config_.debug_mode = debug_mode;
     config_.name = name;
     config_.max_num_clusters = max_num_clusters;
+    config_.streaming = false;
 
     Reset();
 }
@@ -47,13 +48,28 @@ void AllanVariance::Add(
         }
     };
 
+    if (state_.num_observations == 0) {
+        state_.time_first = time;
+    }
+    state_.time_last = time;
+    ++state_.num_observations;
+
     // add observation:
-    state_.data.push_back(data);
+    if (config_.streaming) {
+        AddToOctaves(data.value);
+    } else {
+        state_.data.push_back(data);
+    }
 }
 
 void AllanVariance::Estimate(void) {
     // set state:
-    SetState();
+    if (config_.streaming) {
+        SetStateTau();
+        SetStateCurveObservedFromOctaves();
+    } else {
+        SetState();
+    }
 
     // set params:
     SetParams();
@@ -157,54 +173,54 @@ void AllanVariance::SetStateCurveObserved(void) {
     }
 
     // reset:
-    state_.curve_observed.point.clear();
+    const int num_factors = state_.averaging_factor.size();
+    state_.curve_observed.point.resize(num_factors);
 
     // calculate:
-    size_t N = state_.data.size();
-    double covariance[NUM_FIELDS] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    const size_t N = state_.data.size();
+    const double *theta_data = state_.theta.data();
 
-    for (const int &factor: state_.averaging_factor) {
+    // averaging factors are independent, large ones are cheaper so hand them out dynamically:
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_factors; ++i) {
+        const int factor  = state_.averaging_factor.at(i);
         double tau        = factor * state_.tau;
         double normalizer = 2*(tau*tau)*(N - (factor << 1));
         int upper_bound   = N - (factor << 1);
 
-        for (int field = WX; field < NUM_FIELDS; ++field) {
-            covariance[field] = 0.0;
-        }
+        Point &point = state_.curve_observed.point.at(i);
+        point.tau = tau;
 
-        for (int k = 0; k < upper_bound; k++)
-        {
-            for (int field = WX; field < NUM_FIELDS; ++field) {
-                const std::vector<double> &theta = state_.theta.at(static_cast<Field>(field));
+        // one contiguous pass per field, vectorized over k:
+        for (int field = WX; field < NUM_FIELDS; ++field) {
+            const double *theta = theta_data + field * N;
 
-                double deviation = theta.at(k + (factor << 1)) - 2*theta.at(k + factor) + theta.at(k);
+            double covariance = 0.0;
+            #pragma omp simd reduction(+:covariance)
+            for (int k = 0; k < upper_bound; k++)
+            {
+                double deviation = theta[k + (factor << 1)] - 2*theta[k + factor] + theta[k];
 
-                covariance[field] += deviation * deviation;
+                covariance += deviation * deviation;
             }
-        }
 
-        for (int field = WX; field < NUM_FIELDS; ++field) {
-            covariance[field] /= normalizer;
+            point.covariance[field] = covariance / normalizer;
         }
 
-        // add record:
-        Point point = {
-            tau, 
-            {
-                covariance[WX], covariance[WY], covariance[WZ],
-                covariance[AX], covariance[AY], covariance[AZ]
-            }  
-        };
-        state_.curve_observed.point.push_back(point);
-
         // update progress:
+        #pragma omp atomic
         ++state_.num_clusters_built;
+    }
 
-        if (config_.debug_mode) {
+    if (config_.debug_mode) {
+        for (int i = 0; i < num_factors; ++i) {
+            const int factor = state_.averaging_factor.at(i);
+            const Point &point = state_.curve_observed.point.at(i);
             ROS_WARN(
-                "[IMU Calibration]: SetStateCurveObserved: %d--%f--%f--%d, %f %f %f %f %f %f",
-                factor, tau, normalizer, upper_bound,
-                covariance[WX], covariance[WY], covariance[WZ], covariance[AX], covariance[AY], covariance[AZ]
+                "[IMU Calibration]: SetStateCurveObserved: %d--%f--%d, %f %f %f %f %f %f",
+                factor, point.tau, (int)(N - (factor << 1)),
+                point.covariance[WX], point.covariance[WY], point.covariance[WZ], 
+                point.covariance[AX], point.covariance[AY], point.covariance[AZ]
             );
         }
     }
@@ -216,22 +232,19 @@ void AllanVariance::SetState(void) {
     }
 
     // calculate tau:
-    double time_ = state_.data.at(0).time;
-    for (const Data &data: state_.data) {
-        state_.tau += data.time - time_;
-        time_ = data.time;
-    }
-    state_.tau /= (state_.data.size() - 1);
+    SetStateTau();
 
-    // calculate theta using cumulative sum:
-    double sum_[NUM_FIELDS] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
-    for (const Data &data: state_.data) {
-        for (int field = WX; field < NUM_FIELDS; ++field) {
-            std::vector<double> &theta = state_.theta.at(static_cast<Field>(field));
+    // calculate theta using cumulative sum, one field after another:
+    const size_t N = state_.data.size();
+    state_.theta.resize(NUM_FIELDS * N);
+    for (int field = WX; field < NUM_FIELDS; ++field) {
+        double *theta = state_.theta.data() + field * N;
 
-            sum_[field] += data.value[field];
+        double sum_ = 0.0;
+        for (size_t k = 0; k < N; ++k) {
+            sum_ += state_.data[k].value[field];
 
-            theta.push_back(sum_[field] * state_.tau);
+            theta[k] = sum_ * state_.tau;
         }
     }
 
@@ -242,6 +255,99 @@ void AllanVariance::SetState(void) {
     SetStateCurveObserved();
 }
 
+void AllanVariance::SetStateTau(void) {
+    // mean sampling interval:
+    state_.tau = 0.0;
+    if (state_.num_observations > 1) {
+        state_.tau = (state_.time_last - state_.time_first) / (state_.num_observations - 1);
+    }
+}
+
+const Curve &AllanVariance::GetCurveObserved(void) {
+    if (config_.streaming) {
+        SetStateTau();
+        SetStateCurveObservedFromOctaves();
+    }
+
+    return state_.curve_observed;
+}
+
+void AllanVariance::AddToOctaves(const double *value) {
+    // one observation completes a cluster of octave 0, every second cluster of an octave
+    // completes one of the next octave. O(1) amortized, O(log N) at most:
+    double sum[NUM_FIELDS];
+    for (int field = WX; field < NUM_FIELDS; ++field) {
+        sum[field] = value[field];
+    }
+
+    for (size_t level = 0; ; ++level) {
+        if (level == state_.octave.size()) {
+            state_.octave.push_back(Octave());
+        }
+        Octave &octave = state_.octave.at(level);
+
+        // difference of adjacent cluster averages:
+        const double cluster_size = static_cast<double>(size_t(1) << level);
+        for (int field = WX; field < NUM_FIELDS; ++field) {
+            double average = sum[field] / cluster_size;
+            if (octave.num_clusters > 0) {
+                double difference = average - octave.last_average[field];
+                octave.sum_squared_difference[field] += difference * difference;
+            }
+            octave.last_average[field] = average;
+        }
+        ++octave.num_clusters;
+
+        if (!octave.has_pending) {
+            for (int field = WX; field < NUM_FIELDS; ++field) {
+                octave.pending_sum[field] = sum[field];
+            }
+            octave.has_pending = true;
+            return;
+        }
+
+        for (int field = WX; field < NUM_FIELDS; ++field) {
+            sum[field] += octave.pending_sum[field];
+        }
+        octave.has_pending = false;
+    }
+}
+
+void AllanVariance::SetStateCurveObservedFromOctaves(void) {
+    // non-overlapping allan variance, 1/2 <(y_{k+1} - y_k)^2> of the cluster averages.
+    // same as the batch curve, clusters are only used with at least nine differences:
+    const size_t min_num_differences = 9;
+
+    state_.averaging_factor.clear();
+    state_.curve_observed.point.clear();
+    for (size_t level = 0; level < state_.octave.size(); ++level) {
+        const Octave &octave = state_.octave.at(level);
+        if (octave.num_clusters < min_num_differences + 1) {
+            break;
+        }
+
+        int factor = 1 << level;
+        double normalizer = 2.0 * (octave.num_clusters - 1);
+
+        Point point;
+        point.tau = factor * state_.tau;
+        for (int field = WX; field < NUM_FIELDS; ++field) {
+            point.covariance[field] = octave.sum_squared_difference[field] / normalizer;
+        }
+
+        state_.averaging_factor.push_back(factor);
+        state_.curve_observed.point.push_back(point);
+    }
+    state_.num_clusters_built = state_.averaging_factor.size();
+
+    if (config_.debug_mode) {
+        ROS_ERROR(
+            "[IMU Calibration]: SetStateCurveObservedFromOctaves Num. Obs: %lu, Num. Clusters: %lu.", 
+            state_.num_observations, state_.averaging_factor.size()
+        );
+    }
+}
+
 double AllanVariance::GetCovariance(Field field, const double &tau) {
     // clang-format off
     return  (
@@ -325,7 +431,9 @@ Eigen::VectorXd AllanVariance::GetRefinedEstimation(Field field, const Eigen::Ve
     // solve:
     ceres::Solver::Summary summary;
     ceres::Solve(options, &problem, &summary );
-    std::cout << summary.FullReport() << std::endl;
+    if (config_.debug_mode) {
+        std::cout << summary.FullReport() << std::endl;
+    }
 
     // format result:
     Eigen::VectorXd result(5);
@@ -421,7 +529,7 @@ void AllanVariance::SetParams(void) {
     }
 
     // number of observations:
-    params_.num_observations = state_.data.size();
+    params_.num_observations = state_.num_observations;
     // number of clusters:
     params_.num_clusters = state_.averaging_factor.size();
 
@@ -0,0 +1,285 @@
+#include "batch_activity.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace fs = boost::filesystem;
+namespace pt = boost::property_tree;
+
+namespace imu {
+
+namespace calibrator {
+
+BatchActivity::BatchActivity()
+    : private_nh_("~") {
+}
+
+BatchActivity::~BatchActivity() {}
+
+void BatchActivity::Init(void) {
+    // load parameters:
+    private_nh_.param("debug_mode", config_.debug_mode, false);
+
+    private_nh_.param("batch/log_dir", config_.log_dir, std::string("."));
+    private_nh_.param("batch/output_dir", config_.output_dir, std::string("."));
+    private_nh_.param("batch/max_num_threads", config_.max_num_threads, 0);
+
+    // same curve params as a single device:
+    private_nh_.param("imu/allan_variance_curve/min_collection_time_in_mins", config_.min_collection_time_in_mins, 120);
+    private_nh_.param("imu/allan_variance_curve/max_num_clusters", config_.max_num_clusters, 10000);
+    private_nh_.param("imu/allan_variance_curve/streaming", config_.streaming, false);
+    private_nh_.param("imu/power_spectral_density/enable", config_.psd, false);
+    private_nh_.param("imu/power_spectral_density/segment_length", config_.psd_segment_length, 65536);
+    private_nh_.param("imu/power_spectral_density/max_num_bands", config_.psd_max_num_bands, 100);
+
+    if (config_.max_num_threads <= 0) {
+        config_.max_num_threads = std::max(static_cast<int>(boost::thread::hardware_concurrency()), 1);
+    }
+
+    if (config_.debug_mode) {
+        ROS_WARN(
+            "[IMU Calibration] batch params: %s %s %d threads %d %d",
+            config_.log_dir.c_str(),
+            config_.output_dir.c_str(),
+            config_.max_num_threads,
+            config_.min_collection_time_in_mins,
+            config_.max_num_clusters
+        );
+    }
+}
+
+bool BatchActivity::ListLogs(void) {
+    log_path_.clear();
+
+    boost::system::error_code error;
+    for (fs::directory_iterator it(config_.log_dir, error), end; !error && it != end; it.increment(error)) {
+        if (fs::is_regular_file(it->status()) && it->path().extension() == kIMULogExtension) {
+            log_path_.push_back(it->path().string());
+        }
+    }
+    if (error) {
+        ROS_ERROR("[IMU Calibration]: cannot list IMU logs in %s: %s", config_.log_dir.c_str(), error.message().c_str());
+        return false;
+    }
+
+    // report in device order:
+    std::sort(log_path_.begin(), log_path_.end());
+
+    return true;
+}
+
+int BatchActivity::Run(void) {
+    if (!ListLogs()) {
+        return -1;
+    }
+
+    boost::system::error_code error;
+    fs::create_directories(config_.output_dir, error);
+    if (error) {
+        ROS_ERROR("[IMU Calibration]: cannot create %s: %s", config_.output_dir.c_str(), error.message().c_str());
+        return -1;
+    }
+
+    result_.assign(log_path_.size(), BatchResult());
+    const int num_threads = std::min(config_.max_num_threads, static_cast<int>(log_path_.size()));
+
+    ROS_INFO(
+        "[IMU Calibration]: calibrate %lu devices from %s on %d threads",
+        log_path_.size(), config_.log_dir.c_str(), num_threads
+    );
+
+    // bounded pool, each worker takes the next device until none is left:
+    std::atomic<size_t> next_device(0);
+    boost::thread_group workers;
+    for (int i = 0; i < num_threads; ++i) {
+        workers.create_thread(
+            [this, &next_device]() {
+#ifdef _OPENMP
+                // devices are the parallelism here, the curve of each is built on its own worker:
+                omp_set_num_threads(1);
+#endif
+                for (size_t device = next_device++; device < log_path_.size(); device = next_device++) {
+                    Calibrate(result_.at(device), log_path_.at(device));
+                }
+            }
+        );
+    }
+    workers.join_all();
+
+    int num_failed = 0;
+    for (const BatchResult &result: result_) {
+        if (result.status != "ok") {
+            ++num_failed;
+        }
+    }
+
+    return num_failed;
+}
+
+void BatchActivity::Calibrate(BatchResult &result, const std::string &log_path) {
+    result.device_name = fs::path(log_path).stem().string();
+
+    allan_variance::AllanVariance estimator(config_.debug_mode, result.device_name, config_.max_num_clusters);
+    estimator.SetStreaming(config_.streaming);
+
+    power_spectral_density::PowerSpectralDensity psd_estimator(config_.debug_mode, result.device_name, config_.psd_segment_length);
+    psd_estimator.SetMaxNumBands(config_.psd_max_num_bands);
+
+    // a. load:
+    std::ifstream log(log_path, std::ios::binary);
+    if (!log) {
+        result.status = "unreadable";
+        ROS_ERROR("[IMU Calibration]: cannot open %s", log_path.c_str());
+        return;
+    }
+
+    const size_t kNumRecordsPerRead = 4096;
+    std::vector<double> buffer(kNumRecordsPerRead * kIMULogRecordSize);
+
+    double time_first = -1.0;
+    geometry_msgs::Vector3 angular_velocity, linear_acceleration;
+    while (log) {
+        log.read(reinterpret_cast<char *>(buffer.data()), buffer.size() * sizeof(double));
+        const size_t num_records = log.gcount() / (kIMULogRecordSize * sizeof(double));
+
+        for (size_t i = 0; i < num_records; ++i) {
+            const double *record = buffer.data() + i * kIMULogRecordSize;
+
+            angular_velocity.x = record[1];
+            angular_velocity.y = record[2];
+            angular_velocity.z = record[3];
+            linear_acceleration.x = record[4];
+            linear_acceleration.y = record[5];
+            linear_acceleration.z = record[6];
+
+            if (time_first < 0.0) {
+                time_first = record[0];
+            }
+            estimator.Add(record[0], angular_velocity, linear_acceleration);
+            if (config_.psd) {
+                psd_estimator.Add(record[0], angular_velocity, linear_acceleration);
+            }
+        }
+        result.num_observations += num_records;
+    }
+    result.duration_in_mins = (result.num_observations > 0) ? (estimator.GetT() - time_first) / 60.0 : 0.0;
+
+    // b. too short a test gives no usable curve:
+    if (result.duration_in_mins < config_.min_collection_time_in_mins) {
+        result.status = "insufficient";
+        ROS_WARN(
+            "[IMU Calibration]: %s has %.1f mins of %d mins required, skipped",
+            result.device_name.c_str(), result.duration_in_mins, config_.min_collection_time_in_mins
+        );
+        return;
+    }
+
+    // c. estimate, the fast PSD one first:
+    if (config_.psd) {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        result.psd_estimated = psd_estimator.Estimate();
+        result.psd_time_consumption_in_secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        for (int field = allan_variance::WX; result.psd_estimated && field < allan_variance::NUM_FIELDS; ++field) {
+            allan_variance::Field f = static_cast<allan_variance::Field>(field);
+
+            result.psd_measurement_noise[field] = psd_estimator.GetMeasurementNoise(f);
+            result.psd_random_walk[field] = psd_estimator.GetRandomWalk(f);
+            result.psd_bias_instability[field] = psd_estimator.GetBiasInstability(f);
+        }
+    }
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    estimator.Estimate();
+    result.time_consumption_in_secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (int field = allan_variance::WX; field < allan_variance::NUM_FIELDS; ++field) {
+        allan_variance::Field f = static_cast<allan_variance::Field>(field);
+
+        result.measurement_noise[field] = estimator.GetMeasurementNoise(f);
+        result.random_walk[field] = estimator.GetRandomWalk(f);
+        result.bias_instability[field] = estimator.GetBiasInstability(f);
+    }
+    result.status = "ok";
+
+    // same outputs as a single device, next to the combined report:
+    estimator.WriteIMUCalibrationResult((fs::path(config_.output_dir) / result.device_name).string());
+    if (result.psd_estimated) {
+        psd_estimator.WriteIMUCalibrationResult((fs::path(config_.output_dir) / result.device_name).string());
+    }
+
+    ROS_INFO(
+        "[IMU Calibration]: %s calibrated, %lu observations, %.1f mins, estimated in %.1f s",
+        result.device_name.c_str(), result.num_observations, result.duration_in_mins, result.time_consumption_in_secs
+    );
+}
+
+void BatchActivity::WriteResults(void) {
+    static std::string FIELD_NAME[allan_variance::NUM_FIELDS] = {
+        "gyro_x", "gyro_y", "gyro_z",
+        "acc_x", "acc_y", "acc_z",
+    };
+
+    // write combined results as JSON file:
+    pt::ptree root;
+
+    // a. summary info:
+    root.put("general.log_dir", config_.log_dir);
+    root.put("general.num_devices", result_.size());
+
+    // b. devices:
+    pt::ptree devices;
+    for (const BatchResult &result: result_) {
+        pt::ptree device;
+
+        device.put("status", result.status);
+        device.put("num_observations", result.num_observations);
+        device.put("duration_in_mins", result.duration_in_mins);
+        device.put("time_consumption_in_secs", result.time_consumption_in_secs);
+        if (result.psd_estimated) {
+            device.put("psd_time_consumption_in_secs", result.psd_time_consumption_in_secs);
+        }
+
+        if (result.status == "ok") {
+            for (int field = allan_variance::WX; field < allan_variance::NUM_FIELDS; ++field) {
+                pt::ptree measurement;
+
+                measurement.put("measurement_noise", result.measurement_noise[field]);
+                measurement.put("bias_random_walk", result.random_walk[field]);
+                measurement.put("bias_instability", result.bias_instability[field]);
+
+                // same quantities from the welch PSD, to be compared with the allan variance ones:
+                if (result.psd_estimated) {
+                    measurement.put("psd.measurement_noise", result.psd_measurement_noise[field]);
+                    measurement.put("psd.bias_random_walk", result.psd_random_walk[field]);
+                    measurement.put("psd.bias_instability", result.psd_bias_instability[field]);
+                }
+
+                device.add_child("measurements." + FIELD_NAME[field], measurement);
+            }
+        }
+
+        devices.push_back(std::make_pair(result.device_name, device));
+    }
+    root.add_child("devices", devices);
+
+    const std::string output_filename = (fs::path(config_.output_dir) / "fleet_calibration.json").string();
+    pt::json_parser::write_json(output_filename, root);
+
+    ROS_INFO("[IMU Calibration]: fleet result is available at %s", output_filename.c_str());
+}
+
+}  // namespace calibrator
+
+}  // namespace imu
@@ -0,0 +1,23 @@
+#include "batch_activity.h"
+#include <ros/ros.h>
+
+int main(int argc, char** argv) {
+    std::string node_name{"imu_calibration_batch_node"};
+    ros::init(argc, argv, node_name);
+
+    imu::calibrator::BatchActivity batch_activity;
+
+    batch_activity.Init();
+
+    const int num_failed = batch_activity.Run();
+    if (num_failed < 0) {
+        return 1;
+    }
+    batch_activity.WriteResults();
+
+    if (num_failed > 0) {
+        ROS_WARN("[IMU Calibration]: %d devices not calibrated, see fleet_calibration.json", num_failed);
+    }
+
+    return (num_failed > 0) ? 1 : 0;
+}
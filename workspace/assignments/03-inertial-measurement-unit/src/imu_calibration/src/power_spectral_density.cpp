@@ -0,0 +1,464 @@
+#include <ros/ros.h>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <algorithm>
+#include <limits>
+
+#include "CSVWriter.h"
+#include "power_spectral_density.h"
+
+namespace pt = boost::property_tree;
+
+namespace imu {
+
+namespace calibrator {
+
+namespace power_spectral_density {
+
+PowerSpectralDensity::PowerSpectralDensity(bool debug_mode, std::string name, int segment_length) {
+    config_.debug_mode = debug_mode;
+    config_.name = name;
+    config_.max_num_bands = 100;
+
+    SetSegmentLength(segment_length);
+}
+PowerSpectralDensity::~PowerSpectralDensity(void) {}
+
+void PowerSpectralDensity::Reset(void) {
+    // reset state:
+    state_.Reset();
+    state_.segment.resize(NUM_FIELDS * config_.segment_length);
+    state_.periodogram_sum.assign(NUM_FIELDS * ((config_.segment_length >> 1) + 1), 0.0);
+
+    params_.Reset();
+}
+
+void PowerSpectralDensity::SetSegmentLength(int segment_length) {
+    // radix-2 FFT, at least 16 samples so that the lowest band is not the whole spectrum:
+    config_.segment_length = 16;
+    while (config_.segment_length < segment_length) {
+        config_.segment_length <<= 1;
+    }
+
+    SetStateWindow();
+    Reset();
+}
+
+void PowerSpectralDensity::SetStateWindow(void) {
+    const int L = config_.segment_length;
+
+    // periodic hann window, its power normalizes the periodogram:
+    window_.resize(L);
+    window_power_ = 0.0;
+    for (int k = 0; k < L; ++k) {
+        window_[k] = 0.5 - 0.5 * cos(2.0 * M_PI * k / L);
+        window_power_ += window_[k] * window_[k];
+    }
+
+    twiddle_.resize(L >> 1);
+    for (int k = 0; k < (L >> 1); ++k) {
+        twiddle_[k] = std::polar(1.0, -2.0 * M_PI * k / L);
+    }
+}
+
+void PowerSpectralDensity::Add(
+    double time,
+    const geometry_msgs::Vector3 &angular_velocity,
+    const geometry_msgs::Vector3 &linear_acceleration
+) {
+    const double value[NUM_FIELDS] = {
+        angular_velocity.x, angular_velocity.y, angular_velocity.z,
+        linear_acceleration.x, linear_acceleration.y, linear_acceleration.z
+    };
+
+    if (state_.num_observations == 0) {
+        state_.time_first = time;
+    }
+    state_.time_last = time;
+    ++state_.num_observations;
+
+    // add observation to the pending segment:
+    const size_t L = config_.segment_length;
+    for (int field = WX; field < NUM_FIELDS; ++field) {
+        state_.segment[field * L + state_.segment_size] = value[field];
+    }
+    ++state_.segment_size;
+
+    if (state_.segment_size < L) {
+        return;
+    }
+
+    AddSegment();
+
+    // 50% overlap, the second half starts the next segment:
+    for (int field = WX; field < NUM_FIELDS; ++field) {
+        double *segment = state_.segment.data() + field * L;
+
+        std::copy(segment + (L >> 1), segment + L, segment);
+    }
+    state_.segment_size = L >> 1;
+}
+
+void PowerSpectralDensity::AddSegment(void) {
+    const size_t L = config_.segment_length;
+    const size_t M = (L >> 1) + 1;
+
+    // fields are independent:
+    #pragma omp parallel for
+    for (int field = WX; field < NUM_FIELDS; ++field) {
+        const double *segment = state_.segment.data() + field * L;
+        double *periodogram_sum = state_.periodogram_sum.data() + field * M;
+
+        // remove the segment mean, so that the bias does not leak into the lowest bins:
+        double mean = 0.0;
+        for (size_t k = 0; k < L; ++k) {
+            mean += segment[k];
+        }
+        mean /= L;
+
+        std::vector<std::complex<double>> x(L);
+        for (size_t k = 0; k < L; ++k) {
+            x[k] = window_[k] * (segment[k] - mean);
+        }
+
+        FFT(x);
+
+        for (size_t k = 0; k < M; ++k) {
+            periodogram_sum[k] += std::norm(x[k]);
+        }
+    }
+
+    ++state_.num_segments;
+}
+
+void PowerSpectralDensity::FFT(std::vector<std::complex<double>> &x) const {
+    const size_t L = x.size();
+
+    // a. bit reversal permutation:
+    for (size_t i = 1, j = 0; i < L; ++i) {
+        size_t bit = L >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+
+        if (i < j) {
+            std::swap(x[i], x[j]);
+        }
+    }
+
+    // b. iterative radix-2 butterflies, twiddles of size n are every (L / n)-th of size L:
+    for (size_t n = 2; n <= L; n <<= 1) {
+        const size_t half = n >> 1;
+        const size_t stride = L / n;
+
+        for (size_t i = 0; i < L; i += n) {
+            for (size_t k = 0; k < half; ++k) {
+                const std::complex<double> t = twiddle_[k * stride] * x[i + k + half];
+
+                x[i + k + half] = x[i + k] - t;
+                x[i + k] += t;
+            }
+        }
+    }
+}
+
+bool PowerSpectralDensity::Estimate(void) {
+    if (state_.num_segments == 0) {
+        ROS_WARN(
+            "[IMU Calibration]: %s has %lu observations, less than one PSD segment of %d, skipped",
+            config_.name.c_str(), state_.num_observations, config_.segment_length
+        );
+        return false;
+    }
+
+    // set state:
+    SetStateTau();
+    SetStateCurveObserved();
+
+    // set params:
+    SetParams();
+
+    return true;
+}
+
+void PowerSpectralDensity::WriteIMUCalibrationResult(const std::string &output_filename) {
+    static std::string FIELD_NAME[NUM_FIELDS] = {
+        "gyro_x", "gyro_y", "gyro_z",
+        "acc_x", "acc_y", "acc_z",
+    };
+
+    // write calibration results as JSON file, same keys as the allan variance result:
+    pt::ptree root;
+
+    // a. summary info:
+    root.put("general.device_name", config_.name);
+    root.put("general.num_observations", params_.num_observations);
+    root.put("general.num_segments", params_.num_segments);
+    root.put("general.segment_length", config_.segment_length);
+
+    // b. measurement properties:
+    pt::ptree measurements;
+    for (int field = WX; field < NUM_FIELDS; ++field) {
+        pt::ptree measurement;
+
+        measurement.put("N", params_.N[field]);
+        measurement.put("B", params_.B[field]);
+        measurement.put("K", params_.K[field]);
+
+        measurement.put("measurement_noise", params_.measurement_noise[field]);
+        measurement.put("bias_random_walk", params_.random_walk[field]);
+        measurement.put("bias_instability", params_.bias_instability[field]);
+
+        measurements.push_back(std::make_pair(FIELD_NAME[field], measurement));
+    }
+    root.add_child("measurements", measurements);
+
+    pt::json_parser::write_json(output_filename+"_psd.json", root);
+
+    // write observed & fitted spectrum as CSV file:
+    CSVWriter csv(",");
+    csv.enableAutoNewRow(1 + 2 * NUM_FIELDS);
+    // a. write header:
+    csv << "F";
+    for (int field = WX; field < NUM_FIELDS; ++field) {
+        csv << FIELD_NAME[field];
+    }
+    for (int field = WX; field < NUM_FIELDS; ++field) {
+        csv << FIELD_NAME[field] + "_fit";
+    }
+    // b. write contents:
+    for (size_t i = 0; i < state_.curve_observed.point.size(); ++i) {
+        const Point &observed = state_.curve_observed.point.at(i);
+        const Point &smoothed = params_.curve_smoothed.point.at(i);
+
+        csv << observed.frequency;
+        for (int field = WX; field < NUM_FIELDS; ++field) {
+            csv << observed.density[field];
+        }
+        for (int field = WX; field < NUM_FIELDS; ++field) {
+            csv << smoothed.density[field];
+        }
+    }
+    csv.writeToFile(output_filename+"_psd.csv");
+
+    if (config_.debug_mode) {
+        ROS_ERROR("[IMU Calibration]: PSD result is available at %s", output_filename.data());
+    }
+}
+
+void PowerSpectralDensity::SetStateTau(void) {
+    // mean sampling interval:
+    state_.tau = 0.0;
+    if (state_.num_observations > 1) {
+        state_.tau = (state_.time_last - state_.time_first) / (state_.num_observations - 1);
+    }
+}
+
+void PowerSpectralDensity::SetStateCurveObserved(void) {
+    if (config_.debug_mode) {
+        ROS_ERROR("[IMU Calibration]: SetStateCurveObserved PSD");
+    }
+
+    const size_t L = config_.segment_length;
+    const size_t M = (L >> 1) + 1;
+    // bin spacing:
+    const double df = 1.0 / (L * state_.tau);
+    // two-sided density, the convention the allan variance noise terms are defined in,
+    // e.g. white noise of S(f) = N^2 has an allan variance of N^2 / tau.
+    // DC is left out, it only holds what is left of the removed mean:
+    const double scale = state_.tau / (window_power_ * state_.num_segments);
+
+    // average the bins into log-spaced bands, one bin per band at the low end where the bins are sparse:
+    const double step = pow(static_cast<double>(M - 1), 1.0 / std::max(config_.max_num_bands, 1));
+
+    state_.curve_observed.point.clear();
+    double upper_bound = 1.0;
+    for (size_t k = 1; k < M; ) {
+        upper_bound *= step;
+
+        Point point = { 0.0, { 0.0 }, 0 };
+        for (; k < M && (k <= upper_bound || point.num_bins == 0); ++k, ++point.num_bins) {
+            point.frequency += k * df;
+            for (int field = WX; field < NUM_FIELDS; ++field) {
+                point.density[field] += scale * state_.periodogram_sum[field * M + k];
+            }
+        }
+
+        point.frequency /= point.num_bins;
+        for (int field = WX; field < NUM_FIELDS; ++field) {
+            point.density[field] /= point.num_bins;
+        }
+        state_.curve_observed.point.push_back(point);
+    }
+}
+
+void PowerSpectralDensity::SetParamsNoiseTerms(void) {
+    if (config_.debug_mode) {
+        ROS_ERROR("[IMU Calibration]: SetParamsNoiseTerms");
+    }
+
+    const size_t num_bands = state_.curve_observed.point.size();
+
+    for (int field = WX; field < NUM_FIELDS; ++field) {
+        // linear in N^2, B^2 & K^2. each band is weighted by its relative precision,
+        // the averaged periodogram of n bins has a relative standard deviation of about 1 / sqrt(n):
+        Eigen::MatrixXd A(num_bands, 3);
+        Eigen::VectorXd b(num_bands);
+        for (size_t i = 0; i < num_bands; ++i) {
+            const Point &point = state_.curve_observed.point.at(i);
+            const double omega = 2.0 * M_PI * point.frequency;
+            const double density = std::max(point.density[field], std::numeric_limits<double>::min());
+
+            const double weight = sqrt(static_cast<double>(point.num_bins)) / density;
+
+            A(i, 0) = weight;
+            A(i, 1) = weight / omega;
+            A(i, 2) = weight / (omega * omega);
+            b(i) = weight * density;
+        }
+
+        // non-negative terms: a term fitted negative is not seen in the spectrum, drop it & refit:
+        bool active[3] = { true, true, true };
+        Eigen::Vector3d x = Eigen::Vector3d::Zero();
+        for (int num_active = 3; num_active > 0; --num_active) {
+            Eigen::MatrixXd A_active(num_bands, num_active);
+            for (int j = 0, c = 0; j < 3; ++j) {
+                if (active[j]) {
+                    A_active.col(c++) = A.col(j);
+                }
+            }
+            Eigen::VectorXd x_active = A_active.fullPivHouseholderQr().solve(b);
+
+            x.setZero();
+            int most_negative = -1;
+            for (int j = 0, c = 0; j < 3; ++j) {
+                if (!active[j]) {
+                    continue;
+                }
+                x(j) = x_active(c++);
+                if (x(j) < 0.0 && (most_negative < 0 || x(j) < x(most_negative))) {
+                    most_negative = j;
+                }
+            }
+
+            if (most_negative < 0) {
+                break;
+            }
+            active[most_negative] = false;
+            x.setZero();
+        }
+
+        params_.N[field] = sqrt(x(0));
+        params_.B[field] = sqrt(x(1));
+        params_.K[field] = sqrt(x(2));
+
+        if (config_.debug_mode) {
+            ROS_ERROR(
+                "[IMU Calibration]: SetParamsNoiseTerms: field %d, N %e, B %e, K %e",
+                field,
+                params_.N[field], params_.B[field], params_.K[field]
+            );
+        }
+    }
+}
+
+void PowerSpectralDensity::SetParamsCurveSmoothed(void) {
+    if (config_.debug_mode) {
+        ROS_ERROR("[IMU Calibration]: SetParamsCurveSmoothed PSD");
+    }
+
+    // reset:
+    params_.curve_smoothed.point.clear();
+
+    // calculate:
+    for (const Point &p: state_.curve_observed.point) {
+        const double omega = 2.0 * M_PI * p.frequency;
+
+        Point point = { p.frequency, { 0.0 }, p.num_bins };
+        for (int field = WX; field < NUM_FIELDS; ++field) {
+            // clang-format off
+            point.density[field] = (
+                ( params_.N[field]*params_.N[field] ) +
+                ( params_.B[field]*params_.B[field] / omega ) +
+                ( params_.K[field]*params_.K[field] / (omega*omega) )
+            );
+            // clang-format on
+        }
+        params_.curve_smoothed.point.push_back(point);
+    }
+}
+
+void PowerSpectralDensity::SetParamsMeasurementNoise(void) {
+    if (config_.debug_mode) {
+        ROS_ERROR("[IMU Calibration]: SetParamsMeasurementNoise PSD");
+    }
+
+    // calculate measurement noise covariance, ready to be used by ROS message covariance:
+    for (int field = WX; field < NUM_FIELDS; ++field) {
+        params_.measurement_noise[field] = params_.N[field] * params_.N[field] / sqrt(state_.tau);
+    }
+}
+
+void PowerSpectralDensity::SetParamsRandomWalk(void) {
+    if (config_.debug_mode) {
+        ROS_ERROR("[IMU Calibration]: SetParamsRandomWalk PSD");
+    }
+
+    // calculate bias random walk covariance, ready to be used by ROS message covariance:
+    for (int field = WX; field < NUM_FIELDS; ++field) {
+        params_.random_walk[field] = params_.K[field] * params_.K[field] * sqrt(state_.tau);
+    }
+}
+
+void PowerSpectralDensity::SetParamsBiasInstability(void) {
+    if (config_.debug_mode) {
+        ROS_ERROR("[IMU Calibration]: SetParamsBiasInstability PSD");
+    }
+
+    // minimum of the allan variance implied by the fitted terms, N^2 / tau + 2 ln2 / pi B^2 + K^2 tau / 3,
+    // over the cluster times the allan variance analysis would use:
+    const double min_tau = 9.0 * state_.tau;
+    const double max_tau = std::max(0.5 * state_.num_observations - 9.0, 9.0) * state_.tau;
+
+    for (int field = WX; field < NUM_FIELDS; ++field) {
+        const double N = params_.N[field];
+        const double B = params_.B[field];
+        const double K = params_.K[field];
+
+        // the white noise & random walk terms cross at tau = sqrt(3) N / K:
+        double tau = (K > 0.0) ? sqrt(3.0) * N / K : max_tau;
+        tau = std::max(min_tau, std::min(tau, max_tau));
+
+        params_.bias_instability[field] = N*N / tau + 2.0 * log(2.0) / M_PI * B*B + K*K * tau / 3.0;
+    }
+}
+
+void PowerSpectralDensity::SetParams(void) {
+    if (config_.debug_mode) {
+        ROS_ERROR("[IMU Calibration]: SetParams PSD");
+    }
+
+    // number of observations:
+    params_.num_observations = state_.num_observations;
+    // number of segments:
+    params_.num_segments = state_.num_segments;
+
+    // fit noise terms on the spectrum:
+    SetParamsNoiseTerms();
+
+    // generate fitted spectrum:
+    SetParamsCurveSmoothed();
+
+    // set derived params:
+    SetParamsMeasurementNoise();
+    SetParamsRandomWalk();
+    SetParamsBiasInstability();
+}
+
+}  // namespace power_spectral_density
+
+}  // namespace calibrator
+
+}  // namespace imu
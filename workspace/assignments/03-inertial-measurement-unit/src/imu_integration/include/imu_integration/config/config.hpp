@@ -59,6 +59,38 @@ struct OdomConfig {
     } topic_name;
 };
 
+struct MotionConfig {
+    // position, elliptic in xy & sinusoidal in z:
+    struct {
+        double x;
+        double y;
+        double z;
+    } rho;
+    double omega_xy;
+    double omega_z;
+
+    // orientation, oscillating roll & pitch with constant yaw rate:
+    double roll;
+    double pitch;
+    double yaw_rate;
+};
+
+struct OfflineConfig {
+    // generate into a rosbag instead of publishing live:
+    bool enable;
+    std::string output_file;
+
+    // time span & rates:
+    double start_time;
+    double duration;
+    double imu_frequency;
+    double odom_frequency;
+
+    // noise generation, reproducible by its seed:
+    int seed;
+    int batch_size;
+};
+
 } // namespace imu_integration
 
 #endif 
\ No newline at end of file
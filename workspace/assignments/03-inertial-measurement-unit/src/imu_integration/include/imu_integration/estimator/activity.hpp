@@ -19,6 +19,9 @@
 #include "imu_integration/subscriber/imu_subscriber.hpp"
 #include "imu_integration/subscriber/odom_subscriber.hpp"
 
+// mechanization:
+#include "imu_integration/estimator/imu_mechanization.hpp"
+
 #include <nav_msgs/Odometry.h>
 
 namespace imu_integration {
@@ -34,6 +37,7 @@ class Activity {
     // workflow:
     bool ReadData(void);
     bool HasData(void);
+    bool InitPose(void);
     bool UpdatePose(void);
     bool PublishPose(void);
 
@@ -44,58 +48,6 @@ class Activity {
      * @return unbiased angular velocity in body frame
      */
     Eigen::Vector3d GetUnbiasedAngularVel(const Eigen::Vector3d &angular_vel);
-    /**
-     * @brief  get unbiased linear acceleration in navigation frame
-     * @param  linear_acc, linear acceleration measurement
-     * @param  R, corresponding orientation of measurement
-     * @return unbiased linear acceleration in navigation frame
-     */
-    Eigen::Vector3d GetUnbiasedLinearAcc(
-        const Eigen::Vector3d &linear_acc,
-        const Eigen::Matrix3d &R
-    );
-    /**
-     * @brief  get angular delta
-     * @param  index_curr, current imu measurement buffer index
-     * @param  index_prev, previous imu measurement buffer index
-     * @param  angular_delta, angular delta output
-     * @return true if success false otherwise
-     */
-    bool GetAngularDelta(
-        const size_t index_curr, const size_t index_prev,
-        Eigen::Vector3d &angular_delta
-    );
-    /**
-     * @brief  get velocity delta
-     * @param  index_curr, current imu measurement buffer index
-     * @param  index_prev, previous imu measurement buffer index
-     * @param  R_curr, corresponding orientation of current imu measurement
-     * @param  R_prev, corresponding orientation of previous imu measurement
-     * @param  velocity_delta, velocity delta output
-     * @return true if success false otherwise
-     */
-    bool GetVelocityDelta(
-        const size_t index_curr, const size_t index_prev,
-        const Eigen::Matrix3d &R_curr, const Eigen::Matrix3d &R_prev, 
-        double &delta_t, Eigen::Vector3d &velocity_delta
-    );
-    /**
-     * @brief  update orientation with effective rotation angular_delta
-     * @param  angular_delta, effective rotation
-     * @param  R_curr, current orientation
-     * @param  R_prev, previous orientation
-     * @return void
-     */
-    void UpdateOrientation(
-        const Eigen::Vector3d &angular_delta,
-        Eigen::Matrix3d &R_curr, Eigen::Matrix3d &R_prev
-    );
-    /**
-     * @brief  update orientation with effective velocity change velocity_delta
-     * @param  velocity_delta, effective velocity change
-     * @return void
-     */
-    void UpdatePosition(const double &delta_t, const Eigen::Vector3d &velocity_delta);
 
   private:
     // node handler:
@@ -109,6 +61,8 @@ class Activity {
     // data buffer:
     std::deque<IMUData> imu_data_buff_;
     std::deque<OdomData> odom_data_buff_;
+    // unbiased measurements for batch integration:
+    std::vector<imu_mechanization::IMUSample> imu_samples_;
 
     // config:
     bool initialized_ = false;
@@ -19,6 +19,7 @@
 #include <nav_msgs/Odometry.h>
 
 #include "imu_integration/config/config.hpp"
+#include "imu_integration/generator/motion.hpp"
 
 namespace imu_integration {
 
@@ -29,6 +30,9 @@ public:
     Activity();
     void Init(void);
     void Run(void);
+    // offline generation into a rosbag, as fast as possible:
+    bool IsOffline(void) const { return offline_config_.enable; }
+    bool RunOffline(void);
 private:
     // get groud truth from motion equation:
     void GetGroundTruth(void);
@@ -42,8 +46,6 @@ private:
 
     // utilities:
     Eigen::Vector3d GetGaussianNoise(double stddev);
-    static Eigen::Matrix3d EulerAnglesToRotation(const Eigen::Vector3d &euler_angles);
-    static Eigen::Vector3d EulerAngleRatesToBodyAngleRates(const Eigen::Vector3d &euler_angles, const Eigen::Vector3d &euler_angle_rates);
     
     // node handler:
     ros::NodeHandle private_nh_;
@@ -55,6 +57,8 @@ private:
     // config:
     IMUConfig imu_config_;
     OdomConfig odom_config_;
+    MotionConfig motion_config_;
+    OfflineConfig offline_config_;
 
     // noise generator:
     std::default_random_engine normal_generator_;
@@ -0,0 +1,54 @@
+/*
+ * @Description: motion equation of the IMU measurement generator
+ * @Author: Ge Yao
+ * @Date: 2021-01-01 10:12:36
+ */
+#ifndef IMU_INTEGRATION_GENERATOR_MOTION_HPP_
+#define IMU_INTEGRATION_GENERATOR_MOTION_HPP_
+
+#include <eigen3/Eigen/Core>
+#include <eigen3/Eigen/Dense>
+
+#include "imu_integration/config/config.hpp"
+
+namespace imu_integration {
+
+namespace generator {
+
+// ground truth at one time stamp, IMU measurements in body frame & noise-free:
+struct MotionState {
+    Eigen::Matrix3d R;
+    Eigen::Vector3d t;
+    Eigen::Vector3d v;
+    Eigen::Vector3d angular_vel;
+    Eigen::Vector3d linear_acc;
+};
+
+/**
+ * @brief  get motion definition with the defaults of node_constants.hpp
+ * @return motion definition
+ */
+MotionConfig GetDefaultMotionConfig(void);
+
+/**
+ * @brief  get ground truth from motion equation
+ * @param  motion, motion definition
+ * @param  G, gravity constant
+ * @param  t, time in seconds
+ * @param  state, output ground truth
+ * @return void
+ */
+void GetMotionState(
+    const MotionConfig &motion, const Eigen::Vector3d &G,
+    double t,
+    MotionState &state
+);
+
+Eigen::Matrix3d EulerAnglesToRotation(const Eigen::Vector3d &euler_angles);
+Eigen::Vector3d EulerAngleRatesToBodyAngleRates(const Eigen::Vector3d &euler_angles, const Eigen::Vector3d &euler_angle_rates);
+
+}  // namespace generator
+
+}  // namespace imu_integration
+
+#endif  // IMU_INTEGRATION_GENERATOR_MOTION_HPP_
@@ -0,0 +1,76 @@
+/*
+ * @Description: offline IMU measurement generation, into a rosbag
+ * @Author: Ge Yao
+ * @Date: 2021-01-01 10:12:36
+ */
+#ifndef IMU_INTEGRATION_GENERATOR_OFFLINE_GENERATOR_HPP_
+#define IMU_INTEGRATION_GENERATOR_OFFLINE_GENERATOR_HPP_
+
+#include <random>
+#include <string>
+
+#include <eigen3/Eigen/Core>
+#include <eigen3/Eigen/Dense>
+
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <sensor_msgs/Imu.h>
+#include <nav_msgs/Odometry.h>
+
+#include "imu_integration/config/config.hpp"
+#include "imu_integration/generator/motion.hpp"
+
+namespace imu_integration {
+
+namespace generator {
+
+// measurements are generated in batches of samples, without waiting for the clock. the noises of a whole batch
+// are drawn at once, as standard normal pairs from uniforms, so the bags of one seed are identical whatever the
+// batch size
+class OfflineGenerator {
+public:
+    OfflineGenerator(
+        const IMUConfig &imu_config,
+        const OdomConfig &odom_config,
+        const MotionConfig &motion_config,
+        const OfflineConfig &offline_config
+    );
+    bool Generate(void);
+private:
+    // 12 rows per sample, gyro & acc bias after the random walk, then gyro & acc measurement noise:
+    typedef Eigen::Matrix<double, 12, Eigen::Dynamic> NoiseBatch;
+
+    bool IsValid(void) const;
+    // random walk & measurement noise generation:
+    void GenerateNoise(int num_samples);
+    void GetStandardNormal(double *data, int size);
+    // convert to ROS messages:
+    void SetIMUMessage(const ros::Time &timestamp, const MotionState &state, int index);
+    void SetOdometryMessage(const ros::Time &timestamp, const MotionState &state);
+
+    // config:
+    IMUConfig imu_config_;
+    OdomConfig odom_config_;
+    MotionConfig motion_config_;
+    OfflineConfig offline_config_;
+
+    // noise generator:
+    std::mt19937_64 uniform_generator_;
+    NoiseBatch noise_;
+    Eigen::Array<double, 12, 1> noise_scale_;
+
+    // a. gravity constant:
+    Eigen::Vector3d G_;
+    // b. bias:
+    Eigen::Vector3d angular_vel_bias_;
+    Eigen::Vector3d linear_acc_bias_;
+    // ROS messages:
+    sensor_msgs::Imu message_imu_;
+    nav_msgs::Odometry message_odom_;
+};
+
+}  // namespace generator
+
+}  // namespace imu_integration
+
+#endif  // IMU_INTEGRATION_GENERATOR_OFFLINE_GENERATOR_HPP_
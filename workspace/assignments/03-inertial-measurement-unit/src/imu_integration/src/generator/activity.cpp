@@ -3,8 +3,8 @@
  * @Author: Ge Yao
  * @Date: 2020-11-10 14:25:03
  */
-#include "imu_integration/generator/node_constants.hpp"
 #include "imu_integration/generator/activity.hpp"
+#include "imu_integration/generator/offline_generator.hpp"
 #include "glog/logging.h"
 
 #include <eigen3/Eigen/src/Geometry/Quaternion.h>
@@ -16,6 +16,8 @@ namespace generator {
 
 Activity::Activity(void) 
     : private_nh_("~"), 
+    // motion definition:
+    motion_config_(GetDefaultMotionConfig()),
     // standard normal distribution:
     normal_distribution_(0.0, 1.0),
     // gravity acceleration:
@@ -68,6 +70,30 @@ void Activity::Init(void) {
     private_nh_.param("pose/frame_id", odom_config_.frame_id, std::string("inertial"));
     private_nh_.param("pose/topic_name", odom_config_.topic_name.ground_truth, std::string("/pose/ground_truth"));
 
+    // parse motion definition, defaults to node_constants.hpp:
+    private_nh_.param("motion/rho/x", motion_config_.rho.x, motion_config_.rho.x);
+    private_nh_.param("motion/rho/y", motion_config_.rho.y, motion_config_.rho.y);
+    private_nh_.param("motion/rho/z", motion_config_.rho.z, motion_config_.rho.z);
+    private_nh_.param("motion/omega/xy", motion_config_.omega_xy, motion_config_.omega_xy);
+    private_nh_.param("motion/omega/z", motion_config_.omega_z, motion_config_.omega_z);
+    private_nh_.param("motion/roll", motion_config_.roll, motion_config_.roll);
+    private_nh_.param("motion/pitch", motion_config_.pitch, motion_config_.pitch);
+    private_nh_.param("motion/yaw_rate", motion_config_.yaw_rate, motion_config_.yaw_rate);
+
+    // parse offline config:
+    private_nh_.param("offline/enable", offline_config_.enable, false);
+    private_nh_.param("offline/output_file", offline_config_.output_file, std::string("/tmp/imu_integration.bag"));
+    private_nh_.param("offline/start_time", offline_config_.start_time, 1.0);
+    private_nh_.param("offline/duration", offline_config_.duration, 3600.0);
+    private_nh_.param("offline/imu_frequency", offline_config_.imu_frequency, 1000.0);
+    private_nh_.param("offline/odom_frequency", offline_config_.odom_frequency, 100.0);
+    private_nh_.param("offline/seed", offline_config_.seed, 0);
+    private_nh_.param("offline/batch_size", offline_config_.batch_size, 1000);
+
+    if (offline_config_.enable) {
+        return;
+    }
+
     // init publishers:
     pub_imu_ = private_nh_.advertise<sensor_msgs::Imu>(imu_config_.topic_name, 500);
     pub_odom_ = private_nh_.advertise<nav_msgs::Odometry>(odom_config_.topic_name.ground_truth, 500);
@@ -93,57 +119,23 @@ void Activity::Run(void) {
     PublishMessages();
 }
 
-void Activity::GetGroundTruth(void) {
-    // acceleration:
-    double timestamp_in_sec = timestamp_.toSec();
-    double sin_w_xy_t = sin(kOmegaXY*timestamp_in_sec);
-    double cos_w_xy_t = cos(kOmegaXY*timestamp_in_sec);
-    double sin_w_z_t = sin(kOmegaZ*timestamp_in_sec);
-    double cos_w_z_t = cos(kOmegaZ*timestamp_in_sec);
-    double rho_x_w_xy = kRhoX*kOmegaXY;
-    double rho_y_w_xy = kRhoY*kOmegaXY;
-    double rho_z_w_z = kRhoZ*kOmegaZ;
-
-    Eigen::Vector3d p(
-        kRhoX*cos_w_xy_t, 
-        kRhoY*sin_w_xy_t, 
-        kRhoZ*sin_w_z_t
-    );
-    Eigen::Vector3d v(
-        -rho_x_w_xy*sin_w_xy_t, 
-         rho_y_w_xy*cos_w_xy_t, 
-         rho_z_w_z*cos_w_z_t
-    );
-    Eigen::Vector3d a(
-        -rho_x_w_xy*kOmegaXY*cos_w_xy_t, 
-        -rho_y_w_xy*kOmegaXY*sin_w_xy_t, 
-        -rho_z_w_z*kOmegaZ*sin_w_z_t
-    );
-
-    // angular velocity:
-    double sin_t = sin(timestamp_in_sec);
-    double cos_t = cos(timestamp_in_sec);
+bool Activity::RunOffline(void) {
+    OfflineGenerator generator(imu_config_, odom_config_, motion_config_, offline_config_);
 
-    Eigen::Vector3d euler_angles(
-        kRoll*cos_t,
-        kPitch*sin_t,
-        kYaw*timestamp_in_sec
-    );
+    return generator.Generate();
+}
 
-    Eigen::Vector3d euler_angle_rates(
-        -kRoll*sin_t,
-        kPitch*cos_t,
-        kYaw
-    );
+void Activity::GetGroundTruth(void) {
+    MotionState state;
+    GetMotionState(motion_config_, G_, timestamp_.toSec(), state);
 
-    // transform to body frame:
-    R_gt_ = EulerAnglesToRotation(euler_angles);
-    t_gt_ = p;
-    v_gt_ = v;
+    R_gt_ = state.R;
+    t_gt_ = state.t;
+    v_gt_ = state.v;
     // a. angular velocity:
-    angular_vel_ = EulerAngleRatesToBodyAngleRates(euler_angles, euler_angle_rates);
+    angular_vel_ = state.angular_vel;
     // b. linear acceleration:
-    linear_acc_ = R_gt_.transpose() * (a + G_);
+    linear_acc_ = state.linear_acc;
 }
 
 void Activity::AddNoise(double delta_t) {
@@ -223,49 +215,6 @@ Eigen::Vector3d Activity::GetGaussianNoise(double stddev) {
     );
 }
 
-Eigen::Matrix3d Activity::EulerAnglesToRotation(
-    const Eigen::Vector3d &euler_angles
-) {
-    // parse Euler angles:
-    double roll = euler_angles.x();
-    double pitch = euler_angles.y();
-    double yaw = euler_angles.z();
-
-    double cr =  cos(roll); double sr =  sin(roll);
-    double cp = cos(pitch); double sp = sin(pitch);
-    double cy =   cos(yaw); double sy =   sin(yaw);
-
-    Eigen::Matrix3d R_ib;
-    
-    R_ib << 
-        cy*cp,  cy*sp*sr - sy*cr,   sy*sr + cy* cr*sp,
-        sy*cp, cy *cr + sy*sr*sp,    sp*sy*cr - cy*sr,
-          -sp,             cp*sr,               cp*cr;
-
-    return R_ib;
-}
-
-Eigen::Vector3d Activity::EulerAngleRatesToBodyAngleRates(
-    const Eigen::Vector3d &euler_angles, 
-    const Eigen::Vector3d &euler_angle_rates
-) {
-    // parse euler angles:
-    double roll = euler_angles(0);
-    double pitch = euler_angles(1);
-
-    double cr =  cos(roll); double sr =  sin(roll);
-    double cp = cos(pitch); double sp = sin(pitch);
-
-    Eigen::Matrix3d R;
-
-    R <<  
-        1,     0,    - sp,
-        0,    cr,   sr*cp,
-        0,   -sr,   cr*cp;
-
-    return R * euler_angle_rates;
-}
-
 }  // namespace generator
 
 }  // namespace imu_integration
\ No newline at end of file
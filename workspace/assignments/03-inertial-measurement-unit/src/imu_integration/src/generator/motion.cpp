@@ -0,0 +1,132 @@
+/*
+ * @Description: motion equation of the IMU measurement generator
+ * @Author: Ge Yao
+ * @Date: 2021-01-01 10:12:36
+ */
+#include "imu_integration/generator/node_constants.hpp"
+#include "imu_integration/generator/motion.hpp"
+
+#include <math.h>
+
+namespace imu_integration {
+
+namespace generator {
+
+MotionConfig GetDefaultMotionConfig(void) {
+    MotionConfig motion;
+
+    motion.rho.x = kRhoX;
+    motion.rho.y = kRhoY;
+    motion.rho.z = kRhoZ;
+    motion.omega_xy = kOmegaXY;
+    motion.omega_z = kOmegaZ;
+
+    motion.roll = kRoll;
+    motion.pitch = kPitch;
+    motion.yaw_rate = kYaw;
+
+    return motion;
+}
+
+void GetMotionState(
+    const MotionConfig &motion, const Eigen::Vector3d &G,
+    double t,
+    MotionState &state
+) {
+    // acceleration:
+    double sin_w_xy_t = sin(motion.omega_xy*t);
+    double cos_w_xy_t = cos(motion.omega_xy*t);
+    double sin_w_z_t = sin(motion.omega_z*t);
+    double cos_w_z_t = cos(motion.omega_z*t);
+    double rho_x_w_xy = motion.rho.x*motion.omega_xy;
+    double rho_y_w_xy = motion.rho.y*motion.omega_xy;
+    double rho_z_w_z = motion.rho.z*motion.omega_z;
+
+    Eigen::Vector3d p(
+        motion.rho.x*cos_w_xy_t,
+        motion.rho.y*sin_w_xy_t,
+        motion.rho.z*sin_w_z_t
+    );
+    Eigen::Vector3d v(
+        -rho_x_w_xy*sin_w_xy_t,
+         rho_y_w_xy*cos_w_xy_t,
+         rho_z_w_z*cos_w_z_t
+    );
+    Eigen::Vector3d a(
+        -rho_x_w_xy*motion.omega_xy*cos_w_xy_t,
+        -rho_y_w_xy*motion.omega_xy*sin_w_xy_t,
+        -rho_z_w_z*motion.omega_z*sin_w_z_t
+    );
+
+    // angular velocity:
+    double sin_t = sin(t);
+    double cos_t = cos(t);
+
+    Eigen::Vector3d euler_angles(
+        motion.roll*cos_t,
+        motion.pitch*sin_t,
+        motion.yaw_rate*t
+    );
+
+    Eigen::Vector3d euler_angle_rates(
+        -motion.roll*sin_t,
+        motion.pitch*cos_t,
+        motion.yaw_rate
+    );
+
+    // transform to body frame:
+    state.R = EulerAnglesToRotation(euler_angles);
+    state.t = p;
+    state.v = v;
+    // a. angular velocity:
+    state.angular_vel = EulerAngleRatesToBodyAngleRates(euler_angles, euler_angle_rates);
+    // b. linear acceleration:
+    state.linear_acc = state.R.transpose() * (a + G);
+}
+
+Eigen::Matrix3d EulerAnglesToRotation(
+    const Eigen::Vector3d &euler_angles
+) {
+    // parse Euler angles:
+    double roll = euler_angles.x();
+    double pitch = euler_angles.y();
+    double yaw = euler_angles.z();
+
+    double cr =  cos(roll); double sr =  sin(roll);
+    double cp = cos(pitch); double sp = sin(pitch);
+    double cy =   cos(yaw); double sy =   sin(yaw);
+
+    Eigen::Matrix3d R_ib;
+
+    R_ib <<
+        cy*cp,  cy*sp*sr - sy*cr,   sy*sr + cy* cr*sp,
+        sy*cp, cy *cr + sy*sr*sp,    sp*sy*cr - cy*sr,
+          -sp,             cp*sr,               cp*cr;
+
+    return R_ib;
+}
+
+Eigen::Vector3d EulerAngleRatesToBodyAngleRates(
+    const Eigen::Vector3d &euler_angles,
+    const Eigen::Vector3d &euler_angle_rates
+) {
+    // parse euler angles:
+    double roll = euler_angles(0);
+    double pitch = euler_angles(1);
+
+    double cr =  cos(roll); double sr =  sin(roll);
+    double cp = cos(pitch); double sp = sin(pitch);
+
+    Eigen::Matrix3d R;
+
+    R <<
+        1,     0,    - sp,
+        0,    cr,   sr*cp,
+        0,   -sr,   cr*cp;
+
+    return R * euler_angle_rates;
+}
+
+}  // namespace generator
+
+}  // namespace imu_integration
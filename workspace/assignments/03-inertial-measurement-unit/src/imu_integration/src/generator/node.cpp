@@ -11,7 +11,12 @@ int main(int argc, char** argv) {
     imu_integration::generator::Activity activity;
 
     activity.Init();
-    
+
+    // offline, into a rosbag without waiting for the clock:
+    if (activity.IsOffline()) {
+        return activity.RunOffline() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     // 100 Hz:
     ros::Rate loop_rate(100);
     while (ros::ok())
@@ -0,0 +1,223 @@
+/*
+ * @Description: offline IMU measurement generation, into a rosbag
+ * @Author: Ge Yao
+ * @Date: 2021-01-01 10:12:36
+ */
+#include "imu_integration/generator/offline_generator.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <math.h>
+
+#include <rosbag/exceptions.h>
+
+namespace imu_integration {
+
+namespace generator {
+
+OfflineGenerator::OfflineGenerator(
+    const IMUConfig &imu_config,
+    const OdomConfig &odom_config,
+    const MotionConfig &motion_config,
+    const OfflineConfig &offline_config
+) : imu_config_(imu_config),
+    odom_config_(odom_config),
+    motion_config_(motion_config),
+    offline_config_(offline_config),
+    uniform_generator_(static_cast<uint64_t>(offline_config.seed)),
+    G_(imu_config.gravity.x, imu_config.gravity.y, imu_config.gravity.z),
+    angular_vel_bias_(
+        imu_config.bias.angular_velocity.x,
+        imu_config.bias.angular_velocity.y,
+        imu_config.bias.angular_velocity.z
+    ),
+    linear_acc_bias_(
+        imu_config.bias.linear_acceleration.x,
+        imu_config.bias.linear_acceleration.y,
+        imu_config.bias.linear_acceleration.z
+    )
+{
+    // noise stddevs at the IMU rate, as in the live generator:
+    double sqrt_delta_t = sqrt(1.0 / offline_config_.imu_frequency);
+    noise_scale_.segment<3>(0).setConstant(imu_config_.gyro_bias_stddev * sqrt_delta_t);
+    noise_scale_.segment<3>(3).setConstant(imu_config_.acc_bias_stddev * sqrt_delta_t);
+    noise_scale_.segment<3>(6).setConstant(imu_config_.gyro_noise_stddev / sqrt_delta_t);
+    noise_scale_.segment<3>(9).setConstant(imu_config_.acc_noise_stddev / sqrt_delta_t);
+
+    // constant message fields:
+    message_imu_.header.frame_id = imu_config_.frame_id;
+    message_odom_.header.frame_id = odom_config_.frame_id;
+    message_odom_.child_frame_id = odom_config_.frame_id;
+}
+
+bool OfflineGenerator::Generate(void) {
+    if (!IsValid()) {
+        return false;
+    }
+
+    rosbag::Bag bag;
+    try {
+        bag.open(offline_config_.output_file, rosbag::bagmode::Write);
+    } catch (const rosbag::BagException &e) {
+        ROS_ERROR("Cannot open %s: %s", offline_config_.output_file.c_str(), e.what());
+        return false;
+    }
+
+    const int64_t num_samples = static_cast<int64_t>(offline_config_.duration * offline_config_.imu_frequency) + 1;
+    const int64_t odom_stride = std::max<int64_t>(
+        1, static_cast<int64_t>(round(offline_config_.imu_frequency / offline_config_.odom_frequency))
+    );
+    const int64_t num_progress = std::max<int64_t>(1, num_samples / 10);
+
+    ros::WallTime start = ros::WallTime::now();
+    MotionState state;
+    for (int64_t batch_begin = 0; batch_begin < num_samples; batch_begin += offline_config_.batch_size) {
+        const int batch_size = static_cast<int>(
+            std::min<int64_t>(offline_config_.batch_size, num_samples - batch_begin)
+        );
+
+        // a. noises of the whole batch:
+        GenerateNoise(batch_size);
+
+        // b. ground truth from motion equation, with the noises applied:
+        for (int i = 0; i < batch_size; ++i) {
+            const int64_t k = batch_begin + i;
+            // each time stamp from its index, no drift over hours of data:
+            const ros::Time timestamp(offline_config_.start_time + k / offline_config_.imu_frequency);
+
+            GetMotionState(motion_config_, G_, timestamp.toSec(), state);
+
+            SetIMUMessage(timestamp, state, i);
+            bag.write(imu_config_.topic_name, timestamp, message_imu_);
+
+            if (k % odom_stride == 0) {
+                SetOdometryMessage(timestamp, state);
+                bag.write(odom_config_.topic_name.ground_truth, timestamp, message_odom_);
+            }
+
+            if ((k + 1) % num_progress == 0) {
+                ROS_INFO(
+                    "%ld / %ld IMU measurements written to %s",
+                    static_cast<long>(k + 1), static_cast<long>(num_samples), offline_config_.output_file.c_str()
+                );
+            }
+        }
+    }
+    bag.close();
+
+    ROS_INFO(
+        "%.1f s of measurements generated in %.1f s",
+        offline_config_.duration, (ros::WallTime::now() - start).toSec()
+    );
+
+    return true;
+}
+
+bool OfflineGenerator::IsValid(void) const {
+    if (offline_config_.output_file.empty()) {
+        ROS_ERROR("Offline generation needs an output file.");
+        return false;
+    }
+
+    if (
+        offline_config_.start_time <= 0.0 ||
+        offline_config_.duration <= 0.0 ||
+        offline_config_.imu_frequency <= 0.0 ||
+        offline_config_.odom_frequency <= 0.0
+    ) {
+        ROS_ERROR("Offline generation needs a positive start time, duration & frequencies.");
+        return false;
+    }
+
+    if (offline_config_.batch_size <= 0) {
+        ROS_ERROR("Offline generation needs a positive batch size.");
+        return false;
+    }
+
+    return true;
+}
+
+void OfflineGenerator::GenerateNoise(int num_samples) {
+    noise_.resize(Eigen::NoChange, num_samples);
+    GetStandardNormal(noise_.data(), static_cast<int>(noise_.size()));
+
+    noise_.array().colwise() *= noise_scale_;
+
+    // bias random walk, the increments accumulated over the batch:
+    for (int i = 0; i < num_samples; ++i) {
+        angular_vel_bias_ += noise_.block<3, 1>(0, i);
+        linear_acc_bias_ += noise_.block<3, 1>(3, i);
+        noise_.block<3, 1>(0, i) = angular_vel_bias_;
+        noise_.block<3, 1>(3, i) = linear_acc_bias_;
+    }
+}
+
+void OfflineGenerator::GetStandardNormal(double *data, int size) {
+    // Box-Muller, one pair of standard normals from each pair of uniforms in (0, 1]. the pairs are
+    // interleaved so the stream only depends on the seed, not on the size of the batch:
+    const int num_pairs = size / 2;
+    // 53 random bits to a double:
+    const double kUniformScale = 1.0 / 9007199254740992.0;
+
+    Eigen::ArrayXd u(num_pairs), v(num_pairs);
+    for (int i = 0; i < num_pairs; ++i) {
+        u(i) = ((uniform_generator_() >> 11) + 1) * kUniformScale;
+        v(i) = ((uniform_generator_() >> 11) + 1) * kUniformScale;
+    }
+
+    const Eigen::ArrayXd r = (-2.0 * u.log()).sqrt();
+    const Eigen::ArrayXd theta = (2.0 * M_PI) * v;
+
+    Eigen::Map<Eigen::ArrayXd, 0, Eigen::InnerStride<2> >(data, num_pairs) = r * theta.cos();
+    Eigen::Map<Eigen::ArrayXd, 0, Eigen::InnerStride<2> >(data + 1, num_pairs) = r * theta.sin();
+}
+
+void OfflineGenerator::SetIMUMessage(const ros::Time &timestamp, const MotionState &state, int index) {
+    // apply bias & measurement noise:
+    Eigen::Vector3d angular_vel = state.angular_vel + noise_.block<3, 1>(0, index) + noise_.block<3, 1>(6, index);
+    Eigen::Vector3d linear_acc = state.linear_acc + noise_.block<3, 1>(3, index) + noise_.block<3, 1>(9, index);
+
+    // a. set header:
+    message_imu_.header.stamp = timestamp;
+
+    // b. set orientation:
+    Eigen::Quaterniond q(state.R);
+    message_imu_.orientation.x = q.x();
+    message_imu_.orientation.y = q.y();
+    message_imu_.orientation.z = q.z();
+    message_imu_.orientation.w = q.w();
+    // c. set angular velocity:
+    message_imu_.angular_velocity.x = angular_vel.x();
+    message_imu_.angular_velocity.y = angular_vel.y();
+    message_imu_.angular_velocity.z = angular_vel.z();
+    // d. set linear acceleration:
+    message_imu_.linear_acceleration.x = linear_acc.x();
+    message_imu_.linear_acceleration.y = linear_acc.y();
+    message_imu_.linear_acceleration.z = linear_acc.z();
+}
+
+void OfflineGenerator::SetOdometryMessage(const ros::Time &timestamp, const MotionState &state) {
+    // a. set header:
+    message_odom_.header.stamp = timestamp;
+
+    // b. set orientation:
+    Eigen::Quaterniond q(state.R);
+    message_odom_.pose.pose.orientation.x = q.x();
+    message_odom_.pose.pose.orientation.y = q.y();
+    message_odom_.pose.pose.orientation.z = q.z();
+    message_odom_.pose.pose.orientation.w = q.w();
+
+    // c. set position:
+    message_odom_.pose.pose.position.x = state.t.x();
+    message_odom_.pose.pose.position.y = state.t.y();
+    message_odom_.pose.pose.position.z = state.t.z();
+
+    // d. set velocity:
+    message_odom_.twist.twist.linear.x = state.v.x();
+    message_odom_.twist.twist.linear.y = state.v.y();
+    message_odom_.twist.twist.linear.z = state.v.z();
+}
+
+}  // namespace generator
+
+}  // namespace imu_integration
@@ -0,0 +1,83 @@
+#include <iostream>
+#include <sys/time.h>
+
+#include "imu_tk/io_utils.h"
+#include "imu_tk/calibration.h"
+
+using namespace std;
+using namespace imu_tk;
+using namespace Eigen;
+
+static double wallTime()
+{
+  struct timeval tv;
+  gettimeofday( &tv, NULL );
+  return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+static double calibrate( const vector< TriadData > &acc_data, const vector< TriadData > &gyro_data,
+                         bool analytic_jacobians, CalibratedTriad &acc_calib, CalibratedTriad &gyro_calib )
+{
+  CalibratedTriad init_acc_calib, init_gyro_calib;
+  init_acc_calib.setBias(
+    Vector3d(32768, 32768, 32768)
+  );
+  init_gyro_calib.setScale(
+    Vector3d(1.0/6258.0, 1.0/6258.0, 1.0/6258.0)
+  );
+
+  MultiPosCalibration mp_calib;
+
+  mp_calib.setInitStaticIntervalDuration(50.0);
+  mp_calib.setInitAccCalibration( init_acc_calib );
+  mp_calib.setInitGyroCalibration( init_gyro_calib );
+  mp_calib.setGravityMagnitude(9.81744);
+  mp_calib.enableAccUseMeans(false);
+  mp_calib.enableAnalyticJacobians( analytic_jacobians );
+
+  double start = wallTime();
+  mp_calib.calibrateAccGyro(acc_data, gyro_data );
+  double elapsed = wallTime() - start;
+
+  acc_calib = mp_calib.getAccCalib();
+  gyro_calib = mp_calib.getGyroCalib();
+  return elapsed;
+}
+
+static double maxDiff( const CalibratedTriad &calib0, const CalibratedTriad &calib1 )
+{
+  double diff = ( calib0.getMisalignmentMatrix() - calib1.getMisalignmentMatrix() ).cwiseAbs().maxCoeff();
+  diff = std::max( diff, ( calib0.getScaleMatrix() - calib1.getScaleMatrix() ).cwiseAbs().maxCoeff() );
+  diff = std::max( diff, ( calib0.getBiasVector() - calib1.getBiasVector() ).cwiseAbs().maxCoeff() );
+  return diff;
+}
+
+int main(int argc, char** argv)
+{
+  if( argc < 3 )
+  {
+    cout<<"Usage: "<<argv[0]<<" <acc data> <gyro data>, e.g. test_data/xsens_acc.mat test_data/xsens_gyro.mat"<<endl;
+    return -1;
+  }
+
+  vector< TriadData > acc_data, gyro_data;
+
+  cout<<"Importing IMU data from the Matlab matrix file : "<< argv[1]<<endl;
+  importAsciiData( argv[1], acc_data, imu_tk::TIMESTAMP_UNIT_SEC );
+  cout<<"Importing IMU data from the Matlab matrix file : "<< argv[2]<<endl;
+  importAsciiData( argv[2], gyro_data, imu_tk::TIMESTAMP_UNIT_SEC  );
+
+  CalibratedTriad auto_acc_calib, auto_gyro_calib, analytic_acc_calib, analytic_gyro_calib;
+  double auto_time = calibrate( acc_data, gyro_data, false, auto_acc_calib, auto_gyro_calib );
+  double analytic_time = calibrate( acc_data, gyro_data, true, analytic_acc_calib, analytic_gyro_calib );
+
+  cout<<endl<<"Automatic differentiation : "<<auto_time<<" s"<<endl
+      <<"Analytic Jacobians : "<<analytic_time<<" s"<<endl
+      <<"Speedup : "<<auto_time/analytic_time<<endl
+      <<"Max. difference of the accelerometers parameters : "
+      <<maxDiff( auto_acc_calib, analytic_acc_calib )<<endl
+      <<"Max. difference of the gyroscopes parameters : "
+      <<maxDiff( auto_gyro_calib, analytic_gyro_calib )<<endl;
+
+  return 0;
+}
@@ -0,0 +1,44 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+#include "imu_tk/io_utils.h"
+
+using namespace std;
+using namespace imu_tk;
+
+int main(int argc, char** argv)
+{
+  if( argc < 4 )
+  {
+    cout<<"Usage: "<<argv[0]<<" <ascii log> <binary log> <num triads> "
+        <<"[sec|msec|usec|nsec] [space|comma] [rate]"<<endl;
+    return -1;
+  }
+
+  int num_triads = atoi( argv[3] );
+  TimestampUnit unit = TIMESTAMP_UNIT_USEC;
+  if( argc > 4 )
+  {
+    if( !strcmp( argv[4], "sec" ) ) unit = TIMESTAMP_UNIT_SEC;
+    else if( !strcmp( argv[4], "msec" ) ) unit = TIMESTAMP_UNIT_MSEC;
+    else if( !strcmp( argv[4], "usec" ) ) unit = TIMESTAMP_UNIT_USEC;
+    else if( !strcmp( argv[4], "nsec" ) ) unit = TIMESTAMP_UNIT_NSEC;
+    else
+    {
+      cout<<"Unknown timestamp unit "<<argv[4]<<endl;
+      return -1;
+    }
+  }
+  DatasetType type = DATASET_SPACE_SEPARATED;
+  if( argc > 5 && !strcmp( argv[5], "comma" ) )
+    type = DATASET_COMMA_SEPARATED;
+  double rate = ( argc > 6 ) ? atof( argv[6] ) : 0;
+
+  cout<<"Converting IMU data from the ASCII file : "<< argv[1]<<endl;
+  if( !convertAsciiToBinary( argv[1], argv[2], num_triads, unit, type, rate ) )
+    return -1;
+  cout<<"Binary IMU log written to : "<< argv[2]<<endl;
+
+  return 0;
+}
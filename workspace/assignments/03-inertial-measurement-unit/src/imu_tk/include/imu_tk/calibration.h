@@ -260,6 +260,10 @@ public:
    *         period) are assumed known. */ 
   bool optimizeGyroBias() const { return optimize_gyro_bias_; };
   
+  /** @brief True if the cost functions provide analytic Jacobians instead of
+   *         automatic differentiation */ 
+  bool analyticJacobians() const { return analytic_jacobians_; };
+  
   /** @brief True if the verbose output is enabled */ 
   bool verboseOutput() const { return verbose_output_; };
   
@@ -302,6 +306,11 @@ public:
    *         (computed in the initial static period) are assumed known. */ 
   bool enableGyroBiasOptimization( bool enabled  ) { optimize_gyro_bias_ = enabled; };
   
+  /** @brief If the parameter enabled is true, the cost functions provide analytic Jacobians,
+   *         with the same residuals. If false, the Jacobians are obtained by automatic 
+   *         differentiation, which is much slower for the gyroscopes. Default is true. */ 
+  void enableAnalyticJacobians( bool enabled ) { analytic_jacobians_ = enabled; };
+  
   /** @brief If the parameter enabled is true, verbose output is activeted  */   
   void enableVerboseOutput( bool enabled ){ verbose_output_ = enabled; };
   
@@ -350,6 +359,7 @@ private:
   bool acc_use_means_;
   _T gyro_dt_;
   bool optimize_gyro_bias_;
+  bool analytic_jacobians_;
   std::vector< DataInterval > min_cost_static_intervals_;
   CalibratedTriad_<_T> init_acc_calib_, init_gyro_calib_;
   CalibratedTriad_<_T> acc_calib_, gyro_calib_;
@@ -29,6 +29,7 @@
 #pragma once
 
 #include <vector>
+#include <stdint.h>
 
 #include "imu_tk/base.h"
 
@@ -66,4 +67,65 @@ template <typename _T>
                         std::vector< TriadData_<_T> > &samples2, 
                         TimestampUnit unit = TIMESTAMP_UNIT_USEC,
                         DatasetType type = DATASET_SPACE_SEPARATED ); 
+
+/** @brief Header of the binary IMU log format.
+ * 
+ * The header is followed by the columns of the log: num_samples timestamps as 
+ * little endian float64 in timestamp_unit, then for each triad the x, y and z 
+ * columns with num_samples float32 values each. The columns can be used in place 
+ * from a memory mapped file, without any parsing. */
+struct BinaryLogHeader
+{
+  /** @brief "IMUTKBIN" */
+  char magic[8];
+  uint32_t version;
+  /** @brief 1, 2 or 3 triads per sample, e.g. acc, gyro and mag */
+  uint32_t num_triads;
+  /** @brief TimestampUnit of the timestamp column */
+  uint32_t timestamp_unit;
+  uint32_t reserved;
+  /** @brief Nominal sampling rate in Hz, 0 if unknown */
+  double rate;
+  uint64_t num_samples;
+  char padding[24];
+};
+
+/** @brief Import a binary IMU log (see BinaryLogHeader) written by exportBinaryData() 
+ *         or convertAsciiToBinary(). The file is memory mapped and the columns are 
+ *         copied into the samples vectors. The number of triads has to match the log.
+ * 
+ * @return False if the file can't be read or is not a valid log */
+template <typename _T> 
+  bool importBinaryData( const char *filename,
+                         std::vector< TriadData_<_T> > &samples );
+template <typename _T> 
+  bool importBinaryData( const char *filename,
+                         std::vector< TriadData_<_T> > &samples0,
+                         std::vector< TriadData_<_T> > &samples1 );
+template <typename _T> 
+  bool importBinaryData( const char *filename,
+                         std::vector< TriadData_<_T> > &samples0,
+                         std::vector< TriadData_<_T> > &samples1,
+                         std::vector< TriadData_<_T> > &samples2 );
+
+/** @brief Write the samples as a binary IMU log, with timestamps in seconds. 
+ *         All samples vectors need the same size, samples1 and samples2 are optional.
+ * 
+ * @param rate Nominal sampling rate in Hz stored in the header, 0 if unknown */
+template <typename _T> 
+  bool exportBinaryData( const char *filename,
+                         const std::vector< TriadData_<_T> > &samples0,
+                         const std::vector< TriadData_<_T> > *samples1 = NULL,
+                         const std::vector< TriadData_<_T> > *samples2 = NULL,
+                         double rate = 0 );
+
+/** @brief Convert an ASCII log as read by importAsciiData() into a binary IMU log. 
+ *         Timestamps are kept in their unit, which is stored in the header. The file 
+ *         is memory mapped and parsed with a single pass of strtod().
+ * 
+ * @param num_triads Number of triads per line, 1, 2 or 3
+ * @param rate Nominal sampling rate in Hz stored in the header, 0 if unknown */
+bool convertAsciiToBinary( const char *ascii_filename, const char *binary_filename,
+                           int num_triads, TimestampUnit unit = TIMESTAMP_UNIT_USEC,
+                           DatasetType type = DATASET_SPACE_SEPARATED, double rate = 0 );
 }
\ No newline at end of file
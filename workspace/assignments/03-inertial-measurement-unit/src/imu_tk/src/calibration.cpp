@@ -33,12 +33,43 @@
 
 #include <limits>
 #include <iostream>
+#include <string>
+#include <algorithm>
 #include "ceres/ceres.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 using namespace imu_tk;
 using namespace Eigen;
 using namespace std;
 
+// Accelerometer calibration with the static intervals of one threshold multiplier
+template <typename _T> struct AccCalibTrial
+{
+  int th_mult;
+  std::vector< DataInterval > static_intervals, extracted_intervals;
+  std::vector< TriadData_<_T> > static_samples;
+  std::vector< double > calib_params;
+  double final_cost;
+  std::string report;
+};
+
+static bool sameIntervals( const std::vector< DataInterval > &intervals0, 
+                           const std::vector< DataInterval > &intervals1 )
+{
+  if( intervals0.size() != intervals1.size() )
+    return false;
+  for( int i = 0; i < intervals0.size(); i++ )
+  {
+    if( intervals0[i].start_idx != intervals1[i].start_idx || 
+        intervals0[i].end_idx != intervals1[i].end_idx )
+      return false;
+  }
+  return true;
+}
+
 template <typename _T1> struct MultiPosAccResidual
 {
   MultiPosAccResidual( 
@@ -175,6 +206,239 @@ template <typename _T1> struct MultiPosGyroResidual
   const bool optimize_bias_;
 };
 
+/* Calibrated triad sample ms_mat*(raw - bias), see CalibratedTriad_::unbiasNormalize(), 
+ * and its 3x12 Jacobian with respect to the 12 parameters, ordered as in the 
+ * CalibratedTriad_ constructor */
+static inline void calibratedTriadJacobian( const double params[12], const Eigen::Vector3d &raw_samp,
+                                            Eigen::Vector3d &calib_samp, 
+                                            Eigen::Matrix< double, 3, 12> &jacobian )
+{
+  Eigen::Matrix3d mis_mat;
+  mis_mat <<  1.0       , -params[0],  params[1],
+              params[3] ,  1.0      , -params[2],
+             -params[4] ,  params[5],  1.0      ;
+  Eigen::Vector3d unbias_samp = raw_samp - Eigen::Vector3d( params[9], params[10], params[11] ),
+                  scale_samp( params[6]*unbias_samp(0), params[7]*unbias_samp(1), params[8]*unbias_samp(2) );
+  calib_samp = mis_mat*scale_samp;
+
+  jacobian.setZero();
+  // mis_yz, mis_zy, mis_zx, mis_xz, mis_xy, mis_yx:
+  jacobian(0,0) = -scale_samp(1);
+  jacobian(0,1) = scale_samp(2);
+  jacobian(1,2) = -scale_samp(2);
+  jacobian(1,3) = scale_samp(0);
+  jacobian(2,4) = -scale_samp(0);
+  jacobian(2,5) = scale_samp(1);
+  // s_x, s_y, s_z:
+  for( int j = 0; j < 3; j++ )
+    jacobian.col(6 + j) = mis_mat.col(j)*unbias_samp(j);
+  // b_x, b_y, b_z:
+  jacobian.block<3,3>(0,9) = -mis_mat*Eigen::Vector3d( params[6], params[7], params[8] ).asDiagonal();
+}
+
+/* Matrix of the quaternion quat such that: 
+ *   computeOmegaSkew( omega )*quat = quatOmegaMatrix( quat )*omega */
+static inline Eigen::Matrix< double, 4, 3> quatOmegaMatrix( const Eigen::Vector4d &quat )
+{
+  Eigen::Matrix< double, 4, 3> quat_mat;
+  quat_mat << -quat(1), -quat(2), -quat(3),
+               quat(0), -quat(3),  quat(2),
+               quat(3),  quat(0), -quat(1),
+              -quat(2),  quat(1),  quat(0);
+  return quat_mat;
+}
+
+/* Same residual of MultiPosAccResidual, with analytic Jacobian */
+template <typename _T1> class MultiPosAccAnalyticResidual : public ceres::SizedCostFunction<1, 9>
+{
+public:
+  MultiPosAccAnalyticResidual( 
+    const _T1 &g_mag, 
+    const Eigen::Matrix< _T1, 3 , 1> &sample 
+  ) : g_mag_(g_mag), sample_(sample.template cast<double>()){}
+  
+  virtual bool Evaluate( double const* const* parameters, double* residuals, double** jacobians ) const
+  {
+    const double *params = parameters[0];
+    
+    // Bottom left params in the misalignment matrix are set to zero, as in MultiPosAccResidual
+    const double calib_params[12] = { 0, 0, 0, 
+                                      params[0], params[1], params[2],
+                                      params[3], params[4], params[5],
+                                      params[6], params[7], params[8] };
+    Eigen::Vector3d calib_samp;
+    Eigen::Matrix< double, 3, 12> calib_jacobian;
+    calibratedTriadJacobian( calib_params, sample_, calib_samp, calib_jacobian );
+    
+    double calib_norm = calib_samp.norm();
+    residuals[0] = g_mag_ - calib_norm;
+    
+    if( jacobians != NULL && jacobians[0] != NULL )
+    {
+      Eigen::Map< Eigen::Matrix< double, 1, 9> > jacobian( jacobians[0] );
+      jacobian = -calib_samp.transpose()*calib_jacobian.rightCols<9>()/calib_norm;
+    }
+    return true;
+  }
+  
+  static ceres::CostFunction* Create ( const _T1 &g_mag, const Eigen::Matrix< _T1, 3 , 1> &sample )
+  {
+    return new MultiPosAccAnalyticResidual<_T1>( g_mag, sample );
+  }
+  
+private:
+  const double g_mag_;
+  const Eigen::Vector3d sample_;
+};
+
+/* Same residual of MultiPosGyroResidual, with analytic Jacobian. Only the gyroscopes 
+ * samples of the interval and the integration time steps are stored, in double. 
+ * The RK4 integration of integrateGyroInterval() is performed in double along with 
+ * the derivatives of the integrated quaternion with respect to the parameters */
+template <typename _T1> class MultiPosGyroAnalyticResidual : public ceres::CostFunction
+{
+public:
+  MultiPosGyroAnalyticResidual( const Eigen::Matrix< _T1, 3 , 1> &g_versor_pos0, 
+                                const Eigen::Matrix< _T1, 3 , 1> &g_versor_pos1,
+                                const std::vector< TriadData_<_T1> > &gyro_samples, 
+                                const DataInterval &gyro_interval_pos01, 
+                                _T1 dt, bool optimize_bias ) :
+  g_versor_pos0_(g_versor_pos0.template cast<double>()), 
+  g_versor_pos1_(g_versor_pos1.template cast<double>()),
+  optimize_bias_(optimize_bias)
+  {
+    set_num_residuals(3);
+    mutable_parameter_block_sizes()->push_back( optimize_bias_?12:9 );
+    
+    for( int i = gyro_interval_pos01.start_idx; i <= gyro_interval_pos01.end_idx; i++ )
+    {
+      gyro_samples_.push_back( gyro_samples[i].data().template cast<double>() );
+      if( i < gyro_interval_pos01.end_idx )
+        dts_.push_back( ( dt > _T1(0) )?double(dt):double(gyro_samples[i + 1].timestamp()) - 
+                                                   double(gyro_samples[i].timestamp()) );
+    }
+  }
+  
+  virtual bool Evaluate( double const* const* parameters, double* residuals, double** jacobians ) const
+  {
+    const double *params = parameters[0];
+    const int n_params = optimize_bias_?12:9;
+    const bool compute_jacobian = ( jacobians != NULL && jacobians[0] != NULL );
+    
+    double calib_params[12] = { 0 };
+    for( int j = 0; j < n_params; j++ )
+      calib_params[j] = params[j];
+    
+    Eigen::Vector4d quat( 1.0, 0, 0, 0 ); // Identity quaternion
+    Eigen::Matrix< double, 4, 12> d_quat = Eigen::Matrix< double, 4, 12>::Zero();
+    
+    Eigen::Vector3d omega0, omega1;
+    Eigen::Matrix< double, 3, 12> d_omega0, d_omega1;
+    if( !gyro_samples_.empty() )
+      calibratedTriadJacobian( calib_params, gyro_samples_[0], omega1, d_omega1 );
+    
+    for( int i = 0; i < dts_.size(); i++ )
+    {
+      const double dt = dts_[i];
+      omega0 = omega1;
+      d_omega0 = d_omega1;
+      calibratedTriadJacobian( calib_params, gyro_samples_[i + 1], omega1, d_omega1 );
+      
+      // RK4 step as in quatIntegrationStepRK4()
+      Eigen::Vector3d omega01 = 0.5*( omega0 + omega1 );
+      Eigen::Matrix4d omega_skew0, omega_skew01, omega_skew1;
+      computeOmegaSkew( omega0, omega_skew0 );
+      computeOmegaSkew( omega01, omega_skew01 );
+      computeOmegaSkew( omega1, omega_skew1 );
+      
+      Eigen::Vector4d k1 = 0.5*omega_skew0*quat,
+                      tmp_q2 = quat + 0.5*dt*k1,
+                      k2 = 0.5*omega_skew01*tmp_q2,
+                      tmp_q3 = quat + 0.5*dt*k2,
+                      k3 = 0.5*omega_skew01*tmp_q3,
+                      tmp_q4 = quat + dt*k3,
+                      k4 = 0.5*omega_skew1*tmp_q4;
+      const double mult1 = 1.0/6.0, mult2 = 1.0/3.0;
+      Eigen::Vector4d quat_res = quat + dt*(mult1*k1 + mult2*k2 + mult2*k3 + mult1*k4);
+      double quat_norm = quat_res.norm();
+      
+      if( compute_jacobian )
+      {
+        // Each RK4 coefficient depends on the parameters both through the rotational velocities and 
+        // through the quaternion it is applied to
+        Eigen::Matrix< double, 3, 12> d_omega01 = 0.5*( d_omega0 + d_omega1 );
+        Eigen::Matrix< double, 4, 12> d_k1 = 0.5*( omega_skew0*d_quat + quatOmegaMatrix( quat )*d_omega0 ),
+                                      d_tmp_q2 = d_quat + 0.5*dt*d_k1,
+                                      d_k2 = 0.5*( omega_skew01*d_tmp_q2 + quatOmegaMatrix( tmp_q2 )*d_omega01 ),
+                                      d_tmp_q3 = d_quat + 0.5*dt*d_k2,
+                                      d_k3 = 0.5*( omega_skew01*d_tmp_q3 + quatOmegaMatrix( tmp_q3 )*d_omega01 ),
+                                      d_tmp_q4 = d_quat + dt*d_k3,
+                                      d_k4 = 0.5*( omega_skew1*d_tmp_q4 + quatOmegaMatrix( tmp_q4 )*d_omega1 );
+        Eigen::Matrix< double, 4, 12> d_quat_res = d_quat + dt*(mult1*d_k1 + mult2*d_k2 + mult2*d_k3 + mult1*d_k4);
+        
+        // Normalization
+        quat = quat_res/quat_norm;
+        d_quat = ( Eigen::Matrix4d::Identity() - quat*quat.transpose() )*d_quat_res/quat_norm;
+      }
+      else
+        quat = quat_res/quat_norm;
+    }
+    
+    Eigen::Matrix3d rot_mat;
+    ceres::MatrixAdapter<double, 1, 3> rot_mat_adapter = ceres::ColumnMajorAdapter3x3( rot_mat.data() );
+    ceres::QuaternionToRotation( quat.data(), rot_mat_adapter );
+    
+    Eigen::Vector3d diff = rot_mat.transpose()*g_versor_pos0_ - g_versor_pos1_;
+    residuals[0] = diff(0);
+    residuals[1] = diff(1);
+    residuals[2] = diff(2);
+    
+    if( compute_jacobian )
+    {
+      // Derivatives of rot_mat with respect to the (unit) quaternion components. The derivative
+      // of the normalization in QuaternionToRotation() vanishes, since d_quat is orthogonal to quat
+      const double qw = quat(0), qx = quat(1), qy = quat(2), qz = quat(3);
+      Eigen::Matrix3d d_rot[4];
+      d_rot[0] <<  qw, -qz,  qy,
+                   qz,  qw, -qx,
+                  -qy,  qx,  qw;
+      d_rot[1] <<  qx,  qy,  qz,
+                   qy, -qx, -qw,
+                   qz,  qw, -qx;
+      d_rot[2] << -qy,  qx,  qw,
+                   qx,  qy,  qz,
+                  -qw,  qz, -qy;
+      d_rot[3] << -qz, -qw,  qx,
+                   qw, -qz,  qy,
+                   qx,  qy,  qz;
+      Eigen::Matrix< double, 3, 4> d_diff;
+      for( int k = 0; k < 4; k++ )
+        d_diff.col(k) = 2.0*d_rot[k].transpose()*g_versor_pos0_;
+      
+      Eigen::Map< Eigen::Matrix< double, 3, Eigen::Dynamic, Eigen::RowMajor > > jacobian( jacobians[0], 3, n_params );
+      jacobian = d_diff*d_quat.leftCols( n_params );
+    }
+    
+    return true;
+  }
+  
+  static ceres::CostFunction* Create ( const Eigen::Matrix< _T1, 3 , 1> &g_versor_pos0, 
+                                       const Eigen::Matrix< _T1, 3 , 1> &g_versor_pos1,
+                                       const std::vector< TriadData_<_T1> > &gyro_samples, 
+                                       const DataInterval &gyro_interval_pos01, 
+                                       _T1 dt, bool optimize_bias )
+  {
+    return new MultiPosGyroAnalyticResidual<_T1>( g_versor_pos0, g_versor_pos1, gyro_samples, 
+                                                  gyro_interval_pos01, dt, optimize_bias );
+  }
+  
+private:
+  const Eigen::Vector3d g_versor_pos0_, g_versor_pos1_;
+  std::vector< Eigen::Vector3d > gyro_samples_;
+  std::vector< double > dts_;
+  const bool optimize_bias_;
+};
+
 template <typename _T>
   MultiPosCalibration_<_T>::MultiPosCalibration_() :
   g_mag_(9.81),
@@ -184,6 +448,7 @@ template <typename _T>
   acc_use_means_(false),
   gyro_dt_(-1.0),
   optimize_gyro_bias_(false),
+  analytic_jacobians_(true),
   verbose_output_(false){}
 
 template <typename _T>
@@ -202,54 +467,82 @@ bool MultiPosCalibration_<_T>::calibrateAcc(
   Eigen::Matrix<_T, 3, 1> acc_variance = dataVariance( acc_samples, init_static_interval );
   _T norm_th = acc_variance.norm();
 
-  _T min_cost = std::numeric_limits< _T >::max();
-  int min_cost_th = -1;
-  std::vector< double > min_cost_calib_params;
+  // Each threshold multiplier is an independent calibration trial: the static intervals 
+  // are detected sequentially (it is linear in the number of samples), while the trials 
+  // are solved in parallel with one Ceres problem per trial 
+  std::vector< AccCalibTrial<_T> > trials;
   
   for (int th_mult = 2; th_mult <= 10; th_mult++)
   {
-    std::vector< imu_tk::DataInterval > static_intervals;
-    std::vector< imu_tk::TriadData_<_T> > static_samples;
-    std::vector< double > acc_calib_params(9);
-    
-    acc_calib_params[0] = init_acc_calib_.misXZ();
-    acc_calib_params[1] = init_acc_calib_.misXY();
-    acc_calib_params[2] = init_acc_calib_.misYX();
-    
-    acc_calib_params[3] = init_acc_calib_.scaleX();
-    acc_calib_params[4] = init_acc_calib_.scaleY();
-    acc_calib_params[5] = init_acc_calib_.scaleZ();
+    AccCalibTrial<_T> trial;
+    trial.th_mult = th_mult;
     
-    acc_calib_params[6] = init_acc_calib_.biasX();
-    acc_calib_params[7] = init_acc_calib_.biasY();
-    acc_calib_params[8] = init_acc_calib_.biasZ();
-    
-    std::vector< DataInterval > extracted_intervals;
-    staticIntervalsDetector ( acc_samples, th_mult*norm_th, static_intervals );
-    extractIntervalsSamples ( acc_samples, static_intervals, 
-                              static_samples, extracted_intervals,
+    staticIntervalsDetector ( acc_samples, th_mult*norm_th, trial.static_intervals );
+    extractIntervalsSamples ( acc_samples, trial.static_intervals, 
+                              trial.static_samples, trial.extracted_intervals,
                               interval_n_samples_, acc_use_means_ );
     
     if(verbose_output_) {
-      cout << "Accelerometers Calibration: Extracted "<< extracted_intervals.size()
+      cout << "Accelerometers Calibration: Extracted "<< trial.extracted_intervals.size()
            << " intervals using threshold multiplier "<< th_mult<<" -> ";
     }
 
     // TODO Perform here a quality test
-    if( extracted_intervals.size() < min_num_intervals_)
+    if( trial.extracted_intervals.size() < min_num_intervals_)
     {
       if( verbose_output_) cout<<"Not enough intervals, calibration is not possible"<<endl;
       continue;
     }
     
+    // The same extracted intervals give the same problem and the same residual, which 
+    // can't improve on the one of the lower threshold multiplier
+    int same_th_mult = -1;
+    for( int i = 0; i < trials.size() && same_th_mult < 0; i++ )
+    {
+      if( sameIntervals( trials[i].extracted_intervals, trial.extracted_intervals ) )
+        same_th_mult = trials[i].th_mult;
+    }
+    if( same_th_mult >= 0 )
+    {
+      if( verbose_output_) 
+        cout<<"Same intervals of threshold multiplier "<<same_th_mult<<", skipped"<<endl;
+      continue;
+    }
+    
     if( verbose_output_) cout<<"Trying calibrate... "<<endl;
+    trials.push_back( trial );
+  }
+  
+  int n_trials = trials.size(), solver_threads = 1;
+#ifdef _OPENMP
+  solver_threads = std::max( 1, omp_get_max_threads() / std::max( 1, n_trials ) );
+#endif
+
+  #pragma omp parallel for schedule(dynamic)
+  for( int t = 0; t < n_trials; t++ )
+  {
+    AccCalibTrial<_T> &trial = trials[t];
+    std::vector< double > &acc_calib_params = trial.calib_params;
+    acc_calib_params.resize(9);
+    
+    acc_calib_params[0] = init_acc_calib_.misXZ();
+    acc_calib_params[1] = init_acc_calib_.misXY();
+    acc_calib_params[2] = init_acc_calib_.misYX();
+    
+    acc_calib_params[3] = init_acc_calib_.scaleX();
+    acc_calib_params[4] = init_acc_calib_.scaleY();
+    acc_calib_params[5] = init_acc_calib_.scaleZ();
+    
+    acc_calib_params[6] = init_acc_calib_.biasX();
+    acc_calib_params[7] = init_acc_calib_.biasY();
+    acc_calib_params[8] = init_acc_calib_.biasZ();
     
     ceres::Problem problem;
-    for( int i = 0; i < static_samples.size(); i++)
+    for( int i = 0; i < trial.static_samples.size(); i++)
     {
-      ceres::CostFunction* cost_function = MultiPosAccResidual<_T>::Create ( 
-        g_mag_, static_samples[i].data() 
-      );
+      ceres::CostFunction* cost_function = analytic_jacobians_ ?
+        MultiPosAccAnalyticResidual<_T>::Create ( g_mag_, trial.static_samples[i].data() ) :
+        MultiPosAccResidual<_T>::Create ( g_mag_, trial.static_samples[i].data() );
 
       problem.AddResidualBlock ( 
         cost_function,           /* error fuction */
@@ -258,20 +551,40 @@ bool MultiPosCalibration_<_T>::calibrateAcc(
       ); 
     }
     
+    // The progress of the parallel trials would be interleaved, the report of each 
+    // trial is printed after all of them are solved
     ceres::Solver::Options options;
     options.linear_solver_type = ceres::DENSE_QR;
-    options.minimizer_progress_to_stdout = verbose_output_;
+    options.minimizer_progress_to_stdout = false;
+    options.num_threads = solver_threads;
 
     ceres::Solver::Summary summary;
     ceres::Solve ( options, &problem, &summary );
-    if( summary.final_cost < min_cost)
+    trial.final_cost = summary.final_cost;
+    if( verbose_output_ )
+      trial.report = summary.BriefReport();
+  }
+  
+  _T min_cost = std::numeric_limits< _T >::max();
+  int min_cost_th = -1;
+  std::vector< double > min_cost_calib_params;
+  
+  // Trials in increasing threshold multiplier, so that ties are solved as before
+  for( int t = 0; t < n_trials; t++ )
+  {
+    const AccCalibTrial<_T> &trial = trials[t];
+    if( verbose_output_ )
+      cout << "Accelerometers Calibration: threshold multiplier " << trial.th_mult 
+           << " " << trial.report << endl;
+    
+    if( trial.final_cost < min_cost)
     {
-      min_cost = summary.final_cost;
-      min_cost_th = th_mult;
-      min_cost_static_intervals_ = static_intervals;
-      min_cost_calib_params = acc_calib_params;
+      min_cost = trial.final_cost;
+      min_cost_th = trial.th_mult;
+      min_cost_static_intervals_ = trial.static_intervals;
+      min_cost_calib_params = trial.calib_params;
     } 
-    cout << "residual " << summary.final_cost << endl;
+    cout << "residual " << trial.final_cost << endl;
   }
   
   if( min_cost_th < 0 )
@@ -409,7 +722,9 @@ template <typename _T>
     
     DataInterval gyro_interval(gyro_idx0, gyro_idx1);
     
-    ceres::CostFunction* cost_function =
+    ceres::CostFunction* cost_function = analytic_jacobians_ ?
+      MultiPosGyroAnalyticResidual<_T>::Create ( g_versor_pos0, g_versor_pos1, calib_gyro_samples_,
+                                                 gyro_interval, gyro_dt_, optimize_gyro_bias_ ) :
       MultiPosGyroResidual<_T>::Create ( g_versor_pos0, g_versor_pos1, calib_gyro_samples_,
                                          gyro_interval, gyro_dt_, optimize_gyro_bias_ );
 
@@ -45,13 +45,32 @@ template <typename _T>
  
   intervals.clear();
   
+  // Prefix sums of the samples and of their squares, so that the local variance is 
+  // computed in constant time for each window. The samples are shifted by the first one 
+  // to limit the cancellation of the sums of squares, and accumulated in double precision
+  int n_samps = samples.size();
+  Matrix< double, 3, 1> offset = samples[0].data().template cast<double>();
+  std::vector< Matrix< double, 3, 1> > sum ( n_samps + 1 ), sq_sum ( n_samps + 1 );
+  sum[0].setZero();
+  sq_sum[0].setZero();
+  for( int i = 0; i < n_samps; i++ )
+  {
+    Matrix< double, 3, 1> s = samples[i].data().template cast<double>() - offset;
+    sum[i + 1] = sum[i] + s;
+    sq_sum[i + 1] = sq_sum[i] + ( s.array() * s.array() ).matrix();
+  }
+  
   bool look_for_start = true;
   imu_tk::DataInterval current_interval;
   
   for( int i = h; i < samples.size() - h; i++ )
   {
-    Matrix< _T, 3, 1> variance = dataVariance( samples, DataInterval( i - h, i + h) );
-    _T norm = variance.norm();
+    // Same unbiased estimator of dataVariance(), inside DataInterval( i - h, i + h)
+    Matrix< double, 3, 1> w_sum = sum[i + h + 1] - sum[i - h], 
+                          w_sq_sum = sq_sum[i + h + 1] - sq_sum[i - h];
+    Matrix< double, 3, 1> variance = ( ( w_sq_sum.array() - w_sum.array() * w_sum.array() / win_size ) / 
+                                       ( win_size - 1 ) ).max( 0.0 ).matrix();
+    _T norm = _T( variance.norm() );
     
     if( look_for_start )
     {
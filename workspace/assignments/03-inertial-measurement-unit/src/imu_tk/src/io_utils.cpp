@@ -32,6 +32,13 @@
 #include <fstream>
 #include <string>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 // TODO Add setlocale()
 
@@ -183,6 +190,296 @@ void imu_tk::importAsciiData ( const char *filename,
   }
 }
 
+namespace
+{
+const char BINARY_LOG_MAGIC[8] = { 'I', 'M', 'U', 'T', 'K', 'B', 'I', 'N' };
+const uint32_t BINARY_LOG_VERSION = 1;
+
+/* Read only memory mapping of a whole file. The mapping is followed by at least 
+ * one zero byte, so that strtod() always stops inside of it */
+class MappedFile
+{
+public:
+  MappedFile() : data_ ( NULL ), size_ ( 0 ), mapped_size_ ( 0 ) {};
+  ~MappedFile()
+  {
+    if ( data_ )
+      munmap ( const_cast<char *> ( data_ ), mapped_size_ );
+  };
+
+  bool open ( const char *filename )
+  {
+    int fd = ::open ( filename, O_RDONLY );
+    if ( fd < 0 )
+      return false;
+
+    struct stat st;
+    if ( fstat ( fd, &st ) != 0 || st.st_size == 0 )
+    {
+      close ( fd );
+      return false;
+    }
+    size_ = st.st_size;
+
+    // reserve one more page of zeros, then map the file over the start of it
+    long page_size = sysconf ( _SC_PAGESIZE );
+    mapped_size_ = ( size_ / page_size + 1 ) * page_size;
+    void *reserved = mmap ( NULL, mapped_size_, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if ( reserved == MAP_FAILED )
+    {
+      close ( fd );
+      return false;
+    }
+    void *mapped = mmap ( reserved, size_, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0 );
+    close ( fd );
+    if ( mapped == MAP_FAILED )
+    {
+      munmap ( reserved, mapped_size_ );
+      return false;
+    }
+
+    data_ = static_cast<const char *> ( mapped );
+    madvise ( mapped, size_, MADV_SEQUENTIAL );
+    return true;
+  };
+
+  const char *data() const { return data_; };
+  size_t size() const { return size_; };
+
+private:
+  MappedFile ( const MappedFile & );
+  MappedFile & operator = ( const MappedFile & );
+
+  const char *data_;
+  size_t size_, mapped_size_;
+};
+
+template <typename _T>
+bool importBinaryTriads ( const char *filename, vector< imu_tk::TriadData_<_T> > *samples[],
+                          int num_triads )
+{
+  for ( int i = 0; i < num_triads; i++ )
+    samples[i]->clear();
+
+  MappedFile file;
+  if ( !file.open ( filename ) )
+  {
+    cout<<"importBinaryData(): can't read "<<filename<<endl;
+    return false;
+  }
+
+  imu_tk::BinaryLogHeader header;
+  if ( file.size() < sizeof ( header ) )
+  {
+    cout<<"importBinaryData(): "<<filename<<" is not a binary IMU log"<<endl;
+    return false;
+  }
+  memcpy ( &header, file.data(), sizeof ( header ) );
+  if ( memcmp ( header.magic, BINARY_LOG_MAGIC, sizeof ( header.magic ) ) != 0 ||
+       header.version != BINARY_LOG_VERSION || header.timestamp_unit == 0 )
+  {
+    cout<<"importBinaryData(): "<<filename<<" is not a binary IMU log"<<endl;
+    return false;
+  }
+  if ( header.num_triads != uint32_t ( num_triads ) )
+  {
+    cout<<"importBinaryData(): "<<filename<<" has "<<header.num_triads
+        <<" triads per sample, "<<num_triads<<" requested"<<endl;
+    return false;
+  }
+
+  size_t n = header.num_samples;
+  if ( file.size() < sizeof ( header ) + n * ( sizeof ( double ) + 3 * num_triads * sizeof ( float ) ) )
+  {
+    cout<<"importBinaryData(): "<<filename<<" is truncated"<<endl;
+    return false;
+  }
+
+  // the columns are aligned, the header has 64 bytes
+  const double *ts = reinterpret_cast<const double *> ( file.data() + sizeof ( header ) );
+  const float *values = reinterpret_cast<const float *> ( ts + n );
+  double unit = header.timestamp_unit;
+  for ( int i = 0; i < num_triads; i++ )
+  {
+    const float *x = values + ( 3 * i ) * n, *y = x + n, *z = y + n;
+    vector< imu_tk::TriadData_<_T> > &triads = *samples[i];
+    triads.reserve ( n );
+    for ( size_t j = 0; j < n; j++ )
+      triads.push_back ( imu_tk::TriadData_<_T> ( _T ( ts[j] / unit ), _T ( x[j] ), _T ( y[j] ), _T ( z[j] ) ) );
+  }
+
+  return true;
+}
+
+bool writeBinaryLog ( const char *filename, int num_triads, uint32_t timestamp_unit, 
+                      double rate, const vector<double> &ts, const vector<float> &values )
+{
+  imu_tk::BinaryLogHeader header;
+  memset ( &header, 0, sizeof ( header ) );
+  memcpy ( header.magic, BINARY_LOG_MAGIC, sizeof ( header.magic ) );
+  header.version = BINARY_LOG_VERSION;
+  header.num_triads = num_triads;
+  header.timestamp_unit = timestamp_unit;
+  header.rate = rate;
+  header.num_samples = ts.size();
+
+  FILE *file = fopen ( filename, "wb" );
+  if ( !file )
+  {
+    cout<<"exportBinaryData(): can't write "<<filename<<endl;
+    return false;
+  }
+
+  bool ok = fwrite ( &header, sizeof ( header ), 1, file ) == 1;
+  if ( ok && !ts.empty() )
+  {
+    ok = fwrite ( ts.data(), sizeof ( double ), ts.size(), file ) == ts.size() &&
+         fwrite ( values.data(), sizeof ( float ), values.size(), file ) == values.size();
+  }
+  ok = ( fclose ( file ) == 0 ) && ok;
+  if ( !ok )
+    cout<<"exportBinaryData(): error writing "<<filename<<endl;
+
+  return ok;
+}
+}
+
+template <typename _T>
+bool imu_tk::importBinaryData ( const char *filename, vector< TriadData_<_T> > &samples )
+{
+  vector< TriadData_<_T> > *triads[] = { &samples };
+  return importBinaryTriads ( filename, triads, 1 );
+}
+
+template <typename _T>
+bool imu_tk::importBinaryData ( const char *filename, 
+                                vector< TriadData_<_T> > &samples0,
+                                vector< TriadData_<_T> > &samples1 )
+{
+  vector< TriadData_<_T> > *triads[] = { &samples0, &samples1 };
+  return importBinaryTriads ( filename, triads, 2 );
+}
+
+template <typename _T>
+bool imu_tk::importBinaryData ( const char *filename, 
+                                vector< TriadData_<_T> > &samples0,
+                                vector< TriadData_<_T> > &samples1,
+                                vector< TriadData_<_T> > &samples2 )
+{
+  vector< TriadData_<_T> > *triads[] = { &samples0, &samples1, &samples2 };
+  return importBinaryTriads ( filename, triads, 3 );
+}
+
+template <typename _T>
+bool imu_tk::exportBinaryData ( const char *filename, 
+                                const vector< TriadData_<_T> > &samples0,
+                                const vector< TriadData_<_T> > *samples1,
+                                const vector< TriadData_<_T> > *samples2,
+                                double rate )
+{
+  const vector< TriadData_<_T> > *triads[] = { &samples0, samples1, samples2 };
+  int num_triads = samples2 ? 3 : ( samples1 ? 2 : 1 );
+  size_t n = samples0.size();
+  for ( int i = 0; i < num_triads; i++ )
+  {
+    if ( !triads[i] || triads[i]->size() != n )
+    {
+      cout<<"exportBinaryData(): all samples need the same size"<<endl;
+      return false;
+    }
+  }
+
+  vector<double> ts ( n );
+  vector<float> values ( 3 * num_triads * n );
+  for ( size_t j = 0; j < n; j++ )
+    ts[j] = samples0[j].timestamp();
+  for ( int i = 0; i < num_triads; i++ )
+  {
+    for ( int axis = 0; axis < 3; axis++ )
+    {
+      float *column = &values[( 3 * i + axis ) * n];
+      for ( size_t j = 0; j < n; j++ )
+        column[j] = float ( ( *triads[i] ) [j] ( axis ) );
+    }
+  }
+
+  return writeBinaryLog ( filename, num_triads, TIMESTAMP_UNIT_SEC, rate, ts, values );
+}
+
+bool imu_tk::convertAsciiToBinary ( const char *ascii_filename, const char *binary_filename,
+                                    int num_triads, TimestampUnit unit, DatasetType type, 
+                                    double rate )
+{
+  if ( num_triads < 1 || num_triads > 3 )
+  {
+    cout<<"convertAsciiToBinary(): 1, 2 or 3 triads per line"<<endl;
+    return false;
+  }
+
+  MappedFile file;
+  if ( !file.open ( ascii_filename ) )
+  {
+    cout<<"convertAsciiToBinary(): can't read "<<ascii_filename<<endl;
+    return false;
+  }
+
+  const int num_values = 3 * num_triads;
+  vector<double> ts;
+  // interleaved while parsing, transposed into columns below
+  vector<float> rows;
+  double d[9];
+
+  const char *p = file.data(), *end = file.data() + file.size();
+  int l = 0;
+  while ( p < end )
+  {
+    double t;
+    int res = 0;
+    for ( ; res < num_values + 1; res++ )
+    {
+      // separators, without crossing the end of line
+      while ( p < end && ( *p == ' ' || *p == '\t' || 
+              ( type == DATASET_COMMA_SEPARATED && *p == ',' ) ) )
+        p++;
+      if ( p >= end || *p == '\n' || *p == '\r' )
+        break;
+
+      char *next;
+      double v = strtod ( p, &next );
+      if ( next == p )
+        break;
+      p = next;
+      if ( res == 0 )
+        t = v;
+      else
+        d[res - 1] = v;
+    }
+
+    if ( res != num_values + 1 )
+    {
+      cout<<"convertAsciiToBinary(): error importing data in line "<<l<<", skipped"<<endl;
+    }
+    else
+    {
+      ts.push_back ( t );
+      for ( int i = 0; i < num_values; i++ )
+        rows.push_back ( float ( d[i] ) );
+    }
+
+    const char *eol = static_cast<const char *> ( memchr ( p, '\n', end - p ) );
+    p = eol ? eol + 1 : end;
+    l++;
+  }
+
+  size_t n = ts.size();
+  vector<float> values ( rows.size() );
+  for ( size_t j = 0; j < n; j++ )
+    for ( int i = 0; i < num_values; i++ )
+      values[i * n + j] = rows[j * num_values + i];
+
+  return writeBinaryLog ( binary_filename, num_triads, unit, rate, ts, values );
+}
+
 template void imu_tk::importAsciiData<double> ( const char *filename,
     vector< TriadData_<double> > &samples,
     TimestampUnit unit, DatasetType type );
@@ -207,3 +504,31 @@ template void imu_tk::importAsciiData<float> ( const char *filename,
     vector< TriadData_<float> > &samples1,
     vector< TriadData_<float> > &samples2,
     TimestampUnit unit, DatasetType type );
+template bool imu_tk::importBinaryData<double> ( const char *filename,
+    vector< TriadData_<double> > &samples );
+template bool imu_tk::importBinaryData<float> ( const char *filename,
+    vector< TriadData_<float> > &samples );
+template bool imu_tk::importBinaryData<double> ( const char *filename,
+    vector< TriadData_<double> > &samples0,
+    vector< TriadData_<double> > &samples1 );
+template bool imu_tk::importBinaryData<float> ( const char *filename,
+    vector< TriadData_<float> > &samples0,
+    vector< TriadData_<float> > &samples1 );
+template bool imu_tk::importBinaryData<double> ( const char *filename,
+    vector< TriadData_<double> > &samples0,
+    vector< TriadData_<double> > &samples1,
+    vector< TriadData_<double> > &samples2 );
+template bool imu_tk::importBinaryData<float> ( const char *filename,
+    vector< TriadData_<float> > &samples0,
+    vector< TriadData_<float> > &samples1,
+    vector< TriadData_<float> > &samples2 );
+template bool imu_tk::exportBinaryData<double> ( const char *filename,
+    const vector< TriadData_<double> > &samples0,
+    const vector< TriadData_<double> > *samples1,
+    const vector< TriadData_<double> > *samples2,
+    double rate );
+template bool imu_tk::exportBinaryData<float> ( const char *filename,
+    const vector< TriadData_<float> > &samples0,
+    const vector< TriadData_<float> > *samples1,
+    const vector< TriadData_<float> > *samples2,
+    double rate );
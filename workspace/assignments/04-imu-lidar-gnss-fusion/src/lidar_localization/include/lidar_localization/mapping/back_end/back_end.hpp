@@ -15,6 +15,7 @@
 #include "lidar_localization/sensor_data/pose_data.hpp"
 #include "lidar_localization/sensor_data/key_frame.hpp"
 #include "lidar_localization/sensor_data/loop_pose.hpp"
+#include "lidar_localization/tools/key_frame_writer.hpp"
 
 #include "lidar_localization/models/graph_optimizer/g2o/g2o_graph_optimizer.hpp"
 
@@ -52,6 +53,9 @@ class BackEnd {
     std::string scan_context_path_ = "";
     std::string trajectory_path_ = "";
 
+    // key scans are written to disk off the frame path:
+    std::shared_ptr<KeyFrameWriter> key_frame_writer_ptr_;
+
     std::ofstream ground_truth_ofs_;
     std::ofstream laser_odom_ofs_;
     std::ofstream optimized_pose_ofs_;
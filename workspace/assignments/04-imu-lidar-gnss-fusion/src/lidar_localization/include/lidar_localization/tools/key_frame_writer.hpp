@@ -0,0 +1,68 @@
+/*
+ * @Description: background writer for key frame point clouds
+ * @Author: Ge Yao
+ * @Date: 2020-12-06 20:13:41
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_KEY_FRAME_WRITER_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_KEY_FRAME_WRITER_HPP_
+
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+
+namespace lidar_localization {
+class KeyFrameWriter {
+  public:
+    struct Stats {
+      size_t queue_depth = 0;
+      size_t max_queue_depth = 0;
+      size_t num_written = 0;
+      size_t num_failed = 0;
+      // number of Write calls which had to wait for a free slot:
+      size_t num_blocked = 0;
+    };
+
+    explicit KeyFrameWriter(size_t max_queue_size = 32);
+    ~KeyFrameWriter();
+
+    // the writer takes over the cloud, callers must not modify it afterwards.
+    // blocks only when the queue is full:
+    bool Write(const std::string& file_path, CloudData::CLOUD_PTR cloud_ptr);
+    // wait until every queued cloud is on disk:
+    void Flush(void);
+
+    size_t GetQueueDepth(void);
+    Stats GetStats(void);
+
+  private:
+    struct Task {
+      std::string file_path;
+      CloudData::CLOUD::ConstPtr cloud_ptr;
+    };
+
+    void Run(void);
+    static bool Save(const Task& task);
+
+  private:
+    size_t max_queue_size_;
+
+    std::mutex mutex_;
+    std::condition_variable has_task_;
+    std::condition_variable has_slot_;
+    std::condition_variable is_idle_;
+
+    std::deque<Task> queue_;
+    bool is_writing_ = false;
+    bool stop_ = false;
+    Stats stats_;
+
+    // saves the key frames in queue_:
+    std::thread thread_;
+};
+}
+
+#endif
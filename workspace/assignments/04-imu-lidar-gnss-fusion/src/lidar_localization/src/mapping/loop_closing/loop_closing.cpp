@@ -125,6 +125,7 @@ bool LoopClosing::Update(
 
     all_key_frames_.push_back(key_frame);
     all_key_gnss_.push_back(key_gnss);
+    current_key_scan_ = key_scan;
 
     if (!DetectNearestKeyFrame(key_frame_index, yaw_change_in_rad))
         return false;
@@ -300,9 +301,8 @@ bool LoopClosing::JointScan(CloudData::CLOUD_PTR& scan_cloud_ptr, Eigen::Matrix4
     current_loop_pose_.index1 = all_key_frames_.back().index;
     current_loop_pose_.time = all_key_frames_.back().time;
 
-    // load back current key scan:
-    std::string file_path = key_frames_path_ + "/key_frame_" + std::to_string(all_key_frames_.back().index) + ".pcd";
-    pcl::io::loadPCDFile(file_path, *scan_cloud_ptr);
+    // use current key scan in memory, the back end writes it to disk asynchronously:
+    *scan_cloud_ptr = *current_key_scan_.cloud_ptr;
 
     // pre-process current scan:
     scan_filter_ptr_->Filter(scan_cloud_ptr, scan_cloud_ptr);
@@ -155,7 +155,9 @@ bool Viewer::JointCloudMap(const std::deque<KeyFrame>& key_frames, CloudData::CL
 
     for (size_t i = 0; i < key_frames.size(); ++i) {
         file_path = key_frames_path_ + "/key_frame_" + std::to_string(key_frames.at(i).index) + ".pcd";
-        pcl::io::loadPCDFile(file_path, *cloud_ptr);
+        // the latest key scans may still be queued for disk write in back end:
+        if (pcl::io::loadPCDFile(file_path, *cloud_ptr) != 0)
+            continue;
         pcl::transformPointCloud(*cloud_ptr, *cloud_ptr, key_frames.at(i).pose);
         *map_cloud_ptr += *cloud_ptr;
     }
@@ -0,0 +1,152 @@
+/*
+ * @Description: sliding window local map, kept as frame-tagged voxel centroids
+ * @Author: Ge Yao
+ * @Date: 2020-12-05 19:53:20
+ */
+#include "lidar_localization/models/local_map/voxel_hash_map.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+VoxelHashMap::VoxelHashMap(const YAML::Node& node) {
+    float leaf_size_x = node["leaf_size"][0].as<float>();
+    float leaf_size_y = node["leaf_size"][1].as<float>();
+    float leaf_size_z = node["leaf_size"][2].as<float>();
+
+    SetMapParam(leaf_size_x, leaf_size_y, leaf_size_z);
+}
+
+VoxelHashMap::VoxelHashMap(float leaf_size_x, float leaf_size_y, float leaf_size_z) {
+    SetMapParam(leaf_size_x, leaf_size_y, leaf_size_z);
+}
+
+bool VoxelHashMap::SetMapParam(float leaf_size_x, float leaf_size_y, float leaf_size_z) {
+    inverse_leaf_size_ = Eigen::Vector3f(
+        1.0f / leaf_size_x, 
+        1.0f / leaf_size_y, 
+        1.0f / leaf_size_z
+    );
+
+    std::cout << "Voxel Hash Map params:" << std::endl
+              << leaf_size_x << ", "
+              << leaf_size_y << ", "
+              << leaf_size_z 
+              << std::endl << std::endl;
+
+    return true;
+}
+
+bool VoxelHashMap::AddFrame(int frame_id, const CloudData::CLOUD_PTR& frame_cloud_ptr) {
+    if (frame_voxels_.count(frame_id) > 0) {
+        LOG(WARNING) << "Voxel hash map frame " << frame_id << " already exists.";
+        return false;
+    }
+
+    std::vector<int64_t> &frame_voxels = frame_voxels_[frame_id];
+
+    for (const auto &point: frame_cloud_ptr->points) {
+        if (!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z)) {
+            continue;
+        }
+
+        const int64_t key = GetVoxelKey(point);
+        std::vector<FrameVoxel> &voxel = voxels_[key];
+
+        // points of the same frame are added consecutively, so only the last entry needs checking:
+        if (voxel.empty() || voxel.back().frame_id != frame_id) {
+            voxel.push_back(FrameVoxel{frame_id, 0, Eigen::Vector3f::Zero()});
+            frame_voxels.push_back(key);
+        }
+
+        ++voxel.back().num_points;
+        voxel.back().sum += point.getVector3fMap();
+    }
+
+    return true;
+}
+
+bool VoxelHashMap::RemoveFrame(int frame_id) {
+    auto frame_voxels = frame_voxels_.find(frame_id);
+    if (frame_voxels == frame_voxels_.end()) {
+        return false;
+    }
+
+    // only voxels touched by the frame are visited:
+    for (const auto &key: frame_voxels->second) {
+        auto voxel = voxels_.find(key);
+        if (voxel == voxels_.end()) {
+            continue;
+        }
+
+        std::vector<FrameVoxel> &entries = voxel->second;
+        entries.erase(
+            std::remove_if(
+                entries.begin(), entries.end(), 
+                [frame_id](const FrameVoxel &entry) { return entry.frame_id == frame_id; }
+            ),
+            entries.end()
+        );
+
+        if (entries.empty()) {
+            voxels_.erase(voxel);
+        }
+    }
+    frame_voxels_.erase(frame_voxels);
+
+    return true;
+}
+
+void VoxelHashMap::Clear(void) {
+    voxels_.clear();
+    frame_voxels_.clear();
+}
+
+bool VoxelHashMap::GetMap(CloudData::CLOUD_PTR& map_ptr) const {
+    map_ptr.reset(new CloudData::CLOUD());
+    map_ptr->points.reserve(voxels_.size());
+
+    for (const auto &voxel: voxels_) {
+        int num_points = 0;
+        Eigen::Vector3f sum = Eigen::Vector3f::Zero();
+        for (const auto &entry: voxel.second) {
+            num_points += entry.num_points;
+            sum += entry.sum;
+        }
+
+        const Eigen::Vector3f centroid = sum / static_cast<float>(num_points);
+
+        CloudData::POINT point;
+        point.x = centroid.x();
+        point.y = centroid.y();
+        point.z = centroid.z();
+        map_ptr->points.push_back(point);
+    }
+
+    map_ptr->width = map_ptr->points.size();
+    map_ptr->height = 1;
+    map_ptr->is_dense = true;
+
+    return true;
+}
+
+int64_t VoxelHashMap::GetVoxelKey(const CloudData::POINT &point) const {
+    // 21 bits per axis:
+    static const int64_t OFFSET = (1 << 20);
+    static const int64_t MASK = (1 << 21) - 1;
+
+    const int64_t ix = static_cast<int64_t>(std::floor(point.x * inverse_leaf_size_.x()));
+    const int64_t iy = static_cast<int64_t>(std::floor(point.y * inverse_leaf_size_.y()));
+    const int64_t iz = static_cast<int64_t>(std::floor(point.z * inverse_leaf_size_.z()));
+
+    return (
+        (((ix + OFFSET) & MASK) << 42) |
+        (((iy + OFFSET) & MASK) << 21) |
+        ((iz + OFFSET) & MASK)
+    );
+}
+
+}
@@ -0,0 +1,122 @@
+/*
+ * @Description: background writer for key frame point clouds
+ * @Author: Ge Yao
+ * @Date: 2020-12-06 20:13:41
+ */
+#include "lidar_localization/tools/key_frame_writer.hpp"
+
+#include <cstdio>
+#include <algorithm>
+
+#include <pcl/io/pcd_io.h>
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+KeyFrameWriter::KeyFrameWriter(size_t max_queue_size)
+    : max_queue_size_(std::max(max_queue_size, static_cast<size_t>(1))),
+      thread_(&KeyFrameWriter::Run, this) {
+}
+
+KeyFrameWriter::~KeyFrameWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    has_task_.notify_one();
+
+    // the worker drains the queue before it exits:
+    thread_.join();
+}
+
+bool KeyFrameWriter::Write(const std::string& file_path, CloudData::CLOUD_PTR cloud_ptr) {
+    if (!cloud_ptr)
+        return false;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        if (queue_.size() >= max_queue_size_) {
+            ++stats_.num_blocked;
+            has_slot_.wait(lock, [this]{ return queue_.size() < max_queue_size_; });
+        }
+
+        Task task;
+        task.file_path = file_path;
+        task.cloud_ptr = std::move(cloud_ptr);
+        queue_.push_back(std::move(task));
+
+        stats_.max_queue_depth = std::max(stats_.max_queue_depth, queue_.size());
+    }
+    has_task_.notify_one();
+
+    return true;
+}
+
+void KeyFrameWriter::Flush(void) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    is_idle_.wait(lock, [this]{ return queue_.empty() && !is_writing_; });
+}
+
+size_t KeyFrameWriter::GetQueueDepth(void) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+}
+
+KeyFrameWriter::Stats KeyFrameWriter::GetStats(void) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    Stats stats = stats_;
+    stats.queue_depth = queue_.size();
+
+    return stats;
+}
+
+void KeyFrameWriter::Run(void) {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        has_task_.wait(lock, [this]{ return stop_ || !queue_.empty(); });
+        if (queue_.empty())
+            break;
+
+        Task task = std::move(queue_.front());
+        queue_.pop_front();
+        is_writing_ = true;
+        has_slot_.notify_one();
+
+        lock.unlock();
+        bool is_saved = Save(task);
+        task.cloud_ptr.reset();
+        lock.lock();
+
+        is_writing_ = false;
+        if (is_saved)
+            ++stats_.num_written;
+        else
+            ++stats_.num_failed;
+
+        if (queue_.empty())
+            is_idle_.notify_all();
+    }
+}
+
+bool KeyFrameWriter::Save(const Task& task) {
+    // write to a temporary file first so that readers never see a partial key frame:
+    std::string tmp_file_path = task.file_path + ".tmp";
+
+    if (pcl::io::savePCDFileBinary(tmp_file_path, *task.cloud_ptr) != 0) {
+        LOG(WARNING) << "Failed to write key frame: " << task.file_path;
+        return false;
+    }
+
+    if (std::rename(tmp_file_path.c_str(), task.file_path.c_str()) != 0) {
+        LOG(WARNING) << "Failed to rename key frame: " << tmp_file_path;
+        std::remove(tmp_file_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace lidar_localization
@@ -0,0 +1,6 @@
+find_package(benchmark QUIET)
+
+# only the benchmark targets link against it:
+if(benchmark_FOUND)
+  message(STATUS "Found Google Benchmark ${benchmark_VERSION}")
+endif()
@@ -0,0 +1,7 @@
+find_package(Ceres QUIET)
+
+if(Ceres_FOUND)
+  include_directories(SYSTEM ${CERES_INCLUDE_DIRS})
+  list(APPEND ALL_TARGET_LIBRARIES ${CERES_LIBRARIES})
+  add_definitions(-DLIDAR_LOCALIZATION_WITH_CERES)
+endif()
@@ -0,0 +1,10 @@
+find_package(CUDA QUIET)
+
+if(CUDA_FOUND)
+  # kernels are built into their own library, host sources only see the plain C++ interface:
+  file(GLOB_RECURSE CUDA_SRCS "src/*.cu")
+  list(APPEND CUDA_NVCC_FLAGS -std=c++14 -O3)
+  cuda_add_library(lidar_localization_cuda STATIC ${CUDA_SRCS})
+  list(APPEND ALL_TARGET_LIBRARIES lidar_localization_cuda ${CUDA_LIBRARIES})
+  add_definitions(-DLIDAR_LOCALIZATION_WITH_CUDA)
+endif()
@@ -126,4 +126,23 @@ list(APPEND ALL_TARGET_LIBRARIES
       ${G2O_SOLVER_CSPARSE}
       ${G2O_SOLVER_CHOLMOD}
       ${G2O_TYPES_SLAM3D}
-      ${G2O_TYPES_SLAM3D_ADDONS})
\ No newline at end of file
+      ${G2O_TYPES_SLAM3D_ADDONS})
+
+# 固定块大小求解器直接使用 CHOLMOD、CSparse 线性求解器，找不到时交给 g2o 的求解器工厂
+find_path(CHOLMOD_INCLUDE_DIR cholmod.h PATH_SUFFIXES suitesparse)
+find_library(CHOLMOD_LIBRARY NAMES cholmod)
+
+if(CHOLMOD_INCLUDE_DIR AND CHOLMOD_LIBRARY)
+  include_directories(SYSTEM ${CHOLMOD_INCLUDE_DIR})
+  list(APPEND ALL_TARGET_LIBRARIES ${CHOLMOD_LIBRARY})
+  add_definitions(-DLIDAR_LOCALIZATION_WITH_G2O_CHOLMOD)
+endif()
+
+find_path(CSPARSE_INCLUDE_DIR cs.h PATH_SUFFIXES suitesparse)
+find_library(CSPARSE_LIBRARY NAMES cxsparse)
+
+if(CSPARSE_INCLUDE_DIR AND CSPARSE_LIBRARY AND G2O_SOLVER_CSPARSE_EXTENSION)
+  include_directories(SYSTEM ${CSPARSE_INCLUDE_DIR})
+  list(APPEND ALL_TARGET_LIBRARIES ${G2O_SOLVER_CSPARSE_EXTENSION} ${CSPARSE_LIBRARY})
+  add_definitions(-DLIDAR_LOCALIZATION_WITH_G2O_CSPARSE)
+endif()
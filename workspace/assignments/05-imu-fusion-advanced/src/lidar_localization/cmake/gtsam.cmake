@@ -0,0 +1,7 @@
+find_package(GTSAM QUIET)
+
+if(GTSAM_FOUND)
+  include_directories(${GTSAM_INCLUDE_DIR})
+  list(APPEND ALL_TARGET_LIBRARIES gtsam)
+  add_definitions(-DLIDAR_LOCALIZATION_WITH_GTSAM)
+endif()
@@ -0,0 +1,8 @@
+find_path(LZ4_INCLUDE_DIR lz4.h)
+find_library(LZ4_LIBRARY NAMES lz4)
+
+if(LZ4_INCLUDE_DIR AND LZ4_LIBRARY)
+  include_directories(${LZ4_INCLUDE_DIR})
+  list(APPEND ALL_TARGET_LIBRARIES ${LZ4_LIBRARY})
+  add_definitions(-DLIDAR_LOCALIZATION_WITH_LZ4)
+endif()
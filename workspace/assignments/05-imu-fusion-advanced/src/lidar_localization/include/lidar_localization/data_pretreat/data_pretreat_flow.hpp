@@ -6,6 +6,10 @@
 #ifndef LIDAR_LOCALIZATION_DATA_PRETREAT_DATA_PRETREAT_FLOW_HPP_
 #define LIDAR_LOCALIZATION_DATA_PRETREAT_DATA_PRETREAT_FLOW_HPP_
 
+#include <chrono>
+#include <memory>
+#include <vector>
+
 #include <ros/ros.h>
 // subscriber
 #include "lidar_localization/subscriber/cloud_subscriber.hpp"
@@ -19,6 +23,14 @@
 #include "lidar_localization/publisher/imu_publisher.hpp"
 // models
 #include "lidar_localization/models/scan_adjust/distortion_adjust.hpp"
+#include "lidar_localization/models/scan_adjust/multi_lidar_merger.hpp"
+#include "lidar_localization/data_pretreat/multi_lidar_input.hpp"
+// tools
+#include "lidar_localization/tools/geo_converter.hpp"
+#include "lidar_localization/tools/ordered_pipeline.hpp"
+// metrics
+#include "lidar_localization/tools/metrics.hpp"
+#include "lidar_localization/tools/latency_tracer.hpp"
 
 namespace lidar_localization {
 class DataPretreatFlow {
@@ -36,7 +48,24 @@ class DataPretreatFlow {
     bool TransformData();
     bool PublishData();
 
+    // deskew on the workers, published in sync order:
+    bool SubmitDeskewTask();
+    void PublishDeskewedData(bool wait_oldest);
+
   private:
+    struct DeskewTask {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      CloudData cloud_data;
+      IMUData imu_data;
+      VelocityData velocity_data;
+      Eigen::Matrix4f gnss_pose;
+      std::vector<CloudData> secondary_cloud_data;
+      // raw IMU for the rotation within the sweep:
+      std::deque<IMUData> deskew_imu_data_buff;
+      std::chrono::steady_clock::time_point start;
+    };
+
     // subscriber
     std::shared_ptr<IMUSubscriber> imu_sub_ptr_;
     std::shared_ptr<VelocitySubscriber> velocity_sub_ptr_;
@@ -49,6 +78,13 @@ class DataPretreatFlow {
     std::shared_ptr<IMUPublisher> imu_pub_ptr_;
     // models
     std::shared_ptr<DistortionAdjust> distortion_adjust_ptr_;
+    // one per worker, empty when deskew runs on the flow thread:
+    std::vector<std::shared_ptr<DistortionAdjust>> worker_distortion_adjust_ptrs_;
+    std::unique_ptr<OrderedPipeline<DeskewTask>> deskew_pipeline_ptr_;
+    // secondary lidars, null when there is none:
+    std::shared_ptr<MultiLidarInput> multi_lidar_input_ptr_;
+    // one for the flow thread, then one per worker:
+    std::vector<std::shared_ptr<MultiLidarMerger>> multi_lidar_merger_ptrs_;
 
     Eigen::Matrix4f lidar_to_imu_ = Eigen::Matrix4f::Identity();
 
@@ -58,11 +94,22 @@ class DataPretreatFlow {
     std::deque<GNSSData> gnss_data_buff_;
 
     CloudData current_cloud_data_;
+    std::vector<CloudData> current_secondary_cloud_data_;
     IMUData current_imu_data_;
     VelocityData current_velocity_data_;
     GNSSData current_gnss_data_;
+    // local map frame at the first synced GNSS fix:
+    std::shared_ptr<GeoConverter> geo_converter_ptr_;
 
     Eigen::Matrix4f gnss_pose_ = Eigen::Matrix4f::Identity();
+
+    // metrics
+    FlowMetrics metrics_{"data_pretreat_flow"};
+    Counter* dropped_clouds_ptr_;
+    Counter* dropped_imu_ptr_;
+    Counter* dropped_velocity_ptr_;
+    Counter* dropped_gnss_ptr_;
+    std::shared_ptr<LatencyTracer> latency_tracer_ptr_;
 };
 }
 
@@ -18,6 +18,11 @@
 // publisher:
 #include "lidar_localization/publisher/imu_publisher.hpp"
 #include "lidar_localization/publisher/odometry_publisher.hpp"
+// tools:
+#include "lidar_localization/tools/geo_converter.hpp"
+// metrics:
+#include "lidar_localization/tools/metrics.hpp"
+#include "lidar_localization/tools/latency_tracer.hpp"
 
 namespace lidar_localization {
 
@@ -54,11 +59,21 @@ class ESKFPreprocessFlow {
 
     IMUData current_imu_data_;
     GNSSData current_gnss_data_;
+    // local map frame at the first GNSS fix:
+    std::shared_ptr<GeoConverter> geo_converter_ptr_;
     VelocityData current_velocity_data_;
     PoseData current_ref_pose_data_;
 
     Eigen::Matrix4f gnss_pose_ = Eigen::Matrix4f::Identity();
     Eigen::Matrix4f ref_pose_ = Eigen::Matrix4f::Identity();
+
+    // metrics:
+    FlowMetrics metrics_{"eskf_preprocess_flow"};
+    Counter* dropped_imu_ptr_;
+    Counter* dropped_gnss_ptr_;
+    Counter* dropped_velocity_ptr_;
+    Counter* dropped_ref_pose_ptr_;
+    std::shared_ptr<LatencyTracer> latency_tracer_ptr_;
 };
 
 } // namespace lidar_localization
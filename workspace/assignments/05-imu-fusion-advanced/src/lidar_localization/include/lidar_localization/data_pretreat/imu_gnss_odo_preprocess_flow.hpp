@@ -24,6 +24,12 @@
 // c. reference trajectory:
 #include "lidar_localization/publisher/odometry_publisher.hpp"
 
+// tools:
+#include "lidar_localization/tools/geo_converter.hpp"
+// metrics:
+#include "lidar_localization/tools/metrics.hpp"
+#include "lidar_localization/tools/latency_tracer.hpp"
+
 namespace lidar_localization {
 
 class IMUGNSSOdoPreprocessFlow {
@@ -60,11 +66,21 @@ class IMUGNSSOdoPreprocessFlow {
 
     IMUData current_imu_data_;
     GNSSData current_gnss_data_;
+    // local map frame at the first GNSS fix:
+    std::shared_ptr<GeoConverter> geo_converter_ptr_;
     VelocityData current_odo_data_;
     PoseData current_ref_pose_data_;
 
     PosVelData pos_vel_;
     Eigen::Matrix4f gnss_pose_;
+
+    // metrics:
+    FlowMetrics metrics_{"imu_gnss_odo_preprocess_flow"};
+    Counter* dropped_imu_ptr_;
+    Counter* dropped_gnss_ptr_;
+    Counter* dropped_odo_ptr_;
+    Counter* dropped_ref_pose_ptr_;
+    std::shared_ptr<LatencyTracer> latency_tracer_ptr_;
 };
 
 } // namespace lidar_localization
@@ -0,0 +1,71 @@
+/*
+ * @Description: secondary lidar sweeps & extrinsics, synced with the sweeps of the primary lidar
+ * @Author: Ge Yao
+ * @Date: 2020-12-30 11:05:18
+ */
+#ifndef LIDAR_LOCALIZATION_DATA_PRETREAT_MULTI_LIDAR_INPUT_HPP_
+#define LIDAR_LOCALIZATION_DATA_PRETREAT_MULTI_LIDAR_INPUT_HPP_
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <ros/ros.h>
+#include <yaml-cpp/yaml.h>
+#include <Eigen/Dense>
+
+#include "lidar_localization/subscriber/cloud_subscriber.hpp"
+#include "lidar_localization/tf_listener/tf_listener.hpp"
+#include "lidar_localization/models/scan_adjust/multi_lidar_merger.hpp"
+#include "lidar_localization/tools/metrics.hpp"
+
+namespace lidar_localization {
+class MultiLidarInput {
+  public:
+    // node as MultiLidarMerger, each secondary lidar also has topic & frame_id:
+    MultiLidarInput(
+        ros::NodeHandle& nh, const YAML::Node& node,
+        const std::string& imu_frame_id,
+        FlowMetrics& metrics
+    );
+
+    int GetNumSecondaryLidars(void) const { return static_cast<int>(sensors_.size()); }
+
+    void ParseData(void);
+    // extrinsics of the secondary lidars, set to the mergers once all are received:
+    bool InitCalibration(std::vector<std::shared_ptr<MultiLidarMerger>>& merger_ptrs);
+
+    // false to wait for the secondary sweeps of the primary sweep at time,
+    // until the primary lidar is max_wait_time ahead, at latest_time:
+    bool HasData(double time, double latest_time);
+    // the closest sweep of each secondary lidar, an empty cloud if none within max_time_offset:
+    void GetData(double time, std::vector<CloudData>& secondary_cloud_data);
+
+  private:
+    struct Sensor {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      std::shared_ptr<CloudSubscriber> cloud_sub_ptr;
+      std::shared_ptr<TFListener> lidar_to_imu_ptr;
+      Eigen::Matrix4f lidar_to_imu = Eigen::Matrix4f::Identity();
+      bool calibration_received = false;
+
+      std::deque<CloudData> cloud_data_buff;
+    };
+
+    // drop the sweeps too old for the primary sweep at time:
+    void DropOldData(double time);
+
+  private:
+    double max_time_offset_;
+    double max_wait_time_;
+
+    std::vector<Sensor, Eigen::aligned_allocator<Sensor>> sensors_;
+
+    Counter* dropped_clouds_ptr_;
+    Counter* missing_clouds_ptr_;
+};
+} // namespace lidar_localization
+
+#endif
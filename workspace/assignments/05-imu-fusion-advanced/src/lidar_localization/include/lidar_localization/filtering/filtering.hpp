@@ -7,6 +7,9 @@
 #define LIDAR_LOCALIZATION_FILTERING_FILTERING_HPP_
 
 #include <deque>
+#include <atomic>
+#include <thread>
+#include <functional>
 #include <Eigen/Dense>
 #include <yaml-cpp/yaml.h>
 
@@ -17,29 +20,59 @@
 #include "lidar_localization/models/cloud_filter/cloud_filter_interface.hpp"
 #include "lidar_localization/models/cloud_filter/box_filter.hpp"
 
+#include "lidar_localization/models/tiled_map/tiled_map.hpp"
+#include "lidar_localization/models/lod_map/lod_map.hpp"
+#include "lidar_localization/models/local_map/grid_map.hpp"
+
 #include "lidar_localization/models/scan_context_manager/scan_context_manager.hpp"
 
 #include "lidar_localization/models/registration/registration_interface.hpp"
 
 #include "lidar_localization/models/kalman_filter/error_state_kalman_filter.hpp"
+#include "lidar_localization/models/kalman_filter/error_state_kalman_filter_bank.hpp"
+
+#include "lidar_localization/filtering/filtering_snapshot.hpp"
+#include "lidar_localization/filtering/shadow_filter.hpp"
+#include "lidar_localization/filtering/tracking_monitor.hpp"
 
 namespace lidar_localization {
 
+// the global map & the scan context index are loaded on their own threads with async_init, so the flow
+// takes measurements right away. the first fix waits for what it needs: the map for every init, and the index
+// for scan context proposals, which a scan with a GNSS prior may go without, verified against GNSS only.
+// once tracking, the health of every scan match is monitored. a degraded match is not fused, & once tracking
+// is lost the scan is relocalized on a thread of its own, among the scan context proposals within the GNSS-gated
+// region, while the filter goes on with IMU prediction. the verified pose is taken over with a later scan.
 class Filtering {
   public:
     Filtering();
+    // waits for the loaders & the relocalization in progress:
+    ~Filtering();
 
     bool Init(
       const CloudData& init_scan,
       const Eigen::Vector3f &init_vel,
       const IMUData &init_imu_data
     );
+    // the GNSS pose at the scan time is verified along with the scan context proposals:
+    bool Init(
+      const CloudData& init_scan,
+      const Eigen::Matrix4f& init_gnss_pose,
+      const Eigen::Vector3f &init_vel,
+      const IMUData &init_imu_data
+    );
 
     bool Init(
       const Eigen::Matrix4f& init_pose,
       const Eigen::Vector3f &init_vel,
       const IMUData &init_imu_data
     );
+    // warm restart, the snapshot pose moved on to the scan time is verified within the scan:
+    bool Init(
+      const CloudData& init_scan,
+      const FilteringSnapshot& snapshot,
+      const IMUData &init_imu_data
+    );
 
     bool Update(
       const IMUData &imu_data
@@ -49,20 +82,44 @@ class Filtering {
       const CloudData& cloud_data, 
       Eigen::Matrix4f& cloud_pose
     );
+    // GNSS pose at the time of the next correction, the center of the region a relocalization is gated to:
+    void SetGNSSPose(const Eigen::Matrix4f& gnss_pose);
+
+    // readiness, the Init calls fail until the map is ready:
+    bool IsMapReady() const { return is_map_ready_.load(); }
+    bool IsIndexReady() const { return is_index_ready_.load(); }
+    // blocks until the map & the index are ready, e.g. for offline replay:
+    void WaitUntilReady(void);
 
     // getters:
     bool HasInited() const { return has_inited_; }
-    bool HasNewGlobalMap() const { return has_new_global_map_; }
+    bool HasNewGlobalMap() const { return IsMapReady() && has_new_global_map_; }
     bool HasNewLocalMap() const { return has_new_local_map_; }
 
     void GetGlobalMap(CloudData::CLOUD_PTR& global_map);
     CloudData::CLOUD_PTR& GetLocalMap() { return local_map_ptr_; }
     CloudData::CLOUD_PTR& GetCurrentScan() { return current_scan_ptr_; }
 
-    double GetTime(void) { return kalman_filter_ptr_->GetTime(); }
+    double GetTime(void) { return HasFilterBank() ? kalman_filter_bank_ptr_->GetTime() : kalman_filter_ptr_->GetTime(); }
     Eigen::Matrix4f GetPose(void) { return current_pose_; }
     Eigen::Vector3f GetVel(void) { return current_vel_; }
     void GetOdometry(Eigen::Matrix4f &pose, Eigen::Vector3f &vel);
+    // as of the last update or correction, in map frame, for dead reckoning of newer IMU measurements:
+    bool GetNavState(imu_mechanization::NavState& nav_state);
+    // as of the last correction, not available while init pose hypotheses are tracked:
+    bool GetSnapshot(FilteringSnapshot& snapshot);
+
+    // shadows get the IMU & lidar pose measurements of the Kalman filter from its init on, 
+    // only with a cold init of a single hypothesis & loosely-coupled fusion:
+    void SetShadowFilters(const std::vector<std::shared_ptr<ShadowFilter>>& shadow_filter_ptrs) { 
+      shadow_filter_ptrs_ = shadow_filter_ptrs; 
+    }
+    // log the shadow poses, along with each fused pose logged:
+    void SampleShadowFilters(void);
+
+    // degraded levels of scan matching under load, 0 for full quality:
+    int GetNumLoadLevels(void) const { return static_cast<int>(load_max_iters_.size()); }
+    bool SetLoadLevel(int load_level);
 
   private:
     bool InitWithConfig(void);
@@ -74,10 +131,15 @@ class Filtering {
     );
     bool InitLocalMapSegmenter(const YAML::Node& config_node);
     bool InitFilters(const YAML::Node& config_node);
-    // b. map initializer:
+    // runs load on loader with async_init, inline otherwise, then marks it ready:
+    void StartLoader(
+      const std::string& name, const std::function<void(void)>& load, bool async_init,
+      std::thread& loader, std::atomic<bool>& is_ready
+    );
+    // b. map initializer, on the map loader thread with async_init:
     bool InitGlobalMap(const YAML::Node& config_node);
-    // c. scan context manager initializer:
-    bool InitScanContextManager(const YAML::Node& config_node);
+    // c. scan context manager initializer, the index is loaded on the index loader thread with async_init:
+    bool InitScanContextManager(const YAML::Node& config_node, bool async_init);
     // d. frontend initializer:
     bool InitRegistration(
       std::shared_ptr<RegistrationInterface>& registration_ptr, 
@@ -85,15 +147,82 @@ class Filtering {
     );
     // e. IMU-lidar fusion initializer:
     bool InitFusion(const YAML::Node& config_node);
+    // f. relocalization initializer:
+    bool InitRelocalization(const YAML::Node& config_node);
+    // g. load shedding initializer:
+    bool InitLoadShedding(const YAML::Node& config_node);
+    // h. Kalman filter & filter bank, once the init pose is set:
+    bool InitKalmanFilter(const Eigen::Vector3f &init_vel, const IMUData &init_imu_data);
 
     // local map setter:
     bool ResetLocalMap(float x, float y, float z);
+    // whether the pose is within 50 meters of the local map edge:
+    bool IsNearLocalMapEdge(const Eigen::Matrix4f& pose, const std::vector<float>& edge) const;
+    // edge of the local map centered at pose, without moving the local map segmenter, e.g. off the flow thread:
+    std::vector<float> GetLocalMapEdge(const Eigen::Matrix4f& pose) const;
+    // lod_level is only used for LOD map:
+    bool BuildLocalMap(const std::vector<float>& edge, int lod_level, CloudData::CLOUD_PTR& local_map_ptr);
+    // load the tiles of the next local map ahead of the vehicle:
+    bool PrefetchLocalMap(const Eigen::Matrix4f& pose, const Eigen::Vector3f& motion);
 
     // init pose setter:
-    bool SetInitScan(const CloudData& init_scan);
+    bool SetInitScan(
+      const CloudData& init_scan, 
+      const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& prior_poses
+    );
+    // coarse registration of each init pose hypothesis in parallel, those within fitness limit are kept, best first:
+    bool Relocalize(
+      const CloudData& init_scan, 
+      const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& hypotheses,
+      std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& init_poses
+    );
+    // as above, with the scan already filtered. only touches the relocalization instances & the map:
+    bool Relocalize(
+      const CloudData::CLOUD_PTR& scan_ptr, 
+      const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& hypotheses,
+      std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& init_poses
+    );
     bool SetInitGNSS(const Eigen::Matrix4f& init_pose);
     bool SetInitPose(const Eigen::Matrix4f& init_pose);
 
+    // filter bank, one hypothesis per relocalization candidate until one is left:
+    bool HasFilterBank(void) const { return !bank_hypotheses_.empty(); }
+    // lod_level of relocalization, target of the hypothesis' registration instance:
+    bool ResetBankLocalMap(const int hypothesis, float x, float y, float z);
+    bool SetBankHypotheses(
+      const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& init_poses
+    );
+    bool CorrectBank(
+      const IMUData &imu_data,
+      const CloudData& cloud_data, 
+      const CloudData::CLOUD_PTR& filtered_cloud_ptr,
+      Eigen::Matrix4f& cloud_pose
+    );
+    // the Kalman filter takes over the state of the hypothesis:
+    bool HandOverBank(const int hypothesis, const IMUData &imu_data);
+    bool GetBankOdometry(void);
+
+    // tracking recovery, loosely-coupled fusion only. false if the match of cloud_pose is not to be fused:
+    bool CheckTracking(
+      const CloudData& cloud_data, 
+      const CloudData::CLOUD_PTR& filtered_cloud_ptr,
+      const Eigen::Matrix4f& cloud_pose
+    );
+    // relocalize the scan on the relocalizer thread, false if one is in progress or there are no hypotheses:
+    bool StartRelocalization(const CloudData& cloud_data, const CloudData::CLOUD_PTR& filtered_cloud_ptr);
+    // move the scan matching prediction onto the relocalized pose, once the relocalizer is done:
+    bool ApplyRelocalization(void);
+    // the Kalman filter takes over the pose of the first healthy match after relocalization, biases are kept:
+    bool ResumeTracking(const IMUData &imu_data, const Eigen::Matrix4f& cloud_pose);
+
+    // tightly-coupled correction, point-to-plane residuals of the scan against the local map in an iterated update:
+    bool CorrectTightlyCoupled(
+      const IMUData &imu_data,
+      const CloudData& cloud_data, 
+      const CloudData::CLOUD_PTR& filtered_cloud_ptr,
+      Eigen::Matrix4f& cloud_pose
+    );
+
   private:
     std::string map_path_ = "";
     std::string scan_context_path_ = "";
@@ -102,19 +231,84 @@ class Filtering {
 
     // a. global map:
     std::shared_ptr<CloudFilterInterface> global_map_filter_ptr_;
+    // only set for tiled map, global_map_ptr_ stays empty then:
+    std::shared_ptr<TiledMap> tiled_map_ptr_;
+    float prefetch_distance_ = 100.0f;
+    // mapped tiles up to this far beyond the prefetched ones are read ahead by the kernel:
+    float will_need_distance_ = 0.0f;
+    // only set for pcd map, holds the points of global_map_ptr_ bucketed by cell:
+    std::shared_ptr<GridMap> grid_map_ptr_;
+    // only set for LOD map, already filtered per level, global_map_ptr_ stays empty then:
+    std::shared_ptr<LODMap> lod_map_ptr_;
+    int global_map_level_ = 0;
+    int local_map_level_ = 0;
+    int relocalization_map_level_ = 0;
     // b. local map:
     std::shared_ptr<BoxFilter> local_map_segmenter_ptr_;
+    // box_filter_size, the local map edge around the origin:
+    std::vector<float> local_map_box_;
     std::shared_ptr<CloudFilterInterface> local_map_filter_ptr_;
+    Eigen::Vector3f local_map_origin_ = Eigen::Vector3f::Zero();
     // c. current scan:
     std::shared_ptr<CloudFilterInterface> current_scan_filter_ptr_;
+    // per degraded level, the scan filter applied after the current scan filter and the registration iteration cap:
+    std::vector<std::shared_ptr<CloudFilterInterface>> load_scan_filter_ptrs_;
+    std::vector<int> load_max_iters_;
+    int load_level_ = 0;
 
     // scan context manager:
     std::shared_ptr<ScanContextManager> scan_context_manager_ptr_;
     // frontend:
     std::shared_ptr<RegistrationInterface> registration_ptr_; 
+    // relocalization, one coarse registration instance per hypothesis:
+    int num_relocalization_candidates_ = 1;
+    bool use_gnss_for_relocalization_ = true;
+    float relocalization_fitness_score_limit_ = 1.0f;
+    std::vector<std::shared_ptr<RegistrationInterface>> relocalization_registration_ptrs_;
+    // tracking recovery, nullptr if disabled. scan context proposals are gated to this radius around the GNSS pose,
+    // or the last healthy pose without one:
+    std::shared_ptr<TrackingMonitor> tracking_monitor_ptr_;
+    float relocalization_gate_radius_ = 50.0f;
+    bool has_gnss_pose_ = false;
+    Eigen::Matrix4f last_healthy_pose_ = Eigen::Matrix4f::Identity();
+    // pose of the relocalized scan as predicted on the flow thread, to carry the motion since over:
+    Eigen::Matrix4f relocalization_scan_pose_ = Eigen::Matrix4f::Identity();
+    bool is_resuming_tracking_ = false;
+    // the relocalizer & the relocalization instances are only used by the relocalizer until it is done:
+    std::thread relocalizer_;
+    std::atomic<bool> is_relocalization_done_{false};
+    bool is_relocalized_ = false;
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> relocalized_poses_;
     // IMU-lidar Kalman filter:
     std::shared_ptr<ErrorStateKalmanFilter> kalman_filter_ptr_;
     ErrorStateKalmanFilter::Measurement current_measurement_;
+    // tightly-coupled mode, the registration only provides the residuals at each filter iterate:
+    bool use_tightly_coupled_ = false;
+    int tightly_coupled_max_iter_ = 5;
+    double tightly_coupled_eps_ = 1.0e-3;
+    int tightly_coupled_min_num_residuals_ = 100;
+    double point_to_plane_noise_ = 0.1;
+    // filter bank over ambiguous init poses, one relocalization registration instance per hypothesis:
+    struct BankHypothesis {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      Eigen::Matrix4f init_pose = Eigen::Matrix4f::Identity();
+      Eigen::Matrix4f step_pose = Eigen::Matrix4f::Identity();
+      Eigen::Matrix4f last_pose = Eigen::Matrix4f::Identity();
+      Eigen::Matrix4f predict_pose = Eigen::Matrix4f::Identity();
+      Eigen::Vector3f local_map_origin = Eigen::Vector3f::Zero();
+      CloudData::CLOUD_PTR local_map_ptr;
+    };
+    bool use_filter_bank_ = false;
+    int max_num_bank_hypotheses_ = 1;
+    float bank_min_separation_ = 0.0f;
+    double bank_prune_log_likelihood_ = 0.0;
+    int max_num_bank_corrections_ = 0;
+    std::shared_ptr<ErrorStateKalmanFilterBank> kalman_filter_bank_ptr_;
+    std::vector<BankHypothesis, Eigen::aligned_allocator<BankHypothesis>> bank_hypotheses_;
+    int num_bank_corrections_ = 0;
+    // shadow filters for A/B evaluation, they never publish:
+    std::vector<std::shared_ptr<ShadowFilter>> shadow_filter_ptrs_;
     
     CloudData::CLOUD_PTR global_map_ptr_;
     CloudData::CLOUD_PTR local_map_ptr_;
@@ -125,6 +319,18 @@ class Filtering {
     Eigen::Matrix4f current_pose_ = Eigen::Matrix4f::Identity();
     Eigen::Vector3f current_vel_ = Eigen::Vector3f::Zero();
 
+    // scan matching prediction, reset with the init pose:
+    Eigen::Matrix4f step_pose_ = Eigen::Matrix4f::Identity();
+    Eigen::Matrix4f last_pose_ = Eigen::Matrix4f::Identity();
+    Eigen::Matrix4f predict_pose_ = Eigen::Matrix4f::Identity();
+
+    // startup, members set by a loader are only accessed once it is ready:
+    std::thread map_loader_;
+    std::thread index_loader_;
+    std::atomic<bool> is_map_ready_{false};
+    std::atomic<bool> is_index_ready_{false};
+
+    int gnss_cnt_ = 0;
     bool has_inited_ = false;
     bool has_new_global_map_ = false;
     bool has_new_local_map_ = false;
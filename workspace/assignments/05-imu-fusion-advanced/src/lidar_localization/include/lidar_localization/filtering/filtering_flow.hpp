@@ -25,6 +25,22 @@
 
 // filtering instance:
 #include "lidar_localization/filtering/filtering.hpp"
+#include "lidar_localization/filtering/filtering_snapshot.hpp"
+#include "lidar_localization/filtering/imu_pose_predictor.hpp"
+#include "lidar_localization/filtering/shadow_filter.hpp"
+#include "lidar_localization/models/imu_mechanization/imu_decimator.hpp"
+
+// metrics:
+#include "lidar_localization/tools/metrics.hpp"
+#include "lidar_localization/tools/latency_tracer.hpp"
+#include "lidar_localization/tools/deadline_policy.hpp"
+
+// measurement scheduling:
+#include "lidar_localization/tools/measurement_scheduler.hpp"
+
+// trajectory for evo evaluation:
+#include "lidar_localization/tools/trajectory_log.hpp"
+#include "lidar_localization/tools/background_jobs.hpp"
 
 namespace lidar_localization {
 
@@ -34,37 +50,39 @@ class FilteringFlow {
     bool Run();
     // save odometry for evo evaluation:
     bool SaveOdometry(void);
+    // the poses recorded as of now, saved by the returned job, empty if there are none yet.
+    // the job only reads the logs, which are written on their own threads, the flow must outlive it:
+    BackgroundJobs::Job GetSaveOdometryJob(void);
 
   private:
+    // lidar measurement and the synced IMU measurement of its time:
+    struct LidarData {
+      double time = 0.0;
+      CloudData cloud;
+      IMUData imu_synced;
+    };
+
     bool ReadData();
     bool HasInited();
     
-    bool HasData();
-
-    bool HasIMUData(void) const { 
-      if ( !imu_raw_data_buff_.empty() ) {
-        double diff_filter_time = current_imu_raw_data_.time - filtering_ptr_->GetTime();
-
-        if ( diff_filter_time <= 0.01 ) {
-          return true;
-        }
-      }
-
-      return false; 
-    }
-    bool HasLidarData(void) const { 
-      return ( !cloud_data_buff_.empty() && !imu_synced_data_buff_.empty() );
-    }
-    bool HasIMUComesFirst(void) const { return imu_raw_data_buff_.front().time < cloud_data_buff_.front().time; }
-
-    bool ValidIMUData();
+    // pairs the lidar measurements with the synced IMU measurements of their time:
     bool ValidLidarData();
 
+    // measurement callbacks, in time order:
+    void OnIMUData(const IMUData& imu_raw_data);
+    void OnLidarData(const LidarData& lidar_data);
+
+    // shadow filters of config_node, sampled along with the fused trajectory:
+    bool InitShadowFilters(const YAML::Node& config_node);
     bool InitCalibration();
     bool InitLocalization();
+    // GNSS measurement at time, if any:
+    bool GetGNSSData(const double time, PoseData& gnss_data);
     
     bool UpdateLocalization();
     bool CorrectLocalization();
+    // for warm restart, at most once per snapshot interval:
+    bool SaveSnapshot();
 
     bool PublishGlobalMap();
     bool PublishLocalMap();
@@ -72,6 +90,8 @@ class FilteringFlow {
     bool PublishFusionOdom();
 
     bool UpdateOdometry(const double &time);
+    // the first N poses of the logs:
+    bool SaveOdometry(const size_t N, const BackgroundJobs::Progress& progress);
     /**
      * @brief  save pose in KITTI format for evo evaluation
      * @param  pose, input pose
@@ -87,6 +107,9 @@ class FilteringFlow {
     // subscriber:
     // a. IMU raw:
     std::shared_ptr<IMUSubscriber> imu_raw_sub_ptr_;
+    MeasurementScheduler::Stream<IMUData>* imu_raw_stream_ptr_;
+    // high-rate measurements are integrated into increments at the output rate, nullptr if disabled:
+    std::shared_ptr<IMUDecimator> imu_decimator_ptr_;
     std::deque<IMUData> imu_raw_data_buff_;
     // b. lidar:
     std::shared_ptr<CloudSubscriber> cloud_sub_ptr_;
@@ -99,6 +122,7 @@ class FilteringFlow {
     std::deque<IMUData> imu_synced_data_buff_;
     // e. lidar to imu tf:
     std::shared_ptr<TFListener> lidar_to_imu_ptr_;
+    bool calibration_received_ = false;
     Eigen::Matrix4f lidar_to_imu_ = Eigen::Matrix4f::Identity();
 
     // publisher:
@@ -113,8 +137,15 @@ class FilteringFlow {
     // c. tf:
     std::shared_ptr<TFBroadCaster> laser_tf_pub_ptr_;
 
+    // raw IMU & paired lidar measurements in time order:
+    MeasurementScheduler scheduler_;
+    MeasurementScheduler::Stream<LidarData>* lidar_stream_ptr_;
+
     // filtering instance:
     std::shared_ptr<Filtering> filtering_ptr_;
+    // IMU-rate output while a lidar correction is in progress:
+    std::shared_ptr<ImuPosePredictor> imu_pose_predictor_ptr_;
+    imu_mechanization::NavState nav_state_;
 
     IMUData current_imu_raw_data_;
 
@@ -128,15 +159,39 @@ class FilteringFlow {
 
     Eigen::Matrix4f laser_pose_ = Eigen::Matrix4f::Identity();
 
-    // trajectory for evo evaluation:
+    // trajectory for evo evaluation, streamed to the logs in path_ as it is recorded:
     struct {
       size_t N = 0;
 
-      std::deque<double> time_;
-      std::deque<Eigen::Matrix4f> fused_;
-      std::deque<Eigen::Matrix4f> lidar_;
-      std::deque<Eigen::Matrix4f> ref_;
+      std::string path_ = "";
+      std::shared_ptr<TrajectoryLog> fused_;
+      std::shared_ptr<TrajectoryLog> lidar_;
+      std::shared_ptr<TrajectoryLog> ref_;
     } trajectory;
+    // shadow filters for A/B evaluation, their poses are logged to shadow_<name>.bin in trajectory.path_:
+    std::vector<std::shared_ptr<ShadowFilter>> shadow_filter_ptrs_;
+
+    // metrics, latency is of lidar corrections:
+    FlowMetrics metrics_{"filtering_flow"};
+    LatencyHistogram* update_latency_ptr_;
+    Counter* dropped_clouds_ptr_;
+    Counter* dropped_imu_synced_ptr_;
+    Counter* dropped_imu_raw_ptr_;
+    Counter* failed_corrections_ptr_;
+    // scans before the map needed for the first fix is ready:
+    Counter* unready_clouds_ptr_;
+    std::shared_ptr<LatencyTracer> latency_tracer_ptr_;
+    // stale lidar measurements are skipped & matching degraded under load:
+    std::shared_ptr<DeadlinePolicy> deadline_policy_ptr_;
+
+    // warm restart, the snapshot of the last run is tried once, within the first scan:
+    bool is_warm_restart_enabled_ = false;
+    double snapshot_interval_ = 1.0;
+    double snapshot_max_age_ = 10.0;
+    std::string snapshot_path_ = "";
+    std::shared_ptr<FilteringSnapshot> snapshot_ptr_;
+    bool has_snapshot_ = false;
+    double last_snapshot_time_ = 0.0;
 };
 
 } // namespace lidar_localization
@@ -0,0 +1,40 @@
+/*
+ * @Description: filtering state saved for warm restart of the localization
+ * @Author: Ge Yao
+ * @Date: 2020-12-30 20:41:15
+ */
+#ifndef LIDAR_LOCALIZATION_FILTERING_FILTERING_SNAPSHOT_HPP_
+#define LIDAR_LOCALIZATION_FILTERING_FILTERING_SNAPSHOT_HPP_
+
+#include <string>
+
+#include <Eigen/Dense>
+
+#include "lidar_localization/models/kalman_filter/error_state_kalman_filter.hpp"
+
+namespace lidar_localization {
+// everything in map frame, except the filter state:
+struct FilteringSnapshot {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    // time of the last lidar correction:
+    double time = 0.0;
+
+    // frame of the filter odometry:
+    Eigen::Matrix4f init_pose = Eigen::Matrix4f::Identity();
+    // last scan matching result & motion of the last step:
+    Eigen::Matrix4f last_pose = Eigen::Matrix4f::Identity();
+    Eigen::Matrix4f step_pose = Eigen::Matrix4f::Identity();
+    Eigen::Vector3f vel = Eigen::Vector3f::Zero();
+    // the tiles of the local map are those around its origin:
+    Eigen::Vector3f local_map_origin = Eigen::Vector3f::Zero();
+
+    ErrorStateKalmanFilter::State filter_state;
+
+    // written to a temporary file, then renamed over file_path, so a reader never sees a partial snapshot:
+    bool Save(const std::string& file_path) const;
+    bool Load(const std::string& file_path);
+};
+} // namespace lidar_localization
+
+#endif
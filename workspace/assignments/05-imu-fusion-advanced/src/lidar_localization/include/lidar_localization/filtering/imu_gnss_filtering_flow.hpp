@@ -23,6 +23,13 @@
 // filtering instance:
 #include "lidar_localization/filtering/imu_gnss_filtering.hpp"
 
+// metrics:
+#include "lidar_localization/tools/metrics.hpp"
+#include "lidar_localization/tools/latency_tracer.hpp"
+
+// measurement scheduling:
+#include "lidar_localization/tools/measurement_scheduler.hpp"
+
 #include "glog/logging.h"
 
 namespace lidar_localization {
@@ -39,18 +46,9 @@ class IMUGNSSFilteringFlow {
     bool ReadData();
     bool HasInited();
     
-    bool HasData();
-
-    bool HasIMUData(void) { 
-      return ( !imu_data_buff_.empty() ); 
-    }
-    bool HasGNSSData(void) { 
-      return ( !gnss_data_buff_.empty() );
-    }
-    bool HasIMUComesFirst(void) const { return imu_data_buff_.front().time < gnss_data_buff_.front().time; }
-
-    bool ValidIMUData();
-    bool ValidGNSSData();
+    // measurement callbacks, in time order:
+    void OnIMUData(const IMUData& imu_data);
+    void OnGNSSData(const PoseData& gnss_data);
 
     bool InitLocalization();
     
@@ -76,10 +74,10 @@ class IMUGNSSFilteringFlow {
     // subscriber:
     // a. IMU:
     std::shared_ptr<IMUSubscriber> imu_sub_ptr_;
-    std::deque<IMUData> imu_data_buff_;
+    MeasurementScheduler::Stream<IMUData>* imu_stream_ptr_;
     // b. GNSS:
     std::shared_ptr<OdometrySubscriber> gnss_sub_ptr_;
-    std::deque<PoseData> gnss_data_buff_;
+    MeasurementScheduler::Stream<PoseData>* gnss_stream_ptr_;
     // c. reference trajectory:
     std::shared_ptr<OdometrySubscriber> ref_pose_sub_ptr_;
     std::deque<PoseData> ref_pose_data_buff_;
@@ -91,9 +89,14 @@ class IMUGNSSFilteringFlow {
     std::shared_ptr<TFBroadCaster> imu_tf_pub_ptr_;
     // c. standard deviation:
     ros::Publisher fused_std_pub_;
+
+    // IMU & GNSS measurements in time order:
+    MeasurementScheduler scheduler_;
+
     // filtering instance:
     std::shared_ptr<IMUGNSSFiltering> filtering_ptr_;
 
+    bool has_imu_data_ = false;
     IMUData current_imu_data_;
     PoseData current_gnss_data_;
     PoseData current_ref_pose_data_;
@@ -112,6 +115,11 @@ class IMUGNSSFilteringFlow {
       std::deque<Eigen::Matrix4f> gnss_;
       std::deque<Eigen::Matrix4f> ref_;
     } trajectory;
+
+    // metrics, latency is of GNSS corrections:
+    FlowMetrics metrics_{"imu_gnss_filtering_flow"};
+    LatencyHistogram* update_latency_ptr_;
+    std::shared_ptr<LatencyTracer> latency_tracer_ptr_;
 };
 
 } // namespace lidar_localization
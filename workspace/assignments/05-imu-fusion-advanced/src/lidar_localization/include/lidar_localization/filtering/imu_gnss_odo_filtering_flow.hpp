@@ -25,6 +25,13 @@
 // filtering instance:
 #include "lidar_localization/filtering/imu_gnss_odo_filtering.hpp"
 
+// metrics:
+#include "lidar_localization/tools/metrics.hpp"
+#include "lidar_localization/tools/latency_tracer.hpp"
+
+// measurement scheduling:
+#include "lidar_localization/tools/measurement_scheduler.hpp"
+
 #include "glog/logging.h"
 
 namespace lidar_localization {
@@ -43,18 +50,9 @@ class IMUGNSSOdoFilteringFlow {
     bool ReadData();
     bool HasInited();
     
-    bool HasData();
-
-    bool HasIMUData(void) { 
-      return ( !imu_data_buff_.empty() ); 
-    }
-    bool HasPosVelData(void) { 
-      return ( !pos_vel_data_buff_.empty() );
-    }
-    bool HasIMUComesFirst(void) const { return imu_data_buff_.front().time < pos_vel_data_buff_.front().time; }
-
-    bool ValidIMUData();
-    bool ValidPosVelData();
+    // measurement callbacks, in time order:
+    void OnIMUData(const IMUData& imu_data);
+    void OnPosVelData(const PosVelData& pos_vel_data);
 
     bool InitLocalization();
     
@@ -80,10 +78,10 @@ class IMUGNSSOdoFilteringFlow {
     // subscriber:
     // a. IMU:
     std::shared_ptr<IMUSubscriber> imu_sub_ptr_;
-    std::deque<IMUData> imu_data_buff_;
+    MeasurementScheduler::Stream<IMUData>* imu_stream_ptr_;
     // b. synced GNSS-odo measurement:
     std::shared_ptr<PosVelSubscriber> pos_vel_sub_ptr_;
-    std::deque<PosVelData> pos_vel_data_buff_;
+    MeasurementScheduler::Stream<PosVelData>* pos_vel_stream_ptr_;
     // c. reference trajectory:
     std::shared_ptr<OdometrySubscriber> ref_pose_sub_ptr_;
     std::deque<PoseData> ref_pose_data_buff_;
@@ -95,9 +93,14 @@ class IMUGNSSOdoFilteringFlow {
     std::shared_ptr<TFBroadCaster> imu_tf_pub_ptr_;
     // c. standard deviation:
     ros::Publisher fused_std_pub_;
+
+    // IMU & GNSS-odo measurements in time order:
+    MeasurementScheduler scheduler_;
+
     // filtering instance:
     std::shared_ptr<IMUGNSSOdoFiltering> filtering_ptr_;
 
+    bool has_imu_data_ = false;
     IMUData current_imu_data_;
     PosVelData current_pos_vel_data_;
     PoseData current_ref_pose_data_;
@@ -117,6 +120,11 @@ class IMUGNSSOdoFilteringFlow {
       std::deque<Eigen::Matrix4f> gnss_;
       std::deque<Eigen::Matrix4f> ref_;
     } trajectory;
+
+    // metrics, latency is of GNSS-odo corrections:
+    FlowMetrics metrics_{"imu_gnss_odo_filtering_flow"};
+    LatencyHistogram* update_latency_ptr_;
+    std::shared_ptr<LatencyTracer> latency_tracer_ptr_;
 };
 
 } // namespace lidar_localization
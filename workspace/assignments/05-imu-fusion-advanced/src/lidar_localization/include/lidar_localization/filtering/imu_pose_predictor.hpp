@@ -0,0 +1,80 @@
+/*
+ * @Description: IMU-rate fused pose output, decoupled from lidar correction
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 22:52:18
+ */
+#ifndef LIDAR_LOCALIZATION_FILTERING_IMU_POSE_PREDICTOR_HPP_
+#define LIDAR_LOCALIZATION_FILTERING_IMU_POSE_PREDICTOR_HPP_
+
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+#include <yaml-cpp/yaml.h>
+
+#include "lidar_localization/sensor_data/imu_data.hpp"
+#include "lidar_localization/subscriber/imu_subscriber.hpp"
+#include "lidar_localization/publisher/odometry_publisher.hpp"
+#include "lidar_localization/models/imu_mechanization/imu_mechanization.hpp"
+#include "lidar_localization/tools/metrics.hpp"
+
+namespace lidar_localization {
+// raw IMU measurements are received on a callback queue of its own and served by a worker thread, so the output
+// keeps the IMU rate while the flow is busy with a lidar correction. each measurement is dead reckoned from the
+// latest nominal state of the flow, which takes over as soon as it is set, and the predicted pose is published
+class ImuPosePredictor {
+  public:
+    ImuPosePredictor(
+        ros::NodeHandle& nh,
+        const YAML::Node& node,
+        std::string imu_topic_name,
+        std::string topic_name,
+        std::string base_frame_id,
+        std::string child_frame_id
+    );
+    ~ImuPosePredictor();
+
+    // latest nominal state of the flow, after an update or a correction:
+    void SetNavState(const imu_mechanization::NavState& nav_state);
+
+  private:
+    void Run(void);
+    bool Predict(void);
+
+    imu_mechanization::IMUSample GetUnbiasedIMUSample(const IMUData& imu_data, double time) const;
+
+  private:
+    // no more output once the latest nominal state is older than this:
+    double max_propagation_time_;
+
+    ros::NodeHandle nh_;
+    ros::CallbackQueue callback_queue_;
+    std::shared_ptr<IMUSubscriber> imu_sub_ptr_;
+    std::shared_ptr<OdometryPublisher> odom_pub_ptr_;
+
+    // a. set by the flow:
+    std::mutex mutex_;
+    bool has_new_nav_state_ = false;
+    imu_mechanization::NavState new_nav_state_;
+
+    // b. owned by the worker:
+    bool has_nav_state_ = false;
+    imu_mechanization::NavState nav_state_;
+    imu_mechanization::NavState predicted_state_;
+    std::deque<IMUData> imu_data_buff_;
+    double last_published_time_ = 0.0;
+
+    Counter& num_predictions_;
+    Counter& num_expired_;
+
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+};
+} // namespace lidar_localization
+
+#endif
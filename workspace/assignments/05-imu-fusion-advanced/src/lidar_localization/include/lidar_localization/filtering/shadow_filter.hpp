@@ -0,0 +1,124 @@
+/*
+ * @Description: shadow Kalman filter, fed the measurements of the primary one on its own thread for A/B evaluation
+ * @Author: Ge Yao
+ * @Date: 2021-01-16 10:27:51
+ */
+#ifndef LIDAR_LOCALIZATION_FILTERING_SHADOW_FILTER_HPP_
+#define LIDAR_LOCALIZATION_FILTERING_SHADOW_FILTER_HPP_
+
+#include <deque>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <Eigen/Dense>
+#include <yaml-cpp/yaml.h>
+
+#include "lidar_localization/sensor_data/imu_data.hpp"
+#include "lidar_localization/models/kalman_filter/error_state_kalman_filter.hpp"
+#include "lidar_localization/models/kalman_filter/extended_kalman_filter.hpp"
+#include "lidar_localization/tools/metrics.hpp"
+#include "lidar_localization/tools/trajectory_log.hpp"
+
+namespace lidar_localization {
+// the caller only queues the measurements, so a shadow never delays the primary filter.
+// a shadow that falls behind by more than max_queue_size measurements stops for good,
+// its estimate would be of another measurement stream from then on.
+class ShadowFilter {
+  public:
+    struct Stats {
+      size_t num_updates = 0;
+      size_t num_corrections = 0;
+      size_t num_failed = 0;
+      size_t num_samples = 0;
+      bool is_stopped = false;
+    };
+
+    /**
+     * @brief  create a shadow filter
+     * @param  name, shadow name, for its log & metrics
+     * @param  fusion_method, kalman_filter or extended_kalman_filter
+     * @param  filter_node, filter params, as the kalman_filter params of the primary
+     * @param  log_path, trajectory log of the poses sampled
+     * @param  max_queue_size, max. num. of measurements queued
+     * @param  metrics, metrics of the flow
+     */
+    ShadowFilter(
+      const std::string& name,
+      const std::string& fusion_method, const YAML::Node& filter_node,
+      const std::string& log_path, size_t max_queue_size,
+      FlowMetrics& metrics
+    );
+    ~ShadowFilter();
+
+    const std::string& GetName(void) const { return name_; }
+
+    // measurements are only taken from the init on:
+    void Init(const Eigen::Vector3f& init_vel, const IMUData& init_imu_data);
+    void Update(const IMUData& imu_data);
+    // pose measurement in the odometry frame of the primary filter:
+    void Correct(const IMUData& imu_data, double time, const Eigen::Matrix4d& T_nb);
+    // log the pose, in map frame, as of the measurements queued so far:
+    void Sample(const Eigen::Matrix4f& init_pose);
+    // wait until the queued measurements are processed & the sampled poses on disk:
+    void Flush(void);
+
+    Stats GetStats(void);
+
+  private:
+    enum TaskType {
+      INIT,
+      UPDATE,
+      CORRECT,
+      SAMPLE
+    };
+
+    struct Task {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      TaskType type;
+      IMUData imu_data;
+      double time = 0.0;
+      Eigen::Vector3f vel = Eigen::Vector3f::Zero();
+      // measurement for CORRECT, init pose for SAMPLE:
+      Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+    };
+
+    bool AddTask(const Task& task);
+    void Process(const Task& task);
+    void Run(void);
+
+  private:
+    std::string name_;
+    size_t max_queue_size_;
+
+    // one of them, by fusion method:
+    std::shared_ptr<ErrorStateKalmanFilter> error_state_kalman_filter_ptr_;
+    std::shared_ptr<ExtendedKalmanFilter> extended_kalman_filter_ptr_;
+    std::shared_ptr<TrajectoryLog> log_ptr_;
+
+    // caller side:
+    bool is_started_ = false;
+
+    LatencyHistogram& update_latency_;
+    LatencyHistogram& correct_latency_;
+    Gauge& queue_depth_;
+    Counter& dropped_;
+
+    std::mutex mutex_;
+    std::condition_variable has_task_;
+    std::condition_variable is_idle_;
+
+    std::deque<Task, Eigen::aligned_allocator<Task>> queue_;
+    bool is_processing_ = false;
+    bool stop_ = false;
+    Stats stats_;
+
+    // runs the filter on the tasks in queue_:
+    std::thread thread_;
+};
+} // namespace lidar_localization
+
+#endif // LIDAR_LOCALIZATION_FILTERING_SHADOW_FILTER_HPP_
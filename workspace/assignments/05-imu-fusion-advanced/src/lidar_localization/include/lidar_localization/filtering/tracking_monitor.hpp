@@ -0,0 +1,51 @@
+/*
+ * @Description: tracking health of map-based localization, from the summary of each scan-map registration
+ * @Author: Ge Yao
+ * @Date: 2021-02-02 21:37:15
+ */
+#ifndef LIDAR_LOCALIZATION_FILTERING_TRACKING_MONITOR_HPP_
+#define LIDAR_LOCALIZATION_FILTERING_TRACKING_MONITOR_HPP_
+
+#include <yaml-cpp/yaml.h>
+
+#include "lidar_localization/models/registration/registration_interface.hpp"
+
+namespace lidar_localization {
+// a match is degraded if its fitness score is above the limit, too few source points found a correspondence,
+// or the Hessian is ill-conditioned, i.e. the scan does not constrain the pose in some direction.
+// the translational & rotational blocks are checked on their own, as their eigenvalues are of different units.
+// checks a backend does not report are skipped. tracking is lost after num_degraded_frames degraded matches in a row.
+class TrackingMonitor {
+  public:
+    enum class State {
+      HEALTHY = 0,
+      DEGRADED,
+      LOST
+    };
+
+    TrackingMonitor(const YAML::Node& node);
+
+    State Update(const RegistrationInterface::Result& result);
+    // e.g. once the pose is relocalized:
+    void Reset(void);
+
+    State GetState(void) const;
+    int GetNumDegradedFrames(void) const { return num_degraded_frames_; }
+    // min. of the translational & rotational ratios of the smallest to the largest Hessian eigenvalue, of the last match:
+    double GetConditioning(void) const { return conditioning_; }
+
+  private:
+    bool IsHealthy(const RegistrationInterface::Result& result);
+
+  private:
+    float max_fitness_score_;
+    float min_inlier_ratio_;
+    double min_conditioning_;
+    int max_num_degraded_frames_;
+
+    int num_degraded_frames_ = 0;
+    double conditioning_ = 1.0;
+};
+} // namespace lidar_localization
+
+#endif // LIDAR_LOCALIZATION_FILTERING_TRACKING_MONITOR_HPP_
@@ -8,6 +8,7 @@
 
 #include <string>
 #include <deque>
+#include <functional>
 #include <yaml-cpp/yaml.h>
 #include <fstream>
 
@@ -15,8 +16,17 @@
 #include "lidar_localization/sensor_data/pose_data.hpp"
 #include "lidar_localization/sensor_data/key_frame.hpp"
 #include "lidar_localization/sensor_data/loop_pose.hpp"
+#include "lidar_localization/tools/key_frame_writer.hpp"
+#include "lidar_localization/tools/trajectory_log.hpp"
+#include "lidar_localization/tools/checkpoint_log.hpp"
+#include "lidar_localization/models/key_frame_store/key_frame_store_interface.hpp"
+#include "lidar_localization/models/key_frame_selector/key_frame_selector_interface.hpp"
 
 #include "lidar_localization/models/graph_optimizer/g2o/g2o_graph_optimizer.hpp"
+#include "lidar_localization/models/graph_optimizer/gtsam/isam2_graph_optimizer.hpp"
+#include "lidar_localization/models/graph_optimizer/ceres/ceres_graph_optimizer.hpp"
+#include "lidar_localization/models/graph_optimizer/sliding_window/sliding_window_graph_optimizer.hpp"
+#include "lidar_localization/models/graph_optimizer/submap/submap_graph_optimizer.hpp"
 
 namespace lidar_localization {
 class BackEnd {
@@ -26,49 +36,89 @@ class BackEnd {
     bool Update(const CloudData& cloud_data, const PoseData& laser_odom, const PoseData& gnss_pose);
     bool InsertLoopPose(const LoopPose& loop_pose);
     bool ForceOptimize();
+    // write out what the last ForceOptimize committed, the checkpoint, the optimized pose log & its KITTI export.
+    // only waits on the writer threads, so it can run in the background while Update goes on:
+    bool SaveOptimized(const std::function<void(double progress, const std::string& message)>& progress);
 
     void GetOptimizedKeyFrames(std::deque<KeyFrame>& key_frames_deque);
     bool HasNewKeyFrame();
     bool HasNewOptimized();
-    void GetLatestKeyScan(CloudData& key_scan);
+    // shared with the key frame writer, read only:
+    void GetLatestKeyScan(double& time, CloudData::CLOUD::ConstPtr& key_scan_ptr);
     void GetLatestKeyFrame(KeyFrame& key_frame);
     void GetLatestKeyGNSS(KeyFrame& key_frame);
+    // approx. heap bytes held by key frames & optimized poses, and by the pose graph:
+    size_t GetKeyFramesMemoryUsage(void) const;
+    size_t GetGraphMemoryUsage(void) const;
 
   private:
     bool InitWithConfig();
     bool InitParam(const YAML::Node& config_node);
     bool InitGraphOptimizer(const YAML::Node& config_node);
     bool InitDataPath(const YAML::Node& config_node);
+    bool InitKeyFrameStore(const YAML::Node& config_node);
+    bool InitKeyFrameSelector(const YAML::Node& config_node);
+    bool InitCheckpoint(const YAML::Node& config_node);
+    // replay the checkpoint log, nodes start at their last optimized poses, so nothing is re-optimized:
+    bool RestoreCheckpoint(void);
 
     void ResetParam();
     bool SavePose(std::ofstream& ofs, const Eigen::Matrix4f& pose);
-    bool AddNodeAndEdge(const PoseData& gnss_data);
+    // the node starts at node_pose if given, otherwise at the key frame pose:
+    bool AddNodeAndEdge(const PoseData& gnss_data, const Eigen::Matrix4f* node_pose_ptr = nullptr);
     bool MaybeNewKeyFrame(const CloudData& cloud_data, const PoseData& laser_odom, const PoseData& gnss_pose);
     bool MaybeOptimized();
+    bool MaybeMarginalize();
     bool SaveOptimizedPose();
+    // optimized poses of the graph before marginalization, committed with what led to them:
+    void CommitOptimizedPose();
 
   private:
     std::string key_frames_path_ = "";
     std::string scan_context_path_ = "";
     std::string trajectory_path_ = "";
 
+    // key scans are written to disk off the frame path:
+    std::shared_ptr<KeyFrameStoreInterface> key_frame_store_ptr_;
+    std::shared_ptr<KeyFrameWriter> key_frame_writer_ptr_;
+
     std::ofstream ground_truth_ofs_;
     std::ofstream laser_odom_ofs_;
-    std::ofstream optimized_pose_ofs_;
+    // optimized poses are logged as binary patches, exported as text on ForceOptimize:
+    std::shared_ptr<TrajectoryLog> optimized_pose_log_ptr_;
 
-    float key_frame_distance_ = 2.0;
+    std::shared_ptr<KeyFrameSelectorInterface> key_frame_selector_ptr_;
+    // max. num. of key frames kept in back end, 0 for unbounded:
+    int window_size_ = 0;
 
     bool has_new_key_frame_ = false;
     bool has_new_optimized_ = false;
 
-    CloudData current_key_scan_;
+    // the incoming scan is kept as is, no copy:
+    double current_key_scan_time_ = 0.0;
+    CloudData::CLOUD::ConstPtr current_key_scan_ptr_;
     KeyFrame current_key_frame_;
     KeyFrame current_key_gnss_;
+    // the key frame of the last graph node, for the odometry edge:
+    KeyFrame last_key_frame_;
     std::deque<KeyFrame> key_frames_deque_;
+    unsigned int key_frame_num_ = 0;
     std::deque<Eigen::Matrix4f> optimized_pose_;
+    // key frame index of optimized_pose_.front():
+    unsigned int optimized_pose_first_index_ = 0;
 
     // 优化器
     std::shared_ptr<InterfaceGraphOptimizer> graph_optimizer_ptr_;
+    // export the graph on ForceOptimize, for solver benchmarking:
+    bool save_graph_ = false;
+
+    // key frames, loop closures & optimized poses are logged for restart, nullptr if disabled:
+    std::string checkpoint_path_ = "";
+    bool is_checkpoint_restored_ = false;
+    std::shared_ptr<CheckpointLog> checkpoint_log_ptr_;
+    // committed every checkpoint_interval_ key frames, and after every optimization:
+    int checkpoint_interval_ = 10;
+    int checkpoint_cnt_ = 0;
 
     class GraphOptimizerConfig {
       public:
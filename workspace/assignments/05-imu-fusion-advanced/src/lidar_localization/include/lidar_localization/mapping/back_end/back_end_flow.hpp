@@ -19,6 +19,9 @@
 
 #include "lidar_localization/mapping/back_end/back_end.hpp"
 
+#include "lidar_localization/tools/metrics.hpp"
+#include "lidar_localization/tools/background_jobs.hpp"
+
 namespace lidar_localization {
 class BackEndFlow {
   public:
@@ -27,6 +30,8 @@ class BackEndFlow {
     bool Run();
 
     bool ForceOptimize();
+    // optimizes & publishes at once, the logs are written by the returned job:
+    BackgroundJobs::Job GetForceOptimizeJob();
 
   private:
     bool ReadData();
@@ -57,6 +62,12 @@ class BackEndFlow {
     PoseData current_gnss_pose_data_;
     PoseData current_laser_odom_data_;
     CloudData current_cloud_data_;
+
+    FlowMetrics metrics_{"back_end_flow"};
+    Counter* dropped_clouds_ptr_;
+    Counter* dropped_gnss_ptr_;
+    Counter* dropped_laser_odom_ptr_;
+    Counter* inserted_loop_poses_ptr_;
 };
 }
 
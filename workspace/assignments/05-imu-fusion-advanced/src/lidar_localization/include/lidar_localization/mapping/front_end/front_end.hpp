@@ -7,33 +7,68 @@
 #define LIDAR_LOCALIZATION_MAPPING_FRONT_END_FRONT_END_HPP_
 
 #include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <Eigen/Dense>
 #include <yaml-cpp/yaml.h>
 
 #include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/sensor_data/compact_cloud.hpp"
+#include "lidar_localization/sensor_data/imu_data.hpp"
 #include "lidar_localization/models/registration/registration_interface.hpp"
 #include "lidar_localization/models/cloud_filter/cloud_filter_interface.hpp"
+#include "lidar_localization/models/local_map/voxel_hash_map.hpp"
+#include "lidar_localization/models/key_frame_selector/key_frame_selector_interface.hpp"
+#include "lidar_localization/models/imu_mechanization/imu_motion_prior.hpp"
 
 namespace lidar_localization {
 class FrontEnd {
   public:
     struct Frame { 
+        int id = 0;
         Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
         CloudData cloud_data;
+        // key frames of a fully rebuilt window, in place of cloud_data when compact key frames are enabled:
+        CompactCloud::ConstPtr compact_cloud_ptr;
     };
 
   public:
     FrontEnd();
+    ~FrontEnd();
 
     bool Update(const CloudData& cloud_data, Eigen::Matrix4f& cloud_pose);
     bool SetInitPose(const Eigen::Matrix4f& init_pose);
 
+    // IMU motion prior, the flow only needs to feed IMU measurements & extrinsics when it is used:
+    bool HasIMUMotionPrior(void) const { return static_cast<bool>(imu_motion_prior_ptr_); }
+    bool HasLidarToIMU(void) const { return imu_motion_prior_ptr_ && imu_motion_prior_ptr_->HasLidarToIMU(); }
+    bool HasIMUData(double time) const { return imu_motion_prior_ptr_ && imu_motion_prior_ptr_->HasIMUData(time); }
+    bool SetLidarToIMU(const Eigen::Matrix4f& lidar_to_imu);
+    bool AddIMUData(const IMUData& imu_data);
+
   private:
     bool InitWithConfig();
     bool InitParam(const YAML::Node& config_node);
     bool InitRegistration(std::shared_ptr<RegistrationInterface>& registration_ptr, const YAML::Node& config_node);
+    bool InitRegistration(
+        std::shared_ptr<RegistrationInterface>& registration_ptr, 
+        const std::string& registration_method, const YAML::Node& config_node
+    );
     bool InitFilter(std::string filter_user, std::shared_ptr<CloudFilterInterface>& filter_ptr, const YAML::Node& config_node);
+    bool InitLocalMap(const YAML::Node& config_node);
+    bool InitKeyFrameSelector(const YAML::Node& config_node);
+    bool InitMotionPrior(const YAML::Node& config_node);
+    bool InitTwoRateOdometry(const YAML::Node& config_node);
     bool UpdateWithNewFrame(const Frame& new_key_frame);
+    // odometry state after the pose of the current scan is estimated:
+    void UpdateMotion(double time);
+
+    // two-rate odometry, scan-to-scan match of the current scan, which is then queued for scan-to-map refinement:
+    bool UpdateTwoRate(const CloudData::CLOUD_PTR& filtered_cloud_ptr, Eigen::Matrix4f& cloud_pose);
+    // a finished refinement corrects the odometry state & goes through key frame selection, on the caller thread:
+    void ApplyMapRefinement(void);
+    void RunMapMatching(void);
 
   private:
     std::string data_path_ = "";
@@ -44,16 +79,59 @@ class FrontEnd {
     std::shared_ptr<CloudFilterInterface> local_map_filter_ptr_;
     // point cloud registrator:
     std::shared_ptr<RegistrationInterface> registration_ptr_; 
+    // key frame policy:
+    std::shared_ptr<KeyFrameSelectorInterface> key_frame_selector_ptr_;
+    // registration initial guess from IMU, null for constant velocity:
+    std::shared_ptr<IMUMotionPrior> imu_motion_prior_ptr_;
 
     std::deque<Frame> local_map_frames_;
 
+    // incremental local map, null when local map is fully rebuilt for every key frame:
+    std::shared_ptr<VoxelHashMap> local_map_voxels_ptr_;
     CloudData::CLOUD_PTR local_map_ptr_;
     Frame current_frame_;
+    int num_key_frames_ = 0;
 
     Eigen::Matrix4f init_pose_ = Eigen::Matrix4f::Identity();
 
-    float key_frame_distance_ = 2.0;
+    // odometry state for the prediction of the next scan, reset by the first scan:
+    Eigen::Matrix4f step_pose_ = Eigen::Matrix4f::Identity();
+    Eigen::Matrix4f last_pose_ = Eigen::Matrix4f::Identity();
+    Eigen::Matrix4f predict_pose_ = Eigen::Matrix4f::Identity();
+    double last_time_ = 0.0;
+    Eigen::Vector3f last_vel_ = Eigen::Vector3f::Zero();
+
     int local_frame_num_ = 20;
+    // key frames of a fully rebuilt window are kept quantized, 0 if disabled:
+    float compact_key_frame_resolution_ = 0.0f;
+
+    // two-rate odometry, scans are matched to the previous scan at frame rate & refined against the local map
+    // on a worker thread, null if disabled:
+    std::shared_ptr<RegistrationInterface> scan_to_scan_registration_ptr_;
+    // min. num. of scans between two refinements:
+    int map_interval_ = 1;
+    int num_scans_since_map_ = 0;
+    // previous filtered scan, in its lidar frame:
+    CloudData::CLOUD_PTR last_filtered_cloud_ptr_;
+
+    enum MapJobState {
+      MAP_JOB_NONE,
+      // owned by the worker:
+      MAP_JOB_PENDING,
+      // refined pose ready, owned by the caller:
+      MAP_JOB_DONE
+    };
+    std::mutex map_job_mutex_;
+    std::condition_variable has_map_job_;
+    MapJobState map_job_state_ = MAP_JOB_NONE;
+    bool stop_ = false;
+    // registration_ptr_ & the local map belong to the worker while a job is pending:
+    Frame map_job_frame_;
+    CloudData::CLOUD_PTR map_job_cloud_ptr_;
+    Eigen::Matrix4f map_job_pose_ = Eigen::Matrix4f::Identity();
+
+    // refines map_job_pose_ & updates the local map of the pending map job:
+    std::thread map_thread_;
 };
 }
 
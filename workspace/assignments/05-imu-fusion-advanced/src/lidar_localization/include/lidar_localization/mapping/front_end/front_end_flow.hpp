@@ -9,8 +9,12 @@
 #include <ros/ros.h>
 
 #include "lidar_localization/subscriber/cloud_subscriber.hpp"
+#include "lidar_localization/subscriber/imu_subscriber.hpp"
+#include "lidar_localization/tf_listener/tf_listener.hpp"
 #include "lidar_localization/publisher/odometry_publisher.hpp"
 #include "lidar_localization/mapping/front_end/front_end.hpp"
+#include "lidar_localization/tools/metrics.hpp"
+#include "lidar_localization/tools/latency_tracer.hpp"
 
 namespace lidar_localization {
 class FrontEndFlow {
@@ -21,6 +25,7 @@ class FrontEndFlow {
 
   private:
     bool ReadData();
+    bool InitCalibration();
     bool HasData();
     bool ValidData();
     bool UpdateLaserOdometry();
@@ -28,14 +33,23 @@ class FrontEndFlow {
 
   private:
     std::shared_ptr<CloudSubscriber> cloud_sub_ptr_;
+    // raw IMU & lidar-IMU extrinsics, only for the IMU motion prior:
+    std::shared_ptr<IMUSubscriber> imu_sub_ptr_;
+    std::shared_ptr<TFListener> lidar_to_imu_ptr_;
     std::shared_ptr<OdometryPublisher> laser_odom_pub_ptr_;
     std::shared_ptr<FrontEnd> front_end_ptr_;
 
     std::deque<CloudData> cloud_data_buff_;
+    std::deque<IMUData> imu_data_buff_;
 
     CloudData current_cloud_data_;
 
+    bool odometry_inited_ = false;
     Eigen::Matrix4f laser_odometry_ = Eigen::Matrix4f::Identity();
+
+    FlowMetrics metrics_{"front_end_flow"};
+    Counter* failed_updates_ptr_;
+    std::shared_ptr<LatencyTracer> latency_tracer_ptr_;
 };
 }
 
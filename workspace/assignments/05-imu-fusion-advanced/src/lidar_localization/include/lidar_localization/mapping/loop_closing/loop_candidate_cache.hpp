@@ -0,0 +1,87 @@
+/*
+ * @Description: recent loop candidate verifications, for the deduplication of proposals along a revisit
+ * @Author: Ge Yao
+ * @Date: 2021-01-29 09:47:31
+ */
+#ifndef LIDAR_LOCALIZATION_MAPPING_LOOP_CLOSING_LOOP_CANDIDATE_CACHE_HPP_
+#define LIDAR_LOCALIZATION_MAPPING_LOOP_CLOSING_LOOP_CANDIDATE_CACHE_HPP_
+
+#include <deque>
+
+#include <yaml-cpp/yaml.h>
+#include <Eigen/Dense>
+
+#include "lidar_localization/sensor_data/key_frame.hpp"
+
+namespace lidar_localization {
+// while a mapped segment is revisited, consecutive proposals pair up neighboring key frames of both drives.
+// a candidate whose map & query key frames are both within index_window of an entry added less than
+// time_window ago, by query key frame time, is redundant and not verified again, whatever the outcome.
+// otherwise an accepted entry along the same revisit, i.e. with about the same index offset between map &
+// query key frame and its query key frame within warm_start_window, seeds the registration: its relative
+// pose is moved to the new pair of key frames by their odometry poses.
+// not thread-safe, the caller serializes access.
+class LoopCandidateCache {
+  public:
+    enum Decision {
+      VERIFY,
+      WARM_START,
+      SUPPRESS
+    };
+
+    struct Stats {
+      size_t num_lookups = 0;
+      size_t num_suppressed = 0;
+      size_t num_warm_starts = 0;
+    };
+
+    LoopCandidateCache(const YAML::Node& node);
+
+    /**
+     * @brief  check a candidate against the recent verifications
+     * @param  map_key_frame, key frame of the candidate
+     * @param  key_frame, query key frame
+     * @param  relative_pose, output warm start, pose of the query key frame in the candidate key frame
+     * @return decision
+     */
+    Decision Lookup(const KeyFrame& map_key_frame, const KeyFrame& key_frame, Eigen::Matrix4f& relative_pose);
+    // a candidate queued for verification:
+    void Add(const KeyFrame& map_key_frame, const KeyFrame& key_frame);
+    // verification result, relative_pose as LoopPose::pose:
+    void SetResult(unsigned int map_index, unsigned int index, bool is_accepted, const Eigen::Matrix4f& relative_pose);
+    // a candidate dropped before verification:
+    void Remove(unsigned int map_index, unsigned int index);
+
+    const Stats& GetStats(void) const { return stats_; }
+
+  private:
+    enum State {
+      PENDING,
+      ACCEPTED,
+      REJECTED
+    };
+
+    struct Entry {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      KeyFrame map_key_frame;
+      KeyFrame key_frame;
+      State state = PENDING;
+      Eigen::Matrix4f relative_pose = Eigen::Matrix4f::Identity();
+    };
+
+    Entry* Find(unsigned int map_index, unsigned int index);
+
+  private:
+    int index_window_;
+    double time_window_;
+    int warm_start_window_;
+    size_t max_size_;
+
+    // oldest first:
+    std::deque<Entry, Eigen::aligned_allocator<Entry>> entries_;
+    Stats stats_;
+};
+} // namespace lidar_localization
+
+#endif
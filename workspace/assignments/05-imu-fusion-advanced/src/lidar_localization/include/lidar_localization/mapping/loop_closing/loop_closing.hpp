@@ -7,6 +7,11 @@
 #define LIDAR_LOCALIZATION_MAPPING_LOOP_CLOSING_LOOP_CLOSING_HPP_
 
 #include <deque>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <Eigen/Dense>
 #include <pcl/registration/ndt.h>
 #include <yaml-cpp/yaml.h>
@@ -14,48 +19,144 @@
 #include "lidar_localization/sensor_data/key_frame.hpp"
 #include "lidar_localization/sensor_data/loop_pose.hpp"
 #include "lidar_localization/models/cloud_filter/cloud_filter_interface.hpp"
+#include "lidar_localization/models/key_frame_store/key_frame_store_interface.hpp"
+#include "lidar_localization/models/key_frame_store/key_scan_cache.hpp"
 #include "lidar_localization/models/scan_context_manager/scan_context_manager.hpp"
+#include "lidar_localization/models/key_frame_index/key_frame_grid_index.hpp"
 #include "lidar_localization/models/registration/registration_interface.hpp"
+#include "lidar_localization/models/registration/fpfh_ransac_alignment.hpp"
+#include "lidar_localization/models/registration/registration_target_cache.hpp"
+#include "lidar_localization/mapping/loop_closing/loop_candidate_cache.hpp"
+#include "lidar_localization/tools/checkpoint_log.hpp"
 
 
 namespace lidar_localization {
 class LoopClosing {
   public:
+    struct Stats {
+      size_t queue_depth = 0;
+      size_t max_queue_depth = 0;
+      size_t num_verified = 0;
+      size_t num_loop_poses = 0;
+      // tasks lost because the verifier fell behind:
+      size_t num_dropped = 0;
+      size_t num_coalesced = 0;
+      // candidates not verified as redundant with a recent verification, and seeded by an earlier loop:
+      size_t num_suppressed = 0;
+      size_t num_warm_starts = 0;
+      // key frame windows loaded ahead of a likely verification:
+      size_t num_prefetches = 0;
+    };
+
     LoopClosing();
+    ~LoopClosing();
 
+    // scan context update and proposal search run inline, 
+    // verification runs on the verifier thread when async_verification is set:
     bool Update(
       const CloudData &key_scan, 
       const KeyFrame &key_frame, 
       const KeyFrame &key_gnss
     );
 
+    // takes the next verified loop pose, if any:
     bool HasNewLoopPose();
     LoopPose& GetCurrentLoopPose();
 
+    Stats GetStats(void);
+    // approx. heap bytes held by key frames & key GNSS, by the scan context index, 
+    // and by the clouds of queued verification tasks:
+    size_t GetKeyFramesMemoryUsage(void) const;
+    size_t GetScanContextMemoryUsage(void) const;
+    size_t GetVerificationQueueMemoryUsage(void);
+
     bool Save(void);
+    // commits the checkpoint & takes the scan context state as of now, for SaveSnapshot:
+    std::shared_ptr<ScanContextManager> GetSnapshot(void);
+    // only waits on the checkpoint writer, so it can run on another thread while Update goes on:
+    bool SaveSnapshot(
+      std::shared_ptr<ScanContextManager> snapshot_ptr,
+      const std::function<void(double progress, const std::string& message)>& progress
+    );
 
   private:
+    void LogStats(void);
     bool InitWithConfig();
     bool InitParam(const YAML::Node& config_node);
     bool InitDataPath(const YAML::Node& config_node);
+    bool InitKeyFrameStore(const YAML::Node& config_node);
     bool InitFilter(std::string filter_user, std::shared_ptr<CloudFilterInterface>& filter_ptr, const YAML::Node& config_node);
     bool InitLoopClosure(const YAML::Node& config_node);
     bool InitRegistration(std::shared_ptr<RegistrationInterface>& registration_ptr, const YAML::Node& config_node);
+    bool InitPreAlignment(const YAML::Node& config_node);
+    bool InitVerification(const YAML::Node& config_node);
+    bool InitCandidateCache(const YAML::Node& config_node);
+    bool InitTargetCache(const YAML::Node& config_node);
+    bool InitPrefetch(const YAML::Node& config_node);
+    bool InitCheckpoint(const YAML::Node& config_node);
+    // replay the checkpoint log, scan contexts are restored as logged, no key scan is described again:
+    bool RestoreCheckpoint(void);
+
+    // everything the verifier needs, copied so it never reads the growing key frame buffers:
+    struct LoopCandidate {
+      float yaw_change_in_rad = 0.0f;
+      KeyFrame key_frame;
+      KeyFrame key_gnss;
+      std::vector<KeyFrame> map_key_frames;
+      // relative pose predicted from an earlier loop along the same revisit, as LoopPose::pose:
+      bool has_warm_start = false;
+      Eigen::Matrix4f warm_start_pose = Eigen::Matrix4f::Identity();
+    };
+    struct VerificationTask {
+      std::vector<LoopCandidate> candidates;
+      CloudData key_scan;
+      KeyFrame key_frame;
+      KeyFrame key_gnss;
+    };
+    // the window of a likely candidate & the key frames around it, loaded by the verifier while it is idle:
+    struct PrefetchTask {
+      std::vector<KeyFrame> map_key_frames;
+      std::vector<KeyFrame> margin_key_frames;
+    };
     
     bool DetectNearestKeyFrame(
-      int& key_frame_index,
-      float& yaw_change_in_rad
+      std::vector<std::pair<int, float>>& proposals
     );
-    bool CloudRegistration(
-      const int key_frame_index,
-      const float yaw_change_in_rad
+    void GetVerificationTask(
+      const std::vector<std::pair<int, float>>& proposals,
+      const CloudData& key_scan,
+      VerificationTask& task
     );
-    bool JointMap(
-      const int key_frame_index, const float yaw_change_in_rad,
-      CloudData::CLOUD_PTR& map_cloud_ptr, Eigen::Matrix4f& map_pose
+    // the map window of a candidate key frame, centered on the target window stride:
+    void GetMapKeyFrames(int key_frame_index, std::vector<KeyFrame>& map_key_frames) const;
+    bool AddVerificationTask(VerificationTask& task);
+    // once the closest earlier key frame is within the prefetch radius, its neighborhood is loaded ahead:
+    void RequestPrefetch(int key_frame_index);
+    void Prefetch(const PrefetchTask& task);
+    // candidates of a task discarded by the verification queue, with mutex_ held:
+    void RemoveCandidates(const VerificationTask& task);
+    // verifications saved by the candidate cache, logged once per minute of key frame time:
+    void ReportCandidateCache(double time);
+    void RunVerification(void);
+
+    bool CloudRegistration(const VerificationTask& task, LoopPose& loop_pose);
+    // per-level iterations, empty unless registration is coarse-to-fine:
+    static std::string GetLevelReport(const std::shared_ptr<RegistrationInterface>& registration_ptr);
+    // empty unless pre-alignment is enabled:
+    std::string GetPreAlignmentReport(const FPFHRansacAlignment::Result& result) const;
+    // empty unless the target cache is enabled:
+    std::string GetTargetCacheReport(void) const;
+    // GNSS pose of the candidate key frame, with the yaw change of the proposal:
+    void GetMapPose(const LoopCandidate& candidate, Eigen::Matrix4f& map_pose) const;
+    // the map is in the frame of the key frame poses, so it only depends on the key frame window:
+    bool JointMap(const std::vector<KeyFrame>& map_key_frames, CloudData::CLOUD_PTR& map_cloud_ptr);
+    bool JointScan(
+      const VerificationTask& task,
+      CloudData::CLOUD_PTR& scan_cloud_ptr, Eigen::Matrix4f& scan_pose
     );
-    bool JointScan(CloudData::CLOUD_PTR& scan_cloud_ptr, Eigen::Matrix4f& scan_pose);
-    bool Registration(CloudData::CLOUD_PTR& map_cloud_ptr, 
+    // a target set on the registration is built from the map cloud & kept in the entry, for the target cache:
+    bool Registration(std::shared_ptr<RegistrationInterface>& registration_ptr,
+                      RegistrationTargetCache::Entry& map_target, 
                       CloudData::CLOUD_PTR& scan_cloud_ptr, 
                       Eigen::Matrix4f& scan_pose, 
                       Eigen::Matrix4f& result_pose);
@@ -63,6 +164,8 @@ class LoopClosing {
   private:
     std::string key_frames_path_ = "";
     std::string scan_context_path_ = "";
+    // key scans received from back end are cached in key_frames_path_, instead of read from its key frames:
+    bool is_key_frame_streamed_ = false;
 
     std::string loop_closure_method_ = "";
 
@@ -71,17 +174,70 @@ class LoopClosing {
     int diff_num_ = 100;
     float detect_area_ = 10.0;
     float fitness_score_limit_ = 2.0;
+    int num_loop_candidates_ = 1;
 
+    // detection is performed for every skip_num_ key frames:
+    int skip_cnt_ = 0;
+    int skip_num_ = 10;
+
+    std::shared_ptr<KeyFrameStoreInterface> key_frame_store_ptr_;
+    std::shared_ptr<KeyScanCache> key_scan_cache_ptr_;
     std::shared_ptr<CloudFilterInterface> scan_filter_ptr_;
     std::shared_ptr<CloudFilterInterface> map_filter_ptr_;
     std::shared_ptr<ScanContextManager> scan_context_manager_ptr_;
-    std::shared_ptr<RegistrationInterface> registration_ptr_; 
+    // one per loop closure candidate, candidates are verified in parallel:
+    std::vector<std::shared_ptr<RegistrationInterface>> registration_ptrs_; 
+    // global pre-alignment seeding registration in place of GNSS, shared by all candidates, nullptr if disabled:
+    std::shared_ptr<FPFHRansacAlignment> pre_alignment_ptr_;
+    // recent verifications, guarded by mutex_, nullptr if disabled:
+    std::shared_ptr<LoopCandidateCache> candidate_cache_ptr_;
+    double cache_report_time_ = -1.0;
+    size_t cache_report_num_suppressed_ = 0;
+    size_t cache_report_num_warm_starts_ = 0;
+    // maps & registration targets by key frame window, used by the verifier only, nullptr if disabled.
+    // windows are centered on every target_window_stride_-th key frame, so neighboring candidates share them:
+    std::shared_ptr<RegistrationTargetCache> target_cache_ptr_;
+    int target_window_stride_ = 1;
+    // speculative loading of the key scans, and of the target if cached, of the closest earlier key frame
+    // within prefetch_radius_, on the verifier thread between verifications:
+    bool prefetch_ = false;
+    float prefetch_radius_ = 0.0f;
+    int prefetch_margin_frame_num_ = 0;
+    bool prefetch_target_ = false;
+    // window of the last request, not requested again:
+    int last_prefetch_index_ = -1;
 
     std::deque<KeyFrame> all_key_frames_;
     std::deque<KeyFrame> all_key_gnss_;
+    // positions of all_key_gnss_, by index:
+    std::shared_ptr<KeyFrameGridIndex> key_gnss_index_ptr_;
 
     LoopPose current_loop_pose_;
-    bool has_new_loop_pose_ = false;
+
+    // key frames & their scan context descriptors are logged for restart, nullptr if disabled:
+    std::string checkpoint_path_ = "";
+    bool is_checkpoint_restored_ = false;
+    std::shared_ptr<CheckpointLog> checkpoint_log_ptr_;
+    // committed every checkpoint_interval_ key frames, and on save:
+    int checkpoint_interval_ = 10;
+    int checkpoint_cnt_ = 0;
+
+    // verification pipeline, one producer (Update) and one consumer (verifier thread):
+    bool async_verification_ = false;
+    size_t verification_queue_size_ = 2;
+    // coalesce: the new task replaces the newest queued one; drop: the new task is discarded
+    bool coalesce_verification_ = true;
+
+    std::mutex mutex_;
+    std::condition_variable has_task_;
+    std::deque<VerificationTask> verification_queue_;
+    // the newest request only, verification tasks go first:
+    std::deque<PrefetchTask> prefetch_queue_;
+    std::deque<LoopPose> loop_poses_;
+    bool stop_ = false;
+    Stats stats_;
+
+    std::thread verification_thread_;
 };
 }
 
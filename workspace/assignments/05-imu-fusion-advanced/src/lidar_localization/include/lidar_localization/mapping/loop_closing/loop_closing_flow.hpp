@@ -15,6 +15,10 @@
 #include "lidar_localization/publisher/loop_pose_publisher.hpp"
 // loop closing
 #include "lidar_localization/mapping/loop_closing/loop_closing.hpp"
+// metrics
+#include "lidar_localization/tools/metrics.hpp"
+// save
+#include "lidar_localization/tools/background_jobs.hpp"
 
 namespace lidar_localization {
 class LoopClosingFlow {
@@ -23,6 +27,8 @@ class LoopClosingFlow {
 
     bool Run();
     bool Save();
+    // the scan context state as of now, saved by the returned job:
+    BackgroundJobs::Job GetSaveJob();
     
   private:
     bool ReadData();
@@ -47,6 +53,12 @@ class LoopClosingFlow {
     CloudData current_key_scan_;
     KeyFrame current_key_frame_;
     KeyFrame current_key_gnss_;
+
+    // metrics
+    FlowMetrics metrics_{"loop_closing_flow"};
+    Counter* dropped_key_frames_ptr_;
+    Counter* dropped_key_gnss_ptr_;
+    Counter* published_loop_poses_ptr_;
 };
 }
 
@@ -7,6 +7,11 @@
 #define LIDAR_LOCALIZATION_MAPPING_VIEWER_VIEWER_HPP_
 
 #include <string>
+#include <deque>
+#include <map>
+#include <vector>
+#include <chrono>
+#include <functional>
 #include <Eigen/Dense>
 #include <yaml-cpp/yaml.h>
 
@@ -14,10 +19,19 @@
 #include "lidar_localization/sensor_data/key_frame.hpp"
 #include "lidar_localization/sensor_data/pose_data.hpp"
 #include "lidar_localization/models/cloud_filter/voxel_filter.hpp"
+#include "lidar_localization/models/cloud_filter/voxel_filter_fast.hpp"
+#include "lidar_localization/models/cloud_filter/voxel_filter_adaptive.hpp"
+#include "lidar_localization/models/cloud_filter/filter_chain.hpp"
+#include "lidar_localization/models/key_frame_store/key_frame_store_interface.hpp"
+#include "lidar_localization/models/key_frame_store/key_scan_cache.hpp"
+#include "lidar_localization/models/tiled_map/streaming_map_builder.hpp"
 
 namespace lidar_localization {
 class Viewer {
   public:
+    // fraction done in [0, 1] & the current step, as BackgroundJobs::Progress:
+    typedef std::function<void(double progress, const std::string& message)> Progress;
+
     Viewer();
 
     bool UpdateWithOptimizedKeyFrames(std::deque<KeyFrame>& optimized_key_frames);
@@ -26,10 +40,17 @@ class Viewer {
                                CloudData cloud_data);
 
     bool SaveMap();
+    // the key frames SaveMap saves the map of:
+    void GetOptimizedKeyFrames(std::deque<KeyFrame>& key_frames) const { key_frames = optimized_key_frames_; }
+    // the map of the given key frames, whose key scans are loaded by a key frame store of the call,
+    // so it can run on another thread while the viewer goes on. one call at a time:
+    bool SaveMap(const std::deque<KeyFrame>& key_frames, const Progress& progress);
     Eigen::Matrix4f& GetCurrentPose();
     CloudData::CLOUD_PTR& GetCurrentScan();
     bool GetLocalMap(CloudData::CLOUD_PTR& local_map_ptr);
     bool GetGlobalMap(CloudData::CLOUD_PTR& local_map_ptr);
+    // key scans of the global map that are new or moved since the last update:
+    bool GetGlobalMapDelta(CloudData::CLOUD_PTR& delta_map_ptr);
     bool HasNewLocalMap();
     bool HasNewGlobalMap();
 
@@ -37,15 +58,30 @@ class Viewer {
     bool InitWithConfig();
     bool InitParam(const YAML::Node& config_node);
     bool InitDataPath(const YAML::Node& config_node);
+    bool InitKeyFrameStore(const YAML::Node& config_node);
+    bool CreateKeyFrameStore(std::shared_ptr<KeyFrameStoreInterface>& key_frame_store_ptr);
+    bool InitGlobalMap(const YAML::Node& config_node);
+    bool InitSaveMap(const YAML::Node& config_node);
     bool InitFilter(std::string filter_user, 
                     std::shared_ptr<CloudFilterInterface>& filter_ptr, 
                     const YAML::Node& config_node);
 
     bool OptimizeKeyFrames();
     bool JointGlobalMap(CloudData::CLOUD_PTR& global_map_ptr);
+    struct GlobalMapSubmap;
+    bool UpdateGlobalMapSubmaps();
+    bool IsSubmapRigid(const GlobalMapSubmap& submap, const std::vector<const KeyFrame*>& key_frames);
+    bool BuildSubmap(const std::vector<const KeyFrame*>& key_frames, GlobalMapSubmap& submap);
+    bool IsPoseMoved(const Eigen::Matrix4f& last_pose, const Eigen::Matrix4f& pose);
     bool JointLocalMap(CloudData::CLOUD_PTR& local_map_ptr);
     bool JointCloudMap(const std::deque<KeyFrame>& key_frames, 
                              CloudData::CLOUD_PTR& map_cloud_ptr);
+    bool JointCloudMap(const std::deque<KeyFrame>& key_frames, 
+                       KeyScanCache& key_scan_cache,
+                       CloudData::CLOUD_PTR& map_cloud_ptr,
+                       const Progress& progress);
+    bool SaveMap(const std::deque<KeyFrame>& key_frames, KeyScanCache& key_scan_cache, const Progress& progress);
+    bool SaveStreamingMap(const std::deque<KeyFrame>& key_frames, KeyScanCache& key_scan_cache, const Progress& progress);
 
   private:
     std::string data_path_ = "";
@@ -54,16 +90,50 @@ class Viewer {
     std::string key_frames_path_ = "";
     std::string map_path_ = "";
 
+    // for the key frame stores of SaveMap:
+    YAML::Node key_frame_store_config_node_;
+    std::shared_ptr<KeyFrameStoreInterface> key_frame_store_ptr_;
+    std::shared_ptr<KeyScanCache> key_scan_cache_ptr_;
     std::shared_ptr<CloudFilterInterface> frame_filter_ptr_;
     std::shared_ptr<CloudFilterInterface> local_map_filter_ptr_;
     std::shared_ptr<CloudFilterInterface> global_map_filter_ptr_;
 
+    std::string save_map_method_ = "in_memory";
+    std::shared_ptr<StreamingMapBuilder> streaming_map_builder_ptr_;
+    // no LOD map is saved if 0:
+    int lod_map_num_levels_ = 0;
+    float lod_map_leaf_size_ = 0.5f;
+
     Eigen::Matrix4f pose_to_optimize_ = Eigen::Matrix4f::Identity();
     PoseData optimized_odom_;
     CloudData optimized_cloud_;
     std::deque<KeyFrame> optimized_key_frames_;
     std::deque<KeyFrame> all_key_frames_;
 
+    // global map kept per submap of global_map_submap_size consecutive key frames. the filtered
+    // cloud of a submap is kept in the frame of its first key frame, so a loop closure that moves
+    // the submap rigidly is a pose change, no key scan is loaded or filtered again:
+    struct GlobalMapSubmap {
+      std::vector<unsigned int> key_frame_indices;
+      // key frame poses in the frame of the first key frame:
+      std::vector<Eigen::Matrix4f> relative_poses;
+      Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
+      CloudData::CLOUD_PTR local_cloud_ptr;
+      // the cloud in map frame, transformed with map_cloud_pose when the global map is fetched:
+      Eigen::Matrix4f map_cloud_pose = Eigen::Matrix4f::Identity();
+      CloudData::CLOUD_PTR map_cloud_ptr;
+    };
+    // by key frame index / global_map_submap_size:
+    std::map<unsigned int, GlobalMapSubmap> global_map_submaps_;
+    CloudData::CLOUD_PTR global_map_delta_ptr_;
+    bool has_new_global_map_submaps_ = false;
+
+    double global_map_publish_interval_ = 5.0;
+    int global_map_submap_size_ = 10;
+    float pose_translation_threshold_ = 0.05f;
+    float pose_rotation_threshold_ = 0.01f;
+    std::chrono::steady_clock::time_point last_global_map_time_;
+
     bool has_new_global_map_ = false;
     bool has_new_local_map_ = false;
 };
@@ -18,6 +18,10 @@
 #include "lidar_localization/publisher/cloud_publisher.hpp"
 // viewer
 #include "lidar_localization/mapping/viewer/viewer.hpp"
+// metrics
+#include "lidar_localization/tools/metrics.hpp"
+// save map
+#include "lidar_localization/tools/background_jobs.hpp"
 
 namespace lidar_localization {
 class ViewerFlow {
@@ -26,6 +30,8 @@ class ViewerFlow {
 
     bool Run();
     bool SaveMap();
+    // the map of the optimized key frames as of now, saved by the returned job:
+    BackgroundJobs::Job GetSaveMapJob();
 
   private:
     bool ReadData();
@@ -44,6 +50,7 @@ class ViewerFlow {
     std::shared_ptr<OdometryPublisher> optimized_odom_pub_ptr_;
     std::shared_ptr<CloudPublisher> current_scan_pub_ptr_;
     std::shared_ptr<CloudPublisher> global_map_pub_ptr_;
+    std::shared_ptr<CloudPublisher> global_map_delta_pub_ptr_;
     std::shared_ptr<CloudPublisher> local_map_pub_ptr_;
     // viewer
     std::shared_ptr<Viewer> viewer_ptr_;
@@ -56,6 +63,11 @@ class ViewerFlow {
 
     CloudData current_cloud_data_;
     PoseData current_transformed_odom_;
+
+    // metrics
+    FlowMetrics metrics_{"viewer_flow"};
+    Counter* dropped_clouds_ptr_;
+    Counter* dropped_transformed_odom_ptr_;
 };
 }
 
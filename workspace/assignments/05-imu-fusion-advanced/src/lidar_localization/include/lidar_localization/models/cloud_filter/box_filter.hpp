@@ -16,7 +16,7 @@ class BoxFilter: public CloudFilterInterface {
     BoxFilter(YAML::Node node);
     BoxFilter() = default;
 
-    bool Filter(const CloudData::CLOUD_PTR& input_cloud_ptr, CloudData::CLOUD_PTR& filtered_cloud_ptr) override;
+    bool Filter(const CloudData::CLOUD::ConstPtr& input_cloud_ptr, CloudData::CLOUD_PTR& filtered_cloud_ptr) override;
 
     void SetSize(std::vector<float> size);
     void SetOrigin(std::vector<float> origin);
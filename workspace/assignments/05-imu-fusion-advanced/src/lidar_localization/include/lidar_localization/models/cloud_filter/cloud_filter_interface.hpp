@@ -14,7 +14,12 @@ class CloudFilterInterface {
   public:
     virtual ~CloudFilterInterface() = default;
 
-    virtual bool Filter(const CloudData::CLOUD_PTR& input_cloud_ptr, CloudData::CLOUD_PTR& filtered_cloud_ptr) = 0;
+    // a null filtered cloud is allocated by the filter, or shares the input cloud if nothing is filtered:
+    virtual bool Filter(const CloudData::CLOUD::ConstPtr& input_cloud_ptr, CloudData::CLOUD_PTR& filtered_cloud_ptr) = 0;
+    // same, for filters that can use the range image of the cloud data, if any, instead of building their own:
+    virtual bool Filter(const CloudData& cloud_data, CloudData::CLOUD_PTR& filtered_cloud_ptr) {
+        return Filter(cloud_data.cloud_ptr, filtered_cloud_ptr);
+    }
 };
 }
 
@@ -0,0 +1,63 @@
+/*
+ * @Description: filter chain fused into a single pass over the input with a single output allocation
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 22:31:47
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_CLOUD_FILTER_FILTER_CHAIN_HPP_
+#define LIDAR_LOCALIZATION_MODELS_CLOUD_FILTER_FILTER_CHAIN_HPP_
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <memory>
+
+#include <Eigen/Dense>
+
+#include "lidar_localization/models/cloud_filter/cloud_filter_interface.hpp"
+#include "lidar_localization/models/cloud_filter/voxel_filter_fast.hpp"
+#include "lidar_localization/models/cloud_filter/ground_filter.hpp"
+
+namespace lidar_localization {
+// configured by a sequence of stages, each with its type and params:
+//   nan, drops non-finite points
+//   range, keeps min_range <= |p| <= max_range
+//   box, keeps min <= p <= max, per axis
+//   voxel, as voxel_filter_fast
+//   ground, as ground_filter
+// the point-wise stages commute, so they are fused into one mask, which the last stage, voxel or ground,
+// applies while it reads the input. without one the kept points are compacted into the output.
+// an empty chain passes the input through
+class FilterChain: public CloudFilterInterface {
+  public:
+    FilterChain(const YAML::Node& node);
+
+    bool Filter(const CloudData::CLOUD::ConstPtr& input_cloud_ptr, CloudData::CLOUD_PTR& filtered_cloud_ptr) override;
+    // the range image, if any, goes to the ground stage:
+    bool Filter(const CloudData& cloud_data, CloudData::CLOUD_PTR& filtered_cloud_ptr) override;
+
+  private:
+    bool Filter(
+        const CloudData::CLOUD::ConstPtr& input_cloud_ptr, const CloudData::RANGE_IMAGE_PTR& range_image_ptr,
+        CloudData::CLOUD_PTR& filtered_cloud_ptr
+    );
+    bool IsKept(const CloudData::POINT& point) const;
+
+  private:
+    // a. point-wise stages, intersected:
+    bool has_point_stage_ = false;
+    bool has_range_ = false;
+    float min_sq_range_ = 0.0f;
+    float max_sq_range_ = std::numeric_limits<float>::max();
+    bool has_box_ = false;
+    Eigen::Vector3f box_min_ = Eigen::Vector3f::Constant(-std::numeric_limits<float>::max());
+    Eigen::Vector3f box_max_ = Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+    // b. last stage, at most one of them:
+    std::shared_ptr<FastVoxelFilter> voxel_filter_ptr_;
+    std::shared_ptr<GroundFilter> ground_filter_ptr_;
+
+    // reused across calls:
+    std::vector<uint8_t> point_mask_;
+};
+}
+
+#endif
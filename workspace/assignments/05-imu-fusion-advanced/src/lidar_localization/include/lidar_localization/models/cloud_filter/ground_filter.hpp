@@ -0,0 +1,59 @@
+/*
+ * @Description: range image ground segmentation, ground decimated harder than the rest before registration
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 21:34:12
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_CLOUD_FILTER_GROUND_FILTER_HPP_
+#define LIDAR_LOCALIZATION_MODELS_CLOUD_FILTER_GROUND_FILTER_HPP_
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+
+#include "lidar_localization/sensor_data/range_image.hpp"
+#include "lidar_localization/models/cloud_filter/cloud_filter_interface.hpp"
+#include "lidar_localization/models/cloud_filter/voxel_filter_fast.hpp"
+
+namespace lidar_localization {
+// ground labeling as LINS ImageProjection::groundRemoval, for scans in the lidar frame: points are binned into a
+// range image, see range_image.hpp, the one built at ingest if the cloud data has it.
+// going up each column of the lowest rings, consecutive cells no steeper than max_ground_angle are ground.
+// ground points then go through a coarse voxel filter, all others through the usual one
+class GroundFilter: public CloudFilterInterface {
+  public:
+    GroundFilter(const YAML::Node& node);
+
+    bool Filter(const CloudData::CLOUD::ConstPtr& input_cloud_ptr, CloudData::CLOUD_PTR& filtered_cloud_ptr) override;
+    bool Filter(const CloudData& cloud_data, CloudData::CLOUD_PTR& filtered_cloud_ptr) override;
+    // points with a zero mask are dropped in the same pass, an empty mask keeps all.
+    // a null range image, or one not of the input or with too few rows, is built by the filter:
+    bool Filter(
+        const CloudData::CLOUD::ConstPtr& input_cloud_ptr, const std::vector<uint8_t>& point_mask,
+        const CloudData::RANGE_IMAGE_PTR& range_image_ptr, CloudData::CLOUD_PTR& filtered_cloud_ptr
+    );
+
+    // num. of ground points of the last input, before decimation:
+    size_t GetNumGroundPoints(void) const { return num_ground_points_; }
+
+  private:
+    // a. range image, when the input has none:
+    RangeImage range_image_;
+    // b. ground labeling:
+    int num_ground_rings_;
+    float max_ground_slope_;
+    float max_ground_height_;
+    // c. decimation:
+    std::shared_ptr<FastVoxelFilter> ground_filter_ptr_;
+    std::shared_ptr<FastVoxelFilter> structure_filter_ptr_;
+
+    // reused across calls:
+    // by cell of the ground rings:
+    std::vector<uint8_t> is_ground_cell_;
+    CloudData::CLOUD_PTR ground_cloud_ptr_;
+    CloudData::CLOUD_PTR structure_cloud_ptr_;
+
+    size_t num_ground_points_ = 0;
+};
+}
+
+#endif
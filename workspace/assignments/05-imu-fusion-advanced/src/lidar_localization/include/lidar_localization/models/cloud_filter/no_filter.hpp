@@ -13,7 +13,7 @@ class NoFilter: public CloudFilterInterface {
   public:
     NoFilter();
 
-    bool Filter(const CloudData::CLOUD_PTR& input_cloud_ptr, CloudData::CLOUD_PTR& filtered_cloud_ptr) override;
+    bool Filter(const CloudData::CLOUD::ConstPtr& input_cloud_ptr, CloudData::CLOUD_PTR& filtered_cloud_ptr) override;
 };
 }
 #endif
\ No newline at end of file
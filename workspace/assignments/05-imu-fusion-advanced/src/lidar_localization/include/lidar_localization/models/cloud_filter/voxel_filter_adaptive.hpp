@@ -0,0 +1,43 @@
+/*
+ * @Description: voxel filter aiming at a target point count, with the leaf size adapted from cloud to cloud
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 22:14:05
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_CLOUD_FILTER_VOXEL_FILTER_ADAPTIVE_HPP_
+#define LIDAR_LOCALIZATION_MODELS_CLOUD_FILTER_VOXEL_FILTER_ADAPTIVE_HPP_
+
+#include <memory>
+
+#include "lidar_localization/models/cloud_filter/cloud_filter_interface.hpp"
+#include "lidar_localization/models/cloud_filter/voxel_filter_fast.hpp"
+
+namespace lidar_localization {
+// the filtered count is modeled as proportional to leaf_size^-dimension, which the previous cloud calibrates:
+// its leaf size and filtered count predict the leaf size of the next one, so a stream of similar clouds
+// costs one voxel pass each. a cloud far above the target, e.g. on entering a dense area, is filtered again
+class AdaptiveVoxelFilter: public CloudFilterInterface {
+  public:
+    AdaptiveVoxelFilter(const YAML::Node& node);
+
+    bool Filter(const CloudData::CLOUD::ConstPtr& input_cloud_ptr, CloudData::CLOUD_PTR& filtered_cloud_ptr) override;
+
+    // leaf size predicted for the next cloud:
+    float GetLeafSize(void) const { return leaf_size_; }
+
+  private:
+    float PredictLeafSize(float leaf_size, size_t num_points) const;
+
+  private:
+    size_t target_num_points_;
+    float min_leaf_size_;
+    float max_leaf_size_;
+    float dimension_;
+    float tolerance_;
+    int max_num_refinements_;
+
+    float leaf_size_;
+    std::shared_ptr<FastVoxelFilter> voxel_filter_ptr_;
+};
+}
+
+#endif
@@ -0,0 +1,79 @@
+/*
+ * @Description: parallel hash-based voxel filter, without the bounded index of pcl::VoxelGrid
+ * @Author: Ge Yao
+ * @Date: 2020-12-19 19:42:16
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_CLOUD_FILTER_VOXEL_FILTER_FAST_HPP_
+#define LIDAR_LOCALIZATION_MODELS_CLOUD_FILTER_VOXEL_FILTER_FAST_HPP_
+
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "lidar_localization/models/cloud_filter/cloud_filter_interface.hpp"
+
+namespace lidar_localization {
+class FastVoxelFilter: public CloudFilterInterface {
+  public:
+    enum Mode {
+      // centroid of each voxel, same as pcl::VoxelGrid:
+      CENTROID,
+      // first point of each voxel:
+      APPROXIMATE
+    };
+
+    FastVoxelFilter(const YAML::Node& node);
+    FastVoxelFilter(float leaf_size_x, float leaf_size_y, float leaf_size_z, Mode mode);
+
+    bool Filter(const CloudData::CLOUD::ConstPtr& input_cloud_ptr, CloudData::CLOUD_PTR& filtered_cloud_ptr) override;
+    // points with a zero mask are dropped in the same pass, an empty mask keeps all:
+    bool Filter(
+        const CloudData::CLOUD::ConstPtr& input_cloud_ptr, const std::vector<uint8_t>& point_mask,
+        CloudData::CLOUD_PTR& filtered_cloud_ptr
+    );
+
+    // for owners that change the leaf size per cloud, quiet unlike the constructors:
+    bool SetLeafSize(float leaf_size_x, float leaf_size_y, float leaf_size_z);
+
+  private:
+    struct VoxelIndex {
+      int32_t x;
+      int32_t y;
+      int32_t z;
+
+      bool operator==(const VoxelIndex& other) const {
+        return x == other.x && y == other.y && z == other.z;
+      }
+    };
+
+    struct VoxelIndexHash {
+      size_t operator()(const VoxelIndex& index) const {
+        return static_cast<size_t>(
+          static_cast<uint64_t>(static_cast<uint32_t>(index.x)) * 73856093ULL ^
+          static_cast<uint64_t>(static_cast<uint32_t>(index.y)) * 19349669ULL ^
+          static_cast<uint64_t>(static_cast<uint32_t>(index.z)) * 83492791ULL
+        );
+      }
+    };
+
+    struct Voxel {
+      int first_point_index;
+      int num_points;
+      Eigen::Vector3d sum;
+    };
+
+    bool SetFilterParam(float leaf_size_x, float leaf_size_y, float leaf_size_z, Mode mode);
+
+  private:
+    Eigen::Vector3f inverse_leaf_size_;
+    Mode mode_;
+
+    // reused across calls:
+    std::vector<VoxelIndex> point_voxel_indices_;
+    std::vector<size_t> point_voxel_hashes_;
+    std::vector<CloudData::CLOUD, Eigen::aligned_allocator<CloudData::CLOUD>> shard_clouds_;
+};
+}
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * @Description: pose graph optimizer using Ceres, with analytic SE3 residuals
+ * @Author: Ge Yao
+ * @Date: 2020-12-27 09:41:26
+ */
+
+#ifndef LIDAR_LOCALIZATION_MODELS_GRAPH_OPTIMIZER_CERES_CERES_GRAPH_OPTIMIZER_HPP_
+#define LIDAR_LOCALIZATION_MODELS_GRAPH_OPTIMIZER_CERES_CERES_GRAPH_OPTIMIZER_HPP_
+
+#ifdef LIDAR_LOCALIZATION_WITH_CERES
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+
+#include <ceres/ceres.h>
+
+#include "lidar_localization/models/graph_optimizer/interface_graph_optimizer.hpp"
+
+namespace lidar_localization {
+// t + δt, q * Exp(δθ), defined in the translation unit:
+class Se3Parameterization;
+
+// the problem & its parameter blocks are kept between Optimize calls, so each optimization
+// starts from the previous estimate. the linear solver is multi-threaded on a large graph
+class CeresGraphOptimizer: public InterfaceGraphOptimizer {
+  public:
+    CeresGraphOptimizer(const YAML::Node& node);
+    ~CeresGraphOptimizer();
+    // 优化
+    bool Optimize() override;
+    // 输出数据
+    bool GetOptimizedPose(std::deque<Eigen::Matrix4f>& optimized_pose) override;
+    int GetNodeNum() override;
+    int GetFirstNodeIndex() override;
+    size_t GetMemoryUsage(void) const override;
+    void SetEstimateOptimized(void) override;
+    // the oldest remaining node is fixed at its current estimate, in place of the removed ones:
+    bool RemoveOldestSe3Nodes(int num_nodes_to_keep) override;
+    // 添加节点、边、鲁棒核
+    void SetEdgeRobustKernel(std::string robust_kernel_name, double robust_kernel_size) override;
+    void AddSe3Node(const Eigen::Isometry3d &pose, bool need_fix) override;
+    void AddSe3Edge(int vertex_index1,
+                    int vertex_index2,
+                    const Eigen::Isometry3d &relative_pose,
+                    const Eigen::VectorXd noise) override;
+    void AddSe3PriorXYZEdge(int se3_vertex_index,
+                            const Eigen::Vector3d &xyz,
+                            Eigen::VectorXd noise) override;
+    void AddSe3PriorQuaternionEdge(int se3_vertex_index,
+                                   const Eigen::Quaterniond &quat,
+                                   Eigen::VectorXd noise) override;
+
+  private:
+    // t then q, in Eigen x-y-z-w order:
+    using Se3Param = std::array<double, 7>;
+
+    struct Se3Edge {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      int vertex_index1;
+      int vertex_index2;
+      Eigen::Isometry3d relative_pose;
+    };
+
+    double *GetParam(int vertex_index);
+    Eigen::Isometry3d GetPose(int vertex_index);
+    ceres::LossFunction *CreateRobustKernel(void);
+    // a new node follows its edge to the latest optimized neighbor, instead of keeping the raw odometry pose:
+    void InitNewNodes(void);
+
+  private:
+    ceres::Solver::Options options_;
+
+    std::unique_ptr<Se3Parameterization> se3_parameterization_ptr_;
+    std::unique_ptr<ceres::Problem> problem_ptr_;
+
+    // deque keeps the parameter block addresses on push_back & pop_front:
+    std::deque<Se3Param> nodes_;
+    std::deque<bool> is_fixed_;
+    int node_num_ = 0;
+    int first_node_index_ = 0;
+
+    // estimate has been optimized at least once:
+    bool has_estimate_ = false;
+    // added since last Optimize:
+    int new_node_index_ = 0;
+    std::vector<Se3Edge, Eigen::aligned_allocator<Se3Edge>> new_edges_;
+
+    std::string robust_kernel_name_;
+    double robust_kernel_size_;
+    bool need_robust_kernel_ = false;
+};
+} // namespace lidar_localization
+
+#endif
+
+#endif
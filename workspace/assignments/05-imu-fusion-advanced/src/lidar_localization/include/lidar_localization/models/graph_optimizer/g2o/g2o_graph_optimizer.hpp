@@ -14,7 +14,15 @@
 #include <g2o/core/sparse_optimizer.h>
 #include <g2o/core/robust_kernel_factory.h>
 #include <g2o/core/optimization_algorithm_factory.h>
+#include <g2o/core/optimization_algorithm_levenberg.h>
 #include <g2o/solvers/pcg/linear_solver_pcg.h>
+#include <g2o/solvers/eigen/linear_solver_eigen.h>
+#ifdef LIDAR_LOCALIZATION_WITH_G2O_CHOLMOD
+#include <g2o/solvers/cholmod/linear_solver_cholmod.h>
+#endif
+#ifdef LIDAR_LOCALIZATION_WITH_G2O_CSPARSE
+#include <g2o/solvers/csparse/linear_solver_csparse.h>
+#endif
 #include <g2o/types/slam3d/types_slam3d.h>
 #include <g2o/types/slam3d/edge_se3_pointxyz.h>
 #include <g2o/types/slam3d_addons/types_slam3d_addons.h>
@@ -44,20 +52,26 @@ G2O_USE_OPTIMIZATION_LIBRARY(pcg)
 G2O_USE_OPTIMIZATION_LIBRARY(cholmod)
 G2O_USE_OPTIMIZATION_LIBRARY(csparse)
 
-// namespace g2o {
-// G2O_REGISTER_TYPE(EDGE_SE3_PRIORXYZ, EdgeSE3PriorXYZ)
-// G2O_REGISTER_TYPE(EDGE_SE3_PRIORQUAT, EdgeSE3PriorQuat)
-// } // namespace g2o
-
 namespace lidar_localization {
 class G2oGraphOptimizer: public InterfaceGraphOptimizer {
   public:
-    G2oGraphOptimizer(const std::string &solver_type = "lm_var");
+    // incremental: only hand new vertices & edges to the solver and warm-start from the current estimate
+    G2oGraphOptimizer(const std::string &solver_type = "lm_var", bool incremental = false);
+    // lm_fix6_3_cholmod, lm_fix6_3_csparse & lm_fix6_3_eigen are built as fixed-size 6-3 block solvers,
+    // other names are passed to the g2o solver factory. nullptr if not found:
+    static g2o::OptimizationAlgorithm *CreateAlgorithm(const std::string &solver_type);
     // 优化
     bool Optimize() override;
     // 输出数据
     bool GetOptimizedPose(std::deque<Eigen::Matrix4f>& optimized_pose) override;
+    int GetOptimizedPoses(Eigen::Matrix4f *optimized_poses, int max_num_poses) override;
     int GetNodeNum() override;
+    int GetFirstNodeIndex() override;
+    size_t GetMemoryUsage(void) const override;
+    void SetEstimateOptimized(void) override;
+    // the oldest remaining node is fixed at its current estimate, in place of the removed ones:
+    bool RemoveOldestSe3Nodes(int num_nodes_to_keep) override;
+    bool SaveGraph(const std::string &graph_path) override;
     // 添加节点、边、鲁棒核
     void SetEdgeRobustKernel(std::string robust_kernel_name, double robust_kernel_size) override;
     void AddSe3Node(const Eigen::Isometry3d &pose, bool need_fix) override;
@@ -71,12 +85,20 @@ class G2oGraphOptimizer: public InterfaceGraphOptimizer {
     void AddSe3PriorQuaternionEdge(int se3_vertex_index,
                                    const Eigen::Quaterniond &quat,
                                    Eigen::VectorXd noise) override;
+    void AddSe3Nodes(const Eigen::Isometry3d *poses, int num_poses, bool need_fix) override;
+    void AddSe3Edges(const Se3Edge *edges, int num_edges, const Eigen::VectorXd &noise) override;
 
   private:
-    Eigen::MatrixXd CalculateSe3EdgeInformationMatrix(Eigen::VectorXd noise);
     Eigen::MatrixXd CalculateSe3PriorQuaternionEdgeInformationMatrix(Eigen::VectorXd noise);
     Eigen::MatrixXd CalculateDiagMatrix(Eigen::VectorXd noise);
+    // diag. information matrix of the noise, cached by noise config:
+    const Eigen::MatrixXd &GetDiagMatrix(const Eigen::VectorXd &noise);
+    g2o::VertexSE3 *GetVertex(int vertex_index) const;
+    void AddSe3EdgeToGraph(g2o::VertexSE3 *v1, g2o::VertexSE3 *v2,
+                           const Eigen::Isometry3d &relative_pose,
+                           const Eigen::MatrixXd &information_matrix);
     void AddRobustKernel(g2o::OptimizableGraph::Edge *edge, const std::string &kernel_type, double kernel_size);
+    void InitNewVertices(void);
 
   private:
     g2o::RobustKernelFactory *robust_kernel_factory_;
@@ -85,6 +107,22 @@ class G2oGraphOptimizer: public InterfaceGraphOptimizer {
     std::string robust_kernel_name_;
     double robust_kernel_size_;
     bool need_robust_kernel_ = false;
+
+    int node_num_ = 0;
+    int first_node_index_ = 0;
+    // SE3 vertices by id, nullptr once removed, so no lookup & cast per edge:
+    std::vector<g2o::VertexSE3 *> vertices_;
+    // noise -> information matrix:
+    std::vector<std::pair<Eigen::VectorXd, Eigen::MatrixXd>> information_cache_;
+
+    bool incremental_ = false;
+    // solver structure is up to date:
+    bool is_initialized_ = false;
+    // estimate has been optimized at least once:
+    bool has_estimate_ = false;
+    // added since last Optimize:
+    g2o::HyperGraph::VertexSet new_vertices_;
+    g2o::HyperGraph::EdgeSet new_edges_;
 };
 } // namespace lidar_localization
 #endif
\ No newline at end of file
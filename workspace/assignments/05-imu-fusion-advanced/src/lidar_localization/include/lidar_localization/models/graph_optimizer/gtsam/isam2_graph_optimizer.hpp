@@ -0,0 +1,78 @@
+/*
+ * @Description: incremental graph optimizer using GTSAM iSAM2
+ * @Author: Ge Yao
+ * @Date: 2020-12-11 21:17:45
+ */
+
+#ifndef LIDAR_LOCALIZATION_MODELS_GRAPH_OPTIMIZER_GTSAM_ISAM2_GRAPH_OPTIMIZER_HPP_
+#define LIDAR_LOCALIZATION_MODELS_GRAPH_OPTIMIZER_GTSAM_ISAM2_GRAPH_OPTIMIZER_HPP_
+
+#ifdef LIDAR_LOCALIZATION_WITH_GTSAM
+
+#include <memory>
+
+#include <yaml-cpp/yaml.h>
+
+#include <gtsam/geometry/Pose3.h>
+#include <gtsam/nonlinear/ISAM2.h>
+#include <gtsam/nonlinear/NonlinearFactorGraph.h>
+#include <gtsam/nonlinear/Values.h>
+#include <gtsam/linear/NoiseModel.h>
+
+#include "lidar_localization/models/graph_optimizer/interface_graph_optimizer.hpp"
+
+namespace lidar_localization {
+// nodes and edges are buffered until Optimize, which only re-solves the cliques they touch
+class ISAM2GraphOptimizer: public InterfaceGraphOptimizer {
+  public:
+    ISAM2GraphOptimizer(const YAML::Node& node);
+    // 优化
+    bool Optimize() override;
+    // 输出数据
+    bool GetOptimizedPose(std::deque<Eigen::Matrix4f>& optimized_pose) override;
+    int GetNodeNum() override;
+    int GetFirstNodeIndex() override;
+    // not supported, iSAM2 keeps the whole graph:
+    bool RemoveOldestSe3Nodes(int num_nodes_to_keep) override;
+    // 添加节点、边、鲁棒核
+    void SetEdgeRobustKernel(std::string robust_kernel_name, double robust_kernel_size) override;
+    void AddSe3Node(const Eigen::Isometry3d &pose, bool need_fix) override;
+    void AddSe3Edge(int vertex_index1,
+                    int vertex_index2,
+                    const Eigen::Isometry3d &relative_pose,
+                    const Eigen::VectorXd noise) override;
+    void AddSe3PriorXYZEdge(int se3_vertex_index,
+                            const Eigen::Vector3d &xyz,
+                            Eigen::VectorXd noise) override;
+    void AddSe3PriorQuaternionEdge(int se3_vertex_index,
+                                   const Eigen::Quaterniond &quat,
+                                   Eigen::VectorXd noise) override;
+
+  private:
+    static gtsam::Pose3 ToPose3(const Eigen::Isometry3d &pose);
+    // x-y-z & yaw-roll-pitch noise to GTSAM rotation-first tangent order:
+    gtsam::SharedNoiseModel GetSe3EdgeNoiseModel(const Eigen::VectorXd &noise);
+    gtsam::SharedNoiseModel AddRobustKernel(const gtsam::SharedNoiseModel &noise_model);
+
+  private:
+    std::unique_ptr<gtsam::ISAM2> isam2_ptr_;
+    // extra iSAM2 updates after a loop closure, re-linearize the affected path:
+    int num_loop_updates_ = 5;
+
+    // added since last Optimize:
+    gtsam::NonlinearFactorGraph new_factors_;
+    gtsam::Values new_values_;
+    bool has_new_loop_ = false;
+
+    gtsam::Values estimate_;
+    int node_num_ = 0;
+
+    std::string robust_kernel_name_;
+    double robust_kernel_size_;
+    bool need_robust_kernel_ = false;
+};
+} // namespace lidar_localization
+
+#endif
+
+#endif
@@ -9,17 +9,55 @@
 
 #include <string>
 #include <deque>
+#include <vector>
 #include <Eigen/Dense>
+#include <Eigen/StdVector>
 
 namespace lidar_localization {
 class InterfaceGraphOptimizer {
   public:
+    // 最近一次优化的统计
+    struct OptimizeStats {
+      int num_vertices = 0;
+      int num_edges = 0;
+      int num_iterations = 0;
+      double chi2_before = 0.0;
+      double chi2_after = 0.0;
+      // seconds:
+      double time_consumption = 0.0;
+      bool is_incremental = false;
+    };
+
+    // relative pose edge, for adding them in batch:
+    struct Se3Edge {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      int vertex_index1 = 0;
+      int vertex_index2 = 0;
+      Eigen::Isometry3d relative_pose = Eigen::Isometry3d::Identity();
+    };
+    using Se3EdgeVector = std::vector<Se3Edge, Eigen::aligned_allocator<Se3Edge>>;
+
     virtual ~InterfaceGraphOptimizer() {}
     // 优化
     virtual bool Optimize() = 0;
     // 输入、输出数据
+    // poses of nodes in graph, from GetFirstNodeIndex() on:
     virtual bool GetOptimizedPose(std::deque<Eigen::Matrix4f>& optimized_pose) = 0;
+    // same poses into a caller buffer of max_num_poses, returns the num. written:
+    virtual int GetOptimizedPoses(Eigen::Matrix4f *optimized_poses, int max_num_poses);
+    // num. of nodes ever added, also the index of the next node:
     virtual int GetNodeNum() = 0;
+    virtual int GetFirstNodeIndex() = 0;
+    // 滑窗：移除最早的节点及其边，只保留最新的 num_nodes_to_keep 个节点
+    virtual bool RemoveOldestSe3Nodes(int num_nodes_to_keep) = 0;
+    // export the graph for offline replay, e.g. in .g2o format. false if not supported:
+    virtual bool SaveGraph(const std::string &graph_path) { return false; }
+    // approx. heap bytes held by nodes & edges, solver workspaces are not counted. 0 if not reported:
+    virtual size_t GetMemoryUsage(void) const { return 0; }
+    // take the node estimates as optimized ones, e.g. restored from a checkpoint, so the next optimization 
+    // starts from them instead of an initial guess. no-op for optimizers that always do:
+    virtual void SetEstimateOptimized(void) {}
     // 添加节点、边、鲁棒核
     virtual void SetEdgeRobustKernel(std::string robust_kernel_name, double robust_kernel_size) = 0;
     virtual void AddSe3Node(const Eigen::Isometry3d &pose, bool need_fix) = 0;
@@ -33,11 +71,17 @@ class InterfaceGraphOptimizer {
     virtual void AddSe3PriorQuaternionEdge(int se3_vertex_index,
                                            const Eigen::Quaterniond &quat,
                                            Eigen::VectorXd noise) = 0;
+    // 批量添加：num_poses 个连续节点，need_fix 只作用于第一个；共用同一噪声的边
+    // one by one by default, optimizers override them to skip the per call overhead:
+    virtual void AddSe3Nodes(const Eigen::Isometry3d *poses, int num_poses, bool need_fix);
+    virtual void AddSe3Edges(const Se3Edge *edges, int num_edges, const Eigen::VectorXd &noise);
     // 设置优化参数
     void SetMaxIterationsNum(int max_iterations_num);
+    const OptimizeStats& GetOptimizeStats() const { return optimize_stats_; }
   
   protected:
     int max_iterations_num_ = 512;
+    OptimizeStats optimize_stats_;
 };
 } // namespace lidar_localization
 #endif
\ No newline at end of file
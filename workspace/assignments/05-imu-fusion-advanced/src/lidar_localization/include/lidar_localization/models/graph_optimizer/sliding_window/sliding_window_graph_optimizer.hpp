@@ -0,0 +1,135 @@
+/*
+ * @Description: fixed-lag smoother, dense Levenberg-Marquardt over a sliding window of navigation states,
+ *               nodes leaving the window are marginalized into a prior by Schur complement
+ * @Author: Ge Yao
+ * @Date: 2020-12-25 10:06:18
+ */
+
+#ifndef LIDAR_LOCALIZATION_MODELS_GRAPH_OPTIMIZER_SLIDING_WINDOW_SLIDING_WINDOW_GRAPH_OPTIMIZER_HPP_
+#define LIDAR_LOCALIZATION_MODELS_GRAPH_OPTIMIZER_SLIDING_WINDOW_SLIDING_WINDOW_GRAPH_OPTIMIZER_HPP_
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+
+#include "lidar_localization/models/graph_optimizer/interface_graph_optimizer.hpp"
+#include "lidar_localization/models/pre_integrator/imu_pre_integrator.hpp"
+
+namespace lidar_localization {
+// every node is a navigation state, position, orientation, velocity & IMU biases, in IMU pre-integration order.
+// pose-only graphs work as well, velocities & biases not touched by any IMU edge are left out of the solve
+class SlidingWindowGraphOptimizer: public InterfaceGraphOptimizer {
+  public:
+    static const int DIM_STATE = IMUPreIntegrator::DIM_STATE;
+
+    struct NavState {
+      Eigen::Vector3d pos = Eigen::Vector3d::Zero();
+      Eigen::Matrix3d ori = Eigen::Matrix3d::Identity();
+      Eigen::Vector3d vel = Eigen::Vector3d::Zero();
+      Eigen::Vector3d accel_bias = Eigen::Vector3d::Zero();
+      Eigen::Vector3d gyro_bias = Eigen::Vector3d::Zero();
+    };
+
+    SlidingWindowGraphOptimizer(const YAML::Node& node);
+    // 优化
+    bool Optimize() override;
+    // 输出数据
+    bool GetOptimizedPose(std::deque<Eigen::Matrix4f>& optimized_pose) override;
+    int GetNodeNum() override;
+    int GetFirstNodeIndex() override;
+    size_t GetMemoryUsage(void) const override;
+    // the removed nodes are marginalized, their information is kept as a prior on the remaining ones:
+    bool RemoveOldestSe3Nodes(int num_nodes_to_keep) override;
+    // 添加节点、边、鲁棒核
+    void SetEdgeRobustKernel(std::string robust_kernel_name, double robust_kernel_size) override;
+    void AddSe3Node(const Eigen::Isometry3d &pose, bool need_fix) override;
+    void AddSe3Edge(int vertex_index1,
+                    int vertex_index2,
+                    const Eigen::Isometry3d &relative_pose,
+                    const Eigen::VectorXd noise) override;
+    void AddSe3PriorXYZEdge(int se3_vertex_index,
+                            const Eigen::Vector3d &xyz,
+                            Eigen::VectorXd noise) override;
+    void AddSe3PriorQuaternionEdge(int se3_vertex_index,
+                                   const Eigen::Quaterniond &quat,
+                                   Eigen::VectorXd noise) override;
+
+    // navigation state graph:
+    void AddNavStateNode(const NavState &state, bool need_fix);
+    bool GetOptimizedState(int vertex_index, NavState &state) const;
+    // pre_integration must start at the time of vertex_index1 and end at the time of vertex_index2:
+    void AddIMUPreIntegrationEdge(int vertex_index1,
+                                  int vertex_index2,
+                                  const IMUPreIntegrator &pre_integration);
+    void AddVelocityPriorEdge(int vertex_index,
+                              const Eigen::Vector3d &vel,
+                              Eigen::VectorXd noise);
+    // accel bias then gyro bias:
+    void AddBiasPriorEdge(int vertex_index,
+                          const Eigen::Vector3d &accel_bias,
+                          const Eigen::Vector3d &gyro_bias,
+                          Eigen::VectorXd noise);
+
+  private:
+    struct Edge;
+    struct Prior {
+      // indices of the nodes under the prior:
+      std::vector<int> vertices;
+      // linearization point:
+      std::vector<NavState> states;
+      // gradient & hessian at the linearization point:
+      Eigen::VectorXd b;
+      Eigen::MatrixXd H;
+    };
+
+    NavState& GetState(int vertex_index) { return states_.at(vertex_index - first_node_index_); }
+    const NavState& GetState(int vertex_index) const { return states_.at(vertex_index - first_node_index_); }
+    bool IsFixed(int vertex_index) const { return fixed_.at(vertex_index - first_node_index_); }
+    bool IsValidVertex(int vertex_index) const;
+
+    static void Plus(const NavState &state, const Eigen::VectorXd &delta, NavState &result);
+    static Eigen::VectorXd Minus(const NavState &state, const NavState &linearization_point);
+
+    void AddEdge(const std::shared_ptr<Edge> &edge);
+    // robust loss & its derivative of squared error, the weight of the re-weighted least squares:
+    double GetRobustLoss(const Edge &edge, double squared_error, double &weight) const;
+    double GetEdgeCost(const Edge &edge) const;
+    double GetPriorCost(void) const;
+    double GetTotalCost(void) const;
+    /**
+     * @brief  linearize edge, numerically on the manifold
+     * @param  edge, edge to linearize
+     * @param  H, hessian of the edge's vertices, row-major by vertex order of the edge
+     * @param  b, gradient
+     */
+    void LinearizeEdge(const Edge &edge, Eigen::MatrixXd &H, Eigen::VectorXd &b) const;
+    // normal equations of all edges & the prior over the window, first_node_index_ first:
+    void BuildNormalEquations(Eigen::MatrixXd &H, Eigen::VectorXd &b) const;
+    // fixed nodes & unconstrained dimensions are kept out of the solve:
+    void ConstrainNormalEquations(const std::vector<int> &vertices, Eigen::MatrixXd &H, Eigen::VectorXd &b) const;
+
+  private:
+    double gravity_magnitude_ = 9.81;
+    double min_lambda_ = 1.0e-8;
+    double max_lambda_ = 1.0e8;
+    // pre-integrations are re-propagated once the bias correction exceeds this:
+    double max_bias_correction_ = 1.0e-2;
+
+    int node_num_ = 0;
+    int first_node_index_ = 0;
+    std::deque<NavState> states_;
+    std::deque<bool> fixed_;
+    std::vector<std::shared_ptr<Edge>> edges_;
+
+    bool has_prior_ = false;
+    Prior prior_;
+
+    std::string robust_kernel_name_;
+    double robust_kernel_size_;
+    bool need_robust_kernel_ = false;
+};
+} // namespace lidar_localization
+
+#endif
@@ -0,0 +1,123 @@
+/*
+ * @Description: two-level pose graph, key frames are rigidly attached to submaps of consecutive key frames,
+ *               the global graph only optimizes submap poses, key frames are refined per submap in parallel
+ * @Author: Ge Yao
+ * @Date: 2021-01-26 20:14:52
+ */
+
+#ifndef LIDAR_LOCALIZATION_MODELS_GRAPH_OPTIMIZER_SUBMAP_SUBMAP_GRAPH_OPTIMIZER_HPP_
+#define LIDAR_LOCALIZATION_MODELS_GRAPH_OPTIMIZER_SUBMAP_SUBMAP_GRAPH_OPTIMIZER_HPP_
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+
+#include "lidar_localization/models/graph_optimizer/interface_graph_optimizer.hpp"
+
+namespace lidar_localization {
+// the pose of a submap is the pose of its first key frame, every key frame keeps its pose relative to it.
+// edges between key frames of different submaps become edges between the submaps, GNSS priors of the key
+// frames of a submap are merged into one prior on the submap, so the cost of the global optimization, e.g.
+// after a loop closure, grows with the num. of submaps instead of key frames.
+//
+// before that, submaps with new key frames or edges are refined on their own, their first key frame fixed
+// at the current submap pose, with the edges between their key frames & the GNSS priors.
+// both levels are solved by g2o.
+class SubmapGraphOptimizer: public InterfaceGraphOptimizer {
+  public:
+    SubmapGraphOptimizer(const YAML::Node& node);
+    // 优化
+    bool Optimize() override;
+    // 输出数据
+    bool GetOptimizedPose(std::deque<Eigen::Matrix4f>& optimized_pose) override;
+    int GetNodeNum() override;
+    int GetFirstNodeIndex() override;
+    size_t GetMemoryUsage(void) const override;
+    // not supported, submaps already bound the cost of the global optimization:
+    bool RemoveOldestSe3Nodes(int num_nodes_to_keep) override;
+    // 添加节点、边、鲁棒核
+    void SetEdgeRobustKernel(std::string robust_kernel_name, double robust_kernel_size) override;
+    void AddSe3Node(const Eigen::Isometry3d &pose, bool need_fix) override;
+    void AddSe3Edge(int vertex_index1,
+                    int vertex_index2,
+                    const Eigen::Isometry3d &relative_pose,
+                    const Eigen::VectorXd noise) override;
+    void AddSe3PriorXYZEdge(int se3_vertex_index,
+                            const Eigen::Vector3d &xyz,
+                            Eigen::VectorXd noise) override;
+    void AddSe3PriorQuaternionEdge(int se3_vertex_index,
+                                   const Eigen::Quaterniond &quat,
+                                   Eigen::VectorXd noise) override;
+
+    int GetSubmapNum(void) const { return static_cast<int>(submaps_.size()); }
+
+  private:
+    struct Edge {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      int vertex_index1 = 0;
+      int vertex_index2 = 0;
+      Eigen::Isometry3d relative_pose = Eigen::Isometry3d::Identity();
+      Eigen::VectorXd noise;
+    };
+    using EdgeVector = std::vector<Edge, Eigen::aligned_allocator<Edge>>;
+
+    struct PriorXYZEdge {
+      int vertex_index = 0;
+      Eigen::Vector3d xyz = Eigen::Vector3d::Zero();
+      Eigen::VectorXd noise;
+    };
+
+    struct PriorQuaternionEdge {
+      int vertex_index = 0;
+      Eigen::Quaterniond quat = Eigen::Quaterniond::Identity();
+      Eigen::VectorXd noise;
+    };
+
+    struct Submap {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      // pose of the first key frame:
+      Eigen::Isometry3d pose = Eigen::Isometry3d::Identity();
+      bool need_fix = false;
+      // key frame poses relative to the submap, the first is identity:
+      std::vector<Eigen::Isometry3d, Eigen::aligned_allocator<Eigen::Isometry3d>> node_poses;
+      // edges & priors within the submap, for local refinement:
+      EdgeVector edges;
+      std::vector<PriorXYZEdge> prior_xyz_edges;
+      // new key frames or edges since the last refinement:
+      bool need_refine = false;
+    };
+
+    int GetSubmapIndex(int vertex_index) const { return vertex_index / submap_size_; }
+    int GetSubmapNodeIndex(int vertex_index) const { return vertex_index % submap_size_; }
+
+    std::unique_ptr<InterfaceGraphOptimizer> CreateOptimizer(void) const;
+    // local refinement of key frames, optimizer is created by the caller as g2o factories aren't thread-safe:
+    bool RefineSubmap(InterfaceGraphOptimizer &optimizer, Submap &submap) const;
+    bool OptimizeSubmaps(void);
+
+  private:
+    std::string solver_type_;
+    // num. of key frames per submap:
+    int submap_size_ = 50;
+    bool local_refinement_ = true;
+    int num_threads_ = 1;
+
+    int node_num_ = 0;
+    std::deque<Submap, Eigen::aligned_allocator<Submap>> submaps_;
+    // edges between key frames of different submaps:
+    EdgeVector edges_;
+    // only used by the global optimization:
+    std::vector<PriorQuaternionEdge> prior_quaternion_edges_;
+
+    std::string robust_kernel_name_;
+    double robust_kernel_size_ = 0.0;
+    bool need_robust_kernel_ = false;
+};
+} // namespace lidar_localization
+
+#endif
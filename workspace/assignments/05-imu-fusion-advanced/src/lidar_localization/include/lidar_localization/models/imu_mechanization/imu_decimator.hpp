@@ -0,0 +1,61 @@
+/*
+ * @Description: decimation of high-rate IMU measurements into coning & sculling compensated increments
+ * @Author: Ge Yao
+ * @Date: 2021-01-08 10:12:36
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_IMU_MECHANIZATION_IMU_DECIMATOR_HPP_
+#define LIDAR_LOCALIZATION_MODELS_IMU_MECHANIZATION_IMU_DECIMATOR_HPP_
+
+#include <deque>
+
+#include <yaml-cpp/yaml.h>
+#include <Eigen/Dense>
+
+#include "lidar_localization/sensor_data/imu_data.hpp"
+
+namespace lidar_localization {
+// raw measurements are integrated by trapezoid into delta angles & delta velocities, which are summed over
+// each output interval with the recursive coning & sculling corrections of Savage, so the filters update
+// at the output rate while keeping the accuracy of the raw rate. each output carries the time & orientation
+// of its last raw measurement, the increment over the interval, and the mean rates for other consumers.
+class IMUDecimator {
+  public:
+    IMUDecimator(const YAML::Node& node);
+
+    double GetOutputRate(void) const { return 1.0 / output_interval_; }
+
+    /**
+     * @brief  integrate raw measurements in time order
+     * @param  imu_data_buff, raw measurements, all consumed
+     * @param  increment_buff, completed increments are appended
+     * @return num. of increments appended
+     */
+    size_t Decimate(std::deque<IMUData>& imu_data_buff, std::deque<IMUData>& increment_buff);
+
+  private:
+    void AddIMUData(const IMUData& imu_data, std::deque<IMUData>& increment_buff);
+    // the increment since start_time_, up to the last measurement:
+    void GetIncrement(IMUData& imu_data) const;
+    void Reset(const IMUData& imu_data);
+
+  private:
+    double output_interval_ = 0.01;
+    // the interval is closed early at a larger gap, which is not integrated over:
+    double max_imu_gap_ = 0.05;
+
+    bool has_imu_data_ = false;
+    IMUData last_imu_data_;
+    double start_time_ = 0.0;
+
+    // sums of the trapezoid deltas since start_time_, and the last ones:
+    Eigen::Vector3d alpha_ = Eigen::Vector3d::Zero();
+    Eigen::Vector3d nu_ = Eigen::Vector3d::Zero();
+    Eigen::Vector3d last_angular_delta_ = Eigen::Vector3d::Zero();
+    Eigen::Vector3d last_velocity_delta_ = Eigen::Vector3d::Zero();
+    // coning & sculling corrections:
+    Eigen::Vector3d beta_ = Eigen::Vector3d::Zero();
+    Eigen::Vector3d gamma_ = Eigen::Vector3d::Zero();
+};
+}
+
+#endif
@@ -0,0 +1,265 @@
+/*
+ * @Description: header-only IMU mechanization, mid-value integration of unbiased IMU measurements
+ * @Author: Ge Yao
+ * @Date: 2020-12-22 09:31:05
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_IMU_MECHANIZATION_IMU_MECHANIZATION_HPP_
+#define LIDAR_LOCALIZATION_MODELS_IMU_MECHANIZATION_IMU_MECHANIZATION_HPP_
+
+#include <cmath>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+namespace lidar_localization {
+
+namespace imu_mechanization {
+
+// unbiased IMU measurement, angular velocity & linear acceleration in body frame:
+struct IMUSample {
+    double time = 0.0;
+    Eigen::Vector3d angular_vel = Eigen::Vector3d::Zero();
+    Eigen::Vector3d linear_acc = Eigen::Vector3d::Zero();
+};
+
+// nominal state for dead reckoning of raw IMU measurements, with gravity & earth rotation in the frame of pose:
+struct NavState {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    double time = 0.0;
+    Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+    Eigen::Vector3d vel = Eigen::Vector3d::Zero();
+    Eigen::Vector3d gyro_bias = Eigen::Vector3d::Zero();
+    Eigen::Vector3d accl_bias = Eigen::Vector3d::Zero();
+
+    Eigen::Vector3d g = Eigen::Vector3d::Zero();
+    Eigen::Vector3d w = Eigen::Vector3d::Zero();
+};
+
+/**
+ * @brief  get mid-value angular delta
+ * @param  sample_prev, previous IMU measurement
+ * @param  sample_curr, current IMU measurement
+ * @return angular delta
+ */
+inline Eigen::Vector3d GetAngularDelta(const IMUSample &sample_prev, const IMUSample &sample_curr) {
+    double delta_t = sample_curr.time - sample_prev.time;
+
+    return 0.5*delta_t*(sample_curr.angular_vel + sample_prev.angular_vel);
+}
+
+/**
+ * @brief  get effective rotation of two consecutive angular deltas, with coning correction
+ * @param  angular_delta_1, first angular delta
+ * @param  angular_delta_2, second angular delta
+ * @return effective rotation
+ */
+inline Eigen::Vector3d GetEffectiveAngularDelta(
+    const Eigen::Vector3d &angular_delta_1, const Eigen::Vector3d &angular_delta_2
+) {
+    return angular_delta_1 + angular_delta_2 + 2.0/3.0*angular_delta_1.cross(angular_delta_2);
+}
+
+/**
+ * @brief  get delta quaternion of effective rotation angular_delta
+ * @param  angular_delta, effective rotation
+ * @return delta quaternion
+ */
+inline Eigen::Quaterniond GetDeltaQuaternion(const Eigen::Vector3d &angular_delta) {
+    // magnitude:
+    double angular_delta_mag = angular_delta.norm();
+    // direction:
+    Eigen::Vector3d angular_delta_dir = angular_delta.normalized();
+
+    // build delta q:
+    double angular_delta_cos = cos(angular_delta_mag/2.0);
+    double angular_delta_sin = sin(angular_delta_mag/2.0);
+
+    return Eigen::Quaterniond(
+        angular_delta_cos,
+        angular_delta_sin*angular_delta_dir.x(),
+        angular_delta_sin*angular_delta_dir.y(),
+        angular_delta_sin*angular_delta_dir.z()
+    );
+}
+
+/**
+ * @brief  update orientation with delta quaternion dq
+ * @param  dq, delta quaternion
+ * @param  pose, pose to update
+ * @param  R_curr, current orientation
+ * @param  R_prev, previous orientation
+ * @return void
+ */
+inline void UpdateOrientation(
+    const Eigen::Quaterniond &dq,
+    Eigen::Matrix4d &pose,
+    Eigen::Matrix3d &R_curr, Eigen::Matrix3d &R_prev
+) {
+    Eigen::Quaterniond q(pose.block<3, 3>(0, 0));
+
+    // update:
+    q = q*dq;
+
+    // write back:
+    R_prev = pose.block<3, 3>(0, 0);
+    pose.block<3, 3>(0, 0) = q.normalized().toRotationMatrix();
+    R_curr = pose.block<3, 3>(0, 0);
+}
+
+/**
+ * @brief  update position & velocity with effective velocity change velocity_delta
+ * @param  T, timestamp delta
+ * @param  velocity_delta, effective velocity change
+ * @param  pose, pose to update
+ * @param  vel, velocity to update
+ * @return void
+ */
+inline void UpdatePosition(
+    const double T, const Eigen::Vector3d &velocity_delta,
+    Eigen::Matrix4d &pose, Eigen::Vector3d &vel
+) {
+    pose.block<3, 1>(0, 3) += T*vel + 0.5*T*velocity_delta;
+    vel += velocity_delta;
+}
+
+/**
+ * @brief  propagate pose & velocity from sample_prev to sample_curr
+ * @param  dq, delta quaternion of the rotation from sample_prev to sample_curr
+ * @param  sample_prev, previous IMU measurement
+ * @param  sample_curr, current IMU measurement
+ * @param  g, gravity in navigation frame
+ * @param  pose, pose to update
+ * @param  vel, velocity to update
+ * @return mid-value linear acceleration in navigation frame
+ */
+inline Eigen::Vector3d Propagate(
+    const Eigen::Quaterniond &dq,
+    const IMUSample &sample_prev, const IMUSample &sample_curr,
+    const Eigen::Vector3d &g,
+    Eigen::Matrix4d &pose, Eigen::Vector3d &vel
+) {
+    // update orientation:
+    Eigen::Matrix3d R_curr, R_prev;
+    UpdateOrientation(dq, pose, R_curr, R_prev);
+
+    // get velocity delta:
+    double T = sample_curr.time - sample_prev.time;
+    Eigen::Vector3d linear_acc_mid = 0.5*(
+        (R_curr*sample_curr.linear_acc - g) + (R_prev*sample_prev.linear_acc - g)
+    );
+    Eigen::Vector3d velocity_delta = T*linear_acc_mid;
+
+    // update position:
+    UpdatePosition(T, velocity_delta, pose, vel);
+
+    return linear_acc_mid;
+}
+
+/**
+ * @brief  mid-value integration of one IMU measurement
+ * @param  sample_prev, previous IMU measurement
+ * @param  sample_curr, current IMU measurement
+ * @param  g, gravity in navigation frame
+ * @param  pose, pose to update
+ * @param  vel, velocity to update
+ * @return mid-value linear acceleration in navigation frame
+ */
+inline Eigen::Vector3d IntegrateStep(
+    const IMUSample &sample_prev, const IMUSample &sample_curr,
+    const Eigen::Vector3d &g,
+    Eigen::Matrix4d &pose, Eigen::Vector3d &vel
+) {
+    return Propagate(
+        GetDeltaQuaternion(GetAngularDelta(sample_prev, sample_curr)),
+        sample_prev, sample_curr,
+        g,
+        pose, vel
+    );
+}
+
+/**
+ * @brief  integration of one coning & sculling compensated increment, as from IMUDecimator
+ * @param  T, duration of the increment
+ * @param  angular_delta, unbiased effective rotation
+ * @param  velocity_delta, unbiased velocity change in body frame at the start of the increment
+ * @param  g, gravity in navigation frame
+ * @param  pose, pose to update
+ * @param  vel, velocity to update
+ * @return mean linear acceleration in navigation frame
+ */
+inline Eigen::Vector3d IntegrateIncrement(
+    const double T,
+    const Eigen::Vector3d &angular_delta, const Eigen::Vector3d &velocity_delta,
+    const Eigen::Vector3d &g,
+    Eigen::Matrix4d &pose, Eigen::Vector3d &vel
+) {
+    // update orientation:
+    Eigen::Matrix3d R_curr, R_prev;
+    UpdateOrientation(GetDeltaQuaternion(angular_delta), pose, R_curr, R_prev);
+
+    // the velocity change is resolved in the orientation at the start:
+    Eigen::Vector3d linear_acc_mean = R_prev*velocity_delta/T - g;
+
+    // update position:
+    UpdatePosition(T, T*linear_acc_mean, pose, vel);
+
+    return linear_acc_mean;
+}
+
+/**
+ * @brief  integrate a batch of IMU measurements from a contiguous array. samples[0] is the
+ *         measurement of the current pose. the delta quaternions only depend on the measurements
+ *         and are computed for the whole batch first, then the state is propagated sequentially
+ * @param  samples, IMU measurements
+ * @param  num_samples, number of IMU measurements
+ * @param  second_order, integrate two measurements per step with coning correction
+ * @param  g, gravity in navigation frame
+ * @param  pose, pose to update
+ * @param  vel, velocity to update
+ * @param  on_step, called after each step with the index of the measurement reached
+ * @return index of the last measurement used, 0 if there are not enough measurements
+ */
+template <typename StepCallback>
+inline size_t IntegrateBatch(
+    const IMUSample *samples, const size_t num_samples,
+    const bool second_order,
+    const Eigen::Vector3d &g,
+    Eigen::Matrix4d &pose, Eigen::Vector3d &vel,
+    StepCallback on_step
+) {
+    const size_t stride = second_order ? 2 : 1;
+    if (num_samples <= stride)
+        return 0;
+    const size_t num_steps = (num_samples - 1) / stride;
+
+    // a. delta quaternions:
+    std::vector<Eigen::Quaterniond, Eigen::aligned_allocator<Eigen::Quaterniond>> dq(num_steps);
+    for (size_t i = 0; i < num_steps; ++i) {
+        const IMUSample *step_samples = samples + i*stride;
+
+        Eigen::Vector3d angular_delta = GetAngularDelta(step_samples[0], step_samples[1]);
+        if (second_order) {
+            angular_delta = GetEffectiveAngularDelta(
+                angular_delta, GetAngularDelta(step_samples[1], step_samples[2])
+            );
+        }
+
+        dq[i] = GetDeltaQuaternion(angular_delta);
+    }
+
+    // b. propagate pose & velocity:
+    for (size_t i = 0; i < num_steps; ++i) {
+        Propagate(dq[i], samples[i*stride], samples[(i + 1)*stride], g, pose, vel);
+        on_step((i + 1)*stride);
+    }
+
+    return num_steps*stride;
+}
+
+} // namespace imu_mechanization
+
+} // namespace lidar_localization
+
+#endif
@@ -0,0 +1,65 @@
+/*
+ * @Description: registration initial guess from IMU mechanization between two scans
+ * @Author: Ge Yao
+ * @Date: 2020-12-24 19:26:52
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_IMU_MECHANIZATION_IMU_MOTION_PRIOR_HPP_
+#define LIDAR_LOCALIZATION_MODELS_IMU_MECHANIZATION_IMU_MOTION_PRIOR_HPP_
+
+#include <deque>
+
+#include <yaml-cpp/yaml.h>
+#include <Eigen/Dense>
+
+#include "lidar_localization/sensor_data/imu_data.hpp"
+#include "lidar_localization/models/imu_mechanization/imu_mechanization.hpp"
+
+namespace lidar_localization {
+// the lidar pose is propagated in the odometry frame by mid-value integration of the raw IMU measurements.
+// gravity in the odometry frame is taken from the IMU orientation measurement at the start of the interval,
+// biases are ignored, their effect over one scan interval is well below the registration tolerance.
+class IMUMotionPrior {
+  public:
+    IMUMotionPrior(const YAML::Node& node);
+
+    // lidar pose in IMU frame:
+    void SetLidarToIMU(const Eigen::Matrix4f& lidar_to_imu);
+    bool HasLidarToIMU(void) const { return has_lidar_to_imu_; }
+    // measurements must be added in time order:
+    void AddIMUData(const IMUData& imu_data);
+    // whether the measurements cover time, i.e. a prediction up to time can be made:
+    bool HasIMUData(double time) const;
+
+    /**
+     * @brief  predict lidar pose at time
+     * @param  last_time, time of last lidar pose
+     * @param  last_pose, last lidar pose in odometry frame
+     * @param  last_vel, lidar velocity at last_time in odometry frame
+     * @param  time, prediction time
+     * @param  predict_pose, predicted lidar pose in odometry frame
+     * @return true if the measurements cover [last_time, time], measurements before last_time are dropped
+     */
+    bool Predict(
+        double last_time, const Eigen::Matrix4f& last_pose, const Eigen::Vector3f& last_vel,
+        double time, Eigen::Matrix4f& predict_pose
+    );
+
+  private:
+    // measurement at time, linearly interpolated between imu_data_buff_ at index - 1 & index:
+    imu_mechanization::IMUSample GetSample(size_t index, double time) const;
+    static imu_mechanization::IMUSample ToSample(const IMUData& imu_data);
+
+  private:
+    double gravity_magnitude_ = 9.81;
+    // max. gap between two measurements to integrate over:
+    double max_imu_gap_ = 0.05;
+
+    bool has_lidar_to_imu_ = false;
+    Eigen::Matrix4d lidar_to_imu_ = Eigen::Matrix4d::Identity();
+    Eigen::Matrix4d imu_to_lidar_ = Eigen::Matrix4d::Identity();
+
+    std::deque<IMUData> imu_data_buff_;
+};
+}
+
+#endif
@@ -10,11 +10,15 @@
 #include <yaml-cpp/yaml.h>
 
 #include <deque>
+#include <vector>
+#include <functional>
 
 #include <Eigen/Core>
 #include <Eigen/Dense>
+#include <Eigen/StdVector>
 
 #include "lidar_localization/sensor_data/imu_data.hpp"
+#include "lidar_localization/models/imu_mechanization/imu_mechanization.hpp"
 
 namespace lidar_localization {
 
@@ -27,6 +31,21 @@ public:
         NUM_TYPES
     };
 
+    enum CorrectMethod {
+        // Joseph form covariance update:
+        JOSEPH = 0,
+        // square-root covariance update, P stays positive semi-definite by construction:
+        SQUARE_ROOT,
+        // one scalar update per component for diagonal measurement noise, no matrix inversion:
+        SEQUENTIAL
+    };
+
+    enum Precision {
+        DOUBLE = 0,
+        // covariance propagation in float, process noise, correction & symmetrization in double:
+        MIXED
+    };
+
     struct Measurement {
         double time;
         
@@ -66,17 +85,20 @@ public:
         } accel_bias;
     };
 
+    struct RollbackStats {
+        size_t num_rollbacks = 0;
+        // IMU measurements & corrections re-applied after rollback:
+        size_t num_repropagated = 0;
+        size_t num_reapplied = 0;
+        // measurements older than the state history, not applied:
+        size_t num_too_late = 0;
+        double max_rollback_time = 0.0;
+    };
+
     // dimensions:
     static const int DIM_STATE = 15;
     static const int DIM_PROCESS_NOISE = 6;
 
-    static const int DIM_MEASUREMENT_POSE = 6;
-    static const int DIM_MEASUREMENT_POSE_NOISE = 6;
-    static const int DIM_MEASUREMENT_POSITION = 3;
-    static const int DIM_MEASUREMENT_POSITION_NOISE = 3;
-    static const int DIM_MEASUREMENT_POSVEL = 6;
-    static const int DIM_MEASUREMENT_POSVEL_NOISE = 6;
-
     // indices:
     static const int INDEX_ERROR_POS = 0;
     static const int INDEX_ERROR_VEL = 3;
@@ -84,6 +106,10 @@ public:
     static const int INDEX_ERROR_GYRO = 9;
     static const int INDEX_ERROR_ACCEL = 12;
     
+    // of scalar type, for covariance propagation in either precision:
+    template<typename Scalar> using VectorXT = Eigen::Matrix<Scalar, DIM_STATE,         1>;
+    template<typename Scalar> using MatrixPT = Eigen::Matrix<Scalar, DIM_STATE, DIM_STATE>;
+
     // state:
     typedef Eigen::Matrix<double,                      DIM_STATE,                              1> VectorX;
     typedef Eigen::Matrix<double,                      DIM_STATE,                      DIM_STATE> MatrixP;
@@ -91,32 +117,31 @@ public:
     typedef Eigen::Matrix<double,                      DIM_STATE,                      DIM_STATE> MatrixF;
     typedef Eigen::Matrix<double,                      DIM_STATE,              DIM_PROCESS_NOISE> MatrixB;
     typedef Eigen::Matrix<double,              DIM_PROCESS_NOISE,              DIM_PROCESS_NOISE> MatrixQ;
-    // measurement equation:
-    typedef Eigen::Matrix<double,           DIM_MEASUREMENT_POSE,                      DIM_STATE> MatrixGPose;
-    typedef Eigen::Matrix<double,       DIM_MEASUREMENT_POSITION,                      DIM_STATE> MatrixGPosition;
-    typedef Eigen::Matrix<double,         DIM_MEASUREMENT_POSVEL,                      DIM_STATE> MatrixGPosVel;
-
-    typedef Eigen::Matrix<double,           DIM_MEASUREMENT_POSE,     DIM_MEASUREMENT_POSE_NOISE> MatrixCPose;
-    typedef Eigen::Matrix<double,       DIM_MEASUREMENT_POSITION, DIM_MEASUREMENT_POSITION_NOISE> MatrixCPosition;
-    typedef Eigen::Matrix<double,         DIM_MEASUREMENT_POSVEL,   DIM_MEASUREMENT_POSVEL_NOISE> MatrixCPosVel;
-
-    typedef Eigen::Matrix<double,     DIM_MEASUREMENT_POSE_NOISE,     DIM_MEASUREMENT_POSE_NOISE> MatrixRPose;
-    typedef Eigen::Matrix<double, DIM_MEASUREMENT_POSITION_NOISE, DIM_MEASUREMENT_POSITION_NOISE> MatrixRPosition;
-    typedef Eigen::Matrix<double,   DIM_MEASUREMENT_POSVEL_NOISE,   DIM_MEASUREMENT_POSVEL_NOISE> MatrixRPosVel;
-
-    // measurement:
-    typedef Eigen::Matrix<double,           DIM_MEASUREMENT_POSE,                              1> VectorYPose;
-    typedef Eigen::Matrix<double,       DIM_MEASUREMENT_POSITION,                              1> VectorYPosition;
-    typedef Eigen::Matrix<double,         DIM_MEASUREMENT_POSVEL,                              1> VectorYPosVel;
-    // Kalman gain:
-    typedef Eigen::Matrix<double,                      DIM_STATE,           DIM_MEASUREMENT_POSE> MatrixKPose;
-    typedef Eigen::Matrix<double,                      DIM_STATE,       DIM_MEASUREMENT_POSITION> MatrixKPosition;
-    typedef Eigen::Matrix<double,                      DIM_STATE,         DIM_MEASUREMENT_POSVEL> MatrixKPosVel;
-
-    // state observality matrix:
-    typedef Eigen::Matrix<double,     DIM_STATE*DIM_MEASUREMENT_POSE, DIM_STATE> MatrixSOMPose;
-    typedef Eigen::Matrix<double, DIM_STATE*DIM_MEASUREMENT_POSITION, DIM_STATE> MatrixSOMPosition;
-    typedef Eigen::Matrix<double,   DIM_STATE*DIM_MEASUREMENT_POSVEL, DIM_STATE> MatrixSOMPosVel;
+    // measurement equations, see MeasurementModel:
+
+    // Gauss-Newton system of a tightly-coupled measurement at pose T_nb, in the frame of pose measurements, 
+    // w.r.t. perturbation [delta_t, delta_theta] of t = t + delta_t & C = exp(delta_theta)*C, 
+    // i.e., H = sum(J^T*J / sigma^2) & b = sum(J^T*r / sigma^2). returns the num. of residuals:
+    typedef std::function<
+        int(const Eigen::Matrix4d &T_nb, Eigen::Matrix<double, 6, 6> &H, Eigen::Matrix<double, 6, 1> &b)
+    > LinearizeFunction;
+
+    // filter state kept across restarts:
+    struct State {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        double time;
+
+        // navigation frame pose at init, the odometry is relative to it:
+        Eigen::Matrix4d init_pose;
+        Eigen::Matrix4d pose;
+        Eigen::Vector3d vel;
+        Eigen::Vector3d gyro_bias;
+        Eigen::Vector3d accl_bias;
+
+        VectorX X;
+        MatrixP P;
+    };
 
     ErrorStateKalmanFilter(const YAML::Node& node);
 
@@ -130,6 +155,17 @@ public:
         const IMUData &imu_data
     );
 
+    /**
+     * @brief  init filter from a saved state, e.g. on restart, keeping its biases & covariance
+     * @param  state, saved filter state, its time is replaced by that of imu_data
+     * @param  imu_data, init IMU measurements
+     * @return void
+     */
+    void Init(
+        const State &state,
+        const IMUData &imu_data
+    );
+
     /**
      * @brief  Kalman update
      * @param  imu_data, input IMU measurements
@@ -150,6 +186,23 @@ public:
         const MeasurementType &measurement_type, const Measurement &measurement
     );
 
+    /**
+     * @brief  iterated Kalman correction, tightly-coupled measurement re-linearized at each iterate, information form. 
+     *         the state history is cleared, as the correction cannot be replayed on rollback
+     * @param  imu_data, IMU measurement at measurement time
+     * @param  time, measurement time
+     * @param  max_num_iterations, max. num. of iterations
+     * @param  epsilon, convergence threshold of the position & orientation error update
+     * @param  min_num_residuals, min. num. of residuals at each iterate
+     * @param  linearize, Gauss-Newton system of the measurement at an iterate
+     * @return true if success false otherwise
+     */
+    bool CorrectIterated(
+        const IMUData &imu_data, const double time,
+        const int max_num_iterations, const double epsilon, const int min_num_residuals,
+        const LinearizeFunction &linearize
+    );
+
     /**
      * @brief  Kalman correction, pose measurement and other measurement in body frame
      * @param  T_nb, pose measurement
@@ -167,7 +220,27 @@ public:
      * @return filter time as double    
      */
     double GetTime(void) const { return time_; }
-    
+
+    /**
+     * @brief  get statistics of rollbacks on delayed measurements
+     * @return rollback statistics
+     */
+    RollbackStats GetRollbackStats(void) const { return rollback_stats_; }
+
+    /**
+     * @brief  get filter state, as of last Kalman prediction or correction
+     * @param  state, filter state output
+     * @return void
+     */
+    void GetState(State &state) const;
+
+    /**
+     * @brief  get earth constants used in mechanization
+     * @return gravity & earth rotation in navigation frame
+     */
+    const Eigen::Vector3d &GetGravity(void) const { return g_; }
+    const Eigen::Vector3d &GetEarthRotation(void) const { return w_; }
+
     /**
      * @brief  get odometry estimation
      * @param  pose, init pose
@@ -177,14 +250,14 @@ public:
     void GetOdometry(Eigen::Matrix4f &pose, Eigen::Vector3f &vel);
 
     /**
-     * @brief  get covariance estimation
+     * @brief  get covariance estimation, as of last Kalman prediction
      * @param  cov, covariance output
      * @return void
      */
     void GetCovariance(Cov &cov);
     
     /**
-     * @brief  update observability analysis
+     * @brief  update observability analysis, only a snapshot is taken, the analysis is done on save
      * @param  time, measurement time
      * @param  measurement_type, measurement type
      * @return void
@@ -204,6 +277,66 @@ public:
     );
 
 private:
+    /**
+     * @brief  measurement model, specialized for each measurement type in error_state_kalman_filter.cpp:
+     *         DIM, measurement dimension, with VectorY, MatrixG & MatrixR of that size
+     *         GetResidual, residual between nominal state & measurement
+     *         GetMeasurementEquation, measurement equation at nominal state
+     *         GetMeasurementNoise, measurement noise
+     */
+    template<MeasurementType TYPE>
+    struct MeasurementModel;
+
+    // IMU pre-integration since last Kalman prediction:
+    struct PreIntegration {
+        int num_measurements = 0;
+        double T = 0.0;
+        // integrals of the time-variant blocks of process equation:
+        Eigen::Matrix3d F_vo = Eigen::Matrix3d::Zero();
+        Eigen::Matrix3d F_va = Eigen::Matrix3d::Zero();
+        Eigen::Matrix3d F_og = Eigen::Matrix3d::Zero();
+        // accumulated process noise B*Q*B^T, only the non-zero blocks:
+        Eigen::Matrix3d Q_vv = Eigen::Matrix3d::Zero();
+        Eigen::Matrix3d Q_vo = Eigen::Matrix3d::Zero();
+        Eigen::Matrix3d Q_oo = Eigen::Matrix3d::Zero();
+    };
+
+    // a correction applied right after one state snapshot, re-applied on rollback:
+    struct CorrectionRecord {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        MeasurementType measurement_type;
+        Measurement measurement;
+    };
+
+    // filter state right after one IMU measurement, before any correction at that time:
+    struct StateSnapshot {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        double time;
+        IMUData imu_data;
+
+        Eigen::Matrix4d pose;
+        Eigen::Vector3d vel;
+        Eigen::Vector3d gyro_bias;
+        Eigen::Vector3d accl_bias;
+
+        VectorX X;
+        MatrixP P;
+        MatrixF F;
+        MatrixB B;
+        PreIntegration pre_integration;
+
+        std::vector<CorrectionRecord, Eigen::aligned_allocator<CorrectionRecord>> corrections;
+    };
+
+    // process & measurement equations for deferred observability analysis:
+    struct ObservabilitySnapshot {
+        double time;
+        Eigen::MatrixXd F;
+        Eigen::MatrixXd G;
+    };
+
     /**
      * @brief  get unbiased angular velocity in body frame
      * @param  angular_vel, angular velocity measurement
@@ -215,60 +348,11 @@ private:
         const Eigen::Matrix3d &R
     );
     /**
-     * @brief  get unbiased linear acceleration in navigation frame
-     * @param  linear_acc, linear acceleration measurement
-     * @param  R, corresponding orientation of measurement
-     * @return unbiased linear acceleration in navigation frame
-     */
-    Eigen::Vector3d GetUnbiasedLinearAcc(
-        const Eigen::Vector3d &linear_acc,
-        const Eigen::Matrix3d &R
-    );
-    /**
-     * @brief  get angular delta
-     * @param  index_curr, current imu measurement buffer index
-     * @param  index_prev, previous imu measurement buffer index
-     * @param  angular_delta, angular delta output
-     * @return true if success false otherwise
-     */
-    bool GetAngularDelta(
-        const size_t index_curr, const size_t index_prev,
-        Eigen::Vector3d &angular_delta
-    );
-    /**
-     * @brief  get velocity delta
-     * @param  index_curr, current imu measurement buffer index
-     * @param  index_prev, previous imu measurement buffer index
-     * @param  R_curr, corresponding orientation of current imu measurement
-     * @param  R_prev, corresponding orientation of previous imu measurement
-     * @param  velocity_delta, velocity delta output
-     * @param  linear_acc_mid, mid-value unbiased linear acc
-     * @return true if success false otherwise
-     */
-    bool GetVelocityDelta(
-        const size_t index_curr, const size_t index_prev,
-        const Eigen::Matrix3d &R_curr, const Eigen::Matrix3d &R_prev, 
-        double &T, 
-        Eigen::Vector3d &velocity_delta,
-        Eigen::Vector3d &linear_acc_mid
-    );
-    /**
-     * @brief  update orientation with effective rotation angular_delta
-     * @param  angular_delta, effective rotation
-     * @param  R_curr, current orientation
-     * @param  R_prev, previous orientation
-     * @return void
+     * @brief  get unbiased IMU measurement for mechanization
+     * @param  imu_data, IMU measurement
+     * @return unbiased angular velocity & linear acceleration in body frame
      */
-    void UpdateOrientation(
-        const Eigen::Vector3d &angular_delta,
-        Eigen::Matrix3d &R_curr, Eigen::Matrix3d &R_prev
-    );
-    /**
-     * @brief  update orientation with effective velocity change velocity_delta
-     * @param  velocity_delta, effective velocity change
-     * @return void
-     */
-    void UpdatePosition(const double &T, const Eigen::Vector3d &velocity_delta);
+    imu_mechanization::IMUSample GetUnbiasedIMUSample(const IMUData &imu_data);
     /**
      * @brief  update IMU odometry estimation
      * @param  linear_acc_mid, output mid-value unbiased linear acc
@@ -301,28 +385,121 @@ private:
         const double &T,
         const Eigen::Vector3d &linear_acc_mid
     );
-
     /**
-     * @brief  correct error estimation using pose measurement
-     * @param  T_nb, input pose measurement
+     * @brief  pre-integrate process equation & process noise of one IMU measurement
+     * @param  T, time delta
+     * @return void
+     */
+    void PreIntegrate(const double &T);
+    /**
+     * @brief  Kalman prediction over the pre-integrated IMU measurements, 
+     *         using only the non-zero 3-by-3 blocks of process equation
+     * @param  void
      * @return void
      */
-    void CorrectErrorEstimationPose(const Eigen::Matrix4d &T_nb);
+    void PredictErrorEstimation(void);
+    /**
+     * @brief  propagate covariance, P = F*P*F^T, in Scalar
+     * @param  D, non-zero 3-by-3 blocks of F - I, as row, col & block
+     * @param  num_blocks, num. of blocks
+     * @return upper triangle of F*P*F^T, in double
+     */
+    template<typename Scalar, typename BlockType>
+    MatrixP PropagateCovariance(const BlockType *D, int num_blocks) const;
 
     /**
-     * @brief  correct error estimation using position measurement
-     * @param  T_nb, input position measurement
+     * @brief  Kalman correct with the configured correct method
+     * @param  Y, measurement
+     * @param  G, measurement equation
+     * @param  R, measurement noise
+     * @return true if success false otherwise
+     */
+    template<int DIM_MEASUREMENT>
+    bool CorrectErrorEstimation(
+        const Eigen::Matrix<double, DIM_MEASUREMENT,               1> &Y,
+        const Eigen::Matrix<double, DIM_MEASUREMENT,       DIM_STATE> &G,
+        const Eigen::Matrix<double, DIM_MEASUREMENT, DIM_MEASUREMENT> &R
+    );
+    /**
+     * @brief  Kalman correct, Cholesky solve for Kalman gain & Joseph form covariance update
+     * @param  Y, measurement
+     * @param  G, measurement equation
+     * @param  R, measurement noise
+     * @return true if success false otherwise
+     */
+    template<int DIM_MEASUREMENT>
+    bool CorrectErrorEstimationJoseph(
+        const Eigen::Matrix<double, DIM_MEASUREMENT,               1> &Y,
+        const Eigen::Matrix<double, DIM_MEASUREMENT,       DIM_STATE> &G,
+        const Eigen::Matrix<double, DIM_MEASUREMENT, DIM_MEASUREMENT> &R
+    );
+    /**
+     * @brief  Kalman correct, QR triangularization of the square-root pre-array
+     * @param  Y, measurement
+     * @param  G, measurement equation
+     * @param  R, measurement noise
+     * @return true if success false otherwise
+     */
+    template<int DIM_MEASUREMENT>
+    bool CorrectErrorEstimationSquareRoot(
+        const Eigen::Matrix<double, DIM_MEASUREMENT,               1> &Y,
+        const Eigen::Matrix<double, DIM_MEASUREMENT,       DIM_STATE> &G,
+        const Eigen::Matrix<double, DIM_MEASUREMENT, DIM_MEASUREMENT> &R
+    );
+    /**
+     * @brief  Kalman correct, one scalar update per component, for diagonal measurement noise
+     * @param  Y, measurement
+     * @param  G, measurement equation
+     * @param  R, measurement noise, only its diagonal is used
+     * @return true if any component is applied false otherwise
+     */
+    template<int DIM_MEASUREMENT>
+    bool CorrectErrorEstimationSequential(
+        const Eigen::Matrix<double, DIM_MEASUREMENT,               1> &Y,
+        const Eigen::Matrix<double, DIM_MEASUREMENT,       DIM_STATE> &G,
+        const Eigen::Matrix<double, DIM_MEASUREMENT, DIM_MEASUREMENT> &R
+    );
+
+    /**
+     * @brief  apply correction at filter time & record it for rollback
+     * @param  measurement_type, measurement type
+     * @param  measurement, input measurement
      * @return void
      */
-    void CorrectErrorEstimationPosition(const Eigen::Matrix4d &T_nb);
+    void ApplyCorrection(
+        const MeasurementType &measurement_type, 
+        const Measurement &measurement
+    );
+    /**
+     * @brief  roll back to the state history at measurement time, correct, then re-propagate to filter time
+     * @param  measurement_type, measurement type
+     * @param  measurement, input measurement
+     * @return true if success false if measurement is not covered by state history
+     */
+    bool CorrectDelayed(
+        const MeasurementType &measurement_type, 
+        const Measurement &measurement
+    );
+    /**
+     * @brief  save current filter state into state history
+     * @param  imu_data, the IMU measurement just propagated
+     * @return void
+     */
+    void SaveState(const IMUData &imu_data);
+    /**
+     * @brief  restore filter state from state history
+     * @param  snapshot, state snapshot
+     * @return void
+     */
+    void RestoreState(const StateSnapshot &snapshot);
 
     /**
-     * @brief  correct error estimation using navigation position and body velocity measurement
-     * @param  T_nb, input position measurement
-     * @param  v_b, input velocity measurement
+     * @brief  correct error estimation using measurement model of TYPE
+     * @param  measurement, input measurement
      * @return void
      */
-    void CorrectErrorEstimationPosVel(const Eigen::Matrix4d &T_nb, const Eigen::Vector3d &v_b);
+    template<MeasurementType TYPE>
+    void CorrectErrorEstimationByModel(const Measurement &measurement);
 
     /**
      * @brief  correct error estimation
@@ -363,35 +540,33 @@ private:
      */
     void ResetCovariance(void);
     /**
-     * @brief  update observability analysis for pose measurement
-     * @param  void
-     * @return void
-     */
-    void UpdateObservabilityAnalysisPose(
-        const double &time, std::vector<double> &record
-    );
-
-    /**
-     * @brief  update observability analysis for position measurement
-     * @param  void
-     * @return void
-     */
-    void UpdateObservabilityAnalysisPosition(
-        const double &time, std::vector<double> &record
-    );
-
-    /**
-     * @brief  update observability analysis for navigation position & body velocity measurement
-     * @param  void
+     * @brief  observability analysis of one snapshot
+     * @param  snapshot, process & measurement equations
+     * @param  record, observability analysis output
      * @return void
      */
-    void UpdateObservabilityAnalysisPosVel(
-        const double &time, std::vector<double> &record
+    void AnalyzeObservability(
+        const ObservabilitySnapshot &snapshot, std::vector<double> &record
     );
 
     // data buff:
     std::deque<IMUData> imu_data_buff_;
 
+    // num. of IMU measurements per Kalman prediction, 1 for prediction at every measurement:
+    int prediction_interval_;
+    PreIntegration pre_integration_;
+
+    // precision of covariance propagation:
+    Precision precision_;
+    CorrectMethod correct_method_;
+    // chi-square gate of each component in sequential correct, 1 DOF, disabled if 0:
+    double sequential_gate_;
+
+    // state history for delayed measurements, num. of IMU measurements kept, disabled if 0:
+    size_t state_history_size_;
+    std::deque<StateSnapshot, Eigen::aligned_allocator<StateSnapshot>> state_history_;
+    RollbackStats rollback_stats_;
+
     // time:
     double time_;
 
@@ -411,36 +586,16 @@ private:
     MatrixB B_ = MatrixB::Zero();
     MatrixQ Q_ = MatrixQ::Zero();
 
-    MatrixGPose GPose_ = MatrixGPose::Zero();
-    MatrixGPosition GPosition_ = MatrixGPosition::Zero();
-    MatrixGPosVel GPosVel_ = MatrixGPosVel::Zero();
-
-    MatrixCPose CPose_ = MatrixCPose::Zero();
-    MatrixCPosition CPosition_ = MatrixCPosition::Zero();
-    MatrixCPosVel CPosVel_ = MatrixCPosVel::Zero();
-
-    MatrixRPose RPose_ = MatrixRPose::Zero();
-    MatrixRPosition RPosition_ = MatrixRPosition::Zero();
-    MatrixRPosVel RPosVel_ = MatrixRPosVel::Zero();
-
-    MatrixSOMPose SOMPose_ = MatrixSOMPose::Zero();
-    MatrixSOMPosition SOMPosition_ = MatrixSOMPosition::Zero();
-    MatrixSOMPosVel SOMPosVel_ = MatrixSOMPosVel::Zero();
-
-    // measurement:
-    VectorYPose YPose_;
-    VectorYPosition YPosition_;
-    VectorYPosVel YPosVel_;
-
     // earth constants:
     Eigen::Vector3d g_;
     Eigen::Vector3d w_;
 
-    // observability analysis:
+    // observability analysis, ring buffers of the latest snapshots, disabled if size is 0:
+    size_t observability_buffer_size_;
     struct {
-        std::vector<std::vector<double>> pose_;
-        std::vector<std::vector<double>> position_;
-        std::vector<std::vector<double>> pos_vel_;
+        std::deque<ObservabilitySnapshot> pose_;
+        std::deque<ObservabilitySnapshot> position_;
+        std::deque<ObservabilitySnapshot> pos_vel_;
     } observability;
 
     // hyper-params:
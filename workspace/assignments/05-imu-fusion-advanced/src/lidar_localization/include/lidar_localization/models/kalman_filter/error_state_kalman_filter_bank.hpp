@@ -0,0 +1,225 @@
+/*
+ * @Description: bank of Error-State Kalman Filters over ambiguous init pose hypotheses, in lockstep
+ * @Author: Ge Yao
+ * @Date: 2021-01-01 16:05:12
+ */
+
+#ifndef LIDAR_LOCALIZATION_MODELS_KALMAN_FILTER_ERROR_STATE_KALMAN_FILTER_BANK_HPP_
+#define LIDAR_LOCALIZATION_MODELS_KALMAN_FILTER_ERROR_STATE_KALMAN_FILTER_BANK_HPP_
+
+#include <yaml-cpp/yaml.h>
+
+#include <deque>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Dense>
+
+#include "lidar_localization/sensor_data/imu_data.hpp"
+#include "lidar_localization/models/kalman_filter/error_state_kalman_filter.hpp"
+
+namespace lidar_localization {
+
+// one ErrorStateKalmanFilter per hypothesis, with pose measurements only. all hypotheses share the IMU
+// measurements & filter time, so the nominal states & covariances are kept as structure of arrays, one lane
+// per hypothesis, and the IMU prediction of all hypotheses is one pass over the lanes.
+// each pose correction is scored by the likelihood of its innovation, the hypotheses whose accumulated
+// log likelihood falls behind the best one are pruned.
+class ErrorStateKalmanFilterBank {
+public:
+    typedef ErrorStateKalmanFilter::Measurement Measurement;
+    typedef ErrorStateKalmanFilter::State State;
+
+    static const int DIM_STATE = ErrorStateKalmanFilter::DIM_STATE;
+    // num. of hypotheses processed together by the prediction kernels, lanes are padded to it:
+    static const int LANE_WIDTH = 4;
+
+    /**
+     * @brief  bank of filters with the params of ErrorStateKalmanFilter
+     * @param  node, ErrorStateKalmanFilter config
+     */
+    ErrorStateKalmanFilterBank(const YAML::Node& node);
+
+    /**
+     * @brief  init all hypotheses from the same IMU measurement, prior covariance & zero biases
+     * @param  num_hypotheses, num. of hypotheses, indexed 0 to num_hypotheses - 1 from now on
+     * @param  vel, init vel in body frame
+     * @param  imu_data, init IMU measurement
+     * @return void
+     */
+    void Init(
+        const int num_hypotheses,
+        const Eigen::Vector3d &vel,
+        const IMUData &imu_data
+    );
+
+    /**
+     * @brief  Kalman update of all hypotheses
+     * @param  imu_data, input IMU measurement
+     * @return true if success false otherwise
+     */
+    bool Update(const IMUData &imu_data);
+
+    /**
+     * @brief  Kalman correction of one hypothesis, pose measurement. the first correction at a new time
+     *         predicts all hypotheses up to it. the log likelihood of the innovation is accumulated
+     * @param  hypothesis, hypothesis index
+     * @param  imu_data, IMU measurement at measurement time
+     * @param  measurement, pose measurement
+     * @return true if success false otherwise
+     */
+    bool Correct(
+        const int hypothesis,
+        const IMUData &imu_data,
+        const Measurement &measurement
+    );
+
+    /**
+     * @brief  drop one hypothesis, e.g. when its measurement is not available
+     * @param  hypothesis, hypothesis index
+     * @return void
+     */
+    void Reject(const int hypothesis);
+
+    /**
+     * @brief  drop the hypotheses whose accumulated log likelihood is below that of the best one by more than threshold
+     * @param  threshold, log likelihood threshold
+     * @return num. of hypotheses left
+     */
+    int Prune(const double threshold);
+
+    /**
+     * @brief  getters
+     */
+    double GetTime(void) const { return time_; }
+    int GetNumHypotheses(void) const { return num_lanes_; }
+    bool IsActive(const int hypothesis) const;
+    // of the hypotheses left, the one with the highest accumulated log likelihood, -1 if none left:
+    int GetBestHypothesis(void) const;
+    double GetLogLikelihood(const int hypothesis) const;
+
+    /**
+     * @brief  get filter state of one hypothesis, for ErrorStateKalmanFilter::Init
+     * @param  hypothesis, hypothesis index
+     * @param  state, filter state output
+     * @return true if the hypothesis is active false otherwise
+     */
+    bool GetState(const int hypothesis, State &state) const;
+
+    /**
+     * @brief  get odometry estimation of one hypothesis
+     * @param  hypothesis, hypothesis index
+     * @param  pose, odometry pose relative to init pose
+     * @param  vel, odometry vel
+     * @return true if the hypothesis is active false otherwise
+     */
+    bool GetOdometry(const int hypothesis, Eigen::Matrix4f &pose, Eigen::Vector3f &vel) const;
+
+private:
+    // rows are state components, columns are lanes:
+    typedef Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> LaneArray;
+
+    // IMU pre-integration since last Kalman prediction. the process noise B*Q*B^T does not depend on
+    // the orientation for isotropic Q, so it is shared, and the integral of F_og is -F_va:
+    struct PreIntegration {
+        int num_measurements = 0;
+        double T = 0.0;
+        double Q_vv = 0.0;
+        double Q_oo = 0.0;
+    };
+
+    /**
+     * @brief  get mid-value angular delta before gyro bias compensation, shared by all hypotheses
+     * @param  imu_data_prev, previous IMU measurement
+     * @param  imu_data_curr, current IMU measurement
+     * @return angular delta in body frame
+     */
+    Eigen::Vector3d GetAngularDelta(const IMUData &imu_data_prev, const IMUData &imu_data_curr) const;
+
+    /**
+     * @brief  Kalman prediction of all hypotheses over the pre-integrated IMU measurements
+     * @param  void
+     * @return void
+     */
+    void PredictErrorEstimation(void);
+
+    /**
+     * @brief  Kalman correction, eliminate error & reset of one lane, pose measurement
+     * @param  lane, lane of hypothesis
+     * @param  measurement, pose measurement
+     * @return true if success false otherwise
+     */
+    bool CorrectLane(const int lane, const Measurement &measurement);
+
+    /**
+     * @brief  copy lane from to lane to
+     * @return void
+     */
+    void CopyLane(const int from, const int to);
+    /**
+     * @brief  compact the lanes of the active hypotheses, the padding lanes repeat the first one
+     * @param  void
+     * @return void
+     */
+    void CompactLanes(void);
+
+    // lane of each hypothesis, -1 once rejected or pruned:
+    std::vector<int> lane_;
+    // hypothesis of each lane:
+    std::vector<int> hypothesis_;
+    // active lanes, then padding up to LANE_WIDTH:
+    int num_lanes_ = 0;
+    int num_padded_lanes_ = 0;
+
+    // IMU measurements of last update:
+    std::deque<IMUData> imu_data_buff_;
+    PreIntegration pre_integration_;
+
+    // time:
+    double time_ = 0.0;
+    // navigation frame pose at init, shared:
+    Eigen::Matrix4d init_pose_ = Eigen::Matrix4d::Identity();
+
+    // nominal state, quaternion w, x, y & z, with its rotation matrix, row-major:
+    LaneArray q_;
+    LaneArray C_nb_;
+    LaneArray pos_;
+    LaneArray vel_;
+    LaneArray gyro_bias_;
+    LaneArray accl_bias_;
+    // covariance, row-major DIM_STATE by DIM_STATE, the error state is zero between corrections:
+    LaneArray P_;
+    // integrals of the time-variant blocks of process equation, F_vo & F_va:
+    LaneArray F_vo_;
+    LaneArray F_va_;
+    // accumulated log likelihood, constant terms omitted:
+    LaneArray log_likelihood_;
+
+    // earth constants:
+    Eigen::Vector3d g_;
+    Eigen::Vector3d w_;
+
+    // hyper-params, as ErrorStateKalmanFilter:
+    int prediction_interval_;
+    struct {
+        struct {
+            double POS;
+            double VEL;
+            double ORIENTATION;
+            double EPSILON;
+            double DELTA;
+        } PRIOR;
+        struct {
+            double GYRO;
+            double ACCEL;
+        } PROCESS;
+        struct {
+            double POS;
+            double ORIENTATION;
+        } MEASUREMENT;
+    } COV;
+};
+
+} // namespace lidar_localization
+
+#endif // LIDAR_LOCALIZATION_MODELS_KALMAN_FILTER_ERROR_STATE_KALMAN_FILTER_BANK_HPP_
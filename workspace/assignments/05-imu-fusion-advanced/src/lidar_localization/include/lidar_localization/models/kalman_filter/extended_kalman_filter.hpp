@@ -15,6 +15,7 @@
 #include <Eigen/Dense>
 
 #include "lidar_localization/sensor_data/imu_data.hpp"
+#include "lidar_localization/models/imu_mechanization/imu_mechanization.hpp"
 
 namespace lidar_localization {
 
@@ -215,60 +216,11 @@ private:
         const Eigen::Matrix3d &R
     );
     /**
-     * @brief  get unbiased linear acceleration in navigation frame
-     * @param  linear_acc, linear acceleration measurement
-     * @param  R, corresponding orientation of measurement
-     * @return unbiased linear acceleration in navigation frame
-     */
-    Eigen::Vector3d GetUnbiasedLinearAcc(
-        const Eigen::Vector3d &linear_acc,
-        const Eigen::Matrix3d &R
-    );
-    /**
-     * @brief  get angular delta
-     * @param  index_curr, current imu measurement buffer index
-     * @param  index_prev, previous imu measurement buffer index
-     * @param  angular_delta, angular delta output
-     * @return true if success false otherwise
-     */
-    bool GetAngularDelta(
-        const size_t index_curr, const size_t index_prev,
-        Eigen::Vector3d &angular_delta
-    );
-    /**
-     * @brief  get velocity delta
-     * @param  index_curr, current imu measurement buffer index
-     * @param  index_prev, previous imu measurement buffer index
-     * @param  R_curr, corresponding orientation of current imu measurement
-     * @param  R_prev, corresponding orientation of previous imu measurement
-     * @param  velocity_delta, velocity delta output
-     * @param  linear_acc_mid, mid-value unbiased linear acc
-     * @return true if success false otherwise
-     */
-    bool GetVelocityDelta(
-        const size_t index_curr, const size_t index_prev,
-        const Eigen::Matrix3d &R_curr, const Eigen::Matrix3d &R_prev, 
-        double &T, 
-        Eigen::Vector3d &velocity_delta,
-        Eigen::Vector3d &linear_acc_mid
-    );
-    /**
-     * @brief  update orientation with effective rotation angular_delta
-     * @param  angular_delta, effective rotation
-     * @param  R_curr, current orientation
-     * @param  R_prev, previous orientation
-     * @return void
-     */
-    void UpdateOrientation(
-        const Eigen::Vector3d &angular_delta,
-        Eigen::Matrix3d &R_curr, Eigen::Matrix3d &R_prev
-    );
-    /**
-     * @brief  update orientation with effective velocity change velocity_delta
-     * @param  velocity_delta, effective velocity change
-     * @return void
+     * @brief  get unbiased IMU measurement for mechanization
+     * @param  imu_data, IMU measurement
+     * @return unbiased angular velocity & linear acceleration in body frame
      */
-    void UpdatePosition(const double &T, const Eigen::Vector3d &velocity_delta);
+    imu_mechanization::IMUSample GetUnbiasedIMUSample(const IMUData &imu_data);
     /**
      * @brief  update IMU odometry estimation
      * @param  linear_acc_mid, output mid-value unbiased linear acc
@@ -302,6 +254,20 @@ private:
         const Eigen::Vector3d &linear_acc_mid
     );
 
+    /**
+     * @brief  correct error estimation, one scalar update per component, for diagonal measurement noise
+     * @param  Y, measurement
+     * @param  G, measurement equation
+     * @param  R, measurement noise, only its diagonal is used
+     * @return void
+     */
+    template<int DIM_MEASUREMENT>
+    void CorrectErrorEstimationSequential(
+        const Eigen::Matrix<double, DIM_MEASUREMENT,               1> &Y,
+        const Eigen::Matrix<double, DIM_MEASUREMENT,       DIM_STATE> &G,
+        const Eigen::Matrix<double, DIM_MEASUREMENT, DIM_MEASUREMENT> &R
+    );
+
     /**
      * @brief  correct error estimation using pose measurement
      * @param  T_nb, input pose measurement
@@ -436,6 +402,11 @@ private:
     Eigen::Vector3d g_;
     Eigen::Vector3d w_;
 
+    // sequential correct for correct method SEQUENTIAL, batch correct otherwise:
+    bool use_sequential_correct_ = false;
+    // chi-square gate of each component in sequential correct, 1 DOF, disabled if 0:
+    double sequential_gate_ = 0.0;
+
     // observability analysis:
     struct {
         std::vector<std::vector<double>> pose_;
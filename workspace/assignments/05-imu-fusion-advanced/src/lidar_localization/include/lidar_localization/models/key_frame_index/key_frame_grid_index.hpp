@@ -0,0 +1,75 @@
+/*
+ * @Description: incremental x-y grid hash over key frame positions, for proximity queries in loop closing
+ * @Author: Ge Yao
+ * @Date: 2020-12-29 16:08:37
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_KEY_FRAME_INDEX_KEY_FRAME_GRID_INDEX_HPP_
+#define LIDAR_LOCALIZATION_MODELS_KEY_FRAME_INDEX_KEY_FRAME_GRID_INDEX_HPP_
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+#include <Eigen/Dense>
+
+namespace lidar_localization {
+// key frames are bucketed by x-y cell, distances are in 3D. ids are added in increasing order,
+// so every cell keeps them sorted and id ranges, e.g., a min. seq. distance, cut its scan short.
+class KeyFrameGridIndex {
+  public:
+    static const int NONE = -1;
+
+    KeyFrameGridIndex(float cell_size);
+
+    void Add(int id, const Eigen::Vector3f &position);
+    size_t GetSize(void) const { return size_; }
+
+    /**
+     * @brief  get the closest key frame with id in [min_id, max_id]
+     * @param  position, query position
+     * @param  min_id, max_id, id range
+     * @param  distance, distance to the closest key frame
+     * @return id of the closest key frame, NONE if there is no key frame in the id range
+     */
+    int GetNearest(const Eigen::Vector3f &position, int min_id, int max_id, float &distance) const;
+    /**
+     * @brief  get key frames within radius, with id in [min_id, max_id]
+     * @param  position, query position
+     * @param  radius, search radius
+     * @param  min_id, max_id, id range
+     * @param  ids, output ids, sorted
+     * @return void
+     */
+    void GetInRadius(
+        const Eigen::Vector3f &position, float radius, int min_id, int max_id, 
+        std::vector<int> &ids
+    ) const;
+
+  private:
+    struct Entry {
+      int id;
+      Eigen::Vector3f position;
+    };
+    using Cell = std::vector<Entry>;
+
+    Eigen::Vector2i GetCellIndex(const Eigen::Vector3f &position) const;
+    static int64_t GetCellKey(const Eigen::Vector2i &index);
+    // nearest entry of cell in id range, best_sq_distance is only updated if closer:
+    static void SearchCell(
+        const Cell &cell, const Eigen::Vector3f &position, int min_id, int max_id, 
+        int &best_id, float &best_sq_distance
+    );
+
+  private:
+    float cell_size_;
+    float inverse_cell_size_;
+
+    std::unordered_map<int64_t, Cell> cells_;
+    size_t size_ = 0;
+    // cell index bounds, so that ring searches stop once they cover the grid:
+    Eigen::Vector2i min_index_ = Eigen::Vector2i::Zero();
+    Eigen::Vector2i max_index_ = Eigen::Vector2i::Zero();
+};
+} // namespace lidar_localization
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ * @Description: key frame selection by overlap, rotation & time to the last key frame
+ * @Author: Ge Yao
+ * @Date: 2020-12-24 16:05:28
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_KEY_FRAME_SELECTOR_ADAPTIVE_KEY_FRAME_SELECTOR_HPP_
+#define LIDAR_LOCALIZATION_MODELS_KEY_FRAME_SELECTOR_ADAPTIVE_KEY_FRAME_SELECTOR_HPP_
+
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+
+#include "lidar_localization/models/key_frame_selector/key_frame_selector_interface.hpp"
+#include "lidar_localization/tools/metrics.hpp"
+
+namespace lidar_localization {
+// a scan is selected when any of
+//   a. less than min_overlap of its voxels, in map frame, are occupied by the last key frame too,
+//      once it has moved at least min_distance, so moving objects around a vehicle at rest do not count,
+//   b. it has rotated by more than max_rotation,
+//   c. it is farther than max_distance or later than max_interval
+// holds. any criterion is disabled by a non-positive threshold. the overlap needs the scan cloud,
+// it is skipped for scans without one.
+class AdaptiveKeyFrameSelector: public KeyFrameSelectorInterface {
+  public:
+    // metrics are registered as <metrics_group>.<metric>, with num_scans, num_key_frames, the key frames
+    // selected by each criterion, num_by_overlap, num_by_rotation, num_by_distance & num_by_interval,
+    // and the gauge overlap of the last scan:
+    AdaptiveKeyFrameSelector(const YAML::Node& node, const std::string& metrics_group);
+
+    bool Select(double time, const Eigen::Matrix4f& pose, const CloudData::CLOUD_PTR& cloud_ptr) override;
+
+  private:
+    // keys of the voxels occupied by cloud_ptr in map frame:
+    void GetVoxelKeys(
+        const Eigen::Matrix4f& pose, const CloudData::CLOUD_PTR& cloud_ptr, 
+        std::unordered_set<int64_t>& voxel_keys
+    ) const;
+
+  private:
+    float min_distance_ = 0.5;
+    float max_distance_ = 10.0;
+    // in rad:
+    float max_rotation_ = 0.26;
+    double max_interval_ = 5.0;
+    float min_overlap_ = 0.7;
+    float inverse_leaf_size_ = 1.0;
+
+    bool has_key_frame_ = false;
+    double last_key_frame_time_ = 0.0;
+    Eigen::Matrix4f last_key_frame_pose_ = Eigen::Matrix4f::Identity();
+    std::unordered_set<int64_t> last_key_frame_voxels_;
+    // reused across scans:
+    std::unordered_set<int64_t> voxels_;
+
+    Counter& num_scans_;
+    Counter& num_key_frames_;
+    Counter& num_by_overlap_;
+    Counter& num_by_rotation_;
+    Counter& num_by_distance_;
+    Counter& num_by_interval_;
+    Gauge& overlap_;
+};
+}
+
+#endif
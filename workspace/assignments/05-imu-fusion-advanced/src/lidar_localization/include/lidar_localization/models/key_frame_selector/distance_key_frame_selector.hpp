@@ -0,0 +1,37 @@
+/*
+ * @Description: key frame selection by distance to the last key frame
+ * @Author: Ge Yao
+ * @Date: 2020-12-24 16:05:28
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_KEY_FRAME_SELECTOR_DISTANCE_KEY_FRAME_SELECTOR_HPP_
+#define LIDAR_LOCALIZATION_MODELS_KEY_FRAME_SELECTOR_DISTANCE_KEY_FRAME_SELECTOR_HPP_
+
+#include <string>
+
+#include "lidar_localization/models/key_frame_selector/key_frame_selector_interface.hpp"
+#include "lidar_localization/tools/metrics.hpp"
+
+namespace lidar_localization {
+// a scan is selected once |dx| + |dy| + |dz| to the last key frame exceeds key_frame_distance:
+class DistanceKeyFrameSelector: public KeyFrameSelectorInterface {
+  public:
+    // metrics are registered as <metrics_group>.num_scans & <metrics_group>.num_key_frames:
+    DistanceKeyFrameSelector(const YAML::Node& node, const std::string& metrics_group);
+
+    bool Select(double time, const Eigen::Matrix4f& pose, const CloudData::CLOUD_PTR& cloud_ptr) override;
+
+  private:
+    bool SetSelectorParam(float key_frame_distance);
+
+  private:
+    float key_frame_distance_ = 2.0;
+
+    bool has_key_frame_ = false;
+    Eigen::Matrix4f last_key_frame_pose_ = Eigen::Matrix4f::Identity();
+
+    Counter& num_scans_;
+    Counter& num_key_frames_;
+};
+}
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * @Description: key frame selection policy interface
+ * @Author: Ge Yao
+ * @Date: 2020-12-24 16:05:28
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_KEY_FRAME_SELECTOR_KEY_FRAME_SELECTOR_INTERFACE_HPP_
+#define LIDAR_LOCALIZATION_MODELS_KEY_FRAME_SELECTOR_KEY_FRAME_SELECTOR_INTERFACE_HPP_
+
+#include <yaml-cpp/yaml.h>
+#include <Eigen/Dense>
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+
+namespace lidar_localization {
+class KeyFrameSelectorInterface {
+  public:
+    virtual ~KeyFrameSelectorInterface() = default;
+
+    /**
+     * @brief  whether the scan should become a new key frame, the first scan always does
+     * @param  time, scan time
+     * @param  pose, scan pose in map frame
+     * @param  cloud_ptr, scan in lidar frame, may be null for policies that don't need it
+     * @return true if the scan is selected, it is then the reference of the following scans
+     */
+    virtual bool Select(double time, const Eigen::Matrix4f& pose, const CloudData::CLOUD_PTR& cloud_ptr) = 0;
+};
+}
+
+#endif
@@ -0,0 +1,24 @@
+/*
+ * @Description: key frame point cloud storage interface
+ * @Author: Ge Yao
+ * @Date: 2020-12-07 21:05:12
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_KEY_FRAME_STORE_KEY_FRAME_STORE_INTERFACE_HPP_
+#define LIDAR_LOCALIZATION_MODELS_KEY_FRAME_STORE_KEY_FRAME_STORE_INTERFACE_HPP_
+
+#include <yaml-cpp/yaml.h>
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+
+namespace lidar_localization {
+class KeyFrameStoreInterface {
+  public:
+    virtual ~KeyFrameStoreInterface() = default;
+
+    // writer side, key frames are saved from one thread in index order:
+    virtual bool Save(unsigned int index, const CloudData::CLOUD& cloud) = 0;
+    // reader side, returns false if the key frame is not available yet:
+    virtual bool Load(unsigned int index, CloudData::CLOUD& cloud) = 0;
+};
+}
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * @Description: LRU cache of decoded key scans
+ * @Author: Ge Yao
+ * @Date: 2020-12-08 20:41:27
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_KEY_FRAME_STORE_KEY_SCAN_CACHE_HPP_
+#define LIDAR_LOCALIZATION_MODELS_KEY_FRAME_STORE_KEY_SCAN_CACHE_HPP_
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#include "lidar_localization/models/key_frame_store/key_frame_store_interface.hpp"
+#include "lidar_localization/models/cloud_filter/cloud_filter_interface.hpp"
+#include "lidar_localization/sensor_data/compact_cloud.hpp"
+
+namespace lidar_localization {
+// not thread-safe, one cache per user:
+class KeyScanCache {
+  public:
+    struct Stats {
+      size_t num_hits = 0;
+      size_t num_misses = 0;
+      size_t num_scans = 0;
+      size_t size_in_bytes = 0;
+    };
+
+    // filter_ptr is applied once when a scan enters the cache, nullptr keeps the raw scan.
+    // scans are kept as compact clouds of compact_resolution if it is positive, about 1/3 of the size:
+    KeyScanCache(
+      std::shared_ptr<KeyFrameStoreInterface> store_ptr,
+      std::shared_ptr<CloudFilterInterface> filter_ptr,
+      size_t max_size_in_mb,
+      float compact_resolution = 0.0f
+    );
+
+    bool IsCompact(void) const { return compact_resolution_ > 0.0f; }
+
+    // the returned scan is shared with the cache and must not be modified. 
+    // a compact cache decodes it into a new cloud for every call:
+    bool Get(unsigned int index, CloudData::CLOUD::ConstPtr& scan_ptr);
+    // compact caches only, for CloudAssembler:
+    bool Get(unsigned int index, CompactCloud::ConstPtr& scan_ptr);
+    void Clear(void);
+
+    const Stats& GetStats(void) const { return stats_; }
+
+  private:
+    struct Entry {
+      // one of them, by IsCompact():
+      CloudData::CLOUD::ConstPtr scan_ptr;
+      CompactCloud::ConstPtr compact_scan_ptr;
+      size_t size_in_bytes;
+      std::list<unsigned int>::iterator lru_it;
+    };
+
+    // the entry of the scan, loaded on a miss, nullptr if it cannot be loaded:
+    const Entry* Find(unsigned int index);
+    void Evict(void);
+
+  private:
+    std::shared_ptr<KeyFrameStoreInterface> store_ptr_;
+    std::shared_ptr<CloudFilterInterface> filter_ptr_;
+    size_t max_size_in_bytes_;
+    float compact_resolution_;
+
+    // most recently used first:
+    std::list<unsigned int> lru_;
+    std::unordered_map<unsigned int, Entry> entries_;
+
+    Stats stats_;
+};
+}
+
+#endif
@@ -0,0 +1,86 @@
+/*
+ * @Description: key frame storage as one append-only, memory-mapped file
+ * @Author: Ge Yao
+ * @Date: 2020-12-07 21:05:12
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_KEY_FRAME_STORE_PACKED_KEY_FRAME_STORE_HPP_
+#define LIDAR_LOCALIZATION_MODELS_KEY_FRAME_STORE_PACKED_KEY_FRAME_STORE_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "lidar_localization/models/key_frame_store/key_frame_store_interface.hpp"
+
+namespace lidar_localization {
+// layout:
+//   key_frames.dat -- key frame blobs, a BlobHeader followed by int16 xyz, optionally LZ4 compressed
+//   key_frames.idx -- one IndexRecord per key frame, appended after its blob is written
+// readers map key_frames.dat and only go back to the file system for key frames they have not seen.
+class PackedKeyFrameStore: public KeyFrameStoreInterface {
+  public:
+    PackedKeyFrameStore(const std::string& key_frames_path, const YAML::Node& node);
+    PackedKeyFrameStore(const std::string& key_frames_path, float resolution, bool use_lz4);
+    ~PackedKeyFrameStore();
+
+    bool Save(unsigned int index, const CloudData::CLOUD& cloud) override;
+    bool Load(unsigned int index, CloudData::CLOUD& cloud) override;
+
+  private:
+    enum Compression : uint32_t {
+      NONE = 0,
+      LZ4 = 1
+    };
+
+    struct BlobHeader {
+      uint32_t magic;
+      uint32_t index;
+      uint32_t num_points;
+      uint32_t compression;
+      uint32_t raw_size;
+      uint32_t stored_size;
+      // point = origin + scale * quantized:
+      float origin[3];
+      float scale;
+    };
+
+    struct IndexRecord {
+      uint32_t index;
+      uint32_t reserved;
+      uint64_t offset;
+    };
+
+    bool SetStoreParam(const std::string& key_frames_path, float resolution, bool use_lz4);
+
+    bool OpenForWrite(void);
+    static bool WriteAll(int fd, const void *data, size_t size);
+
+    bool Refresh(void);
+    bool Map(size_t size);
+    void Unmap(void);
+
+  private:
+    std::string data_file_path_;
+    std::string index_file_path_;
+    float resolution_;
+    bool use_lz4_;
+
+    // writer side:
+    int data_write_fd_ = -1;
+    int index_write_fd_ = -1;
+    uint64_t data_write_offset_ = 0;
+    std::vector<int16_t> quantized_;
+    std::vector<char> compressed_;
+
+    // reader side:
+    int data_read_fd_ = -1;
+    int index_read_fd_ = -1;
+    const char *data_ = nullptr;
+    size_t data_size_ = 0;
+    size_t num_records_ = 0;
+    std::vector<uint64_t> offsets_;
+    std::vector<char> decompressed_;
+};
+}
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * @Description: key frame storage as one PCD file per key frame
+ * @Author: Ge Yao
+ * @Date: 2020-12-07 21:05:12
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_KEY_FRAME_STORE_PCD_KEY_FRAME_STORE_HPP_
+#define LIDAR_LOCALIZATION_MODELS_KEY_FRAME_STORE_PCD_KEY_FRAME_STORE_HPP_
+
+#include <string>
+
+#include "lidar_localization/models/key_frame_store/key_frame_store_interface.hpp"
+
+namespace lidar_localization {
+class PCDKeyFrameStore: public KeyFrameStoreInterface {
+  public:
+    PCDKeyFrameStore(const std::string& key_frames_path);
+
+    bool Save(unsigned int index, const CloudData::CLOUD& cloud) override;
+    bool Load(unsigned int index, CloudData::CLOUD& cloud) override;
+
+  private:
+    std::string GetFilePath(unsigned int index) const;
+
+  private:
+    std::string key_frames_path_;
+};
+}
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ * @Description: multi-resolution global map, one voxel centroid cloud per octree depth
+ * @Author: Ge Yao
+ * @Date: 2020-12-28 19:42:17
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_LOD_MAP_LOD_MAP_HPP_
+#define LIDAR_LOCALIZATION_MODELS_LOD_MAP_LOD_MAP_HPP_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/models/local_map/grid_map.hpp"
+
+namespace lidar_localization {
+// layout:
+//   index.yaml       -- leaf size of the finest level and the num. of points of every level
+//   level_<k>.pcd    -- one centroid per voxel of leaf_size * 2^k
+// level k + 1 is built from the voxels of level k, as the octree nodes one depth up, so every
+// centroid is the mean of all map points below it. levels are loaded once and never modified,
+// so the getters can be called from any thread.
+class LODMap {
+  public:
+    // build num_levels levels from map under lod_path:
+    static bool Save(const std::string& lod_path, const CloudData::CLOUD& map, float leaf_size, int num_levels);
+
+    // each level is bucketed into x-y cells of cell_size, see GridMap:
+    LODMap(const std::string& lod_path, float cell_size);
+
+    bool IsValid(void) const { return !levels_.empty(); }
+    int GetNumLevels(void) const { return static_cast<int>(levels_.size()); }
+    float GetLeafSize(int level) const { return levels_.at(level).leaf_size; }
+    // the coarsest level whose leaf size is not larger than resolution, the finest one if none:
+    int GetLevel(float resolution) const;
+
+    // the whole level, e.g. for visualization:
+    CloudData::CLOUD::ConstPtr GetMap(int level) const { return levels_.at(level).map_ptr; }
+    // points of the level inside the box, edge is ordered as BoxFilter::GetEdge:
+    bool GetMap(int level, const std::vector<float>& edge, CloudData::CLOUD_PTR& map_ptr) const;
+
+  private:
+    struct Level {
+      float leaf_size;
+      CloudData::CLOUD_PTR map_ptr;
+      std::shared_ptr<GridMap> grid_map_ptr;
+    };
+
+    static std::string GetLevelFileName(int level);
+    bool Load(const std::string& lod_path, float cell_size);
+
+  private:
+    std::vector<Level> levels_;
+};
+} // namespace lidar_localization
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ * @Description: IMU pre-integration between two graph nodes, mid-value integration in the body frame of the first node
+ * @Author: Ge Yao
+ * @Date: 2020-12-25 10:06:18
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_PRE_INTEGRATOR_IMU_PRE_INTEGRATOR_HPP_
+#define LIDAR_LOCALIZATION_MODELS_PRE_INTEGRATOR_IMU_PRE_INTEGRATOR_HPP_
+
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+#include <Eigen/Dense>
+
+#include "lidar_localization/sensor_data/imu_data.hpp"
+#include "lidar_localization/models/imu_mechanization/imu_mechanization.hpp"
+
+namespace lidar_localization {
+// error state order: delta position, delta orientation, delta velocity, accel bias, gyro bias
+class IMUPreIntegrator {
+  public:
+    static const int DIM_STATE = 15;
+    static const int INDEX_P = 0;
+    static const int INDEX_R = 3;
+    static const int INDEX_V = 6;
+    static const int INDEX_A = 9;
+    static const int INDEX_G = 12;
+
+    typedef Eigen::Matrix<double, DIM_STATE, DIM_STATE> MatrixP;
+
+    // continuous-time noise densities:
+    struct Noise {
+      double accel = 2.5e-3;
+      double gyro = 2.5e-4;
+      double accel_bias = 1.0e-4;
+      double gyro_bias = 1.0e-5;
+    };
+
+    IMUPreIntegrator(const Noise& noise);
+    IMUPreIntegrator(const YAML::Node& node);
+
+    /**
+     * @brief  start a new pre-integration
+     * @param  imu_data, measurement at the time of the first node
+     * @param  accel_bias, accel bias of the first node, used for linearization
+     * @param  gyro_bias, gyro bias of the first node, used for linearization
+     */
+    void Reset(const IMUData& imu_data, const Eigen::Vector3d& accel_bias, const Eigen::Vector3d& gyro_bias);
+    // measurements must be added in time order:
+    bool Integrate(const IMUData& imu_data);
+    // re-integrate all measurements with new linearization biases:
+    void Repropagate(const Eigen::Vector3d& accel_bias, const Eigen::Vector3d& gyro_bias);
+
+    double GetStartTime(void) const { return start_time_; }
+    double GetTime(void) const { return T_; }
+    size_t GetSampleNum(void) const { return samples_.size(); }
+
+    // first-order bias corrected deltas:
+    Eigen::Vector3d GetDeltaPosition(const Eigen::Vector3d& accel_bias, const Eigen::Vector3d& gyro_bias) const;
+    Eigen::Vector3d GetDeltaVelocity(const Eigen::Vector3d& accel_bias, const Eigen::Vector3d& gyro_bias) const;
+    Eigen::Matrix3d GetDeltaOrientation(const Eigen::Vector3d& gyro_bias) const;
+
+    const Eigen::Vector3d& GetLinearizedAccelBias(void) const { return accel_bias_; }
+    const Eigen::Vector3d& GetLinearizedGyroBias(void) const { return gyro_bias_; }
+    const MatrixP& GetCovariance(void) const { return P_; }
+
+  private:
+    void Propagate(const imu_mechanization::IMUSample& sample_prev, const imu_mechanization::IMUSample& sample_curr);
+    static imu_mechanization::IMUSample ToSample(const IMUData& imu_data);
+
+  private:
+    Noise noise_;
+
+    double start_time_ = 0.0;
+    std::vector<imu_mechanization::IMUSample> samples_;
+
+    // linearization point:
+    Eigen::Vector3d accel_bias_ = Eigen::Vector3d::Zero();
+    Eigen::Vector3d gyro_bias_ = Eigen::Vector3d::Zero();
+
+    // pre-integrated measurement:
+    double T_ = 0.0;
+    Eigen::Vector3d alpha_ = Eigen::Vector3d::Zero();
+    Eigen::Vector3d beta_ = Eigen::Vector3d::Zero();
+    Eigen::Matrix3d theta_ = Eigen::Matrix3d::Identity();
+
+    // covariance & jacobian of the deltas w.r.t. the linearization biases:
+    MatrixP P_ = MatrixP::Zero();
+    MatrixP J_ = MatrixP::Identity();
+};
+} // namespace lidar_localization
+
+#endif
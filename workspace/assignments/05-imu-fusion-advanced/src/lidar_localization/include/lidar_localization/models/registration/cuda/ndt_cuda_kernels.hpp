@@ -0,0 +1,52 @@
+/*
+ * @Description: device side of NDTCUDARegistration, target voxelization and batched NDT derivatives
+ * @Author: Ge Yao
+ * @Date: 2020-12-29 10:27:44
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_REGISTRATION_CUDA_NDT_CUDA_KERNELS_HPP_
+#define LIDAR_LOCALIZATION_MODELS_REGISTRATION_CUDA_NDT_CUDA_KERNELS_HPP_
+
+#include <memory>
+
+namespace lidar_localization {
+// no CUDA or Eigen types in this header, so that it is included from host-only translation units.
+// points are packed x, y, z floats. all calls are synchronous on the default stream.
+class NDTCUDAKernels {
+  public:
+    // score, gradient and Gauss-Newton Hessian, as NDTOMPRegistration::Derivatives:
+    struct Derivatives {
+      double score;
+      double g[6];
+      // row-major:
+      double H[36];
+
+      // squared distance to the plane of the most likely neighbor voxel, as NDTOMPRegistration:
+      double sum_sq_dis;
+      int num_matched;
+    };
+
+    /**
+     * @param  res, voxel size
+     * @param  gauss_d1, gauss_d2, NDT score function constants, see Magnusson 2009, eq. 6.8
+     * @param  num_neighbors, 1 for DIRECT1 or 7 for DIRECT7 neighbor search
+     */
+    NDTCUDAKernels(float res, double gauss_d1, double gauss_d2, int num_neighbors);
+    ~NDTCUDAKernels();
+
+    static bool IsDeviceAvailable(void);
+
+    // voxelize the target on the device, false on CUDA errors:
+    bool SetTarget(const float* points, int num_points);
+    bool SetSource(const float* points, int num_points);
+    int GetNumVoxels(void) const;
+
+    // pose is the row-major 3x4 [R|t] of the source in target frame:
+    bool ComputeDerivatives(const double pose[12], Derivatives& derivatives);
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+} // namespace lidar_localization
+
+#endif
@@ -0,0 +1,63 @@
+/*
+ * @Description: global pre-alignment by FPFH correspondences & RANSAC, to seed a local registration
+ * @Author: Ge Yao
+ * @Date: 2021-01-20 20:48:16
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_REGISTRATION_FPFH_RANSAC_ALIGNMENT_HPP_
+#define LIDAR_LOCALIZATION_MODELS_REGISTRATION_FPFH_RANSAC_ALIGNMENT_HPP_
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+#include <yaml-cpp/yaml.h>
+#include <Eigen/Dense>
+
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+
+namespace lidar_localization {
+// FPFH features of the downsampled clouds are matched by mutual nearest neighbors in feature space.
+// RANSAC then draws 3 correspondences at a time, rejects samples whose edge lengths disagree before any
+// pose is estimated, and stops early once the inlier ratio so far makes a better sample unlikely.
+// the pose is refit on the inliers of the best sample. stateless once created, so one instance can be
+// shared by parallel callers
+class FPFHRansacAlignment {
+  public:
+    // downsampled points & their features, computed once per cloud:
+    struct Features {
+      pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_ptr;
+      pcl::PointCloud<pcl::FPFHSignature33>::Ptr feature_ptr;
+    };
+
+    struct Result {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      bool is_found = false;
+      // source pose in target frame:
+      Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
+      int num_correspondences = 0;
+      int num_inliers = 0;
+      int num_iterations = 0;
+    };
+
+    FPFHRansacAlignment(const YAML::Node& node);
+
+    void ComputeFeatures(const CloudData::CLOUD& cloud, Features& features) const;
+    // found only with enough inliers and within max_offset of the initial pose, e.g. from GNSS:
+    Result Align(const Features& source, const Features& target, const Eigen::Matrix4f& init_pose) const;
+
+  private:
+    float leaf_size_;
+    float normal_radius_;
+    float feature_radius_;
+    // RANSAC:
+    int max_iterations_;
+    float confidence_;
+    float inlier_threshold_;
+    // min. ratio of the shorter to the longer of corresponding sample edges:
+    float min_edge_similarity_;
+    int min_num_inliers_;
+    float max_offset_;
+};
+}
+
+#endif
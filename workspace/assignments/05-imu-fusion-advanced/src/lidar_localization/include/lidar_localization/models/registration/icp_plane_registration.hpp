@@ -0,0 +1,132 @@
+/*
+ * @Description: point-to-plane ICP registration with cached per-frame target normals
+ * @Author: Ge Yao
+ * @Date: 2020-12-28 21:15:08
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_REGISTRATION_ICP_PLANE_REGISTRATION_HPP_
+#define LIDAR_LOCALIZATION_MODELS_REGISTRATION_ICP_PLANE_REGISTRATION_HPP_
+
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <unordered_map>
+
+#include <pcl/kdtree/kdtree_flann.h>
+
+#include "lidar_localization/models/registration/registration_interface.hpp"
+
+namespace lidar_localization {
+// target normals are estimated once per frame, from the neighbors in its range image instead of a kd-tree:
+// organized clouds use their own rows and columns, others are projected as LINS image_projection_node does,
+// around the scan pose stored in sensor_origin_ & sensor_orientation_ of the frame cloud.
+// correspondences are the nearest target points in the 27 neighboring voxels of max_corr_dist.
+class ICPPlaneRegistration: public RegistrationInterface {
+  public:
+    ICPPlaneRegistration(const YAML::Node& node);
+
+    bool SetInputTarget(const CloudData::CLOUD_PTR& input_target) override;
+    bool ScanMatch(const CloudData::CLOUD_PTR& input_source,
+                   const Eigen::Matrix4f& predict_pose,
+                   CloudData::CLOUD_PTR& result_cloud_ptr,
+                   Eigen::Matrix4f& result_pose) override;
+    float GetFitnessScore() override;
+    bool SetMaxIterationLimit(int max_iteration_limit) override;
+    int GetNumIterations() override;
+    // from the linear system of the last iteration, i.e., before its final step:
+    Result GetResult() override;
+
+    // incremental target, frame clouds are in map frame:
+    bool HasIncrementalTarget() const override { return true; }
+    bool AddTargetFrame(int frame_id, const CloudData::CLOUD_PTR& frame_cloud) override;
+    bool RemoveTargetFrame(int frame_id) override;
+
+  private:
+    using Vector6d = Eigen::Matrix<double, 6, 1>;
+    using Matrix6d = Eigen::Matrix<double, 6, 6>;
+
+    struct RangeImageParam {
+      int num_rows;
+      int num_cols;
+      // in degrees, as LINS ang_res_x, ang_res_y & ang_bottom:
+      float horizontal_resolution;
+      float vertical_resolution;
+      float vertical_bottom;
+      // neighbor window of +-half size:
+      int row_half_size;
+      int col_half_size;
+      float max_neighbor_distance;
+      int min_num_neighbors;
+    };
+
+    struct RangeImage {
+      int num_rows = 0;
+      int num_cols = 0;
+      // columns of projected images wrap around:
+      bool is_wrapped = false;
+      // pixel of every point, -1 if outside the image:
+      std::vector<int> point_pixels;
+      // point of every pixel, the closest one if several, -1 if empty:
+      std::vector<int> pixel_points;
+    };
+
+    struct TargetPoint {
+      int frame_id;
+      Eigen::Vector3f point;
+      Eigen::Vector3f normal;
+    };
+
+    struct TargetFrame {
+      CloudData::CLOUD_PTR cloud;
+      // keys of the voxels holding its points:
+      std::vector<int64_t> voxel_keys;
+    };
+
+    struct LinearSystem {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      void Reset(void);
+
+      double error = 0.0;
+      int num_corr = 0;
+      Vector6d b = Vector6d::Zero();
+      Matrix6d H = Matrix6d::Zero();
+    };
+
+    void GetRangeImage(const CloudData::CLOUD& cloud, RangeImage& range_image) const;
+    // frame points with a reliable normal, in map frame:
+    void ComputeNormals(int frame_id, const CloudData::CLOUD& cloud, std::vector<TargetPoint>& target_points) const;
+
+    int64_t GetVoxelKey(const Eigen::Vector3f &point) const;
+    // nearest target point within max_corr_dist, nullptr if none:
+    const TargetPoint* GetCorrespondence(const Eigen::Vector3f &point) const;
+
+    void BuildLinearSystem(const Eigen::Matrix4d &pose, LinearSystem &system);
+    static Eigen::Matrix4d UpdatePose(const Eigen::Matrix4d &pose, const Vector6d &delta);
+
+  private:
+    float max_corr_dist_;
+    float trans_eps_;
+    int max_iter_;
+    int max_iteration_limit_ = -1;
+    int num_threads_;
+    RangeImageParam range_image_param_;
+
+    // target frames and the target points bucketed by voxel:
+    std::map<int, TargetFrame> target_frames_;
+    std::unordered_map<int64_t, std::vector<TargetPoint>> target_voxels_;
+
+    CloudData::CLOUD_PTR input_source_;
+    Eigen::Matrix4f final_transformation_ = Eigen::Matrix4f::Identity();
+    int num_iterations_ = 0;
+    Result result_;
+
+    // only built when fitness score is queried:
+    bool has_target_kdtree_ = false;
+    CloudData::CLOUD_PTR input_target_;
+    pcl::KdTreeFLANN<CloudData::POINT>::Ptr input_target_kdtree_;
+
+    std::vector<LinearSystem, Eigen::aligned_allocator<LinearSystem>> thread_systems_;
+};
+}
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ * @Description: LOAM edge & plane feature registration with cached per-frame target features
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 21:52:40
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_REGISTRATION_LOAM_REGISTRATION_HPP_
+#define LIDAR_LOCALIZATION_MODELS_REGISTRATION_LOAM_REGISTRATION_HPP_
+
+#include <map>
+#include <vector>
+#include <memory>
+
+#include <pcl/kdtree/kdtree_flann.h>
+
+#include "lidar_localization/models/registration/registration_interface.hpp"
+#include "lidar_localization/models/cloud_filter/voxel_filter_fast.hpp"
+
+namespace lidar_localization {
+// features are extracted ring by ring as A-LOAM scanRegistration does, from the smoothness along the ring:
+// rings are the ring field if the point type has one and the rows of the LINS range image otherwise,
+// projected around the scan pose stored in sensor_origin_ & sensor_orientation_ of the cloud.
+// source features are matched against the target features as A-LOAM laserMapping does, i.e. point-to-line
+// for edges and point-to-plane for planes, solved by Gauss-Newton instead of Ceres.
+// dense input works best, the features are decimated by their own voxel filters
+class LOAMRegistration: public RegistrationInterface {
+  public:
+    LOAMRegistration(const YAML::Node& node);
+
+    bool SetInputTarget(const CloudData::CLOUD_PTR& input_target) override;
+    bool ScanMatch(const CloudData::CLOUD_PTR& input_source,
+                   const Eigen::Matrix4f& predict_pose,
+                   CloudData::CLOUD_PTR& result_cloud_ptr,
+                   Eigen::Matrix4f& result_pose) override;
+    float GetFitnessScore() override;
+    bool SetMaxIterationLimit(int max_iteration_limit) override;
+    int GetNumIterations() override;
+    // from the linear system of the last iteration, i.e., before its final step:
+    Result GetResult() override;
+
+    // incremental target, frame clouds are in map frame:
+    bool HasIncrementalTarget() const override { return true; }
+    bool AddTargetFrame(int frame_id, const CloudData::CLOUD_PTR& frame_cloud) override;
+    bool RemoveTargetFrame(int frame_id) override;
+
+  private:
+    using Vector6d = Eigen::Matrix<double, 6, 1>;
+    using Matrix6d = Eigen::Matrix<double, 6, 6>;
+
+    struct RangeImageParam {
+      int num_rows;
+      int num_cols;
+      // in degrees, as LINS ang_res_x, ang_res_y & ang_bottom:
+      float horizontal_resolution;
+      float vertical_resolution;
+      float vertical_bottom;
+    };
+
+    struct FeatureParam {
+      // the smoothness of a point is taken over +-half size neighbors on its ring:
+      int curvature_half_size;
+      int num_sectors;
+      int max_num_edges_per_sector;
+      float edge_threshold;
+      float plane_threshold;
+      // the neighbors of a picked edge are not picked, up to a gap of this distance:
+      float max_neighbor_distance;
+    };
+
+    struct MatchParam {
+      int num_neighbors;
+      float max_neighbor_distance;
+      // largest to middle eigenvalue of the edge neighbors:
+      float min_edge_eigen_ratio;
+      float max_plane_distance;
+      float huber_delta;
+    };
+
+    struct TargetFrame {
+      CloudData::CLOUD_PTR cloud;
+      CloudData::CLOUD_PTR edge_cloud;
+      CloudData::CLOUD_PTR plane_cloud;
+    };
+
+    struct LinearSystem {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      void Reset(void);
+
+      double error = 0.0;
+      int num_corr = 0;
+      Vector6d b = Vector6d::Zero();
+      Matrix6d H = Matrix6d::Zero();
+    };
+
+    // points of each ring, in azimuth order, the closest one of each column:
+    void GetRings(const CloudData::CLOUD& cloud, std::vector<std::vector<int>>& rings) const;
+    void GetRingFeatures(
+        const CloudData::CLOUD& cloud, const std::vector<int>& ring,
+        std::vector<int>& edge_indices, std::vector<int>& plane_indices
+    ) const;
+    // decimated edge & plane features, in the frame of the cloud:
+    void ExtractFeatures(
+        const CloudData::CLOUD& cloud,
+        CloudData::CLOUD_PTR& edge_cloud_ptr, CloudData::CLOUD_PTR& plane_cloud_ptr
+    );
+
+    // kd-trees of the target features, rebuilt once the target frames change:
+    void UpdateTargetFeatures(void);
+    // line through the neighbor edges, false if they are not on one:
+    bool GetEdgeCorrespondence(
+        const CloudData::POINT& point, std::vector<int>& indices, std::vector<float>& sq_distances,
+        Eigen::Vector3d& center, Eigen::Vector3d& direction
+    ) const;
+    // plane n * x + d = 0 through the neighbor planes, false if they are not on one:
+    bool GetPlaneCorrespondence(
+        const CloudData::POINT& point, std::vector<int>& indices, std::vector<float>& sq_distances,
+        Eigen::Vector3d& normal, double& d
+    ) const;
+
+    void BuildLinearSystem(const Eigen::Matrix4d &pose, LinearSystem &system);
+    static Eigen::Matrix4d UpdatePose(const Eigen::Matrix4d &pose, const Vector6d &delta);
+
+  private:
+    float trans_eps_;
+    int max_iter_;
+    int max_iteration_limit_ = -1;
+    RangeImageParam range_image_param_;
+    FeatureParam feature_param_;
+    MatchParam match_param_;
+
+    std::shared_ptr<FastVoxelFilter> edge_filter_ptr_;
+    std::shared_ptr<FastVoxelFilter> plane_filter_ptr_;
+
+    std::map<int, TargetFrame> target_frames_;
+    bool has_target_features_ = false;
+    CloudData::CLOUD_PTR target_edge_cloud_;
+    CloudData::CLOUD_PTR target_plane_cloud_;
+    pcl::KdTreeFLANN<CloudData::POINT>::Ptr target_edge_kdtree_;
+    pcl::KdTreeFLANN<CloudData::POINT>::Ptr target_plane_kdtree_;
+
+    CloudData::CLOUD_PTR input_source_;
+    CloudData::CLOUD_PTR source_edge_cloud_;
+    CloudData::CLOUD_PTR source_plane_cloud_;
+    Eigen::Matrix4f final_transformation_ = Eigen::Matrix4f::Identity();
+    int num_iterations_ = 0;
+    Result result_;
+
+    // only built when fitness score is queried:
+    bool has_target_kdtree_ = false;
+    CloudData::CLOUD_PTR input_target_;
+    pcl::KdTreeFLANN<CloudData::POINT>::Ptr input_target_kdtree_;
+
+    // partial systems of fixed blocks of source features, reduced in order:
+    std::vector<LinearSystem, Eigen::aligned_allocator<LinearSystem>> block_systems_;
+};
+}
+
+#endif
@@ -0,0 +1,86 @@
+/*
+ * @Description: NDT registration with target voxelization and derivatives on the GPU
+ * @Author: Ge Yao
+ * @Date: 2020-12-29 10:31:12
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_REGISTRATION_NDT_CUDA_REGISTRATION_HPP_
+#define LIDAR_LOCALIZATION_MODELS_REGISTRATION_NDT_CUDA_REGISTRATION_HPP_
+
+#ifdef LIDAR_LOCALIZATION_WITH_CUDA
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <pcl/kdtree/kdtree_flann.h>
+
+#include "lidar_localization/models/registration/registration_interface.hpp"
+#include "lidar_localization/models/registration/cuda/ndt_cuda_kernels.hpp"
+
+namespace lidar_localization {
+// same score function and optimizer as NDTOMPRegistration, only the O(N) parts run on the device:
+// voxel grid of the target, and score, gradient & Hessian over all source points per pose.
+// the Newton step and the backtracking stay on the host
+class NDTCUDARegistration: public RegistrationInterface {
+  public:
+    NDTCUDARegistration(const YAML::Node& node);
+    NDTCUDARegistration(
+      float res, float step_size, float trans_eps, int max_iter,
+      const std::string &neighbor_search_method = "DIRECT7"
+    );
+
+    // true if a CUDA device can be used, otherwise NDTOMPRegistration should be used instead:
+    static bool IsAvailable(void);
+
+    bool SetInputTarget(const CloudData::CLOUD_PTR& input_target) override;
+    bool ScanMatch(const CloudData::CLOUD_PTR& input_source,
+                   const Eigen::Matrix4f& predict_pose,
+                   CloudData::CLOUD_PTR& result_cloud_ptr,
+                   Eigen::Matrix4f& result_pose) override;
+    float GetFitnessScore() override;
+    bool SetMaxIterationLimit(int max_iteration_limit) override;
+    int GetNumIterations() override;
+    // from the derivatives at the result pose, as NDTOMPRegistration:
+    Result GetResult() override;
+
+  private:
+    using Vector6d = Eigen::Matrix<double, 6, 1>;
+    using Matrix6d = Eigen::Matrix<double, 6, 6>;
+
+    bool SetRegistrationParam(
+      float res, float step_size, float trans_eps, int max_iter,
+      const std::string &neighbor_search_method
+    );
+    static void PackPoints(const CloudData::CLOUD_PTR& cloud, std::vector<float> &points);
+
+    bool ComputeDerivatives(const Eigen::Matrix4d &pose, NDTCUDAKernels::Derivatives &derivatives);
+    static Matrix6d GetHessian(const NDTCUDAKernels::Derivatives &derivatives);
+    static Eigen::Matrix4d UpdatePose(const Eigen::Matrix4d &pose, const Vector6d &delta);
+
+  private:
+    float res_;
+    float step_size_;
+    float trans_eps_;
+    int max_iter_;
+    int max_iteration_limit_ = -1;
+    int num_neighbors_;
+
+    std::unique_ptr<NDTCUDAKernels> kernels_;
+    // host staging buffer:
+    std::vector<float> points_;
+
+    CloudData::CLOUD_PTR input_target_;
+    CloudData::CLOUD_PTR input_source_;
+    Eigen::Matrix4f final_transformation_ = Eigen::Matrix4f::Identity();
+    int num_iterations_ = 0;
+    Result result_;
+
+    // only built when fitness score is queried:
+    bool has_target_kdtree_ = false;
+    pcl::KdTreeFLANN<CloudData::POINT>::Ptr input_target_kdtree_;
+};
+} // namespace lidar_localization
+
+#endif
+
+#endif
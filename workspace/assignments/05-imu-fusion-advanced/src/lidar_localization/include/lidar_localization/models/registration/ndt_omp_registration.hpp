@@ -0,0 +1,169 @@
+/*
+ * @Description: multi-threaded NDT registration
+ * @Author: Ge Yao
+ * @Date: 2020-12-01 21:46:57
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_REGISTRATION_NDT_OMP_REGISTRATION_HPP_
+#define LIDAR_LOCALIZATION_MODELS_REGISTRATION_NDT_OMP_REGISTRATION_HPP_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <pcl/kdtree/kdtree_flann.h>
+
+#include "lidar_localization/models/registration/registration_interface.hpp"
+#include "lidar_localization/models/registration/ndt_voxel.hpp"
+
+namespace lidar_localization {
+class NDTOMPRegistration: public RegistrationInterface {
+  public:
+    // which target voxels contribute to the score of one source point:
+    //   DIRECT1 -- the voxel containing the point
+    //   DIRECT7 -- the voxel containing the point and its 6 face neighbors
+    enum class NeighborSearchMethod {
+      DIRECT1,
+      DIRECT7
+    };
+
+    NDTOMPRegistration(const YAML::Node& node);
+    NDTOMPRegistration(
+      float res, float step_size, float trans_eps, int max_iter,
+      int num_threads = 0,
+      NeighborSearchMethod neighbor_search_method = NeighborSearchMethod::DIRECT7,
+      bool incremental_target = false
+    );
+
+    bool SetInputTarget(const CloudData::CLOUD_PTR& input_target) override;
+    bool ScanMatch(const CloudData::CLOUD_PTR& input_source,
+                   const Eigen::Matrix4f& predict_pose,
+                   CloudData::CLOUD_PTR& result_cloud_ptr,
+                   Eigen::Matrix4f& result_pose) override;
+    float GetFitnessScore() override;
+    bool SetMaxIterationLimit(int max_iteration_limit) override;
+    int GetNumIterations() override;
+    // from the derivatives at the result pose, inliers are points with a neighbor voxel:
+    Result GetResult() override;
+
+    // with incremental_target, the target voxel grid is kept as per-frame point statistics,
+    // so adding or removing a frame only recomputes the distributions of the voxels it touches.
+    // frame clouds are in map frame:
+    bool HasIncrementalTarget() const override { return incremental_target_; }
+    bool AddTargetFrame(int frame_id, const CloudData::CLOUD_PTR& frame_cloud) override;
+    bool RemoveTargetFrame(int frame_id) override;
+
+    // target voxels precomputed offline, e.g. of the whole map by build_ndt_target_node. once loaded,
+    // they are matched against instead of the voxels of each input target, which is only kept for
+    // GetFitnessScore. instances loading the same file share one copy:
+    bool SaveTarget(const std::string& file_path) const;
+    bool LoadTarget(const std::string& file_path);
+
+    // the voxels of the last input target move into the returned one, which is matched against from then on.
+    // not available with incremental_target, or once a target file is loaded:
+    std::shared_ptr<const Target> GetTarget() override;
+    bool SetTarget(const std::shared_ptr<const Target>& target) override;
+
+  private:
+    using Vector6d = Eigen::Matrix<double, 6, 1>;
+    using Matrix6d = Eigen::Matrix<double, 6, 6>;
+
+    using Voxel = NDTVoxel::Distribution;
+    using VoxelStats = NDTVoxel::Stats;
+    using VoxelStatsMap = NDTVoxel::StatsMap;
+
+    struct TargetFrame {
+      CloudData::CLOUD_PTR cloud;
+      VoxelStatsMap stats;
+    };
+
+    struct PrebuiltTarget: public Target {
+      size_t GetMemoryUsage(void) const override;
+
+      float res;
+      std::vector<Voxel, Eigen::aligned_allocator<Voxel>> voxels;
+      std::unordered_map<int64_t, int> voxel_index;
+      // input target of a shared one, for GetFitnessScore, nullptr if loaded:
+      CloudData::CLOUD_PTR cloud;
+    };
+
+    // per-thread partial sums of score, gradient and Gauss-Newton Hessian:
+    struct Derivatives {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      void Reset(void);
+
+      double score = 0.0;
+      Vector6d g = Vector6d::Zero();
+      Matrix6d H = Matrix6d::Zero();
+
+      // squared distance to the plane of the most likely neighbor voxel:
+      double sum_sq_dis = 0.0;
+      int num_matched = 0;
+    };
+
+    bool SetRegistrationParam(
+      float res, float step_size, float trans_eps, int max_iter,
+      int num_threads,
+      NeighborSearchMethod neighbor_search_method,
+      bool incremental_target
+    );
+    static NeighborSearchMethod GetNeighborSearchMethod(const std::string &name);
+
+    // the loaded or the shared target, nullptr while matching against the own voxels:
+    const PrebuiltTarget* GetPrebuiltTarget(void) const {
+        return prebuilt_target_ptr_ ? prebuilt_target_ptr_.get() : shared_target_ptr_.get();
+    }
+    void BuildVoxelGrid(const CloudData::CLOUD_PTR& input_target);
+    void UpdateTargetVoxel(int64_t key);
+    int GetNeighborVoxels(const Eigen::Vector3f &point, const Voxel *neighbors[]) const;
+
+    double ComputeDerivatives(const Eigen::Matrix4d &pose, Derivatives &derivatives);
+    static Eigen::Matrix4d UpdatePose(const Eigen::Matrix4d &pose, const Vector6d &delta);
+
+  private:
+    float res_;
+    float step_size_;
+    float trans_eps_;
+    int max_iter_;
+    int max_iteration_limit_ = -1;
+    int num_threads_;
+    NeighborSearchMethod neighbor_search_method_;
+    bool incremental_target_;
+
+    // NDT score function constants, see Magnusson 2009, eq. 6.8:
+    double gauss_d1_;
+    double gauss_d2_;
+
+    // target voxel grid:
+    std::vector<Voxel, Eigen::aligned_allocator<Voxel>> voxels_;
+    std::unordered_map<int64_t, int> voxel_index_;
+
+    // incremental target frames and their merged statistics,
+    // voxels_ slots of voxels no longer valid are reused:
+    std::map<int, TargetFrame> target_frames_;
+    VoxelStatsMap target_stats_;
+    std::vector<int> free_voxels_;
+
+    // null unless loaded:
+    std::shared_ptr<const PrebuiltTarget> prebuilt_target_ptr_;
+    // null unless shared by GetTarget or SetTarget, until the next input target:
+    std::shared_ptr<const PrebuiltTarget> shared_target_ptr_;
+
+    CloudData::CLOUD_PTR input_target_;
+    CloudData::CLOUD_PTR input_source_;
+    Eigen::Matrix4f final_transformation_ = Eigen::Matrix4f::Identity();
+    int num_iterations_ = 0;
+    Result result_;
+
+    // only built when fitness score is queried:
+    bool has_target_kdtree_ = false;
+    pcl::KdTreeFLANN<CloudData::POINT>::Ptr input_target_kdtree_;
+
+    std::vector<Derivatives, Eigen::aligned_allocator<Derivatives>> thread_derivatives_;
+};
+}
+
+#endif
@@ -21,12 +21,17 @@ class NDTRegistration: public RegistrationInterface {
                    CloudData::CLOUD_PTR& result_cloud_ptr,
                    Eigen::Matrix4f& result_pose) override;
     float GetFitnessScore() override;
+    bool SetMaxIterationLimit(int max_iteration_limit) override;
+    int GetNumIterations() override;
+    // pcl does not expose its correspondences, so the fitness score still needs a search:
+    Result GetResult() override;
   
   private:
     bool SetRegistrationParam(float res, float step_size, float trans_eps, int max_iter);
 
   private:
     pcl::NormalDistributionsTransform<CloudData::POINT, CloudData::POINT>::Ptr ndt_ptr_;
+    int max_iter_;
 };
 }
 
@@ -0,0 +1,74 @@
+/*
+ * @Description: normal distributions of voxels, shared by the NDT backends
+ * @Author: Ge Yao
+ * @Date: 2021-01-22 20:37:12
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_REGISTRATION_NDT_VOXEL_HPP_
+#define LIDAR_LOCALIZATION_MODELS_REGISTRATION_NDT_VOXEL_HPP_
+
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+
+#include <Eigen/Dense>
+
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+
+namespace lidar_localization {
+class NDTVoxel {
+  public:
+    // voxels with fewer points do not have a reliable covariance:
+    static const int MIN_POINTS_PER_VOXEL = 6;
+
+    // normal distribution of the points of one voxel:
+    struct Distribution {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      Eigen::Vector3d mean = Eigen::Vector3d::Zero();
+      Eigen::Matrix3d cov = Eigen::Matrix3d::Identity();
+      Eigen::Matrix3d icov = Eigen::Matrix3d::Identity();
+      // least-variance direction, for the point-to-plane fitness score:
+      Eigen::Vector3d normal = Eigen::Vector3d::UnitZ();
+    };
+
+    // additive point statistics, so that frames can be merged into and removed from a voxel:
+    struct Stats {
+      void Add(const Eigen::Vector3d &point);
+      void Add(const Stats &other);
+      void Subtract(const Stats &other);
+
+      int num_points = 0;
+      Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+      Eigen::Matrix3d sum_sq = Eigen::Matrix3d::Zero();
+    };
+    using StatsMap = std::unordered_map<int64_t, Stats>;
+
+    // distribution of voxel points, with near-singular covariances inflated, false if it is not reliable:
+    static bool ComputeDistribution(
+      const Stats &stats, Distribution &distribution, int min_num_points = MIN_POINTS_PER_VOXEL
+    );
+    // statistics of the cloud points by voxel key:
+    static void GetStats(const CloudData::CLOUD &cloud, float res, StatsMap &stats);
+
+    static Eigen::Vector3i GetIndex(const Eigen::Vector3f &point, float res) {
+        return Eigen::Vector3i(
+            static_cast<int>(std::floor(point.x() / res)),
+            static_cast<int>(std::floor(point.y() / res)),
+            static_cast<int>(std::floor(point.z() / res))
+        );
+    }
+    // 21 bits per axis:
+    static int64_t GetKey(const Eigen::Vector3i &index) {
+        static const int64_t OFFSET = (1 << 20);
+        static const int64_t MASK = (1 << 21) - 1;
+
+        return (
+            (((index.x() + OFFSET) & MASK) << 42) |
+            (((index.y() + OFFSET) & MASK) << 21) |
+            ((index.z() + OFFSET) & MASK)
+        );
+    }
+};
+}
+
+#endif
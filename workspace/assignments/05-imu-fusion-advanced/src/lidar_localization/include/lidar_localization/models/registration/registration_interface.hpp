@@ -6,6 +6,9 @@
 #ifndef LIDAR_LOCALIZATION_MODELS_REGISTRATION_INTERFACE_HPP_
 #define LIDAR_LOCALIZATION_MODELS_REGISTRATION_INTERFACE_HPP_
 
+#include <limits>
+#include <memory>
+
 #include <yaml-cpp/yaml.h>
 #include <Eigen/Dense>
 #include "lidar_localization/sensor_data/cloud_data.hpp"
@@ -13,6 +16,32 @@
 namespace lidar_localization {
 class RegistrationInterface {
   public:
+    // summary of the last ScanMatch, taken from the correspondences of its last iteration:
+    struct Result {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      // mean squared residual of matched source points. point-to-plane for the voxel and plane backends,
+      // which makes it smaller than GetFitnessScore, the point-to-point distance after another search:
+      float fitness_score = std::numeric_limits<float>::max();
+      // ratio of source points with a correspondence, -1 if not available:
+      float inlier_ratio = -1.0f;
+      int num_iterations = -1;
+      bool has_converged = false;
+      // Gauss-Newton Hessian J^T * W * J w.r.t. left perturbation [delta_t, delta_theta] of the result pose,
+      // small eigenvalues mark degenerate directions:
+      bool has_hessian = false;
+      Eigen::Matrix<double, 6, 6> hessian = Eigen::Matrix<double, 6, 6>::Zero();
+    };
+
+    // built target structures, e.g. NDT voxels, to be set again on this or another instance of the same backend
+    // & params, so a target matched repeatedly is only built once:
+    class Target {
+      public:
+        virtual ~Target() = default;
+        // approx. heap bytes of the structures, the target cloud is not counted:
+        virtual size_t GetMemoryUsage(void) const = 0;
+    };
+
     virtual ~RegistrationInterface() = default;
 
     virtual bool SetInputTarget(const CloudData::CLOUD_PTR& input_target) = 0;
@@ -21,6 +50,40 @@ class RegistrationInterface {
                           CloudData::CLOUD_PTR& result_cloud_ptr,
                           Eigen::Matrix4f& result_pose) = 0;
     virtual float GetFitnessScore() = 0;
+    // iterations used by the last ScanMatch, -1 if not available:
+    virtual int GetNumIterations() { return -1; }
+    // cap on the iterations of the following ScanMatch calls, below the configured max. iterations,
+    // e.g. to bound the matching time under load. -1 to remove it, false if the backend has no iteration cap:
+    virtual bool SetMaxIterationLimit(int max_iteration_limit) { return false; }
+    // backends without a cheaper way fall back to GetFitnessScore:
+    virtual Result GetResult() {
+        Result result;
+        result.fitness_score = GetFitnessScore();
+        result.num_iterations = GetNumIterations();
+        return result;
+    }
+
+    // incremental target update for backends that cache per-frame target work,
+    // frame clouds are in map frame and frame_id is unique within one target:
+    virtual bool HasIncrementalTarget() const { return false; }
+    virtual bool AddTargetFrame(int frame_id, const CloudData::CLOUD_PTR& frame_cloud) { return false; }
+    virtual bool RemoveTargetFrame(int frame_id) { return false; }
+
+    // the current target, kept valid while shared, nullptr if the backend cannot share it:
+    virtual std::shared_ptr<const Target> GetTarget() { return nullptr; }
+    // in place of SetInputTarget, false if the target is not of this backend & params:
+    virtual bool SetTarget(const std::shared_ptr<const Target>& target) { return false; }
+
+    // point-to-plane Gauss-Newton system of the source at pose against the target, for tightly-coupled fusion,
+    // w.r.t. left perturbation [delta_t, delta_theta] as in Result::hessian, i.e., the step solves H * delta = b.
+    // returns the num. of residuals, -1 if the backend has no residual model:
+    virtual bool HasLinearization() const { return false; }
+    virtual int Linearize(
+      const CloudData::CLOUD_PTR& input_source,
+      const Eigen::Matrix4d& pose,
+      Eigen::Matrix<double, 6, 6>& H,
+      Eigen::Matrix<double, 6, 1>& b
+    ) { return -1; }
 };
 } 
 
@@ -0,0 +1,70 @@
+/*
+ * @Description: LRU cache of built registration targets, by key frame window
+ * @Author: Ge Yao
+ * @Date: 2021-01-30 10:21:54
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_REGISTRATION_REGISTRATION_TARGET_CACHE_HPP_
+#define LIDAR_LOCALIZATION_MODELS_REGISTRATION_REGISTRATION_TARGET_CACHE_HPP_
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/models/registration/registration_interface.hpp"
+
+namespace lidar_localization {
+// a target is the assembled & filtered cloud of a key frame window, in the frame of the key frame poses,
+// with the structures a registration backend built on it. backends that can't share their structures only
+// save the assembly. not thread-safe, one cache per user:
+class RegistrationTargetCache {
+  public:
+    struct Entry {
+      CloudData::CLOUD_PTR cloud_ptr;
+      // nullptr if the backend can't share it:
+      std::shared_ptr<const RegistrationInterface::Target> target_ptr;
+    };
+
+    struct Stats {
+      size_t num_hits = 0;
+      size_t num_misses = 0;
+      size_t num_targets = 0;
+      size_t size_in_bytes = 0;
+    };
+
+    RegistrationTargetCache(size_t max_size_in_mb);
+
+    // key frame windows are identified by their first & last key frame:
+    static uint64_t GetKey(unsigned int first_index, unsigned int last_index) {
+        return (static_cast<uint64_t>(first_index) << 32) | static_cast<uint64_t>(last_index);
+    }
+
+    // the entry must not be modified, it is shared with the cache & with the registrations it was set on:
+    bool Get(uint64_t key, Entry& entry);
+    void Add(uint64_t key, const Entry& entry);
+    void Clear(void);
+
+    const Stats& GetStats(void) const { return stats_; }
+
+  private:
+    struct Node {
+      Entry entry;
+      size_t size_in_bytes;
+      std::list<uint64_t>::iterator lru_it;
+    };
+
+    void Evict(void);
+
+  private:
+    size_t max_size_in_bytes_;
+
+    // most recently used first:
+    std::list<uint64_t> lru_;
+    std::unordered_map<uint64_t, Node> nodes_;
+
+    Stats stats_;
+};
+}
+
+#endif
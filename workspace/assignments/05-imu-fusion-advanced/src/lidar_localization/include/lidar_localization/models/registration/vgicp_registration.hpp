@@ -0,0 +1,136 @@
+/*
+ * @Description: voxelized GICP registration with cached per-frame target voxels
+ * @Author: Ge Yao
+ * @Date: 2020-12-03 21:46:57
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_REGISTRATION_VGICP_REGISTRATION_HPP_
+#define LIDAR_LOCALIZATION_MODELS_REGISTRATION_VGICP_REGISTRATION_HPP_
+
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <unordered_map>
+
+#include <pcl/kdtree/kdtree_flann.h>
+
+#include "lidar_localization/models/registration/registration_interface.hpp"
+
+namespace lidar_localization {
+class VGICPRegistration: public RegistrationInterface {
+  public:
+    VGICPRegistration(const YAML::Node& node);
+    VGICPRegistration(
+      float res, int num_neighbors, float trans_eps, int max_iter,
+      int num_threads = 0
+    );
+
+    bool SetInputTarget(const CloudData::CLOUD_PTR& input_target) override;
+    bool ScanMatch(const CloudData::CLOUD_PTR& input_source,
+                   const Eigen::Matrix4f& predict_pose,
+                   CloudData::CLOUD_PTR& result_cloud_ptr,
+                   Eigen::Matrix4f& result_pose) override;
+    float GetFitnessScore() override;
+    bool SetMaxIterationLimit(int max_iteration_limit) override;
+    int GetNumIterations() override;
+    // from the linear system of the last iteration, i.e., before its final step:
+    Result GetResult() override;
+
+    // incremental target, frame clouds are in map frame:
+    bool HasIncrementalTarget() const override { return true; }
+    bool AddTargetFrame(int frame_id, const CloudData::CLOUD_PTR& frame_cloud) override;
+    bool RemoveTargetFrame(int frame_id) override;
+
+    // point-to-plane residuals to the least-variance plane of the target voxel, source covariances are not needed:
+    bool HasLinearization() const override { return true; }
+    int Linearize(
+      const CloudData::CLOUD_PTR& input_source,
+      const Eigen::Matrix4d& pose,
+      Eigen::Matrix<double, 6, 6>& H,
+      Eigen::Matrix<double, 6, 1>& b
+    ) override;
+
+  private:
+    using Vector6d = Eigen::Matrix<double, 6, 1>;
+    using Matrix6d = Eigen::Matrix<double, 6, 6>;
+
+    // additive point statistics, so that frames can be merged into and removed from a voxel:
+    struct VoxelStats {
+      void Add(const VoxelStats &other);
+      void Subtract(const VoxelStats &other);
+
+      int num_points = 0;
+      Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+      Eigen::Matrix3d sum_sq = Eigen::Matrix3d::Zero();
+    };
+    using VoxelStatsMap = std::unordered_map<int64_t, VoxelStats>;
+
+    struct Voxel {
+      Eigen::Vector3d mean = Eigen::Vector3d::Zero();
+      Eigen::Matrix3d cov = Eigen::Matrix3d::Identity();
+      // least-variance direction, for the point-to-plane fitness score:
+      Eigen::Vector3d normal = Eigen::Vector3d::UnitZ();
+    };
+
+    struct TargetFrame {
+      CloudData::CLOUD_PTR cloud;
+      VoxelStatsMap stats;
+    };
+
+    struct LinearSystem {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      void Reset(void);
+
+      double error = 0.0;
+      int num_corr = 0;
+      // squared distance to the plane of the target voxel:
+      double sum_sq_dis = 0.0;
+      Vector6d b = Vector6d::Zero();
+      Matrix6d H = Matrix6d::Zero();
+    };
+
+    bool SetRegistrationParam(
+      float res, int num_neighbors, float trans_eps, int max_iter,
+      int num_threads
+    );
+
+    Eigen::Vector3i GetVoxelIndex(const Eigen::Vector3f &point) const;
+    static int64_t GetVoxelKey(const Eigen::Vector3i &index);
+    void GetVoxelStats(const CloudData::CLOUD_PTR& cloud, VoxelStatsMap &stats) const;
+    void UpdateTargetVoxel(int64_t key);
+
+    void ComputeSourceCovariances(void);
+    void BuildLinearSystem(const Eigen::Matrix4d &pose, LinearSystem &system);
+    void BuildPlaneLinearSystem(const Eigen::Matrix4d &pose, LinearSystem &system);
+    static Eigen::Matrix4d UpdatePose(const Eigen::Matrix4d &pose, const Vector6d &delta);
+
+  private:
+    float res_;
+    int num_neighbors_;
+    float trans_eps_;
+    int max_iter_;
+    int max_iteration_limit_ = -1;
+    int num_threads_;
+
+    // target frames and the merged target voxels:
+    std::map<int, TargetFrame> target_frames_;
+    VoxelStatsMap target_stats_;
+    std::unordered_map<int64_t, Voxel> target_voxels_;
+
+    CloudData::CLOUD_PTR input_source_;
+    pcl::KdTreeFLANN<CloudData::POINT>::Ptr input_source_kdtree_;
+    std::vector<Eigen::Matrix3d> source_covs_;
+    Eigen::Matrix4f final_transformation_ = Eigen::Matrix4f::Identity();
+    int num_iterations_ = 0;
+    Result result_;
+
+    // only built when fitness score is queried:
+    bool has_target_kdtree_ = false;
+    CloudData::CLOUD_PTR input_target_;
+    pcl::KdTreeFLANN<CloudData::POINT>::Ptr input_target_kdtree_;
+
+    std::vector<LinearSystem, Eigen::aligned_allocator<LinearSystem>> thread_systems_;
+};
+}
+
+#endif
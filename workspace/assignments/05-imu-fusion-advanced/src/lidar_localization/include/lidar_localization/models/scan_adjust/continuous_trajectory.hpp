@@ -0,0 +1,77 @@
+/*
+ * @Description: continuous-time lidar trajectory over a short time span, cumulative cubic B-spline of
+ *               poses integrated from raw IMU, for sub-sweep pose queries of deskew & sweep sync
+ * @Author: Ge Yao
+ * @Date: 2021-01-28 10:12:46
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_SCAN_ADJUST_CONTINUOUS_TRAJECTORY_HPP_
+#define LIDAR_LOCALIZATION_MODELS_SCAN_ADJUST_CONTINUOUS_TRAJECTORY_HPP_
+
+#include <deque>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "lidar_localization/sensor_data/imu_data.hpp"
+
+namespace lidar_localization {
+// control poses are placed every knot_interval: orientation integrated from the gyro at the midpoint
+// angular rate, position from the lidar velocity, held constant in body frame.
+// orientation & position are separate uniform cubic B-splines, cumulative on SO3:
+//   R(t) = R_{k-1} * Exp(b_1(u) * d_{k-1}) * Exp(b_2(u) * d_k) * Exp(b_3(u) * d_{k+1}), d_k = Log(R_k^T * R_{k+1})
+// with u = (t - t_k) / knot_interval. the deltas d_k are cached by Build, so a query is O(1) and three Exp.
+// poses are of lidar frame at t in lidar frame at reference time, i.e. p_reference = R(t) * p_t + T(t).
+class ContinuousTrajectory {
+  public:
+    ContinuousTrajectory(double knot_interval = 0.005) : knot_interval_(knot_interval) {}
+
+    /**
+     * @brief  build the trajectory over [begin_time, end_time]
+     * @param  imu_data_buff, raw IMU measurements, in time order
+     * @param  imu_to_lidar_rotation, rotation of IMU frame in lidar frame
+     * @param  velocity, lidar velocity in lidar frame
+     * @param  reference_time, time of the identity pose
+     * @return false if the IMU measurements don't cover the time span
+     */
+    bool Build(
+        const std::deque<IMUData>& imu_data_buff,
+        const Eigen::Matrix3f& imu_to_lidar_rotation, const Eigen::Vector3f& velocity,
+        double reference_time, double begin_time, double end_time
+    );
+
+    bool IsValid(void) const { return rotations_.size() >= 4; }
+
+    // times out of the built span are clamped to it:
+    void GetPose(double time, Eigen::Matrix3f& rotation, Eigen::Vector3f& translation) const;
+    void GetPoses(
+        const std::vector<double>& times,
+        std::vector<Eigen::Matrix3f>& rotations, std::vector<Eigen::Vector3f>& translations
+    ) const;
+
+  private:
+    // linear interpolation between the measurements around time, held constant outside the buffer:
+    static Eigen::Vector3f GetAngularRate(const std::deque<IMUData>& imu_data_buff, double time);
+    static Eigen::Matrix3f Exp(const Eigen::Vector3f& delta_angle);
+    static Eigen::Vector3f Log(const Eigen::Matrix3f& rotation);
+
+    // pose in the frame of the first control pose:
+    void Evaluate(double time, Eigen::Matrix3f& rotation, Eigen::Vector3f& translation) const;
+
+  private:
+    double knot_interval_;
+
+    // time of the first control pose:
+    double begin_time_ = 0.0;
+    std::vector<Eigen::Matrix3f> rotations_;
+    std::vector<Eigen::Vector3f> positions_;
+    // Log(R_k^T * R_{k+1}) & p_{k+1} - p_k:
+    std::vector<Eigen::Vector3f> delta_angles_;
+    std::vector<Eigen::Vector3f> delta_positions_;
+
+    // inverse of the pose at reference time:
+    Eigen::Matrix3f reference_rotation_inverse_ = Eigen::Matrix3f::Identity();
+    Eigen::Vector3f reference_position_ = Eigen::Vector3f::Zero();
+};
+} // namespace lidar_localization
+
+#endif
@@ -7,11 +7,16 @@
 #ifndef LIDAR_LOCALIZATION_MODELS_SCAN_ADJUST_DISTORTION_ADJUST_HPP_
 #define LIDAR_LOCALIZATION_MODELS_SCAN_ADJUST_DISTORTION_ADJUST_HPP_
 
+#include <deque>
+#include <vector>
+#include <cstdint>
+
 #include <pcl/common/transforms.h>
 #include <Eigen/Dense>
 #include "glog/logging.h"
 
-#include "lidar_localization/models/scan_adjust/distortion_adjust.hpp"
+#include "lidar_localization/models/scan_adjust/continuous_trajectory.hpp"
+#include "lidar_localization/sensor_data/imu_data.hpp"
 #include "lidar_localization/sensor_data/velocity_data.hpp"
 #include "lidar_localization/sensor_data/cloud_data.hpp"
 
@@ -19,15 +24,57 @@ namespace lidar_localization {
 class DistortionAdjust {
   public:
     void SetMotionInfo(float scan_period, VelocityData velocity_data);
+    // raw IMU measurements, for the rotation within a sweep:
+    void SetLidarToIMU(const Eigen::Matrix4f& lidar_to_imu);
+    void AddIMUData(const IMUData& imu_data);
+    // snapshot of the raw IMU buffer, for deskew by another instance, e.g. on a worker thread:
+    const std::deque<IMUData>& GetIMUData(void) const { return imu_data_buff_; }
+    void SetIMUData(const std::deque<IMUData>& imu_data_buff) { imu_data_buff_ = imu_data_buff; }
+
+    // constant velocity, point time recovered from azimuth:
     bool AdjustCloud(CloudData::CLOUD_PTR& input_cloud_ptr, CloudData::CLOUD_PTR& output_cloud_ptr);
+    // motion from the IMU trajectory when it covers the sweep,
+    // point time from cloud_data.point_times_ptr when available, from azimuth otherwise:
+    bool AdjustCloud(CloudData& cloud_data);
+    // same, with all points moved to reference_time instead, e.g. the sweep time of another lidar:
+    bool AdjustCloud(CloudData& cloud_data, double reference_time);
 
   private:
+    bool AdjustCloudByAzimuth(
+        CloudData::CLOUD_PTR& input_cloud_ptr, CloudData::CLOUD_PTR& output_cloud_ptr,
+        bool use_imu, double scan_time
+    );
+    bool AdjustCloudByPointTimes(CloudData& cloud_data);
+
+    // poses of the table knots at scan time, in lidar frame:
+    bool BuildIMUTable(double scan_time, float begin_time, float end_time);
+    void BuildConstantTable(float begin_time, float end_time);
+
     inline Eigen::Matrix3f UpdateMatrix(float real_time);
+    // max. error about 1e-4 rad, far below the azimuth resolution of the lidar:
+    static inline float FastAtan2(float y, float x);
 
   private:
+    // num. of poses precomputed per sweep, interpolated linearly in between:
+    static const int NUM_ROTATION_BUCKETS = 360;
+
     float scan_period_;
     Eigen::Vector3f velocity_;
     Eigen::Vector3f angular_rate_;
+
+    bool has_lidar_to_imu_ = false;
+    Eigen::Matrix3f imu_to_lidar_rotation_ = Eigen::Matrix3f::Identity();
+    // raw IMU measurements of about the last two sweeps:
+    std::deque<IMUData> imu_data_buff_;
+
+    // spline of the motion within a sweep, rebuilt for each:
+    ContinuousTrajectory trajectory_;
+
+    // reused across sweeps:
+    std::vector<double> knot_times_;
+    std::vector<Eigen::Matrix3f> rotation_table_;
+    std::vector<Eigen::Vector3f> translation_table_;
+    std::vector<uint8_t> is_kept_;
 };
 } // namespace lidar_slam
 #endif
\ No newline at end of file
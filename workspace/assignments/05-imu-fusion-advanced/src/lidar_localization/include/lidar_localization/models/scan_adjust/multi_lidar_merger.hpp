@@ -0,0 +1,78 @@
+/*
+ * @Description: deskew the sweeps of several lidars to a common time and merge them, under a per-sensor point budget
+ * @Author: Ge Yao
+ * @Date: 2020-12-30 10:21:46
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_SCAN_ADJUST_MULTI_LIDAR_MERGER_HPP_
+#define LIDAR_LOCALIZATION_MODELS_SCAN_ADJUST_MULTI_LIDAR_MERGER_HPP_
+
+#include <deque>
+#include <vector>
+#include <memory>
+
+#include <yaml-cpp/yaml.h>
+#include <Eigen/Dense>
+
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/sensor_data/imu_data.hpp"
+#include "lidar_localization/sensor_data/velocity_data.hpp"
+#include "lidar_localization/models/scan_adjust/distortion_adjust.hpp"
+#include "lidar_localization/models/cloud_filter/voxel_filter_fast.hpp"
+
+namespace lidar_localization {
+// sensor 0 is the primary lidar: the merged cloud is in its frame, at its sweep time.
+// each sensor is deskewed with its own extrinsic on its own thread, then voxel filtered and, when still over
+// its budget, uniformly subsampled, so the merged cloud never exceeds the sum of the budgets
+class MultiLidarMerger {
+  public:
+    // node has primary_lidar and secondary_lidars[], each with leaf_size & max_points:
+    MultiLidarMerger(const YAML::Node& node);
+
+    int GetNumSensors(void) const { return static_cast<int>(sensors_.size()); }
+
+    // lidar pose in IMU frame, as DistortionAdjust::SetLidarToIMU:
+    void SetLidarToIMU(int sensor_index, const Eigen::Matrix4f& lidar_to_imu);
+    // raw IMU for the rotation within the sweeps, see DistortionAdjust::GetIMUData:
+    void SetIMUData(const std::deque<IMUData>& imu_data_buff);
+
+    /**
+     * @brief  deskew and merge the sweeps
+     * @param  scan_period, sweep duration
+     * @param  velocity_data, primary lidar velocity in its frame
+     * @param  cloud_data, primary lidar sweep, replaced by the merged one
+     * @param  secondary_cloud_data, sweeps of sensor 1 on, an empty cloud for a missing sweep
+     * @return true if success otherwise false
+     */
+    bool Merge(
+        float scan_period, const VelocityData& velocity_data,
+        CloudData& cloud_data, const std::vector<CloudData>& secondary_cloud_data
+    );
+
+  private:
+    struct Sensor {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      // lidar pose in IMU & primary lidar frame:
+      Eigen::Matrix4f lidar_to_imu = Eigen::Matrix4f::Identity();
+      Eigen::Matrix4f lidar_to_primary = Eigen::Matrix4f::Identity();
+
+      DistortionAdjust distortion_adjust;
+      // null when leaf size is 0:
+      std::shared_ptr<FastVoxelFilter> voxel_filter_ptr;
+      // 0 for no limit:
+      size_t max_points = 0;
+
+      CloudData cloud_data;
+    };
+
+    void AddSensor(const YAML::Node& node);
+    // deskew, filter & move the sweep into primary lidar frame, in sensor.cloud_data:
+    bool AdjustCloud(Sensor& sensor, float scan_period, const VelocityData& velocity_data, double reference_time);
+    static void ApplyBudget(size_t max_points, CloudData::CLOUD& cloud);
+
+  private:
+    std::vector<Sensor, Eigen::aligned_allocator<Sensor>> sensors_;
+};
+} // namespace lidar_localization
+
+#endif
@@ -0,0 +1,33 @@
+/*
+ * @Description: device side of ScanContextDistance, min-shift distances of source-target blocks
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 19:36:08
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_SCAN_CONTEXT_MANAGER_CUDA_SCAN_CONTEXT_DISTANCE_KERNELS_HPP_
+#define LIDAR_LOCALIZATION_MODELS_SCAN_CONTEXT_MANAGER_CUDA_SCAN_CONTEXT_DISTANCE_KERNELS_HPP_
+
+#include <memory>
+
+namespace lidar_localization {
+// no CUDA types in this header, so that it is included from host-only translation units.
+// descriptors come normalized by ScanContextDistance, targets with their columns stored twice.
+// all calls are synchronous on the default stream.
+class ScanContextDistanceKernels {
+  public:
+    ScanContextDistanceKernels(int num_rings, int num_sectors);
+    ~ScanContextDistanceKernels();
+
+    static bool IsDeviceAvailable(void);
+
+    // keep the targets on the device, false on CUDA errors:
+    bool SetTargets(const float* data, const float* is_valid, int num_targets);
+    // min-shift distances & shifts, row-major num_sources x num_targets on the host:
+    bool GetRows(const float* data, const float* is_valid, int num_sources, float* distances, int* shifts);
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+} // namespace lidar_localization
+
+#endif
@@ -114,4 +114,100 @@ struct KDTreeVectorOfVectorsAdaptor
 
 	/** @} */
 
-}; // end of KDTreeVectorOfVectorsAdaptor
\ No newline at end of file
+}; // end of KDTreeVectorOfVectorsAdaptor
+
+/** A vector-of-vectors adaptor for the dynamic nanoflann index, without duplicating the storage.
+  *  Points appended to the container are indexed with addPoints(), the index keeps a forest of
+  *  power-of-two sized static trees so that the amortized insertion cost is O(log N).
+  *
+  *  \tparam DIM If set to >0, it specifies a compile-time fixed dimensionality for the points in the data set, allowing more compiler optimizations.
+  *  \tparam num_t The type of the point coordinates (typically, double or float).
+  *  \tparam Distance The distance metric to use: nanoflann::metric_L1, nanoflann::metric_L2, nanoflann::metric_L2_Simple, etc.
+  *  \tparam IndexType The type for indices in the KD-tree index (typically, size_t of int)
+  */
+template <class VectorOfVectorsType, typename num_t = double, int DIM = -1, class Distance = nanoflann::metric_L2, typename IndexType = size_t>
+struct KDTreeVectorOfVectorsDynamicAdaptor
+{
+	typedef KDTreeVectorOfVectorsDynamicAdaptor<VectorOfVectorsType,num_t,DIM,Distance> self_t;
+	typedef typename Distance::template traits<num_t,self_t>::distance_t metric_t;
+	typedef nanoflann::KDTreeSingleIndexDynamicAdaptor< metric_t,self_t,DIM,IndexType>  index_t;
+
+	index_t* index; //! The dynamic kd-tree index for the user to call its methods as usual.
+
+	/// Constructor: takes a const ref to the vector of vectors object with the data points, points already in it are indexed
+	KDTreeVectorOfVectorsDynamicAdaptor(const size_t dimensionality, const VectorOfVectorsType &mat, const int leaf_max_size = 10) : m_data(mat), m_num_indexed(mat.size())
+	{
+		index = new index_t( static_cast<int>(dimensionality), *this /* adaptor */, nanoflann::KDTreeSingleIndexAdaptorParams(leaf_max_size ) );
+	}
+
+	/// Constructor: takes a const ref to the vector of vectors object with the data points, the index of all of them is loaded from stream
+	KDTreeVectorOfVectorsDynamicAdaptor(const size_t dimensionality, const VectorOfVectorsType &mat, FILE *stream, const int leaf_max_size = 10) : m_data(mat), m_num_indexed(0)
+	{
+		index = new index_t( static_cast<int>(dimensionality), *this /* adaptor */, nanoflann::KDTreeSingleIndexAdaptorParams(leaf_max_size ) );
+		try {
+			index->loadIndex(stream);
+		} catch (...) {
+			delete index;
+			throw;
+		}
+		m_num_indexed = mat.size();
+	}
+
+	~KDTreeVectorOfVectorsDynamicAdaptor() {
+		delete index;
+	}
+
+	const VectorOfVectorsType &m_data;
+
+	/** Index all the points appended to the container since the last call */
+	inline void addPoints()
+	{
+		if (m_num_indexed < m_data.size()) {
+			index->addPoints(m_num_indexed, m_data.size() - 1);
+			m_num_indexed = m_data.size();
+		}
+	}
+
+	/** Query for the \a num_closest closest points to a given point (entered as query_point[0:dim-1]).
+	  *  Returns the number of neighbors found, which is less than \a num_closest for small indices.
+	  */
+	inline size_t query(const num_t *query_point, const size_t num_closest, IndexType *out_indices, num_t *out_distances_sq) const
+	{
+		nanoflann::KNNResultSet<num_t,IndexType> resultSet(num_closest);
+		resultSet.init(out_indices, out_distances_sq);
+		index->findNeighbors(resultSet, query_point, nanoflann::SearchParams());
+		return resultSet.size();
+	}
+
+	/** @name Interface expected by KDTreeSingleIndexDynamicAdaptor
+	  * @{ */
+
+	const self_t & derived() const {
+		return *this;
+	}
+	self_t & derived()       {
+		return *this;
+	}
+
+	// Must return the number of indexed data points
+	inline size_t kdtree_get_point_count() const {
+		return m_num_indexed;
+	}
+
+	// Returns the dim'th component of the idx'th point in the class:
+	inline num_t kdtree_get_pt(const size_t idx, const size_t dim) const {
+		return m_data[idx][dim];
+	}
+
+	// Optional bounding-box computation: return false to default to a standard bbox computation loop.
+	template <class BBOX>
+	bool kdtree_get_bbox(BBOX & /*bb*/) const {
+		return false;
+	}
+
+	/** @} */
+
+private:
+	size_t m_num_indexed;
+
+}; // end of KDTreeVectorOfVectorsDynamicAdaptor
@@ -1069,6 +1069,7 @@ public:
     load_value(stream, obj.m_leaf_max_size);
     load_value(stream, obj.vind);
     load_tree(obj, stream, obj.root_node);
+    obj.m_size_at_index_build = obj.m_size;
   }
 };
 
@@ -1909,6 +1910,41 @@ public:
     treeIndex[idx] = -1;
   }
 
+  /**  Stores the forest in a binary file, empty trees are only marked.
+   *   IMPORTANT NOTE: The set of data points is NOT stored in the file, see
+   * saveIndex of KDTreeSingleIndexAdaptor \sa loadIndex  */
+  void saveIndex(FILE *stream) {
+    save_value(stream, treeCount);
+    save_value(stream, pointCount);
+    save_value(stream, treeIndex);
+    for (size_t i = 0; i < treeCount; i++) {
+      const size_t treeSize = index[i].vind.size();
+      save_value(stream, treeSize);
+      if (treeSize > 0)
+        index[i].saveIndex(stream);
+    }
+  }
+
+  /**  Loads a forest stored by saveIndex, replaces the points indexed so far.
+   *   IMPORTANT NOTE: The index object must be constructed associated to the
+   * same source of data points used while building the index, with no points
+   * indexed yet \sa saveIndex  */
+  void loadIndex(FILE *stream) {
+    size_t treeCount_ = 0;
+    load_value(stream, treeCount_);
+    if (treeCount_ != treeCount) {
+      throw std::runtime_error("Mismatched number of trees in file");
+    }
+    load_value(stream, pointCount);
+    load_value(stream, treeIndex);
+    for (size_t i = 0; i < treeCount; i++) {
+      size_t treeSize = 0;
+      load_value(stream, treeSize);
+      if (treeSize > 0)
+        index[i].loadIndex(stream);
+    }
+  }
+
   /**
    * Find set of nearest neighbors to vec[0:dim-1]. Their indices are stored
    * inside the result object.
@@ -0,0 +1,89 @@
+/*
+ * @Description: approx. nearest neighbor index of ring keys, as a hierarchical navigable small world graph
+ * @Author: Ge Yao
+ * @Date: 2021-01-08 21:03:52
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_SCAN_CONTEXT_MANAGER_RING_KEY_GRAPH_INDEX_HPP_
+#define LIDAR_LOCALIZATION_MODELS_SCAN_CONTEXT_MANAGER_RING_KEY_GRAPH_INDEX_HPP_
+
+#include <cstdio>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace lidar_localization {
+// the kd-tree degrades toward a linear scan for ring keys of 20 dims, the graph is searched in about
+// O(log N) distances at any size, at a recall set by ef_search. like RingKeyDynamicIndex, it refers to
+// the ring keys of the caller without a copy, and the ring keys appended to them are inserted by AddPoints.
+// queries can run concurrently, insertions cannot:
+class RingKeyGraphIndex {
+  public:
+    typedef std::vector<std::vector<float>> RingKeys;
+
+    struct Params {
+      // max. num. of neighbors per node on the upper layers, twice on the bottom one:
+      int max_degree = 16;
+      // candidates kept while inserting, higher for better graphs at slower insertions:
+      int ef_construction = 100;
+      // candidates kept while searching, higher for better recall at slower queries:
+      int ef_search = 64;
+    };
+
+    // the ring keys already in it are inserted:
+    RingKeyGraphIndex(int dim, const RingKeys &ring_keys, const Params &params);
+    // the graph of all of them is loaded from stream, throws std::runtime_error if it does not match:
+    RingKeyGraphIndex(int dim, const RingKeys &ring_keys, const Params &params, FILE *stream);
+
+    // insert all the ring keys appended since the last call:
+    void AddPoints(void);
+    size_t GetSize(void) const { return levels_.size(); }
+    // approx. heap bytes held by the graph, the ring keys are not counted:
+    size_t GetMemoryUsage(void) const;
+
+    // up to N approx. nearest ring keys by squared L2 distance, nearest first. returns the num. found:
+    size_t Query(const float *query, size_t N, size_t *indices, float *distances_sq) const;
+
+    // ef_search is not saved, it is taken from the params of the loading instance:
+    bool Save(FILE *stream) const;
+
+  private:
+    typedef std::pair<float, uint32_t> Candidate;
+
+    float GetDistance(const float *query, uint32_t id) const;
+    int GetRandomLevel(void);
+
+    int GetMaxDegree(int level) const { return (0 == level ? 2 : 1) * params_.max_degree; }
+    // neighbor count followed by GetMaxDegree(level) slots:
+    uint32_t *GetLinks(uint32_t id, int level);
+    const uint32_t *GetLinks(uint32_t id, int level) const;
+
+    // the nearest node on the layer, greedily from entry:
+    uint32_t SearchGreedy(const float *query, uint32_t entry, int level) const;
+    // the ef nearest nodes on the layer from entry, nearest first:
+    void SearchLayer(const float *query, uint32_t entry, int level, int ef, std::vector<Candidate> &nearest) const;
+    // keep up to M of the candidates, sorted nearest first, that are closer to the query than to any one kept:
+    void SelectNeighbors(std::vector<Candidate> &candidates, int M) const;
+    void Insert(uint32_t id);
+
+  private:
+    int dim_;
+    const RingKeys &ring_keys_;
+    Params params_;
+
+    // level of each node:
+    std::vector<int> levels_;
+    // bottom layer links of all nodes, 2 * max_degree + 1 per node:
+    std::vector<uint32_t> bottom_links_;
+    // upper layer links of each node above the bottom one, max_degree + 1 per layer:
+    std::vector<std::vector<uint32_t>> upper_links_;
+
+    uint32_t entry_point_ = 0;
+    int max_level_ = -1;
+
+    // fixed seed, so the same ring keys give the same graph:
+    std::mt19937 random_engine_{42};
+};
+} // namespace lidar_localization
+
+#endif
@@ -0,0 +1,165 @@
+/*
+ * @Description: contiguous storage for scan context descriptors
+ * @Author: Ge Yao
+ * @Date: 2020-12-10 20:26:37
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_SCAN_CONTEXT_MANAGER_SCAN_CONTEXT_BUFFER_HPP_
+#define LIDAR_LOCALIZATION_MODELS_SCAN_CONTEXT_MANAGER_SCAN_CONTEXT_BUFFER_HPP_
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include <Eigen/Core>
+
+namespace lidar_localization {
+// all scan contexts are kept column-major, back to back in one block.
+// views returned by Add are invalidated by the next Add.
+// quantized, each scan context is kept as int8 codes of its own scale, max. abs. height / 127,
+// which is 4x smaller. its float values are only available as a copy, by GetData with a buffer:
+class ScanContextBuffer {
+  public:
+    typedef Eigen::Map<Eigen::MatrixXf> View;
+    typedef Eigen::Map<const Eigen::MatrixXf> ConstView;
+
+    static const int MAX_CODE = 127;
+
+    void Reset(int num_rings, int num_sectors, bool is_quantized = false) {
+        num_rings_ = num_rings;
+        num_sectors_ = num_sectors;
+        is_quantized_ = is_quantized;
+        Clear();
+    }
+    void Clear(void) {
+        data_.clear();
+        codes_.clear();
+        scales_.clear();
+    }
+
+    int GetNumRings(void) const { return num_rings_; }
+    int GetNumSectors(void) const { return num_sectors_; }
+    bool IsQuantized(void) const { return is_quantized_; }
+    size_t GetSize(void) const {
+        if (is_quantized_) {
+            return scales_.size();
+        }
+        return (0 == GetStride() ? 0 : data_.size() / GetStride());
+    }
+
+    // append one zero-initialized scan context, not quantized only:
+    View Add(void) {
+        data_.resize(data_.size() + GetStride(), 0.0f);
+        return View(&data_.at(data_.size() - GetStride()), num_rings_, num_sectors_);
+    }
+    // append a copy of one scan context:
+    void Add(const float *scan_context) {
+        SetSize(GetSize() + 1);
+        Set(GetSize() - 1, scan_context);
+    }
+
+    // replace the content with num scan contexts stored back to back, in one copy if not quantized:
+    void Assign(const float *data, size_t num) {
+        if (!is_quantized_) {
+            data_.assign(data, data + num * GetStride());
+            return;
+        }
+
+        Resize(num);
+        for (size_t i = 0; i < num; ++i) {
+            Set(i, data + i * GetStride());
+        }
+    }
+    // replace the content with num quantized scan contexts stored back to back, quantized only:
+    void Assign(const int8_t *codes, const float *scales, size_t num) {
+        codes_.assign(codes, codes + num * GetStride());
+        scales_.assign(scales, scales + num);
+    }
+
+    // replace the content with num zero-initialized scan contexts, e.g. to be filled in parallel by Set:
+    void Resize(size_t num) {
+        Clear();
+        SetSize(num);
+    }
+    // overwrite scan context i, distinct ones can be set concurrently:
+    void Set(size_t i, const float *scan_context) {
+        if (!is_quantized_) {
+            std::copy(scan_context, scan_context + GetStride(), GetData(i));
+            return;
+        }
+
+        float max_abs = 0.0f;
+        for (size_t j = 0; j < GetStride(); ++j) {
+            max_abs = std::max(max_abs, std::fabs(scan_context[j]));
+        }
+
+        const float scale = max_abs / MAX_CODE;
+        const float inv_scale = (0.0f == scale ? 0.0f : 1.0f / scale);
+        int8_t *codes = &codes_.at(i * GetStride());
+        for (size_t j = 0; j < GetStride(); ++j) {
+            codes[j] = static_cast<int8_t>(std::lround(inv_scale * scan_context[j]));
+        }
+        scales_.at(i) = scale;
+    }
+
+    // in place, not quantized only:
+    float *GetData(size_t i) { return &data_.at(i * GetStride()); }
+    const float *GetData(size_t i) const { return &data_.at(i * GetStride()); }
+    ConstView Get(size_t i) const { return ConstView(GetData(i), num_rings_, num_sectors_); }
+    ConstView GetLatest(void) const { return Get(GetSize() - 1); }
+    // num scan contexts from i, back to back. in place if not quantized, otherwise dequantized to buffer:
+    const float *GetData(size_t i, size_t num, std::vector<float> &buffer) const {
+        if (!is_quantized_) {
+            return GetData(i);
+        }
+
+        buffer.resize(num * GetStride());
+        for (size_t k = 0; k < num; ++k) {
+            const int8_t *codes = GetCodes(i + k);
+            const float scale = GetScale(i + k);
+            float *scan_context = &buffer.at(k * GetStride());
+            for (size_t j = 0; j < GetStride(); ++j) {
+                scan_context[j] = scale * codes[j];
+            }
+        }
+
+        return buffer.data();
+    }
+
+    // approx. heap bytes held:
+    size_t GetMemoryUsage(void) const {
+        return (
+            data_.capacity() * sizeof(float) + 
+            codes_.capacity() * sizeof(int8_t) + 
+            scales_.capacity() * sizeof(float)
+        );
+    }
+
+    // quantized only:
+    const int8_t *GetCodes(size_t i) const { return &codes_.at(i * GetStride()); }
+    float GetScale(size_t i) const { return scales_.at(i); }
+
+  private:
+    size_t GetStride(void) const { return static_cast<size_t>(num_rings_) * num_sectors_; }
+
+    void SetSize(size_t num) {
+        if (is_quantized_) {
+            codes_.resize(num * GetStride(), 0);
+            scales_.resize(num, 0.0f);
+        } else {
+            data_.resize(num * GetStride(), 0.0f);
+        }
+    }
+
+  private:
+    int num_rings_ = 0;
+    int num_sectors_ = 0;
+    bool is_quantized_ = false;
+
+    std::vector<float> data_;
+    std::vector<int8_t> codes_;
+    std::vector<float> scales_;
+};
+}
+
+#endif
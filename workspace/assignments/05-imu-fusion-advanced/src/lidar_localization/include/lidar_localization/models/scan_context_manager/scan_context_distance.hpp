@@ -0,0 +1,97 @@
+/*
+ * @Description: batched min-shift scan context distances for all-pairs searches
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 19:12:46
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_SCAN_CONTEXT_MANAGER_SCAN_CONTEXT_DISTANCE_HPP_
+#define LIDAR_LOCALIZATION_MODELS_SCAN_CONTEXT_MANAGER_SCAN_CONTEXT_DISTANCE_HPP_
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <functional>
+
+namespace lidar_localization {
+class ScanContextDistanceKernels;
+
+// cosine distance of scan context pairs at their best circular shift. all shifts are tried instead of
+// the sector key alignment of ScanContextManager, so a pair is never farther than when scored there.
+// descriptors are column-major num_rings x num_sectors, back to back as in ScanContextBuffer.
+// targets are normalized once and the sources are compared with all of them, in blocks of sources on
+// the task scheduler with AVX-512 / AVX2 kernels picked at runtime, or on the device when built with CUDA
+class ScanContextDistance {
+  public:
+    struct Match {
+      int target_id;
+      // right shift of the target, in sectors:
+      int shift;
+      float distance;
+    };
+
+    // false for pairs not to be kept:
+    typedef std::function<bool(int source_id, int target_id)> PairFilter;
+
+    // use_cuda falls back to the CPU without CUDA or a device:
+    ScanContextDistance(int num_rings, int num_sectors, bool use_cuda);
+    ~ScanContextDistance();
+
+    int GetNumRings(void) const { return num_rings_; }
+    int GetNumSectors(void) const { return num_sectors_; }
+
+    bool SetTargets(const float *scan_contexts, int num_targets);
+    int GetNumTargets(void) const { return num_targets_; }
+
+    /**
+     * @brief  distances & shifts of all pairs, row-major num_sources x num_targets, for small sets
+     * @param  scan_contexts, source descriptors
+     * @param  num_sources, num. of source descriptors
+     * @return true for success otherwise false
+     */
+    bool GetDistances(
+        const float *scan_contexts, int num_sources,
+        std::vector<float> &distances, std::vector<int> &shifts
+    );
+    /**
+     * @brief  up to N nearest targets of each source, the full distance matrix is never kept
+     * @param  scan_contexts, source descriptors
+     * @param  num_sources, num. of source descriptors
+     * @param  N, max. num. of matches per source
+     * @param  max_distance, matches at or beyond it are dropped
+     * @param  is_pair, pairs failing it are dropped, all are kept if empty
+     * @param  matches, for each source, best first
+     * @return true for success otherwise false
+     */
+    bool GetNearest(
+        const float *scan_contexts, int num_sources,
+        int N, float max_distance, const PairFilter &is_pair,
+        std::vector<std::vector<Match>> &matches
+    );
+
+  private:
+    // unit-norm columns & their valid flags, columns stored twice for targets as in ScanContextManager:
+    void Normalize(const float *scan_context, bool is_target, float *data, float *is_valid, uint64_t &valid_mask) const;
+    // min-shift distances of the sources [source_begin, source_end) to all targets, rows of num_targets_:
+    bool GetRows(
+        const float *scan_contexts, int source_begin, int source_end,
+        float *distances, int *shifts
+    );
+    void GetRowsOnCPU(
+        const float *scan_contexts, int source_begin, int source_end,
+        float *distances, int *shifts
+    );
+
+  private:
+    int num_rings_;
+    int num_sectors_;
+
+    int num_targets_ = 0;
+    std::vector<float> target_data_;
+    std::vector<float> target_is_valid_;
+    // valid columns as bits, for num_sectors_ up to 64:
+    std::vector<uint64_t> target_valid_masks_;
+
+    std::unique_ptr<ScanContextDistanceKernels> kernels_;
+};
+} // namespace lidar_localization
+
+#endif
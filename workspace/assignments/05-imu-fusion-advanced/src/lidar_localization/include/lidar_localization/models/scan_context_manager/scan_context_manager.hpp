@@ -9,7 +9,11 @@
 
 #include <yaml-cpp/yaml.h>
 
+#include <string>
 #include <vector>
+#include <complex>
+#include <cstdint>
+#include <functional>
 
 #include <Eigen/Core>
 #include <Eigen/Dense>
@@ -18,6 +22,9 @@
 #include "lidar_localization/sensor_data/key_frame.hpp"
 
 #include "lidar_localization/models/scan_context_manager/kdtree_vector_of_vectors_adaptor.hpp"
+#include "lidar_localization/models/scan_context_manager/ring_key_graph_index.hpp"
+#include "lidar_localization/models/scan_context_manager/scan_context_buffer.hpp"
+#include "lidar_localization/models/scan_context_manager/scan_context_distance.hpp"
 
 namespace lidar_localization {
 
@@ -27,8 +34,56 @@ public:
     typedef std::vector<float> RingKey;
     typedef std::vector<RingKey> RingKeys;
     typedef KDTreeVectorOfVectorsAdaptor<RingKeys, float> RingKeyIndex;
+    typedef KDTreeVectorOfVectorsDynamicAdaptor<RingKeys, float> RingKeyDynamicIndex;
 
     static const int NONE = -1;
+
+    // false for key frames not to be scored, e.g., those too far away by GNSS:
+    typedef std::function<bool(int key_frame_id)> CandidateFilter;
+    // false for key frame pairs not to be scored, for the queries of all key frames:
+    typedef std::function<bool(int query_id, int key_frame_id)> PairFilter;
+    // loads the key scan of a key frame, called concurrently:
+    typedef std::function<bool(const KeyFrame &key_frame, CloudData &scan)> ScanLoader;
+
+    // the common configuration gets fixed-size descriptors, others fall back to ScanContext:
+    static const int FIXED_NUM_RINGS = 20;
+    static const int FIXED_NUM_SECTORS = 60;
+    typedef Eigen::Matrix<float, FIXED_NUM_RINGS, FIXED_NUM_SECTORS> FixedScanContext;
+
+    // scan context with unit-norm columns, column-major like ScanContext:
+    struct NormalizedScanContext {
+        int num_rings = 0;
+        int num_sectors = 0;
+        // for target, columns are stored twice:
+        std::vector<float> data;
+        // 1.0f for non-empty columns, 0.0f otherwise:
+        std::vector<float> is_valid;
+        // sector key of original scan context:
+        std::vector<float> sector_key;
+        // half spectrum of the sector key, num_sectors / 2 + 1 bins. computed for source,
+        // taken from the index for target:
+        std::vector<std::complex<float>> sector_key_spectrum;
+        // quantized index only, data in int8 of 1 / 127 steps for the shift search:
+        std::vector<int8_t> codes;
+    };
+
+    // loop closure proposal from a key frame of another session, or of this index, to one of this index:
+    struct SessionMatch {
+        // key frame id within the other session, or within this index:
+        int query_id = NONE;
+        // key frame id within this index:
+        int match_id = NONE;
+        float yaw_change_in_rad = 0.0f;
+        float distance = 0.0f;
+    };
+
+    // ring key index maintenance, which runs as part of loop closure detection:
+    struct IndexStats {
+        // num. of index extensions & rebuilds:
+        size_t num_updates = 0;
+        // in s:
+        double total_update_time = 0.0;
+    };
     
     ScanContextManager(const YAML::Node& node);
 
@@ -36,6 +91,32 @@ public:
         const CloudData &scan,
         const KeyFrame &key_frame
     );
+    /**
+     * @brief  append a key frame of known descriptors, e.g. replayed from a checkpoint
+     * @param  scan_context, column-major scan context of NUM_RINGS_ x NUM_SECTORS_
+     * @param  ring_key, ring key of NUM_RINGS_
+     * @param  key_frame, key frame
+     * @return true if the descriptors are of this resolution otherwise false
+     */
+    bool Update(
+        const std::vector<float> &scan_context,
+        const RingKey &ring_key,
+        const KeyFrame &key_frame
+    );
+    /**
+     * @brief  get the descriptors of the latest key frame, e.g. for a checkpoint
+     * @param  scan_context, column-major scan context of NUM_RINGS_ x NUM_SECTORS_, dequantized if quantized
+     * @param  ring_key, ring key of NUM_RINGS_
+     * @return true if there is any key frame otherwise false
+     */
+    bool GetLatestDescriptors(std::vector<float> &scan_context, RingKey &ring_key) const;
+    /**
+     * @brief  index a whole drive at once, e.g. for batch mapping. key scans are loaded & described in parallel
+     * @param  key_frames, all key frames in index order, replacing the current ones
+     * @param  load_scan, loads the key scan of a key frame, called concurrently
+     * @return true if every key scan is loaded otherwise false
+     */
+    bool Build(const std::vector<KeyFrame> &key_frames, const ScanLoader &load_scan);
 
     /**
      * @brief  get loop closure proposal using the latest key scan
@@ -43,6 +124,25 @@ public:
      * @return loop closure proposal (key_frame_id, scan_context_distance) as std::pair<int, float>
      */
     std::pair<int, float> DetectLoopClosure(void);
+    /**
+     * @brief  get up to N loop closure proposals using the latest key scan
+     * @param  N, max. num. of proposals
+     * @param  proposals, loop closure proposals (key_frame_id, yaw_change_in_rad), best first
+     * @return true if any proposal is found
+     */
+    bool DetectLoopClosure(const int N, std::vector<std::pair<int, float>> &proposals);
+    /**
+     * @brief  get up to N loop closure proposals using the latest key scan, among the ones passing the filter
+     * @param  N, max. num. of proposals
+     * @param  is_candidate, ring key neighbors failing it are dropped before scan context comparison
+     * @param  proposals, loop closure proposals (key_frame_id, yaw_change_in_rad), best first
+     * @return true if any proposal is found
+     */
+    bool DetectLoopClosure(
+        const int N, 
+        const CandidateFilter &is_candidate, 
+        std::vector<std::pair<int, float>> &proposals
+    );
     /**
      * @brief  get loop closure proposal using the given key scan
      * @param  scan, query key scan
@@ -50,6 +150,101 @@ public:
      * @return true for success match otherwise false
      */
     bool DetectLoopClosure(const CloudData &scan,Eigen::Matrix4f &pose);
+    /**
+     * @brief  get up to N loop closure proposals using the given key scan
+     * @param  scan, query key scan
+     * @param  N, max. num. of proposals
+     * @param  poses, matched poses, best first
+     * @return true if any proposal is found
+     */
+    bool DetectLoopClosure(
+        const CloudData &scan, 
+        const int N, 
+        std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> &poses
+    );
+    /**
+     * @brief  get up to N loop closure proposals using the given key scan, among the ones passing the filter,
+     *         e.g. the key frames within the GNSS-gated region
+     * @param  scan, query key scan
+     * @param  N, max. num. of proposals
+     * @param  is_candidate, ring key neighbors failing it are dropped before scan context comparison
+     * @param  poses, matched poses, best first
+     * @return true if any proposal is found
+     */
+    bool DetectLoopClosure(
+        const CloudData &scan, 
+        const int N, 
+        const CandidateFilter &is_candidate,
+        std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> &poses
+    );
+
+    /**
+     * @brief  get up to N loop closure proposals for each key frame of another session, e.g. a new drive.
+     *         key frames are queried in parallel, the cost is linear in the session and logarithmic in this index
+     * @param  session, fully indexed scan contexts of the other session, e.g. loaded
+     * @param  N, max. num. of proposals per key frame
+     * @param  matches, loop closure proposals in key frame order, best first for each key frame
+     * @return true if any proposal is found
+     */
+    bool DetectLoopClosures(
+        const ScanContextManager &session,
+        const int N,
+        std::vector<SessionMatch> &matches
+    );
+    /**
+     * @brief  get up to N loop closure proposals for each key frame of this index, among the key frames 
+     *         at least min. key frame seq. distance away on either side. key frames are queried in parallel
+     * @param  N, max. num. of proposals per key frame
+     * @param  is_pair, pairs failing it are dropped before scan context comparison, all are scored if empty
+     * @param  matches, loop closure proposals in key frame order, best first for each key frame
+     * @return true if any proposal is found
+     */
+    bool DetectLoopClosures(
+        const int N,
+        const PairFilter &is_pair,
+        std::vector<SessionMatch> &matches
+    );
+    /**
+     * @brief  as above, but every pair is scored at every shift, without the ring key pre-selection or 
+     *         the sector key alignment. the cost is quadratic in this index, for offline runs, e.g. map QA
+     * @param  N, max. num. of proposals per key frame
+     * @param  is_pair, pairs failing it are dropped, all are kept if empty
+     * @param  distance, batched scan context distance of the same resolution, its targets are replaced
+     * @param  matches, loop closure proposals in key frame order, best first for each key frame
+     * @return true if any proposal is found
+     */
+    bool DetectLoopClosures(
+        const int N,
+        const PairFilter &is_pair,
+        ScanContextDistance &distance,
+        std::vector<SessionMatch> &matches
+    );
+    /**
+     * @brief  append the key frames of another session, the ring key index is extended in place
+     * @param  session, fully indexed scan contexts of the other session, poses must be in the map frame of this index
+     * @param  session_name, name of the session
+     * @return true for success otherwise false
+     */
+    bool Append(const ScanContextManager &session, const std::string &session_name);
+
+    size_t GetNumKeyFrames(void) const { return state_.index_.data_.key_frame_.size(); }
+    // by key frame id within this index:
+    const KeyFrame &GetKeyFrame(const int key_frame_id) const { return state_.index_.data_.key_frame_.at(key_frame_id); }
+    /**
+     * @brief  get the session of a key frame, sessions are numbered from 0 in the order they were appended.
+     *         an index saved by back end is one session of empty name
+     * @param  key_frame_id, key frame id within this index
+     * @param  session_name, name of the session
+     * @param  session_key_frame_id, key frame id within the session
+     * @return session id
+     */
+    int GetSession(const int key_frame_id, std::string &session_name, int &session_key_frame_id) const;
+    /**
+     * @brief  get approx. heap bytes held by scan contexts, ring keys, key frames & the ring key index
+     * @return memory usage in bytes
+     */
+    size_t GetMemoryUsage(void) const;
+    const IndexStats &GetIndexStats(void) const { return index_stats_; }
 
     /**
      * @brief  save scan context index & data to persistent storage
@@ -57,6 +252,12 @@ public:
      * @return true for success otherwise false
      */
     bool Save(const std::string &output_path);
+    /**
+     * @brief  copy scan contexts, ring keys, key frames & sessions, e.g. to save them on another thread.
+     *         the snapshot builds an index of its own on Save, as the index of this manager is extended in place
+     * @return the snapshot
+     */
+    std::shared_ptr<ScanContextManager> GetSnapshot(void) const;
     /**
      * @brief  load scan context index & data from persistent storage
      * @param  input_path, scan context input path
@@ -66,19 +267,23 @@ public:
 
 private:
     /**
-     * @brief  get scan context of given lidar scan
+     * @brief  get scan context and ring key of given lidar scan
      * @param  scan, lidar scan of key frame
-     * @return scan context as Eigen::MatrixXd
-     */
-    ScanContext GetScanContext(const CloudData &scan);
-    /**
-     * @brief  get ring key of given scan context
-     * @param  scan_context, scan context of key scan
-     * @return ring key as RingKey
+     * @param  scan_context, output column-major scan context of NUM_RINGS_ x NUM_SECTORS_
+     * @param  ring_key, output ring key
+     * @return void
      */
-    RingKey GetRingKey(
-        const ScanContext &scan_context
-    );
+    void GetScanContext(const CloudData &scan, float *scan_context, RingKey &ring_key);
+    // scan context generation workspace:
+    struct Workspace {
+        std::vector<float> x_;
+        std::vector<float> y_;
+        std::vector<int> bin_id_;
+        // scan context before quantization:
+        std::vector<float> scan_context_;
+    };
+    // with a workspace of the caller, so scans can be described concurrently:
+    void GetScanContext(const CloudData &scan, Workspace &workspace, float *scan_context, RingKey &ring_key) const;
     /**
      * @brief  generate random ring keys for indexing test
      * @return void
@@ -87,30 +292,6 @@ private:
         RingKeys &samples, 
         const int N, const int D, const float max_range
     );
-    /**
-     * @brief  get sector key of given scan context
-     * @param  scan_context, scan context of key scan
-     * @return sector key as RingKey
-     */
-    Eigen::MatrixXf GetSectorKey(
-        const Eigen::MatrixXf &scan_context
-    );
-
-    /**
-     * @brief  get orientation of point measurement 
-     * @param  x, x component of point measurement
-     * @param  y, y component of point measurement
-     * @return point measurement orientation, [0.0f, 360.0f)
-     */
-    float GetOrientation(const float &x, const float &y);
-    /**
-     * @brief  convert floating point value to integer index 
-     * @param  value, target floating point value 
-     * @param  MAX_VALUE, max. floating point value
-     * @param  RESOLUTION, resolution
-     * @return integer index, {0, ..., RESOLUTION - 1}
-     */
-    int GetIndex(const float &value, const float &MAX_VALUE, const int RESOLUTION);
     /**
      * @brief  get candidate scan context indices 
      * @param  ring_key, query ring key 
@@ -125,41 +306,76 @@ private:
         std::vector<float> &distances
     );
     /**
-     * @brief  circular shift mat to right by shift
-     * @param  mat, original matrix 
-     * @param  shift, right shift amount  
-     * @return shifted matrix
+     * @brief  get column-normalized scan context for shift search
+     * @param  scan_context, input column-major scan context 
+     * @param  is_target, whether to store the columns twice, so any circular shift is a contiguous block
+     * @param  normalized_scan_context, output normalized scan context
+     * @return void
      */
-    Eigen::MatrixXf CircularShift(const Eigen::MatrixXf &mat, int shift);
+    void GetNormalizedScanContext(
+        const float *scan_context,
+        const bool is_target,
+        NormalizedScanContext &normalized_scan_context
+    );
+    template <typename Descriptor>
+    void GetNormalizedScanContext(
+        const Eigen::MatrixBase<Descriptor> &scan_context,
+        const bool is_target,
+        NormalizedScanContext &normalized_scan_context
+    );
     /**
-     * @brief  get optimal shift estimation using sector key 
-     * @param  target, target sector key 
-     * @param  source, source sector key  
+     * @brief  get half spectrum of sector key 
+     * @param  sector_key, sector key of num_sectors
+     * @param  sector_key_spectrum, output half spectrum of num_sectors / 2 + 1 bins
      * @return void
      */
+    void GetSectorKeySpectrum(
+        const std::vector<float> &sector_key,
+        std::vector<std::complex<float>> &sector_key_spectrum
+    );
+    /**
+     * @brief  get optimal shift estimation using sector key, as the peak of circular cross-correlation
+     * @param  target, target normalized scan context 
+     * @param  source, source normalized scan context  
+     * @return optimal shift
+     */
     int GetOptimalShiftUsingSectorKey(
-        const Eigen::MatrixXf &target, 
-        const Eigen::MatrixXf &source
+        const NormalizedScanContext &target, 
+        const NormalizedScanContext &source
     );
     /**
-     * @brief  compute cosine distance between target and source scan context 
-     * @param  target_scan_context, target scan context 
-     * @param  source_scan_context, source scan context 
+     * @brief  compute cosine distance between shifted target and source scan context 
+     * @param  target, target normalized scan context 
+     * @param  source, source normalized scan context 
+     * @param  shift, right shift amount of target, {0, ..., NUM_SECTORS - 1}
      * @return scan context cosine distance
      */
     float GetCosineDistance(
-        const ScanContext &target_scan_context, 
-        const ScanContext &source_scan_context
+        const NormalizedScanContext &target, 
+        const NormalizedScanContext &source,
+        const int shift
+    );
+    /**
+     * @brief  as above, on the int8 codes of the normalized scan contexts
+     * @param  target, target normalized scan context 
+     * @param  source, source normalized scan context 
+     * @param  shift, right shift amount of target, {0, ..., NUM_SECTORS - 1}
+     * @return scan context cosine distance
+     */
+    float GetQuantizedCosineDistance(
+        const NormalizedScanContext &target, 
+        const NormalizedScanContext &source,
+        const int shift
     );
     /**
      * @brief  get scan context match result between target and source scan context 
-     * @param  target_scan_context, target scan context 
-     * @param  source_scan_context, source scan context 
+     * @param  target, target normalized scan context 
+     * @param  source, source normalized scan context 
      * @return scan context match result as std::pair<int, float>
      */
     std::pair<int, float> GetScanContextMatch(
-        const ScanContext &target_scan_context, 
-        const ScanContext &source_scan_context
+        const NormalizedScanContext &target, 
+        const NormalizedScanContext &source
     );
 
     /**
@@ -168,17 +384,76 @@ private:
      * @return true if success otherwise false
      */
     bool UpdateIndex(const int MIN_KEY_FRAME_SEQ_DISTANCE);
+    /**
+     * @brief  rebuild scan context index from indexed ring keys
+     * @return void
+     */
+    void ResetIndex(void);
+    /**
+     * @brief  index the ring keys appended to the indexed ones since the last call
+     * @return void
+     */
+    void ExtendIndex(void);
+    // num. of indexed ring keys:
+    size_t GetIndexSize(void) const;
+    /**
+     * @brief  transform the sector keys of indexed key frames not transformed yet 
+     * @return void
+     */
+    void UpdateSectorKeySpectra(void);
     
     /**
      * @brief  get loop closure match result for given scan context and ring key 
-     * @param  query_scan_context, query scan context 
+     * @param  query_scan_context, query column-major scan context 
      * @param  query_ring_key, query ring key
      * @return loop closure match result as std::pair<int, float>
      */
     std::pair<int, float> GetLoopClosureMatch(
-        const ScanContext &query_scan_context,
+        const float *query_scan_context,
         const RingKey &query_ring_key
     );
+    /**
+     * @brief  get loop closure match results for given scan context and ring key 
+     * @param  query_scan_context, query column-major scan context 
+     * @param  query_ring_key, query ring key
+     * @param  N, max. num. of matches
+     * @param  is_candidate, candidate filter, all candidates are scored if empty
+     * @param  matches, matches below distance thresh, best first
+     * @return void
+     */
+    void GetLoopClosureMatches(
+        const float *query_scan_context,
+        const RingKey &query_ring_key,
+        const int N,
+        const CandidateFilter &is_candidate,
+        std::vector<std::pair<int, float>> &matches
+    );
+    struct Match {
+        int id;
+        // right shift of the match, in sectors:
+        int shift;
+        float distance;
+    };
+    /**
+     * @brief  score the ring key nearest neighbors of the query by scan context distance
+     * @param  query_scan_context, query column-major scan context 
+     * @param  query_ring_key, query ring key
+     * @param  num_neighbors, num. of ring key nearest neighbors, of which the first NUM_CANDIDATES_ passing the filter are scored
+     * @param  N, max. num. of matches
+     * @param  is_candidate, candidate filter, all candidates are scored if empty
+     * @param  score_in_parallel, whether to score the candidates of the query in parallel
+     * @param  matches, matches below distance thresh, best first
+     * @return void
+     */
+    void GetMatches(
+        const float *query_scan_context,
+        const RingKey &query_ring_key,
+        const int num_neighbors,
+        const int N,
+        const CandidateFilter &is_candidate,
+        const bool score_in_parallel,
+        std::vector<Match> &matches
+    );
 
     /**
      * @brief  save scan context index
@@ -205,6 +480,32 @@ private:
      */
     bool SaveKeyFrames(const std::string &output_path);
 
+    /**
+     * @brief  save sessions, only for an index with appended sessions
+     * @param  output_path, sessions output path
+     * @return true for success otherwise false
+     */
+    bool SaveSessions(const std::string &output_path);
+    /**
+     * @brief  load sessions, an index without them is one session
+     * @param  input_path, sessions input path
+     * @return true for success otherwise false
+     */
+    bool LoadSessions(const std::string &input_path);
+
+    /**
+     * @brief  save scan contexts, ring keys, key frames & kd-tree as flat index
+     * @param  output_path, flat index output path
+     * @return true for success otherwise false
+     */
+    bool SaveFlatIndex(const std::string &output_path);
+    /**
+     * @brief  load flat index
+     * @param  input_path, flat index input path
+     * @return true for success otherwise false
+     */
+    bool LoadFlatIndex(const std::string &input_path);
+
     /**
      * @brief  load scan contexts
      * @param  input_path, scan contexts input path
@@ -227,7 +528,7 @@ private:
     // states:
     struct {
         // a. scan context buffer:
-        std::vector<ScanContext> scan_context_;
+        ScanContextBuffer scan_context_;
         // b. ring-key buffer:
         RingKeys ring_key_;
         // c. key frame buffer:
@@ -236,16 +537,29 @@ private:
         struct {
             // 1. indexing interval counter:
             int counter_ = 0;
-            // 2. kd-tree:
-            std::shared_ptr<RingKeyIndex> kd_tree_;
+            // 2. kd-tree, or graph if configured, ring keys are appended in place:
+            std::shared_ptr<RingKeyDynamicIndex> kd_tree_;
+            std::shared_ptr<RingKeyGraphIndex> graph_;
             // 3. data:
             struct {
                 RingKeys ring_key_;
                 std::vector<KeyFrame> key_frame_;
+                // sector key half spectra, NUM_SECTORS_ / 2 + 1 bins per key frame:
+                std::vector<std::complex<float>> sector_key_spectrum_;
             } data_;
         } index_;
+        // e. sessions, by the key frame id of their first key frame, empty for a single session:
+        struct Session {
+            std::string name_;
+            size_t begin_;
+        };
+        std::vector<Session> session_;
     } state_;
 
+    // scan context generation workspace, reused across scans:
+    Workspace workspace_;
+    IndexStats index_stats_;
+
     // hyper-params:
     // a. ROI definition:
     float MAX_RADIUS_;
@@ -254,6 +568,7 @@ private:
     int NUM_RINGS_;
     int NUM_SECTORS_; 
     float DEG_PER_SECTOR_;
+    bool USE_FIXED_SIZE_;
     // c. ring key indexing interval:
     int INDEXING_INTERVAL_;
     // d. min key frame sequence distance:
@@ -264,6 +579,11 @@ private:
     float FAST_ALIGNMENT_SEARCH_RATIO_;
     // g. scan context distance threshold:
     float SCAN_CONTEXT_DISTANCE_THRESH_;
+    // h. whether to keep scan contexts quantized, shifts are then searched on int8 codes:
+    bool QUANTIZE_;
+    // i. ring key index, approx. graph instead of kd-tree for large maps:
+    bool USE_GRAPH_INDEX_;
+    RingKeyGraphIndex::Params GRAPH_INDEX_PARAMS_;
 };
 
 } // namespace lidar_localization
@@ -0,0 +1,106 @@
+/*
+ * @Description: offline map pruning, removal of transient points by ray casting, density equalization
+ *               and ground decimation, before the map is split into tiles
+ * @Author: Ge Yao
+ * @Date: 2021-01-27 19:36:08
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_TILED_MAP_MAP_PRUNER_HPP_
+#define LIDAR_LOCALIZATION_MODELS_TILED_MAP_MAP_PRUNER_HPP_
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+
+#include <yaml-cpp/yaml.h>
+#include <Eigen/Dense>
+
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/sensor_data/key_frame.hpp"
+
+namespace lidar_localization {
+// the map is rebuilt from the key scans in three passes over them, on one voxel grid:
+//   a. hits, every key scan marks the voxels of its points as occupied, points low in lidar frame as ground,
+//   b. visibility, the rays from the key frame origin to the points within max_range mark the voxels they
+//      pass through as free, up to hit_margin before the point,
+//   c. output, voxels seen free in at least min_free_scans key scans and more than free_ratio times as often
+//      as occupied are transient, e.g. vehicles & pedestrians, and dropped. the other voxels keep at most
+//      max_points_per_voxel points, ground voxels max_ground_points_per_voxel.
+// occupied & free are counted once per key scan. ground voxels are never transient, as rays to far ground
+// points graze the near ground.
+class MapPruner {
+  public:
+    struct Stats {
+      size_t num_key_frames = 0;
+      size_t num_voxels = 0;
+      size_t num_transient_voxels = 0;
+      size_t num_ground_voxels = 0;
+      size_t num_input_points = 0;
+      size_t num_transient_points = 0;
+      // dropped by the per-voxel caps:
+      size_t num_density_points = 0;
+      size_t num_ground_points = 0;
+      size_t num_output_points = 0;
+    };
+
+    // the returned scan is in lidar frame, false if the key scan is not available:
+    using ScanLoader = std::function<bool(unsigned int index, CloudData::CLOUD::ConstPtr& scan_ptr)>;
+
+    MapPruner(const YAML::Node& node);
+
+    /**
+     * @brief  build the pruned map of key frames
+     * @param  key_frames, key frame poses in map frame
+     * @param  load_scan, key scan loader, called three times per key frame
+     * @param  map, output pruned map, in map frame
+     * @return true if success otherwise false
+     */
+    bool Prune(const std::deque<KeyFrame>& key_frames, const ScanLoader& load_scan, CloudData::CLOUD& map);
+
+    const Stats& GetStats(void) const { return stats_; }
+
+  private:
+    struct Voxel {
+      uint32_t num_points = 0;
+      uint32_t num_ground_points = 0;
+      // num. of key scans that see the voxel occupied / free:
+      uint32_t num_hit_scans = 0;
+      uint32_t num_free_scans = 0;
+      // last key scan counted, 1-based, so that each is counted once:
+      uint32_t last_hit_scan = 0;
+      uint32_t last_free_scan = 0;
+      uint32_t num_kept = 0;
+    };
+    using VoxelMap = std::unordered_map<uint64_t, Voxel>;
+
+    // false if the voxel is outside the index range:
+    bool GetVoxelIndex(const Eigen::Vector3f& position, Eigen::Vector3i& index) const;
+    static uint64_t GetVoxelKey(const Eigen::Vector3i& index);
+
+    void AddHits(const CloudData::CLOUD& scan, const Eigen::Matrix4f& pose, uint32_t scan_id);
+    void AddFreeSpace(const CloudData::CLOUD& scan, const Eigen::Matrix4f& pose, uint32_t scan_id);
+    // 3D DDA from origin towards end, stops hit_margin before end:
+    void CastRay(const Eigen::Vector3f& origin, const Eigen::Vector3f& end, uint32_t scan_id);
+    void AddPoints(const CloudData::CLOUD& scan, const Eigen::Matrix4f& pose, CloudData::CLOUD& map);
+
+    bool IsGround(const Voxel& voxel) const { return 2 * voxel.num_ground_points > voxel.num_points; }
+    bool IsTransient(const Voxel& voxel) const;
+
+  private:
+    float leaf_size_;
+    float inverse_leaf_size_;
+    float max_range_;
+    float hit_margin_;
+    int min_free_scans_;
+    float free_ratio_;
+    // points below ground_z in lidar frame are ground:
+    float ground_z_;
+    int max_points_per_voxel_;
+    int max_ground_points_per_voxel_;
+
+    VoxelMap voxels_;
+    Stats stats_;
+};
+} // namespace lidar_localization
+
+#endif
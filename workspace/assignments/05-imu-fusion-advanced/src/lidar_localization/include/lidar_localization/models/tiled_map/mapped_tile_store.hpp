@@ -0,0 +1,93 @@
+/*
+ * @Description: the points of all map tiles in one memory-mapped file, optionally on huge pages
+ * @Author: Ge Yao
+ * @Date: 2021-01-22 19:48:05
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_TILED_MAP_MAPPED_TILE_STORE_HPP_
+#define LIDAR_LOCALIZATION_MODELS_TILED_MAP_MAPPED_TILE_STORE_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+
+namespace lidar_localization {
+// layout of tiles.bin:
+//   header   -- magic, version, point size & total num. of points, 64 bytes
+//   points   -- CloudData::POINT of every tile, in the order of the tiled map index
+// NONE maps the file itself, pages are faulted in from the page cache on first access.
+// THP & HUGETLB map anonymous memory on 2 MB pages instead, a tile is read into it on its first access,
+// so a city-scale map costs far fewer TLB entries & page faults during local map assembly.
+// HUGETLB needs pages reserved in /proc/sys/vm/nr_hugepages, THP falls back to 4 KB pages by itself.
+class MappedTileStore {
+  public:
+    enum class HugePages {
+      NONE,
+      THP,
+      HUGETLB
+    };
+
+    static bool GetHugePages(const std::string& name, HugePages& huge_pages);
+    static std::string GetHugePagesName(HugePages huge_pages);
+
+    // pack the tile files, in index order, into file_path:
+    static bool Save(const std::string& file_path, const std::vector<std::string>& tile_file_paths);
+
+    // num. of points of every tile, in index order:
+    MappedTileStore(const std::string& file_path, const std::vector<size_t>& tile_num_points, HugePages huge_pages);
+    ~MappedTileStore();
+
+    bool IsValid(void) const { return data_ != nullptr; }
+    // HUGETLB falls back to THP if no huge pages are reserved:
+    HugePages GetHugePages(void) const { return huge_pages_; }
+
+    /**
+     * @brief  points of a tile, read in first unless resident
+     * @param  tile, index of the tile
+     * @param  num_points, num. of points
+     * @param  was_resident, whether the tile was resident already
+     * @return the points, nullptr if the tile cannot be read
+     */
+    const CloudData::POINT* GetTile(size_t tile, size_t& num_points, bool& was_resident);
+    bool IsResident(size_t tile);
+    // fault in the pages of a tile, as GetTile:
+    bool Prefault(size_t tile);
+    // asynchronous read-ahead of a tile by the kernel, no page is faulted in:
+    void WillNeed(size_t tile);
+
+    size_t GetNumResidentTiles(void);
+    size_t GetResidentSizeInBytes(void);
+    // indices of all resident tiles:
+    void GetResidentTiles(std::vector<size_t>& tiles);
+
+  private:
+    bool Map(size_t size);
+    // file-backed: touch every page, anonymous: read the tile from the file:
+    bool Populate(size_t tile);
+
+  private:
+    std::string file_path_;
+    HugePages huge_pages_;
+    int fd_ = -1;
+
+    char* data_ = nullptr;
+    size_t data_size_ = 0;
+    // the mapping, may start before data_ to align anonymous memory to huge pages:
+    void* mapping_ = nullptr;
+    size_t mapping_size_ = 0;
+
+    // offset of the first point of every tile, & one past the last tile:
+    std::vector<size_t> tile_offsets_;
+
+    std::mutex mutex_;
+    std::vector<char> is_resident_;
+    size_t num_resident_tiles_ = 0;
+    size_t resident_size_in_bytes_ = 0;
+    // serializes the reads of anonymous tiles, so a tile is read once:
+    std::mutex populate_mutex_;
+};
+}
+
+#endif
@@ -0,0 +1,119 @@
+/*
+ * @Description: out-of-core global map builder, key scans are voxel-accumulated into x-y tiles flushed to disk
+ * @Author: Ge Yao
+ * @Date: 2020-12-28 14:06:31
+ */
+#ifndef LIDAR_LOCALIZATION_MODELS_TILED_MAP_STREAMING_MAP_BUILDER_HPP_
+#define LIDAR_LOCALIZATION_MODELS_TILED_MAP_STREAMING_MAP_BUILDER_HPP_
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <fstream>
+#include <functional>
+#include <unordered_map>
+
+#include <yaml-cpp/yaml.h>
+#include <Eigen/Dense>
+
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/sensor_data/key_frame.hpp"
+
+namespace lidar_localization {
+// key frames are visited in spatial order, along the longer side of the trajectory. each tile keeps one centroid
+// per voxel, as FastVoxelFilter in centroid mode. a tile behind the reach of the remaining key frames, or the one
+// farthest behind when the tiles in memory exceed the cache size, is appended to its partial file on disk.
+// the partial files are then merged one tile at a time into the tiled map, see TiledMap, and one merged PCD.
+class StreamingMapBuilder {
+  public:
+    struct Stats {
+      size_t num_key_frames = 0;
+      size_t num_tiles = 0;
+      size_t num_points = 0;
+      // num. of tiles moved to disk while accumulating:
+      size_t num_flushed = 0;
+      size_t max_size_in_bytes = 0;
+    };
+
+    // the returned scan is in lidar frame, false if the key scan is not available:
+    using ScanLoader = std::function<bool(unsigned int index, CloudData::CLOUD::ConstPtr& scan_ptr)>;
+
+    StreamingMapBuilder(const YAML::Node& node);
+
+    /**
+     * @brief  build the map of key frames
+     * @param  key_frames, key frame poses in map frame
+     * @param  load_scan, key scan loader
+     * @param  tiles_path, output tiled map directory, cleared first
+     * @param  map_file_path, output merged PCD
+     * @return true if success otherwise false
+     */
+    bool Build(
+        const std::deque<KeyFrame>& key_frames, const ScanLoader& load_scan,
+        const std::string& tiles_path, const std::string& map_file_path
+    );
+
+    const Stats& GetStats(void) const { return stats_; }
+
+  private:
+    struct Voxel {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      // other fields of richer point types are taken from the first point:
+      CloudData::POINT first_point;
+      double sum[3];
+      uint32_t num_points;
+    };
+    // partial file record:
+    struct VoxelRecord {
+      uint64_t voxel_key;
+      Voxel voxel;
+    };
+    using VoxelMap = std::unordered_map<
+      uint64_t, Voxel,
+      std::hash<uint64_t>, std::equal_to<uint64_t>,
+      Eigen::aligned_allocator<std::pair<const uint64_t, Voxel>>
+    >;
+
+    struct Tile {
+      VoxelMap voxels;
+      // far end of the tile along the sweep axis:
+      float sweep_end;
+    };
+
+    // false if the point is outside the voxel index range:
+    bool GetVoxelKey(const CloudData::POINT& point, uint64_t& voxel_key, int64_t& tile_key) const;
+    void AddScan(const CloudData::CLOUD& scan);
+    bool FlushTile(int64_t tile_key);
+    // flush tiles out of reach of key frames from sweep_position on, then the ones farthest behind over cache size:
+    bool FlushTiles(float sweep_position);
+    // merge the partial file of the tile and write the tile, also appended to the merged body, then remove it:
+    bool FinishTile(int64_t tile_key, std::ofstream& body_ofs, size_t& num_points);
+    bool WriteMergedMap(const std::string& map_file_path, const std::string& body_file_path, size_t num_points);
+
+    std::string GetPartialFilePath(int64_t tile_key) const;
+    size_t GetSizeInBytes(void) const;
+
+  private:
+    float tile_size_;
+    Eigen::Vector3f leaf_size_;
+    Eigen::Vector3f inverse_leaf_size_;
+    float max_range_;
+    size_t max_size_in_bytes_;
+
+    // set per build:
+    std::string tiles_path_;
+    int sweep_axis_ = 0;
+
+    std::map<int64_t, Tile> tiles_;
+    size_t num_voxels_ = 0;
+    // all tiles with a partial file:
+    std::set<int64_t> flushed_tiles_;
+
+    Stats stats_;
+};
+} // namespace lidar_localization
+
+#endif
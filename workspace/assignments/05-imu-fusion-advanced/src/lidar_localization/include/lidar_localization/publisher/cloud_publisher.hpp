@@ -12,9 +12,19 @@
 #include <pcl/point_cloud.h>
 #include <pcl_conversions/pcl_conversions.h>
 
+#include <chrono>
+#include <memory>
+
+#include <lidar_localization/CompressedCloud.h>
+
 #include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/models/cloud_filter/cloud_filter_interface.hpp"
+#include "lidar_localization/tools/cloud_codec.hpp"
 
 namespace lidar_localization {
+// publish options are looked up by topic name in config/publisher/cloud_publisher.yaml, falling back to its default.
+// clouds may be skipped without subscribers or above max. rate, and are downsampled only when actually published.
+// with compressed transport, <topic>/compressed is advertised too, for the subscribers on other hosts
 class CloudPublisher {
   public:
     CloudPublisher(ros::NodeHandle& nh,
@@ -23,18 +33,33 @@ class CloudPublisher {
                    size_t buff_size);
     CloudPublisher() = default;
 
-    void Publish(CloudData::CLOUD_PTR& cloud_ptr_input, double time);
-    void Publish(CloudData::CLOUD_PTR& cloud_ptr_input);
+    void Publish(const CloudData::CLOUD::ConstPtr& cloud_ptr_input, double time);
+    void Publish(const CloudData::CLOUD::ConstPtr& cloud_ptr_input);
 
     bool HasSubscribers();
   
   private:
-    void PublishData(CloudData::CLOUD_PTR& cloud_ptr_input, ros::Time time);
+    bool InitOptions(const std::string& topic_name);
+    // whether the cloud should be published now, given subscribers & max. rate:
+    bool ShouldPublish(void);
+    void PublishData(const CloudData::CLOUD::ConstPtr& cloud_ptr_input, ros::Time time);
 
   private:
     ros::NodeHandle nh_;
     ros::Publisher publisher_;
+    ros::Publisher compressed_publisher_;
     std::string frame_id_;
+
+    bool skip_without_subscribers_ = true;
+    // in Hz, 0 for unlimited:
+    double max_rate_ = 0.0;
+    // null for full resolution:
+    std::shared_ptr<CloudFilterInterface> filter_ptr_;
+    // null without compressed transport:
+    std::shared_ptr<CloudCodec> codec_ptr_;
+
+    bool has_published_ = false;
+    std::chrono::steady_clock::time_point last_publish_time_;
 };
 } 
 #endif
\ No newline at end of file
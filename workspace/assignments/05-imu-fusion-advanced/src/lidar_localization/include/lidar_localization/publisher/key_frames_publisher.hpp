@@ -8,9 +8,14 @@
 
 #include <string>
 #include <deque>
+#include <vector>
+#include <chrono>
 #include <ros/ros.h>
 #include <nav_msgs/Path.h>
 #include <geometry_msgs/PoseStamped.h>
+#include <yaml-cpp/yaml.h>
+
+#include <lidar_localization/KeyFrameUpdates.h>
 
 #include "lidar_localization/sensor_data/key_frame.hpp"
 
@@ -21,16 +26,45 @@ class KeyFramesPublisher {
                       std::string topic_name, 
                       std::string frame_id,
                       int buff_size);
+    // incremental mode, the key frames added or moved go to <topic>/incremental, 
+    // while the whole trajectory on topic is throttled:
+    KeyFramesPublisher(ros::NodeHandle& nh, 
+                      std::string topic_name, 
+                      std::string frame_id,
+                      int buff_size,
+                      const YAML::Node& node);
     KeyFramesPublisher() = default;
 
     void Publish(const std::deque<KeyFrame>& key_frames);
 
     bool HasSubscribers();
 
+  private:
+    void PublishPath(const std::deque<KeyFrame>& key_frames);
+    void PublishUpdates(const std::deque<KeyFrame>& key_frames);
+    // the whole trajectory published so far, to a new subscriber of the updates only:
+    void PublishSnapshot(const ros::SingleSubscriberPublisher& publisher);
+
+    bool IsMoved(const KeyFrame& published, const KeyFrame& key_frame) const;
+    void AddUpdate(const KeyFrame& key_frame, KeyFrameUpdates& updates) const;
+
   private:
     ros::NodeHandle nh_;
     ros::Publisher publisher_;
     std::string frame_id_ = "";
+
+    // incremental mode:
+    bool is_incremental_ = false;
+    ros::Publisher updates_publisher_;
+    float min_translation_ = 0.0f;
+    float min_rotation_ = 0.0f;
+    double path_interval_ = 0.0;
+    std::chrono::steady_clock::time_point last_path_time_;
+    bool has_path_ = false;
+
+    // sorted by index:
+    std::vector<KeyFrame> published_key_frames_;
+    KeyFrameUpdates updates_;
 };
 }
-#endif
\ No newline at end of file
+#endif
@@ -6,24 +6,51 @@
 #ifndef LIDAR_LOCALIZATION_SENSOR_DATA_CLOUD_DATA_HPP_
 #define LIDAR_LOCALIZATION_SENSOR_DATA_CLOUD_DATA_HPP_
 
+#include <vector>
+#include <memory>
+
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
 
+#include "lidar_localization/sensor_data/point_types.hpp"
+
 namespace lidar_localization {
+class RangeImage;
+
 class CloudData {
   public:
+    // selected by POINT_TYPE in CMakeLists.txt:
+#if defined(LIDAR_LOCALIZATION_POINT_XYZIRT)
+    using POINT = PointXYZIRT;
+#elif defined(LIDAR_LOCALIZATION_POINT_XYZI)
+    using POINT = pcl::PointXYZI;
+#else
     using POINT = pcl::PointXYZ;
+#endif
     using CLOUD = pcl::PointCloud<POINT>;
     using CLOUD_PTR = CLOUD::Ptr;
+    using POINT_TIMES = std::vector<float>;
+    using POINT_TIMES_PTR = std::shared_ptr<POINT_TIMES>;
+    using RANGE_IMAGE_PTR = std::shared_ptr<const RangeImage>;
 
   public:
     CloudData()
       :cloud_ptr(new CLOUD()) {
     }
+    // e.g. a recycled cloud from CloudPool:
+    explicit CloudData(const CLOUD_PTR& cloud_ptr)
+      :cloud_ptr(cloud_ptr) {
+    }
 
   public:
     double time = 0.0;
     CLOUD_PTR cloud_ptr;
+    // per-point time relative to time, in seconds, for lidars with a time field.
+    // null otherwise, or once a step changes the points:
+    POINT_TIMES_PTR point_times_ptr;
+    // organized view of the points, see range_image.hpp, built at ingest if the topic is configured for it.
+    // null otherwise, or once a step changes the points:
+    RANGE_IMAGE_PTR range_image_ptr;
 };
 }
 
@@ -0,0 +1,55 @@
+/*
+ * @Description: compact in-memory key scan, int16 coordinates relative to its own origin, 6 bytes per point
+ * @Author: Ge Yao
+ * @Date: 2021-01-21 21:16:05
+ */
+#ifndef LIDAR_LOCALIZATION_SENSOR_DATA_COMPACT_CLOUD_HPP_
+#define LIDAR_LOCALIZATION_SENSOR_DATA_COMPACT_CLOUD_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <memory>
+
+#include <Eigen/Dense>
+
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+
+namespace lidar_localization {
+// for key scans kept in memory only to be transformed into local maps, e.g. the front end window & the loop closing
+// key scan cache. x, y & z are quantized around the center of the bounding box, in separate int16 arrays, so
+// decoding & transforming runs 4 points at a time. the resolution is coarsened for clouds wider than 65535 steps.
+// lossy by up to half the resolution. non-finite points are dropped and only x, y & z are kept, other fields of
+// decoded points are default
+class CompactCloud {
+  public:
+    using Ptr = std::shared_ptr<CompactCloud>;
+    using ConstPtr = std::shared_ptr<const CompactCloud>;
+
+    static constexpr float DEFAULT_RESOLUTION = 0.01f;
+
+  public:
+    CompactCloud(const CloudData::CLOUD& cloud, float resolution = DEFAULT_RESOLUTION);
+
+    size_t GetNumPoints(void) const { return x_.size(); }
+    size_t GetSizeInBytes(void) const { return 3 * sizeof(int16_t) * x_.size(); }
+    // may be coarser than requested:
+    float GetResolution(void) const { return resolution_; }
+    uint64_t GetStamp(void) const { return stamp_; }
+
+    // the points in the frame given by pose, into output[0, GetNumPoints()):
+    void Transform(const Eigen::Matrix4f& pose, CloudData::POINT *output) const;
+    void Decode(CloudData::CLOUD& cloud) const;
+
+  private:
+    Eigen::Vector3f origin_;
+    float resolution_;
+    uint64_t stamp_;
+
+    std::vector<int16_t> x_;
+    std::vector<int16_t> y_;
+    std::vector<int16_t> z_;
+};
+}
+
+#endif
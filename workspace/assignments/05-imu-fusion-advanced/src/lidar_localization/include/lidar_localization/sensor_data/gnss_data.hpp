@@ -8,8 +8,6 @@
 
 #include <deque>
 
-#include <GeographicLib/LocalCartesian.hpp>
-
 namespace lidar_localization {
 class GNSSData {
   public:
@@ -17,23 +15,14 @@ class GNSSData {
     double latitude = 0.0;
     double longitude = 0.0;
     double altitude = 0.0;
+    // set by the GeoConverter of the flow:
     double local_E = 0.0;
     double local_N = 0.0;
     double local_U = 0.0;
     int status = 0;
     int service = 0;
 
-    static double origin_longitude;
-    static double origin_latitude;
-    static double origin_altitude;
-
-  private:
-    static GeographicLib::LocalCartesian geo_converter;
-    static bool origin_position_inited;
-
   public: 
-    void InitOriginPosition();
-    void UpdateXYZ();
     static bool SyncData(std::deque<GNSSData>& UnsyncedData, std::deque<GNSSData>& SyncedData, double sync_time);
 };
 }
@@ -42,10 +42,21 @@ class IMUData {
         }
     };
 
+    // integrated raw measurements over (time - delta_time, time], from IMUDecimator.
+    // delta_velocity is in the body frame at the start of the interval:
+    struct Increment {
+      double delta_time = 0.0;
+      Eigen::Vector3d delta_angle = Eigen::Vector3d::Zero();
+      Eigen::Vector3d delta_velocity = Eigen::Vector3d::Zero();
+    };
+
     double time = 0.0;
     LinearAcceleration linear_acceleration;
     AngularVelocity angular_velocity;
     Orientation orientation;
+    // the rates above are then the means over the interval:
+    bool has_increment = false;
+    Increment increment;
   
   public:
     // 把四元数转换成旋转矩阵送出去
@@ -0,0 +1,57 @@
+/*
+ * @Description: point types selectable for CloudData, and traits for the optional fields
+ * @Author: Ge Yao
+ * @Date: 2020-12-18 20:05:47
+ */
+#ifndef LIDAR_LOCALIZATION_SENSOR_DATA_POINT_TYPES_HPP_
+#define LIDAR_LOCALIZATION_SENSOR_DATA_POINT_TYPES_HPP_
+
+#include <cstdint>
+
+// PointXYZIRT needs PCL_NO_PRECOMPILE, which is set by CMake with POINT_TYPE:
+#include <pcl/point_types.h>
+
+namespace lidar_localization {
+// Velodyne / Ouster style point with ring and time relative to the cloud time in seconds:
+struct EIGEN_ALIGN16 PointXYZIRT {
+    PCL_ADD_POINT4D;
+    float intensity;
+    uint16_t ring;
+    float time;
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+template<typename PointType>
+struct PointTraits {
+    static const bool HAS_INTENSITY = false;
+    static const bool HAS_TIME = false;
+
+    static float GetTime(const PointType& point) { return 0.0f; }
+};
+
+template<>
+struct PointTraits<pcl::PointXYZI> {
+    static const bool HAS_INTENSITY = true;
+    static const bool HAS_TIME = false;
+
+    static float GetTime(const pcl::PointXYZI& point) { return 0.0f; }
+};
+
+template<>
+struct PointTraits<PointXYZIRT> {
+    static const bool HAS_INTENSITY = true;
+    static const bool HAS_TIME = true;
+
+    static float GetTime(const PointXYZIRT& point) { return point.time; }
+};
+}
+
+POINT_CLOUD_REGISTER_POINT_STRUCT(
+    lidar_localization::PointXYZIRT,
+    (float, x, x) (float, y, y) (float, z, z)
+    (float, intensity, intensity)
+    (uint16_t, ring, ring)
+    (float, time, time)
+)
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ * @Description: organized range image of a scan, rows by ring & columns by azimuth, for O(1) neighbor access
+ * @Author: Ge Yao
+ * @Date: 2021-01-19 21:05:38
+ */
+#ifndef LIDAR_LOCALIZATION_SENSOR_DATA_RANGE_IMAGE_HPP_
+#define LIDAR_LOCALIZATION_SENSOR_DATA_RANGE_IMAGE_HPP_
+
+#include <vector>
+#include <memory>
+
+#include <yaml-cpp/yaml.h>
+
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+
+namespace lidar_localization {
+// for scans in the lidar frame. points are binned by ring, i.e. the ring field if the point type has one and
+// elevation otherwise, row 0 being the lowest, and by azimuth. each cell keeps its nearest point, as the single
+// return of LINS' projectPointCloud, with its range & coordinates in per-channel arrays, row-major by cell.
+// the image refers to the points of the cloud it was built from by index
+class RangeImage {
+  public:
+    using Ptr = std::shared_ptr<RangeImage>;
+    using ConstPtr = std::shared_ptr<const RangeImage>;
+
+    static const int EMPTY = -1;
+
+  public:
+    // num_rings, min_elevation & max_elevation in deg, num_columns:
+    RangeImage(const YAML::Node& node);
+    RangeImage(int num_rings, float min_elevation, float max_elevation, int num_columns);
+
+    void Build(const CloudData::CLOUD& cloud);
+
+    int GetNumRows(void) const { return num_rows_; }
+    int GetNumCols(void) const { return num_cols_; }
+    // num. of points of the cloud it was built from:
+    size_t GetNumPoints(void) const { return point_cells_.size(); }
+
+    // azimuth wraps around, e.g. column -1 is the last one:
+    int WrapCol(int col) const {
+        col %= num_cols_;
+        return (col < 0) ? col + num_cols_ : col;
+    }
+    int GetCell(int row, int col) const { return row * num_cols_ + WrapCol(col); }
+
+    // nearest point of the cell, EMPTY if none or the row is out of the image:
+    int GetPointIndex(int row, int col) const {
+        return (row < 0 || row >= num_rows_) ? EMPTY : cell_points_[GetCell(row, col)];
+    }
+    // range of the nearest point of the cell, 0 if empty:
+    float GetRange(int row, int col) const {
+        return (row < 0 || row >= num_rows_) ? 0.0f : range_[GetCell(row, col)];
+    }
+    // cell of each point of the cloud, EMPTY if it is not finite or out of the image:
+    int GetPointCell(int point_index) const { return point_cells_[point_index]; }
+
+    // channels by cell, of the nearest point, 0 for empty cells:
+    const std::vector<float>& GetRangeChannel(void) const { return range_; }
+    const std::vector<float>& GetXChannel(void) const { return x_; }
+    const std::vector<float>& GetYChannel(void) const { return y_; }
+    const std::vector<float>& GetZChannel(void) const { return z_; }
+
+  private:
+    int num_rows_;
+    float min_elevation_;
+    float inverse_elevation_res_;
+    int num_cols_;
+    float inverse_azimuth_res_;
+
+    std::vector<int> point_cells_;
+    std::vector<float> point_ranges_;
+    std::vector<int> cell_points_;
+    std::vector<float> range_;
+    std::vector<float> x_;
+    std::vector<float> y_;
+    std::vector<float> z_;
+};
+}
+
+#endif
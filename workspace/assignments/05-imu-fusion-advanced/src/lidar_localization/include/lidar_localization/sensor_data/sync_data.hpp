@@ -0,0 +1,53 @@
+/*
+ * @Description: binary search of the interpolation interval shared by sensor data SyncData
+ * @Author: Ge Yao
+ * @Date: 2020-12-17 19:36:12
+ */
+#ifndef LIDAR_LOCALIZATION_SENSOR_DATA_SYNC_DATA_HPP_
+#define LIDAR_LOCALIZATION_SENSOR_DATA_SYNC_DATA_HPP_
+
+#include <deque>
+#include <algorithm>
+
+namespace lidar_localization {
+// max. time gap to either neighbour for interpolation to be valid:
+const double SYNC_DATA_MAX_GAP = 0.2;
+
+// on success, unsynced_data.at(0) and unsynced_data.at(1) enclose sync_time and are weighted by
+// front_scale and back_scale. measurements older than the interval are dropped, same as the
+// linear scan this replaces, but the interval is found by binary search.
+template<typename DataType>
+bool SeekSyncData(
+    std::deque<DataType>& unsynced_data, double sync_time,
+    double& front_scale, double& back_scale
+) {
+    if (unsynced_data.size() < 2 || unsynced_data.front().time > sync_time)
+        return false;
+
+    // first measurement not earlier than sync_time:
+    auto back_it = std::lower_bound(
+        unsynced_data.begin() + 1, unsynced_data.end(), sync_time,
+        [](const DataType& data, double time) { return data.time < time; }
+    );
+    // keep the last measurement, it may enclose the next sync time:
+    if (back_it == unsynced_data.end()) {
+        unsynced_data.erase(unsynced_data.begin(), unsynced_data.end() - 1);
+        return false;
+    }
+    unsynced_data.erase(unsynced_data.begin(), back_it - 1);
+
+    const DataType& front_data = unsynced_data.at(0);
+    const DataType& back_data = unsynced_data.at(1);
+    if (sync_time - front_data.time > SYNC_DATA_MAX_GAP || back_data.time - sync_time > SYNC_DATA_MAX_GAP) {
+        unsynced_data.pop_front();
+        return false;
+    }
+
+    front_scale = (back_data.time - sync_time) / (back_data.time - front_data.time);
+    back_scale = (sync_time - front_data.time) / (back_data.time - front_data.time);
+
+    return true;
+}
+}
+
+#endif
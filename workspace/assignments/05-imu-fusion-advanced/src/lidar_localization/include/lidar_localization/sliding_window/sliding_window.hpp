@@ -0,0 +1,107 @@
+/*
+ * @Description: lidar-IMU-GNSS fusion for localization by sliding window optimization
+ * @Author: Ge Yao
+ * @Date: 2020-12-25 10:06:18
+ */
+#ifndef LIDAR_LOCALIZATION_SLIDING_WINDOW_SLIDING_WINDOW_HPP_
+#define LIDAR_LOCALIZATION_SLIDING_WINDOW_SLIDING_WINDOW_HPP_
+
+#include <deque>
+#include <memory>
+
+#include <Eigen/Dense>
+#include <yaml-cpp/yaml.h>
+
+#include "lidar_localization/sensor_data/imu_data.hpp"
+#include "lidar_localization/sensor_data/pose_data.hpp"
+
+#include "lidar_localization/models/pre_integrator/imu_pre_integrator.hpp"
+#include "lidar_localization/models/graph_optimizer/sliding_window/sliding_window_graph_optimizer.hpp"
+
+#include "lidar_localization/tools/metrics.hpp"
+
+namespace lidar_localization {
+// one node per lidar odometry measurement, linked to the previous one by IMU pre-integration and
+// the relative lidar odometry motion, GNSS positions are priors on the nodes. the states are of the IMU, in map frame
+class SlidingWindow {
+  public:
+    SlidingWindow();
+
+    bool HasInited(void) const { return has_inited_; }
+    double GetTime(void) const { return time_; }
+
+    // lidar pose in IMU frame:
+    void SetLidarToIMU(const Eigen::Matrix4f& lidar_to_imu);
+    // measurements must be added in time order:
+    void AddIMUData(const IMUData& imu_data);
+    // whether the measurements cover time, i.e. the pre-integration up to time is complete:
+    bool HasIMUData(double time) const;
+
+    /**
+     * @brief  init with the first lidar odometry measurement
+     * @param  laser_odom, lidar pose in odometry frame
+     * @param  gnss_pose, lidar pose & velocity in map frame at the same time
+     * @return true if success otherwise false
+     */
+    bool Init(const PoseData& laser_odom, const PoseData& gnss_pose);
+    /**
+     * @brief  add a node for the lidar odometry measurement & optimize the window
+     * @param  laser_odom, lidar pose in odometry frame
+     * @param  gnss_pose_ptr, lidar pose in map frame at the same time, nullptr if not available
+     * @return true if success otherwise false
+     */
+    bool Update(const PoseData& laser_odom, const PoseData* gnss_pose_ptr);
+
+    // lidar pose in map frame & lidar velocity in lidar frame:
+    void GetOdometry(Eigen::Matrix4f& pose, Eigen::Vector3f& vel) const;
+    // approx. heap bytes held by IMU measurements, and by the window graph:
+    size_t GetIMUDataMemoryUsage(void) const;
+    size_t GetGraphMemoryUsage(void) const;
+
+  private:
+    bool InitWithConfig(void);
+    // measurement at time, linearly interpolated:
+    bool GetIMUData(double time, IMUData& imu_data) const;
+    bool PreIntegrate(double start_time, double end_time, IMUPreIntegrator& pre_integration);
+    void UpdateState(void);
+
+  private:
+    int window_size_ = 10;
+    bool use_gnss_ = true;
+    // max. gap between two measurements to integrate over:
+    double max_imu_gap_ = 0.05;
+
+    // variances, position x-y-z then rotation vector:
+    struct {
+      Eigen::VectorXd lidar_odometry;
+      Eigen::VectorXd gnss_position;
+      // of the first node:
+      Eigen::VectorXd prior_orientation;
+      Eigen::VectorXd prior_velocity;
+      Eigen::VectorXd prior_bias;
+    } noise_;
+    double gravity_magnitude_ = 9.81;
+
+    // noise config, copied for each pre-integration:
+    std::shared_ptr<IMUPreIntegrator> imu_pre_integrator_ptr_;
+
+    std::shared_ptr<SlidingWindowGraphOptimizer> graph_optimizer_ptr_;
+
+    Eigen::Matrix4d lidar_to_imu_ = Eigen::Matrix4d::Identity();
+    Eigen::Matrix4d imu_to_lidar_ = Eigen::Matrix4d::Identity();
+
+    std::deque<IMUData> imu_data_buff_;
+
+    bool has_inited_ = false;
+    double time_ = 0.0;
+    // lidar odometry of the latest node:
+    Eigen::Matrix4d last_laser_odom_ = Eigen::Matrix4d::Identity();
+    SlidingWindowGraphOptimizer::NavState state_;
+
+    Counter& missing_imu_;
+    Counter& failed_optimizations_;
+};
+
+} // namespace lidar_localization
+
+#endif // LIDAR_LOCALIZATION_SLIDING_WINDOW_SLIDING_WINDOW_HPP_
@@ -0,0 +1,113 @@
+/*
+ * @Description: lidar-IMU-GNSS fusion for localization by sliding window optimization workflow
+ * @Author: Ge Yao
+ * @Date: 2020-12-25 10:06:18
+ */
+#ifndef LIDAR_LOCALIZATION_SLIDING_WINDOW_SLIDING_WINDOW_FLOW_HPP_
+#define LIDAR_LOCALIZATION_SLIDING_WINDOW_SLIDING_WINDOW_FLOW_HPP_
+
+#include <ros/ros.h>
+
+// subscribers:
+// a. IMU:
+#include "lidar_localization/subscriber/imu_subscriber.hpp"
+// b. lidar odometry & GNSS:
+#include "lidar_localization/subscriber/odometry_subscriber.hpp"
+// c. lidar to IMU:
+#include "lidar_localization/tf_listener/tf_listener.hpp"
+
+// publishers:
+#include "lidar_localization/publisher/odometry_publisher.hpp"
+#include "lidar_localization/publisher/tf_broadcaster.hpp"
+
+// sliding window instance:
+#include "lidar_localization/sliding_window/sliding_window.hpp"
+
+// metrics:
+#include "lidar_localization/tools/metrics.hpp"
+#include "lidar_localization/tools/latency_tracer.hpp"
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+class SlidingWindowFlow {
+  public:
+    SlidingWindowFlow(ros::NodeHandle& nh);
+    bool Run();
+    // save odometry for evo evaluation:
+    bool SaveOdometry(void);
+
+  private:
+    bool ReadData();
+    bool InitCalibration();
+    bool HasData();
+    bool ValidData();
+    // GNSS measurement at time, if any:
+    bool GetGNSSData(const double time, PoseData& gnss_data);
+
+    bool UpdateLocalization();
+    bool PublishFusionOdom();
+
+    bool UpdateOdometry(const double &time);
+    /**
+     * @brief  save pose in KITTI format for evo evaluation
+     * @param  pose, input pose
+     * @param  ofs, output file stream
+     * @return true if success otherwise false
+     */
+    bool SavePose(
+        const Eigen::Matrix4f& pose,
+        std::ofstream& ofs
+    );
+
+  private:
+    // subscriber:
+    // a. IMU raw:
+    std::shared_ptr<IMUSubscriber> imu_raw_sub_ptr_;
+    std::deque<IMUData> imu_raw_data_buff_;
+    // b. lidar odometry:
+    std::shared_ptr<OdometrySubscriber> laser_odom_sub_ptr_;
+    std::deque<PoseData> laser_odom_data_buff_;
+    // c. GNSS:
+    std::shared_ptr<OdometrySubscriber> gnss_sub_ptr_;
+    std::deque<PoseData> gnss_data_buff_;
+    // d. lidar to imu tf:
+    std::shared_ptr<TFListener> lidar_to_imu_ptr_;
+
+    // publisher:
+    // a. odometry:
+    std::shared_ptr<OdometryPublisher> fused_odom_pub_ptr_;
+    // b. tf:
+    std::shared_ptr<TFBroadCaster> laser_tf_pub_ptr_;
+
+    // sliding window instance:
+    std::shared_ptr<SlidingWindow> sliding_window_ptr_;
+
+    PoseData current_laser_odom_data_;
+    PoseData current_gnss_data_;
+    bool has_current_gnss_data_ = false;
+
+    // fused odometry:
+    Eigen::Matrix4f fused_pose_ = Eigen::Matrix4f::Identity();
+    Eigen::Vector3f fused_vel_ = Eigen::Vector3f::Zero();
+
+    // trajectory for evo evaluation:
+    struct {
+      size_t N = 0;
+
+      std::deque<double> time_;
+      std::deque<Eigen::Matrix4f> fused_;
+      std::deque<Eigen::Matrix4f> gnss_;
+    } trajectory;
+
+    // metrics, latency is of lidar odometry updates:
+    FlowMetrics metrics_{"sliding_window_flow"};
+    LatencyHistogram* update_latency_ptr_;
+    Counter* missing_gnss_ptr_;
+    std::shared_ptr<LatencyTracer> latency_tracer_ptr_;
+};
+
+} // namespace lidar_localization
+
+#endif // LIDAR_LOCALIZATION_SLIDING_WINDOW_SLIDING_WINDOW_FLOW_HPP_
@@ -8,18 +8,29 @@
 #define LIDAR_LOCALIZATION_SUBSCRIBER_CLOUD_SUBSCRIBER_HPP_
 
 #include <deque>
-#include <mutex>
 #include <thread>
+#include <chrono>
+#include <memory>
 
 #include <ros/ros.h>
 #include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/point_cloud2_iterator.h>
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
 #include <pcl_conversions/pcl_conversions.h>
 
+#include <lidar_localization/CompressedCloud.h>
+
 #include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/sensor_data/range_image.hpp"
+#include "lidar_localization/subscriber/subscriber_buffer.hpp"
+#include "lidar_localization/tools/cloud_codec.hpp"
 
 namespace lidar_localization {
+// transport is looked up by topic name in config/subscriber/cloud_subscriber.yaml, falling back to its default.
+// with compressed transport, <topic>/compressed is subscribed instead, and it falls back to the raw topic when
+// no publisher of it shows up in time, e.g. one not configured for compressed transport.
+// with range_image enabled, each cloud comes with its range image, built once here
 class CloudSubscriber {
   public:
     CloudSubscriber(ros::NodeHandle& nh, std::string topic_name, size_t buff_size);
@@ -27,14 +38,38 @@ class CloudSubscriber {
     void ParseData(std::deque<CloudData>& deque_cloud_data);
 
   private:
+    bool InitOptions(const std::string& topic_name);
+    // switch to the raw topic once the compressed one timed out:
+    void UpdateTransport(void);
+
     void msg_callback(const sensor_msgs::PointCloud2::ConstPtr& cloud_msg_ptr);
+    void compressed_msg_callback(const CompressedCloud::ConstPtr& compressed_msg_ptr);
+    // read x, y, z by field offsets, without the intermediate pcl::PCLPointCloud2:
+    static void ParseCloudData(const sensor_msgs::PointCloud2& cloud_msg, CloudData& cloud_data);
+    // Velodyne float time in seconds or Ouster uint32 t in nanoseconds:
+    static void ParsePointTimes(const sensor_msgs::PointCloud2& cloud_msg, CloudData& cloud_data);
+    bool ParseCompressedData(const CompressedCloud& compressed_msg, CloudData& cloud_data);
+    void BuildRangeImage(CloudData& cloud_data);
 
   private:
     ros::NodeHandle nh_;
     ros::Subscriber subscriber_;
-    std::deque<CloudData> new_cloud_data_;
+    std::string topic_name_;
+    size_t buff_size_ = 0;
+    // messages are only converted when parsed:
+    SubscriberBuffer<sensor_msgs::PointCloud2::ConstPtr> new_cloud_msgs_;
+    SubscriberBuffer<CompressedCloud::ConstPtr> new_compressed_msgs_;
 
-    std::mutex buff_mutex_;
+    // compressed transport, until it falls back:
+    bool use_compressed_ = false;
+    bool has_compressed_publisher_ = false;
+    // in s of wall time:
+    double fallback_timeout_ = 0.0;
+    std::chrono::steady_clock::time_point subscribe_time_;
+    // null without compressed transport:
+    std::shared_ptr<CloudCodec> codec_ptr_;
+    // copied for each cloud, null without range images:
+    std::shared_ptr<RangeImage> range_image_ptr_;
 };
 }
 
@@ -7,13 +7,13 @@
 #define LIDAR_LOCALIZATION_SUBSCRIBER_GNSS_SUBSCRIBER_HPP_
 
 #include <deque>
-#include <mutex>
 #include <thread>
 
 #include <ros/ros.h>
 #include "sensor_msgs/NavSatFix.h"
 
 #include "lidar_localization/sensor_data/gnss_data.hpp"
+#include "lidar_localization/subscriber/subscriber_buffer.hpp"
 
 namespace lidar_localization {
 class GNSSSubscriber {
@@ -28,9 +28,7 @@ class GNSSSubscriber {
   private:
     ros::NodeHandle nh_;
     ros::Subscriber subscriber_;
-    std::deque<GNSSData> new_gnss_data_;
-
-    std::mutex buff_mutex_;
+    SubscriberBuffer<GNSSData> new_gnss_data_;
 };
 }
 #endif
\ No newline at end of file
@@ -7,13 +7,13 @@
 #define LIDAR_LOCALIZATION_SUBSCRIBER_IMU_SUBSCRIBER_HPP_
 
 #include <deque>
-#include <mutex>
 #include <thread>
 
 #include <ros/ros.h>
 #include "sensor_msgs/Imu.h"
 
 #include "lidar_localization/sensor_data/imu_data.hpp"
+#include "lidar_localization/subscriber/subscriber_buffer.hpp"
 
 namespace lidar_localization {
 class IMUSubscriber {
@@ -28,9 +28,7 @@ class IMUSubscriber {
   private:
     ros::NodeHandle nh_;
     ros::Subscriber subscriber_;
-    std::deque<IMUData> new_imu_data_;
-
-    std::mutex buff_mutex_; 
+    SubscriberBuffer<IMUData> new_imu_data_;
 };
 }
 #endif
\ No newline at end of file
@@ -7,13 +7,13 @@
 #define LIDAR_LOCALIZATION_SUBSCRIBER_KEY_FRAME_SUBSCRIBER_HPP_
 
 #include <deque>
-#include <mutex>
 #include <thread>
 
 #include <ros/ros.h>
 #include <geometry_msgs/PoseWithCovarianceStamped.h>
 
 #include "lidar_localization/sensor_data/key_frame.hpp"
+#include "lidar_localization/subscriber/subscriber_buffer.hpp"
 
 namespace lidar_localization {
 class KeyFrameSubscriber {
@@ -28,9 +28,7 @@ class KeyFrameSubscriber {
   private:
     ros::NodeHandle nh_;
     ros::Subscriber subscriber_;
-    std::deque<KeyFrame> new_key_frame_;
-
-    std::mutex buff_mutex_; 
+    SubscriberBuffer<KeyFrame> new_key_frame_;
 };
 }
 #endif
\ No newline at end of file
@@ -7,6 +7,7 @@
 #define LIDAR_LOCALIZATION_SUBSCRIBER_KEY_FRAMES_SUBSCRIBER_HPP_
 
 #include <deque>
+#include <vector>
 #include <mutex>
 #include <thread>
 
@@ -14,24 +15,34 @@
 #include <nav_msgs/Path.h>
 #include <geometry_msgs/PoseStamped.h>
 
+#include <lidar_localization/KeyFrameUpdates.h>
+
 #include "lidar_localization/sensor_data/key_frame.hpp"
 
 namespace lidar_localization {
 class KeyFramesSubscriber {
   public:
-    KeyFramesSubscriber(ros::NodeHandle& nh, std::string topic_name, size_t buff_size);
+    // incremental, from <topic>/incremental of a KeyFramesPublisher in incremental mode.
+    // ParseData then gives the key frames from the first one added or moved on:
+    KeyFramesSubscriber(ros::NodeHandle& nh, std::string topic_name, size_t buff_size, bool is_incremental = false);
     KeyFramesSubscriber() = default;
     void ParseData(std::deque<KeyFrame>& deque_key_frames);
 
   private:
     void msg_callback(const nav_msgs::Path::ConstPtr& key_frames_msg_ptr);
+    void updates_callback(const KeyFrameUpdates::ConstPtr& updates_msg_ptr);
 
   private:
     ros::NodeHandle nh_;
     ros::Subscriber subscriber_;
     std::deque<KeyFrame> new_key_frames_;
 
+    // incremental, the whole trajectory sorted by index & the position of its first update since ParseData:
+    std::vector<KeyFrame> key_frames_;
+    size_t first_updated_ = 0;
+    bool has_updates_ = false;
+
     std::mutex buff_mutex_; 
 };
 }
-#endif
\ No newline at end of file
+#endif
@@ -8,7 +8,6 @@
 #define LIDAR_LOCALIZATION_SUBSCRIBER_LIDAR_MEASUREMENT_SUBSCRIBER_HPP_
 
 #include <deque>
-#include <mutex>
 #include <thread>
 
 #include <ros/ros.h>
@@ -24,6 +23,7 @@
 #include <lidar_localization/LidarMeasurement.h>
 
 #include "lidar_localization/sensor_data/lidar_measurement_data.hpp"
+#include "lidar_localization/subscriber/subscriber_buffer.hpp"
 
 namespace lidar_localization {
 
@@ -51,9 +51,7 @@ class LidarMeasurementSubscriber {
   private:
     ros::NodeHandle nh_;
     ros::Subscriber subscriber_;
-    std::deque<LidarMeasurementData> new_cloud_data_;
-
-    std::mutex buff_mutex_;
+    SubscriberBuffer<LidarMeasurementData> new_cloud_data_;
 };
 
 } // namespace lidar_localization
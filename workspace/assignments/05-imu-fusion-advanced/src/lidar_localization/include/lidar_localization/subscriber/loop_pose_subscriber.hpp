@@ -7,13 +7,13 @@
 #define LIDAR_LOCALIZATION_SUBSCRIBER_LOOP_POSE_SUBSCRIBER_HPP_
 
 #include <deque>
-#include <mutex>
 #include <thread>
 
 #include <ros/ros.h>
 #include <geometry_msgs/PoseWithCovarianceStamped.h>
 
 #include "lidar_localization/sensor_data/loop_pose.hpp"
+#include "lidar_localization/subscriber/subscriber_buffer.hpp"
 
 namespace lidar_localization {
 class LoopPoseSubscriber {
@@ -28,9 +28,7 @@ class LoopPoseSubscriber {
   private:
     ros::NodeHandle nh_;
     ros::Subscriber subscriber_;
-    std::deque<LoopPose> new_loop_pose_;
-
-    std::mutex buff_mutex_; 
+    SubscriberBuffer<LoopPose> new_loop_pose_;
 };
 }
 #endif
\ No newline at end of file
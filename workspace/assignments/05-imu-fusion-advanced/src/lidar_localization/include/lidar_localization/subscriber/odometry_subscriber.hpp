@@ -7,13 +7,13 @@
 #define LIDAR_LOCALIZATION_SUBSCRIBER_ODOMETRY_SUBSCRIBER_HPP_
 
 #include <deque>
-#include <mutex>
 #include <thread>
 
 #include <ros/ros.h>
 #include <nav_msgs/Odometry.h>
 
 #include "lidar_localization/sensor_data/pose_data.hpp"
+#include "lidar_localization/subscriber/subscriber_buffer.hpp"
 
 namespace lidar_localization {
 class OdometrySubscriber {
@@ -28,9 +28,7 @@ class OdometrySubscriber {
   private:
     ros::NodeHandle nh_;
     ros::Subscriber subscriber_;
-    std::deque<PoseData> new_pose_data_;
-
-    std::mutex buff_mutex_; 
+    SubscriberBuffer<PoseData> new_pose_data_;
 };
 }
 #endif
\ No newline at end of file
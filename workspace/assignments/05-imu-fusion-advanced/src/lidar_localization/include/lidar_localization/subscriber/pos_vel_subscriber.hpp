@@ -7,7 +7,6 @@
 #define LIDAR_LOCALIZATION_SUBSCRIBER_POS_VEL_SUBSCRIBER_HPP_
 
 #include <deque>
-#include <mutex>
 #include <thread>
 
 #include <ros/ros.h>
@@ -15,6 +14,7 @@
 
 #include "lidar_localization/PosVel.h"
 #include "lidar_localization/sensor_data/pos_vel_data.hpp"
+#include "lidar_localization/subscriber/subscriber_buffer.hpp"
 
 namespace lidar_localization {
 
@@ -34,9 +34,7 @@ class PosVelSubscriber {
   private:
     ros::NodeHandle nh_;
     ros::Subscriber subscriber_;
-    std::deque<PosVelData> new_pos_vel_data_;
-
-    std::mutex buff_mutex_; 
+    SubscriberBuffer<PosVelData> new_pos_vel_data_;
 };
 
 } // namespace lidar_localization
@@ -0,0 +1,113 @@
+/*
+ * @Description: lock-free single-producer single-consumer buffer between subscriber callback and ParseData
+ * @Author: Ge Yao
+ * @Date: 2020-12-15 21:08:36
+ */
+#ifndef LIDAR_LOCALIZATION_SUBSCRIBER_SUBSCRIBER_BUFFER_HPP_
+#define LIDAR_LOCALIZATION_SUBSCRIBER_SUBSCRIBER_BUFFER_HPP_
+
+#include <cstddef>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+#include <Eigen/Core>
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+// the callback is the only producer and ParseData the only consumer.
+// measurements are moved in and out of pre-allocated slots, a full buffer drops the newest one.
+template<typename DataType>
+class SubscriberBuffer {
+  public:
+    static const size_t DEFAULT_CAPACITY = 1 << 10;
+    static const size_t MAX_CAPACITY = 1 << 16;
+
+    explicit SubscriberBuffer(size_t capacity = DEFAULT_CAPACITY)
+        : capacity_(GetCapacity(capacity)),
+          mask_(capacity_ - 1),
+          slots_(capacity_) {
+    }
+
+    SubscriberBuffer(const SubscriberBuffer&) = delete;
+    SubscriberBuffer& operator=(const SubscriberBuffer&) = delete;
+
+    ~SubscriberBuffer() {
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        for (size_t i = head_.load(std::memory_order_relaxed); i != tail; ++i) {
+            GetSlot(i)->~DataType();
+        }
+    }
+
+    // producer side:
+    bool Push(DataType&& data) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == capacity_) {
+            const size_t num_dropped = num_dropped_.fetch_add(1, std::memory_order_relaxed) + 1;
+            LOG_EVERY_N(WARNING, 100) << "Subscriber buffer full, " << num_dropped << " measurements dropped.";
+            return false;
+        }
+
+        new (GetSlot(tail)) DataType(std::move(data));
+        tail_.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // consumer side, move all available measurements to the end of buff:
+    void Drain(std::deque<DataType>& buff) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        const size_t tail = tail_.load(std::memory_order_acquire);
+
+        for (size_t i = head; i != tail; ++i) {
+            DataType* data = GetSlot(i);
+            buff.push_back(std::move(*data));
+            data->~DataType();
+        }
+
+        head_.store(tail, std::memory_order_release);
+    }
+
+    // a statistic, no ordering with the measurements needed:
+    size_t GetNumDropped(void) const { return num_dropped_.load(std::memory_order_relaxed); }
+
+  private:
+    using Slot = typename std::aligned_storage<sizeof(DataType), alignof(DataType)>::type;
+
+    static size_t GetCapacity(size_t capacity) {
+        size_t result = 1;
+        while (result < capacity && result < MAX_CAPACITY) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    DataType* GetSlot(size_t i) {
+        return reinterpret_cast<DataType*>(&slots_[i & mask_]);
+    }
+
+  private:
+    const size_t capacity_;
+    const size_t mask_;
+    // measurements holding fixed-size Eigen members need the stronger alignment:
+    std::vector<Slot, Eigen::aligned_allocator<Slot>> slots_;
+
+    // keep the two indices on separate cache lines:
+    char padding_head_[64];
+    std::atomic<size_t> head_{0};
+    char padding_tail_[64];
+    std::atomic<size_t> tail_{0};
+    // written by the producer, may be read from the consumer thread:
+    std::atomic<size_t> num_dropped_{0};
+};
+
+template<typename DataType>
+const size_t SubscriberBuffer<DataType>::DEFAULT_CAPACITY;
+template<typename DataType>
+const size_t SubscriberBuffer<DataType>::MAX_CAPACITY;
+}
+
+#endif
@@ -7,13 +7,13 @@
 #define LIDAR_LOCALIZATION_SUBSCRIBER_VELOCITY_SUBSCRIBER_HPP_
 
 #include <deque>
-#include <mutex>
 #include <thread>
 
 #include <ros/ros.h>
 #include "geometry_msgs/TwistStamped.h"
 
 #include "lidar_localization/sensor_data/velocity_data.hpp"
+#include "lidar_localization/subscriber/subscriber_buffer.hpp"
 
 namespace lidar_localization {
 class VelocitySubscriber {
@@ -28,9 +28,7 @@ class VelocitySubscriber {
   private:
     ros::NodeHandle nh_;
     ros::Subscriber subscriber_;
-    std::deque<VelocityData> new_velocity_data_;
-
-    std::mutex buff_mutex_; 
+    SubscriberBuffer<VelocityData> new_velocity_data_;
 };
 }
 #endif
\ No newline at end of file
@@ -11,6 +11,7 @@
 #include <Eigen/Dense>
 #include <ros/ros.h>
 #include <tf/transform_listener.h>
+#include <tf2_msgs/TFMessage.h>
 
 namespace lidar_localization {
 class TFListener {
@@ -21,6 +22,7 @@ class TFListener {
     bool LookupData(Eigen::Matrix4f& transform_matrix);
   
   private:
+    void tf_callback(const tf2_msgs::TFMessageConstPtr& tf_msg_ptr);
     bool TransformToMatrix(const tf::StampedTransform& transform, Eigen::Matrix4f& transform_matrix);
 
   private:
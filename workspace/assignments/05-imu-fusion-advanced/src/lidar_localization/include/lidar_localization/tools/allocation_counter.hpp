@@ -0,0 +1,22 @@
+/*
+ * @Description: per-thread count of heap allocations, for benchmarks of hot paths that should not allocate
+ * @Author: Ge Yao
+ * @Date: 2021-01-19 10:14:27
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_ALLOCATION_COUNTER_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_ALLOCATION_COUNTER_HPP_
+
+#include <cstdint>
+
+namespace lidar_localization {
+// malloc & co. of glibc are interposed, so operator new, Eigen & C allocations are all counted.
+// only in targets built with LIDAR_LOCALIZATION_COUNT_ALLOCATIONS, i.e. the benchmarks, the nodes allocate as usual
+class AllocationCounter {
+  public:
+    static bool IsEnabled(void);
+    // allocations of the calling thread so far, 0 if not enabled:
+    static uint64_t GetNumAllocations(void);
+};
+} // namespace lidar_localization
+
+#endif // LIDAR_LOCALIZATION_TOOLS_ALLOCATION_COUNTER_HPP_
@@ -0,0 +1,74 @@
+/*
+ * @Description: save & optimize jobs of the services, run in the background on state captured by the caller
+ * @Author: Ge Yao
+ * @Date: 2021-01-31 20:16:08
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_BACKGROUND_JOBS_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_BACKGROUND_JOBS_HPP_
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+
+#include <ros/ros.h>
+
+#include <lidar_localization/JobStatus.h>
+
+namespace lidar_localization {
+// one worker runs the jobs in submission order. a job works on a snapshot taken by the caller on its own thread,
+// e.g. copies of the key frames, so the service returns the job id at once and the main loop is never blocked.
+// every state change & progress step is published as JobStatus on <nh namespace>/background_jobs, latched.
+class BackgroundJobs {
+  public:
+    // fraction done in [0, 1], with a note on the current step:
+    typedef std::function<void(double progress, const std::string& message)> Progress;
+    // true if the job succeeded:
+    typedef std::function<bool(const Progress& progress)> Job;
+
+    BackgroundJobs(ros::NodeHandle& nh);
+    // the queued jobs are run before the worker exits, so a save requested right before shutdown is kept:
+    ~BackgroundJobs();
+
+    /**
+     * @brief  queue a job
+     * @param  name, e.g. save_map. a queued, not yet running job of the same name is replaced,
+     *         as the new snapshot is the more recent one, and keeps its id
+     * @param  job, the job
+     * @return job id, 0 if the job is empty
+     */
+    uint32_t Submit(const std::string& name, Job job);
+    // wait until every queued job is done:
+    void Flush(void);
+
+  private:
+    struct Task {
+      uint32_t id;
+      std::string name;
+      Job job;
+    };
+
+    void Publish(uint32_t id, const std::string& name, uint8_t state, double progress, const std::string& message);
+    void Run(void);
+
+  private:
+    ros::Publisher publisher_;
+
+    std::mutex mutex_;
+    std::condition_variable has_task_;
+    std::condition_variable is_idle_;
+
+    std::deque<Task> queue_;
+    uint32_t last_id_ = 0;
+    bool is_running_ = false;
+    bool stop_ = false;
+
+    // runs the jobs in queue_ one at a time:
+    std::thread thread_;
+};
+} // namespace lidar_localization
+
+#endif
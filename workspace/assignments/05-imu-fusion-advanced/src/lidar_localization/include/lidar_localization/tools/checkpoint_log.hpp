@@ -0,0 +1,107 @@
+/*
+ * @Description: binary, append-only log of state changes, replayed to restore a node after restart
+ * @Author: Ge Yao
+ * @Date: 2021-01-12 20:37:16
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_CHECKPOINT_LOG_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_CHECKPOINT_LOG_HPP_
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+
+namespace lidar_localization {
+// layout:
+//   a FileHeader, then batches, each a BatchHeader followed by its records, each a RecordHeader & size bytes.
+//   the records are typed by the caller. a batch is replayed only if it is completely on disk & its checksum matches,
+//   so the state replayed is always the one of a commit, never half of one.
+// records are added to the current batch by the caller, committed batches are written & synced on a worker thread.
+class CheckpointLog {
+  public:
+    struct Stats {
+      size_t num_batches = 0;
+      size_t num_records = 0;
+      size_t num_bytes_written = 0;
+      size_t num_failed = 0;
+    };
+
+    // returns false to stop the replay:
+    typedef std::function<bool(uint32_t type, const char *data, size_t size)> RecordHandler;
+
+    // appended to if it exists, a batch cut short by a crash is dropped. is_truncated starts an empty log:
+    CheckpointLog(const std::string& file_path, bool is_truncated);
+    ~CheckpointLog();
+
+    void Add(uint32_t type, const void *data, size_t size);
+    template <typename Record>
+    void Add(uint32_t type, const Record& record) { Add(type, &record, sizeof(record)); }
+    // hand the current batch to the worker, no-op if it is empty:
+    void Commit(void);
+    // wait until every committed batch is on disk:
+    void Flush(void);
+
+    Stats GetStats(void);
+
+    // replay the records of all complete batches in order. false if the log cannot be read or the handler stops:
+    static bool Replay(const std::string& file_path, const RecordHandler& handler);
+
+  private:
+    struct FileHeader {
+      uint32_t magic;
+      uint32_t version;
+    };
+
+    struct BatchHeader {
+      uint32_t num_records;
+      uint32_t checksum;
+      uint64_t size;
+    };
+
+    struct RecordHeader {
+      uint32_t type;
+      uint32_t size;
+    };
+
+    struct Batch {
+      uint32_t num_records = 0;
+      std::vector<char> data;
+    };
+
+    // valid_size, of the header & the complete batches, 0 if it is not a checkpoint log. handler may be empty:
+    static bool Read(const std::string& file_path, const RecordHandler& handler, size_t& valid_size);
+    static uint32_t GetChecksum(const char *data, size_t size);
+
+    bool Open(void);
+    bool WriteBatch(const Batch& batch);
+    void Run(void);
+
+  private:
+    std::string file_path_;
+    bool is_truncated_;
+
+    // caller side:
+    Batch batch_;
+
+    std::mutex mutex_;
+    std::condition_variable has_task_;
+    std::condition_variable is_idle_;
+
+    std::deque<Batch> queue_;
+    bool is_writing_ = false;
+    bool stop_ = false;
+    Stats stats_;
+
+    // worker side:
+    int fd_ = -1;
+
+    // writes the batches in queue_ through fd_:
+    std::thread thread_;
+};
+}
+
+#endif
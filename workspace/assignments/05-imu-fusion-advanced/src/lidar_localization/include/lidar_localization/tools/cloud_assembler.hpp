@@ -0,0 +1,53 @@
+/*
+ * @Description: assembly of maps from many transformed clouds, in one allocation & one pass over the points
+ * @Author: Ge Yao
+ * @Date: 2021-01-17 15:42:19
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_CLOUD_ASSEMBLER_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_CLOUD_ASSEMBLER_HPP_
+
+#include <cstddef>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/sensor_data/compact_cloud.hpp"
+
+namespace lidar_localization {
+// replaces pcl::transformPointCloud into a temporary followed by operator+=, which copies every point twice
+// and grows the map once per cloud. the clouds are only referenced until Assemble, so they must not change before.
+// unlike pcl, NaN points are transformed too and stay NaN.
+class CloudAssembler {
+  public:
+    // the cloud in the frame given by pose:
+    void Add(const CloudData::CLOUD::ConstPtr& cloud_ptr, const Eigen::Matrix4f& pose);
+    // decoded while transformed, with the other fields of the points default:
+    void Add(const CompactCloud::ConstPtr& compact_cloud_ptr, const Eigen::Matrix4f& pose);
+    size_t GetNumPoints(void) const { return num_points_; }
+
+    // append the transformed clouds to map_cloud, whose size grows only once:
+    void Assemble(CloudData::CLOUD& map_cloud);
+
+    // transform the num_points points of input into output, which may be input:
+    static void Transform(
+      const CloudData::POINT *input, size_t num_points, const Eigen::Matrix4f& pose,
+      CloudData::POINT *output
+    );
+
+  private:
+    struct Part {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      // one of them:
+      CloudData::CLOUD::ConstPtr cloud_ptr;
+      CompactCloud::ConstPtr compact_cloud_ptr;
+      Eigen::Matrix4f pose;
+    };
+
+    std::vector<Part, Eigen::aligned_allocator<Part>> parts_;
+    size_t num_points_ = 0;
+};
+} // namespace lidar_localization
+
+#endif // LIDAR_LOCALIZATION_TOOLS_CLOUD_ASSEMBLER_HPP_
@@ -0,0 +1,50 @@
+/*
+ * @Description: compact point cloud encoding for the transport between hosts
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 09:26:40
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_CLOUD_CODEC_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_CLOUD_CODEC_HPP_
+
+#include <cstdint>
+#include <vector>
+
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+
+namespace lidar_localization {
+// x, y & z are quantized to fixed point of the given resolution, and each one is coded as the zig-zag varint of its
+// delta to the previous point, so neighbors along the scan order take 1 or 2 bytes per coordinate.
+// the varint stream is then LZ4 compressed, if built with LZ4 and it pays off.
+// lossy by up to half the resolution, coordinates beyond 2^31 resolutions are clamped.
+// non-finite points are dropped and only x, y & z are kept
+class CloudCodec {
+  public:
+    enum Compression : uint8_t {
+      NONE = 0,
+      LZ4 = 1
+    };
+
+    // everything but the payload, as carried by CompressedCloud.msg:
+    struct FrameInfo {
+      uint32_t num_points = 0;
+      float resolution = 0.0f;
+      uint8_t compression = NONE;
+      // size of the varint stream:
+      uint32_t raw_size = 0;
+    };
+
+    CloudCodec(float resolution, bool use_lz4);
+
+    bool Encode(const CloudData::CLOUD& cloud, FrameInfo& info, std::vector<uint8_t>& data);
+    bool Decode(const FrameInfo& info, const std::vector<uint8_t>& data, CloudData::CLOUD& cloud);
+
+  private:
+    float resolution_;
+    bool use_lz4_;
+
+    // varint stream, reused from frame to frame:
+    std::vector<uint8_t> raw_;
+};
+} // namespace lidar_localization
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ * @Description: load shedding decisions of a flow, to keep its output latency bounded on a busy CPU
+ * @Author: Ge Yao
+ * @Date: 2020-12-30 15:32:09
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_DEADLINE_POLICY_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_DEADLINE_POLICY_HPP_
+
+#include <yaml-cpp/yaml.h>
+
+#include "lidar_localization/tools/metrics.hpp"
+
+namespace lidar_localization {
+// a measurement older than the latest received one by more than max_delay is stale, and is skipped.
+// the load level follows the smoothed processing time of the measurements that are not: one level up over
+// the budget, one level down under half of it, at least min_dwell measurements apart. level 0 is full quality,
+// what a level degrades is up to the flow. every decision is counted in the metrics of the flow
+class DeadlinePolicy {
+  public:
+    /**
+     * @brief  load shedding policy of a flow
+     * @param  node, config with enabled, max_delay, processing_budget & min_dwell
+     * @param  num_levels, num. of degraded levels
+     * @param  metrics, metrics of the flow, stale_measurements, load_level_ups, load_level_downs,
+     *         degraded_measurements & load_level are added
+     */
+    DeadlinePolicy(const YAML::Node& node, int num_levels, FlowMetrics& metrics);
+
+    // stale measurements are counted:
+    bool IsStale(double time, double latest_time);
+    // processing time of a measurement in seconds, true if the load level changed:
+    bool Update(double processing_time);
+
+    int GetLevel(void) const { return level_; }
+
+  private:
+    bool enabled_;
+    double max_delay_;
+    double processing_budget_;
+    int min_dwell_;
+    int num_levels_;
+
+    int level_ = 0;
+    // measurements since the last level change:
+    int dwell_ = 0;
+    bool has_processing_time_ = false;
+    double smoothed_processing_time_ = 0.0;
+
+    Counter& stale_measurements_;
+    Counter& load_level_ups_;
+    Counter& load_level_downs_;
+    Counter& degraded_measurements_;
+    Gauge& load_level_;
+};
+} // namespace lidar_localization
+
+#endif
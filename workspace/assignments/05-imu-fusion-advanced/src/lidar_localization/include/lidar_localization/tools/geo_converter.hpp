@@ -0,0 +1,54 @@
+/*
+ * @Description: geodetic to local ENU conversion around a fixed origin
+ * @Author: Ge Yao
+ * @Date: 2021-01-01 14:36:50
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_GEO_CONVERTER_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_GEO_CONVERTER_HPP_
+
+#include <deque>
+
+#include <Eigen/Dense>
+
+#include "lidar_localization/sensor_data/gnss_data.hpp"
+
+namespace lidar_localization {
+// the converter of one flow, immutable once its origin is set so it can be shared by any number of threads.
+// the ECEF origin & the ECEF to ENU rotation are computed up front, a conversion only maps the fix to ECEF,
+// and a batch of fixes is rotated in one matrix product
+class GeoConverter {
+  public:
+    GeoConverter(double origin_latitude, double origin_longitude, double origin_altitude);
+
+    // latitude & longitude in degrees, altitude in meters:
+    void Forward(
+        double latitude, double longitude, double altitude,
+        double& local_E, double& local_N, double& local_U
+    ) const;
+    void Forward(GNSSData& gnss_data) const;
+    // local E, N & U of the fixes in [begin, end):
+    void Forward(std::deque<GNSSData>::iterator begin, std::deque<GNSSData>::iterator end) const;
+
+    double GetOriginLatitude() const { return origin_latitude_; }
+    double GetOriginLongitude() const { return origin_longitude_; }
+    double GetOriginAltitude() const { return origin_altitude_; }
+
+  private:
+    Eigen::Vector3d GetECEF(double latitude, double longitude, double altitude) const;
+
+  private:
+    double origin_latitude_;
+    double origin_longitude_;
+    double origin_altitude_;
+
+    // WGS84 ellipsoid:
+    double a_;
+    double e2_;
+
+    Eigen::Vector3d origin_ecef_;
+    // rows are E, N & U in ECEF:
+    Eigen::Matrix3d R_enu_ecef_;
+};
+} // namespace lidar_localization
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ * @Description: background writer for key frame point clouds
+ * @Author: Ge Yao
+ * @Date: 2020-12-06 20:13:41
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_KEY_FRAME_WRITER_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_KEY_FRAME_WRITER_HPP_
+
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/models/key_frame_store/key_frame_store_interface.hpp"
+
+namespace lidar_localization {
+class KeyFrameWriter {
+  public:
+    struct Stats {
+      size_t queue_depth = 0;
+      size_t max_queue_depth = 0;
+      size_t num_written = 0;
+      size_t num_failed = 0;
+      // number of Write calls which had to wait for a free slot:
+      size_t num_blocked = 0;
+    };
+
+    KeyFrameWriter(std::shared_ptr<KeyFrameStoreInterface> store_ptr, size_t max_queue_size = 32);
+    ~KeyFrameWriter();
+
+    // the writer takes over the cloud, callers must not modify it afterwards.
+    // blocks only when the queue is full:
+    bool Write(unsigned int index, CloudData::CLOUD::ConstPtr cloud_ptr);
+    // wait until every queued cloud is on disk:
+    void Flush(void);
+
+    size_t GetQueueDepth(void);
+    Stats GetStats(void);
+
+  private:
+    struct Task {
+      unsigned int index;
+      CloudData::CLOUD::ConstPtr cloud_ptr;
+    };
+
+    void Run(void);
+
+  private:
+    std::shared_ptr<KeyFrameStoreInterface> store_ptr_;
+    size_t max_queue_size_;
+
+    std::mutex mutex_;
+    std::condition_variable has_task_;
+    std::condition_variable has_slot_;
+    std::condition_variable is_idle_;
+
+    std::deque<Task> queue_;
+    bool is_writing_ = false;
+    bool stop_ = false;
+    Stats stats_;
+
+    // started last, after all the state above is ready:
+    std::thread thread_;
+};
+}
+
+#endif
@@ -0,0 +1,77 @@
+/*
+ * @Description: end-to-end latency stamping, as the side channel <topic>/trace of the traced topics
+ * @Author: Ge Yao
+ * @Date: 2020-12-24 10:12:36
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_LATENCY_TRACER_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_LATENCY_TRACER_HPP_
+
+#include <cstdint>
+#include <string>
+#include <deque>
+
+#include <ros/ros.h>
+
+#include <lidar_localization/ProcessingTrace.h>
+
+#include "lidar_localization/subscriber/subscriber_buffer.hpp"
+#include "lidar_localization/tools/metrics.hpp"
+
+namespace lidar_localization {
+// each flow continues the trace of the measurement it processes with its own hops, <flow>/receive,
+// <flow>/start and <flow>/publish, and passes it on to the next flow, so the trace of the final output
+// holds the whole breakdown. the trace is published just before the traced message, so it is usually
+// received first. a measurement without upstream trace starts a new one, from its sensor time mapped
+// onto the monotonic clock through the ROS clock, so the sensor hop is only meaningful online.
+class LatencyTracer {
+  public:
+    /**
+     * @brief  latency tracer of a flow
+     * @param  nh, node handle
+     * @param  flow_name, hop prefix, e.g. front_end
+     * @param  input_topic, traced input topic, empty for the first flow
+     * @param  output_topic, traced output topic
+     * @param  metrics, metrics of the flow, end_to_end_latency & over_latency_budget are added
+     */
+    LatencyTracer(
+        ros::NodeHandle& nh,
+        const std::string& flow_name,
+        const std::string& input_topic,
+        const std::string& output_topic,
+        FlowMetrics& metrics
+    );
+
+    // start the trace of the measurement at time:
+    void Start(double time);
+    // stamp a stage of the current measurement, e.g. correct:
+    void AddHop(const std::string& stage);
+    // stamp publish and publish the trace, call just before publishing the traced message:
+    void Publish(void);
+
+  private:
+    struct ReceivedTrace {
+      ProcessingTrace::ConstPtr trace_ptr;
+      int64_t receive_stamp;
+    };
+
+    void msg_callback(const ProcessingTrace::ConstPtr& trace_msg_ptr);
+    // the upstream trace of the measurement at time, older ones are dropped:
+    bool GetUpstreamTrace(double time, ReceivedTrace& received_trace);
+
+  private:
+    std::string flow_name_;
+
+    ros::Subscriber subscriber_;
+    ros::Publisher publisher_;
+    SubscriberBuffer<ReceivedTrace> new_traces_;
+    std::deque<ReceivedTrace> trace_buff_;
+
+    ProcessingTrace trace_;
+
+    double latency_budget_;
+    LatencyHistogram& end_to_end_latency_;
+    Counter& over_latency_budget_;
+};
+} // namespace lidar_localization
+
+#endif
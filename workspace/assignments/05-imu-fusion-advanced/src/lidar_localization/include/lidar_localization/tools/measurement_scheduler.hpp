@@ -0,0 +1,121 @@
+/*
+ * @Description: time-ordered dispatch of measurements from several sensor streams
+ * @Author: Ge Yao
+ * @Date: 2021-01-24 16:05:37
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_MEASUREMENT_SCHEDULER_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_MEASUREMENT_SCHEDULER_HPP_
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+
+namespace lidar_localization {
+// each sensor stream buffers its measurements in arrival order, subscribers parse into the buffer directly.
+// Dispatch merges the stream fronts on a min-heap by time, so every measurement is handed to the callback
+// of its stream exactly once and in time order across streams, at O(log k) for k streams.
+//
+// a measurement is held back while an empty stream might still deliver an older one: it waits for
+// stream s until the newest time received on any stream is max_wait of s past it. max_wait 0 never waits.
+// measurements older than the last dispatched, e.g. a lidar scan behind the IMU, are still dispatched
+// and counted as late, the callback decides whether to use them. ties go to the stream added first.
+//
+// callbacks may read the buffers, but must not add measurements while dispatching.
+class MeasurementScheduler {
+  public:
+    struct Stats {
+      size_t num_dispatched = 0;
+      size_t num_late = 0;
+    };
+
+    class StreamBase {
+      public:
+        StreamBase(const std::string& name, double max_wait) : name_(name), max_wait_(max_wait) {}
+        virtual ~StreamBase() {}
+
+        const std::string& GetName(void) const { return name_; }
+        double GetMaxWait(void) const { return max_wait_; }
+        const Stats& GetStats(void) const { return stats_; }
+
+        virtual size_t GetSize(void) const = 0;
+        virtual double GetFrontTime(void) const = 0;
+        virtual double GetBackTime(void) const = 0;
+
+      private:
+        friend class MeasurementScheduler;
+
+        // hands the front measurement to the callback and pops it:
+        virtual void Dispatch(void) = 0;
+
+        std::string name_;
+        double max_wait_;
+        Stats stats_;
+    };
+
+    // MeasurementType has a time member, in seconds:
+    template<typename MeasurementType>
+    class Stream: public StreamBase {
+      public:
+        using Callback = std::function<void(const MeasurementType&)>;
+
+        Stream(const std::string& name, double max_wait, Callback callback)
+            : StreamBase(name, max_wait), callback_(callback) {}
+
+        size_t GetSize(void) const override { return buffer.size(); }
+        double GetFrontTime(void) const override { return buffer.front().time; }
+        double GetBackTime(void) const override { return buffer.back().time; }
+
+        std::deque<MeasurementType> buffer;
+
+      private:
+        void Dispatch(void) override {
+            callback_(buffer.front());
+            buffer.pop_front();
+        }
+
+        Callback callback_;
+    };
+
+    /**
+     * @brief  add a sensor stream
+     * @param  name, stream name, for logs
+     * @param  max_wait, how long measurements of other streams wait for this one when it is empty, in seconds
+     * @param  callback, called once per measurement, in time order
+     * @return the stream, its buffer is to be filled by the subscriber
+     */
+    template<typename MeasurementType>
+    Stream<MeasurementType>& AddStream(
+        const std::string& name, double max_wait,
+        typename Stream<MeasurementType>::Callback callback
+    ) {
+        Stream<MeasurementType>* stream_ptr = new Stream<MeasurementType>(name, max_wait, callback);
+        streams_.emplace_back(stream_ptr);
+
+        return *stream_ptr;
+    }
+
+    /**
+     * @brief  dispatch the buffered measurements in time order
+     * @param  flush, dispatch all, without waiting for empty streams, e.g. at the end of a sequence
+     * @return num. of measurements dispatched
+     */
+    size_t Dispatch(bool flush = false);
+
+    // time of the last dispatched measurement, negative before the first:
+    double GetTime(void) const { return time_; }
+    size_t GetNumStreams(void) const { return streams_.size(); }
+    const StreamBase& GetStream(size_t index) const { return *streams_.at(index); }
+
+  private:
+    std::vector<std::unique_ptr<StreamBase>> streams_;
+
+    double time_ = -1.0;
+    // newest measurement time received on any stream:
+    double newest_time_ = -1.0;
+};
+}
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ * @Description: approx. heap bytes held by containers, for per-module memory accounting
+ * @Author: Ge Yao
+ * @Date: 2021-01-10 20:14:37
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_MEMORY_USAGE_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_MEMORY_USAGE_HPP_
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+
+namespace lidar_localization {
+// element payloads only, by capacity where the container exposes it. allocator & node overheads are not counted,
+// and elements holding heap memory of their own are only counted by the overloads for them:
+template <typename T, typename Allocator>
+size_t GetMemoryUsage(const std::vector<T, Allocator>& data) {
+    return data.capacity() * sizeof(T);
+}
+
+template <typename T, typename Allocator>
+size_t GetMemoryUsage(const std::deque<T, Allocator>& data) {
+    return data.size() * sizeof(T);
+}
+
+template <typename T, typename Allocator, typename OuterAllocator>
+size_t GetMemoryUsage(const std::vector<std::vector<T, Allocator>, OuterAllocator>& data) {
+    size_t memory_usage = data.capacity() * sizeof(std::vector<T, Allocator>);
+    for (const auto& element: data) {
+        memory_usage += GetMemoryUsage(element);
+    }
+
+    return memory_usage;
+}
+
+// points & point times of the cloud, clouds shared between several entries are counted once per entry:
+inline size_t GetMemoryUsage(const CloudData& cloud_data) {
+    size_t memory_usage = sizeof(CloudData);
+    if (cloud_data.cloud_ptr) {
+        memory_usage += cloud_data.cloud_ptr->points.capacity() * sizeof(CloudData::POINT);
+    }
+    if (cloud_data.point_times_ptr) {
+        memory_usage += GetMemoryUsage(*cloud_data.point_times_ptr);
+    }
+
+    return memory_usage;
+}
+
+template <typename Allocator>
+size_t GetMemoryUsage(const std::deque<CloudData, Allocator>& data) {
+    size_t memory_usage = 0;
+    for (const CloudData& cloud_data: data) {
+        memory_usage += GetMemoryUsage(cloud_data);
+    }
+
+    return memory_usage;
+}
+} // namespace lidar_localization
+
+#endif
@@ -0,0 +1,156 @@
+/*
+ * @Description: process-wide metrics registry, counters, gauges & latency histograms
+ * @Author: Ge Yao
+ * @Date: 2020-12-23 20:31:48
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_METRICS_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_METRICS_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+namespace lidar_localization {
+// metrics are looked up by name once, at construction of their users, and updated through the returned reference.
+// updates are relaxed atomics, readers only get a consistent value per metric.
+class Counter {
+  public:
+    void Increment(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t Get(void) const { return value_.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<uint64_t> value_{0};
+};
+
+class Gauge {
+  public:
+    void Set(double value) { value_.store(value, std::memory_order_relaxed); }
+    double Get(void) const { return value_.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<double> value_{0.0};
+};
+
+// HDR-style log-linear histogram of latencies in ns:
+// values below 2^SUB_BUCKET_BITS are exact, above each power of two is split into 2^SUB_BUCKET_BITS buckets,
+// so the relative error of a percentile is at most 1 / 2^SUB_BUCKET_BITS
+class LatencyHistogram {
+  public:
+    static const int SUB_BUCKET_BITS = 4;
+    static const int SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    static const int NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    struct Snapshot {
+      uint64_t count = 0;
+      // in ns:
+      double sum = 0.0;
+      double p50 = 0.0;
+      double p90 = 0.0;
+      double p99 = 0.0;
+      double max = 0.0;
+    };
+
+    void Record(int64_t latency);
+    Snapshot GetSnapshot(void) const;
+
+  private:
+    static int GetBucketIndex(uint64_t value);
+    // mid value of bucket:
+    static double GetBucketValue(int index);
+
+  private:
+    std::atomic<uint64_t> buckets_[NUM_BUCKETS] = {};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+};
+
+class ScopedLatency {
+  public:
+    explicit ScopedLatency(LatencyHistogram& histogram)
+        : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+    ~ScopedLatency() {
+        histogram_.Record(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count()
+        );
+    }
+
+  private:
+    LatencyHistogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// metric names are <group>.<name>, e.g. data_pretreat_flow.unsynced_clouds
+class MetricsRegistry {
+  public:
+    static MetricsRegistry& GetInstance(void);
+
+    // the same name always gives the same metric:
+    Counter& GetCounter(const std::string& name);
+    Gauge& GetGauge(const std::string& name);
+    LatencyHistogram& GetLatencyHistogram(const std::string& name);
+
+    // in name order:
+    void ForEachCounter(const std::function<void(const std::string&, const Counter&)>& callback);
+    void ForEachGauge(const std::function<void(const std::string&, const Gauge&)>& callback);
+    void ForEachLatencyHistogram(const std::function<void(const std::string&, const LatencyHistogram&)>& callback);
+
+    // Prometheus text exposition format, names are prefixed with lidar_localization_:
+    std::string GetPrometheusText(void);
+
+  private:
+    MetricsRegistry() = default;
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+  private:
+    std::mutex mutex_;
+    std::map<std::string, std::unique_ptr<Counter>> counters_;
+    std::map<std::string, std::unique_ptr<Gauge>> gauges_;
+    std::map<std::string, std::unique_ptr<LatencyHistogram>> latency_histograms_;
+};
+
+// metrics every flow reports, registered as <flow_name>.<metric>:
+//   <flow_name>.latency, processing of one measurement,
+//   <flow_name>.<queue_name>, depth of a buffer at the start of each Run, i.e. what the last Run left unconsumed,
+//   <flow_name>.memory.<container_name>, approx. bytes held by a buffer or module state, at most once per second,
+//   and the counters & extra latencies of the flow, e.g. dropped measurements
+class FlowMetrics {
+  public:
+    explicit FlowMetrics(const std::string& flow_name);
+
+    void AddQueue(const std::string& queue_name, const std::function<size_t(void)>& get_size);
+    // get_bytes is called in the flow thread, by UpdateMemory, so it may read the flow state without locks:
+    void AddMemory(const std::string& container_name, const std::function<size_t(void)>& get_bytes);
+    Counter& AddCounter(const std::string& counter_name);
+    Gauge& AddGauge(const std::string& gauge_name);
+    // for stages whose latencies should not be mixed with the main one, e.g. IMU updates of filters:
+    LatencyHistogram& AddLatency(const std::string& latency_name);
+
+    LatencyHistogram& GetLatency(void) { return latency_; }
+
+    void UpdateQueues(void);
+    void UpdateMemory(void);
+
+  private:
+    struct Queue {
+      Gauge* gauge_ptr;
+      std::function<size_t(void)> get_size;
+    };
+
+    std::string flow_name_;
+    LatencyHistogram& latency_;
+    std::vector<Queue> queues_;
+    // the same as queues, sized in bytes:
+    std::vector<Queue> memories_;
+    std::chrono::steady_clock::time_point last_memory_update_;
+};
+} // namespace lidar_localization
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * @Description: publish the metrics registry as diagnostic_msgs, and optionally serve it to Prometheus
+ * @Author: Ge Yao
+ * @Date: 2020-12-23 21:26:05
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_METRICS_PUBLISHER_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_METRICS_PUBLISHER_HPP_
+
+#include <string>
+#include <thread>
+#include <atomic>
+
+#include <ros/ros.h>
+
+#include <lidar_localization/dumpMemory.h>
+
+namespace lidar_localization {
+// params, in the namespace of nh:
+//   metrics_period, period of /diagnostics publication in seconds, 1.0 by default
+//   metrics_port, port of the Prometheus text endpoint, 0 (default) to disable
+// one DiagnosticStatus per metric group, i.e. per flow, is published every period.
+// process.memory.rss is updated every period, and the dump_memory service reports it with the 
+// <flow_name>.memory.<container_name> gauges of the flows.
+class MetricsPublisher {
+  public:
+    MetricsPublisher(ros::NodeHandle& nh);
+    ~MetricsPublisher();
+
+    /**
+     * @brief  write the memory report of this process, one line per memory gauge in bytes
+     * @param  file_path, output file path, WORK_SPACE_PATH/slam_data/memory/<node name>.txt if empty
+     * @param  report, the report written
+     * @return true if success false otherwise
+     */
+    static bool DumpMemory(std::string& file_path, std::string& report);
+
+  private:
+    void TimerCallback(const ros::WallTimerEvent& event);
+    bool DumpMemoryCallback(dumpMemory::Request &request, dumpMemory::Response &response);
+    void Serve(int port);
+
+  private:
+    std::string node_name_;
+
+    ros::Publisher publisher_;
+    ros::WallTimer timer_;
+    ros::ServiceServer dump_memory_service_;
+
+    std::atomic<bool> running_{true};
+    std::thread server_thread_;
+};
+} // namespace lidar_localization
+
+#endif
@@ -0,0 +1,144 @@
+/*
+ * @Description: offline replay, feed subscribers from rosbag synchronously and loop publishers back in process
+ * @Author: Ge Yao
+ * @Date: 2020-12-22 15:42:18
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_OFFLINE_REPLAY_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_OFFLINE_REPLAY_HPP_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+
+namespace lidar_localization {
+// when enabled, subscribers no longer go through ROS transport. measurements are read from rosbag in
+// timestamp order and handed to the subscriber callbacks in the calling thread, and whatever a flow publishes
+// is also handed to the in-process subscribers of the topic, so a whole pipeline runs as fast as the CPU allows
+class OfflineReplay {
+  public:
+    static OfflineReplay& GetInstance(void);
+
+    void Enable(void) { enabled_ = true; }
+    bool IsEnabled(void) const { return enabled_; }
+
+    /**
+     * @brief  subscribe to topic, through ROS online, to replayed and in-process messages offline
+     * @param  nh, node handle
+     * @param  topic_name, topic name
+     * @param  buff_size, ROS subscriber queue size
+     * @param  callback, subscriber callback
+     * @param  subscriber, subscriber instance
+     * @return ROS subscriber online, empty subscriber offline
+     */
+    template<typename MessageType, typename SubscriberType>
+    ros::Subscriber Subscribe(
+        ros::NodeHandle& nh, const std::string& topic_name, size_t buff_size,
+        void (SubscriberType::*callback)(const boost::shared_ptr<MessageType const>&),
+        SubscriberType* subscriber
+    ) {
+        if (!enabled_) {
+            return nh.subscribe(topic_name, buff_size, callback, subscriber);
+        }
+
+        Handler handler;
+
+        handler.data_type = ros::message_traits::DataType<MessageType>::value();
+        handler.from_bag = [callback, subscriber](const rosbag::MessageInstance& message) {
+            boost::shared_ptr<MessageType const> message_ptr = message.instantiate<MessageType>();
+            if (message_ptr) {
+                (subscriber->*callback)(message_ptr);
+            }
+        };
+        handler.from_publisher = [callback, subscriber](const boost::shared_ptr<void const>& message_ptr) {
+            (subscriber->*callback)(boost::static_pointer_cast<MessageType const>(message_ptr));
+        };
+
+        handlers_[nh.resolveName(topic_name)].push_back(handler);
+
+        return ros::Subscriber();
+    }
+
+    /**
+     * @brief  publish message through ROS, and to in-process subscribers offline
+     * @param  publisher, ROS publisher
+     * @param  message_ptr, message
+     * @return void
+     */
+    template<typename MessageType>
+    void Publish(ros::Publisher& publisher, const boost::shared_ptr<MessageType>& message_ptr) {
+        publisher.publish(message_ptr);
+
+        if (enabled_) {
+            Dispatch<MessageType>(publisher.getTopic(), message_ptr);
+        }
+    }
+
+    template<typename MessageType>
+    void Publish(ros::Publisher& publisher, const MessageType& message) {
+        publisher.publish(message);
+
+        // the message is usually a reused member of the publisher, the in-process subscribers get a copy:
+        if (enabled_ && HasHandlers(publisher.getTopic())) {
+            Dispatch<MessageType>(publisher.getTopic(), boost::make_shared<MessageType const>(message));
+        }
+    }
+
+    // whether anything would receive what publisher publishes, the in-process subscribers included:
+    bool HasSubscribers(const ros::Publisher& publisher) const {
+        return publisher.getNumSubscribers() != 0 || (enabled_ && HasHandlers(publisher.getTopic()));
+    }
+
+    /**
+     * @brief  replay the subscribed topics of rosbags, in timestamp order
+     * @param  bag_paths, rosbag paths
+     * @param  on_message, called after each message has been handed to the subscribers
+     * @return true if success false otherwise
+     */
+    bool Play(const std::vector<std::string>& bag_paths, const std::function<void(void)>& on_message);
+
+  private:
+    struct Handler {
+        std::string data_type;
+        std::function<void(const rosbag::MessageInstance&)> from_bag;
+        std::function<void(const boost::shared_ptr<void const>&)> from_publisher;
+    };
+
+    OfflineReplay() = default;
+    OfflineReplay(const OfflineReplay&) = delete;
+    OfflineReplay& operator=(const OfflineReplay&) = delete;
+
+    bool HasHandlers(const std::string& topic_name) const {
+        return handlers_.find(topic_name) != handlers_.end();
+    }
+
+    template<typename MessageType>
+    void Dispatch(const std::string& topic_name, const boost::shared_ptr<void const>& message_ptr) {
+        auto it = handlers_.find(topic_name);
+        if (it == handlers_.end()) {
+            return;
+        }
+
+        const std::string data_type = ros::message_traits::DataType<MessageType>::value();
+        for (const Handler& handler: it->second) {
+            if (handler.data_type == data_type) {
+                handler.from_publisher(message_ptr);
+            }
+        }
+    }
+
+  private:
+    bool enabled_ = false;
+    // ordered by topic name, so that the bag query is the same for every run:
+    std::map<std::string, std::vector<Handler>> handlers_;
+};
+} // namespace lidar_localization
+
+#endif
@@ -0,0 +1,160 @@
+/*
+ * @Description: worker pool for independent measurements, results are handed back in submission order
+ * @Author: Ge Yao
+ * @Date: 2020-12-27 20:36:12
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_ORDERED_PIPELINE_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_ORDERED_PIPELINE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include <omp.h>
+#include <Eigen/Core>
+
+namespace lidar_localization {
+// tasks are submitted and popped by the same caller thread, e.g. a flow's Run, and processed by the workers
+// in any order. Pop only returns the oldest task, once it is processed, so that the outputs keep the input order.
+// each worker gets an equal share of the OpenMP threads for the parallel loops in process.
+template<typename TaskType>
+class OrderedPipeline {
+  public:
+    // worker_index is in [0, num_workers), e.g. for per-worker models:
+    using Process = std::function<void(TaskType&, int worker_index)>;
+
+    /**
+     * @brief  start the workers
+     * @param  num_workers, num. of worker threads, at least 1
+     * @param  max_num_tasks, max. num. of tasks submitted but not popped yet, at least num_workers
+     * @param  process, processing of one task, called on the workers
+     */
+    OrderedPipeline(int num_workers, size_t max_num_tasks, Process process)
+        : num_workers_(std::max(num_workers, 1)),
+          max_num_tasks_(std::max(max_num_tasks, static_cast<size_t>(num_workers_))),
+          process_(process) {
+        for (int i = 0; i < num_workers_; ++i) {
+            workers_.emplace_back(&OrderedPipeline::Run, this, i);
+        }
+    }
+
+    OrderedPipeline(const OrderedPipeline&) = delete;
+    OrderedPipeline& operator=(const OrderedPipeline&) = delete;
+
+    // tasks still queued are dropped, the ones being processed are finished first:
+    ~OrderedPipeline() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        has_task_.notify_all();
+
+        for (std::thread& worker: workers_) {
+            worker.join();
+        }
+    }
+
+    int GetNumWorkers(void) const { return num_workers_; }
+
+    // false if max_num_tasks are in flight, pop the oldest one first:
+    bool Submit(TaskType&& task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (slots_.size() >= max_num_tasks_)
+                return false;
+
+            slots_.emplace_back();
+            slots_.back().task = std::move(task);
+        }
+        has_task_.notify_one();
+
+        return true;
+    }
+
+    /**
+     * @brief  pop the oldest task once processed
+     * @param  task, output processed task
+     * @param  wait, wait for the oldest task if it is still being processed
+     * @return true if a task was popped, false if none is in flight, or the oldest is not processed and not waited for
+     */
+    bool Pop(TaskType& task, bool wait) {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        if (wait) {
+            is_done_.wait(lock, [this]{ return slots_.empty() || slots_.front().is_done; });
+        }
+        if (slots_.empty() || !slots_.front().is_done)
+            return false;
+
+        task = std::move(slots_.front().task);
+        slots_.pop_front();
+        ++first_id_;
+
+        return true;
+    }
+
+    // submitted but not popped yet:
+    size_t GetNumTasks(void) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return slots_.size();
+    }
+
+    bool IsFull(void) {
+        return GetNumTasks() >= max_num_tasks_;
+    }
+
+  private:
+    struct Slot {
+      TaskType task;
+      bool is_done = false;
+    };
+
+    void Run(int worker_index) {
+        omp_set_num_threads(std::max(omp_get_max_threads() / num_workers_, 1));
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            has_task_.wait(lock, [this]{ return stop_ || next_id_ < first_id_ + slots_.size(); });
+            if (stop_)
+                break;
+
+            // deque keeps the references on push_back & pop_front, and the slot is only popped once done:
+            Slot& slot = slots_.at(next_id_++ - first_id_);
+
+            lock.unlock();
+            process_(slot.task, worker_index);
+            lock.lock();
+
+            slot.is_done = true;
+            is_done_.notify_all();
+        }
+    }
+
+  private:
+    const int num_workers_;
+    const size_t max_num_tasks_;
+    Process process_;
+
+    std::mutex mutex_;
+    std::condition_variable has_task_;
+    std::condition_variable is_done_;
+
+    // tasks may hold fixed-size Eigen members:
+    std::deque<Slot, Eigen::aligned_allocator<Slot>> slots_;
+    // id of slots_.front() & of the next slot to process:
+    uint64_t first_id_ = 0;
+    uint64_t next_id_ = 0;
+    bool stop_ = false;
+
+    // take the slots in id order, finish them in any order:
+    std::vector<std::thread> workers_;
+};
+} // namespace lidar_localization
+
+#endif
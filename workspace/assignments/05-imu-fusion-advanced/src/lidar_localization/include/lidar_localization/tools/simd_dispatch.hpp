@@ -0,0 +1,52 @@
+/*
+ * @Description: runtime selection of the SIMD kernels by the instruction sets of the CPU
+ * @Author: Ge Yao
+ * @Date: 2021-01-25 10:37:52
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_SIMD_DISPATCH_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_SIMD_DISPATCH_HPP_
+
+#include <string>
+#include <atomic>
+
+namespace lidar_localization {
+// instruction sets of the SIMD kernels. SSE2 on x86-64 & NEON on aarch64 are always there,
+// the others are detected at runtime, e.g. AVX2 on the desktop and the dot product extension on Jetson Xavier:
+enum class SIMDLevel {
+  SCALAR = 0,
+  SSE2,
+  NEON,
+  NEON_DOTPROD,
+  AVX2,
+  AVX512
+};
+
+// each kernel takes the widest instruction set enabled, i.e. supported by the CPU and not above the max. level.
+// the max. level is the widest supported, unless capped by environment variable LIDAR_LOCALIZATION_SIMD,
+// e.g. scalar or avx2, or by SetMaxLevel in benchmarks. AVX2 includes FMA
+class SIMDDispatch {
+  public:
+    static bool IsEnabled(SIMDLevel level) {
+      return (
+        0 != (GetSupportedLevels() & (1u << static_cast<unsigned>(level))) &&
+        static_cast<int>(level) <= GetMaxLevel().load(std::memory_order_relaxed)
+      );
+    }
+    // the widest level enabled:
+    static SIMDLevel GetLevel(void);
+
+    // for comparisons of the kernels, not while they run:
+    static void SetMaxLevel(SIMDLevel level);
+
+    static const char *GetName(SIMDLevel level);
+    static bool GetLevel(const std::string &name, SIMDLevel &level);
+
+  private:
+    // bit i for SIMDLevel i, detected once:
+    static unsigned GetSupportedLevels(void);
+    // function statics, so kernels run during static initialization see them too:
+    static std::atomic<int> &GetMaxLevel(void);
+};
+} // namespace lidar_localization
+
+#endif // LIDAR_LOCALIZATION_TOOLS_SIMD_DISPATCH_HPP_
@@ -0,0 +1,111 @@
+/*
+ * @Description: cache of the outputs of a pipeline stage, played back instead of rerunning the stages upstream
+ * @Author: Ge Yao
+ * @Date: 2021-01-14 21:08:45
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_STAGE_CACHE_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_STAGE_CACHE_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include <Eigen/Dense>
+
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/tools/checkpoint_log.hpp"
+#include "lidar_localization/tools/trajectory_log.hpp"
+#include "lidar_localization/models/key_frame_store/packed_key_frame_store.hpp"
+
+namespace lidar_localization {
+// layout, in cache_path:
+//   messages.bin  -- checkpoint log of the streams & of the messages in recorded order, ended by an end record
+//   <stream>/     -- clouds of a cloud stream as a packed key frame store, by sequence number in the stream,
+//                    poses of a pose stream as a trajectory log, in sequence order
+// a cache is only played once it is complete, i.e. the recording was finished.
+// clouds are stored as int16 xyz, the other point fields & point times are not cached.
+class StageCache {
+  public:
+    enum StreamType : uint32_t {
+      CLOUD_STREAM = 0,
+      POSE_STREAM = 1
+    };
+
+    struct Message {
+      std::string stream_name;
+      StreamType stream_type;
+      double time = 0.0;
+      // key frame index, as recorded:
+      unsigned int index = 0;
+      // cloud streams only:
+      CloudData::CLOUD_PTR cloud_ptr;
+      // pose streams only:
+      Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
+    };
+    // returns false to stop playing:
+    typedef std::function<bool(const Message&)> MessageHandler;
+
+    // start recording into cache_path, whatever is in it is removed:
+    StageCache(const std::string& cache_path, float resolution, bool use_lz4);
+    ~StageCache();
+
+    // streams are numbered in the order they are added:
+    int AddStream(const std::string& stream_name, StreamType stream_type);
+    bool AddCloud(int stream, double time, const CloudData::CLOUD& cloud);
+    bool AddPose(int stream, double time, const Eigen::Matrix4f& pose, unsigned int index = 0);
+    // mark the cache complete once everything is on disk, nothing can be added afterwards:
+    bool Finish(void);
+
+    /**
+     * @brief  key of the outputs of a stage, any change upstream gives another key
+     * @param  upstream_key, key of the stage inputs, empty for the first stage
+     * @param  config_file_paths, configs the stage depends on, by content
+     * @param  data_file_paths, data files, e.g. rosbags, by path, size & modification time
+     * @return 16 hex digits
+     */
+    static std::string GetKey(
+      const std::string& upstream_key,
+      const std::vector<std::string>& config_file_paths,
+      const std::vector<std::string>& data_file_paths
+    );
+    static bool IsComplete(const std::string& cache_path);
+    // play the messages of a complete cache in recorded order:
+    static bool Play(const std::string& cache_path, const MessageHandler& handler);
+
+  private:
+    struct Stream {
+      std::string name;
+      StreamType type;
+      unsigned int num_messages = 0;
+      std::shared_ptr<PackedKeyFrameStore> cloud_store_ptr;
+      std::shared_ptr<TrajectoryLog> pose_log_ptr;
+    };
+
+    // index of messages, what is left once the stream & message records are read:
+    struct Index {
+      std::vector<std::pair<std::string, StreamType>> streams;
+      std::vector<std::pair<uint32_t, uint32_t>> messages;
+      std::vector<double> times;
+      std::vector<uint32_t> indices;
+      bool is_complete = false;
+    };
+
+    static std::string GetStreamPath(const std::string& cache_path, const std::string& stream_name);
+    static bool ReadIndex(const std::string& cache_path, Index& index);
+    bool AddMessage(int stream, double time, unsigned int index);
+
+  private:
+    std::string cache_path_;
+    float resolution_;
+    bool use_lz4_;
+
+    std::vector<Stream> streams_;
+    std::shared_ptr<CheckpointLog> message_log_ptr_;
+    size_t num_messages_ = 0;
+    bool is_finished_ = false;
+};
+}
+
+#endif
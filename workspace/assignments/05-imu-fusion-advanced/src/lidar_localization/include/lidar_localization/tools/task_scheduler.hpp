@@ -0,0 +1,196 @@
+/*
+ * @Description: process-wide work-stealing task pool for the parallel loops of all modules
+ * @Author: Ge Yao
+ * @Date: 2020-12-30 16:08:27
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_TASK_SCHEDULER_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_TASK_SCHEDULER_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "lidar_localization/tools/metrics.hpp"
+
+namespace lidar_localization {
+// one set of workers for every flow of the process, so nodelets sharing a process never oversubscribe the cores.
+// a parallel loop is split into chunks, run on the calling thread and on the workers that are free: each worker
+// pops its own queue, newest first, and steals the oldest task of the others when it runs dry. realtime tasks,
+// e.g. of filtering, are always taken before background ones, e.g. of loop closing.
+// the calling thread takes part and never waits on a queued task, so nested loops can't deadlock.
+// parallel code paths should use this instead of their own OpenMP teams or threads
+class TaskScheduler {
+  public:
+    enum Priority {
+        REALTIME = 0,
+        BACKGROUND,
+        NUM_PRIORITIES
+    };
+
+    // how ParallelReduce splits & combines. both combine the partials in a fixed order, so results only vary
+    // with the chunking. FAST chunks by the num. of threads: bit-exact across runs of the same pool size only.
+    // DETERMINISTIC uses a fixed num. of chunks & a pairwise tree combine: bit-exact for any pool size & machine,
+    // at the cost of load balancing, i.e. loops of few, uneven chunks on many cores, and of tiny loops split
+    // into more chunks than threads. the tree combine is as cheap as the in-order one & rounds no worse.
+    enum ReductionMode {
+        FAST = 0,
+        DETERMINISTIC
+    };
+
+    // configured by config/tools/task_scheduler.yaml on first use:
+    static TaskScheduler& GetInstance(void);
+
+    // workers & the calling thread:
+    int GetNumThreads(void) const { return static_cast<int>(workers_.size()) + 1; }
+
+    // max. threads of the following loops, the calling thread included, e.g. for thread scaling benchmarks.
+    // 0 for the whole pool. set at startup by the LIDAR_LOCALIZATION_NUM_THREADS environment variable:
+    void SetThreadLimit(int thread_limit) { thread_limit_ = std::max(thread_limit, 0); }
+    int GetNumActiveThreads(void) const {
+        const int thread_limit = thread_limit_.load();
+        return (thread_limit > 0) ? std::min(thread_limit, GetNumThreads()) : GetNumThreads();
+    }
+
+    // configured by reduction_mode, may be switched at runtime, e.g. by regression tests:
+    void SetReductionMode(ReductionMode reduction_mode) { reduction_mode_ = reduction_mode; }
+    ReductionMode GetReductionMode(void) const { return reduction_mode_.load(); }
+
+    /**
+     * @brief  parallel loop over [begin, end)
+     * @param  begin, first index
+     * @param  end, last index + 1
+     * @param  grain_size, min. num. of indices a task runs, at least 1
+     * @param  func, called as func(chunk_begin, chunk_end) for disjoint chunks covering [begin, end)
+     * @param  priority, lane of the tasks
+     */
+    template <typename Func>
+    void ParallelFor(int begin, int end, int grain_size, Func&& func, Priority priority = REALTIME) {
+        if (end <= begin)
+            return;
+
+        const int chunk_size = GetChunkSize(end - begin, grain_size);
+        const int num_chunks = (end - begin + chunk_size - 1) / chunk_size;
+        Run(
+            num_chunks,
+            [&](int chunk) {
+                const int chunk_begin = begin + chunk * chunk_size;
+                func(chunk_begin, std::min(chunk_begin + chunk_size, end));
+            },
+            priority
+        );
+    }
+
+    /**
+     * @brief  parallel reduction over [begin, end), the chunk partials are combined in a fixed order,
+     *         see ReductionMode for what the result depends on
+     * @param  identity, initial value of each chunk
+     * @param  func, called as func(chunk_begin, chunk_end, identity), returns the partial of the chunk
+     * @param  reduce, called as reduce(lhs, rhs), combines two partials
+     * @return identity reduced with the partials of all chunks
+     */
+    template <typename T, typename Func, typename Reduce>
+    T ParallelReduce(
+        int begin, int end, int grain_size,
+        const T& identity, Func&& func, Reduce&& reduce,
+        Priority priority = REALTIME
+    ) {
+        if (end <= begin)
+            return identity;
+
+        const ReductionMode reduction_mode = GetReductionMode();
+        const int chunk_size = (DETERMINISTIC == reduction_mode) ?
+            GetDeterministicChunkSize(end - begin, grain_size) : GetChunkSize(end - begin, grain_size);
+        const int num_chunks = (end - begin + chunk_size - 1) / chunk_size;
+        std::vector<T> partials(num_chunks, identity);
+        Run(
+            num_chunks,
+            [&](int chunk) {
+                const int chunk_begin = begin + chunk * chunk_size;
+                partials[chunk] = func(chunk_begin, std::min(chunk_begin + chunk_size, end), identity);
+            },
+            priority
+        );
+
+        if (DETERMINISTIC == reduction_mode) {
+            // pairwise, level by level, the shape of the tree only depends on num_chunks:
+            for (int stride = 1; stride < num_chunks; stride *= 2) {
+                for (int chunk = 0; chunk + stride < num_chunks; chunk += 2 * stride) {
+                    partials[chunk] = reduce(partials[chunk], partials[chunk + stride]);
+                }
+            }
+
+            return reduce(identity, partials.front());
+        }
+
+        T result = identity;
+        for (const T& partial: partials) {
+            result = reduce(result, partial);
+        }
+
+        return result;
+    }
+
+  private:
+    using Task = std::function<void(void)>;
+
+    struct Worker {
+      std::mutex mutex;
+      std::deque<Task> tasks[NUM_PRIORITIES];
+
+      std::thread thread;
+    };
+
+    // chunks of one loop, taken by whichever thread gets to them first:
+    struct Job {
+      std::function<void(int)> run_chunk;
+      int num_chunks;
+
+      std::atomic<int> next_chunk{0};
+      std::atomic<int> num_done{0};
+
+      std::mutex mutex;
+      std::condition_variable done;
+    };
+
+    TaskScheduler();
+    ~TaskScheduler();
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    int GetChunkSize(int num_indices, int grain_size) const;
+    // independent of the num. of threads:
+    int GetDeterministicChunkSize(int num_indices, int grain_size) const;
+    // run the chunks on the calling thread & up to num_chunks - 1 workers:
+    void Run(int num_chunks, const std::function<void(int)>& run_chunk, Priority priority);
+    static void RunChunks(Job& job);
+
+    void Push(Task task, Priority priority);
+    bool Pop(int worker_index, Task& task);
+    void RunWorker(int worker_index);
+
+  private:
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<unsigned int> next_worker_{0};
+
+    std::atomic<ReductionMode> reduction_mode_{FAST};
+    std::atomic<int> thread_limit_{0};
+    int deterministic_num_chunks_ = 64;
+
+    // num. of tasks pushed but not popped yet, for the idle workers:
+    std::mutex mutex_;
+    std::condition_variable has_task_;
+    int num_pending_ = 0;
+    bool stop_ = false;
+
+    Counter& num_tasks_;
+    Counter& num_steals_;
+};
+} // namespace lidar_localization
+
+#endif
@@ -0,0 +1,41 @@
+/*
+ * @Description: CPU affinity, scheduling class & memory locking of the main loop of a node
+ * @Author: Ge Yao
+ * @Date: 2020-12-30 17:21:44
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_THREAD_CONFIG_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_THREAD_CONFIG_HPP_
+
+#include <string>
+#include <vector>
+
+namespace lidar_localization {
+// settings of a node from config/tools/thread_config.yaml, the default ones for a node not listed.
+// memory locking is process-wide. the other settings are of the calling thread only, so the task scheduler
+// workers and the background threads of the flows keep the default scheduling
+class ThreadConfig {
+  public:
+    explicit ThreadConfig(const std::string& node_name);
+
+    // for the calling thread, each failed setting is logged and skipped, e.g. without CAP_SYS_NICE:
+    bool Apply(void) const;
+
+    bool IsJitterMeasured(void) const { return measure_jitter_; }
+
+  private:
+    bool SetAffinity(void) const;
+    bool SetScheduler(void) const;
+    bool LockMemory(void) const;
+
+  private:
+    std::string node_name_;
+
+    std::vector<int> cpus_;
+    std::string sched_policy_;
+    int priority_;
+    bool lock_memory_;
+    bool measure_jitter_;
+};
+} // namespace lidar_localization
+
+#endif
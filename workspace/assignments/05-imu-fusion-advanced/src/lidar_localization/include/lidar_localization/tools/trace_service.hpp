@@ -0,0 +1,36 @@
+/*
+ * @Description: dump_trace service, writes the trace of this process as Chrome trace JSON
+ * @Author: Ge Yao
+ * @Date: 2020-12-23 14:52:10
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_TRACE_SERVICE_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_TRACE_SERVICE_HPP_
+
+#include <string>
+
+#include <ros/ros.h>
+
+#include <lidar_localization/dumpTrace.h>
+
+namespace lidar_localization {
+class TraceService {
+  public:
+    // advertised in the namespace of nh, use the private node handle to get one service per node:
+    TraceService(ros::NodeHandle& nh);
+
+    /**
+     * @brief  write the trace of this process
+     * @param  file_path, output file path, WORK_SPACE_PATH/slam_data/trace/<node name>.json if empty
+     * @return true if success false otherwise
+     */
+    static bool Dump(std::string& file_path);
+
+  private:
+    bool DumpTraceCallback(dumpTrace::Request &request, dumpTrace::Response &response);
+
+  private:
+    ros::ServiceServer service_;
+};
+} // namespace lidar_localization
+
+#endif
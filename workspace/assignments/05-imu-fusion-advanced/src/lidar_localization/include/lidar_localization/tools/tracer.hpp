@@ -0,0 +1,139 @@
+/*
+ * @Description: scoped per-stage latency tracing, dumped as Chrome trace JSON
+ * @Author: Ge Yao
+ * @Date: 2020-12-23 14:05:37
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_TRACER_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_TRACER_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+
+#include "lidar_localization/tools/metrics.hpp"
+
+namespace lidar_localization {
+// each thread records its finished scopes into its own ring buffer, so only the latest events are kept
+// and recording never contends with other threads. the buffers outlive their threads until the process exits.
+// timestamps are CLOCK_MONOTONIC, so the dumps of all nodes on a host can be loaded into one chrome://tracing
+// or ui.perfetto.dev session.
+class Tracer {
+  public:
+    struct Event {
+      // string literals, only the pointers are recorded:
+      const char* name;
+      const char* category;
+      // in ns:
+      int64_t start;
+      int64_t duration;
+    };
+
+    // totals of the kept events of one scope name, over all threads:
+    struct ScopeStats {
+      std::string name;
+      size_t num_calls = 0;
+      // in ns:
+      int64_t total_duration = 0;
+    };
+
+    // events kept per thread:
+    static const size_t RING_BUFFER_SIZE = 1 << 16;
+
+    static Tracer& GetInstance(void);
+
+    static int64_t Now(void) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+    }
+
+    void Record(const char* name, const char* category, int64_t start, int64_t end);
+
+    /**
+     * @brief  write the events of all threads as Chrome trace JSON
+     * @param  file_path, output file path
+     * @param  process_name, shown as process name, e.g. ROS node name
+     * @return true if success false otherwise
+     */
+    bool Dump(const std::string& file_path, const std::string& process_name);
+
+    // by total duration, longest first, e.g. for in-process benchmarks:
+    void Summarize(std::vector<ScopeStats>& scope_stats);
+    // drops the events of all threads:
+    void Clear(void);
+
+  private:
+    struct ThreadBuffer {
+      std::mutex mutex;
+      long thread_id = 0;
+      // total num. of recorded events, the latest RING_BUFFER_SIZE of them are kept:
+      size_t num_events = 0;
+      std::vector<Event> events;
+    };
+
+    Tracer() = default;
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    ThreadBuffer& GetThreadBuffer(void);
+
+  private:
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<ThreadBuffer>> thread_buffers_;
+};
+
+class ScopedTrace {
+  public:
+    ScopedTrace(const char* name, const char* category)
+        : name_(name), category_(category), start_(Tracer::Now()) {}
+    ~ScopedTrace() {
+        Tracer::GetInstance().Record(name_, category_, start_, Tracer::Now());
+    }
+
+  private:
+    const char* name_;
+    const char* category_;
+    int64_t start_;
+};
+
+// wake-up jitter of a periodic loop, i.e. how far each iteration starts off one period after the previous one.
+// recorded into <name>.loop_jitter and, when built with tracing, as loop_jitter events spanning the deviation,
+// so they line up with whatever else ran at that time
+class JitterMonitor {
+  public:
+    /**
+     * @brief  jitter of a loop
+     * @param  name, metric group, e.g. node name
+     * @param  period, nominal period in seconds
+     * @param  enabled, Tick does nothing otherwise
+     */
+    JitterMonitor(const std::string& name, double period, bool enabled);
+
+    // at the start of each iteration:
+    void Tick(void);
+
+  private:
+    bool enabled_;
+    // in ns:
+    int64_t period_;
+    int64_t last_tick_ = 0;
+
+    LatencyHistogram& jitter_;
+};
+} // namespace lidar_localization
+
+// traces the enclosing scope, name and category must be string literals.
+// compiled out unless built with tracing, see CMakeLists.txt:
+#ifdef LIDAR_LOCALIZATION_WITH_TRACING
+#define LIDAR_LOCALIZATION_TRACE_CONCAT_IMPL(a, b) a##b
+#define LIDAR_LOCALIZATION_TRACE_CONCAT(a, b) LIDAR_LOCALIZATION_TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name, category) \
+    ::lidar_localization::ScopedTrace LIDAR_LOCALIZATION_TRACE_CONCAT(trace_scope_, __LINE__)(name, category)
+#else
+#define TRACE_SCOPE(name, category)
+#endif
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * @Description: ATE, RPE & KITTI segment drift of saved trajectories, in place of an evo step
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 20:41:23
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_TRAJECTORY_EVALUATOR_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_TRAJECTORY_EVALUATOR_HPP_
+
+#include <string>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+#include <Eigen/Dense>
+
+namespace lidar_localization {
+// trajectories are KITTI text files or binary TrajectoryLog files, the estimated and reference poses pair up by index.
+// the estimated trajectory is aligned to the reference first, as evo_ape --align (--correct_scale).
+// runs are evaluated in parallel on the task scheduler, results are written as JSON
+class TrajectoryEvaluator {
+  public:
+    struct Run {
+      std::string name;
+      std::string estimated_file;
+      std::string reference_file;
+    };
+
+    struct Statistics {
+      double rmse = 0.0;
+      double mean = 0.0;
+      double median = 0.0;
+      double std = 0.0;
+      double min = 0.0;
+      double max = 0.0;
+    };
+
+    // KITTI devkit drift of the segments of one length:
+    struct Drift {
+      double length = 0.0;
+      size_t num_segments = 0;
+      // in %:
+      double translation_error = 0.0;
+      // in deg / 100 m:
+      double rotation_error = 0.0;
+    };
+
+    struct Result {
+      std::string name;
+      bool is_valid = false;
+
+      size_t num_poses = 0;
+      // of the reference, in m:
+      double length = 0.0;
+      double scale = 1.0;
+
+      // position errors after alignment, in m:
+      Statistics ate;
+      // relative pose errors over rpe_delta poses, in m & deg:
+      Statistics rpe_translation;
+      Statistics rpe_rotation;
+      // over all segments of all lengths:
+      Drift drift;
+      std::vector<Drift> segment_drifts;
+    };
+
+    TrajectoryEvaluator(const YAML::Node& node);
+
+    /**
+     * @brief  load a KITTI text trajectory or a binary trajectory log, by its header
+     * @param  file_path, trajectory file path
+     * @param  poses, output poses
+     * @return true for success otherwise false
+     */
+    static bool Load(const std::string& file_path, std::vector<Eigen::Matrix4f>& poses);
+    // absolute paths are kept, others are under WORK_SPACE_PATH/slam_data/trajectory:
+    static std::string GetTrajectoryPath(const std::string& file);
+    // runs of a list of {name, estimated, reference}, with the paths above:
+    static std::vector<Run> GetRuns(const YAML::Node& node);
+
+    bool Evaluate(
+        const std::vector<Eigen::Matrix4f>& estimated,
+        const std::vector<Eigen::Matrix4f>& reference,
+        Result& result
+    ) const;
+    bool Evaluate(const Run& run, Result& result) const;
+    /**
+     * @brief  evaluate the runs in parallel
+     * @param  runs, runs to evaluate
+     * @param  results, results in run order, failed runs are invalid
+     * @return true if every run is evaluated otherwise false
+     */
+    bool Evaluate(const std::vector<Run>& runs, std::vector<Result>& results) const;
+
+    static std::string ToJSON(const Result& result);
+    static bool Save(const std::string& file_path, const std::vector<Result>& results);
+
+  private:
+    // aligned estimated poses, the scale is 1.0 unless corrected:
+    void Align(
+        const std::vector<Eigen::Matrix4d>& estimated,
+        const std::vector<Eigen::Matrix4d>& reference,
+        std::vector<Eigen::Matrix4d>& aligned,
+        double& scale
+    ) const;
+
+  private:
+    // none, se3 or sim3:
+    std::string alignment_;
+    int rpe_delta_;
+    int segment_step_;
+    std::vector<double> segment_lengths_;
+};
+} // namespace lidar_localization
+
+#endif
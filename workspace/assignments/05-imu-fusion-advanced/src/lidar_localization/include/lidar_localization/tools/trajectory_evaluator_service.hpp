@@ -0,0 +1,45 @@
+/*
+ * @Description: evaluate_trajectory service, ATE, RPE & segment drift of the saved trajectories of a run
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 20:58:36
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_TRAJECTORY_EVALUATOR_SERVICE_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_TRAJECTORY_EVALUATOR_SERVICE_HPP_
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <ros/ros.h>
+
+#include <lidar_localization/evaluateTrajectory.h>
+
+#include "lidar_localization/tools/trajectory_evaluator.hpp"
+
+namespace lidar_localization {
+// configured by config/tools/trajectory_evaluator.yaml
+class TrajectoryEvaluatorService {
+  public:
+    // advertised in the namespace of nh, use the private node handle to get one service per node:
+    TrajectoryEvaluatorService(ros::NodeHandle& nh);
+
+    /**
+     * @brief  evaluate the configured runs, e.g. right after the trajectories are saved
+     * @return true if disabled or every run is evaluated, false otherwise
+     */
+    bool EvaluateOnSave(void);
+
+  private:
+    bool EvaluateTrajectoryCallback(evaluateTrajectory::Request &request, evaluateTrajectory::Response &response);
+
+  private:
+    ros::ServiceServer service_;
+
+    std::shared_ptr<TrajectoryEvaluator> evaluator_ptr_;
+    bool evaluate_on_save_;
+    std::vector<TrajectoryEvaluator::Run> runs_;
+    std::string output_file_;
+};
+} // namespace lidar_localization
+
+#endif
@@ -0,0 +1,104 @@
+/*
+ * @Description: binary, append-only log of optimized key frame poses
+ * @Author: Ge Yao
+ * @Date: 2020-12-12 20:41:09
+ */
+#ifndef LIDAR_LOCALIZATION_TOOLS_TRAJECTORY_LOG_HPP_
+#define LIDAR_LOCALIZATION_TOOLS_TRAJECTORY_LOG_HPP_
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <Eigen/Dense>
+
+namespace lidar_localization {
+// layout:
+//   a FileHeader, then patches, each a PatchHeader followed by num_poses row-major 3x4 float poses.
+//   a patch overwrites the poses [first_index, first_index + num_poses), replaying all patches gives the trajectory.
+// only changed poses are queued, file writes and compaction run on a worker thread.
+// a log is either updated or appended to, appended poses are kept by neither side once on disk.
+class TrajectoryLog {
+  public:
+    struct Stats {
+      size_t num_poses = 0;
+      size_t num_patches = 0;
+      size_t num_poses_written = 0;
+      size_t num_compactions = 0;
+      size_t num_failed = 0;
+    };
+
+    // the log is compacted once it is compact_ratio times larger than the trajectory:
+    TrajectoryLog(const std::string& file_path, float compact_ratio = 4.0f);
+    ~TrajectoryLog();
+
+    // poses of key frames from first_index on:
+    bool Update(unsigned int first_index, const std::deque<Eigen::Matrix4f>& poses);
+    // next pose of a streamed trajectory, memory stays bounded by the poses not yet written:
+    bool Append(const Eigen::Matrix4f& pose);
+    // wait until every queued patch is on disk:
+    void Flush(void);
+
+    Stats GetStats(void);
+
+    // true if the file has the header of a trajectory log:
+    static bool IsTrajectoryLog(const std::string& file_path);
+    static bool Load(const std::string& file_path, std::deque<Eigen::Matrix4f>& poses);
+    // KITTI text format, as used by evo:
+    static bool ExportKITTI(const std::string& file_path, const std::string& kitti_file_path);
+
+  private:
+    struct FileHeader {
+      uint32_t magic;
+      uint32_t version;
+    };
+
+    struct PatchHeader {
+      uint32_t first_index;
+      uint32_t num_poses;
+    };
+
+    struct Patch {
+      uint32_t first_index;
+      bool is_appended = false;
+      std::vector<float> data;
+    };
+
+    bool Create(const std::string& file_path);
+    bool WritePatch(uint32_t first_index, const float *data, uint32_t num_poses);
+    bool Compact(void);
+    void Run(void);
+
+  private:
+    std::string file_path_;
+    float compact_ratio_;
+
+    // caller side, poses as last queued:
+    std::vector<float> poses_;
+    size_t num_appended_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable has_task_;
+    std::condition_variable is_idle_;
+
+    std::deque<Patch> queue_;
+    bool is_writing_ = false;
+    bool stop_ = false;
+    Stats stats_;
+
+    // worker side, poses as on disk:
+    int fd_ = -1;
+    size_t file_size_ = 0;
+    size_t num_file_poses_ = 0;
+    std::vector<float> file_poses_;
+
+    // applies the patches in queue_ to the file through the worker side state:
+    std::thread thread_;
+};
+}
+
+#endif
@@ -0,0 +1,158 @@
+#! /usr/bin/python
+# -*- coding: utf-8 -*-
+
+import os
+import sys
+import glob
+import json
+import shutil
+import argparse
+import itertools
+import subprocess
+
+import numpy as np
+import yaml
+
+from offline_sweep import PACKAGE_PATH, init_work_space
+
+def run_pipeline(pipeline, bags, run_path, extra_env=None):
+    init_work_space(run_path, None)
+
+    # a fresh work space has no stage cache, and recording one would add to the latencies:
+    stage_cache_config_path = os.path.join(run_path, 'config', 'tools', 'stage_cache.yaml')
+    with open(stage_cache_config_path) as f:
+        stage_cache_config = yaml.safe_load(f)
+    stage_cache_config['record'] = False
+    with open(stage_cache_config_path, 'w') as f:
+        yaml.safe_dump(stage_cache_config, f)
+
+    env = dict(os.environ)
+    env['LIDAR_LOCALIZATION_WORK_SPACE_PATH'] = run_path
+    env.update(extra_env or {})
+    with open(os.path.join(run_path, 'replay.log'), 'w') as log:
+        return_code = subprocess.call(
+            ['rosrun', 'lidar_localization', 'offline_replay_node', pipeline] + bags,
+            env=env, stdout=log, stderr=subprocess.STDOUT
+        )
+
+    return return_code == 0
+
+def load_latencies(run_path):
+    # durations of each traced stage in ms, from the Chrome trace dumped at the end of the replay:
+    latencies = {}
+    for trace_path in glob.glob(os.path.join(run_path, 'slam_data', 'trace', '*.json')):
+        with open(trace_path) as f:
+            trace = json.load(f)
+        for event in trace['traceEvents']:
+            if event.get('ph') == 'X':
+                latencies.setdefault(event['name'], []).append(1.0e-3 * event['dur'])
+
+    return latencies
+
+def check_budgets(pipeline, latencies, budgets, tolerance, min_count):
+    print("%-48s %8s %8s %8s %8s %8s" % (pipeline + ' [ms]', 'count', 'p50', 'p99', 'budget', 'status'))
+
+    num_failed = 0
+    for stage in sorted(set(latencies.keys()) | set(budgets.keys())):
+        stage_latencies = np.asarray(latencies.get(stage, []))
+        budget = budgets.get(stage, {}).get('p99')
+
+        if len(stage_latencies) == 0:
+            # a budgeted stage that is no longer traced is renamed or skipped:
+            print("%-48s %8d %8s %8s %8.2f %8s" % (stage, 0, '-', '-', budget, 'MISSING'))
+            num_failed += 1
+            continue
+
+        p50 = np.percentile(stage_latencies, 50)
+        p99 = np.percentile(stage_latencies, 99)
+        if budget is None:
+            status = ''
+        elif len(stage_latencies) < min_count:
+            status = 'FEW'
+        elif p99 > budget * (1.0 + tolerance):
+            status = 'FAILED'
+            num_failed += 1
+        else:
+            status = 'OK'
+
+        print(
+            "%-48s %8d %8.2f %8.2f %8s %8s" % (
+                stage, len(stage_latencies), p50, p99,
+                '-' if budget is None else '%.2f' % budget, status
+            )
+        )
+
+    return num_failed
+
+def update_budgets(latencies, min_count):
+    # p99 of this run, rounded up to 0.1ms:
+    return {
+        stage: {'p99': float(np.ceil(10.0 * np.percentile(stage_latencies, 99)) / 10.0)}
+        for stage, stage_latencies in latencies.items() if len(stage_latencies) >= min_count
+    }
+
+def main():
+
+    parser = argparse.ArgumentParser(description='Replay a reference bag offline through lidar_localization pipelines and check the p99 latency of each traced stage against the budgets. Exits with 1 on any regression. A ROS master must be running & the package built with WITH_TRACING.')
+    parser.add_argument('output',
+                        help='output directory, one work space per pipeline, replaced if it exists')
+    parser.add_argument('-b', '--bag', action='append',
+                        help='input bag files, the bundled KITTI bag by default. can be repeated')
+    parser.add_argument('-p', '--pipeline', action='append', choices=['filtering', 'mapping'],
+                        help='pipeline of offline_replay_node, both by default. can be repeated')
+    parser.add_argument('--budgets', default=os.path.join(PACKAGE_PATH, 'config', 'benchmark', 'latency_budgets.yaml'),
+                        help='latency budgets')
+    parser.add_argument('--update', action="store_true", default=False,
+                        help='replace the budgets of the pipelines run by the latencies of this run instead of checking them')
+
+    args = parser.parse_args()
+
+    bags = [os.path.abspath(bag) for bag in (args.bag or [os.path.join(PACKAGE_PATH, 'scripts', 'kitti_2011_10_03_drive_0027_sync_input.bag')])]
+    pipelines = args.pipeline or ['filtering', 'mapping']
+
+    with open(args.budgets) as f:
+        budgets = yaml.safe_load(f)
+    tolerance = budgets['tolerance']
+    min_count = budgets['min_count']
+
+    output_path = os.path.abspath(args.output)
+    if os.path.exists(output_path):
+        shutil.rmtree(output_path)
+
+    num_failed = 0
+    for pipeline in pipelines:
+        run_path = os.path.join(output_path, pipeline)
+        print("Replay " + pipeline + " in " + run_path)
+        if not run_pipeline(pipeline, bags, run_path):
+            print("Pipeline " + pipeline + " failed, see " + os.path.join(run_path, 'replay.log'))
+            num_failed += 1
+            continue
+
+        latencies = load_latencies(run_path)
+        if not latencies:
+            print("No trace events of " + pipeline + ", is the package built with WITH_TRACING?")
+            num_failed += 1
+            continue
+
+        if args.update:
+            budgets['pipelines'][pipeline] = update_budgets(latencies, min_count)
+        else:
+            num_failed += check_budgets(
+                pipeline, latencies, budgets['pipelines'].get(pipeline) or {}, tolerance, min_count
+            )
+
+    if args.update:
+        # the comments above the budgets are kept:
+        with open(args.budgets) as f:
+            header = list(itertools.takewhile(lambda line: line.startswith('#'), f))
+        with open(args.budgets, 'w') as f:
+            f.writelines(header)
+            yaml.safe_dump(budgets, f, default_flow_style=False)
+        print("Budgets updated in " + args.budgets)
+
+    if num_failed > 0:
+        print("%d latency regressions or failures." % num_failed)
+        sys.exit(1)
+
+if __name__ == "__main__":
+    main()
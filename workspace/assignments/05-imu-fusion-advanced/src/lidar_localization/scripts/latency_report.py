@@ -0,0 +1,78 @@
+#! /usr/bin/python
+# -*- coding: utf-8 -*-
+
+import sys
+import argparse
+
+import numpy as np
+
+import rospy
+from lidar_localization.msg import ProcessingTrace
+
+class LatencyReport(object):
+    def __init__(self, budget):
+        self.budget = budget
+        self.num_traces = 0
+        self.num_over_budget = 0
+        # latency between consecutive hops, in ms:
+        self.hop_latencies = {}
+        self.end_to_end_latencies = []
+
+    def callback(self, trace):
+        if len(trace.stamps) < 2:
+            return
+
+        stamps = 1.0e-6 * np.asarray(trace.stamps, dtype=np.float64)
+        for i in range(1, len(stamps)):
+            hop = trace.hops[i - 1] + ' -> ' + trace.hops[i]
+            self.hop_latencies.setdefault(hop, []).append(stamps[i] - stamps[i - 1])
+
+        end_to_end_latency = stamps[-1] - stamps[0]
+        self.end_to_end_latencies.append(end_to_end_latency)
+
+        self.num_traces += 1
+        if end_to_end_latency > self.budget:
+            self.num_over_budget += 1
+
+    def report(self):
+        if self.num_traces == 0:
+            print("No traces received.")
+            return
+
+        print("%-64s %8s %8s %8s %8s %8s" % ('hop [ms]', 'count', 'p50', 'p90', 'p99', 'max'))
+        rows = list(self.hop_latencies.items()) + [('end-to-end', self.end_to_end_latencies)]
+        for hop, latencies in rows:
+            latencies = np.asarray(latencies)
+            print(
+                "%-64s %8d %8.2f %8.2f %8.2f %8.2f" % (
+                    hop, len(latencies),
+                    np.percentile(latencies, 50), np.percentile(latencies, 90), np.percentile(latencies, 99),
+                    np.max(latencies)
+                )
+            )
+        print(
+            "%d of %d over the %.1fms budget, %.2f%%" % (
+                self.num_over_budget, self.num_traces, self.budget,
+                100.0 * self.num_over_budget / self.num_traces
+            )
+        )
+
+def main():
+    parser = argparse.ArgumentParser(description='Per-hop latency breakdown of a traced lidar_localization topic. Reports on exit.')
+    parser.add_argument('topic',
+                        help='traced topic, e.g. /fused_localization, its side channel <topic>/trace is subscribed')
+    parser.add_argument('-b', '--budget', type=float, default=50.0,
+                        help='end-to-end latency budget in ms')
+
+    args = parser.parse_args(rospy.myargv(argv=sys.argv)[1:])
+
+    rospy.init_node('latency_report', anonymous=True)
+
+    report = LatencyReport(args.budget)
+    rospy.Subscriber(args.topic + '/trace', ProcessingTrace, report.callback, queue_size=1000)
+    rospy.spin()
+
+    report.report()
+
+if __name__ == "__main__":
+    main()
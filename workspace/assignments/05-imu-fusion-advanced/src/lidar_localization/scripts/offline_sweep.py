@@ -0,0 +1,85 @@
+#! /usr/bin/python
+# -*- coding: utf-8 -*-
+
+import os
+import sys
+import time
+import shutil
+import argparse
+import subprocess
+import multiprocessing
+
+PACKAGE_PATH = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+def init_work_space(run_path, config_path):
+    # package config, overridden by the files of this run if any:
+    if os.path.exists(run_path):
+        shutil.rmtree(run_path)
+    shutil.copytree(os.path.join(PACKAGE_PATH, 'config'), os.path.join(run_path, 'config'))
+    for root, dirs, files in (os.walk(config_path) if config_path else []):
+        dst_root = os.path.join(run_path, 'config', os.path.relpath(root, config_path))
+        if not os.path.exists(dst_root):
+            os.makedirs(dst_root)
+        for f in files:
+            shutil.copy(os.path.join(root, f), os.path.join(dst_root, f))
+
+    for directory in ['Log', 'slam_data/trajectory', 'slam_data/observability']:
+        os.makedirs(os.path.join(run_path, directory))
+
+def main():
+
+    parser = argparse.ArgumentParser(description='Replay bag files offline through a lidar_localization pipeline, one process per config. A ROS master must be running.')
+    parser.add_argument('pipeline', choices=['filtering', 'imu_gnss', 'imu_gnss_odo', 'mapping'],
+                        help='pipeline of offline_replay_node')
+    parser.add_argument('output',
+                        help='output directory, one work space per config')
+    parser.add_argument('inputbag', nargs='+',
+                        help='input bag files')
+    parser.add_argument('-c', '--config', action='append', required=True,
+                        help='directory with the config files to override, laid out like config/, e.g. filtering/filtering.yaml. can be repeated')
+    parser.add_argument('-j', '--jobs', type=int, default=multiprocessing.cpu_count(),
+                        help='max number of parallel processes')
+
+    args = parser.parse_args()
+
+    bags = [os.path.abspath(bag) for bag in args.inputbag]
+
+    pending = []
+    for config_path in args.config:
+        run_path = os.path.join(os.path.abspath(args.output), os.path.basename(os.path.normpath(config_path)))
+        init_work_space(run_path, config_path)
+        pending.append(run_path)
+
+    running = []
+    failed = []
+    while pending or running:
+        while pending and len(running) < args.jobs:
+            run_path = pending.pop(0)
+
+            env = dict(os.environ)
+            env['LIDAR_LOCALIZATION_WORK_SPACE_PATH'] = run_path
+            log = open(os.path.join(run_path, 'replay.log'), 'w')
+            process = subprocess.Popen(
+                ['rosrun', 'lidar_localization', 'offline_replay_node', args.pipeline] + bags,
+                env=env, stdout=log, stderr=subprocess.STDOUT
+            )
+            print("Start " + run_path)
+            running.append((run_path, process, log))
+
+        for item in list(running):
+            run_path, process, log = item
+            if process.poll() is not None:
+                log.close()
+                running.remove(item)
+                if process.returncode != 0:
+                    failed.append(run_path)
+                print("Done " + run_path + ", return code " + str(process.returncode))
+
+        time.sleep(0.1)
+
+    if failed:
+        print("Failed: " + ' '.join(failed))
+        sys.exit(1)
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,113 @@
+#! /usr/bin/python
+# -*- coding: utf-8 -*-
+
+import os
+import sys
+import time
+import shutil
+import multiprocessing
+import argparse
+
+from offline_sweep import PACKAGE_PATH
+from latency_regression import run_pipeline, load_latencies
+
+def get_thread_counts(max_num_threads):
+    # 1, 2, 4, ... & all cores:
+    thread_counts = []
+    num_threads = 1
+    while num_threads < max_num_threads:
+        thread_counts.append(num_threads)
+        num_threads *= 2
+
+    return thread_counts + [max_num_threads]
+
+def main():
+
+    parser = argparse.ArgumentParser(description='Replay a reference bag offline through lidar_localization pipelines at 1, 2, 4, ... threads and write the speedup & efficiency of the wall time as CSV, in the format of thread_scaling_benchmark. The threads of the task scheduler & of OpenMP are limited through the environment. With the package built with WITH_TRACING, the traced stages losing the most against linear scaling are written too. A ROS master must be running.')
+    parser.add_argument('output',
+                        help='output directory, one work space per pipeline & num. of threads, replaced if it exists')
+    parser.add_argument('-b', '--bag', action='append',
+                        help='input bag files, the bundled KITTI bag by default. can be repeated')
+    parser.add_argument('-p', '--pipeline', action='append', choices=['filtering', 'mapping'],
+                        help='pipeline of offline_replay_node, mapping by default. can be repeated')
+    parser.add_argument('-t', '--threads', type=int, action='append',
+                        help='num. of threads, 1, 2, 4, ... & all cores by default. can be repeated, 1 is always run as the baseline')
+    parser.add_argument('-n', '--num-scopes', type=int, default=5,
+                        help='traced stages attributed per num. of threads')
+
+    args = parser.parse_args()
+
+    bags = [os.path.abspath(bag) for bag in (args.bag or [os.path.join(PACKAGE_PATH, 'scripts', 'kitti_2011_10_03_drive_0027_sync_input.bag')])]
+    pipelines = args.pipeline or ['mapping']
+    thread_counts = sorted(set([1] + (args.threads or get_thread_counts(multiprocessing.cpu_count()))))
+
+    output_path = os.path.abspath(args.output)
+    if os.path.exists(output_path):
+        shutil.rmtree(output_path)
+    os.makedirs(output_path)
+
+    scaling_path = os.path.join(output_path, 'thread_scaling.csv')
+    attribution_path = os.path.join(output_path, 'thread_scaling_attribution.csv')
+    with open(scaling_path, 'w') as scaling, open(attribution_path, 'w') as attribution:
+        scaling.write('kernel,threads,time_ms,speedup,efficiency,serial_fraction\n')
+        attribution.write('kernel,scope,threads,calls,total_ms,excess_ms\n')
+
+        for pipeline in pipelines:
+            kernel = 'replay_' + pipeline
+
+            baseline_time = None
+            baseline_totals = {}
+            for num_threads in thread_counts:
+                run_path = os.path.join(output_path, pipeline, str(num_threads))
+                print("Replay %s at %d threads in %s" % (pipeline, num_threads, run_path))
+
+                extra_env = {
+                    'LIDAR_LOCALIZATION_NUM_THREADS': str(num_threads),
+                    'OMP_NUM_THREADS': str(num_threads),
+                }
+                begin_time = time.time()
+                if not run_pipeline(pipeline, bags, run_path, extra_env):
+                    print("Pipeline " + pipeline + " failed, see " + os.path.join(run_path, 'replay.log'))
+                    sys.exit(1)
+                # the whole replay, start-up included:
+                wall_time = time.time() - begin_time
+
+                # stage totals in ms, summed over all threads:
+                latencies = load_latencies(run_path)
+                totals = {stage: (len(stage_latencies), sum(stage_latencies)) for stage, stage_latencies in latencies.items()}
+
+                if baseline_time is None:
+                    baseline_time = wall_time
+                    baseline_totals = totals
+
+                # Karp-Flatt serial fraction, (1 / speedup - 1 / n) / (1 - 1 / n):
+                speedup = baseline_time / wall_time
+                serial_fraction = '' if num_threads == 1 else '%.3f' % (
+                    (1.0 / speedup - 1.0 / num_threads) / (1.0 - 1.0 / num_threads)
+                )
+                scaling.write(
+                    '%s,%d,%.3f,%.3f,%.3f,%s\n' % (
+                        kernel, num_threads, 1.0e3 * wall_time, speedup, speedup / num_threads, serial_fraction
+                    )
+                )
+                print("\t%.1f s, speedup %.2f" % (wall_time, speedup))
+
+                if num_threads == 1:
+                    continue
+
+                # stages by excess over linear scaling of their single thread total, t_n - t_1 / n:
+                excesses = sorted(
+                    [
+                        (total - baseline_totals.get(stage, (0, 0.0))[1] / num_threads, stage, count, total)
+                        for stage, (count, total) in totals.items()
+                    ],
+                    reverse=True
+                )
+                for excess, stage, count, total in excesses[:args.num_scopes]:
+                    attribution.write('%s,%s,%d,%d,%.3f,%.3f\n' % (kernel, stage, num_threads, count, total, excess))
+
+    print("Scaling: " + scaling_path)
+    print("Attribution: " + attribution_path)
+
+if __name__ == "__main__":
+    main()
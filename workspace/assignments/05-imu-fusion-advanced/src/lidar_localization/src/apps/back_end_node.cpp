@@ -8,15 +8,23 @@
 
 #include <lidar_localization/optimizeMap.h>
 #include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/trace_service.hpp"
+#include "lidar_localization/tools/trajectory_evaluator_service.hpp"
+#include "lidar_localization/tools/background_jobs.hpp"
+#include "lidar_localization/tools/metrics_publisher.hpp"
+#include "lidar_localization/tools/thread_config.hpp"
+#include "lidar_localization/tools/tracer.hpp"
 #include "lidar_localization/mapping/back_end/back_end_flow.hpp"
 
 using namespace lidar_localization;
 
 std::shared_ptr<BackEndFlow> _back_end_flow_ptr;
-bool _need_optimize_map = false;
+std::shared_ptr<BackgroundJobs> _background_jobs_ptr;
 
+// called by spinOnce between two runs of the flow, so the optimization sees a consistent graph.
+// the logs are written in the background:
 bool optimize_map_callback(optimizeMap::Request &request, optimizeMap::Response &response) {
-    _need_optimize_map = true;
+    response.job_id = _background_jobs_ptr->Submit("optimize_map", _back_end_flow_ptr->GetForceOptimizeJob());
     response.succeed = true;
     return response.succeed;
 }
@@ -28,6 +36,12 @@ int main(int argc, char *argv[]) {
 
     ros::init(argc, argv, "back_end_node");
     ros::NodeHandle nh;
+    // dump_trace, metrics & evaluate_trajectory, e.g. of optimized.bin, one per node:
+    ros::NodeHandle private_nh("~");
+    TraceService trace_service(private_nh);
+    MetricsPublisher metrics_publisher(private_nh);
+    TrajectoryEvaluatorService trajectory_evaluator_service(private_nh);
+    _background_jobs_ptr = std::make_shared<BackgroundJobs>(private_nh);
 
     std::string cloud_topic, odom_topic;
     nh.param<std::string>("cloud_topic", cloud_topic, "/synced_cloud");
@@ -45,19 +59,23 @@ int main(int argc, char *argv[]) {
     _back_end_flow_ptr = std::make_shared<BackEndFlow>(nh, cloud_topic, odom_topic);
     ros::ServiceServer service = nh.advertiseService("optimize_map", optimize_map_callback);
 
+    // main loop pinning, scheduling class & memory locking, see config/tools/thread_config.yaml:
+    ThreadConfig thread_config("back_end_node");
+    thread_config.Apply();
+    JitterMonitor jitter_monitor("back_end_node", 0.01, thread_config.IsJitterMeasured());
+
     ros::Rate rate(100);
     while (ros::ok()) {
+        jitter_monitor.Tick();
         ros::spinOnce();
 
         _back_end_flow_ptr->Run();
 
-        if (_need_optimize_map) {
-            _back_end_flow_ptr->ForceOptimize();
-            _need_optimize_map = false;
-        }
-
         rate.sleep();
     }
 
+    // a job submitted right before shutdown is finished:
+    _background_jobs_ptr.reset();
+
     return 0;
 }
\ No newline at end of file
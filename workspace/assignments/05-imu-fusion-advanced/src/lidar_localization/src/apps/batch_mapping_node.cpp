@@ -0,0 +1,532 @@
+/*
+ * @Description: offline batch mapping of a finished slam_data directory, loop closures of all key frames
+ *               are detected & verified in parallel, then optimized with the odometry in one graph
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 16:37:05
+ */
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+#include <yaml-cpp/yaml.h>
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/sensor_data/key_frame.hpp"
+#include "lidar_localization/sensor_data/loop_pose.hpp"
+#include "lidar_localization/tools/task_scheduler.hpp"
+#include "lidar_localization/tools/tic_toc.hpp"
+#include "lidar_localization/tools/cloud_assembler.hpp"
+#include "lidar_localization/models/scan_context_manager/scan_context_manager.hpp"
+#include "lidar_localization/models/key_frame_store/pcd_key_frame_store.hpp"
+#include "lidar_localization/models/key_frame_store/packed_key_frame_store.hpp"
+#include "lidar_localization/models/key_frame_store/key_scan_cache.hpp"
+#include "lidar_localization/models/cloud_filter/voxel_filter.hpp"
+#include "lidar_localization/models/cloud_filter/voxel_filter_fast.hpp"
+#include "lidar_localization/models/cloud_filter/voxel_filter_adaptive.hpp"
+#include "lidar_localization/models/cloud_filter/filter_chain.hpp"
+#include "lidar_localization/models/cloud_filter/ground_filter.hpp"
+#include "lidar_localization/models/cloud_filter/no_filter.hpp"
+#include "lidar_localization/models/registration/ndt_registration.hpp"
+#include "lidar_localization/models/registration/ndt_omp_registration.hpp"
+#include "lidar_localization/models/registration/pyramid_registration.hpp"
+#include "lidar_localization/models/graph_optimizer/g2o/g2o_graph_optimizer.hpp"
+#include "lidar_localization/models/graph_optimizer/gtsam/isam2_graph_optimizer.hpp"
+#include "lidar_localization/models/graph_optimizer/ceres/ceres_graph_optimizer.hpp"
+
+using namespace lidar_localization;
+
+// everything a verification task modifies, one set per concurrent task:
+struct Verifier {
+    std::shared_ptr<KeyFrameStoreInterface> key_frame_store_ptr;
+    std::shared_ptr<CloudFilterInterface> map_filter_ptr;
+    std::shared_ptr<CloudFilterInterface> scan_filter_ptr;
+    std::shared_ptr<KeyScanCache> key_scan_cache_ptr;
+    std::shared_ptr<RegistrationInterface> registration_ptr;
+};
+
+struct LoopConstraint {
+    LoopPose loop_pose;
+    float fitness_score;
+};
+
+// same as loop closing:
+bool CreateFilter(
+    const std::string& filter_user, const YAML::Node& config_node,
+    std::shared_ptr<CloudFilterInterface>& filter_ptr
+) {
+    std::string filter_mothod = config_node[filter_user + "_filter"].as<std::string>();
+
+    if (filter_mothod == "voxel_filter") {
+        filter_ptr = std::make_shared<VoxelFilter>(config_node[filter_mothod][filter_user]);
+    } else if (filter_mothod == "voxel_filter_fast") {
+        filter_ptr = std::make_shared<FastVoxelFilter>(config_node[filter_mothod][filter_user]);
+    } else if (filter_mothod == "voxel_filter_adaptive") {
+        filter_ptr = std::make_shared<AdaptiveVoxelFilter>(config_node[filter_mothod][filter_user]);
+    } else if (filter_mothod == "filter_chain") {
+        filter_ptr = std::make_shared<FilterChain>(config_node[filter_mothod][filter_user]);
+    } else if (filter_mothod == "ground_filter") {
+        filter_ptr = std::make_shared<GroundFilter>(config_node[filter_mothod][filter_user]);
+    } else if (filter_mothod == "no_filter") {
+        filter_ptr = std::make_shared<NoFilter>();
+    } else {
+        LOG(ERROR) << "Filter method " << filter_mothod << " for " << filter_user << " NOT FOUND!";
+        return false;
+    }
+
+    return true;
+}
+
+bool CreateVerifier(
+    const YAML::Node& config_node, const std::string& key_frames_path, size_t key_scan_cache_size,
+    Verifier& verifier
+) {
+    // a. key frame store, opened read-only by each verifier:
+    std::string key_frame_store_method = config_node["key_frame_store"].as<std::string>();
+    if (key_frame_store_method == "pcd") {
+        verifier.key_frame_store_ptr = std::make_shared<PCDKeyFrameStore>(key_frames_path);
+    } else if (key_frame_store_method == "packed") {
+        verifier.key_frame_store_ptr = std::make_shared<PackedKeyFrameStore>(
+            key_frames_path, config_node[key_frame_store_method]
+        );
+    } else {
+        LOG(ERROR) << "Key frame store " << key_frame_store_method << " NOT FOUND!";
+        return false;
+    }
+
+    // b. filters:
+    if (
+        !CreateFilter("map", config_node, verifier.map_filter_ptr) ||
+        !CreateFilter("scan", config_node, verifier.scan_filter_ptr)
+    ) {
+        return false;
+    }
+
+    // c. key scans after map filtering, the queries of a task are consecutive & share most of them:
+    verifier.key_scan_cache_ptr = std::make_shared<KeyScanCache>(
+        verifier.key_frame_store_ptr, verifier.map_filter_ptr, key_scan_cache_size
+    );
+
+    // d. registration:
+    std::string registration_method = config_node["registration_method"].as<std::string>();
+    if (registration_method == "NDT") {
+        verifier.registration_ptr = std::make_shared<NDTRegistration>(config_node[registration_method]);
+    } else if (registration_method == "NDT_OMP") {
+        verifier.registration_ptr = std::make_shared<NDTOMPRegistration>(config_node[registration_method]);
+    } else if (registration_method == "PYRAMID") {
+        verifier.registration_ptr = std::make_shared<PyramidRegistration>(config_node[registration_method]);
+    } else {
+        LOG(ERROR) << "Registration method " << registration_method << " NOT FOUND!";
+        return false;
+    }
+
+    return true;
+}
+
+// same as back end, except sliding_window which has no batch mode:
+bool CreateGraphOptimizer(const YAML::Node& config_node, std::shared_ptr<InterfaceGraphOptimizer>& graph_optimizer_ptr) {
+    std::string graph_optimizer_type = config_node["graph_optimizer_type"].as<std::string>();
+    if (graph_optimizer_type == "g2o") {
+        graph_optimizer_ptr = std::make_shared<G2oGraphOptimizer>(
+            config_node[graph_optimizer_type + "_param"]["solver_type"].as<std::string>(),
+            config_node[graph_optimizer_type + "_param"]["incremental"].as<bool>()
+        );
+#ifdef LIDAR_LOCALIZATION_WITH_GTSAM
+    } else if (graph_optimizer_type == "isam2") {
+        graph_optimizer_ptr = std::make_shared<ISAM2GraphOptimizer>(config_node[graph_optimizer_type + "_param"]);
+#endif
+#ifdef LIDAR_LOCALIZATION_WITH_CERES
+    } else if (graph_optimizer_type == "ceres") {
+        graph_optimizer_ptr = std::make_shared<CeresGraphOptimizer>(config_node[graph_optimizer_type + "_param"]);
+#endif
+    } else {
+        LOG(ERROR) << "Optimizer " << graph_optimizer_type << " NOT FOUND for batch mapping!";
+        return false;
+    }
+
+    return true;
+}
+
+// one 3x4 row-major pose per line, as saved by back end:
+bool LoadKITTI(const std::string& file_path, std::vector<KeyFrame>& key_frames) {
+    std::ifstream ifs(file_path);
+    if (!ifs) {
+        LOG(ERROR) << "Cannot open trajectory " << file_path;
+        return false;
+    }
+
+    key_frames.clear();
+    std::string line;
+    while (std::getline(ifs, line)) {
+        if (line.empty())
+            continue;
+
+        KeyFrame key_frame;
+        key_frame.index = static_cast<unsigned int>(key_frames.size());
+
+        std::istringstream iss(line);
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                iss >> key_frame.pose(i, j);
+            }
+        }
+        if (!iss) {
+            LOG(ERROR) << "Invalid pose of key frame " << key_frame.index << " in " << file_path;
+            return false;
+        }
+
+        key_frames.push_back(key_frame);
+    }
+
+    return true;
+}
+
+bool SavePoses(
+    const std::string& file_path,
+    const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& poses
+) {
+    std::ofstream ofs(file_path);
+    if (!ofs) {
+        LOG(ERROR) << "Cannot create trajectory " << file_path;
+        return false;
+    }
+
+    ofs << std::setprecision(9);
+    for (const Eigen::Matrix4f& pose: poses) {
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                ofs << pose(i, j) << ((i == 2 && j == 3) ? "\n" : " ");
+            }
+        }
+    }
+
+    return static_cast<bool>(ofs);
+}
+
+// index0 index1 fitness_score, then the 3x4 relative pose, row-major:
+bool SaveLoopConstraints(const std::string& file_path, const std::vector<LoopConstraint>& constraints) {
+    std::ofstream ofs(file_path);
+    if (!ofs) {
+        LOG(ERROR) << "Cannot create loop constraints " << file_path;
+        return false;
+    }
+
+    ofs << std::setprecision(9);
+    for (const LoopConstraint& constraint: constraints) {
+        ofs << constraint.loop_pose.index0 << " " << constraint.loop_pose.index1 << " " << constraint.fitness_score;
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                ofs << " " << constraint.loop_pose.pose(i, j);
+            }
+        }
+        ofs << std::endl;
+    }
+
+    return static_cast<bool>(ofs);
+}
+
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_alsologtostderr = 1;
+
+    YAML::Node config_node = YAML::LoadFile(WORK_SPACE_PATH + "/config/mapping/batch_mapping.yaml");
+    // detection & verification as loop closing, graph as back end:
+    YAML::Node loop_closing_config_node = YAML::LoadFile(WORK_SPACE_PATH + "/config/mapping/loop_closing.yaml");
+    YAML::Node back_end_config_node = YAML::LoadFile(WORK_SPACE_PATH + "/config/mapping/back_end.yaml");
+
+    std::string data_path = config_node["data_path"].as<std::string>();
+    if (data_path == "./") {
+        data_path = WORK_SPACE_PATH;
+    }
+    const std::string key_frames_path = data_path + "/slam_data/key_frames";
+    const std::string trajectory_path = data_path + "/slam_data/trajectory";
+
+    const size_t key_scan_cache_size = static_cast<size_t>(std::max(config_node["key_scan_cache_size"].as<int>(), 0));
+    const int num_proposals = std::max(loop_closing_config_node["num_loop_candidates"].as<int>(), 1);
+    const int extend_frame_num = loop_closing_config_node["extend_frame_num"].as<int>();
+    const float detect_area = loop_closing_config_node["detect_area"].as<float>();
+    const float fitness_score_limit = loop_closing_config_node["fitness_score_limit"].as<float>();
+    const std::string proposal_search = config_node["proposal_search"].as<std::string>();
+    if (proposal_search != "kd_tree" && proposal_search != "exhaustive") {
+        LOG(ERROR) << "Proposal search " << proposal_search << " NOT FOUND!";
+        return 1;
+    }
+
+    std::cout << "-----------------Init Batch Mapping-------------------" << std::endl
+              << "\tData Path: " << data_path << std::endl
+              << "\tNum. Threads: " << TaskScheduler::GetInstance().GetNumThreads() << std::endl
+              << "\tKey Scan Cache Size per Thread: " << key_scan_cache_size << " MB" << std::endl
+              << "\tProposal Search: " << proposal_search << std::endl
+              << std::endl;
+
+    // a. key frames by lidar odometry & GNSS/IMU, as saved by back end:
+    std::vector<KeyFrame> key_frames, key_gnss;
+    if (
+        !LoadKITTI(trajectory_path + "/laser_odom.txt", key_frames) ||
+        !LoadKITTI(trajectory_path + "/ground_truth.txt", key_gnss)
+    ) {
+        return 1;
+    }
+    if (key_frames.empty() || key_frames.size() != key_gnss.size()) {
+        LOG(ERROR) << "Key frames by lidar odometry & GNSS/IMU do not match: "
+                   << key_frames.size() << " vs. " << key_gnss.size();
+        return 1;
+    }
+    const int num_key_frames = static_cast<int>(key_frames.size());
+    LOG(INFO) << "Load " << num_key_frames << " key frames from " << trajectory_path;
+
+    // b. one verifier per thread, handed out to the tasks, at most one task runs on each thread:
+    std::mutex verifier_mutex;
+    std::vector<std::shared_ptr<Verifier>> verifiers;
+    for (int i = 0; i < TaskScheduler::GetInstance().GetNumThreads(); ++i) {
+        std::shared_ptr<Verifier> verifier_ptr = std::make_shared<Verifier>();
+        if (!CreateVerifier(loop_closing_config_node, key_frames_path, key_scan_cache_size, *verifier_ptr))
+            return 1;
+        verifiers.push_back(verifier_ptr);
+    }
+    auto acquire_verifier = [&]() {
+        std::lock_guard<std::mutex> lock(verifier_mutex);
+        std::shared_ptr<Verifier> verifier_ptr = verifiers.back();
+        verifiers.pop_back();
+        return verifier_ptr;
+    };
+    auto release_verifier = [&](const std::shared_ptr<Verifier>& verifier_ptr) {
+        std::lock_guard<std::mutex> lock(verifier_mutex);
+        verifiers.push_back(verifier_ptr);
+    };
+
+    // c. scan contexts of all key frames:
+    TicToc timer;
+    const YAML::Node& scan_context_config_node = loop_closing_config_node[
+        loop_closing_config_node["loop_closure_method"].as<std::string>()
+    ];
+    ScanContextManager scan_context_manager(scan_context_config_node);
+    bool is_built = scan_context_manager.Build(
+        key_frames,
+        [&](const KeyFrame& key_frame, CloudData& scan) {
+            std::shared_ptr<Verifier> verifier_ptr = acquire_verifier();
+            bool is_loaded = verifier_ptr->key_frame_store_ptr->Load(key_frame.index, *scan.cloud_ptr);
+            release_verifier(verifier_ptr);
+
+            return is_loaded;
+        }
+    );
+    if (!is_built) {
+        LOG(ERROR) << "Failed to load key frames from " << key_frames_path;
+        return 1;
+    }
+    LOG(INFO) << "Scan contexts: " << timer.toc() << " s";
+
+    // d. proposals of all pairs close by GNSS/IMU, whose candidate has a full local map:
+    timer.tic();
+    const ScanContextManager::PairFilter is_pair = [&](int query_id, int key_frame_id) {
+        if (key_frame_id < extend_frame_num || key_frame_id + extend_frame_num > num_key_frames)
+            return false;
+
+        const Eigen::Vector3f distance =
+            key_gnss.at(query_id).pose.block<3, 1>(0, 3) - key_gnss.at(key_frame_id).pose.block<3, 1>(0, 3);
+        return distance.norm() <= detect_area;
+    };
+    std::vector<ScanContextManager::SessionMatch> matches;
+    if (proposal_search == "exhaustive") {
+        ScanContextDistance scan_context_distance(
+            scan_context_config_node["num_rings"].as<int>(),
+            scan_context_config_node["num_sectors"].as<int>(),
+            config_node["use_cuda"].as<bool>()
+        );
+        scan_context_manager.DetectLoopClosures(num_proposals, is_pair, scan_context_distance, matches);
+    } else {
+        scan_context_manager.DetectLoopClosures(num_proposals, is_pair, matches);
+    }
+    LOG(INFO) << "Loop closure proposals: " << timer.toc() << " s";
+
+    // the proposals of each query are verified together, the best fit is kept as in loop closing:
+    std::vector<size_t> query_begins;
+    for (size_t i = 0; i < matches.size(); ++i) {
+        if (0 == i || matches.at(i).query_id != matches.at(i - 1).query_id)
+            query_begins.push_back(i);
+    }
+    query_begins.push_back(matches.size());
+
+    // e. verification, each task takes consecutive queries for a warm key scan cache:
+    timer.tic();
+    const int num_queries = static_cast<int>(query_begins.size()) - 1;
+    std::vector<bool> is_found(num_queries, false);
+    std::vector<LoopConstraint> results(num_queries);
+    TaskScheduler::GetInstance().ParallelFor(
+        0, num_queries, 4,
+        [&](int begin, int end) {
+            std::shared_ptr<Verifier> verifier_ptr = acquire_verifier();
+            Verifier& verifier = *verifier_ptr;
+
+            for (int q = begin; q < end; ++q) {
+                const int query_id = matches.at(query_begins.at(q)).query_id;
+
+                // current scan at its GNSS/IMU pose:
+                CloudData::CLOUD_PTR scan_cloud_ptr(new CloudData::CLOUD());
+                if (!verifier.key_frame_store_ptr->Load(key_frames.at(query_id).index, *scan_cloud_ptr))
+                    continue;
+                verifier.scan_filter_ptr->Filter(scan_cloud_ptr, scan_cloud_ptr);
+                const Eigen::Matrix4f scan_pose = key_gnss.at(query_id).pose;
+
+                float best_fitness_score = std::numeric_limits<float>::max();
+                for (size_t m = query_begins.at(q); m < query_begins.at(q + 1); ++m) {
+                    const ScanContextManager::SessionMatch& match = matches.at(m);
+
+                    // local map around the candidate at its GNSS/IMU pose, turned by the yaw change:
+                    Eigen::Matrix4f map_pose = key_gnss.at(match.match_id).pose;
+                    map_pose.block<3, 3>(0, 0) = map_pose.block<3, 3>(0, 0) * Eigen::AngleAxisf(
+                        match.yaw_change_in_rad, Eigen::Vector3f::UnitZ()
+                    ).toRotationMatrix();
+
+                    const Eigen::Matrix4f pose_to_gnss = map_pose * key_frames.at(match.match_id).pose.inverse();
+                    CloudData::CLOUD_PTR map_cloud_ptr(new CloudData::CLOUD());
+                    CloudAssembler map_assembler;
+                    for (int i = match.match_id - extend_frame_num; i < match.match_id + extend_frame_num; ++i) {
+                        CloudData::CLOUD::ConstPtr key_scan_ptr;
+                        if (!verifier.key_scan_cache_ptr->Get(key_frames.at(i).index, key_scan_ptr))
+                            continue;
+
+                        map_assembler.Add(key_scan_ptr, pose_to_gnss * key_frames.at(i).pose);
+                    }
+                    map_assembler.Assemble(*map_cloud_ptr);
+                    verifier.map_filter_ptr->Filter(map_cloud_ptr, map_cloud_ptr);
+
+                    // match:
+                    CloudData::CLOUD_PTR result_cloud_ptr(new CloudData::CLOUD());
+                    Eigen::Matrix4f result_pose = Eigen::Matrix4f::Identity();
+                    verifier.registration_ptr->SetInputTarget(map_cloud_ptr);
+                    verifier.registration_ptr->ScanMatch(scan_cloud_ptr, scan_pose, result_cloud_ptr, result_pose);
+                    const float fitness_score = verifier.registration_ptr->GetResult().fitness_score;
+
+                    if (fitness_score < best_fitness_score) {
+                        best_fitness_score = fitness_score;
+
+                        LoopConstraint& result = results.at(q);
+                        result.loop_pose.index0 = key_frames.at(match.match_id).index;
+                        result.loop_pose.index1 = key_frames.at(query_id).index;
+                        result.loop_pose.pose = map_pose.inverse() * result_pose;
+                        result.fitness_score = fitness_score;
+                    }
+                }
+
+                is_found.at(q) = (best_fitness_score <= fitness_score_limit);
+            }
+
+            release_verifier(verifier_ptr);
+        },
+        TaskScheduler::BACKGROUND
+    );
+
+    // a place revisited is usually proposed from both of its key frames, the pair is kept once:
+    std::map<std::pair<unsigned int, unsigned int>, LoopConstraint> unique_constraints;
+    for (int q = 0; q < num_queries; ++q) {
+        if (!is_found.at(q))
+            continue;
+
+        const LoopConstraint& result = results.at(q);
+        std::pair<unsigned int, unsigned int> key(
+            std::min(result.loop_pose.index0, result.loop_pose.index1),
+            std::max(result.loop_pose.index0, result.loop_pose.index1)
+        );
+        auto it = unique_constraints.find(key);
+        if (it == unique_constraints.end() || result.fitness_score < it->second.fitness_score)
+            unique_constraints[key] = result;
+    }
+    std::vector<LoopConstraint> constraints;
+    for (const auto& unique_constraint: unique_constraints) {
+        constraints.push_back(unique_constraint.second);
+    }
+    LOG(INFO) << "Loop closure verification: " << timer.toc() << " s, "
+              << constraints.size() << " loop closures of " << num_queries << " queries, "
+              << matches.size() << " proposals";
+
+    // f. one graph with all the constraints:
+    timer.tic();
+    std::shared_ptr<InterfaceGraphOptimizer> graph_optimizer_ptr;
+    if (!CreateGraphOptimizer(back_end_config_node, graph_optimizer_ptr))
+        return 1;
+
+    const std::string graph_optimizer_param = back_end_config_node["graph_optimizer_type"].as<std::string>() + "_param";
+    const YAML::Node& graph_optimizer_node = back_end_config_node[graph_optimizer_param];
+    const bool use_gnss = back_end_config_node["use_gnss"].as<bool>();
+    Eigen::VectorXd odom_edge_noise(6), close_loop_noise(6), gnss_noise(3);
+    for (int i = 0; i < 6; ++i) {
+        odom_edge_noise(i) = graph_optimizer_node["odom_edge_noise"][i].as<double>();
+        close_loop_noise(i) = graph_optimizer_node["close_loop_noise"][i].as<double>();
+    }
+    for (int i = 0; i < 3; ++i) {
+        gnss_noise(i) = graph_optimizer_node["gnss_noise"][i].as<double>();
+    }
+
+    // nodes, odometry edges & GNSS/IMU priors as back end adds them, nodes & edges in batch:
+    std::vector<Eigen::Isometry3d, Eigen::aligned_allocator<Eigen::Isometry3d>> nodes(num_key_frames);
+    InterfaceGraphOptimizer::Se3EdgeVector odom_edges(std::max(num_key_frames - 1, 0));
+    for (int i = 0; i < num_key_frames; ++i) {
+        nodes.at(i).matrix() = key_frames.at(i).pose.cast<double>();
+
+        if (i > 0) {
+            InterfaceGraphOptimizer::Se3Edge& edge = odom_edges.at(i - 1);
+            edge.vertex_index1 = i - 1;
+            edge.vertex_index2 = i;
+            edge.relative_pose.matrix() = (key_frames.at(i - 1).pose.inverse() * key_frames.at(i).pose).cast<double>();
+        }
+    }
+    graph_optimizer_ptr->AddSe3Nodes(nodes.data(), num_key_frames, !use_gnss);
+    graph_optimizer_ptr->AddSe3Edges(odom_edges.data(), static_cast<int>(odom_edges.size()), odom_edge_noise);
+
+    if (use_gnss) {
+        for (int i = 0; i < num_key_frames; ++i) {
+            graph_optimizer_ptr->AddSe3PriorXYZEdge(
+                i, key_gnss.at(i).pose.block<3, 1>(0, 3).cast<double>(), gnss_noise
+            );
+        }
+    }
+
+    // the robust kernel only applies to the loop closures added after it:
+    const std::string robust_kernel = config_node["robust_kernel"].as<std::string>();
+    if (robust_kernel != "NONE") {
+        graph_optimizer_ptr->SetEdgeRobustKernel(robust_kernel, config_node["robust_kernel_size"].as<double>());
+    }
+    InterfaceGraphOptimizer::Se3EdgeVector loop_edges(constraints.size());
+    for (size_t i = 0; i < constraints.size(); ++i) {
+        loop_edges.at(i).vertex_index1 = constraints.at(i).loop_pose.index0;
+        loop_edges.at(i).vertex_index2 = constraints.at(i).loop_pose.index1;
+        loop_edges.at(i).relative_pose.matrix() = constraints.at(i).loop_pose.pose.cast<double>();
+    }
+    graph_optimizer_ptr->AddSe3Edges(loop_edges.data(), static_cast<int>(loop_edges.size()), close_loop_noise);
+
+    if (!graph_optimizer_ptr->Optimize()) {
+        LOG(ERROR) << "Failed to optimize the batch graph.";
+        return 1;
+    }
+    const InterfaceGraphOptimizer::OptimizeStats& stats = graph_optimizer_ptr->GetOptimizeStats();
+    LOG(INFO) << "Graph optimization: " << timer.toc() << " s, "
+              << stats.num_vertices << " vertices, " << stats.num_edges << " edges, "
+              << stats.num_iterations << " iterations, chi2 " << stats.chi2_before << " -> " << stats.chi2_after;
+
+    // g. results next to what back end saved:
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> optimized_poses(num_key_frames);
+    optimized_poses.resize(graph_optimizer_ptr->GetOptimizedPoses(optimized_poses.data(), num_key_frames));
+
+    const std::string optimized_path = trajectory_path + "/" + config_node["optimized_file"].as<std::string>();
+    const std::string constraints_path = trajectory_path + "/" + config_node["loop_constraints_file"].as<std::string>();
+    if (!SavePoses(optimized_path, optimized_poses) || !SaveLoopConstraints(constraints_path, constraints))
+        return 1;
+    if (back_end_config_node["save_graph"].as<bool>()) {
+        graph_optimizer_ptr->SaveGraph(trajectory_path + "/batch_graph.g2o");
+    }
+    LOG(INFO) << "Save " << optimized_poses.size() << " optimized poses to " << optimized_path
+              << ", loop closures to " << constraints_path;
+
+    return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * @Description: benchmark of the compressed cloud transport, on a key scan saved by back end
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 09:26:40
+ */
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include <pcl/io/pcd_io.h>
+#include <yaml-cpp/yaml.h>
+#include <benchmark/benchmark.h>
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/tools/cloud_codec.hpp"
+
+using namespace lidar_localization;
+
+bool LoadCloud(const YAML::Node& config_node, CloudData::CLOUD& cloud) {
+    std::string cloud_path = config_node["cloud_path"].as<std::string>();
+    if (cloud_path.front() != '/') {
+        cloud_path = WORK_SPACE_PATH + "/" + cloud_path;
+    }
+
+    if (pcl::io::loadPCDFile(cloud_path, cloud) != 0 || cloud.points.empty()) {
+        LOG(ERROR) << "Cannot load cloud " << cloud_path << ", run mapping to save key frames.";
+        return false;
+    }
+
+    LOG(INFO) << "Cloud " << cloud_path << ": " << cloud.points.size() << " points.";
+
+    return true;
+}
+
+/**
+ * @brief  time of encoding one cloud, with the size of the frame against the x, y & z floats of the cloud
+ */
+void BenchmarkEncode(benchmark::State& state, const CloudData::CLOUD* cloud, float resolution, bool use_lz4) {
+    CloudCodec codec(resolution, use_lz4);
+    CloudCodec::FrameInfo info;
+    std::vector<uint8_t> data;
+
+    for (auto _ : state) {
+        codec.Encode(*cloud, info, data);
+        benchmark::DoNotOptimize(data.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * cloud->points.size());
+    state.counters["bytes_per_point"] = static_cast<double>(data.size()) / std::max<uint32_t>(info.num_points, 1);
+    state.counters["ratio"] = 3.0 * sizeof(float) * cloud->points.size() / std::max<size_t>(data.size(), 1);
+    state.counters["lz4"] = (info.compression == CloudCodec::LZ4) ? 1.0 : 0.0;
+}
+
+/**
+ * @brief  time of decoding one frame, with the max. coordinate error of the round trip
+ */
+void BenchmarkDecode(benchmark::State& state, const CloudData::CLOUD* cloud, float resolution, bool use_lz4) {
+    CloudCodec codec(resolution, use_lz4);
+    CloudCodec::FrameInfo info;
+    std::vector<uint8_t> data;
+    codec.Encode(*cloud, info, data);
+
+    CloudData::CLOUD decoded_cloud;
+    for (auto _ : state) {
+        if (!codec.Decode(info, data, decoded_cloud)) {
+            state.SkipWithError("failed to decode");
+            break;
+        }
+        benchmark::DoNotOptimize(decoded_cloud.points.data());
+    }
+
+    // finite points are decoded in order:
+    double max_error = 0.0;
+    size_t i = 0;
+    for (const CloudData::POINT& point: cloud->points) {
+        if (!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z))
+            continue;
+        if (i >= decoded_cloud.points.size())
+            break;
+
+        const CloudData::POINT& decoded_point = decoded_cloud.points.at(i++);
+        max_error = std::max<double>(max_error, std::fabs(decoded_point.x - point.x));
+        max_error = std::max<double>(max_error, std::fabs(decoded_point.y - point.y));
+        max_error = std::max<double>(max_error, std::fabs(decoded_point.z - point.z));
+    }
+
+    state.SetItemsProcessed(state.iterations() * cloud->points.size());
+    state.counters["max_error"] = max_error;
+}
+
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_log_dir = WORK_SPACE_PATH + "/Log";
+    FLAGS_alsologtostderr = 1;
+
+    // the --benchmark_* flags are consumed here, e.g. --benchmark_filter=Decode:
+    benchmark::Initialize(&argc, argv);
+
+    std::string config_file_path = (argc > 1) ? argv[1] : WORK_SPACE_PATH + "/config/benchmark/cloud_codec_benchmark.yaml";
+    YAML::Node config_node = YAML::LoadFile(config_file_path);
+
+    CloudData::CLOUD cloud;
+    if (!LoadCloud(config_node, cloud)) {
+        return 1;
+    }
+
+    const std::vector<float> resolutions = config_node["resolutions"].as<std::vector<float>>();
+    for (const float resolution: resolutions) {
+        for (const bool use_lz4: {false, true}) {
+            const std::string name = std::to_string(resolution) + (use_lz4 ? "/lz4" : "/varint");
+
+            benchmark::RegisterBenchmark(
+                ("CloudCodec/Encode/" + name).c_str(),
+                BenchmarkEncode, &cloud, resolution, use_lz4
+            )->Unit(benchmark::kMicrosecond);
+            benchmark::RegisterBenchmark(
+                ("CloudCodec/Decode/" + name).c_str(),
+                BenchmarkDecode, &cloud, resolution, use_lz4
+            )->Unit(benchmark::kMicrosecond);
+        }
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+
+    return 0;
+}
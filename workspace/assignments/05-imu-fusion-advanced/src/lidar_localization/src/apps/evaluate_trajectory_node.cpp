@@ -0,0 +1,71 @@
+/*
+ * @Description: ATE, RPE & segment drift of saved trajectories, e.g. of all runs of a parameter sweep
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 21:06:54
+ */
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include <yaml-cpp/yaml.h>
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/tic_toc.hpp"
+#include "lidar_localization/tools/trajectory_evaluator.hpp"
+
+using namespace lidar_localization;
+
+// usage:
+//   evaluate_trajectory_node
+//     evaluate the runs of config/tools/trajectory_evaluator.yaml
+//   evaluate_trajectory_node OUTPUT_FILE ESTIMATED_FILE REFERENCE_FILE [ESTIMATED_FILE REFERENCE_FILE ...]
+//     evaluate the given pairs, each named by its estimated file
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_alsologtostderr = 1;
+
+    YAML::Node config_node = YAML::LoadFile(WORK_SPACE_PATH + "/config/tools/trajectory_evaluator.yaml");
+
+    std::vector<TrajectoryEvaluator::Run> runs;
+    std::string output_file;
+    if (argc == 1) {
+        runs = TrajectoryEvaluator::GetRuns(config_node["runs"]);
+        output_file = TrajectoryEvaluator::GetTrajectoryPath(config_node["output_file"].as<std::string>());
+    } else if (argc >= 4 && argc % 2 == 0) {
+        output_file = argv[1];
+        for (int i = 2; i < argc; i += 2) {
+            TrajectoryEvaluator::Run run;
+            run.name = argv[i];
+            run.estimated_file = argv[i];
+            run.reference_file = argv[i + 1];
+
+            runs.push_back(run);
+        }
+    } else {
+        std::cerr << "Usage: " << argv[0] << " [OUTPUT_FILE ESTIMATED_FILE REFERENCE_FILE ...]" << std::endl;
+        return 1;
+    }
+
+    TicToc timer;
+    TrajectoryEvaluator trajectory_evaluator(config_node);
+    std::vector<TrajectoryEvaluator::Result> results;
+    bool is_evaluated = trajectory_evaluator.Evaluate(runs, results);
+    if (!TrajectoryEvaluator::Save(output_file, results)) {
+        return 1;
+    }
+
+    LOG(INFO) << "Evaluate " << runs.size() << " trajectories in " << timer.toc() << " s, save to " << output_file;
+    for (const TrajectoryEvaluator::Result& result: results) {
+        if (!result.is_valid) {
+            LOG(WARNING) << "\t" << result.name << ": failed";
+            continue;
+        }
+        LOG(INFO) << "\t" << result.name << ": " << result.num_poses << " poses, "
+                  << "ATE RMSE " << result.ate.rmse << " m, "
+                  << "RPE RMSE " << result.rpe_translation.rmse << " m / " << result.rpe_rotation.rmse << " deg, "
+                  << "drift " << result.drift.translation_error << " % / " << result.drift.rotation_error << " deg/100m";
+    }
+
+    return is_evaluated ? 0 : 1;
+}
@@ -0,0 +1,31 @@
+/*
+ * @Description: export binary trajectory log to KITTI text format for evo
+ * @Author: Ge Yao
+ * @Date: 2020-12-12 20:41:09
+ */
+#include <string>
+#include <iostream>
+
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/trajectory_log.hpp"
+
+using namespace lidar_localization;
+
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_alsologtostderr = 1;
+
+    std::string trajectory_path = WORK_SPACE_PATH + "/slam_data/trajectory";
+    std::string log_file_path = (argc > 1 ? argv[1] : trajectory_path + "/optimized.bin");
+    std::string kitti_file_path = (argc > 2 ? argv[2] : trajectory_path + "/optimized.txt");
+
+    if (!TrajectoryLog::ExportKITTI(log_file_path, kitti_file_path)) {
+        LOG(ERROR) << "Failed to export " << log_file_path;
+        return 1;
+    }
+    std::cout << "Exported " << log_file_path << " to " << kitti_file_path << std::endl;
+
+    return 0;
+}
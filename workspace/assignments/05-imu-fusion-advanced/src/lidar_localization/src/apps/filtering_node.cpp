@@ -6,6 +6,12 @@
 #include <ros/ros.h>
 
 #include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/trace_service.hpp"
+#include "lidar_localization/tools/trajectory_evaluator_service.hpp"
+#include "lidar_localization/tools/metrics_publisher.hpp"
+#include "lidar_localization/tools/background_jobs.hpp"
+#include "lidar_localization/tools/thread_config.hpp"
+#include "lidar_localization/tools/tracer.hpp"
 
 #include "lidar_localization/filtering/filtering_flow.hpp"
 
@@ -15,11 +21,31 @@
 
 using namespace lidar_localization;
 
-bool _need_save_odometry = false;
+std::shared_ptr<FilteringFlow> _filtering_flow_ptr;
+std::shared_ptr<TrajectoryEvaluatorService> _trajectory_evaluator_service_ptr;
+std::shared_ptr<BackgroundJobs> _background_jobs_ptr;
 
+// called by spinOnce between two runs of the flow, the poses recorded as of now are saved in the background:
 bool SaveOdometryCB(saveOdometry::Request &request, saveOdometry::Response &response) {
-    _need_save_odometry = true;
-    response.succeed = true;
+    BackgroundJobs::Job save_odometry = _filtering_flow_ptr->GetSaveOdometryJob();
+    response.succeed = static_cast<bool>(save_odometry);
+    if (!response.succeed)
+        return response.succeed;
+
+    response.job_id = _background_jobs_ptr->Submit(
+        "save_odometry",
+        [save_odometry](const BackgroundJobs::Progress& progress) {
+            if (!save_odometry(progress))
+                return false;
+
+            // ATE, RPE & drift of the saved odometry, see config/tools/trajectory_evaluator.yaml:
+            progress(0.9, "evaluation");
+            _trajectory_evaluator_service_ptr->EvaluateOnSave();
+
+            return true;
+        }
+    );
+
     return response.succeed;
 }
 
@@ -31,23 +57,33 @@ int main(int argc, char *argv[]) {
 
     ros::init(argc, argv, "filtering_node");
     ros::NodeHandle nh;
-
-    std::shared_ptr<FilteringFlow> filtering_flow_ptr = std::make_shared<FilteringFlow>(nh);
+    // dump_trace, metrics & evaluate_trajectory, one per node:
+    ros::NodeHandle private_nh("~");
+    TraceService trace_service(private_nh);
+    MetricsPublisher metrics_publisher(private_nh);
+    _trajectory_evaluator_service_ptr = std::make_shared<TrajectoryEvaluatorService>(private_nh);
+
+    _filtering_flow_ptr = std::make_shared<FilteringFlow>(nh);
+    _background_jobs_ptr = std::make_shared<BackgroundJobs>(private_nh);
     ros::ServiceServer service = nh.advertiseService("save_odometry", SaveOdometryCB);
 
+    // main loop pinning, scheduling class & memory locking, see config/tools/thread_config.yaml:
+    ThreadConfig thread_config("filtering_node");
+    thread_config.Apply();
+    JitterMonitor jitter_monitor("filtering_node", 0.01, thread_config.IsJitterMeasured());
+
     ros::Rate rate(100);
     while (ros::ok()) {
+        jitter_monitor.Tick();
         ros::spinOnce();
 
-        filtering_flow_ptr->Run();
-
-        // save odometry estimations for evo evaluation:
-        if ( _need_save_odometry && filtering_flow_ptr->SaveOdometry()) {
-            _need_save_odometry = false;
-        }
+        _filtering_flow_ptr->Run();
 
         rate.sleep();
     }
 
+    // a job submitted right before shutdown is finished, before the flow goes:
+    _background_jobs_ptr.reset();
+
     return 0;
 }
\ No newline at end of file
@@ -7,6 +7,10 @@
 #include "glog/logging.h"
 
 #include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/trace_service.hpp"
+#include "lidar_localization/tools/metrics_publisher.hpp"
+#include "lidar_localization/tools/thread_config.hpp"
+#include "lidar_localization/tools/tracer.hpp"
 #include "lidar_localization/mapping/front_end/front_end_flow.hpp"
 
 using namespace lidar_localization;
@@ -18,6 +22,10 @@ int main(int argc, char *argv[]) {
 
     ros::init(argc, argv, "front_end_node");
     ros::NodeHandle nh;
+    // dump_trace & metrics, one per node:
+    ros::NodeHandle private_nh("~");
+    TraceService trace_service(private_nh);
+    MetricsPublisher metrics_publisher(private_nh);
 
     std::string cloud_topic, odom_topic;
     nh.param<std::string>("cloud_topic", cloud_topic, "/synced_cloud");
@@ -29,8 +37,14 @@ int main(int argc, char *argv[]) {
     // a. lidar odometry estimation
     std::shared_ptr<FrontEndFlow> front_end_flow_ptr = std::make_shared<FrontEndFlow>(nh, cloud_topic, odom_topic);
 
+    // main loop pinning, scheduling class & memory locking, see config/tools/thread_config.yaml:
+    ThreadConfig thread_config("front_end_node");
+    thread_config.Apply();
+    JitterMonitor jitter_monitor("front_end_node", 0.01, thread_config.IsJitterMeasured());
+
     ros::Rate rate(100);
     while (ros::ok()) {
+        jitter_monitor.Tick();
         ros::spinOnce();
 
         front_end_flow_ptr->Run();
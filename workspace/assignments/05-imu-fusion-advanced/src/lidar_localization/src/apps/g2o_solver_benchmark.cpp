@@ -0,0 +1,129 @@
+/*
+ * @Description: benchmark of g2o solvers, by replaying a graph exported by back end
+ * @Author: Ge Yao
+ * @Date: 2020-12-27 15:22:03
+ */
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+
+#include <yaml-cpp/yaml.h>
+#include <benchmark/benchmark.h>
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/models/graph_optimizer/g2o/g2o_graph_optimizer.hpp"
+
+using namespace lidar_localization;
+
+struct SavedGraph {
+    std::string path;
+    std::string content;
+};
+
+bool LoadGraph(const YAML::Node& config_node, SavedGraph& graph) {
+    graph.path = config_node["graph_path"].as<std::string>();
+    if (graph.path.front() != '/') {
+        graph.path = WORK_SPACE_PATH + "/" + graph.path;
+    }
+
+    std::ifstream ifs(graph.path);
+    if (!ifs) {
+        LOG(ERROR) << "Cannot open graph " << graph.path << ", set save_graph in back_end.yaml to export one.";
+        return false;
+    }
+
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    graph.content = ss.str();
+
+    // check that the graph can be parsed:
+    std::istringstream is(graph.content);
+    g2o::SparseOptimizer optimizer;
+    if (!optimizer.load(is) || optimizer.vertices().empty()) {
+        LOG(ERROR) << "Invalid graph " << graph.path;
+        return false;
+    }
+
+    LOG(INFO) << "Graph " << graph.path << ": "
+              << optimizer.vertices().size() << " vertices, "
+              << optimizer.edges().size() << " edges.";
+
+    return true;
+}
+
+double GetElapsedSeconds(const std::chrono::steady_clock::time_point& start, const std::chrono::steady_clock::time_point& end) {
+    return std::chrono::duration<double>(end - start).count();
+}
+
+/**
+ * @brief  time of a batch optimization of the whole graph, from the exported estimate.
+ *         loading the graph is not timed
+ */
+void BenchmarkOptimize(benchmark::State& state, const std::string solver_type, const SavedGraph* graph, int max_iterations_num) {
+    double num_iterations = 0.0, chi2_before = 0.0, chi2_after = 0.0;
+
+    for (auto _ : state) {
+        std::istringstream is(graph->content);
+        g2o::SparseOptimizer optimizer;
+        optimizer.load(is);
+
+        g2o::OptimizationAlgorithm *solver = G2oGraphOptimizer::CreateAlgorithm(solver_type);
+        if (solver == nullptr) {
+            state.SkipWithError(("solver " + solver_type + " not found").c_str());
+            break;
+        }
+        optimizer.setAlgorithm(solver);
+        optimizer.setVerbose(false);
+
+        auto start = std::chrono::steady_clock::now();
+        optimizer.initializeOptimization();
+        optimizer.computeActiveErrors();
+        const double chi2 = optimizer.chi2();
+        const int iterations = optimizer.optimize(max_iterations_num);
+        auto end = std::chrono::steady_clock::now();
+
+        state.SetIterationTime(GetElapsedSeconds(start, end));
+
+        num_iterations += iterations;
+        chi2_before = chi2;
+        chi2_after = optimizer.chi2();
+    }
+
+    state.counters["iterations"] = benchmark::Counter(num_iterations, benchmark::Counter::kAvgIterations);
+    state.counters["chi2_before"] = chi2_before;
+    state.counters["chi2_after"] = chi2_after;
+}
+
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_log_dir = WORK_SPACE_PATH + "/Log";
+    FLAGS_alsologtostderr = 1;
+
+    // the --benchmark_* flags are consumed here, e.g. --benchmark_filter=G2O/lm_fix6_3:
+    benchmark::Initialize(&argc, argv);
+
+    std::string config_file_path = (argc > 1) ? argv[1] : WORK_SPACE_PATH + "/config/benchmark/g2o_solver_benchmark.yaml";
+    YAML::Node config_node = YAML::LoadFile(config_file_path);
+
+    SavedGraph graph;
+    if (!LoadGraph(config_node, graph)) {
+        return 1;
+    }
+
+    const int max_iterations_num = config_node["max_iterations_num"].as<int>();
+    for (const YAML::Node& solver_type_node: config_node["solver_types"]) {
+        const std::string solver_type = solver_type_node.as<std::string>();
+
+        benchmark::RegisterBenchmark(
+            ("G2O/" + solver_type).c_str(),
+            BenchmarkOptimize, solver_type, &graph, max_iterations_num
+        )->UseManualTime()->Unit(benchmark::kMillisecond);
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+
+    return 0;
+}
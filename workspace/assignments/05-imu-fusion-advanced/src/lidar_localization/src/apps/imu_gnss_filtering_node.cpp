@@ -12,6 +12,10 @@
 #include "glog/logging.h"
 
 #include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/trace_service.hpp"
+#include "lidar_localization/tools/metrics_publisher.hpp"
+#include "lidar_localization/tools/thread_config.hpp"
+#include "lidar_localization/tools/tracer.hpp"
 
 using namespace lidar_localization;
 
@@ -31,12 +35,22 @@ int main(int argc, char *argv[]) {
 
     ros::init(argc, argv, "imu_gnss_filtering_node");
     ros::NodeHandle nh;
+    // dump_trace & metrics, one per node:
+    ros::NodeHandle private_nh("~");
+    TraceService trace_service(private_nh);
+    MetricsPublisher metrics_publisher(private_nh);
 
     std::shared_ptr<IMUGNSSFilteringFlow> imu_gnss_filtering_flow_ptr = std::make_shared<IMUGNSSFilteringFlow>(nh);
     ros::ServiceServer service = nh.advertiseService("save_odometry", SaveOdometryCB);
 
+    // main loop pinning, scheduling class & memory locking, see config/tools/thread_config.yaml:
+    ThreadConfig thread_config("imu_gnss_filtering_node");
+    thread_config.Apply();
+    JitterMonitor jitter_monitor("imu_gnss_filtering_node", 0.01, thread_config.IsJitterMeasured());
+
     ros::Rate rate(100);
     while (ros::ok()) {
+        jitter_monitor.Tick();
         ros::spinOnce();
 
         imu_gnss_filtering_flow_ptr->Run();
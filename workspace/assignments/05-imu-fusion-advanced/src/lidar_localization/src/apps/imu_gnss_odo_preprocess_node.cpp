@@ -7,6 +7,10 @@
 #include "glog/logging.h"
 
 #include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/trace_service.hpp"
+#include "lidar_localization/tools/metrics_publisher.hpp"
+#include "lidar_localization/tools/thread_config.hpp"
+#include "lidar_localization/tools/tracer.hpp"
 #include "lidar_localization/data_pretreat/imu_gnss_odo_preprocess_flow.hpp"
 
 using namespace lidar_localization;
@@ -18,6 +22,10 @@ int main(int argc, char *argv[]) {
 
     ros::init(argc, argv, "imu_gnss_odo_preprocess_node");
     ros::NodeHandle nh;
+    // dump_trace & metrics, one per node:
+    ros::NodeHandle private_nh("~");
+    TraceService trace_service(private_nh);
+    MetricsPublisher metrics_publisher(private_nh);
 
     // subscribe to
     // a. raw IMU measurement
@@ -35,8 +43,14 @@ int main(int argc, char *argv[]) {
     );
 
     // pre-process IMU, GNSS & odo measurements at 100Hz:
+    // main loop pinning, scheduling class & memory locking, see config/tools/thread_config.yaml:
+    ThreadConfig thread_config("imu_gnss_odo_preprocess_node");
+    thread_config.Apply();
+    JitterMonitor jitter_monitor("imu_gnss_odo_preprocess_node", 0.01, thread_config.IsJitterMeasured());
+
     ros::Rate rate(100);
     while (ros::ok()) {
+        jitter_monitor.Tick();
         ros::spinOnce();
 
         imu_gnss_odo_preprocess_flow_ptr->Run();
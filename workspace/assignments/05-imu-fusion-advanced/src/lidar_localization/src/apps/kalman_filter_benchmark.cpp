@@ -0,0 +1,614 @@
+/*
+ * @Description: micro-benchmark of Kalman filter predict & correct, on synthetic streams of gnss_ins_sim motion definition
+ * @Author: Ge Yao
+ * @Date: 2020-12-23 10:12:45
+ */
+#include <cmath>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+
+#include <yaml-cpp/yaml.h>
+#include <Eigen/Core>
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+#include <benchmark/benchmark.h>
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/sensor_data/imu_data.hpp"
+#include "lidar_localization/tools/allocation_counter.hpp"
+#include "lidar_localization/models/kalman_filter/error_state_kalman_filter.hpp"
+#include "lidar_localization/models/kalman_filter/error_state_kalman_filter_bank.hpp"
+#include "lidar_localization/models/kalman_filter/extended_kalman_filter.hpp"
+
+using namespace lidar_localization;
+
+struct MotionCommand {
+    int type;
+    // euler angles yaw, pitch & roll, in rad, rate in rad/s for type 1:
+    Eigen::Vector3d attitude;
+    // body frame velocity, acceleration for type 1:
+    Eigen::Vector3d velocity;
+    double duration;
+};
+
+struct TruthSample {
+    double time;
+    // navigation frame, starts at origin:
+    Eigen::Matrix4d T_nb;
+    Eigen::Vector3d v_n;
+    Eigen::Vector3d v_b;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+struct SyntheticStreams {
+    Eigen::Vector3d init_v_b;
+    std::vector<IMUData> imu;
+    // measurements are taken at the time of imu[measurement_index[i]]:
+    std::vector<size_t> measurement_index;
+    std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> T_nb;
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> v_b;
+};
+
+Eigen::Matrix3d GetRotation(const Eigen::Vector3d& euler) {
+    return (
+        Eigen::AngleAxisd(euler(0), Eigen::Vector3d::UnitZ()) *
+        Eigen::AngleAxisd(euler(1), Eigen::Vector3d::UnitY()) *
+        Eigen::AngleAxisd(euler(2), Eigen::Vector3d::UnitX())
+    ).toRotationMatrix();
+}
+
+bool ParseRow(const std::string& line, std::vector<double>& values) {
+    values.clear();
+
+    std::stringstream ss(line);
+    std::string value;
+    while (std::getline(ss, value, ',')) {
+        try {
+            values.push_back(std::stod(value));
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+
+    return !values.empty();
+}
+
+/**
+ * @brief  load gnss_ins_sim motion definition
+ * @param  motion_def_path, motion definition csv
+ * @param  init_state, init yaw, pitch & roll in rad, followed by body frame velocity
+ * @param  commands, motion commands
+ * @return true if success false otherwise
+ */
+bool LoadMotionDefinition(
+    const std::string& motion_def_path,
+    Eigen::Matrix<double, 6, 1>& init_state, std::vector<MotionCommand>& commands
+) {
+    std::ifstream ifs(motion_def_path);
+    if (!ifs) {
+        LOG(ERROR) << "Cannot open motion definition " << motion_def_path;
+        return false;
+    }
+
+    std::string line;
+    std::vector<double> values;
+
+    // a. init state, lat, lon, alt, vx_body, vy_body, vz_body, yaw, pitch, roll, the position is not used:
+    std::getline(ifs, line);
+    if (!std::getline(ifs, line) || !ParseRow(line, values) || values.size() < 9) {
+        LOG(ERROR) << "Invalid init state in motion definition " << motion_def_path;
+        return false;
+    }
+    init_state << values.at(6) * M_PI / 180.0, values.at(7) * M_PI / 180.0, values.at(8) * M_PI / 180.0,
+                  values.at(3), values.at(4), values.at(5);
+
+    // b. commands, type, yaw, pitch, roll, vx_body, vy_body, vz_body, duration, GPS visibility:
+    std::getline(ifs, line);
+    commands.clear();
+    while (std::getline(ifs, line)) {
+        if (!ParseRow(line, values)) {
+            continue;
+        }
+        if (values.size() < 8) {
+            LOG(WARNING) << "Skip invalid motion command: " << line;
+            continue;
+        }
+
+        MotionCommand command;
+        command.type = static_cast<int>(values.at(0));
+        command.attitude << values.at(1) * M_PI / 180.0, values.at(2) * M_PI / 180.0, values.at(3) * M_PI / 180.0;
+        command.velocity << values.at(4), values.at(5), values.at(6);
+        command.duration = values.at(7);
+
+        if (command.type < 1 || command.type > 5 || command.duration <= 0.0) {
+            LOG(WARNING) << "Skip unsupported motion command: " << line;
+            continue;
+        }
+
+        commands.push_back(command);
+    }
+
+    if (commands.empty()) {
+        LOG(ERROR) << "No motion command in motion definition " << motion_def_path;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief  generate noise-free IMU measurements & ground truth of motion definition
+ *         the target of command types 2-5 is reached at constant rate over the whole duration,
+ *         instead of at the max. rates of gnss_ins_sim, which makes no difference to the filter cost
+ * @param  config_node, benchmark config
+ * @param  earth_node, earth constants of filter config
+ * @param  streams, output synthetic streams
+ * @return true if success false otherwise
+ */
+bool GenerateStreams(const YAML::Node& config_node, const YAML::Node& earth_node, SyntheticStreams& streams) {
+    std::string motion_def_path = config_node["motion_def_path"].as<std::string>();
+    if (motion_def_path.front() != '/') {
+        motion_def_path = WORK_SPACE_PATH + "/" + motion_def_path;
+    }
+
+    Eigen::Matrix<double, 6, 1> init_state;
+    std::vector<MotionCommand> commands;
+    if (!LoadMotionDefinition(motion_def_path, init_state, commands)) {
+        return false;
+    }
+
+    const double imu_rate = config_node["imu_rate"].as<double>();
+    const double measurement_rate = config_node["measurement_rate"].as<double>();
+    const double dt = 1.0 / imu_rate;
+    const int measurement_interval = std::max(static_cast<int>(std::round(imu_rate / measurement_rate)), 1);
+
+    // same earth model as the filters:
+    const double latitude = earth_node["latitude"].as<double>() * M_PI / 180.0;
+    const double rotation_speed = earth_node["rotation_speed"].as<double>();
+    const Eigen::Vector3d g(0.0, 0.0, earth_node["gravity_magnitude"].as<double>());
+    const Eigen::Vector3d w_ie(0.0, rotation_speed*cos(latitude), rotation_speed*sin(latitude));
+
+    // a. ground truth:
+    std::vector<TruthSample, Eigen::aligned_allocator<TruthSample>> truth;
+    {
+        Eigen::Vector3d euler = init_state.head<3>();
+        Eigen::Vector3d v_b = init_state.tail<3>();
+        Eigen::Vector3d p_n = Eigen::Vector3d::Zero();
+        double time = 0.0;
+
+        auto add_sample = [&]() {
+            TruthSample sample;
+            sample.time = time;
+            sample.T_nb = Eigen::Matrix4d::Identity();
+            sample.T_nb.block<3, 3>(0, 0) = GetRotation(euler);
+            sample.T_nb.block<3, 1>(0, 3) = p_n;
+            sample.v_b = v_b;
+            sample.v_n = sample.T_nb.block<3, 3>(0, 0) * v_b;
+            truth.push_back(sample);
+        };
+        add_sample();
+
+        for (const MotionCommand& command: commands) {
+            Eigen::Vector3d euler_rate, v_b_rate;
+            switch (command.type) {
+                case 1:
+                    euler_rate = command.attitude;
+                    v_b_rate = command.velocity;
+                    break;
+                case 2:
+                    euler_rate = (command.attitude - euler) / command.duration;
+                    v_b_rate = (command.velocity - v_b) / command.duration;
+                    break;
+                case 3:
+                    euler_rate = command.attitude / command.duration;
+                    v_b_rate = command.velocity / command.duration;
+                    break;
+                case 4:
+                    euler_rate = (command.attitude - euler) / command.duration;
+                    v_b_rate = command.velocity / command.duration;
+                    break;
+                default:
+                    euler_rate = command.attitude / command.duration;
+                    v_b_rate = (command.velocity - v_b) / command.duration;
+                    break;
+            }
+
+            const int num_steps = std::max(static_cast<int>(std::round(command.duration * imu_rate)), 1);
+            for (int i = 0; i < num_steps; ++i) {
+                const Eigen::Vector3d v_n_prev = truth.back().v_n;
+
+                euler += euler_rate * dt;
+                v_b += v_b_rate * dt;
+                time += dt;
+                p_n += 0.5 * (v_n_prev + GetRotation(euler) * v_b) * dt;
+
+                add_sample();
+            }
+        }
+    }
+
+    // b. IMU measurements, by differentiating ground truth:
+    streams.init_v_b = init_state.tail<3>();
+    streams.imu.clear();
+    streams.measurement_index.clear();
+    streams.T_nb.clear();
+    streams.v_b.clear();
+
+    // the filters take pose measurements relative to their init pose:
+    Eigen::Matrix4d init_pose = Eigen::Matrix4d::Identity();
+    init_pose.block<3, 3>(0, 0) = truth.front().T_nb.block<3, 3>(0, 0);
+    const Eigen::Matrix4d init_pose_inv = init_pose.inverse();
+
+    for (size_t i = 0; i + 1 < truth.size(); ++i) {
+        const Eigen::Matrix3d R_curr = truth.at(i).T_nb.block<3, 3>(0, 0);
+        const Eigen::Matrix3d R_next = truth.at(i + 1).T_nb.block<3, 3>(0, 0);
+
+        const Eigen::AngleAxisd delta_rotation(R_curr.transpose() * R_next);
+        const Eigen::Vector3d angular_vel = delta_rotation.angle() * delta_rotation.axis() / dt + R_curr.transpose() * w_ie;
+        const Eigen::Vector3d linear_acc = R_curr.transpose() * ((truth.at(i + 1).v_n - truth.at(i).v_n) / dt - g);
+        const Eigen::Quaterniond orientation(R_curr);
+
+        IMUData imu_data;
+        imu_data.time = truth.at(i).time;
+        imu_data.angular_velocity.x = angular_vel.x();
+        imu_data.angular_velocity.y = angular_vel.y();
+        imu_data.angular_velocity.z = angular_vel.z();
+        imu_data.linear_acceleration.x = linear_acc.x();
+        imu_data.linear_acceleration.y = linear_acc.y();
+        imu_data.linear_acceleration.z = linear_acc.z();
+        imu_data.orientation.x = orientation.x();
+        imu_data.orientation.y = orientation.y();
+        imu_data.orientation.z = orientation.z();
+        imu_data.orientation.w = orientation.w();
+        streams.imu.push_back(imu_data);
+
+        if (i > 0 && 0 == i % measurement_interval) {
+            streams.measurement_index.push_back(i);
+            streams.T_nb.push_back(init_pose_inv * truth.at(i).T_nb);
+            streams.v_b.push_back(truth.at(i).v_b);
+        }
+    }
+
+    if (streams.measurement_index.empty()) {
+        LOG(ERROR) << "Motion definition is too short for measurement rate " << measurement_rate;
+        return false;
+    }
+
+    LOG(INFO) << "Synthetic streams of " << motion_def_path << ": "
+              << streams.imu.size() << " IMU measurements, "
+              << streams.measurement_index.size() << " measurements, "
+              << truth.back().time << " seconds.";
+
+    return true;
+}
+
+double GetElapsedSeconds(const std::chrono::steady_clock::time_point& start, const std::chrono::steady_clock::time_point& end) {
+    return std::chrono::duration<double>(end - start).count();
+}
+
+// num. of benchmarks over their allocation budget:
+int num_over_allocation_budget = 0;
+
+// max. allocations per call of the benchmark, negative if it has no budget:
+double GetAllocationBudget(const YAML::Node& config_node, const std::string& benchmark_name) {
+    const YAML::Node& budgets_node = config_node["allocation_budgets"];
+    if (!budgets_node || !budgets_node[benchmark_name]) {
+        return -1.0;
+    }
+
+    return budgets_node[benchmark_name].as<double>();
+}
+
+/**
+ * @brief  report the allocations per timed call, the benchmark fails if they are over its budget
+ */
+void CheckAllocations(benchmark::State& state, uint64_t num_allocations, double max_allocations) {
+    if (!AllocationCounter::IsEnabled()) {
+        return;
+    }
+
+    const double allocations = static_cast<double>(num_allocations) / std::max<double>(state.iterations(), 1.0);
+    state.counters["allocs_per_call"] = allocations;
+
+    if (max_allocations >= 0.0 && allocations > max_allocations) {
+        state.SkipWithError("allocates more than its budget per call");
+        ++num_over_allocation_budget;
+    }
+}
+
+/**
+ * @brief  ns/predict, one Kalman update per IMU measurement, restarted at the end of the streams
+ */
+template<typename FilterType>
+void BenchmarkPredict(
+    benchmark::State& state, const YAML::Node filter_config_node, const SyntheticStreams* streams,
+    double max_allocations
+) {
+    FilterType filter(filter_config_node);
+
+    size_t index = 0;
+    uint64_t num_allocations = 0;
+    filter.Init(streams->init_v_b, streams->imu.front());
+
+    for (auto _ : state) {
+        if (++index == streams->imu.size()) {
+            index = 1;
+            filter.Init(streams->init_v_b, streams->imu.front());
+        }
+
+        const uint64_t begin_allocations = AllocationCounter::GetNumAllocations();
+        auto start = std::chrono::steady_clock::now();
+        benchmark::DoNotOptimize(filter.Update(streams->imu.at(index)));
+        auto end = std::chrono::steady_clock::now();
+        num_allocations += AllocationCounter::GetNumAllocations() - begin_allocations;
+
+        state.SetIterationTime(GetElapsedSeconds(start, end));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    CheckAllocations(state, num_allocations, max_allocations);
+}
+
+/**
+ * @brief  ns/predict of all hypotheses of the filter bank, as BenchmarkPredict
+ */
+void BenchmarkBankPredict(
+    benchmark::State& state, const YAML::Node filter_config_node, const SyntheticStreams* streams, 
+    int num_hypotheses, double max_allocations
+) {
+    ErrorStateKalmanFilterBank filter_bank(filter_config_node);
+
+    size_t index = 0;
+    uint64_t num_allocations = 0;
+    filter_bank.Init(num_hypotheses, streams->init_v_b, streams->imu.front());
+
+    for (auto _ : state) {
+        if (++index == streams->imu.size()) {
+            index = 1;
+            filter_bank.Init(num_hypotheses, streams->init_v_b, streams->imu.front());
+        }
+
+        const uint64_t begin_allocations = AllocationCounter::GetNumAllocations();
+        auto start = std::chrono::steady_clock::now();
+        benchmark::DoNotOptimize(filter_bank.Update(streams->imu.at(index)));
+        auto end = std::chrono::steady_clock::now();
+        num_allocations += AllocationCounter::GetNumAllocations() - begin_allocations;
+
+        state.SetIterationTime(GetElapsedSeconds(start, end));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    CheckAllocations(state, num_allocations, max_allocations);
+}
+
+/**
+ * @brief  ns/correct, one Kalman correction per measurement, the predictions in between are not timed
+ */
+template<typename FilterType>
+void BenchmarkCorrect(
+    benchmark::State& state, const YAML::Node filter_config_node, const SyntheticStreams* streams,
+    typename FilterType::MeasurementType measurement_type, bool with_observability_analysis,
+    double max_allocations
+) {
+    FilterType filter(filter_config_node);
+
+    size_t imu_index = 0, measurement_index = 0;
+    filter.Init(streams->init_v_b, streams->imu.front());
+
+    typename FilterType::Measurement measurement;
+    measurement.m_b = Eigen::Vector3d::Zero();
+
+    double observability_time = 0.0;
+    uint64_t num_allocations = 0;
+    for (auto _ : state) {
+        if (measurement_index == streams->measurement_index.size()) {
+            imu_index = measurement_index = 0;
+            filter.Init(streams->init_v_b, streams->imu.front());
+        }
+
+        // predict up to measurement time, so that the correction does not include a prediction:
+        const size_t measurement_imu_index = streams->measurement_index.at(measurement_index);
+        while (imu_index < measurement_imu_index) {
+            filter.Update(streams->imu.at(++imu_index));
+        }
+
+        measurement.time = streams->imu.at(imu_index).time;
+        measurement.T_nb = streams->T_nb.at(measurement_index);
+        measurement.v_b = streams->v_b.at(measurement_index);
+        ++measurement_index;
+
+        const uint64_t begin_allocations = AllocationCounter::GetNumAllocations();
+        auto start = std::chrono::steady_clock::now();
+        benchmark::DoNotOptimize(filter.Correct(streams->imu.at(imu_index), measurement_type, measurement));
+        auto end = std::chrono::steady_clock::now();
+        if (with_observability_analysis) {
+            auto correct_end = end;
+            filter.UpdateObservabilityAnalysis(measurement.time, measurement_type);
+            end = std::chrono::steady_clock::now();
+
+            observability_time += GetElapsedSeconds(correct_end, end);
+        }
+        num_allocations += AllocationCounter::GetNumAllocations() - begin_allocations;
+
+        state.SetIterationTime(GetElapsedSeconds(start, end));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    // share of the observability snapshot in the reported time:
+    state.counters["observability_ns"] = benchmark::Counter(1.0e9 * observability_time, benchmark::Counter::kAvgIterations);
+    CheckAllocations(state, num_allocations, max_allocations);
+}
+
+/**
+ * @brief  accuracy of MIXED precision against the DOUBLE baseline, both run over the whole streams
+ *         with pose corrections, the run fails if the differences are over the tolerances
+ * @return true if within tolerances false otherwise
+ */
+bool CheckMixedPrecision(const YAML::Node& filter_config_node, const SyntheticStreams& streams, const YAML::Node& config_node) {
+    const YAML::Node& tolerance_node = config_node["mixed_precision_tolerance"];
+    if (!tolerance_node) {
+        return true;
+    }
+
+    YAML::Node double_config_node = YAML::Clone(filter_config_node);
+    YAML::Node mixed_config_node = YAML::Clone(filter_config_node);
+    double_config_node["precision"] = "DOUBLE";
+    mixed_config_node["precision"] = "MIXED";
+
+    ErrorStateKalmanFilter double_filter(double_config_node), mixed_filter(mixed_config_node);
+    double_filter.Init(streams.init_v_b, streams.imu.front());
+    mixed_filter.Init(streams.init_v_b, streams.imu.front());
+
+    ErrorStateKalmanFilter::Measurement measurement;
+    measurement.m_b = Eigen::Vector3d::Zero();
+
+    // max. position difference, in m, & max. relative difference of covariance diagonal:
+    double max_position_diff = 0.0;
+    double max_covariance_diff = 0.0;
+    size_t measurement_index = 0;
+    ErrorStateKalmanFilter::State double_state, mixed_state;
+    for (size_t i = 1; i < streams.imu.size(); ++i) {
+        double_filter.Update(streams.imu.at(i));
+        mixed_filter.Update(streams.imu.at(i));
+
+        if (measurement_index < streams.measurement_index.size() && streams.measurement_index.at(measurement_index) == i) {
+            measurement.time = streams.imu.at(i).time;
+            measurement.T_nb = streams.T_nb.at(measurement_index);
+            measurement.v_b = streams.v_b.at(measurement_index);
+            ++measurement_index;
+
+            double_filter.Correct(streams.imu.at(i), ErrorStateKalmanFilter::MeasurementType::POSE, measurement);
+            mixed_filter.Correct(streams.imu.at(i), ErrorStateKalmanFilter::MeasurementType::POSE, measurement);
+        }
+
+        double_filter.GetState(double_state);
+        mixed_filter.GetState(mixed_state);
+
+        max_position_diff = std::max(
+            max_position_diff,
+            (double_state.pose.block<3, 1>(0, 3) - mixed_state.pose.block<3, 1>(0, 3)).norm()
+        );
+        const ErrorStateKalmanFilter::VectorX double_covariance = double_state.P.diagonal();
+        const ErrorStateKalmanFilter::VectorX mixed_covariance = mixed_state.P.diagonal();
+        max_covariance_diff = std::max(
+            max_covariance_diff,
+            ((double_covariance - mixed_covariance).cwiseAbs().array() / double_covariance.cwiseAbs().array().max(1.0e-12)).maxCoeff()
+        );
+    }
+
+    const double position_tolerance = tolerance_node["position"].as<double>();
+    const double covariance_tolerance = tolerance_node["covariance"].as<double>();
+    const bool is_within_tolerance = (
+        max_position_diff <= position_tolerance && max_covariance_diff <= covariance_tolerance
+    );
+
+    LOG(INFO) << "ESKF mixed precision against double: "
+              << "max. position diff. " << max_position_diff << " m (tolerance " << position_tolerance << "), "
+              << "max. relative covariance diff. " << max_covariance_diff << " (tolerance " << covariance_tolerance << ")"
+              << (is_within_tolerance ? "" : ", OVER TOLERANCE");
+
+    return is_within_tolerance;
+}
+
+template<typename FilterType>
+void RegisterFilterBenchmarks(
+    const std::string& filter_name, const YAML::Node& filter_config_node, const SyntheticStreams& streams,
+    const YAML::Node& config_node
+) {
+    const std::string predict_name = filter_name + "/Predict";
+    benchmark::RegisterBenchmark(
+        predict_name.c_str(),
+        BenchmarkPredict<FilterType>, filter_config_node, &streams, GetAllocationBudget(config_node, predict_name)
+    )->UseManualTime()->Unit(benchmark::kNanosecond);
+
+    const std::vector<std::pair<std::string, typename FilterType::MeasurementType>> measurement_types = {
+        {"POSE", FilterType::MeasurementType::POSE},
+        {"POSITION", FilterType::MeasurementType::POSITION},
+        {"POSITION_VELOCITY", FilterType::MeasurementType::POSITION_VELOCITY}
+    };
+
+    for (const auto& measurement_type: measurement_types) {
+        for (bool with_observability_analysis: {false, true}) {
+            // observability snapshots are only taken when the buffer is enabled:
+            YAML::Node correct_config_node = YAML::Clone(filter_config_node);
+            if (!with_observability_analysis) {
+                correct_config_node["observability_buffer_size"] = 0;
+            } else if (
+                correct_config_node["observability_buffer_size"] && 
+                correct_config_node["observability_buffer_size"].as<int>() <= 0
+            ) {
+                correct_config_node["observability_buffer_size"] = 1000;
+            }
+
+            const std::string correct_name = (
+                filter_name + "/Correct/" + measurement_type.first + (with_observability_analysis ? "/observability" : "")
+            );
+            benchmark::RegisterBenchmark(
+                correct_name.c_str(),
+                BenchmarkCorrect<FilterType>, correct_config_node, &streams, measurement_type.second, with_observability_analysis,
+                GetAllocationBudget(config_node, correct_name)
+            )->UseManualTime()->Unit(benchmark::kNanosecond);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_log_dir = WORK_SPACE_PATH + "/Log";
+    FLAGS_alsologtostderr = 1;
+
+    // the --benchmark_* flags are consumed here, e.g. --benchmark_filter=ESKF/Correct:
+    benchmark::Initialize(&argc, argv);
+
+    std::string config_file_path = (argc > 1) ? argv[1] : WORK_SPACE_PATH + "/config/benchmark/kalman_filter_benchmark.yaml";
+    YAML::Node config_node = YAML::LoadFile(config_file_path);
+    YAML::Node filter_config_node = YAML::LoadFile(
+        WORK_SPACE_PATH + "/" + config_node["filter_config_path"].as<std::string>()
+    )["kalman_filter"];
+
+    SyntheticStreams streams;
+    if (!GenerateStreams(config_node, filter_config_node["earth"], streams)) {
+        return 1;
+    }
+
+    const bool is_mixed_precision_accurate = CheckMixedPrecision(filter_config_node, streams, config_node);
+
+    // the filters log on each init:
+    FLAGS_alsologtostderr = 0;
+
+    RegisterFilterBenchmarks<ErrorStateKalmanFilter>("ESKF", filter_config_node, streams, config_node);
+    // to be compared with ESKF/Predict:
+    YAML::Node mixed_config_node = YAML::Clone(filter_config_node);
+    mixed_config_node["precision"] = "MIXED";
+    RegisterFilterBenchmarks<ErrorStateKalmanFilter>("ESKFMixed", mixed_config_node, streams, config_node);
+    RegisterFilterBenchmarks<ExtendedKalmanFilter>("EKF", filter_config_node, streams, config_node);
+    // to be compared with ESKF/Predict:
+    for (int num_hypotheses: {1, 4, 8, 16}) {
+        const std::string bank_predict_name = "ESKFBank/Predict/" + std::to_string(num_hypotheses);
+        benchmark::RegisterBenchmark(
+            bank_predict_name.c_str(),
+            BenchmarkBankPredict, filter_config_node, &streams, num_hypotheses,
+            GetAllocationBudget(config_node, bank_predict_name)
+        )->UseManualTime()->Unit(benchmark::kNanosecond);
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+
+    // allocation & accuracy regressions fail the run:
+    if (num_over_allocation_budget > 0) {
+        LOG(ERROR) << num_over_allocation_budget << " benchmarks allocate more than their budget per call.";
+        return 1;
+    }
+    if (!is_mixed_precision_accurate) {
+        LOG(ERROR) << "ESKF mixed precision is over its accuracy tolerance against double.";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * @Description: map QA of loop closure proposals, exhaustive scan context search vs. ring key search
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 20:05:17
+ */
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+
+#include <yaml-cpp/yaml.h>
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/tic_toc.hpp"
+#include "lidar_localization/models/scan_context_manager/scan_context_manager.hpp"
+#include "lidar_localization/models/scan_context_manager/scan_context_distance.hpp"
+
+using namespace lidar_localization;
+
+std::string GetPath(const YAML::Node& config_node, const std::string& name) {
+    std::string path = config_node[name].as<std::string>();
+    if (path.front() != '/') {
+        path = WORK_SPACE_PATH + "/" + path;
+    }
+
+    return path;
+}
+
+// best proposal of each key frame, NONE if there is none:
+std::vector<int> GetBestMatches(
+    size_t num_key_frames,
+    const std::vector<ScanContextManager::SessionMatch>& matches,
+    std::vector<float>& distances
+) {
+    std::vector<int> best_matches(num_key_frames, ScanContextManager::NONE);
+    distances.assign(num_key_frames, 1.0f);
+    for (const ScanContextManager::SessionMatch& match: matches) {
+        if (ScanContextManager::NONE == best_matches.at(match.query_id)) {
+            best_matches.at(match.query_id) = match.match_id;
+            distances.at(match.query_id) = match.distance;
+        }
+    }
+
+    return best_matches;
+}
+
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_alsologtostderr = 1;
+
+    std::string config_file_path = WORK_SPACE_PATH + "/config/mapping/loop_candidate_qa.yaml";
+    YAML::Node config_node = YAML::LoadFile(config_file_path);
+
+    // same descriptors & thresholds as loop closing:
+    YAML::Node loop_closing_config_node = YAML::LoadFile(WORK_SPACE_PATH + "/config/mapping/loop_closing.yaml");
+    const YAML::Node& scan_context_node = loop_closing_config_node["scan_context"];
+
+    const std::string index_path = GetPath(config_node, "index_path");
+    const std::string report_path = GetPath(config_node, "report_path");
+    const float revisit_distance = config_node["revisit_distance"].as<float>();
+
+    // key frame poses of the index are GNSS/IMU poses, as saved by loop closing:
+    ScanContextManager scan_context_manager(scan_context_node);
+    if (!scan_context_manager.Load(index_path)) {
+        LOG(ERROR) << "Failed to load scan context index from " << index_path;
+        return 1;
+    }
+    const size_t num_key_frames = scan_context_manager.GetNumKeyFrames();
+
+    TicToc timer;
+    std::vector<ScanContextManager::SessionMatch> exhaustive_matches;
+    ScanContextDistance scan_context_distance(
+        scan_context_node["num_rings"].as<int>(),
+        scan_context_node["num_sectors"].as<int>(),
+        config_node["use_cuda"].as<bool>()
+    );
+    scan_context_manager.DetectLoopClosures(1, nullptr, scan_context_distance, exhaustive_matches);
+    const double exhaustive_time = timer.toc();
+
+    timer.tic();
+    std::vector<ScanContextManager::SessionMatch> kd_tree_matches;
+    scan_context_manager.DetectLoopClosures(1, nullptr, kd_tree_matches);
+    const double kd_tree_time = timer.toc();
+
+    std::vector<float> exhaustive_distances, kd_tree_distances;
+    const std::vector<int> exhaustive_best = GetBestMatches(num_key_frames, exhaustive_matches, exhaustive_distances);
+    const std::vector<int> kd_tree_best = GetBestMatches(num_key_frames, kd_tree_matches, kd_tree_distances);
+
+    auto get_pose_distance = [&](int query_id, int match_id) {
+        if (ScanContextManager::NONE == match_id)
+            return -1.0f;
+
+        const Eigen::Vector3f distance =
+            scan_context_manager.GetKeyFrame(query_id).pose.block<3, 1>(0, 3) -
+            scan_context_manager.GetKeyFrame(match_id).pose.block<3, 1>(0, 3);
+        return distance.norm();
+    };
+
+    std::ofstream ofs(report_path);
+    if (!ofs) {
+        LOG(ERROR) << "Cannot create loop candidate QA report " << report_path;
+        return 1;
+    }
+
+    // a. revisits & aliases of the exhaustive search, b. kd-tree recall of the revisits:
+    int num_revisits = 0, num_aliases = 0;
+    int num_recalled = 0, num_missed = 0, num_kd_tree_aliases = 0;
+    ofs << std::setprecision(6);
+    for (size_t i = 0; i < num_key_frames; ++i) {
+        const float exhaustive_pose_distance = get_pose_distance(i, exhaustive_best.at(i));
+        const float kd_tree_pose_distance = get_pose_distance(i, kd_tree_best.at(i));
+
+        const bool is_revisit = (
+            ScanContextManager::NONE != exhaustive_best.at(i) && exhaustive_pose_distance <= revisit_distance
+        );
+        const bool is_kd_tree_revisit = (
+            ScanContextManager::NONE != kd_tree_best.at(i) && kd_tree_pose_distance <= revisit_distance
+        );
+        if (ScanContextManager::NONE != exhaustive_best.at(i)) {
+            is_revisit ? ++num_revisits : ++num_aliases;
+        }
+        if (is_revisit) {
+            is_kd_tree_revisit ? ++num_recalled : ++num_missed;
+        }
+        if (ScanContextManager::NONE != kd_tree_best.at(i) && !is_kd_tree_revisit) {
+            ++num_kd_tree_aliases;
+        }
+
+        ofs << i << " "
+            << exhaustive_best.at(i) << " " << exhaustive_distances.at(i) << " " << exhaustive_pose_distance << " "
+            << kd_tree_best.at(i) << " " << kd_tree_distances.at(i) << " " << kd_tree_pose_distance << std::endl;
+    }
+    if (!ofs) {
+        LOG(ERROR) << "Failed to write loop candidate QA report " << report_path;
+        return 1;
+    }
+
+    LOG(INFO) << std::endl
+              << "Loop candidate QA of " << num_key_frames << " key frames in " << index_path << ":" << std::endl
+              << "\texhaustive search: " << exhaustive_time << " s, "
+              << num_revisits << " revisits within " << revisit_distance << " m, " << num_aliases << " aliases" << std::endl
+              << "\tring key search: " << kd_tree_time << " s, "
+              << num_recalled << " of the revisits recalled, " << num_missed << " missed, "
+              << num_kd_tree_aliases << " aliases" << std::endl
+              << "\treport: " << report_path << std::endl;
+
+    return 0;
+}
@@ -7,15 +7,22 @@
 #include "glog/logging.h"
 
 #include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/trace_service.hpp"
+#include "lidar_localization/tools/metrics_publisher.hpp"
+#include "lidar_localization/tools/background_jobs.hpp"
+#include "lidar_localization/tools/thread_config.hpp"
+#include "lidar_localization/tools/tracer.hpp"
 #include "lidar_localization/mapping/loop_closing/loop_closing_flow.hpp"
 #include <lidar_localization/saveScanContext.h>
 
 using namespace lidar_localization;
 
-bool save_scan_context = false;
+std::shared_ptr<LoopClosingFlow> loop_closing_flow_ptr;
+std::shared_ptr<BackgroundJobs> background_jobs_ptr;
 
+// called by spinOnce between two runs of the flow, the scan context state as of now is saved in the background:
 bool SaveScanContextCb(saveScanContext::Request &request, saveScanContext::Response &response) {
-    save_scan_context = true;
+    response.job_id = background_jobs_ptr->Submit("save_scan_context", loop_closing_flow_ptr->GetSaveJob());
     response.succeed = true;
     return response.succeed;
 }
@@ -27,29 +34,38 @@ int main(int argc, char *argv[]) {
 
     ros::init(argc, argv, "loop_closing_node");
     ros::NodeHandle nh;
+    // dump_trace & metrics, one per node:
+    ros::NodeHandle private_nh("~");
+    TraceService trace_service(private_nh);
+    MetricsPublisher metrics_publisher(private_nh);
+    background_jobs_ptr = std::make_shared<BackgroundJobs>(private_nh);
 
     // subscribe to:
     // a. key frame pose and corresponding GNSS/IMU pose from backend node
     // publish:
     // a. loop closure detection result for backend node:
-    std::shared_ptr<LoopClosingFlow> loop_closing_flow_ptr = std::make_shared<LoopClosingFlow>(nh);
+    loop_closing_flow_ptr = std::make_shared<LoopClosingFlow>(nh);
 
     // register service for scan context save:
     ros::ServiceServer service = nh.advertiseService("save_scan_context", SaveScanContextCb);
 
+    // main loop pinning, scheduling class & memory locking, see config/tools/thread_config.yaml:
+    ThreadConfig thread_config("loop_closing_node");
+    thread_config.Apply();
+    JitterMonitor jitter_monitor("loop_closing_node", 0.01, thread_config.IsJitterMeasured());
+
     ros::Rate rate(100);
     while (ros::ok()) {
+        jitter_monitor.Tick();
         ros::spinOnce();
 
         loop_closing_flow_ptr->Run();
 
-        if (save_scan_context) {
-            save_scan_context = false;
-            loop_closing_flow_ptr->Save();
-        }
-
         rate.sleep();
     }
 
+    // a job submitted right before shutdown is finished:
+    background_jobs_ptr.reset();
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,129 @@
+/*
+ * @Description: merge the scan context index of a new drive into a multi-session map index
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 14:08:52
+ */
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+
+#include <boost/filesystem.hpp>
+#include <yaml-cpp/yaml.h>
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/file_manager.hpp"
+#include "lidar_localization/models/scan_context_manager/scan_context_manager.hpp"
+
+using namespace lidar_localization;
+
+std::string GetPath(const YAML::Node& config_node, const std::string& name) {
+    std::string path = config_node[name].as<std::string>();
+    if (path.front() != '/') {
+        path = WORK_SPACE_PATH + "/" + path;
+    }
+
+    return path;
+}
+
+/**
+ * @brief  write the inter-session constraints, one line per proposal:
+ *         key frame id in session, map session id, map key frame id in its session, yaw change, distance,
+ *         then the 3x4 pose hint of the key frame in the map frame, row-major
+ */
+bool SaveConstraints(
+    const std::string& constraints_path,
+    const ScanContextManager& map_index,
+    const std::vector<ScanContextManager::SessionMatch>& matches
+) {
+    std::ofstream ofs(constraints_path);
+    if (!ofs) {
+        LOG(ERROR) << "Cannot create inter-session constraints " << constraints_path;
+        return false;
+    }
+
+    ofs << std::setprecision(9);
+    for (const ScanContextManager::SessionMatch& match: matches) {
+        std::string map_session_name;
+        int map_key_frame_id;
+        const int map_session_id = map_index.GetSession(match.match_id, map_session_name, map_key_frame_id);
+
+        // the key frame is where the match is, turned by the yaw change:
+        Eigen::Matrix4f pose = map_index.GetKeyFrame(match.match_id).pose;
+        pose.block<3, 3>(0, 0) = pose.block<3, 3>(0, 0) * Eigen::AngleAxisf(
+            match.yaw_change_in_rad, Eigen::Vector3f::UnitZ()
+        ).toRotationMatrix();
+
+        ofs << match.query_id << " " << map_session_id << " " << map_key_frame_id << " "
+            << match.yaw_change_in_rad << " " << match.distance;
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                ofs << " " << pose(i, j);
+            }
+        }
+        ofs << std::endl;
+    }
+
+    return static_cast<bool>(ofs);
+}
+
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_alsologtostderr = 1;
+
+    std::string config_file_path = WORK_SPACE_PATH + "/config/mapping/merge_sessions.yaml";
+    YAML::Node config_node = YAML::LoadFile(config_file_path);
+
+    // same descriptors as loop closing:
+    YAML::Node loop_closing_config_node = YAML::LoadFile(WORK_SPACE_PATH + "/config/mapping/loop_closing.yaml");
+    const YAML::Node& scan_context_node = loop_closing_config_node["scan_context"];
+
+    const std::string map_path = GetPath(config_node, "map_path");
+    const std::string session_path = GetPath(config_node, "session_path");
+    const std::string session_name = config_node["session_name"].as<std::string>();
+    const std::string constraints_path = GetPath(config_node, "constraints_path");
+    const int num_proposals = config_node["num_proposals"].as<int>();
+
+    ScanContextManager session_index(scan_context_node);
+    if (!session_index.Load(session_path)) {
+        LOG(ERROR) << "Failed to load scan context index of session " << session_name << " from " << session_path;
+        return 1;
+    }
+
+    // the first drive starts the map, an existing map that fails to load is never overwritten:
+    ScanContextManager map_index(scan_context_node);
+    if (boost::filesystem::is_directory(map_path)) {
+        if (!map_index.Load(map_path)) {
+            LOG(ERROR) << "Failed to load map scan context index from " << map_path;
+            return 1;
+        }
+    } else {
+        LOG(WARNING) << "No map scan context index in " << map_path << ", start a new map with session " << session_name;
+        if (!FileManager::CreateDirectory(map_path, "Map Scan Context Index")) {
+            return 1;
+        }
+    }
+
+    if (map_index.GetNumKeyFrames() > 0) {
+        std::vector<ScanContextManager::SessionMatch> matches;
+        map_index.DetectLoopClosures(session_index, num_proposals, matches);
+
+        if (!SaveConstraints(constraints_path, map_index, matches)) {
+            return 1;
+        }
+        LOG(INFO) << "Save " << matches.size() << " inter-session constraints of session " << session_name
+                  << " to " << constraints_path;
+    }
+
+    if (config_node["append"].as<bool>()) {
+        if (!map_index.Append(session_index, session_name) || !map_index.Save(map_path)) {
+            LOG(ERROR) << "Failed to merge session " << session_name << " into " << map_path;
+            return 1;
+        }
+        LOG(INFO) << "Merge session " << session_name << " into " << map_path
+                  << ", " << map_index.GetNumKeyFrames() << " key frames in total.";
+    }
+
+    return 0;
+}
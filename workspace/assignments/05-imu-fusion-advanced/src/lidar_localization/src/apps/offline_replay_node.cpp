@@ -0,0 +1,449 @@
+/*
+ * @Description: replay rosbags through a whole pipeline of flows in one process, as fast as possible
+ * @Author: Ge Yao
+ * @Date: 2020-12-22 16:20:03
+ */
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <functional>
+
+#include <ros/ros.h>
+#include <yaml-cpp/yaml.h>
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/offline_replay.hpp"
+#include "lidar_localization/tools/trace_service.hpp"
+#include "lidar_localization/tools/stage_cache.hpp"
+#include "lidar_localization/tools/file_manager.hpp"
+
+#include "lidar_localization/subscriber/cloud_subscriber.hpp"
+#include "lidar_localization/subscriber/odometry_subscriber.hpp"
+#include "lidar_localization/subscriber/key_frame_subscriber.hpp"
+#include "lidar_localization/publisher/cloud_publisher.hpp"
+#include "lidar_localization/publisher/odometry_publisher.hpp"
+#include "lidar_localization/publisher/key_frame_publisher.hpp"
+
+#include "lidar_localization/data_pretreat/data_pretreat_flow.hpp"
+#include "lidar_localization/data_pretreat/eskf_preprocess_flow.hpp"
+#include "lidar_localization/data_pretreat/imu_gnss_odo_preprocess_flow.hpp"
+#include "lidar_localization/filtering/filtering_flow.hpp"
+#include "lidar_localization/filtering/imu_gnss_filtering_flow.hpp"
+#include "lidar_localization/filtering/imu_gnss_odo_filtering_flow.hpp"
+#include "lidar_localization/mapping/front_end/front_end_flow.hpp"
+#include "lidar_localization/mapping/back_end/back_end_flow.hpp"
+#include "lidar_localization/mapping/loop_closing/loop_closing_flow.hpp"
+#include "lidar_localization/mapping/viewer/viewer_flow.hpp"
+
+using namespace lidar_localization;
+
+// a topic whose messages are cached, with what it takes to publish them again:
+struct CachedTopic {
+    enum Type {
+      CLOUD,
+      ODOMETRY,
+      KEY_FRAME
+    };
+
+    std::string topic_name;
+    Type type;
+    std::string frame_id;
+    std::string child_frame_id;
+};
+
+// outputs of a pipeline stage, cached under a key of everything upstream of them:
+struct Stage {
+    std::string name;
+    std::vector<CachedTopic> topics;
+    std::string cache_path;
+
+    bool IsCached(void) const { return StageCache::IsComplete(cache_path); }
+};
+
+// records the topics of a stage, as the in-process subscribers of the replay receive them:
+class StageRecorder {
+  public:
+    StageRecorder(ros::NodeHandle& nh, const Stage& stage, float resolution, bool use_lz4)
+        : cache_(stage.cache_path, resolution, use_lz4) {
+        for (const CachedTopic& topic: stage.topics) {
+            Stream stream;
+            stream.stream = cache_.AddStream(
+                topic.topic_name, 
+                CachedTopic::CLOUD == topic.type ? StageCache::CLOUD_STREAM : StageCache::POSE_STREAM
+            );
+
+            if (CachedTopic::CLOUD == topic.type) {
+                stream.cloud_sub_ptr = std::make_shared<CloudSubscriber>(nh, topic.topic_name, 100000);
+            } else if (CachedTopic::ODOMETRY == topic.type) {
+                stream.odometry_sub_ptr = std::make_shared<OdometrySubscriber>(nh, topic.topic_name, 100000);
+            } else {
+                stream.key_frame_sub_ptr = std::make_shared<KeyFrameSubscriber>(nh, topic.topic_name, 100000);
+            }
+
+            streams_.push_back(stream);
+        }
+    }
+
+    // move what was received since the last update into the cache:
+    void Update(void) {
+        for (Stream& stream: streams_) {
+            if (stream.cloud_sub_ptr) {
+                stream.cloud_sub_ptr->ParseData(clouds_);
+                for (const CloudData& cloud_data: clouds_) {
+                    cache_.AddCloud(stream.stream, cloud_data.time, *cloud_data.cloud_ptr);
+                }
+                clouds_.clear();
+            } else if (stream.odometry_sub_ptr) {
+                stream.odometry_sub_ptr->ParseData(poses_);
+                for (const PoseData& pose_data: poses_) {
+                    cache_.AddPose(stream.stream, pose_data.time, pose_data.pose);
+                }
+                poses_.clear();
+            } else {
+                stream.key_frame_sub_ptr->ParseData(key_frames_);
+                for (const KeyFrame& key_frame: key_frames_) {
+                    cache_.AddPose(stream.stream, key_frame.time, key_frame.pose, key_frame.index);
+                }
+                key_frames_.clear();
+            }
+        }
+    }
+
+    bool Finish(void) {
+        Update();
+        return cache_.Finish();
+    }
+
+  private:
+    struct Stream {
+      int stream = -1;
+      std::shared_ptr<CloudSubscriber> cloud_sub_ptr;
+      std::shared_ptr<OdometrySubscriber> odometry_sub_ptr;
+      std::shared_ptr<KeyFrameSubscriber> key_frame_sub_ptr;
+    };
+
+    StageCache cache_;
+    std::vector<Stream> streams_;
+
+    std::deque<CloudData> clouds_;
+    std::deque<PoseData> poses_;
+    std::deque<KeyFrame> key_frames_;
+};
+
+struct Pipeline {
+    // flows in data flow order, all of them run after each replayed message:
+    std::vector<std::function<bool(void)>> flows;
+    // what the nodes do on service call, executed in order once the bags are done:
+    std::vector<std::function<bool(void)>> finish;
+
+    // played instead of the rosbags, if any:
+    std::shared_ptr<Stage> source_stage_ptr;
+    // stage outputs recorded while the pipeline runs:
+    std::vector<std::shared_ptr<StageRecorder>> recorders;
+
+    void Run(void) {
+        for (const auto& flow: flows) {
+            flow();
+        }
+        for (const auto& recorder: recorders) {
+            recorder->Update();
+        }
+    }
+};
+
+// the stages whose outputs can be cached, front_end for the back end & loop closing experiments, 
+// back_end for the loop closing ones:
+bool CreateStages(
+    ros::NodeHandle& nh, const std::vector<std::string>& bag_paths, const YAML::Node& config_node,
+    std::map<std::string, Stage>& stages
+) {
+    std::string cloud_topic, odom_topic;
+    nh.param<std::string>("cloud_topic", cloud_topic, "/synced_cloud");
+    nh.param<std::string>("odom_topic", odom_topic, "/laser_odom");
+
+    std::string data_path = config_node["data_path"].as<std::string>();
+    if (data_path == "./") {
+        data_path = WORK_SPACE_PATH;
+    }
+    const std::string cache_path = data_path + "/slam_data/stage_cache";
+    if (
+        !FileManager::CreateDirectory(data_path + "/slam_data") ||
+        !FileManager::CreateDirectory(cache_path, "Stage Cache")
+    ) {
+        return false;
+    }
+
+    // code changes are not part of the keys, the cache has to be removed after them:
+    const std::string front_end_key = StageCache::GetKey(
+        cloud_topic + " " + odom_topic,
+        {
+            WORK_SPACE_PATH + "/config/data_pretreat/multi_lidar.yaml",
+            WORK_SPACE_PATH + "/config/mapping/front_end.yaml",
+            WORK_SPACE_PATH + "/config/publisher/cloud_publisher.yaml",
+            WORK_SPACE_PATH + "/config/subscriber/cloud_subscriber.yaml"
+        },
+        bag_paths
+    );
+    // key frames do not depend on loop closures, so loop closing is not upstream of back end:
+    const std::string back_end_key = StageCache::GetKey(
+        front_end_key,
+        {
+            WORK_SPACE_PATH + "/config/mapping/back_end.yaml"
+        },
+        {}
+    );
+
+    Stage& front_end_stage = stages["front_end"];
+    front_end_stage.name = "front_end";
+    front_end_stage.cache_path = cache_path + "/front_end_" + front_end_key;
+    front_end_stage.topics = {
+        {cloud_topic, CachedTopic::CLOUD, "/velo_link", ""},
+        {"/synced_gnss", CachedTopic::ODOMETRY, "/map", "/velo_link"},
+        {odom_topic, CachedTopic::ODOMETRY, "/map", "/lidar"}
+    };
+
+    Stage& back_end_stage = stages["back_end"];
+    back_end_stage.name = "back_end";
+    back_end_stage.cache_path = cache_path + "/back_end_" + back_end_key;
+    back_end_stage.topics = {
+        {"/key_scan", CachedTopic::CLOUD, "/velo_link", ""},
+        {"/key_frame", CachedTopic::KEY_FRAME, "/map", ""},
+        {"/key_gnss", CachedTopic::KEY_FRAME, "/map", ""}
+    };
+
+    return true;
+}
+
+// record the stage while the pipeline runs, unless it is already cached:
+void MaybeRecordStage(ros::NodeHandle& nh, const Stage& stage, const YAML::Node& config_node, Pipeline& pipeline) {
+    if (!config_node["record"].as<bool>()) {
+        return;
+    }
+    if (stage.IsCached()) {
+        LOG(INFO) << "Stage " << stage.name << " is cached in " << stage.cache_path;
+        return;
+    }
+
+    pipeline.recorders.push_back(
+        std::make_shared<StageRecorder>(
+            nh, stage, config_node["resolution"].as<float>(), config_node["compression"].as<std::string>() == "lz4"
+        )
+    );
+}
+
+// publish the cached messages in recorded order, with the pipeline run after each of them:
+bool PlayStage(ros::NodeHandle& nh, const Stage& stage, Pipeline& pipeline) {
+    std::map<std::string, std::shared_ptr<CloudPublisher>> cloud_pubs;
+    std::map<std::string, std::shared_ptr<OdometryPublisher>> odometry_pubs;
+    std::map<std::string, std::shared_ptr<KeyFramePublisher>> key_frame_pubs;
+    for (const CachedTopic& topic: stage.topics) {
+        if (CachedTopic::CLOUD == topic.type) {
+            cloud_pubs[topic.topic_name] = std::make_shared<CloudPublisher>(nh, topic.topic_name, topic.frame_id, 100);
+        } else if (CachedTopic::ODOMETRY == topic.type) {
+            odometry_pubs[topic.topic_name] = std::make_shared<OdometryPublisher>(
+                nh, topic.topic_name, topic.frame_id, topic.child_frame_id, 100
+            );
+        } else {
+            key_frame_pubs[topic.topic_name] = std::make_shared<KeyFramePublisher>(nh, topic.topic_name, topic.frame_id, 100);
+        }
+    }
+
+    ros::WallTime start_time = ros::WallTime::now();
+    size_t num_messages = 0;
+    bool is_played = StageCache::Play(
+        stage.cache_path,
+        [&](const StageCache::Message& message) {
+            if (!ros::ok()) {
+                LOG(WARNING) << "Stage cache replay interrupted.";
+                return false;
+            }
+
+            if (cloud_pubs.count(message.stream_name)) {
+                cloud_pubs.at(message.stream_name)->Publish(message.cloud_ptr, message.time);
+            } else if (odometry_pubs.count(message.stream_name)) {
+                odometry_pubs.at(message.stream_name)->Publish(message.pose, message.time);
+            } else if (key_frame_pubs.count(message.stream_name)) {
+                KeyFrame key_frame;
+                key_frame.time = message.time;
+                key_frame.index = message.index;
+                key_frame.pose = message.pose;
+                key_frame_pubs.at(message.stream_name)->Publish(key_frame);
+            }
+
+            pipeline.Run();
+            ++num_messages;
+
+            return true;
+        }
+    );
+
+    LOG(INFO) << "Played " << num_messages << " cached messages of stage " << stage.name << " in "
+              << (ros::WallTime::now() - start_time).toSec() << " seconds.";
+
+    return is_played;
+}
+
+bool CreatePipeline(
+    ros::NodeHandle& nh, const std::string& pipeline_name, 
+    const std::map<std::string, Stage>& stages, const YAML::Node& cache_config_node,
+    Pipeline& pipeline
+) {
+    if ("filtering" == pipeline_name) {
+        // same as filtering.launch:
+        std::shared_ptr<DataPretreatFlow> data_pretreat_flow_ptr = std::make_shared<DataPretreatFlow>(nh, "/synced_cloud");
+        std::shared_ptr<FilteringFlow> filtering_flow_ptr = std::make_shared<FilteringFlow>(nh);
+
+        pipeline.flows.push_back([data_pretreat_flow_ptr]() { return data_pretreat_flow_ptr->Run(); });
+        pipeline.flows.push_back([filtering_flow_ptr]() { return filtering_flow_ptr->Run(); });
+
+        pipeline.finish.push_back([filtering_flow_ptr]() { return filtering_flow_ptr->SaveOdometry(); });
+    } else if ("imu_gnss" == pipeline_name) {
+        // same as eskf_analysis.launch:
+        std::shared_ptr<ESKFPreprocessFlow> eskf_preprocess_flow_ptr = std::make_shared<ESKFPreprocessFlow>(nh);
+        std::shared_ptr<IMUGNSSFilteringFlow> filtering_flow_ptr = std::make_shared<IMUGNSSFilteringFlow>(nh);
+
+        pipeline.flows.push_back([eskf_preprocess_flow_ptr]() { return eskf_preprocess_flow_ptr->Run(); });
+        pipeline.flows.push_back([filtering_flow_ptr]() { return filtering_flow_ptr->Run(); });
+
+        pipeline.finish.push_back([filtering_flow_ptr]() { return filtering_flow_ptr->SaveOdometry(); });
+        pipeline.finish.push_back([filtering_flow_ptr]() { return filtering_flow_ptr->SaveObservabilityAnalysis(); });
+    } else if ("imu_gnss_odo" == pipeline_name) {
+        // same as imu_gnss_odo_fusion.launch:
+        std::shared_ptr<IMUGNSSOdoPreprocessFlow> preprocess_flow_ptr = std::make_shared<IMUGNSSOdoPreprocessFlow>(nh);
+        std::shared_ptr<IMUGNSSOdoFilteringFlow> filtering_flow_ptr = std::make_shared<IMUGNSSOdoFilteringFlow>(nh);
+
+        pipeline.flows.push_back([preprocess_flow_ptr]() { return preprocess_flow_ptr->Run(); });
+        pipeline.flows.push_back([filtering_flow_ptr]() { return filtering_flow_ptr->Run(); });
+
+        pipeline.finish.push_back([filtering_flow_ptr]() { return filtering_flow_ptr->SaveOdometry(); });
+        pipeline.finish.push_back([filtering_flow_ptr]() { return filtering_flow_ptr->SaveObservabilityAnalysis(); });
+    } else if ("mapping" == pipeline_name) {
+        // same as mapping.launch:
+        std::string cloud_topic, odom_topic;
+        nh.param<std::string>("cloud_topic", cloud_topic, "/synced_cloud");
+        nh.param<std::string>("odom_topic", odom_topic, "/laser_odom");
+
+        std::shared_ptr<DataPretreatFlow> data_pretreat_flow_ptr = std::make_shared<DataPretreatFlow>(nh, cloud_topic);
+        std::shared_ptr<FrontEndFlow> front_end_flow_ptr = std::make_shared<FrontEndFlow>(nh, cloud_topic, odom_topic);
+        std::shared_ptr<BackEndFlow> back_end_flow_ptr = std::make_shared<BackEndFlow>(nh, cloud_topic, odom_topic);
+        std::shared_ptr<LoopClosingFlow> loop_closing_flow_ptr = std::make_shared<LoopClosingFlow>(nh);
+        std::shared_ptr<ViewerFlow> viewer_flow_ptr = std::make_shared<ViewerFlow>(nh, cloud_topic);
+
+        pipeline.flows.push_back([data_pretreat_flow_ptr]() { return data_pretreat_flow_ptr->Run(); });
+        pipeline.flows.push_back([front_end_flow_ptr]() { return front_end_flow_ptr->Run(); });
+        pipeline.flows.push_back([back_end_flow_ptr]() { return back_end_flow_ptr->Run(); });
+        pipeline.flows.push_back([loop_closing_flow_ptr]() { return loop_closing_flow_ptr->Run(); });
+        pipeline.flows.push_back([viewer_flow_ptr]() { return viewer_flow_ptr->Run(); });
+
+        pipeline.finish.push_back([back_end_flow_ptr]() { return back_end_flow_ptr->ForceOptimize(); });
+        pipeline.finish.push_back([loop_closing_flow_ptr]() { return loop_closing_flow_ptr->Save(); });
+        pipeline.finish.push_back([viewer_flow_ptr]() { return viewer_flow_ptr->SaveMap(); });
+
+        MaybeRecordStage(nh, stages.at("front_end"), cache_config_node, pipeline);
+        MaybeRecordStage(nh, stages.at("back_end"), cache_config_node, pipeline);
+    } else if ("back_end" == pipeline_name) {
+        // mapping, with data_pretreat & front_end played from their cache:
+        std::string cloud_topic, odom_topic;
+        nh.param<std::string>("cloud_topic", cloud_topic, "/synced_cloud");
+        nh.param<std::string>("odom_topic", odom_topic, "/laser_odom");
+
+        std::shared_ptr<BackEndFlow> back_end_flow_ptr = std::make_shared<BackEndFlow>(nh, cloud_topic, odom_topic);
+        std::shared_ptr<LoopClosingFlow> loop_closing_flow_ptr = std::make_shared<LoopClosingFlow>(nh);
+        std::shared_ptr<ViewerFlow> viewer_flow_ptr = std::make_shared<ViewerFlow>(nh, cloud_topic);
+
+        pipeline.flows.push_back([back_end_flow_ptr]() { return back_end_flow_ptr->Run(); });
+        pipeline.flows.push_back([loop_closing_flow_ptr]() { return loop_closing_flow_ptr->Run(); });
+        pipeline.flows.push_back([viewer_flow_ptr]() { return viewer_flow_ptr->Run(); });
+
+        pipeline.finish.push_back([back_end_flow_ptr]() { return back_end_flow_ptr->ForceOptimize(); });
+        pipeline.finish.push_back([loop_closing_flow_ptr]() { return loop_closing_flow_ptr->Save(); });
+        pipeline.finish.push_back([viewer_flow_ptr]() { return viewer_flow_ptr->SaveMap(); });
+
+        pipeline.source_stage_ptr = std::make_shared<Stage>(stages.at("front_end"));
+        MaybeRecordStage(nh, stages.at("back_end"), cache_config_node, pipeline);
+    } else if ("loop_closing" == pipeline_name) {
+        // loop closing alone, with key frames played from the back end cache. 
+        // loop poses go nowhere, the detection itself is what is tuned:
+        std::shared_ptr<LoopClosingFlow> loop_closing_flow_ptr = std::make_shared<LoopClosingFlow>(nh);
+
+        pipeline.flows.push_back([loop_closing_flow_ptr]() { return loop_closing_flow_ptr->Run(); });
+
+        pipeline.finish.push_back([loop_closing_flow_ptr]() { return loop_closing_flow_ptr->Save(); });
+
+        pipeline.source_stage_ptr = std::make_shared<Stage>(stages.at("back_end"));
+    } else {
+        LOG(ERROR) << "Unknown pipeline " << pipeline_name 
+                   << ", use filtering, imu_gnss, imu_gnss_odo, mapping, back_end or loop_closing.";
+        return false;
+    }
+
+    if (pipeline.source_stage_ptr && !pipeline.source_stage_ptr->IsCached()) {
+        LOG(ERROR) << "Stage " << pipeline.source_stage_ptr->name << " is not cached for these rosbags & configs, "
+                   << "run the mapping pipeline with record set in config/tools/stage_cache.yaml first.";
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_log_dir = WORK_SPACE_PATH + "/Log";
+    FLAGS_alsologtostderr = 1;
+
+    // anonymous, so that the processes of a parameter sweep can share one ROS master:
+    ros::init(argc, argv, "offline_replay_node", ros::init_options::AnonymousName);
+    if (argc < 3) {
+        LOG(ERROR) << "Usage: offline_replay_node <filtering|imu_gnss|imu_gnss_odo|mapping|back_end|loop_closing> <bag> [<bag> ...]";
+        return 1;
+    }
+    ros::NodeHandle nh;
+
+    // must be enabled before the flows are created, so that their subscribers are registered for replay:
+    OfflineReplay::GetInstance().Enable();
+
+    // the rosbags are part of the stage cache keys, even when they are not replayed:
+    std::vector<std::string> bag_paths(argv + 2, argv + argc);
+    YAML::Node cache_config_node = YAML::LoadFile(WORK_SPACE_PATH + "/config/tools/stage_cache.yaml");
+    std::map<std::string, Stage> stages;
+    if (!CreateStages(nh, bag_paths, cache_config_node, stages)) {
+        return 1;
+    }
+
+    Pipeline pipeline;
+    if (!CreatePipeline(nh, argv[1], stages, cache_config_node, pipeline)) {
+        return 1;
+    }
+
+    if (pipeline.source_stage_ptr) {
+        if (!PlayStage(nh, *pipeline.source_stage_ptr, pipeline)) {
+            return 1;
+        }
+    } else if (!OfflineReplay::GetInstance().Play(bag_paths, [&pipeline]() { pipeline.Run(); })) {
+        return 1;
+    }
+
+    // let the results of each step reach the downstream flows before the next one:
+    for (const auto& finish: pipeline.finish) {
+        if (!finish()) {
+            LOG(WARNING) << "Pipeline " << argv[1] << " failed to save results.";
+        }
+        pipeline.Run();
+    }
+
+    // only a pipeline that ran to the end leaves a complete cache:
+    if (ros::ok()) {
+        for (const auto& recorder: pipeline.recorders) {
+            recorder->Finish();
+        }
+    }
+
+    // there is no one to call dump_trace, so the trace is always saved:
+    std::string trace_file_path;
+    TraceService::Dump(trace_file_path);
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * @Description: prune the global map rebuilt from the key scans of a mapping session, and split it into tiles
+ * @Author: Ge Yao
+ * @Date: 2021-01-27 19:36:08
+ */
+#include <string>
+#include <deque>
+#include <memory>
+
+#include <yaml-cpp/yaml.h>
+#include <pcl/io/pcd_io.h>
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/sensor_data/key_frame.hpp"
+#include "lidar_localization/tools/trajectory_log.hpp"
+#include "lidar_localization/models/key_frame_store/pcd_key_frame_store.hpp"
+#include "lidar_localization/models/key_frame_store/packed_key_frame_store.hpp"
+#include "lidar_localization/models/tiled_map/map_pruner.hpp"
+#include "lidar_localization/models/tiled_map/tiled_map.hpp"
+
+using namespace lidar_localization;
+
+std::string GetPath(const YAML::Node& config_node, const std::string& name) {
+    std::string path = config_node[name].as<std::string>();
+    if (path.front() != '/') {
+        path = WORK_SPACE_PATH + "/" + path;
+    }
+
+    return path;
+}
+
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_alsologtostderr = 1;
+
+    std::string config_file_path = WORK_SPACE_PATH + "/config/mapping/prune_map.yaml";
+    YAML::Node config_node = YAML::LoadFile(config_file_path);
+
+    const std::string key_frames_path = GetPath(config_node, "key_frames_path");
+    const std::string trajectory_path = GetPath(config_node, "trajectory_path");
+    const std::string tiles_path = GetPath(config_node, "tiles_path");
+    const std::string map_file_path = GetPath(config_node, "map_file_path");
+    const float tile_size = config_node["tile_size"].as<float>();
+
+    // optimized poses of all key frames, in key frame index order:
+    std::deque<Eigen::Matrix4f> poses;
+    if (!TrajectoryLog::Load(trajectory_path, poses) || poses.empty()) {
+        LOG(ERROR) << "Failed to load optimized key frame poses from " << trajectory_path;
+        return 1;
+    }
+    std::deque<KeyFrame> key_frames(poses.size());
+    for (size_t i = 0; i < poses.size(); ++i) {
+        key_frames.at(i).index = static_cast<unsigned int>(i);
+        key_frames.at(i).pose = poses.at(i);
+    }
+
+    std::shared_ptr<KeyFrameStoreInterface> key_frame_store_ptr;
+    const std::string key_frame_store_method = config_node["key_frame_store"].as<std::string>();
+    if (key_frame_store_method == "pcd") {
+        key_frame_store_ptr = std::make_shared<PCDKeyFrameStore>(key_frames_path);
+    } else if (key_frame_store_method == "packed") {
+        key_frame_store_ptr = std::make_shared<PackedKeyFrameStore>(key_frames_path, config_node[key_frame_store_method]);
+    } else {
+        LOG(ERROR) << "Key frame store " << key_frame_store_method << " NOT FOUND!";
+        return 1;
+    }
+
+    auto load_scan = [&key_frame_store_ptr](unsigned int index, CloudData::CLOUD::ConstPtr& scan_ptr) {
+        CloudData::CLOUD_PTR cloud_ptr(new CloudData::CLOUD());
+        if (!key_frame_store_ptr->Load(index, *cloud_ptr))
+            return false;
+
+        scan_ptr = cloud_ptr;
+        return true;
+    };
+
+    MapPruner map_pruner(config_node["map_pruner"]);
+    CloudData::CLOUD map;
+    if (!map_pruner.Prune(key_frames, load_scan, map) || map.points.empty()) {
+        LOG(ERROR) << "Failed to prune the map of " << key_frames.size() << " key frames.";
+        return 1;
+    }
+
+    if (!TiledMap::Save(tiles_path, map, tile_size))
+        return 1;
+
+    if (pcl::io::savePCDFileBinary(map_file_path, map) != 0) {
+        LOG(ERROR) << "Failed to save pruned map " << map_file_path;
+        return 1;
+    }
+    LOG(INFO) << "Save pruned map to " << tiles_path << " and " << map_file_path;
+
+    return 0;
+}
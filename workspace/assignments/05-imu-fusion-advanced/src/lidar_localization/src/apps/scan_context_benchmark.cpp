@@ -0,0 +1,304 @@
+/*
+ * @Description: place recognition benchmark of scan context, precision / recall against GNSS revisits
+ *               & latency by index size, for the scan context options of each variant
+ * @Author: Ge Yao
+ * @Date: 2021-01-18 20:36:52
+ */
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include <yaml-cpp/yaml.h>
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/sensor_data/key_frame.hpp"
+#include "lidar_localization/tools/metrics.hpp"
+#include "lidar_localization/models/scan_context_manager/scan_context_manager.hpp"
+#include "lidar_localization/models/key_frame_store/pcd_key_frame_store.hpp"
+#include "lidar_localization/models/key_frame_store/packed_key_frame_store.hpp"
+
+using namespace lidar_localization;
+
+// latencies of the key frames added while the index was within one size bucket:
+struct SizeBucket {
+    LatencyHistogram update;
+    LatencyHistogram detect;
+    LatencyHistogram index;
+};
+
+struct VariantResult {
+    std::string name;
+    int num_revisits = 0;
+    int num_proposals = 0;
+    int num_true_proposals = 0;
+    size_t memory_usage = 0;
+    double total_time = 0.0;
+    std::vector<std::unique_ptr<SizeBucket>> buckets;
+};
+
+std::string GetPath(const YAML::Node& config_node, const std::string& name) {
+    std::string path = config_node[name].as<std::string>();
+    if (path.front() != '/') {
+        path = WORK_SPACE_PATH + "/" + path;
+    }
+
+    return path;
+}
+
+// same as batch mapping:
+bool LoadKITTI(const std::string& file_path, std::vector<KeyFrame>& key_frames) {
+    std::ifstream ifs(file_path);
+    if (!ifs) {
+        LOG(ERROR) << "Cannot open trajectory " << file_path;
+        return false;
+    }
+
+    key_frames.clear();
+    std::string line;
+    while (std::getline(ifs, line)) {
+        if (line.empty())
+            continue;
+
+        KeyFrame key_frame;
+        key_frame.index = static_cast<unsigned int>(key_frames.size());
+
+        std::istringstream iss(line);
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                iss >> key_frame.pose(i, j);
+            }
+        }
+        if (!iss) {
+            LOG(ERROR) << "Invalid pose of key frame " << key_frame.index << " in " << file_path;
+            return false;
+        }
+
+        key_frames.push_back(key_frame);
+    }
+
+    return true;
+}
+
+// the params of a variant replace those of node, maps are merged key by key:
+void MergeParams(const YAML::Node& params, YAML::Node node) {
+    for (const auto& param: params) {
+        const std::string key = param.first.as<std::string>();
+        if ( param.second.IsMap() && node[key] && node[key].IsMap() ) {
+            MergeParams(param.second, node[key]);
+        } else {
+            node[key] = YAML::Clone(param.second);
+        }
+    }
+}
+
+/**
+ * @brief  whether each key frame revisits a place, i.e. it is within revisit_distance by GNSS
+ *         of a key frame at least min_key_frame_seq_distance before it
+ */
+std::vector<bool> GetRevisits(
+    const std::vector<KeyFrame>& key_gnss, int min_key_frame_seq_distance, float revisit_distance
+) {
+    std::vector<bool> is_revisit(key_gnss.size(), false);
+    for (size_t i = 0; i < key_gnss.size(); ++i) {
+        const Eigen::Vector3f position = key_gnss.at(i).pose.block<3, 1>(0, 3);
+        for (int j = static_cast<int>(i) - min_key_frame_seq_distance; j >= 0; --j) {
+            if ((key_gnss.at(j).pose.block<3, 1>(0, 3) - position).norm() <= revisit_distance) {
+                is_revisit.at(i) = true;
+                break;
+            }
+        }
+    }
+
+    return is_revisit;
+}
+
+/**
+ * @brief  index all key frames one by one as loop closing does, detecting a loop closure after each
+ * @return true if every key scan is loaded otherwise false
+ */
+bool RunVariant(
+    const YAML::Node& scan_context_node,
+    const std::vector<KeyFrame>& key_gnss, const std::vector<bool>& is_revisit,
+    KeyFrameStoreInterface& key_frame_store, float revisit_distance, size_t bucket_size,
+    VariantResult& result
+) {
+    ScanContextManager scan_context_manager(scan_context_node);
+
+    CloudData scan;
+    const auto begin_time = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < key_gnss.size(); ++i) {
+        // loading is not part of place recognition:
+        if (!key_frame_store.Load(key_gnss.at(i).index, *scan.cloud_ptr)) {
+            LOG(ERROR) << "Failed to load key scan " << key_gnss.at(i).index;
+            return false;
+        }
+
+        const size_t bucket = i / bucket_size;
+        if (bucket >= result.buckets.size()) {
+            result.buckets.emplace_back(new SizeBucket());
+        }
+        SizeBucket& size_bucket = *result.buckets.at(bucket);
+
+        // a. descriptors, with key frame poses as GNSS/IMU poses like loop closing:
+        auto time = std::chrono::steady_clock::now();
+        scan_context_manager.Update(scan, key_gnss.at(i));
+        size_bucket.update.Record(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - time).count()
+        );
+
+        // b. detection, index maintenance included & also reported alone:
+        const double index_time = scan_context_manager.GetIndexStats().total_update_time;
+        time = std::chrono::steady_clock::now();
+        const std::pair<int, float> proposal = scan_context_manager.DetectLoopClosure();
+        size_bucket.detect.Record(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - time).count()
+        );
+        size_bucket.index.Record(
+            static_cast<int64_t>(1.0e9 * (scan_context_manager.GetIndexStats().total_update_time - index_time))
+        );
+
+        // c. score against GNSS:
+        if (is_revisit.at(i)) {
+            ++result.num_revisits;
+        }
+        if (ScanContextManager::NONE != proposal.first) {
+            ++result.num_proposals;
+
+            const Eigen::Vector3f distance =
+                scan_context_manager.GetKeyFrame(proposal.first).pose.block<3, 1>(0, 3) -
+                key_gnss.at(i).pose.block<3, 1>(0, 3);
+            if (distance.norm() <= revisit_distance) {
+                ++result.num_true_proposals;
+            }
+        }
+    }
+    result.total_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin_time).count();
+    result.memory_usage = scan_context_manager.GetMemoryUsage();
+
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_log_dir = WORK_SPACE_PATH + "/Log";
+    FLAGS_alsologtostderr = 1;
+
+    std::string config_file_path = (argc > 1) ? argv[1] : WORK_SPACE_PATH + "/config/benchmark/scan_context_benchmark.yaml";
+    YAML::Node config_node = YAML::LoadFile(config_file_path);
+    // descriptors, thresholds & key frame store as loop closing, overridden by each variant:
+    YAML::Node loop_closing_config_node = YAML::LoadFile(WORK_SPACE_PATH + "/config/mapping/loop_closing.yaml");
+
+    std::string data_path = config_node["data_path"].as<std::string>();
+    if (data_path == "./") {
+        data_path = WORK_SPACE_PATH;
+    }
+    const std::string key_frames_path = data_path + "/slam_data/key_frames";
+    const std::string trajectory_path = data_path + "/slam_data/trajectory";
+    const std::string report_path = GetPath(config_node, "report_path");
+    const float revisit_distance = config_node["revisit_distance"].as<float>();
+    const size_t bucket_size = std::max(config_node["bucket_size"].as<size_t>(), size_t(1));
+
+    // a. key frames by GNSS/IMU, as saved by back end:
+    std::vector<KeyFrame> key_gnss;
+    if (!LoadKITTI(trajectory_path + "/ground_truth.txt", key_gnss) || key_gnss.empty()) {
+        LOG(ERROR) << "No key frames in " << trajectory_path;
+        return 1;
+    }
+
+    std::shared_ptr<KeyFrameStoreInterface> key_frame_store_ptr;
+    std::string key_frame_store_method = loop_closing_config_node["key_frame_store"].as<std::string>();
+    if (key_frame_store_method == "pcd") {
+        key_frame_store_ptr = std::make_shared<PCDKeyFrameStore>(key_frames_path);
+    } else if (key_frame_store_method == "packed") {
+        key_frame_store_ptr = std::make_shared<PackedKeyFrameStore>(
+            key_frames_path, loop_closing_config_node[key_frame_store_method]
+        );
+    } else {
+        LOG(ERROR) << "Key frame store " << key_frame_store_method << " NOT FOUND!";
+        return 1;
+    }
+
+    // b. each variant from scratch:
+    const YAML::Node& scan_context_config_node = loop_closing_config_node["scan_context"];
+    std::vector<VariantResult> results;
+    for (const YAML::Node& variant_node: config_node["variants"]) {
+        YAML::Node scan_context_node = YAML::Clone(scan_context_config_node);
+        if (variant_node["params"]) {
+            MergeParams(variant_node["params"], scan_context_node);
+        }
+
+        const std::vector<bool> is_revisit = GetRevisits(
+            key_gnss, scan_context_node["min_key_frame_seq_distance"].as<int>(), revisit_distance
+        );
+
+        results.emplace_back();
+        VariantResult& result = results.back();
+        result.name = variant_node["name"].as<std::string>();
+        LOG(INFO) << "Scan context variant " << result.name << " on " << key_gnss.size() << " key frames...";
+
+        if (
+            !RunVariant(
+                scan_context_node, key_gnss, is_revisit, *key_frame_store_ptr,
+                revisit_distance, bucket_size, result
+            )
+        ) {
+            return 1;
+        }
+    }
+
+    // c. report, precision & recall of each variant, then its latencies by index size:
+    std::ofstream ofs(report_path);
+    if (!ofs) {
+        LOG(ERROR) << "Cannot create scan context benchmark report " << report_path;
+        return 1;
+    }
+
+    std::ostringstream summary;
+    ofs << std::fixed << std::setprecision(3);
+    summary << std::fixed << std::setprecision(3);
+    for (const VariantResult& result: results) {
+        const double precision = static_cast<double>(result.num_true_proposals) / std::max(result.num_proposals, 1);
+        const double recall = static_cast<double>(result.num_true_proposals) / std::max(result.num_revisits, 1);
+
+        ofs << "# " << result.name << ": "
+            << result.num_revisits << " revisits, "
+            << result.num_proposals << " proposals, "
+            << result.num_true_proposals << " true, "
+            << "precision " << precision << ", recall " << recall << ", "
+            << result.memory_usage / 1024.0 / 1024.0 << " MB, " << result.total_time << " s" << std::endl;
+
+        for (size_t i = 0; i < result.buckets.size(); ++i) {
+            ofs << result.name << " " << i * bucket_size;
+            for (const LatencyHistogram* histogram: {
+                &result.buckets.at(i)->update, &result.buckets.at(i)->detect, &result.buckets.at(i)->index
+            }) {
+                const LatencyHistogram::Snapshot snapshot = histogram->GetSnapshot();
+                ofs << " " << 1.0e-6 * snapshot.p50 << " " << 1.0e-6 * snapshot.p90
+                    << " " << 1.0e-6 * snapshot.p99 << " " << 1.0e-6 * snapshot.max;
+            }
+            ofs << std::endl;
+        }
+
+        summary << "\t" << result.name << ": precision " << precision << ", recall " << recall
+                << " (" << result.num_true_proposals << " of " << result.num_proposals << " proposals, "
+                << result.num_revisits << " revisits), " << result.total_time << " s" << std::endl;
+    }
+    if (!ofs) {
+        LOG(ERROR) << "Failed to write scan context benchmark report " << report_path;
+        return 1;
+    }
+
+    LOG(INFO) << std::endl
+              << "Scan context benchmark of " << key_gnss.size() << " key frames in " << data_path << ":" << std::endl
+              << summary.str()
+              << "\treport: " << report_path << std::endl;
+
+    return 0;
+}
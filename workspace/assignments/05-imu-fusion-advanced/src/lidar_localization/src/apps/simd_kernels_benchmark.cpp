@@ -0,0 +1,167 @@
+/*
+ * @Description: benchmark of the SIMD kernels by instruction set, e.g. NEON against scalar on aarch64
+ * @Author: Ge Yao
+ * @Date: 2021-01-25 15:02:44
+ */
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include <pcl/io/pcd_io.h>
+#include <yaml-cpp/yaml.h>
+#include <benchmark/benchmark.h>
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/sensor_data/compact_cloud.hpp"
+#include "lidar_localization/tools/cloud_assembler.hpp"
+#include "lidar_localization/tools/simd_dispatch.hpp"
+#include "lidar_localization/models/scan_context_manager/scan_context_distance.hpp"
+
+using namespace lidar_localization;
+
+bool LoadCloud(const YAML::Node& config_node, CloudData::CLOUD& cloud) {
+    std::string cloud_path = config_node["cloud_path"].as<std::string>();
+    if (cloud_path.front() != '/') {
+        cloud_path = WORK_SPACE_PATH + "/" + cloud_path;
+    }
+
+    if (pcl::io::loadPCDFile(cloud_path, cloud) != 0 || cloud.points.empty()) {
+        LOG(ERROR) << "Cannot load cloud " << cloud_path << ", run mapping to save key frames.";
+        return false;
+    }
+
+    LOG(INFO) << "Cloud " << cloud_path << ": " << cloud.points.size() << " points.";
+
+    return true;
+}
+
+Eigen::Matrix4f GetPose(void) {
+    Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
+    pose.block<3, 3>(0, 0) = Eigen::AngleAxisf(0.3f, Eigen::Vector3f(0.1f, 0.2f, 1.0f).normalized()).toRotationMatrix();
+    pose.block<3, 1>(0, 3) = Eigen::Vector3f(10.0f, -5.0f, 1.0f);
+
+    return pose;
+}
+
+/**
+ * @brief  time of transforming one cloud, as in map assembly
+ */
+void BenchmarkTransform(benchmark::State& state, const CloudData::CLOUD* cloud, SIMDLevel level) {
+    SIMDDispatch::SetMaxLevel(level);
+
+    const Eigen::Matrix4f pose = GetPose();
+    std::vector<CloudData::POINT> output(cloud->points.size());
+    for (auto _ : state) {
+        CloudAssembler::Transform(cloud->points.data(), cloud->points.size(), pose, output.data());
+        benchmark::DoNotOptimize(output.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * cloud->points.size());
+}
+
+/**
+ * @brief  time of decoding & transforming one compact key scan, as in local map assembly
+ */
+void BenchmarkCompactTransform(benchmark::State& state, const CloudData::CLOUD* cloud, SIMDLevel level) {
+    SIMDDispatch::SetMaxLevel(level);
+
+    const CompactCloud compact_cloud(*cloud);
+    const Eigen::Matrix4f pose = GetPose();
+    std::vector<CloudData::POINT> output(compact_cloud.GetNumPoints());
+    for (auto _ : state) {
+        compact_cloud.Transform(pose, output.data());
+        benchmark::DoNotOptimize(output.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * compact_cloud.GetNumPoints());
+}
+
+/**
+ * @brief  time of the min-shift distances of all source-target pairs, as in multi-session loop closure
+ */
+void BenchmarkScanContextDistance(
+    benchmark::State& state, const YAML::Node* node, const std::vector<float>* scan_contexts, SIMDLevel level
+) {
+    SIMDDispatch::SetMaxLevel(level);
+
+    const int num_sources = (*node)["num_sources"].as<int>();
+    const int num_targets = (*node)["num_targets"].as<int>();
+    ScanContextDistance scan_context_distance(
+        (*node)["num_rings"].as<int>(), (*node)["num_sectors"].as<int>(), false
+    );
+    scan_context_distance.SetTargets(scan_contexts->data(), num_targets);
+
+    std::vector<float> distances;
+    std::vector<int> shifts;
+    for (auto _ : state) {
+        scan_context_distance.GetDistances(scan_contexts->data(), num_sources, distances, shifts);
+        benchmark::DoNotOptimize(distances.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * num_sources * num_targets);
+}
+
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_log_dir = WORK_SPACE_PATH + "/Log";
+    FLAGS_alsologtostderr = 1;
+
+    // the --benchmark_* flags are consumed here, e.g. --benchmark_filter=Transform:
+    benchmark::Initialize(&argc, argv);
+
+    std::string config_file_path = (argc > 1) ? argv[1] : WORK_SPACE_PATH + "/config/benchmark/simd_kernels_benchmark.yaml";
+    YAML::Node config_node = YAML::LoadFile(config_file_path);
+
+    CloudData::CLOUD cloud;
+    if (!LoadCloud(config_node, cloud)) {
+        return 1;
+    }
+
+    // random non-negative descriptors, both for sources & targets:
+    const YAML::Node scan_context_node = config_node["scan_context"];
+    std::vector<float> scan_contexts(
+        static_cast<size_t>(scan_context_node["num_rings"].as<int>()) * 
+        scan_context_node["num_sectors"].as<int>() * 
+        std::max(scan_context_node["num_sources"].as<int>(), scan_context_node["num_targets"].as<int>())
+    );
+    std::mt19937 random_engine(0);
+    std::uniform_real_distribution<float> distribution(0.0f, 3.0f);
+    for (float& value: scan_contexts) {
+        value = distribution(random_engine);
+    }
+
+    // levels the CPU does not support are skipped, the widest is run unless capped by LIDAR_LOCALIZATION_SIMD:
+    const SIMDLevel widest_level = SIMDDispatch::GetLevel();
+    LOG(INFO) << "Widest SIMD level: " << SIMDDispatch::GetName(widest_level);
+
+    for (const std::string& name: config_node["levels"].as<std::vector<std::string>>()) {
+        SIMDLevel level;
+        if (!SIMDDispatch::GetLevel(name, level)) {
+            LOG(WARNING) << "Unknown SIMD level " << name << ", skipped.";
+            continue;
+        }
+        if (SIMDLevel::SCALAR != level && !SIMDDispatch::IsEnabled(level)) {
+            continue;
+        }
+
+        benchmark::RegisterBenchmark(
+            ("CloudAssembler/Transform/" + name).c_str(),
+            BenchmarkTransform, &cloud, level
+        )->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark(
+            ("CompactCloud/Transform/" + name).c_str(),
+            BenchmarkCompactTransform, &cloud, level
+        )->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark(
+            ("ScanContextDistance/GetDistances/" + name).c_str(),
+            BenchmarkScanContextDistance, &scan_context_node, &scan_contexts, level
+        )->Unit(benchmark::kMicrosecond);
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+
+    return 0;
+}
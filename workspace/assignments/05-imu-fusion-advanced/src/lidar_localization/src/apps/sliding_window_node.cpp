@@ -0,0 +1,67 @@
+/*
+ * @Description: lidar-IMU-GNSS fusion for localization by sliding window optimization
+ * @Author: Ge Yao
+ * @Date: 2020-12-25 10:06:18
+ */
+#include <ros/ros.h>
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/trace_service.hpp"
+#include "lidar_localization/tools/metrics_publisher.hpp"
+#include "lidar_localization/tools/thread_config.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+
+#include "lidar_localization/sliding_window/sliding_window_flow.hpp"
+
+#include <lidar_localization/saveOdometry.h>
+
+#include "glog/logging.h"
+
+using namespace lidar_localization;
+
+bool _need_save_odometry = false;
+
+bool SaveOdometryCB(saveOdometry::Request &request, saveOdometry::Response &response) {
+    _need_save_odometry = true;
+    response.succeed = true;
+    return response.succeed;
+}
+
+
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_log_dir = WORK_SPACE_PATH + "/Log";
+    FLAGS_alsologtostderr = 1;
+
+    ros::init(argc, argv, "sliding_window_node");
+    ros::NodeHandle nh;
+    // dump_trace & metrics, one per node:
+    ros::NodeHandle private_nh("~");
+    TraceService trace_service(private_nh);
+    MetricsPublisher metrics_publisher(private_nh);
+
+    std::shared_ptr<SlidingWindowFlow> sliding_window_flow_ptr = std::make_shared<SlidingWindowFlow>(nh);
+    ros::ServiceServer service = nh.advertiseService("save_odometry", SaveOdometryCB);
+
+    // main loop pinning, scheduling class & memory locking, see config/tools/thread_config.yaml:
+    ThreadConfig thread_config("sliding_window_node");
+    thread_config.Apply();
+    JitterMonitor jitter_monitor("sliding_window_node", 0.01, thread_config.IsJitterMeasured());
+
+    ros::Rate rate(100);
+    while (ros::ok()) {
+        jitter_monitor.Tick();
+        ros::spinOnce();
+
+        sliding_window_flow_ptr->Run();
+
+        // save odometry estimations for evo evaluation:
+        if ( _need_save_odometry && sliding_window_flow_ptr->SaveOdometry()) {
+            _need_save_odometry = false;
+        }
+
+        rate.sleep();
+    }
+
+    return 0;
+}
\ No newline at end of file
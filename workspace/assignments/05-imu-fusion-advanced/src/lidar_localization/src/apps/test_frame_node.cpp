@@ -14,6 +14,7 @@
 #include "lidar_localization/tf_listener/tf_listener.hpp"
 #include "lidar_localization/publisher/cloud_publisher.hpp"
 #include "lidar_localization/publisher/odometry_publisher.hpp"
+#include "lidar_localization/tools/geo_converter.hpp"
 
 using namespace lidar_localization;
 
@@ -38,7 +39,7 @@ int main(int argc, char *argv[]) {
     std::deque<GNSSData> gnss_data_buff;
     Eigen::Matrix4f lidar_to_imu = Eigen::Matrix4f::Identity();
     bool transform_received = false;
-    bool gnss_origin_position_inited = false;
+    std::shared_ptr<GeoConverter> geo_converter_ptr;
 
     ros::Rate rate(100);
     while (ros::ok()) {
@@ -72,11 +73,10 @@ int main(int argc, char *argv[]) {
 
                     Eigen::Matrix4f odometry_matrix;
 
-                    if (!gnss_origin_position_inited) {
-                        gnss_data.InitOriginPosition();
-                        gnss_origin_position_inited = true;
+                    if (!geo_converter_ptr) {
+                        geo_converter_ptr = std::make_shared<GeoConverter>(gnss_data.latitude, gnss_data.longitude, gnss_data.altitude);
                     }
-                    gnss_data.UpdateXYZ();
+                    geo_converter_ptr->Forward(gnss_data);
                     odometry_matrix(0,3) = gnss_data.local_E;
                     odometry_matrix(1,3) = gnss_data.local_N;
                     odometry_matrix(2,3) = gnss_data.local_U;
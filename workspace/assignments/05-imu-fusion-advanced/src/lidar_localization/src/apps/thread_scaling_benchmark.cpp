@@ -0,0 +1,645 @@
+/*
+ * @Description: thread scaling of the parallel kernels, speedup & efficiency by num. of threads,
+ *               with the traced scopes that lose the most against linear scaling
+ * @Author: Ge Yao
+ * @Date: 2021-02-01 10:26:14
+ */
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <functional>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <pcl/common/transforms.h>
+#include <yaml-cpp/yaml.h>
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/sensor_data/key_frame.hpp"
+#include "lidar_localization/tools/task_scheduler.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/models/key_frame_store/pcd_key_frame_store.hpp"
+#include "lidar_localization/models/key_frame_store/packed_key_frame_store.hpp"
+#include "lidar_localization/models/registration/ndt_registration.hpp"
+#include "lidar_localization/models/registration/ndt_omp_registration.hpp"
+#include "lidar_localization/models/registration/vgicp_registration.hpp"
+#include "lidar_localization/models/registration/icp_plane_registration.hpp"
+#include "lidar_localization/models/registration/loam_registration.hpp"
+#include "lidar_localization/models/cloud_filter/voxel_filter.hpp"
+#include "lidar_localization/models/cloud_filter/voxel_filter_fast.hpp"
+#include "lidar_localization/models/cloud_filter/filter_chain.hpp"
+#include "lidar_localization/models/cloud_filter/ground_filter.hpp"
+#include "lidar_localization/models/scan_context_manager/scan_context_distance.hpp"
+#include "lidar_localization/sensor_data/range_image.hpp"
+
+#ifdef LIDAR_LOCALIZATION_WITH_LOAM_FEATURES
+// shared by LINS & A-LOAM:
+#include <FeatureExtractor.h>
+#endif
+
+using namespace lidar_localization;
+
+// inputs shared by all kernels:
+struct KernelData {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    CloudData::CLOUD_PTR source_cloud_ptr;
+    // key frames around the target key frame, in its frame:
+    CloudData::CLOUD_PTR map_cloud_ptr;
+    // source key frame in the target key frame:
+    Eigen::Matrix4f predict_pose = Eigen::Matrix4f::Identity();
+};
+
+#ifdef LIDAR_LOCALIZATION_WITH_LOAM_FEATURES
+// a scan ordered ring by ring through its range image, as the LOAM feature extractor takes it:
+struct FeatureScan {
+    CloudData::CLOUD cloud;
+    // first & last candidates of each ring, CURVATURE_RADIUS points in from its ends as LINS:
+    std::vector<int> ring_start;
+    std::vector<int> ring_end;
+    // cell & column of each point:
+    std::vector<int> point_cells;
+    std::vector<int> point_cols;
+    // range of each cell, 0 if empty:
+    std::vector<float> cell_ranges;
+    int num_cols = 0;
+};
+
+void BuildFeatureScan(const RangeImage& range_image, const CloudData::CLOUD& cloud, FeatureScan& scan) {
+    const int radius = loam::FeatureExtractor<CloudData::POINT>::CURVATURE_RADIUS;
+
+    scan.cloud.clear();
+    scan.ring_start.clear();
+    scan.ring_end.clear();
+    scan.point_cells.clear();
+    scan.point_cols.clear();
+    scan.cell_ranges = range_image.GetRangeChannel();
+    scan.num_cols = range_image.GetNumCols();
+
+    for (int row = 0; row < range_image.GetNumRows(); ++row) {
+        const int ring_begin = static_cast<int>(scan.cloud.points.size());
+        for (int col = 0; col < scan.num_cols; ++col) {
+            const int index = range_image.GetPointIndex(row, col);
+            if (index == RangeImage::EMPTY)
+                continue;
+
+            scan.cloud.points.push_back(cloud.points.at(index));
+            scan.point_cells.push_back(range_image.GetCell(row, col));
+            scan.point_cols.push_back(col);
+        }
+        scan.ring_start.push_back(ring_begin + radius);
+        scan.ring_end.push_back(static_cast<int>(scan.cloud.points.size()) - 1 - radius);
+    }
+    scan.cloud.width = static_cast<uint32_t>(scan.cloud.points.size());
+    scan.cloud.height = 1;
+}
+#endif
+
+// one timed run of a kernel, false on failure:
+typedef std::function<bool(void)> KernelRun;
+
+struct ScalingResult {
+    int num_threads;
+    // median of the repeats:
+    double time;
+    // traced scopes per run:
+    std::vector<Tracer::ScopeStats> scope_stats;
+};
+
+std::string GetPath(const YAML::Node& config_node, const std::string& name) {
+    std::string path = config_node[name].as<std::string>();
+    if (path.front() != '/') {
+        path = WORK_SPACE_PATH + "/" + path;
+    }
+
+    return path;
+}
+
+// same as batch mapping:
+bool LoadKITTI(const std::string& file_path, std::vector<KeyFrame>& key_frames) {
+    std::ifstream ifs(file_path);
+    if (!ifs) {
+        LOG(ERROR) << "Cannot open trajectory " << file_path;
+        return false;
+    }
+
+    key_frames.clear();
+    std::string line;
+    while (std::getline(ifs, line)) {
+        if (line.empty())
+            continue;
+
+        KeyFrame key_frame;
+        key_frame.index = static_cast<unsigned int>(key_frames.size());
+
+        std::istringstream iss(line);
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                iss >> key_frame.pose(i, j);
+            }
+        }
+        if (!iss) {
+            LOG(ERROR) << "Invalid pose of key frame " << key_frame.index << " in " << file_path;
+            return false;
+        }
+
+        key_frames.push_back(key_frame);
+    }
+
+    return true;
+}
+
+// the params of a kernel replace those of node, maps are merged key by key:
+void MergeParams(const YAML::Node& params, YAML::Node node) {
+    for (const auto& param: params) {
+        const std::string key = param.first.as<std::string>();
+        if ( param.second.IsMap() && node[key] && node[key].IsMap() ) {
+            MergeParams(param.second, node[key]);
+        } else {
+            node[key] = YAML::Clone(param.second);
+        }
+    }
+}
+
+/**
+ * @brief  source key frame & the map of the key frames around the target key frame, as loop closing joins it
+ * @return true if every key scan is loaded otherwise false
+ */
+bool LoadKernelData(
+    const YAML::Node& config_node, const std::vector<KeyFrame>& key_frames,
+    KeyFrameStoreInterface& key_frame_store, KernelData& data
+) {
+    const int num_key_frames = static_cast<int>(key_frames.size());
+    const int source_index = config_node["source_index"].as<int>();
+    const int target_index = config_node["target_index"].as<int>();
+    const int extend_frame_num = config_node["extend_frame_num"].as<int>();
+    if (
+        source_index < 0 || source_index >= num_key_frames ||
+        target_index < 0 || target_index >= num_key_frames
+    ) {
+        LOG(ERROR) << "Source or target key frame out of the " << num_key_frames << " key frames.";
+        return false;
+    }
+
+    const Eigen::Matrix4f target_pose_inv = key_frames.at(target_index).pose.inverse();
+
+    data.source_cloud_ptr.reset(new CloudData::CLOUD());
+    if (!key_frame_store.Load(key_frames.at(source_index).index, *data.source_cloud_ptr)) {
+        LOG(ERROR) << "Failed to load key scan " << source_index;
+        return false;
+    }
+    data.predict_pose = target_pose_inv * key_frames.at(source_index).pose;
+
+    data.map_cloud_ptr.reset(new CloudData::CLOUD());
+    CloudData::CLOUD key_scan, transformed_key_scan;
+    for (
+        int i = std::max(target_index - extend_frame_num, 0);
+        i <= std::min(target_index + extend_frame_num, num_key_frames - 1);
+        ++i
+    ) {
+        if (!key_frame_store.Load(key_frames.at(i).index, key_scan)) {
+            LOG(ERROR) << "Failed to load key scan " << i;
+            return false;
+        }
+
+        pcl::transformPointCloud(key_scan, transformed_key_scan, target_pose_inv * key_frames.at(i).pose);
+        *data.map_cloud_ptr += transformed_key_scan;
+    }
+
+    return true;
+}
+
+/**
+ * @brief  whether the kernel is compiled in, the LOAM feature extractor needs LINS in the same workspace
+ * @return true if available otherwise false
+ */
+bool IsKernelAvailable(const YAML::Node& kernel_node) {
+#ifndef LIDAR_LOCALIZATION_WITH_LOAM_FEATURES
+    if (kernel_node["type"].as<std::string>() == "feature_extractor")
+        return false;
+#endif
+
+    return true;
+}
+
+/**
+ * @brief  a kernel set up for the num. of threads, the setup is not timed
+ * @param  kernel_node, kernel config, params override those of front end or loop closing
+ * @param  front_end_config_node, registration & filter params
+ * @param  loop_closing_config_node, scan context params
+ * @param  num_threads, num. of threads, replaces num_threads of the params if any
+ * @param  run, output kernel
+ * @return true for success otherwise false
+ */
+bool InitKernel(
+    const YAML::Node& kernel_node,
+    const YAML::Node& front_end_config_node, const YAML::Node& loop_closing_config_node,
+    const KernelData& data, int num_threads,
+    KernelRun& run
+) {
+    const std::string type = kernel_node["type"].as<std::string>();
+
+    if (type == "scan_context") {
+        YAML::Node params = YAML::Clone(loop_closing_config_node["scan_context"]);
+        if (kernel_node["params"]) {
+            MergeParams(kernel_node["params"], params);
+        }
+        const int num_rings = params["num_rings"].as<int>();
+        const int num_sectors = params["num_sectors"].as<int>();
+        const int num_targets = kernel_node["num_targets"].as<int>();
+        const int num_sources = kernel_node["num_sources"].as<int>();
+
+        // random descriptors, the same for all num. of threads:
+        std::mt19937 generator(0);
+        std::uniform_real_distribution<float> height(0.0f, 10.0f);
+        std::vector<float> targets(static_cast<size_t>(num_targets) * num_rings * num_sectors);
+        std::vector<float> sources(static_cast<size_t>(num_sources) * num_rings * num_sectors);
+        for (float& value: targets) { value = height(generator); }
+        for (float& value: sources) { value = height(generator); }
+
+        std::shared_ptr<ScanContextDistance> scan_context_distance_ptr = std::make_shared<ScanContextDistance>(
+            num_rings, num_sectors, false
+        );
+        if (!scan_context_distance_ptr->SetTargets(targets.data(), num_targets)) {
+            LOG(ERROR) << "Failed to set scan context targets.";
+            return false;
+        }
+
+        std::shared_ptr<std::vector<float>> distances_ptr = std::make_shared<std::vector<float>>();
+        std::shared_ptr<std::vector<int>> shifts_ptr = std::make_shared<std::vector<int>>();
+        run = [=]() {
+            return scan_context_distance_ptr->GetDistances(sources.data(), num_sources, *distances_ptr, *shifts_ptr);
+        };
+
+        return true;
+    }
+
+    // fixed-size Eigen members are not captured by value:
+    const KernelData* data_ptr = &data;
+
+    const std::string method = kernel_node["method"].as<std::string>();
+    if (!front_end_config_node[method]) {
+        LOG(ERROR) << "No params of " << method << " in front_end.yaml.";
+        return false;
+    }
+    YAML::Node params = YAML::Clone(front_end_config_node[method]);
+    if (kernel_node["params"]) {
+        MergeParams(kernel_node["params"], params);
+    }
+
+    if (type == "registration") {
+        if (params["num_threads"]) {
+            params["num_threads"] = num_threads;
+        }
+
+        std::shared_ptr<RegistrationInterface> registration_ptr;
+        if (method == "NDT") {
+            registration_ptr = std::make_shared<NDTRegistration>(params);
+        } else if (method == "NDT_OMP") {
+            registration_ptr = std::make_shared<NDTOMPRegistration>(params);
+        } else if (method == "VGICP") {
+            registration_ptr = std::make_shared<VGICPRegistration>(params);
+        } else if (method == "ICP_PLANE") {
+            registration_ptr = std::make_shared<ICPPlaneRegistration>(params);
+        } else if (method == "LOAM") {
+            registration_ptr = std::make_shared<LOAMRegistration>(params);
+        } else {
+            LOG(ERROR) << "Registration method " << method << " NOT FOUND!";
+            return false;
+        }
+
+        // the target is built in every run, as front end does for each new local map:
+        CloudData::CLOUD_PTR result_cloud_ptr(new CloudData::CLOUD());
+        run = [=]() mutable {
+            Eigen::Matrix4f result_pose = Eigen::Matrix4f::Identity();
+            return (
+                registration_ptr->SetInputTarget(data_ptr->map_cloud_ptr) &&
+                registration_ptr->ScanMatch(
+                    data_ptr->source_cloud_ptr, data_ptr->predict_pose, result_cloud_ptr, result_pose
+                )
+            );
+        };
+
+        return true;
+    }
+
+    if (type == "filter") {
+        // the frame filter params, as front end:
+        const YAML::Node& filter_params = params["frame"];
+
+        std::shared_ptr<CloudFilterInterface> filter_ptr;
+        if (method == "voxel_filter") {
+            filter_ptr = std::make_shared<VoxelFilter>(filter_params);
+        } else if (method == "voxel_filter_fast") {
+            filter_ptr = std::make_shared<FastVoxelFilter>(filter_params);
+        } else if (method == "filter_chain") {
+            filter_ptr = std::make_shared<FilterChain>(filter_params);
+        } else if (method == "ground_filter") {
+            filter_ptr = std::make_shared<GroundFilter>(filter_params);
+        } else {
+            LOG(ERROR) << "Filter method " << method << " NOT FOUND!";
+            return false;
+        }
+
+        run = [=]() {
+            CloudData::CLOUD_PTR filtered_cloud_ptr;
+            return filter_ptr->Filter(data_ptr->source_cloud_ptr, filtered_cloud_ptr);
+        };
+
+        return true;
+    }
+
+    if (type == "feature_extractor") {
+#ifdef LIDAR_LOCALIZATION_WITH_LOAM_FEATURES
+        // the scan is binned as the LOAM registration does:
+        const YAML::Node& image_params = params["range_image"];
+        const YAML::Node& feature_params = params["feature"];
+        const int num_rows = image_params["num_rows"].as<int>();
+        const float min_elevation = -image_params["vertical_bottom"].as<float>();
+        RangeImage range_image(
+            num_rows,
+            min_elevation, min_elevation + num_rows * image_params["vertical_resolution"].as<float>(),
+            image_params["num_cols"].as<int>()
+        );
+        range_image.Build(*data_ptr->source_cloud_ptr);
+
+        std::shared_ptr<FeatureScan> scan_ptr = std::make_shared<FeatureScan>();
+        BuildFeatureScan(range_image, *data_ptr->source_cloud_ptr, *scan_ptr);
+
+        typedef loam::FeatureExtractor<CloudData::POINT> FeatureExtractor;
+        std::shared_ptr<FeatureExtractor> extractor_ptr = std::make_shared<FeatureExtractor>();
+        extractor_ptr->params().numSectors = feature_params["num_sectors"].as<int>();
+        extractor_ptr->params().maxLessSharp = feature_params["max_num_edges_per_sector"].as<int>();
+        extractor_ptr->params().leafSize = feature_params["plane_leaf_size"].as<float>();
+        const float edge_threshold = feature_params["edge_threshold"].as<float>();
+        const float plane_threshold = feature_params["plane_threshold"].as<float>();
+
+        std::shared_ptr<FeatureExtractor::Features> features_ptr(new FeatureExtractor::Features());
+        run = [=]() {
+            const FeatureScan& scan = *scan_ptr;
+            FeatureExtractor& extractor = *extractor_ptr;
+
+            loam::RangeImageView image;
+            image.numCols = scan.num_cols;
+            image.pointCells = scan.point_cells.data();
+            image.cellRanges = scan.cell_ranges.data();
+
+            extractor.reset(static_cast<int>(scan.cloud.points.size()));
+            extractor.computeCurvature(image);
+            // neighbors are not marked across a gap of more than 10 columns, as LINS:
+            extractor.extract(
+                scan.cloud, scan.ring_start, scan.ring_end,
+                [&scan](int i, int j) { return std::abs(scan.point_cols[i] - scan.point_cols[j]) > 10; },
+                [&extractor, edge_threshold](int i) { return extractor.curvature(i) > edge_threshold; },
+                [&extractor, plane_threshold](int i) { return extractor.curvature(i) < plane_threshold; },
+                *features_ptr
+            );
+
+            return !features_ptr->surfPointsLessFlat.empty();
+        };
+
+        return true;
+#else
+        LOG(ERROR) << "Built without the LOAM feature extractor of LINS.";
+        return false;
+#endif
+    }
+
+    LOG(ERROR) << "Kernel type " << type << " NOT FOUND!";
+    return false;
+}
+
+/**
+ * @brief  run a kernel at each num. of threads, repeats after one untimed warm-up run
+ * @return true for success otherwise false
+ */
+bool RunKernel(
+    const YAML::Node& kernel_node,
+    const YAML::Node& front_end_config_node, const YAML::Node& loop_closing_config_node,
+    const KernelData& data, const std::vector<int>& thread_counts, int num_repeats,
+    std::vector<ScalingResult>& results
+) {
+    TaskScheduler& task_scheduler = TaskScheduler::GetInstance();
+
+    results.clear();
+    for (int num_threads: thread_counts) {
+        task_scheduler.SetThreadLimit(num_threads);
+#ifdef _OPENMP
+        omp_set_num_threads(num_threads);
+#endif
+
+        KernelRun run;
+        if (!InitKernel(kernel_node, front_end_config_node, loop_closing_config_node, data, num_threads, run) || !run()) {
+            return false;
+        }
+
+        Tracer::GetInstance().Clear();
+        std::vector<double> times;
+        for (int i = 0; i < num_repeats; ++i) {
+            const auto begin_time = std::chrono::steady_clock::now();
+            if (!run()) {
+                return false;
+            }
+            times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin_time).count());
+        }
+        std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+
+        results.emplace_back();
+        ScalingResult& result = results.back();
+        result.num_threads = num_threads;
+        result.time = times.at(times.size() / 2);
+        Tracer::GetInstance().Summarize(result.scope_stats);
+        for (Tracer::ScopeStats& stats: result.scope_stats) {
+            stats.num_calls /= num_repeats;
+            stats.total_duration /= num_repeats;
+        }
+    }
+
+    // the whole pool again for the other flows:
+    task_scheduler.SetThreadLimit(0);
+#ifdef _OPENMP
+    omp_set_num_threads(task_scheduler.GetNumThreads());
+#endif
+
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_log_dir = WORK_SPACE_PATH + "/Log";
+    FLAGS_alsologtostderr = 1;
+
+    std::string config_file_path = (argc > 1) ? argv[1] : WORK_SPACE_PATH + "/config/benchmark/thread_scaling_benchmark.yaml";
+    YAML::Node config_node = YAML::LoadFile(config_file_path);
+    // registration & filter params as front end, scan context params & key frame store as loop closing:
+    YAML::Node front_end_config_node = YAML::LoadFile(WORK_SPACE_PATH + "/config/mapping/front_end.yaml");
+    YAML::Node loop_closing_config_node = YAML::LoadFile(WORK_SPACE_PATH + "/config/mapping/loop_closing.yaml");
+
+    std::string data_path = config_node["data_path"].as<std::string>();
+    if (data_path == "./") {
+        data_path = WORK_SPACE_PATH;
+    }
+    const std::string key_frames_path = data_path + "/slam_data/key_frames";
+    const std::string trajectory_path = data_path + "/slam_data/trajectory";
+    const std::string scaling_path = GetPath(config_node, "scaling_path");
+    const std::string attribution_path = GetPath(config_node, "attribution_path");
+    const int num_repeats = std::max(config_node["num_repeats"].as<int>(), 1);
+    const size_t num_attributed_scopes = config_node["num_attributed_scopes"].as<size_t>();
+
+    // a. num. of threads, 1, 2, 4, ... & the whole pool by default:
+    const int max_num_threads = TaskScheduler::GetInstance().GetNumThreads();
+    std::vector<int> thread_counts;
+    if (config_node["threads"] && config_node["threads"].size() > 0) {
+        for (const YAML::Node& num_threads_node: config_node["threads"]) {
+            const int num_threads = num_threads_node.as<int>();
+            if (num_threads < 1 || num_threads > max_num_threads) {
+                LOG(WARNING) << "Skip " << num_threads << " threads, the task scheduler has " << max_num_threads << ".";
+                continue;
+            }
+            thread_counts.push_back(num_threads);
+        }
+    } else {
+        for (int num_threads = 1; num_threads < max_num_threads; num_threads *= 2) {
+            thread_counts.push_back(num_threads);
+        }
+        thread_counts.push_back(max_num_threads);
+    }
+    if (thread_counts.empty() || thread_counts.front() != 1) {
+        LOG(ERROR) << "Thread counts must start with 1, the baseline of speedups.";
+        return 1;
+    }
+
+    // b. key frames by GNSS/IMU, as saved by back end:
+    std::vector<KeyFrame> key_frames;
+    if (!LoadKITTI(trajectory_path + "/ground_truth.txt", key_frames) || key_frames.empty()) {
+        LOG(ERROR) << "No key frames in " << trajectory_path;
+        return 1;
+    }
+
+    std::shared_ptr<KeyFrameStoreInterface> key_frame_store_ptr;
+    std::string key_frame_store_method = loop_closing_config_node["key_frame_store"].as<std::string>();
+    if (key_frame_store_method == "pcd") {
+        key_frame_store_ptr = std::make_shared<PCDKeyFrameStore>(key_frames_path);
+    } else if (key_frame_store_method == "packed") {
+        key_frame_store_ptr = std::make_shared<PackedKeyFrameStore>(
+            key_frames_path, loop_closing_config_node[key_frame_store_method]
+        );
+    } else {
+        LOG(ERROR) << "Key frame store " << key_frame_store_method << " NOT FOUND!";
+        return 1;
+    }
+
+    KernelData data;
+    if (!LoadKernelData(config_node, key_frames, *key_frame_store_ptr, data)) {
+        return 1;
+    }
+
+#ifndef LIDAR_LOCALIZATION_WITH_TRACING
+    LOG(WARNING) << "Built without tracing, scaling losses are not attributed to scopes.";
+#endif
+
+    // c. each kernel at each num. of threads:
+    std::ofstream scaling_ofs(scaling_path);
+    std::ofstream attribution_ofs(attribution_path);
+    if (!scaling_ofs || !attribution_ofs) {
+        LOG(ERROR) << "Cannot create thread scaling reports " << scaling_path << ", " << attribution_path;
+        return 1;
+    }
+    scaling_ofs << "kernel,threads,time_ms,speedup,efficiency,serial_fraction" << std::endl;
+    attribution_ofs << "kernel,scope,threads,calls,total_ms,excess_ms" << std::endl;
+    scaling_ofs << std::fixed << std::setprecision(3);
+    attribution_ofs << std::fixed << std::setprecision(3);
+
+    std::ostringstream summary;
+    summary << std::fixed << std::setprecision(2);
+    for (const YAML::Node& kernel_node: config_node["kernels"]) {
+        const std::string name = kernel_node["name"].as<std::string>();
+        if (!IsKernelAvailable(kernel_node)) {
+            LOG(WARNING) << "Kernel " << name << " is not built in, skipped.";
+            continue;
+        }
+        LOG(INFO) << "Kernel " << name << " at " << thread_counts.size() << " thread counts...";
+
+        std::vector<ScalingResult> results;
+        if (
+            !RunKernel(
+                kernel_node, front_end_config_node, loop_closing_config_node,
+                data, thread_counts, num_repeats, results
+            )
+        ) {
+            LOG(ERROR) << "Kernel " << name << " failed.";
+            return 1;
+        }
+
+        // c.1 speedup, efficiency & Karp-Flatt serial fraction, (1 / speedup - 1 / n) / (1 - 1 / n):
+        const ScalingResult& baseline = results.front();
+        summary << "\t" << name << ":";
+        for (const ScalingResult& result: results) {
+            const double speedup = baseline.time / result.time;
+            const double efficiency = speedup / result.num_threads;
+
+            scaling_ofs << name << "," << result.num_threads << "," << 1.0e3 * result.time << ","
+                        << speedup << "," << efficiency << ",";
+            if (result.num_threads > 1) {
+                scaling_ofs << (1.0 / speedup - 1.0 / result.num_threads) / (1.0 - 1.0 / result.num_threads);
+            }
+            scaling_ofs << std::endl;
+
+            summary << " " << result.num_threads << "T " << 1.0e3 * result.time << " ms (x" << speedup << ")";
+        }
+        summary << std::endl;
+
+        // c.2 scopes by excess over linear scaling of their single thread time, t_n - t_1 / n:
+        for (size_t i = 1; i < results.size(); ++i) {
+            const ScalingResult& result = results.at(i);
+
+            std::vector<std::pair<double, const Tracer::ScopeStats*>> excesses;
+            for (const Tracer::ScopeStats& stats: result.scope_stats) {
+                double baseline_duration = 0.0;
+                for (const Tracer::ScopeStats& baseline_stats: baseline.scope_stats) {
+                    if (baseline_stats.name == stats.name) {
+                        baseline_duration = static_cast<double>(baseline_stats.total_duration);
+                        break;
+                    }
+                }
+                excesses.emplace_back(stats.total_duration - baseline_duration / result.num_threads, &stats);
+            }
+            std::sort(
+                excesses.begin(), excesses.end(),
+                [](const std::pair<double, const Tracer::ScopeStats*>& lhs, const std::pair<double, const Tracer::ScopeStats*>& rhs) {
+                    return lhs.first > rhs.first;
+                }
+            );
+
+            for (size_t j = 0; j < std::min(num_attributed_scopes, excesses.size()); ++j) {
+                const Tracer::ScopeStats& stats = *excesses.at(j).second;
+                attribution_ofs << name << "," << stats.name << "," << result.num_threads << ","
+                                << stats.num_calls << "," << 1.0e-6 * stats.total_duration << ","
+                                << 1.0e-6 * excesses.at(j).first << std::endl;
+            }
+        }
+    }
+    if (!scaling_ofs || !attribution_ofs) {
+        LOG(ERROR) << "Failed to write thread scaling reports " << scaling_path << ", " << attribution_path;
+        return 1;
+    }
+
+    LOG(INFO) << std::endl
+              << "Thread scaling benchmark, up to " << thread_counts.back() << " threads:" << std::endl
+              << summary.str()
+              << "\tscaling: " << scaling_path << std::endl
+              << "\tattribution: " << attribution_path << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,237 @@
+/*
+ * @Description: local map assembly benchmark of the tiled map, cached pcd tiles against the mapped store
+ *               without & with huge pages, latency & page faults along a simulated drive
+ * @Author: Ge Yao
+ * @Date: 2021-01-23 16:12:44
+ */
+#include <cmath>
+#include <string>
+#include <vector>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include <sys/resource.h>
+
+#include <yaml-cpp/yaml.h>
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/sensor_data/cloud_data.hpp"
+#include "lidar_localization/tools/metrics.hpp"
+#include "lidar_localization/models/tiled_map/tiled_map.hpp"
+
+using namespace lidar_localization;
+
+struct PassResult {
+    std::string name;
+    LatencyHistogram latency;
+    size_t num_points = 0;
+    long num_minor_faults = 0;
+    long num_major_faults = 0;
+};
+
+struct VariantResult {
+    std::string name;
+    std::string huge_pages;
+    std::vector<std::unique_ptr<PassResult>> passes;
+};
+
+std::string GetPath(const std::string& path) {
+    return (path.front() != '/') ? WORK_SPACE_PATH + "/" + path : path;
+}
+
+// uniform random points over [-size / 2, size / 2)^2, on a few meters of height:
+bool SaveSyntheticMap(const std::string& tiles_path, const YAML::Node& synthetic_node, std::mt19937& generator) {
+    const float size = synthetic_node["size"].as<float>();
+    const size_t num_points = static_cast<size_t>(size * size * synthetic_node["density"].as<float>());
+
+    std::uniform_real_distribution<float> xy(-0.5f * size, 0.5f * size);
+    std::uniform_real_distribution<float> z(-2.0f, 10.0f);
+
+    CloudData::CLOUD map;
+    map.points.resize(num_points);
+    for (CloudData::POINT& point: map.points) {
+        point.x = xy(generator);
+        point.y = xy(generator);
+        point.z = z(generator);
+    }
+    map.width = static_cast<unsigned int>(num_points);
+    map.height = 1;
+
+    LOG(INFO) << "Synthetic map of " << num_points << " points, " << size << " m wide.";
+
+    return TiledMap::Save(tiles_path, map, synthetic_node["tile_size"].as<float>());
+}
+
+// local map edges along a drive which turns at random and bounces off the map border:
+std::vector<std::vector<float>> GetEdges(
+    const YAML::Node& config_node, const std::vector<float>& box, float size, std::mt19937& generator
+) {
+    const int num_queries = config_node["num_queries"].as<int>();
+    const float step = config_node["step"].as<float>();
+    const float max_turn = config_node["max_turn"].as<float>() * static_cast<float>(M_PI) / 180.0f;
+
+    std::uniform_real_distribution<float> turn(-max_turn, max_turn);
+
+    std::vector<std::vector<float>> edges;
+    float x = 0.0f, y = 0.0f, heading = 0.0f;
+    for (int i = 0; i < num_queries; ++i) {
+        heading += turn(generator);
+        x += step * std::cos(heading);
+        y += step * std::sin(heading);
+        if (std::fabs(x) > 0.5f * size || std::fabs(y) > 0.5f * size) {
+            x = std::max(std::min(x, 0.5f * size), -0.5f * size);
+            y = std::max(std::min(y, 0.5f * size), -0.5f * size);
+            heading += static_cast<float>(M_PI);
+        }
+
+        std::vector<float> edge = box;
+        edge.at(0) += x; edge.at(1) += x;
+        edge.at(2) += y; edge.at(3) += y;
+        edges.push_back(edge);
+    }
+
+    return edges;
+}
+
+void GetPageFaults(long& num_minor_faults, long& num_major_faults) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    num_minor_faults = usage.ru_minflt;
+    num_major_faults = usage.ru_majflt;
+}
+
+void RunPass(TiledMap& tiled_map, const std::vector<std::vector<float>>& edges, PassResult& result) {
+    long num_minor_faults = 0, num_major_faults = 0;
+    GetPageFaults(num_minor_faults, num_major_faults);
+
+    for (const std::vector<float>& edge: edges) {
+        CloudData::CLOUD_PTR map_ptr;
+
+        const auto time = std::chrono::steady_clock::now();
+        tiled_map.GetMap(edge, map_ptr);
+        result.latency.Record(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - time).count()
+        );
+
+        result.num_points += map_ptr->points.size();
+    }
+
+    long num_minor_faults_end = 0, num_major_faults_end = 0;
+    GetPageFaults(num_minor_faults_end, num_major_faults_end);
+    result.num_minor_faults = num_minor_faults_end - num_minor_faults;
+    result.num_major_faults = num_major_faults_end - num_major_faults;
+}
+
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_log_dir = WORK_SPACE_PATH + "/Log";
+    FLAGS_alsologtostderr = 1;
+
+    std::string config_file_path = (argc > 1) ? argv[1] : WORK_SPACE_PATH + "/config/benchmark/tiled_map_benchmark.yaml";
+    YAML::Node config_node = YAML::LoadFile(config_file_path);
+    // local map box & existing tiles as filtering:
+    YAML::Node filtering_config_node = YAML::LoadFile(WORK_SPACE_PATH + "/config/filtering/filtering.yaml");
+
+    std::mt19937 generator(config_node["seed"].as<unsigned int>());
+    const std::string report_path = GetPath(config_node["report_path"].as<std::string>());
+    const std::vector<float> box = filtering_config_node["box_filter_size"].as<std::vector<float>>();
+
+    // a. tiles, the drive stays within the synthetic map, or within the range of the local map for existing ones:
+    const YAML::Node& synthetic_node = config_node["synthetic"];
+    std::string tiles_path;
+    float size = 0.0f;
+    if (synthetic_node["enable"].as<bool>()) {
+        tiles_path = GetPath(config_node["tiles_path"].as<std::string>());
+        size = synthetic_node["size"].as<float>();
+        if (!SaveSyntheticMap(tiles_path, synthetic_node, generator))
+            return 1;
+    } else {
+        tiles_path = filtering_config_node["tiled_map"]["tiles_path"].as<std::string>();
+        size = box.at(1) - box.at(0);
+    }
+    // mapped variants share it, so packing is not part of the first one:
+    if (!TiledMap::SaveMapped(tiles_path))
+        return 1;
+
+    const std::vector<std::vector<float>> edges = GetEdges(config_node, box, size, generator);
+    const int num_warm_passes = config_node["num_warm_passes"].as<int>();
+    const size_t cache_size = config_node["cache_size"].as<size_t>();
+
+    // b. each variant from scratch, cold first:
+    std::vector<VariantResult> results;
+    for (const YAML::Node& variant_node: config_node["variants"]) {
+        results.emplace_back();
+        VariantResult& result = results.back();
+        result.name = variant_node["name"].as<std::string>();
+
+        const bool is_mapped = variant_node["storage"].as<std::string>() == "mapped";
+        MappedTileStore::HugePages huge_pages = MappedTileStore::HugePages::NONE;
+        if (
+            is_mapped && variant_node["huge_pages"] &&
+            !MappedTileStore::GetHugePages(variant_node["huge_pages"].as<std::string>(), huge_pages)
+        ) {
+            LOG(ERROR) << "Huge pages " << variant_node["huge_pages"].as<std::string>() << " NOT FOUND!";
+            return 1;
+        }
+
+        TiledMap tiled_map(tiles_path, cache_size, is_mapped, huge_pages);
+        if (!tiled_map.IsValid()) {
+            LOG(ERROR) << "Tiled map is not available in " << tiles_path;
+            return 1;
+        }
+        // HUGETLB falls back to THP without reserved huge pages:
+        result.huge_pages = tiled_map.IsMapped() ? MappedTileStore::GetHugePagesName(tiled_map.GetHugePages()) : "-";
+
+        LOG(INFO) << "Tiled map variant " << result.name << ", " << edges.size() << " local maps...";
+        for (int i = 0; i <= num_warm_passes; ++i) {
+            result.passes.emplace_back(new PassResult());
+            result.passes.back()->name = (0 == i) ? "cold" : "warm";
+            RunPass(tiled_map, edges, *result.passes.back());
+        }
+    }
+
+    // c. report, cold pass & warm passes of each variant:
+    std::ofstream ofs(report_path);
+    if (!ofs) {
+        LOG(ERROR) << "Cannot create tiled map benchmark report " << report_path;
+        return 1;
+    }
+
+    std::ostringstream summary;
+    ofs << std::fixed << std::setprecision(3);
+    summary << std::fixed << std::setprecision(3);
+    for (const VariantResult& result: results) {
+        for (const std::unique_ptr<PassResult>& pass: result.passes) {
+            const LatencyHistogram::Snapshot snapshot = pass->latency.GetSnapshot();
+            const double num_queries = static_cast<double>(std::max<size_t>(edges.size(), 1));
+
+            ofs << result.name << " " << result.huge_pages << " " << pass->name
+                << " " << 1.0e-6 * snapshot.p50 << " " << 1.0e-6 * snapshot.p90
+                << " " << 1.0e-6 * snapshot.p99 << " " << 1.0e-6 * snapshot.max
+                << " " << pass->num_points / num_queries
+                << " " << pass->num_minor_faults / num_queries
+                << " " << pass->num_major_faults / num_queries << std::endl;
+        }
+
+        const LatencyHistogram::Snapshot warm = result.passes.back()->latency.GetSnapshot();
+        summary << "\t" << result.name << ": warm p50 " << 1.0e-6 * warm.p50 << " ms, p99 " << 1.0e-6 * warm.p99
+                << " ms, cold p99 " << 1.0e-6 * result.passes.front()->latency.GetSnapshot().p99 << " ms" << std::endl;
+    }
+    if (!ofs) {
+        LOG(ERROR) << "Failed to write tiled map benchmark report " << report_path;
+        return 1;
+    }
+
+    LOG(INFO) << std::endl
+              << "Tiled map benchmark of " << edges.size() << " local maps in " << tiles_path << ":" << std::endl
+              << summary.str()
+              << "\treport: " << report_path << std::endl;
+
+    return 0;
+}
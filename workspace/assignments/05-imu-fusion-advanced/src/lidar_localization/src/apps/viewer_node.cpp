@@ -8,15 +8,21 @@
 
 #include <lidar_localization/saveMap.h>
 #include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/trace_service.hpp"
+#include "lidar_localization/tools/metrics_publisher.hpp"
+#include "lidar_localization/tools/background_jobs.hpp"
+#include "lidar_localization/tools/thread_config.hpp"
+#include "lidar_localization/tools/tracer.hpp"
 #include "lidar_localization/mapping/viewer/viewer_flow.hpp"
 
 using namespace lidar_localization;
 
 std::shared_ptr<ViewerFlow> _viewer_flow_ptr;
-bool _need_save_map = false;
+std::shared_ptr<BackgroundJobs> _background_jobs_ptr;
 
+// called by spinOnce between two runs of the flow, the map of the optimized key frames as of now is saved in the background:
 bool save_map_callback(saveMap::Request &request, saveMap::Response &response) {
-    _need_save_map = true;
+    response.job_id = _background_jobs_ptr->Submit("save_map", _viewer_flow_ptr->GetSaveMapJob());
     response.succeed = true;
     return response.succeed;
 }
@@ -28,25 +34,35 @@ int main(int argc, char *argv[]) {
 
     ros::init(argc, argv, "viewer_node");
     ros::NodeHandle nh;
+    // dump_trace & metrics, one per node:
+    ros::NodeHandle private_nh("~");
+    TraceService trace_service(private_nh);
+    MetricsPublisher metrics_publisher(private_nh);
+    _background_jobs_ptr = std::make_shared<BackgroundJobs>(private_nh);
 
     std::string cloud_topic;
     nh.param<std::string>("cloud_topic", cloud_topic, "/synced_cloud");
-    std::shared_ptr<ViewerFlow> _viewer_flow_ptr = std::make_shared<ViewerFlow>(nh, cloud_topic);
+    _viewer_flow_ptr = std::make_shared<ViewerFlow>(nh, cloud_topic);
 
     ros::ServiceServer service = nh.advertiseService("save_map", save_map_callback);
 
+    // main loop pinning, scheduling class & memory locking, see config/tools/thread_config.yaml:
+    ThreadConfig thread_config("viewer_node");
+    thread_config.Apply();
+    JitterMonitor jitter_monitor("viewer_node", 0.01, thread_config.IsJitterMeasured());
+
     ros::Rate rate(100);
     while (ros::ok()) {
+        jitter_monitor.Tick();
         ros::spinOnce();
 
         _viewer_flow_ptr->Run();
-        if (_need_save_map) {
-            _need_save_map = false;
-            _viewer_flow_ptr->SaveMap();
-        }
 
         rate.sleep();
     }
 
+    // a job submitted right before shutdown is finished:
+    _background_jobs_ptr.reset();
+
     return 0;
 }
\ No newline at end of file
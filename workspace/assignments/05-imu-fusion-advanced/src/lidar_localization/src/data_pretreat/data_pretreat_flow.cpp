@@ -4,6 +4,8 @@
  * @Date: 2020-02-10 08:38:42
  */
 #include "lidar_localization/data_pretreat/data_pretreat_flow.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/offline_replay.hpp"
 
 #include "glog/logging.h"
 #include "lidar_localization/global_defination/global_defination.h"
@@ -28,9 +30,65 @@ DataPretreatFlow::DataPretreatFlow(ros::NodeHandle& nh, std::string cloud_topic)
 
     // motion compensation for lidar measurement:
     distortion_adjust_ptr_ = std::make_shared<DistortionAdjust>();
+    // sweeps are independent once synced, so they are deskewed on a worker pool and published in order.
+    // 0 to deskew on the flow thread, which is always the case in offline replay for reproducible results:
+    int num_deskew_workers = 0;
+    nh.param<int>("num_deskew_workers", num_deskew_workers, 2);
+    if (OfflineReplay::GetInstance().IsEnabled()) {
+        num_deskew_workers = 0;
+    }
+    // secondary lidars, deskewed to the primary sweep time and merged into it:
+    YAML::Node multi_lidar_node = YAML::LoadFile(WORK_SPACE_PATH + "/config/data_pretreat/multi_lidar.yaml");
+    if (multi_lidar_node["secondary_lidars"].IsSequence() && multi_lidar_node["secondary_lidars"].size() > 0) {
+        multi_lidar_input_ptr_ = std::make_shared<MultiLidarInput>(nh, multi_lidar_node, "/imu_link", metrics_);
+        for (int i = 0; i <= num_deskew_workers; ++i) {
+            multi_lidar_merger_ptrs_.push_back(std::make_shared<MultiLidarMerger>(multi_lidar_node));
+        }
+    }
+    if (num_deskew_workers > 0) {
+        for (int i = 0; i < num_deskew_workers; ++i) {
+            worker_distortion_adjust_ptrs_.push_back(std::make_shared<DistortionAdjust>());
+        }
+        deskew_pipeline_ptr_.reset(
+            new OrderedPipeline<DeskewTask>(
+                num_deskew_workers, 2 * num_deskew_workers,
+                [this](DeskewTask& task, int worker_index) {
+                    if (multi_lidar_input_ptr_) {
+                        MultiLidarMerger& multi_lidar_merger = *multi_lidar_merger_ptrs_.at(worker_index + 1);
+                        multi_lidar_merger.SetIMUData(task.deskew_imu_data_buff);
+                        multi_lidar_merger.Merge(0.1, task.velocity_data, task.cloud_data, task.secondary_cloud_data);
+                        return;
+                    }
+
+                    DistortionAdjust& distortion_adjust = *worker_distortion_adjust_ptrs_.at(worker_index);
+                    distortion_adjust.SetIMUData(task.deskew_imu_data_buff);
+                    distortion_adjust.SetMotionInfo(0.1, task.velocity_data);
+                    distortion_adjust.AdjustCloud(task.cloud_data);
+                }
+            )
+        );
+    }
+
+    // metrics:
+    metrics_.AddQueue("cloud_queue", [this]{ return cloud_data_buff_.size(); });
+    metrics_.AddQueue("imu_queue", [this]{ return imu_data_buff_.size(); });
+    metrics_.AddQueue("velocity_queue", [this]{ return velocity_data_buff_.size(); });
+    metrics_.AddQueue("gnss_queue", [this]{ return gnss_data_buff_.size(); });
+    metrics_.AddQueue("deskew_queue", [this]{ return deskew_pipeline_ptr_ ? deskew_pipeline_ptr_->GetNumTasks() : 0; });
+    dropped_clouds_ptr_ = &metrics_.AddCounter("dropped_clouds");
+    dropped_imu_ptr_ = &metrics_.AddCounter("dropped_imu");
+    dropped_velocity_ptr_ = &metrics_.AddCounter("dropped_velocity");
+    dropped_gnss_ptr_ = &metrics_.AddCounter("dropped_gnss");
+    latency_tracer_ptr_ = std::make_shared<LatencyTracer>(nh, "data_pretreat", "", cloud_topic, metrics_);
 }
 
 bool DataPretreatFlow::Run() {
+    TRACE_SCOPE("DataPretreatFlow::Run", "flow");
+    metrics_.UpdateQueues();
+
+    // sweeps deskewed since last run:
+    PublishDeskewedData(false);
+
     if (!ReadData())
         return false;
 
@@ -44,10 +102,29 @@ bool DataPretreatFlow::Run() {
         if (!ValidData())
             continue;
 
+        if (deskew_pipeline_ptr_) {
+            SubmitDeskewTask();
+            continue;
+        }
+
+        ScopedLatency latency(metrics_.GetLatency());
+        latency_tracer_ptr_->Start(current_cloud_data_.time);
         TransformData();
+        // motion compensation for lidar measurements:
+        if (multi_lidar_input_ptr_) {
+            multi_lidar_merger_ptrs_.front()->SetIMUData(distortion_adjust_ptr_->GetIMUData());
+            multi_lidar_merger_ptrs_.front()->Merge(
+                0.1, current_velocity_data_, current_cloud_data_, current_secondary_cloud_data_
+            );
+        } else {
+            distortion_adjust_ptr_->SetMotionInfo(0.1, current_velocity_data_);
+            distortion_adjust_ptr_->AdjustCloud(current_cloud_data_);
+        }
         PublishData();
     }
 
+    PublishDeskewedData(false);
+
     return true;
 }
 
@@ -58,9 +135,17 @@ bool DataPretreatFlow::ReadData() {
 
     // fetch lidar measurements from buffer:
     cloud_sub_ptr_->ParseData(cloud_data_buff_);
+    size_t num_unsynced_imu = unsynced_imu_.size();
     imu_sub_ptr_->ParseData(unsynced_imu_);
+    // raw IMU is also used for motion compensation:
+    for (size_t i = num_unsynced_imu; i < unsynced_imu_.size(); ++i) {
+        distortion_adjust_ptr_->AddIMUData(unsynced_imu_.at(i));
+    }
     velocity_sub_ptr_->ParseData(unsynced_velocity_);
     gnss_sub_ptr_->ParseData(unsynced_gnss_);
+    if (multi_lidar_input_ptr_) {
+        multi_lidar_input_ptr_->ParseData();
+    }
 
     if (cloud_data_buff_.size() == 0)
         return false;
@@ -79,6 +164,7 @@ bool DataPretreatFlow::ReadData() {
     if (!sensor_inited) {
         if (!valid_imu || !valid_velocity || !valid_gnss) {
             cloud_data_buff_.pop_front();
+            dropped_clouds_ptr_->Increment();
             return false;
         }
         sensor_inited = true;
@@ -92,22 +178,31 @@ bool DataPretreatFlow::InitCalibration() {
     static bool calibration_received = false;
     if (!calibration_received) {
         if (lidar_to_imu_ptr_->LookupData(lidar_to_imu_)) {
+            distortion_adjust_ptr_->SetLidarToIMU(lidar_to_imu_);
+            for (std::shared_ptr<DistortionAdjust>& worker_distortion_adjust_ptr: worker_distortion_adjust_ptrs_) {
+                worker_distortion_adjust_ptr->SetLidarToIMU(lidar_to_imu_);
+            }
+            for (std::shared_ptr<MultiLidarMerger>& multi_lidar_merger_ptr: multi_lidar_merger_ptrs_) {
+                multi_lidar_merger_ptr->SetLidarToIMU(0, lidar_to_imu_);
+            }
             calibration_received = true;
         }
     }
 
+    if (calibration_received && multi_lidar_input_ptr_) {
+        return multi_lidar_input_ptr_->InitCalibration(multi_lidar_merger_ptrs_);
+    }
+
     return calibration_received;
 }
 
 bool DataPretreatFlow::InitGNSS() {
-    static bool gnss_inited = false;
-    if (!gnss_inited) {
-        GNSSData gnss_data = gnss_data_buff_.front();
-        gnss_data.InitOriginPosition();
-        gnss_inited = true;
+    if (!geo_converter_ptr_) {
+        const GNSSData& gnss_data = gnss_data_buff_.front();
+        geo_converter_ptr_ = std::make_shared<GeoConverter>(gnss_data.latitude, gnss_data.longitude, gnss_data.altitude);
     }
 
-    return gnss_inited;
+    return true;
 }
 
 bool DataPretreatFlow::HasData() {
@@ -119,6 +214,12 @@ bool DataPretreatFlow::HasData() {
         return false;
     if (gnss_data_buff_.size() == 0)
         return false;
+    if (
+        multi_lidar_input_ptr_ &&
+        !multi_lidar_input_ptr_->HasData(cloud_data_buff_.front().time, cloud_data_buff_.back().time)
+    ) {
+        return false;
+    }
 
     return true;
 }
@@ -137,21 +238,25 @@ bool DataPretreatFlow::ValidData() {
     //
     if (diff_imu_time < -0.05 || diff_velocity_time < -0.05 || diff_gnss_time < -0.05) {
         cloud_data_buff_.pop_front();
+        dropped_clouds_ptr_->Increment();
         return false;
     }
 
     if (diff_imu_time > 0.05) {
         imu_data_buff_.pop_front();
+        dropped_imu_ptr_->Increment();
         return false;
     }
 
     if (diff_velocity_time > 0.05) {
         velocity_data_buff_.pop_front();
+        dropped_velocity_ptr_->Increment();
         return false;
     }
 
     if (diff_gnss_time > 0.05) {
         gnss_data_buff_.pop_front();
+        dropped_gnss_ptr_->Increment();
         return false;
     }
 
@@ -160,6 +265,10 @@ bool DataPretreatFlow::ValidData() {
     velocity_data_buff_.pop_front();
     gnss_data_buff_.pop_front();
 
+    if (multi_lidar_input_ptr_) {
+        multi_lidar_input_ptr_->GetData(current_cloud_data_.time, current_secondary_cloud_data_);
+    }
+
     return true;
 }
 
@@ -167,7 +276,7 @@ bool DataPretreatFlow::TransformData() {
     // get GNSS & IMU pose prior:
     gnss_pose_ = Eigen::Matrix4f::Identity();
     // a. get position from GNSS
-    current_gnss_data_.UpdateXYZ();
+    geo_converter_ptr_->Forward(current_gnss_data_);
     gnss_pose_(0,3) = current_gnss_data_.local_E;
     gnss_pose_(1,3) = current_gnss_data_.local_N;
     gnss_pose_(2,3) = current_gnss_data_.local_U;
@@ -178,14 +287,58 @@ bool DataPretreatFlow::TransformData() {
 
     // this is lidar velocity:
     current_velocity_data_.TransformCoordinate(lidar_to_imu_);
-    // motion compensation for lidar measurements:
-    distortion_adjust_ptr_->SetMotionInfo(0.1, current_velocity_data_);
-    distortion_adjust_ptr_->AdjustCloud(current_cloud_data_.cloud_ptr, current_cloud_data_.cloud_ptr);
 
     return true;
 }
 
+bool DataPretreatFlow::SubmitDeskewTask() {
+    DeskewTask task;
+    task.start = std::chrono::steady_clock::now();
+
+    // GNSS position & velocity transform stay here, they are cheap next to the deskew:
+    TransformData();
+    task.cloud_data = current_cloud_data_;
+    task.imu_data = current_imu_data_;
+    task.velocity_data = current_velocity_data_;
+    task.gnss_pose = gnss_pose_;
+    task.secondary_cloud_data = current_secondary_cloud_data_;
+    task.deskew_imu_data_buff = distortion_adjust_ptr_->GetIMUData();
+
+    // all workers busy, the oldest sweep goes first:
+    while (!deskew_pipeline_ptr_->Submit(std::move(task))) {
+        PublishDeskewedData(true);
+    }
+
+    return true;
+}
+
+void DataPretreatFlow::PublishDeskewedData(bool wait_oldest) {
+    if (!deskew_pipeline_ptr_)
+        return;
+
+    DeskewTask task;
+    bool wait = wait_oldest;
+    while (deskew_pipeline_ptr_->Pop(task, wait)) {
+        wait = false;
+
+        current_cloud_data_ = task.cloud_data;
+        current_imu_data_ = task.imu_data;
+        current_velocity_data_ = task.velocity_data;
+        gnss_pose_ = task.gnss_pose;
+
+        // the trace holds one measurement at a time, so it starts at publish here.
+        // the sensor hop, hence the end-to-end latency, is not affected:
+        latency_tracer_ptr_->Start(current_cloud_data_.time);
+        PublishData();
+
+        metrics_.GetLatency().Record(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - task.start).count()
+        );
+    }
+}
+
 bool DataPretreatFlow::PublishData() {
+    latency_tracer_ptr_->Publish();
     cloud_pub_ptr_->Publish(current_cloud_data_.cloud_ptr, current_cloud_data_.time);
     //
     // this synced odometry has the following info:
@@ -4,6 +4,7 @@
  * @Date: 2020-11-12 15:14:07
  */
 #include "lidar_localization/data_pretreat/eskf_preprocess_flow.hpp"
+#include "lidar_localization/tools/tracer.hpp"
 
 #include "glog/logging.h"
 #include "lidar_localization/global_defination/global_defination.h"
@@ -26,9 +27,23 @@ ESKFPreprocessFlow::ESKFPreprocessFlow(
     imu_pub_ptr_ = std::make_shared<IMUPublisher>(nh, "/synced_imu", "/imu_link", 100);
     gnss_pose_pub_ptr_ = std::make_shared<OdometryPublisher>(nh, "/synced_gnss_pose", "/map", "/imu_link", 100);
     ref_pose_pub_ptr_ = std::make_shared<OdometryPublisher>(nh, "/synced_reference_pose", "/map", "/imu_link", 100);
+
+    // metrics:
+    metrics_.AddQueue("imu_queue", [this]{ return imu_data_buff_.size(); });
+    metrics_.AddQueue("gnss_queue", [this]{ return gnss_data_buff_.size(); });
+    metrics_.AddQueue("velocity_queue", [this]{ return velocity_data_buff_.size(); });
+    metrics_.AddQueue("ref_pose_queue", [this]{ return ref_pose_data_buff_.size(); });
+    dropped_imu_ptr_ = &metrics_.AddCounter("dropped_imu");
+    dropped_gnss_ptr_ = &metrics_.AddCounter("dropped_gnss");
+    dropped_velocity_ptr_ = &metrics_.AddCounter("dropped_velocity");
+    dropped_ref_pose_ptr_ = &metrics_.AddCounter("dropped_ref_pose");
+    latency_tracer_ptr_ = std::make_shared<LatencyTracer>(nh, "eskf_preprocess", "", "/synced_gnss_pose", metrics_);
 }
 
 bool ESKFPreprocessFlow::Run() {
+    TRACE_SCOPE("ESKFPreprocessFlow::Run", "flow");
+    metrics_.UpdateQueues();
+
     if (!ReadData())
         return false;
     
@@ -41,6 +56,8 @@ bool ESKFPreprocessFlow::Run() {
             continue;
         }
 
+        ScopedLatency latency(metrics_.GetLatency());
+        latency_tracer_ptr_->Start(current_imu_data_.time);
         TransformData();
         PublishData();
     }
@@ -51,7 +68,12 @@ bool ESKFPreprocessFlow::Run() {
 bool ESKFPreprocessFlow::ReadData() {
     // fetch IMU measurements from buffer:
     imu_sub_ptr_->ParseData(imu_data_buff_);
+    size_t num_gnss_data = gnss_data_buff_.size();
     gnss_sub_ptr_->ParseData(gnss_data_buff_);
+    // new fixes are converted in one batch, those before the origin by InitGNSS:
+    if (geo_converter_ptr_) {
+        geo_converter_ptr_->Forward(gnss_data_buff_.begin() + num_gnss_data, gnss_data_buff_.end());
+    }
     velocity_sub_ptr_->ParseData(velocity_data_buff_);
     ref_pose_sub_ptr_->ParseData(ref_pose_data_buff_);
 
@@ -62,15 +84,13 @@ bool ESKFPreprocessFlow::ReadData() {
 }
 
 bool ESKFPreprocessFlow::InitGNSS() {
-    static bool gnss_inited = false;
-
-    if ( !gnss_inited ) {
-        GNSSData gnss_data = gnss_data_buff_.front();
-        gnss_data.InitOriginPosition();
-        gnss_inited = true;
+    if ( !geo_converter_ptr_ && !gnss_data_buff_.empty() ) {
+        const GNSSData& gnss_data = gnss_data_buff_.front();
+        geo_converter_ptr_ = std::make_shared<GeoConverter>(gnss_data.latitude, gnss_data.longitude, gnss_data.altitude);
+        geo_converter_ptr_->Forward(gnss_data_buff_.begin(), gnss_data_buff_.end());
     }
 
-    return gnss_inited;
+    return static_cast<bool>(geo_converter_ptr_);
 }
 
 bool ESKFPreprocessFlow::HasData() {
@@ -101,21 +121,25 @@ bool ESKFPreprocessFlow::ValidData() {
     //
     if ( diff_gnss_time < -0.005 || diff_velocity_time < -0.005 || diff_ref_pose_time < -0.005 ) {
         imu_data_buff_.pop_front();
+        dropped_imu_ptr_->Increment();
         return false;
     }
 
     if (diff_gnss_time > 0.005) {
         gnss_data_buff_.pop_front();
+        dropped_gnss_ptr_->Increment();
         return false;
     }
 
     if (diff_velocity_time > 0.005) {
         velocity_data_buff_.pop_front();
+        dropped_velocity_ptr_->Increment();
         return false;
     }
 
     if (diff_ref_pose_time > 0.005) {
         ref_pose_data_buff_.pop_front();
+        dropped_ref_pose_ptr_->Increment();
         return false;
     }
 
@@ -128,11 +152,9 @@ bool ESKFPreprocessFlow::ValidData() {
 }
 
 bool ESKFPreprocessFlow::TransformData() {
-    // a. get GNSS position measurement:
+    // a. get GNSS position measurement, already in local ENU:
     gnss_pose_ = Eigen::Matrix4f::Identity();
 
-    current_gnss_data_.UpdateXYZ();
-    
     gnss_pose_(0,3) = current_gnss_data_.local_N;
     gnss_pose_(1,3) = current_gnss_data_.local_E;
     gnss_pose_(2,3) = current_gnss_data_.local_U;
@@ -141,23 +163,25 @@ bool ESKFPreprocessFlow::TransformData() {
     current_velocity_data_.NED2ENU();
 
     // c. transform reference pose position from LLA to xyz:
-    GNSSData ref_position;
-
-    ref_position.latitude  = current_ref_pose_data_.pose(0, 3);
-    ref_position.longitude = current_ref_pose_data_.pose(1, 3);
-    ref_position.altitude  = current_ref_pose_data_.pose(2, 3);
+    double ref_E, ref_N, ref_U;
 
-    ref_position.UpdateXYZ();
+    geo_converter_ptr_->Forward(
+        current_ref_pose_data_.pose(0, 3),
+        current_ref_pose_data_.pose(1, 3),
+        current_ref_pose_data_.pose(2, 3),
+        ref_E, ref_N, ref_U
+    );
 
-    current_ref_pose_data_.pose(0,3) = ref_position.local_N;
-    current_ref_pose_data_.pose(1,3) = ref_position.local_E;
-    current_ref_pose_data_.pose(2,3) = ref_position.local_U;
+    current_ref_pose_data_.pose(0,3) = ref_N;
+    current_ref_pose_data_.pose(1,3) = ref_E;
+    current_ref_pose_data_.pose(2,3) = ref_U;
 
     return true;
 }
 
 bool ESKFPreprocessFlow::PublishData() {
     imu_pub_ptr_->Publish(current_imu_data_, current_imu_data_.time);
+    latency_tracer_ptr_->Publish();
     gnss_pose_pub_ptr_->Publish(gnss_pose_, current_velocity_data_, current_imu_data_.time);
     ref_pose_pub_ptr_->Publish(current_ref_pose_data_.pose, current_ref_pose_data_.vel, current_imu_data_.time);
 
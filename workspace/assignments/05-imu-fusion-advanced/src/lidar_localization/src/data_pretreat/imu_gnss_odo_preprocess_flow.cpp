@@ -4,6 +4,7 @@
  * @Date: 2020-11-21 15:39:24
  */
 #include "lidar_localization/data_pretreat/imu_gnss_odo_preprocess_flow.hpp"
+#include "lidar_localization/tools/tracer.hpp"
 
 #include "glog/logging.h"
 #include "lidar_localization/global_defination/global_defination.h"
@@ -28,9 +29,23 @@ IMUGNSSOdoPreprocessFlow::IMUGNSSOdoPreprocessFlow(
     pos_vel_pub_ptr_ = std::make_shared<PosVelPublisher>(nh, "/synced_pos_vel", "/map", "/imu_link", 100);
     gnss_pose_pub_ptr_ = std::make_shared<OdometryPublisher>(nh, "/synced_gnss_pose", "/map", "/imu_link", 100);
     ref_pose_pub_ptr_ = std::make_shared<OdometryPublisher>(nh, "/synced_reference_pose", "/map", "/imu_link", 100);
+
+    // metrics:
+    metrics_.AddQueue("imu_queue", [this]{ return imu_data_buff_.size(); });
+    metrics_.AddQueue("gnss_queue", [this]{ return gnss_data_buff_.size(); });
+    metrics_.AddQueue("odo_queue", [this]{ return odo_data_buff_.size(); });
+    metrics_.AddQueue("ref_pose_queue", [this]{ return ref_pose_data_buff_.size(); });
+    dropped_imu_ptr_ = &metrics_.AddCounter("dropped_imu");
+    dropped_gnss_ptr_ = &metrics_.AddCounter("dropped_gnss");
+    dropped_odo_ptr_ = &metrics_.AddCounter("dropped_odo");
+    dropped_ref_pose_ptr_ = &metrics_.AddCounter("dropped_ref_pose");
+    latency_tracer_ptr_ = std::make_shared<LatencyTracer>(nh, "imu_gnss_odo_preprocess", "", "/synced_pos_vel", metrics_);
 }
 
 bool IMUGNSSOdoPreprocessFlow::Run() {
+    TRACE_SCOPE("IMUGNSSOdoPreprocessFlow::Run", "flow");
+    metrics_.UpdateQueues();
+
     if (!ReadData())
         return false;
     
@@ -40,6 +55,8 @@ bool IMUGNSSOdoPreprocessFlow::Run() {
             continue;
         }
 
+        ScopedLatency latency(metrics_.GetLatency());
+        latency_tracer_ptr_->Start(current_imu_data_.time);
         TransformData();
         PublishData();
     }
@@ -50,7 +67,12 @@ bool IMUGNSSOdoPreprocessFlow::Run() {
 bool IMUGNSSOdoPreprocessFlow::ReadData() {
     // pipe sensor measurements into buffer:
     imu_sub_ptr_->ParseData(imu_data_buff_);
+    size_t num_gnss_data = gnss_data_buff_.size();
     gnss_sub_ptr_->ParseData(gnss_data_buff_);
+    // new fixes are converted in one batch, those before the origin by InitGNSS:
+    if (geo_converter_ptr_) {
+        geo_converter_ptr_->Forward(gnss_data_buff_.begin() + num_gnss_data, gnss_data_buff_.end());
+    }
     odo_sub_ptr_->ParseData(odo_data_buff_);
     ref_pose_sub_ptr_->ParseData(ref_pose_data_buff_);
 
@@ -58,12 +80,10 @@ bool IMUGNSSOdoPreprocessFlow::ReadData() {
 }
 
 bool IMUGNSSOdoPreprocessFlow::InitGNSS() {
-    static bool gnss_inited = false;
-
-    if ( !gnss_inited && !gnss_data_buff_.empty() ) {
-        GNSSData gnss_data = gnss_data_buff_.front();
-        gnss_data.InitOriginPosition();
-        gnss_inited = true;
+    if ( !geo_converter_ptr_ && !gnss_data_buff_.empty() ) {
+        const GNSSData& gnss_data = gnss_data_buff_.front();
+        geo_converter_ptr_ = std::make_shared<GeoConverter>(gnss_data.latitude, gnss_data.longitude, gnss_data.altitude);
+        geo_converter_ptr_->Forward(gnss_data_buff_.begin(), gnss_data_buff_.end());
 
         LOG(INFO) << "Init local map frame at: " 
                   << gnss_data.latitude << ", "
@@ -71,7 +91,7 @@ bool IMUGNSSOdoPreprocessFlow::InitGNSS() {
                   << gnss_data.altitude << std::endl;
     }
 
-    return gnss_inited;
+    return static_cast<bool>(geo_converter_ptr_);
 }
 
 bool IMUGNSSOdoPreprocessFlow::HasData() {
@@ -102,21 +122,25 @@ bool IMUGNSSOdoPreprocessFlow::ValidData() {
     //
     if ( diff_gnss_time < -0.005 || diff_odo_time < -0.005 || diff_ref_pose_time < -0.005 ) {
         imu_data_buff_.pop_front();
+        dropped_imu_ptr_->Increment();
         return false;
     }
 
     if (diff_gnss_time > 0.005) {
         gnss_data_buff_.pop_front();
+        dropped_gnss_ptr_->Increment();
         return false;
     }
 
     if (diff_odo_time > 0.005) {
         odo_data_buff_.pop_front();
+        dropped_odo_ptr_->Increment();
         return false;
     }
 
     if (diff_ref_pose_time > 0.005) {
         ref_pose_data_buff_.pop_front();
+        dropped_ref_pose_ptr_->Increment();
         return false;
     }
 
@@ -129,9 +153,7 @@ bool IMUGNSSOdoPreprocessFlow::ValidData() {
 }
 
 bool IMUGNSSOdoPreprocessFlow::TransformData() {
-    // a. get synced GNSS-odo measurement:
-    current_gnss_data_.UpdateXYZ();
-    
+    // a. get synced GNSS-odo measurement, already in local ENU:
     gnss_pose_ = Eigen::Matrix4f::Identity();
 
     gnss_pose_(0,3) = current_gnss_data_.local_N;
@@ -147,17 +169,18 @@ bool IMUGNSSOdoPreprocessFlow::TransformData() {
     pos_vel_.vel.z() = current_odo_data_.linear_velocity.z;
 
     // b. transform reference pose position from LLA to xyz:
-    GNSSData ref_position;
-
-    ref_position.latitude  = current_ref_pose_data_.pose(0, 3);
-    ref_position.longitude = current_ref_pose_data_.pose(1, 3);
-    ref_position.altitude  = current_ref_pose_data_.pose(2, 3);
+    double ref_E, ref_N, ref_U;
 
-    ref_position.UpdateXYZ();
+    geo_converter_ptr_->Forward(
+        current_ref_pose_data_.pose(0, 3),
+        current_ref_pose_data_.pose(1, 3),
+        current_ref_pose_data_.pose(2, 3),
+        ref_E, ref_N, ref_U
+    );
 
-    current_ref_pose_data_.pose(0,3) = ref_position.local_N;
-    current_ref_pose_data_.pose(1,3) = ref_position.local_E;
-    current_ref_pose_data_.pose(2,3) = ref_position.local_U;
+    current_ref_pose_data_.pose(0,3) = ref_N;
+    current_ref_pose_data_.pose(1,3) = ref_E;
+    current_ref_pose_data_.pose(2,3) = ref_U;
 
     return true;
 }
@@ -165,6 +188,7 @@ bool IMUGNSSOdoPreprocessFlow::TransformData() {
 bool IMUGNSSOdoPreprocessFlow::PublishData() {
     imu_pub_ptr_->Publish(current_imu_data_, current_imu_data_.time);
 
+    latency_tracer_ptr_->Publish();
     pos_vel_pub_ptr_->Publish(pos_vel_, current_imu_data_.time);
 
     gnss_pose_pub_ptr_->Publish(gnss_pose_, current_imu_data_.time);
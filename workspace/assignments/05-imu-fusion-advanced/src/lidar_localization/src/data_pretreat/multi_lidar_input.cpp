@@ -0,0 +1,128 @@
+/*
+ * @Description: secondary lidar sweeps & extrinsics, synced with the sweeps of the primary lidar
+ * @Author: Ge Yao
+ * @Date: 2020-12-30 11:05:18
+ */
+#include "lidar_localization/data_pretreat/multi_lidar_input.hpp"
+
+#include <cmath>
+#include <iostream>
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+MultiLidarInput::MultiLidarInput(
+    ros::NodeHandle& nh, const YAML::Node& node,
+    const std::string& imu_frame_id,
+    FlowMetrics& metrics
+) {
+    max_time_offset_ = node["max_time_offset"].as<double>();
+    max_wait_time_ = node["max_wait_time"].as<double>();
+
+    const YAML::Node& secondary_lidars_node = node["secondary_lidars"];
+    if (secondary_lidars_node.IsSequence()) {
+        sensors_.resize(secondary_lidars_node.size());
+        for (size_t i = 0; i < sensors_.size(); ++i) {
+            const YAML::Node& secondary_lidar_node = secondary_lidars_node[i];
+            Sensor& sensor = sensors_.at(i);
+
+            sensor.cloud_sub_ptr = std::make_shared<CloudSubscriber>(
+                nh, secondary_lidar_node["topic"].as<std::string>(), 100000
+            );
+            sensor.lidar_to_imu_ptr = std::make_shared<TFListener>(
+                nh, imu_frame_id, secondary_lidar_node["frame_id"].as<std::string>()
+            );
+
+            metrics.AddQueue(
+                "secondary_cloud_queue_" + std::to_string(i + 1),
+                [this, i]{ return sensors_.at(i).cloud_data_buff.size(); }
+            );
+        }
+    }
+    dropped_clouds_ptr_ = &metrics.AddCounter("dropped_secondary_clouds");
+    missing_clouds_ptr_ = &metrics.AddCounter("missing_secondary_clouds");
+
+    std::cout << "Multi-Lidar Input params:" << std::endl
+              << "\tnum. secondary lidars: " << sensors_.size() << std::endl
+              << "\tmax. time offset: " << max_time_offset_ << std::endl
+              << "\tmax. wait time: " << max_wait_time_ << std::endl
+              << std::endl;
+}
+
+void MultiLidarInput::ParseData(void) {
+    for (Sensor& sensor: sensors_) {
+        sensor.cloud_sub_ptr->ParseData(sensor.cloud_data_buff);
+    }
+}
+
+bool MultiLidarInput::InitCalibration(std::vector<std::shared_ptr<MultiLidarMerger>>& merger_ptrs) {
+    bool calibration_received = true;
+
+    for (size_t i = 0; i < sensors_.size(); ++i) {
+        Sensor& sensor = sensors_.at(i);
+        if (!sensor.calibration_received) {
+            if (sensor.lidar_to_imu_ptr->LookupData(sensor.lidar_to_imu)) {
+                for (std::shared_ptr<MultiLidarMerger>& merger_ptr: merger_ptrs) {
+                    merger_ptr->SetLidarToIMU(static_cast<int>(i) + 1, sensor.lidar_to_imu);
+                }
+                sensor.calibration_received = true;
+            }
+        }
+
+        calibration_received = calibration_received && sensor.calibration_received;
+    }
+
+    return calibration_received;
+}
+
+void MultiLidarInput::DropOldData(double time) {
+    for (Sensor& sensor: sensors_) {
+        while (
+            !sensor.cloud_data_buff.empty() &&
+            sensor.cloud_data_buff.front().time < time - max_time_offset_
+        ) {
+            sensor.cloud_data_buff.pop_front();
+            dropped_clouds_ptr_->Increment();
+        }
+    }
+}
+
+bool MultiLidarInput::HasData(double time, double latest_time) {
+    DropOldData(time);
+
+    // a secondary sweep may still arrive within the time offset:
+    if (latest_time - time >= max_wait_time_)
+        return true;
+
+    for (const Sensor& sensor: sensors_) {
+        if (sensor.cloud_data_buff.empty())
+            return false;
+    }
+
+    return true;
+}
+
+void MultiLidarInput::GetData(double time, std::vector<CloudData>& secondary_cloud_data) {
+    DropOldData(time);
+
+    secondary_cloud_data.resize(sensors_.size());
+    for (size_t i = 0; i < sensors_.size(); ++i) {
+        std::deque<CloudData>& cloud_data_buff = sensors_.at(i).cloud_data_buff;
+
+        // the closest one, the sweeps being at least one scan period apart:
+        if (
+            !cloud_data_buff.empty() &&
+            std::fabs(cloud_data_buff.front().time - time) <= max_time_offset_
+        ) {
+            secondary_cloud_data.at(i) = cloud_data_buff.front();
+            cloud_data_buff.pop_front();
+        } else {
+            secondary_cloud_data.at(i) = CloudData();
+            secondary_cloud_data.at(i).time = time;
+            missing_clouds_ptr_->Increment();
+        }
+    }
+}
+
+} // namespace lidar_localization
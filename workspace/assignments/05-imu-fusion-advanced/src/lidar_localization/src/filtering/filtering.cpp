@@ -5,16 +5,33 @@
  */
 #include "lidar_localization/filtering/filtering.hpp"
 
+#include <limits>
+#include <chrono>
+#include <algorithm>
+
 #include <pcl/common/transforms.h>
 #include <pcl/io/pcd_io.h>
 #include "glog/logging.h"
 
 #include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/cloud_pool.hpp"
+#include "lidar_localization/tools/task_scheduler.hpp"
 
 #include "lidar_localization/models/cloud_filter/no_filter.hpp"
 #include "lidar_localization/models/cloud_filter/voxel_filter.hpp"
+#include "lidar_localization/models/cloud_filter/voxel_filter_fast.hpp"
+#include "lidar_localization/models/cloud_filter/voxel_filter_adaptive.hpp"
+#include "lidar_localization/models/cloud_filter/filter_chain.hpp"
+#include "lidar_localization/models/cloud_filter/ground_filter.hpp"
 
 #include "lidar_localization/models/registration/ndt_registration.hpp"
+#include "lidar_localization/models/registration/ndt_omp_registration.hpp"
+#include "lidar_localization/models/registration/ndt_cuda_registration.hpp"
+#include "lidar_localization/models/registration/ndt_d2d_registration.hpp"
+#include "lidar_localization/models/registration/pyramid_registration.hpp"
+#include "lidar_localization/models/registration/vgicp_registration.hpp"
+#include "lidar_localization/models/registration/distance_field_registration.hpp"
+#include "lidar_localization/models/registration/async_registration.hpp"
 
 
 namespace lidar_localization {
@@ -28,20 +45,59 @@ Filtering::Filtering() :
     InitWithConfig();
 }
 
+Filtering::~Filtering() {
+    if (relocalizer_.joinable()) {
+        relocalizer_.join();
+    }
+    WaitUntilReady();
+}
+
+void Filtering::WaitUntilReady(void) {
+    if (map_loader_.joinable()) {
+        map_loader_.join();
+    }
+    if (index_loader_.joinable()) {
+        index_loader_.join();
+    }
+}
+
 bool Filtering::Init(
     const CloudData& init_scan,
     const Eigen::Vector3f &init_vel,
     const IMUData &init_imu_data
 ) {
-    if ( SetInitScan(init_scan) ) {
-        current_vel_ = init_vel;
+    // the scan context proposals are the only hypotheses:
+    if ( !IsMapReady() || !IsIndexReady() ) {
+        return false;
+    }
 
-        kalman_filter_ptr_->Init(
-            current_vel_.cast<double>(),
-            init_imu_data
-        );
-        
-        return true;
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> prior_poses;
+
+    if ( SetInitScan(init_scan, prior_poses) ) {
+        return InitKalmanFilter(init_vel, init_imu_data);
+    }
+
+    return false;
+}
+
+bool Filtering::Init(
+    const CloudData& init_scan,
+    const Eigen::Matrix4f& init_gnss_pose,
+    const Eigen::Vector3f &init_vel,
+    const IMUData &init_imu_data
+) {
+    // without the index, the GNSS pose is the only hypothesis:
+    if ( !IsMapReady() || (!IsIndexReady() && !use_gnss_for_relocalization_) ) {
+        return false;
+    }
+
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> prior_poses;
+    if (use_gnss_for_relocalization_) {
+        prior_poses.push_back(init_gnss_pose);
+    }
+
+    if ( SetInitScan(init_scan, prior_poses) ) {
+        return InitKalmanFilter(init_vel, init_imu_data);
     }
 
     return false;
@@ -52,23 +108,78 @@ bool Filtering::Init(
     const Eigen::Vector3f &init_vel,
     const IMUData &init_imu_data
 ) {
-    if ( SetInitGNSS(init_pose) ) {
-        current_vel_ = init_vel;
+    if ( !IsMapReady() ) {
+        return false;
+    }
 
-        kalman_filter_ptr_->Init(
-            current_vel_.cast<double>(),
-            init_imu_data
-        );
-        
-        return true;
+    if ( SetInitGNSS(init_pose) ) {
+        return InitKalmanFilter(init_vel, init_imu_data);
     }
 
     return false;
 }
 
+bool Filtering::Init(
+    const CloudData& init_scan,
+    const FilteringSnapshot& snapshot,
+    const IMUData &init_imu_data
+) {
+    if ( !IsMapReady() ) {
+        return false;
+    }
+
+    // the vehicle may have moved while the node was down, at the last velocity:
+    const float T = static_cast<float>(init_scan.time - snapshot.time);
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> hypotheses(1, snapshot.last_pose);
+    hypotheses.front().block<3, 1>(0, 3) += T * snapshot.vel;
+
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> init_poses;
+    if (
+        !Relocalize(init_scan, hypotheses, init_poses)
+    ) {
+        return false;
+    }
+    const Eigen::Matrix4f init_pose = init_poses.front();
+
+    // keep the odometry frame of the snapshot, so the filter state stays valid:
+    init_pose_ = snapshot.init_pose;
+
+    step_pose_ = snapshot.step_pose;
+    last_pose_ = init_pose;
+    predict_pose_ = last_pose_ * step_pose_;
+
+    // the local map of the snapshot, moved on with the next correction if needed:
+    ResetLocalMap(
+        snapshot.local_map_origin.x(),
+        snapshot.local_map_origin.y(),
+        snapshot.local_map_origin.z()
+    );
+
+    // the verified pose replaces the saved one, biases & covariance are kept:
+    ErrorStateKalmanFilter::State filter_state = snapshot.filter_state;
+    filter_state.pose = filter_state.init_pose * (init_pose_.inverse() * init_pose).cast<double>();
+    filter_state.vel = filter_state.init_pose.block<3, 3>(0, 0) * (
+        init_pose_.block<3, 3>(0, 0).transpose() * snapshot.vel
+    ).cast<double>();
+    kalman_filter_ptr_->Init(filter_state, init_imu_data);
+    kalman_filter_ptr_->GetOdometry(current_pose_, current_vel_);
+
+    has_inited_ = true;
+
+    return true;
+}
+
 bool Filtering::Update(
     const IMUData &imu_data
 ) {
+    if ( HasFilterBank() ) {
+        return kalman_filter_bank_ptr_->Update(imu_data) && GetBankOdometry();
+    }
+
+    for (const auto& shadow_filter_ptr: shadow_filter_ptrs_) {
+        shadow_filter_ptr->Update(imu_data);
+    }
+
     if ( kalman_filter_ptr_->Update(imu_data) ) {
         kalman_filter_ptr_->GetOdometry(
             current_pose_, current_vel_
@@ -84,54 +195,92 @@ bool Filtering::Correct(
     const CloudData& cloud_data, 
     Eigen::Matrix4f& cloud_pose
 ) {
-    static Eigen::Matrix4f step_pose = Eigen::Matrix4f::Identity();
-    static Eigen::Matrix4f last_pose = init_pose_;
-    static Eigen::Matrix4f predict_pose = init_pose_;
-
     // remove invalid measurements:
+    const size_t num_points = cloud_data.cloud_ptr->points.size();
     std::vector<int> indices;
     pcl::removeNaNFromPointCloud(*cloud_data.cloud_ptr, *cloud_data.cloud_ptr, indices);
 
-    // downsample:
-    CloudData::CLOUD_PTR filtered_cloud_ptr(new CloudData::CLOUD());
-    current_scan_filter_ptr_->Filter(cloud_data.cloud_ptr, filtered_cloud_ptr);
+    // downsample, into a cloud of the filter's choice. the range image from ingest holds if no point was removed:
+    CloudData::CLOUD_PTR filtered_cloud_ptr;
+    if (cloud_data.range_image_ptr && indices.size() == num_points) {
+        current_scan_filter_ptr_->Filter(cloud_data, filtered_cloud_ptr);
+    } else {
+        current_scan_filter_ptr_->Filter(cloud_data.cloud_ptr, filtered_cloud_ptr);
+    }
+    if (load_level_ > 0) {
+        CloudData::CLOUD_PTR degraded_cloud_ptr;
+        load_scan_filter_ptrs_.at(load_level_ - 1)->Filter(filtered_cloud_ptr, degraded_cloud_ptr);
+        filtered_cloud_ptr = degraded_cloud_ptr;
+    }
 
     if (!has_inited_) {
-        predict_pose = current_gnss_pose_;
+        predict_pose_ = current_gnss_pose_;
+    }
+
+    // each init pose hypothesis is matched against its own local map:
+    if ( HasFilterBank() ) {
+        return CorrectBank(imu_data, cloud_data, filtered_cloud_ptr, cloud_pose);
+    }
+
+    // residuals are built at the filter prior, no separate scan matching:
+    if ( use_tightly_coupled_ ) {
+        return CorrectTightlyCoupled(imu_data, cloud_data, filtered_cloud_ptr, cloud_pose);
+    }
+
+    // a relocalization done in the background moves the prediction onto the verified pose:
+    if ( tracking_monitor_ptr_ ) {
+        ApplyRelocalization();
     }
 
     // matching:
-    CloudData::CLOUD_PTR result_cloud_ptr(new CloudData::CLOUD());
-    registration_ptr_->ScanMatch(filtered_cloud_ptr, predict_pose, result_cloud_ptr, cloud_pose);
+    CloudData::CLOUD_PTR result_cloud_ptr = CloudPool::GetInstance().Get();
+    registration_ptr_->ScanMatch(filtered_cloud_ptr, predict_pose_, result_cloud_ptr, cloud_pose);
     pcl::transformPointCloud(*cloud_data.cloud_ptr, *current_scan_ptr_, cloud_pose);
 
+    // a degraded match is not fused, the filter goes on with IMU prediction & scan matching at the last motion:
+    if ( tracking_monitor_ptr_ && !CheckTracking(cloud_data, filtered_cloud_ptr, cloud_pose) ) {
+        last_pose_ = predict_pose_;
+        predict_pose_ = last_pose_ * step_pose_;
+
+        if ( IsNearLocalMapEdge(last_pose_, local_map_segmenter_ptr_->GetEdge()) ) {
+            ResetLocalMap(
+                last_pose_(0,3), 
+                last_pose_(1,3), 
+                last_pose_(2,3)
+            );
+        }
+
+        return false;
+    }
+
+    PrefetchLocalMap(cloud_pose, cloud_pose.block<3, 1>(0, 3) - last_pose_.block<3, 1>(0, 3));
+
     // update predicted pose:
-    step_pose = last_pose.inverse() * cloud_pose;
-    predict_pose = cloud_pose * step_pose;
-    last_pose = cloud_pose;
+    step_pose_ = last_pose_.inverse() * cloud_pose;
+    predict_pose_ = cloud_pose * step_pose_;
+    last_pose_ = cloud_pose;
 
     // shall the local map be updated:
-    std::vector<float> edge = local_map_segmenter_ptr_->GetEdge();
-    for (int i = 0; i < 3; i++) {
-        if (
-            fabs(cloud_pose(i, 3) - edge.at(2 * i)) > 50.0 &&
-            fabs(cloud_pose(i, 3) - edge.at(2 * i + 1)) > 50.0
-        ) {
-            continue;
-        }
-            
+    if ( IsNearLocalMapEdge(cloud_pose, local_map_segmenter_ptr_->GetEdge()) ) {
         ResetLocalMap(
             cloud_pose(0,3), 
             cloud_pose(1,3), 
             cloud_pose(2,3)
         );
-        break;
     }
 
     // set lidar measurement:
     current_measurement_.time = cloud_data.time;
     current_measurement_.T_nb = (init_pose_.inverse() * cloud_pose).cast<double>();
 
+    if ( is_resuming_tracking_ ) {
+        return ResumeTracking(imu_data, cloud_pose);
+    }
+
+    for (const auto& shadow_filter_ptr: shadow_filter_ptrs_) {
+        shadow_filter_ptr->Correct(imu_data, current_measurement_.time, current_measurement_.T_nb);
+    }
+
     // Kalman correction:
     if (
         kalman_filter_ptr_->Correct(
@@ -148,9 +297,30 @@ bool Filtering::Correct(
     return false;
 }
 
+void Filtering::SetGNSSPose(const Eigen::Matrix4f& gnss_pose) {
+    current_gnss_pose_ = gnss_pose;
+    has_gnss_pose_ = true;
+}
+
+void Filtering::SampleShadowFilters(void) {
+    for (const auto& shadow_filter_ptr: shadow_filter_ptrs_) {
+        shadow_filter_ptr->Sample(init_pose_);
+    }
+}
+
 void Filtering::GetGlobalMap(CloudData::CLOUD_PTR& global_map) {
     // downsample global map for visualization:
-    global_map_filter_ptr_->Filter(global_map_ptr_, global_map);
+    if (lod_map_ptr_) {
+        // the coarse level is the display map as is:
+        global_map.reset(new CloudData::CLOUD(*lod_map_ptr_->GetMap(global_map_level_)));
+    } else if (tiled_map_ptr_) {
+        // only the tiles loaded so far:
+        CloudData::CLOUD_PTR cached_map_ptr;
+        tiled_map_ptr_->GetCachedMap(cached_map_ptr);
+        global_map_filter_ptr_->Filter(cached_map_ptr, global_map);
+    } else {
+        global_map_filter_ptr_->Filter(global_map_ptr_, global_map);
+    }
     has_new_global_map_ = false;
 }
 
@@ -159,6 +329,57 @@ void Filtering::GetOdometry(Eigen::Matrix4f &pose, Eigen::Vector3f &vel) {
     vel = init_pose_.block<3, 3>(0, 0) * current_vel_;
 }
 
+bool Filtering::GetNavState(imu_mechanization::NavState& nav_state) {
+    if (!has_inited_) {
+        return false;
+    }
+
+    ErrorStateKalmanFilter::State filter_state;
+    if ( HasFilterBank() ) {
+        kalman_filter_bank_ptr_->GetState(kalman_filter_bank_ptr_->GetBestHypothesis(), filter_state);
+    } else {
+        kalman_filter_ptr_->GetState(filter_state);
+    }
+
+    Eigen::Matrix4f pose;
+    Eigen::Vector3f vel;
+    GetOdometry(pose, vel);
+
+    // rotation from the filter navigation frame to map frame:
+    const Eigen::Matrix3d R_mn = (
+        init_pose_.block<3, 3>(0, 0).cast<double>() * 
+        filter_state.init_pose.block<3, 3>(0, 0).transpose()
+    );
+
+    nav_state.time = filter_state.time;
+    nav_state.pose = pose.cast<double>();
+    nav_state.vel = vel.cast<double>();
+    nav_state.gyro_bias = filter_state.gyro_bias;
+    nav_state.accl_bias = filter_state.accl_bias;
+    nav_state.g = R_mn * kalman_filter_ptr_->GetGravity();
+    nav_state.w = R_mn * kalman_filter_ptr_->GetEarthRotation();
+
+    return true;
+}
+
+bool Filtering::GetSnapshot(FilteringSnapshot& snapshot) {
+    if (!has_inited_ || HasFilterBank()) {
+        return false;
+    }
+
+    snapshot.time = current_measurement_.time;
+
+    snapshot.init_pose = init_pose_;
+    snapshot.last_pose = last_pose_;
+    snapshot.step_pose = step_pose_;
+    snapshot.vel = init_pose_.block<3, 3>(0, 0) * current_vel_;
+    snapshot.local_map_origin = local_map_origin_;
+
+    kalman_filter_ptr_->GetState(snapshot.filter_state);
+
+    return true;
+}
+
 bool Filtering::InitWithConfig(void) {
     std::string config_file_path = WORK_SPACE_PATH + "/config/filtering/filtering.yaml";
 
@@ -168,23 +389,70 @@ bool Filtering::InitWithConfig(void) {
               << "-----------------Init IMU-Lidar Fusion for Localization-------------------" 
               << std::endl;
     
-    // a. init filters:
+    // the global map & the scan context index are loaded in the background, while the rest is set up:
+    const bool async_init = config_node["async_init"] ? config_node["async_init"].as<bool>() : false;
+    std::cout << "\tAsync Init: " << (async_init ? "true" : "false") << std::endl;
+
+    // a. init filters, the local map filter is used by the map loader:
     InitFilters(config_node);
-    // b. init map:
-    InitGlobalMap(config_node);
+    // b. init map, from a copy of the config as YAML nodes are not thread-safe:
+    const YAML::Node map_config_node = YAML::Clone(config_node);
+    StartLoader(
+        "Global map", [this, map_config_node]() { InitGlobalMap(map_config_node); }, async_init,
+        map_loader_, is_map_ready_
+    );
     // c. init scan context manager:
-    InitScanContextManager(config_node);
+    InitScanContextManager(config_node, async_init);
     // d. init frontend:
     InitRegistration(registration_ptr_, config_node);
+    // the next target is built on a worker thread while scans are matched against the current one:
+    if (
+        config_node["async_registration_target"].as<bool>() && 
+        !registration_ptr_->HasIncrementalTarget()
+    ) {
+        std::shared_ptr<RegistrationInterface> next_registration_ptr;
+        InitRegistration(next_registration_ptr, config_node);
+        registration_ptr_ = std::make_shared<AsyncRegistration>(registration_ptr_, next_registration_ptr);
+    }
     // e. init fusion:
     InitFusion(config_node);
+    if ( use_tightly_coupled_ && !registration_ptr_->HasLinearization() ) {
+        LOG(ERROR) << "Registration method " << config_node["registration_method"].as<std::string>() 
+                   << " has no residual model. Fall back to loosely-coupled fusion.";
+        use_tightly_coupled_ = false;
+    }
+    // f. init relocalization:
+    InitRelocalization(config_node);
+    // g. init load shedding:
+    InitLoadShedding(config_node);
 
-    // init local map for frontend matching:
-    ResetLocalMap(0.0, 0.0, 0.0);
+    // the local map for frontend matching is built at the init pose, once the map is ready.
 
     return true;
 }
 
+void Filtering::StartLoader(
+    const std::string& name, const std::function<void(void)>& load, bool async_init,
+    std::thread& loader, std::atomic<bool>& is_ready
+) {
+    auto run = [name, load, &is_ready]() {
+        const auto begin_time = std::chrono::steady_clock::now();
+        load();
+        // a failed load is ready too, the Init calls then fail as without async_init:
+        is_ready = true;
+
+        LOG(INFO) << name << " ready in " 
+                  << std::chrono::duration<double>(std::chrono::steady_clock::now() - begin_time).count() 
+                  << " s." << std::endl;
+    };
+
+    if (async_init) {
+        loader = std::thread(run);
+    } else {
+        run();
+    }
+}
+
 bool Filtering::InitFilter(
     std::string filter_user, 
     std::shared_ptr<CloudFilterInterface>& filter_ptr, 
@@ -196,6 +464,14 @@ bool Filtering::InitFilter(
 
     if (filter_mothod == "voxel_filter") {
         filter_ptr = std::make_shared<VoxelFilter>(config_node[filter_mothod][filter_user]);
+    } else if (filter_mothod == "voxel_filter_fast") {
+        filter_ptr = std::make_shared<FastVoxelFilter>(config_node[filter_mothod][filter_user]);
+    } else if (filter_mothod == "voxel_filter_adaptive") {
+        filter_ptr = std::make_shared<AdaptiveVoxelFilter>(config_node[filter_mothod][filter_user]);
+    } else if (filter_mothod == "filter_chain") {
+        filter_ptr = std::make_shared<FilterChain>(config_node[filter_mothod][filter_user]);
+    } else if (filter_mothod == "ground_filter") {
+        filter_ptr = std::make_shared<GroundFilter>(config_node[filter_mothod][filter_user]);
     } else if (filter_mothod == "no_filter") {
         filter_ptr = std::make_shared<NoFilter>();
     } else {
@@ -208,6 +484,7 @@ bool Filtering::InitFilter(
 
 bool Filtering::InitLocalMapSegmenter(const YAML::Node& config_node) {
     local_map_segmenter_ptr_ = std::make_shared<BoxFilter>(config_node);
+    local_map_box_ = config_node["box_filter_size"].as<std::vector<float>>();
     return true;
 }
 
@@ -224,6 +501,65 @@ bool Filtering::InitFilters(const YAML::Node& config_node) {
 }
 
 bool Filtering::InitGlobalMap(const YAML::Node& config_node) {
+    std::string map_format = config_node["map_format"].as<std::string>();
+    std::cout << "\tGlobal Map Format: " << map_format << std::endl;
+
+    if (map_format == "tiled") {
+        // tiles are filtered when the tiled map is built:
+        const YAML::Node& tiled_map_node = config_node["tiled_map"];
+        const bool is_mapped = (
+            tiled_map_node["storage"] && tiled_map_node["storage"].as<std::string>() == "mapped"
+        );
+        MappedTileStore::HugePages huge_pages = MappedTileStore::HugePages::NONE;
+        if (
+            is_mapped && tiled_map_node["huge_pages"] && 
+            !MappedTileStore::GetHugePages(tiled_map_node["huge_pages"].as<std::string>(), huge_pages)
+        ) {
+            LOG(ERROR) << "Huge pages " << tiled_map_node["huge_pages"].as<std::string>() << " NOT FOUND!";
+            return false;
+        }
+        tiled_map_ptr_ = std::make_shared<TiledMap>(
+            tiled_map_node["tiles_path"].as<std::string>(), 
+            static_cast<size_t>(std::max(tiled_map_node["cache_size"].as<int>(), 1)),
+            is_mapped, huge_pages
+        );
+        prefetch_distance_ = tiled_map_node["prefetch_distance"].as<float>();
+        will_need_distance_ = tiled_map_node["will_need_distance"] ? tiled_map_node["will_need_distance"].as<float>() : 0.0f;
+
+        if (!tiled_map_ptr_->IsValid()) {
+            LOG(ERROR) << "Tiled map is not available, run build_tiled_map_node first.";
+            return false;
+        }
+
+        return true;
+    } else if (map_format == "lod") {
+        // levels are voxel filtered when the LOD map is built:
+        const YAML::Node& lod_map_node = config_node["lod_map"];
+        lod_map_ptr_ = std::make_shared<LODMap>(
+            lod_map_node["lod_path"].as<std::string>(), 
+            config_node["local_map_grid_size"].as<float>()
+        );
+
+        if (!lod_map_ptr_->IsValid()) {
+            LOG(ERROR) << "LOD map is not available, save map with lod_map in viewer.yaml or run build_tiled_map_node first.";
+            return false;
+        }
+
+        global_map_level_ = lod_map_ptr_->GetLevel(lod_map_node["global_map_resolution"].as<float>());
+        local_map_level_ = lod_map_ptr_->GetLevel(lod_map_node["local_map_resolution"].as<float>());
+        relocalization_map_level_ = lod_map_ptr_->GetLevel(lod_map_node["relocalization_resolution"].as<float>());
+        std::cout << "\tLOD Map Leaf Sizes: global map " << lod_map_ptr_->GetLeafSize(global_map_level_)
+                  << ", local map " << lod_map_ptr_->GetLeafSize(local_map_level_)
+                  << ", relocalization " << lod_map_ptr_->GetLeafSize(relocalization_map_level_) << std::endl;
+
+        has_new_global_map_ = true;
+
+        return true;
+    } else if (map_format != "pcd") {
+        LOG(ERROR) << "Global map format " << map_format << " NOT FOUND!";
+        return false;
+    }
+
     map_path_ = config_node["map_path"].as<std::string>();
 
     pcl::io::loadPCDFile(map_path_, *global_map_ptr_);
@@ -233,12 +569,15 @@ bool Filtering::InitGlobalMap(const YAML::Node& config_node) {
     local_map_filter_ptr_->Filter(global_map_ptr_, global_map_ptr_);
     LOG(INFO) << "Filtered global map, size:" << global_map_ptr_->points.size();
 
+    // bucket once, so each local map only visits the cells around it:
+    grid_map_ptr_ = std::make_shared<GridMap>(global_map_ptr_, config_node["local_map_grid_size"].as<float>());
+
     has_new_global_map_ = true;
 
     return true;
 }
 
-bool Filtering::InitScanContextManager(const YAML::Node& config_node) {
+bool Filtering::InitScanContextManager(const YAML::Node& config_node, bool async_init) {
     // get loop closure config:
     loop_closure_method_ = config_node["loop_closure_method"].as<std::string>();
 
@@ -247,7 +586,10 @@ bool Filtering::InitScanContextManager(const YAML::Node& config_node) {
 
     // load pre-built index:
     scan_context_path_ = config_node["scan_context_path"].as<std::string>();
-    scan_context_manager_ptr_->Load(scan_context_path_);
+    StartLoader(
+        "Scan context index", [this]() { scan_context_manager_ptr_->Load(scan_context_path_); }, async_init,
+        index_loader_, is_index_ready_
+    );
 
     return true;
 }
@@ -262,6 +604,29 @@ bool Filtering::InitRegistration(
 
     if (registration_method == "NDT") {
         registration_ptr = std::make_shared<NDTRegistration>(config_node[registration_method]);
+    } else if (registration_method == "NDT_OMP") {
+        registration_ptr = std::make_shared<NDTOMPRegistration>(config_node[registration_method]);
+    } else if (registration_method == "NDT_D2D") {
+        registration_ptr = std::make_shared<NDTD2DRegistration>(config_node[registration_method]);
+    } else if (registration_method == "NDT_CUDA") {
+        // same parameters as NDT_OMP, so it falls back without a GPU:
+#ifdef LIDAR_LOCALIZATION_WITH_CUDA
+        if (NDTCUDARegistration::IsAvailable()) {
+            registration_ptr = std::make_shared<NDTCUDARegistration>(config_node[registration_method]);
+        } else {
+            LOG(WARNING) << "No CUDA device available. Fall back to NDT_OMP.";
+            registration_ptr = std::make_shared<NDTOMPRegistration>(config_node[registration_method]);
+        }
+#else
+        LOG(WARNING) << "Built without CUDA. Fall back to NDT_OMP.";
+        registration_ptr = std::make_shared<NDTOMPRegistration>(config_node[registration_method]);
+#endif
+    } else if (registration_method == "PYRAMID") {
+        registration_ptr = std::make_shared<PyramidRegistration>(config_node[registration_method]);
+    } else if (registration_method == "VGICP") {
+        registration_ptr = std::make_shared<VGICPRegistration>(config_node[registration_method]);
+    } else if (registration_method == "DISTANCE_FIELD") {
+        registration_ptr = std::make_shared<DistanceFieldRegistration>(config_node[registration_method]);
     } else {
         LOG(ERROR) << "Registration method " << registration_method << " NOT FOUND!";
         return false;
@@ -277,46 +642,336 @@ bool Filtering::InitFusion(const YAML::Node& config_node) {
 
     if (fusion_method == "kalman_filter") {
         kalman_filter_ptr_ = std::make_shared<ErrorStateKalmanFilter>(config_node[fusion_method]);
+        kalman_filter_bank_ptr_ = std::make_shared<ErrorStateKalmanFilterBank>(config_node[fusion_method]);
     } else {
         LOG(ERROR) << "Fusion method " << fusion_method << " NOT FOUND!";
         return false;
     }
 
+    const YAML::Node& tightly_coupled_node = config_node["tightly_coupled"];
+    use_tightly_coupled_ = tightly_coupled_node && tightly_coupled_node["enabled"].as<bool>();
+    if (use_tightly_coupled_) {
+        tightly_coupled_max_iter_ = tightly_coupled_node["max_iter"].as<int>();
+        tightly_coupled_eps_ = tightly_coupled_node["eps"].as<double>();
+        tightly_coupled_min_num_residuals_ = tightly_coupled_node["min_num_residuals"].as<int>();
+        point_to_plane_noise_ = tightly_coupled_node["point_to_plane_noise"].as<double>();
+
+        std::cout << "\tTightly-Coupled: max. " << tightly_coupled_max_iter_ << " iterations, "
+                  << "point-to-plane noise " << point_to_plane_noise_ << std::endl;
+    }
+
+    return true;
+}
+
+bool Filtering::InitRelocalization(const YAML::Node& config_node) {
+    const YAML::Node& relocalization_node = config_node["relocalization"];
+
+    num_relocalization_candidates_ = std::max(relocalization_node["num_candidates"].as<int>(), 1);
+    use_gnss_for_relocalization_ = relocalization_node["use_gnss"].as<bool>();
+    relocalization_fitness_score_limit_ = relocalization_node["fitness_score_limit"].as<float>();
+
+    std::cout << "\tNum. Relocalization Candidates: " << num_relocalization_candidates_ 
+              << (use_gnss_for_relocalization_ ? " + GNSS" : "") << std::endl;
+
+    relocalization_registration_ptrs_.resize(
+        num_relocalization_candidates_ + (use_gnss_for_relocalization_ ? 1 : 0)
+    );
+    for (auto &registration_ptr: relocalization_registration_ptrs_) {
+        if (!InitRegistration(registration_ptr, relocalization_node)) {
+            return false;
+        }
+    }
+
+    // the filter bank tracks one hypothesis per coarse registration instance:
+    const YAML::Node& filter_bank_node = relocalization_node["filter_bank"];
+    use_filter_bank_ = filter_bank_node && filter_bank_node["enabled"].as<bool>();
+    if (use_filter_bank_) {
+        max_num_bank_hypotheses_ = std::min(
+            filter_bank_node["max_num_hypotheses"].as<int>(), 
+            static_cast<int>(relocalization_registration_ptrs_.size())
+        );
+        bank_min_separation_ = filter_bank_node["min_separation"].as<float>();
+        bank_prune_log_likelihood_ = filter_bank_node["prune_log_likelihood"].as<double>();
+        max_num_bank_corrections_ = filter_bank_node["max_num_corrections"].as<int>();
+
+        std::cout << "\tFilter Bank: max. " << max_num_bank_hypotheses_ << " hypotheses, "
+                  << max_num_bank_corrections_ << " corrections" << std::endl;
+    }
+
+    // tracking recovery, once tracking with a single hypothesis & loosely-coupled fusion:
+    const YAML::Node& tracking_monitor_node = relocalization_node["tracking_monitor"];
+    if (tracking_monitor_node && tracking_monitor_node["enabled"].as<bool>()) {
+        tracking_monitor_ptr_ = std::make_shared<TrackingMonitor>(tracking_monitor_node);
+        relocalization_gate_radius_ = tracking_monitor_node["gate_radius"].as<float>();
+
+        std::cout << "\tRelocalization Gate Radius: " << relocalization_gate_radius_ << std::endl;
+    }
+
+    return true;
+}
+
+bool Filtering::InitLoadShedding(const YAML::Node& config_node) {
+    const YAML::Node& load_shedding_node = config_node["load_shedding"];
+
+    load_scan_filter_ptrs_.clear();
+    load_max_iters_.clear();
+    if (!load_shedding_node || !load_shedding_node["enabled"].as<bool>())
+        return true;
+
+    const std::vector<float> leaf_sizes = load_shedding_node["leaf_sizes"].as<std::vector<float>>();
+    const std::vector<int> max_iters = load_shedding_node["max_iters"].as<std::vector<int>>();
+    if (leaf_sizes.size() != max_iters.size()) {
+        LOG(ERROR) << "Load shedding has " << leaf_sizes.size() << " leaf sizes but "
+                   << max_iters.size() << " max. iterations!";
+        return false;
+    }
+
+    for (size_t i = 0; i < leaf_sizes.size(); ++i) {
+        load_scan_filter_ptrs_.push_back(
+            std::make_shared<FastVoxelFilter>(
+                leaf_sizes.at(i), leaf_sizes.at(i), leaf_sizes.at(i), FastVoxelFilter::CENTROID
+            )
+        );
+        load_max_iters_.push_back(max_iters.at(i));
+
+        std::cout << "\tLoad Level " << i + 1 << ": scan leaf size " << leaf_sizes.at(i)
+                  << ", max. iterations " << max_iters.at(i) << std::endl;
+    }
+
+    return true;
+}
+
+bool Filtering::InitKalmanFilter(const Eigen::Vector3f &init_vel, const IMUData &init_imu_data) {
+    current_vel_ = init_vel;
+
+    kalman_filter_ptr_->Init(
+        current_vel_.cast<double>(),
+        init_imu_data
+    );
+
+    if ( HasFilterBank() ) {
+        kalman_filter_bank_ptr_->Init(
+            static_cast<int>(bank_hypotheses_.size()), 
+            current_vel_.cast<double>(), 
+            init_imu_data
+        );
+    } else if ( !use_tightly_coupled_ ) {
+        // the shadows share the odometry frame of the Kalman filter, set by the init IMU measurement:
+        for (const auto& shadow_filter_ptr: shadow_filter_ptrs_) {
+            shadow_filter_ptr->Init(current_vel_, init_imu_data);
+        }
+    }
+
+    return true;
+}
+
+bool Filtering::SetLoadLevel(int load_level) {
+    if (load_level < 0 || load_level > GetNumLoadLevels()) {
+        LOG(WARNING) << "Load level " << load_level << " out of range [0, " << GetNumLoadLevels() << "].";
+        return false;
+    }
+
+    load_level_ = load_level;
+    registration_ptr_->SetMaxIterationLimit(load_level_ > 0 ? load_max_iters_.at(load_level_ - 1) : -1);
+
+    return true;
+}
+
+bool Filtering::PrefetchLocalMap(const Eigen::Matrix4f& pose, const Eigen::Vector3f& motion) {
+    if (!tiled_map_ptr_)
+        return false;
+
+    const float distance = motion.head<2>().norm();
+    if (distance < 1.0e-3f)
+        return false;
+
+    // the local map box, moved prefetch_distance ahead along the direction of travel:
+    Eigen::Vector3f ahead = pose.block<3, 1>(0, 3);
+    ahead.head<2>() += prefetch_distance_ / distance * motion.head<2>();
+
+    std::vector<float> edge = local_map_segmenter_ptr_->GetEdge();
+    for (int i = 0; i < 3; ++i) {
+        edge.at(2 * i) += ahead(i) - local_map_origin_(i);
+        edge.at(2 * i + 1) += ahead(i) - local_map_origin_(i);
+    }
+    tiled_map_ptr_->Prefetch(edge);
+
+    // further along the direction of travel, only hinted, so a change of course costs nothing:
+    if (will_need_distance_ > 0.0f) {
+        const float step = will_need_distance_ / distance;
+        for (int i = 0; i < 2; ++i) {
+            edge.at(2 * i) += step * motion(i);
+            edge.at(2 * i + 1) += step * motion(i);
+        }
+        tiled_map_ptr_->WillNeed(edge);
+    }
+
     return true;
 }
 
 /**
  * @brief  get init pose using scan context matching
  * @param  init_scan, init key scan
+ * @param  prior_poses, init pose hypotheses besides scan context proposals, e.g. GNSS
  * @return true if success otherwise false
  */
-bool Filtering::SetInitScan(const CloudData& init_scan) {
-    // get init pose proposal using scan context match:
-    Eigen::Matrix4f init_pose =  Eigen::Matrix4f::Identity();
+bool Filtering::SetInitScan(
+    const CloudData& init_scan, 
+    const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& prior_poses
+) {
+    // get init pose hypotheses, scan context proposals best first, then the priors:
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> hypotheses;
+    if ( IsIndexReady() ) {
+        scan_context_manager_ptr_->DetectLoopClosure(init_scan, num_relocalization_candidates_, hypotheses);
+    } else {
+        LOG(INFO) << "Scan context index not ready, verify the prior poses only." << std::endl;
+    }
+    hypotheses.insert(hypotheses.end(), prior_poses.begin(), prior_poses.end());
+
+    // verify them all within this scan:
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> init_poses;
     if (
-        !scan_context_manager_ptr_->DetectLoopClosure(init_scan, init_pose)
+        !Relocalize(init_scan, hypotheses, init_poses)
     ) {
         return false;
     }
 
-    // set init pose:
-    SetInitPose(init_pose);
+    // set init pose, the best one until the filter bank resolves the ambiguity:
+    SetInitPose(init_poses.front());
+    SetBankHypotheses(init_poses);
     has_inited_ = true;
     
     return true;
 }
 
-bool Filtering::SetInitGNSS(const Eigen::Matrix4f& gnss_pose) {
-    static int gnss_cnt = 0;
+/**
+ * @brief  verify init pose hypotheses using coarse scan-map matching
+ * @param  init_scan, init key scan
+ * @param  hypotheses, init pose hypotheses
+ * @param  init_poses, refined poses of the hypotheses within fitness limit, best first. 
+ *         those closer than the filter bank min. separation to a better one are dropped
+ * @return true if the best hypothesis is within fitness limit otherwise false
+ */
+bool Filtering::Relocalize(
+    const CloudData& init_scan, 
+    const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& hypotheses,
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& init_poses
+) {
+    if (hypotheses.empty()) {
+        return false;
+    }
+
+    // downsampled scan, shared by all hypotheses:
+    CloudData::CLOUD_PTR scan_ptr(new CloudData::CLOUD());
+    std::vector<int> indices;
+    pcl::removeNaNFromPointCloud(*init_scan.cloud_ptr, *scan_ptr, indices);
+    current_scan_filter_ptr_->Filter(scan_ptr, scan_ptr);
+
+    return Relocalize(scan_ptr, hypotheses, init_poses);
+}
+
+/**
+ * @brief  verify pose hypotheses using coarse scan-map matching, e.g. on the relocalizer thread
+ * @param  scan_ptr, filtered scan
+ * @param  hypotheses, pose hypotheses
+ * @param  init_poses, refined poses of the hypotheses within fitness limit, best first
+ * @return true if the best hypothesis is within fitness limit otherwise false
+ */
+bool Filtering::Relocalize(
+    const CloudData::CLOUD_PTR& scan_ptr, 
+    const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& hypotheses,
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& init_poses
+) {
+    const int N = std::min(
+        static_cast<int>(hypotheses.size()), 
+        static_cast<int>(relocalization_registration_ptrs_.size())
+    );
+    if (0 == N) {
+        return false;
+    }
+
+    // local maps, built in order as the map cache is not thread-safe:
+    std::vector<CloudData::CLOUD_PTR> map_ptrs(N);
+    for (int i = 0; i < N; ++i) {
+        BuildLocalMap(GetLocalMapEdge(hypotheses.at(i)), relocalization_map_level_, map_ptrs.at(i));
+    }
+
+    // coarse matching, each hypothesis with its own registration instance:
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> result_poses(
+        N, Eigen::Matrix4f::Identity()
+    );
+    std::vector<float> fitness_scores(N, std::numeric_limits<float>::max());
+    TaskScheduler::GetInstance().ParallelFor(
+        0, N, 1,
+        [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                if (map_ptrs.at(i)->points.empty())
+                    continue;
+
+                const std::shared_ptr<RegistrationInterface>& registration_ptr = relocalization_registration_ptrs_.at(i);
+                CloudData::CLOUD_PTR result_cloud_ptr(new CloudData::CLOUD());
+                registration_ptr->SetInputTarget(map_ptrs.at(i));
+                if (registration_ptr->ScanMatch(scan_ptr, hypotheses.at(i), result_cloud_ptr, result_poses.at(i))) {
+                    // from the last iteration, no extra nearest neighbor search for backends that support it:
+                    fitness_scores.at(i) = registration_ptr->GetResult().fitness_score;
+                }
+            }
+        },
+        TaskScheduler::REALTIME
+    );
+
+    std::vector<int> order(N);
+    for (int i = 0; i < N; ++i) {
+        order.at(i) = i;
+    }
+    std::stable_sort(
+        order.begin(), order.end(),
+        [&](int a, int b) { return fitness_scores.at(a) < fitness_scores.at(b); }
+    );
 
+    const int best_index = order.front();
+    if (fitness_scores.at(best_index) > relocalization_fitness_score_limit_) {
+        LOG(WARNING) << "Relocalization failed, best fitness score " << fitness_scores.at(best_index) 
+                     << " of " << N << " hypotheses, retry with next scan." << std::endl;
+        return false;
+    }
+
+    // hypotheses converged to the same pose are kept once:
+    init_poses.clear();
+    for (const int i: order) {
+        if (fitness_scores.at(i) > relocalization_fitness_score_limit_)
+            break;
+
+        bool is_separated = true;
+        for (const Eigen::Matrix4f& init_pose: init_poses) {
+            if ((init_pose.block<3, 1>(0, 3) - result_poses.at(i).block<3, 1>(0, 3)).norm() < bank_min_separation_) {
+                is_separated = false;
+                break;
+            }
+        }
+
+        if (is_separated)
+            init_poses.push_back(result_poses.at(i));
+    }
+
+    LOG(INFO) << std::endl
+              << "[Relocalization] Hypothesis " << best_index + 1 << " of " << N << std::endl
+              << "\tFitness Score " << fitness_scores.at(best_index) << std::endl
+              << "\tPoses Within Limit " << init_poses.size() << std::endl
+              << std::endl;
+
+    return true;
+}
+
+bool Filtering::SetInitGNSS(const Eigen::Matrix4f& gnss_pose) {
     current_gnss_pose_ = gnss_pose;
 
-    if (gnss_cnt == 0) {
+    if (gnss_cnt_ == 0) {
         SetInitPose(gnss_pose);
-    } else if (gnss_cnt > 3) {
+    } else if (gnss_cnt_ > 3) {
         has_inited_ = true;
     }
-    gnss_cnt++;
+    gnss_cnt_++;
 
     return true;
 }
@@ -324,6 +979,9 @@ bool Filtering::SetInitGNSS(const Eigen::Matrix4f& gnss_pose) {
 bool Filtering::SetInitPose(const Eigen::Matrix4f& init_pose) {
     init_pose_ = init_pose;
 
+    step_pose_ = Eigen::Matrix4f::Identity();
+    last_pose_ = predict_pose_ = init_pose;
+
     ResetLocalMap(
         init_pose(0,3), 
         init_pose(1,3), 
@@ -333,6 +991,447 @@ bool Filtering::SetInitPose(const Eigen::Matrix4f& init_pose) {
     return true;
 }
 
+/**
+ * @brief  track the init poses with the filter bank, one hypothesis each, if there is more than one
+ * @param  init_poses, init poses best first, as of relocalization
+ * @return true if the filter bank is used otherwise false
+ */
+bool Filtering::SetBankHypotheses(
+    const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& init_poses
+) {
+    bank_hypotheses_.clear();
+    num_bank_corrections_ = 0;
+
+    const int N = std::min(static_cast<int>(init_poses.size()), max_num_bank_hypotheses_);
+    if (!use_filter_bank_ || N < 2) {
+        return false;
+    }
+
+    bank_hypotheses_.resize(N);
+    for (int h = 0; h < N; ++h) {
+        BankHypothesis& hypothesis = bank_hypotheses_.at(h);
+
+        hypothesis.init_pose = init_poses.at(h);
+        hypothesis.last_pose = hypothesis.predict_pose = init_poses.at(h);
+
+        ResetBankLocalMap(h, init_poses.at(h)(0, 3), init_poses.at(h)(1, 3), init_poses.at(h)(2, 3));
+    }
+
+    LOG(INFO) << "[Filter Bank] Tracking " << N << " init pose hypotheses." << std::endl;
+
+    return true;
+}
+
+/**
+ * @brief  scan matching & Kalman correction of each init pose hypothesis, the unlikely ones are pruned
+ * @param  imu_data, IMU measurement at scan time
+ * @param  cloud_data, scan
+ * @param  filtered_cloud_ptr, downsampled scan
+ * @param  cloud_pose, scan matching pose of the best hypothesis
+ * @return true if any hypothesis is left otherwise false
+ */
+bool Filtering::CorrectBank(
+    const IMUData &imu_data,
+    const CloudData& cloud_data, 
+    const CloudData::CLOUD_PTR& filtered_cloud_ptr,
+    Eigen::Matrix4f& cloud_pose
+) {
+    const int N = static_cast<int>(bank_hypotheses_.size());
+
+    // a. local maps, moved on in order as the map cache is not thread-safe:
+    for (int h = 0; h < N; ++h) {
+        if (!kalman_filter_bank_ptr_->IsActive(h))
+            continue;
+
+        const BankHypothesis& hypothesis = bank_hypotheses_.at(h);
+        std::vector<float> origin = {
+            hypothesis.local_map_origin.x(), 
+            hypothesis.local_map_origin.y(), 
+            hypothesis.local_map_origin.z()
+        };
+        local_map_segmenter_ptr_->SetOrigin(origin);
+        if ( IsNearLocalMapEdge(hypothesis.predict_pose, local_map_segmenter_ptr_->GetEdge()) ) {
+            ResetBankLocalMap(
+                h, 
+                hypothesis.predict_pose(0, 3), 
+                hypothesis.predict_pose(1, 3), 
+                hypothesis.predict_pose(2, 3)
+            );
+        }
+    }
+
+    // b. matching, each hypothesis with its own registration instance:
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> result_poses(
+        N, Eigen::Matrix4f::Identity()
+    );
+    std::vector<float> fitness_scores(N, std::numeric_limits<float>::max());
+    TaskScheduler::GetInstance().ParallelFor(
+        0, N, 1,
+        [&](int begin, int end) {
+            for (int h = begin; h < end; ++h) {
+                if (
+                    !kalman_filter_bank_ptr_->IsActive(h) || 
+                    bank_hypotheses_.at(h).local_map_ptr->points.empty()
+                ) {
+                    continue;
+                }
+
+                const std::shared_ptr<RegistrationInterface>& registration_ptr = relocalization_registration_ptrs_.at(h);
+                CloudData::CLOUD_PTR result_cloud_ptr(new CloudData::CLOUD());
+                if (
+                    registration_ptr->ScanMatch(
+                        filtered_cloud_ptr, bank_hypotheses_.at(h).predict_pose, 
+                        result_cloud_ptr, result_poses.at(h)
+                    )
+                ) {
+                    fitness_scores.at(h) = registration_ptr->GetResult().fitness_score;
+                }
+            }
+        },
+        TaskScheduler::REALTIME
+    );
+
+    // c. Kalman correction, the hypotheses lost by scan matching are rejected:
+    for (int h = 0; h < N; ++h) {
+        if (!kalman_filter_bank_ptr_->IsActive(h))
+            continue;
+
+        if (fitness_scores.at(h) > relocalization_fitness_score_limit_) {
+            kalman_filter_bank_ptr_->Reject(h);
+            continue;
+        }
+
+        // update predicted pose:
+        BankHypothesis& hypothesis = bank_hypotheses_.at(h);
+        hypothesis.step_pose = hypothesis.last_pose.inverse() * result_poses.at(h);
+        hypothesis.predict_pose = result_poses.at(h) * hypothesis.step_pose;
+        hypothesis.last_pose = result_poses.at(h);
+
+        // set lidar measurement:
+        current_measurement_.time = cloud_data.time;
+        current_measurement_.T_nb = (hypothesis.init_pose.inverse() * result_poses.at(h)).cast<double>();
+
+        kalman_filter_bank_ptr_->Correct(h, imu_data, current_measurement_);
+    }
+
+    // d. prune by likelihood:
+    const int num_hypotheses = kalman_filter_bank_ptr_->Prune(bank_prune_log_likelihood_);
+    ++num_bank_corrections_;
+
+    if (0 == num_hypotheses) {
+        LOG(WARNING) << "[Filter Bank] All " << N << " init pose hypotheses lost, retry with next scan." << std::endl;
+
+        bank_hypotheses_.clear();
+        has_inited_ = false;
+
+        return false;
+    }
+
+    const int best = kalman_filter_bank_ptr_->GetBestHypothesis();
+    cloud_pose = bank_hypotheses_.at(best).last_pose;
+    pcl::transformPointCloud(*cloud_data.cloud_ptr, *current_scan_ptr_, cloud_pose);
+
+    // e. the filter takes over once the ambiguity is resolved:
+    if (1 == num_hypotheses || num_bank_corrections_ >= max_num_bank_corrections_) {
+        return HandOverBank(best, imu_data);
+    }
+
+    // the local map of the best hypothesis is shown meanwhile:
+    if (local_map_ptr_ != bank_hypotheses_.at(best).local_map_ptr) {
+        local_map_ptr_ = bank_hypotheses_.at(best).local_map_ptr;
+        has_new_local_map_ = true;
+    }
+
+    return GetBankOdometry();
+}
+
+bool Filtering::HandOverBank(const int hypothesis, const IMUData &imu_data) {
+    ErrorStateKalmanFilter::State filter_state;
+    if (!kalman_filter_bank_ptr_->GetState(hypothesis, filter_state)) {
+        return false;
+    }
+
+    LOG(INFO) << std::endl
+              << "[Filter Bank] Hypothesis " << hypothesis + 1 << " of " << bank_hypotheses_.size() << std::endl
+              << "\tCorrections " << num_bank_corrections_ << std::endl
+              << "\tLog Likelihood " << kalman_filter_bank_ptr_->GetLogLikelihood(hypothesis) << std::endl
+              << std::endl;
+
+    const BankHypothesis resolved = bank_hypotheses_.at(hypothesis);
+    bank_hypotheses_.clear();
+
+    // odometry frame, scan matching prediction & filter state of the hypothesis:
+    init_pose_ = resolved.init_pose;
+
+    step_pose_ = resolved.step_pose;
+    last_pose_ = resolved.last_pose;
+    predict_pose_ = resolved.predict_pose;
+
+    kalman_filter_ptr_->Init(filter_state, imu_data);
+    kalman_filter_ptr_->GetOdometry(current_pose_, current_vel_);
+
+    // full resolution local map for the frontend:
+    ResetLocalMap(
+        last_pose_(0,3), 
+        last_pose_(1,3), 
+        last_pose_(2,3)
+    );
+
+    return true;
+}
+
+bool Filtering::GetBankOdometry(void) {
+    const int best = kalman_filter_bank_ptr_->GetBestHypothesis();
+    if (best < 0) {
+        return false;
+    }
+
+    init_pose_ = bank_hypotheses_.at(best).init_pose;
+
+    return kalman_filter_bank_ptr_->GetOdometry(best, current_pose_, current_vel_);
+}
+
+bool Filtering::CheckTracking(
+    const CloudData& cloud_data, 
+    const CloudData::CLOUD_PTR& filtered_cloud_ptr,
+    const Eigen::Matrix4f& cloud_pose
+) {
+    const TrackingMonitor::State state = tracking_monitor_ptr_->Update(registration_ptr_->GetResult());
+
+    if ( TrackingMonitor::State::HEALTHY == state ) {
+        last_healthy_pose_ = cloud_pose;
+    } else if ( TrackingMonitor::State::LOST == state ) {
+        StartRelocalization(cloud_data, filtered_cloud_ptr);
+    }
+
+    // the GNSS pose is of this scan only:
+    has_gnss_pose_ = false;
+
+    return TrackingMonitor::State::HEALTHY == state;
+}
+
+bool Filtering::StartRelocalization(const CloudData& cloud_data, const CloudData::CLOUD_PTR& filtered_cloud_ptr) {
+    if ( relocalizer_.joinable() ) {
+        return false;
+    }
+
+    // the GNSS pose is a hypothesis as for init, & the center of the gated region if available:
+    const bool use_gnss = use_gnss_for_relocalization_ && has_gnss_pose_;
+    if ( !IsIndexReady() && !use_gnss ) {
+        return false;
+    }
+
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> prior_poses;
+    if ( use_gnss ) {
+        prior_poses.push_back(current_gnss_pose_);
+    }
+    const Eigen::Vector2f center = (has_gnss_pose_ ? current_gnss_pose_ : last_healthy_pose_).block<2, 1>(0, 3);
+
+    LOG(WARNING) << "Tracking lost after " << tracking_monitor_ptr_->GetNumDegradedFrames() << " degraded matches, "
+                 << "relocalize within " << relocalization_gate_radius_ << " m of the "
+                 << (has_gnss_pose_ ? "GNSS" : "last healthy") << " pose." << std::endl;
+
+    // copies, the scans of the flow are reused:
+    CloudData scan;
+    scan.time = cloud_data.time;
+    *scan.cloud_ptr = *cloud_data.cloud_ptr;
+    CloudData::CLOUD_PTR scan_ptr(new CloudData::CLOUD(*filtered_cloud_ptr));
+
+    relocalization_scan_pose_ = predict_pose_;
+    is_relocalization_done_ = false;
+    relocalizer_ = std::thread(
+        [this, scan, scan_ptr, prior_poses, center]() {
+            // scan context proposals among the key frames of the gated region, then the priors:
+            std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> hypotheses;
+            if ( IsIndexReady() ) {
+                scan_context_manager_ptr_->DetectLoopClosure(
+                    scan, num_relocalization_candidates_,
+                    [this, &center](int key_frame_id) {
+                        const Eigen::Matrix4f& pose = scan_context_manager_ptr_->GetKeyFrame(key_frame_id).pose;
+                        return (pose.block<2, 1>(0, 3) - center).norm() <= relocalization_gate_radius_;
+                    },
+                    hypotheses
+                );
+            }
+            hypotheses.insert(hypotheses.end(), prior_poses.begin(), prior_poses.end());
+
+            is_relocalized_ = Relocalize(scan_ptr, hypotheses, relocalized_poses_);
+            is_relocalization_done_ = true;
+        }
+    );
+
+    return true;
+}
+
+bool Filtering::ApplyRelocalization(void) {
+    if ( !relocalizer_.joinable() || !is_relocalization_done_.load() ) {
+        return false;
+    }
+    relocalizer_.join();
+
+    if ( TrackingMonitor::State::HEALTHY == tracking_monitor_ptr_->GetState() ) {
+        LOG(INFO) << "Tracking recovered during relocalization, the relocalized pose is dropped." << std::endl;
+        return false;
+    }
+    // still lost, the next degraded match starts another one:
+    if ( !is_relocalized_ ) {
+        return false;
+    }
+
+    // the scan matching track moved on since the relocalized scan, the motion is carried over:
+    const Eigen::Matrix4f correction = relocalized_poses_.front() * relocalization_scan_pose_.inverse();
+    last_pose_ = correction * last_pose_;
+    predict_pose_ = last_pose_ * step_pose_;
+
+    ResetLocalMap(
+        predict_pose_(0,3), 
+        predict_pose_(1,3), 
+        predict_pose_(2,3)
+    );
+
+    LOG(INFO) << std::endl
+              << "[Tracking] Relocalized" << std::endl
+              << "\tCorrection " << correction.block<3, 1>(0, 3).norm() << " m" << std::endl
+              << std::endl;
+
+    tracking_monitor_ptr_->Reset();
+    is_resuming_tracking_ = true;
+
+    return true;
+}
+
+bool Filtering::ResumeTracking(const IMUData &imu_data, const Eigen::Matrix4f& cloud_pose) {
+    is_resuming_tracking_ = false;
+
+    // the matched pose replaces the one dead reckoned while lost, as for warm restart:
+    ErrorStateKalmanFilter::State filter_state;
+    kalman_filter_ptr_->GetState(filter_state);
+    filter_state.pose = filter_state.init_pose * (init_pose_.inverse() * cloud_pose).cast<double>();
+    kalman_filter_ptr_->Init(filter_state, imu_data);
+    kalman_filter_ptr_->GetOdometry(current_pose_, current_vel_);
+
+    return true;
+}
+
+bool Filtering::CorrectTightlyCoupled(
+    const IMUData &imu_data,
+    const CloudData& cloud_data, 
+    const CloudData::CLOUD_PTR& filtered_cloud_ptr,
+    Eigen::Matrix4f& cloud_pose
+) {
+    typedef Eigen::Matrix<double, 6, 1> Vector6d;
+    typedef Eigen::Matrix<double, 6, 6> Matrix6d;
+
+    const Eigen::Matrix4d init_pose = init_pose_.cast<double>();
+    const Eigen::Matrix3d R_init = init_pose.block<3, 3>(0, 0);
+    const double info = 1.0 / (point_to_plane_noise_ * point_to_plane_noise_);
+
+    // residuals are in map frame, w.r.t. the left perturbation of the registration:
+    auto linearize = [&](const Eigen::Matrix4d &T_nb, Matrix6d &H, Vector6d &b) {
+        const Eigen::Matrix4d pose = init_pose * T_nb;
+
+        Matrix6d H_map;
+        Vector6d b_map;
+        const int num_residuals = registration_ptr_->Linearize(filtered_cloud_ptr, pose, H_map, b_map);
+        if (num_residuals <= 0) {
+            return num_residuals;
+        }
+
+        // perturbation [delta_t, delta_theta] of T_nb to the left perturbation of pose:
+        const Eigen::Vector3d t = pose.block<3, 1>(0, 3);
+        Eigen::Matrix3d t_hat;
+        t_hat <<    0.0, -t.z(),  t.y(),
+                  t.z(),    0.0, -t.x(),
+                 -t.y(),  t.x(),    0.0;
+        Matrix6d G = Matrix6d::Zero();
+        G.block<3, 3>(0, 0) = R_init;
+        G.block<3, 3>(0, 3) = t_hat * R_init;
+        G.block<3, 3>(3, 3) = R_init;
+
+        // the registration solves H*delta = b, i.e., its b is -J^T*r:
+        H = info * G.transpose() * H_map * G;
+        b = -info * G.transpose() * b_map;
+
+        return num_residuals;
+    };
+
+    const int max_iter = (
+        load_level_ > 0 ? 
+        std::min(tightly_coupled_max_iter_, load_max_iters_.at(load_level_ - 1)) : 
+        tightly_coupled_max_iter_
+    );
+    const bool is_corrected = kalman_filter_ptr_->CorrectIterated(
+        imu_data, cloud_data.time,
+        max_iter, tightly_coupled_eps_, tightly_coupled_min_num_residuals_,
+        linearize
+    );
+
+    // the prediction stands in for the scan pose if the scan could not be used:
+    kalman_filter_ptr_->GetOdometry(current_pose_, current_vel_);
+    cloud_pose = init_pose_ * current_pose_;
+    pcl::transformPointCloud(*cloud_data.cloud_ptr, *current_scan_ptr_, cloud_pose);
+
+    PrefetchLocalMap(cloud_pose, cloud_pose.block<3, 1>(0, 3) - last_pose_.block<3, 1>(0, 3));
+
+    step_pose_ = last_pose_.inverse() * cloud_pose;
+    predict_pose_ = cloud_pose * step_pose_;
+    last_pose_ = cloud_pose;
+
+    // shall the local map be updated:
+    if ( IsNearLocalMapEdge(cloud_pose, local_map_segmenter_ptr_->GetEdge()) ) {
+        ResetLocalMap(
+            cloud_pose(0,3), 
+            cloud_pose(1,3), 
+            cloud_pose(2,3)
+        );
+    }
+
+    if ( is_corrected ) {
+        current_measurement_.time = cloud_data.time;
+        current_measurement_.T_nb = current_pose_.cast<double>();
+    }
+
+    return is_corrected;
+}
+
+bool Filtering::ResetBankLocalMap(const int hypothesis, float x, float y, float z) {
+    BankHypothesis& bank_hypothesis = bank_hypotheses_.at(hypothesis);
+
+    std::vector<float> origin = {x, y, z};
+    local_map_segmenter_ptr_->SetOrigin(origin);
+    bank_hypothesis.local_map_origin = Eigen::Vector3f(x, y, z);
+
+    BuildLocalMap(local_map_segmenter_ptr_->GetEdge(), relocalization_map_level_, bank_hypothesis.local_map_ptr);
+    relocalization_registration_ptrs_.at(hypothesis)->SetInputTarget(bank_hypothesis.local_map_ptr);
+
+    return true;
+}
+
+bool Filtering::IsNearLocalMapEdge(const Eigen::Matrix4f& pose, const std::vector<float>& edge) const {
+    for (int i = 0; i < 3; i++) {
+        if (
+            fabs(pose(i, 3) - edge.at(2 * i)) > 50.0 &&
+            fabs(pose(i, 3) - edge.at(2 * i + 1)) > 50.0
+        ) {
+            continue;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+std::vector<float> Filtering::GetLocalMapEdge(const Eigen::Matrix4f& pose) const {
+    std::vector<float> edge = local_map_box_;
+    for (int i = 0; i < 3; ++i) {
+        edge.at(2 * i) += pose(i, 3);
+        edge.at(2 * i + 1) += pose(i, 3);
+    }
+
+    return edge;
+}
+
 bool Filtering::ResetLocalMap(
     float x, 
     float y, 
@@ -342,13 +1441,41 @@ bool Filtering::ResetLocalMap(
 
     // segment local map from global map:
     local_map_segmenter_ptr_->SetOrigin(origin);
-    local_map_segmenter_ptr_->Filter(global_map_ptr_, local_map_ptr_);
+    local_map_origin_ = Eigen::Vector3f(x, y, z);
 
+    BuildLocalMap(local_map_segmenter_ptr_->GetEdge(), local_map_level_, local_map_ptr_);
     registration_ptr_->SetInputTarget(local_map_ptr_);
 
+    // new tiles may have been loaded:
+    if (tiled_map_ptr_) {
+        has_new_global_map_ = true;
+    }
     has_new_local_map_ = true;
 
-    std::vector<float> edge = local_map_segmenter_ptr_->GetEdge();
+    return true;
+}
+
+bool Filtering::BuildLocalMap(const std::vector<float>& edge, int lod_level, CloudData::CLOUD_PTR& local_map_ptr) {
+    if (lod_map_ptr_) {
+        lod_map_ptr_->GetMap(lod_level, edge, local_map_ptr);
+    } else if (tiled_map_ptr_) {
+        // only the tiles around the new origin are loaded:
+        CloudData::CLOUD_PTR tiles_ptr;
+        tiled_map_ptr_->GetMap(edge, tiles_ptr);
+        local_map_ptr.reset(new CloudData::CLOUD());
+        GridMap::Crop(*tiles_ptr, edge, *local_map_ptr);
+
+        TiledMap::Stats stats = tiled_map_ptr_->GetStats();
+        LOG(INFO) << "Tiled map: " 
+                  << stats.num_hits << " hits, " 
+                  << stats.num_misses << " misses, "
+                  << stats.num_prefetched << " prefetched, "
+                  << stats.num_tiles << " tiles in cache" << std::endl;
+    } else if (grid_map_ptr_) {
+        grid_map_ptr_->GetMap(edge, local_map_ptr);
+    } else {
+        local_map_ptr.reset(new CloudData::CLOUD());
+    }
 
     LOG(INFO) << "New local map:" 
               << edge.at(0) << ","
@@ -356,7 +1483,8 @@ bool Filtering::ResetLocalMap(
               << edge.at(2) << ","
               << edge.at(3) << ","
               << edge.at(4) << ","
-              << edge.at(5) << std::endl << std::endl;
+              << edge.at(5) << ", "
+              << "size: " << local_map_ptr->points.size() << std::endl << std::endl;
 
     return true;
 }
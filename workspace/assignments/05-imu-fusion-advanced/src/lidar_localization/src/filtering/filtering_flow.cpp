@@ -5,17 +5,36 @@
  */
 
 #include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/offline_replay.hpp"
 
 #include "lidar_localization/filtering/filtering_flow.hpp"
 
 #include "lidar_localization/tools/file_manager.hpp"
 
 #include "glog/logging.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <ostream>
 
 
 namespace lidar_localization {
 
+namespace {
+// the given params replace those of node, maps are merged key by key:
+void MergeParams(const YAML::Node& params, YAML::Node node) {
+    for (const auto& param: params) {
+        const std::string key = param.first.as<std::string>();
+        if ( param.second.IsMap() && node[key] && node[key].IsMap() ) {
+            MergeParams(param.second, node[key]);
+        } else {
+            node[key] = YAML::Clone(param.second);
+        }
+    }
+}
+}
+
 FilteringFlow::FilteringFlow(
     ros::NodeHandle& nh
 ) {
@@ -46,10 +65,99 @@ FilteringFlow::FilteringFlow(
     // f. tf:
     laser_tf_pub_ptr_ = std::make_shared<TFBroadCaster>("/map", "/vehicle_link");
 
+    // the map & the scan context index may still be loading, measurements are taken meanwhile:
     filtering_ptr_ = std::make_shared<Filtering>();
+    // offline no scan may be skipped for it, so the results are reproducible:
+    if (OfflineReplay::GetInstance().IsEnabled()) {
+        filtering_ptr_->WaitUntilReady();
+    }
+
+    // metrics:
+    metrics_.AddQueue("imu_raw_queue", [this]{ return imu_raw_stream_ptr_->buffer.size(); });
+    metrics_.AddQueue("cloud_queue", [this]{ return cloud_data_buff_.size(); });
+    metrics_.AddQueue("lidar_queue", [this]{ return lidar_stream_ptr_->buffer.size(); });
+    metrics_.AddQueue("imu_synced_queue", [this]{ return imu_synced_data_buff_.size(); });
+    metrics_.AddQueue("gnss_queue", [this]{ return gnss_data_buff_.size(); });
+    update_latency_ptr_ = &metrics_.AddLatency("update_latency");
+    dropped_clouds_ptr_ = &metrics_.AddCounter("dropped_clouds");
+    dropped_imu_synced_ptr_ = &metrics_.AddCounter("dropped_imu_synced");
+    dropped_imu_raw_ptr_ = &metrics_.AddCounter("dropped_imu_raw");
+    failed_corrections_ptr_ = &metrics_.AddCounter("failed_corrections");
+    unready_clouds_ptr_ = &metrics_.AddCounter("unready_clouds");
+    latency_tracer_ptr_ = std::make_shared<LatencyTracer>(nh, "filtering", "/synced_cloud", "/fused_localization", metrics_);
+
+    YAML::Node config_node = YAML::LoadFile(WORK_SPACE_PATH + "/config/filtering/filtering.yaml");
+
+    // measurement streams, lidar measurements behind the IMU updates are rolled back by the filter:
+    const YAML::Node& scheduler_node = config_node["measurement_scheduler"];
+    imu_raw_stream_ptr_ = &scheduler_.AddStream<IMUData>(
+        "imu_raw",
+        scheduler_node["imu_raw_max_wait"] ? scheduler_node["imu_raw_max_wait"].as<double>() : 0.02,
+        [this](const IMUData& imu_raw_data) { OnIMUData(imu_raw_data); }
+    );
+    // the filter is updated at the output rate, independent of the IMU rate:
+    const YAML::Node& imu_decimation_node = config_node["imu_decimation"];
+    if (imu_decimation_node && imu_decimation_node["enable"].as<bool>()) {
+        imu_decimator_ptr_ = std::make_shared<IMUDecimator>(imu_decimation_node);
+    }
+    lidar_stream_ptr_ = &scheduler_.AddStream<LidarData>(
+        "lidar",
+        scheduler_node["lidar_max_wait"] ? scheduler_node["lidar_max_wait"].as<double>() : 0.0,
+        [this](const LidarData& lidar_data) { OnLidarData(lidar_data); }
+    );
+
+    // processing time is wall clock, so load shedding is off in offline replay for reproducible results:
+    YAML::Node load_shedding_node = YAML::Clone(config_node["load_shedding"]);
+    if (OfflineReplay::GetInstance().IsEnabled()) {
+        load_shedding_node["enabled"] = false;
+    }
+    deadline_policy_ptr_ = std::make_shared<DeadlinePolicy>(
+        load_shedding_node, filtering_ptr_->GetNumLoadLevels(), metrics_
+    );
+
+    // the snapshot left by the last run is not part of the replayed data, so warm restart is off in offline replay too:
+    const YAML::Node& warm_restart_node = config_node["warm_restart"];
+    is_warm_restart_enabled_ = (
+        warm_restart_node["enabled"].as<bool>() && 
+        !OfflineReplay::GetInstance().IsEnabled() &&
+        FileManager::CreateDirectory(WORK_SPACE_PATH + "/slam_data")
+    );
+    snapshot_interval_ = warm_restart_node["snapshot_interval"].as<double>();
+    snapshot_max_age_ = warm_restart_node["max_age"].as<double>();
+    snapshot_path_ = WORK_SPACE_PATH + "/slam_data/filtering_snapshot.bin";
+    snapshot_ptr_.reset(new FilteringSnapshot());
+    has_snapshot_ = is_warm_restart_enabled_ && snapshot_ptr_->Load(snapshot_path_);
+
+    // trajectory for evo evaluation, a crash keeps what was recorded so far:
+    trajectory.path_ = WORK_SPACE_PATH + "/slam_data/trajectory";
+    if (
+        FileManager::CreateDirectory(WORK_SPACE_PATH + "/slam_data") &&
+        FileManager::CreateDirectory(trajectory.path_, "Filtering Trajectory")
+    ) {
+        trajectory.fused_ = std::make_shared<TrajectoryLog>(trajectory.path_ + "/fused.bin");
+        trajectory.lidar_ = std::make_shared<TrajectoryLog>(trajectory.path_ + "/laser.bin");
+        trajectory.ref_ = std::make_shared<TrajectoryLog>(trajectory.path_ + "/ground_truth.bin");
+
+        InitShadowFilters(config_node);
+    }
+
+    // offline the flow never waits for the replayed measurements, so there is no IMU-rate output either:
+    const YAML::Node& imu_rate_output_node = config_node["imu_rate_output"];
+    if ( 
+        imu_rate_output_node["enabled"].as<bool>() && 
+        !OfflineReplay::GetInstance().IsEnabled() 
+    ) {
+        imu_pose_predictor_ptr_ = std::make_shared<ImuPosePredictor>(
+            nh, imu_rate_output_node, 
+            "/kitti/oxts/imu/extract", "/fused_localization_imu_rate", "/map", "/lidar"
+        );
+    }
 }
 
 bool FilteringFlow::Run() {
+    TRACE_SCOPE("FilteringFlow::Run", "flow");
+    metrics_.UpdateQueues();
+
     if ( !InitCalibration() ) {
         return false;
     }
@@ -61,43 +169,72 @@ bool FilteringFlow::Run() {
 
     ReadData();
 
-    while( HasData() ) {
-        if ( !HasInited() ) {
-            if ( ValidLidarData() ) {
-                InitLocalization();
-            }
-        } else {
-            // TODO: handle timestamp chaos in an more elegant way
-            if (  HasLidarData() && ValidLidarData() ) {
-                if ( HasIMUData() ) {
-                    while (
-                        HasIMUData() && ValidIMUData() && 
-                        current_imu_raw_data_.time < current_cloud_data_.time
-                    ) {
-                        UpdateLocalization();
-                    }
-
-                    if (
-                        current_imu_raw_data_.time >= current_cloud_data_.time
-                    ) {
-                        imu_raw_data_buff_.push_back(current_imu_raw_data_);
-                    }
-                }
-
-                CorrectLocalization();
-            }
+    // IMU updates & lidar corrections in time order:
+    scheduler_.Dispatch();
 
-            if ( HasIMUData() && ValidIMUData() ) {
-                UpdateLocalization();
-            }
+    return true;
+}
+
+bool FilteringFlow::InitShadowFilters(const YAML::Node& config_node) {
+    const YAML::Node& shadow_filters_node = config_node["shadow_filters"];
+    if ( !shadow_filters_node || !shadow_filters_node["filters"] ) {
+        return false;
+    }
+
+    const size_t max_queue_size = shadow_filters_node["max_queue_size"].as<size_t>();
+    for (const YAML::Node& shadow_node: shadow_filters_node["filters"]) {
+        // the params of the primary filter, except those given:
+        YAML::Node filter_node = YAML::Clone(config_node["kalman_filter"]);
+        if ( shadow_node["params"] ) {
+            MergeParams(shadow_node["params"], filter_node);
         }
+
+        const std::string name = shadow_node["name"].as<std::string>();
+        shadow_filter_ptrs_.push_back(
+            std::make_shared<ShadowFilter>(
+                name,
+                shadow_node["fusion_method"].as<std::string>(), filter_node,
+                trajectory.path_ + "/shadow_" + name + ".bin", max_queue_size,
+                metrics_
+            )
+        );
     }
 
+    filtering_ptr_->SetShadowFilters(shadow_filter_ptrs_);
+
     return true;
 }
 
 bool FilteringFlow::SaveOdometry(void) {
+    BackgroundJobs::Job job = GetSaveOdometryJob();
+    return job && job([](double progress, const std::string& message) {});
+}
+
+BackgroundJobs::Job FilteringFlow::GetSaveOdometryJob(void) {
     if ( 0 == trajectory.N ) {
+        return nullptr;
+    }
+
+    // poses recorded while the job runs are logged, but not saved:
+    const size_t N = trajectory.N;
+    return [this, N](const BackgroundJobs::Progress& progress) {
+        return SaveOdometry(N, progress);
+    };
+}
+
+bool FilteringFlow::SaveOdometry(const size_t N, const BackgroundJobs::Progress& progress) {
+    // export the logs once every recorded pose is on disk:
+    progress(0.0, "trajectory logs");
+    trajectory.fused_->Flush();
+    trajectory.lidar_->Flush();
+    trajectory.ref_->Flush();
+
+    std::deque<Eigen::Matrix4f> fused_poses, lidar_poses, ref_poses;
+    if (
+        !TrajectoryLog::Load(trajectory.path_ + "/fused.bin", fused_poses) ||
+        !TrajectoryLog::Load(trajectory.path_ + "/laser.bin", lidar_poses) ||
+        !TrajectoryLog::Load(trajectory.path_ + "/ground_truth.bin", ref_poses)
+    ) {
         return false;
     }
 
@@ -106,39 +243,62 @@ bool FilteringFlow::SaveOdometry(void) {
     std::ofstream laser_odom_ofs;
     std::ofstream ref_odom_ofs;
     if (
-        !FileManager::CreateFile(fused_odom_ofs, WORK_SPACE_PATH + "/slam_data/trajectory/fused.txt") ||
-        !FileManager::CreateFile(laser_odom_ofs, WORK_SPACE_PATH + "/slam_data/trajectory/laser.txt") ||
-        !FileManager::CreateFile(ref_odom_ofs, WORK_SPACE_PATH + "/slam_data/trajectory/ground_truth.txt")
+        !FileManager::CreateFile(fused_odom_ofs, trajectory.path_ + "/fused.txt") ||
+        !FileManager::CreateFile(laser_odom_ofs, trajectory.path_ + "/laser.txt") ||
+        !FileManager::CreateFile(ref_odom_ofs, trajectory.path_ + "/ground_truth.txt")
     ) {
         return false;
     }
 
-    // write outputs:
-    for (size_t i = 0; i < trajectory.N; ++i) {
-        // sync ref pose with gnss measurement:
-        while (
-            !gnss_data_buff_.empty() && 
-            (gnss_data_buff_.front().time - trajectory.time_.at(i) <= -0.05)
-        ) {
-            gnss_data_buff_.pop_front();
-        }
-    
-        if ( gnss_data_buff_.empty() ) {
-            break;
+    // write outputs, a failed write leaves the logs of different lengths:
+    progress(0.4, "KITTI export");
+    const size_t num_poses = std::min(N, std::min(fused_poses.size(), std::min(lidar_poses.size(), ref_poses.size())));
+    for (size_t i = 0; i < num_poses; ++i) {
+        const Eigen::Vector3f &position_ref = ref_poses.at(i).block<3, 1>(0, 3);
+        const Eigen::Vector3f &position_lidar = lidar_poses.at(i).block<3, 1>(0, 3);
+
+        if ( (position_ref - position_lidar).norm() > 3.0 ) {
+            continue;
         }
-        
-        current_gnss_data_ = gnss_data_buff_.front();
 
-        const Eigen::Vector3f &position_ref = current_gnss_data_.pose.block<3, 1>(0, 3);
-        const Eigen::Vector3f &position_lidar = trajectory.lidar_.at(i).block<3, 1>(0, 3);
+        SavePose(fused_poses.at(i), fused_odom_ofs);
+        SavePose(lidar_poses.at(i), laser_odom_ofs);
+        SavePose(ref_poses.at(i), ref_odom_ofs);
+    }
 
-        if ( (position_ref - position_lidar).norm() > 3.0 ) {
+    // the shadow poses of the same indices, a stopped shadow stops short:
+    progress(0.8, "shadow filters");
+    for (const auto& shadow_filter_ptr: shadow_filter_ptrs_) {
+        shadow_filter_ptr->Flush();
+
+        const std::string shadow_path = trajectory.path_ + "/shadow_" + shadow_filter_ptr->GetName();
+        std::deque<Eigen::Matrix4f> shadow_poses;
+        std::ofstream shadow_odom_ofs;
+        if (
+            !TrajectoryLog::Load(shadow_path + ".bin", shadow_poses) ||
+            !FileManager::CreateFile(shadow_odom_ofs, shadow_path + ".txt")
+        ) {
             continue;
         }
 
-        SavePose(trajectory.fused_.at(i), fused_odom_ofs);
-        SavePose(trajectory.lidar_.at(i), laser_odom_ofs);
-        SavePose(current_gnss_data_.pose, ref_odom_ofs);
+        for (size_t i = 0; i < std::min(num_poses, shadow_poses.size()); ++i) {
+            const Eigen::Vector3f &position_ref = ref_poses.at(i).block<3, 1>(0, 3);
+            const Eigen::Vector3f &position_lidar = lidar_poses.at(i).block<3, 1>(0, 3);
+
+            if ( (position_ref - position_lidar).norm() > 3.0 ) {
+                continue;
+            }
+
+            SavePose(shadow_poses.at(i), shadow_odom_ofs);
+        }
+
+        ShadowFilter::Stats stats = shadow_filter_ptr->GetStats();
+        LOG(INFO) << "Shadow filter " << shadow_filter_ptr->GetName() << ": "
+                  << stats.num_updates << " updates, "
+                  << stats.num_corrections << " corrections, "
+                  << stats.num_failed << " failed, "
+                  << stats.num_samples << " poses"
+                  << (stats.is_stopped ? ", stopped" : "") << std::endl;
     }
 
     return true;
@@ -148,13 +308,11 @@ bool FilteringFlow::ReadData() {
     //
     // pipe raw IMU measurements into buffer:
     // 
-    imu_raw_sub_ptr_->ParseData(imu_raw_data_buff_);
-    while (
-        HasInited() && 
-        HasIMUData() && 
-        imu_raw_data_buff_.front().time < filtering_ptr_->GetTime()
-    ) {
-        imu_raw_data_buff_.pop_front();
+    if (imu_decimator_ptr_) {
+        imu_raw_sub_ptr_->ParseData(imu_raw_data_buff_);
+        imu_decimator_ptr_->Decimate(imu_raw_data_buff_, imu_raw_stream_ptr_->buffer);
+    } else {
+        imu_raw_sub_ptr_->ParseData(imu_raw_stream_ptr_->buffer);
     }
 
     //
@@ -164,6 +322,8 @@ bool FilteringFlow::ReadData() {
     imu_synced_sub_ptr_->ParseData(imu_synced_data_buff_);
     gnss_sub_ptr_->ParseData(gnss_data_buff_);
 
+    ValidLidarData();
+
     return true;
 }
 
@@ -171,75 +331,136 @@ bool FilteringFlow::HasInited(void) {
     return filtering_ptr_->HasInited();
 }
 
-bool FilteringFlow::HasData() {
-    if ( !HasInited() ) {
-        if ( !HasLidarData() ) {
-            return false;
+bool FilteringFlow::ValidLidarData() {
+    while ( !cloud_data_buff_.empty() && !imu_synced_data_buff_.empty() ) {
+        const CloudData& cloud_data = cloud_data_buff_.front();
+        const IMUData& imu_synced_data = imu_synced_data_buff_.front();
+
+        double diff_imu_time = cloud_data.time - imu_synced_data.time;
+
+        if ( diff_imu_time < -0.05 ) {
+            cloud_data_buff_.pop_front();
+            dropped_clouds_ptr_->Increment();
+            continue;
         }
-    } else {
-        if ( !HasIMUData() && !HasLidarData() ) {
-            return false;
+
+        if (diff_imu_time > 0.05) {
+            imu_synced_data_buff_.pop_front();
+            dropped_imu_synced_ptr_->Increment();
+            continue;
         }
+
+        LidarData lidar_data;
+        lidar_data.time = cloud_data.time;
+        lidar_data.cloud = cloud_data;
+        lidar_data.imu_synced = imu_synced_data;
+        lidar_stream_ptr_->buffer.push_back(lidar_data);
+
+        cloud_data_buff_.pop_front();
+        imu_synced_data_buff_.pop_front();
     }
 
     return true;
 }
 
-bool FilteringFlow::ValidIMUData() {
-    current_imu_raw_data_ = imu_raw_data_buff_.front();
-
-    imu_raw_data_buff_.pop_front();
+void FilteringFlow::OnIMUData(const IMUData& imu_raw_data) {
+    // before init, or older than the filter:
+    if ( !HasInited() || imu_raw_data.time < filtering_ptr_->GetTime() ) {
+        dropped_imu_raw_ptr_->Increment();
+        return;
+    }
 
-    return true;
+    current_imu_raw_data_ = imu_raw_data;
+    UpdateLocalization();
 }
 
-bool FilteringFlow::ValidLidarData() {
-    current_cloud_data_ = cloud_data_buff_.front();
-    current_imu_synced_data_ = imu_synced_data_buff_.front();
-
-    double diff_imu_time = current_cloud_data_.time - current_imu_synced_data_.time;
+void FilteringFlow::OnLidarData(const LidarData& lidar_data) {
+    current_cloud_data_ = lidar_data.cloud;
+    current_imu_synced_data_ = lidar_data.imu_synced;
 
-    if ( diff_imu_time < -0.05 ) {
-        cloud_data_buff_.pop_front();
-        return false;
+    if ( !HasInited() ) {
+        InitLocalization();
+        return;
     }
 
-    if (diff_imu_time > 0.05) {
-        imu_synced_data_buff_.pop_front();
-        return false;
+    // behind the latest lidar measurement by more than max_delay, only the IMU updates are done.
+    // those not paired yet are the latest, the measurement is popped after its callback:
+    const double latest_time = (
+        cloud_data_buff_.empty() ? lidar_stream_ptr_->GetBackTime() : cloud_data_buff_.back().time
+    );
+    if ( deadline_policy_ptr_->IsStale(current_cloud_data_.time, latest_time) ) {
+        return;
     }
 
-    cloud_data_buff_.pop_front();
-    imu_synced_data_buff_.pop_front();
-
-    return true;
+    latency_tracer_ptr_->Start(current_cloud_data_.time);
+    CorrectLocalization();
 }
 
 bool FilteringFlow::InitCalibration() {
     // lookup imu pose in lidar frame:
-    static bool calibration_received = false;
-
-    if (!calibration_received) {
+    if (!calibration_received_) {
         if (lidar_to_imu_ptr_->LookupData(lidar_to_imu_)) {
-            calibration_received = true;
+            calibration_received_ = true;
         }
     }
 
-    return calibration_received;
+    return calibration_received_;
 }
 
 bool FilteringFlow::InitLocalization(void) {
+    // every init verifies the scan against the map:
+    if ( !filtering_ptr_->IsMapReady() ) {
+        unready_clouds_ptr_->Increment();
+        return false;
+    }
+
+    // first try the snapshot of the last run, if it was taken shortly before the first scan:
+    if ( has_snapshot_ ) {
+        has_snapshot_ = false;
+
+        const double age = current_cloud_data_.time - snapshot_ptr_->time;
+        if ( age < 0.0 || age > snapshot_max_age_ ) {
+            LOG(WARNING) << "Filtering snapshot age " << age << " s is out of [0, " << snapshot_max_age_ << "], skip warm restart." << std::endl;
+        } else if ( 
+            filtering_ptr_->Init(
+                current_cloud_data_,
+                *snapshot_ptr_,
+                current_imu_synced_data_
+            ) 
+        ) {
+            last_snapshot_time_ = current_cloud_data_.time;
+
+            // prompt:
+            LOG(INFO) << "Warm Restart Succeeded, snapshot is " << age << " s old." << std::endl;
+
+            return true;
+        } else {
+            LOG(WARNING) << "Filtering snapshot does not match the first scan, skip warm restart." << std::endl;
+        }
+    }
+
     // geo ego vehicle velocity in navigation frame:
     Eigen::Vector3f init_vel = gnss_data_buff_.front().vel;
 
-    // first try to init using scan context query:
-    if (
-        filtering_ptr_->Init(
+    // first try to init using scan context query, verified along with GNSS pose if available:
+    bool is_inited = false;
+    PoseData init_gnss_data;
+    if ( GetGNSSData(current_cloud_data_.time, init_gnss_data) ) {
+        is_inited = filtering_ptr_->Init(
             current_cloud_data_,
+            init_gnss_data.pose,
             init_vel,
             current_imu_synced_data_
-        )
-    ) {
+        );
+    } else {
+        is_inited = filtering_ptr_->Init(
+            current_cloud_data_,
+            init_vel,
+            current_imu_synced_data_
+        );
+    }
+
+    if ( is_inited ) {
         // prompt:
         LOG(INFO) << "Scan Context Localization Init Succeeded." << std::endl;
     } 
@@ -247,7 +468,25 @@ bool FilteringFlow::InitLocalization(void) {
     return true;
 }
 
+bool FilteringFlow::GetGNSSData(const double time, PoseData& gnss_data) {
+    // the buffer is only pruned as poses are recorded, so search backwards from the latest:
+    for (auto it = gnss_data_buff_.rbegin(); it != gnss_data_buff_.rend(); ++it) {
+        if ( std::fabs(it->time - time) < 0.05 ) {
+            gnss_data = *it;
+            return true;
+        }
+
+        if ( it->time < time - 0.05 ) {
+            break;
+        }
+    }
+
+    return false;
+}
+
 bool FilteringFlow::UpdateLocalization() {
+    ScopedLatency latency(*update_latency_ptr_);
+
     if ( filtering_ptr_->Update(current_imu_raw_data_) ) {
         PublishFusionOdom();
         return true;
@@ -257,25 +496,56 @@ bool FilteringFlow::UpdateLocalization() {
 }
 
 bool FilteringFlow::CorrectLocalization() {
+    ScopedLatency latency(metrics_.GetLatency());
+
+    // a relocalization on tracking loss is gated to the region around the GNSS pose, if there is one:
+    PoseData gnss_data;
+    if ( GetGNSSData(current_cloud_data_.time, gnss_data) ) {
+        filtering_ptr_->SetGNSSPose(gnss_data.pose);
+    }
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
     bool is_fusion_succeeded = filtering_ptr_->Correct(
         current_imu_synced_data_, 
         current_cloud_data_, 
         laser_pose_
     );
+    const double processing_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if ( deadline_policy_ptr_->Update(processing_time) ) {
+        filtering_ptr_->SetLoadLevel(deadline_policy_ptr_->GetLevel());
+    }
+    latency_tracer_ptr_->AddHop("correct");
     PublishLidarOdom();
 
     if ( is_fusion_succeeded ) {
+        latency_tracer_ptr_->Publish();
         PublishFusionOdom();
         
         // add to odometry output for evo evaluation:
         UpdateOdometry(current_cloud_data_.time);
 
+        SaveSnapshot();
+
         return true;
     }
 
+    failed_corrections_ptr_->Increment();
+
     return false;
 }
 
+bool FilteringFlow::SaveSnapshot() {
+    if ( 
+        !is_warm_restart_enabled_ || 
+        current_cloud_data_.time - last_snapshot_time_ < snapshot_interval_ 
+    ) {
+        return false;
+    }
+    last_snapshot_time_ = current_cloud_data_.time;
+
+    return filtering_ptr_->GetSnapshot(*snapshot_ptr_) && snapshot_ptr_->Save(snapshot_path_);
+}
+
 bool FilteringFlow::PublishGlobalMap() {
     if (filtering_ptr_->HasNewGlobalMap() && global_map_pub_ptr_->HasSubscribers()) {
         CloudData::CLOUD_PTR global_map_ptr(new CloudData::CLOUD());
@@ -314,15 +584,33 @@ bool FilteringFlow::PublishFusionOdom() {
     laser_tf_pub_ptr_->SendTransform(fused_pose_, current_imu_raw_data_.time);
     // b. publish fusion odometry:
     fused_odom_pub_ptr_->Publish(fused_pose_, fused_vel_, current_imu_raw_data_.time);
+    // c. the IMU-rate output is predicted from here on:
+    if ( imu_pose_predictor_ptr_ && filtering_ptr_->GetNavState(nav_state_) ) {
+        imu_pose_predictor_ptr_->SetNavState(nav_state_);
+    }
 
     return true;
 }
 
 bool FilteringFlow::UpdateOdometry(const double &time) {
-    trajectory.time_.push_back(time);
-    
-    trajectory.fused_.push_back(fused_pose_);
-    trajectory.lidar_.push_back(laser_pose_);
+    // sync ref pose with gnss measurement, those before it are no longer needed:
+    PoseData gnss_data;
+    bool has_gnss_data = GetGNSSData(time, gnss_data);
+    while (
+        !gnss_data_buff_.empty() && 
+        (gnss_data_buff_.front().time - time <= -0.05)
+    ) {
+        gnss_data_buff_.pop_front();
+    }
+
+    if ( !has_gnss_data || !trajectory.fused_ ) {
+        return false;
+    }
+
+    trajectory.fused_->Append(fused_pose_);
+    trajectory.lidar_->Append(laser_pose_);
+    trajectory.ref_->Append(gnss_data.pose);
+    filtering_ptr_->SampleShadowFilters();
 
     ++trajectory.N;
 
@@ -0,0 +1,128 @@
+/*
+ * @Description: filtering state saved for warm restart of the localization
+ * @Author: Ge Yao
+ * @Date: 2020-12-30 20:41:15
+ */
+#include "lidar_localization/filtering/filtering_snapshot.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+// in native byte order, matrices column-major:
+static const char SNAPSHOT_MAGIC[8] = {'F', 'L', 'T', 'S', 'N', 'A', 'P', '\0'};
+static const uint32_t SNAPSHOT_VERSION = 1;
+
+namespace {
+struct SnapshotRecord {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+
+    double time;
+
+    float init_pose[16];
+    float last_pose[16];
+    float step_pose[16];
+    float vel[3];
+    float local_map_origin[3];
+
+    double filter_time;
+    double filter_init_pose[16];
+    double filter_pose[16];
+    double filter_vel[3];
+    double gyro_bias[3];
+    double accl_bias[3];
+    double X[ErrorStateKalmanFilter::DIM_STATE];
+    double P[ErrorStateKalmanFilter::DIM_STATE * ErrorStateKalmanFilter::DIM_STATE];
+};
+}
+
+bool FilteringSnapshot::Save(const std::string& file_path) const {
+    SnapshotRecord record;
+    std::memset(&record, 0, sizeof(record));
+    std::memcpy(record.magic, SNAPSHOT_MAGIC, sizeof(record.magic));
+    record.version = SNAPSHOT_VERSION;
+    record.record_size = sizeof(record);
+
+    record.time = time;
+
+    Eigen::Map<Eigen::Matrix4f>(record.init_pose) = init_pose;
+    Eigen::Map<Eigen::Matrix4f>(record.last_pose) = last_pose;
+    Eigen::Map<Eigen::Matrix4f>(record.step_pose) = step_pose;
+    Eigen::Map<Eigen::Vector3f>(record.vel) = vel;
+    Eigen::Map<Eigen::Vector3f>(record.local_map_origin) = local_map_origin;
+
+    record.filter_time = filter_state.time;
+    Eigen::Map<Eigen::Matrix4d>(record.filter_init_pose) = filter_state.init_pose;
+    Eigen::Map<Eigen::Matrix4d>(record.filter_pose) = filter_state.pose;
+    Eigen::Map<Eigen::Vector3d>(record.filter_vel) = filter_state.vel;
+    Eigen::Map<Eigen::Vector3d>(record.gyro_bias) = filter_state.gyro_bias;
+    Eigen::Map<Eigen::Vector3d>(record.accl_bias) = filter_state.accl_bias;
+    Eigen::Map<ErrorStateKalmanFilter::VectorX>(record.X) = filter_state.X;
+    Eigen::Map<ErrorStateKalmanFilter::MatrixP>(record.P) = filter_state.P;
+
+    // the rename replaces the previous snapshot at once, a crash before it leaves that one intact:
+    const std::string temp_file_path = file_path + ".tmp";
+    FILE *output_fptr = fopen(temp_file_path.c_str(), "wb");
+    if (!output_fptr) {
+        LOG(ERROR) << "Cannot write filtering snapshot " << temp_file_path;
+        return false;
+    }
+
+    bool success = (1 == fwrite(&record, sizeof(record), 1, output_fptr));
+    success = (0 == fclose(output_fptr)) && success;
+    if (!success || 0 != std::rename(temp_file_path.c_str(), file_path.c_str())) {
+        LOG(ERROR) << "Cannot write filtering snapshot " << file_path;
+        std::remove(temp_file_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool FilteringSnapshot::Load(const std::string& file_path) {
+    FILE *input_fptr = fopen(file_path.c_str(), "rb");
+    if (!input_fptr) {
+        LOG(WARNING) << "No filtering snapshot " << file_path;
+        return false;
+    }
+
+    SnapshotRecord record;
+    bool success = (1 == fread(&record, sizeof(record), 1, input_fptr));
+    fclose(input_fptr);
+    if (
+        !success || 
+        0 != std::memcmp(record.magic, SNAPSHOT_MAGIC, sizeof(record.magic)) ||
+        SNAPSHOT_VERSION != record.version ||
+        sizeof(record) != record.record_size
+    ) {
+        LOG(ERROR) << "Filtering snapshot " << file_path << " is not of version " << SNAPSHOT_VERSION;
+        return false;
+    }
+
+    time = record.time;
+
+    init_pose = Eigen::Map<const Eigen::Matrix4f>(record.init_pose);
+    last_pose = Eigen::Map<const Eigen::Matrix4f>(record.last_pose);
+    step_pose = Eigen::Map<const Eigen::Matrix4f>(record.step_pose);
+    vel = Eigen::Map<const Eigen::Vector3f>(record.vel);
+    local_map_origin = Eigen::Map<const Eigen::Vector3f>(record.local_map_origin);
+
+    filter_state.time = record.filter_time;
+    filter_state.init_pose = Eigen::Map<const Eigen::Matrix4d>(record.filter_init_pose);
+    filter_state.pose = Eigen::Map<const Eigen::Matrix4d>(record.filter_pose);
+    filter_state.vel = Eigen::Map<const Eigen::Vector3d>(record.filter_vel);
+    filter_state.gyro_bias = Eigen::Map<const Eigen::Vector3d>(record.gyro_bias);
+    filter_state.accl_bias = Eigen::Map<const Eigen::Vector3d>(record.accl_bias);
+    filter_state.X = Eigen::Map<const ErrorStateKalmanFilter::VectorX>(record.X);
+    filter_state.P = Eigen::Map<const ErrorStateKalmanFilter::MatrixP>(record.P);
+
+    return true;
+}
+
+} // namespace lidar_localization
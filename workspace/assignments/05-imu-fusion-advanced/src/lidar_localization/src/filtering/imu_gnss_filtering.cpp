@@ -74,13 +74,11 @@ bool IMUGNSSFiltering::Correct(
             // reset downsample counter:
             count = 0;
 
-            /*
-            // perform observability analysis:
+            // record snapshot for observability analysis:
             kalman_filter_ptr_->UpdateObservabilityAnalysis(
                 gnss_pose_data.time,
                 ErrorStateKalmanFilter::MeasurementType::POSITION
             );
-            */
         }
 
         return true;
@@ -5,6 +5,7 @@
  */
 
 #include "lidar_localization/filtering/imu_gnss_filtering_flow.hpp"
+#include "lidar_localization/tools/tracer.hpp"
 
 #include "lidar_localization/filtering/imu_gnss_filtering.hpp"
 
@@ -38,45 +39,30 @@ IMUGNSSFilteringFlow::IMUGNSSFilteringFlow(
 
     // filtering instance:
     filtering_ptr_ = std::make_shared<IMUGNSSFiltering>();
+
+    // measurement streams, a correction waits for the IMU measurements up to it, the IMU never waits:
+    imu_stream_ptr_ = &scheduler_.AddStream<IMUData>(
+        "imu", 0.01, [this](const IMUData& imu_data) { OnIMUData(imu_data); }
+    );
+    gnss_stream_ptr_ = &scheduler_.AddStream<PoseData>(
+        "gnss", 0.0, [this](const PoseData& gnss_data) { OnGNSSData(gnss_data); }
+    );
+
+    // metrics:
+    metrics_.AddQueue("imu_queue", [this]{ return imu_stream_ptr_->buffer.size(); });
+    metrics_.AddQueue("gnss_queue", [this]{ return gnss_stream_ptr_->buffer.size(); });
+    update_latency_ptr_ = &metrics_.AddLatency("update_latency");
+    latency_tracer_ptr_ = std::make_shared<LatencyTracer>(nh, "imu_gnss_filtering", "/synced_gnss_pose", "/fused_pose", metrics_);
 }
 
 bool IMUGNSSFilteringFlow::Run() {
+    TRACE_SCOPE("IMUGNSSFilteringFlow::Run", "flow");
+    metrics_.UpdateQueues();
+
     ReadData();
 
-    while( HasData() ) {
-        if ( !HasInited() ) {
-            if ( 
-                HasGNSSData() && ValidGNSSData() &&
-                HasIMUData() && ValidIMUData()
-            ) {
-                InitLocalization();
-            }
-        } else {
-            // TODO: handle timestamp chaos in an more elegant way
-            if (  HasGNSSData() && ValidGNSSData() ) {
-                if ( HasIMUData() ) {
-                    while (
-                        HasIMUData() && ValidIMUData() && 
-                        current_imu_data_.time < current_gnss_data_.time
-                    ) {
-                        UpdateLocalization();
-                    }
-
-                    if (
-                        current_imu_data_.time >= current_gnss_data_.time
-                    ) {
-                        gnss_data_buff_.push_back(current_gnss_data_);
-                    }
-                }
-
-                CorrectLocalization();
-            }
-           
-            if ( HasIMUData() && ValidIMUData() ) {
-                UpdateLocalization();
-            }
-        }
-    }
+    // IMU updates & GNSS corrections in time order:
+    scheduler_.Dispatch();
 
     return true;
 }
@@ -131,8 +117,8 @@ bool IMUGNSSFilteringFlow::ReadData() {
     //
     // pipe synced IMU-GNSS measurements into buffer:
     // 
-    imu_sub_ptr_->ParseData(imu_data_buff_);
-    gnss_sub_ptr_->ParseData(gnss_data_buff_);
+    imu_sub_ptr_->ParseData(imu_stream_ptr_->buffer);
+    gnss_sub_ptr_->ParseData(gnss_stream_ptr_->buffer);
     ref_pose_sub_ptr_->ParseData(ref_pose_data_buff_);
 
     return true;
@@ -142,34 +128,23 @@ bool IMUGNSSFilteringFlow::HasInited(void) {
     return filtering_ptr_->HasInited();
 }
 
-bool IMUGNSSFilteringFlow::HasData() {
-    if ( !HasInited() ) {
-        if ( !HasIMUData() || !HasGNSSData() ) {
-            return false;
-        }
-    } else {
-        if ( !HasIMUData() && !HasGNSSData() ) {
-            return false;
-        }
-    }
+void IMUGNSSFilteringFlow::OnIMUData(const IMUData& imu_data) {
+    current_imu_data_ = imu_data;
+    has_imu_data_ = true;
 
-    return true;
-}
-
-bool IMUGNSSFilteringFlow::ValidIMUData() {
-    current_imu_data_ = imu_data_buff_.front();
-
-    imu_data_buff_.pop_front();
-
-    return true;
+    if ( HasInited() ) {
+        UpdateLocalization();
+    }
 }
 
-bool IMUGNSSFilteringFlow::ValidGNSSData() {
-    current_gnss_data_ = gnss_data_buff_.front();
-    
-    gnss_data_buff_.pop_front();
+void IMUGNSSFilteringFlow::OnGNSSData(const PoseData& gnss_data) {
+    current_gnss_data_ = gnss_data;
 
-    return true;
+    if ( HasInited() ) {
+        CorrectLocalization();
+    } else if ( has_imu_data_ ) {
+        InitLocalization();
+    }
 }
 
 bool IMUGNSSFilteringFlow::InitLocalization(void) {
@@ -186,6 +161,8 @@ bool IMUGNSSFilteringFlow::InitLocalization(void) {
 }
 
 bool IMUGNSSFilteringFlow::UpdateLocalization() {
+    ScopedLatency latency(*update_latency_ptr_);
+
     if ( 
         filtering_ptr_->Update(
             current_imu_data_
@@ -203,9 +180,15 @@ bool IMUGNSSFilteringFlow::UpdateLocalization() {
 bool IMUGNSSFilteringFlow::CorrectLocalization() {
     static int count = 0;
 
+    // downsample GNSS measurement:
+    if ( 0 != (++count % 10) ) {
+        return false;
+    }
+
+    ScopedLatency latency(metrics_.GetLatency());
+    latency_tracer_ptr_->Start(current_gnss_data_.time);
+
     if ( 
-        // downsample GNSS measurement:
-        0 == (++count % 10) && 
         // successful correct:
         filtering_ptr_->Correct(
             current_imu_data_, 
@@ -215,7 +198,10 @@ bool IMUGNSSFilteringFlow::CorrectLocalization() {
         // reset downsample counter:
         count = 0;
 
+        latency_tracer_ptr_->AddHop("correct");
+
         // publish new odom estimation:
+        latency_tracer_ptr_->Publish();
         PublishFusionOdom();
         
         // add to odometry output for evo evaluation:
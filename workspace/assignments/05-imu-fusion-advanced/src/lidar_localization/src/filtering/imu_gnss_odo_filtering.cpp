@@ -81,13 +81,11 @@ bool IMUGNSSOdoFiltering::Correct(
             // reset downsample counter:
             count = 0;
 
-            /*
-            // perform observability analysis:
+            // record snapshot for observability analysis:
             kalman_filter_ptr_->UpdateObservabilityAnalysis(
-                gnss_pose_data.time,
-                ErrorStateKalmanFilter::MeasurementType::POSITION
+                pos_vel_data.time,
+                ErrorStateKalmanFilter::MeasurementType::POSITION_VELOCITY
             );
-            */
         }
 
         return true;
@@ -129,7 +127,7 @@ void IMUGNSSOdoFiltering::GetStandardDeviation(ESKFStd &eskf_std_msg) {
 
 void IMUGNSSOdoFiltering::SaveObservabilityAnalysis(void) {
     kalman_filter_ptr_->SaveObservabilityAnalysis(
-        ErrorStateKalmanFilter::MeasurementType::POSITION
+        ErrorStateKalmanFilter::MeasurementType::POSITION_VELOCITY
     );
 }
 
@@ -5,6 +5,7 @@
  */
 
 #include "lidar_localization/filtering/imu_gnss_odo_filtering_flow.hpp"
+#include "lidar_localization/tools/tracer.hpp"
 
 #include "lidar_localization/filtering/imu_gnss_odo_filtering.hpp"
 
@@ -40,45 +41,30 @@ IMUGNSSOdoFilteringFlow::IMUGNSSOdoFilteringFlow(
 
     // filtering instance:
     filtering_ptr_ = std::make_shared<IMUGNSSOdoFiltering>();
+
+    // measurement streams, a correction waits for the IMU measurements up to it, the IMU never waits:
+    imu_stream_ptr_ = &scheduler_.AddStream<IMUData>(
+        "imu", 0.01, [this](const IMUData& imu_data) { OnIMUData(imu_data); }
+    );
+    pos_vel_stream_ptr_ = &scheduler_.AddStream<PosVelData>(
+        "pos_vel", 0.0, [this](const PosVelData& pos_vel_data) { OnPosVelData(pos_vel_data); }
+    );
+
+    // metrics:
+    metrics_.AddQueue("imu_queue", [this]{ return imu_stream_ptr_->buffer.size(); });
+    metrics_.AddQueue("pos_vel_queue", [this]{ return pos_vel_stream_ptr_->buffer.size(); });
+    update_latency_ptr_ = &metrics_.AddLatency("update_latency");
+    latency_tracer_ptr_ = std::make_shared<LatencyTracer>(nh, "imu_gnss_odo_filtering", "/synced_pos_vel", "/fused_pose", metrics_);
 }
 
 bool IMUGNSSOdoFilteringFlow::Run() {
+    TRACE_SCOPE("IMUGNSSOdoFilteringFlow::Run", "flow");
+    metrics_.UpdateQueues();
+
     ReadData();
 
-    while( HasData() ) {
-        if ( !HasInited() ) {
-            if ( 
-                HasPosVelData() && ValidPosVelData() &&
-                HasIMUData() && ValidIMUData()
-            ) {
-                InitLocalization();
-            }
-        } else {
-            // TODO: handle timestamp chaos in an more elegant way
-            if (  HasPosVelData() && ValidPosVelData() ) {
-                if ( HasIMUData() ) {
-                    while (
-                        HasIMUData() && ValidIMUData() && 
-                        current_imu_data_.time < current_pos_vel_data_.time
-                    ) {
-                        UpdateLocalization();
-                    }
-
-                    if (
-                        current_imu_data_.time >= current_pos_vel_data_.time
-                    ) {
-                        imu_data_buff_.push_back(current_imu_data_);
-                    }
-                }
-
-                CorrectLocalization();
-            }
-           
-            if ( HasIMUData() && ValidIMUData() ) {
-                UpdateLocalization();
-            }
-        }
-    }
+    // IMU updates & GNSS-odo corrections in time order:
+    scheduler_.Dispatch();
 
     return true;
 }
@@ -133,8 +119,8 @@ bool IMUGNSSOdoFilteringFlow::ReadData() {
     //
     // pipe synced IMU-GNSS measurements into buffer:
     // 
-    imu_sub_ptr_->ParseData(imu_data_buff_);
-    pos_vel_sub_ptr_->ParseData(pos_vel_data_buff_);
+    imu_sub_ptr_->ParseData(imu_stream_ptr_->buffer);
+    pos_vel_sub_ptr_->ParseData(pos_vel_stream_ptr_->buffer);
     ref_pose_sub_ptr_->ParseData(ref_pose_data_buff_);
 
     return true;
@@ -144,34 +130,23 @@ bool IMUGNSSOdoFilteringFlow::HasInited(void) {
     return filtering_ptr_->HasInited();
 }
 
-bool IMUGNSSOdoFilteringFlow::HasData() {
-    if ( !HasInited() ) {
-        if ( !HasIMUData() || !HasPosVelData() ) {
-            return false;
-        }
-    } else {
-        if ( !HasIMUData() && !HasPosVelData() ) {
-            return false;
-        }
-    }
+void IMUGNSSOdoFilteringFlow::OnIMUData(const IMUData& imu_data) {
+    current_imu_data_ = imu_data;
+    has_imu_data_ = true;
 
-    return true;
-}
-
-bool IMUGNSSOdoFilteringFlow::ValidIMUData() {
-    current_imu_data_ = imu_data_buff_.front();
-
-    imu_data_buff_.pop_front();
-
-    return true;
+    if ( HasInited() ) {
+        UpdateLocalization();
+    }
 }
 
-bool IMUGNSSOdoFilteringFlow::ValidPosVelData() {
-    current_pos_vel_data_ = pos_vel_data_buff_.front();
-    
-    pos_vel_data_buff_.pop_front();
+void IMUGNSSOdoFilteringFlow::OnPosVelData(const PosVelData& pos_vel_data) {
+    current_pos_vel_data_ = pos_vel_data;
 
-    return true;
+    if ( HasInited() ) {
+        CorrectLocalization();
+    } else if ( has_imu_data_ ) {
+        InitLocalization();
+    }
 }
 
 bool IMUGNSSOdoFilteringFlow::InitLocalization(void) {
@@ -195,6 +170,8 @@ bool IMUGNSSOdoFilteringFlow::InitLocalization(void) {
 }
 
 bool IMUGNSSOdoFilteringFlow::UpdateLocalization() {
+    ScopedLatency latency(*update_latency_ptr_);
+
     if ( 
         filtering_ptr_->Update(
             current_imu_data_
@@ -212,9 +189,15 @@ bool IMUGNSSOdoFilteringFlow::UpdateLocalization() {
 bool IMUGNSSOdoFilteringFlow::CorrectLocalization() {
     static int count = 0;
 
+    // downsample GNSS measurement:
+    if ( 0 != (++count % 10) ) {
+        return false;
+    }
+
+    ScopedLatency latency(metrics_.GetLatency());
+    latency_tracer_ptr_->Start(current_pos_vel_data_.time);
+
     if ( 
-        // downsample GNSS measurement:
-        0 == (++count % 10) && 
         // successful correct:
         filtering_ptr_->Correct(
             current_imu_data_, 
@@ -224,7 +207,10 @@ bool IMUGNSSOdoFilteringFlow::CorrectLocalization() {
         // reset downsample counter:
         count = 0;
 
+        latency_tracer_ptr_->AddHop("correct");
+
         // publish new odom estimation:
+        latency_tracer_ptr_->Publish();
         PublishFusionOdom();
         
         // add to odometry output for evo evaluation:
@@ -0,0 +1,163 @@
+/*
+ * @Description: IMU-rate fused pose output, decoupled from lidar correction
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 22:52:18
+ */
+#include "lidar_localization/filtering/imu_pose_predictor.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <iostream>
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+ImuPosePredictor::ImuPosePredictor(
+    ros::NodeHandle& nh,
+    const YAML::Node& node,
+    std::string imu_topic_name,
+    std::string topic_name,
+    std::string base_frame_id,
+    std::string child_frame_id
+) : max_propagation_time_(node["max_propagation_time"].as<double>()),
+    nh_(nh),
+    num_predictions_(MetricsRegistry::GetInstance().GetCounter("imu_pose_predictor.predictions")),
+    num_expired_(MetricsRegistry::GetInstance().GetCounter("imu_pose_predictor.expired")) {
+    // the subscriber is served by the worker, not by the spin of the flow:
+    nh_.setCallbackQueue(&callback_queue_);
+    imu_sub_ptr_ = std::make_shared<IMUSubscriber>(nh_, imu_topic_name, 1000);
+    odom_pub_ptr_ = std::make_shared<OdometryPublisher>(nh, topic_name, base_frame_id, child_frame_id, 100);
+
+    std::cout << "IMU Pose Predictor params:" << std::endl
+              << "\tIMU topic: " << imu_topic_name << std::endl
+              << "\toutput topic: " << topic_name << std::endl
+              << "\tmax. propagation time: " << max_propagation_time_ << std::endl
+              << std::endl;
+
+    thread_ = std::thread(&ImuPosePredictor::Run, this);
+}
+
+ImuPosePredictor::~ImuPosePredictor() {
+    stop_ = true;
+    thread_.join();
+}
+
+void ImuPosePredictor::SetNavState(const imu_mechanization::NavState& nav_state) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    new_nav_state_ = nav_state;
+    has_new_nav_state_ = true;
+}
+
+void ImuPosePredictor::Run(void) {
+    while (!stop_ && ros::ok()) {
+        callback_queue_.callAvailable(ros::WallDuration(0.01));
+        Predict();
+    }
+}
+
+bool ImuPosePredictor::Predict(void) {
+    TRACE_SCOPE("ImuPosePredictor::Predict", "filter");
+    imu_sub_ptr_->ParseData(imu_data_buff_);
+
+    // a. the latest nominal state of the flow takes over the prediction:
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (has_new_nav_state_) {
+            nav_state_ = new_nav_state_;
+            predicted_state_ = nav_state_;
+            has_new_nav_state_ = false;
+            has_nav_state_ = true;
+        }
+    }
+
+    if (imu_data_buff_.empty()) {
+        return false;
+    }
+
+    // b. keep the measurement at the nominal state, those before it are integrated by the flow.
+    // older than max_propagation_time they would only feed expired predictions:
+    double oldest_time = imu_data_buff_.back().time - max_propagation_time_;
+    if (has_nav_state_) {
+        oldest_time = std::max(oldest_time, nav_state_.time);
+    }
+    while (imu_data_buff_.size() > 1 && imu_data_buff_.at(1).time <= oldest_time) {
+        imu_data_buff_.pop_front();
+    }
+
+    if (!has_nav_state_) {
+        return false;
+    }
+
+    // c. dead reckoning of the measurements after the predicted state:
+    std::deque<IMUData>::const_iterator it = std::upper_bound(
+        imu_data_buff_.begin(), imu_data_buff_.end(), predicted_state_.time,
+        [](double time, const IMUData& imu_data) { return time < imu_data.time; }
+    );
+    if (it == imu_data_buff_.end()) {
+        return false;
+    }
+    // without the measurement at the predicted state, the next one is held:
+    imu_mechanization::IMUSample sample_prev = GetUnbiasedIMUSample(
+        (it == imu_data_buff_.begin()) ? *it : *std::prev(it), predicted_state_.time
+    );
+
+    bool has_output = false;
+    for (; it != imu_data_buff_.end(); ++it) {
+        imu_mechanization::IMUSample sample_curr = GetUnbiasedIMUSample(*it, it->time);
+        imu_mechanization::IntegrateStep(
+            sample_prev, sample_curr,
+            predicted_state_.g,
+            predicted_state_.pose, predicted_state_.vel
+        );
+        predicted_state_.time = it->time;
+        sample_prev = sample_curr;
+
+        // a correction takes over from before the measurements already published:
+        if (predicted_state_.time <= last_published_time_) {
+            continue;
+        }
+
+        if (predicted_state_.time - nav_state_.time > max_propagation_time_) {
+            num_expired_.Increment();
+            continue;
+        }
+
+        odom_pub_ptr_->Publish(
+            predicted_state_.pose.cast<float>(),
+            predicted_state_.vel.cast<float>(),
+            predicted_state_.time
+        );
+        last_published_time_ = predicted_state_.time;
+        num_predictions_.Increment();
+        has_output = true;
+    }
+
+    return has_output;
+}
+
+imu_mechanization::IMUSample ImuPosePredictor::GetUnbiasedIMUSample(const IMUData& imu_data, double time) const {
+    imu_mechanization::IMUSample sample;
+
+    sample.time = time;
+
+    const Eigen::Matrix3d R = predicted_state_.pose.block<3, 3>(0, 0);
+    sample.angular_vel = Eigen::Vector3d(
+        imu_data.angular_velocity.x,
+        imu_data.angular_velocity.y,
+        imu_data.angular_velocity.z
+    ) - predicted_state_.gyro_bias - R.transpose() * predicted_state_.w;
+
+    sample.linear_acc = Eigen::Vector3d(
+        imu_data.linear_acceleration.x,
+        imu_data.linear_acceleration.y,
+        imu_data.linear_acceleration.z
+    ) - predicted_state_.accl_bias;
+
+    return sample;
+}
+
+} // namespace lidar_localization
@@ -0,0 +1,222 @@
+/*
+ * @Description: shadow Kalman filter, fed the measurements of the primary one on its own thread for A/B evaluation
+ * @Author: Ge Yao
+ * @Date: 2021-01-16 10:27:51
+ */
+#include "lidar_localization/filtering/shadow_filter.hpp"
+
+#include <chrono>
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+ShadowFilter::ShadowFilter(
+    const std::string& name,
+    const std::string& fusion_method, const YAML::Node& filter_node,
+    const std::string& log_path, size_t max_queue_size,
+    FlowMetrics& metrics
+) : name_(name),
+    max_queue_size_(max_queue_size),
+    update_latency_(metrics.AddLatency("shadow_" + name + ".update_latency")),
+    correct_latency_(metrics.AddLatency("shadow_" + name + ".correct_latency")),
+    queue_depth_(metrics.AddGauge("shadow_" + name + ".queue")),
+    dropped_(metrics.AddCounter("shadow_" + name + ".dropped")),
+    thread_(&ShadowFilter::Run, this) {
+    if (fusion_method == "kalman_filter") {
+        error_state_kalman_filter_ptr_ = std::make_shared<ErrorStateKalmanFilter>(filter_node);
+    } else if (fusion_method == "extended_kalman_filter") {
+        extended_kalman_filter_ptr_ = std::make_shared<ExtendedKalmanFilter>(filter_node);
+    } else {
+        LOG(ERROR) << "Fusion method " << fusion_method << " of shadow filter " << name_ << " NOT FOUND!";
+    }
+
+    log_ptr_ = std::make_shared<TrajectoryLog>(log_path);
+
+    std::cout << "\tShadow Filter " << name_ << ": " << fusion_method << std::endl;
+}
+
+ShadowFilter::~ShadowFilter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    has_task_.notify_one();
+
+    // the worker drains the queue before it exits:
+    thread_.join();
+}
+
+void ShadowFilter::Init(const Eigen::Vector3f& init_vel, const IMUData& init_imu_data) {
+    if (!error_state_kalman_filter_ptr_ && !extended_kalman_filter_ptr_) {
+        return;
+    }
+
+    Task task;
+    task.type = INIT;
+    task.imu_data = init_imu_data;
+    task.vel = init_vel;
+
+    is_started_ = AddTask(task);
+}
+
+void ShadowFilter::Update(const IMUData& imu_data) {
+    if (!is_started_) {
+        return;
+    }
+
+    Task task;
+    task.type = UPDATE;
+    task.imu_data = imu_data;
+
+    AddTask(task);
+}
+
+void ShadowFilter::Correct(const IMUData& imu_data, double time, const Eigen::Matrix4d& T_nb) {
+    if (!is_started_) {
+        return;
+    }
+
+    Task task;
+    task.type = CORRECT;
+    task.imu_data = imu_data;
+    task.time = time;
+    task.pose = T_nb;
+
+    AddTask(task);
+}
+
+void ShadowFilter::Sample(const Eigen::Matrix4f& init_pose) {
+    if (!is_started_) {
+        return;
+    }
+
+    Task task;
+    task.type = SAMPLE;
+    task.pose = init_pose.cast<double>();
+
+    AddTask(task);
+}
+
+void ShadowFilter::Flush(void) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        is_idle_.wait(lock, [this]{ return queue_.empty() && !is_processing_; });
+    }
+
+    log_ptr_->Flush();
+}
+
+ShadowFilter::Stats ShadowFilter::GetStats(void) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+bool ShadowFilter::AddTask(const Task& task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stats_.is_stopped) {
+            dropped_.Increment();
+            return false;
+        }
+
+        if (queue_.size() >= max_queue_size_) {
+            // what is queued is of no use without the measurement dropped now:
+            queue_.clear();
+            stats_.is_stopped = true;
+            dropped_.Increment();
+
+            LOG(WARNING) << "Shadow filter " << name_ << " fell behind by " << max_queue_size_
+                         << " measurements and is stopped.";
+        } else {
+            queue_.push_back(task);
+        }
+
+        queue_depth_.Set(static_cast<double>(queue_.size()));
+    }
+    has_task_.notify_one();
+
+    return true;
+}
+
+void ShadowFilter::Process(const Task& task) {
+    bool is_ok = true;
+
+    if (INIT == task.type) {
+        if (error_state_kalman_filter_ptr_) {
+            error_state_kalman_filter_ptr_->Init(task.vel.cast<double>(), task.imu_data);
+        } else {
+            extended_kalman_filter_ptr_->Init(task.vel.cast<double>(), task.imu_data);
+        }
+    } else if (UPDATE == task.type) {
+        ScopedLatency latency(update_latency_);
+        if (error_state_kalman_filter_ptr_) {
+            is_ok = error_state_kalman_filter_ptr_->Update(task.imu_data);
+        } else {
+            is_ok = extended_kalman_filter_ptr_->Update(task.imu_data);
+        }
+    } else if (CORRECT == task.type) {
+        ScopedLatency latency(correct_latency_);
+        if (error_state_kalman_filter_ptr_) {
+            ErrorStateKalmanFilter::Measurement measurement;
+            measurement.time = task.time;
+            measurement.T_nb = task.pose;
+            is_ok = error_state_kalman_filter_ptr_->Correct(
+                task.imu_data, ErrorStateKalmanFilter::MeasurementType::POSE, measurement
+            );
+        } else {
+            ExtendedKalmanFilter::Measurement measurement;
+            measurement.time = task.time;
+            measurement.T_nb = task.pose;
+            is_ok = extended_kalman_filter_ptr_->Correct(
+                task.imu_data, ExtendedKalmanFilter::MeasurementType::POSE, measurement
+            );
+        }
+    } else {
+        Eigen::Matrix4f pose;
+        Eigen::Vector3f vel;
+        if (error_state_kalman_filter_ptr_) {
+            error_state_kalman_filter_ptr_->GetOdometry(pose, vel);
+        } else {
+            extended_kalman_filter_ptr_->GetOdometry(pose, vel);
+        }
+        log_ptr_->Append(task.pose.cast<float>() * pose);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (UPDATE == task.type) {
+        ++stats_.num_updates;
+    } else if (CORRECT == task.type) {
+        ++stats_.num_corrections;
+    } else if (SAMPLE == task.type) {
+        ++stats_.num_samples;
+    }
+    if (!is_ok) {
+        ++stats_.num_failed;
+    }
+}
+
+void ShadowFilter::Run(void) {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        has_task_.wait(lock, [this]{ return stop_ || !queue_.empty(); });
+        if (queue_.empty())
+            break;
+
+        Task task = queue_.front();
+        queue_.pop_front();
+        is_processing_ = true;
+
+        lock.unlock();
+        Process(task);
+        lock.lock();
+
+        is_processing_ = false;
+        queue_depth_.Set(static_cast<double>(queue_.size()));
+        if (queue_.empty())
+            is_idle_.notify_all();
+    }
+}
+
+} // namespace lidar_localization
@@ -4,6 +4,11 @@
  * @Date: 2020-02-28 01:02:51
  */
 #include "lidar_localization/mapping/back_end/back_end.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
 
 #include <Eigen/Dense>
 #include <pcl/io/pcd_io.h>
@@ -11,8 +16,49 @@
 
 #include "lidar_localization/global_defination/global_defination.h"
 #include "lidar_localization/tools/file_manager.hpp"
+#include "lidar_localization/tools/memory_usage.hpp"
+#include "lidar_localization/models/key_frame_store/pcd_key_frame_store.hpp"
+#include "lidar_localization/models/key_frame_store/packed_key_frame_store.hpp"
+#include "lidar_localization/models/key_frame_selector/distance_key_frame_selector.hpp"
+#include "lidar_localization/models/key_frame_selector/adaptive_key_frame_selector.hpp"
 
 namespace lidar_localization {
+namespace {
+// checkpoint records, poses are column-major:
+enum CheckpointRecordType : uint32_t {
+    KEY_FRAME_RECORD = 1,
+    LOOP_POSE_RECORD = 2,
+    // followed by num_poses poses:
+    OPTIMIZED_POSE_RECORD = 3
+};
+
+struct KeyFrameRecord {
+    double time;
+    double gnss_time;
+    uint32_t index;
+    uint32_t reserved;
+    float pose[16];
+    float gnss_pose[16];
+};
+
+struct LoopPoseRecord {
+    uint32_t index0;
+    uint32_t index1;
+    float pose[16];
+};
+
+struct OptimizedPoseRecord {
+    uint32_t first_index;
+    uint32_t num_poses;
+};
+
+Eigen::Matrix4f GetPose(const float *data) {
+    Eigen::Matrix4f pose;
+    std::memcpy(pose.data(), data, sizeof(float) * 16);
+    return pose;
+}
+}
+
 BackEnd::BackEnd() {
     InitWithConfig();
 }
@@ -24,13 +70,25 @@ bool BackEnd::InitWithConfig() {
     std::cout << "-----------------Init Backend-------------------" << std::endl;
     InitParam(config_node);
     InitGraphOptimizer(config_node);
+    // before the outputs are initialized, a restored session keeps them:
+    InitCheckpoint(config_node);
     InitDataPath(config_node);
+    InitKeyFrameStore(config_node);
+    InitKeyFrameSelector(config_node);
+
+    if (is_checkpoint_restored_) {
+        RestoreCheckpoint();
+    }
+    if (!checkpoint_path_.empty()) {
+        checkpoint_log_ptr_ = std::make_shared<CheckpointLog>(checkpoint_path_, !is_checkpoint_restored_);
+    }
 
     return true;
 }
 
 bool BackEnd::InitParam(const YAML::Node& config_node) {
-    key_frame_distance_ = config_node["key_frame_distance"].as<float>();
+    window_size_ = std::max(config_node["window_size"].as<int>(), 0);
+    std::cout << "\tWindow Size:" << window_size_ << std::endl;
 
     return true;
 }
@@ -38,13 +96,30 @@ bool BackEnd::InitParam(const YAML::Node& config_node) {
 bool BackEnd::InitGraphOptimizer(const YAML::Node& config_node) {
     std::string graph_optimizer_type = config_node["graph_optimizer_type"].as<std::string>();
     if (graph_optimizer_type == "g2o") {
-        graph_optimizer_ptr_ = std::make_shared<G2oGraphOptimizer>("lm_var");
+        graph_optimizer_ptr_ = std::make_shared<G2oGraphOptimizer>(
+            config_node[graph_optimizer_type + "_param"]["solver_type"].as<std::string>(),
+            config_node[graph_optimizer_type + "_param"]["incremental"].as<bool>()
+        );
+#ifdef LIDAR_LOCALIZATION_WITH_GTSAM
+    } else if (graph_optimizer_type == "isam2") {
+        graph_optimizer_ptr_ = std::make_shared<ISAM2GraphOptimizer>(config_node[graph_optimizer_type + "_param"]);
+#endif
+#ifdef LIDAR_LOCALIZATION_WITH_CERES
+    } else if (graph_optimizer_type == "ceres") {
+        graph_optimizer_ptr_ = std::make_shared<CeresGraphOptimizer>(config_node[graph_optimizer_type + "_param"]);
+#endif
+    } else if (graph_optimizer_type == "sliding_window") {
+        graph_optimizer_ptr_ = std::make_shared<SlidingWindowGraphOptimizer>(config_node[graph_optimizer_type + "_param"]);
+    } else if (graph_optimizer_type == "submap") {
+        graph_optimizer_ptr_ = std::make_shared<SubmapGraphOptimizer>(config_node[graph_optimizer_type + "_param"]);
     } else {
         LOG(ERROR) << "Optimizer " << graph_optimizer_type << " NOT FOUND!";
         return false;
     }
     std::cout << "\tOptimizer:" << graph_optimizer_type << std::endl << std::endl;
 
+    save_graph_ = config_node["save_graph"].as<bool>();
+
     graph_optimizer_config_.use_gnss = config_node["use_gnss"].as<bool>();
     graph_optimizer_config_.use_loop_close = config_node["use_loop_close"].as<bool>();
 
@@ -82,17 +157,244 @@ bool BackEnd::InitDataPath(const YAML::Node& config_node) {
     scan_context_path_ = data_path + "/slam_data/scan_context";
     trajectory_path_ = data_path + "/slam_data/trajectory";
 
-    if (!FileManager::InitDirectory(key_frames_path_, "Point Cloud Key Frames"))
-        return false;
-    if (!FileManager::InitDirectory(scan_context_path_, "Scan Context Index & Data"))
+    // a restored session goes on with its outputs:
+    if (is_checkpoint_restored_) {
+        if (!FileManager::CreateDirectory(key_frames_path_, "Point Cloud Key Frames"))
+            return false;
+        if (!FileManager::CreateDirectory(scan_context_path_, "Scan Context Index & Data"))
+            return false;
+        if (!FileManager::CreateDirectory(trajectory_path_, "Estimated Trajectory"))
+            return false;
+
+        ground_truth_ofs_.open((trajectory_path_ + "/ground_truth.txt").c_str(), std::ios::app);
+        laser_odom_ofs_.open((trajectory_path_ + "/laser_odom.txt").c_str(), std::ios::app);
+        if (!ground_truth_ofs_ || !laser_odom_ofs_)
+            return false;
+    } else {
+        if (!FileManager::InitDirectory(key_frames_path_, "Point Cloud Key Frames"))
+            return false;
+        if (!FileManager::InitDirectory(scan_context_path_, "Scan Context Index & Data"))
+            return false;
+        if (!FileManager::InitDirectory(trajectory_path_, "Estimated Trajectory"))
+            return false;
+
+        if (!FileManager::CreateFile(ground_truth_ofs_, trajectory_path_ + "/ground_truth.txt"))
+            return false;
+        if (!FileManager::CreateFile(laser_odom_ofs_, trajectory_path_ + "/laser_odom.txt"))
+            return false;
+    }
+
+    // the log is rewritten on open, so the poses of a restored session are queued again, 
+    // including the ones already out of the window:
+    std::deque<Eigen::Matrix4f> optimized_pose;
+    if (is_checkpoint_restored_) {
+        TrajectoryLog::Load(trajectory_path_ + "/optimized.bin", optimized_pose);
+    }
+    optimized_pose_log_ptr_ = std::make_shared<TrajectoryLog>(
+        trajectory_path_ + "/optimized.bin", config_node["trajectory_compact_ratio"].as<float>()
+    );
+    if (!optimized_pose.empty()) {
+        optimized_pose_log_ptr_->Update(0, optimized_pose);
+    }
+
+    return true;
+}
+
+bool BackEnd::InitKeyFrameStore(const YAML::Node& config_node) {
+    std::string key_frame_store_method = config_node["key_frame_store"].as<std::string>();
+    std::cout << "\tKey Frame Store:" << key_frame_store_method << std::endl;
+
+    if (key_frame_store_method == "pcd") {
+        key_frame_store_ptr_ = std::make_shared<PCDKeyFrameStore>(key_frames_path_);
+    } else if (key_frame_store_method == "packed") {
+        key_frame_store_ptr_ = std::make_shared<PackedKeyFrameStore>(key_frames_path_, config_node[key_frame_store_method]);
+    } else {
+        LOG(ERROR) << "Key frame store " << key_frame_store_method << " NOT FOUND!";
         return false;
-    if (!FileManager::InitDirectory(trajectory_path_, "Estimated Trajectory"))
+    }
+
+    int key_frame_queue_size = config_node["key_frame_queue_size"].as<int>();
+    key_frame_writer_ptr_ = std::make_shared<KeyFrameWriter>(
+        key_frame_store_ptr_, static_cast<size_t>(std::max(key_frame_queue_size, 1))
+    );
+    std::cout << "\tKey Frame Queue Size:" << key_frame_queue_size << std::endl << std::endl;
+
+    return true;
+}
+
+bool BackEnd::InitKeyFrameSelector(const YAML::Node& config_node) {
+    std::string key_frame_selector = config_node["key_frame_selector"].as<std::string>();
+    std::cout << "\tKey Frame Selector:" << key_frame_selector << std::endl << std::endl;
+
+    if (key_frame_selector == "distance") {
+        key_frame_selector_ptr_ = std::make_shared<DistanceKeyFrameSelector>(
+            config_node["key_frame_selector_param"][key_frame_selector], "back_end_key_frame"
+        );
+    } else if (key_frame_selector == "adaptive") {
+        key_frame_selector_ptr_ = std::make_shared<AdaptiveKeyFrameSelector>(
+            config_node["key_frame_selector_param"][key_frame_selector], "back_end_key_frame"
+        );
+    } else {
+        LOG(ERROR) << "Key frame selector " << key_frame_selector << " NOT FOUND!";
         return false;
+    }
+
+    return true;
+}
+
+bool BackEnd::InitCheckpoint(const YAML::Node& config_node) {
+    const YAML::Node checkpoint_node = config_node["checkpoint"];
+    if (!checkpoint_node || !checkpoint_node["enable"].as<bool>()) {
+        return true;
+    }
 
-    if (!FileManager::CreateFile(ground_truth_ofs_, trajectory_path_ + "/ground_truth.txt"))
+    std::string data_path = config_node["data_path"].as<std::string>();
+    if (data_path == "./") {
+        data_path = WORK_SPACE_PATH;
+    }
+
+    if (
+        !FileManager::CreateDirectory(data_path + "/slam_data") ||
+        !FileManager::CreateDirectory(data_path + "/slam_data/checkpoint", "Checkpoint")
+    ) {
         return false;
-    if (!FileManager::CreateFile(laser_odom_ofs_, trajectory_path_ + "/laser_odom.txt"))
+    }
+
+    checkpoint_path_ = data_path + "/slam_data/checkpoint/back_end.bin";
+    checkpoint_interval_ = std::max(checkpoint_node["interval"].as<int>(), 1);
+
+    // only a readable log is restored, otherwise the session starts over:
+    is_checkpoint_restored_ = (
+        checkpoint_node["restore"].as<bool>() &&
+        CheckpointLog::Replay(
+            checkpoint_path_, 
+            [](uint32_t type, const char *data, size_t size) { return true; }
+        )
+    );
+
+    std::cout << "\tCheckpoint Interval:" << checkpoint_interval_ 
+              << (is_checkpoint_restored_ ? ", restored" : "") << std::endl << std::endl;
+
+    return true;
+}
+
+bool BackEnd::RestoreCheckpoint(void) {
+    TRACE_SCOPE("BackEnd::RestoreCheckpoint", "checkpoint");
+
+    // a. the last optimized pose of each key frame:
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> node_poses;
+    std::vector<bool> has_node_pose;
+    bool is_restored = CheckpointLog::Replay(
+        checkpoint_path_,
+        [&](uint32_t type, const char *data, size_t size) {
+            if (OPTIMIZED_POSE_RECORD != type) {
+                return true;
+            }
+
+            OptimizedPoseRecord record;
+            std::memcpy(&record, data, std::min(size, sizeof(record)));
+            if (size != sizeof(record) + sizeof(float) * 16 * record.num_poses) {
+                return false;
+            }
+
+            const size_t end_index = record.first_index + record.num_poses;
+            if (node_poses.size() < end_index) {
+                node_poses.resize(end_index);
+                has_node_pose.resize(end_index, false);
+            }
+            for (uint32_t i = 0; i < record.num_poses; ++i) {
+                node_poses.at(record.first_index + i) = GetPose(
+                    reinterpret_cast<const float *>(data + sizeof(record)) + 16 * i
+                );
+                has_node_pose.at(record.first_index + i) = true;
+            }
+
+            return true;
+        }
+    );
+
+    // b. the graph is rebuilt as it grew, with the nodes at their optimized poses:
+    bool is_optimized = false;
+    is_restored = is_restored && CheckpointLog::Replay(
+        checkpoint_path_,
+        [&](uint32_t type, const char *data, size_t size) {
+            if (KEY_FRAME_RECORD == type) {
+                KeyFrameRecord record;
+                if (size != sizeof(record)) {
+                    return false;
+                }
+                std::memcpy(&record, data, sizeof(record));
+
+                current_key_frame_.time = record.time;
+                current_key_frame_.index = record.index;
+                current_key_frame_.pose = GetPose(record.pose);
+                key_frames_deque_.push_back(current_key_frame_);
+                if (window_size_ > 0 && key_frames_deque_.size() > static_cast<size_t>(window_size_)) {
+                    key_frames_deque_.pop_front();
+                }
+                key_frame_num_ = record.index + 1;
+
+                current_key_gnss_.time = record.gnss_time;
+                current_key_gnss_.index = record.index;
+                current_key_gnss_.pose = GetPose(record.gnss_pose);
+
+                PoseData gnss_pose;
+                gnss_pose.time = current_key_gnss_.time;
+                gnss_pose.pose = current_key_gnss_.pose;
+                const bool has_pose = (record.index < has_node_pose.size() && has_node_pose.at(record.index));
+                AddNodeAndEdge(gnss_pose, has_pose ? &node_poses.at(record.index) : nullptr);
+            } else if (LOOP_POSE_RECORD == type) {
+                LoopPoseRecord record;
+                if (size != sizeof(record)) {
+                    return false;
+                }
+                std::memcpy(&record, data, sizeof(record));
+
+                LoopPose loop_pose;
+                loop_pose.index0 = record.index0;
+                loop_pose.index1 = record.index1;
+                loop_pose.pose = GetPose(record.pose);
+                InsertLoopPose(loop_pose);
+            } else if (OPTIMIZED_POSE_RECORD == type) {
+                OptimizedPoseRecord record;
+                std::memcpy(&record, data, std::min(size, sizeof(record)));
+
+                // as after the optimization, without running it:
+                new_key_frame_cnt_ = new_gnss_cnt_ = new_loop_cnt_ = 0;
+                MaybeMarginalize();
+
+                optimized_pose_first_index_ = (unsigned int)graph_optimizer_ptr_->GetFirstNodeIndex();
+                optimized_pose_.clear();
+                for (uint32_t i = optimized_pose_first_index_ - record.first_index; i < record.num_poses; ++i) {
+                    optimized_pose_.push_back(
+                        GetPose(reinterpret_cast<const float *>(data + sizeof(record)) + 16 * i)
+                    );
+                }
+                optimized_pose_log_ptr_->Update(optimized_pose_first_index_, optimized_pose_);
+
+                is_optimized = true;
+            }
+
+            // records of later versions are skipped:
+            return true;
+        }
+    );
+
+    if (!is_restored) {
+        LOG(ERROR) << "Failed to restore back end from checkpoint " << checkpoint_path_;
         return false;
+    }
+
+    if (is_optimized) {
+        graph_optimizer_ptr_->SetEstimateOptimized();
+        has_new_optimized_ = true;
+    }
+    last_key_frame_ = current_key_frame_;
+
+    LOG(INFO) << "Back end restored from checkpoint: " 
+              << key_frame_num_ << " key frames, "
+              << graph_optimizer_ptr_->GetNodeNum() - graph_optimizer_ptr_->GetFirstNodeIndex() << " nodes in graph."
+              << std::endl;
 
     return true;
 }
@@ -105,6 +407,22 @@ bool BackEnd::Update(const CloudData& cloud_data, const PoseData& laser_odom, co
         SavePose(ground_truth_ofs_, gnss_pose.pose);
         SavePose(laser_odom_ofs_, laser_odom.pose);
         AddNodeAndEdge(gnss_pose);
+
+        if (checkpoint_log_ptr_) {
+            KeyFrameRecord record;
+            record.time = current_key_frame_.time;
+            record.gnss_time = current_key_gnss_.time;
+            record.index = current_key_frame_.index;
+            record.reserved = 0;
+            std::memcpy(record.pose, current_key_frame_.pose.data(), sizeof(record.pose));
+            std::memcpy(record.gnss_pose, current_key_gnss_.pose.data(), sizeof(record.gnss_pose));
+            checkpoint_log_ptr_->Add(KEY_FRAME_RECORD, record);
+
+            if (++checkpoint_cnt_ >= checkpoint_interval_) {
+                checkpoint_log_ptr_->Commit();
+                checkpoint_cnt_ = 0;
+            }
+        }
         
         if (MaybeOptimized()) {
             SaveOptimizedPose();
@@ -118,6 +436,12 @@ bool BackEnd::InsertLoopPose(const LoopPose& loop_pose) {
     if (!graph_optimizer_config_.use_loop_close)
         return false;
 
+    // the older key frame may have left the sliding window already:
+    if (static_cast<int>(loop_pose.index0) < graph_optimizer_ptr_->GetFirstNodeIndex()) {
+        LOG(WARNING) << "Drop loop closure out of window: " << loop_pose.index0 << "," << loop_pose.index1;
+        return false;
+    }
+
     Eigen::Isometry3d isometry;
     isometry.matrix() = loop_pose.pose.cast<double>();
     graph_optimizer_ptr_->AddSe3Edge(
@@ -127,6 +451,15 @@ bool BackEnd::InsertLoopPose(const LoopPose& loop_pose) {
     );
 
     new_loop_cnt_ ++;
+
+    // committed with the next key frames or optimization:
+    if (checkpoint_log_ptr_) {
+        LoopPoseRecord record;
+        record.index0 = loop_pose.index0;
+        record.index1 = loop_pose.index1;
+        std::memcpy(record.pose, loop_pose.pose.data(), sizeof(record.pose));
+        checkpoint_log_ptr_->Add(LOOP_POSE_RECORD, record);
+    }
     
     LOG(INFO) << "Add loop closure: " << loop_pose.index0 << "," << loop_pose.index1 << std::endl;
 
@@ -155,38 +488,28 @@ bool BackEnd::SavePose(std::ofstream& ofs, const Eigen::Matrix4f& pose) {
 }
 
 bool BackEnd::MaybeNewKeyFrame(const CloudData& cloud_data, const PoseData& laser_odom, const PoseData& gnss_odom) {
-    static Eigen::Matrix4f last_key_pose = laser_odom.pose;
-
-    if (key_frames_deque_.size() == 0) {
-        has_new_key_frame_ = true;
-        last_key_pose = laser_odom.pose;
-    }
+    TRACE_SCOPE("BackEnd::MaybeNewKeyFrame", "key_frame");
 
-    // whether the current scan is far away enough from last key frame:
-    if (fabs(laser_odom.pose(0,3) - last_key_pose(0,3)) + 
-        fabs(laser_odom.pose(1,3) - last_key_pose(1,3)) +
-        fabs(laser_odom.pose(2,3) - last_key_pose(2,3)) > key_frame_distance_) {
-
-        has_new_key_frame_ = true;
-        last_key_pose = laser_odom.pose;
-    }
+    // whether the current scan adds enough to the last key frame, the first scan always does:
+    has_new_key_frame_ = key_frame_selector_ptr_->Select(laser_odom.time, laser_odom.pose, cloud_data.cloud_ptr);
 
     // if so:
     if (has_new_key_frame_) {
-        // a. first write new key scan to disk:
-        std::string file_path = key_frames_path_ + "/key_frame_" + std::to_string(key_frames_deque_.size()) + ".pcd";
-        pcl::io::savePCDFileBinary(file_path, *cloud_data.cloud_ptr);
-        current_key_scan_.time = cloud_data.time;
-        current_key_scan_.cloud_ptr.reset(
-            new CloudData::CLOUD(*cloud_data.cloud_ptr)
-        );
+        // a. first queue new key scan for disk write, the writer & the publisher share the incoming scan,
+        //    which no one modifies once it is synced:
+        current_key_scan_time_ = cloud_data.time;
+        current_key_scan_ptr_ = cloud_data.cloud_ptr;
+        key_frame_writer_ptr_->Write(key_frame_num_, current_key_scan_ptr_);
 
         // b. create key frame index for lidar scan:
         KeyFrame key_frame;
         key_frame.time = laser_odom.time;
-        key_frame.index = (unsigned int)key_frames_deque_.size();
+        key_frame.index = key_frame_num_++;
         key_frame.pose = laser_odom.pose;
         key_frames_deque_.push_back(key_frame);
+        if (window_size_ > 0 && key_frames_deque_.size() > static_cast<size_t>(window_size_)) {
+            key_frames_deque_.pop_front();
+        }
         current_key_frame_ = key_frame;
 
         // c. create key frame index for GNSS/IMU pose:
@@ -198,12 +521,10 @@ bool BackEnd::MaybeNewKeyFrame(const CloudData& cloud_data, const PoseData& lase
     return has_new_key_frame_;
 }
 
-bool BackEnd::AddNodeAndEdge(const PoseData& gnss_data) {
-    static KeyFrame last_key_frame = current_key_frame_;
-
+bool BackEnd::AddNodeAndEdge(const PoseData& gnss_data, const Eigen::Matrix4f* node_pose_ptr) {
     // add node for new key frame pose:
     Eigen::Isometry3d isometry;
-    isometry.matrix() = current_key_frame_.pose.cast<double>();
+    isometry.matrix() = (node_pose_ptr ? *node_pose_ptr : current_key_frame_.pose).cast<double>();
     // fix the pose of the first key frame:
     if (!graph_optimizer_config_.use_gnss && graph_optimizer_ptr_->GetNodeNum() == 0)
         graph_optimizer_ptr_->AddSe3Node(isometry, true);
@@ -214,11 +535,11 @@ bool BackEnd::AddNodeAndEdge(const PoseData& gnss_data) {
     // add edge for new key frame:
     int node_num = graph_optimizer_ptr_->GetNodeNum();
     if (node_num > 1) {
-        Eigen::Matrix4f relative_pose = last_key_frame.pose.inverse() * current_key_frame_.pose;
+        Eigen::Matrix4f relative_pose = last_key_frame_.pose.inverse() * current_key_frame_.pose;
         isometry.matrix() = relative_pose.cast<double>();
         graph_optimizer_ptr_->AddSe3Edge(node_num-2, node_num-1, isometry, graph_optimizer_config_.odom_edge_noise);
     }
-    last_key_frame = current_key_frame_;
+    last_key_frame_ = current_key_frame_;
 
     // add prior for new key frame pose using GNSS/IMU estimation:
     if (graph_optimizer_config_.use_gnss) {
@@ -251,42 +572,122 @@ bool BackEnd::MaybeOptimized() {
     // reset key frame counters:
     new_key_frame_cnt_ = new_gnss_cnt_ = new_loop_cnt_ = 0;
 
-    if (graph_optimizer_ptr_->Optimize())
+    if (graph_optimizer_ptr_->Optimize()) {
         has_new_optimized_ = true;
+        CommitOptimizedPose();
+        MaybeMarginalize();
+    }
 
     return true;
 }
 
-bool BackEnd::SaveOptimizedPose() {
-    if (graph_optimizer_ptr_->GetNodeNum() == 0)
+bool BackEnd::MaybeMarginalize() {
+    if (window_size_ <= 0)
         return false;
 
-    if (!FileManager::CreateFile(optimized_pose_ofs_, trajectory_path_ + "/optimized.txt"))
+    int first_index = graph_optimizer_ptr_->GetFirstNodeIndex();
+    std::deque<Eigen::Matrix4f> optimized_pose;
+    graph_optimizer_ptr_->GetOptimizedPose(optimized_pose);
+
+    if (!graph_optimizer_ptr_->RemoveOldestSe3Nodes(window_size_))
+        return false;
+
+    // poses of the removed key frames are final, log them before they are gone:
+    optimized_pose_log_ptr_->Update(first_index, optimized_pose);
+
+    return true;
+}
+
+bool BackEnd::SaveOptimizedPose() {
+    if (graph_optimizer_ptr_->GetNodeNum() == 0)
         return false;
 
     graph_optimizer_ptr_->GetOptimizedPose(optimized_pose_);
+    optimized_pose_first_index_ = (unsigned int)graph_optimizer_ptr_->GetFirstNodeIndex();
 
-    for (size_t i = 0; i < optimized_pose_.size(); ++i) {
-        SavePose(optimized_pose_ofs_, optimized_pose_.at(i));
+    // only poses changed since the last call are written:
+    return optimized_pose_log_ptr_->Update(optimized_pose_first_index_, optimized_pose_);
+}
+
+void BackEnd::CommitOptimizedPose() {
+    if (!checkpoint_log_ptr_)
+        return;
+
+    std::deque<Eigen::Matrix4f> optimized_pose;
+    graph_optimizer_ptr_->GetOptimizedPose(optimized_pose);
+
+    OptimizedPoseRecord record;
+    record.first_index = static_cast<uint32_t>(graph_optimizer_ptr_->GetFirstNodeIndex());
+    record.num_poses = static_cast<uint32_t>(optimized_pose.size());
+
+    std::vector<char> data(sizeof(record) + sizeof(float) * 16 * optimized_pose.size());
+    std::memcpy(data.data(), &record, sizeof(record));
+    for (size_t i = 0; i < optimized_pose.size(); ++i) {
+        std::memcpy(&data.at(sizeof(record) + sizeof(float) * 16 * i), optimized_pose.at(i).data(), sizeof(float) * 16);
     }
 
-    return true;
+    checkpoint_log_ptr_->Add(OPTIMIZED_POSE_RECORD, data.data(), data.size());
+    checkpoint_log_ptr_->Commit();
+    checkpoint_cnt_ = 0;
 }
 
 bool BackEnd::ForceOptimize() {
-    if (graph_optimizer_ptr_->Optimize())
+    // make sure all key scans are on disk before the optimized key frames go out, the queue is bounded:
+    key_frame_writer_ptr_->Flush();
+
+    KeyFrameWriter::Stats stats = key_frame_writer_ptr_->GetStats();
+    LOG(INFO) << "Key frame writer: " 
+              << stats.num_written << " written, " 
+              << stats.num_failed << " failed, "
+              << stats.num_blocked << " blocked, "
+              << "max queue depth " << stats.max_queue_depth << std::endl;
+
+    if (graph_optimizer_ptr_->Optimize()) {
         has_new_optimized_ = true;
+        CommitOptimizedPose();
+        MaybeMarginalize();
+    }
 
     SaveOptimizedPose();
+    // key frames since the last commit included, on disk after SaveOptimized:
+    if (checkpoint_log_ptr_) {
+        checkpoint_log_ptr_->Commit();
+        checkpoint_cnt_ = 0;
+    }
+    // the graph cannot be copied for the background, so it is written here:
+    if (save_graph_) {
+        graph_optimizer_ptr_->SaveGraph(trajectory_path_ + "/graph.g2o");
+    }
 
     return has_new_optimized_;
 }
 
+bool BackEnd::SaveOptimized(const std::function<void(double progress, const std::string& message)>& progress) {
+    if (checkpoint_log_ptr_) {
+        progress(0.0, "checkpoint");
+        checkpoint_log_ptr_->Flush();
+    }
+
+    // text trajectory for evo evaluation. patches queued after ForceOptimize may be exported as well:
+    progress(0.3, "optimized pose log");
+    optimized_pose_log_ptr_->Flush();
+    TrajectoryLog::Stats trajectory_stats = optimized_pose_log_ptr_->GetStats();
+    LOG(INFO) << "Optimized pose log: " 
+              << trajectory_stats.num_poses << " poses, "
+              << trajectory_stats.num_patches << " patches, "
+              << trajectory_stats.num_poses_written << " poses written, "
+              << trajectory_stats.num_compactions << " compactions, "
+              << trajectory_stats.num_failed << " failed" << std::endl;
+
+    progress(0.6, "KITTI export");
+    return TrajectoryLog::ExportKITTI(trajectory_path_ + "/optimized.bin", trajectory_path_ + "/optimized.txt");
+}
+
 void BackEnd::GetOptimizedKeyFrames(std::deque<KeyFrame>& key_frames_deque) {
     KeyFrame key_frame;
     for (size_t i = 0; i < optimized_pose_.size(); ++i) {
         key_frame.pose = optimized_pose_.at(i);
-        key_frame.index = (unsigned int)i;
+        key_frame.index = optimized_pose_first_index_ + (unsigned int)i;
         key_frames_deque.push_back(key_frame);
     }
 }
@@ -299,11 +700,9 @@ bool BackEnd::HasNewOptimized() {
     return has_new_optimized_;
 }
 
-void BackEnd::GetLatestKeyScan(CloudData& key_scan) {
-    key_scan.time = current_key_scan_.time;
-    key_scan.cloud_ptr.reset(
-        new CloudData::CLOUD(*current_key_scan_.cloud_ptr)
-    );
+void BackEnd::GetLatestKeyScan(double& time, CloudData::CLOUD::ConstPtr& key_scan_ptr) {
+    time = current_key_scan_time_;
+    key_scan_ptr = current_key_scan_ptr_;
 }
 
 void BackEnd::GetLatestKeyFrame(KeyFrame& key_frame) {
@@ -313,4 +712,12 @@ void BackEnd::GetLatestKeyFrame(KeyFrame& key_frame) {
 void BackEnd::GetLatestKeyGNSS(KeyFrame& key_frame) {
     key_frame = current_key_gnss_;
 }
+
+size_t BackEnd::GetKeyFramesMemoryUsage(void) const {
+    return lidar_localization::GetMemoryUsage(key_frames_deque_) + lidar_localization::GetMemoryUsage(optimized_pose_);
+}
+
+size_t BackEnd::GetGraphMemoryUsage(void) const {
+    return graph_optimizer_ptr_->GetMemoryUsage();
+}
 }
\ No newline at end of file
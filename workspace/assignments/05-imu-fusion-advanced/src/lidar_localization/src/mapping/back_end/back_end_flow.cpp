@@ -4,10 +4,12 @@
  * @Date: 2020-02-10 08:38:42
  */
 #include "lidar_localization/mapping/back_end/back_end_flow.hpp"
+#include "lidar_localization/tools/tracer.hpp"
 
 #include "glog/logging.h"
 
 #include "lidar_localization/tools/file_manager.hpp"
+#include "lidar_localization/tools/memory_usage.hpp"
 #include "lidar_localization/global_defination/global_defination.h"
 
 namespace lidar_localization {
@@ -21,12 +23,30 @@ BackEndFlow::BackEndFlow(ros::NodeHandle& nh, std::string cloud_topic, std::stri
     key_scan_pub_ptr_ = std::make_shared<CloudPublisher>(nh, "/key_scan", "/velo_link", 100);
     key_frame_pub_ptr_ = std::make_shared<KeyFramePublisher>(nh, "/key_frame", "/map", 100);
     key_gnss_pub_ptr_ = std::make_shared<KeyFramePublisher>(nh, "/key_gnss", "/map", 100);
-    key_frames_pub_ptr_ = std::make_shared<KeyFramesPublisher>(nh, "/optimized_key_frames", "/map", 100);
+    YAML::Node config_node = YAML::LoadFile(WORK_SPACE_PATH + "/config/mapping/back_end.yaml");
+    key_frames_pub_ptr_ = std::make_shared<KeyFramesPublisher>(
+        nh, "/optimized_key_frames", "/map", 100, config_node["optimized_key_frames"]
+    );
 
     back_end_ptr_ = std::make_shared<BackEnd>();
+
+    metrics_.AddQueue("cloud_queue", [this]{ return cloud_data_buff_.size(); });
+    metrics_.AddQueue("gnss_queue", [this]{ return gnss_pose_data_buff_.size(); });
+    metrics_.AddQueue("laser_odom_queue", [this]{ return laser_odom_data_buff_.size(); });
+    metrics_.AddMemory("cloud_queue", [this]{ return GetMemoryUsage(cloud_data_buff_); });
+    metrics_.AddMemory("key_frames", [this]{ return back_end_ptr_->GetKeyFramesMemoryUsage(); });
+    metrics_.AddMemory("graph", [this]{ return back_end_ptr_->GetGraphMemoryUsage(); });
+    dropped_clouds_ptr_ = &metrics_.AddCounter("dropped_clouds");
+    dropped_gnss_ptr_ = &metrics_.AddCounter("dropped_gnss");
+    dropped_laser_odom_ptr_ = &metrics_.AddCounter("dropped_laser_odom");
+    inserted_loop_poses_ptr_ = &metrics_.AddCounter("inserted_loop_poses");
 }
 
 bool BackEndFlow::Run() {
+    TRACE_SCOPE("BackEndFlow::Run", "flow");
+    metrics_.UpdateQueues();
+    metrics_.UpdateMemory();
+
     // load messages into buffer:
     if (!ReadData())
         return false;
@@ -39,6 +59,7 @@ bool BackEndFlow::Run() {
         if (!ValidData())
             continue;
 
+        ScopedLatency latency(metrics_.GetLatency());
         UpdateBackEnd();
 
         PublishData();
@@ -48,13 +69,22 @@ bool BackEndFlow::Run() {
 }
 
 bool BackEndFlow::ForceOptimize() {
+    GetForceOptimizeJob()([](double progress, const std::string& message) {});
+    return true;
+}
+
+BackgroundJobs::Job BackEndFlow::GetForceOptimizeJob() {
     back_end_ptr_->ForceOptimize();
     if (back_end_ptr_->HasNewOptimized()) {
         std::deque<KeyFrame> optimized_key_frames;
         back_end_ptr_->GetOptimizedKeyFrames(optimized_key_frames);
         key_frames_pub_ptr_->Publish(optimized_key_frames);
     }
-    return true;
+
+    std::shared_ptr<BackEnd> back_end_ptr = back_end_ptr_;
+    return [back_end_ptr](const BackgroundJobs::Progress& progress) {
+        return back_end_ptr->SaveOptimized(progress);
+    };
 }
 
 bool BackEndFlow::ReadData() {
@@ -70,6 +100,7 @@ bool BackEndFlow::MaybeInsertLoopPose() {
     while (loop_pose_data_buff_.size() > 0) {
         back_end_ptr_->InsertLoopPose(loop_pose_data_buff_.front());
         loop_pose_data_buff_.pop_front();
+        inserted_loop_poses_ptr_->Increment();
     }
     return true;
 }
@@ -95,16 +126,19 @@ bool BackEndFlow::ValidData() {
 
     if (diff_gnss_time < -0.05 || diff_laser_time < -0.05) {
         cloud_data_buff_.pop_front();
+        dropped_clouds_ptr_->Increment();
         return false;
     }
 
     if (diff_gnss_time > 0.05) {
         gnss_pose_data_buff_.pop_front();
+        dropped_gnss_ptr_->Increment();
         return false;
     }
 
     if (diff_laser_time > 0.05) {
         laser_odom_data_buff_.pop_front();
+        dropped_laser_odom_ptr_->Increment();
         return false;
     }
 
@@ -135,10 +169,11 @@ bool BackEndFlow::PublishData() {
     transformed_odom_pub_ptr_->Publish(current_laser_odom_data_.pose, current_laser_odom_data_.time);
 
     if (back_end_ptr_->HasNewKeyFrame()) {
-        CloudData key_scan;
+        double key_scan_time = 0.0;
+        CloudData::CLOUD::ConstPtr key_scan_ptr;
 
-        back_end_ptr_->GetLatestKeyScan(key_scan);
-        key_scan_pub_ptr_->Publish(key_scan.cloud_ptr, key_scan.time);
+        back_end_ptr_->GetLatestKeyScan(key_scan_time, key_scan_ptr);
+        key_scan_pub_ptr_->Publish(key_scan_ptr, key_scan_time);
         
         KeyFrame key_frame;
 
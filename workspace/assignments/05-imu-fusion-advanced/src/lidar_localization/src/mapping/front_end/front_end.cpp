@@ -6,6 +6,7 @@
 #include "lidar_localization/mapping/front_end/front_end.hpp"
 
 #include <fstream>
+#include <algorithm>
 #include <boost/filesystem.hpp>
 #include <pcl/common/transforms.h>
 #include <pcl/io/pcd_io.h>
@@ -13,9 +14,24 @@
 
 #include "lidar_localization/global_defination/global_defination.h"
 #include "lidar_localization/tools/print_info.hpp"
+#include "lidar_localization/tools/cloud_pool.hpp"
+#include "lidar_localization/tools/cloud_assembler.hpp"
 #include "lidar_localization/models/registration/ndt_registration.hpp"
+#include "lidar_localization/models/registration/ndt_omp_registration.hpp"
+#include "lidar_localization/models/registration/vgicp_registration.hpp"
+#include "lidar_localization/models/registration/icp_plane_registration.hpp"
+#include "lidar_localization/models/registration/loam_registration.hpp"
+#include "lidar_localization/models/registration/async_registration.hpp"
 #include "lidar_localization/models/cloud_filter/voxel_filter.hpp"
+#include "lidar_localization/models/cloud_filter/voxel_filter_fast.hpp"
+#include "lidar_localization/models/cloud_filter/voxel_filter_adaptive.hpp"
+#include "lidar_localization/models/cloud_filter/filter_chain.hpp"
+#include "lidar_localization/models/cloud_filter/ground_filter.hpp"
 #include "lidar_localization/models/cloud_filter/no_filter.hpp"
+#include "lidar_localization/models/local_map/voxel_hash_map.hpp"
+#include "lidar_localization/models/key_frame_selector/distance_key_frame_selector.hpp"
+#include "lidar_localization/models/key_frame_selector/adaptive_key_frame_selector.hpp"
+#include "lidar_localization/tools/metrics.hpp"
 
 namespace lidar_localization {
 FrontEnd::FrontEnd()
@@ -24,6 +40,19 @@ FrontEnd::FrontEnd()
     InitWithConfig();
 }
 
+FrontEnd::~FrontEnd() {
+    if (!map_thread_.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(map_job_mutex_);
+        stop_ = true;
+    }
+    has_map_job_.notify_one();
+
+    map_thread_.join();
+}
+
 bool FrontEnd::InitWithConfig() {
     std::string config_file_path = WORK_SPACE_PATH + "/config/mapping/front_end.yaml";
     YAML::Node config_node = YAML::LoadFile(config_file_path);
@@ -31,25 +60,56 @@ bool FrontEnd::InitWithConfig() {
     std::cout << "-----------------Init Lidar Frontend-------------------" << std::endl;
     InitParam(config_node);
     InitRegistration(registration_ptr_, config_node);
+    // scans keep matching against the previous local map while a new key frame is added to it:
+    if (
+        config_node["async_registration_target"].as<bool>() && 
+        !registration_ptr_->HasIncrementalTarget()
+    ) {
+        std::shared_ptr<RegistrationInterface> next_registration_ptr;
+        InitRegistration(next_registration_ptr, config_node);
+        registration_ptr_ = std::make_shared<AsyncRegistration>(registration_ptr_, next_registration_ptr);
+    }
     InitFilter("local_map", local_map_filter_ptr_, config_node);
     InitFilter("frame", frame_filter_ptr_, config_node);
+    InitLocalMap(config_node);
+    InitKeyFrameSelector(config_node);
+    InitMotionPrior(config_node);
+    InitTwoRateOdometry(config_node);
 
     return true;
 }
 
 bool FrontEnd::InitParam(const YAML::Node& config_node) {
-    key_frame_distance_ = config_node["key_frame_distance"].as<float>();
     local_frame_num_ = config_node["local_frame_num"].as<int>();
 
+    const YAML::Node& compact_key_frames_node = config_node["compact_key_frames"];
+    if (compact_key_frames_node && compact_key_frames_node["enable"].as<bool>()) {
+        compact_key_frame_resolution_ = compact_key_frames_node["resolution"].as<float>();
+    }
+
     return true;
 }
 
 bool FrontEnd::InitRegistration(std::shared_ptr<RegistrationInterface>& registration_ptr, const YAML::Node& config_node) {
-    std::string registration_method = config_node["registration_method"].as<std::string>();
+    return InitRegistration(registration_ptr, config_node["registration_method"].as<std::string>(), config_node);
+}
+
+bool FrontEnd::InitRegistration(
+    std::shared_ptr<RegistrationInterface>& registration_ptr, 
+    const std::string& registration_method, const YAML::Node& config_node
+) {
     std::cout << "\tPoint Cloud Registration Method: " << registration_method << std::endl;
 
     if (registration_method == "NDT") {
         registration_ptr = std::make_shared<NDTRegistration>(config_node[registration_method]);
+    } else if (registration_method == "NDT_OMP") {
+        registration_ptr = std::make_shared<NDTOMPRegistration>(config_node[registration_method]);
+    } else if (registration_method == "VGICP") {
+        registration_ptr = std::make_shared<VGICPRegistration>(config_node[registration_method]);
+    } else if (registration_method == "ICP_PLANE") {
+        registration_ptr = std::make_shared<ICPPlaneRegistration>(config_node[registration_method]);
+    } else if (registration_method == "LOAM") {
+        registration_ptr = std::make_shared<LOAMRegistration>(config_node[registration_method]);
     } else {
         LOG(ERROR) << "Registration method " << registration_method << " NOT FOUND!";
         return false;
@@ -64,6 +124,14 @@ bool FrontEnd::InitFilter(std::string filter_user, std::shared_ptr<CloudFilterIn
 
     if (filter_mothod == "voxel_filter") {
         filter_ptr = std::make_shared<VoxelFilter>(config_node[filter_mothod][filter_user]);
+    } else if (filter_mothod == "voxel_filter_fast") {
+        filter_ptr = std::make_shared<FastVoxelFilter>(config_node[filter_mothod][filter_user]);
+    } else if (filter_mothod == "voxel_filter_adaptive") {
+        filter_ptr = std::make_shared<AdaptiveVoxelFilter>(config_node[filter_mothod][filter_user]);
+    } else if (filter_mothod == "filter_chain") {
+        filter_ptr = std::make_shared<FilterChain>(config_node[filter_mothod][filter_user]);
+    } else if (filter_mothod == "ground_filter") {
+        filter_ptr = std::make_shared<GroundFilter>(config_node[filter_mothod][filter_user]);
     } else if (filter_mothod == "no_filter") {
         filter_ptr = std::make_shared<NoFilter>();
     } else {
@@ -74,91 +142,355 @@ bool FrontEnd::InitFilter(std::string filter_user, std::shared_ptr<CloudFilterIn
     return true;
 }
 
+bool FrontEnd::InitLocalMap(const YAML::Node& config_node) {
+    std::string local_map_update = config_node["local_map_update"].as<std::string>();
+    std::cout << "\tLocal Map Update Method: " << local_map_update << std::endl;
+
+    if (local_map_update == "incremental") {
+        std::string local_map_filter = config_node["local_map_filter"].as<std::string>();
+        if (local_map_filter != "voxel_filter" && local_map_filter != "voxel_filter_fast") {
+            LOG(WARNING) << "Incremental local map requires voxel_filter or voxel_filter_fast as local_map_filter. Fall back to full_rebuild.";
+            return false;
+        }
+        local_map_voxels_ptr_ = std::make_shared<VoxelHashMap>(config_node[local_map_filter]["local_map"]);
+    } else if (local_map_update != "full_rebuild") {
+        LOG(ERROR) << "Local map update method " << local_map_update << " NOT FOUND!";
+        return false;
+    }
+
+    return true;
+}
+
+bool FrontEnd::InitKeyFrameSelector(const YAML::Node& config_node) {
+    std::string key_frame_selector = config_node["key_frame_selector"].as<std::string>();
+    std::cout << "\tKey Frame Selector: " << key_frame_selector << std::endl;
+
+    if (key_frame_selector == "distance") {
+        key_frame_selector_ptr_ = std::make_shared<DistanceKeyFrameSelector>(
+            config_node["key_frame_selector_param"][key_frame_selector], "front_end_key_frame"
+        );
+    } else if (key_frame_selector == "adaptive") {
+        key_frame_selector_ptr_ = std::make_shared<AdaptiveKeyFrameSelector>(
+            config_node["key_frame_selector_param"][key_frame_selector], "front_end_key_frame"
+        );
+    } else {
+        LOG(ERROR) << "Key frame selector " << key_frame_selector << " NOT FOUND!";
+        return false;
+    }
+
+    return true;
+}
+
+bool FrontEnd::InitMotionPrior(const YAML::Node& config_node) {
+    std::string motion_prior = config_node["motion_prior"].as<std::string>();
+    std::cout << "\tMotion Prior: " << motion_prior << std::endl;
+
+    if (motion_prior == "imu") {
+        imu_motion_prior_ptr_ = std::make_shared<IMUMotionPrior>(config_node[motion_prior]);
+    } else if (motion_prior != "constant_velocity") {
+        LOG(ERROR) << "Motion prior " << motion_prior << " NOT FOUND!";
+        return false;
+    }
+
+    return true;
+}
+
+bool FrontEnd::InitTwoRateOdometry(const YAML::Node& config_node) {
+    const YAML::Node& two_rate_node = config_node["two_rate_odometry"];
+    if (!two_rate_node || !two_rate_node["enable"].as<bool>())
+        return true;
+
+    map_interval_ = std::max(two_rate_node["map_interval"].as<int>(), 1);
+    std::cout << "\tTwo-Rate Odometry: scan-to-map refinement every " << map_interval_ << " scans at least, scan-to-scan" << std::endl;
+
+    // parameters of the scan-to-scan backend are under two_rate_odometry:
+    if (
+        !InitRegistration(
+            scan_to_scan_registration_ptr_, two_rate_node["registration_method"].as<std::string>(), two_rate_node
+        )
+    ) {
+        return false;
+    }
+
+    map_thread_ = std::thread(&FrontEnd::RunMapMatching, this);
+
+    return true;
+}
+
+bool FrontEnd::SetLidarToIMU(const Eigen::Matrix4f& lidar_to_imu) {
+    if (!imu_motion_prior_ptr_)
+        return false;
+
+    imu_motion_prior_ptr_->SetLidarToIMU(lidar_to_imu);
+    return true;
+}
+
+bool FrontEnd::AddIMUData(const IMUData& imu_data) {
+    if (!imu_motion_prior_ptr_)
+        return false;
+
+    imu_motion_prior_ptr_->AddIMUData(imu_data);
+    return true;
+}
+
 bool FrontEnd::SetInitPose(const Eigen::Matrix4f& init_pose) {
     init_pose_ = init_pose;
     return true;
 }
 
 bool FrontEnd::Update(const CloudData& cloud_data, Eigen::Matrix4f& cloud_pose) {
-    static Eigen::Matrix4f step_pose = Eigen::Matrix4f::Identity();
-    static Eigen::Matrix4f last_pose = init_pose_;
-    static Eigen::Matrix4f predict_pose = init_pose_;
-    static Eigen::Matrix4f last_key_frame_pose = init_pose_;
+    // metrics are process-wide, shared by all instances:
+    static Counter& num_imu_predictions = MetricsRegistry::GetInstance().GetCounter("front_end.imu_predictions");
+    static Counter& num_registration_iterations = MetricsRegistry::GetInstance().GetCounter("front_end.registration_iterations");
 
     // 
     // set up current scan:
     // 
     current_frame_.cloud_data.time = cloud_data.time;
-    // a. remove invalid measurements:
+    // a. remove invalid measurements, into a new cloud, so that a key frame can keep the previous one:
+    current_frame_.cloud_data.cloud_ptr = CloudPool::GetInstance().Get();
     std::vector<int> indices;
     pcl::removeNaNFromPointCloud(*cloud_data.cloud_ptr, *current_frame_.cloud_data.cloud_ptr, indices);
-    // b. apply filter to current scan:
-    CloudData::CLOUD_PTR filtered_cloud_ptr(new CloudData::CLOUD());
-    frame_filter_ptr_->Filter(current_frame_.cloud_data.cloud_ptr, filtered_cloud_ptr);
+    // the range image from ingest still holds as long as no point was removed, key frames do not keep it:
+    if (indices.size() == cloud_data.cloud_ptr->points.size()) {
+        current_frame_.cloud_data.range_image_ptr = cloud_data.range_image_ptr;
+    }
+    // b. apply filter to current scan, into a cloud of its choice, e.g. the scan itself without filtering:
+    CloudData::CLOUD_PTR filtered_cloud_ptr;
+    frame_filter_ptr_->Filter(current_frame_.cloud_data, filtered_cloud_ptr);
+    current_frame_.cloud_data.range_image_ptr.reset();
 
     //
     // set up local map:
     //
     if (local_map_frames_.size() == 0) {
+        step_pose_ = Eigen::Matrix4f::Identity();
+        last_pose_ = predict_pose_ = init_pose_;
+        last_time_ = cloud_data.time;
+        last_vel_ = Eigen::Vector3f::Zero();
+
         current_frame_.pose = init_pose_;
+        key_frame_selector_ptr_->Select(current_frame_.cloud_data.time, current_frame_.pose, filtered_cloud_ptr);
         UpdateWithNewFrame(current_frame_);
+        last_filtered_cloud_ptr_ = filtered_cloud_ptr;
         cloud_pose = current_frame_.pose;
         return true;
     }
 
+    // two-rate odometry, a finished refinement corrects the state the prediction starts from:
+    if (scan_to_scan_registration_ptr_) {
+        ApplyMapRefinement();
+        predict_pose_ = last_pose_ * step_pose_;
+    }
+
     // 
     // update lidar odometry using scan match result:
     // 
-    CloudData::CLOUD_PTR result_cloud_ptr(new CloudData::CLOUD());
-    registration_ptr_->ScanMatch(filtered_cloud_ptr, predict_pose, result_cloud_ptr, current_frame_.pose);
+    // IMU mechanization since the last scan, constant velocity if the measurements are not available:
+    if (
+        imu_motion_prior_ptr_ &&
+        imu_motion_prior_ptr_->Predict(last_time_, last_pose_, last_vel_, cloud_data.time, predict_pose_)
+    ) {
+        num_imu_predictions.Increment();
+    }
+
+    if (scan_to_scan_registration_ptr_) {
+        return UpdateTwoRate(filtered_cloud_ptr, cloud_pose);
+    }
+
+    CloudData::CLOUD_PTR result_cloud_ptr = CloudPool::GetInstance().Get();
+    registration_ptr_->ScanMatch(filtered_cloud_ptr, predict_pose_, result_cloud_ptr, current_frame_.pose);
     cloud_pose = current_frame_.pose;
+    if (registration_ptr_->GetNumIterations() > 0) {
+        num_registration_iterations.Increment(registration_ptr_->GetNumIterations());
+    }
 
     //
     // update init pose for next scan match:
     //
-    step_pose = last_pose.inverse() * current_frame_.pose;
-    predict_pose = current_frame_.pose * step_pose;
-    last_pose = current_frame_.pose;
+    UpdateMotion(cloud_data.time);
 
     // 
     // shall the key frame set be updated:
     //
-    if (fabs(last_key_frame_pose(0,3) - current_frame_.pose(0,3)) + 
-        fabs(last_key_frame_pose(1,3) - current_frame_.pose(1,3)) +
-        fabs(last_key_frame_pose(2,3) - current_frame_.pose(2,3)) > key_frame_distance_) {
+    // the filtered scan is what the local map is matched with, its overlap is measured on it too:
+    if (key_frame_selector_ptr_->Select(current_frame_.cloud_data.time, current_frame_.pose, filtered_cloud_ptr)) {
         UpdateWithNewFrame(current_frame_);
-        last_key_frame_pose = current_frame_.pose;
     }
 
     return true;
 }
 
+void FrontEnd::UpdateMotion(double time) {
+    step_pose_ = last_pose_.inverse() * current_frame_.pose;
+    predict_pose_ = current_frame_.pose * step_pose_;
+    if (time > last_time_) {
+        last_vel_ = (current_frame_.pose.block<3, 1>(0, 3) - last_pose_.block<3, 1>(0, 3)) / (time - last_time_);
+    }
+    last_pose_ = current_frame_.pose;
+    last_time_ = time;
+}
+
+bool FrontEnd::UpdateTwoRate(const CloudData::CLOUD_PTR& filtered_cloud_ptr, Eigen::Matrix4f& cloud_pose) {
+    // scan-to-scan, in the lidar frame of the previous scan:
+    Eigen::Matrix4f relative_pose = Eigen::Matrix4f::Identity();
+    CloudData::CLOUD_PTR result_cloud_ptr = CloudPool::GetInstance().Get();
+    scan_to_scan_registration_ptr_->SetInputTarget(last_filtered_cloud_ptr_);
+    scan_to_scan_registration_ptr_->ScanMatch(
+        filtered_cloud_ptr, last_pose_.inverse() * predict_pose_, result_cloud_ptr, relative_pose
+    );
+    current_frame_.pose = last_pose_ * relative_pose;
+    cloud_pose = current_frame_.pose;
+
+    UpdateMotion(current_frame_.cloud_data.time);
+    last_filtered_cloud_ptr_ = filtered_cloud_ptr;
+
+    // the scan is refined against the local map once the worker is free, otherwise the next one is:
+    if (++num_scans_since_map_ >= map_interval_) {
+        std::lock_guard<std::mutex> lock(map_job_mutex_);
+        if (MAP_JOB_NONE == map_job_state_) {
+            map_job_frame_ = current_frame_;
+            map_job_cloud_ptr_ = filtered_cloud_ptr;
+            map_job_state_ = MAP_JOB_PENDING;
+            num_scans_since_map_ = 0;
+            has_map_job_.notify_one();
+        }
+    }
+
+    return true;
+}
+
+void FrontEnd::ApplyMapRefinement(void) {
+    static Counter& num_map_refinements = MetricsRegistry::GetInstance().GetCounter("front_end.map_refinements");
+    static Counter& num_registration_iterations = MetricsRegistry::GetInstance().GetCounter("front_end.registration_iterations");
+
+    {
+        std::lock_guard<std::mutex> lock(map_job_mutex_);
+        if (MAP_JOB_DONE != map_job_state_)
+            return;
+    }
+    num_map_refinements.Increment();
+    if (registration_ptr_->GetNumIterations() > 0) {
+        num_registration_iterations.Increment(registration_ptr_->GetNumIterations());
+    }
+
+    // the scan-to-scan drift up to the refined scan is removed from the latest pose, in map frame:
+    const Eigen::Matrix4f correction = map_job_pose_ * map_job_frame_.pose.inverse();
+    last_pose_ = correction * last_pose_;
+    last_vel_ = correction.block<3, 3>(0, 0) * last_vel_;
+
+    // key frames are selected among the refined scans only:
+    map_job_frame_.pose = map_job_pose_;
+    if (key_frame_selector_ptr_->Select(map_job_frame_.cloud_data.time, map_job_frame_.pose, map_job_cloud_ptr_)) {
+        UpdateWithNewFrame(map_job_frame_);
+    }
+    map_job_frame_ = Frame();
+    map_job_cloud_ptr_.reset();
+
+    std::lock_guard<std::mutex> lock(map_job_mutex_);
+    map_job_state_ = MAP_JOB_NONE;
+}
+
+void FrontEnd::RunMapMatching(void) {
+    std::unique_lock<std::mutex> lock(map_job_mutex_);
+
+    while (true) {
+        has_map_job_.wait(lock, [this]{ return stop_ || MAP_JOB_PENDING == map_job_state_; });
+        // a pending job is dropped on exit:
+        if (stop_)
+            break;
+        lock.unlock();
+
+        CloudData::CLOUD_PTR result_cloud_ptr = CloudPool::GetInstance().Get();
+        if (!registration_ptr_->ScanMatch(map_job_cloud_ptr_, map_job_frame_.pose, result_cloud_ptr, map_job_pose_)) {
+            map_job_pose_ = map_job_frame_.pose;
+        }
+
+        lock.lock();
+        map_job_state_ = MAP_JOB_DONE;
+    }
+}
+
 bool FrontEnd::UpdateWithNewFrame(const Frame& new_key_frame) {
     Frame key_frame = new_key_frame;
-    // 这一步的目的是为了把关键帧的点云保存下来
-    // 由于用的是共享指针，所以直接复制只是复制了一个指针而已
-    // 此时无论你放多少个关键帧在容器里，这些关键帧点云指针都是指向的同一个点云
-    key_frame.cloud_data.cloud_ptr.reset(new CloudData::CLOUD(*new_key_frame.cloud_data.cloud_ptr));
+    key_frame.id = num_key_frames_++;
+    // 关键帧与当前帧共享点云，不再拷贝：
+    // 每一帧的点云都是新分配的，放入关键帧之后不再被修改
     
     // keep only the latest local_frame_num_ frames:
     local_map_frames_.push_back(key_frame);
+    std::deque<Frame> evicted_frames;
     while (local_map_frames_.size() > static_cast<size_t>(local_frame_num_)) {
+        evicted_frames.push_back(local_map_frames_.front());
         local_map_frames_.pop_front();
     }
 
+    // the new key frame in map frame:
+    CloudData::CLOUD_PTR transformed_cloud_ptr = CloudPool::GetInstance().Get();
+    pcl::transformPointCloud(
+        *key_frame.cloud_data.cloud_ptr, 
+        *transformed_cloud_ptr, 
+        key_frame.pose
+    );
+
+    // backends with cached per-frame target work only need the new and the evicted frames:
+    if (registration_ptr_->HasIncrementalTarget()) {
+        for (const auto &evicted_frame: evicted_frames) {
+            registration_ptr_->RemoveTargetFrame(evicted_frame.id);
+        }
+
+        CloudData::CLOUD_PTR filtered_cloud_ptr = CloudPool::GetInstance().Get();
+        local_map_filter_ptr_->Filter(transformed_cloud_ptr, filtered_cloud_ptr);
+        // scan pose, for backends that project the frame back into its range image:
+        filtered_cloud_ptr->sensor_origin_ << key_frame.pose.block<3, 1>(0, 3), 1.0f;
+        filtered_cloud_ptr->sensor_orientation_ = Eigen::Quaternionf(key_frame.pose.block<3, 3>(0, 0));
+        registration_ptr_->AddTargetFrame(key_frame.id, filtered_cloud_ptr);
+
+        return true;
+    }
+
+    // incremental local map, only the new and the evicted frames are touched:
+    if (local_map_voxels_ptr_) {
+        for (const auto &evicted_frame: evicted_frames) {
+            local_map_voxels_ptr_->RemoveFrame(evicted_frame.id);
+        }
+        local_map_voxels_ptr_->AddFrame(key_frame.id, transformed_cloud_ptr);
+
+        // scan-to-map matching:
+        // set target as local map, unfiltered while the window is still short:
+        if (local_map_frames_.size() < 10 && evicted_frames.empty()) {
+            *local_map_ptr_ += *transformed_cloud_ptr;
+            registration_ptr_->SetInputTarget(local_map_ptr_);
+        } else {
+            local_map_voxels_ptr_->GetMap(local_map_ptr_);
+            registration_ptr_->SetInputTarget(local_map_ptr_);
+        }
+
+        return true;
+    }
+
+    // the window keeps the new key frame quantized, its full scan goes back to the pool with the current frame:
+    if (compact_key_frame_resolution_ > 0.0f && !local_map_frames_.empty()) {
+        Frame& stored_frame = local_map_frames_.back();
+        stored_frame.compact_cloud_ptr = std::make_shared<const CompactCloud>(
+            *stored_frame.cloud_data.cloud_ptr, compact_key_frame_resolution_
+        );
+        stored_frame.cloud_data.cloud_ptr.reset();
+    }
+
     // transform all local frame measurements to map frame
     // to create local map:
     local_map_ptr_.reset(new CloudData::CLOUD());
-    CloudData::CLOUD_PTR transformed_cloud_ptr(new CloudData::CLOUD());
+    CloudAssembler local_map_assembler;
     for (size_t i = 0; i < local_map_frames_.size(); ++i) {
-        pcl::transformPointCloud(
-            *local_map_frames_.at(i).cloud_data.cloud_ptr, 
-            *transformed_cloud_ptr, 
-            local_map_frames_.at(i).pose
-        );
-
-        *local_map_ptr_ += *transformed_cloud_ptr;
+        const Frame& local_map_frame = local_map_frames_.at(i);
+        if (local_map_frame.compact_cloud_ptr) {
+            local_map_assembler.Add(local_map_frame.compact_cloud_ptr, local_map_frame.pose);
+        } else {
+            local_map_assembler.Add(local_map_frame.cloud_data.cloud_ptr, local_map_frame.pose);
+        }
     }
+    local_map_assembler.Assemble(*local_map_ptr_);
 
     // scan-to-map matching:
     // set target as local map:
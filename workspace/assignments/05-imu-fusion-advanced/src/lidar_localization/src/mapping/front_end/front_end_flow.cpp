@@ -4,6 +4,7 @@
  * @Date: 2020-02-10 08:38:42
  */
 #include "lidar_localization/mapping/front_end/front_end_flow.hpp"
+#include "lidar_localization/tools/tracer.hpp"
 #include "glog/logging.h"
 #include "lidar_localization/global_defination/global_defination.h"
 
@@ -13,18 +14,38 @@ FrontEndFlow::FrontEndFlow(ros::NodeHandle& nh, std::string cloud_topic, std::st
     laser_odom_pub_ptr_ = std::make_shared<OdometryPublisher>(nh, odom_topic, "/map", "/lidar", 100);
 
     front_end_ptr_ = std::make_shared<FrontEnd>();
+    if (front_end_ptr_->HasIMUMotionPrior()) {
+        std::string imu_topic;
+        nh.param<std::string>("imu_topic", imu_topic, "/kitti/oxts/imu");
+        imu_sub_ptr_ = std::make_shared<IMUSubscriber>(nh, imu_topic, 1000000);
+        lidar_to_imu_ptr_ = std::make_shared<TFListener>(nh, "/imu_link", "/velo_link");
+    }
+
+    metrics_.AddQueue("cloud_queue", [this]{ return cloud_data_buff_.size(); });
+    failed_updates_ptr_ = &metrics_.AddCounter("failed_updates");
+    latency_tracer_ptr_ = std::make_shared<LatencyTracer>(nh, "front_end", cloud_topic, odom_topic, metrics_);
 }
 
 bool FrontEndFlow::Run() {
+    TRACE_SCOPE("FrontEndFlow::Run", "flow");
+    metrics_.UpdateQueues();
+
     if (!ReadData())
         return false;
 
+    if (!InitCalibration())
+        return false;
+
     while(HasData()) {
         if (!ValidData())
             continue;
 
+        ScopedLatency latency(metrics_.GetLatency());
+        latency_tracer_ptr_->Start(current_cloud_data_.time);
         if (UpdateLaserOdometry()) {
             PublishData();
+        } else {
+            failed_updates_ptr_->Increment();
         }
     }
 
@@ -33,11 +54,47 @@ bool FrontEndFlow::Run() {
 
 bool FrontEndFlow::ReadData() {
     cloud_sub_ptr_->ParseData(cloud_data_buff_);
+
+    if (imu_sub_ptr_) {
+        imu_sub_ptr_->ParseData(imu_data_buff_);
+        while (imu_data_buff_.size() > 0) {
+            front_end_ptr_->AddIMUData(imu_data_buff_.front());
+            imu_data_buff_.pop_front();
+        }
+    }
+
     return true;
 }
 
+bool FrontEndFlow::InitCalibration() {
+    if (!lidar_to_imu_ptr_ || front_end_ptr_->HasLidarToIMU())
+        return true;
+
+    Eigen::Matrix4f lidar_to_imu = Eigen::Matrix4f::Identity();
+    if (lidar_to_imu_ptr_->LookupData(lidar_to_imu)) {
+        front_end_ptr_->SetLidarToIMU(lidar_to_imu);
+        return true;
+    }
+
+    return false;
+}
+
 bool FrontEndFlow::HasData() {
-    return cloud_data_buff_.size() > 0;
+    if (cloud_data_buff_.size() == 0)
+        return false;
+
+    // wait for the IMU measurements after the scan, only briefly, so that a lost IMU
+    // doesn't stall the odometry, the front end falls back to constant velocity then:
+    const size_t MAX_WAITING_CLOUDS = 5;
+    if (
+        imu_sub_ptr_ && 
+        !front_end_ptr_->HasIMUData(cloud_data_buff_.front().time) &&
+        cloud_data_buff_.size() < MAX_WAITING_CLOUDS
+    ) {
+        return false;
+    }
+
+    return true;
 }
 
 bool FrontEndFlow::ValidData() {
@@ -48,9 +105,8 @@ bool FrontEndFlow::ValidData() {
 }
 
 bool FrontEndFlow::UpdateLaserOdometry() {
-    static bool odometry_inited = false;
-    if (!odometry_inited) {
-        odometry_inited = true;
+    if (!odometry_inited_) {
+        odometry_inited_ = true;
         // init lidar odometry:
         front_end_ptr_->SetInitPose(Eigen::Matrix4f::Identity());
     }
@@ -60,6 +116,7 @@ bool FrontEndFlow::UpdateLaserOdometry() {
 }
 
 bool FrontEndFlow::PublishData() {
+    latency_tracer_ptr_->Publish();
     laser_odom_pub_ptr_->Publish(laser_odometry_, current_cloud_data_.time);
 
     return true;
@@ -0,0 +1,110 @@
+/*
+ * @Description: recent loop candidate verifications, for the deduplication of proposals along a revisit
+ * @Author: Ge Yao
+ * @Date: 2021-01-29 09:47:31
+ */
+#include "lidar_localization/mapping/loop_closing/loop_candidate_cache.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+namespace lidar_localization {
+
+LoopCandidateCache::LoopCandidateCache(const YAML::Node& node) {
+    index_window_ = node["index_window"].as<int>();
+    time_window_ = node["time_window"].as<double>();
+    warm_start_window_ = node["warm_start_window"].as<int>();
+    max_size_ = static_cast<size_t>(std::max(node["max_size"].as<int>(), 1));
+
+    std::cout << "\tLoop Candidate Cache: index window " << index_window_
+              << ", time window " << time_window_ << " s"
+              << ", warm start window " << warm_start_window_
+              << ", max size " << max_size_ << std::endl;
+}
+
+LoopCandidateCache::Decision LoopCandidateCache::Lookup(
+    const KeyFrame& map_key_frame, const KeyFrame& key_frame, Eigen::Matrix4f& relative_pose
+) {
+    ++stats_.num_lookups;
+
+    const int map_index = static_cast<int>(map_key_frame.index);
+    const int index = static_cast<int>(key_frame.index);
+
+    // newest first, so the warm start is from the closest accepted entry along the revisit:
+    const Entry* warm_start_entry = nullptr;
+    for (auto it = entries_.rbegin(); it != entries_.rend(); ++it) {
+        const int map_index_change = map_index - static_cast<int>(it->map_key_frame.index);
+        const int index_change = index - static_cast<int>(it->key_frame.index);
+
+        if (
+            std::abs(map_index_change) <= index_window_ && std::abs(index_change) <= index_window_ &&
+            key_frame.time - it->key_frame.time <= time_window_
+        ) {
+            ++stats_.num_suppressed;
+            return SUPPRESS;
+        }
+
+        if (
+            nullptr == warm_start_entry && ACCEPTED == it->state &&
+            std::abs(index_change - map_index_change) <= index_window_ && std::abs(index_change) <= warm_start_window_
+        ) {
+            warm_start_entry = &(*it);
+        }
+    }
+
+    if (nullptr == warm_start_entry)
+        return VERIFY;
+
+    //   T_map,query = T_map,map' * T_map',query' * T_query',query, key frame to key frame by odometry:
+    relative_pose = (
+        map_key_frame.pose.inverse() * warm_start_entry->map_key_frame.pose *
+        warm_start_entry->relative_pose *
+        warm_start_entry->key_frame.pose.inverse() * key_frame.pose
+    );
+    ++stats_.num_warm_starts;
+
+    return WARM_START;
+}
+
+void LoopCandidateCache::Add(const KeyFrame& map_key_frame, const KeyFrame& key_frame) {
+    Entry entry;
+    entry.map_key_frame = map_key_frame;
+    entry.key_frame = key_frame;
+    entries_.push_back(entry);
+
+    while (entries_.size() > max_size_) {
+        entries_.pop_front();
+    }
+}
+
+void LoopCandidateCache::SetResult(
+    unsigned int map_index, unsigned int index, bool is_accepted, const Eigen::Matrix4f& relative_pose
+) {
+    Entry* entry = Find(map_index, index);
+    if (nullptr == entry)
+        return;
+
+    entry->state = is_accepted ? ACCEPTED : REJECTED;
+    entry->relative_pose = relative_pose;
+}
+
+void LoopCandidateCache::Remove(unsigned int map_index, unsigned int index) {
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->map_key_frame.index == map_index && it->key_frame.index == index) {
+            entries_.erase(it);
+            return;
+        }
+    }
+}
+
+LoopCandidateCache::Entry* LoopCandidateCache::Find(unsigned int map_index, unsigned int index) {
+    for (auto it = entries_.rbegin(); it != entries_.rend(); ++it) {
+        if (it->map_key_frame.index == map_index && it->key_frame.index == index)
+            return &(*it);
+    }
+
+    return nullptr;
+}
+
+} // namespace lidar_localization
@@ -6,39 +6,105 @@
 #include "lidar_localization/mapping/loop_closing/loop_closing.hpp"
 
 #include <cmath>
+#include <cstring>
 #include <algorithm>
 #include <limits>
+#include <sstream>
 
-#include <pcl/common/transforms.h>
 #include <pcl/io/pcd_io.h>
 
 #include "glog/logging.h"
 
 #include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/file_manager.hpp"
+#include "lidar_localization/tools/memory_usage.hpp"
 #include "lidar_localization/models/registration/ndt_registration.hpp"
+#include "lidar_localization/models/registration/ndt_omp_registration.hpp"
+#include "lidar_localization/models/registration/pyramid_registration.hpp"
+#include "lidar_localization/models/key_frame_store/pcd_key_frame_store.hpp"
+#include "lidar_localization/models/key_frame_store/packed_key_frame_store.hpp"
 #include "lidar_localization/models/cloud_filter/voxel_filter.hpp"
+#include "lidar_localization/models/cloud_filter/voxel_filter_fast.hpp"
+#include "lidar_localization/models/cloud_filter/voxel_filter_adaptive.hpp"
+#include "lidar_localization/models/cloud_filter/filter_chain.hpp"
+#include "lidar_localization/models/cloud_filter/ground_filter.hpp"
 #include "lidar_localization/models/cloud_filter/no_filter.hpp"
 #include "lidar_localization/tools/print_info.hpp"
+#include "lidar_localization/tools/task_scheduler.hpp"
+#include "lidar_localization/tools/cloud_assembler.hpp"
 
 namespace lidar_localization {
+namespace {
+// checkpoint records, poses are column-major:
+enum CheckpointRecordType : uint32_t {
+    // followed by num_rings ring key & num_rings x num_sectors column-major scan context floats:
+    KEY_FRAME_RECORD = 1
+};
+
+struct KeyFrameRecord {
+    double time;
+    double gnss_time;
+    uint32_t index;
+    uint32_t gnss_index;
+    uint32_t num_rings;
+    uint32_t num_sectors;
+    float pose[16];
+    float gnss_pose[16];
+};
+}
+
 LoopClosing::LoopClosing() {
     InitWithConfig();
 }
 
+LoopClosing::~LoopClosing() {
+    if (!verification_thread_.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    has_task_.notify_one();
+
+    // pending tasks are dropped, nobody is left to publish their loop poses:
+    verification_thread_.join();
+}
+
 bool LoopClosing::InitWithConfig() {
     std::string config_file_path = WORK_SPACE_PATH + "/config/mapping/loop_closing.yaml";
     YAML::Node config_node = YAML::LoadFile(config_file_path);
 
     std::cout << "-----------------Init Loop-Closing Detection-------------------" << std::endl;
     InitParam(config_node);
+    // before the key frame cache is initialized, a restored session keeps it:
+    InitCheckpoint(config_node);
     InitDataPath(config_node);
-
     InitFilter("map", map_filter_ptr_, config_node);
     InitFilter("scan", scan_filter_ptr_, config_node);
 
+    InitKeyFrameStore(config_node);
+
     InitLoopClosure(config_node);
 
-    InitRegistration(registration_ptr_, config_node);
+    if (is_checkpoint_restored_) {
+        RestoreCheckpoint();
+    }
+    if (!checkpoint_path_.empty()) {
+        checkpoint_log_ptr_ = std::make_shared<CheckpointLog>(checkpoint_path_, !is_checkpoint_restored_);
+    }
+
+    registration_ptrs_.resize(num_loop_candidates_);
+    for (auto &registration_ptr: registration_ptrs_) {
+        InitRegistration(registration_ptr, config_node);
+    }
+    InitPreAlignment(config_node);
+    InitCandidateCache(config_node);
+    InitTargetCache(config_node);
+
+    InitVerification(config_node);
+    // prefetch runs on the verifier thread:
+    InitPrefetch(config_node);
 
     return true;
 }
@@ -46,9 +112,15 @@ bool LoopClosing::InitWithConfig() {
 bool LoopClosing::InitParam(const YAML::Node& config_node) {
     extend_frame_num_ = config_node["extend_frame_num"].as<int>();
     loop_step_ = config_node["loop_step"].as<int>();
+    skip_cnt_ = 0;
+    skip_num_ = loop_step_;
     diff_num_ = config_node["diff_num"].as<int>();
     detect_area_ = config_node["detect_area"].as<float>();
+    key_gnss_index_ptr_ = std::make_shared<KeyFrameGridIndex>(detect_area_);
     fitness_score_limit_ = config_node["fitness_score_limit"].as<float>();
+    num_loop_candidates_ = std::max(config_node["num_loop_candidates"].as<int>(), 1);
+
+    std::cout << "\tNum. Loop Candidates: " << num_loop_candidates_ << std::endl;
 
     return true;
 }
@@ -59,9 +131,59 @@ bool LoopClosing::InitDataPath(const YAML::Node& config_node) {
         data_path = WORK_SPACE_PATH;
     }
 
-    key_frames_path_ = data_path + "/slam_data/key_frames";
     scan_context_path_ = data_path + "/slam_data/scan_context";
 
+    const std::string key_frame_source = config_node["key_frame_source"].as<std::string>();
+    std::cout << "\tKey Frame Source: " << key_frame_source << std::endl;
+
+    if (key_frame_source == "local") {
+        key_frames_path_ = data_path + "/slam_data/key_frames";
+    } else if (key_frame_source == "stream") {
+        // back end may run on another host, so nothing of its slam_data is assumed here:
+        is_key_frame_streamed_ = true;
+        key_frames_path_ = data_path + "/slam_data/key_frame_cache";
+
+        if (!FileManager::CreateDirectory(data_path + "/slam_data"))
+            return false;
+        // the key scans of a restored session are not streamed again:
+        if (is_checkpoint_restored_) {
+            if (!FileManager::CreateDirectory(key_frames_path_, "Streamed Key Frame Cache"))
+                return false;
+        } else if (!FileManager::InitDirectory(key_frames_path_, "Streamed Key Frame Cache")) {
+            return false;
+        }
+        if (!FileManager::CreateDirectory(scan_context_path_, "Scan Context Index & Data"))
+            return false;
+    } else {
+        LOG(ERROR) << "Key frame source " << key_frame_source << " NOT FOUND!";
+        return false;
+    }
+
+    return true;
+}
+
+bool LoopClosing::InitKeyFrameStore(const YAML::Node& config_node) {
+    std::string key_frame_store_method = config_node["key_frame_store"].as<std::string>();
+    std::cout << "\tKey Frame Store: " << key_frame_store_method << std::endl;
+
+    if (key_frame_store_method == "pcd") {
+        key_frame_store_ptr_ = std::make_shared<PCDKeyFrameStore>(key_frames_path_);
+    } else if (key_frame_store_method == "packed") {
+        key_frame_store_ptr_ = std::make_shared<PackedKeyFrameStore>(key_frames_path_, config_node[key_frame_store_method]);
+    } else {
+        LOG(ERROR) << "Key frame store " << key_frame_store_method << " NOT FOUND!";
+        return false;
+    }
+
+    // key scans are cached after map filtering, consecutive loop candidates share most of them:
+    int key_scan_cache_size = config_node["key_scan_cache_size"].as<int>();
+    float key_scan_cache_resolution = config_node["key_scan_cache_resolution"] ? 
+        config_node["key_scan_cache_resolution"].as<float>() : 0.0f;
+    key_scan_cache_ptr_ = std::make_shared<KeyScanCache>(
+        key_frame_store_ptr_, map_filter_ptr_, static_cast<size_t>(std::max(key_scan_cache_size, 0)), 
+        key_scan_cache_resolution
+    );
+
     return true;
 }
 
@@ -75,6 +197,14 @@ bool LoopClosing::InitFilter(
 
     if (filter_mothod == "voxel_filter") {
         filter_ptr = std::make_shared<VoxelFilter>(config_node[filter_mothod][filter_user]);
+    } else if (filter_mothod == "voxel_filter_fast") {
+        filter_ptr = std::make_shared<FastVoxelFilter>(config_node[filter_mothod][filter_user]);
+    } else if (filter_mothod == "voxel_filter_adaptive") {
+        filter_ptr = std::make_shared<AdaptiveVoxelFilter>(config_node[filter_mothod][filter_user]);
+    } else if (filter_mothod == "filter_chain") {
+        filter_ptr = std::make_shared<FilterChain>(config_node[filter_mothod][filter_user]);
+    } else if (filter_mothod == "ground_filter") {
+        filter_ptr = std::make_shared<GroundFilter>(config_node[filter_mothod][filter_user]);
     } else if (filter_mothod == "no_filter") {
         filter_ptr =std::make_shared<NoFilter>();
     } else {
@@ -101,6 +231,10 @@ bool LoopClosing::InitRegistration(std::shared_ptr<RegistrationInterface>& regis
 
     if (registration_method == "NDT") {
         registration_ptr = std::make_shared<NDTRegistration>(config_node[registration_method]);
+    } else if (registration_method == "NDT_OMP") {
+        registration_ptr = std::make_shared<NDTOMPRegistration>(config_node[registration_method]);
+    } else if (registration_method == "PYRAMID") {
+        registration_ptr = std::make_shared<PyramidRegistration>(config_node[registration_method]);
     } else {
         LOG(ERROR) << "Registration method " << registration_method << " NOT FOUND!";
         return false;
@@ -109,200 +243,772 @@ bool LoopClosing::InitRegistration(std::shared_ptr<RegistrationInterface>& regis
     return true;
 }
 
+bool LoopClosing::InitPreAlignment(const YAML::Node& config_node) {
+    const YAML::Node& pre_alignment_node = config_node["pre_alignment"];
+    if (!pre_alignment_node || !pre_alignment_node["enable"].as<bool>()) {
+        pre_alignment_ptr_.reset();
+        return true;
+    }
+
+    std::cout << "\tPre-Alignment Method: FPFH_RANSAC" << std::endl;
+    pre_alignment_ptr_ = std::make_shared<FPFHRansacAlignment>(pre_alignment_node);
+
+    return true;
+}
+
+bool LoopClosing::InitVerification(const YAML::Node& config_node) {
+    bool async_verification = config_node["async_verification"].as<bool>();
+    verification_queue_size_ = static_cast<size_t>(
+        std::max(config_node["verification_queue_size"].as<int>(), 1)
+    );
+    std::string verification_queue_policy = config_node["verification_queue_policy"].as<std::string>();
+
+    std::cout << "\tLoop Verification: " << (async_verification ? "async" : "sync") 
+              << ", queue size " << verification_queue_size_ 
+              << ", policy " << verification_queue_policy << std::endl;
+
+    if (verification_queue_policy == "coalesce") {
+        coalesce_verification_ = true;
+    } else if (verification_queue_policy == "drop") {
+        coalesce_verification_ = false;
+    } else {
+        LOG(ERROR) << "Verification queue policy " << verification_queue_policy << " NOT FOUND!";
+        return false;
+    }
+
+    // verification stays inline unless the verifier thread is running:
+    if (async_verification) {
+        async_verification_ = true;
+        verification_thread_ = std::thread(&LoopClosing::RunVerification, this);
+    }
+
+    return true;
+}
+
+bool LoopClosing::InitCandidateCache(const YAML::Node& config_node) {
+    const YAML::Node& candidate_cache_node = config_node["candidate_cache"];
+    if (!candidate_cache_node || !candidate_cache_node["enable"].as<bool>()) {
+        candidate_cache_ptr_.reset();
+        return true;
+    }
+
+    candidate_cache_ptr_ = std::make_shared<LoopCandidateCache>(candidate_cache_node);
+
+    return true;
+}
+
+bool LoopClosing::InitTargetCache(const YAML::Node& config_node) {
+    const YAML::Node& target_cache_node = config_node["target_cache"];
+    if (!target_cache_node || !target_cache_node["enable"].as<bool>()) {
+        target_cache_ptr_.reset();
+        target_window_stride_ = 1;
+        return true;
+    }
+
+    target_cache_ptr_ = std::make_shared<RegistrationTargetCache>(
+        static_cast<size_t>(std::max(target_cache_node["size"].as<int>(), 0))
+    );
+    // the candidate key frame must stay within its window:
+    target_window_stride_ = std::max(
+        std::min(target_cache_node["window_stride"].as<int>(), extend_frame_num_), 1
+    );
+
+    std::cout << "\tTarget Cache Window Stride: " << target_window_stride_ << std::endl;
+
+    return true;
+}
+
+bool LoopClosing::InitPrefetch(const YAML::Node& config_node) {
+    const YAML::Node& prefetch_node = config_node["prefetch"];
+    prefetch_ = prefetch_node && prefetch_node["enable"].as<bool>();
+    if (!prefetch_)
+        return true;
+
+    if (!async_verification_) {
+        LOG(WARNING) << "Key scan prefetch needs async verification, disabled.";
+        prefetch_ = false;
+        return false;
+    }
+
+    prefetch_radius_ = std::max(prefetch_node["radius"].as<float>(), detect_area_);
+    prefetch_margin_frame_num_ = std::max(prefetch_node["margin_frame_num"].as<int>(), 0);
+    prefetch_target_ = prefetch_node["build_target"].as<bool>() && target_cache_ptr_;
+
+    std::cout << "\tKey Scan Prefetch: radius " << prefetch_radius_ 
+              << ", margin " << prefetch_margin_frame_num_ << " key frames"
+              << (prefetch_target_ ? ", with target" : "") << std::endl;
+
+    return true;
+}
+
+bool LoopClosing::InitCheckpoint(const YAML::Node& config_node) {
+    const YAML::Node checkpoint_node = config_node["checkpoint"];
+    if (!checkpoint_node || !checkpoint_node["enable"].as<bool>()) {
+        return true;
+    }
+
+    std::string data_path = config_node["data_path"].as<std::string>();
+    if (data_path == "./") {
+        data_path = WORK_SPACE_PATH;
+    }
+
+    if (
+        !FileManager::CreateDirectory(data_path + "/slam_data") ||
+        !FileManager::CreateDirectory(data_path + "/slam_data/checkpoint", "Checkpoint")
+    ) {
+        return false;
+    }
+
+    checkpoint_path_ = data_path + "/slam_data/checkpoint/loop_closing.bin";
+    checkpoint_interval_ = std::max(checkpoint_node["interval"].as<int>(), 1);
+
+    // only a readable log is restored, otherwise the session starts over:
+    is_checkpoint_restored_ = (
+        checkpoint_node["restore"].as<bool>() &&
+        CheckpointLog::Replay(
+            checkpoint_path_, 
+            [](uint32_t type, const char *data, size_t size) { return true; }
+        )
+    );
+
+    std::cout << "\tCheckpoint Interval:" << checkpoint_interval_ 
+              << (is_checkpoint_restored_ ? ", restored" : "") << std::endl;
+
+    return true;
+}
+
+bool LoopClosing::RestoreCheckpoint(void) {
+    std::vector<float> scan_context;
+    ScanContextManager::RingKey ring_key;
+
+    bool is_restored = CheckpointLog::Replay(
+        checkpoint_path_,
+        [&](uint32_t type, const char *data, size_t size) {
+            // records of later versions are skipped:
+            if (KEY_FRAME_RECORD != type) {
+                return true;
+            }
+
+            KeyFrameRecord record;
+            if (size < sizeof(record)) {
+                return false;
+            }
+            std::memcpy(&record, data, sizeof(record));
+            const size_t num_floats = record.num_rings * (1 + record.num_sectors);
+            if (size != sizeof(record) + sizeof(float) * num_floats) {
+                return false;
+            }
+
+            KeyFrame key_frame;
+            key_frame.time = record.time;
+            key_frame.index = record.index;
+            std::memcpy(key_frame.pose.data(), record.pose, sizeof(record.pose));
+
+            KeyFrame key_gnss;
+            key_gnss.time = record.gnss_time;
+            key_gnss.index = record.gnss_index;
+            std::memcpy(key_gnss.pose.data(), record.gnss_pose, sizeof(record.gnss_pose));
+
+            const float *descriptors = reinterpret_cast<const float *>(data + sizeof(record));
+            ring_key.assign(descriptors, descriptors + record.num_rings);
+            scan_context.assign(descriptors + record.num_rings, descriptors + num_floats);
+            // a log of another scan context resolution cannot be restored:
+            if (!scan_context_manager_ptr_->Update(scan_context, ring_key, key_gnss)) {
+                return false;
+            }
+
+            all_key_frames_.push_back(key_frame);
+            key_gnss_index_ptr_->Add(static_cast<int>(all_key_gnss_.size()), key_gnss.pose.block<3, 1>(0, 3));
+            all_key_gnss_.push_back(key_gnss);
+
+            return true;
+        }
+    );
+
+    if (!is_restored) {
+        LOG(ERROR) << "Failed to restore loop closing from checkpoint " << checkpoint_path_;
+        return false;
+    }
+
+    LOG(INFO) << "Loop closing restored from checkpoint: " << all_key_frames_.size() << " key frames." << std::endl;
+
+    return true;
+}
+
 bool LoopClosing::Update(
     const CloudData &key_scan, 
     const KeyFrame &key_frame, 
     const KeyFrame &key_gnss
 ) {
-    static int key_frame_index = 0;
-    static float yaw_change_in_rad = 0.0f;
-
-    has_new_loop_pose_ = false;
+    // each key scan is received once, and saved before any loop candidate can refer to it:
+    if (is_key_frame_streamed_ && !key_frame_store_ptr_->Save(key_frame.index, *key_scan.cloud_ptr)) {
+        LOG(WARNING) << "Failed to cache streamed key frame " << key_frame.index;
+    }
 
     scan_context_manager_ptr_->Update(
         key_scan, key_gnss
     );
 
     all_key_frames_.push_back(key_frame);
+    key_gnss_index_ptr_->Add(static_cast<int>(all_key_gnss_.size()), key_gnss.pose.block<3, 1>(0, 3));
     all_key_gnss_.push_back(key_gnss);
 
-    if (!DetectNearestKeyFrame(key_frame_index, yaw_change_in_rad))
+    if (checkpoint_log_ptr_) {
+        std::vector<float> scan_context;
+        ScanContextManager::RingKey ring_key;
+        scan_context_manager_ptr_->GetLatestDescriptors(scan_context, ring_key);
+
+        KeyFrameRecord record;
+        record.time = key_frame.time;
+        record.gnss_time = key_gnss.time;
+        record.index = key_frame.index;
+        record.gnss_index = key_gnss.index;
+        record.num_rings = ring_key.size();
+        record.num_sectors = ring_key.empty() ? 0 : scan_context.size() / ring_key.size();
+        std::memcpy(record.pose, key_frame.pose.data(), sizeof(record.pose));
+        std::memcpy(record.gnss_pose, key_gnss.pose.data(), sizeof(record.gnss_pose));
+
+        std::vector<char> data(sizeof(record) + sizeof(float) * (ring_key.size() + scan_context.size()));
+        std::memcpy(data.data(), &record, sizeof(record));
+        std::memcpy(data.data() + sizeof(record), ring_key.data(), sizeof(float) * ring_key.size());
+        std::memcpy(
+            data.data() + sizeof(record) + sizeof(float) * ring_key.size(), 
+            scan_context.data(), sizeof(float) * scan_context.size()
+        );
+        checkpoint_log_ptr_->Add(KEY_FRAME_RECORD, data.data(), data.size());
+
+        if (++checkpoint_cnt_ >= checkpoint_interval_) {
+            checkpoint_log_ptr_->Commit();
+            checkpoint_cnt_ = 0;
+        }
+    }
+
+    std::vector<std::pair<int, float>> proposals;
+    if (!DetectNearestKeyFrame(proposals))
         return false;
 
-    if (!CloudRegistration(key_frame_index, yaw_change_in_rad))
+    VerificationTask task;
+    GetVerificationTask(proposals, key_scan, task);
+    ReportCandidateCache(key_frame.time);
+    if (task.candidates.empty())
         return false;
 
-    has_new_loop_pose_ = true;
-    return true;
+    if (async_verification_)
+        return AddVerificationTask(task);
+
+    LoopPose loop_pose;
+    bool is_found = CloudRegistration(task, loop_pose);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.num_verified;
+    if (is_found) {
+        loop_poses_.push_back(loop_pose);
+        ++stats_.num_loop_poses;
+    }
+
+    return is_found;
 }
 
 bool LoopClosing::DetectNearestKeyFrame(
-    int& key_frame_index,
-    float& yaw_change_in_rad
+    std::vector<std::pair<int, float>>& proposals
 ) {
-    static int skip_cnt = 0;
-    static int skip_num = loop_step_;
+
+    proposals.clear();
     
-    // only perform loop closure detection for every skip_num key frames:
-    if (++skip_cnt < skip_num)
+    // only perform loop closure detection for every skip_num_ key frames:
+    if (++skip_cnt_ < skip_num_)
+        return false;
+
+    const int N = static_cast<int>(all_key_gnss_.size());
+    const Eigen::Vector3f current_position = all_key_gnss_.back().pose.block<3, 1>(0, 3);
+
+    // closest GNSS/IMU key frame with enough seq. distance, 
+    // candidates before extend_frame_num are skipped as they have no valid local map:
+    float key_frame_distance = std::numeric_limits<float>::max();
+    const int nearest_key_frame_id = key_gnss_index_ptr_->GetNearest(
+        current_position, extend_frame_num_, std::min(N - diff_num_, N - 2), key_frame_distance
+    );
+    if (KeyFrameGridIndex::NONE == nearest_key_frame_id)
+        return false;
+
+    // the closest key frame is likely to be verified within the next detections:
+    if (prefetch_ && key_frame_distance <= prefetch_radius_) {
+        RequestPrefetch(nearest_key_frame_id);
+    }
+
+    // update detection interval using the closest key frame:
+    skip_cnt_ = 0;
+    if (key_frame_distance > detect_area_) {
+        skip_num_ = std::max((int)(key_frame_distance / 2.0), loop_step_);
         return false;
+    }
 
     #ifndef SCAN_CONTEXT
-        // generate loop-closure proposal using scan context match:
-        std::pair<int, float> proposal = scan_context_manager_ptr_->DetectLoopClosure();
-        const int proposed_key_frame_id = proposal.first;
-        const float proposed_yaw_change = proposal.second;
+        // generate loop-closure proposals using scan context match, best first,
+        // only key frames within detect area by RTK position are compared:
+        std::vector<int> nearby_key_frame_ids;
+        key_gnss_index_ptr_->GetInRadius(
+            current_position, detect_area_, extend_frame_num_, N - 1, nearby_key_frame_ids
+        );
+        const auto is_nearby = [&nearby_key_frame_ids](int key_frame_id) {
+            return std::binary_search(nearby_key_frame_ids.begin(), nearby_key_frame_ids.end(), key_frame_id);
+        };
 
-        // check proposal validity:
-        if (ScanContextManager::NONE == proposed_key_frame_id) {
+        if (!scan_context_manager_ptr_->DetectLoopClosure(num_loop_candidates_, is_nearby, proposals)) {
+            // try again with the next key frame:
+            skip_num_ = 1;
             return false;
         }
+    #else
+        // this orientation compensation is not available for GNSS/IMU proposal:
+        proposals.emplace_back(nearest_key_frame_id, 0.0f);
+    #endif
 
-        // check RTK position difference:
-        const KeyFrame &current_key_frame = all_key_gnss_.back();
-        const KeyFrame &proposed_key_frame = all_key_gnss_.at(proposed_key_frame_id);
+    skip_num_ = loop_step_;
+    return true;
+}
+
+void LoopClosing::GetVerificationTask(
+    const std::vector<std::pair<int, float>>& proposals,
+    const CloudData& key_scan,
+    VerificationTask& task
+) {
+    task.candidates.clear();
+    for (const auto &proposal: proposals) {
+        const int key_frame_index = proposal.first;
+
+        LoopCandidate candidate;
+        candidate.yaw_change_in_rad = proposal.second;
+        candidate.key_frame = all_key_frames_.at(key_frame_index);
+        candidate.key_gnss = all_key_gnss_.at(key_frame_index);
+        if (candidate_cache_ptr_) {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            // a revisited segment proposes about the same pair of key frames again and again:
+            const LoopCandidateCache::Decision decision = candidate_cache_ptr_->Lookup(
+                candidate.key_frame, all_key_frames_.back(), candidate.warm_start_pose
+            );
+            if (LoopCandidateCache::SUPPRESS == decision)
+                continue;
 
-        Eigen::Vector3f translation = (
-            current_key_frame.pose.block<3, 1>(0, 3) - proposed_key_frame.pose.block<3, 1>(0, 3)
+            candidate.has_warm_start = (LoopCandidateCache::WARM_START == decision);
+            candidate_cache_ptr_->Add(candidate.key_frame, all_key_frames_.back());
+        }
+        GetMapKeyFrames(key_frame_index, candidate.map_key_frames);
+
+        task.candidates.push_back(candidate);
+    }
+
+    task.key_scan = key_scan;
+    task.key_frame = all_key_frames_.back();
+    task.key_gnss = all_key_gnss_.back();
+}
+
+void LoopClosing::GetMapKeyFrames(int key_frame_index, std::vector<KeyFrame>& map_key_frames) const {
+    // rounded to the nearest stride, within the key frames:
+    int window_center = key_frame_index;
+    if (target_window_stride_ > 1) {
+        window_center = (key_frame_index + target_window_stride_ / 2) / target_window_stride_ * target_window_stride_;
+        window_center = std::max(
+            std::min(window_center, static_cast<int>(all_key_frames_.size()) - extend_frame_num_), 
+            extend_frame_num_
         );
-        float key_frame_distance = translation.norm();
-    #else
-        // total number of GNSS/IMU key frame poses:
-        const size_t N = all_key_gnss_.size();
+    }
 
-        // ensure valid loop closure match:
-        if (
-            N < static_cast<size_t>(diff_num_ + 1)
-        )
+    map_key_frames.clear();
+    for (int i = window_center - extend_frame_num_; i < window_center + extend_frame_num_; ++i) {
+        map_key_frames.push_back(all_key_frames_.at(i));
+    }
+}
+
+bool LoopClosing::AddVerificationTask(VerificationTask& task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (verification_queue_.size() < verification_queue_size_) {
+            verification_queue_.push_back(std::move(task));
+        } else if (coalesce_verification_) {
+            // consecutive key frames revisit the same place, verifying the newest one is enough:
+            RemoveCandidates(verification_queue_.back());
+            verification_queue_.back() = std::move(task);
+            ++stats_.num_coalesced;
+        } else {
+            ++stats_.num_dropped;
+            RemoveCandidates(task);
+            LOG(WARNING) << "Loop verification falls behind, drop candidates of key frame " 
+                         << task.key_frame.index;
             return false;
+        }
 
-        const KeyFrame &current_key_frame = all_key_gnss_.back();
+        stats_.max_queue_depth = std::max(stats_.max_queue_depth, verification_queue_.size());
+    }
+    has_task_.notify_one();
 
-        int proposed_key_frame_id = ScanContextManager::NONE;
-        // this orientation compensation is not available for GNSS/IMU proposal:
-        const float proposed_yaw_change = 0.0f;
-        float key_frame_distance = std::numeric_limits<float>::max();
-        for (size_t i = 0; i < N - 1; ++i) {
-            // ensure key frame seq. distance:
-            if (N < static_cast<size_t>(i + diff_num_))
-                break;
-            
-            const KeyFrame &proposed_key_frame = all_key_gnss_.at(i);
-
-            Eigen::Vector3f translation = (
-                current_key_frame.pose.block<3, 1>(0, 3) - proposed_key_frame.pose.block<3, 1>(0, 3)
-            );
-            float distance = translation.norm();
+    return true;
+}
 
-            // get closest proposal:
-            if (distance < key_frame_distance) {
-                key_frame_distance = distance;
-                proposed_key_frame_id = i;
-            }
+void LoopClosing::RequestPrefetch(int key_frame_index) {
+    PrefetchTask task;
+    GetMapKeyFrames(key_frame_index, task.map_key_frames);
+    if (task.map_key_frames.empty())
+        return;
+
+    // the vehicle approaches the same key frames for several detections:
+    const int first_index = static_cast<int>(task.map_key_frames.front().index);
+    if (first_index == last_prefetch_index_)
+        return;
+    last_prefetch_index_ = first_index;
+
+    // scan context may propose a neighbor of the closest key frame, whose window reaches a little further:
+    const int N = static_cast<int>(all_key_frames_.size());
+    const int begin = static_cast<int>(task.map_key_frames.front().index) - prefetch_margin_frame_num_;
+    const int end = static_cast<int>(task.map_key_frames.back().index) + 1 + prefetch_margin_frame_num_;
+    for (int i = std::max(begin, 0); i < std::min(end, N); ++i) {
+        if (i < first_index || i > static_cast<int>(task.map_key_frames.back().index)) {
+            task.margin_key_frames.push_back(all_key_frames_.at(i));
         }
-    #endif
+    }
 
-    // this is needed for valid local map build:
-    if (proposed_key_frame_id < extend_frame_num_)
-        return false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // a request not picked up yet is out of date:
+        prefetch_queue_.clear();
+        prefetch_queue_.push_back(std::move(task));
+    }
+    has_task_.notify_one();
+}
 
-    // update detection interval:
-    skip_cnt = 0;
-    skip_num = static_cast<int>(key_frame_distance);
-    if (key_frame_distance > detect_area_) {
-        skip_num = std::max((int)(key_frame_distance / 2.0), loop_step_);
-        return false;
-    } else {
-        key_frame_index = proposed_key_frame_id;
-        yaw_change_in_rad = proposed_yaw_change;
+void LoopClosing::Prefetch(const PrefetchTask& task) {
+    // the window as the verification will build it, the assembly is kept by the target cache:
+    if (prefetch_target_) {
+        const uint64_t key = RegistrationTargetCache::GetKey(
+            task.map_key_frames.front().index, task.map_key_frames.back().index
+        );
 
-        skip_num = loop_step_;
-        return true;
+        RegistrationTargetCache::Entry map_target;
+        if (!target_cache_ptr_->Get(key, map_target)) {
+            map_target.cloud_ptr.reset(new CloudData::CLOUD());
+            JointMap(task.map_key_frames, map_target.cloud_ptr);
+
+            // any instance builds the same target, the verification sets it on its own:
+            registration_ptrs_.front()->SetInputTarget(map_target.cloud_ptr);
+            map_target.target_ptr = registration_ptrs_.front()->GetTarget();
+            target_cache_ptr_->Add(key, map_target);
+        }
+    }
+
+    // the neighbors, and the window unless assembled above, only go into the key scan cache:
+    std::vector<KeyFrame> key_frames = task.margin_key_frames;
+    if (!prefetch_target_) {
+        key_frames.insert(key_frames.end(), task.map_key_frames.begin(), task.map_key_frames.end());
+    }
+    for (const KeyFrame& key_frame: key_frames) {
+        if (key_scan_cache_ptr_->IsCompact()) {
+            CompactCloud::ConstPtr key_scan_ptr;
+            key_scan_cache_ptr_->Get(key_frame.index, key_scan_ptr);
+        } else {
+            CloudData::CLOUD::ConstPtr key_scan_ptr;
+            key_scan_cache_ptr_->Get(key_frame.index, key_scan_ptr);
+        }
     }
 }
 
-bool LoopClosing::CloudRegistration(
-    const int key_frame_index,
-    const float yaw_change_in_rad
-) {
-    // 生成地图
-    CloudData::CLOUD_PTR map_cloud_ptr(new CloudData::CLOUD());
-    Eigen::Matrix4f map_pose = Eigen::Matrix4f::Identity();
-    JointMap(
-        key_frame_index, yaw_change_in_rad, 
-        map_cloud_ptr, map_pose
-    );
+void LoopClosing::RemoveCandidates(const VerificationTask& task) {
+    if (!candidate_cache_ptr_)
+        return;
+
+    // never verified, so they must not suppress the next proposals:
+    for (const LoopCandidate& candidate: task.candidates) {
+        candidate_cache_ptr_->Remove(candidate.key_frame.index, task.key_frame.index);
+    }
+}
+
+void LoopClosing::ReportCandidateCache(double time) {
+    if (!candidate_cache_ptr_)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const LoopCandidateCache::Stats& cache_stats = candidate_cache_ptr_->GetStats();
+    if (cache_report_time_ < 0.0) {
+        cache_report_time_ = time;
+        return;
+    }
+
+    const double report_interval = time - cache_report_time_;
+    if (report_interval < 60.0)
+        return;
+
+    const size_t num_suppressed = cache_stats.num_suppressed - cache_report_num_suppressed_;
+    const size_t num_warm_starts = cache_stats.num_warm_starts - cache_report_num_warm_starts_;
+    LOG(INFO) << "Loop candidate cache: " 
+              << num_suppressed * 60.0 / report_interval << " verifications saved per minute, "
+              << num_warm_starts << " warm starts in the last " << report_interval << " s, "
+              << cache_stats.num_suppressed << " saved of " << cache_stats.num_lookups << " candidates in total";
+
+    cache_report_time_ = time;
+    cache_report_num_suppressed_ = cache_stats.num_suppressed;
+    cache_report_num_warm_starts_ = cache_stats.num_warm_starts;
+}
+
+void LoopClosing::RunVerification(void) {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        has_task_.wait(lock, [this]{ return stop_ || !verification_queue_.empty() || !prefetch_queue_.empty(); });
+        if (stop_)
+            break;
 
-    // 生成当前scan
+        // prefetch only while no verification is waiting, a running one delays the next verification:
+        if (verification_queue_.empty()) {
+            PrefetchTask prefetch_task = std::move(prefetch_queue_.front());
+            prefetch_queue_.pop_front();
+
+            lock.unlock();
+            Prefetch(prefetch_task);
+            lock.lock();
+
+            ++stats_.num_prefetches;
+            continue;
+        }
+
+        VerificationTask task = std::move(verification_queue_.front());
+        verification_queue_.pop_front();
+
+        lock.unlock();
+        LoopPose loop_pose;
+        bool is_found = CloudRegistration(task, loop_pose);
+        lock.lock();
+
+        ++stats_.num_verified;
+        if (is_found) {
+            loop_poses_.push_back(loop_pose);
+            ++stats_.num_loop_poses;
+        }
+    }
+}
+
+bool LoopClosing::CloudRegistration(const VerificationTask& task, LoopPose& loop_pose) {
+    // 生成当前scan, 所有候选共用
     CloudData::CLOUD_PTR scan_cloud_ptr(new CloudData::CLOUD());
     Eigen::Matrix4f scan_pose = Eigen::Matrix4f::Identity();
-    JointScan(scan_cloud_ptr, scan_pose);
+    JointScan(task, scan_cloud_ptr, scan_pose);
+
+    // 生成地图, 按顺序生成以共用关键帧缓存. 地图在关键帧位姿坐标系下, 同一关键帧窗口的地图与匹配目标可直接取自缓存
+    const int N = static_cast<int>(task.candidates.size());
+    std::vector<RegistrationTargetCache::Entry> map_targets(N);
+    std::vector<uint64_t> map_target_keys(N, 0);
+    std::vector<char> is_map_target_cached(N, 0);
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> map_poses(N);
+    // from the map frame to GNSS frame:
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> map_to_gnss(N);
+    for (int i = 0; i < N; ++i) {
+        const LoopCandidate& candidate = task.candidates.at(i);
+        GetMapPose(candidate, map_poses.at(i));
+        map_to_gnss.at(i) = map_poses.at(i) * candidate.key_frame.pose.inverse();
+
+        if (target_cache_ptr_ && !candidate.map_key_frames.empty()) {
+            map_target_keys.at(i) = RegistrationTargetCache::GetKey(
+                candidate.map_key_frames.front().index, candidate.map_key_frames.back().index
+            );
+            if (target_cache_ptr_->Get(map_target_keys.at(i), map_targets.at(i))) {
+                is_map_target_cached.at(i) = 1;
+                continue;
+            }
+        }
 
-    // 匹配
-    Eigen::Matrix4f result_pose = Eigen::Matrix4f::Identity();
-    Registration(map_cloud_ptr, scan_cloud_ptr, scan_pose, result_pose);
+        map_targets.at(i).cloud_ptr.reset(new CloudData::CLOUD());
+        JointMap(candidate.map_key_frames, map_targets.at(i).cloud_ptr);
+    }
 
-    // 计算相对位姿
-    current_loop_pose_.pose = map_pose.inverse() * result_pose;
+    // 全局粗配准的当前帧特征, 所有候选共用
+    FPFHRansacAlignment::Features scan_features;
+    if (pre_alignment_ptr_) {
+        pre_alignment_ptr_->ComputeFeatures(*scan_cloud_ptr, scan_features);
+    }
+
+    // 匹配, 每个候选使用各自的配准实例并行验证
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> result_poses(
+        N, Eigen::Matrix4f::Identity()
+    );
+    // 粗配准成功时以其结果为匹配初值, 否则仍使用GNSS
+    std::vector<FPFHRansacAlignment::Result, Eigen::aligned_allocator<FPFHRansacAlignment::Result>> pre_alignment_results(N);
+    // 匹配结果取自最后一次迭代, 不再额外搜索最近邻
+    std::vector<RegistrationInterface::Result, Eigen::aligned_allocator<RegistrationInterface::Result>> results(N);
+    // 后台任务, 线程池忙时让位于实时定位
+    TaskScheduler::GetInstance().ParallelFor(
+        0, N, 1,
+        [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                // matched in map frame:
+                Eigen::Matrix4f predict_pose = map_to_gnss.at(i).inverse() * scan_pose;
+                if (task.candidates.at(i).has_warm_start) {
+                    // the earlier loop moved to this pair of key frames is closer than GNSS or pre-alignment:
+                    predict_pose = task.candidates.at(i).key_frame.pose * task.candidates.at(i).warm_start_pose;
+                } else if (pre_alignment_ptr_) {
+                    FPFHRansacAlignment::Features map_features;
+                    pre_alignment_ptr_->ComputeFeatures(*map_targets.at(i).cloud_ptr, map_features);
+                    pre_alignment_results.at(i) = pre_alignment_ptr_->Align(scan_features, map_features, predict_pose);
+                    if (pre_alignment_results.at(i).is_found)
+                        predict_pose = pre_alignment_results.at(i).pose;
+                }
+
+                Eigen::Matrix4f result_pose = Eigen::Matrix4f::Identity();
+                Registration(
+                    registration_ptrs_.at(i), 
+                    map_targets.at(i), scan_cloud_ptr, predict_pose, 
+                    result_pose
+                );
+                result_poses.at(i) = map_to_gnss.at(i) * result_pose;
+                results.at(i) = registration_ptrs_.at(i)->GetResult();
+            }
+        },
+        TaskScheduler::BACKGROUND
+    );
+
+    if (target_cache_ptr_) {
+        for (int i = 0; i < N; ++i) {
+            if (!is_map_target_cached.at(i))
+                target_cache_ptr_->Add(map_target_keys.at(i), map_targets.at(i));
+        }
+    }
+
+    int best_index = 0;
+    for (int i = 1; i < N; ++i) {
+        if (results.at(i).fitness_score < results.at(best_index).fitness_score)
+            best_index = i;
+    }
 
     // 判断是否有效
-    if (registration_ptr_->GetFitnessScore() > fitness_score_limit_)
+    const bool is_found = (N > 0 && results.at(best_index).fitness_score <= fitness_score_limit_);
+
+    if (candidate_cache_ptr_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // only the best candidate closes the loop, the others are rejected:
+        for (int i = 0; i < N; ++i) {
+            candidate_cache_ptr_->SetResult(
+                task.candidates.at(i).key_frame.index, task.key_frame.index,
+                is_found && i == best_index, map_poses.at(i).inverse() * result_poses.at(i)
+            );
+        }
+    }
+
+    if (!is_found)
         return false;
-    
-    static int loop_close_cnt = 0;
-    loop_close_cnt ++;
+
+    // 计算相对位姿
+    loop_pose.index0 = task.candidates.at(best_index).key_frame.index;
+    loop_pose.index1 = task.key_frame.index;
+    loop_pose.time = task.key_frame.time;
+    loop_pose.pose = map_poses.at(best_index).inverse() * result_poses.at(best_index);
 
     LOG(INFO) << std::endl
               << "[ICP Registration] Loop-Closure Detected " 
-              << current_loop_pose_.index0 << "<-->" << current_loop_pose_.index1 << std::endl 
-              << "\tFitness Score " << registration_ptr_->GetFitnessScore() << std::endl 
+              << loop_pose.index0 << "<-->" << loop_pose.index1 << std::endl 
+              << "\tFitness Score " << results.at(best_index).fitness_score << std::endl 
+              << "\tInlier Ratio " << results.at(best_index).inlier_ratio << std::endl 
+              << "\tRegistration Iterations " << results.at(best_index).num_iterations 
+              << GetLevelReport(registration_ptrs_.at(best_index)) << std::endl 
+              << GetPreAlignmentReport(pre_alignment_results.at(best_index))
+              << "\tCandidate " << best_index + 1 << " of " << N 
+              << (task.candidates.at(best_index).has_warm_start ? ", warm start" : "") << std::endl 
+              << "\tKey Scan Cache " << key_scan_cache_ptr_->GetStats().num_hits << " hits, "
+              << key_scan_cache_ptr_->GetStats().num_misses << " misses" << std::endl 
+              << GetTargetCacheReport()
+              << "\tVerification Queue Depth " << GetStats().queue_depth << std::endl 
               << std::endl;
 
     return true;
 }
 
-bool LoopClosing::JointMap(
-    const int key_frame_index, const float yaw_change_in_rad,
-    CloudData::CLOUD_PTR& map_cloud_ptr, Eigen::Matrix4f& map_pose
-) {
+std::string LoopClosing::GetLevelReport(const std::shared_ptr<RegistrationInterface>& registration_ptr) {
+    auto pyramid_registration_ptr = std::dynamic_pointer_cast<PyramidRegistration>(registration_ptr);
+    if (!pyramid_registration_ptr)
+        return "";
+
+    // iterations & fitness of each level, for latency tuning:
+    std::ostringstream report;
+    for (const PyramidRegistration::LevelStats& level_stats: pyramid_registration_ptr->GetLevelStats()) {
+        if (level_stats.last_num_iterations < 0)
+            break;
+
+        report << ", res " << level_stats.res << ": " 
+               << level_stats.last_num_iterations << " (" << level_stats.last_fitness_score << ")";
+    }
+
+    return report.str();
+}
+
+std::string LoopClosing::GetPreAlignmentReport(const FPFHRansacAlignment::Result& result) const {
+    if (!pre_alignment_ptr_)
+        return "";
+
+    std::ostringstream report;
+    report << "\tPre-Alignment " << (result.is_found ? "Used" : "Rejected") << ", " 
+           << result.num_inliers << " inliers of " << result.num_correspondences << " correspondences, " 
+           << result.num_iterations << " iterations" << std::endl;
+
+    return report.str();
+}
+
+std::string LoopClosing::GetTargetCacheReport(void) const {
+    if (!target_cache_ptr_)
+        return "";
+
+    std::ostringstream report;
+    report << "\tTarget Cache " << target_cache_ptr_->GetStats().num_hits << " hits, "
+           << target_cache_ptr_->GetStats().num_misses << " misses, "
+           << target_cache_ptr_->GetStats().num_targets << " targets, "
+           << (target_cache_ptr_->GetStats().size_in_bytes >> 20) << " MB" << std::endl;
+
+    return report.str();
+}
+
+void LoopClosing::GetMapPose(const LoopCandidate& candidate, Eigen::Matrix4f& map_pose) const {
     // init map pose as loop closure pose:
-    map_pose = all_key_gnss_.at(key_frame_index).pose;
+    map_pose = candidate.key_gnss.pose;
 
     // apply yaw change estimation from scan context match:
-    Eigen::AngleAxisf orientation_change(yaw_change_in_rad, Eigen::Vector3f::UnitZ());
+    Eigen::AngleAxisf orientation_change(candidate.yaw_change_in_rad, Eigen::Vector3f::UnitZ());
     map_pose.block<3, 3>(0, 0) = map_pose.block<3, 3>(0, 0) * orientation_change.toRotationMatrix();
+}
 
-    current_loop_pose_.index0 = all_key_frames_.at(key_frame_index).index;
-    
+bool LoopClosing::JointMap(const std::vector<KeyFrame>& map_key_frames, CloudData::CLOUD_PTR& map_cloud_ptr) {
     // create local map:
-    Eigen::Matrix4f pose_to_gnss = map_pose * all_key_frames_.at(key_frame_index).pose.inverse();
-    for (int i = key_frame_index - extend_frame_num_; i < key_frame_index + extend_frame_num_; ++i) {
-        // a. load back surrounding key scan:
-        std::string file_path = key_frames_path_ + "/key_frame_" + std::to_string(all_key_frames_.at(i).index) + ".pcd";
-        CloudData::CLOUD_PTR cloud_ptr(new CloudData::CLOUD());
-        pcl::io::loadPCDFile(file_path, *cloud_ptr);
-        
-        // b. transform surrounding key scan to map frame:
-        Eigen::Matrix4f cloud_pose = pose_to_gnss * all_key_frames_.at(i).pose;
-        pcl::transformPointCloud(*cloud_ptr, *cloud_ptr, cloud_pose);
-
-        *map_cloud_ptr += *cloud_ptr;
+    CloudAssembler map_assembler;
+    for (const KeyFrame &key_frame: map_key_frames) {
+        // load back surrounding key scan & add it in map frame, compact scans are decoded while transformed:
+        if (key_scan_cache_ptr_->IsCompact()) {
+            CompactCloud::ConstPtr key_scan_ptr;
+            if (!key_scan_cache_ptr_->Get(key_frame.index, key_scan_ptr))
+                continue;
+
+            map_assembler.Add(key_scan_ptr, key_frame.pose);
+        } else {
+            CloudData::CLOUD::ConstPtr key_scan_ptr;
+            if (!key_scan_cache_ptr_->Get(key_frame.index, key_scan_ptr))
+                continue;
+
+            map_assembler.Add(key_scan_ptr, key_frame.pose);
+        }
     }
+    map_assembler.Assemble(*map_cloud_ptr);
     // pre-process current map:
     map_filter_ptr_->Filter(map_cloud_ptr, map_cloud_ptr);
 
     return true;
 }
 
-bool LoopClosing::JointScan(CloudData::CLOUD_PTR& scan_cloud_ptr, Eigen::Matrix4f& scan_pose) {
+bool LoopClosing::JointScan(
+    const VerificationTask& task,
+    CloudData::CLOUD_PTR& scan_cloud_ptr, Eigen::Matrix4f& scan_pose
+) {
     // set scan pose as GNSS estimation:
-    scan_pose = all_key_gnss_.back().pose;
-    current_loop_pose_.index1 = all_key_frames_.back().index;
-    current_loop_pose_.time = all_key_frames_.back().time;
+    scan_pose = task.key_gnss.pose;
 
-    // load back current key scan:
-    std::string file_path = key_frames_path_ + "/key_frame_" + std::to_string(all_key_frames_.back().index) + ".pcd";
-    pcl::io::loadPCDFile(file_path, *scan_cloud_ptr);
+    // use current key scan in memory, the back end writes it to disk asynchronously:
+    *scan_cloud_ptr = *task.key_scan.cloud_ptr;
 
     // pre-process current scan:
     scan_filter_ptr_->Filter(scan_cloud_ptr, scan_cloud_ptr);
@@ -310,28 +1016,119 @@ bool LoopClosing::JointScan(CloudData::CLOUD_PTR& scan_cloud_ptr, Eigen::Matrix4
     return true;
 }
 
-bool LoopClosing::Registration(CloudData::CLOUD_PTR& map_cloud_ptr, 
+bool LoopClosing::Registration(std::shared_ptr<RegistrationInterface>& registration_ptr,
+                               RegistrationTargetCache::Entry& map_target, 
                                CloudData::CLOUD_PTR& scan_cloud_ptr, 
                                Eigen::Matrix4f& scan_pose, 
                                Eigen::Matrix4f& result_pose) {
-    // point cloud registration:
+    // point cloud registration, a cached target is matched against as built:
     CloudData::CLOUD_PTR result_cloud_ptr(new CloudData::CLOUD());
-    registration_ptr_->SetInputTarget(map_cloud_ptr);
-    registration_ptr_->ScanMatch(scan_cloud_ptr, scan_pose, result_cloud_ptr, result_pose);
+    if (!map_target.target_ptr || !registration_ptr->SetTarget(map_target.target_ptr)) {
+        registration_ptr->SetInputTarget(map_target.cloud_ptr);
+        map_target.target_ptr = target_cache_ptr_ ? registration_ptr->GetTarget() : nullptr;
+    }
+    registration_ptr->ScanMatch(scan_cloud_ptr, scan_pose, result_cloud_ptr, result_pose);
 
     return true;
 }
 
 bool LoopClosing::HasNewLoopPose() {
-    return has_new_loop_pose_;
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (loop_poses_.empty())
+        return false;
+
+    current_loop_pose_ = loop_poses_.front();
+    loop_poses_.pop_front();
+
+    return true;
 }
 
 LoopPose& LoopClosing::GetCurrentLoopPose() {
     return current_loop_pose_;
 }
 
+LoopClosing::Stats LoopClosing::GetStats(void) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    Stats stats = stats_;
+    stats.queue_depth = verification_queue_.size();
+    if (candidate_cache_ptr_) {
+        stats.num_suppressed = candidate_cache_ptr_->GetStats().num_suppressed;
+        stats.num_warm_starts = candidate_cache_ptr_->GetStats().num_warm_starts;
+    }
+
+    return stats;
+}
+
+size_t LoopClosing::GetKeyFramesMemoryUsage(void) const {
+    return lidar_localization::GetMemoryUsage(all_key_frames_) + lidar_localization::GetMemoryUsage(all_key_gnss_);
+}
+
+size_t LoopClosing::GetScanContextMemoryUsage(void) const {
+    return scan_context_manager_ptr_->GetMemoryUsage();
+}
+
+size_t LoopClosing::GetVerificationQueueMemoryUsage(void) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    size_t memory_usage = lidar_localization::GetMemoryUsage(verification_queue_);
+    for (const VerificationTask& task: verification_queue_) {
+        memory_usage += lidar_localization::GetMemoryUsage(task.key_scan);
+        for (const LoopCandidate& candidate: task.candidates) {
+            memory_usage += lidar_localization::GetMemoryUsage(candidate.map_key_frames);
+        }
+    }
+
+    return memory_usage;
+}
+
 bool LoopClosing::Save(void) {
+    LogStats();
+
+    if (checkpoint_log_ptr_) {
+        checkpoint_log_ptr_->Commit();
+        checkpoint_log_ptr_->Flush();
+        checkpoint_cnt_ = 0;
+    }
+
     return scan_context_manager_ptr_->Save(scan_context_path_);
 }
 
-}
\ No newline at end of file
+std::shared_ptr<ScanContextManager> LoopClosing::GetSnapshot(void) {
+    LogStats();
+
+    if (checkpoint_log_ptr_) {
+        checkpoint_log_ptr_->Commit();
+        checkpoint_cnt_ = 0;
+    }
+
+    return scan_context_manager_ptr_->GetSnapshot();
+}
+
+void LoopClosing::LogStats(void) {
+    Stats stats = GetStats();
+    LOG(INFO) << "Loop verification: " << stats.num_verified << " verified, "
+              << stats.num_loop_poses << " loop poses, "
+              << stats.num_dropped << " dropped, " 
+              << stats.num_coalesced << " coalesced, "
+              << stats.num_suppressed << " suppressed, "
+              << stats.num_warm_starts << " warm starts, "
+              << stats.num_prefetches << " prefetches, "
+              << "queue depth " << stats.queue_depth << "/" << stats.max_queue_depth << std::endl;
+}
+
+bool LoopClosing::SaveSnapshot(
+    std::shared_ptr<ScanContextManager> snapshot_ptr,
+    const std::function<void(double progress, const std::string& message)>& progress
+) {
+    if (checkpoint_log_ptr_) {
+        progress(0.0, "checkpoint");
+        checkpoint_log_ptr_->Flush();
+    }
+
+    progress(0.1, "scan context");
+    return snapshot_ptr->Save(scan_context_path_);
+}
+
+}
@@ -4,8 +4,10 @@
  * @Date: 2020-02-10 08:38:42
  */
 #include "lidar_localization/mapping/loop_closing/loop_closing_flow.hpp"
+#include "lidar_localization/tools/tracer.hpp"
 #include "glog/logging.h"
 #include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/memory_usage.hpp"
 
 namespace lidar_localization {
 LoopClosingFlow::LoopClosingFlow(ros::NodeHandle& nh) {
@@ -17,9 +19,24 @@ LoopClosingFlow::LoopClosingFlow(ros::NodeHandle& nh) {
     loop_pose_pub_ptr_ = std::make_shared<LoopPosePublisher>(nh, "/loop_pose", "/map", 100);
     // loop closing
     loop_closing_ptr_ = std::make_shared<LoopClosing>();
+    // metrics
+    metrics_.AddQueue("key_scan_queue", [this]{ return key_scan_buff_.size(); });
+    metrics_.AddQueue("key_frame_queue", [this]{ return key_frame_buff_.size(); });
+    metrics_.AddQueue("key_gnss_queue", [this]{ return key_gnss_buff_.size(); });
+    metrics_.AddMemory("key_scan_queue", [this]{ return GetMemoryUsage(key_scan_buff_); });
+    metrics_.AddMemory("key_frames", [this]{ return loop_closing_ptr_->GetKeyFramesMemoryUsage(); });
+    metrics_.AddMemory("scan_context", [this]{ return loop_closing_ptr_->GetScanContextMemoryUsage(); });
+    metrics_.AddMemory("verification_queue", [this]{ return loop_closing_ptr_->GetVerificationQueueMemoryUsage(); });
+    dropped_key_frames_ptr_ = &metrics_.AddCounter("dropped_key_frames");
+    dropped_key_gnss_ptr_ = &metrics_.AddCounter("dropped_key_gnss");
+    published_loop_poses_ptr_ = &metrics_.AddCounter("published_loop_poses");
 }
 
 bool LoopClosingFlow::Run() {
+    TRACE_SCOPE("LoopClosingFlow::Run", "flow");
+    metrics_.UpdateQueues();
+    metrics_.UpdateMemory();
+
     if (!ReadData())
         return false;
 
@@ -27,13 +44,15 @@ bool LoopClosingFlow::Run() {
         if (!ValidData())
             continue;
         
+        ScopedLatency latency(metrics_.GetLatency());
         loop_closing_ptr_->Update(
             current_key_scan_, current_key_frame_, current_key_gnss_
         );
-        
-        PublishData();
     }
 
+    // loop poses may also come from the verifier thread:
+    PublishData();
+
     return true;
 }
 
@@ -41,6 +60,15 @@ bool LoopClosingFlow::Save(void) {
     return loop_closing_ptr_->Save();
 }
 
+BackgroundJobs::Job LoopClosingFlow::GetSaveJob() {
+    std::shared_ptr<ScanContextManager> snapshot_ptr = loop_closing_ptr_->GetSnapshot();
+
+    std::shared_ptr<LoopClosing> loop_closing_ptr = loop_closing_ptr_;
+    return [loop_closing_ptr, snapshot_ptr](const BackgroundJobs::Progress& progress) {
+        return loop_closing_ptr->SaveSnapshot(snapshot_ptr, progress);
+    };
+}
+
 bool LoopClosingFlow::ReadData() {
     key_scan_sub_ptr_->ParseData(key_scan_buff_);
     key_frame_sub_ptr_->ParseData(key_frame_buff_);
@@ -70,11 +98,13 @@ bool LoopClosingFlow::ValidData() {
 
     if (diff_gnss_time < -0.05) {
         key_frame_buff_.pop_front();
+        dropped_key_frames_ptr_->Increment();
         return false;
     }
 
     if (diff_gnss_time > 0.05) {
         key_gnss_buff_.pop_front();
+        dropped_key_gnss_ptr_->Increment();
         return false;
     }
 
@@ -86,8 +116,10 @@ bool LoopClosingFlow::ValidData() {
 }
 
 bool LoopClosingFlow::PublishData() {
-    if (loop_closing_ptr_->HasNewLoopPose()) 
+    while (loop_closing_ptr_->HasNewLoopPose()) {
         loop_pose_pub_ptr_->Publish(loop_closing_ptr_->GetCurrentLoopPose());
+        published_loop_poses_ptr_->Increment();
+    }
 
     return true;
 }
@@ -5,12 +5,18 @@
  */
 #include "lidar_localization/mapping/viewer/viewer.hpp"
 
+#include <algorithm>
+
 #include <pcl/common/transforms.h>
 #include <pcl/io/pcd_io.h>
 #include "glog/logging.h"
 
 #include "lidar_localization/tools/file_manager.hpp"
+#include "lidar_localization/tools/cloud_assembler.hpp"
 #include "lidar_localization/models/cloud_filter/voxel_filter.hpp"
+#include "lidar_localization/models/key_frame_store/pcd_key_frame_store.hpp"
+#include "lidar_localization/models/key_frame_store/packed_key_frame_store.hpp"
+#include "lidar_localization/models/lod_map/lod_map.hpp"
 #include "lidar_localization/global_defination/global_defination.h"
 
 namespace lidar_localization {
@@ -25,6 +31,9 @@ bool Viewer::InitWithConfig() {
     std::cout << "-----------------显示模块初始化-------------------" << std::endl;
     InitParam(config_node);
     InitDataPath(config_node);
+    InitKeyFrameStore(config_node);
+    InitGlobalMap(config_node);
+    InitSaveMap(config_node);
     InitFilter("frame", frame_filter_ptr_, config_node);
     InitFilter("local_map", local_map_filter_ptr_, config_node);
     InitFilter("global_map", global_map_filter_ptr_, config_node);
@@ -52,12 +61,91 @@ bool Viewer::InitDataPath(const YAML::Node& config_node) {
     return true;
 }
 
+bool Viewer::InitKeyFrameStore(const YAML::Node& config_node) {
+    std::cout << "显示模块关键帧存储方式为：" << config_node["key_frame_store"].as<std::string>() << std::endl;
+
+    key_frame_store_config_node_ = config_node;
+    if (!CreateKeyFrameStore(key_frame_store_ptr_))
+        return false;
+
+    // 缓存未滤波的关键帧，保存地图时也要用原始点云
+    int key_scan_cache_size = config_node["key_scan_cache_size"].as<int>();
+    key_scan_cache_ptr_ = std::make_shared<KeyScanCache>(
+        key_frame_store_ptr_, nullptr, static_cast<size_t>(std::max(key_scan_cache_size, 0))
+    );
+
+    return true;
+}
+
+bool Viewer::CreateKeyFrameStore(std::shared_ptr<KeyFrameStoreInterface>& key_frame_store_ptr) {
+    const YAML::Node& config_node = key_frame_store_config_node_;
+    std::string key_frame_store_method = config_node["key_frame_store"].as<std::string>();
+
+    if (key_frame_store_method == "pcd") {
+        key_frame_store_ptr = std::make_shared<PCDKeyFrameStore>(key_frames_path_);
+    } else if (key_frame_store_method == "packed") {
+        key_frame_store_ptr = std::make_shared<PackedKeyFrameStore>(key_frames_path_, config_node[key_frame_store_method]);
+    } else {
+        LOG(ERROR) << "Key frame store " << key_frame_store_method << " NOT FOUND!";
+        return false;
+    }
+
+    return true;
+}
+
+bool Viewer::InitGlobalMap(const YAML::Node& config_node) {
+    global_map_publish_interval_ = config_node["global_map_publish_interval"].as<double>();
+    global_map_submap_size_ = std::max(config_node["global_map_submap_size"].as<int>(), 1);
+    pose_translation_threshold_ = config_node["global_map_pose_update"]["translation"].as<float>();
+    pose_rotation_threshold_ = config_node["global_map_pose_update"]["rotation"].as<float>();
+
+    std::cout << "全局地图最短发布间隔：" << global_map_publish_interval_ << " s，每 "
+              << global_map_submap_size_ << " 个关键帧一个子图，位姿变化超过 "
+              << pose_translation_threshold_ << " m 或 " << pose_rotation_threshold_ << " rad 时更新"
+              << std::endl;
+
+    global_map_delta_ptr_.reset(new CloudData::CLOUD());
+    // the first global map is not throttled:
+    last_global_map_time_ = std::chrono::steady_clock::now() -
+                            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                std::chrono::duration<double>(global_map_publish_interval_)
+                            );
+
+    return true;
+}
+
+bool Viewer::InitSaveMap(const YAML::Node& config_node) {
+    save_map_method_ = config_node["save_map_method"].as<std::string>();
+    std::cout << "显示模块地图保存方式为：" << save_map_method_ << std::endl;
+
+    if (save_map_method_ == "streaming") {
+        streaming_map_builder_ptr_ = std::make_shared<StreamingMapBuilder>(config_node["streaming_map"]);
+    } else if (save_map_method_ != "in_memory") {
+        LOG(ERROR) << "Save map method " << save_map_method_ << " NOT FOUND!";
+        return false;
+    }
+
+    lod_map_num_levels_ = std::max(config_node["lod_map"]["num_levels"].as<int>(), 0);
+    lod_map_leaf_size_ = config_node["lod_map"]["leaf_size"].as<float>();
+    if (streaming_map_builder_ptr_ && lod_map_num_levels_ > 0) {
+        LOG(WARNING) << "LOD map is not saved in streaming mode, run build_tiled_map_node on filtered_map.pcd instead.";
+    }
+
+    return true;
+}
+
 bool Viewer::InitFilter(std::string filter_user, std::shared_ptr<CloudFilterInterface>& filter_ptr, const YAML::Node& config_node) {
     std::string filter_mothod = config_node[filter_user + "_filter"].as<std::string>();
     std::cout << "显示模块" << filter_user << "选择的滤波方法为：" << filter_mothod << std::endl;
 
     if (filter_mothod == "voxel_filter") {
         filter_ptr = std::make_shared<VoxelFilter>(config_node[filter_mothod][filter_user]);
+    } else if (filter_mothod == "voxel_filter_fast") {
+        filter_ptr = std::make_shared<FastVoxelFilter>(config_node[filter_mothod][filter_user]);
+    } else if (filter_mothod == "voxel_filter_adaptive") {
+        filter_ptr = std::make_shared<AdaptiveVoxelFilter>(config_node[filter_mothod][filter_user]);
+    } else if (filter_mothod == "filter_chain") {
+        filter_ptr = std::make_shared<FilterChain>(config_node[filter_mothod][filter_user]);
     } else {
         LOG(ERROR) << "没有为 " << filter_user << " 找到与 " << filter_mothod << " 相对应的滤波方法!";
         return false;
@@ -67,16 +155,25 @@ bool Viewer::InitFilter(std::string filter_user, std::shared_ptr<CloudFilterInte
 }
 
 bool Viewer::UpdateWithOptimizedKeyFrames(std::deque<KeyFrame>& optimized_key_frames) {
-    has_new_global_map_ = false;
-    
+    // the global map stays pending until it is fetched, see HasNewGlobalMap:
     if (optimized_key_frames.size() > 0) {
-        optimized_key_frames_ = optimized_key_frames;
+        // a sliding window back end only sends the key frames still in its window:
+        unsigned int first_index = optimized_key_frames.front().index;
+        while (optimized_key_frames_.size() > 0 && optimized_key_frames_.back().index >= first_index) {
+            optimized_key_frames_.pop_back();
+        }
+        optimized_key_frames_.insert(
+            optimized_key_frames_.end(), 
+            optimized_key_frames.begin(), optimized_key_frames.end()
+        );
         optimized_key_frames.clear();
         OptimizeKeyFrames();
         has_new_global_map_ = true;
+        has_new_global_map_submaps_ = true;
+        return true;
     }
 
-    return has_new_global_map_;
+    return false;
 }
 
 bool Viewer::UpdateWithNewKeyFrame(std::deque<KeyFrame>& new_key_frames,
@@ -129,10 +226,97 @@ bool Viewer::OptimizeKeyFrames() {
 }
 
 bool Viewer::JointGlobalMap(CloudData::CLOUD_PTR& global_map_ptr) {
-    JointCloudMap(optimized_key_frames_, global_map_ptr);
+    UpdateGlobalMapSubmaps();
+
+    global_map_ptr.reset(new CloudData::CLOUD());
+    for (const auto& submap: global_map_submaps_) {
+        *global_map_ptr += *submap.second.map_cloud_ptr;
+    }
+    return true;
+}
+
+bool Viewer::UpdateGlobalMapSubmaps() {
+    if (!has_new_global_map_submaps_)
+        return true;
+    has_new_global_map_submaps_ = false;
+    global_map_delta_ptr_.reset(new CloudData::CLOUD());
+
+    std::map<unsigned int, std::vector<const KeyFrame*>> submap_key_frames;
+    for (const KeyFrame& key_frame: optimized_key_frames_) {
+        submap_key_frames[key_frame.index / global_map_submap_size_].push_back(&key_frame);
+    }
+
+    for (const auto& key_frames: submap_key_frames) {
+        GlobalMapSubmap& submap = global_map_submaps_[key_frames.first];
+
+        // rebuilt from the key scans only when it gets new key frames or bends:
+        if (!IsSubmapRigid(submap, key_frames.second)) {
+            BuildSubmap(key_frames.second, submap);
+        } else {
+            submap.pose = key_frames.second.front()->pose;
+        }
+
+        if (submap.map_cloud_ptr && !IsPoseMoved(submap.map_cloud_pose, submap.pose))
+            continue;
+        submap.map_cloud_pose = submap.pose;
+        submap.map_cloud_ptr.reset(new CloudData::CLOUD());
+        pcl::transformPointCloud(*submap.local_cloud_ptr, *submap.map_cloud_ptr, submap.pose);
+        *global_map_delta_ptr_ += *submap.map_cloud_ptr;
+    }
+
+    return true;
+}
+
+bool Viewer::IsSubmapRigid(const GlobalMapSubmap& submap, const std::vector<const KeyFrame*>& key_frames) {
+    if (!submap.local_cloud_ptr || submap.key_frame_indices.size() != key_frames.size())
+        return false;
+
+    Eigen::Matrix4f first_pose_inverse = key_frames.front()->pose.inverse();
+    for (size_t i = 0; i < key_frames.size(); ++i) {
+        if (submap.key_frame_indices.at(i) != key_frames.at(i)->index ||
+            IsPoseMoved(submap.relative_poses.at(i), first_pose_inverse * key_frames.at(i)->pose))
+            return false;
+    }
+
+    return true;
+}
+
+bool Viewer::BuildSubmap(const std::vector<const KeyFrame*>& key_frames, GlobalMapSubmap& submap) {
+    submap.key_frame_indices.clear();
+    submap.relative_poses.clear();
+    submap.pose = key_frames.front()->pose;
+    submap.local_cloud_ptr.reset(new CloudData::CLOUD());
+    submap.map_cloud_ptr.reset();
+
+    Eigen::Matrix4f first_pose_inverse = submap.pose.inverse();
+    CloudAssembler submap_assembler;
+    CloudData::CLOUD::ConstPtr key_scan_ptr;
+    for (const KeyFrame* key_frame: key_frames) {
+        // the latest key scans may still be queued for disk write in back end,
+        // the submap is then rebuilt with the next update:
+        if (!key_scan_cache_ptr_->Get(key_frame->index, key_scan_ptr))
+            continue;
+
+        Eigen::Matrix4f relative_pose = first_pose_inverse * key_frame->pose;
+        submap_assembler.Add(key_scan_ptr, relative_pose);
+
+        submap.key_frame_indices.push_back(key_frame->index);
+        submap.relative_poses.push_back(relative_pose);
+    }
+    submap_assembler.Assemble(*submap.local_cloud_ptr);
+    global_map_filter_ptr_->Filter(submap.local_cloud_ptr, submap.local_cloud_ptr);
+
     return true;
 }
 
+bool Viewer::IsPoseMoved(const Eigen::Matrix4f& last_pose, const Eigen::Matrix4f& pose) {
+    Eigen::Matrix4f delta_pose = last_pose.inverse() * pose;
+    float delta_translation = delta_pose.block<3, 1>(0, 3).norm();
+    float delta_rotation = Eigen::AngleAxisf(Eigen::Matrix3f(delta_pose.block<3, 3>(0, 0))).angle();
+
+    return delta_translation > pose_translation_threshold_ || delta_rotation > pose_rotation_threshold_;
+}
+
 bool Viewer::JointLocalMap(CloudData::CLOUD_PTR& local_map_ptr) {
     size_t begin_index = 0;
     if (all_key_frames_.size() > (size_t)local_frame_num_)
@@ -148,38 +332,106 @@ bool Viewer::JointLocalMap(CloudData::CLOUD_PTR& local_map_ptr) {
 }
 
 bool Viewer::JointCloudMap(const std::deque<KeyFrame>& key_frames, CloudData::CLOUD_PTR& map_cloud_ptr) {
+    return JointCloudMap(
+        key_frames, *key_scan_cache_ptr_, map_cloud_ptr, [](double progress, const std::string& message) {}
+    );
+}
+
+bool Viewer::JointCloudMap(
+    const std::deque<KeyFrame>& key_frames, 
+    KeyScanCache& key_scan_cache,
+    CloudData::CLOUD_PTR& map_cloud_ptr,
+    const Progress& progress
+) {
     map_cloud_ptr.reset(new CloudData::CLOUD());
 
-    CloudData::CLOUD_PTR cloud_ptr(new CloudData::CLOUD());
-    std::string file_path = "";
+    CloudAssembler map_assembler;
+    CloudData::CLOUD::ConstPtr key_scan_ptr;
 
     for (size_t i = 0; i < key_frames.size(); ++i) {
-        file_path = key_frames_path_ + "/key_frame_" + std::to_string(key_frames.at(i).index) + ".pcd";
-        pcl::io::loadPCDFile(file_path, *cloud_ptr);
-        pcl::transformPointCloud(*cloud_ptr, *cloud_ptr, key_frames.at(i).pose);
-        *map_cloud_ptr += *cloud_ptr;
+        progress(static_cast<double>(i) / key_frames.size(), "key scans");
+        // the latest key scans may still be queued for disk write in back end:
+        if (!key_scan_cache.Get(key_frames.at(i).index, key_scan_ptr))
+            continue;
+        map_assembler.Add(key_scan_ptr, key_frames.at(i).pose);
     }
+    map_assembler.Assemble(*map_cloud_ptr);
     return true;
 }
 
 bool Viewer::SaveMap() {
-    if (optimized_key_frames_.size() == 0)
+    return SaveMap(
+        optimized_key_frames_, *key_scan_cache_ptr_, [](double progress, const std::string& message) {}
+    );
+}
+
+bool Viewer::SaveMap(const std::deque<KeyFrame>& key_frames, const Progress& progress) {
+    // each key scan is loaded once, so the cache only holds the scan in use:
+    std::shared_ptr<KeyFrameStoreInterface> key_frame_store_ptr;
+    if (!CreateKeyFrameStore(key_frame_store_ptr))
+        return false;
+    KeyScanCache key_scan_cache(key_frame_store_ptr, nullptr, 0);
+
+    return SaveMap(key_frames, key_scan_cache, progress);
+}
+
+bool Viewer::SaveMap(const std::deque<KeyFrame>& key_frames, KeyScanCache& key_scan_cache, const Progress& progress) {
+    if (key_frames.size() == 0)
         return false;
-    // 生成地图
+    if (streaming_map_builder_ptr_)
+        return SaveStreamingMap(key_frames, key_scan_cache, progress);
+    // 生成地图，拼接占进度的前 60%
     CloudData::CLOUD_PTR global_map_ptr(new CloudData::CLOUD());
-    JointCloudMap(optimized_key_frames_, global_map_ptr);
+    JointCloudMap(
+        key_frames, key_scan_cache, global_map_ptr, 
+        [&progress](double fraction, const std::string& message) { progress(0.6 * fraction, message); }
+    );
     // 保存原地图
+    progress(0.6, "map.pcd");
     std::string map_file_path = map_path_ + "/map.pcd";
     pcl::io::savePCDFileBinary(map_file_path, *global_map_ptr);
     // 保存滤波后地图
+    progress(0.7, "filtered_map.pcd");
     if (global_map_ptr->points.size() > 1000000) {
         std::shared_ptr<VoxelFilter> map_filter_ptr = std::make_shared<VoxelFilter>(0.5, 0.5, 0.5);
         map_filter_ptr->Filter(global_map_ptr, global_map_ptr);
     }
     std::string filtered_map_file_path = map_path_ + "/filtered_map.pcd";
     pcl::io::savePCDFileBinary(filtered_map_file_path, *global_map_ptr);
+    // 多分辨率地图，由滤波后地图逐层生成
+    if (lod_map_num_levels_ > 0) {
+        progress(0.85, "lod");
+        LODMap::Save(map_path_ + "/lod", *global_map_ptr, lod_map_leaf_size_, lod_map_num_levels_);
+    }
 
-    LOG(INFO) << "地图保存完成，地址是：" << std::endl << map_path_ << std::endl << std::endl;
+    LOG(INFO) << "地图保存完成，地址是：" << std::endl << map_path_ << std::endl 
+              << "关键帧缓存命中 " << key_scan_cache.GetStats().num_hits 
+              << " 次，未命中 " << key_scan_cache.GetStats().num_misses << " 次" << std::endl << std::endl;
+
+    return true;
+}
+
+bool Viewer::SaveStreamingMap(
+    const std::deque<KeyFrame>& key_frames, KeyScanCache& key_scan_cache, const Progress& progress
+) {
+    // 分块体素累积，内存中只保留扫描范围内的分块，不再生成未滤波的 map.pcd
+    size_t num_loaded = 0;
+    auto load_scan = [&](unsigned int index, CloudData::CLOUD::ConstPtr& scan_ptr) {
+        progress(static_cast<double>(num_loaded++) / key_frames.size(), "key scans");
+        return key_scan_cache.Get(index, scan_ptr);
+    };
+    if (
+        !streaming_map_builder_ptr_->Build(
+            key_frames, load_scan, 
+            map_path_ + "/tiles", map_path_ + "/filtered_map.pcd"
+        )
+    ) {
+        return false;
+    }
+
+    LOG(INFO) << "地图保存完成，地址是：" << std::endl << map_path_ << std::endl 
+              << "关键帧缓存命中 " << key_scan_cache.GetStats().num_hits 
+              << " 次，未命中 " << key_scan_cache.GetStats().num_misses << " 次" << std::endl << std::endl;
 
     return true;
 }
@@ -201,7 +453,21 @@ bool Viewer::GetLocalMap(CloudData::CLOUD_PTR& local_map_ptr) {
 
 bool Viewer::GetGlobalMap(CloudData::CLOUD_PTR& global_map_ptr) {
     JointGlobalMap(global_map_ptr);
+    // the submaps are filtered one by one, this merges the points where they overlap:
     global_map_filter_ptr_->Filter(global_map_ptr, global_map_ptr);
+
+    has_new_global_map_ = false;
+    last_global_map_time_ = std::chrono::steady_clock::now();
+    return true;
+}
+
+bool Viewer::GetGlobalMapDelta(CloudData::CLOUD_PTR& delta_map_ptr) {
+    UpdateGlobalMapSubmaps();
+    delta_map_ptr = global_map_delta_ptr_;
+    global_map_delta_ptr_.reset(new CloudData::CLOUD());
+
+    has_new_global_map_ = false;
+    last_global_map_time_ = std::chrono::steady_clock::now();
     return true;
 }
 
@@ -209,7 +475,9 @@ bool Viewer::HasNewLocalMap() {
     return has_new_local_map_;
 }
 
+// throttled to one global map per global_map_publish_interval:
 bool Viewer::HasNewGlobalMap() {
-    return has_new_global_map_;
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - last_global_map_time_;
+    return has_new_global_map_ && elapsed.count() >= global_map_publish_interval_;
 }
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
  * @Date: 2020-02-10 08:38:42
  */
 #include "lidar_localization/mapping/viewer/viewer_flow.hpp"
+#include "lidar_localization/tools/tracer.hpp"
 #include "glog/logging.h"
 #include "lidar_localization/global_defination/global_defination.h"
 
@@ -13,22 +14,37 @@ ViewerFlow::ViewerFlow(ros::NodeHandle& nh, std::string cloud_topic) {
     cloud_sub_ptr_ = std::make_shared<CloudSubscriber>(nh, cloud_topic, 100000);
     key_frame_sub_ptr_ = std::make_shared<KeyFrameSubscriber>(nh, "/key_frame", 100000);
     transformed_odom_sub_ptr_ = std::make_shared<OdometrySubscriber>(nh, "/transformed_odom", 100000);
-    optimized_key_frames_sub_ptr_ = std::make_shared<KeyFramesSubscriber>(nh, "/optimized_key_frames", 100000);
+    YAML::Node config_node = YAML::LoadFile(WORK_SPACE_PATH + "/config/mapping/viewer.yaml");
+    optimized_key_frames_sub_ptr_ = std::make_shared<KeyFramesSubscriber>(
+        nh, "/optimized_key_frames", 100000, config_node["incremental_key_frames"].as<bool>()
+    );
     // publisher
     optimized_odom_pub_ptr_ = std::make_shared<OdometryPublisher>(nh, "/optimized_odom", "/map", "/lidar", 100);
     current_scan_pub_ptr_ = std::make_shared<CloudPublisher>(nh, "/current_scan", "/map", 100);
     global_map_pub_ptr_ = std::make_shared<CloudPublisher>(nh, "/global_map", "/map", 100);
+    // only the submaps that are new or moved since the last global map:
+    global_map_delta_pub_ptr_ = std::make_shared<CloudPublisher>(nh, "/global_map_delta", "/map", 100);
     local_map_pub_ptr_ = std::make_shared<CloudPublisher>(nh, "/local_map", "/map", 100);
     // viewer
     viewer_ptr_ = std::make_shared<Viewer>();
+    // metrics
+    metrics_.AddQueue("cloud_queue", [this]{ return cloud_data_buff_.size(); });
+    metrics_.AddQueue("transformed_odom_queue", [this]{ return transformed_odom_buff_.size(); });
+    metrics_.AddQueue("key_frame_queue", [this]{ return key_frame_buff_.size(); });
+    dropped_clouds_ptr_ = &metrics_.AddCounter("dropped_clouds");
+    dropped_transformed_odom_ptr_ = &metrics_.AddCounter("dropped_transformed_odom");
 }
 
 bool ViewerFlow::Run() {
+    TRACE_SCOPE("ViewerFlow::Run", "flow");
+    metrics_.UpdateQueues();
+
     if (!ReadData())
         return false;
 
     while(HasData()) {
         if (ValidData()) {
+            ScopedLatency latency(metrics_.GetLatency());
             viewer_ptr_->UpdateWithNewKeyFrame(key_frame_buff_, current_transformed_odom_, current_cloud_data_);
             PublishLocalData();
         }
@@ -36,8 +52,9 @@ bool ViewerFlow::Run() {
 
     if (optimized_key_frames_.size() > 0) {
         viewer_ptr_->UpdateWithOptimizedKeyFrames(optimized_key_frames_);
-        PublishGlobalData();
     }
+    // the global map is throttled, a pending one is published once it is due:
+    PublishGlobalData();
 
     return true;
 }
@@ -68,11 +85,13 @@ bool ViewerFlow::ValidData() {
 
     if (diff_odom_time < -0.05) {
         cloud_data_buff_.pop_front();
+        dropped_clouds_ptr_->Increment();
         return false;
     }
 
     if (diff_odom_time > 0.05) {
         transformed_odom_buff_.pop_front();
+        dropped_transformed_odom_ptr_->Increment();
         return false;
     }
 
@@ -83,7 +102,17 @@ bool ViewerFlow::ValidData() {
 }
 
 bool ViewerFlow::PublishGlobalData() {
-    if (viewer_ptr_->HasNewGlobalMap() && global_map_pub_ptr_->HasSubscribers()) {
+    if (!viewer_ptr_->HasNewGlobalMap())
+        return true;
+
+    if (global_map_delta_pub_ptr_->HasSubscribers()) {
+        CloudData::CLOUD_PTR delta_map_ptr;
+        viewer_ptr_->GetGlobalMapDelta(delta_map_ptr);
+        if (delta_map_ptr->points.size() > 0)
+            global_map_delta_pub_ptr_->Publish(delta_map_ptr);
+    }
+
+    if (global_map_pub_ptr_->HasSubscribers()) {
         CloudData::CLOUD_PTR cloud_ptr(new CloudData::CLOUD());
         viewer_ptr_->GetGlobalMap(cloud_ptr);
         global_map_pub_ptr_->Publish(cloud_ptr);
@@ -108,4 +137,14 @@ bool ViewerFlow::PublishLocalData() {
 bool ViewerFlow::SaveMap() {
     return viewer_ptr_->SaveMap();
 }
+
+BackgroundJobs::Job ViewerFlow::GetSaveMapJob() {
+    std::shared_ptr<std::deque<KeyFrame>> key_frames_ptr = std::make_shared<std::deque<KeyFrame>>();
+    viewer_ptr_->GetOptimizedKeyFrames(*key_frames_ptr);
+
+    std::shared_ptr<Viewer> viewer_ptr = viewer_ptr_;
+    return [viewer_ptr, key_frames_ptr](const BackgroundJobs::Progress& progress) {
+        return viewer_ptr->SaveMap(*key_frames_ptr, progress);
+    };
+}
 }
\ No newline at end of file
@@ -8,6 +8,8 @@
 #include "glog/logging.h"
 
 #include "lidar_localization/models/cloud_filter/box_filter.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/cloud_pool.hpp"
 
 namespace lidar_localization {
 BoxFilter::BoxFilter(YAML::Node node) {
@@ -21,8 +23,12 @@ BoxFilter::BoxFilter(YAML::Node node) {
     SetSize(size_);
 }
 
-bool BoxFilter::Filter(const CloudData::CLOUD_PTR& input_cloud_ptr,
+bool BoxFilter::Filter(const CloudData::CLOUD::ConstPtr& input_cloud_ptr,
                        CloudData::CLOUD_PTR& output_cloud_ptr) {
+    TRACE_SCOPE("BoxFilter::Filter", "filter");
+    if (!output_cloud_ptr) {
+        output_cloud_ptr = CloudPool::GetInstance().Get();
+    }
     output_cloud_ptr->clear();
     pcl_box_filter_.setMin(Eigen::Vector4f(edge_.at(0), edge_.at(2), edge_.at(4), 1.0e-6));
     pcl_box_filter_.setMax(Eigen::Vector4f(edge_.at(1), edge_.at(3), edge_.at(5), 1.0e6));
@@ -0,0 +1,149 @@
+/*
+ * @Description: filter chain fused into a single pass over the input with a single output allocation
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 22:31:47
+ */
+#include "lidar_localization/models/cloud_filter/filter_chain.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/cloud_pool.hpp"
+#include "lidar_localization/tools/task_scheduler.hpp"
+
+#include <cmath>
+#include <string>
+#include <algorithm>
+#include <iostream>
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+FilterChain::FilterChain(const YAML::Node& node) {
+    std::cout << "Filter Chain params:" << std::endl;
+
+    for (size_t i = 0; i < node.size(); ++i) {
+        const YAML::Node& stage_node = node[i];
+        const std::string type = stage_node["type"].as<std::string>();
+        std::cout << "\tstage " << i << ": " << type << std::endl;
+
+        if (voxel_filter_ptr_ || ground_filter_ptr_) {
+            LOG(ERROR) << "Filter chain stage " << type << " after the last stage, voxel or ground, is skipped.";
+            continue;
+        }
+
+        if (type == "nan") {
+            has_point_stage_ = true;
+        } else if (type == "range") {
+            const float min_range = stage_node["min_range"].as<float>();
+            const float max_range = stage_node["max_range"].as<float>();
+            has_point_stage_ = has_range_ = true;
+            min_sq_range_ = std::max(min_sq_range_, min_range * min_range);
+            max_sq_range_ = std::min(max_sq_range_, max_range * max_range);
+        } else if (type == "box") {
+            const std::vector<float> box_min = stage_node["min"].as<std::vector<float>>();
+            const std::vector<float> box_max = stage_node["max"].as<std::vector<float>>();
+            has_point_stage_ = has_box_ = true;
+            box_min_ = box_min_.cwiseMax(Eigen::Vector3f(box_min.at(0), box_min.at(1), box_min.at(2)));
+            box_max_ = box_max_.cwiseMin(Eigen::Vector3f(box_max.at(0), box_max.at(1), box_max.at(2)));
+        } else if (type == "voxel") {
+            voxel_filter_ptr_ = std::make_shared<FastVoxelFilter>(stage_node);
+        } else if (type == "ground") {
+            ground_filter_ptr_ = std::make_shared<GroundFilter>(stage_node);
+        } else {
+            LOG(ERROR) << "Filter chain stage " << type << " NOT FOUND!";
+        }
+    }
+
+    std::cout << std::endl;
+}
+
+bool FilterChain::Filter(const CloudData::CLOUD::ConstPtr& input_cloud_ptr, CloudData::CLOUD_PTR& filtered_cloud_ptr) {
+    return Filter(input_cloud_ptr, nullptr, filtered_cloud_ptr);
+}
+
+bool FilterChain::Filter(const CloudData& cloud_data, CloudData::CLOUD_PTR& filtered_cloud_ptr) {
+    return Filter(cloud_data.cloud_ptr, cloud_data.range_image_ptr, filtered_cloud_ptr);
+}
+
+bool FilterChain::Filter(
+    const CloudData::CLOUD::ConstPtr& input_cloud_ptr, const CloudData::RANGE_IMAGE_PTR& range_image_ptr,
+    CloudData::CLOUD_PTR& filtered_cloud_ptr
+) {
+    TRACE_SCOPE("FilterChain::Filter", "filter");
+    const CloudData::CLOUD& input_cloud = *input_cloud_ptr;
+    const int N = static_cast<int>(input_cloud.points.size());
+
+    // a. mask of the point-wise stages:
+    point_mask_.clear();
+    if (has_point_stage_) {
+        point_mask_.resize(N);
+        TaskScheduler::GetInstance().ParallelFor(
+            0, N, 8192,
+            [&](int begin, int end) {
+                for (int i = begin; i < end; ++i) {
+                    point_mask_[i] = IsKept(input_cloud.points[i]) ? 1 : 0;
+                }
+            }
+        );
+    }
+
+    // b. the last stage reads the input through the mask:
+    if (voxel_filter_ptr_) {
+        return voxel_filter_ptr_->Filter(input_cloud_ptr, point_mask_, filtered_cloud_ptr);
+    }
+    if (ground_filter_ptr_) {
+        return ground_filter_ptr_->Filter(input_cloud_ptr, point_mask_, range_image_ptr, filtered_cloud_ptr);
+    }
+
+    // c. otherwise the kept points are compacted, in place if the filtered cloud is the input:
+    if (!has_point_stage_) {
+        if (!filtered_cloud_ptr) {
+            filtered_cloud_ptr = CloudData::CLOUD_PTR(input_cloud_ptr, const_cast<CloudData::CLOUD*>(input_cloud_ptr.get()));
+        } else if (filtered_cloud_ptr != input_cloud_ptr) {
+            *filtered_cloud_ptr = input_cloud;
+        }
+        return true;
+    }
+
+    if (!filtered_cloud_ptr) {
+        filtered_cloud_ptr = CloudPool::GetInstance().Get();
+    }
+    CloudData::CLOUD& filtered_cloud = *filtered_cloud_ptr;
+    if (filtered_cloud_ptr != input_cloud_ptr) {
+        filtered_cloud.header = input_cloud.header;
+        filtered_cloud.sensor_origin_ = input_cloud.sensor_origin_;
+        filtered_cloud.sensor_orientation_ = input_cloud.sensor_orientation_;
+        filtered_cloud.points.resize(N);
+    }
+
+    int num_kept = 0;
+    for (int i = 0; i < N; ++i) {
+        if (point_mask_[i])
+            filtered_cloud.points[num_kept++] = input_cloud.points[i];
+    }
+    filtered_cloud.points.resize(num_kept);
+    filtered_cloud.width = num_kept;
+    filtered_cloud.height = 1;
+    filtered_cloud.is_dense = true;
+
+    return true;
+}
+
+bool FilterChain::IsKept(const CloudData::POINT& point) const {
+    if (!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z))
+        return false;
+
+    const Eigen::Vector3f p = point.getVector3fMap();
+    if (has_range_) {
+        const float sq_range = p.squaredNorm();
+        if (sq_range < min_sq_range_ || sq_range > max_sq_range_)
+            return false;
+    }
+    if (has_box_) {
+        if ((p.array() < box_min_.array()).any() || (p.array() > box_max_.array()).any())
+            return false;
+    }
+
+    return true;
+}
+
+}
@@ -0,0 +1,162 @@
+/*
+ * @Description: range image ground segmentation, ground decimated harder than the rest before registration
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 21:34:12
+ */
+#include "lidar_localization/models/cloud_filter/ground_filter.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/cloud_pool.hpp"
+#include "lidar_localization/tools/task_scheduler.hpp"
+
+#include <cmath>
+#include <iostream>
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+namespace {
+const float DEG_TO_RAD = M_PI / 180.0f;
+}
+
+GroundFilter::GroundFilter(const YAML::Node& node)
+    : range_image_(node),
+      ground_cloud_ptr_(new CloudData::CLOUD()),
+      structure_cloud_ptr_(new CloudData::CLOUD()) {
+    num_ground_rings_ = std::min(std::max(node["num_ground_rings"].as<int>(), 0), range_image_.GetNumRows());
+    const float max_ground_angle = node["max_ground_angle"].as<float>();
+    max_ground_slope_ = std::tan(max_ground_angle * DEG_TO_RAD);
+    max_ground_height_ = node["max_ground_height"].as<float>();
+
+    const std::vector<float> ground_leaf_size = node["ground_leaf_size"].as<std::vector<float>>();
+    const std::vector<float> leaf_size = node["leaf_size"].as<std::vector<float>>();
+    ground_filter_ptr_ = std::make_shared<FastVoxelFilter>(
+        ground_leaf_size.at(0), ground_leaf_size.at(1), ground_leaf_size.at(2), FastVoxelFilter::CENTROID
+    );
+    structure_filter_ptr_ = std::make_shared<FastVoxelFilter>(
+        leaf_size.at(0), leaf_size.at(1), leaf_size.at(2), FastVoxelFilter::CENTROID
+    );
+
+    std::cout << "Ground Filter params:" << std::endl
+              << "\trange image: " << range_image_.GetNumRows() << " x " << range_image_.GetNumCols() << std::endl
+              << "\tnum. ground rings: " << num_ground_rings_ << std::endl
+              << "\tmax. ground angle: " << max_ground_angle << " deg, "
+              << "max. ground height: " << max_ground_height_ << " m" << std::endl
+              << std::endl;
+}
+
+bool GroundFilter::Filter(const CloudData::CLOUD::ConstPtr& input_cloud_ptr, CloudData::CLOUD_PTR& filtered_cloud_ptr) {
+    static const std::vector<uint8_t> NO_MASK;
+
+    return Filter(input_cloud_ptr, NO_MASK, nullptr, filtered_cloud_ptr);
+}
+
+bool GroundFilter::Filter(const CloudData& cloud_data, CloudData::CLOUD_PTR& filtered_cloud_ptr) {
+    static const std::vector<uint8_t> NO_MASK;
+
+    return Filter(cloud_data.cloud_ptr, NO_MASK, cloud_data.range_image_ptr, filtered_cloud_ptr);
+}
+
+bool GroundFilter::Filter(
+    const CloudData::CLOUD::ConstPtr& input_cloud_ptr, const std::vector<uint8_t>& point_mask,
+    const CloudData::RANGE_IMAGE_PTR& range_image_ptr, CloudData::CLOUD_PTR& filtered_cloud_ptr
+) {
+    TRACE_SCOPE("GroundFilter::Filter", "filter");
+    const CloudData::CLOUD& input_cloud = *input_cloud_ptr;
+    const int N = static_cast<int>(input_cloud.points.size());
+    const bool has_mask = !point_mask.empty();
+
+    // a. range image, from ingest if it is of this cloud & covers the ground rings:
+    const RangeImage* range_image = &range_image_;
+    if (
+        range_image_ptr && 
+        range_image_ptr->GetNumPoints() == input_cloud.points.size() &&
+        range_image_ptr->GetNumRows() >= num_ground_rings_
+    ) {
+        range_image = range_image_ptr.get();
+    } else {
+        range_image_.Build(input_cloud);
+    }
+    const int num_columns = range_image->GetNumCols();
+
+    // b. going up each column, a flat step from the previous candidate cell makes both ground.
+    // a cell is a candidate if its nearest point is kept and low enough:
+    const int num_cells = num_ground_rings_ * num_columns;
+    is_ground_cell_.assign(num_cells, 0);
+    TaskScheduler::GetInstance().ParallelFor(
+        0, num_columns, 64,
+        [&](int begin, int end) {
+            for (int col = begin; col < end; ++col) {
+                int prev_cell = -1;
+                int prev_point = -1;
+                for (int row = 0; row < num_ground_rings_; ++row) {
+                    const int point = range_image->GetPointIndex(row, col);
+                    if (
+                        point == RangeImage::EMPTY || 
+                        (has_mask && !point_mask[point]) ||
+                        input_cloud.points[point].z > max_ground_height_
+                    ) {
+                        continue;
+                    }
+
+                    const int cell = row * num_columns + col;
+                    if (prev_cell >= 0) {
+                        const Eigen::Vector3f diff = (
+                            input_cloud.points[point].getVector3fMap() -
+                            input_cloud.points[prev_point].getVector3fMap()
+                        );
+                        if (std::fabs(diff.z()) <= max_ground_slope_ * diff.head<2>().norm()) {
+                            is_ground_cell_[prev_cell] = is_ground_cell_[cell] = 1;
+                        }
+                    }
+                    prev_cell = cell;
+                    prev_point = point;
+                }
+            }
+        }
+    );
+
+    // c. split, every low enough point of a ground cell is ground. non-finite points are dropped by the voxel filters:
+    ground_cloud_ptr_->points.clear();
+    structure_cloud_ptr_->points.clear();
+    for (int i = 0; i < N; ++i) {
+        if (has_mask && !point_mask[i])
+            continue;
+
+        // cells of the ground rings come first:
+        const int cell = range_image->GetPointCell(i);
+        if (
+            cell != RangeImage::EMPTY && cell < num_cells && is_ground_cell_[cell] &&
+            input_cloud.points[i].z <= max_ground_height_
+        ) {
+            ground_cloud_ptr_->points.push_back(input_cloud.points[i]);
+        } else {
+            structure_cloud_ptr_->points.push_back(input_cloud.points[i]);
+        }
+    }
+    num_ground_points_ = ground_cloud_ptr_->points.size();
+
+    // d. decimate, the filtered cloud may be the input cloud, so it is only written here:
+    CloudData::CLOUD_PTR filtered_ground_ptr;
+    CloudData::CLOUD_PTR output_cloud_ptr;
+    ground_filter_ptr_->Filter(ground_cloud_ptr_, filtered_ground_ptr);
+    structure_filter_ptr_->Filter(structure_cloud_ptr_, output_cloud_ptr);
+
+    output_cloud_ptr->header = input_cloud.header;
+    output_cloud_ptr->points.insert(
+        output_cloud_ptr->points.end(), filtered_ground_ptr->points.begin(), filtered_ground_ptr->points.end()
+    );
+    output_cloud_ptr->width = output_cloud_ptr->points.size();
+    output_cloud_ptr->height = 1;
+    output_cloud_ptr->is_dense = true;
+
+    if (filtered_cloud_ptr) {
+        *filtered_cloud_ptr = *output_cloud_ptr;
+    } else {
+        filtered_cloud_ptr = output_cloud_ptr;
+    }
+
+    return true;
+}
+
+}
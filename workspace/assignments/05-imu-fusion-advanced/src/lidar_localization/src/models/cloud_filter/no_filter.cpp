@@ -10,8 +10,17 @@ namespace lidar_localization {
 NoFilter::NoFilter() {
 }
 
-bool NoFilter::Filter(const CloudData::CLOUD_PTR& input_cloud_ptr, CloudData::CLOUD_PTR& filtered_cloud_ptr) {
-    filtered_cloud_ptr.reset(new CloudData::CLOUD(*input_cloud_ptr));
+bool NoFilter::Filter(const CloudData::CLOUD::ConstPtr& input_cloud_ptr, CloudData::CLOUD_PTR& filtered_cloud_ptr) {
+    // without an output of its own the caller gets the input itself, which filtering never modifies:
+    if (!filtered_cloud_ptr) {
+        filtered_cloud_ptr = CloudData::CLOUD_PTR(input_cloud_ptr, const_cast<CloudData::CLOUD*>(input_cloud_ptr.get()));
+        return true;
+    }
+
+    // assigned, so that a recycled output keeps its capacity:
+    if (filtered_cloud_ptr != input_cloud_ptr) {
+        *filtered_cloud_ptr = *input_cloud_ptr;
+    }
     return true;
 }
 } 
\ No newline at end of file
@@ -4,6 +4,8 @@
  * @Date: 2020-02-09 19:53:20
  */
 #include "lidar_localization/models/cloud_filter/voxel_filter.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/cloud_pool.hpp"
 
 #include "glog/logging.h"
 
@@ -33,7 +35,11 @@ bool VoxelFilter::SetFilterParam(float leaf_size_x, float leaf_size_y, float lea
     return true;
 }
 
-bool VoxelFilter::Filter(const CloudData::CLOUD_PTR& input_cloud_ptr, CloudData::CLOUD_PTR& filtered_cloud_ptr) {
+bool VoxelFilter::Filter(const CloudData::CLOUD::ConstPtr& input_cloud_ptr, CloudData::CLOUD_PTR& filtered_cloud_ptr) {
+    TRACE_SCOPE("VoxelFilter::Filter", "filter");
+    if (!filtered_cloud_ptr) {
+        filtered_cloud_ptr = CloudPool::GetInstance().Get();
+    }
     voxel_filter_.setInputCloud(input_cloud_ptr);
     voxel_filter_.filter(*filtered_cloud_ptr);
 
@@ -0,0 +1,93 @@
+/*
+ * @Description: voxel filter aiming at a target point count, with the leaf size adapted from cloud to cloud
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 22:14:05
+ */
+#include "lidar_localization/models/cloud_filter/voxel_filter_adaptive.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+namespace {
+// bound on the change of leaf size per prediction, against overshooting on a single odd cloud:
+const float MAX_LEAF_SIZE_RATIO = 2.0f;
+}
+
+AdaptiveVoxelFilter::AdaptiveVoxelFilter(const YAML::Node& node) {
+    target_num_points_ = std::max(node["target_num_points"].as<int>(), 1);
+    min_leaf_size_ = node["min_leaf_size"].as<float>();
+    max_leaf_size_ = std::max(node["max_leaf_size"].as<float>(), min_leaf_size_);
+    dimension_ = std::max(node["dimension"].as<float>(), 1.0f);
+    tolerance_ = std::max(node["tolerance"].as<float>(), 0.0f);
+    max_num_refinements_ = std::max(node["max_num_refinements"].as<int>(), 0);
+
+    leaf_size_ = std::min(std::max(node["leaf_size"].as<float>(), min_leaf_size_), max_leaf_size_);
+
+    FastVoxelFilter::Mode mode = FastVoxelFilter::CENTROID;
+    std::string mode_name = node["mode"] ? node["mode"].as<std::string>() : "centroid";
+    if (mode_name == "approximate") {
+        mode = FastVoxelFilter::APPROXIMATE;
+    } else if (mode_name != "centroid") {
+        LOG(ERROR) << "Adaptive voxel filter mode " << mode_name << " NOT FOUND! Use centroid.";
+    }
+    voxel_filter_ptr_ = std::make_shared<FastVoxelFilter>(leaf_size_, leaf_size_, leaf_size_, mode);
+
+    std::cout << "Adaptive Voxel Filter params:" << std::endl
+              << "\ttarget num. points: " << target_num_points_ << std::endl
+              << "\tleaf size: " << leaf_size_ << " in [" << min_leaf_size_ << ", " << max_leaf_size_ << "]" << std::endl
+              << "\tdimension: " << dimension_ << ", "
+              << "tolerance: " << tolerance_ << ", "
+              << "max. num. refinements: " << max_num_refinements_ << std::endl
+              << std::endl;
+}
+
+bool AdaptiveVoxelFilter::Filter(const CloudData::CLOUD::ConstPtr& input_cloud_ptr, CloudData::CLOUD_PTR& filtered_cloud_ptr) {
+    TRACE_SCOPE("AdaptiveVoxelFilter::Filter", "filter");
+
+    // the filtered cloud may be the input cloud, which a refinement reads again, so it is only written at the end:
+    float leaf_size = leaf_size_;
+    CloudData::CLOUD_PTR output_cloud_ptr;
+    voxel_filter_ptr_->SetLeafSize(leaf_size, leaf_size, leaf_size);
+    voxel_filter_ptr_->Filter(input_cloud_ptr, output_cloud_ptr);
+
+    const size_t max_num_points = static_cast<size_t>((1.0f + tolerance_) * target_num_points_);
+    for (
+        int i = 0;
+        i < max_num_refinements_ && output_cloud_ptr->points.size() > max_num_points && leaf_size < max_leaf_size_;
+        ++i
+    ) {
+        leaf_size = PredictLeafSize(leaf_size, output_cloud_ptr->points.size());
+        output_cloud_ptr.reset();
+        voxel_filter_ptr_->SetLeafSize(leaf_size, leaf_size, leaf_size);
+        voxel_filter_ptr_->Filter(input_cloud_ptr, output_cloud_ptr);
+    }
+
+    // an empty cloud says nothing about the scene:
+    if (!output_cloud_ptr->points.empty()) {
+        leaf_size_ = PredictLeafSize(leaf_size, output_cloud_ptr->points.size());
+    }
+
+    if (filtered_cloud_ptr) {
+        *filtered_cloud_ptr = *output_cloud_ptr;
+    } else {
+        filtered_cloud_ptr = output_cloud_ptr;
+    }
+
+    return true;
+}
+
+float AdaptiveVoxelFilter::PredictLeafSize(float leaf_size, size_t num_points) const {
+    // num_points * leaf_size^dimension stays constant:
+    float ratio = std::pow(static_cast<float>(num_points) / target_num_points_, 1.0f / dimension_);
+    ratio = std::min(std::max(ratio, 1.0f / MAX_LEAF_SIZE_RATIO), MAX_LEAF_SIZE_RATIO);
+
+    return std::min(std::max(ratio * leaf_size, min_leaf_size_), max_leaf_size_);
+}
+
+}
@@ -0,0 +1,175 @@
+/*
+ * @Description: parallel hash-based voxel filter, without the bounded index of pcl::VoxelGrid
+ * @Author: Ge Yao
+ * @Date: 2020-12-19 19:42:16
+ */
+#include "lidar_localization/models/cloud_filter/voxel_filter_fast.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/cloud_pool.hpp"
+
+#include <cmath>
+#include <unordered_map>
+
+#include <omp.h>
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+namespace {
+// below this many points a single thread is faster:
+const int MIN_POINTS_PER_THREAD = 8192;
+}
+
+FastVoxelFilter::FastVoxelFilter(const YAML::Node& node) {
+    float leaf_size_x = node["leaf_size"][0].as<float>();
+    float leaf_size_y = node["leaf_size"][1].as<float>();
+    float leaf_size_z = node["leaf_size"][2].as<float>();
+
+    Mode mode = CENTROID;
+    std::string mode_name = node["mode"] ? node["mode"].as<std::string>() : "centroid";
+    if (mode_name == "approximate") {
+        mode = APPROXIMATE;
+    } else if (mode_name != "centroid") {
+        LOG(ERROR) << "Fast voxel filter mode " << mode_name << " NOT FOUND! Use centroid.";
+    }
+
+    SetFilterParam(leaf_size_x, leaf_size_y, leaf_size_z, mode);
+}
+
+FastVoxelFilter::FastVoxelFilter(float leaf_size_x, float leaf_size_y, float leaf_size_z, Mode mode) {
+    SetFilterParam(leaf_size_x, leaf_size_y, leaf_size_z, mode);
+}
+
+bool FastVoxelFilter::SetFilterParam(float leaf_size_x, float leaf_size_y, float leaf_size_z, Mode mode) {
+    SetLeafSize(leaf_size_x, leaf_size_y, leaf_size_z);
+    mode_ = mode;
+
+    std::cout << "Fast Voxel Filter params:" << std::endl
+              << leaf_size_x << ", "
+              << leaf_size_y << ", "
+              << leaf_size_z << ", "
+              << "mode: " << (mode_ == CENTROID ? "centroid" : "approximate")
+              << std::endl << std::endl;
+
+    return true;
+}
+
+bool FastVoxelFilter::SetLeafSize(float leaf_size_x, float leaf_size_y, float leaf_size_z) {
+    inverse_leaf_size_ = Eigen::Vector3f(
+        1.0f / leaf_size_x, 
+        1.0f / leaf_size_y, 
+        1.0f / leaf_size_z
+    );
+
+    return true;
+}
+
+bool FastVoxelFilter::Filter(const CloudData::CLOUD::ConstPtr& input_cloud_ptr, CloudData::CLOUD_PTR& filtered_cloud_ptr) {
+    static const std::vector<uint8_t> NO_MASK;
+
+    return Filter(input_cloud_ptr, NO_MASK, filtered_cloud_ptr);
+}
+
+bool FastVoxelFilter::Filter(
+    const CloudData::CLOUD::ConstPtr& input_cloud_ptr, const std::vector<uint8_t>& point_mask,
+    CloudData::CLOUD_PTR& filtered_cloud_ptr
+) {
+    TRACE_SCOPE("FastVoxelFilter::Filter", "filter");
+    const CloudData::CLOUD& input_cloud = *input_cloud_ptr;
+    const int N = static_cast<int>(input_cloud.points.size());
+
+    // a. voxel of each point, masked and non-finite points get an invalid hash:
+    const bool has_mask = !point_mask.empty();
+    const size_t INVALID_HASH = static_cast<size_t>(-1);
+    point_voxel_indices_.resize(N);
+    point_voxel_hashes_.resize(N);
+
+#pragma omp parallel for schedule(static) if(N > MIN_POINTS_PER_THREAD)
+    for (int i = 0; i < N; ++i) {
+        const CloudData::POINT& point = input_cloud.points[i];
+        if (
+            (has_mask && !point_mask[i]) ||
+            !std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z)
+        ) {
+            point_voxel_hashes_[i] = INVALID_HASH;
+            continue;
+        }
+
+        VoxelIndex& index = point_voxel_indices_[i];
+        index.x = static_cast<int32_t>(std::floor(point.x * inverse_leaf_size_.x()));
+        index.y = static_cast<int32_t>(std::floor(point.y * inverse_leaf_size_.y()));
+        index.z = static_cast<int32_t>(std::floor(point.z * inverse_leaf_size_.z()));
+        point_voxel_hashes_[i] = VoxelIndexHash()(index);
+    }
+
+    // b. each thread owns the voxels whose hash falls into its shard, so no merge is needed:
+    const int num_threads = std::max(1, std::min(omp_get_max_threads(), N / MIN_POINTS_PER_THREAD));
+    // the runtime may start fewer threads, leaving some shards untouched:
+    shard_clouds_.resize(num_threads);
+    for (CloudData::CLOUD& shard_cloud: shard_clouds_) {
+        shard_cloud.points.clear();
+    }
+
+#pragma omp parallel num_threads(num_threads)
+    {
+        const int shard = omp_get_thread_num();
+        const size_t num_shards = static_cast<size_t>(omp_get_num_threads());
+
+        std::unordered_map<VoxelIndex, int, VoxelIndexHash> voxel_ids;
+        std::vector<Voxel> voxels;
+        voxel_ids.reserve(N / num_shards / 4 + 1);
+
+        // points are visited in order, so the first point of a voxel has the lowest index:
+        for (int i = 0; i < N; ++i) {
+            const size_t hash = point_voxel_hashes_[i];
+            if (hash == INVALID_HASH || (hash >> 8) % num_shards != static_cast<size_t>(shard))
+                continue;
+
+            auto result = voxel_ids.emplace(point_voxel_indices_[i], static_cast<int>(voxels.size()));
+            if (result.second) {
+                voxels.push_back(Voxel{i, 0, Eigen::Vector3d::Zero()});
+            }
+
+            if (mode_ == CENTROID) {
+                Voxel& voxel = voxels[result.first->second];
+                ++voxel.num_points;
+                voxel.sum += input_cloud.points[i].getVector3fMap().cast<double>();
+            }
+        }
+
+        CloudData::CLOUD& shard_cloud = shard_clouds_[shard];
+        shard_cloud.points.resize(voxels.size());
+        for (size_t j = 0; j < voxels.size(); ++j) {
+            const Voxel& voxel = voxels[j];
+
+            // other fields of richer point types are taken from the first point:
+            CloudData::POINT& point = shard_cloud.points[j];
+            point = input_cloud.points[voxel.first_point_index];
+            if (mode_ == CENTROID) {
+                point.getVector3fMap() = (voxel.sum / voxel.num_points).cast<float>();
+            }
+        }
+    }
+
+    // c. filtered cloud may be the input cloud, so it is only written here:
+    CloudData::CLOUD_PTR output_cloud_ptr = CloudPool::GetInstance().Get();
+    output_cloud_ptr->header = input_cloud.header;
+    for (int shard = 0; shard < num_threads; ++shard) {
+        const CloudData::CLOUD& shard_cloud = shard_clouds_[shard];
+        output_cloud_ptr->points.insert(output_cloud_ptr->points.end(), shard_cloud.points.begin(), shard_cloud.points.end());
+    }
+    output_cloud_ptr->width = output_cloud_ptr->points.size();
+    output_cloud_ptr->height = 1;
+    output_cloud_ptr->is_dense = true;
+
+    if (filtered_cloud_ptr) {
+        *filtered_cloud_ptr = *output_cloud_ptr;
+    } else {
+        filtered_cloud_ptr = output_cloud_ptr;
+    }
+
+    return true;
+}
+
+}
@@ -0,0 +1,558 @@
+/*
+ * @Description: pose graph optimizer using Ceres, with analytic SE3 residuals
+ * @Author: Ge Yao
+ * @Date: 2020-12-27 09:41:26
+ */
+
+#include "lidar_localization/models/graph_optimizer/ceres/ceres_graph_optimizer.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+
+#ifdef LIDAR_LOCALIZATION_WITH_CERES
+
+#include <cmath>
+#include <algorithm>
+#include <thread>
+
+#include <sophus/so3.hpp>
+
+#include "glog/logging.h"
+#include "lidar_localization/tools/tic_toc.hpp"
+
+// LocalParameterization is replaced by Manifold since Ceres 2.1:
+#if CERES_VERSION_MAJOR > 2 || (CERES_VERSION_MAJOR == 2 && CERES_VERSION_MINOR >= 1)
+#define LIDAR_LOCALIZATION_CERES_WITH_MANIFOLD
+#endif
+
+namespace lidar_localization {
+
+namespace {
+const int SE3_PARAM_SIZE = 7;
+const int SE3_TANGENT_SIZE = 6;
+
+const double SMALL_ANGLE = 1.0e-6;
+
+Eigen::Vector3d Log(const Eigen::Quaterniond &q) {
+    return Sophus::SO3d(q.normalized()).log();
+}
+
+Eigen::Matrix3d RightJacobianInverse(const Eigen::Vector3d &phi) {
+    const double theta = phi.norm();
+    const Eigen::Matrix3d phi_hat = Sophus::SO3d::hat(phi);
+
+    if (theta < SMALL_ANGLE) {
+        return Eigen::Matrix3d::Identity() + 0.5 * phi_hat;
+    }
+
+    return Eigen::Matrix3d::Identity() + 0.5 * phi_hat + (
+        1.0 / (theta * theta) - (1.0 + std::cos(theta)) / (2.0 * theta * std::sin(theta))
+    ) * phi_hat * phi_hat;
+}
+
+// noise is the inverse of the information diagonal, same as g2o:
+template <int N>
+Eigen::Matrix<double, N, N> GetSqrtInformation(const Eigen::VectorXd &noise) {
+    Eigen::Matrix<double, N, N> sqrt_information = Eigen::Matrix<double, N, N>::Zero();
+    for (int i = 0; i < N; ++i) {
+        sqrt_information(i, i) = 1.0 / std::sqrt(noise(i));
+    }
+    return sqrt_information;
+}
+
+/**
+ * @brief  relative pose edge, e_t = R_i^T (t_j - t_i) - t_m, e_θ = Log(R_m^T R_i^T R_j)
+ *         jacobians are w.r.t. the right perturbation t + δt, R Exp(δθ), see Se3Parameterization
+ */
+class RelativePoseFactor: public ceres::SizedCostFunction<6, SE3_PARAM_SIZE, SE3_PARAM_SIZE> {
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    RelativePoseFactor(const Eigen::Isometry3d &relative_pose, const Eigen::VectorXd &noise)
+        : t_m_(relative_pose.translation()),
+          q_m_(relative_pose.rotation()),
+          sqrt_information_(GetSqrtInformation<6>(noise)) {}
+
+    bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const override {
+        Eigen::Map<const Eigen::Vector3d> t_i(parameters[0]);
+        Eigen::Map<const Eigen::Quaterniond> q_i(parameters[0] + 3);
+        Eigen::Map<const Eigen::Vector3d> t_j(parameters[1]);
+        Eigen::Map<const Eigen::Quaterniond> q_j(parameters[1] + 3);
+
+        const Eigen::Matrix3d R_i_t = q_i.toRotationMatrix().transpose();
+        const Eigen::Vector3d t_ij = R_i_t * (t_j - t_i);
+
+        Eigen::Matrix<double, 6, 1> e;
+        e.head<3>() = t_ij - t_m_;
+        e.tail<3>() = Log(q_m_.conjugate() * q_i.conjugate() * q_j);
+
+        Eigen::Map<Eigen::Matrix<double, 6, 1>> r(residuals);
+        r = sqrt_information_ * e;
+
+        if (jacobians == nullptr) {
+            return true;
+        }
+
+        const Eigen::Matrix3d J_r_inv = RightJacobianInverse(e.tail<3>());
+        if (jacobians[0] != nullptr) {
+            Eigen::Map<Eigen::Matrix<double, 6, SE3_PARAM_SIZE, Eigen::RowMajor>> J(jacobians[0]);
+            J.setZero();
+            J.block<3, 3>(0, 0) = -R_i_t;
+            J.block<3, 3>(0, 3) = Sophus::SO3d::hat(t_ij);
+            J.block<3, 3>(3, 3) = -J_r_inv * (q_j.conjugate() * q_i).toRotationMatrix();
+            J = sqrt_information_ * J;
+        }
+        if (jacobians[1] != nullptr) {
+            Eigen::Map<Eigen::Matrix<double, 6, SE3_PARAM_SIZE, Eigen::RowMajor>> J(jacobians[1]);
+            J.setZero();
+            J.block<3, 3>(0, 0) = R_i_t;
+            J.block<3, 3>(3, 3) = J_r_inv;
+            J = sqrt_information_ * J;
+        }
+
+        return true;
+    }
+
+  private:
+    Eigen::Vector3d t_m_;
+    Eigen::Quaterniond q_m_;
+    Eigen::Matrix<double, 6, 6> sqrt_information_;
+};
+
+// position prior, e = t - xyz:
+class PriorXYZFactor: public ceres::SizedCostFunction<3, SE3_PARAM_SIZE> {
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    PriorXYZFactor(const Eigen::Vector3d &xyz, const Eigen::VectorXd &noise)
+        : xyz_(xyz),
+          sqrt_information_(GetSqrtInformation<3>(noise)) {}
+
+    bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const override {
+        Eigen::Map<const Eigen::Vector3d> t(parameters[0]);
+
+        Eigen::Map<Eigen::Vector3d> r(residuals);
+        r = sqrt_information_ * (t - xyz_);
+
+        if (jacobians != nullptr && jacobians[0] != nullptr) {
+            Eigen::Map<Eigen::Matrix<double, 3, SE3_PARAM_SIZE, Eigen::RowMajor>> J(jacobians[0]);
+            J.setZero();
+            J.block<3, 3>(0, 0) = sqrt_information_;
+        }
+
+        return true;
+    }
+
+  private:
+    Eigen::Vector3d xyz_;
+    Eigen::Matrix3d sqrt_information_;
+};
+
+// orientation prior, e = Log(R_m^T R):
+class PriorQuaternionFactor: public ceres::SizedCostFunction<3, SE3_PARAM_SIZE> {
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    PriorQuaternionFactor(const Eigen::Quaterniond &quat, const Eigen::VectorXd &noise)
+        : q_m_(quat.normalized()),
+          sqrt_information_(GetSqrtInformation<3>(noise)) {}
+
+    bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const override {
+        Eigen::Map<const Eigen::Quaterniond> q(parameters[0] + 3);
+
+        const Eigen::Vector3d e = Log(q_m_.conjugate() * q);
+
+        Eigen::Map<Eigen::Vector3d> r(residuals);
+        r = sqrt_information_ * e;
+
+        if (jacobians != nullptr && jacobians[0] != nullptr) {
+            Eigen::Map<Eigen::Matrix<double, 3, SE3_PARAM_SIZE, Eigen::RowMajor>> J(jacobians[0]);
+            J.setZero();
+            J.block<3, 3>(0, 3) = sqrt_information_ * RightJacobianInverse(e);
+        }
+
+        return true;
+    }
+
+  private:
+    Eigen::Quaterniond q_m_;
+    Eigen::Matrix3d sqrt_information_;
+};
+
+bool Se3Plus(const double *x, const double *delta, double *x_plus_delta) {
+    Eigen::Map<const Eigen::Vector3d> t(x);
+    Eigen::Map<const Eigen::Quaterniond> q(x + 3);
+    Eigen::Map<const Eigen::Vector3d> delta_t(delta);
+    Eigen::Map<const Eigen::Vector3d> delta_theta(delta + 3);
+
+    Eigen::Map<Eigen::Vector3d> t_plus(x_plus_delta);
+    Eigen::Map<Eigen::Quaterniond> q_plus(x_plus_delta + 3);
+
+    t_plus = t + delta_t;
+    q_plus = (q * Sophus::SO3d::exp(delta_theta).unit_quaternion()).normalized();
+
+    return true;
+}
+
+// the factors give their jacobians w.r.t. the perturbation in the first 6 columns, the 7th is zero:
+bool Se3PlusJacobian(double *jacobian) {
+    Eigen::Map<Eigen::Matrix<double, SE3_PARAM_SIZE, SE3_TANGENT_SIZE, Eigen::RowMajor>> J(jacobian);
+    J.setZero();
+    J.topRows<SE3_TANGENT_SIZE>().setIdentity();
+
+    return true;
+}
+} // namespace
+
+#ifdef LIDAR_LOCALIZATION_CERES_WITH_MANIFOLD
+class Se3Parameterization: public ceres::Manifold {
+  public:
+    int AmbientSize() const override { return SE3_PARAM_SIZE; }
+    int TangentSize() const override { return SE3_TANGENT_SIZE; }
+
+    bool Plus(const double *x, const double *delta, double *x_plus_delta) const override {
+        return Se3Plus(x, delta, x_plus_delta);
+    }
+    bool PlusJacobian(const double *x, double *jacobian) const override {
+        return Se3PlusJacobian(jacobian);
+    }
+
+    bool Minus(const double *y, const double *x, double *y_minus_x) const override {
+        Eigen::Map<const Eigen::Vector3d> t_y(y);
+        Eigen::Map<const Eigen::Quaterniond> q_y(y + 3);
+        Eigen::Map<const Eigen::Vector3d> t_x(x);
+        Eigen::Map<const Eigen::Quaterniond> q_x(x + 3);
+
+        Eigen::Map<Eigen::Matrix<double, SE3_TANGENT_SIZE, 1>> delta(y_minus_x);
+        delta.head<3>() = t_y - t_x;
+        delta.tail<3>() = Log(q_x.conjugate() * q_y);
+
+        return true;
+    }
+    bool MinusJacobian(const double *x, double *jacobian) const override {
+        Eigen::Map<Eigen::Matrix<double, SE3_TANGENT_SIZE, SE3_PARAM_SIZE, Eigen::RowMajor>> J(jacobian);
+        J.setZero();
+        J.leftCols<SE3_TANGENT_SIZE>().setIdentity();
+
+        return true;
+    }
+};
+#else
+class Se3Parameterization: public ceres::LocalParameterization {
+  public:
+    int GlobalSize() const override { return SE3_PARAM_SIZE; }
+    int LocalSize() const override { return SE3_TANGENT_SIZE; }
+
+    bool Plus(const double *x, const double *delta, double *x_plus_delta) const override {
+        return Se3Plus(x, delta, x_plus_delta);
+    }
+    bool ComputeJacobian(const double *x, double *jacobian) const override {
+        return Se3PlusJacobian(jacobian);
+    }
+};
+#endif
+
+CeresGraphOptimizer::CeresGraphOptimizer(const YAML::Node& node)
+    : se3_parameterization_ptr_(new Se3Parameterization()) {
+    ceres::Problem::Options problem_options;
+    // the oldest nodes are removed in sliding window mode:
+    problem_options.enable_fast_removal = true;
+#ifdef LIDAR_LOCALIZATION_CERES_WITH_MANIFOLD
+    problem_options.manifold_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+#else
+    problem_options.local_parameterization_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+#endif
+    problem_ptr_.reset(new ceres::Problem(problem_options));
+
+    const std::string linear_solver_type = node["linear_solver_type"].as<std::string>();
+    if (!ceres::StringToLinearSolverType(linear_solver_type, &options_.linear_solver_type)) {
+        LOG(ERROR) << "Linear solver " << linear_solver_type << " NOT FOUND! Use SPARSE_NORMAL_CHOLESKY instead.";
+        options_.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
+    }
+
+    // 0 for all cores:
+    int num_threads = node["num_threads"].as<int>();
+    if (num_threads <= 0) {
+        num_threads = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    }
+    options_.num_threads = num_threads;
+#if CERES_VERSION_MAJOR < 2
+    options_.num_linear_solver_threads = num_threads;
+#endif
+
+    options_.trust_region_strategy_type = ceres::LEVENBERG_MARQUARDT;
+    options_.minimizer_progress_to_stdout = false;
+    options_.logging_type = ceres::SILENT;
+
+    SetMaxIterationsNum(node["max_iterations_num"].as<int>());
+
+    std::cout << "Ceres params:" << std::endl
+              << "linear_solver_type: " << ceres::LinearSolverTypeToString(options_.linear_solver_type) << ", "
+              << "num_threads: " << options_.num_threads << ", "
+              << "max_iterations_num: " << max_iterations_num_
+              << std::endl << std::endl;
+}
+
+CeresGraphOptimizer::~CeresGraphOptimizer() {
+}
+
+bool CeresGraphOptimizer::Optimize() {
+    TRACE_SCOPE("CeresGraphOptimizer::Optimize", "optimize");
+    static int optimize_cnt = 0;
+    if (problem_ptr_->NumResidualBlocks() < 1) {
+        return false;
+    }
+
+    TicToc optimize_time;
+    // the kept parameter blocks already hold the last estimate:
+    const bool is_incremental = has_estimate_;
+    if (is_incremental) {
+        InitNewNodes();
+    }
+    new_node_index_ = node_num_;
+    new_edges_.clear();
+
+    options_.max_num_iterations = max_iterations_num_;
+
+    ceres::Solver::Summary summary;
+    ceres::Solve(options_, problem_ptr_.get(), &summary);
+    if (!summary.IsSolutionUsable()) {
+        LOG(ERROR) << "Ceres optimization failed: " << summary.message;
+        return false;
+    }
+    has_estimate_ = true;
+
+    const int iterations = summary.num_successful_steps + summary.num_unsuccessful_steps;
+
+    // Ceres cost is half of the chi2:
+    optimize_stats_.num_vertices = problem_ptr_->NumParameterBlocks();
+    optimize_stats_.num_edges = problem_ptr_->NumResidualBlocks();
+    optimize_stats_.num_iterations = iterations;
+    optimize_stats_.chi2_before = 2.0 * summary.initial_cost;
+    optimize_stats_.chi2_after = 2.0 * summary.final_cost;
+    optimize_stats_.time_consumption = optimize_time.toc();
+    optimize_stats_.is_incremental = is_incremental;
+
+    LOG(INFO) << std::endl << "------ Finish Iteration " << ++optimize_cnt << " of Backend Optimization -------" << std::endl
+              << "Num. Vertices: " << optimize_stats_.num_vertices << ", Num. Edges: " << optimize_stats_.num_edges << std::endl
+              << "Num. Iterations: " << iterations << "/" << max_iterations_num_
+              << (is_incremental ? " (warm-started)" : "") << std::endl
+              << "Linear Solver: " << ceres::LinearSolverTypeToString(summary.linear_solver_type_used)
+              << ", Num. Threads: " << summary.num_threads_used << std::endl
+              << "Time Consumption: " << optimize_stats_.time_consumption << std::endl
+              << "Cost Change: " << optimize_stats_.chi2_before << "--->" << optimize_stats_.chi2_after
+              << std::endl << std::endl;
+
+    return true;
+}
+
+void CeresGraphOptimizer::InitNewNodes(void) {
+    for (int index = std::max(new_node_index_, first_node_index_); index < node_num_; ++index) {
+        if (is_fixed_.at(index - first_node_index_)) {
+            continue;
+        }
+
+        // the latest earlier node, usually the odometry edge:
+        const Se3Edge *neighbor_edge = nullptr;
+        int neighbor = -1;
+        for (const Se3Edge &edge: new_edges_) {
+            int other = -1;
+            if (edge.vertex_index2 == index) {
+                other = edge.vertex_index1;
+            } else if (edge.vertex_index1 == index) {
+                other = edge.vertex_index2;
+            }
+
+            if (other < first_node_index_ || other >= index || other <= neighbor) {
+                continue;
+            }
+
+            neighbor = other;
+            neighbor_edge = &edge;
+        }
+
+        if (neighbor_edge == nullptr) {
+            continue;
+        }
+
+        const Eigen::Isometry3d pose = (
+            neighbor_edge->vertex_index2 == index ?
+            GetPose(neighbor) * neighbor_edge->relative_pose :
+            GetPose(neighbor) * neighbor_edge->relative_pose.inverse()
+        );
+
+        double *param = GetParam(index);
+        Eigen::Map<Eigen::Vector3d> t(param);
+        Eigen::Map<Eigen::Quaterniond> q(param + 3);
+        t = pose.translation();
+        q = Eigen::Quaterniond(pose.rotation()).normalized();
+    }
+}
+
+bool CeresGraphOptimizer::GetOptimizedPose(std::deque<Eigen::Matrix4f>& optimized_pose) {
+    optimized_pose.clear();
+
+    for (int i = first_node_index_; i < node_num_; ++i) {
+        optimized_pose.push_back(GetPose(i).matrix().cast<float>());
+    }
+
+    return true;
+}
+
+int CeresGraphOptimizer::GetNodeNum() {
+    return node_num_;
+}
+
+int CeresGraphOptimizer::GetFirstNodeIndex() {
+    return first_node_index_;
+}
+
+size_t CeresGraphOptimizer::GetMemoryUsage(void) const {
+    // parameter blocks & edges not added to the problem yet, the residual blocks of ceres are not counted:
+    return (
+        nodes_.size() * sizeof(Se3Param) + 
+        new_edges_.capacity() * sizeof(Se3Edge)
+    );
+}
+
+void CeresGraphOptimizer::SetEstimateOptimized(void) {
+    // only nodes added from now on follow their edges:
+    new_node_index_ = node_num_;
+    new_edges_.clear();
+    has_estimate_ = true;
+}
+
+bool CeresGraphOptimizer::RemoveOldestSe3Nodes(int num_nodes_to_keep) {
+    num_nodes_to_keep = std::max(num_nodes_to_keep, 1);
+    if (node_num_ - first_node_index_ <= num_nodes_to_keep)
+        return false;
+
+    while (node_num_ - first_node_index_ > num_nodes_to_keep) {
+        // residual blocks are removed together with the parameter block:
+        problem_ptr_->RemoveParameterBlock(nodes_.front().data());
+        nodes_.pop_front();
+        is_fixed_.pop_front();
+        ++first_node_index_;
+    }
+
+    problem_ptr_->SetParameterBlockConstant(nodes_.front().data());
+    is_fixed_.front() = true;
+
+    new_edges_.erase(
+        std::remove_if(
+            new_edges_.begin(), new_edges_.end(),
+            [this](const Se3Edge &edge) {
+                return edge.vertex_index1 < first_node_index_ || edge.vertex_index2 < first_node_index_;
+            }
+        ),
+        new_edges_.end()
+    );
+
+    return true;
+}
+
+void CeresGraphOptimizer::AddSe3Node(const Eigen::Isometry3d &pose, bool need_fix) {
+    Se3Param param;
+    Eigen::Map<Eigen::Vector3d> t(param.data());
+    Eigen::Map<Eigen::Quaterniond> q(param.data() + 3);
+    t = pose.translation();
+    q = Eigen::Quaterniond(pose.rotation()).normalized();
+
+    nodes_.push_back(param);
+    is_fixed_.push_back(need_fix);
+    ++node_num_;
+
+    problem_ptr_->AddParameterBlock(nodes_.back().data(), SE3_PARAM_SIZE, se3_parameterization_ptr_.get());
+    if (need_fix) {
+        problem_ptr_->SetParameterBlockConstant(nodes_.back().data());
+    }
+}
+
+void CeresGraphOptimizer::SetEdgeRobustKernel(std::string robust_kernel_name,
+        double robust_kernel_size) {
+    robust_kernel_name_ = robust_kernel_name;
+    robust_kernel_size_ = robust_kernel_size;
+    need_robust_kernel_ = true;
+}
+
+void CeresGraphOptimizer::AddSe3Edge(
+    int vertex_index1,
+    int vertex_index2,
+    const Eigen::Isometry3d &relative_pose,
+    const Eigen::VectorXd noise
+) {
+    double *param1 = GetParam(vertex_index1);
+    double *param2 = GetParam(vertex_index2);
+    if (param1 == nullptr || param2 == nullptr) {
+        LOG(WARNING) << "Se3 edge " << vertex_index1 << "-" << vertex_index2 << " is out of the graph, skipped.";
+        return;
+    }
+
+    problem_ptr_->AddResidualBlock(
+        new RelativePoseFactor(relative_pose, noise), CreateRobustKernel(),
+        param1, param2
+    );
+
+    new_edges_.push_back({vertex_index1, vertex_index2, relative_pose});
+}
+
+void CeresGraphOptimizer::AddSe3PriorXYZEdge(
+    int se3_vertex_index,
+    const Eigen::Vector3d &xyz,
+    Eigen::VectorXd noise
+) {
+    double *param = GetParam(se3_vertex_index);
+    if (param == nullptr) {
+        LOG(WARNING) << "Se3 prior xyz edge of " << se3_vertex_index << " is out of the graph, skipped.";
+        return;
+    }
+
+    problem_ptr_->AddResidualBlock(new PriorXYZFactor(xyz, noise), nullptr, param);
+}
+
+void CeresGraphOptimizer::AddSe3PriorQuaternionEdge(int se3_vertex_index,
+        const Eigen::Quaterniond &quat,
+        Eigen::VectorXd noise) {
+    double *param = GetParam(se3_vertex_index);
+    if (param == nullptr) {
+        LOG(WARNING) << "Se3 prior quaternion edge of " << se3_vertex_index << " is out of the graph, skipped.";
+        return;
+    }
+
+    problem_ptr_->AddResidualBlock(new PriorQuaternionFactor(quat, noise), nullptr, param);
+}
+
+double *CeresGraphOptimizer::GetParam(int vertex_index) {
+    if (vertex_index < first_node_index_ || vertex_index >= node_num_) {
+        return nullptr;
+    }
+
+    return nodes_.at(vertex_index - first_node_index_).data();
+}
+
+Eigen::Isometry3d CeresGraphOptimizer::GetPose(int vertex_index) {
+    const double *param = GetParam(vertex_index);
+
+    Eigen::Isometry3d pose = Eigen::Isometry3d::Identity();
+    pose.linear() = Eigen::Map<const Eigen::Quaterniond>(param + 3).toRotationMatrix();
+    pose.translation() = Eigen::Map<const Eigen::Vector3d>(param);
+
+    return pose;
+}
+
+ceres::LossFunction *CeresGraphOptimizer::CreateRobustKernel(void) {
+    if (!need_robust_kernel_ || robust_kernel_name_ == "NONE") {
+        return nullptr;
+    }
+
+    // one per residual block, the problem takes the ownership:
+    if (robust_kernel_name_ == "Huber") {
+        return new ceres::HuberLoss(robust_kernel_size_);
+    } else if (robust_kernel_name_ == "Cauchy") {
+        return new ceres::CauchyLoss(robust_kernel_size_);
+    }
+
+    LOG(WARNING) << "invalid robust kernel type: " << robust_kernel_name_;
+    return nullptr;
+}
+} // namespace lidar_localization
+
+#endif
@@ -5,75 +5,302 @@
  */
 
 #include "lidar_localization/models/graph_optimizer/g2o/g2o_graph_optimizer.hpp"
+#include "lidar_localization/tools/tracer.hpp"
 #include "glog/logging.h"
 #include "lidar_localization/tools/tic_toc.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+// so that the GNSS priors are kept in .g2o exports:
+namespace g2o {
+G2O_REGISTER_TYPE(EDGE_SE3_PRIORXYZ, EdgeSE3PriorXYZ);
+G2O_REGISTER_TYPE(EDGE_SE3_PRIORQUAT, EdgeSE3PriorQuat);
+} // namespace g2o
+
 namespace lidar_localization {
-G2oGraphOptimizer::G2oGraphOptimizer(const std::string &solver_type) {
+
+namespace {
+// incremental mode checks the cost after every few iterations and stops once it no longer improves:
+const int INCREMENTAL_ITERATION_STEP = 5;
+const double INCREMENTAL_MIN_COST_DECREASE = 1.0e-3;
+// max. num. of noise configs whose information matrices are cached:
+const size_t MAX_INFORMATION_CACHE_SIZE = 8;
+
+// all vertices are VertexSE3, so the block sizes are known at compile time:
+template <template <typename> class LinearSolverType>
+g2o::OptimizationAlgorithm *CreateLevenbergFix6_3(void) {
+    std::unique_ptr<g2o::BlockSolver_6_3::LinearSolverType> linear_solver(
+        new LinearSolverType<g2o::BlockSolver_6_3::PoseMatrixType>()
+    );
+
+    return new g2o::OptimizationAlgorithmLevenberg(
+        std::unique_ptr<g2o::BlockSolver_6_3>(new g2o::BlockSolver_6_3(std::move(linear_solver)))
+    );
+}
+}
+
+G2oGraphOptimizer::G2oGraphOptimizer(const std::string &solver_type, bool incremental)
+    : incremental_(incremental) {
     graph_ptr_.reset(new g2o::SparseOptimizer());
 
-    g2o::OptimizationAlgorithmFactory *solver_factory = g2o::OptimizationAlgorithmFactory::instance();
-    g2o::OptimizationAlgorithmProperty solver_property;
-    g2o::OptimizationAlgorithm *solver = solver_factory->construct(solver_type, solver_property);
+    g2o::OptimizationAlgorithm *solver = CreateAlgorithm(solver_type);
     graph_ptr_->setAlgorithm(solver);
 
     if (!graph_ptr_->solver()) {
         LOG(ERROR) << "Failed to create G2O optimizer!" << std::endl;
     }
     robust_kernel_factory_ = g2o::RobustKernelFactory::instance();
+
+    std::cout << "g2o solver: " << solver_type << std::endl;
+}
+
+g2o::OptimizationAlgorithm *G2oGraphOptimizer::CreateAlgorithm(const std::string &solver_type) {
+    if (solver_type == "lm_fix6_3_eigen") {
+        return CreateLevenbergFix6_3<g2o::LinearSolverEigen>();
+    }
+#ifdef LIDAR_LOCALIZATION_WITH_G2O_CHOLMOD
+    if (solver_type == "lm_fix6_3_cholmod") {
+        return CreateLevenbergFix6_3<g2o::LinearSolverCholmod>();
+    }
+#endif
+#ifdef LIDAR_LOCALIZATION_WITH_G2O_CSPARSE
+    if (solver_type == "lm_fix6_3_csparse") {
+        return CreateLevenbergFix6_3<g2o::LinearSolverCSparse>();
+    }
+#endif
+
+    // the fixed-size CSparse solver is registered without suffix:
+    const std::string factory_solver_type = (solver_type == "lm_fix6_3_csparse" ? "lm_fix6_3" : solver_type);
+
+    g2o::OptimizationAlgorithmFactory *solver_factory = g2o::OptimizationAlgorithmFactory::instance();
+    g2o::OptimizationAlgorithmProperty solver_property;
+    g2o::OptimizationAlgorithm *solver = solver_factory->construct(factory_solver_type, solver_property);
+    if (solver == nullptr) {
+        LOG(ERROR) << "G2O solver " << solver_type << " NOT FOUND!";
+    }
+
+    return solver;
 }
 
 bool G2oGraphOptimizer::Optimize() {
-    static int optimize_cnt = 0;
+    TRACE_SCOPE("G2oGraphOptimizer::Optimize", "optimize");
+    // submap graphs optimize several instances in parallel:
+    static std::atomic<int> optimize_cnt(0);
     if(graph_ptr_->edges().size() < 1) {
         return false;
     }
 
     TicToc optimize_time;
-    graph_ptr_->initializeOptimization();
-    graph_ptr_->computeInitialGuess();
+    const bool is_incremental = (incremental_ && is_initialized_);
+    if (is_incremental) {
+        InitNewVertices();
+        graph_ptr_->updateInitialization(new_vertices_, new_edges_);
+    } else if (incremental_ && has_estimate_) {
+        // the structure changed after node removal, keep the estimate:
+        InitNewVertices();
+        graph_ptr_->initializeOptimization();
+        is_initialized_ = true;
+    } else {
+        graph_ptr_->initializeOptimization();
+        graph_ptr_->computeInitialGuess();
+        is_initialized_ = has_estimate_ = true;
+    }
+    new_vertices_.clear();
+    new_edges_.clear();
+
     graph_ptr_->computeActiveErrors();
     graph_ptr_->setVerbose(false);
 
     double chi2 = graph_ptr_->chi2();
-    int iterations = graph_ptr_->optimize(max_iterations_num_);
+    int iterations = 0;
+    if (is_incremental) {
+        double last_chi2 = chi2;
+        while (iterations < max_iterations_num_) {
+            int step = std::min(INCREMENTAL_ITERATION_STEP, max_iterations_num_ - iterations);
+            int step_iterations = graph_ptr_->optimize(step);
+            if (step_iterations <= 0)
+                break;
+            iterations += step_iterations;
+
+            double current_chi2 = graph_ptr_->chi2();
+            if (last_chi2 - current_chi2 < INCREMENTAL_MIN_COST_DECREASE * last_chi2)
+                break;
+            last_chi2 = current_chi2;
+        }
+    } else {
+        iterations = graph_ptr_->optimize(max_iterations_num_);
+    }
+
+    optimize_stats_.num_vertices = graph_ptr_->vertices().size();
+    optimize_stats_.num_edges = graph_ptr_->edges().size();
+    optimize_stats_.num_iterations = iterations;
+    optimize_stats_.chi2_before = chi2;
+    optimize_stats_.chi2_after = graph_ptr_->chi2();
+    optimize_stats_.time_consumption = optimize_time.toc();
+    optimize_stats_.is_incremental = is_incremental;
 
     LOG(INFO) << std::endl << "------ Finish Iteration " << ++optimize_cnt << " of Backend Optimization -------" << std::endl
-              << "Num. Vertices: " << graph_ptr_->vertices().size() << ", Num. Edges: " << graph_ptr_->edges().size() << std::endl
-              << "Num. Iterations: " << iterations << "/" << max_iterations_num_ << std::endl
-              << "Time Consumption: " << optimize_time.toc() << std::endl
-              << "Cost Change: " << chi2 << "--->" << graph_ptr_->chi2()
+              << "Num. Vertices: " << optimize_stats_.num_vertices << ", Num. Edges: " << optimize_stats_.num_edges << std::endl
+              << "Num. Iterations: " << iterations << "/" << max_iterations_num_ 
+              << (is_incremental ? " (incremental)" : "") << std::endl
+              << "Time Consumption: " << optimize_stats_.time_consumption << std::endl
+              << "Cost Change: " << chi2 << "--->" << optimize_stats_.chi2_after
               << std::endl << std::endl;
 
     return true;
 }
 
+void G2oGraphOptimizer::InitNewVertices(void) {
+    // a new vertex follows its edge to the latest optimized neighbor, instead of keeping the raw odometry pose:
+    std::vector<g2o::VertexSE3 *> vertices;
+    for (g2o::HyperGraph::Vertex *v: new_vertices_) {
+        vertices.push_back(dynamic_cast<g2o::VertexSE3 *>(v));
+    }
+    std::sort(
+        vertices.begin(), vertices.end(), 
+        [](const g2o::VertexSE3 *a, const g2o::VertexSE3 *b) { return a->id() < b->id(); }
+    );
+
+    g2o::HyperGraph::VertexSet pending = new_vertices_;
+    for (g2o::VertexSE3 *vertex: vertices) {
+        pending.erase(vertex);
+        if (vertex->fixed())
+            continue;
+
+        g2o::VertexSE3 *neighbor = nullptr;
+        Eigen::Isometry3d estimate = vertex->estimate();
+        for (g2o::HyperGraph::Edge *e: vertex->edges()) {
+            g2o::EdgeSE3 *edge = dynamic_cast<g2o::EdgeSE3 *>(e);
+            if (edge == nullptr)
+                continue;
+
+            g2o::VertexSE3 *from = static_cast<g2o::VertexSE3 *>(edge->vertices()[0]);
+            g2o::VertexSE3 *to = static_cast<g2o::VertexSE3 *>(edge->vertices()[1]);
+            g2o::VertexSE3 *other = (to == vertex ? from : to);
+            if (pending.count(other) || (neighbor != nullptr && other->id() < neighbor->id()))
+                continue;
+
+            neighbor = other;
+            estimate = (
+                to == vertex ? 
+                from->estimate() * edge->measurement() : 
+                to->estimate() * edge->measurement().inverse()
+            );
+        }
+
+        vertex->setEstimate(estimate);
+    }
+}
+
 bool G2oGraphOptimizer::GetOptimizedPose(std::deque<Eigen::Matrix4f>& optimized_pose) {
     optimized_pose.clear();
-    int vertex_num = graph_ptr_->vertices().size();
 
-    for (int i = 0; i < vertex_num; i++) {
-        g2o::VertexSE3* v = dynamic_cast<g2o::VertexSE3*>(graph_ptr_->vertex(i));
-        Eigen::Isometry3d pose = v->estimate();
-        optimized_pose.push_back(pose.matrix().cast<float>());
+    for (int i = first_node_index_; i < node_num_; i++) {
+        optimized_pose.push_back(vertices_[i]->estimate().matrix().cast<float>());
     }
     return true;
 }
 
+int G2oGraphOptimizer::GetOptimizedPoses(Eigen::Matrix4f *optimized_poses, int max_num_poses) {
+    const int num_poses = std::min(node_num_ - first_node_index_, max_num_poses);
+    for (int i = 0; i < num_poses; ++i) {
+        optimized_poses[i] = vertices_[first_node_index_ + i]->estimate().matrix().cast<float>();
+    }
+
+    return num_poses;
+}
+
 int G2oGraphOptimizer::GetNodeNum() {
-    return graph_ptr_->vertices().size();
+    return node_num_;
+}
+
+int G2oGraphOptimizer::GetFirstNodeIndex() {
+    return first_node_index_;
+}
+
+size_t G2oGraphOptimizer::GetMemoryUsage(void) const {
+    // all vertices are SE3, edges are mostly SE3 ones, priors are smaller:
+    return (
+        graph_ptr_->vertices().size() * sizeof(g2o::VertexSE3) + 
+        graph_ptr_->edges().size() * sizeof(g2o::EdgeSE3)
+    );
+}
+
+void G2oGraphOptimizer::SetEstimateOptimized(void) {
+    // the next incremental optimization re-initializes the structure, keeping the estimate:
+    new_vertices_.clear();
+    new_edges_.clear();
+    is_initialized_ = false;
+    has_estimate_ = true;
+}
+
+bool G2oGraphOptimizer::RemoveOldestSe3Nodes(int num_nodes_to_keep) {
+    num_nodes_to_keep = std::max(num_nodes_to_keep, 1);
+    if (node_num_ - first_node_index_ <= num_nodes_to_keep)
+        return false;
+
+    while (node_num_ - first_node_index_ > num_nodes_to_keep) {
+        g2o::VertexSE3 *vertex = vertices_[first_node_index_];
+        vertices_[first_node_index_++] = nullptr;
+        if (vertex == nullptr)
+            continue;
+
+        // edges are deleted together with the vertex:
+        for (g2o::HyperGraph::Edge *edge: vertex->edges()) {
+            new_edges_.erase(edge);
+        }
+        new_vertices_.erase(vertex);
+        graph_ptr_->removeVertex(vertex);
+    }
+
+    vertices_[first_node_index_]->setFixed(true);
+
+    is_initialized_ = false;
+
+    return true;
+}
+
+bool G2oGraphOptimizer::SaveGraph(const std::string &graph_path) {
+    if (!graph_ptr_->save(graph_path.c_str())) {
+        LOG(ERROR) << "Failed to save graph to " << graph_path;
+        return false;
+    }
+
+    LOG(INFO) << "Graph saved to " << graph_path << ", "
+              << graph_ptr_->vertices().size() << " vertices, "
+              << graph_ptr_->edges().size() << " edges.";
+
+    return true;
 }
 
 void G2oGraphOptimizer::AddSe3Node(const Eigen::Isometry3d &pose, bool need_fix) {
     g2o::VertexSE3 *vertex(new g2o::VertexSE3());
 
-    vertex->setId(graph_ptr_->vertices().size());
+    vertex->setId(node_num_++);
     vertex->setEstimate(pose);
     if (need_fix) {
         vertex->setFixed(true);
     }
 
     graph_ptr_->addVertex(vertex);
+    new_vertices_.insert(vertex);
+    vertices_.push_back(vertex);
+}
+
+void G2oGraphOptimizer::AddSe3Nodes(const Eigen::Isometry3d *poses, int num_poses, bool need_fix) {
+    vertices_.reserve(vertices_.size() + num_poses);
+    for (int i = 0; i < num_poses; ++i) {
+        AddSe3Node(poses[i], need_fix && 0 == i);
+    }
+}
+
+g2o::VertexSE3 *G2oGraphOptimizer::GetVertex(int vertex_index) const {
+    if (vertex_index < 0 || vertex_index >= static_cast<int>(vertices_.size()))
+        return nullptr;
+
+    return vertices_[vertex_index];
 }
 
 void G2oGraphOptimizer::SetEdgeRobustKernel(std::string robust_kernel_name,
@@ -89,28 +316,38 @@ void G2oGraphOptimizer::AddSe3Edge(
     const Eigen::Isometry3d &relative_pose,
     const Eigen::VectorXd noise
 ) {
-    Eigen::MatrixXd information_matrix = CalculateSe3EdgeInformationMatrix(noise);
+    AddSe3EdgeToGraph(
+        GetVertex(vertex_index1), GetVertex(vertex_index2), relative_pose, GetDiagMatrix(noise)
+    );
+}
 
-    g2o::VertexSE3* v1 = dynamic_cast<g2o::VertexSE3*>(graph_ptr_->vertex(vertex_index1));
-    g2o::VertexSE3* v2 = dynamic_cast<g2o::VertexSE3*>(graph_ptr_->vertex(vertex_index2));
-    
+void G2oGraphOptimizer::AddSe3Edges(const Se3Edge *edges, int num_edges, const Eigen::VectorXd &noise) {
+    const Eigen::MatrixXd &information_matrix = GetDiagMatrix(noise);
+    for (int i = 0; i < num_edges; ++i) {
+        AddSe3EdgeToGraph(
+            GetVertex(edges[i].vertex_index1), GetVertex(edges[i].vertex_index2),
+            edges[i].relative_pose, information_matrix
+        );
+    }
+}
+
+void G2oGraphOptimizer::AddSe3EdgeToGraph(
+    g2o::VertexSE3 *v1, g2o::VertexSE3 *v2,
+    const Eigen::Isometry3d &relative_pose,
+    const Eigen::MatrixXd &information_matrix
+) {
     g2o::EdgeSE3 *edge(new g2o::EdgeSE3());
     edge->setMeasurement(relative_pose);
     edge->setInformation(information_matrix);
     edge->vertices()[0] = v1;
     edge->vertices()[1] = v2;
     graph_ptr_->addEdge(edge);
+    new_edges_.insert(edge);
     if (need_robust_kernel_) {
         AddRobustKernel(edge, robust_kernel_name_, robust_kernel_size_);
     }
 }
 
-Eigen::MatrixXd G2oGraphOptimizer::CalculateSe3EdgeInformationMatrix(Eigen::VectorXd noise) {
-    Eigen::MatrixXd information_matrix = Eigen::MatrixXd::Identity(6, 6);
-    information_matrix = CalculateDiagMatrix(noise);
-    return information_matrix;
-}
-
 void G2oGraphOptimizer::AddRobustKernel(g2o::OptimizableGraph::Edge *edge, const std::string &kernel_type, double kernel_size) {
     if (kernel_type == "NONE") {
         return;
@@ -134,30 +371,44 @@ Eigen::MatrixXd G2oGraphOptimizer::CalculateDiagMatrix(Eigen::VectorXd noise) {
     return information_matrix;
 }
 
+const Eigen::MatrixXd &G2oGraphOptimizer::GetDiagMatrix(const Eigen::VectorXd &noise) {
+    for (const auto &entry: information_cache_) {
+        if (entry.first.rows() == noise.rows() && entry.first == noise)
+            return entry.second;
+    }
+
+    // noise configs are few, a noise varying per edge must not grow the cache:
+    if (information_cache_.size() >= MAX_INFORMATION_CACHE_SIZE) {
+        information_cache_.erase(information_cache_.begin());
+    }
+    information_cache_.emplace_back(noise, CalculateDiagMatrix(noise));
+    return information_cache_.back().second;
+}
+
 void G2oGraphOptimizer::AddSe3PriorXYZEdge(
     int se3_vertex_index,
     const Eigen::Vector3d &xyz,
     Eigen::VectorXd noise
 ) {
-    Eigen::MatrixXd information_matrix = CalculateDiagMatrix(noise);
-    g2o::VertexSE3 *v_se3 = dynamic_cast<g2o::VertexSE3 *>(graph_ptr_->vertex(se3_vertex_index));
     g2o::EdgeSE3PriorXYZ *edge(new g2o::EdgeSE3PriorXYZ());
     edge->setMeasurement(xyz);
-    edge->setInformation(information_matrix);
-    edge->vertices()[0] = v_se3;
+    edge->setInformation(GetDiagMatrix(noise));
+    edge->vertices()[0] = GetVertex(se3_vertex_index);
     graph_ptr_->addEdge(edge);
+    new_edges_.insert(edge);
 }
 
 void G2oGraphOptimizer::AddSe3PriorQuaternionEdge(int se3_vertex_index,
         const Eigen::Quaterniond &quat,
         Eigen::VectorXd noise) {
     Eigen::MatrixXd information_matrix = CalculateSe3PriorQuaternionEdgeInformationMatrix(noise);
-    g2o::VertexSE3 *v_se3 = dynamic_cast<g2o::VertexSE3 *>(graph_ptr_->vertex(se3_vertex_index));
+    g2o::VertexSE3 *v_se3 = GetVertex(se3_vertex_index);
     g2o::EdgeSE3PriorQuat *edge(new g2o::EdgeSE3PriorQuat());
     edge->setMeasurement(quat);
     edge->setInformation(information_matrix);
     edge->vertices()[0] = v_se3;
     graph_ptr_->addEdge(edge);
+    new_edges_.insert(edge);
 }
 
 // TODO: 姿态观测的信息矩阵尚未添加
@@ -0,0 +1,220 @@
+/*
+ * @Description: incremental graph optimizer using GTSAM iSAM2
+ * @Author: Ge Yao
+ * @Date: 2020-12-11 21:17:45
+ */
+
+#include "lidar_localization/models/graph_optimizer/gtsam/isam2_graph_optimizer.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+
+#ifdef LIDAR_LOCALIZATION_WITH_GTSAM
+
+#include <cstdlib>
+
+#include <gtsam/slam/BetweenFactor.h>
+#include <gtsam/slam/PriorFactor.h>
+#include <gtsam/slam/PoseRotationPrior.h>
+#include <gtsam/navigation/GPSFactor.h>
+
+#include "glog/logging.h"
+#include "lidar_localization/tools/tic_toc.hpp"
+
+namespace lidar_localization {
+
+namespace {
+// iSAM2 has no fixed nodes, the first node is anchored with a prior instead.
+// a loose one only removes the gauge freedom when GNSS constrains the position:
+const double FIXED_NODE_SIGMA = 1.0e-6;
+const double GAUGE_ROTATION_SIGMA = 1.0;
+const double GAUGE_TRANSLATION_SIGMA = 1.0e2;
+}
+
+ISAM2GraphOptimizer::ISAM2GraphOptimizer(const YAML::Node& node) {
+    gtsam::ISAM2Params params;
+    params.relinearizeThreshold = node["relinearize_threshold"].as<double>();
+    params.relinearizeSkip = node["relinearize_skip"].as<int>();
+    num_loop_updates_ = node["num_loop_updates"].as<int>();
+
+    isam2_ptr_.reset(new gtsam::ISAM2(params));
+
+    std::cout << "iSAM2 params:" << std::endl
+              << "relinearize_threshold: " << params.relinearizeThreshold << ", "
+              << "relinearize_skip: " << params.relinearizeSkip << ", "
+              << "num_loop_updates: " << num_loop_updates_
+              << std::endl << std::endl;
+}
+
+bool ISAM2GraphOptimizer::Optimize() {
+    TRACE_SCOPE("ISAM2GraphOptimizer::Optimize", "optimize");
+    static int optimize_cnt = 0;
+    if (new_factors_.empty() && new_values_.empty()) {
+        return false;
+    }
+
+    TicToc optimize_time;
+    size_t num_new_factors = new_factors_.size();
+    int iterations = 1;
+    try {
+        isam2_ptr_->update(new_factors_, new_values_);
+        if (has_new_loop_) {
+            for (int i = 0; i < num_loop_updates_; ++i) {
+                isam2_ptr_->update();
+            }
+            iterations += num_loop_updates_;
+        }
+        estimate_ = isam2_ptr_->calculateEstimate();
+    } catch (const std::exception &e) {
+        LOG(ERROR) << "iSAM2 update failed: " << e.what();
+        return false;
+    }
+
+    new_factors_ = gtsam::NonlinearFactorGraph();
+    new_values_.clear();
+    has_new_loop_ = false;
+
+    // the cost is not evaluated, that would touch the whole graph:
+    optimize_stats_.num_vertices = estimate_.size();
+    optimize_stats_.num_edges = isam2_ptr_->getFactorsUnsafe().size();
+    optimize_stats_.num_iterations = iterations;
+    optimize_stats_.time_consumption = optimize_time.toc();
+    optimize_stats_.is_incremental = true;
+
+    LOG(INFO) << std::endl << "------ Finish Iteration " << ++optimize_cnt << " of Backend Optimization -------" << std::endl
+              << "Num. Vertices: " << optimize_stats_.num_vertices << ", Num. New Factors: " << num_new_factors << std::endl
+              << "Time Consumption: " << optimize_stats_.time_consumption
+              << std::endl << std::endl;
+
+    return true;
+}
+
+bool ISAM2GraphOptimizer::GetOptimizedPose(std::deque<Eigen::Matrix4f>& optimized_pose) {
+    optimized_pose.clear();
+
+    for (int i = 0; i < node_num_; ++i) {
+        // nodes added since the last Optimize keep their initial guess:
+        const gtsam::Values &values = (estimate_.exists(i) ? estimate_ : new_values_);
+        optimized_pose.push_back(values.at<gtsam::Pose3>(i).matrix().cast<float>());
+    }
+
+    return true;
+}
+
+int ISAM2GraphOptimizer::GetNodeNum() {
+    return node_num_;
+}
+
+int ISAM2GraphOptimizer::GetFirstNodeIndex() {
+    return 0;
+}
+
+bool ISAM2GraphOptimizer::RemoveOldestSe3Nodes(int num_nodes_to_keep) {
+    static bool is_warned = false;
+    if (!is_warned) {
+        LOG(WARNING) << "iSAM2 optimizer does not support sliding window, all nodes are kept.";
+        is_warned = true;
+    }
+
+    return false;
+}
+
+void ISAM2GraphOptimizer::AddSe3Node(const Eigen::Isometry3d &pose, bool need_fix) {
+    gtsam::Key key = node_num_++;
+    new_values_.insert(key, ToPose3(pose));
+
+    if (need_fix || 0 == key) {
+        gtsam::Vector6 sigmas;
+        if (need_fix) {
+            sigmas.setConstant(FIXED_NODE_SIGMA);
+        } else {
+            sigmas << gtsam::Vector3::Constant(GAUGE_ROTATION_SIGMA), gtsam::Vector3::Constant(GAUGE_TRANSLATION_SIGMA);
+        }
+
+        new_factors_.add(
+            gtsam::PriorFactor<gtsam::Pose3>(key, ToPose3(pose), gtsam::noiseModel::Diagonal::Sigmas(sigmas))
+        );
+    }
+}
+
+void ISAM2GraphOptimizer::SetEdgeRobustKernel(std::string robust_kernel_name,
+        double robust_kernel_size) {
+    robust_kernel_name_ = robust_kernel_name;
+    robust_kernel_size_ = robust_kernel_size;
+    need_robust_kernel_ = true;
+}
+
+void ISAM2GraphOptimizer::AddSe3Edge(
+    int vertex_index1,
+    int vertex_index2,
+    const Eigen::Isometry3d &relative_pose,
+    const Eigen::VectorXd noise
+) {
+    gtsam::SharedNoiseModel noise_model = GetSe3EdgeNoiseModel(noise);
+    if (need_robust_kernel_) {
+        noise_model = AddRobustKernel(noise_model);
+    }
+
+    new_factors_.add(
+        gtsam::BetweenFactor<gtsam::Pose3>(
+            vertex_index1, vertex_index2, ToPose3(relative_pose), noise_model
+        )
+    );
+
+    if (std::abs(vertex_index2 - vertex_index1) > 1) {
+        has_new_loop_ = true;
+    }
+}
+
+void ISAM2GraphOptimizer::AddSe3PriorXYZEdge(
+    int se3_vertex_index,
+    const Eigen::Vector3d &xyz,
+    Eigen::VectorXd noise
+) {
+    new_factors_.add(
+        gtsam::GPSFactor(
+            se3_vertex_index, gtsam::Point3(xyz),
+            gtsam::noiseModel::Diagonal::Variances(noise)
+        )
+    );
+}
+
+void ISAM2GraphOptimizer::AddSe3PriorQuaternionEdge(int se3_vertex_index,
+        const Eigen::Quaterniond &quat,
+        Eigen::VectorXd noise) {
+    new_factors_.add(
+        gtsam::PoseRotationPrior<gtsam::Pose3>(
+            se3_vertex_index, gtsam::Rot3(quat),
+            gtsam::noiseModel::Diagonal::Variances(noise)
+        )
+    );
+}
+
+gtsam::Pose3 ISAM2GraphOptimizer::ToPose3(const Eigen::Isometry3d &pose) {
+    return gtsam::Pose3(gtsam::Rot3(pose.rotation()), gtsam::Point3(pose.translation()));
+}
+
+gtsam::SharedNoiseModel ISAM2GraphOptimizer::GetSe3EdgeNoiseModel(const Eigen::VectorXd &noise) {
+    // same as g2o, noise is the inverse of the information diagonal:
+    gtsam::Vector6 variances;
+    variances << noise(3), noise(4), noise(5), noise(0), noise(1), noise(2);
+
+    return gtsam::noiseModel::Diagonal::Variances(variances);
+}
+
+gtsam::SharedNoiseModel ISAM2GraphOptimizer::AddRobustKernel(const gtsam::SharedNoiseModel &noise_model) {
+    if (robust_kernel_name_ == "Huber") {
+        return gtsam::noiseModel::Robust::Create(
+            gtsam::noiseModel::mEstimator::Huber::Create(robust_kernel_size_), noise_model
+        );
+    } else if (robust_kernel_name_ == "Cauchy") {
+        return gtsam::noiseModel::Robust::Create(
+            gtsam::noiseModel::mEstimator::Cauchy::Create(robust_kernel_size_), noise_model
+        );
+    } else if (robust_kernel_name_ != "NONE") {
+        LOG(WARNING) << "invalid robust kernel type: " << robust_kernel_name_;
+    }
+
+    return noise_model;
+}
+} // namespace lidar_localization
+
+#endif
@@ -6,8 +6,33 @@
 
 #include "lidar_localization/models/graph_optimizer/interface_graph_optimizer.hpp"
 
+#include <algorithm>
+
 namespace lidar_localization {
 void InterfaceGraphOptimizer::SetMaxIterationsNum(int max_iterations_num) {
     max_iterations_num_ = max_iterations_num;
 }
+
+int InterfaceGraphOptimizer::GetOptimizedPoses(Eigen::Matrix4f *optimized_poses, int max_num_poses) {
+    std::deque<Eigen::Matrix4f> optimized_pose;
+    if (!GetOptimizedPose(optimized_pose))
+        return 0;
+
+    const int num_poses = std::min(static_cast<int>(optimized_pose.size()), max_num_poses);
+    std::copy(optimized_pose.begin(), optimized_pose.begin() + num_poses, optimized_poses);
+
+    return num_poses;
+}
+
+void InterfaceGraphOptimizer::AddSe3Nodes(const Eigen::Isometry3d *poses, int num_poses, bool need_fix) {
+    for (int i = 0; i < num_poses; ++i) {
+        AddSe3Node(poses[i], need_fix && 0 == i);
+    }
+}
+
+void InterfaceGraphOptimizer::AddSe3Edges(const Se3Edge *edges, int num_edges, const Eigen::VectorXd &noise) {
+    for (int i = 0; i < num_edges; ++i) {
+        AddSe3Edge(edges[i].vertex_index1, edges[i].vertex_index2, edges[i].relative_pose, noise);
+    }
+}
 }
\ No newline at end of file
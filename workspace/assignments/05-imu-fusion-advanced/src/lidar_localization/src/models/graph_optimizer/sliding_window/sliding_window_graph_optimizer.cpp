@@ -0,0 +1,713 @@
+/*
+ * @Description: fixed-lag smoother, dense Levenberg-Marquardt over a sliding window of navigation states,
+ *               nodes leaving the window are marginalized into a prior by Schur complement
+ * @Author: Ge Yao
+ * @Date: 2020-12-25 10:06:18
+ */
+
+#include "lidar_localization/models/graph_optimizer/sliding_window/sliding_window_graph_optimizer.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <functional>
+#include <map>
+
+#include <sophus/so3.hpp>
+
+#include <Eigen/Cholesky>
+#include <Eigen/Eigenvalues>
+
+#include "glog/logging.h"
+#include "lidar_localization/tools/tic_toc.hpp"
+
+namespace lidar_localization {
+
+namespace {
+const int INDEX_P = IMUPreIntegrator::INDEX_P;
+const int INDEX_R = IMUPreIntegrator::INDEX_R;
+const int INDEX_V = IMUPreIntegrator::INDEX_V;
+const int INDEX_A = IMUPreIntegrator::INDEX_A;
+const int INDEX_G = IMUPreIntegrator::INDEX_G;
+
+// step of the numerical jacobians:
+const double JACOBIAN_STEP = 1.0e-6;
+// eigen values below this are treated as unobservable in marginalization:
+const double MIN_EIGEN_VALUE = 1.0e-8;
+// stop once the step or the relative cost decrease falls below:
+const double MIN_STEP_NORM = 1.0e-8;
+const double MIN_COST_DECREASE = 1.0e-6;
+const double INIT_LAMBDA = 1.0e-4;
+
+Eigen::MatrixXd GetInformationMatrix(const Eigen::VectorXd &noise) {
+    // same as g2o, noise is the inverse of the information diagonal:
+    Eigen::MatrixXd information_matrix = Eigen::MatrixXd::Identity(noise.rows(), noise.rows());
+    for (int i = 0; i < noise.rows(); i++) {
+        information_matrix(i, i) /= noise(i);
+    }
+    return information_matrix;
+}
+
+Eigen::Vector3d LogSO3(const Eigen::Matrix3d &R) {
+    return Sophus::SO3d(Eigen::Quaterniond(R).normalized()).log();
+}
+}
+
+struct SlidingWindowGraphOptimizer::Edge {
+    typedef std::function<Eigen::VectorXd(const std::vector<const NavState *> &)> ErrorFunction;
+
+    std::vector<int> vertices;
+    Eigen::MatrixXd information;
+    bool robust = false;
+    ErrorFunction error;
+
+    // IMU edges only, re-propagated when the bias estimate moves away from its linearization point:
+    std::shared_ptr<IMUPreIntegrator> pre_integration_ptr;
+};
+
+SlidingWindowGraphOptimizer::SlidingWindowGraphOptimizer(const YAML::Node& node) {
+    max_iterations_num_ = node["max_iterations_num"].as<int>();
+    gravity_magnitude_ = node["gravity_magnitude"].as<double>();
+    max_bias_correction_ = node["max_bias_correction"].as<double>();
+
+    std::cout << "Sliding window optimizer params:" << std::endl
+              << "max_iterations_num: " << max_iterations_num_ << ", "
+              << "gravity_magnitude: " << gravity_magnitude_ << ", "
+              << "max_bias_correction: " << max_bias_correction_
+              << std::endl << std::endl;
+}
+
+bool SlidingWindowGraphOptimizer::Optimize() {
+    TRACE_SCOPE("SlidingWindowGraphOptimizer::Optimize", "optimize");
+    static int optimize_cnt = 0;
+    if (edges_.empty() && !has_prior_) {
+        return false;
+    }
+
+    TicToc optimize_time;
+    double cost = GetTotalCost();
+    const double init_cost = cost;
+
+    double lambda = INIT_LAMBDA;
+    int iterations = 0;
+    while (iterations < max_iterations_num_) {
+        ++iterations;
+
+        // a. re-propagate pre-integrations whose first order bias correction is no longer valid:
+        bool is_repropagated = false;
+        for (const std::shared_ptr<Edge> &edge: edges_) {
+            if (!edge->pre_integration_ptr)
+                continue;
+
+            const NavState &state_i = GetState(edge->vertices.front());
+            IMUPreIntegrator &pre_integration = *edge->pre_integration_ptr;
+            if (
+                (state_i.accel_bias - pre_integration.GetLinearizedAccelBias()).norm() > max_bias_correction_ ||
+                (state_i.gyro_bias - pre_integration.GetLinearizedGyroBias()).norm() > max_bias_correction_
+            ) {
+                pre_integration.Repropagate(state_i.accel_bias, state_i.gyro_bias);
+                edge->information = pre_integration.GetCovariance().inverse();
+                is_repropagated = true;
+            }
+        }
+        if (is_repropagated) {
+            cost = GetTotalCost();
+        }
+
+        // b. normal equations:
+        Eigen::MatrixXd H;
+        Eigen::VectorXd b;
+        BuildNormalEquations(H, b);
+
+        std::vector<int> vertices(states_.size());
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            vertices.at(i) = first_node_index_ + i;
+        }
+        ConstrainNormalEquations(vertices, H, b);
+
+        // c. Marquardt damped step, lambda grows until the cost decreases:
+        bool is_improved = false;
+        double step_norm = 0.0;
+        std::deque<NavState> states = states_;
+        while (lambda < max_lambda_) {
+            Eigen::MatrixXd H_lm = H;
+            H_lm.diagonal() *= (1.0 + lambda);
+            Eigen::VectorXd delta = H_lm.ldlt().solve(-b);
+            step_norm = delta.norm();
+
+            for (size_t i = 0; i < states_.size(); ++i) {
+                Plus(states.at(i), delta.segment<DIM_STATE>(DIM_STATE*i), states_.at(i));
+            }
+
+            double new_cost = GetTotalCost();
+            if (std::isfinite(new_cost) && new_cost < cost) {
+                is_improved = (cost - new_cost > MIN_COST_DECREASE * std::fabs(cost));
+                cost = new_cost;
+                lambda = std::max(0.1 * lambda, min_lambda_);
+                break;
+            }
+
+            states_ = states;
+            lambda *= 10.0;
+        }
+
+        if (!is_improved || step_norm < MIN_STEP_NORM)
+            break;
+    }
+
+    optimize_stats_.num_vertices = states_.size();
+    optimize_stats_.num_edges = edges_.size();
+    optimize_stats_.num_iterations = iterations;
+    optimize_stats_.chi2_before = 2.0 * init_cost;
+    optimize_stats_.chi2_after = 2.0 * cost;
+    optimize_stats_.time_consumption = optimize_time.toc();
+    optimize_stats_.is_incremental = true;
+
+    LOG(INFO) << std::endl << "------ Finish Iteration " << ++optimize_cnt << " of Sliding Window Optimization -------" << std::endl
+              << "Num. Vertices: " << optimize_stats_.num_vertices << ", Num. Edges: " << optimize_stats_.num_edges << std::endl
+              << "Num. Iterations: " << iterations << "/" << max_iterations_num_ << std::endl
+              << "Time Consumption: " << optimize_stats_.time_consumption << std::endl
+              << "Cost Change: " << optimize_stats_.chi2_before << "--->" << optimize_stats_.chi2_after
+              << std::endl << std::endl;
+
+    return true;
+}
+
+bool SlidingWindowGraphOptimizer::GetOptimizedPose(std::deque<Eigen::Matrix4f>& optimized_pose) {
+    optimized_pose.clear();
+
+    for (const NavState &state: states_) {
+        Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
+        pose.block<3, 3>(0, 0) = state.ori.cast<float>();
+        pose.block<3, 1>(0, 3) = state.pos.cast<float>();
+        optimized_pose.push_back(pose);
+    }
+
+    return true;
+}
+
+int SlidingWindowGraphOptimizer::GetNodeNum() {
+    return node_num_;
+}
+
+int SlidingWindowGraphOptimizer::GetFirstNodeIndex() {
+    return first_node_index_;
+}
+
+size_t SlidingWindowGraphOptimizer::GetMemoryUsage(void) const {
+    size_t memory_usage = (
+        states_.size() * sizeof(NavState) + 
+        edges_.capacity() * sizeof(std::shared_ptr<Edge>) + 
+        edges_.size() * sizeof(Edge)
+    );
+    for (const auto &edge: edges_) {
+        memory_usage += edge->information.size() * sizeof(double);
+    }
+    if (has_prior_) {
+        memory_usage += (prior_.H.size() + prior_.b.size()) * sizeof(double);
+    }
+
+    return memory_usage;
+}
+
+bool SlidingWindowGraphOptimizer::RemoveOldestSe3Nodes(int num_nodes_to_keep) {
+    TRACE_SCOPE("SlidingWindowGraphOptimizer::RemoveOldestSe3Nodes", "optimize");
+    num_nodes_to_keep = std::max(num_nodes_to_keep, 1);
+    if (node_num_ - first_node_index_ <= num_nodes_to_keep)
+        return false;
+
+    const int last_marginalized_index = node_num_ - num_nodes_to_keep;
+
+    // a. split edges, the ones on the marginalized nodes go into the prior:
+    std::vector<std::shared_ptr<Edge>> marginalized_edges;
+    std::vector<std::shared_ptr<Edge>> remaining_edges;
+    for (const std::shared_ptr<Edge> &edge: edges_) {
+        bool is_marginalized = false;
+        for (int vertex_index: edge->vertices) {
+            if (vertex_index < last_marginalized_index) {
+                is_marginalized = true;
+                break;
+            }
+        }
+
+        (is_marginalized ? marginalized_edges : remaining_edges).push_back(edge);
+    }
+
+    // b. order the involved nodes, marginalized ones first:
+    std::vector<int> vertices;
+    std::map<int, int> blocks;
+    for (int i = first_node_index_; i < last_marginalized_index; ++i) {
+        blocks[i] = vertices.size();
+        vertices.push_back(i);
+    }
+    const int num_marginalized = vertices.size();
+
+    std::vector<int> remaining_vertices;
+    for (const std::shared_ptr<Edge> &edge: marginalized_edges) {
+        remaining_vertices.insert(remaining_vertices.end(), edge->vertices.begin(), edge->vertices.end());
+    }
+    if (has_prior_) {
+        remaining_vertices.insert(remaining_vertices.end(), prior_.vertices.begin(), prior_.vertices.end());
+    }
+    std::sort(remaining_vertices.begin(), remaining_vertices.end());
+    for (int vertex_index: remaining_vertices) {
+        if (vertex_index >= last_marginalized_index && blocks.count(vertex_index) == 0) {
+            blocks[vertex_index] = vertices.size();
+            vertices.push_back(vertex_index);
+        }
+    }
+
+    // c. normal equations of the marginalized edges & the previous prior:
+    const int dim = DIM_STATE * vertices.size();
+    Eigen::MatrixXd H = Eigen::MatrixXd::Zero(dim, dim);
+    Eigen::VectorXd b = Eigen::VectorXd::Zero(dim);
+    for (const std::shared_ptr<Edge> &edge: marginalized_edges) {
+        Eigen::MatrixXd H_edge;
+        Eigen::VectorXd b_edge;
+        LinearizeEdge(*edge, H_edge, b_edge);
+
+        for (size_t i = 0; i < edge->vertices.size(); ++i) {
+            const int block_i = DIM_STATE * blocks.at(edge->vertices.at(i));
+            b.segment<DIM_STATE>(block_i) += b_edge.segment<DIM_STATE>(DIM_STATE*i);
+            for (size_t j = 0; j < edge->vertices.size(); ++j) {
+                const int block_j = DIM_STATE * blocks.at(edge->vertices.at(j));
+                H.block<DIM_STATE, DIM_STATE>(block_i, block_j) += H_edge.block<DIM_STATE, DIM_STATE>(DIM_STATE*i, DIM_STATE*j);
+            }
+        }
+    }
+    if (has_prior_) {
+        for (size_t i = 0; i < prior_.vertices.size(); ++i) {
+            const int block_i = DIM_STATE * blocks.at(prior_.vertices.at(i));
+            for (size_t j = 0; j < prior_.vertices.size(); ++j) {
+                const int block_j = DIM_STATE * blocks.at(prior_.vertices.at(j));
+                H.block<DIM_STATE, DIM_STATE>(block_i, block_j) += prior_.H.block<DIM_STATE, DIM_STATE>(DIM_STATE*i, DIM_STATE*j);
+            }
+        }
+
+        Eigen::VectorXd dx(DIM_STATE * prior_.vertices.size());
+        for (size_t i = 0; i < prior_.vertices.size(); ++i) {
+            dx.segment<DIM_STATE>(DIM_STATE*i) = Minus(GetState(prior_.vertices.at(i)), prior_.states.at(i));
+        }
+        Eigen::VectorXd b_prior = prior_.b + prior_.H * dx;
+        for (size_t i = 0; i < prior_.vertices.size(); ++i) {
+            b.segment<DIM_STATE>(DIM_STATE * blocks.at(prior_.vertices.at(i))) += b_prior.segment<DIM_STATE>(DIM_STATE*i);
+        }
+    }
+
+    // fixed nodes are conditioned on instead:
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        if (IsFixed(vertices.at(i))) {
+            H.middleRows<DIM_STATE>(DIM_STATE*i).setZero();
+            H.middleCols<DIM_STATE>(DIM_STATE*i).setZero();
+            b.segment<DIM_STATE>(DIM_STATE*i).setZero();
+        }
+    }
+
+    // d. Schur complement, with pseudo inverse as some dimensions may be unobservable:
+    const int dim_m = DIM_STATE * num_marginalized;
+    const int dim_r = dim - dim_m;
+
+    if (dim_r > 0) {
+        Eigen::MatrixXd H_mm = 0.5 * (H.topLeftCorner(dim_m, dim_m) + H.topLeftCorner(dim_m, dim_m).transpose());
+        Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(H_mm);
+        Eigen::VectorXd eigen_values_inv = (
+            solver.eigenvalues().array() > MIN_EIGEN_VALUE
+        ).select(solver.eigenvalues().array().inverse(), 0.0);
+        Eigen::MatrixXd H_mm_inv = solver.eigenvectors() * eigen_values_inv.asDiagonal() * solver.eigenvectors().transpose();
+
+        const Eigen::MatrixXd H_rm_H_mm_inv = H.bottomLeftCorner(dim_r, dim_m) * H_mm_inv;
+
+        prior_.H = H.bottomRightCorner(dim_r, dim_r) - H_rm_H_mm_inv * H.topRightCorner(dim_m, dim_r);
+        prior_.H = 0.5 * (prior_.H + prior_.H.transpose());
+        prior_.b = b.tail(dim_r) - H_rm_H_mm_inv * b.head(dim_m);
+        prior_.vertices.assign(vertices.begin() + num_marginalized, vertices.end());
+        prior_.states.clear();
+        for (int vertex_index: prior_.vertices) {
+            prior_.states.push_back(GetState(vertex_index));
+        }
+        has_prior_ = true;
+    } else {
+        has_prior_ = false;
+    }
+
+    // e. finally remove the nodes:
+    edges_.swap(remaining_edges);
+    for (int i = 0; i < num_marginalized; ++i) {
+        states_.pop_front();
+        fixed_.pop_front();
+    }
+    first_node_index_ = last_marginalized_index;
+
+    return true;
+}
+
+void SlidingWindowGraphOptimizer::SetEdgeRobustKernel(std::string robust_kernel_name,
+        double robust_kernel_size) {
+    robust_kernel_name_ = robust_kernel_name;
+    robust_kernel_size_ = robust_kernel_size;
+    need_robust_kernel_ = true;
+}
+
+void SlidingWindowGraphOptimizer::AddSe3Node(const Eigen::Isometry3d &pose, bool need_fix) {
+    NavState state;
+    state.pos = pose.translation();
+    state.ori = pose.rotation();
+
+    AddNavStateNode(state, need_fix);
+}
+
+void SlidingWindowGraphOptimizer::AddSe3Edge(
+    int vertex_index1,
+    int vertex_index2,
+    const Eigen::Isometry3d &relative_pose,
+    const Eigen::VectorXd noise
+) {
+    std::shared_ptr<Edge> edge = std::make_shared<Edge>();
+
+    edge->vertices = {vertex_index1, vertex_index2};
+    edge->information = GetInformationMatrix(noise);
+    edge->robust = need_robust_kernel_;
+
+    const Eigen::Vector3d t = relative_pose.translation();
+    const Eigen::Matrix3d R = relative_pose.rotation();
+    edge->error = [t, R](const std::vector<const NavState *> &states) {
+        const NavState &state_i = *states.at(0);
+        const NavState &state_j = *states.at(1);
+
+        Eigen::VectorXd error(6);
+        error.head<3>() = state_i.ori.transpose() * (state_j.pos - state_i.pos) - t;
+        error.tail<3>() = LogSO3(R.transpose() * state_i.ori.transpose() * state_j.ori);
+
+        return error;
+    };
+
+    AddEdge(edge);
+}
+
+void SlidingWindowGraphOptimizer::AddSe3PriorXYZEdge(
+    int se3_vertex_index,
+    const Eigen::Vector3d &xyz,
+    Eigen::VectorXd noise
+) {
+    std::shared_ptr<Edge> edge = std::make_shared<Edge>();
+
+    edge->vertices = {se3_vertex_index};
+    edge->information = GetInformationMatrix(noise);
+    edge->error = [xyz](const std::vector<const NavState *> &states) {
+        Eigen::VectorXd error = states.at(0)->pos - xyz;
+        return error;
+    };
+
+    AddEdge(edge);
+}
+
+void SlidingWindowGraphOptimizer::AddSe3PriorQuaternionEdge(
+    int se3_vertex_index,
+    const Eigen::Quaterniond &quat,
+    Eigen::VectorXd noise
+) {
+    std::shared_ptr<Edge> edge = std::make_shared<Edge>();
+
+    edge->vertices = {se3_vertex_index};
+    edge->information = GetInformationMatrix(noise);
+
+    const Eigen::Matrix3d R = quat.normalized().toRotationMatrix();
+    edge->error = [R](const std::vector<const NavState *> &states) {
+        Eigen::VectorXd error = LogSO3(R.transpose() * states.at(0)->ori);
+        return error;
+    };
+
+    AddEdge(edge);
+}
+
+void SlidingWindowGraphOptimizer::AddNavStateNode(const NavState &state, bool need_fix) {
+    states_.push_back(state);
+    fixed_.push_back(need_fix);
+
+    ++node_num_;
+}
+
+bool SlidingWindowGraphOptimizer::GetOptimizedState(int vertex_index, NavState &state) const {
+    if (!IsValidVertex(vertex_index))
+        return false;
+
+    state = GetState(vertex_index);
+
+    return true;
+}
+
+void SlidingWindowGraphOptimizer::AddIMUPreIntegrationEdge(
+    int vertex_index1,
+    int vertex_index2,
+    const IMUPreIntegrator &pre_integration
+) {
+    std::shared_ptr<Edge> edge = std::make_shared<Edge>();
+
+    edge->vertices = {vertex_index1, vertex_index2};
+    edge->pre_integration_ptr = std::make_shared<IMUPreIntegrator>(pre_integration);
+    edge->information = pre_integration.GetCovariance().inverse();
+
+    const Eigen::Vector3d g(0.0, 0.0, gravity_magnitude_);
+    const std::shared_ptr<IMUPreIntegrator> pre_integration_ptr = edge->pre_integration_ptr;
+    edge->error = [g, pre_integration_ptr](const std::vector<const NavState *> &states) {
+        const NavState &state_i = *states.at(0);
+        const NavState &state_j = *states.at(1);
+        const IMUPreIntegrator &pre_integration = *pre_integration_ptr;
+        const double T = pre_integration.GetTime();
+
+        const Eigen::Matrix3d R_i_inv = state_i.ori.transpose();
+
+        Eigen::VectorXd error(DIM_STATE);
+        error.segment<3>(INDEX_P) = R_i_inv * (
+            state_j.pos - state_i.pos - state_i.vel*T + 0.5*g*T*T
+        ) - pre_integration.GetDeltaPosition(state_i.accel_bias, state_i.gyro_bias);
+        error.segment<3>(INDEX_R) = LogSO3(
+            pre_integration.GetDeltaOrientation(state_i.gyro_bias).transpose() * R_i_inv * state_j.ori
+        );
+        error.segment<3>(INDEX_V) = R_i_inv * (
+            state_j.vel - state_i.vel + g*T
+        ) - pre_integration.GetDeltaVelocity(state_i.accel_bias, state_i.gyro_bias);
+        error.segment<3>(INDEX_A) = state_j.accel_bias - state_i.accel_bias;
+        error.segment<3>(INDEX_G) = state_j.gyro_bias - state_i.gyro_bias;
+
+        return error;
+    };
+
+    AddEdge(edge);
+}
+
+void SlidingWindowGraphOptimizer::AddVelocityPriorEdge(
+    int vertex_index,
+    const Eigen::Vector3d &vel,
+    Eigen::VectorXd noise
+) {
+    std::shared_ptr<Edge> edge = std::make_shared<Edge>();
+
+    edge->vertices = {vertex_index};
+    edge->information = GetInformationMatrix(noise);
+    edge->error = [vel](const std::vector<const NavState *> &states) {
+        Eigen::VectorXd error = states.at(0)->vel - vel;
+        return error;
+    };
+
+    AddEdge(edge);
+}
+
+void SlidingWindowGraphOptimizer::AddBiasPriorEdge(
+    int vertex_index,
+    const Eigen::Vector3d &accel_bias,
+    const Eigen::Vector3d &gyro_bias,
+    Eigen::VectorXd noise
+) {
+    std::shared_ptr<Edge> edge = std::make_shared<Edge>();
+
+    edge->vertices = {vertex_index};
+    edge->information = GetInformationMatrix(noise);
+    edge->error = [accel_bias, gyro_bias](const std::vector<const NavState *> &states) {
+        Eigen::VectorXd error(6);
+        error.head<3>() = states.at(0)->accel_bias - accel_bias;
+        error.tail<3>() = states.at(0)->gyro_bias - gyro_bias;
+        return error;
+    };
+
+    AddEdge(edge);
+}
+
+bool SlidingWindowGraphOptimizer::IsValidVertex(int vertex_index) const {
+    return first_node_index_ <= vertex_index && vertex_index < node_num_;
+}
+
+void SlidingWindowGraphOptimizer::Plus(const NavState &state, const Eigen::VectorXd &delta, NavState &result) {
+    result.pos = state.pos + delta.segment<3>(INDEX_P);
+    result.ori = state.ori * Sophus::SO3d::exp(delta.segment<3>(INDEX_R)).matrix();
+    result.vel = state.vel + delta.segment<3>(INDEX_V);
+    result.accel_bias = state.accel_bias + delta.segment<3>(INDEX_A);
+    result.gyro_bias = state.gyro_bias + delta.segment<3>(INDEX_G);
+}
+
+Eigen::VectorXd SlidingWindowGraphOptimizer::Minus(const NavState &state, const NavState &linearization_point) {
+    Eigen::VectorXd delta(DIM_STATE);
+
+    delta.segment<3>(INDEX_P) = state.pos - linearization_point.pos;
+    delta.segment<3>(INDEX_R) = LogSO3(linearization_point.ori.transpose() * state.ori);
+    delta.segment<3>(INDEX_V) = state.vel - linearization_point.vel;
+    delta.segment<3>(INDEX_A) = state.accel_bias - linearization_point.accel_bias;
+    delta.segment<3>(INDEX_G) = state.gyro_bias - linearization_point.gyro_bias;
+
+    return delta;
+}
+
+void SlidingWindowGraphOptimizer::AddEdge(const std::shared_ptr<Edge> &edge) {
+    for (int vertex_index: edge->vertices) {
+        if (!IsValidVertex(vertex_index)) {
+            LOG(WARNING) << "Drop edge on vertex out of window: " << vertex_index;
+            return;
+        }
+    }
+
+    edges_.push_back(edge);
+}
+
+double SlidingWindowGraphOptimizer::GetRobustLoss(const Edge &edge, double squared_error, double &weight) const {
+    weight = 1.0;
+    if (!edge.robust)
+        return squared_error;
+
+    const double delta_squared = robust_kernel_size_ * robust_kernel_size_;
+    if (robust_kernel_name_ == "Huber") {
+        if (squared_error <= delta_squared)
+            return squared_error;
+
+        const double error = std::sqrt(squared_error);
+        weight = robust_kernel_size_ / error;
+        return 2.0 * robust_kernel_size_ * error - delta_squared;
+    } else if (robust_kernel_name_ == "Cauchy") {
+        weight = 1.0 / (1.0 + squared_error / delta_squared);
+        return delta_squared * std::log(1.0 + squared_error / delta_squared);
+    } else if (robust_kernel_name_ != "NONE") {
+        LOG_EVERY_N(WARNING, 1000) << "invalid robust kernel type: " << robust_kernel_name_;
+    }
+
+    return squared_error;
+}
+
+double SlidingWindowGraphOptimizer::GetEdgeCost(const Edge &edge) const {
+    std::vector<const NavState *> states;
+    for (int vertex_index: edge.vertices) {
+        states.push_back(&GetState(vertex_index));
+    }
+
+    const Eigen::VectorXd error = edge.error(states);
+
+    double weight;
+    return 0.5 * GetRobustLoss(edge, error.dot(edge.information * error), weight);
+}
+
+double SlidingWindowGraphOptimizer::GetPriorCost(void) const {
+    if (!has_prior_)
+        return 0.0;
+
+    Eigen::VectorXd dx(DIM_STATE * prior_.vertices.size());
+    for (size_t i = 0; i < prior_.vertices.size(); ++i) {
+        dx.segment<DIM_STATE>(DIM_STATE*i) = Minus(GetState(prior_.vertices.at(i)), prior_.states.at(i));
+    }
+
+    return prior_.b.dot(dx) + 0.5 * dx.dot(prior_.H * dx);
+}
+
+double SlidingWindowGraphOptimizer::GetTotalCost(void) const {
+    double cost = GetPriorCost();
+    for (const std::shared_ptr<Edge> &edge: edges_) {
+        cost += GetEdgeCost(*edge);
+    }
+
+    return cost;
+}
+
+void SlidingWindowGraphOptimizer::LinearizeEdge(const Edge &edge, Eigen::MatrixXd &H, Eigen::VectorXd &b) const {
+    const int num_vertices = edge.vertices.size();
+
+    std::vector<NavState> states;
+    for (int vertex_index: edge.vertices) {
+        states.push_back(GetState(vertex_index));
+    }
+    std::vector<const NavState *> state_ptrs;
+    for (const NavState &state: states) {
+        state_ptrs.push_back(&state);
+    }
+
+    const Eigen::VectorXd error = edge.error(state_ptrs);
+
+    // central differences, the error functions are cheap:
+    Eigen::MatrixXd J = Eigen::MatrixXd::Zero(error.rows(), DIM_STATE * num_vertices);
+    for (int i = 0; i < num_vertices; ++i) {
+        if (IsFixed(edge.vertices.at(i)))
+            continue;
+
+        const NavState state = states.at(i);
+        for (int j = 0; j < DIM_STATE; ++j) {
+            Eigen::VectorXd delta = Eigen::VectorXd::Zero(DIM_STATE);
+
+            delta(j) = JACOBIAN_STEP;
+            Plus(state, delta, states.at(i));
+            const Eigen::VectorXd error_plus = edge.error(state_ptrs);
+
+            delta(j) = -JACOBIAN_STEP;
+            Plus(state, delta, states.at(i));
+            const Eigen::VectorXd error_minus = edge.error(state_ptrs);
+
+            J.col(DIM_STATE*i + j) = (error_plus - error_minus) / (2.0 * JACOBIAN_STEP);
+        }
+        states.at(i) = state;
+    }
+
+    double weight;
+    GetRobustLoss(edge, error.dot(edge.information * error), weight);
+
+    const Eigen::MatrixXd JtW = weight * J.transpose() * edge.information;
+    H = JtW * J;
+    b = JtW * error;
+}
+
+void SlidingWindowGraphOptimizer::BuildNormalEquations(Eigen::MatrixXd &H, Eigen::VectorXd &b) const {
+    const int dim = DIM_STATE * states_.size();
+    H = Eigen::MatrixXd::Zero(dim, dim);
+    b = Eigen::VectorXd::Zero(dim);
+
+    for (const std::shared_ptr<Edge> &edge: edges_) {
+        Eigen::MatrixXd H_edge;
+        Eigen::VectorXd b_edge;
+        LinearizeEdge(*edge, H_edge, b_edge);
+
+        for (size_t i = 0; i < edge->vertices.size(); ++i) {
+            const int block_i = DIM_STATE * (edge->vertices.at(i) - first_node_index_);
+            b.segment<DIM_STATE>(block_i) += b_edge.segment<DIM_STATE>(DIM_STATE*i);
+            for (size_t j = 0; j < edge->vertices.size(); ++j) {
+                const int block_j = DIM_STATE * (edge->vertices.at(j) - first_node_index_);
+                H.block<DIM_STATE, DIM_STATE>(block_i, block_j) += H_edge.block<DIM_STATE, DIM_STATE>(DIM_STATE*i, DIM_STATE*j);
+            }
+        }
+    }
+
+    if (!has_prior_)
+        return;
+
+    // the prior is linear in the state difference from its linearization point:
+    Eigen::VectorXd dx(DIM_STATE * prior_.vertices.size());
+    for (size_t i = 0; i < prior_.vertices.size(); ++i) {
+        dx.segment<DIM_STATE>(DIM_STATE*i) = Minus(GetState(prior_.vertices.at(i)), prior_.states.at(i));
+    }
+    const Eigen::VectorXd b_prior = prior_.b + prior_.H * dx;
+
+    for (size_t i = 0; i < prior_.vertices.size(); ++i) {
+        const int block_i = DIM_STATE * (prior_.vertices.at(i) - first_node_index_);
+        b.segment<DIM_STATE>(block_i) += b_prior.segment<DIM_STATE>(DIM_STATE*i);
+        for (size_t j = 0; j < prior_.vertices.size(); ++j) {
+            const int block_j = DIM_STATE * (prior_.vertices.at(j) - first_node_index_);
+            H.block<DIM_STATE, DIM_STATE>(block_i, block_j) += prior_.H.block<DIM_STATE, DIM_STATE>(DIM_STATE*i, DIM_STATE*j);
+        }
+    }
+}
+
+void SlidingWindowGraphOptimizer::ConstrainNormalEquations(
+    const std::vector<int> &vertices, Eigen::MatrixXd &H, Eigen::VectorXd &b
+) const {
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        if (!IsFixed(vertices.at(i)))
+            continue;
+
+        H.middleRows<DIM_STATE>(DIM_STATE*i).setZero();
+        H.middleCols<DIM_STATE>(DIM_STATE*i).setZero();
+        b.segment<DIM_STATE>(DIM_STATE*i).setZero();
+    }
+
+    // unconstrained dimensions, e.g. velocities & biases of a pose graph, or fixed nodes stay where they are:
+    for (int i = 0; i < H.rows(); ++i) {
+        if (H(i, i) <= 0.0) {
+            H(i, i) = 1.0;
+            b(i) = 0.0;
+        }
+    }
+}
+
+} // namespace lidar_localization
@@ -0,0 +1,308 @@
+/*
+ * @Description: two-level pose graph, key frames are rigidly attached to submaps of consecutive key frames,
+ *               the global graph only optimizes submap poses, key frames are refined per submap in parallel
+ * @Author: Ge Yao
+ * @Date: 2021-01-26 20:14:52
+ */
+
+#include "lidar_localization/models/graph_optimizer/submap/submap_graph_optimizer.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "glog/logging.h"
+#include "lidar_localization/tools/tic_toc.hpp"
+#include "lidar_localization/models/graph_optimizer/g2o/g2o_graph_optimizer.hpp"
+
+namespace lidar_localization {
+
+SubmapGraphOptimizer::SubmapGraphOptimizer(const YAML::Node& node) {
+    solver_type_ = node["solver_type"].as<std::string>();
+    submap_size_ = std::max(node["submap_size"].as<int>(), 1);
+    local_refinement_ = node["local_refinement"].as<bool>();
+
+    // num_threads <= 0 means use all available cores:
+    const int num_threads = node["num_threads"].as<int>();
+#ifdef _OPENMP
+    num_threads_ = (num_threads > 0) ? num_threads : omp_get_max_threads();
+#else
+    num_threads_ = 1;
+#endif
+
+    std::cout << "Submap graph optimizer: " << std::endl
+              << "\tsolver: " << solver_type_ << std::endl
+              << "\tsubmap size: " << submap_size_ << std::endl
+              << "\tlocal refinement: " << (local_refinement_ ? "on" : "off") << ", "
+              << "num_threads: " << num_threads_ << std::endl << std::endl;
+}
+
+std::unique_ptr<InterfaceGraphOptimizer> SubmapGraphOptimizer::CreateOptimizer(void) const {
+    // incremental, so that after SetEstimateOptimized it starts from the current poses,
+    // instead of the initial guess of g2o:
+    std::unique_ptr<InterfaceGraphOptimizer> optimizer(new G2oGraphOptimizer(solver_type_, true));
+
+    optimizer->SetMaxIterationsNum(max_iterations_num_);
+    if (need_robust_kernel_) {
+        optimizer->SetEdgeRobustKernel(robust_kernel_name_, robust_kernel_size_);
+    }
+
+    return optimizer;
+}
+
+bool SubmapGraphOptimizer::Optimize() {
+    TRACE_SCOPE("SubmapGraphOptimizer::Optimize", "optimize");
+
+    if (submaps_.empty()) {
+        return false;
+    }
+
+    TicToc optimize_time;
+
+    // a. refine the key frames of changed submaps, in parallel:
+    int num_refined = 0;
+    if (local_refinement_) {
+        std::vector<int> submap_indices;
+        std::vector<std::unique_ptr<InterfaceGraphOptimizer>> optimizers;
+        for (size_t i = 0; i < submaps_.size(); ++i) {
+            if (submaps_.at(i).need_refine) {
+                submap_indices.push_back(static_cast<int>(i));
+                optimizers.push_back(CreateOptimizer());
+            }
+        }
+
+        const int num_submaps = static_cast<int>(submap_indices.size());
+#pragma omp parallel for num_threads(num_threads_) schedule(dynamic) reduction(+:num_refined)
+        for (int i = 0; i < num_submaps; ++i) {
+            if (RefineSubmap(*optimizers.at(i), submaps_.at(submap_indices.at(i)))) {
+                ++num_refined;
+            }
+        }
+    }
+
+    // b. then the submap poses:
+    const bool is_optimized = OptimizeSubmaps();
+
+    optimize_stats_.time_consumption = optimize_time.toc();
+
+    return is_optimized || num_refined > 0;
+}
+
+bool SubmapGraphOptimizer::RefineSubmap(InterfaceGraphOptimizer &optimizer, Submap &submap) const {
+    submap.need_refine = false;
+
+    if (submap.edges.empty() && submap.prior_xyz_edges.empty()) {
+        return false;
+    }
+
+    // in map frame, the first key frame is fixed at the submap pose:
+    for (size_t i = 0; i < submap.node_poses.size(); ++i) {
+        optimizer.AddSe3Node(submap.pose * submap.node_poses.at(i), 0 == i);
+    }
+    for (const Edge &edge: submap.edges) {
+        optimizer.AddSe3Edge(
+            GetSubmapNodeIndex(edge.vertex_index1), GetSubmapNodeIndex(edge.vertex_index2),
+            edge.relative_pose, edge.noise
+        );
+    }
+    for (const PriorXYZEdge &edge: submap.prior_xyz_edges) {
+        optimizer.AddSe3PriorXYZEdge(GetSubmapNodeIndex(edge.vertex_index), edge.xyz, edge.noise);
+    }
+    optimizer.SetEstimateOptimized();
+
+    std::deque<Eigen::Matrix4f> optimized_pose;
+    if (!optimizer.Optimize() || !optimizer.GetOptimizedPose(optimized_pose)) {
+        return false;
+    }
+
+    const Eigen::Isometry3d submap_pose_inverse = submap.pose.inverse();
+    for (size_t i = 1; i < optimized_pose.size(); ++i) {
+        Eigen::Isometry3d pose;
+        pose.matrix() = optimized_pose.at(i).cast<double>();
+        submap.node_poses.at(i) = submap_pose_inverse * pose;
+    }
+
+    return true;
+}
+
+bool SubmapGraphOptimizer::OptimizeSubmaps(void) {
+    // the global graph is rebuilt from the current submap poses, as edges move with the key frames in them:
+    std::unique_ptr<InterfaceGraphOptimizer> optimizer = CreateOptimizer();
+
+    for (const Submap &submap: submaps_) {
+        optimizer->AddSe3Node(submap.pose, submap.need_fix);
+    }
+
+    // pose1 * relative_pose = pose2, with pose = submap pose * node pose:
+    for (const Edge &edge: edges_) {
+        const Submap &submap1 = submaps_.at(GetSubmapIndex(edge.vertex_index1));
+        const Submap &submap2 = submaps_.at(GetSubmapIndex(edge.vertex_index2));
+
+        optimizer->AddSe3Edge(
+            GetSubmapIndex(edge.vertex_index1), GetSubmapIndex(edge.vertex_index2),
+            submap1.node_poses.at(GetSubmapNodeIndex(edge.vertex_index1)) *
+            edge.relative_pose *
+            submap2.node_poses.at(GetSubmapNodeIndex(edge.vertex_index2)).inverse(),
+            edge.noise
+        );
+    }
+
+    // the key frame positions are moved to the submap origin at its current orientation,
+    // then merged by information, noise is the inverse of the information diagonal:
+    for (size_t i = 0; i < submaps_.size(); ++i) {
+        const Submap &submap = submaps_.at(i);
+        if (submap.prior_xyz_edges.empty()) {
+            continue;
+        }
+
+        Eigen::Vector3d information = Eigen::Vector3d::Zero();
+        Eigen::Vector3d weighted_xyz = Eigen::Vector3d::Zero();
+        for (const PriorXYZEdge &edge: submap.prior_xyz_edges) {
+            const Eigen::Vector3d xyz = (
+                edge.xyz -
+                submap.pose.linear() * submap.node_poses.at(GetSubmapNodeIndex(edge.vertex_index)).translation()
+            );
+            const Eigen::Vector3d edge_information = edge.noise.head<3>().cwiseInverse();
+
+            information += edge_information;
+            weighted_xyz += edge_information.cwiseProduct(xyz);
+        }
+
+        Eigen::VectorXd noise = information.cwiseInverse();
+        optimizer->AddSe3PriorXYZEdge(static_cast<int>(i), weighted_xyz.cwiseQuotient(information), noise);
+    }
+
+    for (const PriorQuaternionEdge &edge: prior_quaternion_edges_) {
+        const Submap &submap = submaps_.at(GetSubmapIndex(edge.vertex_index));
+        const Eigen::Quaterniond node_quat(submap.node_poses.at(GetSubmapNodeIndex(edge.vertex_index)).linear());
+
+        optimizer->AddSe3PriorQuaternionEdge(
+            GetSubmapIndex(edge.vertex_index), edge.quat * node_quat.inverse(), edge.noise
+        );
+    }
+    optimizer->SetEstimateOptimized();
+
+    std::deque<Eigen::Matrix4f> optimized_pose;
+    if (!optimizer->Optimize() || !optimizer->GetOptimizedPose(optimized_pose)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < optimized_pose.size(); ++i) {
+        submaps_.at(i).pose.matrix() = optimized_pose.at(i).cast<double>();
+    }
+
+    optimize_stats_ = optimizer->GetOptimizeStats();
+
+    return true;
+}
+
+bool SubmapGraphOptimizer::GetOptimizedPose(std::deque<Eigen::Matrix4f>& optimized_pose) {
+    optimized_pose.clear();
+
+    for (const Submap &submap: submaps_) {
+        for (const Eigen::Isometry3d &node_pose: submap.node_poses) {
+            optimized_pose.push_back((submap.pose * node_pose).matrix().cast<float>());
+        }
+    }
+
+    return true;
+}
+
+int SubmapGraphOptimizer::GetNodeNum() {
+    return node_num_;
+}
+
+int SubmapGraphOptimizer::GetFirstNodeIndex() {
+    return 0;
+}
+
+size_t SubmapGraphOptimizer::GetMemoryUsage(void) const {
+    size_t memory_usage = (
+        submaps_.size() * sizeof(Submap) +
+        edges_.capacity() * sizeof(Edge) +
+        prior_quaternion_edges_.capacity() * sizeof(PriorQuaternionEdge)
+    );
+    for (const Submap &submap: submaps_) {
+        memory_usage += (
+            submap.node_poses.capacity() * sizeof(Eigen::Isometry3d) +
+            submap.edges.capacity() * sizeof(Edge) +
+            submap.prior_xyz_edges.capacity() * sizeof(PriorXYZEdge)
+        );
+    }
+
+    return memory_usage;
+}
+
+bool SubmapGraphOptimizer::RemoveOldestSe3Nodes(int num_nodes_to_keep) {
+    return false;
+}
+
+void SubmapGraphOptimizer::SetEdgeRobustKernel(std::string robust_kernel_name, double robust_kernel_size) {
+    robust_kernel_name_ = robust_kernel_name;
+    robust_kernel_size_ = robust_kernel_size;
+    need_robust_kernel_ = true;
+}
+
+void SubmapGraphOptimizer::AddSe3Node(const Eigen::Isometry3d &pose, bool need_fix) {
+    // a new submap starts at its first key frame:
+    if (GetSubmapNodeIndex(node_num_) == 0) {
+        Submap submap;
+        submap.pose = pose;
+        submap.need_fix = need_fix;
+        submaps_.push_back(submap);
+    }
+
+    Submap &submap = submaps_.back();
+    submap.node_poses.push_back(submap.pose.inverse() * pose);
+    submap.need_refine = true;
+
+    ++node_num_;
+}
+
+void SubmapGraphOptimizer::AddSe3Edge(int vertex_index1,
+                                      int vertex_index2,
+                                      const Eigen::Isometry3d &relative_pose,
+                                      const Eigen::VectorXd noise) {
+    Edge edge;
+    edge.vertex_index1 = vertex_index1;
+    edge.vertex_index2 = vertex_index2;
+    edge.relative_pose = relative_pose;
+    edge.noise = noise;
+
+    if (GetSubmapIndex(vertex_index1) == GetSubmapIndex(vertex_index2)) {
+        Submap &submap = submaps_.at(GetSubmapIndex(vertex_index1));
+        submap.edges.push_back(edge);
+        submap.need_refine = true;
+    } else {
+        edges_.push_back(edge);
+    }
+}
+
+void SubmapGraphOptimizer::AddSe3PriorXYZEdge(int se3_vertex_index,
+                                              const Eigen::Vector3d &xyz,
+                                              Eigen::VectorXd noise) {
+    PriorXYZEdge edge;
+    edge.vertex_index = se3_vertex_index;
+    edge.xyz = xyz;
+    edge.noise = noise;
+
+    Submap &submap = submaps_.at(GetSubmapIndex(se3_vertex_index));
+    submap.prior_xyz_edges.push_back(edge);
+    submap.need_refine = true;
+}
+
+void SubmapGraphOptimizer::AddSe3PriorQuaternionEdge(int se3_vertex_index,
+                                                     const Eigen::Quaterniond &quat,
+                                                     Eigen::VectorXd noise) {
+    PriorQuaternionEdge edge;
+    edge.vertex_index = se3_vertex_index;
+    edge.quat = quat;
+    edge.noise = noise;
+
+    prior_quaternion_edges_.push_back(edge);
+}
+
+} // namespace lidar_localization
@@ -0,0 +1,129 @@
+/*
+ * @Description: decimation of high-rate IMU measurements into coning & sculling compensated increments
+ * @Author: Ge Yao
+ * @Date: 2021-01-08 10:31:52
+ */
+#include "lidar_localization/models/imu_mechanization/imu_decimator.hpp"
+
+#include <iostream>
+
+#include "glog/logging.h"
+
+#include "lidar_localization/tools/tracer.hpp"
+
+namespace lidar_localization {
+
+IMUDecimator::IMUDecimator(const YAML::Node& node) {
+    output_interval_ = 1.0 / node["output_rate"].as<double>();
+    max_imu_gap_ = node["max_imu_gap"].as<double>();
+
+    std::cout << "IMU Decimator params:" << std::endl
+              << "output_rate: " << GetOutputRate() << ", "
+              << "max_imu_gap: " << max_imu_gap_
+              << std::endl << std::endl;
+}
+
+size_t IMUDecimator::Decimate(std::deque<IMUData>& imu_data_buff, std::deque<IMUData>& increment_buff) {
+    TRACE_SCOPE("IMUDecimator::Decimate", "filter");
+    const size_t num_increments = increment_buff.size();
+
+    while (!imu_data_buff.empty()) {
+        AddIMUData(imu_data_buff.front(), increment_buff);
+        imu_data_buff.pop_front();
+    }
+
+    return increment_buff.size() - num_increments;
+}
+
+void IMUDecimator::AddIMUData(const IMUData& imu_data, std::deque<IMUData>& increment_buff) {
+    if (!has_imu_data_) {
+        Reset(imu_data);
+        has_imu_data_ = true;
+        return;
+    }
+
+    const double T = imu_data.time - last_imu_data_.time;
+    if (T <= 0.0) {
+        return;
+    }
+
+    // a gap cannot be integrated over, the interval ends at the last measurement:
+    if (T > max_imu_gap_) {
+        LOG(WARNING) << "IMU decimation: gap of " << T << " s at " << imu_data.time << ", interval closed early.";
+        if (last_imu_data_.time > start_time_) {
+            IMUData increment = last_imu_data_;
+            GetIncrement(increment);
+            increment_buff.push_back(increment);
+        }
+        Reset(imu_data);
+        return;
+    }
+
+    // trapezoid deltas of the raw interval:
+    const Eigen::Vector3d angular_vel_prev(
+        last_imu_data_.angular_velocity.x, last_imu_data_.angular_velocity.y, last_imu_data_.angular_velocity.z
+    );
+    const Eigen::Vector3d angular_vel_curr(
+        imu_data.angular_velocity.x, imu_data.angular_velocity.y, imu_data.angular_velocity.z
+    );
+    const Eigen::Vector3d linear_acc_prev(
+        last_imu_data_.linear_acceleration.x, last_imu_data_.linear_acceleration.y, last_imu_data_.linear_acceleration.z
+    );
+    const Eigen::Vector3d linear_acc_curr(
+        imu_data.linear_acceleration.x, imu_data.linear_acceleration.y, imu_data.linear_acceleration.z
+    );
+    const Eigen::Vector3d angular_delta = 0.5*T*(angular_vel_prev + angular_vel_curr);
+    const Eigen::Vector3d velocity_delta = 0.5*T*(linear_acc_prev + linear_acc_curr);
+
+    // recursive coning & sculling, with the deltas of the previous raw interval as the slope:
+    const Eigen::Vector3d alpha_mid = alpha_ + last_angular_delta_ / 6.0;
+    const Eigen::Vector3d nu_mid = nu_ + last_velocity_delta_ / 6.0;
+    beta_ += 0.5*alpha_mid.cross(angular_delta);
+    gamma_ += 0.5*(alpha_mid.cross(velocity_delta) + nu_mid.cross(angular_delta));
+
+    alpha_ += angular_delta;
+    nu_ += velocity_delta;
+    last_angular_delta_ = angular_delta;
+    last_velocity_delta_ = velocity_delta;
+    last_imu_data_ = imu_data;
+
+    // the interval ends at the measurement closest to its nominal end:
+    if (imu_data.time - start_time_ + 0.5*T >= output_interval_) {
+        IMUData increment = imu_data;
+        GetIncrement(increment);
+        increment_buff.push_back(increment);
+
+        Reset(imu_data);
+    }
+}
+
+void IMUDecimator::GetIncrement(IMUData& imu_data) const {
+    const double T = last_imu_data_.time - start_time_;
+
+    imu_data.has_increment = true;
+    imu_data.increment.delta_time = T;
+    imu_data.increment.delta_angle = alpha_ + beta_;
+    // with the rotation of the body frame during the interval:
+    imu_data.increment.delta_velocity = nu_ + 0.5*alpha_.cross(nu_) + gamma_;
+
+    imu_data.angular_velocity.x = imu_data.increment.delta_angle.x() / T;
+    imu_data.angular_velocity.y = imu_data.increment.delta_angle.y() / T;
+    imu_data.angular_velocity.z = imu_data.increment.delta_angle.z() / T;
+    imu_data.linear_acceleration.x = imu_data.increment.delta_velocity.x() / T;
+    imu_data.linear_acceleration.y = imu_data.increment.delta_velocity.y() / T;
+    imu_data.linear_acceleration.z = imu_data.increment.delta_velocity.z() / T;
+}
+
+void IMUDecimator::Reset(const IMUData& imu_data) {
+    last_imu_data_ = imu_data;
+    start_time_ = imu_data.time;
+
+    alpha_.setZero();
+    nu_.setZero();
+    last_angular_delta_.setZero();
+    last_velocity_delta_.setZero();
+    beta_.setZero();
+    gamma_.setZero();
+}
+
+} // namespace lidar_localization
@@ -0,0 +1,124 @@
+/*
+ * @Description: registration initial guess from IMU mechanization between two scans
+ * @Author: Ge Yao
+ * @Date: 2020-12-24 19:41:07
+ */
+#include "lidar_localization/models/imu_mechanization/imu_motion_prior.hpp"
+
+#include <iostream>
+
+#include "glog/logging.h"
+
+#include "lidar_localization/tools/tracer.hpp"
+
+namespace lidar_localization {
+
+IMUMotionPrior::IMUMotionPrior(const YAML::Node& node) {
+    gravity_magnitude_ = node["gravity_magnitude"].as<double>();
+    max_imu_gap_ = node["max_imu_gap"].as<double>();
+
+    std::cout << "IMU Motion Prior params:" << std::endl
+              << "gravity_magnitude: " << gravity_magnitude_ << ", "
+              << "max_imu_gap: " << max_imu_gap_
+              << std::endl << std::endl;
+}
+
+void IMUMotionPrior::SetLidarToIMU(const Eigen::Matrix4f& lidar_to_imu) {
+    lidar_to_imu_ = lidar_to_imu.cast<double>();
+    imu_to_lidar_ = lidar_to_imu_.inverse();
+    has_lidar_to_imu_ = true;
+}
+
+void IMUMotionPrior::AddIMUData(const IMUData& imu_data) {
+    imu_data_buff_.push_back(imu_data);
+}
+
+bool IMUMotionPrior::HasIMUData(double time) const {
+    return !imu_data_buff_.empty() && imu_data_buff_.back().time >= time;
+}
+
+imu_mechanization::IMUSample IMUMotionPrior::ToSample(const IMUData& imu_data) {
+    imu_mechanization::IMUSample sample;
+
+    sample.time = imu_data.time;
+    sample.angular_vel = Eigen::Vector3d(
+        imu_data.angular_velocity.x,
+        imu_data.angular_velocity.y,
+        imu_data.angular_velocity.z
+    );
+    sample.linear_acc = Eigen::Vector3d(
+        imu_data.linear_acceleration.x,
+        imu_data.linear_acceleration.y,
+        imu_data.linear_acceleration.z
+    );
+
+    return sample;
+}
+
+imu_mechanization::IMUSample IMUMotionPrior::GetSample(size_t index, double time) const {
+    const imu_mechanization::IMUSample sample_prev = ToSample(imu_data_buff_.at(index - 1));
+    const imu_mechanization::IMUSample sample_next = ToSample(imu_data_buff_.at(index));
+
+    const double s = (time - sample_prev.time) / (sample_next.time - sample_prev.time);
+
+    imu_mechanization::IMUSample sample;
+    sample.time = time;
+    sample.angular_vel = (1.0 - s) * sample_prev.angular_vel + s * sample_next.angular_vel;
+    sample.linear_acc = (1.0 - s) * sample_prev.linear_acc + s * sample_next.linear_acc;
+
+    return sample;
+}
+
+bool IMUMotionPrior::Predict(
+    double last_time, const Eigen::Matrix4f& last_pose, const Eigen::Vector3f& last_vel,
+    double time, Eigen::Matrix4f& predict_pose
+) {
+    TRACE_SCOPE("IMUMotionPrior::Predict", "registration");
+
+    // keep the last measurement before last_time for interpolation:
+    while (imu_data_buff_.size() >= 2 && imu_data_buff_.at(1).time <= last_time) {
+        imu_data_buff_.pop_front();
+    }
+
+    if (
+        !has_lidar_to_imu_ || 
+        imu_data_buff_.size() < 2 || 
+        imu_data_buff_.front().time > last_time || 
+        !HasIMUData(time)
+    ) {
+        return false;
+    }
+
+    // IMU pose in odometry frame:
+    Eigen::Matrix4d pose = last_pose.cast<double>() * imu_to_lidar_;
+    // the lever arm between lidar & IMU is neglected:
+    Eigen::Vector3d vel = last_vel.cast<double>();
+
+    // gravity in odometry frame, through the IMU orientation in navigation frame:
+    const Eigen::Matrix3d R_nav_imu = imu_data_buff_.front().GetOrientationMatrix().cast<double>();
+    const Eigen::Vector3d g = pose.block<3, 3>(0, 0) * R_nav_imu.transpose() * Eigen::Vector3d(0.0, 0.0, gravity_magnitude_);
+
+    imu_mechanization::IMUSample sample_prev = GetSample(1, last_time);
+    for (size_t i = 1; i < imu_data_buff_.size() && sample_prev.time < time; ++i) {
+        const IMUData& imu_data = imu_data_buff_.at(i);
+        if (imu_data.time - imu_data_buff_.at(i - 1).time > max_imu_gap_) {
+            LOG(WARNING) << "IMU measurement gap of " << imu_data.time - imu_data_buff_.at(i - 1).time 
+                         << "s before " << std::fixed << imu_data.time << ". Fall back to constant velocity.";
+            return false;
+        }
+
+        const imu_mechanization::IMUSample sample_curr = (
+            imu_data.time < time ? ToSample(imu_data) : GetSample(i, time)
+        );
+        if (sample_curr.time > sample_prev.time) {
+            imu_mechanization::IntegrateStep(sample_prev, sample_curr, g, pose, vel);
+        }
+        sample_prev = sample_curr;
+    }
+
+    predict_pose = (pose * lidar_to_imu_).cast<float>();
+
+    return true;
+}
+
+} // namespace lidar_localization
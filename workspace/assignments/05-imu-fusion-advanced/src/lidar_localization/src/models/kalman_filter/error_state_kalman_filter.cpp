@@ -6,6 +6,7 @@
 #include <limits>
 
 #include <cmath>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <ostream>
@@ -15,8 +16,14 @@
 
 // SVD for observability analysis:
 #include <Eigen/SVD>
+// Cholesky & QR for Kalman correct:
+#include <Eigen/Cholesky>
+#include <Eigen/QR>
+#include <Eigen/Eigenvalues>
 
 #include "lidar_localization/models/kalman_filter/error_state_kalman_filter.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/metrics.hpp"
 
 #include "lidar_localization/global_defination/global_defination.h"
 
@@ -48,6 +55,37 @@ ErrorStateKalmanFilter::ErrorStateKalmanFilter(const YAML::Node& node) {
     COV.MEASUREMENT.POS = node["covariance"]["measurement"]["pos"].as<double>();
     COV.MEASUREMENT.VEL = node["covariance"]["measurement"]["vel"].as<double>();
     COV.MEASUREMENT.ORIENTATION = node["covariance"]["measurement"]["orientation"].as<double>();
+    // e. observability analysis:
+    observability_buffer_size_ = std::max(node["observability_buffer_size"].as<int>(), 0);
+    // f. prediction interval:
+    prediction_interval_ = std::max(node["prediction_interval"].as<int>(), 1);
+    // g. state history for delayed measurements:
+    state_history_size_ = std::max(node["state_history_size"].as<int>(), 0);
+    // h. correct method:
+    std::string correct_method = node["correct_method"].as<std::string>();
+    if (correct_method == "JOSEPH") {
+        correct_method_ = CorrectMethod::JOSEPH;
+    } else if (correct_method == "SQUARE_ROOT") {
+        correct_method_ = CorrectMethod::SQUARE_ROOT;
+    } else if (correct_method == "SEQUENTIAL") {
+        correct_method_ = CorrectMethod::SEQUENTIAL;
+    } else {
+        LOG(ERROR) << "Kalman correct method " << correct_method << " NOT FOUND! Use JOSEPH instead.";
+        correct_method = "JOSEPH";
+        correct_method_ = CorrectMethod::JOSEPH;
+    }
+    sequential_gate_ = node["sequential_gate"] ? std::max(node["sequential_gate"].as<double>(), 0.0) : 0.0;
+    // i. precision of covariance propagation:
+    std::string precision = node["precision"] ? node["precision"].as<std::string>() : "DOUBLE";
+    if (precision == "DOUBLE") {
+        precision_ = Precision::DOUBLE;
+    } else if (precision == "MIXED") {
+        precision_ = Precision::MIXED;
+    } else {
+        LOG(ERROR) << "Kalman filter precision " << precision << " NOT FOUND! Use DOUBLE instead.";
+        precision = "DOUBLE";
+        precision_ = Precision::DOUBLE;
+    }
 
     // prompt:
     LOG(INFO) << std::endl 
@@ -68,6 +106,13 @@ ErrorStateKalmanFilter::ErrorStateKalmanFilter(const YAML::Node& node) {
               << "\tmeasurement noise pos.: " << COV.MEASUREMENT.POS << std::endl
               << "\tmeasurement noise vel.: " << COV.MEASUREMENT.VEL << std::endl
               << "\tmeasurement noise orientation.: " << COV.MEASUREMENT.ORIENTATION << std::endl
+              << std::endl
+              << "\tobservability buffer size: " << observability_buffer_size_ << std::endl
+              << "\tprediction interval: " << prediction_interval_ << std::endl
+              << "\tstate history size: " << state_history_size_ << std::endl
+              << "\tcorrect method: " << correct_method << std::endl
+              << "\tsequential gate: " << sequential_gate_ << std::endl
+              << "\tprecision: " << precision << std::endl
               << std::endl;
     
     //
@@ -91,39 +136,11 @@ ErrorStateKalmanFilter::ErrorStateKalmanFilter(const YAML::Node& node) {
     Q_.block<3, 3>(0, 0) = COV.PROCESS.GYRO*Eigen::Matrix3d::Identity();
     Q_.block<3, 3>(3, 3) = COV.PROCESS.ACCEL*Eigen::Matrix3d::Identity();
 
-    // d. measurement noise:
-    RPose_.block<3, 3>(0, 0) = COV.MEASUREMENT.POS*Eigen::Matrix3d::Identity();
-    RPose_.block<3, 3>(3, 3) = COV.MEASUREMENT.ORIENTATION*Eigen::Matrix3d::Identity();
-
-    RPosition_.block<3, 3>(0, 0) = COV.MEASUREMENT.POS*Eigen::Matrix3d::Identity();
-
-    RPosVel_.block<3, 3>(0, 0) = COV.MEASUREMENT.POS*Eigen::Matrix3d::Identity();
-    RPosVel_.block<3, 3>(3, 3) = COV.MEASUREMENT.VEL*Eigen::Matrix3d::Identity();
-    // RPosVel_.block<3, 3>(6, 6) = COV.MEASUREMENT.ORIENTATION*Eigen::Matrix3d::Identity();
-
-    // e. process equation:
+    // d. process equation:
     F_.block<3, 3>(  INDEX_ERROR_POS,   INDEX_ERROR_VEL) = Eigen::Matrix3d::Identity();
     F_.block<3, 3>(  INDEX_ERROR_ORI,   INDEX_ERROR_ORI) = Sophus::SO3d::hat(-w_).matrix();
 
-    // f. measurement equation:
-    GPose_.block<3, 3>(0, INDEX_ERROR_POS) = Eigen::Matrix3d::Identity();
-    GPose_.block<3, 3>(3, INDEX_ERROR_ORI) = Eigen::Matrix3d::Identity();
-    CPose_.block<3, 3>(0, 0) = Eigen::Matrix3d::Identity();
-    CPose_.block<3, 3>(3, 3) = Eigen::Matrix3d::Identity();
-
-    GPosition_.block<3, 3>(0, INDEX_ERROR_POS) = Eigen::Matrix3d::Identity();
-    CPosition_.block<3, 3>(0, 0) = Eigen::Matrix3d::Identity();
-
-    GPosVel_.block<3, 3>(0, INDEX_ERROR_POS) = Eigen::Matrix3d::Identity();
-    // GPosVel_.block<3, 3>(6, INDEX_ERROR_ORI) = Eigen::Matrix3d::Identity();
-    CPosVel_.block<3, 3>(0, 0) = Eigen::Matrix3d::Identity();
-    CPosVel_.block<3, 3>(3, 3) = Eigen::Matrix3d::Identity();
-    // CPosVel_.block<3, 3>(6, 6) = Eigen::Matrix3d::Identity();
-
-    // init soms:
-    SOMPose_.block<DIM_MEASUREMENT_POSE, DIM_STATE>(0, 0) = GPose_;
-    SOMPosition_.block<DIM_MEASUREMENT_POSITION, DIM_STATE>(0, 0) = GPosition_;
-    SOMPosVel_.block<DIM_MEASUREMENT_POSVEL, DIM_STATE>(0, 0) = GPosVel_;
+    // measurement equations & noises are given by MeasurementModel of each measurement type.
 }
 
 /**
@@ -150,6 +167,10 @@ void ErrorStateKalmanFilter::Init(
     // init IMU data buffer:
     imu_data_buff_.clear();
     imu_data_buff_.push_back(imu_data);
+    pre_integration_ = PreIntegration();
+
+    // init state history:
+    state_history_.clear();
 
     // init filter time:
     time_ = imu_data.time;
@@ -178,12 +199,69 @@ void ErrorStateKalmanFilter::Init(
               << vel_.z() << std::endl;
 }
 
+/**
+ * @brief  init filter from a saved state
+ * @param  state, saved filter state
+ * @param  imu_data, init IMU measurements
+ * @return void
+ */
+void ErrorStateKalmanFilter::Init(
+    const State &state,
+    const IMUData &imu_data
+) {
+    // restore state:
+    init_pose_ = state.init_pose;
+    pose_ = state.pose;
+    vel_ = state.vel;
+    gyro_bias_ = state.gyro_bias;
+    accl_bias_ = state.accl_bias;
+
+    X_ = state.X;
+    P_ = state.P;
+
+    // the IMU measurements & history before the restart are gone:
+    imu_data_buff_.clear();
+    imu_data_buff_.push_back(imu_data);
+    pre_integration_ = PreIntegration();
+
+    state_history_.clear();
+
+    time_ = imu_data.time;
+
+    // init process equation, in case of direct correct step:
+    Eigen::Vector3d linear_acc_init(
+        imu_data.linear_acceleration.x,
+        imu_data.linear_acceleration.y,
+        imu_data.linear_acceleration.z
+    );
+    linear_acc_init = pose_.block<3, 3>(0, 0) * (linear_acc_init - accl_bias_);
+
+    UpdateProcessEquation(linear_acc_init);
+
+    LOG(INFO) << std::endl 
+              << "Kalman Filter Restored at " << static_cast<int>(time_) 
+              << ", saved at " << static_cast<int>(state.time) << std::endl
+              << "Init Position: " 
+              << pose_(0, 3) << ", "
+              << pose_(1, 3) << ", "
+              << pose_(2, 3) << std::endl
+              << "Gyro Bias: "
+              << gyro_bias_.x() << ", "
+              << gyro_bias_.y() << ", "
+              << gyro_bias_.z() << std::endl
+              << "Accel Bias: "
+              << accl_bias_.x() << ", "
+              << accl_bias_.y() << ", "
+              << accl_bias_.z() << std::endl;
+}
+
 /**
  * @brief  Kalman update
  * @param  imu_data, input IMU measurements
  * @return true if success false otherwise
  */
 bool ErrorStateKalmanFilter::Update(const IMUData &imu_data) {
+    TRACE_SCOPE("ErrorStateKalmanFilter::Update", "filter");
     // update IMU buff:
     if (time_ < imu_data.time) {
         // update buffer:
@@ -203,6 +281,8 @@ bool ErrorStateKalmanFilter::Update(const IMUData &imu_data) {
         // update filter time:
         time_ = imu_data.time;
 
+        SaveState(imu_data);
+
         return true;
     }
 
@@ -218,34 +298,35 @@ bool ErrorStateKalmanFilter::Update(const IMUData &imu_data) {
 bool ErrorStateKalmanFilter::Correct(
     const IMUData &imu_data, 
     const MeasurementType &measurement_type, const Measurement &measurement
-) { 
+) {
+    TRACE_SCOPE("ErrorStateKalmanFilter::Correct", "filter");
     static Measurement measurement_;
 
     // get time delta:
     double time_delta = measurement.time - time_;
 
+    // delayed measurement, apply it at its own time if still covered by state history:
+    if ( time_delta < 0.0 && CorrectDelayed(measurement_type, measurement) ) {
+        return true;
+    }
+
     if ( time_delta > -0.05 ) {
         // perform Kalman prediction:
         if ( time_ < measurement.time ) {
             Update(imu_data);
         }
-
         // get observation in navigation frame:
         measurement_ = measurement;
         measurement_.T_nb = init_pose_ * measurement_.T_nb;
 
-        // correct error estimation:
-        CorrectErrorEstimation(measurement_type, measurement);
-
-        // eliminate error:
-        EliminateError();
-
-        // reset error state:
-        ResetState();
+        ApplyCorrection(measurement_type, measurement);
 
         return true;
     }
 
+    static Counter& num_skipped = MetricsRegistry::GetInstance().GetCounter("eskf.skipped_measurements");
+    num_skipped.Increment();
+
     LOG(INFO) << "Kalman Correct: Observation is not synced with filter. Skip, " 
               << (int)measurement.time << " <-- " << (int)time_ << " @ " << time_delta
               << std::endl; 
@@ -253,6 +334,293 @@ bool ErrorStateKalmanFilter::Correct(
     return false;
 }
 
+/**
+ * @brief  iterated Kalman correction, tightly-coupled measurement re-linearized at each iterate, information form. 
+ *         the measurement only depends on position & orientation, so its information sum(G^T*R^{-1}*G) has one 
+ *         6-by-6 block and the correction costs the same for any num. of residuals
+ * @param  imu_data, IMU measurement at measurement time
+ * @param  time, measurement time
+ * @param  max_num_iterations, max. num. of iterations
+ * @param  epsilon, convergence threshold of the position & orientation error update
+ * @param  min_num_residuals, min. num. of residuals at each iterate
+ * @param  linearize, Gauss-Newton system of the measurement at an iterate
+ * @return true if success false otherwise
+ */
+bool ErrorStateKalmanFilter::CorrectIterated(
+    const IMUData &imu_data, const double time,
+    const int max_num_iterations, const double epsilon, const int min_num_residuals,
+    const LinearizeFunction &linearize
+) {
+    TRACE_SCOPE("ErrorStateKalmanFilter::CorrectIterated", "filter");
+    typedef Eigen::Matrix<double, 6, 1> Vector6d;
+    typedef Eigen::Matrix<double, 6, 6> Matrix6d;
+
+    // get time delta:
+    double time_delta = time - time_;
+
+    if ( time_delta <= -0.05 ) {
+        static Counter& num_skipped = MetricsRegistry::GetInstance().GetCounter("eskf.skipped_measurements");
+        num_skipped.Increment();
+
+        LOG(INFO) << "Kalman Correct: Observation is not synced with filter. Skip, " 
+                  << (int)time << " <-- " << (int)time_ << " @ " << time_delta
+                  << std::endl; 
+
+        return false;
+    }
+
+    // perform Kalman prediction:
+    if ( time_ < time ) {
+        Update(imu_data);
+    }
+    if ( pre_integration_.num_measurements > 0 ) {
+        PredictErrorEstimation();
+    }
+
+    // a. prior covariance of position & orientation error, and its cross covariance:
+    const int INDEX_MEASUREMENT[6] = {
+        INDEX_ERROR_POS, INDEX_ERROR_POS + 1, INDEX_ERROR_POS + 2,
+        INDEX_ERROR_ORI, INDEX_ERROR_ORI + 1, INDEX_ERROR_ORI + 2
+    };
+    Eigen::Matrix<double, DIM_STATE, 6> PE;
+    for (int j = 0; j < 6; ++j) {
+        PE.col(j) = P_.col(INDEX_MEASUREMENT[j]);
+    }
+    Matrix6d P6;
+    for (int i = 0; i < 6; ++i) {
+        P6.row(i) = PE.row(INDEX_MEASUREMENT[i]);
+    }
+
+    // b. error perturbation to measurement frame perturbation, as T_nb = init_pose^{-1}*(pose - error):
+    const Eigen::Matrix3d C_in = init_pose_.block<3, 3>(0, 0).transpose();
+    Matrix6d D = Matrix6d::Zero();
+    D.block<3, 3>(0, 0) = -C_in;
+    D.block<3, 3>(3, 3) =  C_in;
+
+    VectorX X = VectorX::Zero();
+    Matrix6d H_X = Matrix6d::Zero();
+    Eigen::PartialPivLU<Matrix6d> M_lu;
+    bool has_converged = false;
+    int num_iterations = 0;
+    for (; num_iterations < max_num_iterations && !has_converged; ++num_iterations) {
+        // c. linearize at the iterate:
+        Eigen::Matrix4d pose = pose_;
+        pose.block<3, 1>(0, 3) -= X.block<3, 1>(INDEX_ERROR_POS, 0);
+        pose.block<3, 3>(0, 0) = Sophus::SO3d::exp(X.block<3, 1>(INDEX_ERROR_ORI, 0)).matrix()*pose.block<3, 3>(0, 0);
+
+        Matrix6d H;
+        Vector6d b;
+        if ( linearize(init_pose_.inverse()*pose, H, b) < min_num_residuals ) {
+            LOG(WARNING) << "Kalman correct: too few residuals at iteration " << num_iterations << ". Skip.";
+            return false;
+        }
+        H_X = D.transpose()*H*D;
+        const Vector6d b_X = D.transpose()*b;
+
+        Vector6d X6;
+        for (int i = 0; i < 6; ++i) {
+            X6(i) = X(INDEX_MEASUREMENT[i]);
+        }
+
+        // d. (P^{-1} + E^T*H_X*E)*X = E^T*(H_X*X6 - b_X), by Woodbury identity with M = I + P6*H_X:
+        const Vector6d c = H_X*X6 - b_X;
+        M_lu.compute(Matrix6d::Identity() + P6*H_X);
+        const VectorX X_next = PE*(c - H_X*M_lu.solve(P6*c));
+
+        has_converged = (
+            (X_next.block<3, 1>(INDEX_ERROR_POS, 0) - X.block<3, 1>(INDEX_ERROR_POS, 0)).norm() < epsilon &&
+            (X_next.block<3, 1>(INDEX_ERROR_ORI, 0) - X.block<3, 1>(INDEX_ERROR_ORI, 0)).norm() < epsilon
+        );
+        X = X_next;
+    }
+
+    // e. posterior covariance at the last linearization, P - PE*H_X*M^{-1}*PE^T:
+    P_ = P_ - PE*H_X*M_lu.solve(PE.transpose());
+    P_ = 0.5*(P_ + P_.transpose());
+    X_ = X;
+
+    // eliminate error:
+    EliminateError();
+
+    // reset error state:
+    ResetState();
+
+    // delayed measurements can not roll back past it:
+    state_history_.clear();
+
+    static Counter& num_iterations_total = MetricsRegistry::GetInstance().GetCounter("eskf.correct_iterations");
+    num_iterations_total.Increment(num_iterations);
+
+    return true;
+}
+
+/**
+ * @brief  apply correction at filter time & record it for rollback
+ * @param  measurement_type, measurement type
+ * @param  measurement, input measurement
+ * @return void
+ */
+void ErrorStateKalmanFilter::ApplyCorrection(
+    const MeasurementType &measurement_type, 
+    const Measurement &measurement
+) {
+    // the measurements pre-integrated since last prediction:
+    if ( pre_integration_.num_measurements > 0 ) {
+        PredictErrorEstimation();
+    }
+
+    // correct error estimation:
+    CorrectErrorEstimation(measurement_type, measurement);
+
+    // eliminate error:
+    EliminateError();
+
+    // reset error state:
+    ResetState();
+
+    if ( !state_history_.empty() ) {
+        CorrectionRecord correction;
+        correction.measurement_type = measurement_type;
+        correction.measurement = measurement;
+        state_history_.back().corrections.push_back(correction);
+    }
+}
+
+/**
+ * @brief  roll back to the state history at measurement time, correct, then re-propagate to filter time
+ * @param  measurement_type, measurement type
+ * @param  measurement, input measurement
+ * @return true if success false if measurement is not covered by state history
+ */
+bool ErrorStateKalmanFilter::CorrectDelayed(
+    const MeasurementType &measurement_type, 
+    const Measurement &measurement
+) {
+    if ( state_history_.empty() ) {
+        return false;
+    }
+
+    // latest state not after the measurement:
+    auto it = std::upper_bound(
+        state_history_.begin(), state_history_.end(), measurement.time,
+        [](const double &time, const StateSnapshot &snapshot) { return time < snapshot.time; }
+    );
+    if ( it == state_history_.begin() ) {
+        static Counter& num_too_late = MetricsRegistry::GetInstance().GetCounter("eskf.too_late_measurements");
+        num_too_late.Increment();
+
+        ++rollback_stats_.num_too_late;
+        return false;
+    }
+    --it;
+
+    // the measurement goes after the corrections already applied at that time:
+    std::vector<CorrectionRecord, Eigen::aligned_allocator<CorrectionRecord>> corrections = it->corrections;
+    {
+        CorrectionRecord correction;
+        correction.measurement_type = measurement_type;
+        correction.measurement = measurement;
+        corrections.push_back(correction);
+    }
+    // IMU measurements & corrections after it, to be re-applied:
+    std::deque<StateSnapshot, Eigen::aligned_allocator<StateSnapshot>> later(it + 1, state_history_.end());
+
+    const double rollback_time = time_ - it->time;
+
+    // roll back:
+    RestoreState(*it);
+    it->corrections.clear();
+    state_history_.erase(it + 1, state_history_.end());
+
+    for (const CorrectionRecord &correction: corrections) {
+        ApplyCorrection(correction.measurement_type, correction.measurement);
+    }
+
+    // re-propagate:
+    for (const StateSnapshot &snapshot: later) {
+        Update(snapshot.imu_data);
+
+        for (const CorrectionRecord &correction: snapshot.corrections) {
+            ApplyCorrection(correction.measurement_type, correction.measurement);
+        }
+
+        ++rollback_stats_.num_repropagated;
+        rollback_stats_.num_reapplied += snapshot.corrections.size();
+    }
+
+    if ( !later.empty() ) {
+        static Counter& num_rollbacks = MetricsRegistry::GetInstance().GetCounter("eskf.rollbacks");
+        num_rollbacks.Increment();
+
+        ++rollback_stats_.num_rollbacks;
+        rollback_stats_.max_rollback_time = std::max(rollback_stats_.max_rollback_time, rollback_time);
+
+        if ( 0 == rollback_stats_.num_rollbacks % 100 ) {
+            LOG(INFO) << "Kalman Correct: " << rollback_stats_.num_rollbacks << " rollbacks, "
+                      << rollback_stats_.num_repropagated << " IMU measurements re-propagated, "
+                      << rollback_stats_.num_reapplied << " corrections re-applied, "
+                      << rollback_stats_.num_too_late << " too late, "
+                      << "max. rollback " << rollback_stats_.max_rollback_time << "s" << std::endl;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief  save current filter state into state history
+ * @param  imu_data, the IMU measurement just propagated
+ * @return void
+ */
+void ErrorStateKalmanFilter::SaveState(const IMUData &imu_data) {
+    if ( 0 == state_history_size_ ) {
+        return;
+    }
+
+    StateSnapshot snapshot;
+
+    snapshot.time = time_;
+    snapshot.imu_data = imu_data;
+
+    snapshot.pose = pose_;
+    snapshot.vel = vel_;
+    snapshot.gyro_bias = gyro_bias_;
+    snapshot.accl_bias = accl_bias_;
+
+    snapshot.X = X_;
+    snapshot.P = P_;
+    snapshot.F = F_;
+    snapshot.B = B_;
+    snapshot.pre_integration = pre_integration_;
+
+    state_history_.push_back(snapshot);
+    while ( state_history_.size() > state_history_size_ ) {
+        state_history_.pop_front();
+    }
+}
+
+/**
+ * @brief  restore filter state from state history
+ * @param  snapshot, state snapshot
+ * @return void
+ */
+void ErrorStateKalmanFilter::RestoreState(const StateSnapshot &snapshot) {
+    time_ = snapshot.time;
+    imu_data_buff_.clear();
+    imu_data_buff_.push_back(snapshot.imu_data);
+
+    pose_ = snapshot.pose;
+    vel_ = snapshot.vel;
+    gyro_bias_ = snapshot.gyro_bias;
+    accl_bias_ = snapshot.accl_bias;
+
+    X_ = snapshot.X;
+    P_ = snapshot.P;
+    F_ = snapshot.F;
+    B_ = snapshot.B;
+    pre_integration_ = snapshot.pre_integration;
+}
+
 /**
  * @brief  get odometry estimation
  * @param  pose, init pose
@@ -283,6 +651,24 @@ void ErrorStateKalmanFilter::GetOdometry(
     vel = vel_double.cast<float>();
 }
 
+/**
+ * @brief  get filter state
+ * @param  state, filter state output
+ * @return void
+ */
+void ErrorStateKalmanFilter::GetState(State &state) const {
+    state.time = time_;
+
+    state.init_pose = init_pose_;
+    state.pose = pose_;
+    state.vel = vel_;
+    state.gyro_bias = gyro_bias_;
+    state.accl_bias = accl_bias_;
+
+    state.X = X_;
+    state.P = P_;
+}
+
 /**
  * @brief  get covariance estimation
  * @param  cov, covariance output
@@ -333,156 +719,30 @@ inline Eigen::Vector3d ErrorStateKalmanFilter::GetUnbiasedAngularVel(
 }
 
 /**
- * @brief  get unbiased linear acceleration in navigation frame
- * @param  linear_acc, linear acceleration measurement
- * @param  R, corresponding orientation of measurement
- * @return unbiased linear acceleration in navigation frame
- */
-inline Eigen::Vector3d ErrorStateKalmanFilter::GetUnbiasedLinearAcc(
-    const Eigen::Vector3d &linear_acc,
-    const Eigen::Matrix3d &R
-) {
-    return R*(linear_acc - accl_bias_) - g_;
-}
-
-/**
- * @brief  get angular delta
- * @param  index_curr, current imu measurement buffer index
- * @param  index_prev, previous imu measurement buffer index
- * @param  angular_delta, angular delta output
- * @return true if success false otherwise
- */
-bool ErrorStateKalmanFilter::GetAngularDelta(
-    const size_t index_curr, const size_t index_prev,
-    Eigen::Vector3d &angular_delta
-) {
-    if (
-        index_curr <= index_prev ||
-        imu_data_buff_.size() <= index_curr
-    ) {
-        return false;
-    }
-
-    const IMUData &imu_data_curr = imu_data_buff_.at(index_curr);
-    const IMUData &imu_data_prev = imu_data_buff_.at(index_prev);
-
-    double delta_t = imu_data_curr.time - imu_data_prev.time;
-
-    Eigen::Vector3d angular_vel_curr = Eigen::Vector3d(
-        imu_data_curr.angular_velocity.x,
-        imu_data_curr.angular_velocity.y,
-        imu_data_curr.angular_velocity.z
-    );
-    Eigen::Matrix3d R_curr = imu_data_curr.GetOrientationMatrix().cast<double>();
-    angular_vel_curr = GetUnbiasedAngularVel(angular_vel_curr, R_curr);
-
-    Eigen::Vector3d angular_vel_prev = Eigen::Vector3d(
-        imu_data_prev.angular_velocity.x,
-        imu_data_prev.angular_velocity.y,
-        imu_data_prev.angular_velocity.z
-    );
-    Eigen::Matrix3d R_prev = imu_data_prev.GetOrientationMatrix().cast<double>();
-    angular_vel_prev = GetUnbiasedAngularVel(angular_vel_prev, R_prev);
-
-    angular_delta = 0.5*delta_t*(angular_vel_curr + angular_vel_prev);
-
-    return true;
-}
-
-/**
- * @brief  update orientation with effective rotation angular_delta
- * @param  angular_delta, effective rotation
- * @param  R_curr, current orientation
- * @param  R_prev, previous orientation
- * @return void
- */
-void ErrorStateKalmanFilter::UpdateOrientation(
-    const Eigen::Vector3d &angular_delta,
-    Eigen::Matrix3d &R_curr, Eigen::Matrix3d &R_prev
-) {
-    // magnitude:
-    double angular_delta_mag = angular_delta.norm();
-    // direction:
-    Eigen::Vector3d angular_delta_dir = angular_delta.normalized();
-
-    // build delta q:
-    double angular_delta_cos = cos(angular_delta_mag/2.0);
-    double angular_delta_sin = sin(angular_delta_mag/2.0);
-    Eigen::Quaterniond dq(
-        angular_delta_cos, 
-        angular_delta_sin*angular_delta_dir.x(), 
-        angular_delta_sin*angular_delta_dir.y(), 
-        angular_delta_sin*angular_delta_dir.z()
-    );
-    Eigen::Quaterniond q(pose_.block<3, 3>(0, 0));
-    
-    // update:
-    q = q*dq;
-    
-    // write back:
-    R_prev = pose_.block<3, 3>(0, 0);
-    pose_.block<3, 3>(0, 0) = q.normalized().toRotationMatrix();
-    R_curr = pose_.block<3, 3>(0, 0);
-}
-
-/**
- * @brief  get velocity delta
- * @param  index_curr, current imu measurement buffer index
- * @param  index_prev, previous imu measurement buffer index
- * @param  R_curr, corresponding orientation of current imu measurement
- * @param  R_prev, corresponding orientation of previous imu measurement
- * @param  velocity_delta, velocity delta output
- * @param  linear_acc_mid, mid-value unbiased linear acc
- * @return true if success false otherwise
+ * @brief  get unbiased IMU measurement for mechanization
+ * @param  imu_data, IMU measurement
+ * @return unbiased angular velocity & linear acceleration in body frame
  */
-bool ErrorStateKalmanFilter::GetVelocityDelta(
-    const size_t index_curr, const size_t index_prev,
-    const Eigen::Matrix3d &R_curr, const Eigen::Matrix3d &R_prev, 
-    double &T, 
-    Eigen::Vector3d &velocity_delta, 
-    Eigen::Vector3d &linear_acc_mid
-) {
-    if (
-        index_curr <= index_prev ||
-        imu_data_buff_.size() <= index_curr
-    ) {
-        return false;
-    }
-
-    const IMUData &imu_data_curr = imu_data_buff_.at(index_curr);
-    const IMUData &imu_data_prev = imu_data_buff_.at(index_prev);
+imu_mechanization::IMUSample ErrorStateKalmanFilter::GetUnbiasedIMUSample(const IMUData &imu_data) {
+    imu_mechanization::IMUSample sample;
 
-    T = imu_data_curr.time - imu_data_prev.time;
+    sample.time = imu_data.time;
 
-    Eigen::Vector3d linear_acc_curr = Eigen::Vector3d(
-        imu_data_curr.linear_acceleration.x,
-        imu_data_curr.linear_acceleration.y,
-        imu_data_curr.linear_acceleration.z
-    );
-    linear_acc_curr = GetUnbiasedLinearAcc(linear_acc_curr, R_curr);
-    Eigen::Vector3d linear_acc_prev = Eigen::Vector3d(
-        imu_data_prev.linear_acceleration.x,
-        imu_data_prev.linear_acceleration.y,
-        imu_data_prev.linear_acceleration.z
+    Eigen::Vector3d angular_vel = Eigen::Vector3d(
+        imu_data.angular_velocity.x,
+        imu_data.angular_velocity.y,
+        imu_data.angular_velocity.z
     );
-    linear_acc_prev = GetUnbiasedLinearAcc(linear_acc_prev, R_prev);
-    
-    // mid-value acc can improve error state prediction accuracy:
-    linear_acc_mid = 0.5*(linear_acc_curr + linear_acc_prev);
-    velocity_delta = T*linear_acc_mid;
+    Eigen::Matrix3d R = imu_data.GetOrientationMatrix().cast<double>();
+    sample.angular_vel = GetUnbiasedAngularVel(angular_vel, R);
 
-    return true;
-}
+    sample.linear_acc = Eigen::Vector3d(
+        imu_data.linear_acceleration.x,
+        imu_data.linear_acceleration.y,
+        imu_data.linear_acceleration.z
+    ) - accl_bias_;
 
-/**
- * @brief  update orientation with effective velocity change velocity_delta
- * @param  T, timestamp delta 
- * @param  velocity_delta, effective velocity change
- * @return void
- */
-void ErrorStateKalmanFilter::UpdatePosition(const double &T, const Eigen::Vector3d &velocity_delta) {
-    pose_.block<3, 1>(0, 3) += T*vel_ + 0.5*T*velocity_delta;
-    vel_ += velocity_delta;
+    return sample;
 }
 
 /**
@@ -491,26 +751,29 @@ void ErrorStateKalmanFilter::UpdatePosition(const double &T, const Eigen::Vector
  * @return void
  */
 void ErrorStateKalmanFilter::UpdateOdomEstimation(Eigen::Vector3d &linear_acc_mid) {
-    // get deltas:
-    Eigen::Vector3d angular_delta; 
-    GetAngularDelta(1, 0, angular_delta);
+    // an increment already integrates the raw measurements since the last one, its mean rates are unbiased as usual.
+    // the filter may have been moved into the interval by a synced measurement, then only the rest is integrated:
+    if (imu_data_buff_.at(1).has_increment) {
+        const double T = imu_data_buff_.at(1).time - imu_data_buff_.at(0).time;
+        imu_mechanization::IMUSample sample = GetUnbiasedIMUSample(imu_data_buff_.at(1));
+
+        linear_acc_mid = imu_mechanization::IntegrateIncrement(
+            T, T*sample.angular_vel, T*sample.linear_acc,
+            g_,
+            pose_, vel_
+        );
+        return;
+    }
 
-    // update orientation:
-    Eigen::Matrix3d R_curr, R_prev;
-    UpdateOrientation(angular_delta, R_curr, R_prev);
+    imu_mechanization::IMUSample sample_prev = GetUnbiasedIMUSample(imu_data_buff_.at(0));
+    imu_mechanization::IMUSample sample_curr = GetUnbiasedIMUSample(imu_data_buff_.at(1));
 
-    // get velocity delta:
-    double T;
-    Eigen::Vector3d velocity_delta;
     // save mid-value unbiased linear acc for error-state update:
-    GetVelocityDelta(
-        1, 0, 
-        R_curr, R_prev, 
-        T, velocity_delta, linear_acc_mid
+    linear_acc_mid = imu_mechanization::IntegrateStep(
+        sample_prev, sample_curr, 
+        g_, 
+        pose_, vel_
     );
-
-    // update position:
-    UpdatePosition(T, velocity_delta);
 }
 
 /**
@@ -558,22 +821,15 @@ void ErrorStateKalmanFilter::UpdateErrorEstimation(
 ) {
     static int count = 0;
 
-    static MatrixF F_1st;
-    static MatrixF F_2nd;
-
     // update process equation:
     UpdateProcessEquation(linear_acc_mid);
 
-    // get discretized process equations:
-    F_1st = T*F_;
-    F_2nd = 0.5*T*F_*F_1st;
-    // approximate to 2nd order:
-    MatrixF F = MatrixF::Identity() + F_1st + F_2nd;
-    MatrixB B = T*B_;
-
-    // perform Kalman prediction:
-    X_ = F*X_;
-    P_ = F*P_*F.transpose() + B*Q_*B.transpose();
+    // the nominal state is integrated at IMU rate, the covariance only once per prediction interval:
+    PreIntegrate(T);
+    if (pre_integration_.num_measurements >= prediction_interval_) {
+        // perform Kalman prediction:
+        PredictErrorEstimation();
+    }
 
     if (
         0 == (++count % 10) 
@@ -594,82 +850,397 @@ void ErrorStateKalmanFilter::UpdateErrorEstimation(
 }
 
 /**
- * @brief  correct error estimation using pose measurement
- * @param  T_nb, input pose measurement
+ * @brief  pre-integrate process equation & process noise of one IMU measurement
+ * @param  T, time delta
  * @return void
  */
-void ErrorStateKalmanFilter::CorrectErrorEstimationPose(
-    const Eigen::Matrix4d &T_nb
+void ErrorStateKalmanFilter::PreIntegrate(const double &T) {
+    ++pre_integration_.num_measurements;
+    pre_integration_.T += T;
+
+    // block layout of F_ & B_ set by Init & SetProcessEquation, all other blocks are zero or constant:
+    pre_integration_.F_vo += T*F_.block<3, 3>(INDEX_ERROR_VEL,   INDEX_ERROR_ORI);
+    pre_integration_.F_va += T*F_.block<3, 3>(INDEX_ERROR_VEL, INDEX_ERROR_ACCEL);
+    pre_integration_.F_og += T*F_.block<3, 3>(INDEX_ERROR_ORI,  INDEX_ERROR_GYRO);
+
+    // B*Q*B^T, with B = T*B_:
+    const Eigen::Matrix3d B_va = T*B_.block<3, 3>(INDEX_ERROR_VEL, 3);
+    const Eigen::Matrix3d B_og = T*B_.block<3, 3>(INDEX_ERROR_ORI, 0);
+    pre_integration_.Q_vv += B_va*Q_.block<3, 3>(3, 3)*B_va.transpose();
+    pre_integration_.Q_vo += B_va*Q_.block<3, 3>(3, 0)*B_og.transpose();
+    pre_integration_.Q_oo += B_og*Q_.block<3, 3>(0, 0)*B_og.transpose();
+}
+
+/**
+ * @brief  propagate covariance, P = F*P*F^T, in Scalar
+ * @param  D, non-zero 3-by-3 blocks of F - I, as row, col & block
+ * @param  num_blocks, num. of blocks
+ * @return upper triangle of F*P*F^T, in double
+ */
+template<typename Scalar, typename BlockType>
+ErrorStateKalmanFilter::MatrixP ErrorStateKalmanFilter::PropagateCovariance(
+    const BlockType *D, int num_blocks
+) const {
+    const MatrixPT<Scalar> P = P_.template cast<Scalar>();
+
+    // first F*P:
+    MatrixPT<Scalar> FP = P;
+    for (int i = 0; i < num_blocks; ++i) {
+        const Eigen::Matrix<Scalar, 3, 3> D_i = D[i].D.template cast<Scalar>();
+        FP.template block<3, DIM_STATE>(D[i].row, 0) += D_i*P.template block<3, DIM_STATE>(D[i].col, 0);
+    }
+    // then (F*P)*F^T, the result is symmetric so only the upper triangle is evaluated:
+    MatrixPT<Scalar> FPFt = FP;
+    for (int i = 0; i < num_blocks; ++i) {
+        const Eigen::Matrix<Scalar, 3, 3> D_i = D[i].D.template cast<Scalar>();
+        const int num_rows = D[i].row + 3;
+        FPFt.block(0, D[i].row, num_rows, 3) += FP.block(0, D[i].col, num_rows, 3)*D_i.transpose();
+    }
+
+    return FPFt.template cast<double>();
+}
+
+/**
+ * @brief  Kalman prediction over the pre-integrated IMU measurements, 
+ *         using only the non-zero 3-by-3 blocks of process equation
+ * @param  void
+ * @return void
+ */
+void ErrorStateKalmanFilter::PredictErrorEstimation(void) {
+    const double T = pre_integration_.T;
+
+    // integrals of process equation blocks over T:
+    const Eigen::Matrix3d F_pv = T*F_.block<3, 3>(INDEX_ERROR_POS, INDEX_ERROR_VEL);
+    const Eigen::Matrix3d &F_vo = pre_integration_.F_vo;
+    const Eigen::Matrix3d &F_va = pre_integration_.F_va;
+    const Eigen::Matrix3d F_oo = T*F_.block<3, 3>(INDEX_ERROR_ORI, INDEX_ERROR_ORI);
+    const Eigen::Matrix3d &F_og = pre_integration_.F_og;
+
+    // discretized process equation approximated to 2nd order, F = I + D, D = T*F_ + 0.5*T^2*F_^2,
+    // with F_ averaged over the pre-integrated measurements:
+    struct Block {
+        int row;
+        int col;
+        Eigen::Matrix3d D;
+    };
+    const Block D[] = {
+        {INDEX_ERROR_POS,   INDEX_ERROR_VEL, F_pv},
+        {INDEX_ERROR_POS,   INDEX_ERROR_ORI, 0.5*F_pv*F_vo},
+        {INDEX_ERROR_POS, INDEX_ERROR_ACCEL, 0.5*F_pv*F_va},
+        {INDEX_ERROR_VEL,   INDEX_ERROR_ORI, F_vo + 0.5*F_vo*F_oo},
+        {INDEX_ERROR_VEL,  INDEX_ERROR_GYRO, 0.5*F_vo*F_og},
+        {INDEX_ERROR_VEL, INDEX_ERROR_ACCEL, F_va},
+        {INDEX_ERROR_ORI,   INDEX_ERROR_ORI, F_oo + 0.5*F_oo*F_oo},
+        {INDEX_ERROR_ORI,  INDEX_ERROR_GYRO, F_og + 0.5*F_oo*F_og}
+    };
+
+    // a. X = F*X:
+    VectorX X = X_;
+    for (const Block &block: D) {
+        X.block<3, 1>(block.row, 0) += block.D*X_.block<3, 1>(block.col, 0);
+    }
+    X_ = X;
+
+    // b. P = F*P*F^T:
+    const int num_blocks = sizeof(D) / sizeof(D[0]);
+    MatrixP FPFt = (
+        Precision::MIXED == precision_ ? 
+        PropagateCovariance<float>(D, num_blocks) : PropagateCovariance<double>(D, num_blocks)
+    );
+
+    // c. accumulated process noise, in double so that small increments are not rounded off:
+    FPFt.block<3, 3>(INDEX_ERROR_VEL, INDEX_ERROR_VEL) += pre_integration_.Q_vv;
+    FPFt.block<3, 3>(INDEX_ERROR_VEL, INDEX_ERROR_ORI) += pre_integration_.Q_vo;
+    FPFt.block<3, 3>(INDEX_ERROR_ORI, INDEX_ERROR_ORI) += pre_integration_.Q_oo;
+
+    P_ = FPFt.selfadjointView<Eigen::Upper>();
+
+    // start next pre-integration:
+    pre_integration_ = PreIntegration();
+}
+
+/**
+ * @brief  Kalman correct with the configured correct method
+ * @param  Y, measurement
+ * @param  G, measurement equation
+ * @param  R, measurement noise
+ * @return true if success false otherwise
+ */
+template<int DIM_MEASUREMENT>
+bool ErrorStateKalmanFilter::CorrectErrorEstimation(
+    const Eigen::Matrix<double, DIM_MEASUREMENT,               1> &Y,
+    const Eigen::Matrix<double, DIM_MEASUREMENT,       DIM_STATE> &G,
+    const Eigen::Matrix<double, DIM_MEASUREMENT, DIM_MEASUREMENT> &R
 ) {
-    // parse measurement:
-    Eigen::Vector3d P_nn_obs = pose_.block<3, 1>(0,3) - T_nb.block<3, 1>(0,3);
-    Eigen::Matrix3d C_nn_obs = pose_.block<3, 3>(0,0) * T_nb.block<3, 3>(0,0).transpose();
+    if (CorrectMethod::SQUARE_ROOT == correct_method_) {
+        return CorrectErrorEstimationSquareRoot(Y, G, R);
+    }
 
-    YPose_.block<3, 1>(0, 0) = P_nn_obs;
-    YPose_.block<3, 1>(3, 0) = Sophus::SO3d::vee(Eigen::Matrix3d::Identity() - C_nn_obs);
+    // correlated measurement noise is corrected as a whole:
+    if (CorrectMethod::SEQUENTIAL == correct_method_ && R.isDiagonal()) {
+        return CorrectErrorEstimationSequential(Y, G, R);
+    }
 
-    // build Kalman gain:
-    MatrixRPose R = GPose_*P_*GPose_.transpose() + RPose_;
-    MatrixKPose K = P_*GPose_.transpose()*R.inverse();
+    return CorrectErrorEstimationJoseph(Y, G, R);
+}
 
-    // perform Kalman correct:
-    P_ = (MatrixP::Identity() - K*GPose_)*P_;
-    X_ = X_ + K*(YPose_ - GPose_*X_);
+/**
+ * @brief  Kalman correct, Cholesky solve for Kalman gain & Joseph form covariance update
+ * @param  Y, measurement
+ * @param  G, measurement equation
+ * @param  R, measurement noise
+ * @return true if success false otherwise
+ */
+template<int DIM_MEASUREMENT>
+bool ErrorStateKalmanFilter::CorrectErrorEstimationJoseph(
+    const Eigen::Matrix<double, DIM_MEASUREMENT,               1> &Y,
+    const Eigen::Matrix<double, DIM_MEASUREMENT,       DIM_STATE> &G,
+    const Eigen::Matrix<double, DIM_MEASUREMENT, DIM_MEASUREMENT> &R
+) {
+    // innovation covariance:
+    const Eigen::Matrix<double, DIM_MEASUREMENT, DIM_STATE> GP = G*P_;
+    const Eigen::Matrix<double, DIM_MEASUREMENT, DIM_MEASUREMENT> S = GP*G.transpose() + R;
+
+    Eigen::LLT<Eigen::Matrix<double, DIM_MEASUREMENT, DIM_MEASUREMENT>> S_llt(S);
+    if (Eigen::Success != S_llt.info()) {
+        LOG(WARNING) << "Kalman correct: innovation covariance is not positive definite. Skip.";
+        return false;
+    }
+
+    // K = P*G^T*S^{-1}, as K^T = S^{-1}*G*P:
+    const Eigen::Matrix<double, DIM_STATE, DIM_MEASUREMENT> K = S_llt.solve(GP).transpose();
+
+    // Joseph form (I - K*G)*P*(I - K*G)^T + K*R*K^T, expanded as P - K*G*P - (K*G*P)^T + K*S*K^T:
+    const MatrixP KGP = K*GP;
+    P_ = P_ - KGP - KGP.transpose() + K*S*K.transpose();
+    P_ = 0.5*(P_ + P_.transpose());
+
+    X_ = X_ + K*(Y - G*X_);
+
+    return true;
 }
 
 /**
- * @brief  correct error estimation using position measurement
- * @param  T_nb, input position measurement
- * @return void
+ * @brief  Kalman correct, QR triangularization of the square-root pre-array
+ * @param  Y, measurement
+ * @param  G, measurement equation
+ * @param  R, measurement noise
+ * @return true if success false otherwise
  */
-void ErrorStateKalmanFilter::CorrectErrorEstimationPosition(
-    const Eigen::Matrix4d &T_nb
+template<int DIM_MEASUREMENT>
+bool ErrorStateKalmanFilter::CorrectErrorEstimationSquareRoot(
+    const Eigen::Matrix<double, DIM_MEASUREMENT,               1> &Y,
+    const Eigen::Matrix<double, DIM_MEASUREMENT,       DIM_STATE> &G,
+    const Eigen::Matrix<double, DIM_MEASUREMENT, DIM_MEASUREMENT> &R
 ) {
-    // parse measurement:
-    Eigen::Vector3d P_nn_obs = pose_.block<3, 1>(0,3) - T_nb.block<3, 1>(0,3);
+    static const int DIM_ARRAY = DIM_MEASUREMENT + DIM_STATE;
 
-    YPosition_.block<3, 1>(0, 0) = P_nn_obs;
+    // square roots, R = R_sqrt*R_sqrt^T & P = P_sqrt*P_sqrt^T:
+    Eigen::LLT<Eigen::Matrix<double, DIM_MEASUREMENT, DIM_MEASUREMENT>> R_llt(R);
+    if (Eigen::Success != R_llt.info()) {
+        LOG(WARNING) << "Kalman correct: measurement noise is not positive definite. Skip.";
+        return false;
+    }
+    const Eigen::Matrix<double, DIM_MEASUREMENT, DIM_MEASUREMENT> R_sqrt = R_llt.matrixL();
+
+    MatrixP P_sqrt;
+    Eigen::LLT<MatrixP> P_llt(P_);
+    if (Eigen::Success == P_llt.info()) {
+        P_sqrt = P_llt.matrixL();
+    } else {
+        // P has lost positive definiteness through rounding, drop the negative eigenvalues:
+        Eigen::SelfAdjointEigenSolver<MatrixP> P_eigen(P_);
+        P_sqrt = P_eigen.eigenvectors()*P_eigen.eigenvalues().cwiseMax(0.0).cwiseSqrt().asDiagonal();
+    }
 
-    // build Kalman gain:
-    MatrixRPosition R = GPosition_*P_*GPosition_.transpose() + RPosition_;
-    MatrixKPosition K = P_*GPosition_.transpose()*R.inverse();
+    // pre-array [R_sqrt G*P_sqrt; 0 P_sqrt], triangularized as [S_sqrt 0; K*S_sqrt P_sqrt_corrected]:
+    Eigen::Matrix<double, DIM_ARRAY, DIM_ARRAY> A = Eigen::Matrix<double, DIM_ARRAY, DIM_ARRAY>::Zero();
+    A.template block<DIM_MEASUREMENT, DIM_MEASUREMENT>(0, 0) = R_sqrt.transpose();
+    A.template block<DIM_STATE, DIM_MEASUREMENT>(DIM_MEASUREMENT, 0) = (G*P_sqrt).transpose();
+    A.template block<DIM_STATE, DIM_STATE>(DIM_MEASUREMENT, DIM_MEASUREMENT) = P_sqrt.transpose();
 
-    // perform Kalman correct:
-    P_ = (MatrixP::Identity() - K*GPosition_)*P_;
-    X_ = X_ + K*(YPosition_ - GPosition_*X_);
+    Eigen::HouseholderQR<Eigen::Matrix<double, DIM_ARRAY, DIM_ARRAY>> A_qr(A);
+    const Eigen::Matrix<double, DIM_ARRAY, DIM_ARRAY> post = A_qr.matrixQR().template triangularView<Eigen::Upper>().transpose();
+
+    const Eigen::Matrix<double, DIM_MEASUREMENT, DIM_MEASUREMENT> S_sqrt = post.template block<DIM_MEASUREMENT, DIM_MEASUREMENT>(0, 0);
+    const Eigen::Matrix<double, DIM_STATE, DIM_MEASUREMENT> KS_sqrt = post.template block<DIM_STATE, DIM_MEASUREMENT>(DIM_MEASUREMENT, 0);
+    const MatrixP P_sqrt_corrected = post.template block<DIM_STATE, DIM_STATE>(DIM_MEASUREMENT, DIM_MEASUREMENT);
+
+    // K = (K*S_sqrt)*S_sqrt^{-1}, as K^T = S_sqrt^{-T}*(K*S_sqrt)^T:
+    const Eigen::Matrix<double, DIM_STATE, DIM_MEASUREMENT> K = S_sqrt.transpose().template triangularView<Eigen::Upper>().solve(
+        KS_sqrt.transpose()
+    ).transpose();
+
+    P_ = P_sqrt_corrected*P_sqrt_corrected.transpose();
+    X_ = X_ + K*(Y - G*X_);
+
+    return true;
 }
 
 /**
- * @brief  correct error estimation using navigation position and body velocity measurement
- * @param  T_nb, input position measurement
- * @param  v_b, input velocity measurement
- * @return void
+ * @brief  Kalman correct, one scalar update per component, for diagonal measurement noise
+ * @param  Y, measurement
+ * @param  G, measurement equation
+ * @param  R, measurement noise, only its diagonal is used
+ * @return true if any component is applied false otherwise
  */
-void ErrorStateKalmanFilter::CorrectErrorEstimationPosVel(
-    const Eigen::Matrix4d &T_nb, const Eigen::Vector3d &v_b
+template<int DIM_MEASUREMENT>
+bool ErrorStateKalmanFilter::CorrectErrorEstimationSequential(
+    const Eigen::Matrix<double, DIM_MEASUREMENT,               1> &Y,
+    const Eigen::Matrix<double, DIM_MEASUREMENT,       DIM_STATE> &G,
+    const Eigen::Matrix<double, DIM_MEASUREMENT, DIM_MEASUREMENT> &R
 ) {
-    // parse measurement:
-    Eigen::Vector3d P_nn_obs = pose_.block<3, 1>(0,3) - T_nb.block<3, 1>(0,3);
-    Eigen::Vector3d v_bb_obs = pose_.block<3, 3>(0,0).transpose()*vel_ - v_b;
-    // apply motion constraint:
-    v_bb_obs.y() = v_bb_obs.z() = 0.0;
-    // Eigen::Matrix3d C_nn_obs = pose_.block<3, 3>(0,0) * T_nb.block<3, 3>(0,0).transpose();
+    int num_applied = 0;
+    for (int i = 0; i < DIM_MEASUREMENT; ++i) {
+        // innovation variance, the components corrected so far are included in P & X:
+        const VectorX PG = P_*G.row(i).transpose();
+        const double S = G.row(i).dot(PG) + R(i, i);
+        if (S <= 0.0) {
+            LOG(WARNING) << "Kalman correct: innovation variance of component " << i << " is not positive. Skip.";
+            continue;
+        }
 
-    YPosVel_.block<3, 1>(0, 0) = P_nn_obs;
-    YPosVel_.block<3, 1>(3, 0) = v_bb_obs ;
-    // YPosVel_.block<3, 1>(6, 0) = Sophus::SO3d::vee(Eigen::Matrix3d::Identity() - C_nn_obs);
+        const double innovation = Y(i) - G.row(i).dot(X_);
+        if (sequential_gate_ > 0.0 && innovation*innovation > sequential_gate_*S) {
+            LOG_EVERY_N(WARNING, 100) << "Kalman correct: component " << i << " of measurement gated out, normalized innovation " 
+                                      << innovation*innovation / S << ".";
+            continue;
+        }
 
-    // set measurement equation:
-    GPosVel_.block<3, 3>(3, INDEX_ERROR_VEL) =  pose_.block<3, 3>(0,0).transpose();
-    GPosVel_.block<3, 3>(3, INDEX_ERROR_ORI) = -pose_.block<3, 3>(0,0).transpose()*Sophus::SO3d::hat(vel_);
+        // Joseph form for one component reduces to P - K*S*K^T, with K = P*G^T / S:
+        const VectorX K = PG / S;
+        P_.noalias() -= K*PG.transpose();
+        X_ += K*innovation;
+
+        ++num_applied;
+    }
+    P_ = 0.5*(P_ + P_.transpose());
+
+    return num_applied > 0;
+}
+
+/**
+ * @brief  pose measurement, lidar/visual frontend
+ */
+template<>
+struct ErrorStateKalmanFilter::MeasurementModel<ErrorStateKalmanFilter::MeasurementType::POSE> {
+    static const int DIM = 6;
+    typedef Eigen::Matrix<double, DIM,         1> VectorY;
+    typedef Eigen::Matrix<double, DIM, DIM_STATE> MatrixG;
+    typedef Eigen::Matrix<double, DIM,       DIM> MatrixR;
+
+    static VectorY GetResidual(const ErrorStateKalmanFilter &filter, const Measurement &measurement) {
+        const Eigen::Matrix4d &T_nb = measurement.T_nb;
+        Eigen::Vector3d P_nn_obs = filter.pose_.block<3, 1>(0,3) - T_nb.block<3, 1>(0,3);
+        Eigen::Matrix3d C_nn_obs = filter.pose_.block<3, 3>(0,0) * T_nb.block<3, 3>(0,0).transpose();
+
+        VectorY Y;
+        Y.block<3, 1>(0, 0) = P_nn_obs;
+        Y.block<3, 1>(3, 0) = Sophus::SO3d::vee(Eigen::Matrix3d::Identity() - C_nn_obs);
+
+        return Y;
+    }
+
+    static MatrixG GetMeasurementEquation(const ErrorStateKalmanFilter &filter) {
+        MatrixG G = MatrixG::Zero();
+        G.block<3, 3>(0, INDEX_ERROR_POS) = Eigen::Matrix3d::Identity();
+        G.block<3, 3>(3, INDEX_ERROR_ORI) = Eigen::Matrix3d::Identity();
+
+        return G;
+    }
+
+    static MatrixR GetMeasurementNoise(const ErrorStateKalmanFilter &filter) {
+        MatrixR R = MatrixR::Zero();
+        R.block<3, 3>(0, 0) = filter.COV.MEASUREMENT.POS*Eigen::Matrix3d::Identity();
+        R.block<3, 3>(3, 3) = filter.COV.MEASUREMENT.ORIENTATION*Eigen::Matrix3d::Identity();
+
+        return R;
+    }
+};
+
+/**
+ * @brief  position measurement, GNSS
+ */
+template<>
+struct ErrorStateKalmanFilter::MeasurementModel<ErrorStateKalmanFilter::MeasurementType::POSITION> {
+    static const int DIM = 3;
+    typedef Eigen::Matrix<double, DIM,         1> VectorY;
+    typedef Eigen::Matrix<double, DIM, DIM_STATE> MatrixG;
+    typedef Eigen::Matrix<double, DIM,       DIM> MatrixR;
+
+    static VectorY GetResidual(const ErrorStateKalmanFilter &filter, const Measurement &measurement) {
+        return filter.pose_.block<3, 1>(0,3) - measurement.T_nb.block<3, 1>(0,3);
+    }
+
+    static MatrixG GetMeasurementEquation(const ErrorStateKalmanFilter &filter) {
+        MatrixG G = MatrixG::Zero();
+        G.block<3, 3>(0, INDEX_ERROR_POS) = Eigen::Matrix3d::Identity();
+
+        return G;
+    }
+
+    static MatrixR GetMeasurementNoise(const ErrorStateKalmanFilter &filter) {
+        return filter.COV.MEASUREMENT.POS*MatrixR::Identity();
+    }
+};
 
-    // build Kalman gain:
-    MatrixRPosVel R = GPosVel_*P_*GPosVel_.transpose() + RPosVel_;
-    MatrixKPosVel K = P_*GPosVel_.transpose()*R.inverse();
+/**
+ * @brief  navigation position & body velocity measurement, GNSS & odometer
+ */
+template<>
+struct ErrorStateKalmanFilter::MeasurementModel<ErrorStateKalmanFilter::MeasurementType::POSITION_VELOCITY> {
+    static const int DIM = 6;
+    typedef Eigen::Matrix<double, DIM,         1> VectorY;
+    typedef Eigen::Matrix<double, DIM, DIM_STATE> MatrixG;
+    typedef Eigen::Matrix<double, DIM,       DIM> MatrixR;
+
+    static VectorY GetResidual(const ErrorStateKalmanFilter &filter, const Measurement &measurement) {
+        Eigen::Vector3d P_nn_obs = filter.pose_.block<3, 1>(0,3) - measurement.T_nb.block<3, 1>(0,3);
+        Eigen::Vector3d v_bb_obs = filter.pose_.block<3, 3>(0,0).transpose()*filter.vel_ - measurement.v_b;
+        // apply motion constraint:
+        v_bb_obs.y() = v_bb_obs.z() = 0.0;
+
+        VectorY Y;
+        Y.block<3, 1>(0, 0) = P_nn_obs;
+        Y.block<3, 1>(3, 0) = v_bb_obs;
+
+        return Y;
+    }
+
+    static MatrixG GetMeasurementEquation(const ErrorStateKalmanFilter &filter) {
+        MatrixG G = MatrixG::Zero();
+        G.block<3, 3>(0, INDEX_ERROR_POS) = Eigen::Matrix3d::Identity();
+        G.block<3, 3>(3, INDEX_ERROR_VEL) =  filter.pose_.block<3, 3>(0,0).transpose();
+        G.block<3, 3>(3, INDEX_ERROR_ORI) = -filter.pose_.block<3, 3>(0,0).transpose()*Sophus::SO3d::hat(filter.vel_);
+
+        return G;
+    }
+
+    static MatrixR GetMeasurementNoise(const ErrorStateKalmanFilter &filter) {
+        MatrixR R = MatrixR::Zero();
+        R.block<3, 3>(0, 0) = filter.COV.MEASUREMENT.POS*Eigen::Matrix3d::Identity();
+        R.block<3, 3>(3, 3) = filter.COV.MEASUREMENT.VEL*Eigen::Matrix3d::Identity();
+
+        return R;
+    }
+};
+
+/**
+ * @brief  correct error estimation using measurement model of TYPE
+ * @param  measurement, input measurement
+ * @return void
+ */
+template<ErrorStateKalmanFilter::MeasurementType TYPE>
+void ErrorStateKalmanFilter::CorrectErrorEstimationByModel(const Measurement &measurement) {
+    typedef MeasurementModel<TYPE> Model;
+
+    // parse measurement:
+    const typename Model::VectorY Y = Model::GetResidual(*this, measurement);
+    // set measurement equation:
+    const typename Model::MatrixG G = Model::GetMeasurementEquation(*this);
 
     // perform Kalman correct:
-    P_ = (MatrixP::Identity() - K*GPosVel_)*P_;
-    X_ = X_ + K*(YPosVel_ - GPosVel_*X_);
+    CorrectErrorEstimation(Y, G, Model::GetMeasurementNoise(*this));
 }
 
 /**
@@ -686,16 +1257,14 @@ void ErrorStateKalmanFilter::CorrectErrorEstimation(
 
     switch ( measurement_type ) {
         case MeasurementType::POSE:
-            CorrectErrorEstimationPose(measurement.T_nb);
+            CorrectErrorEstimationByModel<MeasurementType::POSE>(measurement);
             break;
         case MeasurementType::POSITION:
-            CorrectErrorEstimationPosition(measurement.T_nb);
+            CorrectErrorEstimationByModel<MeasurementType::POSITION>(measurement);
             break;
         case MeasurementType::POSITION_VELOCITY:
-            CorrectErrorEstimationPosVel(
-                measurement.T_nb,
-                measurement.v_b
-            );
+            CorrectErrorEstimationByModel<MeasurementType::POSITION_VELOCITY>(measurement);
+            break;
         default:
             break;
     }
@@ -792,75 +1361,31 @@ void ErrorStateKalmanFilter::ResetCovariance(void) {
 }
 
 /**
- * @brief  update observability analysis for pose measurement
- * @param  void
- * @return void
- */
-void ErrorStateKalmanFilter::UpdateObservabilityAnalysisPose(
-    const double &time, std::vector<double> &record
-) {
-    ;
-}
-
-/**
- * @brief  update observability analysis for position measurement
- * @param  void
+ * @brief  observability analysis of one snapshot
+ * @param  snapshot, process & measurement equations
+ * @param  record, observability analysis output
  * @return void
  */
-void ErrorStateKalmanFilter::UpdateObservabilityAnalysisPosition(
-    const double &time, std::vector<double> &record
+void ErrorStateKalmanFilter::AnalyzeObservability(
+    const ObservabilitySnapshot &snapshot, std::vector<double> &record
 ) {
-    // build observability matrix for position measurement:
-    for (int i = 1; i < DIM_STATE; ++i) {
-        SOMPosition_.block<DIM_MEASUREMENT_POSITION, DIM_STATE>(i*DIM_MEASUREMENT_POSITION, 0) = (
-            SOMPosition_.block<DIM_MEASUREMENT_POSITION, DIM_STATE>((i - 1)*DIM_MEASUREMENT_POSITION, 0) * F_
-        );
-    }
-
-    // perform SVD analysis:
-    Eigen::JacobiSVD<Eigen::MatrixXd> svd(SOMPosition_, Eigen::ComputeThinU | Eigen::ComputeThinV);
-
-    // record timestamp:
-    record.push_back(time);
-
-    // record singular values:
-    for (int i = 0; i < DIM_STATE; ++i) {
-        record.push_back(svd.singularValues()(i, 0));
-    }
-
-    // record degree of observability:
-    Eigen::Matrix<double, DIM_STATE*DIM_MEASUREMENT_POSITION, 1> Y = COV.MEASUREMENT.POS*Eigen::Matrix<double, DIM_STATE*DIM_MEASUREMENT_POSITION, 1>::Ones();
-    VectorX X = (
-        svd.matrixV()*
-        svd.singularValues().asDiagonal().inverse()*
-        svd.matrixU().transpose()
-    )*Y;
-    for (int i = 0; i < DIM_STATE; ++i) {
-        record.push_back(X(i, 0));
-    }
-}
+    const int DIM_MEASUREMENT = snapshot.G.rows();
+    const int DIM_SOM = DIM_STATE*DIM_MEASUREMENT;
 
-/**
- * @brief  update observability analysis for navigation position & body velocity measurement
- * @param  void
- * @return void
- */
-void ErrorStateKalmanFilter::UpdateObservabilityAnalysisPosVel(
-    const double &time, std::vector<double> &record
-) {
-    // build observability matrix for position measurement:
-    SOMPosVel_.block<DIM_MEASUREMENT_POSVEL, DIM_STATE>(0, 0) = GPosVel_;
+    // build observability matrix:
+    Eigen::MatrixXd SOM(DIM_SOM, DIM_STATE);
+    SOM.block(0, 0, DIM_MEASUREMENT, DIM_STATE) = snapshot.G;
     for (int i = 1; i < DIM_STATE; ++i) {
-        SOMPosVel_.block<DIM_MEASUREMENT_POSVEL, DIM_STATE>(i*DIM_MEASUREMENT_POSVEL, 0) = (
-            SOMPosVel_.block<DIM_MEASUREMENT_POSVEL, DIM_STATE>((i - 1)*DIM_MEASUREMENT_POSVEL, 0) * F_
+        SOM.block(i*DIM_MEASUREMENT, 0, DIM_MEASUREMENT, DIM_STATE) = (
+            SOM.block((i - 1)*DIM_MEASUREMENT, 0, DIM_MEASUREMENT, DIM_STATE) * snapshot.F
         );
     }
 
     // perform SVD analysis:
-    Eigen::JacobiSVD<Eigen::MatrixXd> svd(SOMPosVel_, Eigen::ComputeThinU | Eigen::ComputeThinV);
+    Eigen::JacobiSVD<Eigen::MatrixXd> svd(SOM, Eigen::ComputeThinU | Eigen::ComputeThinV);
 
     // record timestamp:
-    record.push_back(time);
+    record.push_back(snapshot.time);
 
     // record singular values:
     for (int i = 0; i < DIM_STATE; ++i) {
@@ -868,7 +1393,7 @@ void ErrorStateKalmanFilter::UpdateObservabilityAnalysisPosVel(
     }
 
     // record degree of observability:
-    Eigen::Matrix<double, DIM_STATE*DIM_MEASUREMENT_POSVEL, 1> Y = COV.MEASUREMENT.POS*Eigen::Matrix<double, DIM_STATE*DIM_MEASUREMENT_POSVEL, 1>::Ones();
+    Eigen::VectorXd Y = COV.MEASUREMENT.POS*Eigen::VectorXd::Ones(DIM_SOM);
     VectorX X = (
         svd.matrixV()*
         svd.singularValues().asDiagonal().inverse()*
@@ -880,7 +1405,7 @@ void ErrorStateKalmanFilter::UpdateObservabilityAnalysisPosVel(
 }
 
 /**
- * @brief  update observability analysis
+ * @brief  update observability analysis, only a snapshot is taken, the analysis is done on save
  * @param  measurement_type, measurement type
  * @return void
  */
@@ -888,49 +1413,66 @@ void ErrorStateKalmanFilter::UpdateObservabilityAnalysis(
     const double &time,
     const MeasurementType &measurement_type
 ) {
-    // init record:
-    std::vector<double> record;
+    if ( 0 == observability_buffer_size_ ) {
+        return;
+    }
+
+    // init snapshot:
+    ObservabilitySnapshot snapshot;
+    snapshot.time = time;
+    snapshot.F = F_;
+
+    std::deque<ObservabilitySnapshot> *snapshots = nullptr;
 
     switch ( measurement_type ) {
         case MeasurementType::POSE:
-            UpdateObservabilityAnalysisPose(time, record);
-            observability.pose_.push_back(record);
+            snapshot.G = MeasurementModel<MeasurementType::POSE>::GetMeasurementEquation(*this);
+            snapshots = &(observability.pose_);
             break;
         case MeasurementType::POSITION:
-            UpdateObservabilityAnalysisPosition(time, record);
-            observability.position_.push_back(record);
+            snapshot.G = MeasurementModel<MeasurementType::POSITION>::GetMeasurementEquation(*this);
+            snapshots = &(observability.position_);
             break;
         case MeasurementType::POSITION_VELOCITY:
-            observability.pos_vel_.push_back(record);
+            snapshot.G = MeasurementModel<MeasurementType::POSITION_VELOCITY>::GetMeasurementEquation(*this);
+            snapshots = &(observability.pos_vel_);
             break;
         default:
-            break;
+            return;
+    }
+
+    // keep the latest ones only:
+    snapshots->push_back(snapshot);
+    if ( snapshots->size() > observability_buffer_size_ ) {
+        snapshots->pop_front();
     }
 }
 
 void ErrorStateKalmanFilter::SaveObservabilityAnalysis(
     const MeasurementType &measurement_type
 ) {
-    std::vector<std::vector<double>> *data = nullptr;
+    const std::deque<ObservabilitySnapshot> *snapshots = nullptr;
     std::string type;
 
     switch ( measurement_type ) {
         case MeasurementType::POSE:
-            data = &(observability.pose_);
+            snapshots = &(observability.pose_);
             type = std::string("pose");
             break;
         case MeasurementType::POSITION:
-            data = &(observability.position_);
+            snapshots = &(observability.position_);
             type = std::string("position");
             break;
         case MeasurementType::POSITION_VELOCITY:
-            data = &(observability.pos_vel_);
+            snapshots = &(observability.pos_vel_);
             type = std::string("position_velocity");
             break;
         default:
-            break;
+            return;
     }
 
+    LOG(INFO) << "Observability analysis of " << snapshots->size() << " " << type << " snapshots..." << std::endl;
+
     // init:
     CSVWriter csv(",");
     csv.enableAutoNewRow(1 + 2*DIM_STATE);
@@ -945,7 +1487,10 @@ void ErrorStateKalmanFilter::SaveObservabilityAnalysis(
     }
 
     // b. write contents:
-    for (const auto &record: *data) {
+    for (const auto &snapshot: *snapshots) {
+        std::vector<double> record;
+        AnalyzeObservability(snapshot, record);
+
         // cast timestamp to int:
         csv << static_cast<int>(record.at(0));
 
@@ -0,0 +1,787 @@
+/*
+ * @Description: bank of Error-State Kalman Filters over ambiguous init pose hypotheses, in lockstep
+ * @Author: Ge Yao
+ * @Date: 2021-01-01 16:05:12
+ */
+#include "lidar_localization/models/kalman_filter/error_state_kalman_filter_bank.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+// use sophus to handle so3 hat & SO3 exp operations:
+#include <sophus/so3.hpp>
+
+#include <Eigen/Cholesky>
+
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/simd_dispatch.hpp"
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+namespace {
+const int DIM_STATE = ErrorStateKalmanFilter::DIM_STATE;
+const int LANE_WIDTH = ErrorStateKalmanFilterBank::LANE_WIDTH;
+
+const int INDEX_ERROR_POS = ErrorStateKalmanFilter::INDEX_ERROR_POS;
+const int INDEX_ERROR_VEL = ErrorStateKalmanFilter::INDEX_ERROR_VEL;
+const int INDEX_ERROR_ORI = ErrorStateKalmanFilter::INDEX_ERROR_ORI;
+const int INDEX_ERROR_GYRO = ErrorStateKalmanFilter::INDEX_ERROR_GYRO;
+const int INDEX_ERROR_ACCEL = ErrorStateKalmanFilter::INDEX_ERROR_ACCEL;
+
+// bias covariance threshold of ErrorStateKalmanFilter::IsCovStable:
+const double BIAS_COV_STABLE_THRESH = 1.0e-5;
+
+// beyond this angular delta per IMU measurement the series of the delta quaternion is replaced by sin & cos:
+const double MAX_SERIES_ANGULAR_DELTA = 0.5;
+
+// one IMU measurement, shared by all lanes:
+struct IntegrationStep {
+    double T;
+    // mid-value angular delta before gyro bias compensation:
+    double angular_delta[3];
+    // linear acc. of previous & current measurement before accel bias compensation:
+    double linear_acc_prev[3];
+    double linear_acc_curr[3];
+    double g[3];
+};
+
+// prediction over the pre-integrated IMU measurements, shared by all lanes:
+struct PredictionStep {
+    double T;
+    // T*F_oo, with its 2nd order term:
+    double F_oo[9];
+    double D_oo[9];
+    double Q_vv;
+    double Q_oo;
+};
+
+// rows of the lanes, stride doubles apart:
+struct Lanes {
+    int stride;
+
+    double *q;
+    double *C_nb;
+    double *pos;
+    double *vel;
+    double *gyro_bias;
+    double *accl_bias;
+    double *P;
+    double *F_vo;
+    double *F_va;
+};
+
+// mid-value integration of one IMU measurement, as imu_mechanization::IntegrateStep, for lanes [lane, lane + LANE_WIDTH).
+// the orientation is kept as quaternion so it is not recovered from the rotation matrix at each step:
+inline __attribute__((always_inline)) void IntegrateLanes(
+    const IntegrationStep &step, const Lanes &lanes, const int lane
+) {
+    const int S = lanes.stride;
+    const double T = step.T;
+
+    // a. delta quaternion, cos(|theta|/2) & sin(|theta|/2)/|theta| as series in |theta|^2, no sqrt or trigonometry:
+    double theta[3][LANE_WIDTH];
+    double theta_2[LANE_WIDTH];
+    double dq_cos[LANE_WIDTH];
+    double dq_sin[LANE_WIDTH];
+    for (int l = 0; l < LANE_WIDTH; ++l) {
+        for (int i = 0; i < 3; ++i) {
+            theta[i][l] = step.angular_delta[i] - T*lanes.gyro_bias[i*S + lane + l];
+        }
+        theta_2[l] = theta[0][l]*theta[0][l] + theta[1][l]*theta[1][l] + theta[2][l]*theta[2][l];
+
+        const double h_2 = 0.25*theta_2[l];
+        dq_cos[l] = 1.0 + h_2*(-1.0/2.0 + h_2*(1.0/24.0 + h_2*(-1.0/720.0 + h_2*(1.0/40320.0))));
+        dq_sin[l] = 0.5*(1.0 + h_2*(-1.0/6.0 + h_2*(1.0/120.0 + h_2*(-1.0/5040.0 + h_2*(1.0/362880.0)))));
+    }
+    for (int l = 0; l < LANE_WIDTH; ++l) {
+        if (theta_2[l] > MAX_SERIES_ANGULAR_DELTA*MAX_SERIES_ANGULAR_DELTA) {
+            const double theta_mag = std::sqrt(theta_2[l]);
+            dq_cos[l] = std::cos(0.5*theta_mag);
+            dq_sin[l] = std::sin(0.5*theta_mag) / theta_mag;
+        }
+    }
+
+    for (int l = 0; l < LANE_WIDTH; ++l) {
+        const int n = lane + l;
+
+        // b. orientation, q = q*dq:
+        const double dw = dq_cos[l];
+        const double dx = dq_sin[l]*theta[0][l];
+        const double dy = dq_sin[l]*theta[1][l];
+        const double dz = dq_sin[l]*theta[2][l];
+
+        const double qw = lanes.q[0*S + n], qx = lanes.q[1*S + n], qy = lanes.q[2*S + n], qz = lanes.q[3*S + n];
+        double w = qw*dw - qx*dx - qy*dy - qz*dz;
+        double x = qw*dx + qx*dw + qy*dz - qz*dy;
+        double y = qw*dy - qx*dz + qy*dw + qz*dx;
+        double z = qw*dz + qx*dy - qy*dx + qz*dw;
+
+        // q & dq are unit, one Newton step of 1/sqrt around 1 removes the rounding:
+        const double inv_norm = 0.5*(3.0 - (w*w + x*x + y*y + z*z));
+        w *= inv_norm; x *= inv_norm; y *= inv_norm; z *= inv_norm;
+
+        lanes.q[0*S + n] = w; lanes.q[1*S + n] = x; lanes.q[2*S + n] = y; lanes.q[3*S + n] = z;
+
+        const double R_curr[9] = {
+            1.0 - 2.0*(y*y + z*z),       2.0*(x*y - w*z),       2.0*(x*z + w*y),
+                  2.0*(x*y + w*z), 1.0 - 2.0*(x*x + z*z),       2.0*(y*z - w*x),
+                  2.0*(x*z - w*y),       2.0*(y*z + w*x), 1.0 - 2.0*(x*x + y*y)
+        };
+
+        // c. mid-value linear acc. in navigation frame:
+        double linear_acc_prev[3], linear_acc_curr[3];
+        for (int i = 0; i < 3; ++i) {
+            linear_acc_prev[i] = step.linear_acc_prev[i] - lanes.accl_bias[i*S + n];
+            linear_acc_curr[i] = step.linear_acc_curr[i] - lanes.accl_bias[i*S + n];
+        }
+
+        double linear_acc_mid[3];
+        for (int i = 0; i < 3; ++i) {
+            double acc_prev = 0.0, acc_curr = 0.0;
+            for (int j = 0; j < 3; ++j) {
+                acc_prev += lanes.C_nb[(3*i + j)*S + n]*linear_acc_prev[j];
+                acc_curr += R_curr[3*i + j]*linear_acc_curr[j];
+            }
+            linear_acc_mid[i] = 0.5*(acc_prev + acc_curr) - step.g[i];
+        }
+
+        // d. position & velocity:
+        for (int i = 0; i < 3; ++i) {
+            const double velocity_delta = T*linear_acc_mid[i];
+            lanes.pos[i*S + n] += T*lanes.vel[i*S + n] + 0.5*T*velocity_delta;
+            lanes.vel[i*S + n] += velocity_delta;
+        }
+
+        // e. pre-integration of process equation, F_vo = hat(f_n) & F_va = C_nb at the new orientation:
+        const double f_x = linear_acc_mid[0] + step.g[0];
+        const double f_y = linear_acc_mid[1] + step.g[1];
+        const double f_z = linear_acc_mid[2] + step.g[2];
+        lanes.F_vo[1*S + n] -= T*f_z; lanes.F_vo[2*S + n] += T*f_y;
+        lanes.F_vo[3*S + n] += T*f_z; lanes.F_vo[5*S + n] -= T*f_x;
+        lanes.F_vo[6*S + n] -= T*f_y; lanes.F_vo[7*S + n] += T*f_x;
+
+        for (int k = 0; k < 9; ++k) {
+            lanes.F_va[k*S + n] += T*R_curr[k];
+            lanes.C_nb[k*S + n] = R_curr[k];
+        }
+    }
+}
+
+// 3-by-3 product C += alpha*A*B of each lane:
+inline __attribute__((always_inline)) void MultiplyBlocks(
+    const double alpha,
+    const double (*A)[LANE_WIDTH], const double (*B)[LANE_WIDTH],
+    double (*C)[LANE_WIDTH]
+) {
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            for (int k = 0; k < 3; ++k) {
+                for (int l = 0; l < LANE_WIDTH; ++l) {
+                    C[3*i + j][l] += alpha*A[3*i + k][l]*B[3*k + j][l];
+                }
+            }
+        }
+    }
+}
+
+// Kalman prediction P = F*P*F^T + Q, as ErrorStateKalmanFilter::PredictErrorEstimation, for lanes [lane, lane + LANE_WIDTH).
+// F = I + D has no bias rows, so F*P only changes the first 9 rows, (F*P)*F^T the first 9 columns, and the bias-bias block is kept:
+inline __attribute__((always_inline)) void PredictLanes(
+    const PredictionStep &step, const Lanes &lanes, const int lane
+) {
+    const int S = lanes.stride;
+    const int DIM_NAV = INDEX_ERROR_GYRO;
+    const double T = step.T;
+
+    // a. non-zero blocks of D, 2nd order discretization as ErrorStateKalmanFilter::PredictErrorEstimation with F_og = -F_va.
+    // D_pv = T*I & D_oo are shared, D_po = 0.5*T*F_vo, D_pa = 0.5*T*F_va, D_va = F_va are scaled on the fly:
+    double F_vo[9][LANE_WIDTH], F_va[9][LANE_WIDTH], F_oo[9][LANE_WIDTH];
+    // D_vo = F_vo + 0.5*F_vo*F_oo, D_vg = -0.5*F_vo*F_va, D_og = -F_va - 0.5*F_oo*F_va:
+    double D_vo[9][LANE_WIDTH], D_vg[9][LANE_WIDTH], D_og[9][LANE_WIDTH];
+    for (int k = 0; k < 9; ++k) {
+        for (int l = 0; l < LANE_WIDTH; ++l) {
+            F_vo[k][l] = lanes.F_vo[k*S + lane + l];
+            F_va[k][l] = lanes.F_va[k*S + lane + l];
+            F_oo[k][l] = step.F_oo[k];
+
+            D_vo[k][l] = F_vo[k][l];
+            D_vg[k][l] = 0.0;
+            D_og[k][l] = -F_va[k][l];
+        }
+    }
+    MultiplyBlocks( 0.5, F_vo, F_oo, D_vo);
+    MultiplyBlocks(-0.5, F_vo, F_va, D_vg);
+    MultiplyBlocks(-0.5, F_oo, F_va, D_og);
+
+    // b. F*P, rows of pos., vel. & ori., one column of P at a time:
+    double FP[DIM_NAV][DIM_STATE][LANE_WIDTH];
+    for (int j = 0; j < DIM_STATE; ++j) {
+        double P_col[DIM_STATE][LANE_WIDTH];
+        for (int i = 0; i < DIM_STATE; ++i) {
+            for (int l = 0; l < LANE_WIDTH; ++l) {
+                P_col[i][l] = lanes.P[(i*DIM_STATE + j)*S + lane + l];
+            }
+        }
+
+        for (int i = 0; i < 3; ++i) {
+            for (int l = 0; l < LANE_WIDTH; ++l) {
+                double FP_p = 0.0, FP_v = 0.0, FP_o = 0.0;
+                for (int k = 0; k < 3; ++k) {
+                    FP_p += F_vo[3*i + k][l]*P_col[INDEX_ERROR_ORI + k][l] + F_va[3*i + k][l]*P_col[INDEX_ERROR_ACCEL + k][l];
+                    FP_v += (
+                        D_vo[3*i + k][l]*P_col[INDEX_ERROR_ORI + k][l] + 
+                        D_vg[3*i + k][l]*P_col[INDEX_ERROR_GYRO + k][l] + 
+                        F_va[3*i + k][l]*P_col[INDEX_ERROR_ACCEL + k][l]
+                    );
+                    FP_o += step.D_oo[3*i + k]*P_col[INDEX_ERROR_ORI + k][l] + D_og[3*i + k][l]*P_col[INDEX_ERROR_GYRO + k][l];
+                }
+                FP[INDEX_ERROR_POS + i][j][l] = P_col[INDEX_ERROR_POS + i][l] + T*P_col[INDEX_ERROR_VEL + i][l] + 0.5*T*FP_p;
+                FP[INDEX_ERROR_VEL + i][j][l] = P_col[INDEX_ERROR_VEL + i][l] + FP_v;
+                FP[INDEX_ERROR_ORI + i][j][l] = P_col[INDEX_ERROR_ORI + i][l] + FP_o;
+            }
+        }
+    }
+
+    // c. (F*P)*F^T, only the upper triangle of the first 9 columns, plus the accumulated process noise:
+    for (int i = 0; i < DIM_NAV; ++i) {
+        for (int a = 0; a < 3; ++a) {
+            for (int l = 0; l < LANE_WIDTH; ++l) {
+                double FPFt_p = 0.0, FPFt_v = 0.0, FPFt_o = 0.0;
+                for (int k = 0; k < 3; ++k) {
+                    FPFt_p += FP[i][INDEX_ERROR_ORI + k][l]*F_vo[3*a + k][l] + FP[i][INDEX_ERROR_ACCEL + k][l]*F_va[3*a + k][l];
+                    FPFt_v += (
+                        FP[i][INDEX_ERROR_ORI + k][l]*D_vo[3*a + k][l] + 
+                        FP[i][INDEX_ERROR_GYRO + k][l]*D_vg[3*a + k][l] + 
+                        FP[i][INDEX_ERROR_ACCEL + k][l]*F_va[3*a + k][l]
+                    );
+                    FPFt_o += FP[i][INDEX_ERROR_ORI + k][l]*step.D_oo[3*a + k] + FP[i][INDEX_ERROR_GYRO + k][l]*D_og[3*a + k][l];
+                }
+
+                const int j_p = INDEX_ERROR_POS + a, j_v = INDEX_ERROR_VEL + a, j_o = INDEX_ERROR_ORI + a;
+                if (i <= j_p) {
+                    const double FPFt = FP[i][j_p][l] + T*FP[i][INDEX_ERROR_VEL + a][l] + 0.5*T*FPFt_p;
+                    lanes.P[(i*DIM_STATE + j_p)*S + lane + l] = lanes.P[(j_p*DIM_STATE + i)*S + lane + l] = FPFt;
+                }
+                if (i <= j_v) {
+                    const double FPFt = FP[i][j_v][l] + FPFt_v + (i == j_v ? step.Q_vv : 0.0);
+                    lanes.P[(i*DIM_STATE + j_v)*S + lane + l] = lanes.P[(j_v*DIM_STATE + i)*S + lane + l] = FPFt;
+                }
+                if (i <= j_o) {
+                    const double FPFt = FP[i][j_o][l] + FPFt_o + (i == j_o ? step.Q_oo : 0.0);
+                    lanes.P[(i*DIM_STATE + j_o)*S + lane + l] = lanes.P[(j_o*DIM_STATE + i)*S + lane + l] = FPFt;
+                }
+            }
+        }
+    }
+
+    // d. the bias columns are those of F*P:
+    for (int i = 0; i < DIM_NAV; ++i) {
+        for (int j = DIM_NAV; j < DIM_STATE; ++j) {
+            for (int l = 0; l < LANE_WIDTH; ++l) {
+                lanes.P[(i*DIM_STATE + j)*S + lane + l] = lanes.P[(j*DIM_STATE + i)*S + lane + l] = FP[i][j][l];
+            }
+        }
+    }
+}
+
+void IntegrateScalar(const IntegrationStep &step, const Lanes &lanes, const int num_lanes) {
+    for (int lane = 0; lane < num_lanes; lane += LANE_WIDTH) {
+        IntegrateLanes(step, lanes, lane);
+    }
+}
+
+void PredictScalar(const PredictionStep &step, const Lanes &lanes, const int num_lanes) {
+    for (int lane = 0; lane < num_lanes; lane += LANE_WIDTH) {
+        PredictLanes(step, lanes, lane);
+    }
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define FILTER_BANK_HAS_AVX2_KERNEL
+// the same kernels, LANE_WIDTH lanes per AVX2 register:
+__attribute__((target("avx2,fma")))
+void IntegrateAVX2(const IntegrationStep &step, const Lanes &lanes, const int num_lanes) {
+    for (int lane = 0; lane < num_lanes; lane += LANE_WIDTH) {
+        IntegrateLanes(step, lanes, lane);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+void PredictAVX2(const PredictionStep &step, const Lanes &lanes, const int num_lanes) {
+    for (int lane = 0; lane < num_lanes; lane += LANE_WIDTH) {
+        PredictLanes(step, lanes, lane);
+    }
+}
+#endif
+
+// mid-value integration of all lanes, uses AVX2 when enabled, see SIMDDispatch. the scalar kernels
+// are vectorized by the compiler, so on aarch64 they already run on NEON:
+void Integrate(const IntegrationStep &step, const Lanes &lanes, const int num_lanes) {
+#ifdef FILTER_BANK_HAS_AVX2_KERNEL
+    if (SIMDDispatch::IsEnabled(SIMDLevel::AVX2)) {
+        IntegrateAVX2(step, lanes, num_lanes);
+        return;
+    }
+#endif
+    IntegrateScalar(step, lanes, num_lanes);
+}
+
+// Kalman prediction of all lanes, uses AVX2 when enabled:
+void Predict(const PredictionStep &step, const Lanes &lanes, const int num_lanes) {
+#ifdef FILTER_BANK_HAS_AVX2_KERNEL
+    if (SIMDDispatch::IsEnabled(SIMDLevel::AVX2)) {
+        PredictAVX2(step, lanes, num_lanes);
+        return;
+    }
+#endif
+    PredictScalar(step, lanes, num_lanes);
+}
+} // namespace
+
+ErrorStateKalmanFilterBank::ErrorStateKalmanFilterBank(const YAML::Node& node) {
+    // a. earth constants:
+    const double gravity_magnitude = node["earth"]["gravity_magnitude"].as<double>();
+    const double rotation_speed = node["earth"]["rotation_speed"].as<double>();
+    const double latitude = node["earth"]["latitude"].as<double>() * M_PI / 180.0;
+    g_ = Eigen::Vector3d(0.0, 0.0, gravity_magnitude);
+    w_ = Eigen::Vector3d(0.0, rotation_speed*cos(latitude), rotation_speed*sin(latitude));
+    // b. prior state covariance:
+    COV.PRIOR.POS = node["covariance"]["prior"]["pos"].as<double>();
+    COV.PRIOR.VEL = node["covariance"]["prior"]["vel"].as<double>();
+    COV.PRIOR.ORIENTATION = node["covariance"]["prior"]["orientation"].as<double>();
+    COV.PRIOR.EPSILON = node["covariance"]["prior"]["epsilon"].as<double>();
+    COV.PRIOR.DELTA = node["covariance"]["prior"]["delta"].as<double>();
+    // c. process noise:
+    COV.PROCESS.GYRO = node["covariance"]["process"]["gyro"].as<double>();
+    COV.PROCESS.ACCEL = node["covariance"]["process"]["accel"].as<double>();
+    // d. measurement noise:
+    COV.MEASUREMENT.POS = node["covariance"]["measurement"]["pos"].as<double>();
+    COV.MEASUREMENT.ORIENTATION = node["covariance"]["measurement"]["orientation"].as<double>();
+    // e. prediction interval:
+    prediction_interval_ = std::max(node["prediction_interval"].as<int>(), 1);
+}
+
+void ErrorStateKalmanFilterBank::Init(
+    const int num_hypotheses,
+    const Eigen::Vector3d &vel,
+    const IMUData &imu_data
+) {
+    num_lanes_ = std::max(num_hypotheses, 0);
+    num_padded_lanes_ = (num_lanes_ + LANE_WIDTH - 1) / LANE_WIDTH * LANE_WIDTH;
+
+    lane_.resize(num_lanes_);
+    hypothesis_.assign(num_padded_lanes_, -1);
+    for (int i = 0; i < num_lanes_; ++i) {
+        lane_.at(i) = hypothesis_.at(i) = i;
+    }
+
+    // a. init C_nb using IMU estimation, as ErrorStateKalmanFilter::Init:
+    const Eigen::Matrix3d C_nb = imu_data.GetOrientationMatrix().cast<double>();
+    const Eigen::Quaterniond q = Eigen::Quaterniond(C_nb).normalized();
+    const Eigen::Matrix3d R = q.toRotationMatrix();
+
+    init_pose_ = Eigen::Matrix4d::Identity();
+    init_pose_.block<3, 3>(0, 0) = R;
+
+    q_ = Eigen::Array4d(q.w(), q.x(), q.y(), q.z()).replicate(1, num_padded_lanes_);
+    C_nb_.resize(9, num_padded_lanes_);
+    for (int k = 0; k < 9; ++k) {
+        C_nb_.row(k).setConstant(R(k / 3, k % 3));
+    }
+    pos_ = LaneArray::Zero(3, num_padded_lanes_);
+    // b. convert flu velocity into navigation frame:
+    vel_ = (R*vel).array().replicate(1, num_padded_lanes_);
+    gyro_bias_ = LaneArray::Zero(3, num_padded_lanes_);
+    accl_bias_ = LaneArray::Zero(3, num_padded_lanes_);
+
+    // c. prior covariance:
+    ErrorStateKalmanFilter::MatrixP P = ErrorStateKalmanFilter::MatrixP::Zero();
+    P.block<3, 3>(  INDEX_ERROR_POS,   INDEX_ERROR_POS) = COV.PRIOR.POS*Eigen::Matrix3d::Identity();
+    P.block<3, 3>(  INDEX_ERROR_VEL,   INDEX_ERROR_VEL) = COV.PRIOR.VEL*Eigen::Matrix3d::Identity();
+    P.block<3, 3>(  INDEX_ERROR_ORI,   INDEX_ERROR_ORI) = COV.PRIOR.ORIENTATION*Eigen::Matrix3d::Identity();
+    P.block<3, 3>( INDEX_ERROR_GYRO,  INDEX_ERROR_GYRO) = COV.PRIOR.EPSILON*Eigen::Matrix3d::Identity();
+    P.block<3, 3>(INDEX_ERROR_ACCEL, INDEX_ERROR_ACCEL) = COV.PRIOR.DELTA*Eigen::Matrix3d::Identity();
+    // P is symmetric, so its column-major storage is also the row-major one:
+    P_ = Eigen::Map<const Eigen::ArrayXd>(P.data(), DIM_STATE*DIM_STATE).replicate(1, num_padded_lanes_);
+
+    F_vo_ = LaneArray::Zero(9, num_padded_lanes_);
+    F_va_ = LaneArray::Zero(9, num_padded_lanes_);
+    log_likelihood_ = LaneArray::Zero(1, num_padded_lanes_);
+
+    // init IMU data buffer:
+    imu_data_buff_.clear();
+    imu_data_buff_.push_back(imu_data);
+    pre_integration_ = PreIntegration();
+
+    // init filter time:
+    time_ = imu_data.time;
+
+    LOG(INFO) << std::endl
+              << "Kalman Filter Bank Inited at " << static_cast<int>(time_)
+              << " with " << num_lanes_ << " hypotheses" << std::endl;
+}
+
+bool ErrorStateKalmanFilterBank::Update(const IMUData &imu_data) {
+    TRACE_SCOPE("ErrorStateKalmanFilterBank::Update", "filter");
+    if (0 == num_lanes_ || time_ >= imu_data.time) {
+        return false;
+    }
+
+    imu_data_buff_.push_back(imu_data);
+    const IMUData &imu_data_prev = imu_data_buff_.at(0);
+    const IMUData &imu_data_curr = imu_data_buff_.at(1);
+
+    // a. IMU odometry of all lanes:
+    IntegrationStep step;
+    step.T = imu_data_curr.time - imu_data_prev.time;
+    Eigen::Map<Eigen::Vector3d>(step.angular_delta) = GetAngularDelta(imu_data_prev, imu_data_curr);
+    step.linear_acc_prev[0] = imu_data_prev.linear_acceleration.x;
+    step.linear_acc_prev[1] = imu_data_prev.linear_acceleration.y;
+    step.linear_acc_prev[2] = imu_data_prev.linear_acceleration.z;
+    step.linear_acc_curr[0] = imu_data_curr.linear_acceleration.x;
+    step.linear_acc_curr[1] = imu_data_curr.linear_acceleration.y;
+    step.linear_acc_curr[2] = imu_data_curr.linear_acceleration.z;
+    if (imu_data_curr.has_increment) {
+        // the mean rates of an increment, with its velocity change moved from the orientation at the start
+        // to the mid orientation the lanes resolve it in, exact to first order in the rotation:
+        const Eigen::Vector3d angular_delta = step.T*Eigen::Vector3d(
+            imu_data_curr.angular_velocity.x, imu_data_curr.angular_velocity.y, imu_data_curr.angular_velocity.z
+        );
+        const Eigen::Vector3d linear_acc(
+            imu_data_curr.linear_acceleration.x, imu_data_curr.linear_acceleration.y, imu_data_curr.linear_acceleration.z
+        );
+        Eigen::Map<Eigen::Vector3d>(step.angular_delta) = angular_delta - step.T*imu_data_curr.GetOrientationMatrix().cast<double>().transpose()*w_;
+        Eigen::Map<Eigen::Vector3d>(step.linear_acc_prev) = Eigen::Map<Eigen::Vector3d>(step.linear_acc_curr) = (
+            linear_acc - 0.5*angular_delta.cross(linear_acc)
+        );
+    }
+    Eigen::Map<Eigen::Vector3d>(step.g) = g_;
+
+    const Lanes lanes = {
+        num_padded_lanes_,
+        q_.data(), C_nb_.data(), pos_.data(), vel_.data(), gyro_bias_.data(), accl_bias_.data(),
+        P_.data(), F_vo_.data(), F_va_.data()
+    };
+    Integrate(step, lanes, num_padded_lanes_);
+
+    // b. pre-integrated process noise, B*Q*B^T = T^2*Q as C_nb is orthonormal:
+    ++pre_integration_.num_measurements;
+    pre_integration_.T += step.T;
+    pre_integration_.Q_vv += step.T*step.T*COV.PROCESS.ACCEL;
+    pre_integration_.Q_oo += step.T*step.T*COV.PROCESS.GYRO;
+    if (pre_integration_.num_measurements >= prediction_interval_) {
+        PredictErrorEstimation();
+    }
+
+    // move forward:
+    imu_data_buff_.pop_front();
+    time_ = imu_data.time;
+
+    return true;
+}
+
+bool ErrorStateKalmanFilterBank::Correct(
+    const int hypothesis,
+    const IMUData &imu_data,
+    const Measurement &measurement
+) {
+    TRACE_SCOPE("ErrorStateKalmanFilterBank::Correct", "filter");
+    if (!IsActive(hypothesis)) {
+        return false;
+    }
+
+    // get time delta:
+    double time_delta = measurement.time - time_;
+
+    if ( time_delta > -0.05 ) {
+        // perform Kalman prediction, of all hypotheses, once per measurement time:
+        if ( time_ < measurement.time ) {
+            Update(imu_data);
+        }
+        if ( pre_integration_.num_measurements > 0 ) {
+            PredictErrorEstimation();
+        }
+
+        return CorrectLane(lane_.at(hypothesis), measurement);
+    }
+
+    LOG(INFO) << "Kalman Filter Bank Correct: Observation is not synced with filter. Skip, "
+              << (int)measurement.time << " <-- " << (int)time_ << " @ " << time_delta
+              << std::endl;
+
+    return false;
+}
+
+void ErrorStateKalmanFilterBank::Reject(const int hypothesis) {
+    if (!IsActive(hypothesis)) {
+        return;
+    }
+
+    lane_.at(hypothesis) = -1;
+    CompactLanes();
+}
+
+int ErrorStateKalmanFilterBank::Prune(const double threshold) {
+    const int best_hypothesis = GetBestHypothesis();
+    if (best_hypothesis < 0) {
+        return 0;
+    }
+
+    const double min_log_likelihood = GetLogLikelihood(best_hypothesis) - threshold;
+    for (int lane = 0; lane < num_lanes_; ++lane) {
+        if (log_likelihood_(0, lane) < min_log_likelihood) {
+            lane_.at(hypothesis_.at(lane)) = -1;
+        }
+    }
+    CompactLanes();
+
+    return num_lanes_;
+}
+
+bool ErrorStateKalmanFilterBank::IsActive(const int hypothesis) const {
+    return (
+        hypothesis >= 0 && hypothesis < static_cast<int>(lane_.size()) &&
+        lane_.at(hypothesis) >= 0
+    );
+}
+
+int ErrorStateKalmanFilterBank::GetBestHypothesis(void) const {
+    if (0 == num_lanes_) {
+        return -1;
+    }
+
+    int best_lane = 0;
+    for (int lane = 1; lane < num_lanes_; ++lane) {
+        if (log_likelihood_(0, lane) > log_likelihood_(0, best_lane)) {
+            best_lane = lane;
+        }
+    }
+
+    return hypothesis_.at(best_lane);
+}
+
+double ErrorStateKalmanFilterBank::GetLogLikelihood(const int hypothesis) const {
+    if (!IsActive(hypothesis)) {
+        return -std::numeric_limits<double>::infinity();
+    }
+
+    return log_likelihood_(0, lane_.at(hypothesis));
+}
+
+bool ErrorStateKalmanFilterBank::GetState(const int hypothesis, State &state) const {
+    if (!IsActive(hypothesis)) {
+        return false;
+    }
+    const int lane = lane_.at(hypothesis);
+
+    state.time = time_;
+
+    state.init_pose = init_pose_;
+    state.pose = Eigen::Matrix4d::Identity();
+    for (int k = 0; k < 9; ++k) {
+        state.pose(k / 3, k % 3) = C_nb_(k, lane);
+    }
+    state.pose.block<3, 1>(0, 3) = pos_.col(lane).matrix();
+    state.vel = vel_.col(lane).matrix();
+    state.gyro_bias = gyro_bias_.col(lane).matrix();
+    state.accl_bias = accl_bias_.col(lane).matrix();
+
+    state.X = ErrorStateKalmanFilter::VectorX::Zero();
+    Eigen::Map<Eigen::ArrayXd>(state.P.data(), DIM_STATE*DIM_STATE) = P_.col(lane);
+
+    return true;
+}
+
+bool ErrorStateKalmanFilterBank::GetOdometry(
+    const int hypothesis, Eigen::Matrix4f &pose, Eigen::Vector3f &vel
+) const {
+    State state;
+    if (!GetState(hypothesis, state)) {
+        return false;
+    }
+
+    // the error state is zero between corrections:
+    pose = (init_pose_.inverse() * state.pose).cast<float>();
+    vel = (init_pose_.block<3, 3>(0, 0).transpose() * state.vel).cast<float>();
+
+    return true;
+}
+
+Eigen::Vector3d ErrorStateKalmanFilterBank::GetAngularDelta(
+    const IMUData &imu_data_prev, const IMUData &imu_data_curr
+) const {
+    const double T = imu_data_curr.time - imu_data_prev.time;
+
+    // earth rotation compensated with the orientation of each measurement, as ErrorStateKalmanFilter::GetUnbiasedAngularVel:
+    const Eigen::Vector3d angular_vel_prev = Eigen::Vector3d(
+        imu_data_prev.angular_velocity.x,
+        imu_data_prev.angular_velocity.y,
+        imu_data_prev.angular_velocity.z
+    ) - imu_data_prev.GetOrientationMatrix().cast<double>().transpose() * w_;
+    const Eigen::Vector3d angular_vel_curr = Eigen::Vector3d(
+        imu_data_curr.angular_velocity.x,
+        imu_data_curr.angular_velocity.y,
+        imu_data_curr.angular_velocity.z
+    ) - imu_data_curr.GetOrientationMatrix().cast<double>().transpose() * w_;
+
+    return 0.5*T*(angular_vel_prev + angular_vel_curr);
+}
+
+void ErrorStateKalmanFilterBank::PredictErrorEstimation(void) {
+    PredictionStep step;
+    step.T = pre_integration_.T;
+
+    const Eigen::Matrix3d F_oo = step.T*Sophus::SO3d::hat(-w_).matrix();
+    const Eigen::Matrix3d D_oo = F_oo + 0.5*F_oo*F_oo;
+    for (int k = 0; k < 9; ++k) {
+        step.F_oo[k] = F_oo(k / 3, k % 3);
+        step.D_oo[k] = D_oo(k / 3, k % 3);
+    }
+    step.Q_vv = pre_integration_.Q_vv;
+    step.Q_oo = pre_integration_.Q_oo;
+
+    const Lanes lanes = {
+        num_padded_lanes_,
+        q_.data(), C_nb_.data(), pos_.data(), vel_.data(), gyro_bias_.data(), accl_bias_.data(),
+        P_.data(), F_vo_.data(), F_va_.data()
+    };
+    Predict(step, lanes, num_padded_lanes_);
+
+    // start next pre-integration:
+    pre_integration_ = PreIntegration();
+    F_vo_.setZero();
+    F_va_.setZero();
+}
+
+bool ErrorStateKalmanFilterBank::CorrectLane(const int lane, const Measurement &measurement) {
+    typedef ErrorStateKalmanFilter::MatrixP MatrixP;
+    typedef ErrorStateKalmanFilter::VectorX VectorX;
+    typedef Eigen::Matrix<double, 6, 1> VectorY;
+    typedef Eigen::Matrix<double, 6, 6> MatrixS;
+
+    // a. state of lane:
+    Eigen::Quaterniond q(q_(0, lane), q_(1, lane), q_(2, lane), q_(3, lane));
+    Eigen::Matrix3d C_nb;
+    for (int k = 0; k < 9; ++k) {
+        C_nb(k / 3, k % 3) = C_nb_(k, lane);
+    }
+    Eigen::Vector3d pos = pos_.col(lane).matrix();
+    Eigen::Vector3d vel = vel_.col(lane).matrix();
+    MatrixP P;
+    Eigen::Map<Eigen::ArrayXd>(P.data(), DIM_STATE*DIM_STATE) = P_.col(lane);
+
+    // b. residual of pose measurement, as ErrorStateKalmanFilter::MeasurementModel<POSE>:
+    const Eigen::Matrix4d &T_nb = measurement.T_nb;
+    VectorY Y;
+    Y.block<3, 1>(0, 0) = pos - T_nb.block<3, 1>(0, 3);
+    Y.block<3, 1>(3, 0) = Sophus::SO3d::vee(
+        Eigen::Matrix3d::Identity() - C_nb * T_nb.block<3, 3>(0, 0).transpose()
+    );
+
+    // c. innovation covariance, the measurement equation selects position & orientation:
+    Eigen::Matrix<double, 6, DIM_STATE> GP;
+    GP.block<3, DIM_STATE>(0, 0) = P.block<3, DIM_STATE>(INDEX_ERROR_POS, 0);
+    GP.block<3, DIM_STATE>(3, 0) = P.block<3, DIM_STATE>(INDEX_ERROR_ORI, 0);
+
+    MatrixS S;
+    S.block<6, 3>(0, 0) = GP.block<6, 3>(0, INDEX_ERROR_POS);
+    S.block<6, 3>(0, 3) = GP.block<6, 3>(0, INDEX_ERROR_ORI);
+    S.diagonal().head<3>().array() += COV.MEASUREMENT.POS;
+    S.diagonal().tail<3>().array() += COV.MEASUREMENT.ORIENTATION;
+
+    Eigen::LLT<MatrixS> S_llt(S);
+    if (Eigen::Success != S_llt.info()) {
+        LOG(WARNING) << "Kalman filter bank correct: innovation covariance is not positive definite. Skip.";
+        return false;
+    }
+
+    // d. log likelihood of the innovation, -0.5*(Y^T*S^{-1}*Y + log(det(S))):
+    const double log_det_S = 2.0*S_llt.matrixLLT().diagonal().array().log().sum();
+    log_likelihood_(0, lane) += -0.5*(Y.dot(S_llt.solve(Y)) + log_det_S);
+
+    // e. Kalman correct, Joseph form as ErrorStateKalmanFilter::CorrectErrorEstimationJoseph, with zero prior error state:
+    const Eigen::Matrix<double, DIM_STATE, 6> K = S_llt.solve(GP).transpose();
+    const MatrixP KGP = K*GP;
+    P = P - KGP - KGP.transpose() + K*S*K.transpose();
+    P = 0.5*(P + P.transpose());
+
+    const VectorX X = K*Y;
+
+    // f. eliminate error, as ErrorStateKalmanFilter::EliminateError:
+    pos = pos - X.block<3, 1>(INDEX_ERROR_POS, 0);
+    vel = vel - X.block<3, 1>(INDEX_ERROR_VEL, 0);
+
+    Eigen::Vector3d vel_b = C_nb.transpose() * vel;
+    vel_b.y() = vel_b.z() = 0.0;
+    vel = C_nb * vel_b;
+
+    q = (Sophus::SO3d::exp(X.block<3, 1>(INDEX_ERROR_ORI, 0)).unit_quaternion() * q).normalized();
+    C_nb = q.toRotationMatrix();
+
+    if ( (P.diagonal().segment<3>(INDEX_ERROR_GYRO).array() <= BIAS_COV_STABLE_THRESH).all() ) {
+        gyro_bias_.col(lane) += X.block<3, 1>(INDEX_ERROR_GYRO, 0).array();
+    }
+    if ( (P.diagonal().segment<3>(INDEX_ERROR_ACCEL).array() <= BIAS_COV_STABLE_THRESH).all() ) {
+        accl_bias_.col(lane) += X.block<3, 1>(INDEX_ERROR_ACCEL, 0).array();
+    }
+
+    // g. write back, the error state is reset:
+    q_(0, lane) = q.w(); q_(1, lane) = q.x(); q_(2, lane) = q.y(); q_(3, lane) = q.z();
+    for (int k = 0; k < 9; ++k) {
+        C_nb_(k, lane) = C_nb(k / 3, k % 3);
+    }
+    pos_.col(lane) = pos.array();
+    vel_.col(lane) = vel.array();
+    P_.col(lane) = Eigen::Map<const Eigen::ArrayXd>(P.data(), DIM_STATE*DIM_STATE);
+
+    return true;
+}
+
+void ErrorStateKalmanFilterBank::CopyLane(const int from, const int to) {
+    q_.col(to) = q_.col(from);
+    C_nb_.col(to) = C_nb_.col(from);
+    pos_.col(to) = pos_.col(from);
+    vel_.col(to) = vel_.col(from);
+    gyro_bias_.col(to) = gyro_bias_.col(from);
+    accl_bias_.col(to) = accl_bias_.col(from);
+    P_.col(to) = P_.col(from);
+    F_vo_.col(to) = F_vo_.col(from);
+    F_va_.col(to) = F_va_.col(from);
+    log_likelihood_.col(to) = log_likelihood_.col(from);
+}
+
+void ErrorStateKalmanFilterBank::CompactLanes(void) {
+    int num_lanes = 0;
+    for (int lane = 0; lane < num_lanes_; ++lane) {
+        const int hypothesis = hypothesis_.at(lane);
+        if (lane_.at(hypothesis) < 0) {
+            continue;
+        }
+
+        if (num_lanes != lane) {
+            CopyLane(lane, num_lanes);
+        }
+        lane_.at(hypothesis) = num_lanes;
+        hypothesis_.at(num_lanes) = hypothesis;
+        ++num_lanes;
+    }
+
+    num_lanes_ = num_lanes;
+    num_padded_lanes_ = (num_lanes_ + LANE_WIDTH - 1) / LANE_WIDTH * LANE_WIDTH;
+
+    for (LaneArray *lane_array: {&q_, &C_nb_, &pos_, &vel_, &gyro_bias_, &accl_bias_, &P_, &F_vo_, &F_va_, &log_likelihood_}) {
+        lane_array->conservativeResize(Eigen::NoChange, num_padded_lanes_);
+    }
+
+    // padding lanes are valid states, so the kernels never see garbage:
+    hypothesis_.resize(num_padded_lanes_);
+    for (int lane = num_lanes_; lane < num_padded_lanes_; ++lane) {
+        CopyLane(0, lane);
+        hypothesis_.at(lane) = -1;
+    }
+}
+
+} // namespace lidar_localization
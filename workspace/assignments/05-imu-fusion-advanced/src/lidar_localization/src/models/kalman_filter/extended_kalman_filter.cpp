@@ -6,6 +6,7 @@
 #include <limits>
 
 #include <cmath>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <ostream>
@@ -17,6 +18,8 @@
 #include <Eigen/SVD>
 
 #include "lidar_localization/models/kalman_filter/extended_kalman_filter.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/metrics.hpp"
 
 #include "lidar_localization/global_defination/global_defination.h"
 
@@ -48,6 +51,9 @@ ExtendedKalmanFilter::ExtendedKalmanFilter(const YAML::Node& node) {
     COV.MEASUREMENT.POS = node["covariance"]["measurement"]["pos"].as<double>();
     COV.MEASUREMENT.VEL = node["covariance"]["measurement"]["vel"].as<double>();
     COV.MEASUREMENT.ORIENTATION = node["covariance"]["measurement"]["orientation"].as<double>();
+    // e. correct method, only SEQUENTIAL differs from the batch correct:
+    use_sequential_correct_ = node["correct_method"] && "SEQUENTIAL" == node["correct_method"].as<std::string>();
+    sequential_gate_ = node["sequential_gate"] ? std::max(node["sequential_gate"].as<double>(), 0.0) : 0.0;
 
     // prompt:
     LOG(INFO) << std::endl 
@@ -68,6 +74,9 @@ ExtendedKalmanFilter::ExtendedKalmanFilter(const YAML::Node& node) {
               << "\tmeasurement noise pos.: " << COV.MEASUREMENT.POS << std::endl
               << "\tmeasurement noise vel.: " << COV.MEASUREMENT.VEL << std::endl
               << "\tmeasurement noise orientation.: " << COV.MEASUREMENT.ORIENTATION << std::endl
+              << std::endl
+              << "\tsequential correct: " << (use_sequential_correct_ ? "true" : "false") << std::endl
+              << "\tsequential gate: " << sequential_gate_ << std::endl
               << std::endl;
     
     //
@@ -184,6 +193,7 @@ void ExtendedKalmanFilter::Init(
  * @return true if success false otherwise
  */
 bool ExtendedKalmanFilter::Update(const IMUData &imu_data) {
+    TRACE_SCOPE("ExtendedKalmanFilter::Update", "filter");
     // update IMU buff:
     if (time_ < imu_data.time) {
         // update buffer:
@@ -218,7 +228,8 @@ bool ExtendedKalmanFilter::Update(const IMUData &imu_data) {
 bool ExtendedKalmanFilter::Correct(
     const IMUData &imu_data, 
     const MeasurementType &measurement_type, const Measurement &measurement
-) { 
+) {
+    TRACE_SCOPE("ExtendedKalmanFilter::Correct", "filter");
     static Measurement measurement_;
 
     // get time delta:
@@ -246,6 +257,9 @@ bool ExtendedKalmanFilter::Correct(
         return true;
     }
 
+    static Counter& num_skipped = MetricsRegistry::GetInstance().GetCounter("ekf.skipped_measurements");
+    num_skipped.Increment();
+
     LOG(INFO) << "Kalman Correct: Observation is not synced with filter. Skip, " 
               << (int)measurement.time << " <-- " << (int)time_ << " @ " << time_delta
               << std::endl; 
@@ -333,156 +347,30 @@ inline Eigen::Vector3d ExtendedKalmanFilter::GetUnbiasedAngularVel(
 }
 
 /**
- * @brief  get unbiased linear acceleration in navigation frame
- * @param  linear_acc, linear acceleration measurement
- * @param  R, corresponding orientation of measurement
- * @return unbiased linear acceleration in navigation frame
- */
-inline Eigen::Vector3d ExtendedKalmanFilter::GetUnbiasedLinearAcc(
-    const Eigen::Vector3d &linear_acc,
-    const Eigen::Matrix3d &R
-) {
-    return R*(linear_acc - accl_bias_) - g_;
-}
-
-/**
- * @brief  get angular delta
- * @param  index_curr, current imu measurement buffer index
- * @param  index_prev, previous imu measurement buffer index
- * @param  angular_delta, angular delta output
- * @return true if success false otherwise
- */
-bool ExtendedKalmanFilter::GetAngularDelta(
-    const size_t index_curr, const size_t index_prev,
-    Eigen::Vector3d &angular_delta
-) {
-    if (
-        index_curr <= index_prev ||
-        imu_data_buff_.size() <= index_curr
-    ) {
-        return false;
-    }
-
-    const IMUData &imu_data_curr = imu_data_buff_.at(index_curr);
-    const IMUData &imu_data_prev = imu_data_buff_.at(index_prev);
-
-    double delta_t = imu_data_curr.time - imu_data_prev.time;
-
-    Eigen::Vector3d angular_vel_curr = Eigen::Vector3d(
-        imu_data_curr.angular_velocity.x,
-        imu_data_curr.angular_velocity.y,
-        imu_data_curr.angular_velocity.z
-    );
-    Eigen::Matrix3d R_curr = imu_data_curr.GetOrientationMatrix().cast<double>();
-    angular_vel_curr = GetUnbiasedAngularVel(angular_vel_curr, R_curr);
-
-    Eigen::Vector3d angular_vel_prev = Eigen::Vector3d(
-        imu_data_prev.angular_velocity.x,
-        imu_data_prev.angular_velocity.y,
-        imu_data_prev.angular_velocity.z
-    );
-    Eigen::Matrix3d R_prev = imu_data_prev.GetOrientationMatrix().cast<double>();
-    angular_vel_prev = GetUnbiasedAngularVel(angular_vel_prev, R_prev);
-
-    angular_delta = 0.5*delta_t*(angular_vel_curr + angular_vel_prev);
-
-    return true;
-}
-
-/**
- * @brief  update orientation with effective rotation angular_delta
- * @param  angular_delta, effective rotation
- * @param  R_curr, current orientation
- * @param  R_prev, previous orientation
- * @return void
- */
-void ExtendedKalmanFilter::UpdateOrientation(
-    const Eigen::Vector3d &angular_delta,
-    Eigen::Matrix3d &R_curr, Eigen::Matrix3d &R_prev
-) {
-    // magnitude:
-    double angular_delta_mag = angular_delta.norm();
-    // direction:
-    Eigen::Vector3d angular_delta_dir = angular_delta.normalized();
-
-    // build delta q:
-    double angular_delta_cos = cos(angular_delta_mag/2.0);
-    double angular_delta_sin = sin(angular_delta_mag/2.0);
-    Eigen::Quaterniond dq(
-        angular_delta_cos, 
-        angular_delta_sin*angular_delta_dir.x(), 
-        angular_delta_sin*angular_delta_dir.y(), 
-        angular_delta_sin*angular_delta_dir.z()
-    );
-    Eigen::Quaterniond q(pose_.block<3, 3>(0, 0));
-    
-    // update:
-    q = q*dq;
-    
-    // write back:
-    R_prev = pose_.block<3, 3>(0, 0);
-    pose_.block<3, 3>(0, 0) = q.normalized().toRotationMatrix();
-    R_curr = pose_.block<3, 3>(0, 0);
-}
-
-/**
- * @brief  get velocity delta
- * @param  index_curr, current imu measurement buffer index
- * @param  index_prev, previous imu measurement buffer index
- * @param  R_curr, corresponding orientation of current imu measurement
- * @param  R_prev, corresponding orientation of previous imu measurement
- * @param  velocity_delta, velocity delta output
- * @param  linear_acc_mid, mid-value unbiased linear acc
- * @return true if success false otherwise
+ * @brief  get unbiased IMU measurement for mechanization
+ * @param  imu_data, IMU measurement
+ * @return unbiased angular velocity & linear acceleration in body frame
  */
-bool ExtendedKalmanFilter::GetVelocityDelta(
-    const size_t index_curr, const size_t index_prev,
-    const Eigen::Matrix3d &R_curr, const Eigen::Matrix3d &R_prev, 
-    double &T, 
-    Eigen::Vector3d &velocity_delta, 
-    Eigen::Vector3d &linear_acc_mid
-) {
-    if (
-        index_curr <= index_prev ||
-        imu_data_buff_.size() <= index_curr
-    ) {
-        return false;
-    }
-
-    const IMUData &imu_data_curr = imu_data_buff_.at(index_curr);
-    const IMUData &imu_data_prev = imu_data_buff_.at(index_prev);
+imu_mechanization::IMUSample ExtendedKalmanFilter::GetUnbiasedIMUSample(const IMUData &imu_data) {
+    imu_mechanization::IMUSample sample;
 
-    T = imu_data_curr.time - imu_data_prev.time;
+    sample.time = imu_data.time;
 
-    Eigen::Vector3d linear_acc_curr = Eigen::Vector3d(
-        imu_data_curr.linear_acceleration.x,
-        imu_data_curr.linear_acceleration.y,
-        imu_data_curr.linear_acceleration.z
-    );
-    linear_acc_curr = GetUnbiasedLinearAcc(linear_acc_curr, R_curr);
-    Eigen::Vector3d linear_acc_prev = Eigen::Vector3d(
-        imu_data_prev.linear_acceleration.x,
-        imu_data_prev.linear_acceleration.y,
-        imu_data_prev.linear_acceleration.z
+    Eigen::Vector3d angular_vel = Eigen::Vector3d(
+        imu_data.angular_velocity.x,
+        imu_data.angular_velocity.y,
+        imu_data.angular_velocity.z
     );
-    linear_acc_prev = GetUnbiasedLinearAcc(linear_acc_prev, R_prev);
-    
-    // mid-value acc can improve error state prediction accuracy:
-    linear_acc_mid = 0.5*(linear_acc_curr + linear_acc_prev);
-    velocity_delta = T*linear_acc_mid;
+    Eigen::Matrix3d R = imu_data.GetOrientationMatrix().cast<double>();
+    sample.angular_vel = GetUnbiasedAngularVel(angular_vel, R);
 
-    return true;
-}
+    sample.linear_acc = Eigen::Vector3d(
+        imu_data.linear_acceleration.x,
+        imu_data.linear_acceleration.y,
+        imu_data.linear_acceleration.z
+    ) - accl_bias_;
 
-/**
- * @brief  update orientation with effective velocity change velocity_delta
- * @param  T, timestamp delta 
- * @param  velocity_delta, effective velocity change
- * @return void
- */
-void ExtendedKalmanFilter::UpdatePosition(const double &T, const Eigen::Vector3d &velocity_delta) {
-    pose_.block<3, 1>(0, 3) += T*vel_ + 0.5*T*velocity_delta;
-    vel_ += velocity_delta;
+    return sample;
 }
 
 /**
@@ -491,26 +379,29 @@ void ExtendedKalmanFilter::UpdatePosition(const double &T, const Eigen::Vector3d
  * @return void
  */
 void ExtendedKalmanFilter::UpdateOdomEstimation(Eigen::Vector3d &linear_acc_mid) {
-    // get deltas:
-    Eigen::Vector3d angular_delta; 
-    GetAngularDelta(1, 0, angular_delta);
+    // an increment already integrates the raw measurements since the last one, its mean rates are unbiased as usual.
+    // the filter may have been moved into the interval by a synced measurement, then only the rest is integrated:
+    if (imu_data_buff_.at(1).has_increment) {
+        const double T = imu_data_buff_.at(1).time - imu_data_buff_.at(0).time;
+        imu_mechanization::IMUSample sample = GetUnbiasedIMUSample(imu_data_buff_.at(1));
+
+        linear_acc_mid = imu_mechanization::IntegrateIncrement(
+            T, T*sample.angular_vel, T*sample.linear_acc,
+            g_,
+            pose_, vel_
+        );
+        return;
+    }
 
-    // update orientation:
-    Eigen::Matrix3d R_curr, R_prev;
-    UpdateOrientation(angular_delta, R_curr, R_prev);
+    imu_mechanization::IMUSample sample_prev = GetUnbiasedIMUSample(imu_data_buff_.at(0));
+    imu_mechanization::IMUSample sample_curr = GetUnbiasedIMUSample(imu_data_buff_.at(1));
 
-    // get velocity delta:
-    double T;
-    Eigen::Vector3d velocity_delta;
     // save mid-value unbiased linear acc for error-state update:
-    GetVelocityDelta(
-        1, 0, 
-        R_curr, R_prev, 
-        T, velocity_delta, linear_acc_mid
+    linear_acc_mid = imu_mechanization::IntegrateStep(
+        sample_prev, sample_curr, 
+        g_, 
+        pose_, vel_
     );
-
-    // update position:
-    UpdatePosition(T, velocity_delta);
 }
 
 /**
@@ -593,6 +484,43 @@ void ExtendedKalmanFilter::UpdateErrorEstimation(
     }
 }
 
+/**
+ * @brief  correct error estimation, one scalar update per component, for diagonal measurement noise
+ * @param  Y, measurement
+ * @param  G, measurement equation
+ * @param  R, measurement noise, only its diagonal is used
+ * @return void
+ */
+template<int DIM_MEASUREMENT>
+void ExtendedKalmanFilter::CorrectErrorEstimationSequential(
+    const Eigen::Matrix<double, DIM_MEASUREMENT,               1> &Y,
+    const Eigen::Matrix<double, DIM_MEASUREMENT,       DIM_STATE> &G,
+    const Eigen::Matrix<double, DIM_MEASUREMENT, DIM_MEASUREMENT> &R
+) {
+    for (int i = 0; i < DIM_MEASUREMENT; ++i) {
+        // innovation variance, the components corrected so far are included in P & X:
+        const VectorX PG = P_*G.row(i).transpose();
+        const double S = G.row(i).dot(PG) + R(i, i);
+        if (S <= 0.0) {
+            LOG(WARNING) << "Kalman correct: innovation variance of component " << i << " is not positive. Skip.";
+            continue;
+        }
+
+        const double innovation = Y(i) - G.row(i).dot(X_);
+        if (sequential_gate_ > 0.0 && innovation*innovation > sequential_gate_*S) {
+            LOG_EVERY_N(WARNING, 100) << "Kalman correct: component " << i << " of measurement gated out, normalized innovation " 
+                                      << innovation*innovation / S << ".";
+            continue;
+        }
+
+        // (I - K*G)*P for one component, with K = P*G^T / S:
+        const VectorX K = PG / S;
+        P_.noalias() -= K*PG.transpose();
+        X_ += K*innovation;
+    }
+    P_ = 0.5*(P_ + P_.transpose());
+}
+
 /**
  * @brief  correct error estimation using pose measurement
  * @param  T_nb, input pose measurement
@@ -608,6 +536,11 @@ void ExtendedKalmanFilter::CorrectErrorEstimationPose(
     YPose_.block<3, 1>(0, 0) = P_nn_obs;
     YPose_.block<3, 1>(3, 0) = Sophus::SO3d::vee(Eigen::Matrix3d::Identity() - C_nn_obs);
 
+    if (use_sequential_correct_) {
+        CorrectErrorEstimationSequential(YPose_, GPose_, RPose_);
+        return;
+    }
+
     // build Kalman gain:
     MatrixRPose R = GPose_*P_*GPose_.transpose() + RPose_;
     MatrixKPose K = P_*GPose_.transpose()*R.inverse();
@@ -630,6 +563,11 @@ void ExtendedKalmanFilter::CorrectErrorEstimationPosition(
 
     YPosition_.block<3, 1>(0, 0) = P_nn_obs;
 
+    if (use_sequential_correct_) {
+        CorrectErrorEstimationSequential(YPosition_, GPosition_, RPosition_);
+        return;
+    }
+
     // build Kalman gain:
     MatrixRPosition R = GPosition_*P_*GPosition_.transpose() + RPosition_;
     MatrixKPosition K = P_*GPosition_.transpose()*R.inverse();
@@ -663,6 +601,11 @@ void ExtendedKalmanFilter::CorrectErrorEstimationPosVel(
     GPosVel_.block<3, 3>(3, INDEX_ERROR_VEL) =  pose_.block<3, 3>(0,0).transpose();
     GPosVel_.block<3, 3>(3, INDEX_ERROR_ORI) = -pose_.block<3, 3>(0,0).transpose()*Sophus::SO3d::hat(vel_);
 
+    if (use_sequential_correct_) {
+        CorrectErrorEstimationSequential(YPosVel_, GPosVel_, RPosVel_);
+        return;
+    }
+
     // build Kalman gain:
     MatrixRPosVel R = GPosVel_*P_*GPosVel_.transpose() + RPosVel_;
     MatrixKPosVel K = P_*GPosVel_.transpose()*R.inverse();
@@ -0,0 +1,132 @@
+/*
+ * @Description: incremental x-y grid hash over key frame positions, for proximity queries in loop closing
+ * @Author: Ge Yao
+ * @Date: 2020-12-29 16:08:37
+ */
+#include "lidar_localization/models/key_frame_index/key_frame_grid_index.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace lidar_localization {
+
+KeyFrameGridIndex::KeyFrameGridIndex(float cell_size) 
+    : cell_size_(cell_size), inverse_cell_size_(1.0f / cell_size) {
+}
+
+void KeyFrameGridIndex::Add(int id, const Eigen::Vector3f &position) {
+    const Eigen::Vector2i index = GetCellIndex(position);
+
+    if (size_ == 0) {
+        min_index_ = max_index_ = index;
+    } else {
+        min_index_ = min_index_.cwiseMin(index);
+        max_index_ = max_index_.cwiseMax(index);
+    }
+
+    cells_[GetCellKey(index)].push_back(Entry{id, position});
+    ++size_;
+}
+
+int KeyFrameGridIndex::GetNearest(const Eigen::Vector3f &position, int min_id, int max_id, float &distance) const {
+    int best_id = NONE;
+    float best_sq_distance = std::numeric_limits<float>::max();
+
+    const Eigen::Vector2i center = GetCellIndex(position);
+    // ring beyond which no cell is left:
+    const int max_ring = std::max(
+        (center - min_index_).cwiseAbs().maxCoeff(), 
+        (max_index_ - center).cwiseAbs().maxCoeff()
+    );
+
+    for (int r = 0; size_ > 0 && r <= max_ring; ++r) {
+        // cells of ring r are at least (r - 1) cells away:
+        if (best_id != NONE) {
+            const float min_distance = (r - 1) * cell_size_;
+            if (min_distance * min_distance > best_sq_distance)
+                break;
+        }
+
+        for (int dx = -r; dx <= r; ++dx) {
+            // only the ring border, top & bottom rows in full:
+            const int step = (std::abs(dx) == r) ? 1 : std::max(2 * r, 1);
+            for (int dy = -r; dy <= r; dy += step) {
+                auto cell = cells_.find(GetCellKey(center + Eigen::Vector2i(dx, dy)));
+                if (cell == cells_.end())
+                    continue;
+
+                SearchCell(cell->second, position, min_id, max_id, best_id, best_sq_distance);
+            }
+        }
+    }
+
+    distance = (best_id == NONE) ? std::numeric_limits<float>::max() : std::sqrt(best_sq_distance);
+
+    return best_id;
+}
+
+void KeyFrameGridIndex::GetInRadius(
+    const Eigen::Vector3f &position, float radius, int min_id, int max_id, 
+    std::vector<int> &ids
+) const {
+    ids.clear();
+
+    const Eigen::Vector2i center = GetCellIndex(position);
+    const int num_rings = static_cast<int>(std::ceil(radius * inverse_cell_size_));
+    const float sq_radius = radius * radius;
+
+    for (int dx = -num_rings; dx <= num_rings; ++dx) {
+        for (int dy = -num_rings; dy <= num_rings; ++dy) {
+            auto cell = cells_.find(GetCellKey(center + Eigen::Vector2i(dx, dy)));
+            if (cell == cells_.end())
+                continue;
+
+            for (const Entry &entry: cell->second) {
+                if (entry.id > max_id)
+                    break;
+                if (entry.id < min_id)
+                    continue;
+
+                if ((entry.position - position).squaredNorm() <= sq_radius) {
+                    ids.push_back(entry.id);
+                }
+            }
+        }
+    }
+
+    std::sort(ids.begin(), ids.end());
+}
+
+Eigen::Vector2i KeyFrameGridIndex::GetCellIndex(const Eigen::Vector3f &position) const {
+    return Eigen::Vector2i(
+        static_cast<int>(std::floor(position.x() * inverse_cell_size_)),
+        static_cast<int>(std::floor(position.y() * inverse_cell_size_))
+    );
+}
+
+int64_t KeyFrameGridIndex::GetCellKey(const Eigen::Vector2i &index) {
+    return static_cast<int64_t>(
+        (static_cast<uint64_t>(static_cast<uint32_t>(index.x())) << 32) | static_cast<uint32_t>(index.y())
+    );
+}
+
+void KeyFrameGridIndex::SearchCell(
+    const Cell &cell, const Eigen::Vector3f &position, int min_id, int max_id, 
+    int &best_id, float &best_sq_distance
+) {
+    for (const Entry &entry: cell) {
+        if (entry.id > max_id)
+            break;
+        if (entry.id < min_id)
+            continue;
+
+        const float sq_distance = (entry.position - position).squaredNorm();
+        if (sq_distance < best_sq_distance) {
+            best_sq_distance = sq_distance;
+            best_id = entry.id;
+        }
+    }
+}
+
+} // namespace lidar_localization
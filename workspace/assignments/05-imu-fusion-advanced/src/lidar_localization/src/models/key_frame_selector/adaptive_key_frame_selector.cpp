@@ -0,0 +1,135 @@
+/*
+ * @Description: key frame selection by overlap, rotation & time to the last key frame
+ * @Author: Ge Yao
+ * @Date: 2020-12-24 16:12:41
+ */
+#include "lidar_localization/models/key_frame_selector/adaptive_key_frame_selector.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+#include "lidar_localization/tools/tracer.hpp"
+
+namespace lidar_localization {
+
+AdaptiveKeyFrameSelector::AdaptiveKeyFrameSelector(const YAML::Node& node, const std::string& metrics_group)
+    : num_scans_(MetricsRegistry::GetInstance().GetCounter(metrics_group + ".num_scans")),
+      num_key_frames_(MetricsRegistry::GetInstance().GetCounter(metrics_group + ".num_key_frames")),
+      num_by_overlap_(MetricsRegistry::GetInstance().GetCounter(metrics_group + ".num_by_overlap")),
+      num_by_rotation_(MetricsRegistry::GetInstance().GetCounter(metrics_group + ".num_by_rotation")),
+      num_by_distance_(MetricsRegistry::GetInstance().GetCounter(metrics_group + ".num_by_distance")),
+      num_by_interval_(MetricsRegistry::GetInstance().GetCounter(metrics_group + ".num_by_interval")),
+      overlap_(MetricsRegistry::GetInstance().GetGauge(metrics_group + ".overlap")) {
+    min_distance_ = node["min_distance"].as<float>();
+    max_distance_ = node["max_distance"].as<float>();
+    max_rotation_ = node["max_rotation"].as<float>() * M_PI / 180.0;
+    max_interval_ = node["max_interval"].as<double>();
+    min_overlap_ = node["min_overlap"].as<float>();
+    inverse_leaf_size_ = 1.0f / node["overlap_leaf_size"].as<float>();
+
+    std::cout << "Adaptive Key Frame Selector params:" << std::endl
+              << "min_distance: " << min_distance_ << ", "
+              << "max_distance: " << max_distance_ << ", "
+              << "max_rotation: " << node["max_rotation"].as<float>() << ", "
+              << "max_interval: " << max_interval_ << ", "
+              << "min_overlap: " << min_overlap_ << ", "
+              << "overlap_leaf_size: " << 1.0f / inverse_leaf_size_
+              << std::endl << std::endl;
+}
+
+void AdaptiveKeyFrameSelector::GetVoxelKeys(
+    const Eigen::Matrix4f& pose, const CloudData::CLOUD_PTR& cloud_ptr, 
+    std::unordered_set<int64_t>& voxel_keys
+) const {
+    // 21 bits per axis, same as VoxelHashMap:
+    static const int64_t OFFSET = (1 << 20);
+    static const int64_t MASK = (1 << 21) - 1;
+
+    const Eigen::Matrix3f R = inverse_leaf_size_ * pose.block<3, 3>(0, 0);
+    const Eigen::Vector3f t = inverse_leaf_size_ * pose.block<3, 1>(0, 3);
+
+    voxel_keys.clear();
+    voxel_keys.reserve(cloud_ptr->points.size());
+    for (const auto &point: cloud_ptr->points) {
+        if (!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z)) {
+            continue;
+        }
+
+        const Eigen::Vector3f p = R * point.getVector3fMap() + t;
+        const int64_t ix = static_cast<int64_t>(std::floor(p.x()));
+        const int64_t iy = static_cast<int64_t>(std::floor(p.y()));
+        const int64_t iz = static_cast<int64_t>(std::floor(p.z()));
+
+        voxel_keys.insert(
+            (((ix + OFFSET) & MASK) << 42) |
+            (((iy + OFFSET) & MASK) << 21) |
+            ((iz + OFFSET) & MASK)
+        );
+    }
+}
+
+bool AdaptiveKeyFrameSelector::Select(double time, const Eigen::Matrix4f& pose, const CloudData::CLOUD_PTR& cloud_ptr) {
+    TRACE_SCOPE("AdaptiveKeyFrameSelector::Select", "key_frame");
+    num_scans_.Increment();
+
+    const bool use_overlap = (min_overlap_ > 0.0f && cloud_ptr);
+    if (use_overlap) {
+        GetVoxelKeys(pose, cloud_ptr, voxels_);
+    }
+
+    bool by_overlap = false;
+    bool by_rotation = false;
+    bool by_distance = false;
+    bool by_interval = false;
+    if (has_key_frame_) {
+        const Eigen::Matrix4f relative_pose = last_key_frame_pose_.inverse() * pose;
+        const float distance = relative_pose.block<3, 1>(0, 3).norm();
+        const float rotation = Eigen::AngleAxisf(
+            Eigen::Matrix3f(relative_pose.block<3, 3>(0, 0))
+        ).angle();
+
+        // the last key frame is kept without overlap if it had no cloud:
+        if (use_overlap && !last_key_frame_voxels_.empty() && !voxels_.empty()) {
+            size_t num_overlapped = 0;
+            for (const auto &key: voxels_) {
+                num_overlapped += last_key_frame_voxels_.count(key);
+            }
+            const float overlap = static_cast<float>(num_overlapped) / voxels_.size();
+            overlap_.Set(overlap);
+
+            by_overlap = (overlap < min_overlap_ && distance >= min_distance_);
+        }
+        by_rotation = (max_rotation_ > 0.0f && rotation > max_rotation_);
+        by_distance = (max_distance_ > 0.0f && distance > max_distance_);
+        by_interval = (max_interval_ > 0.0 && time - last_key_frame_time_ > max_interval_);
+
+        if (!by_overlap && !by_rotation && !by_distance && !by_interval) {
+            return false;
+        }
+    }
+
+    // the criteria are not exclusive, each key frame may count for several of them:
+    if (by_overlap)
+        num_by_overlap_.Increment();
+    if (by_rotation)
+        num_by_rotation_.Increment();
+    if (by_distance)
+        num_by_distance_.Increment();
+    if (by_interval)
+        num_by_interval_.Increment();
+    num_key_frames_.Increment();
+
+    has_key_frame_ = true;
+    last_key_frame_time_ = time;
+    last_key_frame_pose_ = pose;
+    if (use_overlap) {
+        last_key_frame_voxels_.swap(voxels_);
+    } else {
+        last_key_frame_voxels_.clear();
+    }
+
+    return true;
+}
+
+} // namespace lidar_localization
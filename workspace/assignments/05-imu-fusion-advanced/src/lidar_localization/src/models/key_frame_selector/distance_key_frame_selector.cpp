@@ -0,0 +1,48 @@
+/*
+ * @Description: key frame selection by distance to the last key frame
+ * @Author: Ge Yao
+ * @Date: 2020-12-24 16:12:41
+ */
+#include "lidar_localization/models/key_frame_selector/distance_key_frame_selector.hpp"
+
+#include <cmath>
+#include <iostream>
+
+namespace lidar_localization {
+
+DistanceKeyFrameSelector::DistanceKeyFrameSelector(const YAML::Node& node, const std::string& metrics_group)
+    : num_scans_(MetricsRegistry::GetInstance().GetCounter(metrics_group + ".num_scans")),
+      num_key_frames_(MetricsRegistry::GetInstance().GetCounter(metrics_group + ".num_key_frames")) {
+    SetSelectorParam(node["key_frame_distance"].as<float>());
+}
+
+bool DistanceKeyFrameSelector::SetSelectorParam(float key_frame_distance) {
+    key_frame_distance_ = key_frame_distance;
+
+    std::cout << "Distance Key Frame Selector params:" << std::endl
+              << "key_frame_distance: " << key_frame_distance_
+              << std::endl << std::endl;
+
+    return true;
+}
+
+bool DistanceKeyFrameSelector::Select(double time, const Eigen::Matrix4f& pose, const CloudData::CLOUD_PTR& cloud_ptr) {
+    num_scans_.Increment();
+
+    if (
+        has_key_frame_ && 
+        std::fabs(pose(0,3) - last_key_frame_pose_(0,3)) + 
+        std::fabs(pose(1,3) - last_key_frame_pose_(1,3)) +
+        std::fabs(pose(2,3) - last_key_frame_pose_(2,3)) <= key_frame_distance_
+    ) {
+        return false;
+    }
+
+    has_key_frame_ = true;
+    last_key_frame_pose_ = pose;
+    num_key_frames_.Increment();
+
+    return true;
+}
+
+} // namespace lidar_localization
@@ -0,0 +1,120 @@
+/*
+ * @Description: LRU cache of decoded key scans
+ * @Author: Ge Yao
+ * @Date: 2020-12-08 20:41:27
+ */
+#include "lidar_localization/models/key_frame_store/key_scan_cache.hpp"
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+KeyScanCache::KeyScanCache(
+    std::shared_ptr<KeyFrameStoreInterface> store_ptr,
+    std::shared_ptr<CloudFilterInterface> filter_ptr,
+    size_t max_size_in_mb,
+    float compact_resolution
+) : store_ptr_(store_ptr),
+    filter_ptr_(filter_ptr),
+    max_size_in_bytes_(max_size_in_mb << 20),
+    compact_resolution_(compact_resolution) {
+    std::cout << "Key Scan Cache params:" << std::endl
+              << "max size in MB: " << max_size_in_mb << ", "
+              << "compact resolution: " << compact_resolution_
+              << std::endl << std::endl;
+}
+
+bool KeyScanCache::Get(unsigned int index, CloudData::CLOUD::ConstPtr& scan_ptr) {
+    const Entry* entry = Find(index);
+    if (!entry)
+        return false;
+
+    if (entry->compact_scan_ptr) {
+        CloudData::CLOUD_PTR decoded_scan_ptr(new CloudData::CLOUD());
+        entry->compact_scan_ptr->Decode(*decoded_scan_ptr);
+        scan_ptr = decoded_scan_ptr;
+    } else {
+        scan_ptr = entry->scan_ptr;
+    }
+
+    return true;
+}
+
+bool KeyScanCache::Get(unsigned int index, CompactCloud::ConstPtr& scan_ptr) {
+    if (!IsCompact()) {
+        LOG(ERROR) << "Key scan cache is not compact.";
+        return false;
+    }
+
+    const Entry* entry = Find(index);
+    if (!entry)
+        return false;
+
+    scan_ptr = entry->compact_scan_ptr;
+    return true;
+}
+
+const KeyScanCache::Entry* KeyScanCache::Find(unsigned int index) {
+    auto it = entries_.find(index);
+    if (it != entries_.end()) {
+        ++stats_.num_hits;
+        lru_.splice(lru_.begin(), lru_, it->second.lru_it);
+        return &it->second;
+    }
+
+    ++stats_.num_misses;
+
+    CloudData::CLOUD_PTR loaded_scan_ptr(new CloudData::CLOUD());
+    if (!store_ptr_->Load(index, *loaded_scan_ptr))
+        return nullptr;
+
+    if (filter_ptr_) {
+        CloudData::CLOUD_PTR filtered_scan_ptr(new CloudData::CLOUD());
+        filter_ptr_->Filter(loaded_scan_ptr, filtered_scan_ptr);
+        loaded_scan_ptr = filtered_scan_ptr;
+    }
+
+    lru_.push_front(index);
+
+    Entry entry;
+    if (IsCompact()) {
+        entry.compact_scan_ptr = std::make_shared<const CompactCloud>(*loaded_scan_ptr, compact_resolution_);
+        entry.size_in_bytes = entry.compact_scan_ptr->GetSizeInBytes();
+    } else {
+        entry.scan_ptr = loaded_scan_ptr;
+        entry.size_in_bytes = loaded_scan_ptr->points.size() * sizeof(CloudData::POINT);
+    }
+    entry.lru_it = lru_.begin();
+    it = entries_.emplace(index, entry).first;
+
+    ++stats_.num_scans;
+    stats_.size_in_bytes += entry.size_in_bytes;
+
+    // the new entry is never evicted:
+    Evict();
+
+    return &it->second;
+}
+
+void KeyScanCache::Clear(void) {
+    lru_.clear();
+    entries_.clear();
+
+    stats_.num_scans = 0;
+    stats_.size_in_bytes = 0;
+}
+
+void KeyScanCache::Evict(void) {
+    // always keep the scan just inserted, even if it alone exceeds the budget:
+    while (stats_.size_in_bytes > max_size_in_bytes_ && lru_.size() > 1) {
+        auto it = entries_.find(lru_.back());
+
+        --stats_.num_scans;
+        stats_.size_in_bytes -= it->second.size_in_bytes;
+
+        entries_.erase(it);
+        lru_.pop_back();
+    }
+}
+
+} // namespace lidar_localization
@@ -0,0 +1,332 @@
+/*
+ * @Description: key frame storage as one append-only, memory-mapped file
+ * @Author: Ge Yao
+ * @Date: 2020-12-07 21:05:12
+ */
+#include "lidar_localization/models/key_frame_store/packed_key_frame_store.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+
+#include <cmath>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef LIDAR_LOCALIZATION_WITH_LZ4
+#include <lz4.h>
+#endif
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+namespace {
+const uint32_t BLOB_MAGIC = 0x4b465231; // KFR1
+const uint64_t INVALID_OFFSET = std::numeric_limits<uint64_t>::max();
+const size_t BLOB_ALIGNMENT = 8;
+const float MAX_QUANTIZED = 32767.0f;
+}
+
+PackedKeyFrameStore::PackedKeyFrameStore(const std::string& key_frames_path, const YAML::Node& node) {
+    float resolution = node["resolution"].as<float>();
+    bool use_lz4 = (node["compression"].as<std::string>() == "lz4");
+
+    SetStoreParam(key_frames_path, resolution, use_lz4);
+}
+
+PackedKeyFrameStore::PackedKeyFrameStore(const std::string& key_frames_path, float resolution, bool use_lz4) {
+    SetStoreParam(key_frames_path, resolution, use_lz4);
+}
+
+PackedKeyFrameStore::~PackedKeyFrameStore() {
+    Unmap();
+
+    for (int fd: {data_write_fd_, index_write_fd_, data_read_fd_, index_read_fd_}) {
+        if (fd >= 0)
+            close(fd);
+    }
+}
+
+bool PackedKeyFrameStore::SetStoreParam(const std::string& key_frames_path, float resolution, bool use_lz4) {
+    data_file_path_ = key_frames_path + "/key_frames.dat";
+    index_file_path_ = key_frames_path + "/key_frames.idx";
+    resolution_ = resolution;
+    use_lz4_ = use_lz4;
+
+#ifndef LIDAR_LOCALIZATION_WITH_LZ4
+    if (use_lz4_) {
+        LOG(WARNING) << "Packed key frame store is built without LZ4, key frames will not be compressed.";
+        use_lz4_ = false;
+    }
+#endif
+
+    std::cout << "Packed Key Frame Store params:" << std::endl
+              << "resolution: " << resolution_ << ", "
+              << "compression: " << (use_lz4_ ? "lz4" : "none")
+              << std::endl << std::endl;
+
+    return true;
+}
+
+bool PackedKeyFrameStore::Save(unsigned int index, const CloudData::CLOUD& cloud) {
+    TRACE_SCOPE("PackedKeyFrameStore::Save", "key_frame");
+    if (!OpenForWrite())
+        return false;
+
+    // quantize into a per-frame box, the step grows beyond resolution only for very wide scans:
+    Eigen::Vector3f min_point = Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+    Eigen::Vector3f max_point = Eigen::Vector3f::Constant(std::numeric_limits<float>::lowest());
+    for (const auto &point: cloud.points) {
+        if (!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z))
+            continue;
+        min_point = min_point.cwiseMin(point.getVector3fMap());
+        max_point = max_point.cwiseMax(point.getVector3fMap());
+    }
+
+    Eigen::Vector3f origin = Eigen::Vector3f::Zero();
+    float scale = resolution_;
+    if (min_point.x() <= max_point.x()) {
+        origin = 0.5f * (min_point + max_point);
+        scale = std::max(resolution_, 0.5f * (max_point - min_point).maxCoeff() / MAX_QUANTIZED);
+    }
+
+    quantized_.clear();
+    quantized_.reserve(3 * cloud.points.size());
+    for (const auto &point: cloud.points) {
+        if (!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z))
+            continue;
+        Eigen::Vector3f q = (point.getVector3fMap() - origin) / scale;
+        for (int i = 0; i < 3; ++i) {
+            quantized_.push_back(
+                static_cast<int16_t>(std::max(-MAX_QUANTIZED, std::min(MAX_QUANTIZED, std::round(q(i)))))
+            );
+        }
+    }
+
+    BlobHeader header;
+    header.magic = BLOB_MAGIC;
+    header.index = index;
+    header.num_points = static_cast<uint32_t>(quantized_.size() / 3);
+    header.compression = NONE;
+    header.raw_size = static_cast<uint32_t>(quantized_.size() * sizeof(int16_t));
+    header.stored_size = header.raw_size;
+    for (int i = 0; i < 3; ++i)
+        header.origin[i] = origin(i);
+    header.scale = scale;
+
+    const char *payload = reinterpret_cast<const char *>(quantized_.data());
+
+#ifdef LIDAR_LOCALIZATION_WITH_LZ4
+    if (use_lz4_ && header.raw_size > 0) {
+        compressed_.resize(LZ4_compressBound(header.raw_size));
+        int compressed_size = LZ4_compress_default(
+            payload, compressed_.data(), header.raw_size, compressed_.size()
+        );
+        // keep the raw payload when compression does not pay off:
+        if (compressed_size > 0 && static_cast<uint32_t>(compressed_size) < header.raw_size) {
+            header.compression = LZ4;
+            header.stored_size = static_cast<uint32_t>(compressed_size);
+            payload = compressed_.data();
+        }
+    }
+#endif
+
+    // pad blobs so that every header and payload in the mapped file stays aligned:
+    size_t blob_size = sizeof(BlobHeader) + header.stored_size;
+    size_t padding = (BLOB_ALIGNMENT - blob_size % BLOB_ALIGNMENT) % BLOB_ALIGNMENT;
+    const char zeros[BLOB_ALIGNMENT] = {0};
+
+    if (
+        !WriteAll(data_write_fd_, &header, sizeof(BlobHeader)) ||
+        !WriteAll(data_write_fd_, payload, header.stored_size) ||
+        !WriteAll(data_write_fd_, zeros, padding)
+    ) {
+        LOG(WARNING) << "Failed to write key frame " << index << " to " << data_file_path_;
+        return false;
+    }
+
+    // the index record goes last, so readers only see key frames whose blob is complete:
+    IndexRecord record;
+    record.index = index;
+    record.reserved = 0;
+    record.offset = data_write_offset_;
+    data_write_offset_ += blob_size + padding;
+
+    if (!WriteAll(index_write_fd_, &record, sizeof(IndexRecord))) {
+        LOG(WARNING) << "Failed to write key frame " << index << " to " << index_file_path_;
+        return false;
+    }
+
+    return true;
+}
+
+bool PackedKeyFrameStore::Load(unsigned int index, CloudData::CLOUD& cloud) {
+    if (index >= offsets_.size() || offsets_.at(index) == INVALID_OFFSET) {
+        if (!Refresh() || index >= offsets_.size() || offsets_.at(index) == INVALID_OFFSET)
+            return false;
+    }
+
+    uint64_t offset = offsets_.at(index);
+    if (offset + sizeof(BlobHeader) > data_size_)
+        return false;
+
+    BlobHeader header;
+    std::memcpy(&header, data_ + offset, sizeof(BlobHeader));
+    if (
+        header.magic != BLOB_MAGIC || header.index != index ||
+        offset + sizeof(BlobHeader) + header.stored_size > data_size_ ||
+        header.raw_size != header.num_points * 3 * sizeof(int16_t)
+    ) {
+        LOG(ERROR) << "Corrupted key frame " << index << " in " << data_file_path_;
+        return false;
+    }
+
+    const char *payload = data_ + offset + sizeof(BlobHeader);
+    if (header.compression == LZ4) {
+#ifdef LIDAR_LOCALIZATION_WITH_LZ4
+        decompressed_.resize(header.raw_size);
+        int raw_size = LZ4_decompress_safe(
+            payload, decompressed_.data(), header.stored_size, header.raw_size
+        );
+        if (raw_size != static_cast<int>(header.raw_size)) {
+            LOG(ERROR) << "Failed to decompress key frame " << index << " in " << data_file_path_;
+            return false;
+        }
+        payload = decompressed_.data();
+#else
+        LOG(ERROR) << "Key frame " << index << " is LZ4 compressed, but LZ4 support is not built.";
+        return false;
+#endif
+    } else if (header.stored_size != header.raw_size) {
+        LOG(ERROR) << "Corrupted key frame " << index << " in " << data_file_path_;
+        return false;
+    }
+
+    const int16_t *quantized = reinterpret_cast<const int16_t *>(payload);
+    Eigen::Vector3f origin(header.origin[0], header.origin[1], header.origin[2]);
+
+    cloud.points.resize(header.num_points);
+    for (size_t i = 0; i < header.num_points; ++i) {
+        CloudData::POINT &point = cloud.points.at(i);
+        point.x = origin.x() + header.scale * quantized[3 * i + 0];
+        point.y = origin.y() + header.scale * quantized[3 * i + 1];
+        point.z = origin.z() + header.scale * quantized[3 * i + 2];
+    }
+    cloud.width = header.num_points;
+    cloud.height = 1;
+    cloud.is_dense = true;
+
+    return true;
+}
+
+bool PackedKeyFrameStore::OpenForWrite(void) {
+    if (data_write_fd_ >= 0 && index_write_fd_ >= 0)
+        return true;
+
+    data_write_fd_ = open(data_file_path_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    index_write_fd_ = open(index_file_path_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (data_write_fd_ < 0 || index_write_fd_ < 0) {
+        LOG(ERROR) << "Cannot open packed key frame store in " << data_file_path_;
+        return false;
+    }
+
+    off_t offset = lseek(data_write_fd_, 0, SEEK_END);
+    data_write_offset_ = (offset < 0 ? 0 : static_cast<uint64_t>(offset));
+
+    return true;
+}
+
+bool PackedKeyFrameStore::WriteAll(int fd, const void *data, size_t size) {
+    const char *buffer = static_cast<const char *>(data);
+
+    while (size > 0) {
+        ssize_t written = write(fd, buffer, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        buffer += written;
+        size -= static_cast<size_t>(written);
+    }
+
+    return true;
+}
+
+bool PackedKeyFrameStore::Refresh(void) {
+    // the writer may not have created the store yet:
+    if (index_read_fd_ < 0) {
+        index_read_fd_ = open(index_file_path_.c_str(), O_RDONLY);
+        if (index_read_fd_ < 0)
+            return false;
+    }
+    if (data_read_fd_ < 0) {
+        data_read_fd_ = open(data_file_path_.c_str(), O_RDONLY);
+        if (data_read_fd_ < 0)
+            return false;
+    }
+
+    // read index records appended since the last refresh:
+    struct stat index_stat;
+    if (fstat(index_read_fd_, &index_stat) != 0)
+        return false;
+
+    size_t num_records = static_cast<size_t>(index_stat.st_size) / sizeof(IndexRecord);
+    if (num_records > num_records_) {
+        std::vector<IndexRecord> records(num_records - num_records_);
+        size_t size = records.size() * sizeof(IndexRecord);
+        ssize_t num_read = pread(
+            index_read_fd_, records.data(), size, num_records_ * sizeof(IndexRecord)
+        );
+        if (num_read != static_cast<ssize_t>(size))
+            return false;
+
+        for (const auto &record: records) {
+            if (record.index >= offsets_.size())
+                offsets_.resize(record.index + 1, INVALID_OFFSET);
+            offsets_.at(record.index) = record.offset;
+        }
+        num_records_ = num_records;
+    }
+
+    // grow the mapping to cover the new blobs:
+    struct stat data_stat;
+    if (fstat(data_read_fd_, &data_stat) != 0)
+        return false;
+
+    size_t data_size = static_cast<size_t>(data_stat.st_size);
+    if (data_size > data_size_)
+        return Map(data_size);
+
+    return true;
+}
+
+bool PackedKeyFrameStore::Map(size_t size) {
+    Unmap();
+
+    void *data = mmap(nullptr, size, PROT_READ, MAP_SHARED, data_read_fd_, 0);
+    if (data == MAP_FAILED) {
+        LOG(ERROR) << "Cannot map packed key frame store " << data_file_path_;
+        return false;
+    }
+
+    data_ = static_cast<const char *>(data);
+    data_size_ = size;
+
+    return true;
+}
+
+void PackedKeyFrameStore::Unmap(void) {
+    if (data_ != nullptr) {
+        munmap(const_cast<char *>(data_), data_size_);
+        data_ = nullptr;
+        data_size_ = 0;
+    }
+}
+
+} // namespace lidar_localization
@@ -0,0 +1,49 @@
+/*
+ * @Description: key frame storage as one PCD file per key frame
+ * @Author: Ge Yao
+ * @Date: 2020-12-07 21:05:12
+ */
+#include "lidar_localization/models/key_frame_store/pcd_key_frame_store.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+
+#include <cstdio>
+
+#include <pcl/io/pcd_io.h>
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+PCDKeyFrameStore::PCDKeyFrameStore(const std::string& key_frames_path) 
+    : key_frames_path_(key_frames_path) {
+}
+
+bool PCDKeyFrameStore::Save(unsigned int index, const CloudData::CLOUD& cloud) {
+    TRACE_SCOPE("PCDKeyFrameStore::Save", "key_frame");
+    std::string file_path = GetFilePath(index);
+
+    // write to a temporary file first so that readers never see a partial key frame:
+    std::string tmp_file_path = file_path + ".tmp";
+
+    if (pcl::io::savePCDFileBinary(tmp_file_path, cloud) != 0) {
+        LOG(WARNING) << "Failed to write key frame: " << file_path;
+        return false;
+    }
+
+    if (std::rename(tmp_file_path.c_str(), file_path.c_str()) != 0) {
+        LOG(WARNING) << "Failed to rename key frame: " << tmp_file_path;
+        std::remove(tmp_file_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool PCDKeyFrameStore::Load(unsigned int index, CloudData::CLOUD& cloud) {
+    return pcl::io::loadPCDFile(GetFilePath(index), cloud) == 0;
+}
+
+std::string PCDKeyFrameStore::GetFilePath(unsigned int index) const {
+    return key_frames_path_ + "/key_frame_" + std::to_string(index) + ".pcd";
+}
+
+} // namespace lidar_localization
@@ -0,0 +1,237 @@
+/*
+ * @Description: multi-resolution global map, one voxel centroid cloud per octree depth
+ * @Author: Ge Yao
+ * @Date: 2020-12-28 19:42:17
+ */
+#include "lidar_localization/models/lod_map/lod_map.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <algorithm>
+#include <unordered_map>
+
+#include <yaml-cpp/yaml.h>
+#include <pcl/io/pcd_io.h>
+
+#include "glog/logging.h"
+
+#include "lidar_localization/tools/file_manager.hpp"
+
+namespace lidar_localization {
+
+namespace {
+const int LOD_MAP_VERSION = 1;
+
+// voxel indices are packed into 21 bits each:
+const int VOXEL_INDEX_BITS = 21;
+const int64_t VOXEL_INDEX_OFFSET = 1 << (VOXEL_INDEX_BITS - 1);
+
+struct Voxel {
+  int64_t index[3];
+  double sum[3];
+  size_t num_points;
+};
+using VoxelMap = std::unordered_map<uint64_t, Voxel>;
+
+uint64_t GetVoxelKey(const int64_t index[3]) {
+    return (static_cast<uint64_t>(index[0] + VOXEL_INDEX_OFFSET) << (2 * VOXEL_INDEX_BITS)) |
+           (static_cast<uint64_t>(index[1] + VOXEL_INDEX_OFFSET) << VOXEL_INDEX_BITS) |
+           static_cast<uint64_t>(index[2] + VOXEL_INDEX_OFFSET);
+}
+
+// the parent octree node, i.e. floor(index / 2):
+int64_t GetParentIndex(int64_t index) {
+    return (index >= 0) ? (index / 2) : -((1 - index) / 2);
+}
+
+void AddToVoxel(const int64_t index[3], const double sum[3], size_t num_points, VoxelMap& voxels) {
+    auto result = voxels.emplace(GetVoxelKey(index), Voxel());
+    Voxel& voxel = result.first->second;
+    if (result.second) {
+        std::copy(index, index + 3, voxel.index);
+        std::fill(voxel.sum, voxel.sum + 3, 0.0);
+        voxel.num_points = 0;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        voxel.sum[i] += sum[i];
+    }
+    voxel.num_points += num_points;
+}
+
+// in voxel key order, so that the output only depends on the map:
+void GetCentroids(const VoxelMap& voxels, CloudData::CLOUD& cloud) {
+    std::vector<const Voxel*> sorted_voxels;
+    sorted_voxels.reserve(voxels.size());
+    for (const auto& voxel: voxels) {
+        sorted_voxels.push_back(&voxel.second);
+    }
+    std::sort(
+        sorted_voxels.begin(), sorted_voxels.end(),
+        [](const Voxel* a, const Voxel* b) { return GetVoxelKey(a->index) < GetVoxelKey(b->index); }
+    );
+
+    cloud.points.resize(sorted_voxels.size());
+    for (size_t i = 0; i < sorted_voxels.size(); ++i) {
+        const Voxel& voxel = *sorted_voxels[i];
+
+        CloudData::POINT& point = cloud.points[i];
+        point.x = voxel.sum[0] / voxel.num_points;
+        point.y = voxel.sum[1] / voxel.num_points;
+        point.z = voxel.sum[2] / voxel.num_points;
+    }
+    cloud.width = cloud.points.size();
+    cloud.height = 1;
+    cloud.is_dense = true;
+}
+}
+
+bool LODMap::Save(const std::string& lod_path, const CloudData::CLOUD& map, float leaf_size, int num_levels) {
+    if (leaf_size <= 0.0f || num_levels < 1) {
+        LOG(ERROR) << "Invalid LOD map leaf size " << leaf_size << " or num. of levels " << num_levels;
+        return false;
+    }
+
+    if (!FileManager::InitDirectory(lod_path, "LOD Map"))
+        return false;
+
+    // a. the finest level from the map points:
+    VoxelMap voxels;
+    size_t num_skipped = 0;
+    for (const CloudData::POINT& point: map.points) {
+        const double position[3] = {point.x, point.y, point.z};
+
+        int64_t index[3];
+        bool is_valid = true;
+        for (int i = 0; i < 3; ++i) {
+            if (!std::isfinite(position[i])) {
+                is_valid = false;
+                break;
+            }
+            index[i] = static_cast<int64_t>(std::floor(position[i] / leaf_size));
+            if (index[i] < -VOXEL_INDEX_OFFSET || index[i] >= VOXEL_INDEX_OFFSET) {
+                is_valid = false;
+                break;
+            }
+        }
+        if (!is_valid) {
+            ++num_skipped;
+            continue;
+        }
+
+        AddToVoxel(index, position, 1, voxels);
+    }
+    if (num_skipped > 0) {
+        LOG(WARNING) << "LOD map: " << num_skipped << " points outside the voxel index range are skipped.";
+    }
+
+    // b. coarser levels, one octree depth up from the previous one:
+    YAML::Node index;
+    index["version"] = LOD_MAP_VERSION;
+    index["leaf_size"] = leaf_size;
+    for (int level = 0; level < num_levels; ++level) {
+        if (level > 0) {
+            VoxelMap parent_voxels;
+            for (const auto& voxel: voxels) {
+                const int64_t parent_index[3] = {
+                    GetParentIndex(voxel.second.index[0]),
+                    GetParentIndex(voxel.second.index[1]),
+                    GetParentIndex(voxel.second.index[2])
+                };
+                AddToVoxel(parent_index, voxel.second.sum, voxel.second.num_points, parent_voxels);
+            }
+            voxels.swap(parent_voxels);
+        }
+
+        CloudData::CLOUD level_map;
+        GetCentroids(voxels, level_map);
+        if (pcl::io::savePCDFileBinary(lod_path + "/" + GetLevelFileName(level), level_map) != 0) {
+            LOG(ERROR) << "Failed to save LOD map level " << level;
+            return false;
+        }
+
+        index["levels"].push_back(level_map.points.size());
+    }
+
+    std::ofstream ofs(lod_path + "/index.yaml");
+    ofs << index;
+    if (!ofs) {
+        LOG(ERROR) << "Failed to save LOD map index in " << lod_path;
+        return false;
+    }
+
+    LOG(INFO) << "Saved LOD map, " << num_levels << " levels from leaf size " << leaf_size 
+              << ", " << map.points.size() << " points.";
+
+    return true;
+}
+
+LODMap::LODMap(const std::string& lod_path, float cell_size) {
+    Load(lod_path, cell_size);
+
+    std::cout << "LOD Map params:" << std::endl
+              << "lod path: " << lod_path << ", "
+              << "num. of levels: " << levels_.size() << ", "
+              << "finest leaf size: " << (levels_.empty() ? 0.0f : levels_.front().leaf_size)
+              << std::endl << std::endl;
+}
+
+int LODMap::GetLevel(float resolution) const {
+    for (int level = GetNumLevels() - 1; level > 0; --level) {
+        if (levels_.at(level).leaf_size <= resolution)
+            return level;
+    }
+
+    return 0;
+}
+
+bool LODMap::GetMap(int level, const std::vector<float>& edge, CloudData::CLOUD_PTR& map_ptr) const {
+    if (level < 0 || level >= GetNumLevels()) {
+        map_ptr.reset(new CloudData::CLOUD());
+        return false;
+    }
+
+    return levels_.at(level).grid_map_ptr->GetMap(edge, map_ptr);
+}
+
+std::string LODMap::GetLevelFileName(int level) {
+    return "level_" + std::to_string(level) + ".pcd";
+}
+
+bool LODMap::Load(const std::string& lod_path, float cell_size) {
+    std::string index_file_path = lod_path + "/index.yaml";
+
+    YAML::Node index;
+    try {
+        index = YAML::LoadFile(index_file_path);
+    } catch (const YAML::Exception &e) {
+        LOG(ERROR) << "Failed to load LOD map index " << index_file_path << ": " << e.what();
+        return false;
+    }
+
+    if (index["version"].as<int>() != LOD_MAP_VERSION) {
+        LOG(ERROR) << "Unsupported LOD map version " << index["version"].as<int>() << " in " << index_file_path;
+        return false;
+    }
+
+    std::vector<Level> levels;
+    float leaf_size = index["leaf_size"].as<float>();
+    for (size_t level = 0; level < index["levels"].size(); ++level) {
+        CloudData::CLOUD_PTR map_ptr(new CloudData::CLOUD());
+        std::string level_file_path = lod_path + "/" + GetLevelFileName(level);
+        if (pcl::io::loadPCDFile(level_file_path, *map_ptr) != 0) {
+            LOG(ERROR) << "Failed to load LOD map level " << level_file_path;
+            return false;
+        }
+
+        // points are reordered by cell once here:
+        levels.push_back(Level{leaf_size, map_ptr, std::make_shared<GridMap>(map_ptr, cell_size)});
+        leaf_size *= 2.0f;
+    }
+    levels_.swap(levels);
+
+    return true;
+}
+
+} // namespace lidar_localization
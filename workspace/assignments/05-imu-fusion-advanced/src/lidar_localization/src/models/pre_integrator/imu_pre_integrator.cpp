@@ -0,0 +1,144 @@
+/*
+ * @Description: IMU pre-integration between two graph nodes, mid-value integration in the body frame of the first node
+ * @Author: Ge Yao
+ * @Date: 2020-12-25 10:06:18
+ */
+#include "lidar_localization/models/pre_integrator/imu_pre_integrator.hpp"
+
+#include <sophus/so3.hpp>
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+IMUPreIntegrator::IMUPreIntegrator(const Noise& noise) : noise_(noise) {
+}
+
+IMUPreIntegrator::IMUPreIntegrator(const YAML::Node& node) {
+    noise_.accel = node["accel"].as<double>();
+    noise_.gyro = node["gyro"].as<double>();
+    noise_.accel_bias = node["accel_bias"].as<double>();
+    noise_.gyro_bias = node["gyro_bias"].as<double>();
+}
+
+void IMUPreIntegrator::Reset(
+    const IMUData& imu_data,
+    const Eigen::Vector3d& accel_bias, const Eigen::Vector3d& gyro_bias
+) {
+    start_time_ = imu_data.time;
+
+    samples_.clear();
+    samples_.push_back(ToSample(imu_data));
+
+    Repropagate(accel_bias, gyro_bias);
+}
+
+bool IMUPreIntegrator::Integrate(const IMUData& imu_data) {
+    if (samples_.empty() || imu_data.time <= samples_.back().time) {
+        return false;
+    }
+
+    samples_.push_back(ToSample(imu_data));
+    Propagate(samples_.at(samples_.size() - 2), samples_.back());
+
+    return true;
+}
+
+void IMUPreIntegrator::Repropagate(const Eigen::Vector3d& accel_bias, const Eigen::Vector3d& gyro_bias) {
+    accel_bias_ = accel_bias;
+    gyro_bias_ = gyro_bias;
+
+    T_ = 0.0;
+    alpha_ = beta_ = Eigen::Vector3d::Zero();
+    theta_ = Eigen::Matrix3d::Identity();
+    P_ = MatrixP::Zero();
+    J_ = MatrixP::Identity();
+
+    for (size_t i = 1; i < samples_.size(); ++i) {
+        Propagate(samples_.at(i - 1), samples_.at(i));
+    }
+}
+
+Eigen::Vector3d IMUPreIntegrator::GetDeltaPosition(
+    const Eigen::Vector3d& accel_bias, const Eigen::Vector3d& gyro_bias
+) const {
+    return alpha_ +
+           J_.block<3, 3>(INDEX_P, INDEX_A) * (accel_bias - accel_bias_) +
+           J_.block<3, 3>(INDEX_P, INDEX_G) * (gyro_bias - gyro_bias_);
+}
+
+Eigen::Vector3d IMUPreIntegrator::GetDeltaVelocity(
+    const Eigen::Vector3d& accel_bias, const Eigen::Vector3d& gyro_bias
+) const {
+    return beta_ +
+           J_.block<3, 3>(INDEX_V, INDEX_A) * (accel_bias - accel_bias_) +
+           J_.block<3, 3>(INDEX_V, INDEX_G) * (gyro_bias - gyro_bias_);
+}
+
+Eigen::Matrix3d IMUPreIntegrator::GetDeltaOrientation(const Eigen::Vector3d& gyro_bias) const {
+    return theta_ * Sophus::SO3d::exp(J_.block<3, 3>(INDEX_R, INDEX_G) * (gyro_bias - gyro_bias_)).matrix();
+}
+
+void IMUPreIntegrator::Propagate(
+    const imu_mechanization::IMUSample& sample_prev, const imu_mechanization::IMUSample& sample_curr
+) {
+    const double dt = sample_curr.time - sample_prev.time;
+
+    // a. mean, same mid-value scheme as imu_mechanization:
+    const Eigen::Vector3d w = 0.5*(sample_prev.angular_vel + sample_curr.angular_vel) - gyro_bias_;
+    const Eigen::Matrix3d delta_R = Sophus::SO3d::exp(w*dt).matrix();
+    const Eigen::Matrix3d theta_prev = theta_;
+    theta_ = theta_ * delta_R;
+
+    const Eigen::Vector3d a = 0.5*(
+        theta_prev*(sample_prev.linear_acc - accel_bias_) + theta_*(sample_curr.linear_acc - accel_bias_)
+    );
+    alpha_ += beta_*dt + 0.5*a*dt*dt;
+    beta_ += a*dt;
+    T_ += dt;
+
+    // b. error state transition, around the orientation at the start of the step:
+    const Eigen::Vector3d a_body = 0.5*(sample_prev.linear_acc + sample_curr.linear_acc) - accel_bias_;
+    const Eigen::Matrix3d R_a_hat = theta_prev * Sophus::SO3d::hat(a_body);
+
+    MatrixP F = MatrixP::Identity();
+    F.block<3, 3>(INDEX_P, INDEX_R) = -0.5*dt*dt*R_a_hat;
+    F.block<3, 3>(INDEX_P, INDEX_V) = dt*Eigen::Matrix3d::Identity();
+    F.block<3, 3>(INDEX_P, INDEX_A) = -0.5*dt*dt*theta_prev;
+    F.block<3, 3>(INDEX_R, INDEX_R) = delta_R.transpose();
+    // right jacobian of a small rotation is close to identity:
+    F.block<3, 3>(INDEX_R, INDEX_G) = -dt*Eigen::Matrix3d::Identity();
+    F.block<3, 3>(INDEX_V, INDEX_R) = -dt*R_a_hat;
+    F.block<3, 3>(INDEX_V, INDEX_A) = -dt*theta_prev;
+
+    // c. discrete noise, measurement noise over dt & bias random walk:
+    MatrixP Q = MatrixP::Zero();
+    const double accel_var = noise_.accel*noise_.accel;
+    const double gyro_var = noise_.gyro*noise_.gyro;
+    Q.block<3, 3>(INDEX_P, INDEX_P) = 0.25*dt*dt*dt*accel_var*Eigen::Matrix3d::Identity();
+    Q.block<3, 3>(INDEX_P, INDEX_V) = 0.5*dt*dt*accel_var*Eigen::Matrix3d::Identity();
+    Q.block<3, 3>(INDEX_V, INDEX_P) = 0.5*dt*dt*accel_var*Eigen::Matrix3d::Identity();
+    Q.block<3, 3>(INDEX_V, INDEX_V) = dt*accel_var*Eigen::Matrix3d::Identity();
+    Q.block<3, 3>(INDEX_R, INDEX_R) = dt*gyro_var*Eigen::Matrix3d::Identity();
+    Q.block<3, 3>(INDEX_A, INDEX_A) = dt*noise_.accel_bias*noise_.accel_bias*Eigen::Matrix3d::Identity();
+    Q.block<3, 3>(INDEX_G, INDEX_G) = dt*noise_.gyro_bias*noise_.gyro_bias*Eigen::Matrix3d::Identity();
+
+    P_ = F*P_*F.transpose() + Q;
+    J_ = F*J_;
+}
+
+imu_mechanization::IMUSample IMUPreIntegrator::ToSample(const IMUData& imu_data) {
+    imu_mechanization::IMUSample sample;
+
+    sample.time = imu_data.time;
+    sample.angular_vel = Eigen::Vector3d(
+        imu_data.angular_velocity.x, imu_data.angular_velocity.y, imu_data.angular_velocity.z
+    );
+    sample.linear_acc = Eigen::Vector3d(
+        imu_data.linear_acceleration.x, imu_data.linear_acceleration.y, imu_data.linear_acceleration.z
+    );
+
+    return sample;
+}
+
+} // namespace lidar_localization
@@ -0,0 +1,544 @@
+/*
+ * @Description: device side of NDTCUDARegistration, target voxelization and batched NDT derivatives
+ * @Author: Ge Yao
+ * @Date: 2020-12-29 10:27:44
+ */
+#include "lidar_localization/models/registration/cuda/ndt_cuda_kernels.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <cuda_runtime.h>
+
+#include <thrust/device_vector.h>
+#include <thrust/sequence.h>
+#include <thrust/sort.h>
+#include <thrust/reduce.h>
+#include <thrust/remove.h>
+#include <thrust/functional.h>
+#include <thrust/system_error.h>
+#include <thrust/iterator/counting_iterator.h>
+#include <thrust/iterator/transform_iterator.h>
+#include <thrust/iterator/zip_iterator.h>
+
+namespace lidar_localization {
+
+namespace {
+// same as NDTOMPRegistration:
+const int MIN_POINTS_PER_VOXEL = 6;
+const double MIN_EIGENVALUE_RATIO = 0.01;
+
+const int BLOCK_SIZE = 128;
+// score, gradient & the upper triangle of the Hessian:
+const int NUM_DERIVATIVES = 1 + 6 + 21;
+// with the squared point-to-plane distance and the count of matched points:
+const int NUM_SUMS = NUM_DERIVATIVES + 2;
+const int MAX_JACOBI_SWEEPS = 16;
+
+struct VoxelStats {
+  double num_points;
+  double sum[3];
+  // xx, xy, xz, yy, yz, zz:
+  double sum_sq[6];
+};
+
+struct Voxel {
+  float mean[3];
+  // xx, xy, xz, yy, yz, zz:
+  float icov[6];
+  // least-variance direction:
+  float normal[3];
+  int is_valid;
+};
+
+struct Pose {
+  float R[9];
+  float t[3];
+};
+
+__host__ __device__ inline void GetVoxelIndex(const float point[3], float inverse_res, int index[3]) {
+    for (int i = 0; i < 3; ++i) {
+        index[i] = static_cast<int>(floorf(point[i] * inverse_res));
+    }
+}
+
+// same packing as NDTOMPRegistration::GetVoxelKey, 21 bits per axis:
+__host__ __device__ inline int64_t GetVoxelKey(int x, int y, int z) {
+    const int64_t OFFSET = (1 << 20);
+    const int64_t MASK = (1 << 21) - 1;
+
+    return (
+        (((x + OFFSET) & MASK) << 42) |
+        (((y + OFFSET) & MASK) << 21) |
+        ((z + OFFSET) & MASK)
+    );
+}
+
+struct PointToVoxelKey {
+  const float* points;
+  float inverse_res;
+
+  __host__ __device__ int64_t operator()(int i) const {
+      int index[3];
+      GetVoxelIndex(points + 3 * i, inverse_res, index);
+      return GetVoxelKey(index[0], index[1], index[2]);
+  }
+};
+
+struct PointToVoxelStats {
+  const float* points;
+
+  __host__ __device__ VoxelStats operator()(int i) const {
+      const double x = points[3 * i + 0], y = points[3 * i + 1], z = points[3 * i + 2];
+
+      VoxelStats stats;
+      stats.num_points = 1.0;
+      stats.sum[0] = x; stats.sum[1] = y; stats.sum[2] = z;
+      stats.sum_sq[0] = x * x; stats.sum_sq[1] = x * y; stats.sum_sq[2] = x * z;
+      stats.sum_sq[3] = y * y; stats.sum_sq[4] = y * z; stats.sum_sq[5] = z * z;
+
+      return stats;
+  }
+};
+
+struct AddVoxelStats {
+  __host__ __device__ VoxelStats operator()(const VoxelStats& a, const VoxelStats& b) const {
+      VoxelStats stats;
+      stats.num_points = a.num_points + b.num_points;
+      for (int i = 0; i < 3; ++i) {
+          stats.sum[i] = a.sum[i] + b.sum[i];
+      }
+      for (int i = 0; i < 6; ++i) {
+          stats.sum_sq[i] = a.sum_sq[i] + b.sum_sq[i];
+      }
+
+      return stats;
+  }
+};
+
+struct IsInvalidVoxel {
+  template <typename Tuple>
+  __host__ __device__ bool operator()(const Tuple& voxel) const {
+      return thrust::get<1>(voxel).is_valid == 0;
+  }
+};
+
+// cyclic Jacobi for symmetric 3x3, A is diagonalized in place, eigenvectors are the columns of V:
+__host__ __device__ inline void ComputeEigen(double A[3][3], double V[3][3]) {
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            V[i][j] = (i == j) ? 1.0 : 0.0;
+        }
+    }
+
+    for (int sweep = 0; sweep < MAX_JACOBI_SWEEPS; ++sweep) {
+        const double off_diagonal = A[0][1] * A[0][1] + A[0][2] * A[0][2] + A[1][2] * A[1][2];
+        const double diagonal = A[0][0] * A[0][0] + A[1][1] * A[1][1] + A[2][2] * A[2][2];
+        if (off_diagonal <= 1.0e-24 * diagonal)
+            break;
+
+        for (int p = 0; p < 2; ++p) {
+            for (int q = p + 1; q < 3; ++q) {
+                if (A[p][q] == 0.0)
+                    continue;
+
+                // rotation that zeroes A[p][q]:
+                const double theta = (A[q][q] - A[p][p]) / (2.0 * A[p][q]);
+                const double t = ((theta >= 0.0) ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                const double c = 1.0 / sqrt(t * t + 1.0);
+                const double s = t * c;
+
+                for (int k = 0; k < 3; ++k) {
+                    const double a_kp = A[k][p], a_kq = A[k][q];
+                    A[k][p] = c * a_kp - s * a_kq;
+                    A[k][q] = s * a_kp + c * a_kq;
+                }
+                for (int k = 0; k < 3; ++k) {
+                    const double a_pk = A[p][k], a_qk = A[q][k];
+                    A[p][k] = c * a_pk - s * a_qk;
+                    A[q][k] = s * a_pk + c * a_qk;
+                }
+                for (int k = 0; k < 3; ++k) {
+                    const double v_kp = V[k][p], v_kq = V[k][q];
+                    V[k][p] = c * v_kp - s * v_kq;
+                    V[k][q] = s * v_kp + c * v_kq;
+                }
+            }
+        }
+    }
+}
+
+// same as NDTOMPRegistration::ComputeVoxel, near-singular covariances are inflated:
+__host__ __device__ inline Voxel ComputeVoxel(const VoxelStats& stats) {
+    Voxel voxel;
+    voxel.is_valid = 0;
+    if (stats.num_points < MIN_POINTS_PER_VOXEL)
+        return voxel;
+
+    const double N = stats.num_points;
+    const double mean[3] = {stats.sum[0] / N, stats.sum[1] / N, stats.sum[2] / N};
+
+    const int SQ_INDEX[3][3] = {{0, 1, 2}, {1, 3, 4}, {2, 4, 5}};
+    double A[3][3], V[3][3];
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            A[i][j] = (stats.sum_sq[SQ_INDEX[i][j]] - N * mean[i] * mean[j]) / (N - 1.0);
+        }
+    }
+    ComputeEigen(A, V);
+
+    double eigen_values[3] = {A[0][0], A[1][1], A[2][2]};
+    const double max_eigen_value = fmax(eigen_values[0], fmax(eigen_values[1], eigen_values[2]));
+    if (max_eigen_value <= 0.0)
+        return voxel;
+    for (int i = 0; i < 3; ++i) {
+        eigen_values[i] = fmax(eigen_values[i], MIN_EIGENVALUE_RATIO * max_eigen_value);
+    }
+
+    int min_index = 0;
+    for (int i = 1; i < 3; ++i) {
+        if (eigen_values[i] < eigen_values[min_index])
+            min_index = i;
+    }
+    for (int i = 0; i < 3; ++i) {
+        voxel.mean[i] = static_cast<float>(mean[i]);
+        voxel.normal[i] = static_cast<float>(V[i][min_index]);
+    }
+    for (int i = 0; i < 3; ++i) {
+        for (int j = i; j < 3; ++j) {
+            double icov = 0.0;
+            for (int k = 0; k < 3; ++k) {
+                icov += V[i][k] * V[j][k] / eigen_values[k];
+            }
+            voxel.icov[SQ_INDEX[i][j]] = static_cast<float>(icov);
+        }
+    }
+    voxel.is_valid = 1;
+
+    return voxel;
+}
+
+struct VoxelStatsToVoxel {
+  __host__ __device__ Voxel operator()(const VoxelStats& stats) const {
+      return ComputeVoxel(stats);
+  }
+};
+
+__device__ inline int FindVoxel(const int64_t* voxel_keys, int num_voxels, int64_t key) {
+    int begin = 0, end = num_voxels;
+    while (begin < end) {
+        const int middle = (begin + end) / 2;
+        if (voxel_keys[middle] < key) {
+            begin = middle + 1;
+        } else {
+            end = middle;
+        }
+    }
+
+    return (begin < num_voxels && voxel_keys[begin] == key) ? begin : -1;
+}
+
+// score contribution of one point and one voxel, with its Gauss-Newton derivatives as NDTOMPRegistration,
+// returns the likelihood term:
+__host__ __device__ inline double AddDerivatives(
+    const float point[3], const Voxel& voxel, double gauss_d1, double gauss_d2,
+    double derivatives[NUM_DERIVATIVES]
+) {
+    const int SQ_INDEX[3][3] = {{0, 1, 2}, {1, 3, 4}, {2, 4, 5}};
+
+    float q[3], icov_q[3];
+    for (int i = 0; i < 3; ++i) {
+        q[i] = point[i] - voxel.mean[i];
+    }
+    for (int i = 0; i < 3; ++i) {
+        icov_q[i] = voxel.icov[SQ_INDEX[i][0]] * q[0] + voxel.icov[SQ_INDEX[i][1]] * q[1] + voxel.icov[SQ_INDEX[i][2]] * q[2];
+    }
+    const double e = exp(-0.5 * gauss_d2 * (q[0] * icov_q[0] + q[1] * icov_q[1] + q[2] * icov_q[2]));
+    // positive as d1 < 0:
+    const double w = -gauss_d1 * gauss_d2 * e;
+
+    // jacobian of transformed point w.r.t. left perturbation [delta_t, delta_theta], J = [I | M]:
+    const float x = point[0], y = point[1], z = point[2];
+    const float J[3][6] = {
+        {1.0f, 0.0f, 0.0f, 0.0f,    z,   -y},
+        {0.0f, 1.0f, 0.0f,   -z, 0.0f,    x},
+        {0.0f, 0.0f, 1.0f,    y,   -x, 0.0f}
+    };
+
+    // icov * J:
+    float A[3][6];
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 6; ++j) {
+            A[i][j] = voxel.icov[SQ_INDEX[i][0]] * J[0][j] + voxel.icov[SQ_INDEX[i][1]] * J[1][j] + voxel.icov[SQ_INDEX[i][2]] * J[2][j];
+        }
+    }
+
+    derivatives[0] += -gauss_d1 * e;
+    for (int j = 0; j < 6; ++j) {
+        derivatives[1 + j] += w * (J[0][j] * icov_q[0] + J[1][j] * icov_q[1] + J[2][j] * icov_q[2]);
+    }
+    int k = 7;
+    for (int a = 0; a < 6; ++a) {
+        for (int b = a; b < 6; ++b) {
+            derivatives[k++] += w * (J[0][a] * A[0][b] + J[1][a] * A[1][b] + J[2][a] * A[2][b]);
+        }
+    }
+
+    return e;
+}
+
+__host__ __device__ inline double GetSquaredPlaneDistance(const float point[3], const Voxel& voxel) {
+    const float d = (
+        voxel.normal[0] * (point[0] - voxel.mean[0]) +
+        voxel.normal[1] * (point[1] - voxel.mean[1]) +
+        voxel.normal[2] * (point[2] - voxel.mean[2])
+    );
+
+    return d * d;
+}
+
+// one thread per source point, partial sums reduced per block:
+__global__ void ComputeDerivativesKernel(
+    const float* source, int num_points, Pose pose,
+    const int64_t* voxel_keys, const Voxel* voxels, int num_voxels,
+    float inverse_res, int num_neighbors, double gauss_d1, double gauss_d2,
+    double* block_derivatives
+) {
+    const int OFFSETS[7][3] = {
+        { 0,  0,  0},
+        {+1,  0,  0}, {-1,  0,  0},
+        { 0, +1,  0}, { 0, -1,  0},
+        { 0,  0, +1}, { 0,  0, -1}
+    };
+
+    double derivatives[NUM_SUMS];
+    for (int k = 0; k < NUM_SUMS; ++k) {
+        derivatives[k] = 0.0;
+    }
+
+    // threads past the end still take part in the block reduction:
+    const int i = blockIdx.x * blockDim.x + threadIdx.x;
+    if (i < num_points) {
+        const float* p = source + 3 * i;
+        float point[3];
+        for (int r = 0; r < 3; ++r) {
+            point[r] = pose.R[3 * r + 0] * p[0] + pose.R[3 * r + 1] * p[1] + pose.R[3 * r + 2] * p[2] + pose.t[r];
+        }
+
+        int index[3];
+        GetVoxelIndex(point, inverse_res, index);
+        // the most likely neighbor voxel gives the fitness score:
+        double max_e = -1.0;
+        int best_voxel_index = -1;
+        for (int n = 0; n < num_neighbors; ++n) {
+            const int voxel_index = FindVoxel(
+                voxel_keys, num_voxels,
+                GetVoxelKey(index[0] + OFFSETS[n][0], index[1] + OFFSETS[n][1], index[2] + OFFSETS[n][2])
+            );
+            if (voxel_index >= 0) {
+                const double e = AddDerivatives(point, voxels[voxel_index], gauss_d1, gauss_d2, derivatives);
+                if (e > max_e) {
+                    max_e = e;
+                    best_voxel_index = voxel_index;
+                }
+            }
+        }
+
+        if (best_voxel_index >= 0) {
+            derivatives[NUM_DERIVATIVES] = GetSquaredPlaneDistance(point, voxels[best_voxel_index]);
+            derivatives[NUM_DERIVATIVES + 1] = 1.0;
+        }
+    }
+
+    __shared__ double buffer[BLOCK_SIZE];
+    for (int k = 0; k < NUM_SUMS; ++k) {
+        buffer[threadIdx.x] = derivatives[k];
+        __syncthreads();
+
+        for (int stride = BLOCK_SIZE / 2; stride > 0; stride >>= 1) {
+            if (threadIdx.x < stride) {
+                buffer[threadIdx.x] += buffer[threadIdx.x + stride];
+            }
+            __syncthreads();
+        }
+
+        if (threadIdx.x == 0) {
+            block_derivatives[blockIdx.x * NUM_SUMS + k] = buffer[0];
+        }
+        __syncthreads();
+    }
+}
+}
+
+struct NDTCUDAKernels::Impl {
+  float inverse_res;
+  double gauss_d1;
+  double gauss_d2;
+  int num_neighbors;
+
+  // valid target voxels, sorted by key:
+  thrust::device_vector<int64_t> voxel_keys;
+  thrust::device_vector<Voxel> voxels;
+
+  thrust::device_vector<float> source;
+  int num_source_points = 0;
+  thrust::device_vector<double> block_derivatives;
+  std::vector<double> host_block_derivatives;
+};
+
+NDTCUDAKernels::NDTCUDAKernels(float res, double gauss_d1, double gauss_d2, int num_neighbors)
+    : impl_(new Impl()) {
+    impl_->inverse_res = 1.0f / res;
+    impl_->gauss_d1 = gauss_d1;
+    impl_->gauss_d2 = gauss_d2;
+    impl_->num_neighbors = (num_neighbors == 1) ? 1 : 7;
+}
+
+NDTCUDAKernels::~NDTCUDAKernels() = default;
+
+bool NDTCUDAKernels::IsDeviceAvailable(void) {
+    int num_devices = 0;
+    return cudaGetDeviceCount(&num_devices) == cudaSuccess && num_devices > 0;
+}
+
+bool NDTCUDAKernels::SetTarget(const float* points, int num_points) {
+    try {
+        thrust::device_vector<float> target(points, points + 3 * num_points);
+        const float* target_ptr = thrust::raw_pointer_cast(target.data());
+
+        // a. sort points by voxel key:
+        thrust::device_vector<int64_t> keys(num_points);
+        thrust::transform(
+            thrust::counting_iterator<int>(0), thrust::counting_iterator<int>(num_points),
+            keys.begin(), PointToVoxelKey{target_ptr, impl_->inverse_res}
+        );
+        thrust::device_vector<int> indices(num_points);
+        thrust::sequence(indices.begin(), indices.end());
+        thrust::sort_by_key(keys.begin(), keys.end(), indices.begin());
+
+        // b. point statistics per voxel:
+        thrust::device_vector<int64_t> voxel_keys(num_points);
+        thrust::device_vector<VoxelStats> voxel_stats(num_points);
+        auto ends = thrust::reduce_by_key(
+            keys.begin(), keys.end(),
+            thrust::make_transform_iterator(indices.begin(), PointToVoxelStats{target_ptr}),
+            voxel_keys.begin(), voxel_stats.begin(),
+            thrust::equal_to<int64_t>(), AddVoxelStats()
+        );
+        const int num_voxels = static_cast<int>(ends.first - voxel_keys.begin());
+        voxel_keys.resize(num_voxels);
+        voxel_stats.resize(num_voxels);
+
+        // c. distributions, only the valid ones are kept, still sorted by key:
+        thrust::device_vector<Voxel> voxels(num_voxels);
+        thrust::transform(voxel_stats.begin(), voxel_stats.end(), voxels.begin(), VoxelStatsToVoxel());
+
+        auto voxel_begin = thrust::make_zip_iterator(thrust::make_tuple(voxel_keys.begin(), voxels.begin()));
+        auto voxel_end = thrust::remove_if(
+            voxel_begin, thrust::make_zip_iterator(thrust::make_tuple(voxel_keys.end(), voxels.end())),
+            IsInvalidVoxel()
+        );
+        const int num_valid_voxels = static_cast<int>(voxel_end - voxel_begin);
+        voxel_keys.resize(num_valid_voxels);
+        voxels.resize(num_valid_voxels);
+
+        impl_->voxel_keys.swap(voxel_keys);
+        impl_->voxels.swap(voxels);
+    } catch (const std::exception&) {
+        impl_->voxel_keys.clear();
+        impl_->voxels.clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool NDTCUDAKernels::SetSource(const float* points, int num_points) {
+    try {
+        impl_->source.assign(points, points + 3 * num_points);
+        impl_->num_source_points = num_points;
+    } catch (const std::exception&) {
+        impl_->source.clear();
+        impl_->num_source_points = 0;
+        return false;
+    }
+
+    return true;
+}
+
+int NDTCUDAKernels::GetNumVoxels(void) const {
+    return static_cast<int>(impl_->voxels.size());
+}
+
+bool NDTCUDAKernels::ComputeDerivatives(const double pose[12], Derivatives& derivatives) {
+    derivatives.score = 0.0;
+    std::fill(derivatives.g, derivatives.g + 6, 0.0);
+    std::fill(derivatives.H, derivatives.H + 36, 0.0);
+    derivatives.sum_sq_dis = 0.0;
+    derivatives.num_matched = 0;
+
+    const int N = impl_->num_source_points;
+    if (N == 0 || impl_->voxels.empty())
+        return true;
+
+    Pose device_pose;
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 3; ++c) {
+            device_pose.R[3 * r + c] = static_cast<float>(pose[4 * r + c]);
+        }
+        device_pose.t[r] = static_cast<float>(pose[4 * r + 3]);
+    }
+
+    const int num_blocks = (N + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    try {
+        impl_->block_derivatives.resize(num_blocks * NUM_SUMS);
+    } catch (const std::exception&) {
+        return false;
+    }
+
+    ComputeDerivativesKernel<<<num_blocks, BLOCK_SIZE>>>(
+        thrust::raw_pointer_cast(impl_->source.data()), N, device_pose,
+        thrust::raw_pointer_cast(impl_->voxel_keys.data()), thrust::raw_pointer_cast(impl_->voxels.data()),
+        static_cast<int>(impl_->voxels.size()),
+        impl_->inverse_res, impl_->num_neighbors, impl_->gauss_d1, impl_->gauss_d2,
+        thrust::raw_pointer_cast(impl_->block_derivatives.data())
+    );
+    if (cudaGetLastError() != cudaSuccess)
+        return false;
+
+    impl_->host_block_derivatives.resize(num_blocks * NUM_SUMS);
+    if (
+        cudaMemcpy(
+            impl_->host_block_derivatives.data(), thrust::raw_pointer_cast(impl_->block_derivatives.data()),
+            num_blocks * NUM_SUMS * sizeof(double), cudaMemcpyDeviceToHost
+        ) != cudaSuccess
+    ) {
+        return false;
+    }
+
+    // reduce in block order, so the result is deterministic:
+    double sums[NUM_SUMS] = {0.0};
+    for (int i = 0; i < num_blocks; ++i) {
+        for (int k = 0; k < NUM_SUMS; ++k) {
+            sums[k] += impl_->host_block_derivatives[i * NUM_SUMS + k];
+        }
+    }
+
+    derivatives.score = sums[0];
+    for (int j = 0; j < 6; ++j) {
+        derivatives.g[j] = sums[1 + j];
+    }
+    int k = 7;
+    for (int a = 0; a < 6; ++a) {
+        for (int b = a; b < 6; ++b) {
+            derivatives.H[6 * a + b] = derivatives.H[6 * b + a] = sums[k++];
+        }
+    }
+    derivatives.sum_sq_dis = sums[NUM_DERIVATIVES];
+    derivatives.num_matched = static_cast<int>(sums[NUM_DERIVATIVES + 1] + 0.5);
+
+    return true;
+}
+
+} // namespace lidar_localization
@@ -0,0 +1,604 @@
+/*
+ * @Description: registration against a truncated distance field of the target, in sparse voxel blocks
+ * @Author: Ge Yao
+ * @Date: 2021-01-06 20:41:09
+ */
+#include "lidar_localization/models/registration/distance_field_registration.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <utility>
+
+#include <pcl/common/transforms.h>
+
+#include <Eigen/Eigenvalues>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+// neighborhoods thicker than this, as the ratio of the smallest to the middle eigenvalue, are not planes:
+static const double MAX_PLANARITY_RATIO = 0.1;
+
+// prebuilt field, in native byte order: the header, then one record per block in key order:
+static const char FIELD_MAGIC[8] = {'D', 'I', 'S', 'T', 'F', 'L', 'D', '\0'};
+static const uint32_t FIELD_VERSION = 1;
+
+namespace {
+struct FieldHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t record_size;
+    uint32_t block_size;
+    float res;
+    float truncation;
+    uint64_t num_blocks;
+};
+}
+
+DistanceFieldRegistration::DistanceFieldRegistration(const YAML::Node& node)
+    : input_target_(new CloudData::CLOUD()),
+      input_target_kdtree_(new pcl::KdTreeFLANN<CloudData::POINT>()) {
+
+    float res = node["res"].as<float>();
+    float truncation = node["truncation"].as<float>();
+    int num_neighbors = node["num_neighbors"].as<int>();
+    float trans_eps = node["trans_eps"].as<float>();
+    int max_iter = node["max_iter"].as<int>();
+    int num_threads = node["num_threads"].as<int>();
+
+    SetRegistrationParam(res, truncation, num_neighbors, trans_eps, max_iter, num_threads);
+
+    const std::string target_path = node["target_path"] ? node["target_path"].as<std::string>() : "";
+    if (!target_path.empty() && !LoadTarget(target_path)) {
+        LOG(ERROR) << "Failed to load distance field " << target_path << ", the field is computed online.";
+    }
+}
+
+DistanceFieldRegistration::DistanceFieldRegistration(
+    float res, float truncation, int num_neighbors, float trans_eps, int max_iter,
+    int num_threads
+) : input_target_(new CloudData::CLOUD()),
+    input_target_kdtree_(new pcl::KdTreeFLANN<CloudData::POINT>()) {
+    SetRegistrationParam(res, truncation, num_neighbors, trans_eps, max_iter, num_threads);
+}
+
+bool DistanceFieldRegistration::SetRegistrationParam(
+    float res, float truncation, int num_neighbors, float trans_eps, int max_iter,
+    int num_threads
+) {
+    res_ = res;
+    truncation_ = truncation;
+    num_neighbors_ = std::max(num_neighbors, 3);
+    trans_eps_ = trans_eps;
+    max_iter_ = max_iter;
+
+    // num_threads <= 0 means use all available cores:
+#ifdef _OPENMP
+    num_threads_ = (num_threads > 0) ? num_threads : omp_get_max_threads();
+#else
+    num_threads_ = 1;
+#endif
+    thread_systems_.resize(num_threads_);
+
+    std::cout << "Distance field params:" << std::endl
+              << "res: " << res_ << ", "
+              << "truncation: " << truncation_ << ", "
+              << "num_neighbors: " << num_neighbors_ << ", "
+              << "trans_eps: " << trans_eps_ << ", "
+              << "max_iter: " << max_iter_ << ", "
+              << "num_threads: " << num_threads_
+              << std::endl << std::endl;
+
+    return true;
+}
+
+bool DistanceFieldRegistration::SetInputTarget(const CloudData::CLOUD_PTR& input_target) {
+    input_target_ = input_target;
+    has_target_kdtree_ = false;
+
+    if (is_prebuilt_) {
+        return true;
+    }
+
+    TRACE_SCOPE("DistanceFieldRegistration::SetInputTarget", "registration");
+    std::shared_ptr<Field> field_ptr = std::make_shared<Field>();
+    BuildField(input_target_, *field_ptr);
+    field_ptr_ = field_ptr;
+
+    return true;
+}
+
+bool DistanceFieldRegistration::ScanMatch(const CloudData::CLOUD_PTR& input_source,
+                                          const Eigen::Matrix4f& predict_pose,
+                                          CloudData::CLOUD_PTR& result_cloud_ptr,
+                                          Eigen::Matrix4f& result_pose) {
+    TRACE_SCOPE("DistanceFieldRegistration::ScanMatch", "registration");
+    input_source_ = input_source;
+
+    Eigen::Matrix4d pose = predict_pose.cast<double>();
+    LinearSystem system;
+    num_iterations_ = 0;
+    bool has_converged = false;
+    const int max_iter = max_iteration_limit_ < 0 ? max_iter_ : std::min(max_iter_, max_iteration_limit_);
+    for (int curr_iter = 0; curr_iter < max_iter; ++curr_iter) {
+        ++num_iterations_;
+        BuildLinearSystem(pose, system);
+        if (system.num_corr < 6) {
+            break;
+        }
+
+        // Gauss-Newton step:
+        const Vector6d delta = system.H.ldlt().solve(system.b);
+        if (!delta.allFinite()) {
+            break;
+        }
+
+        pose = UpdatePose(pose, delta);
+
+        if (delta.norm() < trans_eps_) {
+            has_converged = true;
+            break;
+        }
+    }
+
+    final_transformation_ = pose.cast<float>();
+
+    const int N = static_cast<int>(input_source_->points.size());
+    result_ = Result();
+    result_.num_iterations = num_iterations_;
+    result_.has_converged = has_converged;
+    result_.inlier_ratio = (N > 0) ? static_cast<float>(system.num_corr) / N : 0.0f;
+    if (system.num_corr > 0) {
+        result_.fitness_score = static_cast<float>(system.error / system.num_corr);
+    }
+    result_.has_hessian = (system.num_corr >= 6);
+    result_.hessian = system.H;
+
+    result_pose = final_transformation_;
+    pcl::transformPointCloud(*input_source_, *result_cloud_ptr, result_pose);
+
+    return true;
+}
+
+bool DistanceFieldRegistration::SetMaxIterationLimit(int max_iteration_limit) {
+    max_iteration_limit_ = max_iteration_limit;
+
+    return true;
+}
+
+int DistanceFieldRegistration::GetNumIterations() {
+    return num_iterations_;
+}
+
+RegistrationInterface::Result DistanceFieldRegistration::GetResult() {
+    return result_;
+}
+
+int DistanceFieldRegistration::Linearize(
+    const CloudData::CLOUD_PTR& input_source,
+    const Eigen::Matrix4d& pose,
+    Eigen::Matrix<double, 6, 6>& H,
+    Eigen::Matrix<double, 6, 1>& b
+) {
+    TRACE_SCOPE("DistanceFieldRegistration::Linearize", "registration");
+    input_source_ = input_source;
+    // so that the fitness score is the one at the linearization point:
+    final_transformation_ = pose.cast<float>();
+
+    LinearSystem system;
+    BuildLinearSystem(pose, system);
+
+    H = system.H;
+    b = system.b;
+
+    return system.num_corr;
+}
+
+float DistanceFieldRegistration::GetFitnessScore() {
+    // same definition as pcl::Registration::getFitnessScore,
+    // i.e., mean squared distance from aligned source to nearest target point.
+    // the kd-tree is only built here, so matching never pays for it:
+    if (!has_target_kdtree_) {
+        input_target_kdtree_->setInputCloud(input_target_);
+        has_target_kdtree_ = true;
+    }
+
+    const Eigen::Matrix3f R = final_transformation_.block<3, 3>(0, 0);
+    const Eigen::Vector3f t = final_transformation_.block<3, 1>(0, 3);
+    const int N = static_cast<int>(input_source_->points.size());
+
+    double sum_sq_dis = 0.0;
+    int num_corr = 0;
+#pragma omp parallel num_threads(num_threads_) reduction(+:sum_sq_dis, num_corr)
+    {
+        std::vector<int> corr_ind(1);
+        std::vector<float> corr_sq_dis(1);
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < N; ++i) {
+            CloudData::POINT point = input_source_->points[i];
+            point.getVector3fMap() = R * point.getVector3fMap() + t;
+
+            if (input_target_kdtree_->nearestKSearch(point, 1, corr_ind, corr_sq_dis) > 0) {
+                sum_sq_dis += corr_sq_dis.at(0);
+                ++num_corr;
+            }
+        }
+    }
+
+    return (num_corr > 0) ? static_cast<float>(sum_sq_dis / num_corr) : std::numeric_limits<float>::max();
+}
+
+bool DistanceFieldRegistration::SaveTarget(const std::string& file_path) const {
+    if (!field_ptr_) {
+        LOG(ERROR) << "No distance field to save.";
+        return false;
+    }
+    const Field &field = *field_ptr_;
+
+    // in key order, so the same target always gives the same file:
+    std::vector<std::pair<int64_t, int>> keyed_blocks(field.block_index.begin(), field.block_index.end());
+    std::sort(keyed_blocks.begin(), keyed_blocks.end());
+
+    FieldHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, FIELD_MAGIC, sizeof(header.magic));
+    header.version = FIELD_VERSION;
+    header.header_size = sizeof(header);
+    header.record_size = sizeof(int64_t) + sizeof(Block);
+    header.block_size = BLOCK_SIZE;
+    header.res = field.res;
+    header.truncation = field.truncation;
+    header.num_blocks = keyed_blocks.size();
+
+    FILE *output_fptr = fopen(file_path.c_str(), "wb");
+    if (!output_fptr) {
+        LOG(ERROR) << "Cannot write distance field " << file_path;
+        return false;
+    }
+
+    bool success = (1 == fwrite(&header, sizeof(header), 1, output_fptr));
+    for (size_t i = 0; success && i < keyed_blocks.size(); ++i) {
+        success = (
+            1 == fwrite(&keyed_blocks[i].first, sizeof(int64_t), 1, output_fptr) &&
+            1 == fwrite(&field.blocks[keyed_blocks[i].second], sizeof(Block), 1, output_fptr)
+        );
+    }
+
+    return (0 == fclose(output_fptr)) && success;
+}
+
+bool DistanceFieldRegistration::LoadTarget(const std::string& file_path) {
+    // shared by the instances of the process, e.g. the relocalization ones, while any of them holds it:
+    static std::mutex mutex;
+    static std::map<std::string, std::weak_ptr<const Field>> fields;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<const Field> field_ptr = fields[file_path].lock();
+
+    if (!field_ptr) {
+        FILE *input_fptr = fopen(file_path.c_str(), "rb");
+        if (!input_fptr) {
+            LOG(ERROR) << "Cannot read distance field " << file_path;
+            return false;
+        }
+
+        FieldHeader header;
+        std::shared_ptr<Field> new_field_ptr = std::make_shared<Field>();
+        bool success = (1 == fread(&header, sizeof(header), 1, input_fptr));
+        if (
+            success && (
+                0 != std::memcmp(header.magic, FIELD_MAGIC, sizeof(header.magic)) ||
+                FIELD_VERSION != header.version ||
+                sizeof(header) != header.header_size ||
+                sizeof(int64_t) + sizeof(Block) != header.record_size ||
+                BLOCK_SIZE != header.block_size
+            )
+        ) {
+            LOG(ERROR) << "Distance field " << file_path << " is not of version " << FIELD_VERSION;
+            success = false;
+        }
+        if (success) {
+            new_field_ptr->res = header.res;
+            new_field_ptr->truncation = header.truncation;
+            new_field_ptr->blocks.resize(header.num_blocks);
+            new_field_ptr->block_index.reserve(header.num_blocks);
+            for (size_t i = 0; success && i < new_field_ptr->blocks.size(); ++i) {
+                int64_t key;
+                success = (
+                    1 == fread(&key, sizeof(int64_t), 1, input_fptr) &&
+                    1 == fread(&new_field_ptr->blocks[i], sizeof(Block), 1, input_fptr)
+                );
+                new_field_ptr->block_index.emplace(key, static_cast<int>(i));
+            }
+            if (!success) {
+                LOG(ERROR) << "Distance field " << file_path << " is truncated.";
+            }
+        }
+        fclose(input_fptr);
+        if (!success) {
+            return false;
+        }
+
+        field_ptr = new_field_ptr;
+        fields[file_path] = field_ptr;
+    }
+
+    // cell keys are only meaningful at the resolution they were built with:
+    if (std::fabs(field_ptr->res - res_) > 1.0e-6f) {
+        LOG(ERROR) << "Distance field " << file_path << " has resolution " << field_ptr->res
+                   << ", expected " << res_;
+        return false;
+    }
+
+    field_ptr_ = field_ptr;
+    is_prebuilt_ = true;
+
+    LOG(INFO) << "Load distance field " << file_path << ", num. blocks: " << field_ptr_->blocks.size();
+
+    return true;
+}
+
+void DistanceFieldRegistration::ComputeNormals(
+    const CloudData::CLOUD_PTR& input_target,
+    std::vector<Eigen::Vector3f>& normals, std::vector<char>& is_valid
+) const {
+    pcl::KdTreeFLANN<CloudData::POINT> kdtree;
+    kdtree.setInputCloud(input_target);
+
+    const int N = static_cast<int>(input_target->points.size());
+    normals.assign(N, Eigen::Vector3f::UnitZ());
+    is_valid.assign(N, 0);
+
+#pragma omp parallel num_threads(num_threads_)
+    {
+        std::vector<int> corr_ind(num_neighbors_);
+        std::vector<float> corr_sq_dis(num_neighbors_);
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < N; ++i) {
+            const int num_found = kdtree.nearestKSearch(input_target->points[i], num_neighbors_, corr_ind, corr_sq_dis);
+            if (num_found < 3) {
+                continue;
+            }
+
+            Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+            Eigen::Matrix3d sum_sq = Eigen::Matrix3d::Zero();
+            for (int k = 0; k < num_found; ++k) {
+                const Eigen::Vector3d p = input_target->points[corr_ind[k]].getVector3fMap().cast<double>();
+                sum += p;
+                sum_sq.noalias() += p * p.transpose();
+            }
+            const Eigen::Vector3d mean = sum / num_found;
+            const Eigen::Matrix3d cov = (sum_sq - num_found * mean * mean.transpose()) / num_found;
+
+            Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eigen_solver(cov);
+            const Eigen::Vector3d eigen_values = eigen_solver.eigenvalues();
+            if (eigen_values(0) > MAX_PLANARITY_RATIO * eigen_values(1)) {
+                continue;
+            }
+
+            normals[i] = eigen_solver.eigenvectors().col(0).cast<float>();
+            is_valid[i] = 1;
+        }
+    }
+}
+
+void DistanceFieldRegistration::BuildField(const CloudData::CLOUD_PTR& input_target, Field& field) const {
+    field.res = res_;
+    field.truncation = truncation_;
+    field.blocks.clear();
+    field.block_index.clear();
+
+    std::vector<Eigen::Vector3f> normals;
+    std::vector<char> is_valid;
+    ComputeNormals(input_target, normals, is_valid);
+
+    Block empty_block;
+    for (Cell &cell: empty_block.cells) {
+        cell.distance = std::numeric_limits<float>::quiet_NaN();
+        cell.gradient[0] = cell.gradient[1] = cell.gradient[2] = 0.0f;
+    }
+
+    // squared distance of each cell center to its nearest target point so far:
+    std::vector<std::vector<float>> block_sq_distances;
+
+    const int radius = static_cast<int>(std::ceil(truncation_ / res_));
+    const float sq_truncation = truncation_ * truncation_;
+    for (size_t i = 0; i < input_target->points.size(); ++i) {
+        if (!is_valid[i]) {
+            continue;
+        }
+
+        const Eigen::Vector3f point = input_target->points[i].getVector3fMap();
+        const Eigen::Vector3f &normal = normals[i];
+        const Eigen::Vector3i index(
+            static_cast<int>(std::floor(point.x() / res_)),
+            static_cast<int>(std::floor(point.y() / res_)),
+            static_cast<int>(std::floor(point.z() / res_))
+        );
+
+        for (int dx = -radius; dx <= radius; ++dx) {
+            for (int dy = -radius; dy <= radius; ++dy) {
+                for (int dz = -radius; dz <= radius; ++dz) {
+                    const Eigen::Vector3i cell_index = index + Eigen::Vector3i(dx, dy, dz);
+                    const Eigen::Vector3f center = (cell_index.cast<float>() + Eigen::Vector3f::Constant(0.5f)) * res_;
+                    const float sq_distance = (center - point).squaredNorm();
+                    if (sq_distance > sq_truncation) {
+                        continue;
+                    }
+
+                    const Eigen::Vector3i block_index(
+                        static_cast<int>(std::floor(static_cast<float>(cell_index.x()) / BLOCK_SIZE)),
+                        static_cast<int>(std::floor(static_cast<float>(cell_index.y()) / BLOCK_SIZE)),
+                        static_cast<int>(std::floor(static_cast<float>(cell_index.z()) / BLOCK_SIZE))
+                    );
+                    auto block = field.block_index.find(GetBlockKey(block_index));
+                    if (block == field.block_index.end()) {
+                        block = field.block_index.emplace(GetBlockKey(block_index), static_cast<int>(field.blocks.size())).first;
+                        field.blocks.push_back(empty_block);
+                        block_sq_distances.push_back(std::vector<float>(NUM_BLOCK_CELLS, std::numeric_limits<float>::max()));
+                    }
+
+                    const Eigen::Vector3i local_index = cell_index - BLOCK_SIZE * block_index;
+                    const int cell_id = (local_index.x() * BLOCK_SIZE + local_index.y()) * BLOCK_SIZE + local_index.z();
+                    float &min_sq_distance = block_sq_distances[block->second][cell_id];
+                    if (sq_distance >= min_sq_distance) {
+                        continue;
+                    }
+
+                    // the tangent plane of the nearest target point:
+                    min_sq_distance = sq_distance;
+                    Cell &cell = field.blocks[block->second].cells[cell_id];
+                    cell.distance = normal.dot(center - point);
+                    cell.gradient[0] = normal.x();
+                    cell.gradient[1] = normal.y();
+                    cell.gradient[2] = normal.z();
+                }
+            }
+        }
+    }
+
+    LOG(INFO) << "Distance field of " << input_target->points.size() << " points, "
+              << "num. blocks: " << field.blocks.size();
+}
+
+int64_t DistanceFieldRegistration::GetBlockKey(const Eigen::Vector3i &index) {
+    // 21 bits per axis:
+    static const int64_t OFFSET = (1 << 20);
+    static const int64_t MASK = (1 << 21) - 1;
+
+    return (
+        (((index.x() + OFFSET) & MASK) << 42) |
+        (((index.y() + OFFSET) & MASK) << 21) |
+        ((index.z() + OFFSET) & MASK)
+    );
+}
+
+const DistanceFieldRegistration::Cell* DistanceFieldRegistration::GetCell(
+    const Eigen::Vector3f &point, Eigen::Vector3f &center
+) const {
+    const Eigen::Vector3i cell_index(
+        static_cast<int>(std::floor(point.x() / res_)),
+        static_cast<int>(std::floor(point.y() / res_)),
+        static_cast<int>(std::floor(point.z() / res_))
+    );
+    const Eigen::Vector3i block_index(
+        static_cast<int>(std::floor(static_cast<float>(cell_index.x()) / BLOCK_SIZE)),
+        static_cast<int>(std::floor(static_cast<float>(cell_index.y()) / BLOCK_SIZE)),
+        static_cast<int>(std::floor(static_cast<float>(cell_index.z()) / BLOCK_SIZE))
+    );
+
+    auto block = field_ptr_->block_index.find(GetBlockKey(block_index));
+    if (block == field_ptr_->block_index.end()) {
+        return nullptr;
+    }
+
+    const Eigen::Vector3i local_index = cell_index - BLOCK_SIZE * block_index;
+    const Cell &cell = field_ptr_->blocks[block->second].cells[
+        (local_index.x() * BLOCK_SIZE + local_index.y()) * BLOCK_SIZE + local_index.z()
+    ];
+    if (std::isnan(cell.distance)) {
+        return nullptr;
+    }
+
+    center = (cell_index.cast<float>() + Eigen::Vector3f::Constant(0.5f)) * res_;
+
+    return &cell;
+}
+
+void DistanceFieldRegistration::BuildLinearSystem(const Eigen::Matrix4d &pose, LinearSystem &system) {
+    system.Reset();
+    if (!field_ptr_) {
+        return;
+    }
+
+    const Eigen::Matrix3d R = pose.block<3, 3>(0, 0);
+    const Eigen::Vector3d t = pose.block<3, 1>(0, 3);
+    const double truncation = field_ptr_->truncation;
+    const int N = static_cast<int>(input_source_->points.size());
+
+#pragma omp parallel num_threads(num_threads_)
+    {
+#ifdef _OPENMP
+        LinearSystem &partial = thread_systems_.at(omp_get_thread_num());
+#else
+        LinearSystem &partial = thread_systems_.at(0);
+#endif
+        partial.Reset();
+
+        Vector6d J;
+        Eigen::Vector3f center;
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < N; ++i) {
+            const Eigen::Vector3d point = R * input_source_->points[i].getVector3fMap().cast<double>() + t;
+
+            const Cell* cell = GetCell(point.cast<float>(), center);
+            if (cell == nullptr) {
+                continue;
+            }
+
+            // signed distance to the tangent plane, first order from the cell center:
+            const Eigen::Vector3d gradient(cell->gradient[0], cell->gradient[1], cell->gradient[2]);
+            const double r = -(cell->distance + gradient.dot(point - center.cast<double>()));
+            if (std::fabs(r) > truncation) {
+                continue;
+            }
+
+            // negated jacobian w.r.t. left perturbation [delta_t, delta_theta], so the step solves H * delta = b:
+            J.head<3>() = gradient;
+            J.tail<3>() = point.cross(gradient);
+
+            partial.error += r * r;
+            ++partial.num_corr;
+            partial.b.noalias() += J * r;
+            partial.H.noalias() += J * J.transpose();
+        }
+    }
+
+    // reduce in thread order, so the result is deterministic:
+    for (const auto &partial: thread_systems_) {
+        system.error += partial.error;
+        system.num_corr += partial.num_corr;
+        system.b += partial.b;
+        system.H += partial.H;
+    }
+}
+
+Eigen::Matrix4d DistanceFieldRegistration::UpdatePose(const Eigen::Matrix4d &pose, const Vector6d &delta) {
+    const Eigen::Vector3d delta_theta = delta.tail<3>();
+    const double angle = delta_theta.norm();
+
+    Eigen::Matrix3d delta_R = Eigen::Matrix3d::Identity();
+    if (angle > 1.0e-10) {
+        delta_R = Eigen::AngleAxisd(angle, delta_theta / angle).toRotationMatrix();
+    }
+
+    Eigen::Matrix4d updated_pose = Eigen::Matrix4d::Identity();
+    updated_pose.block<3, 3>(0, 0) = delta_R * pose.block<3, 3>(0, 0);
+    updated_pose.block<3, 1>(0, 3) = delta_R * pose.block<3, 1>(0, 3) + delta.head<3>();
+
+    return updated_pose;
+}
+
+void DistanceFieldRegistration::LinearSystem::Reset(void) {
+    error = 0.0;
+    num_corr = 0;
+    b.setZero();
+    H.setZero();
+}
+
+}
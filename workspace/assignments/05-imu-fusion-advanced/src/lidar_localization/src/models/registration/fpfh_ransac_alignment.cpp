@@ -0,0 +1,212 @@
+/*
+ * @Description: global pre-alignment by FPFH correspondences & RANSAC, to seed a local registration
+ * @Author: Ge Yao
+ * @Date: 2021-01-20 20:48:16
+ */
+#include "lidar_localization/models/registration/fpfh_ransac_alignment.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <iostream>
+
+#include <pcl/filters/voxel_grid.h>
+#include <pcl/features/normal_3d.h>
+#include <pcl/features/fpfh.h>
+#include <pcl/kdtree/kdtree_flann.h>
+#include <pcl/search/kdtree.h>
+
+#include <Eigen/Geometry>
+
+namespace lidar_localization {
+
+FPFHRansacAlignment::FPFHRansacAlignment(const YAML::Node& node) {
+    leaf_size_ = node["leaf_size"].as<float>();
+    normal_radius_ = node["normal_radius"].as<float>();
+    feature_radius_ = node["feature_radius"].as<float>();
+    max_iterations_ = std::max(node["max_iterations"].as<int>(), 1);
+    confidence_ = std::min(std::max(node["confidence"].as<float>(), 0.0f), 0.9999f);
+    inlier_threshold_ = node["inlier_threshold"].as<float>();
+    min_edge_similarity_ = node["min_edge_similarity"].as<float>();
+    min_num_inliers_ = std::max(node["min_num_inliers"].as<int>(), 3);
+    max_offset_ = node["max_offset"].as<float>();
+
+    std::cout << "FPFH RANSAC pre-alignment params:" << std::endl
+              << "\tleaf_size: " << leaf_size_ << ", "
+              << "normal_radius: " << normal_radius_ << ", "
+              << "feature_radius: " << feature_radius_ << std::endl
+              << "\tmax_iterations: " << max_iterations_ << ", "
+              << "confidence: " << confidence_ << ", "
+              << "inlier_threshold: " << inlier_threshold_ << ", "
+              << "min_num_inliers: " << min_num_inliers_ << ", "
+              << "max_offset: " << max_offset_ << std::endl
+              << std::endl;
+}
+
+void FPFHRansacAlignment::ComputeFeatures(const CloudData::CLOUD& cloud, Features& features) const {
+    TRACE_SCOPE("FPFHRansacAlignment::ComputeFeatures", "registration");
+
+    // a. downsample, x, y & z only:
+    pcl::PointCloud<pcl::PointXYZ>::Ptr xyz_cloud_ptr(new pcl::PointCloud<pcl::PointXYZ>());
+    xyz_cloud_ptr->points.reserve(cloud.points.size());
+    for (const CloudData::POINT& point: cloud.points) {
+        if (std::isfinite(point.x) && std::isfinite(point.y) && std::isfinite(point.z)) {
+            xyz_cloud_ptr->points.emplace_back(point.x, point.y, point.z);
+        }
+    }
+    xyz_cloud_ptr->width = xyz_cloud_ptr->points.size();
+    xyz_cloud_ptr->height = 1;
+
+    features.cloud_ptr.reset(new pcl::PointCloud<pcl::PointXYZ>());
+    pcl::VoxelGrid<pcl::PointXYZ> voxel_grid;
+    voxel_grid.setLeafSize(leaf_size_, leaf_size_, leaf_size_);
+    voxel_grid.setInputCloud(xyz_cloud_ptr);
+    voxel_grid.filter(*features.cloud_ptr);
+
+    // b. normals & features, single threaded as callers verify candidates in parallel:
+    pcl::search::KdTree<pcl::PointXYZ>::Ptr kdtree_ptr(new pcl::search::KdTree<pcl::PointXYZ>());
+
+    pcl::PointCloud<pcl::Normal>::Ptr normal_ptr(new pcl::PointCloud<pcl::Normal>());
+    pcl::NormalEstimation<pcl::PointXYZ, pcl::Normal> normal_estimation;
+    normal_estimation.setInputCloud(features.cloud_ptr);
+    normal_estimation.setSearchMethod(kdtree_ptr);
+    normal_estimation.setRadiusSearch(normal_radius_);
+    normal_estimation.compute(*normal_ptr);
+
+    features.feature_ptr.reset(new pcl::PointCloud<pcl::FPFHSignature33>());
+    pcl::FPFHEstimation<pcl::PointXYZ, pcl::Normal, pcl::FPFHSignature33> fpfh_estimation;
+    fpfh_estimation.setInputCloud(features.cloud_ptr);
+    fpfh_estimation.setInputNormals(normal_ptr);
+    fpfh_estimation.setSearchMethod(kdtree_ptr);
+    fpfh_estimation.setRadiusSearch(feature_radius_);
+    fpfh_estimation.compute(*features.feature_ptr);
+}
+
+FPFHRansacAlignment::Result FPFHRansacAlignment::Align(
+    const Features& source, const Features& target, const Eigen::Matrix4f& init_pose
+) const {
+    TRACE_SCOPE("FPFHRansacAlignment::Align", "registration");
+    Result result;
+
+    const int num_source = static_cast<int>(source.feature_ptr->points.size());
+    const int num_target = static_cast<int>(target.feature_ptr->points.size());
+    if (num_source < 3 || num_target < 3)
+        return result;
+
+    // a. mutual nearest neighbors in feature space. features of points without enough neighbors are NaN:
+    auto is_valid = [](const pcl::FPFHSignature33& feature) { return std::isfinite(feature.histogram[0]); };
+
+    pcl::KdTreeFLANN<pcl::FPFHSignature33> target_kdtree;
+    pcl::KdTreeFLANN<pcl::FPFHSignature33> source_kdtree;
+    target_kdtree.setInputCloud(target.feature_ptr);
+    source_kdtree.setInputCloud(source.feature_ptr);
+
+    std::vector<std::pair<int, int>> correspondences;
+    std::vector<int> indices(1);
+    std::vector<float> sq_distances(1);
+    for (int i = 0; i < num_source; ++i) {
+        const pcl::FPFHSignature33& feature = source.feature_ptr->points[i];
+        if (!is_valid(feature) || target_kdtree.nearestKSearch(feature, 1, indices, sq_distances) != 1)
+            continue;
+
+        const int j = indices[0];
+        if (source_kdtree.nearestKSearch(target.feature_ptr->points[j], 1, indices, sq_distances) != 1 || indices[0] != i)
+            continue;
+
+        correspondences.emplace_back(i, j);
+    }
+    result.num_correspondences = static_cast<int>(correspondences.size());
+
+    const int num_correspondences = result.num_correspondences;
+    if (num_correspondences < min_num_inliers_)
+        return result;
+
+    auto get_source = [&](int k) { return source.cloud_ptr->points[correspondences[k].first].getVector3fMap(); };
+    auto get_target = [&](int k) { return target.cloud_ptr->points[correspondences[k].second].getVector3fMap(); };
+
+    // b. RANSAC over 3-point samples:
+    const float sq_inlier_threshold = inlier_threshold_ * inlier_threshold_;
+    std::mt19937 random_engine(0);
+    std::uniform_int_distribution<int> distribution(0, num_correspondences - 1);
+
+    int best_num_inliers = 0;
+    Eigen::Matrix4f best_transform = Eigen::Matrix4f::Identity();
+    int num_iterations = max_iterations_;
+    int iteration = 0;
+    for (; iteration < num_iterations; ++iteration) {
+        int sample[3];
+        sample[0] = distribution(random_engine);
+        do { sample[1] = distribution(random_engine); } while (sample[1] == sample[0]);
+        do { sample[2] = distribution(random_engine); } while (sample[2] == sample[0] || sample[2] == sample[1]);
+
+        // rigid motions keep edge lengths, so a dissimilar sample is rejected before any pose:
+        bool is_similar = true;
+        Eigen::Matrix3f source_points, target_points;
+        for (int k = 0; k < 3; ++k) {
+            source_points.col(k) = get_source(sample[k]);
+            target_points.col(k) = get_target(sample[k]);
+        }
+        for (int k = 0; k < 3 && is_similar; ++k) {
+            const float source_edge = (source_points.col(k) - source_points.col((k + 1) % 3)).norm();
+            const float target_edge = (target_points.col(k) - target_points.col((k + 1) % 3)).norm();
+            is_similar = std::min(source_edge, target_edge) >= min_edge_similarity_ * std::max(source_edge, target_edge);
+        }
+        if (!is_similar)
+            continue;
+
+        const Eigen::Matrix4f transform = Eigen::umeyama(source_points, target_points, false);
+        const Eigen::Matrix3f R = transform.block<3, 3>(0, 0);
+        const Eigen::Vector3f t = transform.block<3, 1>(0, 3);
+
+        int num_inliers = 0;
+        for (int k = 0; k < num_correspondences; ++k) {
+            if ((R * get_source(k) + t - get_target(k)).squaredNorm() <= sq_inlier_threshold)
+                ++num_inliers;
+        }
+        if (num_inliers <= best_num_inliers)
+            continue;
+
+        best_num_inliers = num_inliers;
+        best_transform = transform;
+
+        // early exit, iterations needed to draw an all-inlier sample at the best inlier ratio so far:
+        const double inlier_ratio = static_cast<double>(num_inliers) / num_correspondences;
+        const double all_inlier_probability = inlier_ratio * inlier_ratio * inlier_ratio;
+        if (all_inlier_probability >= 1.0 - std::numeric_limits<double>::epsilon()) {
+            num_iterations = iteration + 1;
+        } else if (all_inlier_probability > 0.0) {
+            const double num_needed = std::log(1.0 - confidence_) / std::log(1.0 - all_inlier_probability);
+            num_iterations = std::min(num_iterations, static_cast<int>(std::ceil(num_needed)));
+        }
+    }
+    result.num_iterations = iteration;
+
+    if (best_num_inliers < min_num_inliers_)
+        return result;
+
+    // c. refit on all inliers of the best sample:
+    const Eigen::Matrix3f R = best_transform.block<3, 3>(0, 0);
+    const Eigen::Vector3f t = best_transform.block<3, 1>(0, 3);
+    Eigen::Matrix3Xf source_inliers(3, best_num_inliers), target_inliers(3, best_num_inliers);
+    int num_inliers = 0;
+    for (int k = 0; k < num_correspondences && num_inliers < best_num_inliers; ++k) {
+        if ((R * get_source(k) + t - get_target(k)).squaredNorm() <= sq_inlier_threshold) {
+            source_inliers.col(num_inliers) = get_source(k);
+            target_inliers.col(num_inliers) = get_target(k);
+            ++num_inliers;
+        }
+    }
+    result.pose = Eigen::umeyama(source_inliers, target_inliers, false);
+    result.num_inliers = num_inliers;
+
+    // d. a pose far from the prior is a symmetric or repetitive match, not a better seed:
+    result.is_found = (result.pose.block<3, 1>(0, 3) - init_pose.block<3, 1>(0, 3)).norm() <= max_offset_;
+
+    return result;
+}
+
+}
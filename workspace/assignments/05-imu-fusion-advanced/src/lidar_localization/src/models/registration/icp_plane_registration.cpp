@@ -0,0 +1,482 @@
+/*
+ * @Description: point-to-plane ICP registration with cached per-frame target normals
+ * @Author: Ge Yao
+ * @Date: 2020-12-28 21:15:08
+ */
+#include "lidar_localization/models/registration/icp_plane_registration.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include <pcl/common/transforms.h>
+
+#include <Eigen/Eigenvalues>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+// neighborhoods thinner than this, as the ratio of the middle to the largest eigenvalue, are lines, e.g. one ring:
+static const double MIN_LINEARITY_RATIO = 0.01;
+// neighborhoods thicker than this, as the ratio of the smallest to the middle eigenvalue, are not planes:
+static const double MAX_PLANARITY_RATIO = 0.1;
+
+ICPPlaneRegistration::ICPPlaneRegistration(const YAML::Node& node)
+    : input_target_(new CloudData::CLOUD()),
+      input_target_kdtree_(new pcl::KdTreeFLANN<CloudData::POINT>()) {
+    max_corr_dist_ = node["max_corr_dist"].as<float>();
+    trans_eps_ = node["trans_eps"].as<float>();
+    max_iter_ = node["max_iter"].as<int>();
+    int num_threads = node["num_threads"].as<int>();
+
+    const YAML::Node& range_image_node = node["range_image"];
+    range_image_param_.num_rows = range_image_node["num_rows"].as<int>();
+    range_image_param_.num_cols = range_image_node["num_cols"].as<int>();
+    range_image_param_.horizontal_resolution = range_image_node["horizontal_resolution"].as<float>();
+    range_image_param_.vertical_resolution = range_image_node["vertical_resolution"].as<float>();
+    range_image_param_.vertical_bottom = range_image_node["vertical_bottom"].as<float>();
+    range_image_param_.row_half_size = range_image_node["row_half_size"].as<int>();
+    range_image_param_.col_half_size = range_image_node["col_half_size"].as<int>();
+    range_image_param_.max_neighbor_distance = range_image_node["max_neighbor_distance"].as<float>();
+    range_image_param_.min_num_neighbors = std::max(range_image_node["min_num_neighbors"].as<int>(), 3);
+
+    // num_threads <= 0 means use all available cores:
+#ifdef _OPENMP
+    num_threads_ = (num_threads > 0) ? num_threads : omp_get_max_threads();
+#else
+    num_threads_ = 1;
+#endif
+    thread_systems_.resize(num_threads_);
+
+    std::cout << "Point-to-plane ICP params:" << std::endl
+              << "max_corr_dist: " << max_corr_dist_ << ", "
+              << "trans_eps: " << trans_eps_ << ", "
+              << "max_iter: " << max_iter_ << ", "
+              << "num_threads: " << num_threads_ << ", "
+              << "range image: " << range_image_param_.num_rows << "x" << range_image_param_.num_cols << ", "
+              << "neighbor window: " << 2 * range_image_param_.row_half_size + 1 << "x" << 2 * range_image_param_.col_half_size + 1
+              << std::endl << std::endl;
+}
+
+bool ICPPlaneRegistration::SetInputTarget(const CloudData::CLOUD_PTR& input_target) {
+    // a full target replaces all cached frames:
+    target_frames_.clear();
+    target_voxels_.clear();
+
+    return AddTargetFrame(0, input_target);
+}
+
+bool ICPPlaneRegistration::AddTargetFrame(int frame_id, const CloudData::CLOUD_PTR& frame_cloud) {
+    if (target_frames_.count(frame_id) > 0) {
+        LOG(WARNING) << "Point-to-plane ICP target frame " << frame_id << " already exists.";
+        return false;
+    }
+
+    // normals are estimated only once, when the frame enters the target:
+    std::vector<TargetPoint> target_points;
+    ComputeNormals(frame_id, *frame_cloud, target_points);
+
+    TargetFrame &frame = target_frames_[frame_id];
+    frame.cloud = frame_cloud;
+    for (const TargetPoint &target_point: target_points) {
+        const int64_t key = GetVoxelKey(target_point.point);
+        target_voxels_[key].push_back(target_point);
+        frame.voxel_keys.push_back(key);
+    }
+    std::sort(frame.voxel_keys.begin(), frame.voxel_keys.end());
+    frame.voxel_keys.erase(std::unique(frame.voxel_keys.begin(), frame.voxel_keys.end()), frame.voxel_keys.end());
+
+    has_target_kdtree_ = false;
+
+    return true;
+}
+
+bool ICPPlaneRegistration::RemoveTargetFrame(int frame_id) {
+    auto frame = target_frames_.find(frame_id);
+    if (frame == target_frames_.end()) {
+        return false;
+    }
+
+    for (int64_t key: frame->second.voxel_keys) {
+        auto voxel = target_voxels_.find(key);
+        std::vector<TargetPoint> &points = voxel->second;
+        points.erase(
+            std::remove_if(
+                points.begin(), points.end(), 
+                [frame_id](const TargetPoint &target_point) { return target_point.frame_id == frame_id; }
+            ),
+            points.end()
+        );
+
+        if (points.empty()) {
+            target_voxels_.erase(voxel);
+        }
+    }
+    target_frames_.erase(frame);
+
+    has_target_kdtree_ = false;
+
+    return true;
+}
+
+bool ICPPlaneRegistration::ScanMatch(const CloudData::CLOUD_PTR& input_source,
+                                     const Eigen::Matrix4f& predict_pose,
+                                     CloudData::CLOUD_PTR& result_cloud_ptr,
+                                     Eigen::Matrix4f& result_pose) {
+    TRACE_SCOPE("ICPPlaneRegistration::ScanMatch", "registration");
+    input_source_ = input_source;
+
+    Eigen::Matrix4d pose = predict_pose.cast<double>();
+    LinearSystem system;
+    num_iterations_ = 0;
+    bool has_converged = false;
+    const int max_iter = max_iteration_limit_ < 0 ? max_iter_ : std::min(max_iter_, max_iteration_limit_);
+    for (int curr_iter = 0; curr_iter < max_iter; ++curr_iter) {
+        ++num_iterations_;
+        BuildLinearSystem(pose, system);
+        if (system.num_corr < 6) {
+            break;
+        }
+
+        // Gauss-Newton step:
+        const Vector6d delta = system.H.ldlt().solve(system.b);
+        if (!delta.allFinite()) {
+            break;
+        }
+
+        pose = UpdatePose(pose, delta);
+
+        if (delta.norm() < trans_eps_) {
+            has_converged = true;
+            break;
+        }
+    }
+
+    final_transformation_ = pose.cast<float>();
+
+    const int N = static_cast<int>(input_source_->points.size());
+    result_ = Result();
+    result_.num_iterations = num_iterations_;
+    result_.has_converged = has_converged;
+    result_.inlier_ratio = (N > 0) ? static_cast<float>(system.num_corr) / N : 0.0f;
+    if (system.num_corr > 0) {
+        result_.fitness_score = static_cast<float>(system.error / system.num_corr);
+    }
+    result_.has_hessian = (system.num_corr >= 6);
+    result_.hessian = system.H;
+
+    result_pose = final_transformation_;
+    pcl::transformPointCloud(*input_source_, *result_cloud_ptr, result_pose);
+
+    return true;
+}
+
+bool ICPPlaneRegistration::SetMaxIterationLimit(int max_iteration_limit) {
+    max_iteration_limit_ = max_iteration_limit;
+
+    return true;
+}
+
+int ICPPlaneRegistration::GetNumIterations() {
+    return num_iterations_;
+}
+
+RegistrationInterface::Result ICPPlaneRegistration::GetResult() {
+    return result_;
+}
+
+float ICPPlaneRegistration::GetFitnessScore() {
+    // same definition as pcl::Registration::getFitnessScore,
+    // i.e., mean squared distance from aligned source to nearest target point.
+    // target frames are only concatenated here, so matching never pays for it:
+    if (!has_target_kdtree_) {
+        input_target_.reset(new CloudData::CLOUD());
+        for (const auto &frame: target_frames_) {
+            *input_target_ += *frame.second.cloud;
+        }
+        input_target_kdtree_->setInputCloud(input_target_);
+        has_target_kdtree_ = true;
+    }
+
+    const Eigen::Matrix3f R = final_transformation_.block<3, 3>(0, 0);
+    const Eigen::Vector3f t = final_transformation_.block<3, 1>(0, 3);
+    const int N = static_cast<int>(input_source_->points.size());
+
+    double sum_sq_dis = 0.0;
+    int num_corr = 0;
+#pragma omp parallel num_threads(num_threads_) reduction(+:sum_sq_dis, num_corr)
+    {
+        std::vector<int> corr_ind(1);
+        std::vector<float> corr_sq_dis(1);
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < N; ++i) {
+            CloudData::POINT point = input_source_->points[i];
+            point.getVector3fMap() = R * point.getVector3fMap() + t;
+
+            if (input_target_kdtree_->nearestKSearch(point, 1, corr_ind, corr_sq_dis) > 0) {
+                sum_sq_dis += corr_sq_dis.at(0);
+                ++num_corr;
+            }
+        }
+    }
+
+    return (num_corr > 0) ? static_cast<float>(sum_sq_dis / num_corr) : std::numeric_limits<float>::max();
+}
+
+void ICPPlaneRegistration::GetRangeImage(const CloudData::CLOUD& cloud, RangeImage& range_image) const {
+    const int N = static_cast<int>(cloud.points.size());
+    range_image.point_pixels.assign(N, -1);
+
+    // an organized cloud is its own range image:
+    if (cloud.height > 1 && static_cast<size_t>(cloud.width) * cloud.height == cloud.points.size()) {
+        range_image.num_rows = static_cast<int>(cloud.height);
+        range_image.num_cols = static_cast<int>(cloud.width);
+        range_image.is_wrapped = false;
+        range_image.pixel_points.assign(N, -1);
+
+        for (int i = 0; i < N; ++i) {
+            if (std::isfinite(cloud.points[i].x)) {
+                range_image.point_pixels[i] = i;
+                range_image.pixel_points[i] = i;
+            }
+        }
+
+        return;
+    }
+
+    // otherwise project in the scan frame, as LINS image_projection_node:
+    const RangeImageParam &param = range_image_param_;
+    range_image.num_rows = param.num_rows;
+    range_image.num_cols = param.num_cols;
+    range_image.is_wrapped = true;
+    range_image.pixel_points.assign(param.num_rows * param.num_cols, -1);
+    std::vector<float> pixel_ranges(param.num_rows * param.num_cols, std::numeric_limits<float>::max());
+
+    const Eigen::Matrix3f R = cloud.sensor_orientation_.toRotationMatrix().transpose();
+    const Eigen::Vector3f t = -R * cloud.sensor_origin_.head<3>();
+    for (int i = 0; i < N; ++i) {
+        const Eigen::Vector3f point = R * cloud.points[i].getVector3fMap() + t;
+        if (!point.allFinite())
+            continue;
+
+        const float range = point.norm();
+        const float vertical_angle = std::atan2(point.z(), point.head<2>().norm()) * 180.0f / M_PI;
+        const int row = static_cast<int>((vertical_angle + param.vertical_bottom) / param.vertical_resolution);
+        if (row < 0 || row >= param.num_rows)
+            continue;
+
+        const float horizontal_angle = std::atan2(point.x(), point.y()) * 180.0f / M_PI;
+        int col = -static_cast<int>(std::round((horizontal_angle - 90.0f) / param.horizontal_resolution)) + param.num_cols / 2;
+        if (col >= param.num_cols)
+            col -= param.num_cols;
+        if (col < 0 || col >= param.num_cols)
+            continue;
+
+        const int pixel = row * param.num_cols + col;
+        range_image.point_pixels[i] = pixel;
+        if (range < pixel_ranges[pixel]) {
+            pixel_ranges[pixel] = range;
+            range_image.pixel_points[pixel] = i;
+        }
+    }
+}
+
+void ICPPlaneRegistration::ComputeNormals(int frame_id, const CloudData::CLOUD& cloud, std::vector<TargetPoint>& target_points) const {
+    RangeImage range_image;
+    GetRangeImage(cloud, range_image);
+
+    const RangeImageParam &param = range_image_param_;
+    const float max_sq_distance = param.max_neighbor_distance * param.max_neighbor_distance;
+    const int N = static_cast<int>(cloud.points.size());
+
+    std::vector<TargetPoint> frame_points(N);
+    std::vector<char> is_valid(N, 0);
+#pragma omp parallel for num_threads(num_threads_) schedule(static)
+    for (int i = 0; i < N; ++i) {
+        const int pixel = range_image.point_pixels[i];
+        if (pixel < 0)
+            continue;
+
+        const Eigen::Vector3f point = cloud.points[i].getVector3fMap();
+        const int row = pixel / range_image.num_cols;
+        const int col = pixel % range_image.num_cols;
+
+        // the point itself and its neighbors in the window, close enough in 3D:
+        int num_neighbors = 1;
+        Eigen::Vector3d sum = point.cast<double>();
+        Eigen::Matrix3d sum_sq = sum * sum.transpose();
+        for (int r = std::max(row - param.row_half_size, 0); r <= std::min(row + param.row_half_size, range_image.num_rows - 1); ++r) {
+            for (int dc = -param.col_half_size; dc <= param.col_half_size; ++dc) {
+                int c = col + dc;
+                if (range_image.is_wrapped) {
+                    c = (c + range_image.num_cols) % range_image.num_cols;
+                } else if (c < 0 || c >= range_image.num_cols) {
+                    continue;
+                }
+
+                const int j = range_image.pixel_points[r * range_image.num_cols + c];
+                if (j < 0 || j == i)
+                    continue;
+
+                const Eigen::Vector3f neighbor = cloud.points[j].getVector3fMap();
+                if ((neighbor - point).squaredNorm() > max_sq_distance)
+                    continue;
+
+                const Eigen::Vector3d neighbor_d = neighbor.cast<double>();
+                ++num_neighbors;
+                sum += neighbor_d;
+                sum_sq.noalias() += neighbor_d * neighbor_d.transpose();
+            }
+        }
+        if (num_neighbors < param.min_num_neighbors)
+            continue;
+
+        const Eigen::Vector3d mean = sum / num_neighbors;
+        const Eigen::Matrix3d cov = (sum_sq - num_neighbors * mean * mean.transpose()) / num_neighbors;
+
+        Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eigen_solver(cov);
+        const Eigen::Vector3d eigen_values = eigen_solver.eigenvalues();
+        if (
+            eigen_values(1) < MIN_LINEARITY_RATIO * eigen_values(2) || 
+            eigen_values(0) > MAX_PLANARITY_RATIO * eigen_values(1)
+        ) {
+            continue;
+        }
+
+        frame_points[i].frame_id = frame_id;
+        frame_points[i].point = point;
+        frame_points[i].normal = eigen_solver.eigenvectors().col(0).cast<float>();
+        is_valid[i] = 1;
+    }
+
+    target_points.clear();
+    for (int i = 0; i < N; ++i) {
+        if (is_valid[i])
+            target_points.push_back(frame_points[i]);
+    }
+}
+
+int64_t ICPPlaneRegistration::GetVoxelKey(const Eigen::Vector3f &point) const {
+    // 21 bits per axis:
+    static const int64_t OFFSET = (1 << 20);
+    static const int64_t MASK = (1 << 21) - 1;
+
+    const int64_t x = static_cast<int64_t>(std::floor(point.x() / max_corr_dist_));
+    const int64_t y = static_cast<int64_t>(std::floor(point.y() / max_corr_dist_));
+    const int64_t z = static_cast<int64_t>(std::floor(point.z() / max_corr_dist_));
+
+    return (
+        (((x + OFFSET) & MASK) << 42) |
+        (((y + OFFSET) & MASK) << 21) |
+        ((z + OFFSET) & MASK)
+    );
+}
+
+const ICPPlaneRegistration::TargetPoint* ICPPlaneRegistration::GetCorrespondence(const Eigen::Vector3f &point) const {
+    const TargetPoint* nearest = nullptr;
+    float min_sq_distance = max_corr_dist_ * max_corr_dist_;
+
+    // voxels are max_corr_dist wide, so the 27 around the point cover the search radius:
+    for (int dx = -1; dx <= 1; ++dx) {
+        for (int dy = -1; dy <= 1; ++dy) {
+            for (int dz = -1; dz <= 1; ++dz) {
+                const Eigen::Vector3f offset(dx * max_corr_dist_, dy * max_corr_dist_, dz * max_corr_dist_);
+                auto voxel = target_voxels_.find(GetVoxelKey(point + offset));
+                if (voxel == target_voxels_.end())
+                    continue;
+
+                for (const TargetPoint &target_point: voxel->second) {
+                    const float sq_distance = (target_point.point - point).squaredNorm();
+                    if (sq_distance < min_sq_distance) {
+                        min_sq_distance = sq_distance;
+                        nearest = &target_point;
+                    }
+                }
+            }
+        }
+    }
+
+    return nearest;
+}
+
+void ICPPlaneRegistration::BuildLinearSystem(const Eigen::Matrix4d &pose, LinearSystem &system) {
+    const Eigen::Matrix3d R = pose.block<3, 3>(0, 0);
+    const Eigen::Vector3d t = pose.block<3, 1>(0, 3);
+    const int N = static_cast<int>(input_source_->points.size());
+
+#pragma omp parallel num_threads(num_threads_)
+    {
+#ifdef _OPENMP
+        LinearSystem &partial = thread_systems_.at(omp_get_thread_num());
+#else
+        LinearSystem &partial = thread_systems_.at(0);
+#endif
+        partial.Reset();
+
+        Vector6d J;
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < N; ++i) {
+            const Eigen::Vector3d point = R * input_source_->points[i].getVector3fMap().cast<double>() + t;
+
+            const TargetPoint* target_point = GetCorrespondence(point.cast<float>());
+            if (target_point == nullptr) {
+                continue;
+            }
+
+            // point-to-plane residual:
+            const Eigen::Vector3d normal = target_point->normal.cast<double>();
+            const double r = normal.dot(target_point->point.cast<double>() - point);
+
+            // jacobian w.r.t. left perturbation [delta_t, delta_theta]:
+            J.head<3>() = normal;
+            J.tail<3>() = point.cross(normal);
+
+            partial.error += r * r;
+            ++partial.num_corr;
+            partial.b.noalias() += J * r;
+            partial.H.noalias() += J * J.transpose();
+        }
+    }
+
+    // reduce in thread order, so the result is deterministic:
+    system.Reset();
+    for (const auto &partial: thread_systems_) {
+        system.error += partial.error;
+        system.num_corr += partial.num_corr;
+        system.b += partial.b;
+        system.H += partial.H;
+    }
+}
+
+Eigen::Matrix4d ICPPlaneRegistration::UpdatePose(const Eigen::Matrix4d &pose, const Vector6d &delta) {
+    const Eigen::Vector3d delta_theta = delta.tail<3>();
+    const double angle = delta_theta.norm();
+
+    Eigen::Matrix3d delta_R = Eigen::Matrix3d::Identity();
+    if (angle > 1.0e-10) {
+        delta_R = Eigen::AngleAxisd(angle, delta_theta / angle).toRotationMatrix();
+    }
+
+    Eigen::Matrix4d updated_pose = Eigen::Matrix4d::Identity();
+    updated_pose.block<3, 3>(0, 0) = delta_R * pose.block<3, 3>(0, 0);
+    updated_pose.block<3, 1>(0, 3) = delta_R * pose.block<3, 1>(0, 3) + delta.head<3>();
+
+    return updated_pose;
+}
+
+void ICPPlaneRegistration::LinearSystem::Reset(void) {
+    error = 0.0;
+    num_corr = 0;
+    b.setZero();
+    H.setZero();
+}
+
+}
@@ -0,0 +1,606 @@
+/*
+ * @Description: LOAM edge & plane feature registration with cached per-frame target features
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 21:52:40
+ */
+#include "lidar_localization/models/registration/loam_registration.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/task_scheduler.hpp"
+
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <algorithm>
+
+#include <pcl/common/transforms.h>
+
+#include <Eigen/Eigenvalues>
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+// num. of source features of one partial linear system:
+static const int BLOCK_SIZE = 256;
+
+LOAMRegistration::LOAMRegistration(const YAML::Node& node)
+    : target_edge_cloud_(new CloudData::CLOUD()),
+      target_plane_cloud_(new CloudData::CLOUD()),
+      target_edge_kdtree_(new pcl::KdTreeFLANN<CloudData::POINT>()),
+      target_plane_kdtree_(new pcl::KdTreeFLANN<CloudData::POINT>()),
+      source_edge_cloud_(new CloudData::CLOUD()),
+      source_plane_cloud_(new CloudData::CLOUD()),
+      input_target_(new CloudData::CLOUD()),
+      input_target_kdtree_(new pcl::KdTreeFLANN<CloudData::POINT>()) {
+    trans_eps_ = node["trans_eps"].as<float>();
+    max_iter_ = node["max_iter"].as<int>();
+
+    const YAML::Node& range_image_node = node["range_image"];
+    range_image_param_.num_rows = range_image_node["num_rows"].as<int>();
+    range_image_param_.num_cols = range_image_node["num_cols"].as<int>();
+    range_image_param_.horizontal_resolution = range_image_node["horizontal_resolution"].as<float>();
+    range_image_param_.vertical_resolution = range_image_node["vertical_resolution"].as<float>();
+    range_image_param_.vertical_bottom = range_image_node["vertical_bottom"].as<float>();
+
+    const YAML::Node& feature_node = node["feature"];
+    feature_param_.curvature_half_size = std::max(feature_node["curvature_half_size"].as<int>(), 1);
+    feature_param_.num_sectors = std::max(feature_node["num_sectors"].as<int>(), 1);
+    feature_param_.max_num_edges_per_sector = feature_node["max_num_edges_per_sector"].as<int>();
+    feature_param_.edge_threshold = feature_node["edge_threshold"].as<float>();
+    feature_param_.plane_threshold = feature_node["plane_threshold"].as<float>();
+    feature_param_.max_neighbor_distance = feature_node["max_neighbor_distance"].as<float>();
+    const float edge_leaf_size = feature_node["edge_leaf_size"].as<float>();
+    const float plane_leaf_size = feature_node["plane_leaf_size"].as<float>();
+    edge_filter_ptr_ = std::make_shared<FastVoxelFilter>(
+        edge_leaf_size, edge_leaf_size, edge_leaf_size, FastVoxelFilter::CENTROID
+    );
+    plane_filter_ptr_ = std::make_shared<FastVoxelFilter>(
+        plane_leaf_size, plane_leaf_size, plane_leaf_size, FastVoxelFilter::CENTROID
+    );
+
+    const YAML::Node& match_node = node["match"];
+    match_param_.num_neighbors = std::max(match_node["num_neighbors"].as<int>(), 3);
+    match_param_.max_neighbor_distance = match_node["max_neighbor_distance"].as<float>();
+    match_param_.min_edge_eigen_ratio = match_node["min_edge_eigen_ratio"].as<float>();
+    match_param_.max_plane_distance = match_node["max_plane_distance"].as<float>();
+    match_param_.huber_delta = match_node["huber_delta"].as<float>();
+
+    std::cout << "LOAM feature registration params:" << std::endl
+              << "trans_eps: " << trans_eps_ << ", "
+              << "max_iter: " << max_iter_ << ", "
+              << "range image: " << range_image_param_.num_rows << "x" << range_image_param_.num_cols << ", "
+              << "edge threshold: " << feature_param_.edge_threshold << ", "
+              << "plane threshold: " << feature_param_.plane_threshold << ", "
+              << "feature leaf sizes: " << edge_leaf_size << " / " << plane_leaf_size
+              << std::endl << std::endl;
+}
+
+bool LOAMRegistration::SetInputTarget(const CloudData::CLOUD_PTR& input_target) {
+    // a full target replaces all cached frames:
+    target_frames_.clear();
+
+    return AddTargetFrame(0, input_target);
+}
+
+bool LOAMRegistration::AddTargetFrame(int frame_id, const CloudData::CLOUD_PTR& frame_cloud) {
+    if (target_frames_.count(frame_id) > 0) {
+        LOG(WARNING) << "LOAM target frame " << frame_id << " already exists.";
+        return false;
+    }
+
+    // features are extracted only once, when the frame enters the target:
+    TargetFrame &frame = target_frames_[frame_id];
+    frame.cloud = frame_cloud;
+    ExtractFeatures(*frame_cloud, frame.edge_cloud, frame.plane_cloud);
+
+    has_target_features_ = false;
+    has_target_kdtree_ = false;
+
+    return true;
+}
+
+bool LOAMRegistration::RemoveTargetFrame(int frame_id) {
+    if (target_frames_.erase(frame_id) == 0) {
+        return false;
+    }
+
+    has_target_features_ = false;
+    has_target_kdtree_ = false;
+
+    return true;
+}
+
+bool LOAMRegistration::ScanMatch(const CloudData::CLOUD_PTR& input_source,
+                                 const Eigen::Matrix4f& predict_pose,
+                                 CloudData::CLOUD_PTR& result_cloud_ptr,
+                                 Eigen::Matrix4f& result_pose) {
+    TRACE_SCOPE("LOAMRegistration::ScanMatch", "registration");
+    input_source_ = input_source;
+    ExtractFeatures(*input_source_, source_edge_cloud_, source_plane_cloud_);
+    UpdateTargetFeatures();
+
+    Eigen::Matrix4d pose = predict_pose.cast<double>();
+    LinearSystem system;
+    num_iterations_ = 0;
+    bool has_converged = false;
+    const int max_iter = max_iteration_limit_ < 0 ? max_iter_ : std::min(max_iter_, max_iteration_limit_);
+    for (int curr_iter = 0; curr_iter < max_iter; ++curr_iter) {
+        ++num_iterations_;
+        BuildLinearSystem(pose, system);
+        if (system.num_corr < 6) {
+            break;
+        }
+
+        // Gauss-Newton step:
+        const Vector6d delta = system.H.ldlt().solve(system.b);
+        if (!delta.allFinite()) {
+            break;
+        }
+
+        pose = UpdatePose(pose, delta);
+
+        if (delta.norm() < trans_eps_) {
+            has_converged = true;
+            break;
+        }
+    }
+
+    final_transformation_ = pose.cast<float>();
+
+    const size_t num_features = source_edge_cloud_->points.size() + source_plane_cloud_->points.size();
+    result_ = Result();
+    result_.num_iterations = num_iterations_;
+    result_.has_converged = has_converged;
+    result_.inlier_ratio = (num_features > 0) ? static_cast<float>(system.num_corr) / num_features : 0.0f;
+    if (system.num_corr > 0) {
+        result_.fitness_score = static_cast<float>(system.error / system.num_corr);
+    }
+    result_.has_hessian = (system.num_corr >= 6);
+    result_.hessian = system.H;
+
+    result_pose = final_transformation_;
+    pcl::transformPointCloud(*input_source_, *result_cloud_ptr, result_pose);
+
+    return true;
+}
+
+bool LOAMRegistration::SetMaxIterationLimit(int max_iteration_limit) {
+    max_iteration_limit_ = max_iteration_limit;
+
+    return true;
+}
+
+int LOAMRegistration::GetNumIterations() {
+    return num_iterations_;
+}
+
+RegistrationInterface::Result LOAMRegistration::GetResult() {
+    return result_;
+}
+
+float LOAMRegistration::GetFitnessScore() {
+    // same definition as pcl::Registration::getFitnessScore,
+    // i.e., mean squared distance from aligned source to nearest target point.
+    // target frames are only concatenated here, so matching never pays for it:
+    if (!has_target_kdtree_) {
+        input_target_.reset(new CloudData::CLOUD());
+        for (const auto &frame: target_frames_) {
+            *input_target_ += *frame.second.cloud;
+        }
+        if (input_target_->points.empty()) {
+            return std::numeric_limits<float>::max();
+        }
+        input_target_kdtree_->setInputCloud(input_target_);
+        has_target_kdtree_ = true;
+    }
+
+    const Eigen::Matrix3f R = final_transformation_.block<3, 3>(0, 0);
+    const Eigen::Vector3f t = final_transformation_.block<3, 1>(0, 3);
+    const int N = static_cast<int>(input_source_->points.size());
+
+    using Partial = std::pair<double, int>;
+    const Partial sum = TaskScheduler::GetInstance().ParallelReduce(
+        0, N, 1024, Partial(0.0, 0),
+        [&](int begin, int end, Partial partial) {
+            std::vector<int> corr_ind(1);
+            std::vector<float> corr_sq_dis(1);
+            for (int i = begin; i < end; ++i) {
+                CloudData::POINT point = input_source_->points[i];
+                point.getVector3fMap() = R * point.getVector3fMap() + t;
+
+                if (input_target_kdtree_->nearestKSearch(point, 1, corr_ind, corr_sq_dis) > 0) {
+                    partial.first += corr_sq_dis.at(0);
+                    ++partial.second;
+                }
+            }
+            return partial;
+        },
+        [](const Partial& lhs, const Partial& rhs) {
+            return Partial(lhs.first + rhs.first, lhs.second + rhs.second);
+        }
+    );
+
+    return (sum.second > 0) ? static_cast<float>(sum.first / sum.second) : std::numeric_limits<float>::max();
+}
+
+void LOAMRegistration::GetRings(const CloudData::CLOUD& cloud, std::vector<std::vector<int>>& rings) const {
+    const RangeImageParam &param = range_image_param_;
+    const int N = static_cast<int>(cloud.points.size());
+
+    // project in the scan frame, as LINS image_projection_node:
+    std::vector<int> point_pixels(N, -1);
+    const Eigen::Matrix3f R = cloud.sensor_orientation_.toRotationMatrix().transpose();
+    const Eigen::Vector3f t = -R * cloud.sensor_origin_.head<3>();
+    TaskScheduler::GetInstance().ParallelFor(
+        0, N, 8192,
+        [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                const Eigen::Vector3f point = R * cloud.points[i].getVector3fMap() + t;
+                if (!point.allFinite())
+                    continue;
+
+#if defined(LIDAR_LOCALIZATION_POINT_XYZIRT)
+                const int row = static_cast<int>(cloud.points[i].ring);
+#else
+                const float vertical_angle = std::atan2(point.z(), point.head<2>().norm()) * 180.0f / M_PI;
+                const int row = static_cast<int>((vertical_angle + param.vertical_bottom) / param.vertical_resolution);
+#endif
+                if (row < 0 || row >= param.num_rows)
+                    continue;
+
+                const float horizontal_angle = std::atan2(point.x(), point.y()) * 180.0f / M_PI;
+                int col = -static_cast<int>(std::round((horizontal_angle - 90.0f) / param.horizontal_resolution)) + param.num_cols / 2;
+                if (col >= param.num_cols)
+                    col -= param.num_cols;
+                if (col < 0 || col >= param.num_cols)
+                    continue;
+
+                point_pixels[i] = row * param.num_cols + col;
+            }
+        }
+    );
+
+    // the closest point of each pixel, as the single return of the range image:
+    std::vector<int> pixel_points(param.num_rows * param.num_cols, -1);
+    std::vector<float> pixel_ranges(param.num_rows * param.num_cols, std::numeric_limits<float>::max());
+    for (int i = 0; i < N; ++i) {
+        const int pixel = point_pixels[i];
+        if (pixel < 0)
+            continue;
+
+        const float range = (cloud.points[i].getVector3fMap() - cloud.sensor_origin_.head<3>()).squaredNorm();
+        if (range < pixel_ranges[pixel]) {
+            pixel_ranges[pixel] = range;
+            pixel_points[pixel] = i;
+        }
+    }
+
+    rings.resize(param.num_rows);
+    for (int row = 0; row < param.num_rows; ++row) {
+        std::vector<int> &ring = rings[row];
+        ring.clear();
+        for (int col = 0; col < param.num_cols; ++col) {
+            const int i = pixel_points[row * param.num_cols + col];
+            if (i >= 0)
+                ring.push_back(i);
+        }
+    }
+}
+
+void LOAMRegistration::GetRingFeatures(
+    const CloudData::CLOUD& cloud, const std::vector<int>& ring,
+    std::vector<int>& edge_indices, std::vector<int>& plane_indices
+) const {
+    const FeatureParam &param = feature_param_;
+    const int K = param.curvature_half_size;
+    const int N = static_cast<int>(ring.size());
+    if (N < 2 * K + 1)
+        return;
+
+    // smoothness, as A-LOAM scanRegistration:
+    std::vector<float> curvatures(N, 0.0f);
+    for (int i = K; i < N - K; ++i) {
+        Eigen::Vector3f diff = -(2 * K) * cloud.points[ring[i]].getVector3fMap();
+        for (int j = i - K; j <= i + K; ++j) {
+            if (j != i)
+                diff += cloud.points[ring[j]].getVector3fMap();
+        }
+        curvatures[i] = diff.squaredNorm();
+    }
+
+    const float max_sq_neighbor_distance = param.max_neighbor_distance * param.max_neighbor_distance;
+    std::vector<char> is_picked(N, 0);
+    std::vector<char> is_edge(N, 0);
+    std::vector<int> sorted;
+    for (int sector = 0; sector < param.num_sectors; ++sector) {
+        const int begin = K + (N - 2 * K) * sector / param.num_sectors;
+        const int end = K + (N - 2 * K) * (sector + 1) / param.num_sectors;
+        if (end <= begin)
+            continue;
+
+        sorted.resize(end - begin);
+        for (int i = begin; i < end; ++i)
+            sorted[i - begin] = i;
+        std::sort(
+            sorted.begin(), sorted.end(),
+            [&curvatures](int lhs, int rhs) { return curvatures[lhs] < curvatures[rhs]; }
+        );
+
+        // sharpest first, the neighbors of a picked edge are not picked again:
+        int num_edges = 0;
+        for (auto it = sorted.rbegin(); it != sorted.rend() && num_edges < param.max_num_edges_per_sector; ++it) {
+            const int i = *it;
+            if (curvatures[i] <= param.edge_threshold)
+                break;
+            if (is_picked[i])
+                continue;
+
+            ++num_edges;
+            is_edge[i] = 1;
+            is_picked[i] = 1;
+            for (int l = 1; l <= K; ++l) {
+                const Eigen::Vector3f gap = cloud.points[ring[i + l]].getVector3fMap() - cloud.points[ring[i + l - 1]].getVector3fMap();
+                if (gap.squaredNorm() > max_sq_neighbor_distance)
+                    break;
+                is_picked[i + l] = 1;
+            }
+            for (int l = 1; l <= K; ++l) {
+                const Eigen::Vector3f gap = cloud.points[ring[i - l]].getVector3fMap() - cloud.points[ring[i - l + 1]].getVector3fMap();
+                if (gap.squaredNorm() > max_sq_neighbor_distance)
+                    break;
+                is_picked[i - l] = 1;
+            }
+        }
+
+        // all smooth points, as A-LOAM surfPointsLessFlat, which are decimated later:
+        for (int i: sorted) {
+            if (curvatures[i] >= param.plane_threshold)
+                break;
+            if (!is_edge[i])
+                plane_indices.push_back(ring[i]);
+        }
+    }
+
+    for (int i = K; i < N - K; ++i) {
+        if (is_edge[i])
+            edge_indices.push_back(ring[i]);
+    }
+}
+
+void LOAMRegistration::ExtractFeatures(
+    const CloudData::CLOUD& cloud,
+    CloudData::CLOUD_PTR& edge_cloud_ptr, CloudData::CLOUD_PTR& plane_cloud_ptr
+) {
+    std::vector<std::vector<int>> rings;
+    GetRings(cloud, rings);
+
+    const int num_rings = static_cast<int>(rings.size());
+    std::vector<std::vector<int>> ring_edges(num_rings), ring_planes(num_rings);
+    TaskScheduler::GetInstance().ParallelFor(
+        0, num_rings, 1,
+        [&](int begin, int end) {
+            for (int r = begin; r < end; ++r) {
+                GetRingFeatures(cloud, rings[r], ring_edges[r], ring_planes[r]);
+            }
+        }
+    );
+
+    CloudData::CLOUD_PTR edge_cloud(new CloudData::CLOUD());
+    CloudData::CLOUD_PTR plane_cloud(new CloudData::CLOUD());
+    for (int r = 0; r < num_rings; ++r) {
+        for (int i: ring_edges[r])
+            edge_cloud->points.push_back(cloud.points[i]);
+        for (int i: ring_planes[r])
+            plane_cloud->points.push_back(cloud.points[i]);
+    }
+    edge_cloud->width = edge_cloud->points.size();
+    edge_cloud->height = 1;
+    plane_cloud->width = plane_cloud->points.size();
+    plane_cloud->height = 1;
+
+    // into new clouds from the pool, as the target frames keep theirs:
+    edge_cloud_ptr.reset();
+    plane_cloud_ptr.reset();
+    edge_filter_ptr_->Filter(edge_cloud, edge_cloud_ptr);
+    plane_filter_ptr_->Filter(plane_cloud, plane_cloud_ptr);
+}
+
+void LOAMRegistration::UpdateTargetFeatures(void) {
+    if (has_target_features_)
+        return;
+
+    target_edge_cloud_.reset(new CloudData::CLOUD());
+    target_plane_cloud_.reset(new CloudData::CLOUD());
+    for (const auto &frame: target_frames_) {
+        *target_edge_cloud_ += *frame.second.edge_cloud;
+        *target_plane_cloud_ += *frame.second.plane_cloud;
+    }
+
+    if (!target_edge_cloud_->points.empty())
+        target_edge_kdtree_->setInputCloud(target_edge_cloud_);
+    if (!target_plane_cloud_->points.empty())
+        target_plane_kdtree_->setInputCloud(target_plane_cloud_);
+
+    has_target_features_ = true;
+}
+
+bool LOAMRegistration::GetEdgeCorrespondence(
+    const CloudData::POINT& point, std::vector<int>& indices, std::vector<float>& sq_distances,
+    Eigen::Vector3d& center, Eigen::Vector3d& direction
+) const {
+    const int K = match_param_.num_neighbors;
+    if (static_cast<int>(target_edge_cloud_->points.size()) < K)
+        return false;
+    if (
+        target_edge_kdtree_->nearestKSearch(point, K, indices, sq_distances) < K ||
+        sq_distances.back() > match_param_.max_neighbor_distance * match_param_.max_neighbor_distance
+    ) {
+        return false;
+    }
+
+    center.setZero();
+    for (int i: indices)
+        center += target_edge_cloud_->points[i].getVector3fMap().cast<double>();
+    center /= K;
+
+    Eigen::Matrix3d cov = Eigen::Matrix3d::Zero();
+    for (int i: indices) {
+        const Eigen::Vector3d diff = target_edge_cloud_->points[i].getVector3fMap().cast<double>() - center;
+        cov.noalias() += diff * diff.transpose();
+    }
+
+    // the neighbors are on a line if one direction dominates:
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eigen_solver(cov);
+    const Eigen::Vector3d eigen_values = eigen_solver.eigenvalues();
+    if (eigen_values(2) < match_param_.min_edge_eigen_ratio * eigen_values(1))
+        return false;
+
+    direction = eigen_solver.eigenvectors().col(2);
+
+    return true;
+}
+
+bool LOAMRegistration::GetPlaneCorrespondence(
+    const CloudData::POINT& point, std::vector<int>& indices, std::vector<float>& sq_distances,
+    Eigen::Vector3d& normal, double& d
+) const {
+    const int K = match_param_.num_neighbors;
+    if (static_cast<int>(target_plane_cloud_->points.size()) < K)
+        return false;
+    if (
+        target_plane_kdtree_->nearestKSearch(point, K, indices, sq_distances) < K ||
+        sq_distances.back() > match_param_.max_neighbor_distance * match_param_.max_neighbor_distance
+    ) {
+        return false;
+    }
+
+    // plane n * x + 1 = 0 by least squares, as A-LOAM laserMapping:
+    Eigen::MatrixXd A(K, 3);
+    for (int k = 0; k < K; ++k)
+        A.row(k) = target_plane_cloud_->points[indices[k]].getVector3fMap().cast<double>().transpose();
+    normal = A.colPivHouseholderQr().solve(-Eigen::VectorXd::Ones(K));
+
+    const double norm = normal.norm();
+    if (!std::isfinite(norm) || norm < 1.0e-10)
+        return false;
+    normal /= norm;
+    d = 1.0 / norm;
+
+    for (int k = 0; k < K; ++k) {
+        if (std::fabs(normal.dot(A.row(k).transpose()) + d) > match_param_.max_plane_distance)
+            return false;
+    }
+
+    return true;
+}
+
+void LOAMRegistration::BuildLinearSystem(const Eigen::Matrix4d &pose, LinearSystem &system) {
+    const Eigen::Matrix3d R = pose.block<3, 3>(0, 0);
+    const Eigen::Vector3d t = pose.block<3, 1>(0, 3);
+    const int num_edges = static_cast<int>(source_edge_cloud_->points.size());
+    const int N = num_edges + static_cast<int>(source_plane_cloud_->points.size());
+    const int num_blocks = (N + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    const double huber_delta = match_param_.huber_delta;
+
+    block_systems_.resize(num_blocks);
+    TaskScheduler::GetInstance().ParallelFor(
+        0, num_blocks, 1,
+        [&](int block_begin, int block_end) {
+            std::vector<int> indices;
+            std::vector<float> sq_distances;
+            Eigen::Matrix<double, 3, 6> J_edge;
+            Vector6d J_plane;
+
+            for (int block = block_begin; block < block_end; ++block) {
+                LinearSystem &partial = block_systems_[block];
+                partial.Reset();
+
+                for (int i = block * BLOCK_SIZE; i < std::min((block + 1) * BLOCK_SIZE, N); ++i) {
+                    const bool is_edge = (i < num_edges);
+                    CloudData::POINT point = is_edge ? source_edge_cloud_->points[i] : source_plane_cloud_->points[i - num_edges];
+                    const Eigen::Vector3d p = R * point.getVector3fMap().cast<double>() + t;
+                    point.getVector3fMap() = p.cast<float>();
+
+                    // left perturbation [delta_t, delta_theta] moves p by delta_t - [p]x * delta_theta:
+                    Eigen::Matrix3d p_hat;
+                    p_hat <<     0.0, -p.z(),  p.y(),
+                               p.z(),    0.0, -p.x(),
+                              -p.y(),  p.x(),    0.0;
+
+                    double sq_r;
+                    if (is_edge) {
+                        Eigen::Vector3d center, direction;
+                        if (!GetEdgeCorrespondence(point, indices, sq_distances, center, direction))
+                            continue;
+
+                        // point-to-line residual, as A-LOAM LidarEdgeFactor:
+                        Eigen::Matrix3d u_hat;
+                        u_hat <<            0.0, -direction.z(),  direction.y(),
+                                  direction.z(),            0.0, -direction.x(),
+                                 -direction.y(),  direction.x(),            0.0;
+                        const Eigen::Vector3d r = u_hat * (p - center);
+                        J_edge.leftCols<3>() = u_hat;
+                        J_edge.rightCols<3>() = -u_hat * p_hat;
+
+                        sq_r = r.squaredNorm();
+                        const double w = (sq_r > huber_delta * huber_delta) ? huber_delta / std::sqrt(sq_r) : 1.0;
+                        partial.b.noalias() -= w * J_edge.transpose() * r;
+                        partial.H.noalias() += w * J_edge.transpose() * J_edge;
+                    } else {
+                        Eigen::Vector3d normal;
+                        double d;
+                        if (!GetPlaneCorrespondence(point, indices, sq_distances, normal, d))
+                            continue;
+
+                        // point-to-plane residual, as A-LOAM LidarPlaneNormFactor:
+                        const double r = normal.dot(p) + d;
+                        J_plane.head<3>() = normal;
+                        J_plane.tail<3>() = p.cross(normal);
+
+                        sq_r = r * r;
+                        const double w = (std::fabs(r) > huber_delta) ? huber_delta / std::fabs(r) : 1.0;
+                        partial.b.noalias() -= w * J_plane * r;
+                        partial.H.noalias() += w * J_plane * J_plane.transpose();
+                    }
+
+                    partial.error += sq_r;
+                    ++partial.num_corr;
+                }
+            }
+        }
+    );
+
+    // reduce in block order, so the result is deterministic:
+    system.Reset();
+    for (const auto &partial: block_systems_) {
+        system.error += partial.error;
+        system.num_corr += partial.num_corr;
+        system.b += partial.b;
+        system.H += partial.H;
+    }
+}
+
+Eigen::Matrix4d LOAMRegistration::UpdatePose(const Eigen::Matrix4d &pose, const Vector6d &delta) {
+    const Eigen::Vector3d delta_theta = delta.tail<3>();
+    const double angle = delta_theta.norm();
+
+    Eigen::Matrix3d delta_R = Eigen::Matrix3d::Identity();
+    if (angle > 1.0e-10) {
+        delta_R = Eigen::AngleAxisd(angle, delta_theta / angle).toRotationMatrix();
+    }
+
+    Eigen::Matrix4d updated_pose = Eigen::Matrix4d::Identity();
+    updated_pose.block<3, 3>(0, 0) = delta_R * pose.block<3, 3>(0, 0);
+    updated_pose.block<3, 1>(0, 3) = delta_R * pose.block<3, 1>(0, 3) + delta.head<3>();
+
+    return updated_pose;
+}
+
+void LOAMRegistration::LinearSystem::Reset(void) {
+    error = 0.0;
+    num_corr = 0;
+    b.setZero();
+    H.setZero();
+}
+
+}
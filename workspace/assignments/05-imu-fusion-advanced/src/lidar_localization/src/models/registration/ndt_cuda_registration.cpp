@@ -0,0 +1,281 @@
+/*
+ * @Description: NDT registration with target voxelization and derivatives on the GPU
+ * @Author: Ge Yao
+ * @Date: 2020-12-29 10:31:12
+ */
+#include "lidar_localization/models/registration/ndt_cuda_registration.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+
+#ifdef LIDAR_LOCALIZATION_WITH_CUDA
+
+#include <cmath>
+#include <limits>
+
+#include <pcl/common/transforms.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+// same as NDTOMPRegistration:
+static const double OUTLIER_RATIO = 0.55;
+static const int MAX_BACKTRACKING = 4;
+
+NDTCUDARegistration::NDTCUDARegistration(const YAML::Node& node)
+    : input_target_kdtree_(new pcl::KdTreeFLANN<CloudData::POINT>()) {
+
+    float res = node["res"].as<float>();
+    float step_size = node["step_size"].as<float>();
+    float trans_eps = node["trans_eps"].as<float>();
+    int max_iter = node["max_iter"].as<int>();
+    std::string neighbor_search_method = node["neighbor_search_method"].as<std::string>();
+
+    SetRegistrationParam(res, step_size, trans_eps, max_iter, neighbor_search_method);
+}
+
+NDTCUDARegistration::NDTCUDARegistration(
+    float res, float step_size, float trans_eps, int max_iter,
+    const std::string &neighbor_search_method
+) : input_target_kdtree_(new pcl::KdTreeFLANN<CloudData::POINT>()) {
+    SetRegistrationParam(res, step_size, trans_eps, max_iter, neighbor_search_method);
+}
+
+bool NDTCUDARegistration::IsAvailable(void) {
+    return NDTCUDAKernels::IsDeviceAvailable();
+}
+
+bool NDTCUDARegistration::SetRegistrationParam(
+    float res, float step_size, float trans_eps, int max_iter,
+    const std::string &neighbor_search_method
+) {
+    res_ = res;
+    step_size_ = step_size;
+    trans_eps_ = trans_eps;
+    max_iter_ = max_iter;
+
+    if (neighbor_search_method == "DIRECT1") {
+        num_neighbors_ = 1;
+    } else {
+        if (neighbor_search_method != "DIRECT7") {
+            LOG(ERROR) << "NDT CUDA neighbor search method " << neighbor_search_method << " NOT FOUND! Fall back to DIRECT7.";
+        }
+        num_neighbors_ = 7;
+    }
+
+    // score function constants, follow pcl::NormalDistributionsTransform:
+    const double gauss_c1 = 10.0 * (1.0 - OUTLIER_RATIO);
+    const double gauss_c2 = OUTLIER_RATIO / std::pow(res_, 3);
+    const double gauss_d3 = -std::log(gauss_c2);
+    const double gauss_d1 = -std::log(gauss_c1 + gauss_c2) - gauss_d3;
+    const double gauss_d2 = -2.0 * std::log((-std::log(gauss_c1 * std::exp(-0.5) + gauss_c2) - gauss_d3) / gauss_d1);
+
+    kernels_.reset(new NDTCUDAKernels(res_, gauss_d1, gauss_d2, num_neighbors_));
+
+    std::cout << "NDT CUDA params:" << std::endl
+              << "res: " << res_ << ", "
+              << "step_size: " << step_size_ << ", "
+              << "trans_eps: " << trans_eps_ << ", "
+              << "max_iter: " << max_iter_ << ", "
+              << "neighbor_search_method: " << (num_neighbors_ == 1 ? "DIRECT1" : "DIRECT7")
+              << std::endl << std::endl;
+
+    return true;
+}
+
+void NDTCUDARegistration::PackPoints(const CloudData::CLOUD_PTR& cloud, std::vector<float> &points) {
+    const size_t N = cloud->points.size();
+
+    points.resize(3 * N);
+    for (size_t i = 0; i < N; ++i) {
+        points[3 * i + 0] = cloud->points[i].x;
+        points[3 * i + 1] = cloud->points[i].y;
+        points[3 * i + 2] = cloud->points[i].z;
+    }
+}
+
+bool NDTCUDARegistration::SetInputTarget(const CloudData::CLOUD_PTR& input_target) {
+    TRACE_SCOPE("NDTCUDARegistration::SetInputTarget", "registration");
+    input_target_ = input_target;
+    has_target_kdtree_ = false;
+
+    PackPoints(input_target_, points_);
+    if (!kernels_->SetTarget(points_.data(), static_cast<int>(input_target_->points.size()))) {
+        LOG(ERROR) << "NDT CUDA failed to voxelize target on device.";
+        return false;
+    }
+
+    return true;
+}
+
+bool NDTCUDARegistration::ScanMatch(const CloudData::CLOUD_PTR& input_source,
+                                    const Eigen::Matrix4f& predict_pose,
+                                    CloudData::CLOUD_PTR& result_cloud_ptr,
+                                    Eigen::Matrix4f& result_pose) {
+    TRACE_SCOPE("NDTCUDARegistration::ScanMatch", "registration");
+    input_source_ = input_source;
+
+    // the source is uploaded once, only the pose changes between evaluations:
+    PackPoints(input_source_, points_);
+    if (!kernels_->SetSource(points_.data(), static_cast<int>(input_source_->points.size()))) {
+        LOG(ERROR) << "NDT CUDA failed to upload source to device.";
+        return false;
+    }
+
+    Eigen::Matrix4d pose = predict_pose.cast<double>();
+    NDTCUDAKernels::Derivatives derivatives, candidate_derivatives;
+    if (!ComputeDerivatives(pose, derivatives)) {
+        return false;
+    }
+
+    num_iterations_ = 0;
+    bool has_converged = false;
+    const int max_iter = max_iteration_limit_ < 0 ? max_iter_ : std::min(max_iter_, max_iteration_limit_);
+    for (int curr_iter = 0; curr_iter < max_iter; ++curr_iter) {
+        ++num_iterations_;
+        // Gauss-Newton step:
+        Vector6d delta = GetHessian(derivatives).ldlt().solve(-Eigen::Map<const Vector6d>(derivatives.g));
+        if (!delta.allFinite()) {
+            break;
+        }
+
+        // limit step length, as step_size does for pcl::NormalDistributionsTransform:
+        const double delta_norm = delta.norm();
+        if (delta_norm > step_size_) {
+            delta *= step_size_ / delta_norm;
+        }
+
+        // backtrack until the score improves:
+        bool is_improved = false;
+        for (int i = 0; i < MAX_BACKTRACKING; ++i) {
+            const Eigen::Matrix4d candidate_pose = UpdatePose(pose, delta);
+            if (!ComputeDerivatives(candidate_pose, candidate_derivatives)) {
+                return false;
+            }
+
+            if (candidate_derivatives.score >= derivatives.score) {
+                pose = candidate_pose;
+                derivatives = candidate_derivatives;
+                is_improved = true;
+                break;
+            }
+
+            delta *= 0.5;
+        }
+
+        // converged once the step is small, or when no shorter step improves the score either:
+        if (!is_improved || delta.norm() < trans_eps_) {
+            has_converged = true;
+            break;
+        }
+    }
+
+    final_transformation_ = pose.cast<float>();
+
+    // derivatives are always those of the current pose:
+    const int N = static_cast<int>(input_source_->points.size());
+    result_ = Result();
+    result_.num_iterations = num_iterations_;
+    result_.has_converged = has_converged;
+    result_.inlier_ratio = (N > 0) ? static_cast<float>(derivatives.num_matched) / N : 0.0f;
+    if (derivatives.num_matched > 0) {
+        result_.fitness_score = static_cast<float>(derivatives.sum_sq_dis / derivatives.num_matched);
+    }
+    result_.has_hessian = true;
+    result_.hessian = GetHessian(derivatives);
+
+    result_pose = final_transformation_;
+    pcl::transformPointCloud(*input_source_, *result_cloud_ptr, result_pose);
+
+    return true;
+}
+
+bool NDTCUDARegistration::SetMaxIterationLimit(int max_iteration_limit) {
+    max_iteration_limit_ = max_iteration_limit;
+
+    return true;
+}
+
+int NDTCUDARegistration::GetNumIterations() {
+    return num_iterations_;
+}
+
+RegistrationInterface::Result NDTCUDARegistration::GetResult() {
+    return result_;
+}
+
+float NDTCUDARegistration::GetFitnessScore() {
+    // same definition as pcl::Registration::getFitnessScore, on the host:
+    if (!has_target_kdtree_) {
+        input_target_kdtree_->setInputCloud(input_target_);
+        has_target_kdtree_ = true;
+    }
+
+    const Eigen::Matrix3f R = final_transformation_.block<3, 3>(0, 0);
+    const Eigen::Vector3f t = final_transformation_.block<3, 1>(0, 3);
+    const int N = static_cast<int>(input_source_->points.size());
+
+    double sum_sq_dis = 0.0;
+    int num_corr = 0;
+#pragma omp parallel reduction(+:sum_sq_dis, num_corr)
+    {
+        std::vector<int> corr_ind(1);
+        std::vector<float> corr_sq_dis(1);
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < N; ++i) {
+            CloudData::POINT point = input_source_->points[i];
+            point.getVector3fMap() = R * point.getVector3fMap() + t;
+
+            if (input_target_kdtree_->nearestKSearch(point, 1, corr_ind, corr_sq_dis) > 0) {
+                sum_sq_dis += corr_sq_dis.at(0);
+                ++num_corr;
+            }
+        }
+    }
+
+    return (num_corr > 0) ? static_cast<float>(sum_sq_dis / num_corr) : std::numeric_limits<float>::max();
+}
+
+bool NDTCUDARegistration::ComputeDerivatives(const Eigen::Matrix4d &pose, NDTCUDAKernels::Derivatives &derivatives) {
+    double device_pose[12];
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 4; ++c) {
+            device_pose[4 * r + c] = pose(r, c);
+        }
+    }
+
+    if (!kernels_->ComputeDerivatives(device_pose, derivatives)) {
+        LOG(ERROR) << "NDT CUDA failed to compute derivatives on device.";
+        return false;
+    }
+
+    return true;
+}
+
+NDTCUDARegistration::Matrix6d NDTCUDARegistration::GetHessian(const NDTCUDAKernels::Derivatives &derivatives) {
+    return Eigen::Map<const Eigen::Matrix<double, 6, 6, Eigen::RowMajor>>(derivatives.H);
+}
+
+Eigen::Matrix4d NDTCUDARegistration::UpdatePose(const Eigen::Matrix4d &pose, const Vector6d &delta) {
+    const Eigen::Vector3d delta_theta = delta.tail<3>();
+    const double angle = delta_theta.norm();
+
+    Eigen::Matrix3d delta_R = Eigen::Matrix3d::Identity();
+    if (angle > 1.0e-10) {
+        delta_R = Eigen::AngleAxisd(angle, delta_theta / angle).toRotationMatrix();
+    }
+
+    Eigen::Matrix4d updated_pose = Eigen::Matrix4d::Identity();
+    updated_pose.block<3, 3>(0, 0) = delta_R * pose.block<3, 3>(0, 0);
+    updated_pose.block<3, 1>(0, 3) = delta_R * pose.block<3, 1>(0, 3) + delta.head<3>();
+
+    return updated_pose;
+}
+
+} // namespace lidar_localization
+
+#endif
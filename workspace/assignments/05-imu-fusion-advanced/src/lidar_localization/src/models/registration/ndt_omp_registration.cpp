@@ -0,0 +1,716 @@
+/*
+ * @Description: multi-threaded NDT registration
+ * @Author: Ge Yao
+ * @Date: 2020-12-01 21:46:45
+ */
+#include "lidar_localization/models/registration/ndt_omp_registration.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <utility>
+
+#include <pcl/common/transforms.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+// expected ratio of outliers in the source scan:
+static const double OUTLIER_RATIO = 0.55;
+// max. number of step halvings when the score does not improve:
+static const int MAX_BACKTRACKING = 4;
+
+// prebuilt target, in native byte order: the header, then one record per voxel in key order:
+static const char TARGET_MAGIC[8] = {'N', 'D', 'T', 'T', 'A', 'R', 'G', '\0'};
+static const uint32_t TARGET_VERSION = 1;
+
+namespace {
+struct TargetHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t record_size;
+    float res;
+    uint64_t num_voxels;
+};
+
+struct TargetRecord {
+    int64_t key;
+    double mean[3];
+    // column-major:
+    double icov[9];
+    double normal[3];
+};
+}
+
+NDTOMPRegistration::NDTOMPRegistration(const YAML::Node& node)
+    : input_target_kdtree_(new pcl::KdTreeFLANN<CloudData::POINT>()) {
+
+    float res = node["res"].as<float>();
+    float step_size = node["step_size"].as<float>();
+    float trans_eps = node["trans_eps"].as<float>();
+    int max_iter = node["max_iter"].as<int>();
+    int num_threads = node["num_threads"].as<int>();
+    NeighborSearchMethod neighbor_search_method = GetNeighborSearchMethod(
+        node["neighbor_search_method"].as<std::string>()
+    );
+    bool incremental_target = node["incremental_target"] ? node["incremental_target"].as<bool>() : false;
+
+    SetRegistrationParam(
+        res, step_size, trans_eps, max_iter, num_threads, neighbor_search_method, incremental_target
+    );
+
+    const std::string target_path = node["target_path"] ? node["target_path"].as<std::string>() : "";
+    if (!target_path.empty() && !LoadTarget(target_path)) {
+        LOG(ERROR) << "Failed to load NDT OMP target " << target_path << ", target voxels are computed online.";
+    }
+}
+
+NDTOMPRegistration::NDTOMPRegistration(
+    float res, float step_size, float trans_eps, int max_iter,
+    int num_threads,
+    NeighborSearchMethod neighbor_search_method,
+    bool incremental_target
+) : input_target_kdtree_(new pcl::KdTreeFLANN<CloudData::POINT>()) {
+    SetRegistrationParam(
+        res, step_size, trans_eps, max_iter, num_threads, neighbor_search_method, incremental_target
+    );
+}
+
+bool NDTOMPRegistration::SetRegistrationParam(
+    float res, float step_size, float trans_eps, int max_iter,
+    int num_threads,
+    NeighborSearchMethod neighbor_search_method,
+    bool incremental_target
+) {
+    res_ = res;
+    step_size_ = step_size;
+    trans_eps_ = trans_eps;
+    max_iter_ = max_iter;
+    neighbor_search_method_ = neighbor_search_method;
+    incremental_target_ = incremental_target;
+
+    // num_threads <= 0 means use all available cores:
+#ifdef _OPENMP
+    num_threads_ = (num_threads > 0) ? num_threads : omp_get_max_threads();
+#else
+    num_threads_ = 1;
+#endif
+    thread_derivatives_.resize(num_threads_);
+
+    // score function constants, follow pcl::NormalDistributionsTransform:
+    const double gauss_c1 = 10.0 * (1.0 - OUTLIER_RATIO);
+    const double gauss_c2 = OUTLIER_RATIO / std::pow(res_, 3);
+    const double gauss_d3 = -std::log(gauss_c2);
+    gauss_d1_ = -std::log(gauss_c1 + gauss_c2) - gauss_d3;
+    gauss_d2_ = -2.0 * std::log((-std::log(gauss_c1 * std::exp(-0.5) + gauss_c2) - gauss_d3) / gauss_d1_);
+
+    std::cout << "NDT OMP params:" << std::endl
+              << "res: " << res_ << ", "
+              << "step_size: " << step_size_ << ", "
+              << "trans_eps: " << trans_eps_ << ", "
+              << "max_iter: " << max_iter_ << ", "
+              << "num_threads: " << num_threads_ << ", "
+              << "neighbor_search_method: " << (neighbor_search_method_ == NeighborSearchMethod::DIRECT1 ? "DIRECT1" : "DIRECT7") << ", "
+              << "incremental_target: " << (incremental_target_ ? "true" : "false")
+              << std::endl << std::endl;
+
+    return true;
+}
+
+NDTOMPRegistration::NeighborSearchMethod NDTOMPRegistration::GetNeighborSearchMethod(
+    const std::string &name
+) {
+    if (name == "DIRECT1") {
+        return NeighborSearchMethod::DIRECT1;
+    } else if (name == "DIRECT7") {
+        return NeighborSearchMethod::DIRECT7;
+    }
+
+    LOG(ERROR) << "NDT OMP neighbor search method " << name << " NOT FOUND! Fall back to DIRECT7.";
+    return NeighborSearchMethod::DIRECT7;
+}
+
+bool NDTOMPRegistration::SetInputTarget(const CloudData::CLOUD_PTR& input_target) {
+    if (prebuilt_target_ptr_) {
+        input_target_ = input_target;
+        has_target_kdtree_ = false;
+
+        return true;
+    }
+
+    if (incremental_target_) {
+        // a full target replaces all cached frames:
+        target_frames_.clear();
+        target_stats_.clear();
+        voxels_.clear();
+        voxel_index_.clear();
+        free_voxels_.clear();
+
+        return AddTargetFrame(0, input_target);
+    }
+
+    input_target_ = input_target;
+    has_target_kdtree_ = false;
+
+    shared_target_ptr_.reset();
+    BuildVoxelGrid(input_target_);
+
+    return true;
+}
+
+bool NDTOMPRegistration::AddTargetFrame(int frame_id, const CloudData::CLOUD_PTR& frame_cloud) {
+    if (!incremental_target_) {
+        return false;
+    }
+    if (target_frames_.count(frame_id) > 0) {
+        LOG(WARNING) << "NDT OMP target frame " << frame_id << " already exists.";
+        return false;
+    }
+
+    TRACE_SCOPE("NDTOMPRegistration::AddTargetFrame", "registration");
+    // per-frame statistics are computed only once, when the frame enters the target:
+    TargetFrame &frame = target_frames_[frame_id];
+    frame.cloud = frame_cloud;
+    NDTVoxel::GetStats(*frame.cloud, res_, frame.stats);
+
+    for (const auto &voxel_stats: frame.stats) {
+        target_stats_[voxel_stats.first].Add(voxel_stats.second);
+        UpdateTargetVoxel(voxel_stats.first);
+    }
+
+    has_target_kdtree_ = false;
+
+    return true;
+}
+
+bool NDTOMPRegistration::RemoveTargetFrame(int frame_id) {
+    auto frame = target_frames_.find(frame_id);
+    if (frame == target_frames_.end()) {
+        return false;
+    }
+
+    TRACE_SCOPE("NDTOMPRegistration::RemoveTargetFrame", "registration");
+    for (const auto &voxel_stats: frame->second.stats) {
+        auto target_voxel_stats = target_stats_.find(voxel_stats.first);
+        target_voxel_stats->second.Subtract(voxel_stats.second);
+
+        if (target_voxel_stats->second.num_points <= 0) {
+            target_stats_.erase(target_voxel_stats);
+        }
+        UpdateTargetVoxel(voxel_stats.first);
+    }
+    target_frames_.erase(frame);
+
+    has_target_kdtree_ = false;
+
+    return true;
+}
+
+bool NDTOMPRegistration::ScanMatch(const CloudData::CLOUD_PTR& input_source,
+                                   const Eigen::Matrix4f& predict_pose,
+                                   CloudData::CLOUD_PTR& result_cloud_ptr,
+                                   Eigen::Matrix4f& result_pose) {
+    TRACE_SCOPE("NDTOMPRegistration::ScanMatch", "registration");
+    input_source_ = input_source;
+
+    Eigen::Matrix4d pose = predict_pose.cast<double>();
+    Derivatives derivatives, candidate_derivatives;
+    double score = ComputeDerivatives(pose, derivatives);
+
+    num_iterations_ = 0;
+    bool has_converged = false;
+    const int max_iter = max_iteration_limit_ < 0 ? max_iter_ : std::min(max_iter_, max_iteration_limit_);
+    for (int curr_iter = 0; curr_iter < max_iter; ++curr_iter) {
+        ++num_iterations_;
+        // Gauss-Newton step:
+        Vector6d delta = derivatives.H.ldlt().solve(-derivatives.g);
+        if (!delta.allFinite()) {
+            break;
+        }
+
+        // limit step length, as step_size does for pcl::NormalDistributionsTransform:
+        const double delta_norm = delta.norm();
+        if (delta_norm > step_size_) {
+            delta *= step_size_ / delta_norm;
+        }
+
+        // backtrack until the score improves:
+        bool is_improved = false;
+        for (int i = 0; i < MAX_BACKTRACKING; ++i) {
+            const Eigen::Matrix4d candidate_pose = UpdatePose(pose, delta);
+            const double candidate_score = ComputeDerivatives(candidate_pose, candidate_derivatives);
+
+            if (candidate_score >= score) {
+                pose = candidate_pose;
+                score = candidate_score;
+                std::swap(derivatives, candidate_derivatives);
+                is_improved = true;
+                break;
+            }
+
+            delta *= 0.5;
+        }
+
+        // converged once the step is small, or when no shorter step improves the score either:
+        if (!is_improved || delta.norm() < trans_eps_) {
+            has_converged = true;
+            break;
+        }
+    }
+
+    final_transformation_ = pose.cast<float>();
+
+    // derivatives are always those of the current pose:
+    const int N = static_cast<int>(input_source_->points.size());
+    result_ = Result();
+    result_.num_iterations = num_iterations_;
+    result_.has_converged = has_converged;
+    result_.inlier_ratio = (N > 0) ? static_cast<float>(derivatives.num_matched) / N : 0.0f;
+    if (derivatives.num_matched > 0) {
+        result_.fitness_score = static_cast<float>(derivatives.sum_sq_dis / derivatives.num_matched);
+    }
+    result_.has_hessian = true;
+    result_.hessian = derivatives.H;
+
+    result_pose = final_transformation_;
+    pcl::transformPointCloud(*input_source_, *result_cloud_ptr, result_pose);
+
+    return true;
+}
+
+bool NDTOMPRegistration::SetMaxIterationLimit(int max_iteration_limit) {
+    max_iteration_limit_ = max_iteration_limit;
+
+    return true;
+}
+
+bool NDTOMPRegistration::SaveTarget(const std::string& file_path) const {
+    const PrebuiltTarget *prebuilt_target = GetPrebuiltTarget();
+    const std::unordered_map<int64_t, int> &voxel_index = 
+        prebuilt_target ? prebuilt_target->voxel_index : voxel_index_;
+    const std::vector<Voxel, Eigen::aligned_allocator<Voxel>> &voxels = 
+        prebuilt_target ? prebuilt_target->voxels : voxels_;
+
+    // in key order, so the same target always gives the same file:
+    std::vector<std::pair<int64_t, int>> keyed_voxels(voxel_index.begin(), voxel_index.end());
+    std::sort(keyed_voxels.begin(), keyed_voxels.end());
+
+    TargetHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, TARGET_MAGIC, sizeof(header.magic));
+    header.version = TARGET_VERSION;
+    header.header_size = sizeof(header);
+    header.record_size = sizeof(TargetRecord);
+    header.res = res_;
+    header.num_voxels = keyed_voxels.size();
+
+    std::vector<TargetRecord> records(keyed_voxels.size());
+    for (size_t i = 0; i < keyed_voxels.size(); ++i) {
+        const Voxel &voxel = voxels[keyed_voxels[i].second];
+        TargetRecord &record = records[i];
+
+        record.key = keyed_voxels[i].first;
+        Eigen::Map<Eigen::Vector3d>(record.mean) = voxel.mean;
+        Eigen::Map<Eigen::Matrix3d>(record.icov) = voxel.icov;
+        Eigen::Map<Eigen::Vector3d>(record.normal) = voxel.normal;
+    }
+
+    FILE *output_fptr = fopen(file_path.c_str(), "wb");
+    if (!output_fptr) {
+        LOG(ERROR) << "Cannot write NDT OMP target " << file_path;
+        return false;
+    }
+
+    bool success = (
+        1 == fwrite(&header, sizeof(header), 1, output_fptr) &&
+        records.size() == fwrite(records.data(), sizeof(TargetRecord), records.size(), output_fptr)
+    );
+
+    return (0 == fclose(output_fptr)) && success;
+}
+
+bool NDTOMPRegistration::LoadTarget(const std::string& file_path) {
+    // shared by the instances of the process, e.g. the relocalization ones, while any of them holds it:
+    static std::mutex mutex;
+    static std::map<std::string, std::weak_ptr<const PrebuiltTarget>> targets;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<const PrebuiltTarget> target_ptr = targets[file_path].lock();
+
+    if (!target_ptr) {
+        FILE *input_fptr = fopen(file_path.c_str(), "rb");
+        if (!input_fptr) {
+            LOG(ERROR) << "Cannot read NDT OMP target " << file_path;
+            return false;
+        }
+
+        TargetHeader header;
+        std::vector<TargetRecord> records;
+        bool success = (1 == fread(&header, sizeof(header), 1, input_fptr));
+        if (
+            success && (
+                0 != std::memcmp(header.magic, TARGET_MAGIC, sizeof(header.magic)) ||
+                TARGET_VERSION != header.version ||
+                sizeof(header) != header.header_size ||
+                sizeof(TargetRecord) != header.record_size
+            )
+        ) {
+            LOG(ERROR) << "NDT OMP target " << file_path << " is not of version " << TARGET_VERSION;
+            success = false;
+        }
+        if (success) {
+            records.resize(header.num_voxels);
+            success = (records.size() == fread(records.data(), sizeof(TargetRecord), records.size(), input_fptr));
+            if (!success) {
+                LOG(ERROR) << "NDT OMP target " << file_path << " is truncated.";
+            }
+        }
+        fclose(input_fptr);
+        if (!success) {
+            return false;
+        }
+
+        std::shared_ptr<PrebuiltTarget> new_target_ptr = std::make_shared<PrebuiltTarget>();
+        new_target_ptr->res = header.res;
+        new_target_ptr->voxels.resize(records.size());
+        new_target_ptr->voxel_index.reserve(records.size());
+        for (size_t i = 0; i < records.size(); ++i) {
+            const TargetRecord &record = records[i];
+            Voxel &voxel = new_target_ptr->voxels[i];
+
+            voxel.mean = Eigen::Map<const Eigen::Vector3d>(record.mean);
+            voxel.icov = Eigen::Map<const Eigen::Matrix3d>(record.icov);
+            voxel.cov = voxel.icov.inverse();
+            voxel.normal = Eigen::Map<const Eigen::Vector3d>(record.normal);
+            new_target_ptr->voxel_index.emplace(record.key, static_cast<int>(i));
+        }
+
+        target_ptr = new_target_ptr;
+        targets[file_path] = target_ptr;
+    }
+
+    // voxel keys are only meaningful at the resolution they were built with:
+    if (std::fabs(target_ptr->res - res_) > 1.0e-6f) {
+        LOG(ERROR) << "NDT OMP target " << file_path << " has resolution " << target_ptr->res 
+                   << ", expected " << res_;
+        return false;
+    }
+
+    if (incremental_target_) {
+        LOG(WARNING) << "NDT OMP incremental target is disabled with target " << file_path;
+        incremental_target_ = false;
+    }
+    prebuilt_target_ptr_ = target_ptr;
+
+    LOG(INFO) << "Load NDT OMP target " << file_path << ", num. voxels: " << prebuilt_target_ptr_->voxels.size();
+
+    return true;
+}
+
+std::shared_ptr<const RegistrationInterface::Target> NDTOMPRegistration::GetTarget() {
+    if (shared_target_ptr_)
+        return shared_target_ptr_;
+
+    // incremental voxels still change, a loaded target is not the input target:
+    if (incremental_target_ || prebuilt_target_ptr_ || !input_target_)
+        return nullptr;
+
+    std::shared_ptr<PrebuiltTarget> target_ptr = std::make_shared<PrebuiltTarget>();
+    target_ptr->res = res_;
+    target_ptr->voxels.swap(voxels_);
+    target_ptr->voxel_index.swap(voxel_index_);
+    target_ptr->cloud = input_target_;
+    shared_target_ptr_ = target_ptr;
+
+    return shared_target_ptr_;
+}
+
+bool NDTOMPRegistration::SetTarget(const std::shared_ptr<const Target>& target) {
+    std::shared_ptr<const PrebuiltTarget> target_ptr = std::dynamic_pointer_cast<const PrebuiltTarget>(target);
+    if (!target_ptr || !target_ptr->cloud || incremental_target_ || prebuilt_target_ptr_)
+        return false;
+
+    // voxel keys are only meaningful at the resolution they were built with:
+    if (std::fabs(target_ptr->res - res_) > 1.0e-6f)
+        return false;
+
+    shared_target_ptr_ = target_ptr;
+    input_target_ = target_ptr->cloud;
+    has_target_kdtree_ = false;
+    voxels_.clear();
+    voxel_index_.clear();
+
+    return true;
+}
+
+size_t NDTOMPRegistration::PrebuiltTarget::GetMemoryUsage(void) const {
+    // a key, a slot & a node pointer per voxel, a pointer per bucket:
+    return (
+        voxels.capacity() * sizeof(Voxel) + 
+        voxel_index.size() * (sizeof(std::pair<const int64_t, int>) + sizeof(void*)) + 
+        voxel_index.bucket_count() * sizeof(void*)
+    );
+}
+
+int NDTOMPRegistration::GetNumIterations() {
+    return num_iterations_;
+}
+
+RegistrationInterface::Result NDTOMPRegistration::GetResult() {
+    return result_;
+}
+
+float NDTOMPRegistration::GetFitnessScore() {
+    // same definition as pcl::Registration::getFitnessScore,
+    // i.e., mean squared distance from aligned source to nearest target point.
+    // incremental target frames are only concatenated here, so matching never pays for it:
+    if (!has_target_kdtree_) {
+        if (incremental_target_) {
+            input_target_.reset(new CloudData::CLOUD());
+            for (const auto &frame: target_frames_) {
+                *input_target_ += *frame.second.cloud;
+            }
+        }
+        input_target_kdtree_->setInputCloud(input_target_);
+        has_target_kdtree_ = true;
+    }
+
+    const Eigen::Matrix3f R = final_transformation_.block<3, 3>(0, 0);
+    const Eigen::Vector3f t = final_transformation_.block<3, 1>(0, 3);
+    const int N = static_cast<int>(input_source_->points.size());
+
+    double sum_sq_dis = 0.0;
+    int num_corr = 0;
+#pragma omp parallel num_threads(num_threads_) reduction(+:sum_sq_dis, num_corr)
+    {
+        std::vector<int> corr_ind(1);
+        std::vector<float> corr_sq_dis(1);
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < N; ++i) {
+            CloudData::POINT point = input_source_->points[i];
+            point.getVector3fMap() = R * point.getVector3fMap() + t;
+
+            if (input_target_kdtree_->nearestKSearch(point, 1, corr_ind, corr_sq_dis) > 0) {
+                sum_sq_dis += corr_sq_dis.at(0);
+                ++num_corr;
+            }
+        }
+    }
+
+    return (num_corr > 0) ? static_cast<float>(sum_sq_dis / num_corr) : std::numeric_limits<float>::max();
+}
+
+void NDTOMPRegistration::BuildVoxelGrid(const CloudData::CLOUD_PTR& input_target) {
+    const int N = static_cast<int>(input_target->points.size());
+
+    // a. bucket points by voxel key:
+    std::vector<std::pair<int64_t, int>> keyed_points(N);
+#pragma omp parallel for num_threads(num_threads_) schedule(static)
+    for (int i = 0; i < N; ++i) {
+        keyed_points[i] = std::make_pair(
+            NDTVoxel::GetKey(NDTVoxel::GetIndex(input_target->points[i].getVector3fMap(), res_)), i
+        );
+    }
+    std::sort(keyed_points.begin(), keyed_points.end());
+
+    std::vector<int> voxel_begin;
+    for (int i = 0; i < N; ++i) {
+        if (i == 0 || keyed_points[i].first != keyed_points[i - 1].first) {
+            voxel_begin.push_back(i);
+        }
+    }
+    voxel_begin.push_back(N);
+
+    // b. estimate voxel distributions in parallel:
+    const int M = static_cast<int>(voxel_begin.size()) - 1;
+    std::vector<Voxel, Eigen::aligned_allocator<Voxel>> voxels(M);
+    std::vector<char> is_valid(M, 0);
+
+#pragma omp parallel for num_threads(num_threads_) schedule(dynamic, 64)
+    for (int j = 0; j < M; ++j) {
+        const int num_points = voxel_begin[j + 1] - voxel_begin[j];
+        if (num_points < NDTVoxel::MIN_POINTS_PER_VOXEL) {
+            continue;
+        }
+
+        VoxelStats stats;
+        for (int k = voxel_begin[j]; k < voxel_begin[j + 1]; ++k) {
+            stats.Add(input_target->points[keyed_points[k].second].getVector3fMap().cast<double>());
+        }
+
+        is_valid[j] = NDTVoxel::ComputeDistribution(stats, voxels[j]) ? 1 : 0;
+    }
+
+    // c. index valid voxels:
+    voxels_.clear();
+    voxels_.reserve(M);
+    voxel_index_.clear();
+    voxel_index_.reserve(M);
+    for (int j = 0; j < M; ++j) {
+        if (is_valid[j]) {
+            voxel_index_.emplace(keyed_points[voxel_begin[j]].first, static_cast<int>(voxels_.size()));
+            voxels_.push_back(voxels[j]);
+        }
+    }
+}
+
+void NDTOMPRegistration::UpdateTargetVoxel(int64_t key) {
+    Voxel voxel;
+    auto voxel_stats = target_stats_.find(key);
+    const bool is_valid = (voxel_stats != target_stats_.end() && NDTVoxel::ComputeDistribution(voxel_stats->second, voxel));
+
+    auto it = voxel_index_.find(key);
+    if (!is_valid) {
+        if (it != voxel_index_.end()) {
+            free_voxels_.push_back(it->second);
+            voxel_index_.erase(it);
+        }
+        return;
+    }
+
+    if (it == voxel_index_.end()) {
+        if (free_voxels_.empty()) {
+            it = voxel_index_.emplace(key, static_cast<int>(voxels_.size())).first;
+            voxels_.push_back(voxel);
+            return;
+        }
+
+        it = voxel_index_.emplace(key, free_voxels_.back()).first;
+        free_voxels_.pop_back();
+    }
+    voxels_[it->second] = voxel;
+}
+
+int NDTOMPRegistration::GetNeighborVoxels(const Eigen::Vector3f &point, const Voxel *neighbors[]) const {
+    static const int OFFSETS[7][3] = {
+        { 0,  0,  0},
+        {+1,  0,  0}, {-1,  0,  0},
+        { 0, +1,  0}, { 0, -1,  0},
+        { 0,  0, +1}, { 0,  0, -1}
+    };
+    const int num_offsets = (neighbor_search_method_ == NeighborSearchMethod::DIRECT1) ? 1 : 7;
+
+    const Eigen::Vector3i index = NDTVoxel::GetIndex(point, res_);
+    const PrebuiltTarget *prebuilt_target = GetPrebuiltTarget();
+    const std::unordered_map<int64_t, int> &voxel_index = 
+        prebuilt_target ? prebuilt_target->voxel_index : voxel_index_;
+    const std::vector<Voxel, Eigen::aligned_allocator<Voxel>> &voxels = 
+        prebuilt_target ? prebuilt_target->voxels : voxels_;
+
+    int num_neighbors = 0;
+    for (int i = 0; i < num_offsets; ++i) {
+        const Eigen::Vector3i neighbor_index = index + Eigen::Vector3i(OFFSETS[i][0], OFFSETS[i][1], OFFSETS[i][2]);
+
+        auto it = voxel_index.find(NDTVoxel::GetKey(neighbor_index));
+        if (it != voxel_index.end()) {
+            neighbors[num_neighbors++] = &voxels[it->second];
+        }
+    }
+
+    return num_neighbors;
+}
+
+double NDTOMPRegistration::ComputeDerivatives(const Eigen::Matrix4d &pose, Derivatives &derivatives) {
+    const Eigen::Matrix3d R = pose.block<3, 3>(0, 0);
+    const Eigen::Vector3d t = pose.block<3, 1>(0, 3);
+    const int N = static_cast<int>(input_source_->points.size());
+
+#pragma omp parallel num_threads(num_threads_)
+    {
+#ifdef _OPENMP
+        Derivatives &partial = thread_derivatives_.at(omp_get_thread_num());
+#else
+        Derivatives &partial = thread_derivatives_.at(0);
+#endif
+        partial.Reset();
+
+        const Voxel *neighbors[7];
+        Eigen::Matrix<double, 3, 6> J;
+        J.block<3, 3>(0, 0).setIdentity();
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < N; ++i) {
+            const Eigen::Vector3d point = R * input_source_->points[i].getVector3fMap().cast<double>() + t;
+            const int num_neighbors = GetNeighborVoxels(point.cast<float>(), neighbors);
+            if (num_neighbors == 0) {
+                continue;
+            }
+
+            // jacobian of transformed point w.r.t. left perturbation [delta_t, delta_theta]:
+            J.block<3, 3>(0, 3) <<          0.0,  point.z(), -point.y(),
+                                     -point.z(),        0.0,  point.x(),
+                                      point.y(), -point.x(),        0.0;
+
+            double max_e = -1.0;
+            double sq_dis = 0.0;
+            for (int k = 0; k < num_neighbors; ++k) {
+                const Eigen::Vector3d q = point - neighbors[k]->mean;
+                const Eigen::Vector3d icov_q = neighbors[k]->icov * q;
+                const double e = std::exp(-0.5 * gauss_d2_ * q.dot(icov_q));
+                if (e > max_e) {
+                    max_e = e;
+                    sq_dis = std::pow(neighbors[k]->normal.dot(q), 2);
+                }
+
+                // score contribution and its Gauss-Newton derivatives, the weight is positive as d1 < 0:
+                const double w = -gauss_d1_ * gauss_d2_ * e;
+
+                partial.score += -gauss_d1_ * e;
+                partial.g.noalias() += w * J.transpose() * icov_q;
+                partial.H.noalias() += w * J.transpose() * neighbors[k]->icov * J;
+            }
+
+            partial.sum_sq_dis += sq_dis;
+            ++partial.num_matched;
+        }
+    }
+
+    // reduce in thread order, so the result is deterministic:
+    derivatives.Reset();
+    for (const auto &partial: thread_derivatives_) {
+        derivatives.score += partial.score;
+        derivatives.g += partial.g;
+        derivatives.H += partial.H;
+        derivatives.sum_sq_dis += partial.sum_sq_dis;
+        derivatives.num_matched += partial.num_matched;
+    }
+
+    return derivatives.score;
+}
+
+Eigen::Matrix4d NDTOMPRegistration::UpdatePose(const Eigen::Matrix4d &pose, const Vector6d &delta) {
+    const Eigen::Vector3d delta_theta = delta.tail<3>();
+    const double angle = delta_theta.norm();
+
+    Eigen::Matrix3d delta_R = Eigen::Matrix3d::Identity();
+    if (angle > 1.0e-10) {
+        delta_R = Eigen::AngleAxisd(angle, delta_theta / angle).toRotationMatrix();
+    }
+
+    Eigen::Matrix4d updated_pose = Eigen::Matrix4d::Identity();
+    updated_pose.block<3, 3>(0, 0) = delta_R * pose.block<3, 3>(0, 0);
+    updated_pose.block<3, 1>(0, 3) = delta_R * pose.block<3, 1>(0, 3) + delta.head<3>();
+
+    return updated_pose;
+}
+
+void NDTOMPRegistration::Derivatives::Reset(void) {
+    score = 0.0;
+    g.setZero();
+    H.setZero();
+    sum_sq_dis = 0.0;
+    num_matched = 0;
+}
+
+}
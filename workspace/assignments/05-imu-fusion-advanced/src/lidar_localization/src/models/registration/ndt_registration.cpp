@@ -4,6 +4,7 @@
  * @Date: 2020-02-08 21:46:45
  */
 #include "lidar_localization/models/registration/ndt_registration.hpp"
+#include "lidar_localization/tools/tracer.hpp"
 
 #include "glog/logging.h"
 
@@ -30,6 +31,7 @@ bool NDTRegistration::SetRegistrationParam(float res, float step_size, float tra
     ndt_ptr_->setResolution(res);
     ndt_ptr_->setStepSize(step_size);
     ndt_ptr_->setTransformationEpsilon(trans_eps);
+    max_iter_ = max_iter;
     ndt_ptr_->setMaximumIterations(max_iter);
 
     std::cout << "NDT params:" << std::endl
@@ -52,6 +54,7 @@ bool NDTRegistration::ScanMatch(const CloudData::CLOUD_PTR& input_source,
                                 const Eigen::Matrix4f& predict_pose, 
                                 CloudData::CLOUD_PTR& result_cloud_ptr,
                                 Eigen::Matrix4f& result_pose) {
+    TRACE_SCOPE("NDTRegistration::ScanMatch", "registration");
     ndt_ptr_->setInputSource(input_source);
     ndt_ptr_->align(*result_cloud_ptr, predict_pose);
     result_pose = ndt_ptr_->getFinalTransformation();
@@ -62,4 +65,25 @@ bool NDTRegistration::ScanMatch(const CloudData::CLOUD_PTR& input_source,
 float NDTRegistration::GetFitnessScore() {
     return ndt_ptr_->getFitnessScore();
 }
+
+bool NDTRegistration::SetMaxIterationLimit(int max_iteration_limit) {
+    ndt_ptr_->setMaximumIterations(
+        max_iteration_limit < 0 ? max_iter_ : std::min(max_iter_, max_iteration_limit)
+    );
+
+    return true;
+}
+
+int NDTRegistration::GetNumIterations() {
+    return ndt_ptr_->getFinalNumIteration();
+}
+
+RegistrationInterface::Result NDTRegistration::GetResult() {
+    Result result;
+    result.fitness_score = GetFitnessScore();
+    result.num_iterations = GetNumIterations();
+    result.has_converged = ndt_ptr_->hasConverged();
+
+    return result;
+}
 }
\ No newline at end of file
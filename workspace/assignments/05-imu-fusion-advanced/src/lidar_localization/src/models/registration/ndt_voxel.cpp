@@ -0,0 +1,72 @@
+/*
+ * @Description: normal distributions of voxels, shared by the NDT backends
+ * @Author: Ge Yao
+ * @Date: 2021-01-22 20:37:12
+ */
+#include "lidar_localization/models/registration/ndt_voxel.hpp"
+
+#include <algorithm>
+
+#include <Eigen/Eigenvalues>
+
+namespace lidar_localization {
+
+// ratio of the largest eigenvalue used to inflate degenerate covariances:
+static const double MIN_EIGENVALUE_RATIO = 0.01;
+
+const int NDTVoxel::MIN_POINTS_PER_VOXEL;
+
+bool NDTVoxel::ComputeDistribution(const Stats &stats, Distribution &distribution, int min_num_points) {
+    if (stats.num_points < std::max(min_num_points, 2)) {
+        return false;
+    }
+
+    const double N = static_cast<double>(stats.num_points);
+    const Eigen::Vector3d mean = stats.sum / N;
+    const Eigen::Matrix3d cov = (stats.sum_sq - N * mean * mean.transpose()) / (N - 1.0);
+
+    // inflate near-singular covariances, as pcl::VoxelGridCovariance does:
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eigen_solver(cov);
+    Eigen::Vector3d eigen_values = eigen_solver.eigenvalues();
+    if (eigen_values(2) <= 0.0) {
+        return false;
+    }
+    eigen_values = eigen_values.cwiseMax(MIN_EIGENVALUE_RATIO * eigen_values(2));
+
+    const Eigen::Matrix3d &eigen_vectors = eigen_solver.eigenvectors();
+    distribution.mean = mean;
+    distribution.cov = eigen_vectors * eigen_values.asDiagonal() * eigen_vectors.transpose();
+    distribution.icov = eigen_vectors * eigen_values.cwiseInverse().asDiagonal() * eigen_vectors.transpose();
+    distribution.normal = eigen_vectors.col(0);
+
+    return true;
+}
+
+void NDTVoxel::GetStats(const CloudData::CLOUD &cloud, float res, StatsMap &stats) {
+    stats.clear();
+
+    for (const auto &point: cloud.points) {
+        const Eigen::Vector3f p = point.getVector3fMap();
+        stats[GetKey(GetIndex(p, res))].Add(p.cast<double>());
+    }
+}
+
+void NDTVoxel::Stats::Add(const Eigen::Vector3d &point) {
+    ++num_points;
+    sum += point;
+    sum_sq.noalias() += point * point.transpose();
+}
+
+void NDTVoxel::Stats::Add(const Stats &other) {
+    num_points += other.num_points;
+    sum += other.sum;
+    sum_sq += other.sum_sq;
+}
+
+void NDTVoxel::Stats::Subtract(const Stats &other) {
+    num_points -= other.num_points;
+    sum -= other.sum;
+    sum_sq -= other.sum_sq;
+}
+
+}
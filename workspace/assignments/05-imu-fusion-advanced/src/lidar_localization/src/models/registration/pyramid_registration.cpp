@@ -0,0 +1,244 @@
+/*
+ * @Description: coarse-to-fine registration over a pyramid of NDT resolutions
+ * @Author: Ge Yao
+ * @Date: 2020-12-13 19:52:30
+ */
+#include "lidar_localization/models/registration/pyramid_registration.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+
+#include <limits>
+#include <algorithm>
+
+#include <pcl/common/transforms.h>
+
+#include "glog/logging.h"
+
+#include "lidar_localization/models/registration/ndt_registration.hpp"
+#include "lidar_localization/models/registration/ndt_omp_registration.hpp"
+#include "lidar_localization/models/cloud_filter/voxel_filter.hpp"
+#include "lidar_localization/tools/tic_toc.hpp"
+
+namespace lidar_localization {
+
+PyramidRegistration::PyramidRegistration(const YAML::Node& node)
+    : input_target_kdtree_(new pcl::KdTreeFLANN<CloudData::POINT>()) {
+    std::string method = node["method"].as<std::string>();
+    std::vector<float> resolutions = node["resolutions"].as<std::vector<float>>();
+    std::vector<float> step_sizes = node["step_sizes"].as<std::vector<float>>();
+    std::vector<int> max_iters = node["max_iters"].as<std::vector<int>>();
+    std::vector<float> leaf_sizes = node["leaf_sizes"].as<std::vector<float>>();
+    fitness_score_thresh_ = node["fitness_score_thresh"].as<float>();
+
+    size_t num_levels = std::min({resolutions.size(), step_sizes.size(), max_iters.size(), leaf_sizes.size()});
+    if (num_levels != resolutions.size() || num_levels != leaf_sizes.size()) {
+        LOG(ERROR) << "Pyramid registration level params differ in length, only the first " << num_levels << " levels are used.";
+    }
+
+    std::cout << "Pyramid registration params:" << std::endl
+              << "method: " << method << ", "
+              << "fitness_score_thresh: " << fitness_score_thresh_
+              << std::endl << std::endl;
+
+    for (size_t i = 0; i < num_levels; ++i) {
+        // the other params of the level registration are shared:
+        YAML::Node level_node = YAML::Clone(node);
+        level_node["res"] = resolutions.at(i);
+        level_node["step_size"] = step_sizes.at(i);
+        level_node["max_iter"] = max_iters.at(i);
+
+        Level level;
+        if (method == "NDT") {
+            level.registration_ptr = std::make_shared<NDTRegistration>(level_node);
+        } else if (method == "NDT_OMP") {
+            level.registration_ptr = std::make_shared<NDTOMPRegistration>(level_node);
+        } else {
+            LOG(ERROR) << "Pyramid registration method " << method << " NOT FOUND!";
+            break;
+        }
+
+        if (leaf_sizes.at(i) > 0.0f) {
+            level.filter_ptr = std::make_shared<VoxelFilter>(leaf_sizes.at(i), leaf_sizes.at(i), leaf_sizes.at(i));
+        }
+        levels_.push_back(level);
+
+        LevelStats level_stats;
+        level_stats.res = resolutions.at(i);
+        level_stats_.push_back(level_stats);
+    }
+}
+
+bool PyramidRegistration::SetInputTarget(const CloudData::CLOUD_PTR& input_target) {
+    input_target_ = input_target;
+    has_target_kdtree_ = false;
+
+    for (Level& level: levels_) {
+        level.registration_ptr->SetInputTarget(input_target_);
+    }
+
+    return true;
+}
+
+bool PyramidRegistration::ScanMatch(const CloudData::CLOUD_PTR& input_source,
+                                    const Eigen::Matrix4f& predict_pose,
+                                    CloudData::CLOUD_PTR& result_cloud_ptr,
+                                    Eigen::Matrix4f& result_pose) {
+    TRACE_SCOPE("PyramidRegistration::ScanMatch", "registration");
+    result_pose = predict_pose;
+    fitness_score_ = std::numeric_limits<float>::max();
+    num_iterations_ = 0;
+    last_level_ = -1;
+
+    for (LevelStats& level_stats: level_stats_) {
+        level_stats.last_num_iterations = -1;
+    }
+
+    CloudData::CLOUD_PTR level_result_ptr(new CloudData::CLOUD());
+    for (size_t i = 0; i < levels_.size(); ++i) {
+        Level& level = levels_.at(i);
+        LevelStats& level_stats = level_stats_.at(i);
+        TicToc level_time;
+
+        CloudData::CLOUD_PTR level_source_ptr = input_source;
+        if (level.filter_ptr) {
+            level_source_ptr.reset(new CloudData::CLOUD());
+            level.filter_ptr->Filter(input_source, level_source_ptr);
+        }
+
+        Eigen::Matrix4f level_pose = result_pose;
+        level.registration_ptr->ScanMatch(level_source_ptr, level_pose, level_result_ptr, result_pose);
+        fitness_score_ = ComputeFitnessScore(level_source_ptr, result_pose);
+        last_level_ = static_cast<int>(i);
+
+        int level_iterations = std::max(level.registration_ptr->GetNumIterations(), 0);
+        num_iterations_ += level_iterations;
+
+        ++level_stats.num_runs;
+        level_stats.num_iterations += level_iterations;
+        level_stats.time_consumption += level_time.toc();
+        level_stats.last_num_iterations = level_iterations;
+        level_stats.last_fitness_score = fitness_score_;
+
+        // good enough, skip the finer levels:
+        if (i + 1 < levels_.size() && fitness_score_ < fitness_score_thresh_) {
+            ++level_stats.num_early_stops;
+            break;
+        }
+    }
+
+    pcl::transformPointCloud(*input_source, *result_cloud_ptr, result_pose);
+
+    return true;
+}
+
+std::shared_ptr<const RegistrationInterface::Target> PyramidRegistration::GetTarget() {
+    if (!input_target_)
+        return nullptr;
+
+    std::shared_ptr<PyramidTarget> target_ptr = std::make_shared<PyramidTarget>();
+    for (Level& level: levels_) {
+        std::shared_ptr<const Target> level_target_ptr = level.registration_ptr->GetTarget();
+        if (!level_target_ptr)
+            return nullptr;
+
+        target_ptr->level_targets.push_back(level_target_ptr);
+    }
+    target_ptr->cloud = input_target_;
+
+    return target_ptr;
+}
+
+bool PyramidRegistration::SetTarget(const std::shared_ptr<const Target>& target) {
+    std::shared_ptr<const PyramidTarget> target_ptr = std::dynamic_pointer_cast<const PyramidTarget>(target);
+    if (!target_ptr || target_ptr->level_targets.size() != levels_.size())
+        return false;
+
+    for (size_t i = 0; i < levels_.size(); ++i) {
+        if (!levels_.at(i).registration_ptr->SetTarget(target_ptr->level_targets.at(i))) {
+            // no level is left with the target of another:
+            SetInputTarget(target_ptr->cloud);
+            return false;
+        }
+    }
+
+    input_target_ = target_ptr->cloud;
+    has_target_kdtree_ = false;
+
+    return true;
+}
+
+size_t PyramidRegistration::PyramidTarget::GetMemoryUsage(void) const {
+    size_t memory_usage = 0;
+    for (const std::shared_ptr<const Target>& level_target_ptr: level_targets) {
+        memory_usage += level_target_ptr->GetMemoryUsage();
+    }
+
+    return memory_usage;
+}
+
+float PyramidRegistration::GetFitnessScore() {
+    return fitness_score_;
+}
+
+bool PyramidRegistration::SetMaxIterationLimit(int max_iteration_limit) {
+    // each level is capped on its own:
+    bool is_limited = false;
+    for (Level& level: levels_) {
+        is_limited = level.registration_ptr->SetMaxIterationLimit(max_iteration_limit) || is_limited;
+    }
+
+    return is_limited;
+}
+
+int PyramidRegistration::GetNumIterations() {
+    return num_iterations_;
+}
+
+RegistrationInterface::Result PyramidRegistration::GetResult() {
+    Result result;
+    if (last_level_ >= 0) {
+        result = levels_.at(last_level_).registration_ptr->GetResult();
+    }
+
+    // the pyramid fitness score is already computed for early stops:
+    result.fitness_score = fitness_score_;
+    result.num_iterations = num_iterations_;
+
+    return result;
+}
+
+float PyramidRegistration::ComputeFitnessScore(const CloudData::CLOUD_PTR& input_source, const Eigen::Matrix4f& pose) {
+    if (!input_target_ || input_target_->empty())
+        return std::numeric_limits<float>::max();
+
+    if (!has_target_kdtree_) {
+        input_target_kdtree_->setInputCloud(input_target_);
+        has_target_kdtree_ = true;
+    }
+
+    const Eigen::Matrix3f R = pose.block<3, 3>(0, 0);
+    const Eigen::Vector3f t = pose.block<3, 1>(0, 3);
+    const int N = static_cast<int>(input_source->points.size());
+
+    double sum_sq_dis = 0.0;
+    int num_corr = 0;
+#pragma omp parallel reduction(+:sum_sq_dis, num_corr)
+    {
+        std::vector<int> corr_ind(1);
+        std::vector<float> corr_sq_dis(1);
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < N; ++i) {
+            CloudData::POINT point = input_source->points[i];
+            point.getVector3fMap() = R * point.getVector3fMap() + t;
+
+            if (input_target_kdtree_->nearestKSearch(point, 1, corr_ind, corr_sq_dis) > 0) {
+                sum_sq_dis += corr_sq_dis.at(0);
+                ++num_corr;
+            }
+        }
+    }
+
+    return (num_corr > 0) ? static_cast<float>(sum_sq_dis / num_corr) : std::numeric_limits<float>::max();
+}
+
+}
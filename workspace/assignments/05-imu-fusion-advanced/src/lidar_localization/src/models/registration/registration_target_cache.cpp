@@ -0,0 +1,85 @@
+/*
+ * @Description: LRU cache of built registration targets, by key frame window
+ * @Author: Ge Yao
+ * @Date: 2021-01-30 10:21:54
+ */
+#include "lidar_localization/models/registration/registration_target_cache.hpp"
+
+#include <iostream>
+
+namespace lidar_localization {
+
+RegistrationTargetCache::RegistrationTargetCache(size_t max_size_in_mb)
+    : max_size_in_bytes_(max_size_in_mb << 20) {
+    std::cout << "Registration Target Cache params:" << std::endl
+              << "max size in MB: " << max_size_in_mb
+              << std::endl << std::endl;
+}
+
+bool RegistrationTargetCache::Get(uint64_t key, Entry& entry) {
+    auto it = nodes_.find(key);
+    if (it == nodes_.end()) {
+        ++stats_.num_misses;
+        return false;
+    }
+
+    ++stats_.num_hits;
+    lru_.splice(lru_.begin(), lru_, it->second.lru_it);
+    entry = it->second.entry;
+
+    return true;
+}
+
+void RegistrationTargetCache::Add(uint64_t key, const Entry& entry) {
+    if (!entry.cloud_ptr)
+        return;
+
+    auto it = nodes_.find(key);
+    if (it != nodes_.end()) {
+        stats_.size_in_bytes -= it->second.size_in_bytes;
+        lru_.erase(it->second.lru_it);
+        nodes_.erase(it);
+        --stats_.num_targets;
+    }
+
+    lru_.push_front(key);
+
+    Node node;
+    node.entry = entry;
+    node.size_in_bytes = entry.cloud_ptr->points.size() * sizeof(CloudData::POINT);
+    if (entry.target_ptr) {
+        node.size_in_bytes += entry.target_ptr->GetMemoryUsage();
+    }
+    node.lru_it = lru_.begin();
+    nodes_.emplace(key, node);
+
+    ++stats_.num_targets;
+    stats_.size_in_bytes += node.size_in_bytes;
+
+    // the new entry is never evicted:
+    Evict();
+}
+
+void RegistrationTargetCache::Clear(void) {
+    lru_.clear();
+    nodes_.clear();
+
+    stats_.num_targets = 0;
+    stats_.size_in_bytes = 0;
+}
+
+void RegistrationTargetCache::Evict(void) {
+    // always keep the target just inserted, even if it alone exceeds the budget.
+    // evicted targets stay alive while a registration still holds them:
+    while (stats_.size_in_bytes > max_size_in_bytes_ && lru_.size() > 1) {
+        auto it = nodes_.find(lru_.back());
+
+        --stats_.num_targets;
+        stats_.size_in_bytes -= it->second.size_in_bytes;
+
+        nodes_.erase(it);
+        lru_.pop_back();
+    }
+}
+
+} // namespace lidar_localization
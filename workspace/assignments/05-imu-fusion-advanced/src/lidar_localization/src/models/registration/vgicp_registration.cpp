@@ -0,0 +1,500 @@
+/*
+ * @Description: voxelized GICP registration with cached per-frame target voxels
+ * @Author: Ge Yao
+ * @Date: 2020-12-03 21:46:45
+ */
+#include "lidar_localization/models/registration/vgicp_registration.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+
+#include <cmath>
+#include <limits>
+
+#include <pcl/common/transforms.h>
+
+#include <Eigen/Eigenvalues>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+// voxels with fewer points do not have a reliable covariance:
+static const int MIN_POINTS_PER_VOXEL = 4;
+// ratio of the largest eigenvalue used to inflate degenerate voxel covariances:
+static const double MIN_EIGENVALUE_RATIO = 0.01;
+// source point covariances are regularized as planes, see Segal et al., 2009:
+static const double PLANE_EPSILON = 1.0e-3;
+
+VGICPRegistration::VGICPRegistration(const YAML::Node& node)
+    : input_source_kdtree_(new pcl::KdTreeFLANN<CloudData::POINT>()),
+      input_target_(new CloudData::CLOUD()),
+      input_target_kdtree_(new pcl::KdTreeFLANN<CloudData::POINT>()) {
+
+    float res = node["res"].as<float>();
+    int num_neighbors = node["num_neighbors"].as<int>();
+    float trans_eps = node["trans_eps"].as<float>();
+    int max_iter = node["max_iter"].as<int>();
+    int num_threads = node["num_threads"].as<int>();
+
+    SetRegistrationParam(res, num_neighbors, trans_eps, max_iter, num_threads);
+}
+
+VGICPRegistration::VGICPRegistration(
+    float res, int num_neighbors, float trans_eps, int max_iter,
+    int num_threads
+) : input_source_kdtree_(new pcl::KdTreeFLANN<CloudData::POINT>()),
+    input_target_(new CloudData::CLOUD()),
+    input_target_kdtree_(new pcl::KdTreeFLANN<CloudData::POINT>()) {
+    SetRegistrationParam(res, num_neighbors, trans_eps, max_iter, num_threads);
+}
+
+bool VGICPRegistration::SetRegistrationParam(
+    float res, int num_neighbors, float trans_eps, int max_iter,
+    int num_threads
+) {
+    res_ = res;
+    num_neighbors_ = num_neighbors;
+    trans_eps_ = trans_eps;
+    max_iter_ = max_iter;
+
+    // num_threads <= 0 means use all available cores:
+#ifdef _OPENMP
+    num_threads_ = (num_threads > 0) ? num_threads : omp_get_max_threads();
+#else
+    num_threads_ = 1;
+#endif
+    thread_systems_.resize(num_threads_);
+
+    std::cout << "VGICP params:" << std::endl
+              << "res: " << res_ << ", "
+              << "num_neighbors: " << num_neighbors_ << ", "
+              << "trans_eps: " << trans_eps_ << ", "
+              << "max_iter: " << max_iter_ << ", "
+              << "num_threads: " << num_threads_
+              << std::endl << std::endl;
+
+    return true;
+}
+
+bool VGICPRegistration::SetInputTarget(const CloudData::CLOUD_PTR& input_target) {
+    // a full target replaces all cached frames:
+    target_frames_.clear();
+    target_stats_.clear();
+    target_voxels_.clear();
+
+    return AddTargetFrame(0, input_target);
+}
+
+bool VGICPRegistration::AddTargetFrame(int frame_id, const CloudData::CLOUD_PTR& frame_cloud) {
+    if (target_frames_.count(frame_id) > 0) {
+        LOG(WARNING) << "VGICP target frame " << frame_id << " already exists.";
+        return false;
+    }
+
+    // per-frame statistics are computed only once, when the frame enters the target:
+    TargetFrame &frame = target_frames_[frame_id];
+    frame.cloud = frame_cloud;
+    GetVoxelStats(frame.cloud, frame.stats);
+
+    for (const auto &voxel_stats: frame.stats) {
+        target_stats_[voxel_stats.first].Add(voxel_stats.second);
+        UpdateTargetVoxel(voxel_stats.first);
+    }
+
+    has_target_kdtree_ = false;
+
+    return true;
+}
+
+bool VGICPRegistration::RemoveTargetFrame(int frame_id) {
+    auto frame = target_frames_.find(frame_id);
+    if (frame == target_frames_.end()) {
+        return false;
+    }
+
+    for (const auto &voxel_stats: frame->second.stats) {
+        auto target_voxel_stats = target_stats_.find(voxel_stats.first);
+        target_voxel_stats->second.Subtract(voxel_stats.second);
+
+        if (target_voxel_stats->second.num_points <= 0) {
+            target_stats_.erase(target_voxel_stats);
+        }
+        UpdateTargetVoxel(voxel_stats.first);
+    }
+    target_frames_.erase(frame);
+
+    has_target_kdtree_ = false;
+
+    return true;
+}
+
+bool VGICPRegistration::ScanMatch(const CloudData::CLOUD_PTR& input_source,
+                                  const Eigen::Matrix4f& predict_pose,
+                                  CloudData::CLOUD_PTR& result_cloud_ptr,
+                                  Eigen::Matrix4f& result_pose) {
+    TRACE_SCOPE("VGICPRegistration::ScanMatch", "registration");
+    input_source_ = input_source;
+    ComputeSourceCovariances();
+
+    Eigen::Matrix4d pose = predict_pose.cast<double>();
+    LinearSystem system;
+    num_iterations_ = 0;
+    bool has_converged = false;
+    const int max_iter = max_iteration_limit_ < 0 ? max_iter_ : std::min(max_iter_, max_iteration_limit_);
+    for (int curr_iter = 0; curr_iter < max_iter; ++curr_iter) {
+        ++num_iterations_;
+        BuildLinearSystem(pose, system);
+        if (system.num_corr < 6) {
+            break;
+        }
+
+        // Gauss-Newton step:
+        const Vector6d delta = system.H.ldlt().solve(system.b);
+        if (!delta.allFinite()) {
+            break;
+        }
+
+        pose = UpdatePose(pose, delta);
+
+        if (delta.norm() < trans_eps_) {
+            has_converged = true;
+            break;
+        }
+    }
+
+    final_transformation_ = pose.cast<float>();
+
+    const int N = static_cast<int>(input_source_->points.size());
+    result_ = Result();
+    result_.num_iterations = num_iterations_;
+    result_.has_converged = has_converged;
+    result_.inlier_ratio = (N > 0) ? static_cast<float>(system.num_corr) / N : 0.0f;
+    if (system.num_corr > 0) {
+        result_.fitness_score = static_cast<float>(system.sum_sq_dis / system.num_corr);
+    }
+    result_.has_hessian = (system.num_corr >= 6);
+    result_.hessian = system.H;
+
+    result_pose = final_transformation_;
+    pcl::transformPointCloud(*input_source_, *result_cloud_ptr, result_pose);
+
+    return true;
+}
+
+bool VGICPRegistration::SetMaxIterationLimit(int max_iteration_limit) {
+    max_iteration_limit_ = max_iteration_limit;
+
+    return true;
+}
+
+int VGICPRegistration::GetNumIterations() {
+    return num_iterations_;
+}
+
+RegistrationInterface::Result VGICPRegistration::GetResult() {
+    return result_;
+}
+
+int VGICPRegistration::Linearize(
+    const CloudData::CLOUD_PTR& input_source,
+    const Eigen::Matrix4d& pose,
+    Eigen::Matrix<double, 6, 6>& H,
+    Eigen::Matrix<double, 6, 1>& b
+) {
+    TRACE_SCOPE("VGICPRegistration::Linearize", "registration");
+    input_source_ = input_source;
+    // so that the fitness score is the one at the linearization point:
+    final_transformation_ = pose.cast<float>();
+
+    LinearSystem system;
+    BuildPlaneLinearSystem(pose, system);
+
+    H = system.H;
+    b = system.b;
+
+    return system.num_corr;
+}
+
+float VGICPRegistration::GetFitnessScore() {
+    // same definition as pcl::Registration::getFitnessScore,
+    // i.e., mean squared distance from aligned source to nearest target point.
+    // target frames are only concatenated here, so matching never pays for it:
+    if (!has_target_kdtree_) {
+        input_target_.reset(new CloudData::CLOUD());
+        for (const auto &frame: target_frames_) {
+            *input_target_ += *frame.second.cloud;
+        }
+        input_target_kdtree_->setInputCloud(input_target_);
+        has_target_kdtree_ = true;
+    }
+
+    const Eigen::Matrix3f R = final_transformation_.block<3, 3>(0, 0);
+    const Eigen::Vector3f t = final_transformation_.block<3, 1>(0, 3);
+    const int N = static_cast<int>(input_source_->points.size());
+
+    double sum_sq_dis = 0.0;
+    int num_corr = 0;
+#pragma omp parallel num_threads(num_threads_) reduction(+:sum_sq_dis, num_corr)
+    {
+        std::vector<int> corr_ind(1);
+        std::vector<float> corr_sq_dis(1);
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < N; ++i) {
+            CloudData::POINT point = input_source_->points[i];
+            point.getVector3fMap() = R * point.getVector3fMap() + t;
+
+            if (input_target_kdtree_->nearestKSearch(point, 1, corr_ind, corr_sq_dis) > 0) {
+                sum_sq_dis += corr_sq_dis.at(0);
+                ++num_corr;
+            }
+        }
+    }
+
+    return (num_corr > 0) ? static_cast<float>(sum_sq_dis / num_corr) : std::numeric_limits<float>::max();
+}
+
+Eigen::Vector3i VGICPRegistration::GetVoxelIndex(const Eigen::Vector3f &point) const {
+    return Eigen::Vector3i(
+        static_cast<int>(std::floor(point.x() / res_)),
+        static_cast<int>(std::floor(point.y() / res_)),
+        static_cast<int>(std::floor(point.z() / res_))
+    );
+}
+
+int64_t VGICPRegistration::GetVoxelKey(const Eigen::Vector3i &index) {
+    // 21 bits per axis:
+    static const int64_t OFFSET = (1 << 20);
+    static const int64_t MASK = (1 << 21) - 1;
+
+    return (
+        (((index.x() + OFFSET) & MASK) << 42) |
+        (((index.y() + OFFSET) & MASK) << 21) |
+        ((index.z() + OFFSET) & MASK)
+    );
+}
+
+void VGICPRegistration::GetVoxelStats(const CloudData::CLOUD_PTR& cloud, VoxelStatsMap &stats) const {
+    stats.clear();
+
+    for (const auto &point: cloud->points) {
+        const Eigen::Vector3f p = point.getVector3fMap();
+        const Eigen::Vector3d p_d = p.cast<double>();
+
+        VoxelStats &voxel_stats = stats[GetVoxelKey(GetVoxelIndex(p))];
+        ++voxel_stats.num_points;
+        voxel_stats.sum += p_d;
+        voxel_stats.sum_sq.noalias() += p_d * p_d.transpose();
+    }
+}
+
+void VGICPRegistration::UpdateTargetVoxel(int64_t key) {
+    auto voxel_stats = target_stats_.find(key);
+    if (voxel_stats == target_stats_.end() || voxel_stats->second.num_points < MIN_POINTS_PER_VOXEL) {
+        target_voxels_.erase(key);
+        return;
+    }
+
+    const double N = static_cast<double>(voxel_stats->second.num_points);
+    const Eigen::Vector3d mean = voxel_stats->second.sum / N;
+    const Eigen::Matrix3d cov = (voxel_stats->second.sum_sq - N * mean * mean.transpose()) / (N - 1.0);
+
+    // inflate near-singular covariances:
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eigen_solver(cov);
+    Eigen::Vector3d eigen_values = eigen_solver.eigenvalues();
+    if (eigen_values(2) <= 0.0) {
+        target_voxels_.erase(key);
+        return;
+    }
+    eigen_values = eigen_values.cwiseMax(MIN_EIGENVALUE_RATIO * eigen_values(2));
+
+    Voxel &voxel = target_voxels_[key];
+    voxel.mean = mean;
+    voxel.cov = eigen_solver.eigenvectors() * eigen_values.asDiagonal() * eigen_solver.eigenvectors().transpose();
+    voxel.normal = eigen_solver.eigenvectors().col(0);
+}
+
+void VGICPRegistration::ComputeSourceCovariances(void) {
+    input_source_kdtree_->setInputCloud(input_source_);
+
+    const int N = static_cast<int>(input_source_->points.size());
+    source_covs_.resize(N);
+
+#pragma omp parallel num_threads(num_threads_)
+    {
+        std::vector<int> corr_ind(num_neighbors_);
+        std::vector<float> corr_sq_dis(num_neighbors_);
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < N; ++i) {
+            const int num_found = input_source_kdtree_->nearestKSearch(
+                input_source_->points[i], num_neighbors_, corr_ind, corr_sq_dis
+            );
+            if (num_found < 3) {
+                source_covs_[i] = Eigen::Matrix3d::Identity();
+                continue;
+            }
+
+            Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+            Eigen::Matrix3d sum_sq = Eigen::Matrix3d::Zero();
+            for (int k = 0; k < num_found; ++k) {
+                const Eigen::Vector3d p = input_source_->points[corr_ind[k]].getVector3fMap().cast<double>();
+                sum += p;
+                sum_sq.noalias() += p * p.transpose();
+            }
+            const Eigen::Vector3d mean = sum / num_found;
+            const Eigen::Matrix3d cov = (sum_sq - num_found * mean * mean.transpose()) / num_found;
+
+            Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eigen_solver(cov);
+            const Eigen::Vector3d eigen_values(PLANE_EPSILON, 1.0, 1.0);
+            source_covs_[i] = eigen_solver.eigenvectors() * eigen_values.asDiagonal() * eigen_solver.eigenvectors().transpose();
+        }
+    }
+}
+
+void VGICPRegistration::BuildLinearSystem(const Eigen::Matrix4d &pose, LinearSystem &system) {
+    const Eigen::Matrix3d R = pose.block<3, 3>(0, 0);
+    const Eigen::Vector3d t = pose.block<3, 1>(0, 3);
+    const int N = static_cast<int>(input_source_->points.size());
+
+#pragma omp parallel num_threads(num_threads_)
+    {
+#ifdef _OPENMP
+        LinearSystem &partial = thread_systems_.at(omp_get_thread_num());
+#else
+        LinearSystem &partial = thread_systems_.at(0);
+#endif
+        partial.Reset();
+
+        Eigen::Matrix<double, 3, 6> J;
+        J.block<3, 3>(0, 0).setIdentity();
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < N; ++i) {
+            const Eigen::Vector3d point = R * input_source_->points[i].getVector3fMap().cast<double>() + t;
+
+            auto voxel = target_voxels_.find(GetVoxelKey(GetVoxelIndex(point.cast<float>())));
+            if (voxel == target_voxels_.end()) {
+                continue;
+            }
+
+            // distribution-to-distribution residual and its information matrix:
+            const Eigen::Vector3d d = voxel->second.mean - point;
+            const Eigen::Matrix3d info = (voxel->second.cov + R * source_covs_[i] * R.transpose()).inverse();
+
+            // jacobian of transformed point w.r.t. left perturbation [delta_t, delta_theta]:
+            J.block<3, 3>(0, 3) <<          0.0,  point.z(), -point.y(),
+                                     -point.z(),        0.0,  point.x(),
+                                      point.y(), -point.x(),        0.0;
+
+            partial.error += d.dot(info * d);
+            ++partial.num_corr;
+            partial.sum_sq_dis += std::pow(voxel->second.normal.dot(d), 2);
+            partial.b.noalias() += J.transpose() * info * d;
+            partial.H.noalias() += J.transpose() * info * J;
+        }
+    }
+
+    // reduce in thread order, so the result is deterministic:
+    system.Reset();
+    for (const auto &partial: thread_systems_) {
+        system.error += partial.error;
+        system.num_corr += partial.num_corr;
+        system.b += partial.b;
+        system.H += partial.H;
+        system.sum_sq_dis += partial.sum_sq_dis;
+    }
+}
+
+void VGICPRegistration::BuildPlaneLinearSystem(const Eigen::Matrix4d &pose, LinearSystem &system) {
+    const Eigen::Matrix3d R = pose.block<3, 3>(0, 0);
+    const Eigen::Vector3d t = pose.block<3, 1>(0, 3);
+    const int N = static_cast<int>(input_source_->points.size());
+
+#pragma omp parallel num_threads(num_threads_)
+    {
+#ifdef _OPENMP
+        LinearSystem &partial = thread_systems_.at(omp_get_thread_num());
+#else
+        LinearSystem &partial = thread_systems_.at(0);
+#endif
+        partial.Reset();
+
+        Vector6d J;
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < N; ++i) {
+            const Eigen::Vector3d point = R * input_source_->points[i].getVector3fMap().cast<double>() + t;
+
+            auto voxel = target_voxels_.find(GetVoxelKey(GetVoxelIndex(point.cast<float>())));
+            if (voxel == target_voxels_.end()) {
+                continue;
+            }
+
+            // point-to-plane residual:
+            const Eigen::Vector3d &normal = voxel->second.normal;
+            const double r = normal.dot(voxel->second.mean - point);
+
+            // negated jacobian w.r.t. left perturbation [delta_t, delta_theta], so the step solves H * delta = b:
+            J.head<3>() = normal;
+            J.tail<3>() = point.cross(normal);
+
+            partial.error += r * r;
+            ++partial.num_corr;
+            partial.sum_sq_dis += r * r;
+            partial.b.noalias() += J * r;
+            partial.H.noalias() += J * J.transpose();
+        }
+    }
+
+    // reduce in thread order, so the result is deterministic:
+    system.Reset();
+    for (const auto &partial: thread_systems_) {
+        system.error += partial.error;
+        system.num_corr += partial.num_corr;
+        system.b += partial.b;
+        system.H += partial.H;
+        system.sum_sq_dis += partial.sum_sq_dis;
+    }
+}
+
+Eigen::Matrix4d VGICPRegistration::UpdatePose(const Eigen::Matrix4d &pose, const Vector6d &delta) {
+    const Eigen::Vector3d delta_theta = delta.tail<3>();
+    const double angle = delta_theta.norm();
+
+    Eigen::Matrix3d delta_R = Eigen::Matrix3d::Identity();
+    if (angle > 1.0e-10) {
+        delta_R = Eigen::AngleAxisd(angle, delta_theta / angle).toRotationMatrix();
+    }
+
+    Eigen::Matrix4d updated_pose = Eigen::Matrix4d::Identity();
+    updated_pose.block<3, 3>(0, 0) = delta_R * pose.block<3, 3>(0, 0);
+    updated_pose.block<3, 1>(0, 3) = delta_R * pose.block<3, 1>(0, 3) + delta.head<3>();
+
+    return updated_pose;
+}
+
+void VGICPRegistration::VoxelStats::Add(const VoxelStats &other) {
+    num_points += other.num_points;
+    sum += other.sum;
+    sum_sq += other.sum_sq;
+}
+
+void VGICPRegistration::VoxelStats::Subtract(const VoxelStats &other) {
+    num_points -= other.num_points;
+    sum -= other.sum;
+    sum_sq -= other.sum_sq;
+}
+
+void VGICPRegistration::LinearSystem::Reset(void) {
+    error = 0.0;
+    num_corr = 0;
+    sum_sq_dis = 0.0;
+    b.setZero();
+    H.setZero();
+}
+
+}
@@ -0,0 +1,157 @@
+/*
+ * @Description: continuous-time lidar trajectory over a short time span, cumulative cubic B-spline of
+ *               poses integrated from raw IMU, for sub-sweep pose queries of deskew & sweep sync
+ * @Author: Ge Yao
+ * @Date: 2021-01-28 10:12:46
+ */
+#include "lidar_localization/models/scan_adjust/continuous_trajectory.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+namespace lidar_localization {
+
+namespace {
+// the last IMU measurement may end this much before the time span, its rate is then held:
+const double IMU_MAX_EXTRAPOLATION = 0.05;
+}
+
+bool ContinuousTrajectory::Build(
+    const std::deque<IMUData>& imu_data_buff,
+    const Eigen::Matrix3f& imu_to_lidar_rotation, const Eigen::Vector3f& velocity,
+    double reference_time, double begin_time, double end_time
+) {
+    rotations_.clear();
+    positions_.clear();
+    delta_angles_.clear();
+    delta_positions_.clear();
+
+    if (
+        imu_data_buff.size() < 2 || end_time < begin_time ||
+        imu_data_buff.front().time > begin_time ||
+        imu_data_buff.back().time < end_time - IMU_MAX_EXTRAPOLATION
+    ) {
+        return false;
+    }
+
+    // the spline is valid from the second control pose to the third last:
+    const int num_poses = static_cast<int>(std::ceil((end_time - begin_time) / knot_interval_)) + 4;
+    begin_time_ = begin_time - knot_interval_;
+
+    rotations_.resize(num_poses);
+    positions_.resize(num_poses);
+    rotations_.front() = Eigen::Matrix3f::Identity();
+    positions_.front() = Eigen::Vector3f::Zero();
+    const float delta_time = static_cast<float>(knot_interval_);
+    for (int k = 0; k + 1 < num_poses; ++k) {
+        const Eigen::Vector3f delta_angle = imu_to_lidar_rotation * GetAngularRate(
+            imu_data_buff, begin_time_ + (k + 0.5) * knot_interval_
+        ) * delta_time;
+
+        rotations_[k + 1] = rotations_[k] * Exp(delta_angle);
+        positions_[k + 1] = positions_[k] + 0.5f * (rotations_[k] + rotations_[k + 1]) * velocity * delta_time;
+    }
+
+    delta_angles_.resize(num_poses - 1);
+    delta_positions_.resize(num_poses - 1);
+    for (int k = 0; k + 1 < num_poses; ++k) {
+        delta_angles_[k] = Log(rotations_[k].transpose() * rotations_[k + 1]);
+        delta_positions_[k] = positions_[k + 1] - positions_[k];
+    }
+
+    Eigen::Matrix3f reference_rotation;
+    Evaluate(reference_time, reference_rotation, reference_position_);
+    reference_rotation_inverse_ = reference_rotation.transpose();
+
+    return true;
+}
+
+void ContinuousTrajectory::GetPose(double time, Eigen::Matrix3f& rotation, Eigen::Vector3f& translation) const {
+    Evaluate(time, rotation, translation);
+
+    rotation = reference_rotation_inverse_ * rotation;
+    translation = reference_rotation_inverse_ * (translation - reference_position_);
+}
+
+void ContinuousTrajectory::GetPoses(
+    const std::vector<double>& times,
+    std::vector<Eigen::Matrix3f>& rotations, std::vector<Eigen::Vector3f>& translations
+) const {
+    rotations.resize(times.size());
+    translations.resize(times.size());
+
+    for (size_t i = 0; i < times.size(); ++i) {
+        GetPose(times[i], rotations[i], translations[i]);
+    }
+}
+
+void ContinuousTrajectory::Evaluate(double time, Eigen::Matrix3f& rotation, Eigen::Vector3f& translation) const {
+    const int num_poses = static_cast<int>(rotations_.size());
+
+    const double s = (time - begin_time_) / knot_interval_;
+    int k = static_cast<int>(std::floor(s));
+    double u = s - k;
+    if (k < 1) {
+        k = 1;
+        u = 0.0;
+    } else if (k > num_poses - 3) {
+        k = num_poses - 3;
+        u = 1.0;
+    }
+
+    // cumulative basis of the uniform cubic B-spline, b_0 is 1:
+    const float u_1 = static_cast<float>(u);
+    const float u_2 = u_1 * u_1;
+    const float u_3 = u_2 * u_1;
+    const float b_1 = (5.0f + 3.0f * u_1 - 3.0f * u_2 + u_3) / 6.0f;
+    const float b_2 = (1.0f + 3.0f * u_1 + 3.0f * u_2 - 2.0f * u_3) / 6.0f;
+    const float b_3 = u_3 / 6.0f;
+
+    rotation = rotations_[k - 1] *
+               Exp(b_1 * delta_angles_[k - 1]) *
+               Exp(b_2 * delta_angles_[k]) *
+               Exp(b_3 * delta_angles_[k + 1]);
+    translation = positions_[k - 1] +
+                  b_1 * delta_positions_[k - 1] +
+                  b_2 * delta_positions_[k] +
+                  b_3 * delta_positions_[k + 1];
+}
+
+Eigen::Vector3f ContinuousTrajectory::GetAngularRate(const std::deque<IMUData>& imu_data_buff, double time) {
+    // first measurement not earlier than time:
+    auto back_it = std::lower_bound(
+        imu_data_buff.begin(), imu_data_buff.end(), time,
+        [](const IMUData& imu_data, double time) { return imu_data.time < time; }
+    );
+    if (back_it == imu_data_buff.begin())
+        back_it = imu_data_buff.begin() + 1;
+    if (back_it == imu_data_buff.end())
+        back_it = imu_data_buff.end() - 1;
+
+    const IMUData& front_data = *(back_it - 1);
+    const IMUData& back_data = *back_it;
+    double back_scale = (time - front_data.time) / (back_data.time - front_data.time);
+    back_scale = std::max(std::min(back_scale, 1.0), 0.0);
+    double front_scale = 1.0 - back_scale;
+
+    return Eigen::Vector3f(
+        front_data.angular_velocity.x * front_scale + back_data.angular_velocity.x * back_scale,
+        front_data.angular_velocity.y * front_scale + back_data.angular_velocity.y * back_scale,
+        front_data.angular_velocity.z * front_scale + back_data.angular_velocity.z * back_scale
+    );
+}
+
+Eigen::Matrix3f ContinuousTrajectory::Exp(const Eigen::Vector3f& delta_angle) {
+    const float delta_angle_norm = delta_angle.norm();
+    if (delta_angle_norm <= 0.0f)
+        return Eigen::Matrix3f::Identity();
+
+    return Eigen::AngleAxisf(delta_angle_norm, delta_angle / delta_angle_norm).matrix();
+}
+
+Eigen::Vector3f ContinuousTrajectory::Log(const Eigen::Matrix3f& rotation) {
+    const Eigen::AngleAxisf angle_axis(rotation);
+    return angle_axis.angle() * angle_axis.axis();
+}
+
+} // namespace lidar_localization
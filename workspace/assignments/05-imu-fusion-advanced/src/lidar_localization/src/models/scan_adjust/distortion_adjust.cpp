@@ -4,60 +4,282 @@
  * @Date: 2020-02-25 14:39:00
  */
 #include "lidar_localization/models/scan_adjust/distortion_adjust.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/cloud_pool.hpp"
+#include <algorithm>
+
 #include "glog/logging.h"
 
 namespace lidar_localization {
+
+namespace {
+// raw IMU kept for deskew:
+const double IMU_BUFFER_DURATION = 0.5;
+}
+
 void DistortionAdjust::SetMotionInfo(float scan_period, VelocityData velocity_data) {
     scan_period_ = scan_period;
     velocity_ << velocity_data.linear_velocity.x, velocity_data.linear_velocity.y, velocity_data.linear_velocity.z;
     angular_rate_ << velocity_data.angular_velocity.x, velocity_data.angular_velocity.y, velocity_data.angular_velocity.z;
 }
 
+void DistortionAdjust::SetLidarToIMU(const Eigen::Matrix4f& lidar_to_imu) {
+    imu_to_lidar_rotation_ = lidar_to_imu.block<3, 3>(0, 0).transpose();
+    has_lidar_to_imu_ = true;
+}
+
+void DistortionAdjust::AddIMUData(const IMUData& imu_data) {
+    imu_data_buff_.push_back(imu_data);
+
+    while (imu_data_buff_.front().time < imu_data.time - IMU_BUFFER_DURATION) {
+        imu_data_buff_.pop_front();
+    }
+}
+
 bool DistortionAdjust::AdjustCloud(CloudData::CLOUD_PTR& input_cloud_ptr, CloudData::CLOUD_PTR& output_cloud_ptr) {
-    CloudData::CLOUD_PTR origin_cloud_ptr(new CloudData::CLOUD(*input_cloud_ptr));
-    output_cloud_ptr.reset(new CloudData::CLOUD());
+    TRACE_SCOPE("DistortionAdjust::AdjustCloud", "deskew");
+    return AdjustCloudByAzimuth(input_cloud_ptr, output_cloud_ptr, false, 0.0);
+}
+
+bool DistortionAdjust::AdjustCloud(CloudData& cloud_data) {
+    TRACE_SCOPE("DistortionAdjust::AdjustCloud", "deskew");
+    bool is_adjusted = false;
+    if (
+        cloud_data.point_times_ptr && 
+        cloud_data.point_times_ptr->size() == cloud_data.cloud_ptr->points.size()
+    ) {
+        is_adjusted = AdjustCloudByPointTimes(cloud_data);
+    } else {
+        is_adjusted = AdjustCloudByAzimuth(cloud_data.cloud_ptr, cloud_data.cloud_ptr, true, cloud_data.time);
+    }
+
+    // all points are at cloud_data.time now, and moved:
+    cloud_data.point_times_ptr.reset();
+    cloud_data.range_image_ptr.reset();
+
+    return is_adjusted;
+}
+
+bool DistortionAdjust::AdjustCloud(CloudData& cloud_data, double reference_time) {
+    const float time_offset = static_cast<float>(cloud_data.time - reference_time);
+
+    // point times are simply made relative to reference time:
+    if (
+        cloud_data.point_times_ptr && 
+        cloud_data.point_times_ptr->size() == cloud_data.cloud_ptr->points.size()
+    ) {
+        CloudData::POINT_TIMES_PTR point_times_ptr = std::make_shared<CloudData::POINT_TIMES>(*cloud_data.point_times_ptr);
+        for (float& point_time: *point_times_ptr) {
+            point_time += time_offset;
+        }
+        cloud_data.point_times_ptr = point_times_ptr;
+        cloud_data.time = reference_time;
 
-    float orientation_space = 2.0 * M_PI;
-    float delete_space = 5.0 * M_PI / 180.0;
-    float start_orientation = atan2(origin_cloud_ptr->points[0].y, origin_cloud_ptr->points[0].x);
+        return AdjustCloud(cloud_data);
+    }
+
+    // otherwise deskewed to the sweep time first, as the azimuth is relative to it, then moved by the motion in between.
+    // the motion is taken before it is changed by the azimuth adjustment:
+    const Eigen::Vector3f velocity = velocity_;
+    const Eigen::Vector3f angular_rate = angular_rate_;
+
+    bool is_adjusted = AdjustCloud(cloud_data);
+    const double scan_time = cloud_data.time;
+    cloud_data.time = reference_time;
+
+    if (time_offset == 0.0f)
+        return is_adjusted;
+
+    //   p_adjusted = R * p + t, the pose at sweep time in lidar frame at reference time,
+    // from the IMU trajectory when it covers both, constant velocity otherwise:
+    Eigen::Matrix3f rotation = Eigen::Matrix3f::Identity();
+    Eigen::Vector3f translation = velocity * time_offset;
+    if (
+        has_lidar_to_imu_ &&
+        trajectory_.Build(
+            imu_data_buff_, imu_to_lidar_rotation_, velocity, reference_time,
+            std::min(scan_time, reference_time), std::max(scan_time, reference_time)
+        )
+    ) {
+        trajectory_.GetPose(scan_time, rotation, translation);
+    } else {
+        Eigen::Vector3f delta_angle = angular_rate * time_offset;
+        float delta_angle_norm = delta_angle.norm();
+        if (delta_angle_norm > 0.0f) {
+            rotation = Eigen::AngleAxisf(delta_angle_norm, delta_angle / delta_angle_norm).matrix();
+        }
+    }
+
+    CloudData::CLOUD& cloud = *cloud_data.cloud_ptr;
+    const int N = static_cast<int>(cloud.points.size());
+#pragma omp parallel for schedule(static)
+    for (int point_index = 0; point_index < N; ++point_index) {
+        CloudData::POINT& point = cloud.points[point_index];
+        point.getVector3fMap() = rotation * point.getVector3fMap() + translation;
+    }
+
+    return is_adjusted;
+}
+
+bool DistortionAdjust::AdjustCloudByAzimuth(
+    CloudData::CLOUD_PTR& input_cloud_ptr, CloudData::CLOUD_PTR& output_cloud_ptr,
+    bool use_imu, double scan_time
+) {
+    // input and output may be the same pointer:
+    CloudData::CLOUD_PTR origin_cloud_ptr = input_cloud_ptr;
+    output_cloud_ptr = CloudPool::GetInstance().Get();
+
+    if (origin_cloud_ptr->points.empty())
+        return true;
+
+    const float orientation_space = 2.0 * M_PI;
+    const float delete_space = 5.0 * M_PI / 180.0;
+    const float start_orientation = atan2(origin_cloud_ptr->points[0].y, origin_cloud_ptr->points[0].x);
 
     Eigen::AngleAxisf t_V(start_orientation, Eigen::Vector3f::UnitZ());
     Eigen::Matrix3f rotate_matrix = t_V.matrix();
-    Eigen::Matrix4f transform_matrix = Eigen::Matrix4f::Identity();
-    transform_matrix.block<3,3>(0,0) = rotate_matrix.inverse();
-    pcl::transformPointCloud(*origin_cloud_ptr, *origin_cloud_ptr, transform_matrix);
 
-    velocity_ = rotate_matrix * velocity_;
-    angular_rate_ = rotate_matrix * angular_rate_;
+    if (!use_imu || !BuildIMUTable(scan_time, -scan_period_ / 2.0, scan_period_ / 2.0)) {
+        velocity_ = rotate_matrix * velocity_;
+        angular_rate_ = rotate_matrix * angular_rate_;
 
-    for (size_t point_index = 1; point_index < origin_cloud_ptr->points.size(); ++point_index) {
-        float orientation = atan2(origin_cloud_ptr->points[point_index].y, origin_cloud_ptr->points[point_index].x);
+        // the rotation to start orientation and back is fused into the table:
+        //   p_adjusted = R_start * (R(t) * R_start^T * p + v * t)
+        BuildConstantTable(-scan_period_ / 2.0, scan_period_ / 2.0);
+        for (size_t i = 0; i < rotation_table_.size(); ++i) {
+            rotation_table_[i] = rotate_matrix * rotation_table_[i] * rotate_matrix.transpose();
+            translation_table_[i] = rotate_matrix * translation_table_[i];
+        }
+    }
+
+    const int N = static_cast<int>(origin_cloud_ptr->points.size());
+    CloudData::CLOUD& output_cloud = *output_cloud_ptr;
+    output_cloud.points.resize(N);
+    is_kept_.assign(N, 0);
+
+#pragma omp parallel for schedule(static)
+    for (int point_index = 1; point_index < N; ++point_index) {
+        const CloudData::POINT& origin_point = origin_cloud_ptr->points[point_index];
+
+        // orientation relative to the first point:
+        float orientation = FastAtan2(origin_point.y, origin_point.x) - start_orientation;
         if (orientation < 0.0)
             orientation += 2.0 * M_PI;
-        
+        else if (orientation >= 2.0 * M_PI)
+            orientation -= 2.0 * M_PI;
+
         if (orientation < delete_space || 2.0 * M_PI - orientation < delete_space)
             continue;
 
-        float real_time = fabs(orientation) / orientation_space * scan_period_ - scan_period_ / 2.0;
+        float bucket = orientation / orientation_space * NUM_ROTATION_BUCKETS;
+        int bucket_index = std::min(static_cast<int>(bucket), NUM_ROTATION_BUCKETS - 1);
+        float ratio = bucket - bucket_index;
 
-        Eigen::Vector3f origin_point(origin_cloud_ptr->points[point_index].x,
-                                     origin_cloud_ptr->points[point_index].y,
-                                     origin_cloud_ptr->points[point_index].z);
+        Eigen::Matrix3f current_matrix = (1.0f - ratio) * rotation_table_[bucket_index] + ratio * rotation_table_[bucket_index + 1];
+        Eigen::Vector3f current_translation = (1.0f - ratio) * translation_table_[bucket_index] + ratio * translation_table_[bucket_index + 1];
+        Eigen::Vector3f adjusted_point = current_matrix * origin_point.getVector3fMap() + current_translation;
 
-        Eigen::Matrix3f current_matrix = UpdateMatrix(real_time);
-        Eigen::Vector3f rotated_point = current_matrix * origin_point;
-        Eigen::Vector3f adjusted_point = rotated_point + velocity_ * real_time;
-        CloudData::POINT point;
+        // other fields of richer point types are kept:
+        CloudData::POINT& point = output_cloud.points[point_index];
+        point = origin_point;
         point.x = adjusted_point(0);
         point.y = adjusted_point(1);
         point.z = adjusted_point(2);
-        output_cloud_ptr->points.push_back(point);
+        is_kept_[point_index] = 1;
     }
 
-    pcl::transformPointCloud(*output_cloud_ptr, *output_cloud_ptr, transform_matrix.inverse());
+    // compact while keeping scan order:
+    int num_kept = 0;
+    for (int point_index = 1; point_index < N; ++point_index) {
+        if (is_kept_[point_index])
+            output_cloud.points[num_kept++] = output_cloud.points[point_index];
+    }
+    output_cloud.points.resize(num_kept);
+    output_cloud.width = num_kept;
+    output_cloud.height = 1;
+
     return true;
 }
 
+bool DistortionAdjust::AdjustCloudByPointTimes(CloudData& cloud_data) {
+    CloudData::CLOUD_PTR origin_cloud_ptr = cloud_data.cloud_ptr;
+    const CloudData::POINT_TIMES& point_times = *cloud_data.point_times_ptr;
+
+    CloudData::CLOUD_PTR output_cloud_ptr = CloudPool::GetInstance().Get();
+    cloud_data.cloud_ptr = output_cloud_ptr;
+
+    if (point_times.empty())
+        return true;
+
+    auto time_range = std::minmax_element(point_times.begin(), point_times.end());
+    const float begin_time = *time_range.first;
+    const float end_time = std::max(*time_range.second, begin_time + 1.0e-3f);
+
+    if (!BuildIMUTable(cloud_data.time, begin_time, end_time)) {
+        BuildConstantTable(begin_time, end_time);
+    }
+
+    // no start orientation to rotate to, the table is in lidar frame:
+    //   p_adjusted = R(t) * p + T(t)
+    const int N = static_cast<int>(origin_cloud_ptr->points.size());
+    CloudData::CLOUD& output_cloud = *output_cloud_ptr;
+    output_cloud.points.resize(N);
+    output_cloud.width = N;
+    output_cloud.height = 1;
+    output_cloud.is_dense = origin_cloud_ptr->is_dense;
+
+#pragma omp parallel for schedule(static)
+    for (int point_index = 0; point_index < N; ++point_index) {
+        const float real_time = point_times[point_index];
+
+        float bucket = (real_time - begin_time) / (end_time - begin_time) * NUM_ROTATION_BUCKETS;
+        int bucket_index = std::max(std::min(static_cast<int>(bucket), NUM_ROTATION_BUCKETS - 1), 0);
+        float ratio = bucket - bucket_index;
+
+        Eigen::Matrix3f current_matrix = (1.0f - ratio) * rotation_table_[bucket_index] + ratio * rotation_table_[bucket_index + 1];
+        Eigen::Vector3f current_translation = (1.0f - ratio) * translation_table_[bucket_index] + ratio * translation_table_[bucket_index + 1];
+        Eigen::Vector3f adjusted_point = current_matrix * origin_cloud_ptr->points[point_index].getVector3fMap() + current_translation;
+
+        CloudData::POINT& point = output_cloud.points[point_index];
+        point = origin_cloud_ptr->points[point_index];
+        point.x = adjusted_point(0);
+        point.y = adjusted_point(1);
+        point.z = adjusted_point(2);
+    }
+
+    return true;
+}
+
+bool DistortionAdjust::BuildIMUTable(double scan_time, float begin_time, float end_time) {
+    if (
+        !has_lidar_to_imu_ ||
+        !trajectory_.Build(
+            imu_data_buff_, imu_to_lidar_rotation_, velocity_, scan_time,
+            scan_time + begin_time, scan_time + end_time
+        )
+    ) {
+        return false;
+    }
+
+    knot_times_.resize(NUM_ROTATION_BUCKETS + 1);
+    for (int i = 0; i <= NUM_ROTATION_BUCKETS; ++i) {
+        knot_times_[i] = scan_time + begin_time + static_cast<double>(i) / NUM_ROTATION_BUCKETS * (end_time - begin_time);
+    }
+    trajectory_.GetPoses(knot_times_, rotation_table_, translation_table_);
+
+    return true;
+}
+
+void DistortionAdjust::BuildConstantTable(float begin_time, float end_time) {
+    rotation_table_.resize(NUM_ROTATION_BUCKETS + 1);
+    translation_table_.resize(NUM_ROTATION_BUCKETS + 1);
+    for (int i = 0; i <= NUM_ROTATION_BUCKETS; ++i) {
+        float real_time = begin_time + static_cast<float>(i) / NUM_ROTATION_BUCKETS * (end_time - begin_time);
+        rotation_table_[i] = UpdateMatrix(real_time);
+        translation_table_[i] = velocity_ * real_time;
+    }
+}
+
 Eigen::Matrix3f DistortionAdjust::UpdateMatrix(float real_time) {
     Eigen::Vector3f angle = angular_rate_ * real_time;
     Eigen::AngleAxisf t_Vz(angle(2), Eigen::Vector3f::UnitZ());
@@ -67,4 +289,25 @@ Eigen::Matrix3f DistortionAdjust::UpdateMatrix(float real_time) {
     t_V = t_Vz * t_Vy * t_Vx;
     return t_V.matrix();
 }
-} // namespace lidar_localization
\ No newline at end of file
+
+float DistortionAdjust::FastAtan2(float y, float x) {
+    const float abs_x = std::fabs(x);
+    const float abs_y = std::fabs(y);
+    if (abs_x == 0.0f && abs_y == 0.0f)
+        return 0.0f;
+
+    // atan on [0, 1] by a minimax polynomial, then unfold the octants:
+    const float a = std::min(abs_x, abs_y) / std::max(abs_x, abs_y);
+    const float s = a * a;
+    float r = ((-0.0464964749f * s + 0.15931422f) * s - 0.327622764f) * s * a + a;
+
+    if (abs_y > abs_x)
+        r = 0.5f * M_PI - r;
+    if (x < 0.0f)
+        r = M_PI - r;
+    if (y < 0.0f)
+        r = -r;
+
+    return r;
+}
+} // namespace lidar_localization
@@ -0,0 +1,169 @@
+/*
+ * @Description: deskew the sweeps of several lidars to a common time and merge them, under a per-sensor point budget
+ * @Author: Ge Yao
+ * @Date: 2020-12-30 10:21:46
+ */
+#include "lidar_localization/models/scan_adjust/multi_lidar_merger.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/cloud_pool.hpp"
+
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+MultiLidarMerger::MultiLidarMerger(const YAML::Node& node) {
+    const YAML::Node& secondary_lidars_node = node["secondary_lidars"];
+    sensors_.reserve(1 + (secondary_lidars_node.IsSequence() ? secondary_lidars_node.size() : 0));
+
+    AddSensor(node["primary_lidar"]);
+    if (secondary_lidars_node.IsSequence()) {
+        for (const YAML::Node& secondary_lidar_node: secondary_lidars_node) {
+            AddSensor(secondary_lidar_node);
+        }
+    }
+
+    std::cout << "Multi-Lidar Merger params:" << std::endl
+              << "\tnum. sensors: " << sensors_.size() << std::endl;
+    for (size_t i = 0; i < sensors_.size(); ++i) {
+        std::cout << "\tsensor " << i << " max. points: " << sensors_.at(i).max_points << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void MultiLidarMerger::AddSensor(const YAML::Node& node) {
+    sensors_.emplace_back();
+    Sensor& sensor = sensors_.back();
+
+    float leaf_size = node["leaf_size"].as<float>();
+    if (leaf_size > 0.0f) {
+        sensor.voxel_filter_ptr = std::make_shared<FastVoxelFilter>(
+            leaf_size, leaf_size, leaf_size, FastVoxelFilter::CENTROID
+        );
+    }
+    sensor.max_points = static_cast<size_t>(std::max(node["max_points"].as<int>(), 0));
+}
+
+void MultiLidarMerger::SetLidarToIMU(int sensor_index, const Eigen::Matrix4f& lidar_to_imu) {
+    Sensor& sensor = sensors_.at(sensor_index);
+    sensor.lidar_to_imu = lidar_to_imu;
+    sensor.distortion_adjust.SetLidarToIMU(lidar_to_imu);
+
+    // the primary extrinsic may come last:
+    const Eigen::Matrix4f imu_to_primary = sensors_.front().lidar_to_imu.inverse();
+    for (Sensor& other_sensor: sensors_) {
+        other_sensor.lidar_to_primary = imu_to_primary * other_sensor.lidar_to_imu;
+    }
+}
+
+void MultiLidarMerger::SetIMUData(const std::deque<IMUData>& imu_data_buff) {
+    for (Sensor& sensor: sensors_) {
+        sensor.distortion_adjust.SetIMUData(imu_data_buff);
+    }
+}
+
+bool MultiLidarMerger::Merge(
+    float scan_period, const VelocityData& velocity_data,
+    CloudData& cloud_data, const std::vector<CloudData>& secondary_cloud_data
+) {
+    TRACE_SCOPE("MultiLidarMerger::Merge", "deskew");
+    if (secondary_cloud_data.size() + 1 != sensors_.size()) {
+        LOG(ERROR) << "Multi-lidar merger expects " << sensors_.size() - 1 << " secondary sweeps, got "
+                   << secondary_cloud_data.size();
+        return false;
+    }
+
+    const int N = static_cast<int>(sensors_.size());
+    sensors_.front().cloud_data = cloud_data;
+    for (int i = 1; i < N; ++i) {
+        sensors_.at(i).cloud_data = secondary_cloud_data.at(i - 1);
+    }
+
+    // one thread per sensor, the nested loops of deskew and filter run serially then:
+    std::vector<uint8_t> is_adjusted(N, 0);
+#pragma omp parallel for num_threads(N) schedule(static, 1)
+    for (int i = 0; i < N; ++i) {
+        is_adjusted[i] = AdjustCloud(sensors_[i], scan_period, velocity_data, cloud_data.time);
+    }
+
+    // merge in sensor order:
+    size_t num_points = 0;
+    for (const Sensor& sensor: sensors_) {
+        num_points += sensor.cloud_data.cloud_ptr->points.size();
+    }
+    CloudData::CLOUD_PTR merged_cloud_ptr = CloudPool::GetInstance().Get();
+    merged_cloud_ptr->points.reserve(num_points);
+    for (Sensor& sensor: sensors_) {
+        const CloudData::CLOUD& cloud = *sensor.cloud_data.cloud_ptr;
+        merged_cloud_ptr->points.insert(merged_cloud_ptr->points.end(), cloud.points.begin(), cloud.points.end());
+        // the sweeps go back to the pool:
+        sensor.cloud_data.cloud_ptr.reset();
+        sensor.cloud_data.point_times_ptr.reset();
+        sensor.cloud_data.range_image_ptr.reset();
+    }
+    merged_cloud_ptr->width = merged_cloud_ptr->points.size();
+    merged_cloud_ptr->height = 1;
+
+    cloud_data.cloud_ptr = merged_cloud_ptr;
+    cloud_data.point_times_ptr.reset();
+    cloud_data.range_image_ptr.reset();
+
+    for (int i = 0; i < N; ++i) {
+        if (!is_adjusted[i])
+            return false;
+    }
+
+    return true;
+}
+
+bool MultiLidarMerger::AdjustCloud(
+    Sensor& sensor, float scan_period, const VelocityData& velocity_data, double reference_time
+) {
+    CloudData& cloud_data = sensor.cloud_data;
+    if (cloud_data.cloud_ptr->points.empty())
+        return true;
+
+    // velocity of this lidar, in its frame:
+    VelocityData lidar_velocity_data = velocity_data;
+    lidar_velocity_data.TransformCoordinate(sensor.lidar_to_primary);
+
+    sensor.distortion_adjust.SetMotionInfo(scan_period, lidar_velocity_data);
+    bool is_adjusted = sensor.distortion_adjust.AdjustCloud(cloud_data, reference_time);
+
+    if (sensor.voxel_filter_ptr) {
+        CloudData::CLOUD_PTR filtered_cloud_ptr;
+        sensor.voxel_filter_ptr->Filter(cloud_data.cloud_ptr, filtered_cloud_ptr);
+        cloud_data.cloud_ptr = filtered_cloud_ptr;
+    }
+    ApplyBudget(sensor.max_points, *cloud_data.cloud_ptr);
+
+    // into primary lidar frame, the deskewed cloud is owned here:
+    if (!sensor.lidar_to_primary.isIdentity()) {
+        const Eigen::Matrix3f rotation = sensor.lidar_to_primary.block<3, 3>(0, 0);
+        const Eigen::Vector3f translation = sensor.lidar_to_primary.block<3, 1>(0, 3);
+        for (CloudData::POINT& point: cloud_data.cloud_ptr->points) {
+            point.getVector3fMap() = rotation * point.getVector3fMap() + translation;
+        }
+    }
+
+    return is_adjusted;
+}
+
+void MultiLidarMerger::ApplyBudget(size_t max_points, CloudData::CLOUD& cloud) {
+    const size_t N = cloud.points.size();
+    if (max_points == 0 || N <= max_points)
+        return;
+
+    // evenly spaced along the filter output, which keeps the scan order of the first points:
+    for (size_t i = 0; i < max_points; ++i) {
+        cloud.points[i] = cloud.points[i * N / max_points];
+    }
+    cloud.points.resize(max_points);
+    cloud.width = max_points;
+    cloud.height = 1;
+}
+
+} // namespace lidar_localization
@@ -0,0 +1,213 @@
+/*
+ * @Description: device side of ScanContextDistance, min-shift distances of source-target blocks
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 19:36:08
+ */
+#include "lidar_localization/models/scan_context_manager/cuda/scan_context_distance_kernels.hpp"
+
+#include <algorithm>
+#include <cfloat>
+
+#include <cuda_runtime.h>
+
+#include <thrust/device_vector.h>
+#include <thrust/system_error.h>
+
+namespace lidar_localization {
+
+namespace {
+const int WARP_SIZE = 32;
+// one warp per source, the target & the sources of a block are staged in shared memory:
+const int SOURCES_PER_BLOCK = 4;
+const int BLOCK_SIZE = SOURCES_PER_BLOCK * WARP_SIZE;
+const int MAX_GRID_Y = 65535;
+const size_t MAX_SHARED_BYTES = 48 * 1024;
+
+size_t GetSharedBytes(int R, int N) {
+    return sizeof(float) * (2 * N * R + 2 * N + SOURCES_PER_BLOCK * (N * R + N));
+}
+
+// block (t, b) scores target t against sources [b * SOURCES_PER_BLOCK, (b + 1) * SOURCES_PER_BLOCK),
+// each lane tries every 32nd shift and the warp keeps the min., ties to the smaller shift as on the CPU:
+__global__ void GetRowsKernel(
+    const float* targets, const float* target_is_valid, int num_targets,
+    const float* sources, const float* source_is_valid, int source_begin, int source_end,
+    int R, int N,
+    float* distances, int* shifts
+) {
+    extern __shared__ float shared[];
+    const int M = N * R;
+    float* target = shared;
+    float* target_valid = target + 2 * M;
+    float* source = target_valid + 2 * N;
+    float* source_valid = source + SOURCES_PER_BLOCK * M;
+
+    const int t = blockIdx.x;
+    const int block_begin = source_begin + blockIdx.y * SOURCES_PER_BLOCK;
+    const int block_size = min(SOURCES_PER_BLOCK, source_end - block_begin);
+
+    for (int i = threadIdx.x; i < 2 * M; i += blockDim.x) {
+        target[i] = targets[static_cast<size_t>(t) * 2 * M + i];
+    }
+    for (int i = threadIdx.x; i < 2 * N; i += blockDim.x) {
+        target_valid[i] = target_is_valid[static_cast<size_t>(t) * 2 * N + i];
+    }
+    for (int i = threadIdx.x; i < block_size * M; i += blockDim.x) {
+        source[i] = sources[static_cast<size_t>(block_begin) * M + i];
+    }
+    for (int i = threadIdx.x; i < block_size * N; i += blockDim.x) {
+        source_valid[i] = source_is_valid[static_cast<size_t>(block_begin) * N + i];
+    }
+    __syncthreads();
+
+    const int k = threadIdx.x / WARP_SIZE;
+    const int lane = threadIdx.x % WARP_SIZE;
+    if (k >= block_size)
+        return;
+
+    const float* s = source + k * M;
+    const float* s_valid = source_valid + k * N;
+    float optimal_dist = FLT_MAX;
+    int optimal_shift = N;
+    for (int shift = lane; shift < N; shift += WARP_SIZE) {
+        const float* shifted = target + (N - shift) * R;
+        const float* shifted_valid = target_valid + (N - shift);
+
+        float similarity = 0.0f;
+        for (int i = 0; i < M; ++i) {
+            similarity += shifted[i] * s[i];
+        }
+        float num_effective_cols = 0.0f;
+        for (int i = 0; i < N; ++i) {
+            num_effective_cols += shifted_valid[i] * s_valid[i];
+        }
+
+        const float dist = (
+            num_effective_cols < 0.5f ? 1.0f : (1.0f - similarity / num_effective_cols)
+        );
+        if (dist < optimal_dist) {
+            optimal_dist = dist;
+            optimal_shift = shift;
+        }
+    }
+
+    for (int offset = WARP_SIZE / 2; offset > 0; offset /= 2) {
+        const float other_dist = __shfl_down_sync(0xffffffff, optimal_dist, offset);
+        const int other_shift = __shfl_down_sync(0xffffffff, optimal_shift, offset);
+        if (other_dist < optimal_dist || (other_dist == optimal_dist && other_shift < optimal_shift)) {
+            optimal_dist = other_dist;
+            optimal_shift = other_shift;
+        }
+    }
+
+    if (0 == lane) {
+        const size_t index = static_cast<size_t>(block_begin - source_begin + k) * num_targets + t;
+        distances[index] = optimal_dist;
+        shifts[index] = optimal_shift;
+    }
+}
+}
+
+struct ScanContextDistanceKernels::Impl {
+  int num_rings;
+  int num_sectors;
+
+  thrust::device_vector<float> targets;
+  thrust::device_vector<float> target_is_valid;
+  int num_targets = 0;
+
+  thrust::device_vector<float> sources;
+  thrust::device_vector<float> source_is_valid;
+  thrust::device_vector<float> distances;
+  thrust::device_vector<int> shifts;
+};
+
+ScanContextDistanceKernels::ScanContextDistanceKernels(int num_rings, int num_sectors)
+    : impl_(new Impl()) {
+    impl_->num_rings = num_rings;
+    impl_->num_sectors = num_sectors;
+}
+
+ScanContextDistanceKernels::~ScanContextDistanceKernels() = default;
+
+bool ScanContextDistanceKernels::IsDeviceAvailable(void) {
+    int num_devices = 0;
+    return cudaGetDeviceCount(&num_devices) == cudaSuccess && num_devices > 0;
+}
+
+bool ScanContextDistanceKernels::SetTargets(const float* data, const float* is_valid, int num_targets) {
+    const int M = impl_->num_sectors * impl_->num_rings;
+    try {
+        impl_->targets.assign(data, data + static_cast<size_t>(num_targets) * 2 * M);
+        impl_->target_is_valid.assign(is_valid, is_valid + static_cast<size_t>(num_targets) * 2 * impl_->num_sectors);
+        impl_->num_targets = num_targets;
+    } catch (const std::exception&) {
+        impl_->targets.clear();
+        impl_->target_is_valid.clear();
+        impl_->num_targets = 0;
+        return false;
+    }
+
+    return true;
+}
+
+bool ScanContextDistanceKernels::GetRows(
+    const float* data, const float* is_valid, int num_sources, float* distances, int* shifts
+) {
+    const int R = impl_->num_rings;
+    const int N = impl_->num_sectors;
+    const int num_targets = impl_->num_targets;
+    if (0 == num_sources || 0 == num_targets)
+        return true;
+
+    const size_t shared_bytes = GetSharedBytes(R, N);
+    if (shared_bytes > MAX_SHARED_BYTES)
+        return false;
+
+    const size_t num_entries = static_cast<size_t>(num_sources) * num_targets;
+    try {
+        impl_->sources.assign(data, data + static_cast<size_t>(num_sources) * N * R);
+        impl_->source_is_valid.assign(is_valid, is_valid + static_cast<size_t>(num_sources) * N);
+        impl_->distances.resize(num_entries);
+        impl_->shifts.resize(num_entries);
+    } catch (const std::exception&) {
+        return false;
+    }
+
+    // the grid height limits the sources of one launch:
+    const int max_sources_per_launch = MAX_GRID_Y * SOURCES_PER_BLOCK;
+    for (int source_begin = 0; source_begin < num_sources; source_begin += max_sources_per_launch) {
+        const int num_launch_sources = std::min(max_sources_per_launch, num_sources - source_begin);
+        const dim3 grid(num_targets, (num_launch_sources + SOURCES_PER_BLOCK - 1) / SOURCES_PER_BLOCK);
+        const size_t offset = static_cast<size_t>(source_begin) * num_targets;
+
+        GetRowsKernel<<<grid, BLOCK_SIZE, shared_bytes>>>(
+            thrust::raw_pointer_cast(impl_->targets.data()), thrust::raw_pointer_cast(impl_->target_is_valid.data()),
+            num_targets,
+            thrust::raw_pointer_cast(impl_->sources.data()), thrust::raw_pointer_cast(impl_->source_is_valid.data()),
+            source_begin, source_begin + num_launch_sources,
+            R, N,
+            thrust::raw_pointer_cast(impl_->distances.data()) + offset,
+            thrust::raw_pointer_cast(impl_->shifts.data()) + offset
+        );
+        if (cudaGetLastError() != cudaSuccess)
+            return false;
+    }
+
+    if (
+        cudaMemcpy(
+            distances, thrust::raw_pointer_cast(impl_->distances.data()),
+            num_entries * sizeof(float), cudaMemcpyDeviceToHost
+        ) != cudaSuccess ||
+        cudaMemcpy(
+            shifts, thrust::raw_pointer_cast(impl_->shifts.data()),
+            num_entries * sizeof(int), cudaMemcpyDeviceToHost
+        ) != cudaSuccess
+    ) {
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace lidar_localization
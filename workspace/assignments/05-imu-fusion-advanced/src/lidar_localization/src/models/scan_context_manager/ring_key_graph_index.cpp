@@ -0,0 +1,409 @@
+/*
+ * @Description: approx. nearest neighbor index of ring keys, as a hierarchical navigable small world graph
+ * @Author: Ge Yao
+ * @Date: 2021-01-08 21:03:52
+ */
+#include "lidar_localization/models/scan_context_manager/ring_key_graph_index.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <queue>
+#include <stdexcept>
+#include <algorithm>
+
+namespace lidar_localization {
+
+namespace {
+const char GRAPH_INDEX_MAGIC[8] = {'S', 'C', 'G', 'R', 'A', 'P', 'H', '\0'};
+
+struct GraphIndexHeader {
+    char magic[8];
+    uint32_t dim;
+    uint32_t max_degree;
+    uint64_t num_nodes;
+    uint32_t entry_point;
+    int32_t max_level;
+};
+
+// visit marks of the calling thread, a node is visited in the current search if its mark is the epoch,
+// so they are only cleared once the epoch wraps around:
+struct VisitedList {
+    std::vector<uint32_t> marks;
+    uint32_t epoch = 0;
+
+    void Reset(size_t size) {
+        if (marks.size() < size) {
+            marks.resize(size, 0);
+        }
+        if (0 == ++epoch) {
+            std::fill(marks.begin(), marks.end(), 0);
+            epoch = 1;
+        }
+    }
+    // true if it is newly visited:
+    bool Visit(uint32_t id) {
+        if (epoch == marks[id]) {
+            return false;
+        }
+        marks[id] = epoch;
+        return true;
+    }
+};
+
+VisitedList &GetVisitedList(void) {
+    static thread_local VisitedList visited;
+    return visited;
+}
+
+// max-heap on distance, for the furthest of the nearest ones found:
+struct FurtherFirst {
+    bool operator()(const std::pair<float, uint32_t> &a, const std::pair<float, uint32_t> &b) const {
+        return a.first < b.first;
+    }
+};
+// min-heap on distance, for the nearest of the candidates to expand:
+struct NearerFirst {
+    bool operator()(const std::pair<float, uint32_t> &a, const std::pair<float, uint32_t> &b) const {
+        return a.first > b.first;
+    }
+};
+
+template <typename T>
+bool Write(FILE *stream, const T *data, size_t num) {
+    return 0 == num || num == fwrite(data, sizeof(T), num, stream);
+}
+
+template <typename T>
+bool Read(FILE *stream, T *data, size_t num) {
+    return 0 == num || num == fread(data, sizeof(T), num, stream);
+}
+} // namespace
+
+RingKeyGraphIndex::RingKeyGraphIndex(int dim, const RingKeys &ring_keys, const Params &params)
+    : dim_(dim), ring_keys_(ring_keys), params_(params) {
+    params_.max_degree = std::max(params_.max_degree, 2);
+    params_.ef_construction = std::max(params_.ef_construction, params_.max_degree);
+    params_.ef_search = std::max(params_.ef_search, 1);
+
+    AddPoints();
+}
+
+RingKeyGraphIndex::RingKeyGraphIndex(int dim, const RingKeys &ring_keys, const Params &params, FILE *stream)
+    : dim_(dim), ring_keys_(ring_keys), params_(params) {
+    params_.ef_search = std::max(params_.ef_search, 1);
+
+    GraphIndexHeader header;
+    if (!Read(stream, &header, 1) || 0 != std::memcmp(header.magic, GRAPH_INDEX_MAGIC, sizeof(header.magic))) {
+        throw std::runtime_error("not a ring key graph");
+    }
+    if (
+        static_cast<uint32_t>(dim_) != header.dim || header.max_degree < 2 ||
+        ring_keys_.size() != header.num_nodes ||
+        (0 < header.num_nodes && header.entry_point >= header.num_nodes)
+    ) {
+        throw std::runtime_error("ring key graph does not match the ring keys");
+    }
+
+    // the graph is kept with the degree it was built with:
+    params_.max_degree = header.max_degree;
+    params_.ef_construction = std::max(params_.ef_construction, params_.max_degree);
+    entry_point_ = header.entry_point;
+    max_level_ = header.max_level;
+
+    const size_t num_nodes = header.num_nodes;
+    levels_.resize(num_nodes);
+    bottom_links_.resize(num_nodes * (GetMaxDegree(0) + 1));
+    if (!Read(stream, levels_.data(), num_nodes) || !Read(stream, bottom_links_.data(), bottom_links_.size())) {
+        throw std::runtime_error("ring key graph is truncated");
+    }
+
+    upper_links_.resize(num_nodes);
+    for (size_t i = 0; i < num_nodes; ++i) {
+        if (levels_.at(i) < 0 || levels_.at(i) > max_level_) {
+            throw std::runtime_error("ring key graph is corrupted");
+        }
+        upper_links_.at(i).resize(levels_.at(i) * (GetMaxDegree(1) + 1));
+        if (!Read(stream, upper_links_.at(i).data(), upper_links_.at(i).size())) {
+            throw std::runtime_error("ring key graph is truncated");
+        }
+    }
+
+    // links must stay within the graph:
+    for (uint32_t i = 0; i < num_nodes; ++i) {
+        for (int level = 0; level <= levels_.at(i); ++level) {
+            const uint32_t *links = GetLinks(i, level);
+            if (links[0] > static_cast<uint32_t>(GetMaxDegree(level))) {
+                throw std::runtime_error("ring key graph is corrupted");
+            }
+            for (uint32_t j = 1; j <= links[0]; ++j) {
+                if (links[j] >= num_nodes || levels_.at(links[j]) < level) {
+                    throw std::runtime_error("ring key graph is corrupted");
+                }
+            }
+        }
+    }
+}
+
+void RingKeyGraphIndex::AddPoints(void) {
+    for (size_t id = levels_.size(); id < ring_keys_.size(); ++id) {
+        Insert(static_cast<uint32_t>(id));
+    }
+}
+
+size_t RingKeyGraphIndex::GetMemoryUsage(void) const {
+    size_t memory_usage = (
+        levels_.capacity() * sizeof(int) +
+        bottom_links_.capacity() * sizeof(uint32_t) +
+        upper_links_.capacity() * sizeof(std::vector<uint32_t>)
+    );
+    for (const std::vector<uint32_t> &links: upper_links_) {
+        memory_usage += links.capacity() * sizeof(uint32_t);
+    }
+
+    return memory_usage;
+}
+
+size_t RingKeyGraphIndex::Query(const float *query, size_t N, size_t *indices, float *distances_sq) const {
+    if (levels_.empty() || 0 == N) {
+        return 0;
+    }
+
+    uint32_t entry = entry_point_;
+    for (int level = max_level_; level > 0; --level) {
+        entry = SearchGreedy(query, entry, level);
+    }
+
+    std::vector<Candidate> nearest;
+    SearchLayer(query, entry, 0, std::max(params_.ef_search, static_cast<int>(N)), nearest);
+
+    const size_t num_found = std::min(N, nearest.size());
+    for (size_t i = 0; i < num_found; ++i) {
+        indices[i] = nearest.at(i).second;
+        distances_sq[i] = nearest.at(i).first;
+    }
+
+    return num_found;
+}
+
+bool RingKeyGraphIndex::Save(FILE *stream) const {
+    GraphIndexHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, GRAPH_INDEX_MAGIC, sizeof(header.magic));
+    header.dim = dim_;
+    header.max_degree = params_.max_degree;
+    header.num_nodes = levels_.size();
+    header.entry_point = entry_point_;
+    header.max_level = max_level_;
+
+    bool success = (
+        Write(stream, &header, 1) &&
+        Write(stream, levels_.data(), levels_.size()) &&
+        Write(stream, bottom_links_.data(), bottom_links_.size())
+    );
+    for (size_t i = 0; success && i < upper_links_.size(); ++i) {
+        success = Write(stream, upper_links_.at(i).data(), upper_links_.at(i).size());
+    }
+
+    return success;
+}
+
+float RingKeyGraphIndex::GetDistance(const float *query, uint32_t id) const {
+    const float *ring_key = ring_keys_[id].data();
+
+    float distance = 0.0f;
+    for (int i = 0; i < dim_; ++i) {
+        const float d = query[i] - ring_key[i];
+        distance += d * d;
+    }
+
+    return distance;
+}
+
+int RingKeyGraphIndex::GetRandomLevel(void) {
+    // levels are geometric with ratio 1 / max_degree:
+    std::uniform_real_distribution<double> uniform(std::numeric_limits<double>::min(), 1.0);
+    const double level_scale = 1.0 / std::log(static_cast<double>(params_.max_degree));
+
+    return static_cast<int>(-std::log(uniform(random_engine_)) * level_scale);
+}
+
+uint32_t *RingKeyGraphIndex::GetLinks(uint32_t id, int level) {
+    if (0 == level) {
+        return &bottom_links_[static_cast<size_t>(id) * (GetMaxDegree(0) + 1)];
+    }
+    return &upper_links_[id][(level - 1) * (GetMaxDegree(1) + 1)];
+}
+
+const uint32_t *RingKeyGraphIndex::GetLinks(uint32_t id, int level) const {
+    if (0 == level) {
+        return &bottom_links_[static_cast<size_t>(id) * (GetMaxDegree(0) + 1)];
+    }
+    return &upper_links_[id][(level - 1) * (GetMaxDegree(1) + 1)];
+}
+
+uint32_t RingKeyGraphIndex::SearchGreedy(const float *query, uint32_t entry, int level) const {
+    float distance = GetDistance(query, entry);
+
+    bool is_improved = true;
+    while (is_improved) {
+        is_improved = false;
+
+        const uint32_t *links = GetLinks(entry, level);
+        for (uint32_t i = 1; i <= links[0]; ++i) {
+            const float curr_distance = GetDistance(query, links[i]);
+            if (curr_distance < distance) {
+                distance = curr_distance;
+                entry = links[i];
+                is_improved = true;
+            }
+        }
+    }
+
+    return entry;
+}
+
+void RingKeyGraphIndex::SearchLayer(
+    const float *query, uint32_t entry, int level, int ef,
+    std::vector<Candidate> &nearest
+) const {
+    VisitedList &visited = GetVisitedList();
+    visited.Reset(levels_.size());
+
+    std::priority_queue<Candidate, std::vector<Candidate>, NearerFirst> candidates;
+    std::priority_queue<Candidate, std::vector<Candidate>, FurtherFirst> found;
+
+    const float entry_distance = GetDistance(query, entry);
+    visited.Visit(entry);
+    candidates.emplace(entry_distance, entry);
+    found.emplace(entry_distance, entry);
+
+    while (!candidates.empty()) {
+        const Candidate candidate = candidates.top();
+        // all the others are further than the furthest found:
+        if (candidate.first > found.top().first) {
+            break;
+        }
+        candidates.pop();
+
+        const uint32_t *links = GetLinks(candidate.second, level);
+        for (uint32_t i = 1; i <= links[0]; ++i) {
+            const uint32_t id = links[i];
+            if (!visited.Visit(id)) {
+                continue;
+            }
+
+            const float distance = GetDistance(query, id);
+            if (found.size() < static_cast<size_t>(ef) || distance < found.top().first) {
+                candidates.emplace(distance, id);
+                found.emplace(distance, id);
+                if (found.size() > static_cast<size_t>(ef)) {
+                    found.pop();
+                }
+            }
+        }
+    }
+
+    nearest.resize(found.size());
+    for (size_t i = nearest.size(); i > 0; --i) {
+        nearest.at(i - 1) = found.top();
+        found.pop();
+    }
+}
+
+void RingKeyGraphIndex::SelectNeighbors(std::vector<Candidate> &candidates, int M) const {
+    if (candidates.size() <= static_cast<size_t>(M)) {
+        return;
+    }
+
+    // a candidate closer to a kept neighbor than to the query is reached through it,
+    // so the kept ones spread in all directions:
+    std::vector<Candidate> neighbors;
+    for (const Candidate &candidate: candidates) {
+        if (neighbors.size() >= static_cast<size_t>(M)) {
+            break;
+        }
+
+        const float *ring_key = ring_keys_[candidate.second].data();
+        bool is_diverse = true;
+        for (const Candidate &neighbor: neighbors) {
+            if (GetDistance(ring_key, neighbor.second) < candidate.first) {
+                is_diverse = false;
+                break;
+            }
+        }
+
+        if (is_diverse) {
+            neighbors.push_back(candidate);
+        }
+    }
+
+    candidates.swap(neighbors);
+}
+
+void RingKeyGraphIndex::Insert(uint32_t id) {
+    const int level = GetRandomLevel();
+
+    levels_.push_back(level);
+    bottom_links_.resize(bottom_links_.size() + GetMaxDegree(0) + 1, 0);
+    upper_links_.emplace_back(level * (GetMaxDegree(1) + 1), 0);
+
+    if (max_level_ < 0) {
+        entry_point_ = id;
+        max_level_ = level;
+        return;
+    }
+
+    const float *query = ring_keys_[id].data();
+
+    // a. descend to the top layer of the new node:
+    uint32_t entry = entry_point_;
+    for (int l = max_level_; l > level; --l) {
+        entry = SearchGreedy(query, entry, l);
+    }
+
+    // b. link it on every layer from there:
+    std::vector<Candidate> nearest;
+    for (int l = std::min(level, max_level_); l >= 0; --l) {
+        SearchLayer(query, entry, l, params_.ef_construction, nearest);
+        entry = nearest.front().second;
+
+        const int M = GetMaxDegree(l);
+        std::vector<Candidate> neighbors = nearest;
+        SelectNeighbors(neighbors, params_.max_degree);
+
+        uint32_t *links = GetLinks(id, l);
+        links[0] = neighbors.size();
+        for (size_t i = 0; i < neighbors.size(); ++i) {
+            links[i + 1] = neighbors.at(i).second;
+        }
+
+        // c. and back, the neighbors full already keep the best spread of the old and the new:
+        for (const Candidate &neighbor: neighbors) {
+            uint32_t *neighbor_links = GetLinks(neighbor.second, l);
+            if (neighbor_links[0] < static_cast<uint32_t>(M)) {
+                neighbor_links[++neighbor_links[0]] = id;
+                continue;
+            }
+
+            const float *neighbor_ring_key = ring_keys_[neighbor.second].data();
+            std::vector<Candidate> candidates{ {neighbor.first, id} };
+            for (uint32_t i = 1; i <= neighbor_links[0]; ++i) {
+                candidates.emplace_back(GetDistance(neighbor_ring_key, neighbor_links[i]), neighbor_links[i]);
+            }
+            std::sort(candidates.begin(), candidates.end());
+            SelectNeighbors(candidates, M);
+
+            neighbor_links[0] = candidates.size();
+            for (size_t i = 0; i < candidates.size(); ++i) {
+                neighbor_links[i + 1] = candidates.at(i).second;
+            }
+        }
+    }
+
+    if (level > max_level_) {
+        entry_point_ = id;
+        max_level_ = level;
+    }
+}
+} // namespace lidar_localization
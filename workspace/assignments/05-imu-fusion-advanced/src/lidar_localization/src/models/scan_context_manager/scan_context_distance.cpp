@@ -0,0 +1,524 @@
+/*
+ * @Description: batched min-shift scan context distances for all-pairs searches
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 19:12:46
+ */
+#include "lidar_localization/models/scan_context_manager/scan_context_distance.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <iostream>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "glog/logging.h"
+
+#include "lidar_localization/tools/task_scheduler.hpp"
+#include "lidar_localization/tools/simd_dispatch.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+
+#ifdef LIDAR_LOCALIZATION_WITH_CUDA
+#include "lidar_localization/models/scan_context_manager/cuda/scan_context_distance_kernels.hpp"
+#endif
+
+namespace lidar_localization {
+
+#ifndef LIDAR_LOCALIZATION_WITH_CUDA
+// never created without CUDA, complete only for the destructor of kernels_:
+class ScanContextDistanceKernels {};
+#endif
+
+namespace {
+// sources compared by one task, their normalized descriptors stay in cache while all targets stream by:
+const int SOURCE_BLOCK_SIZE = 8;
+// distances of one device round, rows of all targets:
+const size_t MAX_DEVICE_ENTRIES = 16 * 1024 * 1024;
+
+float DotScalar(const float *a, const float *b, const int n) {
+    float sum = 0.0f;
+    for (int i = 0; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+// similarities[shift] is the sum of column dot products of the target shifted to right by shift and the source.
+// target has its columns stored twice, so the shifted target is the contiguous block from column N - shift:
+void GetSimilaritiesScalar(const float *target, const float *source, const int R, const int N, float *similarities) {
+    for (int shift = 0; shift < N; ++shift) {
+        similarities[shift] = DotScalar(target + (N - shift) * R, source, N * R);
+    }
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SCAN_CONTEXT_DISTANCE_HAS_SIMD_KERNELS
+__attribute__((target("avx2,fma")))
+float HorizontalSumAVX2(const __m256 sum) {
+    __m128 sum_4 = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    sum_4 = _mm_add_ps(sum_4, _mm_movehl_ps(sum_4, sum_4));
+    sum_4 = _mm_add_ss(sum_4, _mm_shuffle_ps(sum_4, sum_4, 0x55));
+
+    return _mm_cvtss_f32(sum_4);
+}
+
+// 4 shifts at a time, each source load feeds the 4 target blocks one column apart:
+__attribute__((target("avx2,fma")))
+void GetSimilaritiesAVX2(const float *target, const float *source, const int R, const int N, float *similarities) {
+    const int M = N * R;
+
+    int shift = 0;
+    for (; shift + 4 <= N; shift += 4) {
+        const float *t = target + (N - shift) * R;
+
+        __m256 sum_0 = _mm256_setzero_ps();
+        __m256 sum_1 = _mm256_setzero_ps();
+        __m256 sum_2 = _mm256_setzero_ps();
+        __m256 sum_3 = _mm256_setzero_ps();
+        int i = 0;
+        for (; i + 8 <= M; i += 8) {
+            const __m256 s = _mm256_loadu_ps(source + i);
+            sum_0 = _mm256_fmadd_ps(_mm256_loadu_ps(t + i), s, sum_0);
+            sum_1 = _mm256_fmadd_ps(_mm256_loadu_ps(t - R + i), s, sum_1);
+            sum_2 = _mm256_fmadd_ps(_mm256_loadu_ps(t - 2 * R + i), s, sum_2);
+            sum_3 = _mm256_fmadd_ps(_mm256_loadu_ps(t - 3 * R + i), s, sum_3);
+        }
+
+        similarities[shift + 0] = HorizontalSumAVX2(sum_0) + DotScalar(t + i, source + i, M - i);
+        similarities[shift + 1] = HorizontalSumAVX2(sum_1) + DotScalar(t - R + i, source + i, M - i);
+        similarities[shift + 2] = HorizontalSumAVX2(sum_2) + DotScalar(t - 2 * R + i, source + i, M - i);
+        similarities[shift + 3] = HorizontalSumAVX2(sum_3) + DotScalar(t - 3 * R + i, source + i, M - i);
+    }
+    for (; shift < N; ++shift) {
+        similarities[shift] = DotScalar(target + (N - shift) * R, source, M);
+    }
+}
+
+// as the AVX2 kernel, the tail is a masked load:
+__attribute__((target("avx512f")))
+void GetSimilaritiesAVX512(const float *target, const float *source, const int R, const int N, float *similarities) {
+    const int M = N * R;
+
+    int shift = 0;
+    for (; shift + 4 <= N; shift += 4) {
+        const float *t = target + (N - shift) * R;
+
+        __m512 sum_0 = _mm512_setzero_ps();
+        __m512 sum_1 = _mm512_setzero_ps();
+        __m512 sum_2 = _mm512_setzero_ps();
+        __m512 sum_3 = _mm512_setzero_ps();
+        int i = 0;
+        for (; i + 16 <= M; i += 16) {
+            const __m512 s = _mm512_loadu_ps(source + i);
+            sum_0 = _mm512_fmadd_ps(_mm512_loadu_ps(t + i), s, sum_0);
+            sum_1 = _mm512_fmadd_ps(_mm512_loadu_ps(t - R + i), s, sum_1);
+            sum_2 = _mm512_fmadd_ps(_mm512_loadu_ps(t - 2 * R + i), s, sum_2);
+            sum_3 = _mm512_fmadd_ps(_mm512_loadu_ps(t - 3 * R + i), s, sum_3);
+        }
+        if (i < M) {
+            const __m512 zero = _mm512_setzero_ps();
+            const __mmask16 mask = static_cast<__mmask16>((1u << (M - i)) - 1u);
+            const __m512 s = _mm512_mask_loadu_ps(zero, mask, source + i);
+            sum_0 = _mm512_fmadd_ps(_mm512_mask_loadu_ps(zero, mask, t + i), s, sum_0);
+            sum_1 = _mm512_fmadd_ps(_mm512_mask_loadu_ps(zero, mask, t - R + i), s, sum_1);
+            sum_2 = _mm512_fmadd_ps(_mm512_mask_loadu_ps(zero, mask, t - 2 * R + i), s, sum_2);
+            sum_3 = _mm512_fmadd_ps(_mm512_mask_loadu_ps(zero, mask, t - 3 * R + i), s, sum_3);
+        }
+
+        similarities[shift + 0] = _mm512_reduce_add_ps(sum_0);
+        similarities[shift + 1] = _mm512_reduce_add_ps(sum_1);
+        similarities[shift + 2] = _mm512_reduce_add_ps(sum_2);
+        similarities[shift + 3] = _mm512_reduce_add_ps(sum_3);
+    }
+    for (; shift < N; ++shift) {
+        similarities[shift] = DotScalar(target + (N - shift) * R, source, M);
+    }
+}
+#endif
+
+#if defined(__GNUC__) && defined(__aarch64__)
+#define SCAN_CONTEXT_DISTANCE_HAS_NEON_KERNELS
+// as the AVX2 kernel, with 4 lanes:
+void GetSimilaritiesNEON(const float *target, const float *source, const int R, const int N, float *similarities) {
+    const int M = N * R;
+
+    int shift = 0;
+    for (; shift + 4 <= N; shift += 4) {
+        const float *t = target + (N - shift) * R;
+
+        float32x4_t sum_0 = vdupq_n_f32(0.0f);
+        float32x4_t sum_1 = vdupq_n_f32(0.0f);
+        float32x4_t sum_2 = vdupq_n_f32(0.0f);
+        float32x4_t sum_3 = vdupq_n_f32(0.0f);
+        int i = 0;
+        for (; i + 4 <= M; i += 4) {
+            const float32x4_t s = vld1q_f32(source + i);
+            sum_0 = vfmaq_f32(sum_0, vld1q_f32(t + i), s);
+            sum_1 = vfmaq_f32(sum_1, vld1q_f32(t - R + i), s);
+            sum_2 = vfmaq_f32(sum_2, vld1q_f32(t - 2 * R + i), s);
+            sum_3 = vfmaq_f32(sum_3, vld1q_f32(t - 3 * R + i), s);
+        }
+
+        similarities[shift + 0] = vaddvq_f32(sum_0) + DotScalar(t + i, source + i, M - i);
+        similarities[shift + 1] = vaddvq_f32(sum_1) + DotScalar(t - R + i, source + i, M - i);
+        similarities[shift + 2] = vaddvq_f32(sum_2) + DotScalar(t - 2 * R + i, source + i, M - i);
+        similarities[shift + 3] = vaddvq_f32(sum_3) + DotScalar(t - 3 * R + i, source + i, M - i);
+    }
+    for (; shift < N; ++shift) {
+        similarities[shift] = DotScalar(target + (N - shift) * R, source, M);
+    }
+}
+#endif
+
+typedef void (*SimilarityKernel)(const float *target, const float *source, const int R, const int N, float *similarities);
+
+// the widest kernel enabled, see SIMDDispatch:
+SimilarityKernel GetSimilarityKernel(SIMDLevel *level) {
+#ifdef SCAN_CONTEXT_DISTANCE_HAS_SIMD_KERNELS
+    if (SIMDDispatch::IsEnabled(SIMDLevel::AVX512)) {
+        *level = SIMDLevel::AVX512;
+        return GetSimilaritiesAVX512;
+    }
+    if (SIMDDispatch::IsEnabled(SIMDLevel::AVX2)) {
+        *level = SIMDLevel::AVX2;
+        return GetSimilaritiesAVX2;
+    }
+#endif
+#ifdef SCAN_CONTEXT_DISTANCE_HAS_NEON_KERNELS
+    if (SIMDDispatch::IsEnabled(SIMDLevel::NEON)) {
+        *level = SIMDLevel::NEON;
+        return GetSimilaritiesNEON;
+    }
+#endif
+    *level = SIMDLevel::SCALAR;
+    return GetSimilaritiesScalar;
+}
+
+// keep the best N of a row by (distance, target id), the row is visited once:
+void KeepNearest(
+    const float *distances, const int *shifts, int num_targets, int source_id,
+    int N, float max_distance, const ScanContextDistance::PairFilter &is_pair,
+    std::vector<ScanContextDistance::Match> &matches
+) {
+    matches.clear();
+    if (N <= 0)
+        return;
+
+    for (int target_id = 0; target_id < num_targets; ++target_id) {
+        const float distance = distances[target_id];
+        if (
+            !(distance < max_distance) ||
+            (static_cast<int>(matches.size()) == N && !(distance < matches.back().distance))
+        ) {
+            continue;
+        }
+        if (is_pair && !is_pair(source_id, target_id))
+            continue;
+
+        ScanContextDistance::Match match;
+        match.target_id = target_id;
+        match.shift = shifts[target_id];
+        match.distance = distance;
+
+        // targets come in order, so a tie stays behind the earlier target:
+        auto it = std::upper_bound(
+            matches.begin(), matches.end(), match,
+            [](const ScanContextDistance::Match &a, const ScanContextDistance::Match &b) {
+                return a.distance < b.distance;
+            }
+        );
+        matches.insert(it, match);
+        if (static_cast<int>(matches.size()) > N) {
+            matches.pop_back();
+        }
+    }
+}
+}
+
+ScanContextDistance::ScanContextDistance(int num_rings, int num_sectors, bool use_cuda)
+    : num_rings_(num_rings), num_sectors_(num_sectors) {
+    if (use_cuda) {
+#ifdef LIDAR_LOCALIZATION_WITH_CUDA
+        if (ScanContextDistanceKernels::IsDeviceAvailable()) {
+            kernels_.reset(new ScanContextDistanceKernels(num_rings_, num_sectors_));
+        } else {
+            LOG(WARNING) << "No CUDA device available. Scan context distances fall back to CPU.";
+        }
+#else
+        LOG(WARNING) << "Built without CUDA. Scan context distances fall back to CPU.";
+#endif
+    }
+
+    SIMDLevel kernel_level;
+    GetSimilarityKernel(&kernel_level);
+
+    std::cout << "Scan Context Distance params:" << std::endl
+              << "\tnum. rings: " << num_rings_ << ", num. sectors: " << num_sectors_ << std::endl
+              << "\tdevice: " << (kernels_ ? "cuda" : "cpu") << ", CPU kernel: " << SIMDDispatch::GetName(kernel_level) << std::endl
+              << std::endl;
+}
+
+ScanContextDistance::~ScanContextDistance() = default;
+
+void ScanContextDistance::Normalize(
+    const float *scan_context, bool is_target, float *data, float *is_valid, uint64_t &valid_mask
+) const {
+    const int R = num_rings_;
+    const int N = num_sectors_;
+    const int M = (is_target ? 2 : 1);
+
+    valid_mask = 0;
+    for (int sid = 0; sid < N; ++sid) {
+        const float *col = scan_context + sid * R;
+        const float sector_norm = std::sqrt(DotScalar(col, col, R));
+        const float scale = (0.0f == sector_norm ? 0.0f : 1.0f / sector_norm);
+
+        for (int m = 0; m < M; ++m) {
+            const int cid = m * N + sid;
+            for (int rid = 0; rid < R; ++rid) {
+                data[cid * R + rid] = scale * col[rid];
+            }
+            is_valid[cid] = (0.0f == sector_norm ? 0.0f : 1.0f);
+        }
+        if (0.0f != sector_norm && N <= 64) {
+            valid_mask |= (uint64_t(1) << sid);
+        }
+    }
+}
+
+bool ScanContextDistance::SetTargets(const float *scan_contexts, int num_targets) {
+    TRACE_SCOPE("ScanContextDistance::SetTargets", "scan_context");
+    const int R = num_rings_;
+    const int N = num_sectors_;
+
+    num_targets_ = std::max(num_targets, 0);
+    target_data_.resize(static_cast<size_t>(num_targets_) * 2 * N * R);
+    target_is_valid_.resize(static_cast<size_t>(num_targets_) * 2 * N);
+    target_valid_masks_.resize(num_targets_);
+    TaskScheduler::GetInstance().ParallelFor(
+        0, num_targets_, 64,
+        [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                Normalize(
+                    scan_contexts + static_cast<size_t>(i) * N * R, true,
+                    &target_data_.at(static_cast<size_t>(i) * 2 * N * R),
+                    &target_is_valid_.at(static_cast<size_t>(i) * 2 * N),
+                    target_valid_masks_.at(i)
+                );
+            }
+        }
+    );
+
+#ifdef LIDAR_LOCALIZATION_WITH_CUDA
+    if (kernels_ && num_targets_ > 0 && !kernels_->SetTargets(target_data_.data(), target_is_valid_.data(), num_targets_)) {
+        LOG(ERROR) << "Failed to upload " << num_targets_ << " scan context targets to device.";
+        num_targets_ = 0;
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+void ScanContextDistance::GetRowsOnCPU(
+    const float *scan_contexts, int source_begin, int source_end,
+    float *distances, int *shifts
+) {
+    const int R = num_rings_;
+    const int N = num_sectors_;
+    const int num_sources = source_end - source_begin;
+
+    std::vector<float> source_data(static_cast<size_t>(num_sources) * N * R);
+    std::vector<float> source_is_valid(static_cast<size_t>(num_sources) * N);
+    std::vector<uint64_t> source_valid_masks(num_sources);
+    for (int k = 0; k < num_sources; ++k) {
+        Normalize(
+            scan_contexts + static_cast<size_t>(source_begin + k) * N * R, false,
+            &source_data.at(static_cast<size_t>(k) * N * R), &source_is_valid.at(k * N),
+            source_valid_masks.at(k)
+        );
+    }
+
+    // each target is read once for the whole block:
+    SIMDLevel kernel_level;
+    const SimilarityKernel GetSimilarities = GetSimilarityKernel(&kernel_level);
+    std::vector<float> similarities(N);
+    const uint64_t full_mask = (N >= 64 ? ~uint64_t(0) : ((uint64_t(1) << N) - 1));
+    for (int t = 0; t < num_targets_; ++t) {
+        const float *target_data = &target_data_.at(static_cast<size_t>(t) * 2 * N * R);
+        const float *target_is_valid = &target_is_valid_.at(static_cast<size_t>(t) * 2 * N);
+        const uint64_t target_valid_mask = target_valid_masks_.at(t);
+
+        for (int k = 0; k < num_sources; ++k) {
+            GetSimilarities(target_data, &source_data.at(static_cast<size_t>(k) * N * R), R, N, similarities.data());
+
+            int optimal_shift = 0;
+            float optimal_dist = std::numeric_limits<float>::max();
+            for (int shift = 0; shift < N; ++shift) {
+                // empty columns of either side don't count, as in ScanContextManager::GetCosineDistance:
+                int num_effective_cols;
+                if (N <= 64) {
+                    const uint64_t shifted_mask = (0 == shift) ? target_valid_mask : (
+                        ((target_valid_mask << shift) | (target_valid_mask >> (N - shift))) & full_mask
+                    );
+                    num_effective_cols = __builtin_popcountll(shifted_mask & source_valid_masks.at(k));
+                } else {
+                    num_effective_cols = static_cast<int>(
+                        DotScalar(target_is_valid + N - shift, &source_is_valid.at(k * N), N) + 0.5f
+                    );
+                }
+
+                const float dist = (
+                    0 == num_effective_cols ? 1.0f : (1.0f - similarities[shift] / num_effective_cols)
+                );
+                if (dist < optimal_dist) {
+                    optimal_dist = dist;
+                    optimal_shift = shift;
+                }
+            }
+
+            distances[static_cast<size_t>(k) * num_targets_ + t] = optimal_dist;
+            shifts[static_cast<size_t>(k) * num_targets_ + t] = optimal_shift;
+        }
+    }
+}
+
+bool ScanContextDistance::GetRows(
+    const float *scan_contexts, int source_begin, int source_end,
+    float *distances, int *shifts
+) {
+#ifdef LIDAR_LOCALIZATION_WITH_CUDA
+    if (kernels_) {
+        const int R = num_rings_;
+        const int N = num_sectors_;
+        const int num_sources = source_end - source_begin;
+
+        std::vector<float> source_data(static_cast<size_t>(num_sources) * N * R);
+        std::vector<float> source_is_valid(static_cast<size_t>(num_sources) * N);
+        TaskScheduler::GetInstance().ParallelFor(
+            0, num_sources, 64,
+            [&](int begin, int end) {
+                for (int k = begin; k < end; ++k) {
+                    uint64_t valid_mask;
+                    Normalize(
+                        scan_contexts + static_cast<size_t>(source_begin + k) * N * R, false,
+                        &source_data.at(static_cast<size_t>(k) * N * R), &source_is_valid.at(k * N),
+                        valid_mask
+                    );
+                }
+            }
+        );
+
+        return kernels_->GetRows(source_data.data(), source_is_valid.data(), num_sources, distances, shifts);
+    }
+#endif
+
+    GetRowsOnCPU(scan_contexts, source_begin, source_end, distances, shifts);
+
+    return true;
+}
+
+bool ScanContextDistance::GetDistances(
+    const float *scan_contexts, int num_sources,
+    std::vector<float> &distances, std::vector<int> &shifts
+) {
+    TRACE_SCOPE("ScanContextDistance::GetDistances", "scan_context");
+    num_sources = std::max(num_sources, 0);
+    distances.resize(static_cast<size_t>(num_sources) * num_targets_);
+    shifts.resize(static_cast<size_t>(num_sources) * num_targets_);
+    if (0 == num_sources || 0 == num_targets_)
+        return true;
+
+    if (kernels_) {
+        return GetRows(scan_contexts, 0, num_sources, distances.data(), shifts.data());
+    }
+
+    const int num_blocks = (num_sources + SOURCE_BLOCK_SIZE - 1) / SOURCE_BLOCK_SIZE;
+    TaskScheduler::GetInstance().ParallelFor(
+        0, num_blocks, 1,
+        [&](int begin, int end) {
+            for (int b = begin; b < end; ++b) {
+                const int source_begin = b * SOURCE_BLOCK_SIZE;
+                const int source_end = std::min(source_begin + SOURCE_BLOCK_SIZE, num_sources);
+                const size_t offset = static_cast<size_t>(source_begin) * num_targets_;
+                GetRowsOnCPU(scan_contexts, source_begin, source_end, &distances.at(offset), &shifts.at(offset));
+            }
+        }
+    );
+
+    return true;
+}
+
+bool ScanContextDistance::GetNearest(
+    const float *scan_contexts, int num_sources,
+    int N, float max_distance, const PairFilter &is_pair,
+    std::vector<std::vector<Match>> &matches
+) {
+    TRACE_SCOPE("ScanContextDistance::GetNearest", "scan_context");
+    num_sources = std::max(num_sources, 0);
+    matches.assign(num_sources, std::vector<Match>());
+    if (0 == num_sources || 0 == num_targets_)
+        return true;
+
+    // a. on the device, rows of a round are reduced on the CPU while nothing else runs:
+    if (kernels_) {
+        const int block_size = static_cast<int>(std::max(MAX_DEVICE_ENTRIES / num_targets_, size_t(1)));
+        std::vector<float> distances;
+        std::vector<int> shifts;
+        for (int source_begin = 0; source_begin < num_sources; source_begin += block_size) {
+            const int source_end = std::min(source_begin + block_size, num_sources);
+            distances.resize(static_cast<size_t>(source_end - source_begin) * num_targets_);
+            shifts.resize(distances.size());
+            if (!GetRows(scan_contexts, source_begin, source_end, distances.data(), shifts.data())) {
+                LOG(ERROR) << "Failed to compute scan context distances on device.";
+                return false;
+            }
+
+            TaskScheduler::GetInstance().ParallelFor(
+                source_begin, source_end, 16,
+                [&](int begin, int end) {
+                    for (int i = begin; i < end; ++i) {
+                        const size_t offset = static_cast<size_t>(i - source_begin) * num_targets_;
+                        KeepNearest(
+                            &distances.at(offset), &shifts.at(offset), num_targets_, i,
+                            N, max_distance, is_pair, matches.at(i)
+                        );
+                    }
+                }
+            );
+        }
+
+        return true;
+    }
+
+    // b. on the CPU, each task reduces the rows of its own blocks:
+    const int num_blocks = (num_sources + SOURCE_BLOCK_SIZE - 1) / SOURCE_BLOCK_SIZE;
+    TaskScheduler::GetInstance().ParallelFor(
+        0, num_blocks, 1,
+        [&](int begin, int end) {
+            std::vector<float> distances(static_cast<size_t>(SOURCE_BLOCK_SIZE) * num_targets_);
+            std::vector<int> shifts(distances.size());
+            for (int b = begin; b < end; ++b) {
+                const int source_begin = b * SOURCE_BLOCK_SIZE;
+                const int source_end = std::min(source_begin + SOURCE_BLOCK_SIZE, num_sources);
+                GetRowsOnCPU(scan_contexts, source_begin, source_end, distances.data(), shifts.data());
+
+                for (int i = source_begin; i < source_end; ++i) {
+                    const size_t offset = static_cast<size_t>(i - source_begin) * num_targets_;
+                    KeepNearest(
+                        &distances.at(offset), &shifts.at(offset), num_targets_, i,
+                        N, max_distance, is_pair, matches.at(i)
+                    );
+                }
+            }
+        }
+    );
+
+    return true;
+}
+
+} // namespace lidar_localization
@@ -8,13 +8,38 @@
 #include <math.h>
 #include <ctime>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <stdexcept>
 #include <memory>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <fstream>
 #include <ostream>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include <unsupported/Eigen/FFT>
 
 #include "lidar_localization/models/scan_context_manager/scan_context_manager.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/task_scheduler.hpp"
+#include "lidar_localization/tools/simd_dispatch.hpp"
+#include "lidar_localization/tools/memory_usage.hpp"
 
 #include "lidar_localization/models/scan_context_manager/scan_contexts.pb.h"
 #include "lidar_localization/models/scan_context_manager/ring_keys.pb.h"
@@ -24,6 +49,471 @@
 
 namespace lidar_localization {
 
+namespace {
+float DotScalar(const float *a, const float *b, const int n) {
+    float sum = 0.0f;
+    for (int i = 0; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SCAN_CONTEXT_HAS_AVX2_KERNEL
+__attribute__((target("avx2,fma")))
+float DotAVX2(const float *a, const float *b, const int n) {
+    __m256 sum_0 = _mm256_setzero_ps();
+    __m256 sum_1 = _mm256_setzero_ps();
+
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        sum_0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum_0);
+        sum_1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), sum_1);
+    }
+    for (; i + 8 <= n; i += 8) {
+        sum_0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum_0);
+    }
+    sum_0 = _mm256_add_ps(sum_0, sum_1);
+
+    // horizontal sum:
+    __m128 sum_4 = _mm_add_ps(_mm256_castps256_ps128(sum_0), _mm256_extractf128_ps(sum_0, 1));
+    sum_4 = _mm_add_ps(sum_4, _mm_movehl_ps(sum_4, sum_4));
+    sum_4 = _mm_add_ss(sum_4, _mm_shuffle_ps(sum_4, sum_4, 0x55));
+
+    return _mm_cvtss_f32(sum_4) + DotScalar(a + i, b + i, n - i);
+}
+#endif
+
+#if defined(__GNUC__) && defined(__aarch64__)
+#define SCAN_CONTEXT_HAS_NEON_KERNEL
+float DotNEON(const float *a, const float *b, const int n) {
+    float32x4_t sum_0 = vdupq_n_f32(0.0f);
+    float32x4_t sum_1 = vdupq_n_f32(0.0f);
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        sum_0 = vfmaq_f32(sum_0, vld1q_f32(a + i), vld1q_f32(b + i));
+        sum_1 = vfmaq_f32(sum_1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    for (; i + 4 <= n; i += 4) {
+        sum_0 = vfmaq_f32(sum_0, vld1q_f32(a + i), vld1q_f32(b + i));
+    }
+
+    return vaddvq_f32(vaddq_f32(sum_0, sum_1)) + DotScalar(a + i, b + i, n - i);
+}
+#endif
+
+// dot product of two float arrays, uses the widest kernel enabled, see SIMDDispatch:
+float Dot(const float *a, const float *b, const int n) {
+#ifdef SCAN_CONTEXT_HAS_AVX2_KERNEL
+    if (SIMDDispatch::IsEnabled(SIMDLevel::AVX2)) {
+        return DotAVX2(a, b, n);
+    }
+#endif
+#ifdef SCAN_CONTEXT_HAS_NEON_KERNEL
+    if (SIMDDispatch::IsEnabled(SIMDLevel::NEON)) {
+        return DotNEON(a, b, n);
+    }
+#endif
+    return DotScalar(a, b, n);
+}
+
+int DotScalar(const int8_t *a, const int8_t *b, const int n) {
+    int sum = 0;
+    for (int i = 0; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+#ifdef SCAN_CONTEXT_HAS_AVX2_KERNEL
+__attribute__((target("avx2")))
+int DotAVX2(const int8_t *a, const int8_t *b, const int n) {
+    __m256i sum_0 = _mm256_setzero_si256();
+    __m256i sum_1 = _mm256_setzero_si256();
+
+    // widened to int16, so products are exact & pairwise sums fit in int32:
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i a_0 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)));
+        const __m256i b_0 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+        const __m256i a_1 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i + 16)));
+        const __m256i b_1 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i + 16)));
+        sum_0 = _mm256_add_epi32(sum_0, _mm256_madd_epi16(a_0, b_0));
+        sum_1 = _mm256_add_epi32(sum_1, _mm256_madd_epi16(a_1, b_1));
+    }
+    for (; i + 16 <= n; i += 16) {
+        const __m256i a_0 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)));
+        const __m256i b_0 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+        sum_0 = _mm256_add_epi32(sum_0, _mm256_madd_epi16(a_0, b_0));
+    }
+    sum_0 = _mm256_add_epi32(sum_0, sum_1);
+
+    // horizontal sum:
+    __m128i sum_4 = _mm_add_epi32(_mm256_castsi256_si128(sum_0), _mm256_extracti128_si256(sum_0, 1));
+    sum_4 = _mm_add_epi32(sum_4, _mm_shuffle_epi32(sum_4, 0x4E));
+    sum_4 = _mm_add_epi32(sum_4, _mm_shuffle_epi32(sum_4, 0xB1));
+
+    return _mm_cvtsi128_si32(sum_4) + DotScalar(a + i, b + i, n - i);
+}
+#endif
+
+#ifdef SCAN_CONTEXT_HAS_NEON_KERNEL
+int DotNEON(const int8_t *a, const int8_t *b, const int n) {
+    int32x4_t sum_0 = vdupq_n_s32(0);
+    int32x4_t sum_1 = vdupq_n_s32(0);
+
+    // products are exact in int16 & pairwise sums accumulate into int32:
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const int8x16_t a_0 = vld1q_s8(a + i);
+        const int8x16_t b_0 = vld1q_s8(b + i);
+        sum_0 = vpadalq_s16(sum_0, vmull_s8(vget_low_s8(a_0), vget_low_s8(b_0)));
+        sum_1 = vpadalq_s16(sum_1, vmull_high_s8(a_0, b_0));
+    }
+
+    return vaddvq_s32(vaddq_s32(sum_0, sum_1)) + DotScalar(a + i, b + i, n - i);
+}
+
+// sums of 4 products per lane in one instruction, ARMv8.2 dot product extension:
+__attribute__((target("arch=armv8.2-a+dotprod")))
+int DotNEONDotProd(const int8_t *a, const int8_t *b, const int n) {
+    int32x4_t sum_0 = vdupq_n_s32(0);
+    int32x4_t sum_1 = vdupq_n_s32(0);
+
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        sum_0 = vdotq_s32(sum_0, vld1q_s8(a + i), vld1q_s8(b + i));
+        sum_1 = vdotq_s32(sum_1, vld1q_s8(a + i + 16), vld1q_s8(b + i + 16));
+    }
+    for (; i + 16 <= n; i += 16) {
+        sum_0 = vdotq_s32(sum_0, vld1q_s8(a + i), vld1q_s8(b + i));
+    }
+
+    return vaddvq_s32(vaddq_s32(sum_0, sum_1)) + DotScalar(a + i, b + i, n - i);
+}
+#endif
+
+// dot product of two int8 arrays, uses the widest kernel enabled, see SIMDDispatch.
+// exact for n up to 2^31 / 127^2, i.e., 133k:
+int Dot(const int8_t *a, const int8_t *b, const int n) {
+#ifdef SCAN_CONTEXT_HAS_AVX2_KERNEL
+    if (SIMDDispatch::IsEnabled(SIMDLevel::AVX2)) {
+        return DotAVX2(a, b, n);
+    }
+#endif
+#ifdef SCAN_CONTEXT_HAS_NEON_KERNEL
+    if (SIMDDispatch::IsEnabled(SIMDLevel::NEON_DOTPROD)) {
+        return DotNEONDotProd(a, b, n);
+    }
+    if (SIMDDispatch::IsEnabled(SIMDLevel::NEON)) {
+        return DotNEON(a, b, n);
+    }
+#endif
+    return DotScalar(a, b, n);
+}
+
+// atan(t) for t in [0, 1], minimax polynomial with max. error about 2e-6 rad:
+const float ATAN_COEFFS[] = {
+    0.99997726f, -0.33262347f, 0.19354346f, -0.11643287f, 0.05265332f, -0.01172120f
+};
+const float HALF_PI = static_cast<float>(0.5 * M_PI);
+const float PI = static_cast<float>(M_PI);
+const float TWO_PI = static_cast<float>(2.0 * M_PI);
+
+// ring-sector binning params:
+struct BinParams {
+    float max_radius_2;
+    float ring_scale;
+    float sector_scale;
+    int num_rings;
+    int num_sectors;
+};
+
+// column-major ring-sector bin index of point measurements, -1 outside ROI.
+// orientation is reduced to the first octant, so a short polynomial replaces atan2:
+void GetBinIndicesScalar(
+    const float *x, const float *y, const int n, 
+    const BinParams &params, 
+    int *bin_id
+) {
+    for (int i = 0; i < n; ++i) {
+        const float r2 = x[i] * x[i] + y[i] * y[i];
+
+        const float ax = std::fabs(x[i]);
+        const float ay = std::fabs(y[i]);
+        const float lo = std::min(ax, ay);
+        const float hi = std::max(ax, ay);
+        const float t = (hi > 0.0f ? lo / hi : 0.0f);
+        const float t2 = t * t;
+        float theta = t * (
+            ATAN_COEFFS[0] + t2 * (
+                ATAN_COEFFS[1] + t2 * (
+                    ATAN_COEFFS[2] + t2 * (
+                        ATAN_COEFFS[3] + t2 * (
+                            ATAN_COEFFS[4] + t2 * ATAN_COEFFS[5]
+                        )
+                    )
+                )
+            )
+        );
+        theta = (ay > ax ? HALF_PI - theta : theta);
+        theta = (x[i] < 0.0f ? PI - theta : theta);
+        theta = (y[i] < 0.0f ? TWO_PI - theta : theta);
+
+        // NaN measurements also fail the ROI check:
+        if (r2 <= params.max_radius_2) {
+            const int rid = std::min(static_cast<int>(std::sqrt(r2) * params.ring_scale), params.num_rings - 1);
+            const int sid = std::min(static_cast<int>(theta * params.sector_scale), params.num_sectors - 1);
+            bin_id[i] = sid * params.num_rings + rid;
+        } else {
+            bin_id[i] = -1;
+        }
+    }
+}
+
+#ifdef SCAN_CONTEXT_HAS_AVX2_KERNEL
+__attribute__((target("avx2,fma")))
+void GetBinIndicesAVX2(
+    const float *x, const float *y, const int n, 
+    const BinParams &params, 
+    int *bin_id
+) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+    const __m256 half_pi = _mm256_set1_ps(HALF_PI);
+    const __m256 pi = _mm256_set1_ps(PI);
+    const __m256 two_pi = _mm256_set1_ps(TWO_PI);
+    const __m256 max_radius_2 = _mm256_set1_ps(params.max_radius_2);
+    const __m256 ring_scale = _mm256_set1_ps(params.ring_scale);
+    const __m256 sector_scale = _mm256_set1_ps(params.sector_scale);
+    const __m256i max_rid = _mm256_set1_epi32(params.num_rings - 1);
+    const __m256i max_sid = _mm256_set1_epi32(params.num_sectors - 1);
+    const __m256i num_rings = _mm256_set1_epi32(params.num_rings);
+    const __m256i outside = _mm256_set1_epi32(-1);
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 px = _mm256_loadu_ps(x + i);
+        const __m256 py = _mm256_loadu_ps(y + i);
+        const __m256 r2 = _mm256_fmadd_ps(px, px, _mm256_mul_ps(py, py));
+
+        // orientation:
+        const __m256 ax = _mm256_andnot_ps(sign_mask, px);
+        const __m256 ay = _mm256_andnot_ps(sign_mask, py);
+        const __m256 hi = _mm256_max_ps(ax, ay);
+        // 0 / 0 at the origin is masked to 0:
+        const __m256 t = _mm256_and_ps(
+            _mm256_div_ps(_mm256_min_ps(ax, ay), hi), 
+            _mm256_cmp_ps(hi, zero, _CMP_GT_OQ)
+        );
+        const __m256 t2 = _mm256_mul_ps(t, t);
+        __m256 theta = _mm256_set1_ps(ATAN_COEFFS[5]);
+        theta = _mm256_fmadd_ps(theta, t2, _mm256_set1_ps(ATAN_COEFFS[4]));
+        theta = _mm256_fmadd_ps(theta, t2, _mm256_set1_ps(ATAN_COEFFS[3]));
+        theta = _mm256_fmadd_ps(theta, t2, _mm256_set1_ps(ATAN_COEFFS[2]));
+        theta = _mm256_fmadd_ps(theta, t2, _mm256_set1_ps(ATAN_COEFFS[1]));
+        theta = _mm256_fmadd_ps(theta, t2, _mm256_set1_ps(ATAN_COEFFS[0]));
+        theta = _mm256_mul_ps(theta, t);
+        theta = _mm256_blendv_ps(theta, _mm256_sub_ps(half_pi, theta), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+        theta = _mm256_blendv_ps(theta, _mm256_sub_ps(pi, theta), _mm256_cmp_ps(px, zero, _CMP_LT_OQ));
+        theta = _mm256_blendv_ps(theta, _mm256_sub_ps(two_pi, theta), _mm256_cmp_ps(py, zero, _CMP_LT_OQ));
+
+        // ring-sector index:
+        const __m256i rid = _mm256_min_epi32(
+            _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_sqrt_ps(r2), ring_scale)), max_rid
+        );
+        const __m256i sid = _mm256_min_epi32(
+            _mm256_cvttps_epi32(_mm256_mul_ps(theta, sector_scale)), max_sid
+        );
+        const __m256i bid = _mm256_add_epi32(_mm256_mullo_epi32(sid, num_rings), rid);
+
+        // NaN measurements also fail the ROI check:
+        const __m256i in_roi = _mm256_castps_si256(_mm256_cmp_ps(r2, max_radius_2, _CMP_LE_OQ));
+        _mm256_storeu_si256(
+            reinterpret_cast<__m256i *>(bin_id + i), 
+            _mm256_blendv_epi8(outside, bid, in_roi)
+        );
+    }
+
+    GetBinIndicesScalar(x + i, y + i, n - i, params, bin_id + i);
+}
+#endif
+
+#ifdef SCAN_CONTEXT_HAS_NEON_KERNEL
+void GetBinIndicesNEON(
+    const float *x, const float *y, const int n, 
+    const BinParams &params, 
+    int *bin_id
+) {
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t half_pi = vdupq_n_f32(HALF_PI);
+    const float32x4_t pi = vdupq_n_f32(PI);
+    const float32x4_t two_pi = vdupq_n_f32(TWO_PI);
+    const float32x4_t max_radius_2 = vdupq_n_f32(params.max_radius_2);
+    const float32x4_t ring_scale = vdupq_n_f32(params.ring_scale);
+    const float32x4_t sector_scale = vdupq_n_f32(params.sector_scale);
+    const int32x4_t max_rid = vdupq_n_s32(params.num_rings - 1);
+    const int32x4_t max_sid = vdupq_n_s32(params.num_sectors - 1);
+    const int32x4_t num_rings = vdupq_n_s32(params.num_rings);
+    const int32x4_t outside = vdupq_n_s32(-1);
+
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const float32x4_t px = vld1q_f32(x + i);
+        const float32x4_t py = vld1q_f32(y + i);
+        const float32x4_t r2 = vfmaq_f32(vmulq_f32(py, py), px, px);
+
+        // orientation:
+        const float32x4_t ax = vabsq_f32(px);
+        const float32x4_t ay = vabsq_f32(py);
+        const float32x4_t hi = vmaxq_f32(ax, ay);
+        // 0 / 0 at the origin is masked to 0:
+        const float32x4_t t = vreinterpretq_f32_u32(
+            vandq_u32(
+                vreinterpretq_u32_f32(vdivq_f32(vminq_f32(ax, ay), hi)), 
+                vcgtq_f32(hi, zero)
+            )
+        );
+        const float32x4_t t2 = vmulq_f32(t, t);
+        float32x4_t theta = vdupq_n_f32(ATAN_COEFFS[5]);
+        theta = vfmaq_f32(vdupq_n_f32(ATAN_COEFFS[4]), theta, t2);
+        theta = vfmaq_f32(vdupq_n_f32(ATAN_COEFFS[3]), theta, t2);
+        theta = vfmaq_f32(vdupq_n_f32(ATAN_COEFFS[2]), theta, t2);
+        theta = vfmaq_f32(vdupq_n_f32(ATAN_COEFFS[1]), theta, t2);
+        theta = vfmaq_f32(vdupq_n_f32(ATAN_COEFFS[0]), theta, t2);
+        theta = vmulq_f32(theta, t);
+        theta = vbslq_f32(vcgtq_f32(ay, ax), vsubq_f32(half_pi, theta), theta);
+        theta = vbslq_f32(vcltq_f32(px, zero), vsubq_f32(pi, theta), theta);
+        theta = vbslq_f32(vcltq_f32(py, zero), vsubq_f32(two_pi, theta), theta);
+
+        // ring-sector index:
+        const int32x4_t rid = vminq_s32(
+            vcvtq_s32_f32(vmulq_f32(vsqrtq_f32(r2), ring_scale)), max_rid
+        );
+        const int32x4_t sid = vminq_s32(
+            vcvtq_s32_f32(vmulq_f32(theta, sector_scale)), max_sid
+        );
+        const int32x4_t bid = vmlaq_s32(rid, sid, num_rings);
+
+        // NaN measurements also fail the ROI check:
+        vst1q_s32(bin_id + i, vbslq_s32(vcleq_f32(r2, max_radius_2), bid, outside));
+    }
+
+    GetBinIndicesScalar(x + i, y + i, n - i, params, bin_id + i);
+}
+#endif
+
+// ring-sector bin index of point measurements, uses the widest kernel enabled, see SIMDDispatch:
+void GetBinIndices(
+    const float *x, const float *y, const int n, 
+    const BinParams &params, 
+    int *bin_id
+) {
+#ifdef SCAN_CONTEXT_HAS_AVX2_KERNEL
+    if (SIMDDispatch::IsEnabled(SIMDLevel::AVX2)) {
+        GetBinIndicesAVX2(x, y, n, params, bin_id);
+        return;
+    }
+#endif
+#ifdef SCAN_CONTEXT_HAS_NEON_KERNEL
+    if (SIMDDispatch::IsEnabled(SIMDLevel::NEON)) {
+        GetBinIndicesNEON(x, y, n, params, bin_id);
+        return;
+    }
+#endif
+    GetBinIndicesScalar(x, y, n, params, bin_id);
+}
+
+// flat scan context index, in native byte order. sections are aligned, so they
+// are used in place from a read-only memory mapping:
+const char FLAT_INDEX_MAGIC[8] = {'S', 'C', 'I', 'N', 'D', 'E', 'X', '\0'};
+const uint32_t FLAT_INDEX_VERSION = 2;
+const uint64_t FLAT_INDEX_ALIGNMENT = 64;
+// scan context types:
+const uint32_t FLAT_INDEX_FLOAT = 0;
+const uint32_t FLAT_INDEX_INT8 = 1;
+// ring key index types:
+const uint32_t FLAT_INDEX_KD_TREE = 0;
+const uint32_t FLAT_INDEX_GRAPH = 1;
+
+struct FlatIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t num_rings;
+    uint32_t num_sectors;
+    // a. column-major scan contexts, back to back:
+    uint64_t num_scan_contexts;
+    uint64_t scan_contexts_offset;
+    // b. indexed ring keys, back to back:
+    uint64_t num_ring_keys;
+    uint64_t ring_keys_offset;
+    // c. column-major 4x4 key frame poses, one per indexed ring key:
+    uint64_t key_frames_offset;
+    // d. ring key index of the indexed ring keys, kd-tree forest as serialized by nanoflann or graph, 
+    // by ring_key_index_type:
+    uint64_t kd_tree_offset;
+    uint64_t kd_tree_size;
+    uint64_t file_size;
+    // e. since version 2, scan context type, and for int8 ones their scales, back to back:
+    uint32_t scan_context_type;
+    uint32_t ring_key_index_type;
+    uint64_t scan_context_scales_offset;
+};
+// version 1 headers end before e., their scan contexts are float:
+const uint32_t FLAT_INDEX_V1_HEADER_SIZE = offsetof(FlatIndexHeader, scan_context_type);
+
+uint64_t AlignOffset(const uint64_t offset) {
+    return (offset + FLAT_INDEX_ALIGNMENT - 1) / FLAT_INDEX_ALIGNMENT * FLAT_INDEX_ALIGNMENT;
+}
+
+bool WriteAt(FILE *output_fptr, const uint64_t offset, const void *data, const size_t size) {
+    if (0 != fseek(output_fptr, static_cast<long>(offset), SEEK_SET)) {
+        return false;
+    }
+
+    return (0 == size || 1 == fwrite(data, size, 1, output_fptr));
+}
+
+// read-only memory mapping of a whole file:
+class MappedFile {
+  public:
+    explicit MappedFile(const std::string &path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+
+        struct stat file_stat;
+        if (0 == fstat(fd, &file_stat) && file_stat.st_size > 0) {
+            void *data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (MAP_FAILED != data) {
+                data_ = static_cast<const char *>(data);
+                size_ = file_stat.st_size;
+            }
+        }
+        // the mapping stays valid after close:
+        close(fd);
+    }
+    ~MappedFile() {
+        if (data_) {
+            munmap(const_cast<char *>(data_), size_);
+        }
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *GetData(void) const { return data_; }
+    size_t GetSize(void) const { return size_; }
+
+  private:
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+};
+}
+
 ScanContextManager::ScanContextManager(const YAML::Node& node) {
     //
     // parse config:
@@ -35,6 +525,7 @@ ScanContextManager::ScanContextManager(const YAML::Node& node) {
     NUM_RINGS_ = node["num_rings"].as<int>();
     NUM_SECTORS_ = node["num_sectors"].as<int>();
     DEG_PER_SECTOR_ = MAX_THETA_ / NUM_SECTORS_;
+    USE_FIXED_SIZE_ = (FIXED_NUM_RINGS == NUM_RINGS_ && FIXED_NUM_SECTORS == NUM_SECTORS_);
     // c. ring key indexing interval:
     INDEXING_INTERVAL_ = node["indexing_interval"].as<int>();
     // d. min. key frame sequence distance:
@@ -45,6 +536,20 @@ ScanContextManager::ScanContextManager(const YAML::Node& node) {
     FAST_ALIGNMENT_SEARCH_RATIO_ = node["fast_alignment_search_ratio"].as<float>();
     // g. scan context distance threshold:
     SCAN_CONTEXT_DISTANCE_THRESH_ = node["scan_context_distance_thresh"].as<float>();
+    // h. scan context quantization:
+    QUANTIZE_ = node["quantize"] ? node["quantize"].as<bool>() : false;
+    // i. ring key index:
+    const std::string ring_key_index = node["ring_key_index"] ? node["ring_key_index"].as<std::string>() : "kd_tree";
+    USE_GRAPH_INDEX_ = ("graph" == ring_key_index);
+    if (!USE_GRAPH_INDEX_ && "kd_tree" != ring_key_index) {
+        LOG(WARNING) << "Unknown ring key index " << ring_key_index << ", fall back to kd_tree." << std::endl;
+    }
+    if (node["ring_key_graph"]) {
+        const YAML::Node &graph_node = node["ring_key_graph"];
+        GRAPH_INDEX_PARAMS_.max_degree = graph_node["max_degree"].as<int>();
+        GRAPH_INDEX_PARAMS_.ef_construction = graph_node["ef_construction"].as<int>();
+        GRAPH_INDEX_PARAMS_.ef_search = graph_node["ef_search"].as<int>();
+    }
 
     // prompt:
     LOG(INFO) << "Scan Context params:" << std::endl
@@ -52,46 +557,200 @@ ScanContextManager::ScanContextManager(const YAML::Node& node) {
               << "\tmax. theta: " << MAX_THETA_ << std::endl
               << "\tnum. rings: " << NUM_RINGS_ << std::endl
               << "\tnum. sectors: " << NUM_SECTORS_  << std::endl
+              << "\tfixed-size descriptors: " << (USE_FIXED_SIZE_ ? "true" : "false") << std::endl
               << "\tre-indexing interval: " << INDEXING_INTERVAL_ << std::endl
               << "\tmin. key frame sequence distance: " << MIN_KEY_FRAME_SEQ_DISTANCE_ << std::endl
               << "\tnearest-neighbor candidates to check: " << NUM_CANDIDATES_ << std::endl
               << "\tfast alignment search ratio: " << FAST_ALIGNMENT_SEARCH_RATIO_ << std::endl
               << "\tloop-closure scan context distance thresh: " << SCAN_CONTEXT_DISTANCE_THRESH_ << std::endl
-              << std::endl;
+              << "\tquantized scan contexts: " << (QUANTIZE_ ? "true" : "false") << std::endl
+              << "\tring key index: " << (USE_GRAPH_INDEX_ ? "graph" : "kd_tree") << std::endl;
+    if (USE_GRAPH_INDEX_) {
+        LOG(INFO) << "\tring key graph max. degree: " << GRAPH_INDEX_PARAMS_.max_degree << std::endl
+                  << "\tring key graph ef construction: " << GRAPH_INDEX_PARAMS_.ef_construction << std::endl
+                  << "\tring key graph ef search: " << GRAPH_INDEX_PARAMS_.ef_search << std::endl;
+    }
+    LOG(INFO) << std::endl;
     
     // reset state:
-    state_.scan_context_.clear();
+    state_.scan_context_.Reset(NUM_RINGS_, NUM_SECTORS_, QUANTIZE_);
     state_.ring_key_.clear();
 
     state_.index_.counter_ = 0;
 
-    state_.index_.kd_tree_.reset();
     state_.index_.data_.ring_key_.clear();
     state_.index_.data_.key_frame_.clear();
+    ResetIndex();
 }
 
 void ScanContextManager::Update(
     const CloudData &scan,
     const KeyFrame &key_frame
 ) {
-    // extract scan context and corresponding ring key:
-    ScanContext scan_context = GetScanContext(scan);
-    RingKey ring_key = GetRingKey(scan_context);
+    TRACE_SCOPE("ScanContextManager::Update", "scan_context");
+    // extract scan context and get corresponding ring key, in place unless quantized:
+    RingKey ring_key;
+    if (state_.scan_context_.IsQuantized()) {
+        workspace_.scan_context_.resize(NUM_RINGS_ * NUM_SECTORS_);
+        GetScanContext(scan, workspace_.scan_context_.data(), ring_key);
+        state_.scan_context_.Add(workspace_.scan_context_.data());
+    } else {
+        GetScanContext(scan, state_.scan_context_.Add().data(), ring_key);
+    }
 
     // update buffer:
-    state_.scan_context_.push_back(scan_context);
     state_.ring_key_.push_back(ring_key);
     state_.key_frame_.push_back(key_frame);
 }
 
+/**
+ * @brief  append a key frame of known descriptors, e.g. replayed from a checkpoint
+ * @param  scan_context, column-major scan context of NUM_RINGS_ x NUM_SECTORS_
+ * @param  ring_key, ring key of NUM_RINGS_
+ * @param  key_frame, key frame
+ * @return true if the descriptors are of this resolution otherwise false
+ */
+bool ScanContextManager::Update(
+    const std::vector<float> &scan_context,
+    const RingKey &ring_key,
+    const KeyFrame &key_frame
+) {
+    if (
+        scan_context.size() != static_cast<size_t>(NUM_RINGS_ * NUM_SECTORS_) ||
+        ring_key.size() != static_cast<size_t>(NUM_RINGS_)
+    ) {
+        return false;
+    }
+
+    // re-quantized to the same codes, the max. abs. height is exact:
+    state_.scan_context_.Add(scan_context.data());
+    state_.ring_key_.push_back(ring_key);
+    state_.key_frame_.push_back(key_frame);
+
+    return true;
+}
+
+/**
+ * @brief  get the descriptors of the latest key frame, e.g. for a checkpoint
+ * @param  scan_context, column-major scan context of NUM_RINGS_ x NUM_SECTORS_, dequantized if quantized
+ * @param  ring_key, ring key of NUM_RINGS_
+ * @return true if there is any key frame otherwise false
+ */
+bool ScanContextManager::GetLatestDescriptors(std::vector<float> &scan_context, RingKey &ring_key) const {
+    const size_t num_scan_contexts = state_.scan_context_.GetSize();
+    if (0 == num_scan_contexts) {
+        return false;
+    }
+
+    std::vector<float> buffer;
+    const float *data = state_.scan_context_.GetData(num_scan_contexts - 1, 1, buffer);
+    scan_context.assign(data, data + NUM_RINGS_ * NUM_SECTORS_);
+    ring_key = state_.ring_key_.back();
+
+    return true;
+}
+
+/**
+ * @brief  index a whole drive at once, key scans are loaded & described in parallel
+ * @param  key_frames, all key frames in index order, replacing the current ones
+ * @param  load_scan, loads the key scan of a key frame, called concurrently
+ * @return true if every key scan is loaded otherwise false
+ */
+bool ScanContextManager::Build(const std::vector<KeyFrame> &key_frames, const ScanLoader &load_scan) {
+    TRACE_SCOPE("ScanContextManager::Build", "scan_context");
+    const int num_key_frames = static_cast<int>(key_frames.size());
+
+    // a. scan contexts & ring keys, filled in place by one task per chunk of key frames:
+    state_.scan_context_.Resize(num_key_frames);
+    state_.ring_key_.assign(num_key_frames, RingKey(NUM_RINGS_, 0.0f));
+    std::atomic<int> num_failed{0};
+    TaskScheduler::GetInstance().ParallelFor(
+        0, num_key_frames, 16,
+        [&](int begin, int end) {
+            Workspace workspace;
+            workspace.scan_context_.resize(NUM_RINGS_ * NUM_SECTORS_);
+            for (int i = begin; i < end; ++i) {
+                CloudData scan;
+                if (!load_scan(key_frames.at(i), scan)) {
+                    ++num_failed;
+                    continue;
+                }
+
+                GetScanContext(scan, workspace, workspace.scan_context_.data(), state_.ring_key_.at(i));
+                state_.scan_context_.Set(i, workspace.scan_context_.data());
+            }
+        }
+    );
+
+    // b. key frames:
+    state_.key_frame_ = key_frames;
+
+    // c. index all of them, nothing is left to be buffered:
+    state_.index_.counter_ = 0;
+    state_.index_.data_.ring_key_.clear();
+    state_.index_.data_.key_frame_.clear();
+    state_.session_.clear();
+    ResetIndex();
+    UpdateIndex(0);
+
+    if (num_failed > 0) {
+        LOG(ERROR) << "[Scan Context]: Failed to load " << num_failed << " of " << num_key_frames 
+                   << " key scans." << std::endl;
+        return false;
+    }
+
+    LOG(INFO) << std::endl
+              << "[Scan Context]: Build index of " << num_key_frames << " key frames." << std::endl;
+
+    return true;
+}
+
 /**
  * @brief  detect loop closure for the latest key scan
  * @param  void
  * @return loop closure propsal as std::pair<int, float>
  */
 std::pair<int, float> ScanContextManager::DetectLoopClosure(void) {
+    std::vector<std::pair<int, float>> proposals;
+    DetectLoopClosure(1, proposals);
+
+    if (proposals.empty()) {
+        std::pair<int, float> result {NONE, 0.0};
+        return result;
+    }
+
+    return proposals.front();
+}
+
+/**
+ * @brief  detect up to N loop closures for the latest key scan
+ * @param  N, max. num. of proposals
+ * @param  proposals, loop closure proposals as std::pair<int, float>, best first
+ * @return true if any proposal is found
+ */
+bool ScanContextManager::DetectLoopClosure(
+    const int N,
+    std::vector<std::pair<int, float>> &proposals
+) {
+    return DetectLoopClosure(N, CandidateFilter(), proposals);
+}
+
+/**
+ * @brief  detect up to N loop closures for the latest key scan, among the ones passing the filter
+ * @param  N, max. num. of proposals
+ * @param  is_candidate, ring key neighbors failing it are dropped before scan context comparison
+ * @param  proposals, loop closure proposals as std::pair<int, float>, best first
+ * @return true if any proposal is found
+ */
+bool ScanContextManager::DetectLoopClosure(
+    const int N,
+    const CandidateFilter &is_candidate,
+    std::vector<std::pair<int, float>> &proposals
+) {
+    TRACE_SCOPE("ScanContextManager::DetectLoopClosure", "scan_context");
     // use latest key scan for query:
-    const ScanContext &query_scan_context = state_.scan_context_.back();
+    std::vector<float> buffer;
+    const float *query_scan_context = state_.scan_context_.GetData(state_.scan_context_.GetSize() - 1, 1, buffer);
     const RingKey &query_ring_key = state_.ring_key_.back();
 
     // update ring key index:
@@ -102,7 +761,9 @@ std::pair<int, float> ScanContextManager::DetectLoopClosure(void) {
         UpdateIndex(MIN_KEY_FRAME_SEQ_DISTANCE_);
     }
 
-    return GetLoopClosureMatch(query_scan_context, query_ring_key);
+    GetLoopClosureMatches(query_scan_context, query_ring_key, N, is_candidate, proposals);
+
+    return !proposals.empty();
 }
 
 /**
@@ -115,33 +776,355 @@ bool ScanContextManager::DetectLoopClosure(
     const CloudData &scan,
     Eigen::Matrix4f &pose
 ) {
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> poses;
+    if (!DetectLoopClosure(scan, 1, poses)) {
+        return false;
+    }
+
+    pose = poses.front();
+
+    return true;
+}
+
+/**
+ * @brief  get up to N loop closure proposals using the given key scan
+ * @param  scan, query key scan
+ * @param  N, max. num. of proposals
+ * @param  poses, matched poses, best first
+ * @return true if any proposal is found
+ */
+bool ScanContextManager::DetectLoopClosure(
+    const CloudData &scan,
+    const int N,
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> &poses
+) {
+    return DetectLoopClosure(scan, N, CandidateFilter(), poses);
+}
+
+/**
+ * @brief  get up to N loop closure proposals using the given key scan, among the ones passing the filter
+ * @param  scan, query key scan
+ * @param  N, max. num. of proposals
+ * @param  is_candidate, ring key neighbors failing it are dropped before scan context comparison
+ * @param  poses, matched poses, best first
+ * @return true if any proposal is found
+ */
+bool ScanContextManager::DetectLoopClosure(
+    const CloudData &scan,
+    const int N,
+    const CandidateFilter &is_candidate,
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> &poses
+) {
+    TRACE_SCOPE("ScanContextManager::DetectLoopClosure", "scan_context");
     // extract scan context and corresponding ring key:
-    ScanContext query_scan_context = GetScanContext(scan);
-    RingKey query_ring_key = GetRingKey(query_scan_context);
+    std::vector<float> query_scan_context(NUM_RINGS_ * NUM_SECTORS_);
+    RingKey query_ring_key;
+    GetScanContext(scan, query_scan_context.data(), query_ring_key);
+
+    // get proposals:
+    std::vector<std::pair<int, float>> proposals;
+    GetLoopClosureMatches(query_scan_context.data(), query_ring_key, N, is_candidate, proposals);
+
+    poses.clear();
+    for (const auto &proposal: proposals) {
+        const int key_frame_id = proposal.first;
+        const float yaw_change_in_rad = proposal.second;
+
+        // set matched pose:
+        Eigen::Matrix4f pose = state_.index_.data_.key_frame_.at(key_frame_id).pose;
+        // apply orientation change estimation:
+        Eigen::AngleAxisf orientation_change(yaw_change_in_rad, Eigen::Vector3f::UnitZ());
+        pose.block<3, 3>(0, 0) = pose.block<3, 3>(0, 0) * orientation_change.toRotationMatrix();
+
+        poses.push_back(pose);
+    }
+
+    return !poses.empty();
+}
+
+/**
+ * @brief  get up to N loop closure proposals for each key frame of another session
+ * @param  session, fully indexed scan contexts of the other session
+ * @param  N, max. num. of proposals per key frame
+ * @param  matches, loop closure proposals in key frame order, best first for each key frame
+ * @return true if any proposal is found
+ */
+bool ScanContextManager::DetectLoopClosures(
+    const ScanContextManager &session,
+    const int N,
+    std::vector<SessionMatch> &matches
+) {
+    TRACE_SCOPE("ScanContextManager::DetectLoopClosures", "scan_context");
+    matches.clear();
+
+    if (
+        NUM_RINGS_ != session.NUM_RINGS_ || NUM_SECTORS_ != session.NUM_SECTORS_ ||
+        session.state_.scan_context_.GetSize() != session.state_.ring_key_.size()
+    ) {
+        LOG(ERROR) << "[Scan Context]: Session scan contexts do not match the index." << std::endl;
+        return false;
+    }
+
+    // query the whole index, including the key frames still buffered:
+    if (!UpdateIndex(0)) {
+        return false;
+    }
 
-    // get proposal:
-    std::pair<int, float> proposal = GetLoopClosureMatch(
-        query_scan_context, query_ring_key
+    // one task per query key frame, the candidates of each are scored serially:
+    const int num_queries = static_cast<int>(session.state_.ring_key_.size());
+    std::vector<std::vector<Match>> results(num_queries);
+    TaskScheduler::GetInstance().ParallelFor(
+        0, num_queries, 1,
+        [&](int begin, int end) {
+            std::vector<float> buffer;
+            for (int i = begin; i < end; ++i) {
+                GetMatches(
+                    session.state_.scan_context_.GetData(i, 1, buffer), session.state_.ring_key_.at(i), 
+                    NUM_CANDIDATES_, N, CandidateFilter(), false, results.at(i)
+                );
+            }
+        }
     );
 
-    const int key_frame_id = proposal.first;
-    const float yaw_change_in_rad = proposal.second;
+    for (int i = 0; i < num_queries; ++i) {
+        for (const Match &result: results.at(i)) {
+            SessionMatch match;
+            match.query_id = i;
+            match.match_id = result.id;
+            match.yaw_change_in_rad = result.shift * DEG_PER_SECTOR_ / 180.0f * M_PI;
+            match.distance = result.distance;
 
-    // check proposal validity:
-    if (ScanContextManager::NONE == key_frame_id) {
+            matches.push_back(match);
+        }
+    }
+
+    LOG(INFO) << std::endl
+              << "[Scan Context]: " << matches.size() << " cross-session proposals for "
+              << num_queries << " key frames against " << GetNumKeyFrames() << std::endl;
+
+    return !matches.empty();
+}
+
+/**
+ * @brief  get up to N loop closure proposals for each key frame of this index, among the key frames 
+ *         at least min. key frame seq. distance away on either side
+ * @param  N, max. num. of proposals per key frame
+ * @param  is_pair, pairs failing it are dropped before scan context comparison, all are scored if empty
+ * @param  matches, loop closure proposals in key frame order, best first for each key frame
+ * @return true if any proposal is found
+ */
+bool ScanContextManager::DetectLoopClosures(
+    const int N,
+    const PairFilter &is_pair,
+    std::vector<SessionMatch> &matches
+) {
+    TRACE_SCOPE("ScanContextManager::DetectLoopClosures", "scan_context");
+    matches.clear();
+
+    // query the whole index, including the key frames still buffered:
+    if (!UpdateIndex(0)) {
         return false;
     }
 
-    // set matched pose:
-    pose = state_.index_.data_.key_frame_.at(key_frame_id).pose;
-    // apply orientation change estimation:
-    Eigen::AngleAxisf orientation_change(yaw_change_in_rad, Eigen::Vector3f::UnitZ());
-    pose.block<3, 3>(0, 0) = pose.block<3, 3>(0, 0) * orientation_change.toRotationMatrix();
+    // the nearest ring keys of a key frame are mostly its own sequence neighbors, which are dropped. 
+    // searching past all of them keeps the NUM_CANDIDATES_ nearest of the others:
+    const int num_neighbors = NUM_CANDIDATES_ + 2 * std::max(MIN_KEY_FRAME_SEQ_DISTANCE_, 0);
+
+    // one task per query key frame, the candidates of each are scored serially:
+    const int num_queries = static_cast<int>(state_.index_.data_.ring_key_.size());
+    std::vector<std::vector<Match>> results(num_queries);
+    TaskScheduler::GetInstance().ParallelFor(
+        0, num_queries, 1,
+        [&](int begin, int end) {
+            std::vector<float> buffer;
+            for (int i = begin; i < end; ++i) {
+                const CandidateFilter is_candidate = [&, i](int key_frame_id) {
+                    return std::abs(key_frame_id - i) >= MIN_KEY_FRAME_SEQ_DISTANCE_ && 
+                           (!is_pair || is_pair(i, key_frame_id));
+                };
+
+                GetMatches(
+                    state_.scan_context_.GetData(i, 1, buffer), state_.index_.data_.ring_key_.at(i), 
+                    num_neighbors, N, is_candidate, false, results.at(i)
+                );
+            }
+        }
+    );
+
+    for (int i = 0; i < num_queries; ++i) {
+        for (const Match &result: results.at(i)) {
+            SessionMatch match;
+            match.query_id = i;
+            match.match_id = result.id;
+            match.yaw_change_in_rad = result.shift * DEG_PER_SECTOR_ / 180.0f * M_PI;
+            match.distance = result.distance;
+
+            matches.push_back(match);
+        }
+    }
+
+    LOG(INFO) << std::endl
+              << "[Scan Context]: " << matches.size() << " proposals for all " << num_queries << " key frames" << std::endl;
+
+    return !matches.empty();
+}
+
+/**
+ * @brief  get up to N loop closure proposals for each key frame of this index by exhaustive search
+ * @param  N, max. num. of proposals per key frame
+ * @param  is_pair, pairs failing it are dropped, all are kept if empty
+ * @param  distance, batched scan context distance of the same resolution, its targets are replaced
+ * @param  matches, loop closure proposals in key frame order, best first for each key frame
+ * @return true if any proposal is found
+ */
+bool ScanContextManager::DetectLoopClosures(
+    const int N,
+    const PairFilter &is_pair,
+    ScanContextDistance &distance,
+    std::vector<SessionMatch> &matches
+) {
+    TRACE_SCOPE("ScanContextManager::DetectLoopClosures", "scan_context");
+    matches.clear();
+
+    if (distance.GetNumRings() != NUM_RINGS_ || distance.GetNumSectors() != NUM_SECTORS_) {
+        LOG(ERROR) << "Scan context resolution mismatch: "
+                   << distance.GetNumRings() << " x " << distance.GetNumSectors() << " vs. "
+                   << NUM_RINGS_ << " x " << NUM_SECTORS_;
+        return false;
+    }
+
+    // query the whole index, including the key frames still buffered:
+    if (!UpdateIndex(0)) {
+        return false;
+    }
+
+    // the index is both the targets and the sources:
+    // a quantized index is dequantized once, for the offline run only:
+    const int num_queries = static_cast<int>(state_.index_.data_.ring_key_.size());
+    std::vector<float> buffer;
+    const float *scan_contexts = state_.scan_context_.GetData(0, num_queries, buffer);
+    if (!distance.SetTargets(scan_contexts, num_queries)) {
+        return false;
+    }
+
+    std::vector<std::vector<ScanContextDistance::Match>> results;
+    bool is_searched = distance.GetNearest(
+        scan_contexts, num_queries, N, SCAN_CONTEXT_DISTANCE_THRESH_,
+        [&](int query_id, int key_frame_id) {
+            return std::abs(key_frame_id - query_id) >= MIN_KEY_FRAME_SEQ_DISTANCE_ && 
+                   (!is_pair || is_pair(query_id, key_frame_id));
+        },
+        results
+    );
+    if (!is_searched) {
+        return false;
+    }
+
+    for (int i = 0; i < num_queries; ++i) {
+        for (const ScanContextDistance::Match &result: results.at(i)) {
+            SessionMatch match;
+            match.query_id = i;
+            match.match_id = result.target_id;
+            match.yaw_change_in_rad = result.shift * DEG_PER_SECTOR_ / 180.0f * M_PI;
+            match.distance = result.distance;
+
+            matches.push_back(match);
+        }
+    }
+
+    LOG(INFO) << std::endl
+              << "[Scan Context]: " << matches.size() << " exhaustive proposals for all " << num_queries << " key frames" << std::endl;
+
+    return !matches.empty();
+}
+
+/**
+ * @brief  append the key frames of another session, the ring key index is extended in place
+ * @param  session, fully indexed scan contexts of the other session
+ * @param  session_name, name of the session
+ * @return true for success otherwise false
+ */
+bool ScanContextManager::Append(const ScanContextManager &session, const std::string &session_name) {
+    TRACE_SCOPE("ScanContextManager::Append", "scan_context");
+    const size_t num_key_frames = session.state_.index_.data_.key_frame_.size();
+    if (
+        NUM_RINGS_ != session.NUM_RINGS_ || NUM_SECTORS_ != session.NUM_SECTORS_ ||
+        session.state_.scan_context_.GetSize() != num_key_frames ||
+        session.state_.index_.data_.ring_key_.size() != num_key_frames
+    ) {
+        LOG(ERROR) << "[Scan Context]: Session " << session_name << " does not match the index." << std::endl;
+        return false;
+    }
+
+    // the new key frames go behind everything buffered so far:
+    UpdateIndex(0);
+    const size_t num_indexed = state_.index_.data_.ring_key_.size();
+
+    if (state_.session_.empty() && num_indexed > 0) {
+        state_.session_.push_back({"", 0});
+    }
+    state_.session_.push_back({session_name, num_indexed});
+
+    // a. scan contexts, (de)quantized if the session is stored differently:
+    std::vector<float> buffer;
+    for (size_t i = 0; i < num_key_frames; ++i) {
+        state_.scan_context_.Add(session.state_.scan_context_.GetData(i, 1, buffer));
+    }
+
+    // b. ring keys:
+    const RingKeys &ring_keys = session.state_.index_.data_.ring_key_;
+    state_.ring_key_.insert(state_.ring_key_.end(), ring_keys.begin(), ring_keys.end());
+    state_.index_.data_.ring_key_.insert(state_.index_.data_.ring_key_.end(), ring_keys.begin(), ring_keys.end());
+
+    // c. key frames, numbered by their position in this index:
+    for (size_t i = 0; i < num_key_frames; ++i) {
+        KeyFrame key_frame = session.state_.index_.data_.key_frame_.at(i);
+        key_frame.index = static_cast<unsigned int>(num_indexed + i);
+
+        // the buffer is only filled by Update:
+        if (state_.key_frame_.size() == num_indexed + i) {
+            state_.key_frame_.push_back(key_frame);
+        }
+        state_.index_.data_.key_frame_.push_back(key_frame);
+    }
+
+    // d. only the new ring keys are inserted, amortized O(log N) per ring key:
+    ExtendIndex();
+
+    LOG(INFO) << std::endl
+              << "[Scan Context]: Append session " << session_name << " of " << num_key_frames
+              << " key frames, index size " << GetIndexSize() << std::endl;
 
-    // finally:
     return true;
 }
 
+/**
+ * @brief  get the session of a key frame
+ * @param  key_frame_id, key frame id within this index
+ * @param  session_name, name of the session
+ * @param  session_key_frame_id, key frame id within the session
+ * @return session id
+ */
+int ScanContextManager::GetSession(const int key_frame_id, std::string &session_name, int &session_key_frame_id) const {
+    if (state_.session_.empty()) {
+        session_name.clear();
+        session_key_frame_id = key_frame_id;
+        return 0;
+    }
+
+    // the last session beginning at or before the key frame:
+    auto it = std::upper_bound(
+        state_.session_.begin(), state_.session_.end(), static_cast<size_t>(key_frame_id),
+        [](const size_t id, const decltype(state_.session_)::value_type &session) { return id < session.begin_; }
+    );
+    --it;
+
+    session_name = it->name_;
+    session_key_frame_id = key_frame_id - static_cast<int>(it->begin_);
+
+    return static_cast<int>(it - state_.session_.begin());
+}
+
 /**
  * @brief  save scan context index & data to persistent storage
  * @param  output_path, scan context output path
@@ -154,7 +1137,7 @@ bool ScanContextManager::Save(const std::string &output_path) {
     ) {
         // prompt:
         LOG(INFO) << std::endl
-                  << "[Scan Context]: Index size " << state_.index_.kd_tree_->kdtree_get_point_count()
+                  << "[Scan Context]: Index size " << GetIndexSize()
                   << std::endl;
 
         // a. save index:
@@ -182,7 +1165,7 @@ bool ScanContextManager::Save(const std::string &output_path) {
             LOG(ERROR) << "[Scan Context]: Failed to write scan contexts." << std::endl;
             return false;
         } else {
-            LOG(INFO) << "\tSave scan context of size " << state_.scan_context_.size()
+            LOG(INFO) << "\tSave scan context of size " << state_.scan_context_.GetSize()
                       << " to: " << scan_contexts_output_path
                       << std::endl;
         }
@@ -214,6 +1197,28 @@ bool ScanContextManager::Save(const std::string &output_path) {
         }
 
         google::protobuf::ShutdownProtobufLibrary();
+
+        // c. save flat index, for loading without parsing & re-indexing:
+        std::string flat_index_output_path = output_path + "/scan_context_index.bin";
+        if (
+            !SaveFlatIndex(flat_index_output_path)
+        ) {
+            LOG(ERROR) << "[Scan Context]: Failed to write flat index." << std::endl;
+            return false;
+        } else {
+            LOG(INFO) << "\tSave flat index to: " << flat_index_output_path << std::endl;
+        }
+
+        // d. save sessions of a merged index:
+        std::string sessions_output_path = output_path + "/sessions.txt";
+        if (
+            !SaveSessions(sessions_output_path)
+        ) {
+            LOG(ERROR) << "[Scan Context]: Failed to write sessions." << std::endl;
+            return false;
+        } else if (!state_.session_.empty()) {
+            LOG(INFO) << "\tSave " << state_.session_.size() << " sessions to: " << sessions_output_path << std::endl;
+        }
     } else {
         LOG(ERROR) << std::endl
                     << "[Scan Context]: Skip empty index"
@@ -223,12 +1228,55 @@ bool ScanContextManager::Save(const std::string &output_path) {
     return true;
 }
 
+/**
+ * @brief  copy scan contexts, ring keys, key frames & sessions, e.g. to save them on another thread
+ * @return the snapshot
+ */
+std::shared_ptr<ScanContextManager> ScanContextManager::GetSnapshot(void) const {
+    std::shared_ptr<ScanContextManager> snapshot_ptr = std::make_shared<ScanContextManager>(*this);
+
+    // the index refers to the ring keys of this manager, so the snapshot re-indexes its copies on Save:
+    snapshot_ptr->state_.index_.counter_ = 0;
+    snapshot_ptr->state_.index_.data_.ring_key_.clear();
+    snapshot_ptr->state_.index_.data_.key_frame_.clear();
+    snapshot_ptr->ResetIndex();
+
+    return snapshot_ptr;
+}
+
 /**
  * @brief  load scan context index & data from persistent storage
  * @param  input_path, scan context input path
  * @return true for success otherwise false
  */
 bool ScanContextManager::Load(const std::string &input_path) {
+    // sessions of a merged index:
+    std::string sessions_input_path = input_path + "/sessions.txt";
+    if (
+        !LoadSessions(sessions_input_path)
+    ) {
+        LOG(ERROR) << "[Scan Context]: Failed to load sessions." << std::endl;
+        return false;
+    }
+
+    // use the flat index if available, it holds the ring key index too:
+    std::string flat_index_input_path = input_path + "/scan_context_index.bin";
+    if (
+        LoadFlatIndex(flat_index_input_path)
+    ) {
+        LOG(INFO) << std::endl
+                  << "[Scan Context]: Load Scan Context Index from " << flat_index_input_path << std::endl
+                  << "\tNum. Scan Contexts: " << state_.scan_context_.GetSize() << std::endl
+                  << "\tNum. Ring Keys: " << state_.ring_key_.size() << std::endl
+                  << "\tNum. Key Frames: " << state_.index_.data_.key_frame_.size() << std::endl
+                  << "\tIndex Size: " << GetIndexSize() 
+                  << std::endl;
+        return true;
+    }
+
+    LOG(WARNING) << "[Scan Context]: No valid flat index in " << input_path 
+                 << ", fall back to protobuf." << std::endl;
+
     // a. load ring key data:
 
     // Verify that the version of the library that we linked against is
@@ -247,7 +1295,7 @@ bool ScanContextManager::Load(const std::string &input_path) {
         LOG(ERROR) << "[Scan Context]: Failed to load scan contexts." << std::endl;
         return false;
     } else {
-        LOG(INFO) << "\tNum. Scan Contexts: " << state_.scan_context_.size() << std::endl;
+        LOG(INFO) << "\tNum. Scan Contexts: " << state_.scan_context_.GetSize() << std::endl;
     }
 
     // 2. ring keys:
@@ -273,14 +1321,9 @@ bool ScanContextManager::Load(const std::string &input_path) {
     }
     
     // b. load scan context index:
-    state_.index_.kd_tree_.reset(); 
-    state_.index_.kd_tree_ = std::make_shared<RingKeyIndex>(
-        NUM_RINGS_,  /* dim */
-        state_.index_.data_.ring_key_,
-        10           /* max leaf size */
-    );
+    ResetIndex();
 
-    LOG(INFO) << "\tIndex Size: " << state_.index_.kd_tree_->kdtree_get_point_count() 
+    LOG(INFO) << "\tIndex Size: " << GetIndexSize() 
               << std::endl;
 
     google::protobuf::ShutdownProtobufLibrary();
@@ -289,72 +1332,89 @@ bool ScanContextManager::Load(const std::string &input_path) {
 }
 
 /**
- * @brief  get scan context of given lidar scan
+ * @brief  get scan context and ring key of given lidar scan
  * @param  scan, lidar scan of key frame
- * @return scan context as Eigen::MatrixXd
+ * @param  scan_context, output column-major scan context of NUM_RINGS_ x NUM_SECTORS_
+ * @param  ring_key, output ring key
+ * @return void
  */
-ScanContextManager::ScanContext ScanContextManager::GetScanContext(const CloudData &scan) {
+void ScanContextManager::GetScanContext(
+    const CloudData &scan, 
+    float *scan_context, 
+    RingKey &ring_key
+) {
+    GetScanContext(scan, workspace_, scan_context, ring_key);
+}
+
+/**
+ * @brief  get scan context and ring key of given lidar scan, using the given workspace
+ * @param  scan, lidar scan of key frame
+ * @param  workspace, binning buffers, reused across scans
+ * @param  scan_context, output column-major scan context of NUM_RINGS_ x NUM_SECTORS_
+ * @param  ring_key, output ring key
+ * @return void
+ */
+void ScanContextManager::GetScanContext(
+    const CloudData &scan, 
+    Workspace &workspace,
+    float *scan_context, 
+    RingKey &ring_key
+) const {
     // num. of point measurements in current scan:
-    const size_t N = scan.cloud_ptr->points.size();
-    
-    // init scan context:
+    const auto &points = scan.cloud_ptr->points;
+    const int N = static_cast<int>(points.size());
+
+    // a. xy components as structure of arrays for the vectorized binning:
+    workspace.x_.resize(N);
+    workspace.y_.resize(N);
+    workspace.bin_id_.resize(N);
+    for (int i = 0; i < N; ++i) {
+        workspace.x_[i] = points[i].x;
+        workspace.y_[i] = points[i].y;
+    }
+
+    // b. get ring-sector index:
+    BinParams params;
+    params.max_radius_2 = MAX_RADIUS_ * MAX_RADIUS_;
+    params.ring_scale = NUM_RINGS_ / MAX_RADIUS_;
+    params.sector_scale = NUM_SECTORS_ / (MAX_THETA_ * static_cast<float>(M_PI / 180.0));
+    params.num_rings = NUM_RINGS_;
+    params.num_sectors = NUM_SECTORS_;
+    GetBinIndices(
+        workspace.x_.data(), workspace.y_.data(), N, 
+        params, 
+        workspace.bin_id_.data()
+    );
+
+    // c. update bin height:
     const float UNKNOWN_HEIGHT = -1000.0f;
-    ScanContext scan_context = UNKNOWN_HEIGHT * ScanContext::Ones(NUM_RINGS_, NUM_SECTORS_);
-
-    // iterate through point measurements and create scan context:
-    float x, y, z;
-    float radius, theta;
-    for (size_t i = 0; i < N; ++i) {
-        // parse point measurement:
-        x = scan.cloud_ptr->points.at(i).x;
-        y = scan.cloud_ptr->points.at(i).y;
-        z = scan.cloud_ptr->points.at(i).z + 2.0f;
-
-        radius = hypot(x, y);
-        theta = GetOrientation(x, y);
-
-        // ROI check:
-        if (radius > MAX_RADIUS_) {
+    std::fill(scan_context, scan_context + NUM_RINGS_ * NUM_SECTORS_, UNKNOWN_HEIGHT);
+    for (int i = 0; i < N; ++i) {
+        const int bid = workspace.bin_id_[i];
+        if (bid < 0) {
             continue;
         }
-        
-        // get ring-sector index:
-        int rid = GetIndex(radius, MAX_RADIUS_, NUM_RINGS_); 
-        int sid = GetIndex(theta, MAX_THETA_, NUM_SECTORS_); 
 
-        // update bin height:
-        if (scan_context(rid, sid) < z) {
-            scan_context(rid, sid) = z;
+        const float z = points[i].z + 2.0f;
+        if (scan_context[bid] < z) {
+            scan_context[bid] = z;
         }
     }
 
-    // reset unknown height to 0.0 for later cosine distance calculation:
-    for (int rid = 0; rid < scan_context.rows(); ++rid) {
-        for (int sid = 0; sid < scan_context.cols(); ++sid) {
-            if (UNKNOWN_HEIGHT == scan_context(rid, sid)) {
-                scan_context(rid, sid) = 0.0;
-            }
+    // d. reset unknown height to 0.0 for later cosine distance calculation, 
+    // in the same pass as ring key reduction:
+    ring_key.assign(NUM_RINGS_, 0.0f);
+    for (int sid = 0; sid < NUM_SECTORS_; ++sid) {
+        float *col = scan_context + sid * NUM_RINGS_;
+        for (int rid = 0; rid < NUM_RINGS_; ++rid) {
+            const float height = (UNKNOWN_HEIGHT == col[rid] ? 0.0f : col[rid]);
+            col[rid] = height;
+            ring_key[rid] += height;
         }
     }
-
-    return scan_context;
-}
-
-/**
- * @brief  get ring key of given scan context
- * @param  scan_context, scan context of key scan
- * @return ring key as RingKey
- */
-ScanContextManager::RingKey ScanContextManager::GetRingKey(
-    const ScanContext &scan_context
-) {
-    RingKey ring_key(scan_context.rows());
-
-    for (int rid = 0; rid < scan_context.rows(); ++rid) {
-        ring_key.at(rid) = scan_context.row(rid).mean();
+    for (int rid = 0; rid < NUM_RINGS_; ++rid) {
+        ring_key[rid] /= NUM_SECTORS_;
     }
-
-    return ring_key;
 }
 
 /**
@@ -375,64 +1435,6 @@ void ScanContextManager::GenerateRandomRingKey(
 	}
 }
 
-/**
- * @brief  get sector key of given scan context
- * @param  scan_context, scan context of key scan
- * @return sector key as RingKey
- */
-Eigen::MatrixXf ScanContextManager::GetSectorKey(
-    const Eigen::MatrixXf &scan_context
-) {
-    Eigen::MatrixXf sector_key(1, scan_context.cols());
-
-    for (int sid = 0; sid < scan_context.cols(); ++sid)
-    {
-        sector_key(0, sid) = scan_context.col(sid).mean();
-    }
-
-    return sector_key;
-}
-
-/**
- * @brief  get orientation of point measurement 
- * @param  x, x component of point measurement
- * @param  y, y component of point measurement
- * @return point measurement orientation, [0.0f, 360.0f)
- */
-float ScanContextManager::GetOrientation(
-    const float &x, 
-    const float &y
-) {
-    float theta = 180.0f / M_PI * atan2(y, x);
-
-    // make sure the orientation is consistent with scan context convension:
-    if (theta < 0.0f) {
-        theta += 360.0f;
-    }
-
-    return theta;
-}
-
-/**
- * @brief  convert floating point value to integer index 
- * @param  value, target floating point value 
- * @param  MAX_VALUE, max. floating point value
- * @param  RESOLUTION, resolution
- * @return integer index, {0, ..., RESOLUTION - 1}
- */
-int ScanContextManager::GetIndex(
-    const float &value, 
-    const float &MAX_VALUE, 
-    const int RESOLUTION
-) {
-    int index = std::floor(static_cast<int>(RESOLUTION*value/MAX_VALUE));
-
-    // this ensures value at MAX_VALUE will be cast into last bin:
-    index = std::min(index, RESOLUTION - 1);
-
-    return index;
-} 
-
 /**
  * @brief  get candidate scan context indices 
  * @param  ring_key, query ring key 
@@ -446,127 +1448,228 @@ void ScanContextManager::GetCandidateIndices(
     std::vector<size_t> &indices,
 	std::vector<float> &distances
 ) {    
-    state_.index_.kd_tree_->query(
-        &ring_key.at(0),
-        N,
-        &indices.at(0),
-        &distances.at(0)
-    );
+    indices.resize(N);
+    distances.resize(N);
+
+    size_t num_found = 0;
+    if (USE_GRAPH_INDEX_) {
+        num_found = state_.index_.graph_->Query(
+            &ring_key.at(0),
+            N,
+            &indices.at(0),
+            &distances.at(0)
+        );
+    } else {
+        num_found = state_.index_.kd_tree_->query(
+            &ring_key.at(0),
+            N,
+            &indices.at(0),
+            &distances.at(0)
+        );
+    }
+
+    // the index can be smaller than N right after start:
+    indices.resize(num_found);
+    distances.resize(num_found);
 }
 
 /**
- * @brief  circular shift mat to right by shift
- * @param  mat, original matrix 
- * @param  shift, right shift amount  
- * @return shifted matrix
+ * @brief  get column-normalized scan context for shift search
+ * @param  scan_context, input scan context 
+ * @param  is_target, whether to store the columns twice, so any circular shift is a contiguous block
+ * @param  normalized_scan_context, output normalized scan context
+ * @return void
  */
-Eigen::MatrixXf ScanContextManager::CircularShift(
-    const Eigen::MatrixXf &mat, 
-    int shift 
+void ScanContextManager::GetNormalizedScanContext(
+    const float *scan_context,
+    const bool is_target,
+    NormalizedScanContext &normalized_scan_context
 ) {
-    if(0 == shift)
-    {
-        Eigen::MatrixXf shifted_mat(mat);
-        return shifted_mat; // Early return 
+    if (USE_FIXED_SIZE_) {
+        GetNormalizedScanContext(
+            Eigen::Map<const FixedScanContext>(scan_context), 
+            is_target, normalized_scan_context
+        );
+    } else {
+        GetNormalizedScanContext(
+            Eigen::Map<const ScanContext>(scan_context, NUM_RINGS_, NUM_SECTORS_), 
+            is_target, normalized_scan_context
+        );
     }
+}
 
-    Eigen::MatrixXf shifted_mat = Eigen::MatrixXf::Zero( 
-        mat.rows(), 
-        mat.cols() 
-    );
-    for (int i = 0; i < mat.cols(); ++i) {
-        int shifted_i = (i + shift) % mat.cols();
-        shifted_mat.col(shifted_i) = mat.col(i);
+template <typename Descriptor>
+void ScanContextManager::GetNormalizedScanContext(
+    const Eigen::MatrixBase<Descriptor> &scan_context,
+    const bool is_target,
+    NormalizedScanContext &normalized_scan_context
+) {
+    const int R = scan_context.rows();
+    const int N = scan_context.cols();
+    const int M = (is_target ? 2 : 1);
+
+    normalized_scan_context.num_rings = R;
+    normalized_scan_context.num_sectors = N;
+    normalized_scan_context.data.resize(M * N * R);
+    normalized_scan_context.is_valid.resize(M * N);
+    normalized_scan_context.sector_key.resize(M * N);
+
+    for (int sid = 0; sid < N; ++sid) {
+        const float sector_norm = scan_context.col(sid).norm();
+        const float scale = (0.0f == sector_norm ? 0.0f : 1.0f / sector_norm);
+        const float sector_key = scan_context.col(sid).mean();
+
+        for (int m = 0; m < M; ++m) {
+            const int cid = m * N + sid;
+            float *col = &normalized_scan_context.data.at(cid * R);
+            for (int rid = 0; rid < R; ++rid) {
+                col[rid] = scale * scan_context(rid, sid);
+            }
+            normalized_scan_context.is_valid.at(cid) = (0.0f == sector_norm ? 0.0f : 1.0f);
+            normalized_scan_context.sector_key.at(cid) = sector_key;
+        }
+    }
+
+    // columns are unit-norm, so one scale fits all:
+    if (QUANTIZE_) {
+        const float scale = ScanContextBuffer::MAX_CODE;
+        normalized_scan_context.codes.resize(M * N * R);
+        for (size_t i = 0; i < normalized_scan_context.data.size(); ++i) {
+            normalized_scan_context.codes.at(i) = static_cast<int8_t>(
+                std::lround(scale * normalized_scan_context.data.at(i))
+            );
+        }
     }
 
-    return shifted_mat;
+    // target spectra are kept along with the index:
+    if (!is_target) {
+        GetSectorKeySpectrum(normalized_scan_context.sector_key, normalized_scan_context.sector_key_spectrum);
+    }
 }
 
 /**
- * @brief  get optimal shift estimation using sector key 
- * @param  target, target sector key 
- * @param  source, source sector key  
+ * @brief  get half spectrum of sector key 
+ * @param  sector_key, sector key of num_sectors
+ * @param  sector_key_spectrum, output half spectrum of num_sectors / 2 + 1 bins
  * @return void
  */
-int ScanContextManager::GetOptimalShiftUsingSectorKey(
-    const Eigen::MatrixXf &target, 
-    const Eigen::MatrixXf &source
+void ScanContextManager::GetSectorKeySpectrum(
+    const std::vector<float> &sector_key,
+    std::vector<std::complex<float>> &sector_key_spectrum
 ) {
-    int optimal_shift = 0;
-    float optimal_dist = std::numeric_limits<float>::max();
-
-    for (int curr_shift = 0; curr_shift < target.cols(); ++curr_shift) {
-        Eigen::MatrixXf curr_target = CircularShift(
-            target, curr_shift
-        );
-
-        float curr_dist = (curr_target - source).norm();
+    // plans are cached per instance, so one instance per thread:
+    static thread_local Eigen::FFT<float> fft;
+    fft.SetFlag(Eigen::FFT<float>::HalfSpectrum);
 
-        if(curr_dist < optimal_dist)
-        {
-            optimal_dist = curr_dist;
-            optimal_shift = curr_shift;
-        }
+    fft.fwd(sector_key_spectrum, sector_key);
+}
+
+/**
+ * @brief  get optimal shift estimation using sector key 
+ * @param  target, target normalized scan context 
+ * @param  source, source normalized scan context  
+ * @return optimal shift
+ */
+int ScanContextManager::GetOptimalShiftUsingSectorKey(
+    const NormalizedScanContext &target, 
+    const NormalizedScanContext &source
+) {
+    static thread_local Eigen::FFT<float> fft;
+    fft.SetFlag(Eigen::FFT<float>::HalfSpectrum);
+    static thread_local std::vector<std::complex<float>> cross_spectrum;
+    static thread_local std::vector<float> correlation;
+
+    const int N = source.num_sectors;
+    const int K = N / 2 + 1;
+
+    // the squared distance between target shifted to right by curr_shift and source is
+    // |target|^2 + |source|^2 - 2 * sum(target(sid - curr_shift) * source(sid)), so it is the 
+    // peak of the circular cross-correlation, whose spectrum is conj(T) * S:
+    cross_spectrum.resize(K);
+    for (int k = 0; k < K; ++k) {
+        cross_spectrum[k] = std::conj(target.sector_key_spectrum.at(k)) * source.sector_key_spectrum.at(k);
     }
+    fft.inv(correlation, cross_spectrum, N);
 
-    return optimal_shift;
+    return static_cast<int>(
+        std::max_element(correlation.begin(), correlation.end()) - correlation.begin()
+    );
 } 
 
 /**
- * @brief  compute cosine distance between target and source scan context 
- * @param  target_scan_context, target scan context 
- * @param  source_scan_context, source scan context 
+ * @brief  compute cosine distance between shifted target and source scan context 
+ * @param  target, target normalized scan context 
+ * @param  source, source normalized scan context 
+ * @param  shift, right shift amount of target, {0, ..., NUM_SECTORS - 1}
  * @return scan context cosine distance
  */
 float ScanContextManager::GetCosineDistance(
-    const ScanContext &target_scan_context, 
-    const ScanContext &source_scan_context 
+    const NormalizedScanContext &target, 
+    const NormalizedScanContext &source,
+    const int shift
 ) {
-    const int N = target_scan_context.cols();
-
-    int num_effective_cols = 0;
-    float sum_sector_similarity = 0.0f;
-    for (int sid = 0; sid < N; ++sid)
-    {
-        const Eigen::VectorXf target_sector = target_scan_context.col(sid);
-        const Eigen::VectorXf source_sector = source_scan_context.col(sid);
-        
-        float target_sector_norm = target_sector.norm();
-        float source_sector_norm = source_sector.norm();
-
-        if( 0.0f == target_sector_norm || 0.0f == source_sector_norm ) {
-            continue;
-        }
-             
-        float sector_similarity = target_sector.dot(source_sector) / (target_sector_norm * source_sector_norm);
+    const int R = source.num_rings;
+    const int N = source.num_sectors;
+
+    // column sid of shifted target is column (N - shift + sid) of the doubled target,
+    // empty columns are zero, so they add nothing to the sum of sector similarities:
+    const int offset = N - shift;
+    float sum_sector_similarity = Dot(
+        &target.data.at(offset * R), &source.data.at(0), N * R
+    );
+    int num_effective_cols = static_cast<int>(
+        Dot(&target.is_valid.at(offset), &source.is_valid.at(0), N) + 0.5f
+    );
+    
+    return (0 == num_effective_cols ? 1.0f : (1.0f - sum_sector_similarity / num_effective_cols));
+}
 
-        sum_sector_similarity += sector_similarity;
-        ++num_effective_cols;
-    }
+/**
+ * @brief  compute cosine distance between shifted target and source scan context, on int8 codes
+ * @param  target, target normalized scan context 
+ * @param  source, source normalized scan context 
+ * @param  shift, right shift amount of target, {0, ..., NUM_SECTORS - 1}
+ * @return scan context cosine distance
+ */
+float ScanContextManager::GetQuantizedCosineDistance(
+    const NormalizedScanContext &target, 
+    const NormalizedScanContext &source,
+    const int shift
+) {
+    const int R = source.num_rings;
+    const int N = source.num_sectors;
+
+    // same as GetCosineDistance, with exact integer sums of the codes:
+    const int offset = N - shift;
+    const float scale = 1.0f / (ScanContextBuffer::MAX_CODE * ScanContextBuffer::MAX_CODE);
+    float sum_sector_similarity = scale * Dot(
+        &target.codes.at(offset * R), &source.codes.at(0), N * R
+    );
+    int num_effective_cols = static_cast<int>(
+        Dot(&target.is_valid.at(offset), &source.is_valid.at(0), N) + 0.5f
+    );
     
     return (0 == num_effective_cols ? 1.0f : (1.0f - sum_sector_similarity / num_effective_cols));
 }
 
 /**
  * @brief  get scan context match result between target and source scan context 
- * @param  target_scan_context, target scan context 
- * @param  source_scan_context, source scan context 
+ * @param  target, target normalized scan context 
+ * @param  source, source normalized scan context 
  * @return scan context match result as std::pair<int, float>
  */
 std::pair<int, float> ScanContextManager::GetScanContextMatch(
-    const ScanContext &target_scan_context, 
-    const ScanContext &source_scan_context
+    const NormalizedScanContext &target, 
+    const NormalizedScanContext &source
 ) {
     // first perform fast alignment using sector key:
-    Eigen::MatrixXf target_sector_key = GetSectorKey(target_scan_context);
-    Eigen::MatrixXf source_sector_key = GetSectorKey(source_scan_context);
     int sector_key_shift = GetOptimalShiftUsingSectorKey(
-        target_sector_key, 
-        source_sector_key 
+        target, 
+        source 
     );
 
     // generate precise alignment proposals:
-    const int N = target_scan_context.cols();
+    const int N = source.num_sectors;
     const int SEARCH_RADIUS = round(
         0.5 * FAST_ALIGNMENT_SEARCH_RATIO_ * N
     );
@@ -587,14 +1690,10 @@ std::pair<int, float> ScanContextManager::GetScanContextMatch(
     float optimal_dist = std::numeric_limits<float>::max();
     for (int curr_shift: candidate_shifts)
     {
-        ScanContext target_scan_context_shifted = CircularShift(
-            target_scan_context, 
-            curr_shift
-        );
-
-        float curr_dist = GetCosineDistance(
-            target_scan_context_shifted, 
-            source_scan_context 
+        float curr_dist = (
+            QUANTIZE_ ? 
+            GetQuantizedCosineDistance(target, source, curr_shift) : 
+            GetCosineDistance(target, source, curr_shift)
         );
 
         if(curr_dist < optimal_dist)
@@ -616,48 +1715,188 @@ bool ScanContextManager::UpdateIndex(const int MIN_KEY_FRAME_SEQ_DISTANCE) {
     if (
         state_.ring_key_.size() > static_cast<size_t>(MIN_KEY_FRAME_SEQ_DISTANCE)
     ) {
-        // fetch to-be-indexed ring keys from buffer:
-        state_.index_.data_.ring_key_.clear();
-        state_.index_.data_.ring_key_.insert(
-            state_.index_.data_.ring_key_.end(),
-            state_.ring_key_.begin(), 
-            // this ensures the min. key frame seq. distance
-            state_.ring_key_.end() - MIN_KEY_FRAME_SEQ_DISTANCE
-        );
+        // this ensures the min. key frame seq. distance:
+        const size_t num_to_index = state_.ring_key_.size() - MIN_KEY_FRAME_SEQ_DISTANCE;
+        const size_t num_indexed = state_.index_.data_.ring_key_.size();
+        if (num_to_index == num_indexed) {
+            return true;
+        }
 
-        state_.index_.data_.key_frame_.clear();
-        state_.index_.data_.key_frame_.insert(
-            state_.index_.data_.key_frame_.end(),
-            state_.key_frame_.begin(), 
-            // this ensures the min. key frame seq. distance
-            state_.key_frame_.end() - MIN_KEY_FRAME_SEQ_DISTANCE
-        );
+        const auto begin_time = std::chrono::steady_clock::now();
+        if (num_to_index < num_indexed) {
+            // the index is ahead of the requested seq. distance, e.g. after Save, so rebuild it:
+            state_.index_.data_.ring_key_.resize(num_to_index);
+            state_.index_.data_.key_frame_.resize(num_to_index);
+            ResetIndex();
+        } else if (num_to_index > num_indexed) {
+            // fetch to-be-indexed ring keys from buffer:
+            state_.index_.data_.ring_key_.insert(
+                state_.index_.data_.ring_key_.end(),
+                state_.ring_key_.begin() + num_indexed, 
+                state_.ring_key_.begin() + num_to_index
+            );
+            state_.index_.data_.key_frame_.insert(
+                state_.index_.data_.key_frame_.end(),
+                state_.key_frame_.begin() + num_indexed, 
+                state_.key_frame_.begin() + num_to_index
+            );
+
+            // only the new ring keys are inserted, amortized O(log N) per ring key:
+            ExtendIndex();
+        }
+
+        ++index_stats_.num_updates;
+        index_stats_.total_update_time += std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - begin_time
+        ).count();
 
-        // TODO: enable in-place update of KDTree
-        state_.index_.kd_tree_.reset(); 
-        state_.index_.kd_tree_ = std::make_shared<RingKeyIndex>(
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief  rebuild scan context index from indexed ring keys
+ * @return void
+ */
+void ScanContextManager::ResetIndex(void) {
+    state_.index_.kd_tree_.reset(); 
+    state_.index_.graph_.reset();
+    if (USE_GRAPH_INDEX_) {
+        state_.index_.graph_ = std::make_shared<RingKeyGraphIndex>(
+            NUM_RINGS_,  /* dim */
+            state_.index_.data_.ring_key_,
+            GRAPH_INDEX_PARAMS_
+        );
+    } else {
+        state_.index_.kd_tree_ = std::make_shared<RingKeyDynamicIndex>(
             NUM_RINGS_,  /* dim */
             state_.index_.data_.ring_key_,
             10           /* max leaf size */
         );
+    }
 
-        return true;
+    state_.index_.data_.sector_key_spectrum_.clear();
+    UpdateSectorKeySpectra();
+}
+
+/**
+ * @brief  index the ring keys appended to the indexed ones since the last call
+ * @return void
+ */
+void ScanContextManager::ExtendIndex(void) {
+    if (USE_GRAPH_INDEX_) {
+        state_.index_.graph_->AddPoints();
+    } else {
+        state_.index_.kd_tree_->addPoints();
     }
 
-    return false;
+    UpdateSectorKeySpectra();
+}
+
+size_t ScanContextManager::GetMemoryUsage(void) const {
+    size_t memory_usage = (
+        state_.scan_context_.GetMemoryUsage() + 
+        lidar_localization::GetMemoryUsage(state_.ring_key_) + 
+        lidar_localization::GetMemoryUsage(state_.key_frame_) + 
+        lidar_localization::GetMemoryUsage(state_.index_.data_.ring_key_) + 
+        lidar_localization::GetMemoryUsage(state_.index_.data_.key_frame_) + 
+        lidar_localization::GetMemoryUsage(state_.index_.data_.sector_key_spectrum_)
+    );
+
+    if (state_.index_.graph_) {
+        memory_usage += state_.index_.graph_->GetMemoryUsage();
+    }
+    if (state_.index_.kd_tree_) {
+        // node pool & point indices of each sub-tree:
+        for (const auto &tree: state_.index_.kd_tree_->index->getAllIndices()) {
+            memory_usage += (
+                tree.pool.usedMemory + tree.pool.wastedMemory + 
+                tree.vind.capacity() * sizeof(size_t)
+            );
+        }
+    }
+
+    return memory_usage;
+}
+
+size_t ScanContextManager::GetIndexSize(void) const {
+    if (USE_GRAPH_INDEX_) {
+        return state_.index_.graph_->GetSize();
+    }
+
+    return state_.index_.kd_tree_->kdtree_get_point_count();
+}
+
+/**
+ * @brief  transform the sector keys of indexed key frames not transformed yet 
+ * @return void
+ */
+void ScanContextManager::UpdateSectorKeySpectra(void) {
+    const size_t K = NUM_SECTORS_ / 2 + 1;
+    std::vector<std::complex<float>> &spectra = state_.index_.data_.sector_key_spectrum_;
+
+    const size_t num_indexed = std::min(
+        state_.index_.data_.ring_key_.size(), state_.scan_context_.GetSize()
+    );
+    if (spectra.size() > num_indexed * K) {
+        spectra.resize(num_indexed * K);
+    }
+
+    std::vector<float> sector_key(NUM_SECTORS_);
+    std::vector<std::complex<float>> sector_key_spectrum;
+    std::vector<float> buffer;
+    for (size_t i = spectra.size() / K; i < num_indexed; ++i) {
+        // same as GetNormalizedScanContext, from the column-major scan context:
+        const float *scan_context = state_.scan_context_.GetData(i, 1, buffer);
+        for (int sid = 0; sid < NUM_SECTORS_; ++sid) {
+            sector_key.at(sid) = Eigen::Map<const Eigen::VectorXf>(scan_context + sid * NUM_RINGS_, NUM_RINGS_).mean();
+        }
+
+        GetSectorKeySpectrum(sector_key, sector_key_spectrum);
+        spectra.insert(spectra.end(), sector_key_spectrum.begin(), sector_key_spectrum.end());
+    }
 }
 
 /**
  * @brief  get loop closure match result for given scan context and ring key 
- * @param  query_scan_context, query scan context 
+ * @param  query_scan_context, query column-major scan context 
  * @param  query_ring_key, query ring key
  * @return loop closure match result as std::pair<int, float>
  */
 std::pair<int, float> ScanContextManager::GetLoopClosureMatch(
-    const ScanContext &query_scan_context,
+    const float *query_scan_context,
     const RingKey &query_ring_key
 ) {
-    int match_id = NONE;
+    std::vector<std::pair<int, float>> matches;
+    GetLoopClosureMatches(query_scan_context, query_ring_key, 1, CandidateFilter(), matches);
+
+    if (matches.empty()) {
+        std::pair<int, float> result {NONE, 0.0};
+        return result;
+    }
+
+    return matches.front();
+}
+
+/**
+ * @brief  get loop closure match results for given scan context and ring key 
+ * @param  query_scan_context, query column-major scan context 
+ * @param  query_ring_key, query ring key
+ * @param  N, max. num. of matches
+ * @param  is_candidate, candidate filter, all candidates are scored if empty
+ * @param  matches, matches below distance thresh, best first
+ * @return void
+ */
+void ScanContextManager::GetLoopClosureMatches(
+    const float *query_scan_context,
+    const RingKey &query_ring_key,
+    const int N,
+    const CandidateFilter &is_candidate,
+    std::vector<std::pair<int, float>> &matches
+) {
+    matches.clear();
 
     //
     // step 1: loop closure detection criteria check -- only perform loop closure detection when
@@ -666,67 +1905,163 @@ std::pair<int, float> ScanContextManager::GetLoopClosureMatch(
     if(
         state_.ring_key_.size() <= (static_cast<size_t>(MIN_KEY_FRAME_SEQ_DISTANCE_))
     ) {
-        std::pair<int, float> result {match_id, 0.0};
-        return result; 
+        return;
+    }
+
+    std::vector<Match> results;
+    GetMatches(query_scan_context, query_ring_key, NUM_CANDIDATES_, N, is_candidate, true, results);
+
+    for (const Match &result: results) {
+        float yaw_change_in_deg = result.shift * DEG_PER_SECTOR_;
+        float yaw_change_in_rad = yaw_change_in_deg / 180.0f * M_PI;
+
+        LOG(INFO) << std::endl
+                  << "[Scan Context] Loop-Closure Detected " 
+                  << state_.scan_context_.GetSize() - 1 << "<-->" << result.id << std::endl 
+                  << "\tDistance " << result.distance << std::endl 
+                  << "\tHeading Change " << yaw_change_in_deg << " deg." << std::endl
+                  << std::endl;
+
+        matches.emplace_back(result.id, yaw_change_in_rad);
     }
+}
+
+/**
+ * @brief  score the ring key nearest neighbors of the query by scan context distance
+ * @param  query_scan_context, query column-major scan context 
+ * @param  query_ring_key, query ring key
+ * @param  num_neighbors, num. of ring key nearest neighbors, of which the first NUM_CANDIDATES_ passing the filter are scored
+ * @param  N, max. num. of matches
+ * @param  is_candidate, candidate filter, all candidates are scored if empty
+ * @param  score_in_parallel, whether to score the candidates of the query in parallel
+ * @param  matches, matches below distance thresh, best first
+ * @return void
+ */
+void ScanContextManager::GetMatches(
+    const float *query_scan_context,
+    const RingKey &query_ring_key,
+    const int num_neighbors,
+    const int N,
+    const CandidateFilter &is_candidate,
+    const bool score_in_parallel,
+    std::vector<Match> &matches
+) {
+    matches.clear();
 
     //
     // step 2: perform kNN search
     // 
-    std::vector<size_t> candidate_indices(NUM_CANDIDATES_);
-	std::vector<float> candidate_distances(NUM_CANDIDATES_);
+    std::vector<size_t> candidate_indices(num_neighbors);
+	std::vector<float> candidate_distances(num_neighbors);
     GetCandidateIndices(
-        query_ring_key, NUM_CANDIDATES_,
+        query_ring_key, num_neighbors,
         candidate_indices, candidate_distances
     );
 
+    // drop filtered candidates before the more expensive scan context comparison:
+    if (is_candidate) {
+        size_t num_kept = 0;
+        for (size_t i = 0; i < candidate_indices.size(); ++i) {
+            if (is_candidate(static_cast<int>(candidate_indices.at(i)))) {
+                candidate_indices.at(num_kept) = candidate_indices.at(i);
+                candidate_distances.at(num_kept) = candidate_distances.at(i);
+                ++num_kept;
+            }
+        }
+        candidate_indices.resize(num_kept);
+        candidate_distances.resize(num_kept);
+    }
+    if (candidate_indices.size() > static_cast<size_t>(NUM_CANDIDATES_)) {
+        candidate_indices.resize(NUM_CANDIDATES_);
+        candidate_distances.resize(NUM_CANDIDATES_);
+    }
+
+    if (candidate_indices.empty()) {
+        return;
+    }
+
     // 
-    // step 3: find optimal match
+    // step 3: score candidates
     // 
-    int optimal_index = 0;
-    int optimal_shift = 0;
-    float optimal_dist = std::numeric_limits<float>::max();
-    for (int i = 0; i < NUM_CANDIDATES_; ++i)
+    NormalizedScanContext query;
+    GetNormalizedScanContext(query_scan_context, false, query);
+    const size_t K = NUM_SECTORS_ / 2 + 1;
+
+    // candidates are scored in parallel, then reduced in order:
+    const int num_candidates = static_cast<int>(candidate_indices.size());
+    std::vector<NormalizedScanContext> candidates(num_candidates);
+    std::vector<std::pair<int, float>> match_results(num_candidates);
+#pragma omp parallel for schedule(static) if(score_in_parallel && num_candidates > 1)
+    for (int i = 0; i < num_candidates; ++i)
     {   
-        const ScanContext &candidate_scan_context = state_.scan_context_.at(
-            candidate_indices.at(i)
+        NormalizedScanContext &candidate = candidates.at(i);
+        std::vector<float> buffer;
+        GetNormalizedScanContext(
+            state_.scan_context_.GetData(candidate_indices.at(i), 1, buffer), true, candidate
+        );
+        candidate.sector_key_spectrum.assign(
+            state_.index_.data_.sector_key_spectrum_.begin() + candidate_indices.at(i) * K,
+            state_.index_.data_.sector_key_spectrum_.begin() + (candidate_indices.at(i) + 1) * K
+        );
+
+        match_results.at(i) = GetScanContextMatch(candidate, query); 
+    }
+
+    //
+    // step 4: quantized, re-score the best N in float at their shift, for the threshold check:
+    //
+    std::vector<int> orders;
+    for (int i = 0; i < num_candidates; ++i) {
+        orders.push_back(i);
+    }
+    if (QUANTIZE_) {
+        std::stable_sort(
+            orders.begin(), orders.end(), 
+            [&match_results](const int a, const int b) {
+                return match_results.at(a).second < match_results.at(b).second;
+            }
         );
+        if (orders.size() > static_cast<size_t>(std::max(N, 0))) {
+            orders.resize(std::max(N, 0));
+        }
 
-        std::pair<int, float> match_result = GetScanContextMatch(
-            candidate_scan_context, query_scan_context
-        ); 
-        
-        int candidate_shift = match_result.first;
-        float candidate_dist = match_result.second;
-        
-        if(candidate_dist < optimal_dist)
-        {
-            optimal_dist = candidate_dist;
-            optimal_shift = candidate_shift;
-            optimal_index = candidate_indices.at(i);
+        for (const int i: orders) {
+            match_results.at(i).second = GetCosineDistance(
+                candidates.at(i), query, match_results.at(i).first
+            );
         }
     }
 
     // 
-    // step 4: loop closure threshold check:
+    // step 5: loop closure threshold check, keep the best N:
     //
-    float yaw_change_in_deg = optimal_shift * DEG_PER_SECTOR_;
-    float yaw_change_in_rad = yaw_change_in_deg / 180.0f * M_PI;
-    if(optimal_dist < SCAN_CONTEXT_DISTANCE_THRESH_)
-    {
-        match_id = optimal_index; 
-
-        LOG(INFO) << std::endl
-                  << "[Scan Context] Loop-Closure Detected " 
-                  << state_.scan_context_.size() - 1 << "<-->" << optimal_index << std::endl 
-                  << "\tDistance " << optimal_dist << std::endl 
-                  << "\tHeading Change " << yaw_change_in_deg << " deg." << std::endl
-                  << std::endl;
+    orders.erase(
+        std::remove_if(
+            orders.begin(), orders.end(),
+            [&match_results, this](const int i) {
+                return match_results.at(i).second >= SCAN_CONTEXT_DISTANCE_THRESH_;
+            }
+        ),
+        orders.end()
+    );
+    std::stable_sort(
+        orders.begin(), orders.end(), 
+        [&match_results](const int a, const int b) {
+            return match_results.at(a).second < match_results.at(b).second;
+        }
+    );
+    if (orders.size() > static_cast<size_t>(std::max(N, 0))) {
+        orders.resize(std::max(N, 0));
     }
 
-    std::pair<int, float> result{match_id, yaw_change_in_rad};
+    for (const int i: orders) {
+        Match match;
+        match.id = static_cast<int>(candidate_indices.at(i));
+        match.shift = match_results.at(i).first;
+        match.distance = match_results.at(i).second;
 
-    return result;
+        matches.push_back(match);
+    }
 }
 
 /**
@@ -739,7 +2074,13 @@ bool ScanContextManager::SaveIndex(const std::string &output_path) {
     if (!output_fptr) {
         return false;
     };
-    state_.index_.kd_tree_->index->saveIndex(output_fptr);
+    // the dynamic index cannot be serialized, so build a static one of the same ring keys:
+    RingKeyIndex kd_tree(
+        NUM_RINGS_,  /* dim */
+        state_.index_.data_.ring_key_,
+        10           /* max leaf size */
+    );
+    kd_tree.index->saveIndex(output_fptr);
     fclose(output_fptr);
 
     return true;
@@ -755,8 +2096,11 @@ bool ScanContextManager::SaveScanContexts(const std::string &output_path) {
 
     scan_contexts.set_num_rings(NUM_RINGS_);
     scan_contexts.set_num_sectors(NUM_SECTORS_);
-    for (size_t i = 0; i < state_.scan_context_.size(); ++i) {
-        const ScanContext &input_scan_context = state_.scan_context_.at(i);
+    std::vector<float> buffer;
+    for (size_t i = 0; i < state_.scan_context_.GetSize(); ++i) {
+        const ScanContextBuffer::ConstView input_scan_context(
+            state_.scan_context_.GetData(i, 1, buffer), NUM_RINGS_, NUM_SECTORS_
+        );
         scan_context_io::ScanContext *output_scan_context = scan_contexts.add_data();
 
         for (int rid = 0; rid < NUM_RINGS_; ++rid) {
@@ -849,6 +2193,309 @@ bool ScanContextManager::SaveKeyFrames(const std::string &output_path) {
     return true;
 }
 
+/**
+ * @brief  save sessions, one line of name & first key frame id per session
+ * @param  output_path, sessions output path
+ * @return true for success otherwise false
+ */
+bool ScanContextManager::SaveSessions(const std::string &output_path) {
+    // a single session leaves no file behind, also from a merged index saved before:
+    if (state_.session_.empty()) {
+        std::remove(output_path.c_str());
+        return true;
+    }
+
+    std::ofstream output(output_path);
+    if (!output) {
+        return false;
+    }
+
+    for (const auto &session: state_.session_) {
+        output << session.begin_ << " " << session.name_ << std::endl;
+    }
+
+    return static_cast<bool>(output);
+}
+
+/**
+ * @brief  load sessions
+ * @param  input_path, sessions input path
+ * @return true for success otherwise false
+ */
+bool ScanContextManager::LoadSessions(const std::string &input_path) {
+    state_.session_.clear();
+
+    std::ifstream input(input_path);
+    if (!input) {
+        return true;
+    }
+
+    std::string line;
+    while (std::getline(input, line)) {
+        if (line.empty())
+            continue;
+
+        // names may contain spaces:
+        const size_t separator = line.find(' ');
+        decltype(state_.session_)::value_type session;
+        try {
+            session.begin_ = std::stoul(line.substr(0, separator));
+        } catch (const std::exception &e) {
+            LOG(ERROR) << "Invalid session " << line << " in " << input_path << std::endl;
+            return false;
+        }
+        session.name_ = (separator == std::string::npos) ? "" : line.substr(separator + 1);
+
+        // sessions are listed in order, the first from key frame 0:
+        if (
+            (state_.session_.empty() && 0 != session.begin_) ||
+            (!state_.session_.empty() && session.begin_ <= state_.session_.back().begin_)
+        ) {
+            LOG(ERROR) << "Sessions out of order in " << input_path << std::endl;
+            return false;
+        }
+        state_.session_.push_back(session);
+    }
+
+    return true;
+}
+
+/**
+ * @brief  save scan contexts, ring keys, key frames & ring key index as flat index
+ * @param  output_path, flat index output path
+ * @return true for success otherwise false
+ */
+bool ScanContextManager::SaveFlatIndex(const std::string &output_path) {
+    const RingKeys &ring_keys = state_.index_.data_.ring_key_;
+    const std::vector<KeyFrame> &key_frames = state_.index_.data_.key_frame_;
+
+    const size_t num_scan_contexts = state_.scan_context_.GetSize();
+    const bool is_quantized = state_.scan_context_.IsQuantized();
+    const size_t scan_context_size = (is_quantized ? sizeof(int8_t) : sizeof(float)) * NUM_RINGS_ * NUM_SECTORS_;
+    const size_t scale_size = (is_quantized ? sizeof(float) : 0);
+    const size_t ring_key_size = sizeof(float) * NUM_RINGS_;
+    const size_t pose_size = sizeof(float) * 16;
+
+    // layout:
+    FlatIndexHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, FLAT_INDEX_MAGIC, sizeof(header.magic));
+    header.version = FLAT_INDEX_VERSION;
+    header.header_size = sizeof(header);
+    header.num_rings = NUM_RINGS_;
+    header.num_sectors = NUM_SECTORS_;
+    header.num_scan_contexts = num_scan_contexts;
+    header.scan_contexts_offset = AlignOffset(sizeof(header));
+    header.scan_context_type = (is_quantized ? FLAT_INDEX_INT8 : FLAT_INDEX_FLOAT);
+    header.ring_key_index_type = (USE_GRAPH_INDEX_ ? FLAT_INDEX_GRAPH : FLAT_INDEX_KD_TREE);
+    header.scan_context_scales_offset = AlignOffset(header.scan_contexts_offset + num_scan_contexts * scan_context_size);
+    header.num_ring_keys = ring_keys.size();
+    header.ring_keys_offset = AlignOffset(header.scan_context_scales_offset + num_scan_contexts * scale_size);
+    header.key_frames_offset = AlignOffset(header.ring_keys_offset + ring_keys.size() * ring_key_size);
+    header.kd_tree_offset = AlignOffset(header.key_frames_offset + key_frames.size() * pose_size);
+
+    FILE *output_fptr = fopen(output_path.c_str(), "wb");
+    if (!output_fptr) {
+        return false;
+    }
+
+    // a. scan contexts, already back to back:
+    bool success = true;
+    if (0 < num_scan_contexts && is_quantized) {
+        std::vector<float> scales(num_scan_contexts);
+        for (size_t i = 0; i < num_scan_contexts; ++i) {
+            scales.at(i) = state_.scan_context_.GetScale(i);
+        }
+
+        success = (
+            WriteAt(output_fptr, header.scan_contexts_offset, state_.scan_context_.GetCodes(0), num_scan_contexts * scan_context_size) &&
+            WriteAt(output_fptr, header.scan_context_scales_offset, scales.data(), num_scan_contexts * scale_size)
+        );
+    } else if (0 < num_scan_contexts) {
+        success = WriteAt(output_fptr, header.scan_contexts_offset, state_.scan_context_.GetData(0), num_scan_contexts * scan_context_size);
+    }
+    // b. ring keys:
+    for (size_t i = 0; success && i < ring_keys.size(); ++i) {
+        success = WriteAt(output_fptr, header.ring_keys_offset + i * ring_key_size, ring_keys.at(i).data(), ring_key_size);
+    }
+    // c. key frame poses:
+    for (size_t i = 0; success && i < key_frames.size(); ++i) {
+        success = WriteAt(output_fptr, header.key_frames_offset + i * pose_size, key_frames.at(i).pose.data(), pose_size);
+    }
+    // d. ring key index:
+    if (success && 0 == fseek(output_fptr, static_cast<long>(header.kd_tree_offset), SEEK_SET)) {
+        if (USE_GRAPH_INDEX_) {
+            success = state_.index_.graph_->Save(output_fptr);
+        } else {
+            state_.index_.kd_tree_->index->saveIndex(output_fptr);
+        }
+        header.file_size = ftell(output_fptr);
+        header.kd_tree_size = header.file_size - header.kd_tree_offset;
+    } else {
+        success = false;
+    }
+    // finally the header, once all sizes are known:
+    success = success && WriteAt(output_fptr, 0, &header, sizeof(header)) && !ferror(output_fptr);
+
+    return (0 == fclose(output_fptr)) && success;
+}
+
+/**
+ * @brief  load flat index
+ * @param  input_path, flat index input path
+ * @return true for success otherwise false
+ */
+bool ScanContextManager::LoadFlatIndex(const std::string &input_path) {
+    MappedFile input(input_path);
+    if (!input.GetData() || input.GetSize() < FLAT_INDEX_V1_HEADER_SIZE) {
+        return false;
+    }
+
+    // fields of version 2 are zero, i.e. float scan contexts, for version 1:
+    FlatIndexHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(&header, input.GetData(), std::min<size_t>(input.GetSize(), sizeof(header)));
+
+    if (
+        0 != std::memcmp(header.magic, FLAT_INDEX_MAGIC, sizeof(header.magic)) ||
+        !(
+            (1 == header.version && FLAT_INDEX_V1_HEADER_SIZE == header.header_size) ||
+            (FLAT_INDEX_VERSION == header.version && sizeof(header) == header.header_size)
+        ) ||
+        input.GetSize() < header.header_size ||
+        (FLAT_INDEX_FLOAT != header.scan_context_type && FLAT_INDEX_INT8 != header.scan_context_type) ||
+        (FLAT_INDEX_KD_TREE != header.ring_key_index_type && FLAT_INDEX_GRAPH != header.ring_key_index_type)
+    ) {
+        LOG(ERROR) << "Flat index " << input_path << " is not of version " << FLAT_INDEX_VERSION << std::endl;
+        return false;
+    }
+
+    // queries are extracted with the configured resolution:
+    if (
+        static_cast<uint32_t>(NUM_RINGS_) != header.num_rings || 
+        static_cast<uint32_t>(NUM_SECTORS_) != header.num_sectors
+    ) {
+        LOG(ERROR) << "Scan contexts in " << input_path << " are " 
+                   << header.num_rings << "x" << header.num_sectors 
+                   << ", expected " << NUM_RINGS_ << "x" << NUM_SECTORS_ << std::endl;
+        return false;
+    }
+
+    // sections must lie within the file, in order:
+    const bool is_quantized = (FLAT_INDEX_INT8 == header.scan_context_type);
+    if (!is_quantized) {
+        header.scan_context_scales_offset = header.ring_keys_offset;
+    }
+    const uint64_t scan_context_size = (is_quantized ? sizeof(int8_t) : sizeof(float)) * NUM_RINGS_ * NUM_SECTORS_;
+    const uint64_t scale_size = (is_quantized ? sizeof(float) : 0);
+    const uint64_t ring_key_size = sizeof(float) * NUM_RINGS_;
+    const uint64_t pose_size = sizeof(float) * 16;
+    const uint64_t file_size = input.GetSize();
+    if (
+        header.file_size != file_size ||
+        header.num_scan_contexts > file_size / scan_context_size ||
+        header.num_ring_keys > file_size / ring_key_size ||
+        header.scan_contexts_offset < header.header_size ||
+        header.scan_contexts_offset + header.num_scan_contexts * scan_context_size > header.scan_context_scales_offset ||
+        header.scan_context_scales_offset + header.num_scan_contexts * scale_size > header.ring_keys_offset ||
+        header.ring_keys_offset + header.num_ring_keys * ring_key_size > header.key_frames_offset ||
+        header.key_frames_offset + header.num_ring_keys * pose_size > header.kd_tree_offset ||
+        header.kd_tree_offset + header.kd_tree_size > file_size
+    ) {
+        LOG(ERROR) << "Flat index " << input_path << " is truncated or corrupted." << std::endl;
+        return false;
+    }
+
+    // a. scan contexts, in one copy if stored as configured:
+    state_.scan_context_.Reset(NUM_RINGS_, NUM_SECTORS_, QUANTIZE_);
+    if (is_quantized) {
+        const int8_t *input_codes = reinterpret_cast<const int8_t *>(input.GetData() + header.scan_contexts_offset);
+        const float *input_scales = reinterpret_cast<const float *>(input.GetData() + header.scan_context_scales_offset);
+        if (QUANTIZE_) {
+            state_.scan_context_.Assign(input_codes, input_scales, header.num_scan_contexts);
+        } else {
+            ScanContextBuffer input_scan_contexts;
+            input_scan_contexts.Reset(NUM_RINGS_, NUM_SECTORS_, true);
+            input_scan_contexts.Assign(input_codes, input_scales, header.num_scan_contexts);
+
+            std::vector<float> buffer;
+            state_.scan_context_.Assign(
+                input_scan_contexts.GetData(0, header.num_scan_contexts, buffer), header.num_scan_contexts
+            );
+        }
+    } else {
+        state_.scan_context_.Assign(
+            reinterpret_cast<const float *>(input.GetData() + header.scan_contexts_offset), 
+            header.num_scan_contexts
+        );
+    }
+
+    // b. ring keys:
+    const float *input_ring_keys = reinterpret_cast<const float *>(input.GetData() + header.ring_keys_offset);
+    state_.index_.data_.ring_key_.resize(header.num_ring_keys);
+    for (size_t i = 0; i < header.num_ring_keys; ++i) {
+        state_.index_.data_.ring_key_.at(i).assign(
+            input_ring_keys + i * NUM_RINGS_, input_ring_keys + (i + 1) * NUM_RINGS_
+        );
+    }
+    state_.ring_key_ = state_.index_.data_.ring_key_;
+
+    // c. key frames:
+    const float *input_poses = reinterpret_cast<const float *>(input.GetData() + header.key_frames_offset);
+    state_.index_.data_.key_frame_.clear();
+    state_.index_.data_.key_frame_.resize(header.num_ring_keys);
+    for (size_t i = 0; i < header.num_ring_keys; ++i) {
+        KeyFrame &output_key_frame = state_.index_.data_.key_frame_.at(i);
+
+        output_key_frame.index = i;
+        output_key_frame.pose = Eigen::Map<const Eigen::Matrix4f>(input_poses + 16 * i);
+    }
+
+    // d. ring key index, rebuilt if it is not of the configured type:
+    if ((FLAT_INDEX_GRAPH == header.ring_key_index_type) != USE_GRAPH_INDEX_) {
+        LOG(WARNING) << "Ring key index in " << input_path << " is not a " 
+                     << (USE_GRAPH_INDEX_ ? "graph" : "kd-tree") << ", rebuild it." << std::endl;
+        ResetIndex();
+        return true;
+    }
+
+    // read in place from the mapping:
+    FILE *kd_tree_fptr = fmemopen(
+        const_cast<char *>(input.GetData() + header.kd_tree_offset), header.kd_tree_size, "rb"
+    );
+    if (!kd_tree_fptr) {
+        return false;
+    }
+    try {
+        if (USE_GRAPH_INDEX_) {
+            state_.index_.graph_ = std::make_shared<RingKeyGraphIndex>(
+                NUM_RINGS_,  /* dim */
+                state_.index_.data_.ring_key_,
+                GRAPH_INDEX_PARAMS_,
+                kd_tree_fptr
+            );
+        } else {
+            state_.index_.kd_tree_ = std::make_shared<RingKeyDynamicIndex>(
+                NUM_RINGS_,  /* dim */
+                state_.index_.data_.ring_key_,
+                kd_tree_fptr,
+                10           /* max leaf size */
+            );
+        }
+    } catch (const std::exception &e) {
+        LOG(ERROR) << "Failed to load ring key index from " << input_path << ": " << e.what() << std::endl;
+        fclose(kd_tree_fptr);
+        return false;
+    }
+    fclose(kd_tree_fptr);
+
+    // e. sector key spectra:
+    state_.index_.data_.sector_key_spectrum_.clear();
+    UpdateSectorKeySpectra();
+
+    return true;
+}
+
 /**
  * @brief  load scan contexts
  * @param  input_path, scan contexts input path
@@ -865,13 +2512,22 @@ bool ScanContextManager::LoadScanContexts(const std::string &input_path) {
         return false;
     }
 
-    state_.scan_context_.clear();
-    state_.scan_context_.resize(scan_contexts.data_size());
+    // queries are extracted with the configured resolution:
+    if (
+        NUM_RINGS_ != scan_contexts.num_rings() || 
+        NUM_SECTORS_ != scan_contexts.num_sectors()
+    ) {
+        LOG(ERROR) << "Scan contexts in " << input_path << " are " 
+                   << scan_contexts.num_rings() << "x" << scan_contexts.num_sectors() 
+                   << ", expected " << NUM_RINGS_ << "x" << NUM_SECTORS_ << std::endl;
+        return false;
+    }
+
+    state_.scan_context_.Reset(NUM_RINGS_, NUM_SECTORS_, QUANTIZE_);
+    std::vector<float> buffer(NUM_RINGS_ * NUM_SECTORS_);
     for (int i = 0; i < scan_contexts.data_size(); ++i) {
         const scan_context_io::ScanContext &input_scan_context = scan_contexts.data(i);
-        ScanContext output_scan_context = ScanContext::Zero(
-            scan_contexts.num_rings(), scan_contexts.num_sectors()
-        );
+        ScanContextBuffer::View output_scan_context(buffer.data(), NUM_RINGS_, NUM_SECTORS_);
 
         for (int rid = 0; rid < scan_contexts.num_rings(); ++rid) {
             for (int sid = 0; sid < scan_contexts.num_sectors(); ++sid) {
@@ -880,8 +2536,7 @@ bool ScanContextManager::LoadScanContexts(const std::string &input_path) {
                 output_scan_context(rid, sid) = input_scan_context.data(did);
             }
         }
-
-        state_.scan_context_.at(i) = output_scan_context;
+        state_.scan_context_.Add(buffer.data());
     }
 
     return true;
@@ -0,0 +1,260 @@
+/*
+ * @Description: offline map pruning, removal of transient points by ray casting, density equalization
+ *               and ground decimation, before the map is split into tiles
+ * @Author: Ge Yao
+ * @Date: 2021-01-27 19:36:08
+ */
+#include "lidar_localization/models/tiled_map/map_pruner.hpp"
+
+#include <cmath>
+#include <limits>
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+namespace {
+// voxel indices are packed into 21 bits each:
+const int VOXEL_INDEX_BITS = 21;
+const int VOXEL_INDEX_OFFSET = 1 << (VOXEL_INDEX_BITS - 1);
+const uint64_t VOXEL_INDEX_MASK = (1ull << VOXEL_INDEX_BITS) - 1;
+
+bool IsFinite(const CloudData::POINT& point) {
+    return std::isfinite(point.x) && std::isfinite(point.y) && std::isfinite(point.z);
+}
+}
+
+MapPruner::MapPruner(const YAML::Node& node) {
+    leaf_size_ = node["leaf_size"].as<float>();
+    inverse_leaf_size_ = 1.0f / leaf_size_;
+    max_range_ = node["max_range"].as<float>();
+    hit_margin_ = node["hit_margin"].as<float>();
+    min_free_scans_ = node["min_free_scans"].as<int>();
+    free_ratio_ = node["free_ratio"].as<float>();
+    ground_z_ = node["ground_z"].as<float>();
+    max_points_per_voxel_ = node["max_points_per_voxel"].as<int>();
+    max_ground_points_per_voxel_ = node["max_ground_points_per_voxel"].as<int>();
+
+    std::cout << "Map Pruner params:" << std::endl
+              << "leaf size: " << leaf_size_ << ", "
+              << "max range: " << max_range_ << ", "
+              << "hit margin: " << hit_margin_ << std::endl
+              << "transient: free in at least " << min_free_scans_ << " key scans, "
+              << free_ratio_ << " times as often as occupied" << std::endl
+              << "ground z: " << ground_z_ << ", "
+              << "max points per voxel: " << max_points_per_voxel_ << ", "
+              << "ground: " << max_ground_points_per_voxel_
+              << std::endl << std::endl;
+}
+
+bool MapPruner::Prune(const std::deque<KeyFrame>& key_frames, const ScanLoader& load_scan, CloudData::CLOUD& map) {
+    stats_ = Stats();
+    voxels_.clear();
+    map.points.clear();
+
+    if (key_frames.empty() || leaf_size_ <= 0.0f) {
+        LOG(ERROR) << "Invalid map pruning input, " << key_frames.size() << " key frames, leaf size " << leaf_size_;
+        return false;
+    }
+
+    // a. occupied voxels:
+    for (size_t i = 0; i < key_frames.size(); ++i) {
+        CloudData::CLOUD::ConstPtr scan_ptr;
+        if (!load_scan(key_frames.at(i).index, scan_ptr)) {
+            LOG(WARNING) << "Key scan " << key_frames.at(i).index << " is not available, skipped in map.";
+            continue;
+        }
+
+        AddHits(*scan_ptr, key_frames.at(i).pose, static_cast<uint32_t>(i + 1));
+        ++stats_.num_key_frames;
+    }
+
+    // b. free space, only voxels occupied in some key scan are tracked:
+    for (size_t i = 0; i < key_frames.size(); ++i) {
+        CloudData::CLOUD::ConstPtr scan_ptr;
+        if (!load_scan(key_frames.at(i).index, scan_ptr))
+            continue;
+
+        AddFreeSpace(*scan_ptr, key_frames.at(i).pose, static_cast<uint32_t>(i + 1));
+    }
+
+    stats_.num_voxels = voxels_.size();
+    for (const auto& voxel: voxels_) {
+        if (IsGround(voxel.second)) {
+            ++stats_.num_ground_voxels;
+        } else if (IsTransient(voxel.second)) {
+            ++stats_.num_transient_voxels;
+        }
+    }
+
+    // c. the points of the voxels kept, up to the caps:
+    for (size_t i = 0; i < key_frames.size(); ++i) {
+        CloudData::CLOUD::ConstPtr scan_ptr;
+        if (!load_scan(key_frames.at(i).index, scan_ptr))
+            continue;
+
+        AddPoints(*scan_ptr, key_frames.at(i).pose, map);
+    }
+    map.width = static_cast<uint32_t>(map.points.size());
+    map.height = 1;
+    stats_.num_output_points = map.points.size();
+
+    LOG(INFO) << "Pruned map of " << stats_.num_key_frames << " key frames, "
+              << stats_.num_voxels << " voxels, "
+              << stats_.num_transient_voxels << " transient, "
+              << stats_.num_ground_voxels << " ground. "
+              << stats_.num_input_points << " points in, "
+              << stats_.num_transient_points << " transient, "
+              << stats_.num_density_points << " over density cap, "
+              << stats_.num_ground_points << " over ground cap, "
+              << stats_.num_output_points << " out.";
+
+    return true;
+}
+
+bool MapPruner::GetVoxelIndex(const Eigen::Vector3f& position, Eigen::Vector3i& index) const {
+    for (int i = 0; i < 3; ++i) {
+        const float voxel_index = std::floor(position(i) * inverse_leaf_size_);
+        if (!(voxel_index >= -VOXEL_INDEX_OFFSET && voxel_index < VOXEL_INDEX_OFFSET))
+            return false;
+
+        index(i) = static_cast<int>(voxel_index);
+    }
+
+    return true;
+}
+
+uint64_t MapPruner::GetVoxelKey(const Eigen::Vector3i& index) {
+    return ((static_cast<uint64_t>(index(0) + VOXEL_INDEX_OFFSET) & VOXEL_INDEX_MASK) << (2 * VOXEL_INDEX_BITS)) |
+           ((static_cast<uint64_t>(index(1) + VOXEL_INDEX_OFFSET) & VOXEL_INDEX_MASK) << VOXEL_INDEX_BITS) |
+           (static_cast<uint64_t>(index(2) + VOXEL_INDEX_OFFSET) & VOXEL_INDEX_MASK);
+}
+
+void MapPruner::AddHits(const CloudData::CLOUD& scan, const Eigen::Matrix4f& pose, uint32_t scan_id) {
+    const Eigen::Matrix3f rotation = pose.block<3, 3>(0, 0);
+    const Eigen::Vector3f translation = pose.block<3, 1>(0, 3);
+
+    Eigen::Vector3i index;
+    for (const CloudData::POINT& point: scan.points) {
+        if (!IsFinite(point) || !GetVoxelIndex(rotation * point.getVector3fMap() + translation, index))
+            continue;
+
+        Voxel& voxel = voxels_[GetVoxelKey(index)];
+        ++voxel.num_points;
+        if (point.z < ground_z_) {
+            ++voxel.num_ground_points;
+        }
+        if (voxel.last_hit_scan != scan_id) {
+            voxel.last_hit_scan = scan_id;
+            ++voxel.num_hit_scans;
+        }
+    }
+}
+
+void MapPruner::AddFreeSpace(const CloudData::CLOUD& scan, const Eigen::Matrix4f& pose, uint32_t scan_id) {
+    const Eigen::Matrix3f rotation = pose.block<3, 3>(0, 0);
+    const Eigen::Vector3f translation = pose.block<3, 1>(0, 3);
+
+    const float max_range_squared = max_range_ * max_range_;
+    for (const CloudData::POINT& point: scan.points) {
+        if (!IsFinite(point) || point.getVector3fMap().squaredNorm() > max_range_squared)
+            continue;
+
+        CastRay(translation, rotation * point.getVector3fMap() + translation, scan_id);
+    }
+}
+
+void MapPruner::CastRay(const Eigen::Vector3f& origin, const Eigen::Vector3f& end, uint32_t scan_id) {
+    Eigen::Vector3f direction = end - origin;
+    const float length = direction.norm();
+    // the surface is not carved by its own points:
+    const float free_length = length - hit_margin_;
+    if (free_length <= 0.0f)
+        return;
+    direction /= length;
+
+    Eigen::Vector3i index;
+    if (!GetVoxelIndex(origin, index))
+        return;
+
+    // ray parameter at the next voxel boundary along each axis, and between two boundaries:
+    Eigen::Vector3i step;
+    Eigen::Vector3f t_max, t_delta;
+    for (int i = 0; i < 3; ++i) {
+        if (direction(i) > 0.0f) {
+            step(i) = 1;
+            t_max(i) = ((index(i) + 1) * leaf_size_ - origin(i)) / direction(i);
+            t_delta(i) = leaf_size_ / direction(i);
+        } else if (direction(i) < 0.0f) {
+            step(i) = -1;
+            t_max(i) = (index(i) * leaf_size_ - origin(i)) / direction(i);
+            t_delta(i) = -leaf_size_ / direction(i);
+        } else {
+            step(i) = 0;
+            t_max(i) = t_delta(i) = std::numeric_limits<float>::infinity();
+        }
+    }
+
+    // the current voxel is entered at t:
+    float t = 0.0f;
+    while (t < free_length) {
+        auto it = voxels_.find(GetVoxelKey(index));
+        // a voxel occupied in this key scan is not free in it:
+        if (it != voxels_.end() && it->second.last_hit_scan != scan_id && it->second.last_free_scan != scan_id) {
+            it->second.last_free_scan = scan_id;
+            ++it->second.num_free_scans;
+        }
+
+        int axis = 0;
+        t = t_max.minCoeff(&axis);
+        index(axis) += step(axis);
+        t_max(axis) += t_delta(axis);
+    }
+}
+
+void MapPruner::AddPoints(const CloudData::CLOUD& scan, const Eigen::Matrix4f& pose, CloudData::CLOUD& map) {
+    const Eigen::Matrix3f rotation = pose.block<3, 3>(0, 0);
+    const Eigen::Vector3f translation = pose.block<3, 1>(0, 3);
+
+    Eigen::Vector3i index;
+    for (const CloudData::POINT& point: scan.points) {
+        ++stats_.num_input_points;
+
+        if (!IsFinite(point))
+            continue;
+        const Eigen::Vector3f position = rotation * point.getVector3fMap() + translation;
+        if (!GetVoxelIndex(position, index))
+            continue;
+
+        auto it = voxels_.find(GetVoxelKey(index));
+        if (it == voxels_.end())
+            continue;
+        Voxel& voxel = it->second;
+
+        const bool is_ground = IsGround(voxel);
+        if (!is_ground && IsTransient(voxel)) {
+            ++stats_.num_transient_points;
+            continue;
+        }
+
+        // points are kept in key frame order, i.e. the first key scans to see the voxel:
+        const int max_points = is_ground ? max_ground_points_per_voxel_ : max_points_per_voxel_;
+        if (max_points > 0 && static_cast<int>(voxel.num_kept) >= max_points) {
+            ++(is_ground ? stats_.num_ground_points : stats_.num_density_points);
+            continue;
+        }
+        ++voxel.num_kept;
+
+        map.points.push_back(point);
+        map.points.back().getVector3fMap() = position;
+    }
+}
+
+bool MapPruner::IsTransient(const Voxel& voxel) const {
+    return (
+        static_cast<int>(voxel.num_free_scans) >= min_free_scans_ &&
+        voxel.num_free_scans > free_ratio_ * voxel.num_hit_scans
+    );
+}
+
+} // namespace lidar_localization
@@ -0,0 +1,394 @@
+/*
+ * @Description: out-of-core global map builder, key scans are voxel-accumulated into x-y tiles flushed to disk
+ * @Author: Ge Yao
+ * @Date: 2020-12-28 14:06:31
+ */
+#include "lidar_localization/models/tiled_map/streaming_map_builder.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include <pcl/common/io.h>
+#include <pcl/common/transforms.h>
+#include <pcl/conversions.h>
+#include <pcl/io/pcd_io.h>
+
+#include "glog/logging.h"
+
+#include "lidar_localization/tools/file_manager.hpp"
+#include "lidar_localization/models/tiled_map/tiled_map.hpp"
+
+namespace lidar_localization {
+
+namespace {
+// voxel indices are packed into 21 bits each:
+const int VOXEL_INDEX_BITS = 21;
+const int64_t VOXEL_INDEX_OFFSET = 1 << (VOXEL_INDEX_BITS - 1);
+// hash node & bucket of std::unordered_map:
+const size_t VOXEL_OVERHEAD_IN_BYTES = 3 * sizeof(void*);
+
+// fields of CloudData::POINT as packed by pcl::PCDWriter::writeBinary, i.e. without padding:
+void GetPCDFields(std::vector<pcl::PCLPointField>& fields, std::vector<size_t>& field_sizes) {
+    pcl::PCLPointCloud2 cloud_msg;
+    pcl::toPCLPointCloud2(CloudData::CLOUD(), cloud_msg);
+
+    fields.clear();
+    field_sizes.clear();
+    for (const pcl::PCLPointField& field: cloud_msg.fields) {
+        if (field.name == "_")
+            continue;
+
+        fields.push_back(field);
+        field_sizes.push_back(field.count * pcl::getFieldSize(field.datatype));
+    }
+}
+
+bool AppendPCDBinary(const CloudData::CLOUD& cloud, std::ofstream& ofs) {
+    std::vector<pcl::PCLPointField> fields;
+    std::vector<size_t> field_sizes;
+    GetPCDFields(fields, field_sizes);
+
+    size_t point_size = 0;
+    for (size_t field_size: field_sizes) {
+        point_size += field_size;
+    }
+
+    std::vector<char> data(cloud.points.size() * point_size);
+    char *out = data.data();
+    for (const CloudData::POINT& point: cloud.points) {
+        for (size_t i = 0; i < fields.size(); ++i) {
+            std::memcpy(out, reinterpret_cast<const char*>(&point) + fields[i].offset, field_sizes[i]);
+            out += field_sizes[i];
+        }
+    }
+
+    ofs.write(data.data(), data.size());
+    return static_cast<bool>(ofs);
+}
+}
+
+StreamingMapBuilder::StreamingMapBuilder(const YAML::Node& node) {
+    tile_size_ = node["tile_size"].as<float>();
+    leaf_size_ << node["leaf_size"][0].as<float>(), node["leaf_size"][1].as<float>(), node["leaf_size"][2].as<float>();
+    inverse_leaf_size_ = leaf_size_.cwiseInverse();
+    max_range_ = node["max_range"].as<float>();
+    max_size_in_bytes_ = node["tile_cache_size"].as<size_t>() << 20;
+
+    std::cout << "Streaming Map Builder params:" << std::endl
+              << "tile size: " << tile_size_ << ", "
+              << "leaf size: " << leaf_size_.transpose() << ", "
+              << "max range: " << max_range_ << ", "
+              << "tile cache size in MB: " << (max_size_in_bytes_ >> 20)
+              << std::endl << std::endl;
+}
+
+bool StreamingMapBuilder::Build(
+    const std::deque<KeyFrame>& key_frames, const ScanLoader& load_scan,
+    const std::string& tiles_path, const std::string& map_file_path
+) {
+    stats_ = Stats();
+    tiles_.clear();
+    num_voxels_ = 0;
+    flushed_tiles_.clear();
+
+    if (key_frames.empty() || tile_size_ <= 0.0f || leaf_size_.minCoeff() <= 0.0f) {
+        LOG(ERROR) << "Invalid streaming map input, " << key_frames.size() << " key frames, tile size " << tile_size_;
+        return false;
+    }
+
+    if (!FileManager::InitDirectory(tiles_path, "Streaming Map Tiles"))
+        return false;
+    tiles_path_ = tiles_path;
+
+    // sweep along the longer side of the trajectory, so that few tiles are in reach at a time:
+    Eigen::Vector2f min_position = key_frames.front().pose.block<2, 1>(0, 3);
+    Eigen::Vector2f max_position = min_position;
+    for (const KeyFrame& key_frame: key_frames) {
+        min_position = min_position.cwiseMin(key_frame.pose.block<2, 1>(0, 3));
+        max_position = max_position.cwiseMax(key_frame.pose.block<2, 1>(0, 3));
+    }
+    sweep_axis_ = (max_position.x() - min_position.x() >= max_position.y() - min_position.y()) ? 0 : 1;
+
+    std::vector<const KeyFrame*> sorted_key_frames;
+    for (const KeyFrame& key_frame: key_frames) {
+        sorted_key_frames.push_back(&key_frame);
+    }
+    std::stable_sort(
+        sorted_key_frames.begin(), sorted_key_frames.end(),
+        [this](const KeyFrame* a, const KeyFrame* b) { return a->pose(sweep_axis_, 3) < b->pose(sweep_axis_, 3); }
+    );
+
+    // a. accumulate key scans, tiles out of reach are flushed as the sweep goes:
+    CloudData::CLOUD transformed_scan;
+    for (const KeyFrame* key_frame: sorted_key_frames) {
+        CloudData::CLOUD::ConstPtr scan_ptr;
+        if (!load_scan(key_frame->index, scan_ptr)) {
+            LOG(WARNING) << "Key scan " << key_frame->index << " is not available, skipped in map.";
+            continue;
+        }
+
+        pcl::transformPointCloud(*scan_ptr, transformed_scan, key_frame->pose);
+        AddScan(transformed_scan);
+        ++stats_.num_key_frames;
+        stats_.max_size_in_bytes = std::max(stats_.max_size_in_bytes, GetSizeInBytes());
+
+        if (!FlushTiles(key_frame->pose(sweep_axis_, 3)))
+            return false;
+    }
+
+    while (!tiles_.empty()) {
+        if (!FlushTile(tiles_.begin()->first))
+            return false;
+    }
+
+    // b. merge partial files, one tile in memory at a time:
+    const std::string body_file_path = map_file_path + ".body";
+    std::ofstream body_ofs(body_file_path, std::ios::binary | std::ios::trunc);
+    if (!body_ofs) {
+        LOG(ERROR) << "Failed to create " << body_file_path;
+        return false;
+    }
+
+    std::map<int64_t, size_t> tile_sizes;
+    for (int64_t tile_key: flushed_tiles_) {
+        size_t num_points = 0;
+        if (!FinishTile(tile_key, body_ofs, num_points))
+            return false;
+
+        tile_sizes[tile_key] = num_points;
+        stats_.num_points += num_points;
+    }
+    body_ofs.close();
+    stats_.num_tiles = tile_sizes.size();
+
+    if (
+        !TiledMap::SaveIndex(tiles_path_, tile_size_, tile_sizes) ||
+        !WriteMergedMap(map_file_path, body_file_path, stats_.num_points)
+    ) {
+        return false;
+    }
+
+    LOG(INFO) << "Streamed map of " << stats_.num_key_frames << " key frames, "
+              << stats_.num_tiles << " tiles, " << stats_.num_points << " points, "
+              << stats_.num_flushed << " tile flushes, peak tile cache "
+              << (stats_.max_size_in_bytes >> 20) << " MB.";
+
+    return true;
+}
+
+bool StreamingMapBuilder::GetVoxelKey(const CloudData::POINT& point, uint64_t& voxel_key, int64_t& tile_key) const {
+    if (!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z))
+        return false;
+
+    int64_t index[3];
+    const float* position = &point.x;
+    for (int i = 0; i < 3; ++i) {
+        index[i] = static_cast<int64_t>(std::floor(position[i] * inverse_leaf_size_(i))) + VOXEL_INDEX_OFFSET;
+        if (index[i] < 0 || index[i] >= 2 * VOXEL_INDEX_OFFSET)
+            return false;
+    }
+    voxel_key = (static_cast<uint64_t>(index[0]) << (2 * VOXEL_INDEX_BITS)) |
+                (static_cast<uint64_t>(index[1]) << VOXEL_INDEX_BITS) |
+                static_cast<uint64_t>(index[2]);
+
+    // by the voxel corner, so that a voxel never spans two tiles:
+    int ix = static_cast<int>(std::floor((index[0] - VOXEL_INDEX_OFFSET) * leaf_size_.x() / tile_size_));
+    int iy = static_cast<int>(std::floor((index[1] - VOXEL_INDEX_OFFSET) * leaf_size_.y() / tile_size_));
+    tile_key = TiledMap::GetTileKey(ix, iy);
+
+    return true;
+}
+
+void StreamingMapBuilder::AddScan(const CloudData::CLOUD& scan) {
+    // consecutive points mostly fall into the same tile:
+    int64_t last_tile_key = 0;
+    Tile* last_tile = nullptr;
+
+    for (const CloudData::POINT& point: scan.points) {
+        uint64_t voxel_key;
+        int64_t tile_key;
+        if (!GetVoxelKey(point, voxel_key, tile_key))
+            continue;
+
+        if (last_tile == nullptr || tile_key != last_tile_key) {
+            auto result = tiles_.emplace(tile_key, Tile());
+            if (result.second) {
+                const int tile_index = (sweep_axis_ == 0) ? static_cast<int>(tile_key >> 32) : static_cast<int32_t>(tile_key & 0xffffffff);
+                result.first->second.sweep_end = (tile_index + 1) * tile_size_;
+            }
+            last_tile_key = tile_key;
+            last_tile = &result.first->second;
+        }
+
+        auto result = last_tile->voxels.emplace(voxel_key, Voxel());
+        Voxel& voxel = result.first->second;
+        if (result.second) {
+            voxel.first_point = point;
+            voxel.sum[0] = voxel.sum[1] = voxel.sum[2] = 0.0;
+            voxel.num_points = 0;
+            ++num_voxels_;
+        }
+        voxel.sum[0] += point.x;
+        voxel.sum[1] += point.y;
+        voxel.sum[2] += point.z;
+        ++voxel.num_points;
+    }
+}
+
+bool StreamingMapBuilder::FlushTile(int64_t tile_key) {
+    auto it = tiles_.find(tile_key);
+    if (it == tiles_.end())
+        return true;
+
+    const std::string partial_file_path = GetPartialFilePath(tile_key);
+    std::ofstream ofs(partial_file_path, std::ios::binary | std::ios::app);
+
+    VoxelRecord record;
+    for (const auto& voxel: it->second.voxels) {
+        record.voxel_key = voxel.first;
+        record.voxel = voxel.second;
+        ofs.write(reinterpret_cast<const char*>(&record), sizeof(VoxelRecord));
+    }
+
+    if (!ofs) {
+        LOG(ERROR) << "Failed to flush map tile to " << partial_file_path;
+        return false;
+    }
+
+    num_voxels_ -= it->second.voxels.size();
+    tiles_.erase(it);
+    flushed_tiles_.insert(tile_key);
+    ++stats_.num_flushed;
+
+    return true;
+}
+
+bool StreamingMapBuilder::FlushTiles(float sweep_position) {
+    // the remaining key frames are at or beyond sweep position, so they no longer reach these tiles:
+    std::vector<int64_t> finished_tile_keys;
+    for (const auto& tile: tiles_) {
+        if (tile.second.sweep_end < sweep_position - max_range_)
+            finished_tile_keys.push_back(tile.first);
+    }
+    for (int64_t tile_key: finished_tile_keys) {
+        if (!FlushTile(tile_key))
+            return false;
+    }
+
+    // over cache size, the farthest behind goes first. it is merged again with what comes later:
+    while (!tiles_.empty() && GetSizeInBytes() > max_size_in_bytes_) {
+        auto farthest_it = std::min_element(
+            tiles_.begin(), tiles_.end(),
+            [](const std::pair<const int64_t, Tile>& a, const std::pair<const int64_t, Tile>& b) {
+                return a.second.sweep_end < b.second.sweep_end;
+            }
+        );
+        if (!FlushTile(farthest_it->first))
+            return false;
+    }
+
+    return true;
+}
+
+bool StreamingMapBuilder::FinishTile(int64_t tile_key, std::ofstream& body_ofs, size_t& num_points) {
+    const std::string partial_file_path = GetPartialFilePath(tile_key);
+
+    VoxelMap voxels;
+    {
+        std::ifstream ifs(partial_file_path, std::ios::binary);
+        if (!ifs) {
+            LOG(ERROR) << "Failed to open map tile " << partial_file_path;
+            return false;
+        }
+
+        VoxelRecord record;
+        while (ifs.read(reinterpret_cast<char*>(&record), sizeof(VoxelRecord))) {
+            auto result = voxels.emplace(record.voxel_key, record.voxel);
+            if (!result.second) {
+                Voxel& voxel = result.first->second;
+                voxel.sum[0] += record.voxel.sum[0];
+                voxel.sum[1] += record.voxel.sum[1];
+                voxel.sum[2] += record.voxel.sum[2];
+                voxel.num_points += record.voxel.num_points;
+            }
+        }
+    }
+
+    // in voxel key order, so that the output does not depend on the flush order:
+    std::vector<uint64_t> voxel_keys;
+    voxel_keys.reserve(voxels.size());
+    for (const auto& voxel: voxels) {
+        voxel_keys.push_back(voxel.first);
+    }
+    std::sort(voxel_keys.begin(), voxel_keys.end());
+
+    CloudData::CLOUD tile;
+    tile.points.resize(voxel_keys.size());
+    for (size_t i = 0; i < voxel_keys.size(); ++i) {
+        const Voxel& voxel = voxels.at(voxel_keys[i]);
+
+        CloudData::POINT& point = tile.points[i];
+        point = voxel.first_point;
+        point.x = voxel.sum[0] / voxel.num_points;
+        point.y = voxel.sum[1] / voxel.num_points;
+        point.z = voxel.sum[2] / voxel.num_points;
+    }
+    tile.width = tile.points.size();
+    tile.height = 1;
+    tile.is_dense = true;
+
+    const int ix = static_cast<int>(tile_key >> 32);
+    const int iy = static_cast<int>(static_cast<int32_t>(tile_key & 0xffffffff));
+    if (pcl::io::savePCDFileBinary(tiles_path_ + "/" + TiledMap::GetTileFileName(ix, iy), tile) != 0) {
+        LOG(ERROR) << "Failed to save tile " << ix << "," << iy;
+        return false;
+    }
+    if (!AppendPCDBinary(tile, body_ofs)) {
+        LOG(ERROR) << "Failed to append tile " << ix << "," << iy << " to merged map";
+        return false;
+    }
+
+    std::remove(partial_file_path.c_str());
+    num_points = tile.points.size();
+
+    return true;
+}
+
+bool StreamingMapBuilder::WriteMergedMap(const std::string& map_file_path, const std::string& body_file_path, size_t num_points) {
+    {
+        std::ofstream ofs(map_file_path, std::ios::binary | std::ios::trunc);
+        std::ifstream body_ifs(body_file_path, std::ios::binary);
+
+        // same header as pcl::io::savePCDFileBinary, the points are only known once all tiles are merged:
+        ofs << pcl::PCDWriter::generateHeader<CloudData::POINT>(CloudData::CLOUD(), static_cast<int>(num_points))
+            << "DATA binary\n";
+        if (num_points > 0) {
+            ofs << body_ifs.rdbuf();
+        }
+
+        if (!ofs) {
+            LOG(ERROR) << "Failed to save merged map " << map_file_path;
+            return false;
+        }
+    }
+
+    std::remove(body_file_path.c_str());
+
+    return true;
+}
+
+std::string StreamingMapBuilder::GetPartialFilePath(int64_t tile_key) const {
+    const int ix = static_cast<int>(tile_key >> 32);
+    const int iy = static_cast<int>(static_cast<int32_t>(tile_key & 0xffffffff));
+
+    return tiles_path_ + "/" + TiledMap::GetTileFileName(ix, iy) + ".partial";
+}
+
+size_t StreamingMapBuilder::GetSizeInBytes(void) const {
+    return num_voxels_ * (sizeof(std::pair<const uint64_t, Voxel>) + VOXEL_OVERHEAD_IN_BYTES);
+}
+
+} // namespace lidar_localization
@@ -0,0 +1,238 @@
+/*
+ * @Description: nodelet versions of the mapping nodes, for running the whole chain in one process
+ * @Author: Ge Yao
+ * @Date: 2020-12-16 20:41:05
+ */
+#include <mutex>
+#include <memory>
+
+#include <ros/ros.h>
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include "glog/logging.h"
+
+#include <lidar_localization/optimizeMap.h>
+#include <lidar_localization/saveMap.h>
+#include <lidar_localization/saveScanContext.h>
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/trace_service.hpp"
+#include "lidar_localization/tools/metrics_publisher.hpp"
+#include "lidar_localization/tools/background_jobs.hpp"
+#include "lidar_localization/data_pretreat/data_pretreat_flow.hpp"
+#include "lidar_localization/mapping/front_end/front_end_flow.hpp"
+#include "lidar_localization/mapping/back_end/back_end_flow.hpp"
+#include "lidar_localization/mapping/loop_closing/loop_closing_flow.hpp"
+#include "lidar_localization/mapping/viewer/viewer_flow.hpp"
+
+namespace lidar_localization {
+
+namespace {
+// the nodelets share one process, so glog is only initialized once:
+void InitLogging(void) {
+    static std::once_flag flag;
+    std::call_once(
+        flag,
+        []{
+            google::InitGoogleLogging("lidar_localization_nodelets");
+            FLAGS_log_dir = WORK_SPACE_PATH + "/Log";
+            FLAGS_alsologtostderr = 1;
+        }
+    );
+}
+
+// the metrics registry is process-wide, so the nodelets share one publisher while any of them is loaded:
+std::shared_ptr<MetricsPublisher> GetMetricsPublisher(ros::NodeHandle& private_nh) {
+    static std::mutex mutex;
+    static std::weak_ptr<MetricsPublisher> metrics_publisher;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<MetricsPublisher> metrics_publisher_ptr = metrics_publisher.lock();
+    if (!metrics_publisher_ptr) {
+        metrics_publisher_ptr = std::make_shared<MetricsPublisher>(private_nh);
+        metrics_publisher = metrics_publisher_ptr;
+    }
+
+    return metrics_publisher_ptr;
+}
+
+// same rate as the main loops of the standalone nodes:
+const double RUN_PERIOD = 0.01;
+}
+
+// each nodelet uses its own single-threaded callback queue,
+// so subscriber callbacks, service callbacks and Run never overlap.
+// clouds published as shared pointers are passed between nodelets without serialization.
+// the trace is process-wide, the dump_trace of any nodelet writes the whole chain.
+class DataPretreatNodelet : public nodelet::Nodelet {
+  private:
+    void onInit() override {
+        InitLogging();
+        ros::NodeHandle& nh = getNodeHandle();
+        trace_service_ptr_ = std::make_shared<TraceService>(getPrivateNodeHandle());
+        metrics_publisher_ptr_ = GetMetricsPublisher(getPrivateNodeHandle());
+
+        std::string cloud_topic;
+        nh.param<std::string>("cloud_topic", cloud_topic, "/synced_cloud");
+        flow_ptr_ = std::make_shared<DataPretreatFlow>(nh, cloud_topic);
+
+        timer_ = nh.createTimer(ros::Duration(RUN_PERIOD), &DataPretreatNodelet::TimerCallback, this);
+    }
+
+    void TimerCallback(const ros::TimerEvent&) {
+        flow_ptr_->Run();
+    }
+
+  private:
+    std::shared_ptr<DataPretreatFlow> flow_ptr_;
+    std::shared_ptr<TraceService> trace_service_ptr_;
+    std::shared_ptr<MetricsPublisher> metrics_publisher_ptr_;
+    ros::Timer timer_;
+};
+
+class FrontEndNodelet : public nodelet::Nodelet {
+  private:
+    void onInit() override {
+        InitLogging();
+        ros::NodeHandle& nh = getNodeHandle();
+        trace_service_ptr_ = std::make_shared<TraceService>(getPrivateNodeHandle());
+        metrics_publisher_ptr_ = GetMetricsPublisher(getPrivateNodeHandle());
+
+        std::string cloud_topic, odom_topic;
+        nh.param<std::string>("cloud_topic", cloud_topic, "/synced_cloud");
+        nh.param<std::string>("odom_topic", odom_topic, "/laser_odom");
+        flow_ptr_ = std::make_shared<FrontEndFlow>(nh, cloud_topic, odom_topic);
+
+        timer_ = nh.createTimer(ros::Duration(RUN_PERIOD), &FrontEndNodelet::TimerCallback, this);
+    }
+
+    void TimerCallback(const ros::TimerEvent&) {
+        flow_ptr_->Run();
+    }
+
+  private:
+    std::shared_ptr<FrontEndFlow> flow_ptr_;
+    std::shared_ptr<TraceService> trace_service_ptr_;
+    std::shared_ptr<MetricsPublisher> metrics_publisher_ptr_;
+    ros::Timer timer_;
+};
+
+class BackEndNodelet : public nodelet::Nodelet {
+  private:
+    void onInit() override {
+        InitLogging();
+        ros::NodeHandle& nh = getNodeHandle();
+        trace_service_ptr_ = std::make_shared<TraceService>(getPrivateNodeHandle());
+        metrics_publisher_ptr_ = GetMetricsPublisher(getPrivateNodeHandle());
+
+        std::string cloud_topic, odom_topic;
+        nh.param<std::string>("cloud_topic", cloud_topic, "/synced_cloud");
+        nh.param<std::string>("odom_topic", odom_topic, "/laser_odom");
+        flow_ptr_ = std::make_shared<BackEndFlow>(nh, cloud_topic, odom_topic);
+        background_jobs_ptr_ = std::make_shared<BackgroundJobs>(getPrivateNodeHandle());
+
+        service_ = nh.advertiseService("optimize_map", &BackEndNodelet::OptimizeMapCallback, this);
+        timer_ = nh.createTimer(ros::Duration(RUN_PERIOD), &BackEndNodelet::TimerCallback, this);
+    }
+
+    // the logs are written in the background:
+    bool OptimizeMapCallback(optimizeMap::Request &request, optimizeMap::Response &response) {
+        response.job_id = background_jobs_ptr_->Submit("optimize_map", flow_ptr_->GetForceOptimizeJob());
+        response.succeed = true;
+        return response.succeed;
+    }
+
+    void TimerCallback(const ros::TimerEvent&) {
+        flow_ptr_->Run();
+    }
+
+  private:
+    std::shared_ptr<BackEndFlow> flow_ptr_;
+    std::shared_ptr<TraceService> trace_service_ptr_;
+    std::shared_ptr<MetricsPublisher> metrics_publisher_ptr_;
+    // after the flow, so the queued jobs finish first on unload:
+    std::shared_ptr<BackgroundJobs> background_jobs_ptr_;
+    ros::ServiceServer service_;
+    ros::Timer timer_;
+};
+
+class LoopClosingNodelet : public nodelet::Nodelet {
+  private:
+    void onInit() override {
+        InitLogging();
+        ros::NodeHandle& nh = getNodeHandle();
+        trace_service_ptr_ = std::make_shared<TraceService>(getPrivateNodeHandle());
+        metrics_publisher_ptr_ = GetMetricsPublisher(getPrivateNodeHandle());
+
+        flow_ptr_ = std::make_shared<LoopClosingFlow>(nh);
+        background_jobs_ptr_ = std::make_shared<BackgroundJobs>(getPrivateNodeHandle());
+
+        service_ = nh.advertiseService("save_scan_context", &LoopClosingNodelet::SaveScanContextCallback, this);
+        timer_ = nh.createTimer(ros::Duration(RUN_PERIOD), &LoopClosingNodelet::TimerCallback, this);
+    }
+
+    // the scan context state as of now is saved in the background:
+    bool SaveScanContextCallback(saveScanContext::Request &request, saveScanContext::Response &response) {
+        response.job_id = background_jobs_ptr_->Submit("save_scan_context", flow_ptr_->GetSaveJob());
+        response.succeed = true;
+        return response.succeed;
+    }
+
+    void TimerCallback(const ros::TimerEvent&) {
+        flow_ptr_->Run();
+    }
+
+  private:
+    std::shared_ptr<LoopClosingFlow> flow_ptr_;
+    std::shared_ptr<TraceService> trace_service_ptr_;
+    std::shared_ptr<MetricsPublisher> metrics_publisher_ptr_;
+    // after the flow, so the queued jobs finish first on unload:
+    std::shared_ptr<BackgroundJobs> background_jobs_ptr_;
+    ros::ServiceServer service_;
+    ros::Timer timer_;
+};
+
+class ViewerNodelet : public nodelet::Nodelet {
+  private:
+    void onInit() override {
+        InitLogging();
+        ros::NodeHandle& nh = getNodeHandle();
+        trace_service_ptr_ = std::make_shared<TraceService>(getPrivateNodeHandle());
+        metrics_publisher_ptr_ = GetMetricsPublisher(getPrivateNodeHandle());
+
+        std::string cloud_topic;
+        nh.param<std::string>("cloud_topic", cloud_topic, "/synced_cloud");
+        flow_ptr_ = std::make_shared<ViewerFlow>(nh, cloud_topic);
+        background_jobs_ptr_ = std::make_shared<BackgroundJobs>(getPrivateNodeHandle());
+
+        service_ = nh.advertiseService("save_map", &ViewerNodelet::SaveMapCallback, this);
+        timer_ = nh.createTimer(ros::Duration(RUN_PERIOD), &ViewerNodelet::TimerCallback, this);
+    }
+
+    // the map of the optimized key frames as of now is saved in the background:
+    bool SaveMapCallback(saveMap::Request &request, saveMap::Response &response) {
+        response.job_id = background_jobs_ptr_->Submit("save_map", flow_ptr_->GetSaveMapJob());
+        response.succeed = true;
+        return response.succeed;
+    }
+
+    void TimerCallback(const ros::TimerEvent&) {
+        flow_ptr_->Run();
+    }
+
+  private:
+    std::shared_ptr<ViewerFlow> flow_ptr_;
+    std::shared_ptr<TraceService> trace_service_ptr_;
+    std::shared_ptr<MetricsPublisher> metrics_publisher_ptr_;
+    // after the flow, so the queued jobs finish first on unload:
+    std::shared_ptr<BackgroundJobs> background_jobs_ptr_;
+    ros::ServiceServer service_;
+    ros::Timer timer_;
+};
+
+} // namespace lidar_localization
+
+PLUGINLIB_EXPORT_CLASS(lidar_localization::DataPretreatNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(lidar_localization::FrontEndNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(lidar_localization::BackEndNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(lidar_localization::LoopClosingNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(lidar_localization::ViewerNodelet, nodelet::Nodelet)
@@ -5,6 +5,11 @@
  */
 
 #include "lidar_localization/publisher/cloud_publisher.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/offline_replay.hpp"
+#include "lidar_localization/tools/cloud_pool.hpp"
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/models/cloud_filter/voxel_filter_fast.hpp"
 #include "glog/logging.h"
 
 namespace lidar_localization {
@@ -14,28 +19,111 @@ CloudPublisher::CloudPublisher(ros::NodeHandle& nh,
                                size_t buff_size)
     :nh_(nh), frame_id_(frame_id) {
     publisher_ = nh_.advertise<sensor_msgs::PointCloud2>(topic_name, buff_size);
+    InitOptions(topic_name);
+
+    if (codec_ptr_) {
+        compressed_publisher_ = nh_.advertise<CompressedCloud>(topic_name + "/compressed", buff_size);
+    }
+}
+
+bool CloudPublisher::InitOptions(const std::string& topic_name) {
+    // shared by all cloud publishers of the process:
+    static const YAML::Node config_node = YAML::LoadFile(WORK_SPACE_PATH + "/config/publisher/cloud_publisher.yaml");
+
+    const YAML::Node& default_node = config_node["default"];
+    const YAML::Node topic_node = config_node["topics"][topic_name];
+    auto get_option = [&](const std::string& name) {
+        return (topic_node && topic_node[name]) ? topic_node[name] : default_node[name];
+    };
+
+    skip_without_subscribers_ = get_option("skip_without_subscribers").as<bool>();
+    max_rate_ = get_option("max_rate").as<double>();
+    float leaf_size = get_option("leaf_size").as<float>();
+    if (leaf_size > 0.0f) {
+        // the first point of each voxel is enough for visualization:
+        filter_ptr_ = std::make_shared<FastVoxelFilter>(leaf_size, leaf_size, leaf_size, FastVoxelFilter::APPROXIMATE);
+    }
+    if (get_option("compressed_transport").as<bool>()) {
+        codec_ptr_ = std::make_shared<CloudCodec>(
+            get_option("compression_resolution").as<float>(), get_option("use_lz4").as<bool>()
+        );
+    }
+
+    return true;
 }
 
-void CloudPublisher::Publish(CloudData::CLOUD_PTR&  cloud_ptr_input, double time) {
+void CloudPublisher::Publish(const CloudData::CLOUD::ConstPtr& cloud_ptr_input, double time) {
     ros::Time ros_time(time);
     PublishData(cloud_ptr_input, ros_time);
 }
 
-void CloudPublisher::Publish(CloudData::CLOUD_PTR&  cloud_ptr_input) {
+void CloudPublisher::Publish(const CloudData::CLOUD::ConstPtr& cloud_ptr_input) {
     ros::Time time = ros::Time::now();
     PublishData(cloud_ptr_input, time);
 }
 
-void CloudPublisher::PublishData(CloudData::CLOUD_PTR&  cloud_ptr_input, ros::Time time) {
-    sensor_msgs::PointCloud2Ptr cloud_ptr_output(new sensor_msgs::PointCloud2());
-    pcl::toROSMsg(*cloud_ptr_input, *cloud_ptr_output);
+bool CloudPublisher::ShouldPublish(void) {
+    if (skip_without_subscribers_ && !HasSubscribers()) {
+        return false;
+    }
+
+    // wall time, so the rate also bounds the cost when replaying faster than real time:
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (
+        max_rate_ > 0.0 && has_published_ &&
+        std::chrono::duration<double>(now - last_publish_time_).count() < 1.0 / max_rate_
+    ) {
+        return false;
+    }
+
+    has_published_ = true;
+    last_publish_time_ = now;
+
+    return true;
+}
+
+void CloudPublisher::PublishData(const CloudData::CLOUD::ConstPtr& cloud_ptr_input, ros::Time time) {
+    TRACE_SCOPE("CloudPublisher::PublishData", "publish");
+    if (!ShouldPublish()) {
+        return;
+    }
+
+    CloudData::CLOUD::ConstPtr cloud_ptr = cloud_ptr_input;
+    if (filter_ptr_) {
+        CloudData::CLOUD_PTR filtered_cloud_ptr = CloudPool::GetInstance().Get();
+        filter_ptr_->Filter(cloud_ptr_input, filtered_cloud_ptr);
+        cloud_ptr = filtered_cloud_ptr;
+    }
+
+    // the raw cloud is still published for the subscribers of this host, and ROS tools:
+    if (!codec_ptr_ || !skip_without_subscribers_ || OfflineReplay::GetInstance().HasSubscribers(publisher_)) {
+        sensor_msgs::PointCloud2Ptr cloud_ptr_output(new sensor_msgs::PointCloud2());
+        pcl::toROSMsg(*cloud_ptr, *cloud_ptr_output);
+
+        cloud_ptr_output->header.stamp = time;
+        cloud_ptr_output->header.frame_id = frame_id_;
+        // publish the pointer, so subscribers in the same process share the message:
+        OfflineReplay::GetInstance().Publish(publisher_, cloud_ptr_output);
+    }
+
+    if (codec_ptr_ && OfflineReplay::GetInstance().HasSubscribers(compressed_publisher_)) {
+        CompressedCloudPtr compressed_ptr_output(new CompressedCloud());
+        CloudCodec::FrameInfo info;
+        codec_ptr_->Encode(*cloud_ptr, info, compressed_ptr_output->data);
 
-    cloud_ptr_output->header.stamp = time;
-    cloud_ptr_output->header.frame_id = frame_id_;
-    publisher_.publish(*cloud_ptr_output);
+        compressed_ptr_output->header.stamp = time;
+        compressed_ptr_output->header.frame_id = frame_id_;
+        compressed_ptr_output->num_points = info.num_points;
+        compressed_ptr_output->resolution = info.resolution;
+        compressed_ptr_output->compression = info.compression;
+        compressed_ptr_output->raw_size = info.raw_size;
+        OfflineReplay::GetInstance().Publish(compressed_publisher_, compressed_ptr_output);
+    }
 }
 
 bool CloudPublisher::HasSubscribers() {
-    return publisher_.getNumSubscribers() != 0;
+    return OfflineReplay::GetInstance().HasSubscribers(publisher_) || (
+        codec_ptr_ && OfflineReplay::GetInstance().HasSubscribers(compressed_publisher_)
+    );
 }
 } // namespace lidar_localization
\ No newline at end of file
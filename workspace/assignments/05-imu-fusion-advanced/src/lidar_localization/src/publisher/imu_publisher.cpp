@@ -4,6 +4,8 @@
  * @Date: 2020-02-05 02:27:30
  */
 #include "lidar_localization/publisher/imu_publisher.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/offline_replay.hpp"
 #include "glog/logging.h"
 
 namespace lidar_localization {
@@ -31,6 +33,7 @@ void IMUPublisher::Publish(const IMUData &imu_data) {
 }
 
 void IMUPublisher::PublishData(const IMUData &imu_data, ros::Time time) {
+    TRACE_SCOPE("IMUPublisher::PublishData", "publish");
     imu_.header.stamp = time;
 
     // set orientation:
@@ -49,7 +52,7 @@ void IMUPublisher::PublishData(const IMUData &imu_data, ros::Time time) {
     imu_.linear_acceleration.y = imu_data.linear_acceleration.y;
     imu_.linear_acceleration.z = imu_data.linear_acceleration.z;
 
-    publisher_.publish(imu_);
+    OfflineReplay::GetInstance().Publish(publisher_, imu_);
 }
 
 bool IMUPublisher::HasSubscribers(void) {
@@ -4,6 +4,8 @@
  * @Date: 2020-02-06 21:11:44
  */
 #include "lidar_localization/publisher/key_frame_publisher.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/offline_replay.hpp"
 
 #include <Eigen/Dense>
 
@@ -18,6 +20,7 @@ KeyFramePublisher::KeyFramePublisher(ros::NodeHandle& nh,
 }
 
 void KeyFramePublisher::Publish(KeyFrame& key_frame) {
+    TRACE_SCOPE("KeyFramePublisher::Publish", "publish");
     geometry_msgs::PoseWithCovarianceStamped pose_stamped;
 
     ros::Time ros_time(key_frame.time);
@@ -36,7 +39,7 @@ void KeyFramePublisher::Publish(KeyFrame& key_frame) {
 
     pose_stamped.pose.covariance[0] = (double)key_frame.index;
 
-    publisher_.publish(pose_stamped);
+    OfflineReplay::GetInstance().Publish(publisher_, pose_stamped);
 }
 
 bool KeyFramePublisher::HasSubscribers() {
@@ -4,6 +4,12 @@
  * @Date: 2020-02-06 21:11:44
  */
 #include "lidar_localization/publisher/key_frames_publisher.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/offline_replay.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <iostream>
 
 #include <Eigen/Dense>
 
@@ -17,13 +23,64 @@ KeyFramesPublisher::KeyFramesPublisher(ros::NodeHandle& nh,
     publisher_ = nh_.advertise<nav_msgs::Path>(topic_name, buff_size);
 }
 
+KeyFramesPublisher::KeyFramesPublisher(ros::NodeHandle& nh, 
+                                     std::string topic_name, 
+                                     std::string frame_id,
+                                     int buff_size,
+                                     const YAML::Node& node)
+    :nh_(nh), frame_id_(frame_id) {
+    is_incremental_ = node["incremental"].as<bool>();
+    min_translation_ = node["translation"].as<float>();
+    min_rotation_ = node["rotation"].as<float>();
+    path_interval_ = node["path_interval"].as<double>();
+
+    publisher_ = nh_.advertise<nav_msgs::Path>(topic_name, buff_size);
+    if (is_incremental_) {
+        updates_publisher_ = nh_.advertise<KeyFrameUpdates>(
+            topic_name + "/incremental", buff_size,
+            [this](const ros::SingleSubscriberPublisher& publisher) { PublishSnapshot(publisher); }
+        );
+    }
+
+    std::cout << "Key Frames Publisher params:" << std::endl
+              << "\ttopic: " << topic_name << (is_incremental_ ? ", incremental" : "") << std::endl
+              << "\tmin. translation: " << min_translation_ << ", "
+              << "min. rotation: " << min_rotation_ << std::endl
+              << "\tpath interval: " << path_interval_ << std::endl
+              << std::endl;
+}
+
 void KeyFramesPublisher::Publish(const std::deque<KeyFrame>& key_frames) {
+    TRACE_SCOPE("KeyFramesPublisher::Publish", "publish");
+    if (!is_incremental_) {
+        PublishPath(key_frames);
+        return;
+    }
+
+    PublishUpdates(key_frames);
+
+    // the whole trajectory is for compatibility only:
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (
+        OfflineReplay::GetInstance().HasSubscribers(publisher_) && (
+            !has_path_ || 
+            std::chrono::duration<double>(now - last_path_time_).count() >= path_interval_
+        )
+    ) {
+        PublishPath(key_frames);
+        last_path_time_ = now;
+        has_path_ = true;
+    }
+}
+
+void KeyFramesPublisher::PublishPath(const std::deque<KeyFrame>& key_frames) {
     nav_msgs::Path path;
     path.header.stamp = ros::Time::now();
     path.header.frame_id = frame_id_;
+    path.poses.reserve(key_frames.size());
 
     for (size_t i = 0; i < key_frames.size(); ++i) {
-        KeyFrame key_frame = key_frames.at(i);
+        const KeyFrame& key_frame = key_frames.at(i);
 
         geometry_msgs::PoseStamped pose_stamped;
         ros::Time ros_time(key_frame.time);
@@ -45,10 +102,87 @@ void KeyFramesPublisher::Publish(const std::deque<KeyFrame>& key_frames) {
         path.poses.push_back(pose_stamped);
     }
 
-    publisher_.publish(path);
+    OfflineReplay::GetInstance().Publish(publisher_, path);
+}
+
+void KeyFramesPublisher::PublishUpdates(const std::deque<KeyFrame>& key_frames) {
+    updates_.header.stamp = ros::Time::now();
+    updates_.header.frame_id = frame_id_;
+    updates_.is_snapshot = false;
+    updates_.indices.clear();
+    updates_.times.clear();
+    updates_.poses.clear();
+
+    // merge into the published key frames, both sorted by index:
+    size_t j = 0;
+    for (const KeyFrame& key_frame: key_frames) {
+        while (j < published_key_frames_.size() && published_key_frames_.at(j).index < key_frame.index) {
+            ++j;
+        }
+
+        if (j < published_key_frames_.size() && published_key_frames_.at(j).index == key_frame.index) {
+            if (!IsMoved(published_key_frames_.at(j), key_frame)) {
+                continue;
+            }
+            published_key_frames_.at(j) = key_frame;
+        } else {
+            published_key_frames_.insert(published_key_frames_.begin() + j, key_frame);
+        }
+
+        AddUpdate(key_frame, updates_);
+    }
+
+    if (!updates_.indices.empty()) {
+        OfflineReplay::GetInstance().Publish(updates_publisher_, updates_);
+    }
+}
+
+void KeyFramesPublisher::PublishSnapshot(const ros::SingleSubscriberPublisher& publisher) {
+    KeyFrameUpdates snapshot;
+    snapshot.header.stamp = ros::Time::now();
+    snapshot.header.frame_id = frame_id_;
+    snapshot.is_snapshot = true;
+
+    snapshot.indices.reserve(published_key_frames_.size());
+    snapshot.times.reserve(published_key_frames_.size());
+    snapshot.poses.reserve(published_key_frames_.size());
+    for (const KeyFrame& key_frame: published_key_frames_) {
+        AddUpdate(key_frame, snapshot);
+    }
+
+    publisher.publish(snapshot);
+}
+
+bool KeyFramesPublisher::IsMoved(const KeyFrame& published, const KeyFrame& key_frame) const {
+    const Eigen::Matrix4f delta = published.pose.inverse() * key_frame.pose;
+
+    const float translation = delta.block<3, 1>(0, 3).norm();
+    // rotation angle from the trace, clamped against round-off:
+    const float cos_rotation = std::max(-1.0f, std::min(1.0f, 0.5f * (delta.block<3, 3>(0, 0).trace() - 1.0f)));
+    const float rotation = std::acos(cos_rotation);
+
+    return translation > min_translation_ || rotation > min_rotation_;
+}
+
+void KeyFramesPublisher::AddUpdate(const KeyFrame& key_frame, KeyFrameUpdates& updates) const {
+    updates.indices.push_back(key_frame.index);
+    updates.times.push_back(key_frame.time);
+
+    geometry_msgs::Pose pose;
+    pose.position.x = key_frame.pose(0,3);
+    pose.position.y = key_frame.pose(1,3);
+    pose.position.z = key_frame.pose(2,3);
+
+    Eigen::Quaternionf q = key_frame.GetQuaternion();
+    pose.orientation.x = q.x();
+    pose.orientation.y = q.y();
+    pose.orientation.z = q.z();
+    pose.orientation.w = q.w();
+
+    updates.poses.push_back(pose);
 }
 
 bool KeyFramesPublisher::HasSubscribers() {
-    return publisher_.getNumSubscribers() != 0;
+    return publisher_.getNumSubscribers() != 0 || updates_publisher_.getNumSubscribers() != 0;
+}
 }
-}
\ No newline at end of file
@@ -5,6 +5,8 @@
  */
 
 #include "lidar_localization/publisher/lidar_measurement_publisher.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/offline_replay.hpp"
 #include "glog/logging.h"
 
 namespace lidar_localization {
@@ -145,6 +147,7 @@ void LidarMeasurementPublisher::PublishData(
     const Eigen::Matrix4f &transform_matrix, 
     const VelocityData &velocity_data
 ) {
+    TRACE_SCOPE("LidarMeasurementPublisher::PublishData", "publish");
     // set header:
     lidar_measurement_.header.stamp = time;
     
@@ -158,7 +161,7 @@ void LidarMeasurementPublisher::PublishData(
     SetGNSSOdometry(time, transform_matrix, velocity_data, lidar_measurement_.gnss_odometry);
 
     // publish synced lidar measurement:
-    publisher_.publish(lidar_measurement_);
+    OfflineReplay::GetInstance().Publish(publisher_, lidar_measurement_);
 }
 
 } // namespace lidar_localization
\ No newline at end of file
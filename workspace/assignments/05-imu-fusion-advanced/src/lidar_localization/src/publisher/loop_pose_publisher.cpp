@@ -4,6 +4,8 @@
  * @Date: 2020-02-06 21:11:44
  */
 #include "lidar_localization/publisher/loop_pose_publisher.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/offline_replay.hpp"
 
 #include <Eigen/Dense>
 #include "glog/logging.h"
@@ -19,6 +21,7 @@ LoopPosePublisher::LoopPosePublisher(ros::NodeHandle& nh,
 }
 
 void LoopPosePublisher::Publish(LoopPose& loop_pose) {
+    TRACE_SCOPE("LoopPosePublisher::Publish", "publish");
     geometry_msgs::PoseWithCovarianceStamped pose_stamped;
 
     ros::Time ros_time(loop_pose.time);
@@ -38,7 +41,7 @@ void LoopPosePublisher::Publish(LoopPose& loop_pose) {
     pose_stamped.pose.covariance[0] = (double)loop_pose.index0;
     pose_stamped.pose.covariance[1] = (double)loop_pose.index1;
 
-    publisher_.publish(pose_stamped);
+    OfflineReplay::GetInstance().Publish(publisher_, pose_stamped);
 }
 
 bool LoopPosePublisher::HasSubscribers() {
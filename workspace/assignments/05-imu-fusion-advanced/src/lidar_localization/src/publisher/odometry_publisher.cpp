@@ -4,6 +4,8 @@
  * @Date: 2020-02-06 21:11:44
  */
 #include "lidar_localization/publisher/odometry_publisher.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/offline_replay.hpp"
 
 namespace lidar_localization {
 OdometryPublisher::OdometryPublisher(ros::NodeHandle& nh, 
@@ -82,6 +84,7 @@ void OdometryPublisher::PublishData(
     const VelocityData &velocity_data,  
     ros::Time time
 ) {
+    TRACE_SCOPE("OdometryPublisher::PublishData", "publish");
     odometry_.header.stamp = time;
 
     // set the pose
@@ -105,7 +108,7 @@ void OdometryPublisher::PublishData(
     odometry_.twist.twist.angular.y = velocity_data.angular_velocity.y;
     odometry_.twist.twist.angular.z = velocity_data.angular_velocity.z;
 
-    publisher_.publish(odometry_);
+    OfflineReplay::GetInstance().Publish(publisher_, odometry_);
 }
 
 bool OdometryPublisher::HasSubscribers() {
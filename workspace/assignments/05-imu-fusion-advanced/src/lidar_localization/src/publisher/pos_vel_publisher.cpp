@@ -4,6 +4,8 @@
  * @Date: 2020-11-21 15:39:24
  */
 #include "lidar_localization/publisher/pos_vel_publisher.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/offline_replay.hpp"
 
 namespace lidar_localization {
 
@@ -43,6 +45,7 @@ void PosVelPublisher::PublishData(
     const PosVelData &pos_vel_data,  
     ros::Time time
 ) {
+    TRACE_SCOPE("PosVelPublisher::PublishData", "publish");
     pos_vel_msg_.header.stamp = time;
 
     // a. set position
@@ -55,7 +58,7 @@ void PosVelPublisher::PublishData(
     pos_vel_msg_.velocity.y = pos_vel_data.vel.y();
     pos_vel_msg_.velocity.z = pos_vel_data.vel.z();    
 
-    publisher_.publish(pos_vel_msg_);
+    OfflineReplay::GetInstance().Publish(publisher_, pos_vel_msg_);
 }
 
 } // namespace lidar_localization
\ No newline at end of file
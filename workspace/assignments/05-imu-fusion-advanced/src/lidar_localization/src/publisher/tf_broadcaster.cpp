@@ -5,6 +5,7 @@
  */
 
 #include "lidar_localization/publisher/tf_broadcaster.hpp"
+#include "lidar_localization/tools/tracer.hpp"
 
 namespace lidar_localization {
 TFBroadCaster::TFBroadCaster(std::string frame_id, std::string child_frame_id) {
@@ -13,6 +14,7 @@ TFBroadCaster::TFBroadCaster(std::string frame_id, std::string child_frame_id) {
 }
 
 void TFBroadCaster::SendTransform(Eigen::Matrix4f pose, double time) {
+    TRACE_SCOPE("TFBroadCaster::SendTransform", "publish");
     Eigen::Quaternionf q(pose.block<3,3>(0,0));
     ros::Time ros_time(time);
     transform_.stamp_ = ros_time;
@@ -0,0 +1,172 @@
+/*
+ * @Description: compact in-memory key scan, int16 coordinates relative to its own origin, 6 bytes per point
+ * @Author: Ge Yao
+ * @Date: 2021-01-21 21:16:05
+ */
+#include "lidar_localization/sensor_data/compact_cloud.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "lidar_localization/tools/simd_dispatch.hpp"
+
+namespace lidar_localization {
+
+constexpr float CompactCloud::DEFAULT_RESOLUTION;
+
+CompactCloud::CompactCloud(const CloudData::CLOUD& cloud, float resolution)
+    : origin_(Eigen::Vector3f::Zero()), resolution_(resolution), stamp_(cloud.header.stamp) {
+    // a. bounding box of the finite points:
+    Eigen::Vector3f min_point = Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+    Eigen::Vector3f max_point = Eigen::Vector3f::Constant(std::numeric_limits<float>::lowest());
+    size_t num_points = 0;
+    for (const CloudData::POINT& point: cloud.points) {
+        if (!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z))
+            continue;
+
+        min_point = min_point.cwiseMin(point.getVector3fMap());
+        max_point = max_point.cwiseMax(point.getVector3fMap());
+        ++num_points;
+    }
+    if (num_points == 0)
+        return;
+
+    // b. origin at the center, the half extent must fit in int16:
+    origin_ = 0.5f * (min_point + max_point);
+    const float max_half_extent = 0.5f * (max_point - min_point).maxCoeff();
+    resolution_ = std::max(resolution_, max_half_extent / std::numeric_limits<int16_t>::max());
+
+    // c. quantize:
+    const float inverse_resolution = 1.0f / resolution_;
+    auto quantize = [&](float value, float origin) {
+        const float steps = std::round((value - origin) * inverse_resolution);
+        return static_cast<int16_t>(std::min(std::max(steps, -32767.0f), 32767.0f));
+    };
+
+    x_.reserve(num_points);
+    y_.reserve(num_points);
+    z_.reserve(num_points);
+    for (const CloudData::POINT& point: cloud.points) {
+        if (!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z))
+            continue;
+
+        x_.push_back(quantize(point.x, origin_.x()));
+        y_.push_back(quantize(point.y, origin_.y()));
+        z_.push_back(quantize(point.z, origin_.z()));
+    }
+}
+
+void CompactCloud::Transform(const Eigen::Matrix4f& pose, CloudData::POINT *output) const {
+    // scale & origin are folded into the pose, each point is then A * q + b of its int16 coordinates q:
+    const Eigen::Matrix3f A = pose.block<3, 3>(0, 0) * resolution_;
+    const Eigen::Vector3f b = pose.block<3, 3>(0, 0) * origin_ + pose.block<3, 1>(0, 3);
+
+    const size_t N = x_.size();
+    size_t i = 0;
+#if defined(__GNUC__) && defined(__x86_64__)
+    // SSE2 only, 4 points at a time. int16 are sign extended by unpacking into the upper halves & shifting back:
+    if (SIMDDispatch::IsEnabled(SIMDLevel::SSE2)) {
+        auto load = [](const int16_t *input) {
+            const __m128i value = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(input));
+            return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(value, value), 16));
+        };
+
+        const __m128 a00 = _mm_set1_ps(A(0, 0)), a01 = _mm_set1_ps(A(0, 1)), a02 = _mm_set1_ps(A(0, 2));
+        const __m128 a10 = _mm_set1_ps(A(1, 0)), a11 = _mm_set1_ps(A(1, 1)), a12 = _mm_set1_ps(A(1, 2));
+        const __m128 a20 = _mm_set1_ps(A(2, 0)), a21 = _mm_set1_ps(A(2, 1)), a22 = _mm_set1_ps(A(2, 2));
+        const __m128 b0 = _mm_set1_ps(b.x()), b1 = _mm_set1_ps(b.y()), b2 = _mm_set1_ps(b.z());
+
+        for (; i + 4 <= N; i += 4) {
+            const __m128 x = load(x_.data() + i);
+            const __m128 y = load(y_.data() + i);
+            const __m128 z = load(z_.data() + i);
+
+            __m128 row_0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a00, x), _mm_mul_ps(a01, y)), _mm_add_ps(_mm_mul_ps(a02, z), b0));
+            __m128 row_1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a10, x), _mm_mul_ps(a11, y)), _mm_add_ps(_mm_mul_ps(a12, z), b1));
+            __m128 row_2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a20, x), _mm_mul_ps(a21, y)), _mm_add_ps(_mm_mul_ps(a22, z), b2));
+            // the padding of pcl points is 1:
+            __m128 row_3 = _mm_set1_ps(1.0f);
+            // rows of x, y, z & padding into points:
+            _MM_TRANSPOSE4_PS(row_0, row_1, row_2, row_3);
+
+            output[i + 0] = CloudData::POINT();
+            output[i + 1] = CloudData::POINT();
+            output[i + 2] = CloudData::POINT();
+            output[i + 3] = CloudData::POINT();
+            _mm_storeu_ps(output[i + 0].data, row_0);
+            _mm_storeu_ps(output[i + 1].data, row_1);
+            _mm_storeu_ps(output[i + 2].data, row_2);
+            _mm_storeu_ps(output[i + 3].data, row_3);
+        }
+    }
+#elif defined(__GNUC__) && defined(__aarch64__)
+    // as SSE2, int16 are sign extended by widening:
+    if (SIMDDispatch::IsEnabled(SIMDLevel::NEON)) {
+        auto load = [](const int16_t *input) {
+            return vcvtq_f32_s32(vmovl_s16(vld1_s16(input)));
+        };
+        // 4x4 transpose, by 32-bit then 64-bit lane pairs:
+        auto get_column = [](const float32x4_t &a, const float32x4_t &b, bool is_high) {
+            return vreinterpretq_f32_f64(
+                is_high ? 
+                vtrn2q_f64(vreinterpretq_f64_f32(a), vreinterpretq_f64_f32(b)) : 
+                vtrn1q_f64(vreinterpretq_f64_f32(a), vreinterpretq_f64_f32(b))
+            );
+        };
+
+        const float32x4_t a00 = vdupq_n_f32(A(0, 0)), a01 = vdupq_n_f32(A(0, 1)), a02 = vdupq_n_f32(A(0, 2));
+        const float32x4_t a10 = vdupq_n_f32(A(1, 0)), a11 = vdupq_n_f32(A(1, 1)), a12 = vdupq_n_f32(A(1, 2));
+        const float32x4_t a20 = vdupq_n_f32(A(2, 0)), a21 = vdupq_n_f32(A(2, 1)), a22 = vdupq_n_f32(A(2, 2));
+        const float32x4_t b0 = vdupq_n_f32(b.x()), b1 = vdupq_n_f32(b.y()), b2 = vdupq_n_f32(b.z());
+        // the padding of pcl points is 1:
+        const float32x4_t row_3 = vdupq_n_f32(1.0f);
+
+        for (; i + 4 <= N; i += 4) {
+            const float32x4_t x = load(x_.data() + i);
+            const float32x4_t y = load(y_.data() + i);
+            const float32x4_t z = load(z_.data() + i);
+
+            const float32x4_t row_0 = vfmaq_f32(vfmaq_f32(vfmaq_f32(b0, a00, x), a01, y), a02, z);
+            const float32x4_t row_1 = vfmaq_f32(vfmaq_f32(vfmaq_f32(b1, a10, x), a11, y), a12, z);
+            const float32x4_t row_2 = vfmaq_f32(vfmaq_f32(vfmaq_f32(b2, a20, x), a21, y), a22, z);
+
+            const float32x4_t t_0 = vtrn1q_f32(row_0, row_1);
+            const float32x4_t t_1 = vtrn2q_f32(row_0, row_1);
+            const float32x4_t t_2 = vtrn1q_f32(row_2, row_3);
+            const float32x4_t t_3 = vtrn2q_f32(row_2, row_3);
+
+            output[i + 0] = CloudData::POINT();
+            output[i + 1] = CloudData::POINT();
+            output[i + 2] = CloudData::POINT();
+            output[i + 3] = CloudData::POINT();
+            vst1q_f32(output[i + 0].data, get_column(t_0, t_2, false));
+            vst1q_f32(output[i + 1].data, get_column(t_1, t_3, false));
+            vst1q_f32(output[i + 2].data, get_column(t_0, t_2, true));
+            vst1q_f32(output[i + 3].data, get_column(t_1, t_3, true));
+        }
+    }
+#endif
+    for (; i < N; ++i) {
+        output[i] = CloudData::POINT();
+        output[i].getVector3fMap() = A * Eigen::Vector3f(x_[i], y_[i], z_[i]) + b;
+    }
+}
+
+void CompactCloud::Decode(CloudData::CLOUD& cloud) const {
+    cloud.points.resize(x_.size());
+    Transform(Eigen::Matrix4f::Identity(), cloud.points.data());
+
+    cloud.width = static_cast<uint32_t>(cloud.points.size());
+    cloud.height = 1;
+    cloud.is_dense = true;
+    cloud.header.stamp = stamp_;
+}
+
+} // namespace lidar_localization
@@ -4,66 +4,26 @@
  * @Date: 2020-02-06 20:42:23
  */
 #include "lidar_localization/sensor_data/gnss_data.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/sensor_data/sync_data.hpp"
 
 #include "glog/logging.h"
 #include <ostream>
 
-//静态成员变量必须在类外初始化
-double lidar_localization::GNSSData::origin_latitude = 0.0;
-double lidar_localization::GNSSData::origin_longitude = 0.0;
-double lidar_localization::GNSSData::origin_altitude = 0.0;
-bool lidar_localization::GNSSData::origin_position_inited = false;
-GeographicLib::LocalCartesian lidar_localization::GNSSData::geo_converter;
-
 namespace lidar_localization {
-void GNSSData::InitOriginPosition() {
-    geo_converter.Reset(latitude, longitude, altitude);
-
-    origin_latitude = latitude;
-    origin_longitude = longitude;
-    origin_altitude = altitude;
-
-    origin_position_inited = true;
-}
-
-void GNSSData::UpdateXYZ() {
-    if (!origin_position_inited) {
-        LOG(WARNING) << "GeoConverter has not set origin position";
-    }
-
-    geo_converter.Forward(latitude, longitude, altitude, local_E, local_N, local_U);
-}
-
 bool GNSSData::SyncData(std::deque<GNSSData>& UnsyncedData, std::deque<GNSSData>& SyncedData, double sync_time) {
+    TRACE_SCOPE("GNSSData::SyncData", "sync");
     // 传感器数据按时间序列排列，在传感器数据中为同步的时间点找到合适的时间位置
     // 即找到与同步时间相邻的左右两个数据
     // 需要注意的是，如果左右相邻数据有一个离同步时间差值比较大，则说明数据有丢失，时间离得太远不适合做差值
-    while (UnsyncedData.size() >= 2) {
-        if (UnsyncedData.front().time > sync_time)
-            return false;
-        if (UnsyncedData.at(1).time < sync_time) {
-            UnsyncedData.pop_front();
-            continue;
-        }
-        if (sync_time - UnsyncedData.front().time > 0.2) {
-            UnsyncedData.pop_front();
-            return false;
-        }
-        if (UnsyncedData.at(1).time - sync_time > 0.2) {
-            UnsyncedData.pop_front();
-            return false;
-        }
-        break;
-    }
-    if (UnsyncedData.size() < 2)
+    double front_scale, back_scale;
+    if (!SeekSyncData(UnsyncedData, sync_time, front_scale, back_scale))
         return false;
 
-    GNSSData front_data = UnsyncedData.at(0);
-    GNSSData back_data = UnsyncedData.at(1);
+    const GNSSData& front_data = UnsyncedData.at(0);
+    const GNSSData& back_data = UnsyncedData.at(1);
     GNSSData synced_data;
 
-    double front_scale = (back_data.time - sync_time) / (back_data.time - front_data.time);
-    double back_scale = (sync_time - front_data.time) / (back_data.time - front_data.time);
     synced_data.time = sync_time;
     synced_data.status = back_data.status;
     synced_data.longitude = front_data.longitude * front_scale + back_data.longitude * back_scale;
@@ -4,6 +4,8 @@
  * @Date: 2020-02-23 22:20:41
  */
 #include "lidar_localization/sensor_data/imu_data.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/sensor_data/sync_data.hpp"
 
 #include <cmath>
 #include "glog/logging.h"
@@ -15,40 +17,18 @@ Eigen::Matrix3f IMUData::GetOrientationMatrix() const {
 }
 
 bool IMUData::SyncData(std::deque<IMUData>& UnsyncedData, std::deque<IMUData>& SyncedData, double sync_time) {
+    TRACE_SCOPE("IMUData::SyncData", "sync");
     // 传感器数据按时间序列排列，在传感器数据中为同步的时间点找到合适的时间位置
     // 即找到与同步时间相邻的左右两个数据
     // 需要注意的是，如果左右相邻数据有一个离同步时间差值比较大，则说明数据有丢失，时间离得太远不适合做差值
-    while (UnsyncedData.size() >= 2) {
-        // UnsyncedData.front().time should be <= sync_time:
-        if (UnsyncedData.front().time > sync_time) 
-            return false;
-        // sync_time should be <= UnsyncedData.at(1).time:
-        if (UnsyncedData.at(1).time < sync_time) {
-            UnsyncedData.pop_front();
-            continue;
-        }
-
-        // sync_time - UnsyncedData.front().time should be <= 0.2:
-        if (sync_time - UnsyncedData.front().time > 0.2) {
-            UnsyncedData.pop_front();
-            return false;
-        }
-        // UnsyncedData.at(1).time - sync_time should be <= 0.2
-        if (UnsyncedData.at(1).time - sync_time > 0.2) {
-            UnsyncedData.pop_front();
-            return false;
-        }
-        break;
-    }
-    if (UnsyncedData.size() < 2)
+    double front_scale, back_scale;
+    if (!SeekSyncData(UnsyncedData, sync_time, front_scale, back_scale))
         return false;
 
-    IMUData front_data = UnsyncedData.at(0);
-    IMUData back_data = UnsyncedData.at(1);
+    const IMUData& front_data = UnsyncedData.at(0);
+    const IMUData& back_data = UnsyncedData.at(1);
     IMUData synced_data;
 
-    double front_scale = (back_data.time - sync_time) / (back_data.time - front_data.time);
-    double back_scale = (sync_time - front_data.time) / (back_data.time - front_data.time);
     synced_data.time = sync_time;
     synced_data.linear_acceleration.x = front_data.linear_acceleration.x * front_scale + back_data.linear_acceleration.x * back_scale;
     synced_data.linear_acceleration.y = front_data.linear_acceleration.y * front_scale + back_data.linear_acceleration.y * back_scale;
@@ -56,14 +36,14 @@ bool IMUData::SyncData(std::deque<IMUData>& UnsyncedData, std::deque<IMUData>& S
     synced_data.angular_velocity.x = front_data.angular_velocity.x * front_scale + back_data.angular_velocity.x * back_scale;
     synced_data.angular_velocity.y = front_data.angular_velocity.y * front_scale + back_data.angular_velocity.y * back_scale;
     synced_data.angular_velocity.z = front_data.angular_velocity.z * front_scale + back_data.angular_velocity.z * back_scale;
-    // 四元数插值有线性插值和球面插值，球面插值更准确，但是两个四元数差别不大是，二者精度相当
-    // 由于是对相邻两时刻姿态插值，姿态差比较小，所以可以用线性插值
-    synced_data.orientation.x = front_data.orientation.x * front_scale + back_data.orientation.x * back_scale;
-    synced_data.orientation.y = front_data.orientation.y * front_scale + back_data.orientation.y * back_scale;
-    synced_data.orientation.z = front_data.orientation.z * front_scale + back_data.orientation.z * back_scale;
-    synced_data.orientation.w = front_data.orientation.w * front_scale + back_data.orientation.w * back_scale;
-    // 线性插值之后要归一化
-    synced_data.orientation.Normlize();
+    // 四元数用球面插值, 姿态差较大时也能保持匀角速度, 且结果无需再归一化:
+    Eigen::Quaterniond front_q(front_data.orientation.w, front_data.orientation.x, front_data.orientation.y, front_data.orientation.z);
+    Eigen::Quaterniond back_q(back_data.orientation.w, back_data.orientation.x, back_data.orientation.y, back_data.orientation.z);
+    Eigen::Quaterniond synced_q = front_q.normalized().slerp(back_scale, back_q.normalized());
+    synced_data.orientation.x = synced_q.x();
+    synced_data.orientation.y = synced_q.y();
+    synced_data.orientation.z = synced_q.z();
+    synced_data.orientation.w = synced_q.w();
 
     SyncedData.push_back(synced_data);
 
@@ -0,0 +1,114 @@
+/*
+ * @Description: organized range image of a scan, rows by ring & columns by azimuth, for O(1) neighbor access
+ * @Author: Ge Yao
+ * @Date: 2021-01-19 21:05:38
+ */
+#include "lidar_localization/sensor_data/range_image.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/task_scheduler.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+namespace lidar_localization {
+
+namespace {
+const float DEG_TO_RAD = M_PI / 180.0f;
+}
+
+const int RangeImage::EMPTY;
+
+RangeImage::RangeImage(const YAML::Node& node)
+    : RangeImage(
+        node["num_rings"].as<int>(),
+        node["min_elevation"].as<float>(), node["max_elevation"].as<float>(),
+        node["num_columns"].as<int>()
+    ) {
+}
+
+RangeImage::RangeImage(int num_rings, float min_elevation, float max_elevation, int num_columns) {
+    num_rows_ = std::max(num_rings, 1);
+    min_elevation_ = min_elevation * DEG_TO_RAD;
+    inverse_elevation_res_ = num_rows_ / std::max((max_elevation - min_elevation) * DEG_TO_RAD, 1.0e-3f);
+    num_cols_ = std::max(num_columns, 1);
+    inverse_azimuth_res_ = num_cols_ / (2.0f * static_cast<float>(M_PI));
+}
+
+void RangeImage::Build(const CloudData::CLOUD& cloud) {
+    TRACE_SCOPE("RangeImage::Build", "filter");
+    const int N = static_cast<int>(cloud.points.size());
+
+    // a. cell of each point:
+    point_cells_.resize(N);
+    point_ranges_.resize(N);
+    TaskScheduler::GetInstance().ParallelFor(
+        0, N, 8192,
+        [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                const CloudData::POINT& point = cloud.points[i];
+
+                point_cells_[i] = EMPTY;
+                if (!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z))
+                    continue;
+
+                const float range_xy = std::sqrt(point.x * point.x + point.y * point.y);
+                if (range_xy <= 0.0f)
+                    continue;
+#if defined(LIDAR_LOCALIZATION_POINT_XYZIRT)
+                const int row = static_cast<int>(point.ring);
+#else
+                const int row = static_cast<int>(
+                    std::floor((std::atan2(point.z, range_xy) - min_elevation_) * inverse_elevation_res_)
+                );
+#endif
+                if (row < 0 || row >= num_rows_)
+                    continue;
+
+                int col = static_cast<int>((std::atan2(point.y, point.x) + M_PI) * inverse_azimuth_res_);
+                col = std::min(std::max(col, 0), num_cols_ - 1);
+
+                point_cells_[i] = row * num_cols_ + col;
+                point_ranges_[i] = std::sqrt(range_xy * range_xy + point.z * point.z);
+            }
+        }
+    );
+
+    // b. nearest point of each cell:
+    const int num_cells = num_rows_ * num_cols_;
+    cell_points_.assign(num_cells, EMPTY);
+    for (int i = 0; i < N; ++i) {
+        const int cell = point_cells_[i];
+        if (cell == EMPTY)
+            continue;
+
+        int& cell_point = cell_points_[cell];
+        if (cell_point == EMPTY || point_ranges_[i] < point_ranges_[cell_point]) {
+            cell_point = i;
+        }
+    }
+
+    // c. channels:
+    range_.resize(num_cells);
+    x_.resize(num_cells);
+    y_.resize(num_cells);
+    z_.resize(num_cells);
+    TaskScheduler::GetInstance().ParallelFor(
+        0, num_cells, 8192,
+        [&](int begin, int end) {
+            for (int cell = begin; cell < end; ++cell) {
+                const int i = cell_points_[cell];
+                if (i == EMPTY) {
+                    range_[cell] = x_[cell] = y_[cell] = z_[cell] = 0.0f;
+                    continue;
+                }
+
+                range_[cell] = point_ranges_[i];
+                x_[cell] = cloud.points[i].x;
+                y_[cell] = cloud.points[i].y;
+                z_[cell] = cloud.points[i].z;
+            }
+        }
+    );
+}
+
+}
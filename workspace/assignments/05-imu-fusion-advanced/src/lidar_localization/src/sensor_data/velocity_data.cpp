@@ -4,40 +4,25 @@
  * @Date: 2020-02-23 22:20:41
  */
 #include "lidar_localization/sensor_data/velocity_data.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/sensor_data/sync_data.hpp"
 
 #include "glog/logging.h"
 
 namespace lidar_localization {
 bool VelocityData::SyncData(std::deque<VelocityData>& UnsyncedData, std::deque<VelocityData>& SyncedData, double sync_time) {
+    TRACE_SCOPE("VelocityData::SyncData", "sync");
     // 传感器数据按时间序列排列，在传感器数据中为同步的时间点找到合适的时间位置
     // 即找到与同步时间相邻的左右两个数据
     // 需要注意的是，如果左右相邻数据有一个离同步时间差值比较大，则说明数据有丢失，时间离得太远不适合做差值
-    while (UnsyncedData.size() >= 2) {
-        if (UnsyncedData.front().time > sync_time)
-            return false;
-        if (UnsyncedData.at(1).time < sync_time) {
-            UnsyncedData.pop_front();
-            continue;
-        }
-        if (sync_time - UnsyncedData.front().time > 0.2) {
-            UnsyncedData.pop_front();
-            return false;
-        }
-        if (UnsyncedData.at(1).time - sync_time > 0.2) {
-            UnsyncedData.pop_front();
-            return false;
-        }
-        break;
-    }
-    if (UnsyncedData.size() < 2)
+    double front_scale, back_scale;
+    if (!SeekSyncData(UnsyncedData, sync_time, front_scale, back_scale))
         return false;
 
-    VelocityData front_data = UnsyncedData.at(0);
-    VelocityData back_data = UnsyncedData.at(1);
+    const VelocityData& front_data = UnsyncedData.at(0);
+    const VelocityData& back_data = UnsyncedData.at(1);
     VelocityData synced_data;
 
-    double front_scale = (back_data.time - sync_time) / (back_data.time - front_data.time);
-    double back_scale = (sync_time - front_data.time) / (back_data.time - front_data.time);
     synced_data.time = sync_time;
     synced_data.linear_velocity.x = front_data.linear_velocity.x * front_scale + back_data.linear_velocity.x * back_scale;
     synced_data.linear_velocity.y = front_data.linear_velocity.y * front_scale + back_data.linear_velocity.y * back_scale;
@@ -0,0 +1,272 @@
+/*
+ * @Description: lidar-IMU-GNSS fusion for localization by sliding window optimization
+ * @Author: Ge Yao
+ * @Date: 2020-12-25 10:06:18
+ */
+#include "lidar_localization/sliding_window/sliding_window.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/memory_usage.hpp"
+
+namespace lidar_localization {
+
+namespace {
+Eigen::VectorXd GetNoise(const YAML::Node& node) {
+    Eigen::VectorXd noise(node.size());
+    for (size_t i = 0; i < node.size(); ++i) {
+        noise(i) = node[i].as<double>();
+    }
+    return noise;
+}
+}
+
+SlidingWindow::SlidingWindow()
+    : missing_imu_(MetricsRegistry::GetInstance().GetCounter("sliding_window.missing_imu")),
+      failed_optimizations_(MetricsRegistry::GetInstance().GetCounter("sliding_window.failed_optimizations")) {
+    // load ROS config:
+    InitWithConfig();
+}
+
+bool SlidingWindow::InitWithConfig(void) {
+    std::string config_file_path = WORK_SPACE_PATH + "/config/sliding_window/sliding_window.yaml";
+    YAML::Node config_node = YAML::LoadFile(config_file_path);
+
+    std::cout << "-----------------Init Sliding Window-------------------" << std::endl;
+
+    window_size_ = std::max(config_node["window_size"].as<int>(), 1);
+    use_gnss_ = config_node["use_gnss"].as<bool>();
+    max_imu_gap_ = config_node["max_imu_gap"].as<double>();
+
+    const YAML::Node& measurement_node = config_node["measurement_noise"];
+    noise_.lidar_odometry = GetNoise(measurement_node["lidar_odometry"]);
+    noise_.gnss_position = GetNoise(measurement_node["gnss_position"]);
+    const YAML::Node& prior_node = config_node["prior_noise"];
+    noise_.prior_orientation = GetNoise(prior_node["orientation"]);
+    noise_.prior_velocity = GetNoise(prior_node["velocity"]);
+    noise_.prior_bias = GetNoise(prior_node["bias"]);
+
+    imu_pre_integrator_ptr_ = std::make_shared<IMUPreIntegrator>(config_node["imu_pre_integration"]);
+
+    const YAML::Node& optimizer_node = config_node["sliding_window_param"];
+    gravity_magnitude_ = optimizer_node["gravity_magnitude"].as<double>();
+    graph_optimizer_ptr_ = std::make_shared<SlidingWindowGraphOptimizer>(optimizer_node);
+    graph_optimizer_ptr_->SetEdgeRobustKernel(
+        config_node["robust_kernel"].as<std::string>(),
+        config_node["robust_kernel_size"].as<double>()
+    );
+
+    std::cout << "\tWindow Size: " << window_size_ << std::endl
+              << "\tUse GNSS: " << (use_gnss_ ? "true" : "false") << std::endl
+              << "\tRobust Kernel: " << config_node["robust_kernel"].as<std::string>() << std::endl
+              << std::endl;
+
+    return true;
+}
+
+void SlidingWindow::SetLidarToIMU(const Eigen::Matrix4f& lidar_to_imu) {
+    lidar_to_imu_ = lidar_to_imu.cast<double>();
+    imu_to_lidar_ = lidar_to_imu_.inverse();
+}
+
+void SlidingWindow::AddIMUData(const IMUData& imu_data) {
+    if (!imu_data_buff_.empty() && imu_data.time <= imu_data_buff_.back().time) {
+        return;
+    }
+
+    imu_data_buff_.push_back(imu_data);
+}
+
+bool SlidingWindow::HasIMUData(double time) const {
+    return !imu_data_buff_.empty() && imu_data_buff_.back().time >= time;
+}
+
+bool SlidingWindow::Init(const PoseData& laser_odom, const PoseData& gnss_pose) {
+    // IMU pose in map frame:
+    const Eigen::Matrix4d pose = gnss_pose.pose.cast<double>() * imu_to_lidar_;
+
+    state_ = SlidingWindowGraphOptimizer::NavState();
+    state_.pos = pose.block<3, 1>(0, 3);
+    state_.ori = pose.block<3, 3>(0, 0);
+    // the lever arm between lidar & IMU is neglected:
+    state_.vel = gnss_pose.pose.block<3, 3>(0, 0).cast<double>() * gnss_pose.vel.cast<double>();
+
+    graph_optimizer_ptr_->AddNavStateNode(state_, false);
+    const int index = graph_optimizer_ptr_->GetNodeNum() - 1;
+    graph_optimizer_ptr_->AddSe3PriorXYZEdge(index, state_.pos, noise_.gnss_position);
+    graph_optimizer_ptr_->AddSe3PriorQuaternionEdge(index, Eigen::Quaterniond(state_.ori), noise_.prior_orientation);
+    graph_optimizer_ptr_->AddVelocityPriorEdge(index, state_.vel, noise_.prior_velocity);
+    graph_optimizer_ptr_->AddBiasPriorEdge(index, state_.accel_bias, state_.gyro_bias, noise_.prior_bias);
+
+    time_ = laser_odom.time;
+    last_laser_odom_ = laser_odom.pose.cast<double>();
+
+    // measurements before the first node are no longer needed:
+    while (imu_data_buff_.size() >= 2 && imu_data_buff_.at(1).time <= time_) {
+        imu_data_buff_.pop_front();
+    }
+
+    has_inited_ = true;
+
+    LOG(INFO) << "Sliding window inited at " << std::fixed << time_ << ", position: " << state_.pos.transpose();
+
+    return true;
+}
+
+bool SlidingWindow::Update(const PoseData& laser_odom, const PoseData* gnss_pose_ptr) {
+    TRACE_SCOPE("SlidingWindow::Update", "fusion");
+    if (!has_inited_ || laser_odom.time <= time_) {
+        return false;
+    }
+
+    const int last_index = graph_optimizer_ptr_->GetNodeNum() - 1;
+    const int index = last_index + 1;
+
+    // a. relative lidar motion, as IMU motion:
+    const Eigen::Matrix4d laser_odom_pose = laser_odom.pose.cast<double>();
+    const Eigen::Matrix4d relative_pose = lidar_to_imu_ * last_laser_odom_.inverse() * laser_odom_pose * imu_to_lidar_;
+
+    // b. initial guess from IMU pre-integration, from lidar odometry without IMU:
+    SlidingWindowGraphOptimizer::NavState state = state_;
+    IMUPreIntegrator pre_integration = *imu_pre_integrator_ptr_;
+    const bool has_imu = PreIntegrate(time_, laser_odom.time, pre_integration);
+    if (has_imu) {
+        const double T = pre_integration.GetTime();
+        const Eigen::Vector3d g(0.0, 0.0, gravity_magnitude_);
+
+        state.pos = state_.pos + state_.vel*T - 0.5*g*T*T +
+                    state_.ori * pre_integration.GetDeltaPosition(state_.accel_bias, state_.gyro_bias);
+        state.vel = state_.vel - g*T +
+                    state_.ori * pre_integration.GetDeltaVelocity(state_.accel_bias, state_.gyro_bias);
+        state.ori = state_.ori * pre_integration.GetDeltaOrientation(state_.gyro_bias);
+    } else {
+        missing_imu_.Increment();
+        LOG_EVERY_N(WARNING, 10) << "IMU measurements do not cover " << std::fixed << time_ << " to " << laser_odom.time
+                                 << ", the node is only constrained by lidar odometry. " << missing_imu_.Get() << " in total.";
+
+        state.pos = state_.pos + state_.ori * relative_pose.block<3, 1>(0, 3);
+        state.ori = state_.ori * relative_pose.block<3, 3>(0, 0);
+    }
+
+    // c. add node & edges:
+    graph_optimizer_ptr_->AddNavStateNode(state, false);
+    if (has_imu) {
+        graph_optimizer_ptr_->AddIMUPreIntegrationEdge(last_index, index, pre_integration);
+    }
+
+    Eigen::Isometry3d relative_isometry(relative_pose);
+    graph_optimizer_ptr_->AddSe3Edge(last_index, index, relative_isometry, noise_.lidar_odometry);
+
+    if (use_gnss_ && gnss_pose_ptr != nullptr) {
+        // GNSS position is IMU position, see data pretreat:
+        const Eigen::Matrix4d gnss_pose = gnss_pose_ptr->pose.cast<double>() * imu_to_lidar_;
+        graph_optimizer_ptr_->AddSe3PriorXYZEdge(index, gnss_pose.block<3, 1>(0, 3), noise_.gnss_position);
+    }
+
+    // d. optimize, then marginalize the oldest nodes. the cost only depends on the window size:
+    if (!graph_optimizer_ptr_->Optimize()) {
+        failed_optimizations_.Increment();
+    }
+    graph_optimizer_ptr_->RemoveOldestSe3Nodes(window_size_);
+
+    time_ = laser_odom.time;
+    last_laser_odom_ = laser_odom_pose;
+    UpdateState();
+
+    return true;
+}
+
+void SlidingWindow::GetOdometry(Eigen::Matrix4f& pose, Eigen::Vector3f& vel) const {
+    Eigen::Matrix4d imu_pose = Eigen::Matrix4d::Identity();
+    imu_pose.block<3, 3>(0, 0) = state_.ori;
+    imu_pose.block<3, 1>(0, 3) = state_.pos;
+
+    const Eigen::Matrix4d lidar_pose = imu_pose * lidar_to_imu_;
+
+    pose = lidar_pose.cast<float>();
+    vel = (lidar_pose.block<3, 3>(0, 0).transpose() * state_.vel).cast<float>();
+}
+
+size_t SlidingWindow::GetIMUDataMemoryUsage(void) const {
+    return lidar_localization::GetMemoryUsage(imu_data_buff_);
+}
+
+size_t SlidingWindow::GetGraphMemoryUsage(void) const {
+    return graph_optimizer_ptr_->GetMemoryUsage();
+}
+
+bool SlidingWindow::GetIMUData(double time, IMUData& imu_data) const {
+    if (imu_data_buff_.empty() || imu_data_buff_.front().time > time || imu_data_buff_.back().time < time) {
+        return false;
+    }
+
+    size_t index = 1;
+    while (index < imu_data_buff_.size() && imu_data_buff_.at(index).time < time) {
+        ++index;
+    }
+    if (index == imu_data_buff_.size()) {
+        imu_data = imu_data_buff_.back();
+        return true;
+    }
+
+    const IMUData& prev = imu_data_buff_.at(index - 1);
+    const IMUData& next = imu_data_buff_.at(index);
+    if (next.time - prev.time > max_imu_gap_) {
+        return false;
+    }
+
+    const double s = (time - prev.time) / (next.time - prev.time);
+    imu_data = prev;
+    imu_data.time = time;
+    imu_data.linear_acceleration.x = (1.0 - s) * prev.linear_acceleration.x + s * next.linear_acceleration.x;
+    imu_data.linear_acceleration.y = (1.0 - s) * prev.linear_acceleration.y + s * next.linear_acceleration.y;
+    imu_data.linear_acceleration.z = (1.0 - s) * prev.linear_acceleration.z + s * next.linear_acceleration.z;
+    imu_data.angular_velocity.x = (1.0 - s) * prev.angular_velocity.x + s * next.angular_velocity.x;
+    imu_data.angular_velocity.y = (1.0 - s) * prev.angular_velocity.y + s * next.angular_velocity.y;
+    imu_data.angular_velocity.z = (1.0 - s) * prev.angular_velocity.z + s * next.angular_velocity.z;
+
+    return true;
+}
+
+bool SlidingWindow::PreIntegrate(double start_time, double end_time, IMUPreIntegrator& pre_integration) {
+    IMUData start_imu_data, end_imu_data;
+    bool has_imu = GetIMUData(start_time, start_imu_data) && GetIMUData(end_time, end_imu_data);
+
+    if (has_imu) {
+        pre_integration.Reset(start_imu_data, state_.accel_bias, state_.gyro_bias);
+
+        double last_time = start_time;
+        for (const IMUData& imu_data: imu_data_buff_) {
+            if (imu_data.time <= start_time)
+                continue;
+            if (imu_data.time >= end_time)
+                break;
+
+            if (imu_data.time - last_time > max_imu_gap_) {
+                has_imu = false;
+                break;
+            }
+            pre_integration.Integrate(imu_data);
+            last_time = imu_data.time;
+        }
+
+        if (has_imu) {
+            pre_integration.Integrate(end_imu_data);
+        }
+    }
+
+    // keep the last measurement before end_time for interpolation:
+    while (imu_data_buff_.size() >= 2 && imu_data_buff_.at(1).time <= end_time) {
+        imu_data_buff_.pop_front();
+    }
+
+    return has_imu;
+}
+
+void SlidingWindow::UpdateState(void) {
+    graph_optimizer_ptr_->GetOptimizedState(graph_optimizer_ptr_->GetNodeNum() - 1, state_);
+}
+
+} // namespace lidar_localization
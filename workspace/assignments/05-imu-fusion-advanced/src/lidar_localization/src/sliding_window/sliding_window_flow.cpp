@@ -0,0 +1,271 @@
+/*
+ * @Description: lidar-IMU-GNSS fusion for localization by sliding window optimization workflow
+ * @Author: Ge Yao
+ * @Date: 2020-12-25 10:06:18
+ */
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/tracer.hpp"
+
+#include "lidar_localization/sliding_window/sliding_window_flow.hpp"
+
+#include "lidar_localization/tools/file_manager.hpp"
+#include "lidar_localization/tools/memory_usage.hpp"
+
+#include "glog/logging.h"
+#include <cmath>
+#include <ostream>
+
+namespace lidar_localization {
+
+namespace {
+// lidar odometry is published at 10Hz, GNSS & IMU at 100Hz:
+const double MAX_TIME_DIFF = 0.05;
+// wait for the IMU & GNSS measurements of a lidar odometry only briefly, so that a lost sensor doesn't stall the fusion:
+const size_t MAX_WAITING_ODOMETRY = 5;
+}
+
+SlidingWindowFlow::SlidingWindowFlow(
+    ros::NodeHandle& nh
+) {
+    // subscriber:
+    // a. IMU raw measurement:
+    imu_raw_sub_ptr_ = std::make_shared<IMUSubscriber>(nh, "/kitti/oxts/imu/extract", 1000000);
+    // b. lidar odometry from front end:
+    laser_odom_sub_ptr_ = std::make_shared<OdometrySubscriber>(nh, "/laser_odom", 100000);
+    // c. lidar pose in map frame:
+    gnss_sub_ptr_ = std::make_shared<OdometrySubscriber>(nh, "/synced_gnss", 100000);
+    // d. lidar to imu tf:
+    lidar_to_imu_ptr_ = std::make_shared<TFListener>(nh, "/imu_link", "/velo_link");
+
+    // publisher, same as filtering:
+    // a. fused pose in map frame:
+    fused_odom_pub_ptr_ = std::make_shared<OdometryPublisher>(nh, "/fused_localization", "/map", "/lidar", 100);
+    // b. tf:
+    laser_tf_pub_ptr_ = std::make_shared<TFBroadCaster>("/map", "/vehicle_link");
+
+    sliding_window_ptr_ = std::make_shared<SlidingWindow>();
+
+    // metrics:
+    metrics_.AddQueue("imu_raw_queue", [this]{ return imu_raw_data_buff_.size(); });
+    metrics_.AddQueue("laser_odom_queue", [this]{ return laser_odom_data_buff_.size(); });
+    metrics_.AddQueue("gnss_queue", [this]{ return gnss_data_buff_.size(); });
+    metrics_.AddMemory("imu_raw_queue", [this]{ return GetMemoryUsage(imu_raw_data_buff_); });
+    metrics_.AddMemory("laser_odom_queue", [this]{ return GetMemoryUsage(laser_odom_data_buff_); });
+    metrics_.AddMemory("imu_data", [this]{ return sliding_window_ptr_->GetIMUDataMemoryUsage(); });
+    metrics_.AddMemory("graph", [this]{ return sliding_window_ptr_->GetGraphMemoryUsage(); });
+    update_latency_ptr_ = &metrics_.AddLatency("update_latency");
+    missing_gnss_ptr_ = &metrics_.AddCounter("missing_gnss");
+    latency_tracer_ptr_ = std::make_shared<LatencyTracer>(nh, "sliding_window", "/laser_odom", "/fused_localization", metrics_);
+}
+
+bool SlidingWindowFlow::Run() {
+    TRACE_SCOPE("SlidingWindowFlow::Run", "flow");
+    metrics_.UpdateQueues();
+    metrics_.UpdateMemory();
+
+    if ( !InitCalibration() ) {
+        return false;
+    }
+
+    ReadData();
+
+    while( HasData() ) {
+        if ( !ValidData() ) {
+            continue;
+        }
+
+        latency_tracer_ptr_->Start(current_laser_odom_data_.time);
+        if ( UpdateLocalization() ) {
+            latency_tracer_ptr_->Publish();
+            PublishFusionOdom();
+
+            // add to odometry output for evo evaluation:
+            UpdateOdometry(current_laser_odom_data_.time);
+        }
+    }
+
+    return true;
+}
+
+bool SlidingWindowFlow::SaveOdometry(void) {
+    if ( 0 == trajectory.N ) {
+        return false;
+    }
+
+    // init output files:
+    std::ofstream fused_odom_ofs;
+    std::ofstream ref_odom_ofs;
+    if (
+        !FileManager::CreateFile(fused_odom_ofs, WORK_SPACE_PATH + "/slam_data/trajectory/fused.txt") ||
+        !FileManager::CreateFile(ref_odom_ofs, WORK_SPACE_PATH + "/slam_data/trajectory/ground_truth.txt")
+    ) {
+        return false;
+    }
+
+    // write outputs:
+    for (size_t i = 0; i < trajectory.N; ++i) {
+        SavePose(trajectory.fused_.at(i), fused_odom_ofs);
+        SavePose(trajectory.gnss_.at(i), ref_odom_ofs);
+    }
+
+    return true;
+}
+
+bool SlidingWindowFlow::ReadData() {
+    //
+    // pipe raw IMU measurements into sliding window:
+    //
+    imu_raw_sub_ptr_->ParseData(imu_raw_data_buff_);
+    while ( !imu_raw_data_buff_.empty() ) {
+        sliding_window_ptr_->AddIMUData(imu_raw_data_buff_.front());
+        imu_raw_data_buff_.pop_front();
+    }
+
+    //
+    // pipe lidar odometry & GNSS measurements into buffer:
+    //
+    laser_odom_sub_ptr_->ParseData(laser_odom_data_buff_);
+    gnss_sub_ptr_->ParseData(gnss_data_buff_);
+
+    return true;
+}
+
+bool SlidingWindowFlow::InitCalibration() {
+    // lookup imu pose in lidar frame:
+    static bool calibration_received = false;
+
+    if (!calibration_received) {
+        Eigen::Matrix4f lidar_to_imu = Eigen::Matrix4f::Identity();
+        if (lidar_to_imu_ptr_->LookupData(lidar_to_imu)) {
+            sliding_window_ptr_->SetLidarToIMU(lidar_to_imu);
+            calibration_received = true;
+        }
+    }
+
+    return calibration_received;
+}
+
+bool SlidingWindowFlow::HasData() {
+    if ( laser_odom_data_buff_.empty() ) {
+        return false;
+    }
+
+    const double time = laser_odom_data_buff_.front().time;
+    if (
+        (
+            !sliding_window_ptr_->HasIMUData(time) ||
+            gnss_data_buff_.empty() || gnss_data_buff_.back().time < time - MAX_TIME_DIFF
+        ) &&
+        laser_odom_data_buff_.size() < MAX_WAITING_ODOMETRY
+    ) {
+        return false;
+    }
+
+    return true;
+}
+
+bool SlidingWindowFlow::ValidData() {
+    current_laser_odom_data_ = laser_odom_data_buff_.front();
+    laser_odom_data_buff_.pop_front();
+
+    has_current_gnss_data_ = GetGNSSData(current_laser_odom_data_.time, current_gnss_data_);
+
+    // the first node is placed at the GNSS pose:
+    if ( !sliding_window_ptr_->HasInited() && !has_current_gnss_data_ ) {
+        return false;
+    }
+
+    return true;
+}
+
+bool SlidingWindowFlow::GetGNSSData(const double time, PoseData& gnss_data) {
+    while (
+        !gnss_data_buff_.empty() &&
+        gnss_data_buff_.front().time < time - MAX_TIME_DIFF
+    ) {
+        gnss_data_buff_.pop_front();
+    }
+
+    if ( gnss_data_buff_.empty() || gnss_data_buff_.front().time > time + MAX_TIME_DIFF ) {
+        missing_gnss_ptr_->Increment();
+        return false;
+    }
+
+    gnss_data = gnss_data_buff_.front();
+    gnss_data_buff_.pop_front();
+
+    return true;
+}
+
+bool SlidingWindowFlow::UpdateLocalization() {
+    ScopedLatency latency(*update_latency_ptr_);
+
+    if ( !sliding_window_ptr_->HasInited() ) {
+        if ( sliding_window_ptr_->Init(current_laser_odom_data_, current_gnss_data_) ) {
+            LOG(INFO) << "Init sliding window with first GNSS measurement" << std::endl;
+            return true;
+        }
+
+        return false;
+    }
+
+    return sliding_window_ptr_->Update(
+        current_laser_odom_data_,
+        has_current_gnss_data_ ? &current_gnss_data_ : nullptr
+    );
+}
+
+bool SlidingWindowFlow::PublishFusionOdom() {
+    // get odometry from sliding window:
+    sliding_window_ptr_->GetOdometry(fused_pose_, fused_vel_);
+    // a. publish tf:
+    laser_tf_pub_ptr_->SendTransform(fused_pose_, current_laser_odom_data_.time);
+    // b. publish fusion odometry:
+    fused_odom_pub_ptr_->Publish(fused_pose_, fused_vel_, current_laser_odom_data_.time);
+
+    return true;
+}
+
+bool SlidingWindowFlow::UpdateOdometry(const double &time) {
+    // only poses with a GNSS reference are evaluated:
+    if ( !has_current_gnss_data_ ) {
+        return false;
+    }
+
+    trajectory.time_.push_back(time);
+
+    trajectory.fused_.push_back(fused_pose_);
+    trajectory.gnss_.push_back(current_gnss_data_.pose);
+
+    ++trajectory.N;
+
+    return true;
+}
+
+/**
+ * @brief  save pose in KITTI format for evo evaluation
+ * @param  pose, input pose
+ * @param  ofs, output file stream
+ * @return true if success otherwise false
+ */
+bool SlidingWindowFlow::SavePose(
+    const Eigen::Matrix4f& pose,
+    std::ofstream& ofs
+) {
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            ofs << pose(i, j);
+
+            if (i == 2 && j == 3) {
+                ofs << std::endl;
+            } else {
+                ofs << " ";
+            }
+        }
+    }
+
+    return true;
+}
+
+} // namespace lidar_localization
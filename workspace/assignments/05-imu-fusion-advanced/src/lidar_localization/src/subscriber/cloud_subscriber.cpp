@@ -5,37 +5,213 @@
  */
 
 #include "lidar_localization/subscriber/cloud_subscriber.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/offline_replay.hpp"
+#include "lidar_localization/tools/cloud_pool.hpp"
 
+#include "lidar_localization/global_defination/global_defination.h"
+
+#include <type_traits>
+
+#include <yaml-cpp/yaml.h>
 #include "glog/logging.h"
 
 namespace lidar_localization {
 CloudSubscriber::CloudSubscriber(ros::NodeHandle& nh, std::string topic_name, size_t buff_size)
-    :nh_(nh) {
-    subscriber_ = nh_.subscribe(topic_name, buff_size, &CloudSubscriber::msg_callback, this);
+    :nh_(nh), topic_name_(topic_name), buff_size_(buff_size), new_cloud_msgs_(buff_size), new_compressed_msgs_(buff_size) {
+    InitOptions(topic_name);
+
+    if (use_compressed_) {
+        subscriber_ = nh_.subscribe(
+            topic_name + "/compressed", buff_size, &CloudSubscriber::compressed_msg_callback, this
+        );
+        subscribe_time_ = std::chrono::steady_clock::now();
+    } else {
+        subscriber_ = OfflineReplay::GetInstance().Subscribe(nh_, topic_name, buff_size, &CloudSubscriber::msg_callback, this);
+    }
 }
 
-void CloudSubscriber::msg_callback(const sensor_msgs::PointCloud2::ConstPtr& cloud_msg_ptr) {
-    buff_mutex_.lock();
+bool CloudSubscriber::InitOptions(const std::string& topic_name) {
+    // shared by all cloud subscribers of the process:
+    static const YAML::Node config_node = YAML::LoadFile(WORK_SPACE_PATH + "/config/subscriber/cloud_subscriber.yaml");
+
+    const YAML::Node& default_node = config_node["default"];
+    const YAML::Node topic_node = config_node["topics"][topic_name];
+    auto get_option = [&](const std::string& name) {
+        return (topic_node && topic_node[name]) ? topic_node[name] : default_node[name];
+    };
+
+    const std::string transport = get_option("transport").as<std::string>();
+    fallback_timeout_ = get_option("fallback_timeout").as<double>();
+    if (transport == "compressed") {
+        // replayed and in-process clouds are raw:
+        use_compressed_ = !OfflineReplay::GetInstance().IsEnabled();
+    } else if (transport != "raw") {
+        LOG(ERROR) << "Cloud transport " << transport << " of " << topic_name << " NOT FOUND!";
+        return false;
+    }
+
+    if (use_compressed_) {
+        // decoded with the resolution of each message:
+        codec_ptr_ = std::make_shared<CloudCodec>(0.0f, false);
+    }
+
+    const YAML::Node range_image_node = get_option("range_image");
+    if (range_image_node && range_image_node["enabled"].as<bool>()) {
+        range_image_ptr_ = std::make_shared<RangeImage>(range_image_node);
+    }
 
-    // convert ROS PointCloud2 to pcl::PointCloud<pcl::PointXYZ>:
-    CloudData cloud_data;
-    cloud_data.time = cloud_msg_ptr->header.stamp.toSec();
-    pcl::fromROSMsg(*cloud_msg_ptr, *(cloud_data.cloud_ptr));
-    // add new message to buffer:
-    new_cloud_data_.push_back(cloud_data);
+    return true;
+}
+
+void CloudSubscriber::UpdateTransport(void) {
+    if (!use_compressed_ || has_compressed_publisher_)
+        return;
+
+    if (subscriber_.getNumPublishers() > 0) {
+        has_compressed_publisher_ = true;
+        return;
+    }
+
+    if (std::chrono::duration<double>(std::chrono::steady_clock::now() - subscribe_time_).count() < fallback_timeout_)
+        return;
+
+    LOG(WARNING) << "No publisher of " << topic_name_ << "/compressed after " << fallback_timeout_
+                 << " s, fall back to raw transport.";
+    subscriber_.shutdown();
+    subscriber_ = nh_.subscribe(topic_name_, buff_size_, &CloudSubscriber::msg_callback, this);
+    use_compressed_ = false;
+}
+
+void CloudSubscriber::msg_callback(const sensor_msgs::PointCloud2::ConstPtr& cloud_msg_ptr) {
+    TRACE_SCOPE("CloudSubscriber::msg_callback", "subscriber");
+    // add new message to buffer, sharing it with the other subscribers:
+    new_cloud_msgs_.Push(sensor_msgs::PointCloud2::ConstPtr(cloud_msg_ptr));
+}
 
-    buff_mutex_.unlock();
+void CloudSubscriber::compressed_msg_callback(const CompressedCloud::ConstPtr& compressed_msg_ptr) {
+    TRACE_SCOPE("CloudSubscriber::compressed_msg_callback", "subscriber");
+    new_compressed_msgs_.Push(CompressedCloud::ConstPtr(compressed_msg_ptr));
 }
 
 void CloudSubscriber::ParseData(std::deque<CloudData>& cloud_data_buff) {
-    buff_mutex_.lock();
+    TRACE_SCOPE("CloudSubscriber::ParseData", "subscriber");
+    UpdateTransport();
+
+    // received before any fallback, so they come first:
+    std::deque<CompressedCloud::ConstPtr> compressed_msgs;
+    new_compressed_msgs_.Drain(compressed_msgs);
+    for (const CompressedCloud::ConstPtr& compressed_msg_ptr: compressed_msgs) {
+        cloud_data_buff.emplace_back(CloudPool::GetInstance().Get());
+        if (!ParseCompressedData(*compressed_msg_ptr, cloud_data_buff.back())) {
+            cloud_data_buff.pop_back();
+            continue;
+        }
+        BuildRangeImage(cloud_data_buff.back());
+    }
+
+    std::deque<sensor_msgs::PointCloud2::ConstPtr> cloud_msgs;
+    new_cloud_msgs_.Drain(cloud_msgs);
+
+    // convert ROS PointCloud2 to pcl::PointCloud<CloudData::POINT>, in place in output buffer:
+    for (const sensor_msgs::PointCloud2::ConstPtr& cloud_msg_ptr: cloud_msgs) {
+        cloud_data_buff.emplace_back(CloudPool::GetInstance().Get());
+        ParseCloudData(*cloud_msg_ptr, cloud_data_buff.back());
+        ParsePointTimes(*cloud_msg_ptr, cloud_data_buff.back());
+        BuildRangeImage(cloud_data_buff.back());
+    }
+}
+
+void CloudSubscriber::BuildRangeImage(CloudData& cloud_data) {
+    if (!range_image_ptr_)
+        return;
+
+    std::shared_ptr<RangeImage> range_image_ptr = std::make_shared<RangeImage>(*range_image_ptr_);
+    range_image_ptr->Build(*cloud_data.cloud_ptr);
+    cloud_data.range_image_ptr = range_image_ptr;
+}
+
+void CloudSubscriber::ParseCloudData(const sensor_msgs::PointCloud2& cloud_msg, CloudData& cloud_data) {
+    cloud_data.time = cloud_msg.header.stamp.toSec();
+
+    int num_xyz_fields = 0;
+    for (const sensor_msgs::PointField& field: cloud_msg.fields) {
+        if (
+            (field.name == "x" || field.name == "y" || field.name == "z") &&
+            field.datatype == sensor_msgs::PointField::FLOAT32
+        ) {
+            ++num_xyz_fields;
+        }
+    }
+    // other layouts and richer point types go through the generic conversion:
+    if (num_xyz_fields != 3 || !std::is_same<CloudData::POINT, pcl::PointXYZ>::value) {
+        pcl::fromROSMsg(cloud_msg, *(cloud_data.cloud_ptr));
+        return;
+    }
+
+    CloudData::CLOUD& cloud = *(cloud_data.cloud_ptr);
+    pcl_conversions::toPCL(cloud_msg.header, cloud.header);
+    cloud.width = cloud_msg.width;
+    cloud.height = cloud_msg.height;
+    cloud.is_dense = (cloud_msg.is_dense == 1);
+    cloud.points.resize(cloud_msg.width * cloud_msg.height);
+
+    sensor_msgs::PointCloud2ConstIterator<float> iter_x(cloud_msg, "x");
+    sensor_msgs::PointCloud2ConstIterator<float> iter_y(cloud_msg, "y");
+    sensor_msgs::PointCloud2ConstIterator<float> iter_z(cloud_msg, "z");
+    for (CloudData::POINT& point: cloud.points) {
+        point.x = *iter_x;
+        point.y = *iter_y;
+        point.z = *iter_z;
+
+        ++iter_x;
+        ++iter_y;
+        ++iter_z;
+    }
+}
+
+bool CloudSubscriber::ParseCompressedData(const CompressedCloud& compressed_msg, CloudData& cloud_data) {
+    cloud_data.time = compressed_msg.header.stamp.toSec();
+
+    CloudCodec::FrameInfo info;
+    info.num_points = compressed_msg.num_points;
+    info.resolution = compressed_msg.resolution;
+    info.compression = compressed_msg.compression;
+    info.raw_size = compressed_msg.raw_size;
+
+    CloudData::CLOUD& cloud = *(cloud_data.cloud_ptr);
+    pcl_conversions::toPCL(compressed_msg.header, cloud.header);
+    if (!codec_ptr_->Decode(info, compressed_msg.data, cloud)) {
+        LOG(WARNING) << "Drop corrupted compressed cloud of " << topic_name_ << " at " << cloud_data.time;
+        return false;
+    }
+
+    return true;
+}
+
+void CloudSubscriber::ParsePointTimes(const sensor_msgs::PointCloud2& cloud_msg, CloudData& cloud_data) {
+    const size_t num_points = cloud_msg.width * cloud_msg.height;
+
+    for (const sensor_msgs::PointField& field: cloud_msg.fields) {
+        if (field.name == "time" && field.datatype == sensor_msgs::PointField::FLOAT32) {
+            cloud_data.point_times_ptr = std::make_shared<CloudData::POINT_TIMES>(num_points);
+            sensor_msgs::PointCloud2ConstIterator<float> iter_time(cloud_msg, "time");
+            for (float& point_time: *cloud_data.point_times_ptr) {
+                point_time = *iter_time;
+                ++iter_time;
+            }
+            return;
+        }
 
-    // pipe all available measurements to output buffer:
-    if (new_cloud_data_.size() > 0) {
-        cloud_data_buff.insert(cloud_data_buff.end(), new_cloud_data_.begin(), new_cloud_data_.end());
-        new_cloud_data_.clear();
+        if (field.name == "t" && field.datatype == sensor_msgs::PointField::UINT32) {
+            cloud_data.point_times_ptr = std::make_shared<CloudData::POINT_TIMES>(num_points);
+            sensor_msgs::PointCloud2ConstIterator<uint32_t> iter_t(cloud_msg, "t");
+            for (float& point_time: *cloud_data.point_times_ptr) {
+                point_time = 1.0e-9 * (*iter_t);
+                ++iter_t;
+            }
+            return;
+        }
     }
-    
-    buff_mutex_.unlock();
 }
-} // namespace data_input
\ No newline at end of file
+} // namespace data_input
@@ -4,18 +4,19 @@
  * @Date: 2019-03-31 13:10:51
  */
 #include "lidar_localization/subscriber/gnss_subscriber.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/offline_replay.hpp"
 
 #include "glog/logging.h"
 
 namespace lidar_localization {
 GNSSSubscriber::GNSSSubscriber(ros::NodeHandle& nh, std::string topic_name, size_t buff_size) 
-    :nh_(nh) {
-    subscriber_ = nh_.subscribe(topic_name, buff_size, &GNSSSubscriber::msg_callback, this);
+    :nh_(nh), new_gnss_data_(buff_size) {
+    subscriber_ = OfflineReplay::GetInstance().Subscribe(nh_, topic_name, buff_size, &GNSSSubscriber::msg_callback, this);
 }
 
 void GNSSSubscriber::msg_callback(const sensor_msgs::NavSatFixConstPtr& nav_sat_fix_ptr) {
-    buff_mutex_.lock();
-
+    TRACE_SCOPE("GNSSSubscriber::msg_callback", "subscriber");
     // convert ROS NavSatFix to GeographicLib compatible GNSS message:
     GNSSData gnss_data;
     gnss_data.time = nav_sat_fix_ptr->header.stamp.toSec();
@@ -25,20 +26,12 @@ void GNSSSubscriber::msg_callback(const sensor_msgs::NavSatFixConstPtr& nav_sat_
     gnss_data.status = nav_sat_fix_ptr->status.status;
     gnss_data.service = nav_sat_fix_ptr->status.service;
     // add new message to buffer:
-    new_gnss_data_.push_back(gnss_data);
-
-    buff_mutex_.unlock();
+    new_gnss_data_.Push(std::move(gnss_data));
 }
 
 void GNSSSubscriber::ParseData(std::deque<GNSSData>& gnss_data_buff) {
-    buff_mutex_.lock();
-
-    // pipe all available measurements to output buffer:
-    if (new_gnss_data_.size() > 0) {
-        gnss_data_buff.insert(gnss_data_buff.end(), new_gnss_data_.begin(), new_gnss_data_.end());
-        new_gnss_data_.clear();
-    }
-
-    buff_mutex_.unlock();
+    TRACE_SCOPE("GNSSSubscriber::ParseData", "subscriber");
+    // move all available measurements to output buffer:
+    new_gnss_data_.Drain(gnss_data_buff);
 }
 }
\ No newline at end of file
@@ -4,17 +4,18 @@
  * @Date: 2019-06-14 16:44:18
  */
 #include "lidar_localization/subscriber/imu_subscriber.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/offline_replay.hpp"
 #include "glog/logging.h"
 
 namespace lidar_localization{
 IMUSubscriber::IMUSubscriber(ros::NodeHandle& nh, std::string topic_name, size_t buff_size)
-    :nh_(nh) {
-    subscriber_ = nh_.subscribe(topic_name, buff_size, &IMUSubscriber::msg_callback, this);
+    :nh_(nh), new_imu_data_(buff_size) {
+    subscriber_ = OfflineReplay::GetInstance().Subscribe(nh_, topic_name, buff_size, &IMUSubscriber::msg_callback, this);
 }
 
 void IMUSubscriber::msg_callback(const sensor_msgs::ImuConstPtr& imu_msg_ptr) {
-    buff_mutex_.lock();
-
+    TRACE_SCOPE("IMUSubscriber::msg_callback", "subscriber");
     // convert ROS IMU to GeographicLib compatible GNSS message:
     IMUData imu_data;
     imu_data.time = imu_msg_ptr->header.stamp.toSec();
@@ -33,20 +34,12 @@ void IMUSubscriber::msg_callback(const sensor_msgs::ImuConstPtr& imu_msg_ptr) {
     imu_data.orientation.w = imu_msg_ptr->orientation.w;
     
     // add new message to buffer:
-    new_imu_data_.push_back(imu_data);
-    
-    buff_mutex_.unlock();
+    new_imu_data_.Push(std::move(imu_data));
 }
 
 void IMUSubscriber::ParseData(std::deque<IMUData>& imu_data_buff) {
-    buff_mutex_.lock();
-
-    // pipe all available measurements to output buffer:
-    if (new_imu_data_.size() > 0) {
-        imu_data_buff.insert(imu_data_buff.end(), new_imu_data_.begin(), new_imu_data_.end());
-        new_imu_data_.clear();
-    }
-
-    buff_mutex_.unlock();
+    TRACE_SCOPE("IMUSubscriber::ParseData", "subscriber");
+    // move all available measurements to output buffer:
+    new_imu_data_.Drain(imu_data_buff);
 }
 }
\ No newline at end of file
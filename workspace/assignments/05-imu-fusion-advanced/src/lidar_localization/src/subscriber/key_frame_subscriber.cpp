@@ -4,16 +4,18 @@
  * @Date: 2019-06-14 16:44:18
  */
 #include "lidar_localization/subscriber/key_frame_subscriber.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/offline_replay.hpp"
 #include "glog/logging.h"
 
 namespace lidar_localization{
 KeyFrameSubscriber::KeyFrameSubscriber(ros::NodeHandle& nh, std::string topic_name, size_t buff_size)
-    :nh_(nh) {
-    subscriber_ = nh_.subscribe(topic_name, buff_size, &KeyFrameSubscriber::msg_callback, this);
+    :nh_(nh), new_key_frame_(buff_size) {
+    subscriber_ = OfflineReplay::GetInstance().Subscribe(nh_, topic_name, buff_size, &KeyFrameSubscriber::msg_callback, this);
 }
 
 void KeyFrameSubscriber::msg_callback(const geometry_msgs::PoseWithCovarianceStampedConstPtr& key_frame_msg_ptr) {
-    buff_mutex_.lock();
+    TRACE_SCOPE("KeyFrameSubscriber::msg_callback", "subscriber");
     KeyFrame key_frame;
     key_frame.time = key_frame_msg_ptr->header.stamp.toSec();
     key_frame.index = (unsigned int)key_frame_msg_ptr->pose.covariance[0];
@@ -29,16 +31,12 @@ void KeyFrameSubscriber::msg_callback(const geometry_msgs::PoseWithCovarianceSta
     q.w() = key_frame_msg_ptr->pose.pose.orientation.w;
     key_frame.pose.block<3,3>(0,0) = q.matrix();
 
-    new_key_frame_.push_back(key_frame);
-    buff_mutex_.unlock();
+    new_key_frame_.Push(std::move(key_frame));
 }
 
 void KeyFrameSubscriber::ParseData(std::deque<KeyFrame>& key_frame_buff) {
-    buff_mutex_.lock();
-    if (new_key_frame_.size() > 0) {
-        key_frame_buff.insert(key_frame_buff.end(), new_key_frame_.begin(), new_key_frame_.end());
-        new_key_frame_.clear();
-    }
-    buff_mutex_.unlock();
+    TRACE_SCOPE("KeyFrameSubscriber::ParseData", "subscriber");
+    // move all available measurements to output buffer:
+    new_key_frame_.Drain(key_frame_buff);
 }
 }
\ No newline at end of file
@@ -4,15 +4,22 @@
  * @Date: 2019-06-14 16:44:18
  */
 #include "lidar_localization/subscriber/key_frames_subscriber.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/offline_replay.hpp"
 #include "glog/logging.h"
 
 namespace lidar_localization{
-KeyFramesSubscriber::KeyFramesSubscriber(ros::NodeHandle& nh, std::string topic_name, size_t buff_size)
+KeyFramesSubscriber::KeyFramesSubscriber(ros::NodeHandle& nh, std::string topic_name, size_t buff_size, bool is_incremental)
     :nh_(nh) {
-    subscriber_ = nh_.subscribe(topic_name, buff_size, &KeyFramesSubscriber::msg_callback, this);
+    if (is_incremental) {
+        subscriber_ = OfflineReplay::GetInstance().Subscribe(nh_, topic_name + "/incremental", buff_size, &KeyFramesSubscriber::updates_callback, this);
+    } else {
+        subscriber_ = OfflineReplay::GetInstance().Subscribe(nh_, topic_name, buff_size, &KeyFramesSubscriber::msg_callback, this);
+    }
 }
 
 void KeyFramesSubscriber::msg_callback(const nav_msgs::Path::ConstPtr& key_frames_msg_ptr) {
+    TRACE_SCOPE("KeyFramesSubscriber::msg_callback", "subscriber");
     buff_mutex_.lock();
     new_key_frames_.clear();
 
@@ -37,12 +44,63 @@ void KeyFramesSubscriber::msg_callback(const nav_msgs::Path::ConstPtr& key_frame
     buff_mutex_.unlock();
 }
 
+void KeyFramesSubscriber::updates_callback(const KeyFrameUpdates::ConstPtr& updates_msg_ptr) {
+    TRACE_SCOPE("KeyFramesSubscriber::updates_callback", "subscriber");
+    std::lock_guard<std::mutex> lock(buff_mutex_);
+
+    if (updates_msg_ptr->is_snapshot) {
+        key_frames_.clear();
+        first_updated_ = 0;
+        has_updates_ = true;
+    }
+
+    // merge into the trajectory, both sorted by index:
+    size_t j = 0;
+    for (size_t i = 0; i < updates_msg_ptr->indices.size(); ++i) {
+        KeyFrame key_frame;
+        key_frame.index = updates_msg_ptr->indices.at(i);
+        key_frame.time = updates_msg_ptr->times.at(i);
+
+        const geometry_msgs::Pose& pose = updates_msg_ptr->poses.at(i);
+        key_frame.pose(0,3) = pose.position.x;
+        key_frame.pose(1,3) = pose.position.y;
+        key_frame.pose(2,3) = pose.position.z;
+
+        Eigen::Quaternionf q;
+        q.x() = pose.orientation.x;
+        q.y() = pose.orientation.y;
+        q.z() = pose.orientation.z;
+        q.w() = pose.orientation.w;
+        key_frame.pose.block<3,3>(0,0) = q.matrix();
+
+        while (j < key_frames_.size() && key_frames_.at(j).index < key_frame.index) {
+            ++j;
+        }
+        if (j < key_frames_.size() && key_frames_.at(j).index == key_frame.index) {
+            key_frames_.at(j) = key_frame;
+        } else {
+            key_frames_.insert(key_frames_.begin() + j, key_frame);
+        }
+
+        if (!has_updates_ || j < first_updated_) {
+            first_updated_ = j;
+            has_updates_ = true;
+        }
+    }
+}
+
 void KeyFramesSubscriber::ParseData(std::deque<KeyFrame>& key_frames_buff) {
+    TRACE_SCOPE("KeyFramesSubscriber::ParseData", "subscriber");
     buff_mutex_.lock();
     if (new_key_frames_.size() > 0) {
         key_frames_buff = new_key_frames_;
         new_key_frames_.clear();
     }
+    // incremental, the unchanged head is left out:
+    if (has_updates_) {
+        key_frames_buff.assign(key_frames_.begin() + first_updated_, key_frames_.end());
+        has_updates_ = false;
+    }
     buff_mutex_.unlock();
 }
 }
\ No newline at end of file
@@ -5,6 +5,8 @@
  */
 
 #include "lidar_localization/subscriber/lidar_measurement_subscriber.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/offline_replay.hpp"
 
 #include "glog/logging.h"
 
@@ -15,22 +17,16 @@ LidarMeasurementSubscriber::LidarMeasurementSubscriber(
     std::string topic_name, 
     size_t buff_size
 )
-    :nh_(nh) {
-    subscriber_ = nh_.subscribe(topic_name, buff_size, &LidarMeasurementSubscriber::msg_callback, this);
+    :nh_(nh), new_cloud_data_(buff_size) {
+    subscriber_ = OfflineReplay::GetInstance().Subscribe(nh_, topic_name, buff_size, &LidarMeasurementSubscriber::msg_callback, this);
 }
 
 void LidarMeasurementSubscriber::ParseData(
     std::deque<LidarMeasurementData>& cloud_data_buff
 ) {
-    buff_mutex_.lock();
-
-    // pipe all available measurements to output buffer:
-    if (new_cloud_data_.size() > 0) {
-        cloud_data_buff.insert(cloud_data_buff.end(), new_cloud_data_.begin(), new_cloud_data_.end());
-        new_cloud_data_.clear();
-    }
-    
-    buff_mutex_.unlock();
+    TRACE_SCOPE("LidarMeasurementSubscriber::ParseData", "subscriber");
+    // move all available measurements to output buffer:
+    new_cloud_data_.Drain(cloud_data_buff);
 }
 
 void LidarMeasurementSubscriber::ParseCloudData(
@@ -89,8 +85,7 @@ void LidarMeasurementSubscriber::ParsePoseData(
 void LidarMeasurementSubscriber::msg_callback(
     const LidarMeasurement::ConstPtr& synced_cloud_msg_ptr
 ) {
-    buff_mutex_.lock();
-
+    TRACE_SCOPE("LidarMeasurementSubscriber::msg_callback", "subscriber");
     LidarMeasurementData synced_cloud_data;
     
     // parse header:
@@ -106,9 +101,7 @@ void LidarMeasurementSubscriber::msg_callback(
     ParsePoseData(synced_cloud_msg_ptr->gnss_odometry, synced_cloud_data.gnss_odometry);
 
     // add new message to buffer:
-    new_cloud_data_.push_back(synced_cloud_data);
-
-    buff_mutex_.unlock();
+    new_cloud_data_.Push(std::move(synced_cloud_data));
 }
 
 } // namespace lidar_localization
\ No newline at end of file
@@ -4,16 +4,18 @@
  * @Date: 2019-06-14 16:44:18
  */
 #include "lidar_localization/subscriber/loop_pose_subscriber.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/offline_replay.hpp"
 #include "glog/logging.h"
 
 namespace lidar_localization{
 LoopPoseSubscriber::LoopPoseSubscriber(ros::NodeHandle& nh, std::string topic_name, size_t buff_size)
-    :nh_(nh) {
-    subscriber_ = nh_.subscribe(topic_name, buff_size, &LoopPoseSubscriber::msg_callback, this);
+    :nh_(nh), new_loop_pose_(buff_size) {
+    subscriber_ = OfflineReplay::GetInstance().Subscribe(nh_, topic_name, buff_size, &LoopPoseSubscriber::msg_callback, this);
 }
 
 void LoopPoseSubscriber::msg_callback(const geometry_msgs::PoseWithCovarianceStampedConstPtr& loop_pose_msg_ptr) {
-    buff_mutex_.lock();
+    TRACE_SCOPE("LoopPoseSubscriber::msg_callback", "subscriber");
     LoopPose loop_pose;
     loop_pose.time = loop_pose_msg_ptr->header.stamp.toSec();
     loop_pose.index0 = (unsigned int)loop_pose_msg_ptr->pose.covariance[0];
@@ -30,16 +32,12 @@ void LoopPoseSubscriber::msg_callback(const geometry_msgs::PoseWithCovarianceSta
     q.w() = loop_pose_msg_ptr->pose.pose.orientation.w;
     loop_pose.pose.block<3,3>(0,0) = q.matrix();
 
-    new_loop_pose_.push_back(loop_pose);
-    buff_mutex_.unlock();
+    new_loop_pose_.Push(std::move(loop_pose));
 }
 
 void LoopPoseSubscriber::ParseData(std::deque<LoopPose>& loop_pose_buff) {
-    buff_mutex_.lock();
-    if (new_loop_pose_.size() > 0) {
-        loop_pose_buff.insert(loop_pose_buff.end(), new_loop_pose_.begin(), new_loop_pose_.end());
-        new_loop_pose_.clear();
-    }
-    buff_mutex_.unlock();
+    TRACE_SCOPE("LoopPoseSubscriber::ParseData", "subscriber");
+    // move all available measurements to output buffer:
+    new_loop_pose_.Drain(loop_pose_buff);
 }
 }
\ No newline at end of file
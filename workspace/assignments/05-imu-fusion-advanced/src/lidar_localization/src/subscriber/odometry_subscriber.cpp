@@ -4,16 +4,18 @@
  * @Date: 2019-06-14 16:44:18
  */
 #include "lidar_localization/subscriber/odometry_subscriber.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/offline_replay.hpp"
 #include "glog/logging.h"
 
 namespace lidar_localization{
 OdometrySubscriber::OdometrySubscriber(ros::NodeHandle& nh, std::string topic_name, size_t buff_size)
-    :nh_(nh) {
-    subscriber_ = nh_.subscribe(topic_name, buff_size, &OdometrySubscriber::msg_callback, this);
+    :nh_(nh), new_pose_data_(buff_size) {
+    subscriber_ = OfflineReplay::GetInstance().Subscribe(nh_, topic_name, buff_size, &OdometrySubscriber::msg_callback, this);
 }
 
 void OdometrySubscriber::msg_callback(const nav_msgs::OdometryConstPtr& odom_msg_ptr) {
-    buff_mutex_.lock();
+    TRACE_SCOPE("OdometrySubscriber::msg_callback", "subscriber");
     PoseData pose_data;
     pose_data.time = odom_msg_ptr->header.stamp.toSec();
 
@@ -35,17 +37,12 @@ void OdometrySubscriber::msg_callback(const nav_msgs::OdometryConstPtr& odom_msg
     pose_data.vel.y() = odom_msg_ptr->twist.twist.linear.y;
     pose_data.vel.z() = odom_msg_ptr->twist.twist.linear.z;
 
-    new_pose_data_.push_back(pose_data);
-    
-    buff_mutex_.unlock();
+    new_pose_data_.Push(std::move(pose_data));
 }
 
 void OdometrySubscriber::ParseData(std::deque<PoseData>& pose_data_buff) {
-    buff_mutex_.lock();
-    if (new_pose_data_.size() > 0) {
-        pose_data_buff.insert(pose_data_buff.end(), new_pose_data_.begin(), new_pose_data_.end());
-        new_pose_data_.clear();
-    }
-    buff_mutex_.unlock();
+    TRACE_SCOPE("OdometrySubscriber::ParseData", "subscriber");
+    // move all available measurements to output buffer:
+    new_pose_data_.Drain(pose_data_buff);
 }
 }
\ No newline at end of file
@@ -5,6 +5,8 @@
  */
 
 #include "lidar_localization/subscriber/pos_vel_subscriber.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/offline_replay.hpp"
 #include "glog/logging.h"
 
 namespace lidar_localization{
@@ -14,13 +16,12 @@ PosVelSubscriber::PosVelSubscriber(
     std::string topic_name, 
     size_t buff_size
 )
-    :nh_(nh) {
-    subscriber_ = nh_.subscribe(topic_name, buff_size, &PosVelSubscriber::msg_callback, this);
+    :nh_(nh), new_pos_vel_data_(buff_size) {
+    subscriber_ = OfflineReplay::GetInstance().Subscribe(nh_, topic_name, buff_size, &PosVelSubscriber::msg_callback, this);
 }
 
 void PosVelSubscriber::msg_callback(const PosVelConstPtr& pos_vel_msg_ptr) {
-    buff_mutex_.lock();
-
+    TRACE_SCOPE("PosVelSubscriber::msg_callback", "subscriber");
     PosVelData pos_vel_data;
     pos_vel_data.time = pos_vel_msg_ptr->header.stamp.toSec();
 
@@ -34,23 +35,13 @@ void PosVelSubscriber::msg_callback(const PosVelConstPtr& pos_vel_msg_ptr) {
     pos_vel_data.vel.y() = pos_vel_msg_ptr->velocity.y;
     pos_vel_data.vel.z() = pos_vel_msg_ptr->velocity.z;
 
-    new_pos_vel_data_.push_back(pos_vel_data);
-    
-    buff_mutex_.unlock();
+    new_pos_vel_data_.Push(std::move(pos_vel_data));
 }
 
 void PosVelSubscriber::ParseData(std::deque<PosVelData>& pos_vel_data_buff) {
-    buff_mutex_.lock();
-
-    if ( new_pos_vel_data_.size() > 0 ) {
-        pos_vel_data_buff.insert(
-            pos_vel_data_buff.end(), 
-            new_pos_vel_data_.begin(), new_pos_vel_data_.end()
-        );
-        new_pos_vel_data_.clear();
-    }
-
-    buff_mutex_.unlock();
+    TRACE_SCOPE("PosVelSubscriber::ParseData", "subscriber");
+    // move all available measurements to output buffer:
+    new_pos_vel_data_.Drain(pos_vel_data_buff);
 }
 
 } // namespace lidar_localization
\ No newline at end of file
@@ -4,17 +4,19 @@
  * @Date: 2019-06-14 16:44:18
  */
 #include "lidar_localization/subscriber/velocity_subscriber.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/offline_replay.hpp"
 
 #include "glog/logging.h"
 
 namespace lidar_localization{
 VelocitySubscriber::VelocitySubscriber(ros::NodeHandle& nh, std::string topic_name, size_t buff_size)
-    :nh_(nh) {
-    subscriber_ = nh_.subscribe(topic_name, buff_size, &VelocitySubscriber::msg_callback, this);
+    :nh_(nh), new_velocity_data_(buff_size) {
+    subscriber_ = OfflineReplay::GetInstance().Subscribe(nh_, topic_name, buff_size, &VelocitySubscriber::msg_callback, this);
 }
 
 void VelocitySubscriber::msg_callback(const geometry_msgs::TwistStampedConstPtr& twist_msg_ptr) {
-    buff_mutex_.lock();
+    TRACE_SCOPE("VelocitySubscriber::msg_callback", "subscriber");
     VelocityData velocity_data;
     velocity_data.time = twist_msg_ptr->header.stamp.toSec();
 
@@ -26,16 +28,12 @@ void VelocitySubscriber::msg_callback(const geometry_msgs::TwistStampedConstPtr&
     velocity_data.angular_velocity.y = twist_msg_ptr->twist.angular.y;
     velocity_data.angular_velocity.z = twist_msg_ptr->twist.angular.z;
 
-    new_velocity_data_.push_back(velocity_data);
-    buff_mutex_.unlock();
+    new_velocity_data_.Push(std::move(velocity_data));
 }
 
 void VelocitySubscriber::ParseData(std::deque<VelocityData>& velocity_data_buff) {
-    buff_mutex_.lock();
-    if (new_velocity_data_.size() > 0) {
-        velocity_data_buff.insert(velocity_data_buff.end(), new_velocity_data_.begin(), new_velocity_data_.end());
-        new_velocity_data_.clear();
-    }
-    buff_mutex_.unlock();
+    TRACE_SCOPE("VelocitySubscriber::ParseData", "subscriber");
+    // move all available measurements to output buffer:
+    new_velocity_data_.Drain(velocity_data_buff);
 }
 }
\ No newline at end of file
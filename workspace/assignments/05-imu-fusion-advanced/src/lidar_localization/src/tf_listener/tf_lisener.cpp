@@ -4,12 +4,26 @@
  * @Date: 2020-02-06 16:10:31
  */
 #include "lidar_localization/tf_listener/tf_listener.hpp"
+#include "lidar_localization/tools/offline_replay.hpp"
 
 #include <Eigen/Geometry>
 
 namespace lidar_localization {
 TFListener::TFListener(ros::NodeHandle& nh, std::string base_frame_id, std::string child_frame_id) 
     :nh_(nh), base_frame_id_(base_frame_id), child_frame_id_(child_frame_id) {
+    // offline, transforms are replayed from rosbag instead of received by listener:
+    if (OfflineReplay::GetInstance().IsEnabled()) {
+        OfflineReplay::GetInstance().Subscribe(nh_, "/tf", 100, &TFListener::tf_callback, this);
+        OfflineReplay::GetInstance().Subscribe(nh_, "/tf_static", 100, &TFListener::tf_callback, this);
+    }
+}
+
+void TFListener::tf_callback(const tf2_msgs::TFMessageConstPtr& tf_msg_ptr) {
+    for (const geometry_msgs::TransformStamped& transform_msg: tf_msg_ptr->transforms) {
+        tf::StampedTransform transform;
+        tf::transformStampedMsgToTF(transform_msg, transform);
+        listener_.setTransform(transform, "offline_replay");
+    }
 }
 
 bool TFListener::LookupData(Eigen::Matrix4f& transform_matrix) {
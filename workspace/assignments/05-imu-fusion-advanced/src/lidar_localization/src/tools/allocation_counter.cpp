@@ -0,0 +1,92 @@
+/*
+ * @Description: per-thread count of heap allocations, for benchmarks of hot paths that should not allocate
+ * @Author: Ge Yao
+ * @Date: 2021-01-19 10:14:27
+ */
+#include "lidar_localization/tools/allocation_counter.hpp"
+
+#include <cerrno>
+#include <cstddef>
+
+#if defined(LIDAR_LOCALIZATION_COUNT_ALLOCATIONS) && defined(__GLIBC__)
+#define ALLOCATION_COUNTER_ENABLED
+
+namespace {
+// trivial, so that it is in static TLS & never allocates itself:
+thread_local uint64_t num_allocations = 0;
+}
+
+// the allocator of glibc under the interposed names:
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t num, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size) {
+    ++num_allocations;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size) {
+    ++num_allocations;
+    return __libc_calloc(num, size);
+}
+
+// growing in place is counted too, it may move:
+void *realloc(void *ptr, size_t size) {
+    ++num_allocations;
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    ++num_allocations;
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    ++num_allocations;
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+    if (0 == alignment || 0 != (alignment & (alignment - 1)) || 0 != alignment % sizeof(void *)) {
+        return EINVAL;
+    }
+
+    ++num_allocations;
+    void *result = __libc_memalign(alignment, size);
+    if (nullptr == result) {
+        return ENOMEM;
+    }
+    *ptr = result;
+
+    return 0;
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+}
+#endif
+
+namespace lidar_localization {
+
+bool AllocationCounter::IsEnabled(void) {
+#ifdef ALLOCATION_COUNTER_ENABLED
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint64_t AllocationCounter::GetNumAllocations(void) {
+#ifdef ALLOCATION_COUNTER_ENABLED
+    return num_allocations;
+#else
+    return 0;
+#endif
+}
+
+} // namespace lidar_localization
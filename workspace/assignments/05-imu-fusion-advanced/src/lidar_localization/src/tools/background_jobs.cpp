@@ -0,0 +1,135 @@
+/*
+ * @Description: save & optimize jobs of the services, run in the background on state captured by the caller
+ * @Author: Ge Yao
+ * @Date: 2021-01-31 20:16:08
+ */
+#include "lidar_localization/tools/background_jobs.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+namespace {
+// progress is published in steps of at least 1%:
+const double MIN_PROGRESS_STEP = 0.01;
+}
+
+BackgroundJobs::BackgroundJobs(ros::NodeHandle& nh)
+    : publisher_(nh.advertise<JobStatus>("background_jobs", 16, true)),
+      thread_(&BackgroundJobs::Run, this) {
+}
+
+BackgroundJobs::~BackgroundJobs() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    has_task_.notify_one();
+
+    // the worker drains the queue before it exits:
+    thread_.join();
+}
+
+uint32_t BackgroundJobs::Submit(const std::string& name, Job job) {
+    if (!job)
+        return 0;
+
+    uint32_t id = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = std::find_if(
+            queue_.begin(), queue_.end(), [&name](const Task& queued) { return queued.name == name; }
+        );
+        if (it != queue_.end()) {
+            it->job = std::move(job);
+            LOG(INFO) << "Background job " << name << " " << it->id << " replaced by a more recent snapshot.";
+            return it->id;
+        }
+
+        id = ++last_id_;
+
+        Task task;
+        task.id = id;
+        task.name = name;
+        task.job = std::move(job);
+        queue_.push_back(std::move(task));
+    }
+    has_task_.notify_one();
+
+    Publish(id, name, JobStatus::QUEUED, 0.0, "");
+
+    return id;
+}
+
+void BackgroundJobs::Flush(void) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    is_idle_.wait(lock, [this]{ return queue_.empty() && !is_running_; });
+}
+
+void BackgroundJobs::Publish(
+    uint32_t id, const std::string& name, uint8_t state, double progress, const std::string& message
+) {
+    JobStatus status;
+    status.header.stamp = ros::Time::now();
+    status.job_id = id;
+    status.name = name;
+    status.state = state;
+    status.progress = static_cast<float>(progress);
+    status.message = message;
+
+    publisher_.publish(status);
+}
+
+void BackgroundJobs::Run(void) {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        has_task_.wait(lock, [this]{ return stop_ || !queue_.empty(); });
+        if (queue_.empty())
+            break;
+
+        Task task = std::move(queue_.front());
+        queue_.pop_front();
+        is_running_ = true;
+
+        lock.unlock();
+        Publish(task.id, task.name, JobStatus::RUNNING, 0.0, "");
+
+        double last_progress = 0.0;
+        std::string last_message;
+        const Progress progress = [&](double fraction, const std::string& message) {
+            fraction = std::max(0.0, std::min(fraction, 1.0));
+            if (message == last_message && std::fabs(fraction - last_progress) < MIN_PROGRESS_STEP)
+                return;
+
+            last_progress = fraction;
+            last_message = message;
+            Publish(task.id, task.name, JobStatus::RUNNING, fraction, message);
+        };
+
+        const auto begin_time = std::chrono::steady_clock::now();
+        const bool is_succeeded = task.job(progress);
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin_time).count();
+
+        LOG(INFO) << "Background job " << task.name << " " << task.id
+                  << (is_succeeded ? " succeeded" : " failed") << " in " << elapsed << " s." << std::endl;
+        Publish(
+            task.id, task.name, is_succeeded ? JobStatus::SUCCEEDED : JobStatus::FAILED,
+            is_succeeded ? 1.0 : last_progress, last_message
+        );
+
+        // the snapshot held by the job is released outside of the lock:
+        task.job = nullptr;
+        lock.lock();
+
+        is_running_ = false;
+        if (queue_.empty())
+            is_idle_.notify_all();
+    }
+}
+
+} // namespace lidar_localization
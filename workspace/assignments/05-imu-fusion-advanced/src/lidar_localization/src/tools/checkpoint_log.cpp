@@ -0,0 +1,262 @@
+/*
+ * @Description: binary, append-only log of state changes, replayed to restore a node after restart
+ * @Author: Ge Yao
+ * @Date: 2021-01-12 20:37:16
+ */
+#include "lidar_localization/tools/checkpoint_log.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+namespace {
+const uint32_t CHECKPOINT_MAGIC = 0x4b504331; // CPK1
+const uint32_t CHECKPOINT_VERSION = 1;
+
+bool WriteAll(int fd, const void *data, size_t size) {
+    const char *buffer = static_cast<const char *>(data);
+
+    while (size > 0) {
+        ssize_t written = write(fd, buffer, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        buffer += written;
+        size -= static_cast<size_t>(written);
+    }
+
+    return true;
+}
+}
+
+CheckpointLog::CheckpointLog(const std::string& file_path, bool is_truncated)
+    : file_path_(file_path),
+      is_truncated_(is_truncated),
+      thread_(&CheckpointLog::Run, this) {
+}
+
+CheckpointLog::~CheckpointLog() {
+    Commit();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    has_task_.notify_one();
+
+    // the worker drains the queue before it exits:
+    thread_.join();
+
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+void CheckpointLog::Add(uint32_t type, const void *data, size_t size) {
+    RecordHeader record_header;
+    record_header.type = type;
+    record_header.size = static_cast<uint32_t>(size);
+
+    const char *header = reinterpret_cast<const char *>(&record_header);
+    batch_.data.insert(batch_.data.end(), header, header + sizeof(record_header));
+    batch_.data.insert(batch_.data.end(), static_cast<const char *>(data), static_cast<const char *>(data) + size);
+    ++batch_.num_records;
+}
+
+void CheckpointLog::Commit(void) {
+    if (0 == batch_.num_records)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(batch_));
+    }
+    has_task_.notify_one();
+
+    batch_ = Batch();
+}
+
+void CheckpointLog::Flush(void) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    is_idle_.wait(lock, [this]{ return queue_.empty() && !is_writing_; });
+}
+
+CheckpointLog::Stats CheckpointLog::GetStats(void) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+bool CheckpointLog::Replay(const std::string& file_path, const RecordHandler& handler) {
+    size_t valid_size = 0;
+    return Read(file_path, handler, valid_size) && valid_size > 0;
+}
+
+bool CheckpointLog::Read(const std::string& file_path, const RecordHandler& handler, size_t& valid_size) {
+    valid_size = 0;
+
+    std::ifstream ifs(file_path.c_str(), std::ios::in | std::ios::binary);
+    if (!ifs) {
+        return false;
+    }
+
+    FileHeader file_header;
+    if (
+        !ifs.read(reinterpret_cast<char *>(&file_header), sizeof(file_header)) ||
+        file_header.magic != CHECKPOINT_MAGIC
+    ) {
+        LOG(WARNING) << "Invalid checkpoint log " << file_path;
+        return false;
+    }
+    if (file_header.version != CHECKPOINT_VERSION) {
+        LOG(WARNING) << "Unsupported checkpoint log version " << file_header.version << " in " << file_path;
+        return false;
+    }
+    valid_size = sizeof(file_header);
+
+    BatchHeader batch_header;
+    std::vector<char> data;
+    while (ifs.read(reinterpret_cast<char *>(&batch_header), sizeof(batch_header))) {
+        data.resize(batch_header.size);
+        if (
+            !ifs.read(data.data(), data.size()) ||
+            GetChecksum(data.data(), data.size()) != batch_header.checksum
+        ) {
+            // a batch cut short by a crash, keep what was complete:
+            LOG(WARNING) << "Incomplete batch in checkpoint log " << file_path;
+            break;
+        }
+
+        // records are validated before any of them is handed out:
+        size_t offset = 0;
+        uint32_t num_records = 0;
+        while (offset + sizeof(RecordHeader) <= data.size()) {
+            RecordHeader record_header;
+            std::memcpy(&record_header, data.data() + offset, sizeof(record_header));
+            offset += sizeof(record_header) + record_header.size;
+            ++num_records;
+        }
+        if (offset != data.size() || num_records != batch_header.num_records) {
+            LOG(WARNING) << "Corrupted batch in checkpoint log " << file_path;
+            break;
+        }
+
+        if (handler) {
+            offset = 0;
+            while (offset < data.size()) {
+                RecordHeader record_header;
+                std::memcpy(&record_header, data.data() + offset, sizeof(record_header));
+                offset += sizeof(record_header);
+
+                if (!handler(record_header.type, data.data() + offset, record_header.size))
+                    return false;
+                offset += record_header.size;
+            }
+        }
+
+        valid_size += sizeof(batch_header) + data.size();
+    }
+
+    return true;
+}
+
+uint32_t CheckpointLog::GetChecksum(const char *data, size_t size) {
+    // FNV-1a, enough to catch torn writes:
+    uint32_t checksum = 2166136261u;
+    for (size_t i = 0; i < size; ++i) {
+        checksum ^= static_cast<uint8_t>(data[i]);
+        checksum *= 16777619u;
+    }
+
+    return checksum;
+}
+
+bool CheckpointLog::Open(void) {
+    size_t valid_size = 0;
+    if (!is_truncated_) {
+        Read(file_path_, RecordHandler(), valid_size);
+    }
+
+    if (valid_size > 0) {
+        // batches after a torn one would never be replayed, so the torn one is cut off:
+        fd_ = open(file_path_.c_str(), O_WRONLY);
+        if (fd_ < 0 || ftruncate(fd_, static_cast<off_t>(valid_size)) != 0 || lseek(fd_, 0, SEEK_END) < 0) {
+            LOG(ERROR) << "Failed to open checkpoint log " << file_path_;
+            return false;
+        }
+
+        return true;
+    }
+
+    fd_ = open(file_path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+        LOG(ERROR) << "Failed to create checkpoint log " << file_path_;
+        return false;
+    }
+
+    FileHeader file_header;
+    file_header.magic = CHECKPOINT_MAGIC;
+    file_header.version = CHECKPOINT_VERSION;
+    if (!WriteAll(fd_, &file_header, sizeof(file_header))) {
+        LOG(ERROR) << "Failed to write checkpoint log " << file_path_;
+        return false;
+    }
+
+    return true;
+}
+
+bool CheckpointLog::WriteBatch(const Batch& batch) {
+    BatchHeader batch_header;
+    batch_header.num_records = batch.num_records;
+    batch_header.checksum = GetChecksum(batch.data.data(), batch.data.size());
+    batch_header.size = batch.data.size();
+
+    // synced batch by batch, so a restart loses at most the batches not committed yet:
+    return (
+        fd_ >= 0 &&
+        WriteAll(fd_, &batch_header, sizeof(batch_header)) &&
+        WriteAll(fd_, batch.data.data(), batch.data.size()) &&
+        0 == fdatasync(fd_)
+    );
+}
+
+void CheckpointLog::Run(void) {
+    Open();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        has_task_.wait(lock, [this]{ return stop_ || !queue_.empty(); });
+        if (queue_.empty())
+            break;
+
+        Batch batch = std::move(queue_.front());
+        queue_.pop_front();
+        is_writing_ = true;
+
+        lock.unlock();
+        bool is_written = WriteBatch(batch);
+        lock.lock();
+
+        is_writing_ = false;
+        if (is_written) {
+            ++stats_.num_batches;
+            stats_.num_records += batch.num_records;
+            stats_.num_bytes_written += sizeof(BatchHeader) + batch.data.size();
+        } else {
+            ++stats_.num_failed;
+        }
+
+        if (queue_.empty())
+            is_idle_.notify_all();
+    }
+}
+
+} // namespace lidar_localization
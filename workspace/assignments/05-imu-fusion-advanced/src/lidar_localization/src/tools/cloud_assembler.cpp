@@ -0,0 +1,155 @@
+/*
+ * @Description: assembly of maps from many transformed clouds, in one allocation & one pass over the points
+ * @Author: Ge Yao
+ * @Date: 2021-01-17 15:42:19
+ */
+#include "lidar_localization/tools/cloud_assembler.hpp"
+
+#include <algorithm>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "lidar_localization/tools/simd_dispatch.hpp"
+
+namespace lidar_localization {
+
+void CloudAssembler::Add(const CloudData::CLOUD::ConstPtr& cloud_ptr, const Eigen::Matrix4f& pose) {
+    if (!cloud_ptr || cloud_ptr->points.empty()) {
+        return;
+    }
+
+    Part part;
+    part.cloud_ptr = cloud_ptr;
+    part.pose = pose;
+    parts_.push_back(part);
+
+    num_points_ += cloud_ptr->points.size();
+}
+
+void CloudAssembler::Add(const CompactCloud::ConstPtr& compact_cloud_ptr, const Eigen::Matrix4f& pose) {
+    if (!compact_cloud_ptr || compact_cloud_ptr->GetNumPoints() == 0) {
+        return;
+    }
+
+    Part part;
+    part.compact_cloud_ptr = compact_cloud_ptr;
+    part.pose = pose;
+    parts_.push_back(part);
+
+    num_points_ += compact_cloud_ptr->GetNumPoints();
+}
+
+void CloudAssembler::Assemble(CloudData::CLOUD& map_cloud) {
+    size_t begin = map_cloud.points.size();
+    map_cloud.points.resize(begin + num_points_);
+
+    for (const Part& part: parts_) {
+        if (part.compact_cloud_ptr) {
+            const CompactCloud& compact_cloud = *part.compact_cloud_ptr;
+
+            compact_cloud.Transform(part.pose, map_cloud.points.data() + begin);
+            begin += compact_cloud.GetNumPoints();
+
+            map_cloud.header.stamp = std::max<decltype(map_cloud.header.stamp)>(map_cloud.header.stamp, compact_cloud.GetStamp());
+            continue;
+        }
+
+        const CloudData::CLOUD& cloud = *part.cloud_ptr;
+
+        Transform(cloud.points.data(), cloud.points.size(), part.pose, map_cloud.points.data() + begin);
+        begin += cloud.points.size();
+
+        map_cloud.is_dense = map_cloud.is_dense && cloud.is_dense;
+        map_cloud.header.stamp = std::max(map_cloud.header.stamp, cloud.header.stamp);
+    }
+    map_cloud.width = static_cast<uint32_t>(map_cloud.points.size());
+    map_cloud.height = 1;
+
+    parts_.clear();
+    num_points_ = 0;
+}
+
+void CloudAssembler::Transform(
+    const CloudData::POINT *input, size_t num_points, const Eigen::Matrix4f& pose,
+    CloudData::POINT *output
+) {
+#if defined(__GNUC__) && defined(__x86_64__)
+    // pose is column major & the points are x, y, z, padding,
+    // so each point is the sum of the columns scaled by its coordinates:
+    if (SIMDDispatch::IsEnabled(SIMDLevel::SSE2)) {
+        const __m128 column_0 = _mm_loadu_ps(pose.data());
+        const __m128 column_1 = _mm_loadu_ps(pose.data() + 4);
+        const __m128 column_2 = _mm_loadu_ps(pose.data() + 8);
+        const __m128 column_3 = _mm_loadu_ps(pose.data() + 12);
+        // the padding is kept as it is:
+        const __m128 xyz_mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+
+        for (size_t i = 0; i < num_points; ++i) {
+            const __m128 point = _mm_loadu_ps(input[i].data);
+
+            __m128 result = _mm_add_ps(
+                _mm_mul_ps(column_0, _mm_shuffle_ps(point, point, 0x00)),
+                _mm_mul_ps(column_1, _mm_shuffle_ps(point, point, 0x55))
+            );
+            result = _mm_add_ps(
+                result,
+                _mm_add_ps(_mm_mul_ps(column_2, _mm_shuffle_ps(point, point, 0xAA)), column_3)
+            );
+            result = _mm_or_ps(_mm_and_ps(xyz_mask, result), _mm_andnot_ps(xyz_mask, point));
+
+            // the other fields first, output may be input:
+            if (output + i != input + i) {
+                output[i] = input[i];
+            }
+            _mm_storeu_ps(output[i].data, result);
+        }
+
+        return;
+    }
+#elif defined(__GNUC__) && defined(__aarch64__)
+    // as SSE2, the columns are scaled by lanes of the point:
+    if (SIMDDispatch::IsEnabled(SIMDLevel::NEON)) {
+        const float32x4_t column_0 = vld1q_f32(pose.data());
+        const float32x4_t column_1 = vld1q_f32(pose.data() + 4);
+        const float32x4_t column_2 = vld1q_f32(pose.data() + 8);
+        const float32x4_t column_3 = vld1q_f32(pose.data() + 12);
+        // the padding is kept as it is:
+        const uint32x4_t xyz_mask = vsetq_lane_u32(0u, vdupq_n_u32(0xFFFFFFFFu), 3);
+
+        for (size_t i = 0; i < num_points; ++i) {
+            const float32x4_t point = vld1q_f32(input[i].data);
+
+            float32x4_t result = vfmaq_laneq_f32(column_3, column_0, point, 0);
+            result = vfmaq_laneq_f32(result, column_1, point, 1);
+            result = vfmaq_laneq_f32(result, column_2, point, 2);
+            result = vbslq_f32(xyz_mask, result, point);
+
+            // the other fields first, output may be input:
+            if (output + i != input + i) {
+                output[i] = input[i];
+            }
+            vst1q_f32(output[i].data, result);
+        }
+
+        return;
+    }
+#endif
+
+    const Eigen::Matrix3f rotation = pose.block<3, 3>(0, 0);
+    const Eigen::Vector3f translation = pose.block<3, 1>(0, 3);
+
+    for (size_t i = 0; i < num_points; ++i) {
+        const Eigen::Vector3f point = rotation * input[i].getVector3fMap() + translation;
+
+        if (output + i != input + i) {
+            output[i] = input[i];
+        }
+        output[i].getVector3fMap() = point;
+    }
+}
+
+} // namespace lidar_localization
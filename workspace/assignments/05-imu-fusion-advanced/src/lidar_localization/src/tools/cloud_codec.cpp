@@ -0,0 +1,170 @@
+/*
+ * @Description: compact point cloud encoding for the transport between hosts
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 09:26:40
+ */
+#include "lidar_localization/tools/cloud_codec.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#ifdef LIDAR_LOCALIZATION_WITH_LZ4
+#include <lz4.h>
+#endif
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+namespace {
+// 5 bytes of 7 bits for 32 bits:
+const size_t MAX_VARINT_SIZE = 5;
+
+inline uint32_t ZigZag(int32_t value) {
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+inline int32_t UnZigZag(uint32_t value) {
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+inline uint8_t* PutVarint(uint32_t value, uint8_t* output) {
+    while (value >= 0x80) {
+        *output++ = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    *output++ = static_cast<uint8_t>(value);
+
+    return output;
+}
+
+inline bool GetVarint(const uint8_t*& input, const uint8_t* end, uint32_t& value) {
+    value = 0;
+    for (size_t i = 0; i < MAX_VARINT_SIZE && input < end; ++i) {
+        const uint8_t byte = *input++;
+        value |= static_cast<uint32_t>(byte & 0x7f) << (7 * i);
+        if (byte < 0x80)
+            return true;
+    }
+
+    return false;
+}
+}
+
+CloudCodec::CloudCodec(float resolution, bool use_lz4)
+    : resolution_(resolution), use_lz4_(use_lz4) {
+#ifndef LIDAR_LOCALIZATION_WITH_LZ4
+    if (use_lz4_) {
+        LOG(WARNING) << "Cloud codec is built without LZ4, clouds will only be delta coded.";
+        use_lz4_ = false;
+    }
+#endif
+}
+
+bool CloudCodec::Encode(const CloudData::CLOUD& cloud, FrameInfo& info, std::vector<uint8_t>& data) {
+    TRACE_SCOPE("CloudCodec::Encode", "transport");
+    const double scale = 1.0 / resolution_;
+    const double max_quantized = std::numeric_limits<int32_t>::max();
+
+    raw_.resize(3 * MAX_VARINT_SIZE * cloud.points.size());
+    uint8_t* output = raw_.data();
+
+    // deltas wrap around like the quantized coordinates themselves, so decoding does too:
+    uint32_t prev[3] = {0, 0, 0};
+    uint32_t num_points = 0;
+    for (const CloudData::POINT& point: cloud.points) {
+        if (!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z))
+            continue;
+
+        const float coords[3] = {point.x, point.y, point.z};
+        for (int i = 0; i < 3; ++i) {
+            const double q = std::max(-max_quantized, std::min(max_quantized, std::round(scale * coords[i])));
+            const uint32_t curr = static_cast<uint32_t>(static_cast<int32_t>(q));
+            output = PutVarint(ZigZag(static_cast<int32_t>(curr - prev[i])), output);
+            prev[i] = curr;
+        }
+        ++num_points;
+    }
+
+    info.num_points = num_points;
+    info.resolution = resolution_;
+    info.compression = NONE;
+    info.raw_size = static_cast<uint32_t>(output - raw_.data());
+
+#ifdef LIDAR_LOCALIZATION_WITH_LZ4
+    if (use_lz4_ && info.raw_size > 0) {
+        data.resize(LZ4_compressBound(info.raw_size));
+        const int compressed_size = LZ4_compress_default(
+            reinterpret_cast<const char*>(raw_.data()), reinterpret_cast<char*>(data.data()),
+            info.raw_size, data.size()
+        );
+        // keep the varint stream when compression does not pay off:
+        if (compressed_size > 0 && static_cast<uint32_t>(compressed_size) < info.raw_size) {
+            info.compression = LZ4;
+            data.resize(compressed_size);
+            return true;
+        }
+    }
+#endif
+
+    data.assign(raw_.begin(), raw_.begin() + info.raw_size);
+
+    return true;
+}
+
+bool CloudCodec::Decode(const FrameInfo& info, const std::vector<uint8_t>& data, CloudData::CLOUD& cloud) {
+    TRACE_SCOPE("CloudCodec::Decode", "transport");
+    // a larger stream can't be valid, checked before anything is allocated:
+    if (info.raw_size > 3 * MAX_VARINT_SIZE * static_cast<uint64_t>(info.num_points)) {
+        LOG(ERROR) << "Corrupted compressed cloud, " << info.raw_size << " bytes for " << info.num_points << " points.";
+        return false;
+    }
+
+    const uint8_t* input = data.data();
+    if (info.compression == LZ4) {
+#ifdef LIDAR_LOCALIZATION_WITH_LZ4
+        raw_.resize(info.raw_size);
+        const int raw_size = LZ4_decompress_safe(
+            reinterpret_cast<const char*>(data.data()), reinterpret_cast<char*>(raw_.data()),
+            data.size(), info.raw_size
+        );
+        if (raw_size != static_cast<int>(info.raw_size)) {
+            LOG(ERROR) << "Failed to decompress compressed cloud.";
+            return false;
+        }
+        input = raw_.data();
+#else
+        LOG(ERROR) << "Cloud is LZ4 compressed, but LZ4 support is not built.";
+        return false;
+#endif
+    } else if (info.compression != NONE || data.size() != info.raw_size) {
+        LOG(ERROR) << "Corrupted compressed cloud.";
+        return false;
+    }
+    const uint8_t* end = input + info.raw_size;
+
+    cloud.points.resize(info.num_points);
+    uint32_t prev[3] = {0, 0, 0};
+    for (CloudData::POINT& point: cloud.points) {
+        float* coords[3] = {&point.x, &point.y, &point.z};
+        for (int i = 0; i < 3; ++i) {
+            uint32_t value;
+            if (!GetVarint(input, end, value)) {
+                LOG(ERROR) << "Corrupted compressed cloud, truncated varint stream.";
+                cloud.points.clear();
+                return false;
+            }
+            prev[i] += static_cast<uint32_t>(UnZigZag(value));
+            *coords[i] = static_cast<float>(static_cast<double>(info.resolution) * static_cast<int32_t>(prev[i]));
+        }
+    }
+    cloud.width = info.num_points;
+    cloud.height = 1;
+    cloud.is_dense = true;
+
+    return input == end;
+}
+
+} // namespace lidar_localization
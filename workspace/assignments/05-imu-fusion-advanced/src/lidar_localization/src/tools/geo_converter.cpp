@@ -0,0 +1,94 @@
+/*
+ * @Description: geodetic to local ENU conversion around a fixed origin
+ * @Author: Ge Yao
+ * @Date: 2021-01-01 14:36:50
+ */
+#include "lidar_localization/tools/geo_converter.hpp"
+
+#include <cmath>
+#include <iterator>
+
+#include <GeographicLib/Constants.hpp>
+
+namespace lidar_localization {
+
+GeoConverter::GeoConverter(
+    double origin_latitude, double origin_longitude, double origin_altitude
+) : origin_latitude_(origin_latitude),
+    origin_longitude_(origin_longitude),
+    origin_altitude_(origin_altitude),
+    a_(GeographicLib::Constants::WGS84_a<double>()) {
+    const double f = GeographicLib::Constants::WGS84_f<double>();
+    e2_ = f * (2.0 - f);
+
+    origin_ecef_ = GetECEF(origin_latitude_, origin_longitude_, origin_altitude_);
+
+    const double phi = origin_latitude_ * M_PI / 180.0;
+    const double lambda = origin_longitude_ * M_PI / 180.0;
+    const double sin_phi = std::sin(phi), cos_phi = std::cos(phi);
+    const double sin_lambda = std::sin(lambda), cos_lambda = std::cos(lambda);
+
+    R_enu_ecef_ <<
+                  -sin_lambda,            cos_lambda,     0.0,
+        -sin_phi * cos_lambda, -sin_phi * sin_lambda, cos_phi,
+         cos_phi * cos_lambda,  cos_phi * sin_lambda, sin_phi;
+}
+
+void GeoConverter::Forward(
+    double latitude, double longitude, double altitude,
+    double& local_E, double& local_N, double& local_U
+) const {
+    const Eigen::Vector3d enu = R_enu_ecef_ * (GetECEF(latitude, longitude, altitude) - origin_ecef_);
+
+    local_E = enu.x();
+    local_N = enu.y();
+    local_U = enu.z();
+}
+
+void GeoConverter::Forward(GNSSData& gnss_data) const {
+    Forward(
+        gnss_data.latitude, gnss_data.longitude, gnss_data.altitude,
+        gnss_data.local_E, gnss_data.local_N, gnss_data.local_U
+    );
+}
+
+void GeoConverter::Forward(std::deque<GNSSData>::iterator begin, std::deque<GNSSData>::iterator end) const {
+    const long num_fixes = std::distance(begin, end);
+    if (num_fixes <= 0) {
+        return;
+    }
+
+    // a. ECEF relative to the origin, one column per fix:
+    Eigen::Matrix3Xd ecef(3, num_fixes);
+    std::deque<GNSSData>::iterator it = begin;
+    for (long i = 0; i < num_fixes; ++i, ++it) {
+        ecef.col(i) = GetECEF(it->latitude, it->longitude, it->altitude) - origin_ecef_;
+    }
+
+    // b. all rotated at once:
+    const Eigen::Matrix3Xd enu = R_enu_ecef_ * ecef;
+
+    it = begin;
+    for (long i = 0; i < num_fixes; ++i, ++it) {
+        it->local_E = enu(0, i);
+        it->local_N = enu(1, i);
+        it->local_U = enu(2, i);
+    }
+}
+
+Eigen::Vector3d GeoConverter::GetECEF(double latitude, double longitude, double altitude) const {
+    const double phi = latitude * M_PI / 180.0;
+    const double lambda = longitude * M_PI / 180.0;
+    const double sin_phi = std::sin(phi), cos_phi = std::cos(phi);
+
+    // prime vertical radius of curvature:
+    const double N = a_ / std::sqrt(1.0 - e2_ * sin_phi * sin_phi);
+
+    return Eigen::Vector3d(
+        (N + altitude) * cos_phi * std::cos(lambda),
+        (N + altitude) * cos_phi * std::sin(lambda),
+        (N * (1.0 - e2_) + altitude) * sin_phi
+    );
+}
+
+} // namespace lidar_localization
@@ -0,0 +1,122 @@
+/*
+ * @Description: end-to-end latency stamping, as the side channel <topic>/trace of the traced topics
+ * @Author: Ge Yao
+ * @Date: 2020-12-24 10:12:36
+ */
+#include "lidar_localization/tools/latency_tracer.hpp"
+
+#include <cmath>
+
+#include "glog/logging.h"
+
+#include "lidar_localization/tools/tracer.hpp"
+#include "lidar_localization/tools/offline_replay.hpp"
+
+namespace lidar_localization {
+
+namespace {
+// stamps of the same ROS time agree to well below this:
+const double TIME_TOLERANCE = 1.0e-6;
+// unmatched upstream traces, e.g. of downsampled measurements, are kept for this long:
+const double MAX_TRACE_AGE = 1.0;
+}
+
+LatencyTracer::LatencyTracer(
+    ros::NodeHandle& nh,
+    const std::string& flow_name,
+    const std::string& input_topic,
+    const std::string& output_topic,
+    FlowMetrics& metrics
+) : flow_name_(flow_name),
+    end_to_end_latency_(metrics.AddLatency("end_to_end_latency")),
+    over_latency_budget_(metrics.AddCounter("over_latency_budget")) {
+    // in seconds, 50ms by default:
+    nh.param("latency_budget", latency_budget_, 0.05);
+
+    if (!input_topic.empty()) {
+        subscriber_ = OfflineReplay::GetInstance().Subscribe(
+            nh, input_topic + "/trace", 1000, &LatencyTracer::msg_callback, this
+        );
+    }
+    publisher_ = nh.advertise<ProcessingTrace>(output_topic + "/trace", 100);
+}
+
+void LatencyTracer::msg_callback(const ProcessingTrace::ConstPtr& trace_msg_ptr) {
+    ReceivedTrace received_trace;
+    received_trace.trace_ptr = trace_msg_ptr;
+    received_trace.receive_stamp = Tracer::Now();
+
+    new_traces_.Push(std::move(received_trace));
+}
+
+bool LatencyTracer::GetUpstreamTrace(double time, ReceivedTrace& received_trace) {
+    new_traces_.Drain(trace_buff_);
+
+    while (
+        !trace_buff_.empty() &&
+        trace_buff_.front().trace_ptr->header.stamp.toSec() < time - MAX_TRACE_AGE
+    ) {
+        trace_buff_.pop_front();
+    }
+
+    for (auto it = trace_buff_.begin(); it != trace_buff_.end(); ++it) {
+        if (std::fabs(it->trace_ptr->header.stamp.toSec() - time) < TIME_TOLERANCE) {
+            received_trace = *it;
+            trace_buff_.erase(trace_buff_.begin(), it + 1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void LatencyTracer::Start(double time) {
+    const int64_t start_stamp = Tracer::Now();
+
+    ReceivedTrace upstream_trace;
+    if (GetUpstreamTrace(time, upstream_trace)) {
+        trace_ = *upstream_trace.trace_ptr;
+        trace_.hops.push_back(flow_name_ + "/receive");
+        trace_.stamps.push_back(upstream_trace.receive_stamp);
+    } else {
+        trace_.header.stamp = ros::Time(time);
+        trace_.hops.clear();
+        trace_.stamps.clear();
+
+        // sensor time on the monotonic clock, the ROS clock is unrelated to it offline:
+        if (!OfflineReplay::GetInstance().IsEnabled()) {
+            const double sensor_age = (ros::Time::now() - trace_.header.stamp).toSec();
+            trace_.hops.push_back("sensor");
+            trace_.stamps.push_back(start_stamp - static_cast<int64_t>(1.0e9 * sensor_age));
+        }
+    }
+
+    trace_.hops.push_back(flow_name_ + "/start");
+    trace_.stamps.push_back(start_stamp);
+}
+
+void LatencyTracer::AddHop(const std::string& stage) {
+    trace_.hops.push_back(flow_name_ + "/" + stage);
+    trace_.stamps.push_back(Tracer::Now());
+}
+
+void LatencyTracer::Publish(void) {
+    if (trace_.stamps.empty()) {
+        return;
+    }
+
+    AddHop("publish");
+
+    const int64_t latency = trace_.stamps.back() - trace_.stamps.front();
+    end_to_end_latency_.Record(latency);
+    if (1.0e-9 * latency > latency_budget_) {
+        over_latency_budget_.Increment();
+        LOG_EVERY_N(WARNING, 100) << flow_name_ << ": end-to-end latency " << 1.0e-6 * latency
+                                  << "ms over budget " << 1.0e3 * latency_budget_ << "ms, "
+                                  << over_latency_budget_.Get() << " in total.";
+    }
+
+    OfflineReplay::GetInstance().Publish(publisher_, trace_);
+}
+
+} // namespace lidar_localization
@@ -0,0 +1,66 @@
+/*
+ * @Description: time-ordered dispatch of measurements from several sensor streams
+ * @Author: Ge Yao
+ * @Date: 2021-01-24 16:05:37
+ */
+#include "lidar_localization/tools/measurement_scheduler.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace lidar_localization {
+
+size_t MeasurementScheduler::Dispatch(bool flush) {
+    // a. the stream fronts on a min-heap. buffers are in arrival order, so the back is the newest of each:
+    using Entry = std::pair<double, size_t>;
+    std::vector<Entry> heap;
+    heap.reserve(streams_.size());
+
+    // the longest wait for the streams without a measurement:
+    double max_wait = 0.0;
+    for (size_t i = 0; i < streams_.size(); ++i) {
+        const StreamBase& stream = *streams_.at(i);
+        if (0 == stream.GetSize()) {
+            max_wait = std::max(max_wait, stream.GetMaxWait());
+            continue;
+        }
+
+        newest_time_ = std::max(newest_time_, stream.GetBackTime());
+        heap.emplace_back(stream.GetFrontTime(), i);
+    }
+    std::make_heap(heap.begin(), heap.end(), std::greater<Entry>());
+
+    // b. dispatch the oldest until an empty stream might still deliver an older one:
+    size_t num_dispatched = 0;
+    while ( !heap.empty() ) {
+        const Entry entry = heap.front();
+        if ( !flush && entry.first + max_wait > newest_time_ ) {
+            break;
+        }
+
+        std::pop_heap(heap.begin(), heap.end(), std::greater<Entry>());
+        heap.pop_back();
+
+        StreamBase& stream = *streams_.at(entry.second);
+        if ( entry.first < time_ ) {
+            ++stream.stats_.num_late;
+        } else {
+            time_ = entry.first;
+        }
+        ++stream.stats_.num_dispatched;
+        ++num_dispatched;
+
+        stream.Dispatch();
+
+        if ( stream.GetSize() > 0 ) {
+            heap.emplace_back(stream.GetFrontTime(), entry.second);
+            std::push_heap(heap.begin(), heap.end(), std::greater<Entry>());
+        } else {
+            max_wait = std::max(max_wait, stream.GetMaxWait());
+        }
+    }
+
+    return num_dispatched;
+}
+
+}
@@ -0,0 +1,248 @@
+/*
+ * @Description: process-wide metrics registry, counters, gauges & latency histograms
+ * @Author: Ge Yao
+ * @Date: 2020-12-23 20:31:48
+ */
+#include "lidar_localization/tools/metrics.hpp"
+
+#include <cctype>
+#include <algorithm>
+#include <sstream>
+
+namespace lidar_localization {
+
+const int LatencyHistogram::SUB_BUCKET_BITS;
+const int LatencyHistogram::SUB_BUCKET_COUNT;
+const int LatencyHistogram::NUM_BUCKETS;
+
+int LatencyHistogram::GetBucketIndex(uint64_t value) {
+    if (value < static_cast<uint64_t>(SUB_BUCKET_COUNT)) {
+        return static_cast<int>(value);
+    }
+
+    const int shift = (63 - __builtin_clzll(value)) - SUB_BUCKET_BITS;
+
+    return ((shift + 1) << SUB_BUCKET_BITS) + static_cast<int>((value >> shift) - SUB_BUCKET_COUNT);
+}
+
+double LatencyHistogram::GetBucketValue(int index) {
+    if (index < SUB_BUCKET_COUNT) {
+        return index;
+    }
+
+    const int shift = (index >> SUB_BUCKET_BITS) - 1;
+    const double lower = static_cast<double>(static_cast<uint64_t>((index & (SUB_BUCKET_COUNT - 1)) + SUB_BUCKET_COUNT) << shift);
+
+    return lower + 0.5 * static_cast<double>(1ULL << shift);
+}
+
+void LatencyHistogram::Record(int64_t latency) {
+    const uint64_t value = static_cast<uint64_t>(std::max<int64_t>(latency, 0));
+
+    buckets_[GetBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::GetSnapshot(void) const {
+    Snapshot snapshot;
+
+    std::vector<uint64_t> buckets(NUM_BUCKETS);
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+        snapshot.count += buckets[i];
+    }
+    snapshot.sum = static_cast<double>(sum_.load(std::memory_order_relaxed));
+    snapshot.max = static_cast<double>(max_.load(std::memory_order_relaxed));
+
+    if (0 == snapshot.count) {
+        return snapshot;
+    }
+
+    const double quantiles[] = {0.50, 0.90, 0.99};
+    double* values[] = {&snapshot.p50, &snapshot.p90, &snapshot.p99};
+
+    uint64_t num_below = 0;
+    int q = 0;
+    for (int i = 0; i < NUM_BUCKETS && q < 3; ++i) {
+        num_below += buckets[i];
+        while (q < 3 && num_below >= quantiles[q] * snapshot.count) {
+            *values[q] = std::min(GetBucketValue(i), snapshot.max);
+            ++q;
+        }
+    }
+
+    return snapshot;
+}
+
+MetricsRegistry& MetricsRegistry::GetInstance(void) {
+    static MetricsRegistry instance;
+
+    return instance;
+}
+
+Counter& MetricsRegistry::GetCounter(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::unique_ptr<Counter>& counter_ptr = counters_[name];
+    if (!counter_ptr) {
+        counter_ptr.reset(new Counter());
+    }
+
+    return *counter_ptr;
+}
+
+Gauge& MetricsRegistry::GetGauge(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::unique_ptr<Gauge>& gauge_ptr = gauges_[name];
+    if (!gauge_ptr) {
+        gauge_ptr.reset(new Gauge());
+    }
+
+    return *gauge_ptr;
+}
+
+LatencyHistogram& MetricsRegistry::GetLatencyHistogram(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::unique_ptr<LatencyHistogram>& histogram_ptr = latency_histograms_[name];
+    if (!histogram_ptr) {
+        histogram_ptr.reset(new LatencyHistogram());
+    }
+
+    return *histogram_ptr;
+}
+
+void MetricsRegistry::ForEachCounter(const std::function<void(const std::string&, const Counter&)>& callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (const auto& counter: counters_) {
+        callback(counter.first, *counter.second);
+    }
+}
+
+void MetricsRegistry::ForEachGauge(const std::function<void(const std::string&, const Gauge&)>& callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (const auto& gauge: gauges_) {
+        callback(gauge.first, *gauge.second);
+    }
+}
+
+void MetricsRegistry::ForEachLatencyHistogram(const std::function<void(const std::string&, const LatencyHistogram&)>& callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (const auto& histogram: latency_histograms_) {
+        callback(histogram.first, *histogram.second);
+    }
+}
+
+namespace {
+std::string GetPrometheusName(const std::string& name) {
+    std::string prometheus_name = "lidar_localization_" + name;
+
+    for (char& c: prometheus_name) {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '_') {
+            c = '_';
+        }
+    }
+
+    return prometheus_name;
+}
+}
+
+std::string MetricsRegistry::GetPrometheusText(void) {
+    std::ostringstream oss;
+    oss.precision(9);
+
+    ForEachCounter(
+        [&oss](const std::string& name, const Counter& counter) {
+            const std::string prometheus_name = GetPrometheusName(name) + "_total";
+            oss << "# TYPE " << prometheus_name << " counter\n"
+                << prometheus_name << " " << counter.Get() << "\n";
+        }
+    );
+
+    ForEachGauge(
+        [&oss](const std::string& name, const Gauge& gauge) {
+            const std::string prometheus_name = GetPrometheusName(name);
+            oss << "# TYPE " << prometheus_name << " gauge\n"
+                << prometheus_name << " " << gauge.Get() << "\n";
+        }
+    );
+
+    // as summaries, in seconds:
+    ForEachLatencyHistogram(
+        [&oss](const std::string& name, const LatencyHistogram& histogram) {
+            const std::string prometheus_name = GetPrometheusName(name) + "_seconds";
+            const LatencyHistogram::Snapshot snapshot = histogram.GetSnapshot();
+            oss << "# TYPE " << prometheus_name << " summary\n"
+                << prometheus_name << "{quantile=\"0.5\"} " << 1.0e-9 * snapshot.p50 << "\n"
+                << prometheus_name << "{quantile=\"0.9\"} " << 1.0e-9 * snapshot.p90 << "\n"
+                << prometheus_name << "{quantile=\"0.99\"} " << 1.0e-9 * snapshot.p99 << "\n"
+                << prometheus_name << "_sum " << 1.0e-9 * snapshot.sum << "\n"
+                << prometheus_name << "_count " << snapshot.count << "\n";
+        }
+    );
+
+    return oss.str();
+}
+
+FlowMetrics::FlowMetrics(const std::string& flow_name)
+    : flow_name_(flow_name),
+      latency_(MetricsRegistry::GetInstance().GetLatencyHistogram(flow_name + ".latency")) {
+}
+
+void FlowMetrics::AddQueue(const std::string& queue_name, const std::function<size_t(void)>& get_size) {
+    Queue queue;
+    queue.gauge_ptr = &MetricsRegistry::GetInstance().GetGauge(flow_name_ + "." + queue_name);
+    queue.get_size = get_size;
+
+    queues_.push_back(queue);
+}
+
+void FlowMetrics::AddMemory(const std::string& container_name, const std::function<size_t(void)>& get_bytes) {
+    Queue memory;
+    memory.gauge_ptr = &MetricsRegistry::GetInstance().GetGauge(flow_name_ + ".memory." + container_name);
+    memory.get_size = get_bytes;
+
+    memories_.push_back(memory);
+}
+
+Counter& FlowMetrics::AddCounter(const std::string& counter_name) {
+    return MetricsRegistry::GetInstance().GetCounter(flow_name_ + "." + counter_name);
+}
+
+Gauge& FlowMetrics::AddGauge(const std::string& gauge_name) {
+    return MetricsRegistry::GetInstance().GetGauge(flow_name_ + "." + gauge_name);
+}
+
+LatencyHistogram& FlowMetrics::AddLatency(const std::string& latency_name) {
+    return MetricsRegistry::GetInstance().GetLatencyHistogram(flow_name_ + "." + latency_name);
+}
+
+void FlowMetrics::UpdateQueues(void) {
+    for (const Queue& queue: queues_) {
+        queue.gauge_ptr->Set(static_cast<double>(queue.get_size()));
+    }
+}
+
+void FlowMetrics::UpdateMemory(void) {
+    // some containers are walked to be sized, e.g. clouds, so not on every Run:
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now - last_memory_update_ < std::chrono::seconds(1)) {
+        return;
+    }
+    last_memory_update_ = now;
+
+    for (const Queue& memory: memories_) {
+        memory.gauge_ptr->Set(static_cast<double>(memory.get_size()));
+    }
+}
+
+} // namespace lidar_localization
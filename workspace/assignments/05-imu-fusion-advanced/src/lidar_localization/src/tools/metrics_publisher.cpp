@@ -0,0 +1,269 @@
+/*
+ * @Description: publish the metrics registry as diagnostic_msgs, and optionally serve it to Prometheus
+ * @Author: Ge Yao
+ * @Date: 2020-12-23 21:26:05
+ */
+#include "lidar_localization/tools/metrics_publisher.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <diagnostic_msgs/DiagnosticArray.h>
+
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/file_manager.hpp"
+#include "lidar_localization/tools/metrics.hpp"
+
+namespace lidar_localization {
+namespace {
+diagnostic_msgs::KeyValue GetKeyValue(const std::string& key, double value) {
+    diagnostic_msgs::KeyValue key_value;
+
+    std::ostringstream oss;
+    oss << value;
+
+    key_value.key = key;
+    key_value.value = oss.str();
+
+    return key_value;
+}
+
+// <group>.<name> -> group & name:
+void SplitName(const std::string& name, std::string& group, std::string& key) {
+    const size_t pos = name.find('.');
+
+    group = (std::string::npos == pos) ? "" : name.substr(0, pos);
+    key = (std::string::npos == pos) ? name : name.substr(pos + 1);
+}
+
+// resident set size in bytes, 0 if not available:
+size_t GetResidentSetSize(void) {
+    std::ifstream statm("/proc/self/statm");
+
+    size_t num_total_pages = 0, num_resident_pages = 0;
+    if (!(statm >> num_total_pages >> num_resident_pages)) {
+        return 0;
+    }
+
+    return num_resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+}
+
+MetricsPublisher::MetricsPublisher(ros::NodeHandle& nh) {
+    node_name_ = ros::this_node::getName();
+
+    double period;
+    int port;
+    nh.param("metrics_period", period, 1.0);
+    nh.param("metrics_port", port, 0);
+
+    ros::NodeHandle root_nh;
+    publisher_ = root_nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 10);
+    timer_ = nh.createWallTimer(ros::WallDuration(period), &MetricsPublisher::TimerCallback, this);
+    dump_memory_service_ = nh.advertiseService("dump_memory", &MetricsPublisher::DumpMemoryCallback, this);
+
+    if (port > 0) {
+        server_thread_ = std::thread(&MetricsPublisher::Serve, this, port);
+    }
+}
+
+MetricsPublisher::~MetricsPublisher() {
+    running_ = false;
+
+    if (server_thread_.joinable()) {
+        server_thread_.join();
+    }
+}
+
+void MetricsPublisher::TimerCallback(const ros::WallTimerEvent& event) {
+    MetricsRegistry& registry = MetricsRegistry::GetInstance();
+
+    // kept up to date for Prometheus too:
+    static Gauge& rss = registry.GetGauge("process.memory.rss");
+    rss.Set(static_cast<double>(GetResidentSetSize()));
+
+    if (0 == publisher_.getNumSubscribers()) {
+        return;
+    }
+
+    // one status per group:
+    std::map<std::string, diagnostic_msgs::DiagnosticStatus> statuses;
+    std::string group, key;
+
+    registry.ForEachCounter(
+        [&](const std::string& name, const Counter& counter) {
+            SplitName(name, group, key);
+            statuses[group].values.push_back(GetKeyValue(key, static_cast<double>(counter.Get())));
+        }
+    );
+
+    registry.ForEachGauge(
+        [&](const std::string& name, const Gauge& gauge) {
+            SplitName(name, group, key);
+            statuses[group].values.push_back(GetKeyValue(key, gauge.Get()));
+        }
+    );
+
+    // in ms:
+    registry.ForEachLatencyHistogram(
+        [&](const std::string& name, const LatencyHistogram& histogram) {
+            SplitName(name, group, key);
+            const LatencyHistogram::Snapshot snapshot = histogram.GetSnapshot();
+
+            std::vector<diagnostic_msgs::KeyValue>& values = statuses[group].values;
+            values.push_back(GetKeyValue(key + ".count", static_cast<double>(snapshot.count)));
+            values.push_back(GetKeyValue(key + ".p50_ms", 1.0e-6 * snapshot.p50));
+            values.push_back(GetKeyValue(key + ".p90_ms", 1.0e-6 * snapshot.p90));
+            values.push_back(GetKeyValue(key + ".p99_ms", 1.0e-6 * snapshot.p99));
+            values.push_back(GetKeyValue(key + ".max_ms", 1.0e-6 * snapshot.max));
+        }
+    );
+
+    diagnostic_msgs::DiagnosticArray diagnostic_array;
+    diagnostic_array.header.stamp = ros::Time::now();
+
+    for (auto& status: statuses) {
+        status.second.level = diagnostic_msgs::DiagnosticStatus::OK;
+        status.second.name = node_name_ + ": " + status.first;
+        status.second.hardware_id = node_name_;
+        diagnostic_array.status.push_back(status.second);
+    }
+
+    publisher_.publish(diagnostic_array);
+}
+
+bool MetricsPublisher::DumpMemory(std::string& file_path, std::string& report) {
+    // WORK_SPACE_PATH/slam_data/memory/<node name>.txt by default:
+    if (file_path.empty()) {
+        const std::string memory_path = WORK_SPACE_PATH + "/slam_data/memory";
+        if (
+            !FileManager::CreateDirectory(WORK_SPACE_PATH + "/slam_data") ||
+            !FileManager::CreateDirectory(memory_path)
+        ) {
+            return false;
+        }
+
+        std::string node_name = ros::this_node::getName();
+        std::replace(node_name.begin(), node_name.end(), '/', '_');
+        node_name.erase(0, node_name.find_first_not_of('_'));
+
+        file_path = memory_path + "/" + node_name + ".txt";
+    }
+
+    // <group>.memory.<container> in bytes, the resident set size first:
+    std::ostringstream oss;
+    oss << "process.memory.rss " << GetResidentSetSize() << "\n";
+
+    size_t total_bytes = 0;
+    MetricsRegistry::GetInstance().ForEachGauge(
+        [&](const std::string& name, const Gauge& gauge) {
+            if (std::string::npos == name.find(".memory.") || 0 == name.find("process.")) {
+                return;
+            }
+
+            const size_t bytes = static_cast<size_t>(gauge.Get());
+            total_bytes += bytes;
+            oss << name << " " << bytes << "\n";
+        }
+    );
+    oss << "total " << total_bytes << "\n";
+    report = oss.str();
+
+    std::ofstream ofs(file_path);
+    if (!ofs) {
+        LOG(ERROR) << "Cannot write memory report to " << file_path;
+        return false;
+    }
+    ofs << report;
+
+    return true;
+}
+
+bool MetricsPublisher::DumpMemoryCallback(dumpMemory::Request &request, dumpMemory::Response &response) {
+    response.file_path = request.file_path;
+    response.succeed = DumpMemory(response.file_path, response.report);
+
+    return response.succeed;
+}
+
+void MetricsPublisher::Serve(int port) {
+    const int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_fd < 0) {
+        LOG(ERROR) << "Cannot create metrics socket: " << strerror(errno);
+        return;
+    }
+
+    const int enable = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+
+    if (
+        bind(server_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+        listen(server_fd, 4) < 0
+    ) {
+        LOG(ERROR) << "Cannot serve metrics on port " << port << ": " << strerror(errno);
+        close(server_fd);
+        return;
+    }
+
+    LOG(INFO) << "Serving Prometheus metrics on port " << port;
+
+    char request[1024];
+    while (running_) {
+        // wake up periodically to check for shutdown:
+        pollfd server_poll = {server_fd, POLLIN, 0};
+        if (poll(&server_poll, 1, 200) <= 0) {
+            continue;
+        }
+
+        const int client_fd = accept(server_fd, nullptr, nullptr);
+        if (client_fd < 0) {
+            continue;
+        }
+
+        // every request, whatever its path, gets the metrics:
+        pollfd client_poll = {client_fd, POLLIN, 0};
+        if (poll(&client_poll, 1, 200) > 0) {
+            recv(client_fd, request, sizeof(request), 0);
+        }
+
+        const std::string body = MetricsRegistry::GetInstance().GetPrometheusText();
+        std::ostringstream response;
+        response << "HTTP/1.0 200 OK\r\n"
+                 << "Content-Type: text/plain; version=0.0.4\r\n"
+                 << "Content-Length: " << body.size() << "\r\n"
+                 << "Connection: close\r\n\r\n"
+                 << body;
+
+        const std::string data = response.str();
+        size_t num_sent = 0;
+        while (num_sent < data.size()) {
+            const ssize_t n = send(client_fd, data.data() + num_sent, data.size() - num_sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                break;
+            }
+            num_sent += n;
+        }
+
+        close(client_fd);
+    }
+
+    close(server_fd);
+}
+} // namespace lidar_localization
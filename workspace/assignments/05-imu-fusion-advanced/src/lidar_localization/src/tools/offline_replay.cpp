@@ -0,0 +1,86 @@
+/*
+ * @Description: offline replay, feed subscribers from rosbag synchronously and loop publishers back in process
+ * @Author: Ge Yao
+ * @Date: 2020-12-22 15:42:18
+ */
+#include "lidar_localization/tools/offline_replay.hpp"
+
+#include <algorithm>
+#include <memory>
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+OfflineReplay& OfflineReplay::GetInstance(void) {
+    static OfflineReplay instance;
+
+    return instance;
+}
+
+bool OfflineReplay::Play(const std::vector<std::string>& bag_paths, const std::function<void(void)>& on_message) {
+    if (!enabled_) {
+        LOG(ERROR) << "Offline replay is not enabled.";
+        return false;
+    }
+
+    std::vector<std::string> topics;
+    for (const auto& topic_handlers: handlers_) {
+        topics.push_back(topic_handlers.first);
+    }
+
+    // the view merges all bags in timestamp order, so the bags have to stay open while replaying:
+    std::vector<std::unique_ptr<rosbag::Bag>> bags;
+    rosbag::View view;
+    for (const std::string& bag_path: bag_paths) {
+        std::unique_ptr<rosbag::Bag> bag(new rosbag::Bag());
+        try {
+            bag->open(bag_path, rosbag::bagmode::Read);
+        } catch (const rosbag::BagException& e) {
+            LOG(ERROR) << "Failed to open rosbag " << bag_path << ": " << e.what();
+            return false;
+        }
+
+        view.addQuery(*bag, rosbag::TopicQuery(topics));
+        bags.push_back(std::move(bag));
+    }
+
+    if (0 == view.size()) {
+        LOG(ERROR) << "No subscribed topic found in the rosbags.";
+        return false;
+    }
+
+    LOG(INFO) << "Replay " << view.size() << " messages, "
+              << (view.getEndTime() - view.getBeginTime()).toSec() << " seconds of data.";
+
+    ros::WallTime start_time = ros::WallTime::now();
+    size_t num_messages = 0;
+    for (const rosbag::MessageInstance& message: view) {
+        if (!ros::ok()) {
+            LOG(WARNING) << "Offline replay interrupted.";
+            break;
+        }
+
+        auto it = handlers_.find(message.getTopic());
+        if (it != handlers_.end()) {
+            for (const Handler& handler: it->second) {
+                if (handler.data_type == message.getDataType()) {
+                    handler.from_bag(message);
+                }
+            }
+        }
+
+        on_message();
+
+        ++num_messages;
+    }
+
+    double wall_time = (ros::WallTime::now() - start_time).toSec();
+    LOG(INFO) << "Replayed " << num_messages << " messages in " << wall_time << " seconds, "
+              << (view.getEndTime() - view.getBeginTime()).toSec() / std::max(wall_time, 1.0e-6)
+              << "x real time.";
+
+    return true;
+}
+
+} // namespace lidar_localization
@@ -0,0 +1,104 @@
+/*
+ * @Description: runtime selection of the SIMD kernels by the instruction sets of the CPU
+ * @Author: Ge Yao
+ * @Date: 2021-01-25 10:37:52
+ */
+#include "lidar_localization/tools/simd_dispatch.hpp"
+
+#include <cstdlib>
+
+#if defined(__GNUC__) && defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#ifndef HWCAP_ASIMDDP
+#define HWCAP_ASIMDDP (1 << 20)
+#endif
+#endif
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+namespace {
+const char *LEVEL_NAMES[] = {"scalar", "sse2", "neon", "neon_dotprod", "avx2", "avx512"};
+const int NUM_LEVELS = sizeof(LEVEL_NAMES) / sizeof(LEVEL_NAMES[0]);
+
+unsigned GetBit(SIMDLevel level) {
+    return 1u << static_cast<unsigned>(level);
+}
+
+unsigned DetectLevels(void) {
+    unsigned levels = GetBit(SIMDLevel::SCALAR);
+
+#if defined(__GNUC__) && defined(__x86_64__)
+    levels |= GetBit(SIMDLevel::SSE2);
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        levels |= GetBit(SIMDLevel::AVX2);
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        levels |= GetBit(SIMDLevel::AVX512);
+    }
+#elif defined(__GNUC__) && defined(__aarch64__)
+    levels |= GetBit(SIMDLevel::NEON);
+#if defined(__linux__)
+    if (0 != (getauxval(AT_HWCAP) & HWCAP_ASIMDDP)) {
+        levels |= GetBit(SIMDLevel::NEON_DOTPROD);
+    }
+#endif
+#endif
+
+    return levels;
+}
+
+int GetInitialMaxLevel(void) {
+    const char *name = std::getenv("LIDAR_LOCALIZATION_SIMD");
+    SIMDLevel level = SIMDLevel::AVX512;
+    if (nullptr != name && !SIMDDispatch::GetLevel(name, level)) {
+        LOG(WARNING) << "Unknown SIMD level " << name << " of LIDAR_LOCALIZATION_SIMD, all levels are enabled.";
+    }
+
+    return static_cast<int>(level);
+}
+} // namespace
+
+unsigned SIMDDispatch::GetSupportedLevels(void) {
+    static const unsigned SUPPORTED_LEVELS = DetectLevels();
+
+    return SUPPORTED_LEVELS;
+}
+
+std::atomic<int> &SIMDDispatch::GetMaxLevel(void) {
+    static std::atomic<int> max_level(GetInitialMaxLevel());
+
+    return max_level;
+}
+
+SIMDLevel SIMDDispatch::GetLevel(void) {
+    for (int i = NUM_LEVELS - 1; i > 0; --i) {
+        if (IsEnabled(static_cast<SIMDLevel>(i))) {
+            return static_cast<SIMDLevel>(i);
+        }
+    }
+
+    return SIMDLevel::SCALAR;
+}
+
+void SIMDDispatch::SetMaxLevel(SIMDLevel level) {
+    GetMaxLevel().store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+const char *SIMDDispatch::GetName(SIMDLevel level) {
+    return LEVEL_NAMES[static_cast<int>(level)];
+}
+
+bool SIMDDispatch::GetLevel(const std::string &name, SIMDLevel &level) {
+    for (int i = 0; i < NUM_LEVELS; ++i) {
+        if (name == LEVEL_NAMES[i]) {
+            level = static_cast<SIMDLevel>(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+} // namespace lidar_localization
@@ -0,0 +1,360 @@
+/*
+ * @Description: cache of the outputs of a pipeline stage, played back instead of rerunning the stages upstream
+ * @Author: Ge Yao
+ * @Date: 2021-01-14 21:08:45
+ */
+#include "lidar_localization/tools/stage_cache.hpp"
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iterator>
+
+#include <boost/filesystem.hpp>
+
+#include "glog/logging.h"
+
+#include "lidar_localization/tools/file_manager.hpp"
+
+namespace lidar_localization {
+
+namespace {
+enum CacheRecordType : uint32_t {
+    // followed by name_size bytes of stream name:
+    STREAM_RECORD = 1,
+    MESSAGE_RECORD = 2,
+    END_RECORD = 3
+};
+
+struct StreamRecord {
+    uint32_t stream_type;
+    uint32_t name_size;
+};
+
+struct MessageRecord {
+    double time;
+    uint32_t stream;
+    uint32_t sequence;
+    uint32_t index;
+    uint32_t reserved;
+};
+
+struct EndRecord {
+    uint64_t num_messages;
+};
+
+// messages are committed in batches, only the end record has to be durable:
+const size_t COMMIT_INTERVAL = 256;
+
+// FNV-1a:
+void Hash(const void *data, size_t size, uint64_t& hash) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+}
+
+void Hash(const std::string& value, uint64_t& hash) {
+    // sized, so that consecutive values cannot run into each other:
+    const uint64_t size = value.size();
+    Hash(&size, sizeof(size), hash);
+    Hash(value.data(), value.size(), hash);
+}
+}
+
+StageCache::StageCache(const std::string& cache_path, float resolution, bool use_lz4)
+    : cache_path_(cache_path),
+      resolution_(resolution),
+      use_lz4_(use_lz4) {
+    if (!FileManager::InitDirectory(cache_path_, "Stage Cache")) {
+        return;
+    }
+
+    message_log_ptr_ = std::make_shared<CheckpointLog>(cache_path_ + "/messages.bin", true);
+}
+
+StageCache::~StageCache() {
+    // an unfinished cache is left incomplete, so it is never played:
+    if (!is_finished_ && message_log_ptr_) {
+        LOG(WARNING) << "Stage cache " << cache_path_ << " is not finished, it will be recorded again.";
+    }
+}
+
+int StageCache::AddStream(const std::string& stream_name, StreamType stream_type) {
+    if (!message_log_ptr_ || is_finished_) {
+        return -1;
+    }
+
+    Stream stream;
+    stream.name = stream_name;
+    stream.type = stream_type;
+
+    const std::string stream_path = GetStreamPath(cache_path_, stream_name);
+    if (!FileManager::CreateDirectory(stream_path)) {
+        return -1;
+    }
+    if (CLOUD_STREAM == stream_type) {
+        stream.cloud_store_ptr = std::make_shared<PackedKeyFrameStore>(stream_path, resolution_, use_lz4_);
+    } else {
+        stream.pose_log_ptr = std::make_shared<TrajectoryLog>(stream_path + "/poses.bin");
+    }
+
+    StreamRecord record;
+    record.stream_type = stream_type;
+    record.name_size = static_cast<uint32_t>(stream_name.size());
+
+    std::vector<char> data(sizeof(record) + stream_name.size());
+    std::memcpy(data.data(), &record, sizeof(record));
+    std::memcpy(data.data() + sizeof(record), stream_name.data(), stream_name.size());
+    message_log_ptr_->Add(STREAM_RECORD, data.data(), data.size());
+
+    streams_.push_back(stream);
+
+    return static_cast<int>(streams_.size()) - 1;
+}
+
+bool StageCache::AddCloud(int stream, double time, const CloudData::CLOUD& cloud) {
+    if (
+        stream < 0 || stream >= static_cast<int>(streams_.size()) ||
+        CLOUD_STREAM != streams_.at(stream).type || is_finished_
+    ) {
+        return false;
+    }
+
+    Stream& cloud_stream = streams_.at(stream);
+    if (!cloud_stream.cloud_store_ptr->Save(cloud_stream.num_messages, cloud)) {
+        return false;
+    }
+
+    return AddMessage(stream, time, 0);
+}
+
+bool StageCache::AddPose(int stream, double time, const Eigen::Matrix4f& pose, unsigned int index) {
+    if (
+        stream < 0 || stream >= static_cast<int>(streams_.size()) ||
+        POSE_STREAM != streams_.at(stream).type || is_finished_
+    ) {
+        return false;
+    }
+
+    if (!streams_.at(stream).pose_log_ptr->Append(pose)) {
+        return false;
+    }
+
+    return AddMessage(stream, time, index);
+}
+
+bool StageCache::AddMessage(int stream, double time, unsigned int index) {
+    Stream& message_stream = streams_.at(stream);
+
+    MessageRecord record;
+    record.time = time;
+    record.stream = static_cast<uint32_t>(stream);
+    record.sequence = message_stream.num_messages;
+    record.index = index;
+    record.reserved = 0;
+    message_log_ptr_->Add(MESSAGE_RECORD, record);
+
+    ++message_stream.num_messages;
+    if (0 == ++num_messages_ % COMMIT_INTERVAL) {
+        message_log_ptr_->Commit();
+    }
+
+    return true;
+}
+
+bool StageCache::Finish(void) {
+    if (!message_log_ptr_ || is_finished_) {
+        return false;
+    }
+
+    // the end record only goes to disk after all the messages it ends:
+    size_t num_failed = 0;
+    for (Stream& stream: streams_) {
+        if (stream.pose_log_ptr) {
+            stream.pose_log_ptr->Flush();
+            num_failed += stream.pose_log_ptr->GetStats().num_failed;
+        }
+    }
+    message_log_ptr_->Commit();
+    message_log_ptr_->Flush();
+    num_failed += message_log_ptr_->GetStats().num_failed;
+
+    if (num_failed > 0) {
+        LOG(ERROR) << "Failed to write stage cache " << cache_path_;
+        return false;
+    }
+
+    EndRecord record;
+    record.num_messages = num_messages_;
+    message_log_ptr_->Add(END_RECORD, record);
+    message_log_ptr_->Commit();
+    message_log_ptr_->Flush();
+
+    is_finished_ = (0 == message_log_ptr_->GetStats().num_failed);
+
+    LOG(INFO) << "Stage cache " << cache_path_ << " finished: "
+              << num_messages_ << " messages in " << streams_.size() << " streams.";
+
+    return is_finished_;
+}
+
+std::string StageCache::GetKey(
+    const std::string& upstream_key,
+    const std::vector<std::string>& config_file_paths,
+    const std::vector<std::string>& data_file_paths
+) {
+    uint64_t hash = 14695981039346656037ull;
+    Hash(upstream_key, hash);
+
+    for (const std::string& file_path: config_file_paths) {
+        std::ifstream ifs(file_path.c_str(), std::ios::in | std::ios::binary);
+        const bool is_found = ifs.is_open();
+        std::string content(
+            (std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>()
+        );
+
+        // a missing config is a change too:
+        Hash(file_path, hash);
+        Hash(is_found ? content : std::string("<missing>"), hash);
+    }
+
+    // rosbags are too large to be hashed at every run:
+    for (const std::string& file_path: data_file_paths) {
+        boost::system::error_code error_code;
+        const uint64_t file_size = boost::filesystem::file_size(file_path, error_code);
+        const int64_t modified_time = static_cast<int64_t>(boost::filesystem::last_write_time(file_path, error_code));
+
+        Hash(boost::filesystem::absolute(file_path).string(), hash);
+        Hash(&file_size, sizeof(file_size), hash);
+        Hash(&modified_time, sizeof(modified_time), hash);
+    }
+
+    char key[17];
+    std::snprintf(key, sizeof(key), "%016llx", static_cast<unsigned long long>(hash));
+
+    return std::string(key);
+}
+
+bool StageCache::IsComplete(const std::string& cache_path) {
+    Index index;
+    return ReadIndex(cache_path, index) && index.is_complete;
+}
+
+bool StageCache::Play(const std::string& cache_path, const MessageHandler& handler) {
+    Index index;
+    if (!ReadIndex(cache_path, index) || !index.is_complete) {
+        LOG(ERROR) << "No complete stage cache in " << cache_path;
+        return false;
+    }
+
+    std::vector<std::deque<Eigen::Matrix4f>> poses(index.streams.size());
+    std::vector<std::shared_ptr<PackedKeyFrameStore>> cloud_stores(index.streams.size());
+    for (size_t i = 0; i < index.streams.size(); ++i) {
+        const std::string stream_path = GetStreamPath(cache_path, index.streams.at(i).first);
+        if (CLOUD_STREAM == index.streams.at(i).second) {
+            // the resolution is stored with each cloud:
+            cloud_stores.at(i) = std::make_shared<PackedKeyFrameStore>(stream_path, 0.0f, false);
+        } else if (!TrajectoryLog::Load(stream_path + "/poses.bin", poses.at(i))) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < index.messages.size(); ++i) {
+        const uint32_t stream = index.messages.at(i).first;
+        const uint32_t sequence = index.messages.at(i).second;
+
+        Message message;
+        message.stream_name = index.streams.at(stream).first;
+        message.stream_type = index.streams.at(stream).second;
+        message.time = index.times.at(i);
+        message.index = index.indices.at(i);
+
+        if (CLOUD_STREAM == message.stream_type) {
+            message.cloud_ptr.reset(new CloudData::CLOUD());
+            if (!cloud_stores.at(stream)->Load(sequence, *message.cloud_ptr)) {
+                LOG(ERROR) << "Missing cloud " << sequence << " of " << message.stream_name << " in " << cache_path;
+                return false;
+            }
+        } else {
+            if (sequence >= poses.at(stream).size()) {
+                LOG(ERROR) << "Missing pose " << sequence << " of " << message.stream_name << " in " << cache_path;
+                return false;
+            }
+            message.pose = poses.at(stream).at(sequence);
+        }
+
+        if (!handler(message)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::string StageCache::GetStreamPath(const std::string& cache_path, const std::string& stream_name) {
+    // topic names, e.g. /synced_cloud:
+    std::string directory_name;
+    for (char c: stream_name) {
+        if (std::isalnum(static_cast<unsigned char>(c)) || '_' == c) {
+            directory_name.push_back(c);
+        } else if (!directory_name.empty()) {
+            directory_name.push_back('_');
+        }
+    }
+
+    return cache_path + "/" + directory_name;
+}
+
+bool StageCache::ReadIndex(const std::string& cache_path, Index& index) {
+    index = Index();
+
+    return CheckpointLog::Replay(
+        cache_path + "/messages.bin",
+        [&index](uint32_t type, const char *data, size_t size) {
+            if (STREAM_RECORD == type) {
+                StreamRecord record;
+                if (size < sizeof(record)) {
+                    return false;
+                }
+                std::memcpy(&record, data, sizeof(record));
+                if (size != sizeof(record) + record.name_size) {
+                    return false;
+                }
+
+                index.streams.emplace_back(
+                    std::string(data + sizeof(record), record.name_size),
+                    static_cast<StreamType>(record.stream_type)
+                );
+            } else if (MESSAGE_RECORD == type) {
+                MessageRecord record;
+                if (size != sizeof(record)) {
+                    return false;
+                }
+                std::memcpy(&record, data, sizeof(record));
+                if (record.stream >= index.streams.size()) {
+                    return false;
+                }
+
+                index.messages.emplace_back(record.stream, record.sequence);
+                index.times.push_back(record.time);
+                index.indices.push_back(record.index);
+            } else if (END_RECORD == type) {
+                EndRecord record;
+                if (size != sizeof(record)) {
+                    return false;
+                }
+                std::memcpy(&record, data, sizeof(record));
+
+                index.is_complete = (record.num_messages == index.messages.size());
+            }
+
+            return true;
+        }
+    );
+}
+
+} // namespace lidar_localization
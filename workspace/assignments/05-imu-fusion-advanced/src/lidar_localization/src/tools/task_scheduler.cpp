@@ -0,0 +1,227 @@
+/*
+ * @Description: process-wide work-stealing task pool for the parallel loops of all modules
+ * @Author: Ge Yao
+ * @Date: 2020-12-30 16:08:27
+ */
+#include "lidar_localization/tools/task_scheduler.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <omp.h>
+#include <yaml-cpp/yaml.h>
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+
+namespace lidar_localization {
+
+namespace {
+// index of the worker running on this thread, -1 for the other threads:
+thread_local int current_worker_index = -1;
+}
+
+TaskScheduler& TaskScheduler::GetInstance(void) {
+    static TaskScheduler instance;
+
+    return instance;
+}
+
+TaskScheduler::TaskScheduler()
+    : num_tasks_(MetricsRegistry::GetInstance().GetCounter("task_scheduler.tasks")),
+      num_steals_(MetricsRegistry::GetInstance().GetCounter("task_scheduler.steals")) {
+    YAML::Node config_node = YAML::LoadFile(WORK_SPACE_PATH + "/config/tools/task_scheduler.yaml");
+
+    int num_threads = config_node["num_threads"].as<int>();
+    if (num_threads <= 0) {
+        num_threads = static_cast<int>(std::thread::hardware_concurrency()) - 1;
+    }
+    num_threads = std::max(num_threads, 0);
+    const std::vector<int> cpus = config_node["cpus"].as<std::vector<int>>();
+
+    std::string reduction_mode = config_node["reduction_mode"] ?
+        config_node["reduction_mode"].as<std::string>() : "fast";
+    if (reduction_mode == "deterministic") {
+        reduction_mode_ = DETERMINISTIC;
+    } else if (reduction_mode != "fast") {
+        LOG(ERROR) << "Reduction mode " << reduction_mode << " NOT FOUND, use fast.";
+        reduction_mode = "fast";
+    }
+    if (config_node["deterministic_num_chunks"]) {
+        deterministic_num_chunks_ = std::max(config_node["deterministic_num_chunks"].as<int>(), 1);
+    }
+
+    // the pool is still created in full, so the limit can be raised again:
+    const char* thread_limit = std::getenv("LIDAR_LOCALIZATION_NUM_THREADS");
+    if (nullptr != thread_limit) {
+        SetThreadLimit(std::atoi(thread_limit));
+    }
+
+    for (int i = 0; i < num_threads; ++i) {
+        workers_.emplace_back(new Worker());
+    }
+    for (int i = 0; i < num_threads; ++i) {
+        Worker& worker = *workers_.at(i);
+        worker.thread = std::thread(&TaskScheduler::RunWorker, this, i);
+
+        if (!cpus.empty()) {
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            CPU_SET(cpus.at(i % cpus.size()), &cpu_set);
+            if (0 != pthread_setaffinity_np(worker.thread.native_handle(), sizeof(cpu_set_t), &cpu_set)) {
+                LOG(WARNING) << "Failed to pin task scheduler worker " << i << " to CPU " << cpus.at(i % cpus.size());
+            }
+        }
+    }
+
+    std::cout << "Task Scheduler params:" << std::endl
+              << "\tnum. workers: " << workers_.size() << std::endl
+              << "\tnum. pinned CPUs: " << cpus.size() << std::endl
+              << "\treduction mode: " << reduction_mode << std::endl
+              << "\tthread limit: " << thread_limit_.load() << std::endl
+              << std::endl;
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    has_task_.notify_all();
+
+    for (std::unique_ptr<Worker>& worker: workers_) {
+        worker->thread.join();
+    }
+}
+
+int TaskScheduler::GetChunkSize(int num_indices, int grain_size) const {
+    // a few chunks per thread, so a stolen or late one doesn't hold up the loop:
+    const int max_num_chunks = 4 * GetNumActiveThreads();
+
+    return std::max((num_indices + max_num_chunks - 1) / max_num_chunks, std::max(grain_size, 1));
+}
+
+int TaskScheduler::GetDeterministicChunkSize(int num_indices, int grain_size) const {
+    return std::max((num_indices + deterministic_num_chunks_ - 1) / deterministic_num_chunks_, std::max(grain_size, 1));
+}
+
+void TaskScheduler::Run(int num_chunks, const std::function<void(int)>& run_chunk, Priority priority) {
+    const int num_active_threads = GetNumActiveThreads();
+    if (num_chunks <= 1 || num_active_threads <= 1) {
+        for (int chunk = 0; chunk < num_chunks; ++chunk) {
+            run_chunk(chunk);
+        }
+        return;
+    }
+
+    // helpers popped after the loop is done find no chunk left, so the job outlives the call:
+    std::shared_ptr<Job> job_ptr = std::make_shared<Job>();
+    job_ptr->run_chunk = run_chunk;
+    job_ptr->num_chunks = num_chunks;
+
+    const int num_helpers = std::min(num_chunks - 1, num_active_threads - 1);
+    for (int i = 0; i < num_helpers; ++i) {
+        Push([job_ptr]{ RunChunks(*job_ptr); }, priority);
+    }
+
+    RunChunks(*job_ptr);
+
+    // the remaining chunks are being run by the helpers that took them:
+    std::unique_lock<std::mutex> lock(job_ptr->mutex);
+    job_ptr->done.wait(lock, [&job_ptr]{ return job_ptr->num_done.load() == job_ptr->num_chunks; });
+}
+
+void TaskScheduler::RunChunks(Job& job) {
+    int num_done = 0;
+    for (int chunk = job.next_chunk++; chunk < job.num_chunks; chunk = job.next_chunk++) {
+        job.run_chunk(chunk);
+        ++num_done;
+    }
+
+    if (num_done > 0 && job.num_done.fetch_add(num_done) + num_done == job.num_chunks) {
+        { std::lock_guard<std::mutex> lock(job.mutex); }
+        job.done.notify_all();
+    }
+}
+
+void TaskScheduler::Push(Task task, Priority priority) {
+    // a worker keeps its own tasks, the others spread them:
+    const int worker_index = (current_worker_index >= 0) ?
+        current_worker_index : static_cast<int>(next_worker_++ % workers_.size());
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++num_pending_;
+    }
+    {
+        Worker& worker = *workers_.at(worker_index);
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks[priority].push_back(std::move(task));
+    }
+    has_task_.notify_one();
+
+    num_tasks_.Increment();
+}
+
+bool TaskScheduler::Pop(int worker_index, Task& task) {
+    const int N = static_cast<int>(workers_.size());
+
+    for (int priority = REALTIME; priority < NUM_PRIORITIES; ++priority) {
+        // own tasks, newest first:
+        {
+            Worker& worker = *workers_.at(worker_index);
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            std::deque<Task>& tasks = worker.tasks[priority];
+            if (!tasks.empty()) {
+                task = std::move(tasks.back());
+                tasks.pop_back();
+                return true;
+            }
+        }
+
+        // steal the oldest of the others:
+        for (int i = 1; i < N; ++i) {
+            Worker& victim = *workers_.at((worker_index + i) % N);
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            std::deque<Task>& tasks = victim.tasks[priority];
+            if (!tasks.empty()) {
+                task = std::move(tasks.front());
+                tasks.pop_front();
+                num_steals_.Increment();
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void TaskScheduler::RunWorker(int worker_index) {
+    current_worker_index = worker_index;
+    // the cores are already shared out by the pool, OpenMP regions within the tasks run serially:
+    omp_set_num_threads(1);
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            has_task_.wait(lock, [this]{ return stop_ || num_pending_ > 0; });
+            if (stop_)
+                return;
+        }
+
+        Task task;
+        if (Pop(worker_index, task)) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                --num_pending_;
+            }
+            task();
+        }
+    }
+}
+
+} // namespace lidar_localization
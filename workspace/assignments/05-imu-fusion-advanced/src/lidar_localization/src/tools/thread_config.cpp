@@ -0,0 +1,111 @@
+/*
+ * @Description: CPU affinity, scheduling class & memory locking of the main loop of a node
+ * @Author: Ge Yao
+ * @Date: 2020-12-30 17:21:44
+ */
+#include "lidar_localization/tools/thread_config.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <yaml-cpp/yaml.h>
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+
+namespace lidar_localization {
+
+ThreadConfig::ThreadConfig(const std::string& node_name) : node_name_(node_name) {
+    const YAML::Node config_node = YAML::LoadFile(WORK_SPACE_PATH + "/config/tools/thread_config.yaml");
+
+    const YAML::Node& default_node = config_node["default"];
+    const YAML::Node node = config_node["nodes"][node_name];
+    auto get_option = [&](const std::string& name) {
+        return (node && node[name]) ? node[name] : default_node[name];
+    };
+
+    cpus_ = get_option("cpus").as<std::vector<int>>();
+    sched_policy_ = get_option("sched_policy").as<std::string>();
+    priority_ = get_option("priority").as<int>();
+    lock_memory_ = get_option("lock_memory").as<bool>();
+    measure_jitter_ = get_option("measure_jitter").as<bool>();
+
+    std::cout << "Thread Config params of " << node_name_ << ":" << std::endl
+              << "\tnum. pinned CPUs: " << cpus_.size() << std::endl
+              << "\tsched. policy: " << sched_policy_ << ", priority " << priority_ << std::endl
+              << "\tlock memory: " << (lock_memory_ ? "true" : "false") << std::endl
+              << "\tmeasure jitter: " << (measure_jitter_ ? "true" : "false") << std::endl
+              << std::endl;
+}
+
+bool ThreadConfig::Apply(void) const {
+    bool is_applied = SetAffinity();
+    is_applied = SetScheduler() && is_applied;
+    is_applied = LockMemory() && is_applied;
+
+    return is_applied;
+}
+
+bool ThreadConfig::SetAffinity(void) const {
+    if (cpus_.empty())
+        return true;
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int cpu: cpus_) {
+        CPU_SET(cpu, &cpu_set);
+    }
+
+    const int error = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set);
+    if (0 != error) {
+        LOG(WARNING) << "Failed to pin " << node_name_ << ": " << std::strerror(error);
+        return false;
+    }
+
+    return true;
+}
+
+bool ThreadConfig::SetScheduler(void) const {
+    int policy;
+    if (sched_policy_ == "other") {
+        return true;
+    } else if (sched_policy_ == "fifo") {
+        policy = SCHED_FIFO;
+    } else if (sched_policy_ == "rr") {
+        policy = SCHED_RR;
+    } else {
+        LOG(ERROR) << "Scheduling policy " << sched_policy_ << " NOT FOUND!";
+        return false;
+    }
+
+    sched_param param;
+    param.sched_priority = priority_;
+    const int error = pthread_setschedparam(pthread_self(), policy, &param);
+    if (0 != error) {
+        LOG(WARNING) << "Failed to set scheduling policy " << sched_policy_ << ", priority " << priority_
+                     << " of " << node_name_ << ": " << std::strerror(error);
+        return false;
+    }
+
+    return true;
+}
+
+bool ThreadConfig::LockMemory(void) const {
+    if (!lock_memory_)
+        return true;
+
+    // the pages mapped later on, e.g. by new clouds, are locked too:
+    if (0 != mlockall(MCL_CURRENT | MCL_FUTURE)) {
+        LOG(WARNING) << "Failed to lock memory of " << node_name_ << ": " << std::strerror(errno);
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace lidar_localization
@@ -0,0 +1,51 @@
+/*
+ * @Description: dump_trace service, writes the trace of this process as Chrome trace JSON
+ * @Author: Ge Yao
+ * @Date: 2020-12-23 14:52:10
+ */
+#include "lidar_localization/tools/trace_service.hpp"
+
+#include <algorithm>
+
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/file_manager.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+
+namespace lidar_localization {
+TraceService::TraceService(ros::NodeHandle& nh) {
+    service_ = nh.advertiseService("dump_trace", &TraceService::DumpTraceCallback, this);
+}
+
+bool TraceService::Dump(std::string& file_path) {
+#ifndef LIDAR_LOCALIZATION_WITH_TRACING
+    LOG(WARNING) << "Built without tracing, the trace is empty.";
+#endif
+    // WORK_SPACE_PATH/slam_data/trace/<node name>.json by default:
+    if (file_path.empty()) {
+        const std::string trace_path = WORK_SPACE_PATH + "/slam_data/trace";
+        if (
+            !FileManager::CreateDirectory(WORK_SPACE_PATH + "/slam_data") ||
+            !FileManager::CreateDirectory(trace_path)
+        ) {
+            return false;
+        }
+
+        std::string node_name = ros::this_node::getName();
+        std::replace(node_name.begin(), node_name.end(), '/', '_');
+        node_name.erase(0, node_name.find_first_not_of('_'));
+
+        file_path = trace_path + "/" + node_name + ".json";
+    }
+
+    return Tracer::GetInstance().Dump(file_path, ros::this_node::getName());
+}
+
+bool TraceService::DumpTraceCallback(dumpTrace::Request &request, dumpTrace::Response &response) {
+    response.file_path = request.file_path;
+    response.succeed = Dump(response.file_path);
+
+    return response.succeed;
+}
+} // namespace lidar_localization
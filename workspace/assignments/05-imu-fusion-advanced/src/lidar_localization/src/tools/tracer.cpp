@@ -0,0 +1,175 @@
+/*
+ * @Description: scoped per-stage latency tracing, dumped as Chrome trace JSON
+ * @Author: Ge Yao
+ * @Date: 2020-12-23 14:05:37
+ */
+#include "lidar_localization/tools/tracer.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <fstream>
+#include <map>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+const size_t Tracer::RING_BUFFER_SIZE;
+
+Tracer& Tracer::GetInstance(void) {
+    static Tracer instance;
+
+    return instance;
+}
+
+Tracer::ThreadBuffer& Tracer::GetThreadBuffer(void) {
+    thread_local ThreadBuffer* thread_buffer = nullptr;
+
+    if (nullptr == thread_buffer) {
+        std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+        buffer->thread_id = syscall(SYS_gettid);
+        buffer->events.resize(RING_BUFFER_SIZE);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        thread_buffer = buffer.get();
+        thread_buffers_.push_back(std::move(buffer));
+    }
+
+    return *thread_buffer;
+}
+
+void Tracer::Record(const char* name, const char* category, int64_t start, int64_t end) {
+    ThreadBuffer& buffer = GetThreadBuffer();
+
+    // only contended during dump:
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    Event& event = buffer.events[buffer.num_events % RING_BUFFER_SIZE];
+    event.name = name;
+    event.category = category;
+    event.start = start;
+    event.duration = end - start;
+    ++buffer.num_events;
+}
+
+bool Tracer::Dump(const std::string& file_path, const std::string& process_name) {
+    std::ofstream ofs(file_path.c_str(), std::ios::out);
+    if (!ofs) {
+        LOG(ERROR) << "Cannot write trace " << file_path;
+        return false;
+    }
+
+    const long process_id = getpid();
+
+    ofs << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[" << std::endl;
+    ofs << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << process_id
+        << ",\"args\":{\"name\":\"" << process_name << "\"}}";
+
+    size_t num_events = 0, num_dropped = 0;
+    std::vector<Event> events;
+    char line[512];
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const std::unique_ptr<ThreadBuffer>& buffer: thread_buffers_) {
+        long thread_id;
+        size_t num_recorded;
+        {
+            std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+            thread_id = buffer->thread_id;
+            num_recorded = buffer->num_events;
+            events = buffer->events;
+        }
+
+        const size_t num_kept = std::min(num_recorded, RING_BUFFER_SIZE);
+        // oldest first:
+        for (size_t i = num_recorded - num_kept; i < num_recorded; ++i) {
+            const Event& event = events[i % RING_BUFFER_SIZE];
+            // complete events, ts & dur in us:
+            snprintf(
+                line, sizeof(line),
+                ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%ld}",
+                event.name, event.category,
+                1.0e-3 * event.start, 1.0e-3 * event.duration,
+                process_id, thread_id
+            );
+            ofs << line;
+        }
+
+        num_events += num_kept;
+        num_dropped += num_recorded - num_kept;
+    }
+
+    ofs << std::endl << "]}" << std::endl;
+
+    if (!ofs) {
+        LOG(ERROR) << "Failed to write trace " << file_path;
+        return false;
+    }
+
+    LOG(INFO) << "Trace of " << thread_buffers_.size() << " threads, " << num_events << " events saved to "
+              << file_path << ", " << num_dropped << " older events dropped.";
+
+    return true;
+}
+
+void Tracer::Summarize(std::vector<ScopeStats>& scope_stats) {
+    // names are string literals, the same scope may still have several copies of its name:
+    std::map<std::string, ScopeStats> stats_by_name;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const std::unique_ptr<ThreadBuffer>& buffer: thread_buffers_) {
+        std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+
+        const size_t num_kept = std::min(buffer->num_events, RING_BUFFER_SIZE);
+        for (size_t i = buffer->num_events - num_kept; i < buffer->num_events; ++i) {
+            const Event& event = buffer->events[i % RING_BUFFER_SIZE];
+            ScopeStats& stats = stats_by_name[event.name];
+            ++stats.num_calls;
+            stats.total_duration += event.duration;
+        }
+    }
+
+    scope_stats.clear();
+    for (auto& stats: stats_by_name) {
+        stats.second.name = stats.first;
+        scope_stats.push_back(stats.second);
+    }
+    std::sort(
+        scope_stats.begin(), scope_stats.end(),
+        [](const ScopeStats& lhs, const ScopeStats& rhs) { return lhs.total_duration > rhs.total_duration; }
+    );
+}
+
+void Tracer::Clear(void) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const std::unique_ptr<ThreadBuffer>& buffer: thread_buffers_) {
+        std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+        buffer->num_events = 0;
+    }
+}
+
+JitterMonitor::JitterMonitor(const std::string& name, double period, bool enabled)
+    : enabled_(enabled),
+      period_(static_cast<int64_t>(period * 1.0e9)),
+      jitter_(MetricsRegistry::GetInstance().GetLatencyHistogram(name + ".loop_jitter")) {
+}
+
+void JitterMonitor::Tick(void) {
+    if (!enabled_)
+        return;
+
+    const int64_t now = Tracer::Now();
+    if (last_tick_ > 0) {
+        const int64_t expected = last_tick_ + period_;
+        jitter_.Record(std::llabs(now - expected));
+#ifdef LIDAR_LOCALIZATION_WITH_TRACING
+        Tracer::GetInstance().Record("loop_jitter", "jitter", std::min(now, expected), std::max(now, expected));
+#endif
+    }
+    last_tick_ = now;
+}
+
+} // namespace lidar_localization
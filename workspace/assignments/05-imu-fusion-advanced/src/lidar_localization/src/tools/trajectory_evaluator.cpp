@@ -0,0 +1,374 @@
+/*
+ * @Description: ATE, RPE & KITTI segment drift of saved trajectories, in place of an evo step
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 20:41:23
+ */
+#include "lidar_localization/tools/trajectory_evaluator.hpp"
+
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+
+#include <Eigen/Geometry>
+
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+#include "lidar_localization/tools/trajectory_log.hpp"
+#include "lidar_localization/tools/task_scheduler.hpp"
+#include "lidar_localization/tools/tracer.hpp"
+
+namespace lidar_localization {
+
+namespace {
+TrajectoryEvaluator::Statistics GetStatistics(std::vector<double> errors) {
+    TrajectoryEvaluator::Statistics statistics;
+    if (errors.empty())
+        return statistics;
+
+    double sum = 0.0, sum_sq = 0.0;
+    for (double error: errors) {
+        sum += error;
+        sum_sq += error * error;
+    }
+    const double n = static_cast<double>(errors.size());
+    statistics.mean = sum / n;
+    statistics.rmse = std::sqrt(sum_sq / n);
+    statistics.std = std::sqrt(std::max(sum_sq / n - statistics.mean * statistics.mean, 0.0));
+
+    std::sort(errors.begin(), errors.end());
+    statistics.min = errors.front();
+    statistics.max = errors.back();
+    const size_t mid = errors.size() / 2;
+    statistics.median = (errors.size() % 2 == 1) ? errors.at(mid) : 0.5 * (errors.at(mid - 1) + errors.at(mid));
+
+    return statistics;
+}
+
+// error of the estimated motion from i to j, w.r.t. the reference one:
+Eigen::Matrix4d GetRelativeError(
+    const Eigen::Matrix4d& estimated_i, const Eigen::Matrix4d& estimated_j,
+    const Eigen::Matrix4d& reference_i, const Eigen::Matrix4d& reference_j
+) {
+    return (reference_i.inverse() * reference_j).inverse() * (estimated_i.inverse() * estimated_j);
+}
+
+double GetRotationError(const Eigen::Matrix4d& error) {
+    const double cos_angle = 0.5 * (error.block<3, 3>(0, 0).trace() - 1.0);
+    return std::acos(std::max(std::min(cos_angle, 1.0), -1.0));
+}
+
+void WriteStatistics(std::ostream& os, const TrajectoryEvaluator::Statistics& statistics) {
+    os << "{\"rmse\":" << statistics.rmse
+       << ",\"mean\":" << statistics.mean
+       << ",\"median\":" << statistics.median
+       << ",\"std\":" << statistics.std
+       << ",\"min\":" << statistics.min
+       << ",\"max\":" << statistics.max << "}";
+}
+
+void WriteDrift(std::ostream& os, const TrajectoryEvaluator::Drift& drift) {
+    os << "{\"length\":" << drift.length
+       << ",\"num_segments\":" << drift.num_segments
+       << ",\"translation\":" << drift.translation_error
+       << ",\"rotation\":" << drift.rotation_error << "}";
+}
+}
+
+TrajectoryEvaluator::TrajectoryEvaluator(const YAML::Node& node) {
+    alignment_ = node["alignment"].as<std::string>();
+    rpe_delta_ = std::max(node["rpe_delta"].as<int>(), 1);
+    segment_step_ = std::max(node["segment_step"].as<int>(), 1);
+    segment_lengths_ = node["segment_lengths"].as<std::vector<double>>();
+
+    std::cout << "Trajectory Evaluator params:" << std::endl
+              << "\talignment: " << alignment_ << std::endl
+              << "\tRPE delta: " << rpe_delta_ << std::endl
+              << "\tsegment step: " << segment_step_ << ", num. segment lengths: " << segment_lengths_.size() << std::endl
+              << std::endl;
+}
+
+bool TrajectoryEvaluator::Load(const std::string& file_path, std::vector<Eigen::Matrix4f>& poses) {
+    poses.clear();
+
+    if (TrajectoryLog::IsTrajectoryLog(file_path)) {
+        std::deque<Eigen::Matrix4f> log_poses;
+        if (!TrajectoryLog::Load(file_path, log_poses))
+            return false;
+
+        poses.assign(log_poses.begin(), log_poses.end());
+        return true;
+    }
+
+    std::ifstream ifs(file_path.c_str(), std::ios::in);
+    if (!ifs) {
+        LOG(ERROR) << "Failed to open trajectory " << file_path;
+        return false;
+    }
+
+    std::string line;
+    for (size_t line_number = 1; std::getline(ifs, line); ++line_number) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+
+        std::istringstream iss(line);
+        Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                iss >> pose(i, j);
+            }
+        }
+        if (iss.fail()) {
+            LOG(ERROR) << "Invalid KITTI pose at line " << line_number << " of " << file_path;
+            return false;
+        }
+
+        poses.push_back(pose);
+    }
+
+    return true;
+}
+
+std::string TrajectoryEvaluator::GetTrajectoryPath(const std::string& file) {
+    if (!file.empty() && file.front() == '/')
+        return file;
+
+    return WORK_SPACE_PATH + "/slam_data/trajectory/" + file;
+}
+
+std::vector<TrajectoryEvaluator::Run> TrajectoryEvaluator::GetRuns(const YAML::Node& node) {
+    std::vector<Run> runs;
+    for (const YAML::Node& run_node: node) {
+        Run run;
+        run.name = run_node["name"].as<std::string>();
+        run.estimated_file = GetTrajectoryPath(run_node["estimated"].as<std::string>());
+        run.reference_file = GetTrajectoryPath(run_node["reference"].as<std::string>());
+
+        runs.push_back(run);
+    }
+
+    return runs;
+}
+
+void TrajectoryEvaluator::Align(
+    const std::vector<Eigen::Matrix4d>& estimated,
+    const std::vector<Eigen::Matrix4d>& reference,
+    std::vector<Eigen::Matrix4d>& aligned,
+    double& scale
+) const {
+    aligned = estimated;
+    scale = 1.0;
+    if (alignment_ == "none")
+        return;
+
+    const size_t N = estimated.size();
+    Eigen::Matrix3Xd src(3, N), dst(3, N);
+    for (size_t i = 0; i < N; ++i) {
+        src.col(i) = estimated.at(i).block<3, 1>(0, 3);
+        dst.col(i) = reference.at(i).block<3, 1>(0, 3);
+    }
+
+    // Umeyama, the similarity has the scale in its rotation block:
+    const Eigen::Matrix4d T = Eigen::umeyama(src, dst, alignment_ == "sim3");
+    scale = T.block<3, 1>(0, 0).norm();
+    const Eigen::Matrix3d R = T.block<3, 3>(0, 0) / scale;
+    const Eigen::Vector3d t = T.block<3, 1>(0, 3);
+
+    // the scale applies to positions only:
+    for (size_t i = 0; i < N; ++i) {
+        aligned.at(i).block<3, 3>(0, 0) = R * estimated.at(i).block<3, 3>(0, 0);
+        aligned.at(i).block<3, 1>(0, 3) = scale * R * estimated.at(i).block<3, 1>(0, 3) + t;
+    }
+}
+
+bool TrajectoryEvaluator::Evaluate(
+    const std::vector<Eigen::Matrix4f>& estimated,
+    const std::vector<Eigen::Matrix4f>& reference,
+    Result& result
+) const {
+    TRACE_SCOPE("TrajectoryEvaluator::Evaluate", "tools");
+    result.is_valid = false;
+
+    if (alignment_ != "none" && alignment_ != "se3" && alignment_ != "sim3") {
+        LOG(ERROR) << "Alignment " << alignment_ << " NOT FOUND!";
+        return false;
+    }
+
+    // e.g. the last key frames of the back end are not optimized yet:
+    const size_t N = std::min(estimated.size(), reference.size());
+    if (estimated.size() != reference.size()) {
+        LOG(WARNING) << "Trajectory " << result.name << ": " << estimated.size() << " estimated vs. "
+                     << reference.size() << " reference poses, the first " << N << " are evaluated.";
+    }
+    if (N < 3) {
+        LOG(ERROR) << "Trajectory " << result.name << ": too few poses, " << N;
+        return false;
+    }
+
+    std::vector<Eigen::Matrix4d> estimated_poses(N), reference_poses(N);
+    for (size_t i = 0; i < N; ++i) {
+        estimated_poses.at(i) = estimated.at(i).cast<double>();
+        reference_poses.at(i) = reference.at(i).cast<double>();
+    }
+
+    std::vector<Eigen::Matrix4d> aligned;
+    Align(estimated_poses, reference_poses, aligned, result.scale);
+    result.num_poses = N;
+
+    // a. ATE:
+    std::vector<double> errors(N);
+    for (size_t i = 0; i < N; ++i) {
+        errors.at(i) = (aligned.at(i).block<3, 1>(0, 3) - reference_poses.at(i).block<3, 1>(0, 3)).norm();
+    }
+    result.ate = GetStatistics(errors);
+
+    // b. RPE:
+    std::vector<double> translation_errors, rotation_errors;
+    for (size_t i = 0; i + rpe_delta_ < N; ++i) {
+        const Eigen::Matrix4d error = GetRelativeError(
+            aligned.at(i), aligned.at(i + rpe_delta_), reference_poses.at(i), reference_poses.at(i + rpe_delta_)
+        );
+        translation_errors.push_back(error.block<3, 1>(0, 3).norm());
+        rotation_errors.push_back(GetRotationError(error) * 180.0 / M_PI);
+    }
+    result.rpe_translation = GetStatistics(translation_errors);
+    result.rpe_rotation = GetStatistics(rotation_errors);
+
+    // c. segment drift, as KITTI devkit, by path length of the reference:
+    std::vector<double> distances(N, 0.0);
+    for (size_t i = 1; i < N; ++i) {
+        distances.at(i) = distances.at(i - 1) + (
+            reference_poses.at(i).block<3, 1>(0, 3) - reference_poses.at(i - 1).block<3, 1>(0, 3)
+        ).norm();
+    }
+    result.length = distances.back();
+
+    result.drift = Drift();
+    result.segment_drifts.clear();
+    for (double length: segment_lengths_) {
+        Drift drift;
+        drift.length = length;
+
+        size_t last = 0;
+        for (size_t first = 0; first < N; first += segment_step_) {
+            // segment ends are monotonic in their first pose:
+            last = std::max(last, first);
+            while (last < N && distances.at(last) <= distances.at(first) + length) {
+                ++last;
+            }
+            if (last == N)
+                break;
+
+            const Eigen::Matrix4d error = GetRelativeError(
+                aligned.at(first), aligned.at(last), reference_poses.at(first), reference_poses.at(last)
+            );
+            drift.translation_error += error.block<3, 1>(0, 3).norm() / length;
+            drift.rotation_error += GetRotationError(error) / length;
+            ++drift.num_segments;
+        }
+
+        result.drift.num_segments += drift.num_segments;
+        result.drift.translation_error += drift.translation_error;
+        result.drift.rotation_error += drift.rotation_error;
+        if (drift.num_segments > 0) {
+            drift.translation_error *= 100.0 / drift.num_segments;
+            drift.rotation_error *= 100.0 * 180.0 / M_PI / drift.num_segments;
+        }
+        result.segment_drifts.push_back(drift);
+    }
+    if (result.drift.num_segments > 0) {
+        result.drift.translation_error *= 100.0 / result.drift.num_segments;
+        result.drift.rotation_error *= 100.0 * 180.0 / M_PI / result.drift.num_segments;
+    }
+
+    result.is_valid = true;
+
+    return true;
+}
+
+bool TrajectoryEvaluator::Evaluate(const Run& run, Result& result) const {
+    result = Result();
+    result.name = run.name;
+
+    std::vector<Eigen::Matrix4f> estimated, reference;
+    if (!Load(run.estimated_file, estimated) || !Load(run.reference_file, reference)) {
+        LOG(ERROR) << "Failed to load trajectory " << run.name;
+        return false;
+    }
+
+    return Evaluate(estimated, reference, result);
+}
+
+bool TrajectoryEvaluator::Evaluate(const std::vector<Run>& runs, std::vector<Result>& results) const {
+    results.assign(runs.size(), Result());
+
+    // one task per run, the parallel loops of the nodes go first:
+    std::vector<char> is_evaluated(runs.size(), 0);
+    TaskScheduler::GetInstance().ParallelFor(
+        0, static_cast<int>(runs.size()), 1,
+        [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                is_evaluated.at(i) = Evaluate(runs.at(i), results.at(i));
+            }
+        },
+        TaskScheduler::BACKGROUND
+    );
+
+    return std::find(is_evaluated.begin(), is_evaluated.end(), 0) == is_evaluated.end();
+}
+
+std::string TrajectoryEvaluator::ToJSON(const Result& result) {
+    std::ostringstream oss;
+    oss << std::setprecision(9);
+
+    oss << "{\"name\":\"" << result.name << "\",\"is_valid\":" << (result.is_valid ? "true" : "false");
+    if (result.is_valid) {
+        oss << ",\"num_poses\":" << result.num_poses
+            << ",\"length\":" << result.length
+            << ",\"scale\":" << result.scale;
+
+        oss << ",\"ate\":";
+        WriteStatistics(oss, result.ate);
+
+        oss << ",\"rpe\":{\"translation\":";
+        WriteStatistics(oss, result.rpe_translation);
+        oss << ",\"rotation\":";
+        WriteStatistics(oss, result.rpe_rotation);
+        oss << "}";
+
+        oss << ",\"drift\":";
+        WriteDrift(oss, result.drift);
+        oss << ",\"segment_drifts\":[";
+        for (size_t i = 0; i < result.segment_drifts.size(); ++i) {
+            if (i > 0)
+                oss << ",";
+            WriteDrift(oss, result.segment_drifts.at(i));
+        }
+        oss << "]";
+    }
+    oss << "}";
+
+    return oss.str();
+}
+
+bool TrajectoryEvaluator::Save(const std::string& file_path, const std::vector<Result>& results) {
+    std::ofstream ofs(file_path.c_str(), std::ios::out | std::ios::trunc);
+    if (!ofs) {
+        LOG(ERROR) << "Failed to create trajectory evaluation " << file_path;
+        return false;
+    }
+
+    ofs << "{\"runs\":[" << std::endl;
+    for (size_t i = 0; i < results.size(); ++i) {
+        ofs << ToJSON(results.at(i)) << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    ofs << "]}" << std::endl;
+
+    return static_cast<bool>(ofs);
+}
+
+} // namespace lidar_localization
@@ -0,0 +1,61 @@
+/*
+ * @Description: evaluate_trajectory service, ATE, RPE & segment drift of the saved trajectories of a run
+ * @Author: Ge Yao
+ * @Date: 2020-12-31 20:58:36
+ */
+#include "lidar_localization/tools/trajectory_evaluator_service.hpp"
+
+#include "glog/logging.h"
+
+#include "lidar_localization/global_defination/global_defination.h"
+
+namespace lidar_localization {
+TrajectoryEvaluatorService::TrajectoryEvaluatorService(ros::NodeHandle& nh) {
+    YAML::Node config_node = YAML::LoadFile(WORK_SPACE_PATH + "/config/tools/trajectory_evaluator.yaml");
+
+    evaluator_ptr_ = std::make_shared<TrajectoryEvaluator>(config_node);
+    evaluate_on_save_ = config_node["evaluate_on_save"].as<bool>();
+    runs_ = TrajectoryEvaluator::GetRuns(config_node["runs"]);
+    output_file_ = TrajectoryEvaluator::GetTrajectoryPath(config_node["output_file"].as<std::string>());
+
+    service_ = nh.advertiseService("evaluate_trajectory", &TrajectoryEvaluatorService::EvaluateTrajectoryCallback, this);
+}
+
+bool TrajectoryEvaluatorService::EvaluateOnSave(void) {
+    if (!evaluate_on_save_)
+        return true;
+
+    std::vector<TrajectoryEvaluator::Result> results;
+    bool is_evaluated = evaluator_ptr_->Evaluate(runs_, results);
+    for (const TrajectoryEvaluator::Result& result: results) {
+        if (result.is_valid) {
+            LOG(INFO) << "Trajectory " << result.name << ": ATE RMSE " << result.ate.rmse << " m, "
+                      << "RPE RMSE " << result.rpe_translation.rmse << " m / " << result.rpe_rotation.rmse << " deg, "
+                      << "drift " << result.drift.translation_error << " %";
+        }
+    }
+
+    return TrajectoryEvaluator::Save(output_file_, results) && is_evaluated;
+}
+
+bool TrajectoryEvaluatorService::EvaluateTrajectoryCallback(
+    evaluateTrajectory::Request &request, evaluateTrajectory::Response &response
+) {
+    TrajectoryEvaluator::Run run;
+    run.name = request.estimated_file;
+    run.estimated_file = TrajectoryEvaluator::GetTrajectoryPath(request.estimated_file);
+    run.reference_file = TrajectoryEvaluator::GetTrajectoryPath(request.reference_file);
+
+    TrajectoryEvaluator::Result result;
+    response.succeed = evaluator_ptr_->Evaluate(run, result);
+    response.result = TrajectoryEvaluator::ToJSON(result);
+
+    if (!request.output_file.empty()) {
+        response.succeed = TrajectoryEvaluator::Save(
+            TrajectoryEvaluator::GetTrajectoryPath(request.output_file), {result}
+        ) && response.succeed;
+    }
+
+    return response.succeed;
+}
+} // namespace lidar_localization
@@ -0,0 +1,362 @@
+/*
+ * @Description: binary, append-only log of optimized key frame poses
+ * @Author: Ge Yao
+ * @Date: 2020-12-12 20:41:09
+ */
+#include "lidar_localization/tools/trajectory_log.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <algorithm>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "glog/logging.h"
+
+namespace lidar_localization {
+
+namespace {
+const uint32_t TRAJECTORY_MAGIC = 0x4a525431; // TRJ1
+const uint32_t TRAJECTORY_VERSION = 1;
+const size_t POSE_SIZE = 12;
+// small logs are not worth compacting:
+const size_t MIN_COMPACT_SIZE = 1 << 20;
+
+bool WriteAll(int fd, const void *data, size_t size) {
+    const char *buffer = static_cast<const char *>(data);
+
+    while (size > 0) {
+        ssize_t written = write(fd, buffer, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        buffer += written;
+        size -= static_cast<size_t>(written);
+    }
+
+    return true;
+}
+}
+
+TrajectoryLog::TrajectoryLog(const std::string& file_path, float compact_ratio)
+    : file_path_(file_path),
+      compact_ratio_(std::max(compact_ratio, 1.0f)),
+      thread_(&TrajectoryLog::Run, this) {
+}
+
+TrajectoryLog::~TrajectoryLog() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    has_task_.notify_one();
+
+    // the worker drains the queue before it exits:
+    thread_.join();
+
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+bool TrajectoryLog::Update(unsigned int first_index, const std::deque<Eigen::Matrix4f>& poses) {
+    if (num_appended_ > 0) {
+        LOG(WARNING) << "Trajectory log: " << file_path_ << " is appended to, it cannot be updated.";
+        return false;
+    }
+
+    size_t num_poses = poses_.size() / POSE_SIZE;
+    if (first_index > num_poses) {
+        LOG(WARNING) << "Trajectory log: poses from " << num_poses << " to " << first_index << " are missing.";
+        return false;
+    }
+
+    // split the changed poses into contiguous patches:
+    std::deque<Patch> patches;
+    bool in_patch = false;
+    for (size_t i = 0; i < poses.size(); ++i) {
+        size_t index = first_index + i;
+
+        float pose[POSE_SIZE];
+        for (size_t r = 0; r < 3; ++r) {
+            for (size_t c = 0; c < 4; ++c) {
+                pose[4 * r + c] = poses.at(i)(r, c);
+            }
+        }
+
+        bool is_changed = true;
+        if (index < num_poses) {
+            is_changed = !std::equal(pose, pose + POSE_SIZE, &poses_.at(POSE_SIZE * index));
+            std::copy(pose, pose + POSE_SIZE, &poses_.at(POSE_SIZE * index));
+        } else {
+            poses_.insert(poses_.end(), pose, pose + POSE_SIZE);
+        }
+
+        if (is_changed) {
+            if (!in_patch) {
+                patches.emplace_back();
+                patches.back().first_index = static_cast<uint32_t>(index);
+            }
+            patches.back().data.insert(patches.back().data.end(), pose, pose + POSE_SIZE);
+        }
+        in_patch = is_changed;
+    }
+
+    if (patches.empty())
+        return true;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (Patch& patch: patches) {
+            queue_.push_back(std::move(patch));
+        }
+    }
+    has_task_.notify_one();
+
+    return true;
+}
+
+bool TrajectoryLog::Append(const Eigen::Matrix4f& pose) {
+    if (!poses_.empty()) {
+        LOG(WARNING) << "Trajectory log: " << file_path_ << " is updated, it cannot be appended to.";
+        return false;
+    }
+
+    Patch patch;
+    patch.first_index = static_cast<uint32_t>(num_appended_);
+    patch.is_appended = true;
+    patch.data.resize(POSE_SIZE);
+    for (size_t r = 0; r < 3; ++r) {
+        for (size_t c = 0; c < 4; ++c) {
+            patch.data[4 * r + c] = pose(r, c);
+        }
+    }
+    ++num_appended_;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(patch));
+    }
+    has_task_.notify_one();
+
+    return true;
+}
+
+void TrajectoryLog::Flush(void) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    is_idle_.wait(lock, [this]{ return queue_.empty() && !is_writing_; });
+}
+
+TrajectoryLog::Stats TrajectoryLog::GetStats(void) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+bool TrajectoryLog::IsTrajectoryLog(const std::string& file_path) {
+    std::ifstream ifs(file_path.c_str(), std::ios::in | std::ios::binary);
+
+    FileHeader file_header;
+    return (
+        ifs.read(reinterpret_cast<char *>(&file_header), sizeof(file_header)) &&
+        file_header.magic == TRAJECTORY_MAGIC
+    );
+}
+
+bool TrajectoryLog::Load(const std::string& file_path, std::deque<Eigen::Matrix4f>& poses) {
+    poses.clear();
+
+    std::ifstream ifs(file_path.c_str(), std::ios::in | std::ios::binary);
+    if (!ifs) {
+        LOG(WARNING) << "Failed to open trajectory log " << file_path;
+        return false;
+    }
+
+    FileHeader file_header;
+    if (
+        !ifs.read(reinterpret_cast<char *>(&file_header), sizeof(file_header)) ||
+        file_header.magic != TRAJECTORY_MAGIC
+    ) {
+        LOG(WARNING) << "Invalid trajectory log " << file_path;
+        return false;
+    }
+    if (file_header.version != TRAJECTORY_VERSION) {
+        LOG(WARNING) << "Unsupported trajectory log version " << file_header.version << " in " << file_path;
+        return false;
+    }
+
+    PatchHeader patch_header;
+    std::vector<float> data;
+    while (ifs.read(reinterpret_cast<char *>(&patch_header), sizeof(patch_header))) {
+        data.resize(POSE_SIZE * patch_header.num_poses);
+        if (
+            !ifs.read(reinterpret_cast<char *>(data.data()), sizeof(float) * data.size()) ||
+            patch_header.first_index > poses.size()
+        ) {
+            // a patch cut short by a crash, keep what was complete:
+            LOG(WARNING) << "Incomplete patch in trajectory log " << file_path;
+            break;
+        }
+
+        for (uint32_t i = 0; i < patch_header.num_poses; ++i) {
+            size_t index = patch_header.first_index + i;
+            if (index == poses.size())
+                poses.push_back(Eigen::Matrix4f::Identity());
+
+            for (size_t r = 0; r < 3; ++r) {
+                for (size_t c = 0; c < 4; ++c) {
+                    poses.at(index)(r, c) = data.at(POSE_SIZE * i + 4 * r + c);
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+bool TrajectoryLog::ExportKITTI(const std::string& file_path, const std::string& kitti_file_path) {
+    std::deque<Eigen::Matrix4f> poses;
+    if (!Load(file_path, poses))
+        return false;
+
+    std::ofstream ofs(kitti_file_path.c_str(), std::ios::out | std::ios::trunc);
+    if (!ofs) {
+        LOG(WARNING) << "Failed to create " << kitti_file_path;
+        return false;
+    }
+
+    for (const Eigen::Matrix4f& pose: poses) {
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                ofs << pose(i, j);
+
+                if (i == 2 && j == 3) {
+                    ofs << std::endl;
+                } else {
+                    ofs << " ";
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+bool TrajectoryLog::Create(const std::string& file_path) {
+    int fd = open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        LOG(ERROR) << "Failed to create trajectory log " << file_path;
+        return false;
+    }
+
+    FileHeader file_header;
+    file_header.magic = TRAJECTORY_MAGIC;
+    file_header.version = TRAJECTORY_VERSION;
+    if (!WriteAll(fd, &file_header, sizeof(file_header))) {
+        LOG(ERROR) << "Failed to write trajectory log " << file_path;
+        close(fd);
+        return false;
+    }
+
+    if (fd_ >= 0)
+        close(fd_);
+    fd_ = fd;
+    file_size_ = sizeof(file_header);
+
+    return true;
+}
+
+bool TrajectoryLog::WritePatch(uint32_t first_index, const float *data, uint32_t num_poses) {
+    PatchHeader patch_header;
+    patch_header.first_index = first_index;
+    patch_header.num_poses = num_poses;
+
+    size_t data_size = sizeof(float) * POSE_SIZE * num_poses;
+    if (
+        fd_ < 0 ||
+        !WriteAll(fd_, &patch_header, sizeof(patch_header)) ||
+        !WriteAll(fd_, data, data_size)
+    ) {
+        return false;
+    }
+    file_size_ += sizeof(patch_header) + data_size;
+
+    return true;
+}
+
+bool TrajectoryLog::Compact(void) {
+    // write the whole trajectory as one patch, then swap it in:
+    std::string tmp_file_path = file_path_ + ".tmp";
+    uint32_t num_poses = static_cast<uint32_t>(file_poses_.size() / POSE_SIZE);
+    if (
+        Create(tmp_file_path) &&
+        WritePatch(0, file_poses_.data(), num_poses) &&
+        std::rename(tmp_file_path.c_str(), file_path_.c_str()) == 0
+    ) {
+        return true;
+    }
+
+    // later patches must still go to the log itself, rewrite it in place:
+    LOG(ERROR) << "Failed to compact trajectory log " << file_path_;
+    std::remove(tmp_file_path.c_str());
+    if (Create(file_path_))
+        WritePatch(0, file_poses_.data(), num_poses);
+
+    return false;
+}
+
+void TrajectoryLog::Run(void) {
+    Create(file_path_);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        has_task_.wait(lock, [this]{ return stop_ || !queue_.empty(); });
+        if (queue_.empty())
+            break;
+
+        Patch patch = std::move(queue_.front());
+        queue_.pop_front();
+        is_writing_ = true;
+
+        lock.unlock();
+        uint32_t num_poses = static_cast<uint32_t>(patch.data.size() / POSE_SIZE);
+        bool is_written = WritePatch(patch.first_index, patch.data.data(), num_poses);
+
+        num_file_poses_ = std::max(num_file_poses_, static_cast<size_t>(patch.first_index + num_poses));
+
+        // appended poses are never overwritten, so there is nothing to compact:
+        bool is_compacted = false;
+        if (!patch.is_appended) {
+            size_t end = POSE_SIZE * patch.first_index + patch.data.size();
+            if (file_poses_.size() < end)
+                file_poses_.resize(end);
+            std::copy(patch.data.begin(), patch.data.end(), file_poses_.begin() + POSE_SIZE * patch.first_index);
+
+            // patches keep piling up over the same window, rewrite once they dominate the file:
+            size_t trajectory_size = sizeof(FileHeader) + sizeof(PatchHeader) + sizeof(float) * file_poses_.size();
+            if (file_size_ > MIN_COMPACT_SIZE && file_size_ > compact_ratio_ * trajectory_size) {
+                is_compacted = Compact();
+            }
+        }
+        lock.lock();
+
+        is_writing_ = false;
+        if (is_written) {
+            ++stats_.num_patches;
+            stats_.num_poses_written += num_poses;
+        } else {
+            ++stats_.num_failed;
+        }
+        if (is_compacted)
+            ++stats_.num_compactions;
+        stats_.num_poses = num_file_poses_;
+
+        if (queue_.empty())
+            is_idle_.notify_all();
+    }
+}
+
+} // namespace lidar_localization
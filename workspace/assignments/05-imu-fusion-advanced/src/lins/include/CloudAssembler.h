@@ -0,0 +1,262 @@
+// This file is part of LINS.
+//
+// Copyright (C) 2020 Chao Qin <cscharlesqin@gmail.com>,
+// Robotics and Multiperception Lab (RAM-LAB <https://ram-lab.com>),
+// The Hong Kong University of Science and Technology
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+
+#ifndef INCLUDE_CLOUDASSEMBLER_H_
+#define INCLUDE_CLOUDASSEMBLER_H_
+
+#include <pcl/point_cloud.h>
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Assembly of a map from many transformed clouds, in one allocation and one
+// pass over the points. Replaces transformPointCloud into a temporary followed
+// by operator+=, which copies every point twice and grows the map once per
+// cloud. The clouds are only referenced until assemble, so they must not
+// change before.
+//
+// The 4x4 kernel is the one of the lidar_localization CloudAssembler
+// (tools/cloud_assembler.cpp). LINS does not link lidar_localization, so the
+// two copies must be kept identical. PointT must keep x, y, z in data[0..2],
+// as the PCL_ADD_POINT4D types do.
+//
+// assembleFiltered fuses an optional crop box and a voxel grid into the same
+// pass: each block of transformed points is cropped and hashed into its voxel
+// while it is still in cache, and the large intermediate map a VoxelGrid would
+// read again is never built. The output is the centroid of the points of each
+// voxel, all fields averaged, as VoxelGrid does; only the order of the points
+// differs.
+template <typename PointT>
+class CloudAssembler {
+ public:
+  typedef pcl::PointCloud<PointT> PointCloud;
+
+  static const int BLOCK_SIZE = 256;
+
+  // The cloud in the frame given by pose
+  void add(const typename PointCloud::ConstPtr& cloud,
+           const Eigen::Matrix4f& pose = Eigen::Matrix4f::Identity()) {
+    if (!cloud || cloud->points.empty()) return;
+
+    Part part;
+    part.cloud = cloud;
+    part.pose = pose;
+    parts_.push_back(part);
+    pointNum_ += cloud->points.size();
+  }
+
+  size_t size() const { return pointNum_; }
+
+  // Points outside of the box are dropped by the next assembleFiltered
+  void setCropBox(const Eigen::Vector3f& minPoint,
+                  const Eigen::Vector3f& maxPoint) {
+    cropMin_ = minPoint;
+    cropMax_ = maxPoint;
+  }
+
+  // Appends the transformed clouds to out, whose size grows only once
+  void assemble(PointCloud& out) {
+    size_t begin = out.points.size();
+    out.points.resize(begin + pointNum_);
+    for (const Part& part : parts_) {
+      const PointCloud& cloud = *part.cloud;
+      transform(cloud.points.data(), cloud.points.size(), part.pose,
+                out.points.data() + begin);
+      begin += cloud.points.size();
+      out.is_dense = out.is_dense && cloud.is_dense;
+    }
+    out.width = static_cast<uint32_t>(out.points.size());
+    out.height = 1;
+    clear();
+  }
+
+  // Replaces out by the cropped and voxel filtered transformed clouds. Voxel
+  // indices are kept on 21 bits each, so voxels 2^20 leaves apart alias.
+  void assembleFiltered(PointCloud& out, float leafSize) {
+    const float inverseLeaf = 1.0f / leafSize;
+    std::unordered_map<uint64_t, size_t> voxelIndex;
+    voxelIndex.reserve(pointNum_ / 4 + 1);
+    std::vector<Centroid> centroids;
+
+    alignas(16) PointT block[BLOCK_SIZE];
+    for (const Part& part : parts_) {
+      const PointCloud& cloud = *part.cloud;
+      const size_t size = cloud.points.size();
+      for (size_t begin = 0; begin < size; begin += BLOCK_SIZE) {
+        const size_t n = std::min<size_t>(BLOCK_SIZE, size - begin);
+        transform(&cloud.points[begin], n, part.pose, block);
+
+        for (size_t i = 0; i < n; i++) {
+          const PointT& point = block[i];
+          if (!std::isfinite(point.x) || !std::isfinite(point.y) ||
+              !std::isfinite(point.z))
+            continue;
+          if (point.x < cropMin_.x() || point.x > cropMax_.x() ||
+              point.y < cropMin_.y() || point.y > cropMax_.y() ||
+              point.z < cropMin_.z() || point.z > cropMax_.z())
+            continue;
+
+          const uint64_t key =
+              voxelKey(point.x * inverseLeaf, point.y * inverseLeaf,
+                       point.z * inverseLeaf);
+          auto iter = voxelIndex.find(key);
+          if (iter == voxelIndex.end()) {
+            iter = voxelIndex.emplace(key, centroids.size()).first;
+            centroids.push_back(Centroid());
+          }
+          Centroid& centroid = centroids[iter->second];
+          centroid.sum[0] += point.x;
+          centroid.sum[1] += point.y;
+          centroid.sum[2] += point.z;
+          centroid.sum[3] += point.intensity;
+          centroid.num++;
+        }
+      }
+    }
+
+    out.points.resize(centroids.size());
+    for (size_t i = 0; i < centroids.size(); i++) {
+      const Centroid& centroid = centroids[i];
+      PointT& point = out.points[i];
+      point.x = centroid.sum[0] / centroid.num;
+      point.y = centroid.sum[1] / centroid.num;
+      point.z = centroid.sum[2] / centroid.num;
+      point.intensity = centroid.sum[3] / centroid.num;
+    }
+    out.width = static_cast<uint32_t>(out.points.size());
+    out.height = 1;
+    out.is_dense = true;
+    clear();
+  }
+
+  void clear() {
+    parts_.clear();
+    pointNum_ = 0;
+    cropMin_ = Eigen::Vector3f::Constant(-std::numeric_limits<float>::max());
+    cropMax_ = Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+  }
+
+  // Transforms the n points of in into out, which may be in. Unlike PCL, NaN
+  // points are transformed too and stay NaN
+  static void transform(const PointT* in, size_t n, const Eigen::Matrix4f& pose,
+                        PointT* out) {
+#if defined(__GNUC__) && defined(__x86_64__)
+    // pose is column major and the points are x, y, z, padding, so each point
+    // is the sum of the columns scaled by its coordinates
+    const __m128 column0 = _mm_loadu_ps(pose.data());
+    const __m128 column1 = _mm_loadu_ps(pose.data() + 4);
+    const __m128 column2 = _mm_loadu_ps(pose.data() + 8);
+    const __m128 column3 = _mm_loadu_ps(pose.data() + 12);
+    // the padding is kept as it is
+    const __m128 xyzMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+
+    for (size_t i = 0; i < n; i++) {
+      const __m128 point = _mm_loadu_ps(in[i].data);
+
+      __m128 result =
+          _mm_add_ps(_mm_mul_ps(column0, _mm_shuffle_ps(point, point, 0x00)),
+                     _mm_mul_ps(column1, _mm_shuffle_ps(point, point, 0x55)));
+      result = _mm_add_ps(
+          result,
+          _mm_add_ps(_mm_mul_ps(column2, _mm_shuffle_ps(point, point, 0xAA)),
+                     column3));
+      result = _mm_or_ps(_mm_and_ps(xyzMask, result),
+                         _mm_andnot_ps(xyzMask, point));
+
+      // the other fields first, out may be in
+      if (out + i != in + i) out[i] = in[i];
+      _mm_storeu_ps(out[i].data, result);
+    }
+#elif defined(__GNUC__) && defined(__aarch64__)
+    // as SSE2, the columns are scaled by lanes of the point
+    const float32x4_t column0 = vld1q_f32(pose.data());
+    const float32x4_t column1 = vld1q_f32(pose.data() + 4);
+    const float32x4_t column2 = vld1q_f32(pose.data() + 8);
+    const float32x4_t column3 = vld1q_f32(pose.data() + 12);
+    // the padding is kept as it is
+    const uint32x4_t xyzMask = vsetq_lane_u32(0u, vdupq_n_u32(0xFFFFFFFFu), 3);
+
+    for (size_t i = 0; i < n; i++) {
+      const float32x4_t point = vld1q_f32(in[i].data);
+
+      float32x4_t result = vfmaq_laneq_f32(column3, column0, point, 0);
+      result = vfmaq_laneq_f32(result, column1, point, 1);
+      result = vfmaq_laneq_f32(result, column2, point, 2);
+      result = vbslq_f32(xyzMask, result, point);
+
+      // the other fields first, out may be in
+      if (out + i != in + i) out[i] = in[i];
+      vst1q_f32(out[i].data, result);
+    }
+#else
+    const Eigen::Matrix3f rotation = pose.block<3, 3>(0, 0);
+    const Eigen::Vector3f translation = pose.block<3, 1>(0, 3);
+
+    for (size_t i = 0; i < n; i++) {
+      const Eigen::Vector3f point =
+          rotation * in[i].getVector3fMap() + translation;
+      if (out + i != in + i) out[i] = in[i];
+      out[i].getVector3fMap() = point;
+    }
+#endif
+  }
+
+ private:
+  struct Part {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    typename PointCloud::ConstPtr cloud;
+    Eigen::Matrix4f pose;
+  };
+
+  struct Centroid {
+    float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    int num = 0;
+  };
+
+  static uint64_t voxelKey(float x, float y, float z) {
+    const uint64_t mask = (1u << 21) - 1;
+    const uint64_t ix = static_cast<int64_t>(std::floor(x)) & mask;
+    const uint64_t iy = static_cast<int64_t>(std::floor(y)) & mask;
+    const uint64_t iz = static_cast<int64_t>(std::floor(z)) & mask;
+    return (ix << 42) | (iy << 21) | iz;
+  }
+
+ private:
+  std::vector<Part, Eigen::aligned_allocator<Part>> parts_;
+  size_t pointNum_ = 0;
+  Eigen::Vector3f cropMin_ =
+      Eigen::Vector3f::Constant(-std::numeric_limits<float>::max());
+  Eigen::Vector3f cropMax_ =
+      Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+};
+
+template <typename PointT>
+const int CloudAssembler<PointT>::BLOCK_SIZE;
+
+#endif  // INCLUDE_CLOUDASSEMBLER_H_
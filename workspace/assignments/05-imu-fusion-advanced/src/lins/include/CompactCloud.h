@@ -0,0 +1,124 @@
+// This file is part of LINS.
+//
+// Copyright (C) 2020 Chao Qin <cscharlesqin@gmail.com>,
+// Robotics and Multiperception Lab (RAM-LAB <https://ram-lab.com>),
+// The Hong Kong University of Science and Technology
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+
+#ifndef INCLUDE_COMPACTCLOUD_H_
+#define INCLUDE_COMPACTCLOUD_H_
+
+#include <pcl/point_cloud.h>
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+// Key frame cloud kept in RAM with x, y and z quantized to int16 around the
+// center of its bounding box, and the intensity as it is: 10 bytes per point
+// instead of sizeof(PointT). The resolution is coarsened for clouds wider than
+// 65535 steps, and decoded points are off by up to half of it. Non-finite
+// points are dropped, fields other than x, y, z and intensity are default.
+//
+// The quantization is the one of the lidar_localization CompactCloud
+// (sensor_data/compact_cloud.cpp), which LINS does not link. Unlike that one,
+// the intensity is kept, since it goes into the published maps.
+template <typename PointT>
+class CompactCloud {
+ public:
+  typedef pcl::PointCloud<PointT> PointCloud;
+  typedef std::shared_ptr<const CompactCloud> ConstPtr;
+
+  CompactCloud(const PointCloud& cloud, float resolution)
+      : origin_(Eigen::Vector3f::Zero()), resolution_(resolution) {
+    // bounding box of the finite points
+    Eigen::Vector3f minPoint =
+        Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+    Eigen::Vector3f maxPoint =
+        Eigen::Vector3f::Constant(std::numeric_limits<float>::lowest());
+    size_t pointNum = 0;
+    for (const PointT& point : cloud.points) {
+      if (!isFinite(point)) continue;
+      minPoint = minPoint.cwiseMin(point.getVector3fMap());
+      maxPoint = maxPoint.cwiseMax(point.getVector3fMap());
+      pointNum++;
+    }
+    if (pointNum == 0) return;
+
+    // origin at the center, the half extent must fit in int16
+    origin_ = 0.5f * (minPoint + maxPoint);
+    const float maxHalfExtent = 0.5f * (maxPoint - minPoint).maxCoeff();
+    resolution_ = std::max(
+        resolution_, maxHalfExtent / std::numeric_limits<int16_t>::max());
+
+    const float inverseResolution = 1.0f / resolution_;
+    auto quantize = [&](float value, float origin) {
+      const float steps = std::round((value - origin) * inverseResolution);
+      return static_cast<int16_t>(
+          std::min(std::max(steps, -32767.0f), 32767.0f));
+    };
+
+    x_.reserve(pointNum);
+    y_.reserve(pointNum);
+    z_.reserve(pointNum);
+    intensity_.reserve(pointNum);
+    for (const PointT& point : cloud.points) {
+      if (!isFinite(point)) continue;
+      x_.push_back(quantize(point.x, origin_.x()));
+      y_.push_back(quantize(point.y, origin_.y()));
+      z_.push_back(quantize(point.z, origin_.z()));
+      intensity_.push_back(point.intensity);
+    }
+  }
+
+  size_t size() const { return x_.size(); }
+  size_t bytes() const {
+    return x_.size() * (3 * sizeof(int16_t) + sizeof(float));
+  }
+
+  // Replaces the points of cloud by the decoded ones
+  void decode(PointCloud& cloud) const {
+    cloud.points.resize(x_.size());
+    for (size_t i = 0; i < x_.size(); i++) {
+      PointT& point = cloud.points[i];
+      point = PointT();
+      point.x = origin_.x() + resolution_ * x_[i];
+      point.y = origin_.y() + resolution_ * y_[i];
+      point.z = origin_.z() + resolution_ * z_[i];
+      point.intensity = intensity_[i];
+    }
+    cloud.width = static_cast<uint32_t>(cloud.points.size());
+    cloud.height = 1;
+    cloud.is_dense = true;
+  }
+
+ private:
+  static bool isFinite(const PointT& point) {
+    return std::isfinite(point.x) && std::isfinite(point.y) &&
+           std::isfinite(point.z);
+  }
+
+  Eigen::Vector3f origin_;
+  float resolution_;
+
+  std::vector<int16_t> x_;
+  std::vector<int16_t> y_;
+  std::vector<int16_t> z_;
+  std::vector<float> intensity_;
+};
+
+#endif  // INCLUDE_COMPACTCLOUD_H_
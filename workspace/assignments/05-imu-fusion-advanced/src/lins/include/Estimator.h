@@ -19,6 +19,7 @@
 #define INCLUDE_ESTIMATOR_H_
 
 #include <MapRingBuffer.h>
+#include <SpscQueue.h>
 #include <math_utils.h>
 #include <nav_msgs/Odometry.h>
 #include <parameters.h>
@@ -39,11 +40,16 @@
 #include <tic_toc.h>
 
 #include <StateEstimator.hpp>
+#include <ThreadConfig.h>
+#include <atomic>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
 #include <opencv2/core/eigen.hpp>
 #include <opencv2/opencv.hpp>
 #include <queue>
 #include <sensor_utils.hpp>
+#include <thread>
 
 #include "cloud_msgs/cloud_info.h"
 
@@ -59,7 +65,8 @@ class LinsFusion {
   LinsFusion(ros::NodeHandle& nh, ros::NodeHandle& pnh);
   ~LinsFusion();
 
-  void run();
+  // the estimation thread gets threadConfig:
+  void run(const ThreadConfig& threadConfig);
   void initialization();
   void publishTopics();
   void publishOdometryYZX(double timeStamp);
@@ -82,6 +89,10 @@ class LinsFusion {
       const sensor_msgs::PointCloud2ConstPtr& laserCloudMsg);
   void mapOdometryCallback(const nav_msgs::Odometry::ConstPtr& odometryMsg);
 
+  void runEstimation(const ThreadConfig& threadConfig);
+  bool drainQueues();
+  void reportLatency(double arrivalTime);
+
   void performStateEstimation();
   void processFirstPointCloud();
   bool processPointClouds();
@@ -139,6 +150,36 @@ class LinsFusion {
   MapRingBuffer<cloud_msgs::cloud_info> cloudInfoBuf_;
   MapRingBuffer<Gps> gpsBuf_;
 
+  // !@Queues
+  // filled by the callbacks on the spinner thread, drained into the buffers
+  // above by the estimation thread, which is the only one to use them
+  template <typename Meas>
+  struct QueuedMeas {
+    Meas meas;
+    double time;         // time stamp of the measurement
+    double arrivalTime;  // wall time of its callback
+  };
+  SpscQueue<QueuedMeas<Imu>> imuQueue_;
+  SpscQueue<QueuedMeas<sensor_msgs::PointCloud2::ConstPtr>> pclQueue_;
+  SpscQueue<QueuedMeas<sensor_msgs::PointCloud2::ConstPtr>> outlierQueue_;
+  SpscQueue<QueuedMeas<cloud_msgs::cloud_infoConstPtr>> cloudInfoQueue_;
+  MapRingBuffer<double> pclArrivalBuf_;
+
+  // !@EstimationThread
+  std::thread estimationThread_;
+  std::atomic<bool> stop_;
+  std::mutex wakeMutex_;
+  std::condition_variable wakeCondition_;
+  JitterMonitor jitterMonitor_;
+
+  // !@Latency
+  // from the callback of a point cloud to its published estimate, and the
+  // deepest IMU queue drained, since the last report
+  int latency_counter_;
+  double latency_sum_;
+  double latency_max_;
+  size_t max_queue_depth_;
+
   // !@Time
   int scan_counter_;
   double duration_;
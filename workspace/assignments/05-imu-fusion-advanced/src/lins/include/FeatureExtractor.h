@@ -0,0 +1,349 @@
+// This file is part of LINS.
+//
+// Copyright (C) 2020 Chao Qin <cscharlesqin@gmail.com>,
+// Robotics and Multiperception Lab (RAM-LAB <https://ram-lab.com>),
+// The Hong Kong University of Science and Technology
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+
+
+#ifndef INCLUDE_FEATUREEXTRACTOR_H_
+#define INCLUDE_FEATUREEXTRACTOR_H_
+
+#include <pcl/filters/voxel_grid.h>
+#include <pcl/point_cloud.h>
+
+#include <Eigen/Core>
+#include <algorithm>
+#include <vector>
+
+namespace loam {
+
+// Organized view of a scan, laid out as the range image of the ingest: cells
+// row by row, a row per ring and a column per azimuth bin. Neither array is
+// owned.
+struct RangeImageView {
+  int numCols = 0;
+  // cell of each point, row * numCols + col, or -1 if it has none
+  const int* pointCells = nullptr;
+  // range of the point of each cell, 0 if the cell is empty
+  const float* cellRanges = nullptr;
+};
+
+// LOAM edge and plane feature selection, header-only and shared by A-LOAM
+// (aloam_velodyne/feature_extractor.h) and LINS (FeatureExtractor.h). The catkin
+// workspaces are independent, so the two copies must be kept identical.
+//
+// The points of a scan are ordered ring by ring, and every ring is split into
+// sectors. In each sector the sharpest and the flattest candidates are picked,
+// skipping those next to a point picked before. Rings are processed in
+// parallel: a picked point only marks neighbors within its own ring, the only
+// ones ever read again. Candidates are popped from a heap, which visits them in
+// the order of a full sort of the sector, but only as far as they are picked.
+//
+// The per-point state is an arena kept from scan to scan, it is only allocated
+// for the largest scan seen.
+template <typename PointT>
+class FeatureExtractor {
+ public:
+  typedef pcl::PointCloud<PointT> PointCloud;
+
+  struct Params {
+    int numSectors = 6;
+    int maxSharp = 2;
+    int maxLessSharp = 20;
+    int maxFlat = 4;
+    // neighbors marked on each side of a picked point
+    int neighborRadius = 5;
+    // rings and sectors with fewer points are skipped
+    int minRingPoints = 0;
+    int minSectorPoints = 1;
+    // of the voxel filter applied to the less flat points of each ring
+    float leafSize = 0.2f;
+    // columns searched on each side for the curvature neighbors in a range
+    // image, 0 for the whole ring
+    int maxCurvatureSpan = 0;
+  };
+
+  struct Features {
+    PointCloud cornerPointsSharp;
+    PointCloud cornerPointsLessSharp;
+    PointCloud surfPointsFlat;
+    PointCloud surfPointsLessFlat;
+
+    void clear() {
+      cornerPointsSharp.clear();
+      cornerPointsLessSharp.clear();
+      surfPointsFlat.clear();
+      surfPointsLessFlat.clear();
+    }
+  };
+
+  // points on each side of the curvature window
+  static const int CURVATURE_RADIUS = 5;
+
+  // labels of the points
+  static const int LABEL_SHARP = 2;
+  static const int LABEL_LESS_SHARP = 1;
+  static const int LABEL_FLAT = -1;
+
+  Params& params() { return params_; }
+
+  // Starts a scan of size points, none of them picked or labeled
+  void reset(int size) {
+    if (static_cast<int>(curvature_.size()) < size) {
+      curvature_.resize(size);
+      picked_.resize(size);
+      label_.resize(size);
+    }
+    std::fill(curvature_.begin(), curvature_.begin() + size, 0.0f);
+    std::fill(picked_.begin(), picked_.begin() + size, 0);
+    std::fill(label_.begin(), label_.begin() + size, 0);
+    size_ = size;
+  }
+
+  int size() const { return size_; }
+  float curvature(int i) const { return curvature_[i]; }
+  bool isPicked(int i) const { return picked_[i] != 0; }
+  void setPicked(int i) { picked_[i] = 1; }
+  int label(int i) const { return label_[i]; }
+
+  // Curvature from the positions of the points of cloud
+  void computeCurvature(const PointCloud& cloud) {
+#pragma omp parallel for schedule(static)
+    for (int i = CURVATURE_RADIUS; i < size_ - CURVATURE_RADIUS; i++) {
+      // in index order, rounded as the unrolled sum of LOAM
+      float diffX = 0.0f, diffY = 0.0f, diffZ = 0.0f;
+      for (int l = -CURVATURE_RADIUS; l <= CURVATURE_RADIUS; l++) {
+        const float weight = (l == 0) ? -2 * CURVATURE_RADIUS : 1;
+        diffX += weight * cloud.points[i + l].x;
+        diffY += weight * cloud.points[i + l].y;
+        diffZ += weight * cloud.points[i + l].z;
+      }
+      curvature_[i] = diffX * diffX + diffY * diffY + diffZ * diffZ;
+    }
+  }
+
+  // Curvature from a value per point, such as its range
+  template <typename Scalar>
+  void computeCurvature(const std::vector<Scalar>& values) {
+#pragma omp parallel for schedule(static)
+    for (int i = CURVATURE_RADIUS; i < size_ - CURVATURE_RADIUS; i++) {
+      Scalar diff = 0;
+      for (int l = -CURVATURE_RADIUS; l <= CURVATURE_RADIUS; l++) {
+        const Scalar weight = (l == 0) ? -2 * CURVATURE_RADIUS : 1;
+        diff += weight * values[i + l];
+      }
+      curvature_[i] = diff * diff;
+    }
+  }
+
+  // Curvature from the ranges of the nearest CURVATURE_RADIUS filled cells on
+  // each side of every point within its ring, columns wrapping around. Unlike
+  // the index order of a cloud, the neighbors never come from another ring, so
+  // the points at the ends of a ring get a curvature too. With fewer neighbors
+  // within maxCurvatureSpan columns the center is weighted by their number,
+  // and the point is marked picked.
+  void computeCurvature(const RangeImageView& image) {
+    const int numCols = image.numCols;
+    const int span = (params_.maxCurvatureSpan > 0)
+                         ? std::min(params_.maxCurvatureSpan, numCols / 2)
+                         : numCols / 2;
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < size_; i++) {
+      const int cell = image.pointCells[i];
+      if (cell < 0) {
+        curvature_[i] = 0.0f;
+        picked_[i] = 1;
+        continue;
+      }
+      const int rowStart = cell - cell % numCols;
+      const int col = cell - rowStart;
+
+      float diff = 0.0f;
+      int neighborNum = 0;
+      for (int side = -1; side <= 1; side += 2) {
+        int found = 0;
+        for (int l = 1; l <= span && found < CURVATURE_RADIUS; l++) {
+          int c = col + side * l;
+          c += (c < 0) ? numCols : ((c >= numCols) ? -numCols : 0);
+          const float range = image.cellRanges[rowStart + c];
+          if (range <= 0.0f) continue;
+          diff += range;
+          found++;
+        }
+        neighborNum += found;
+      }
+      diff -= neighborNum * image.cellRanges[cell];
+      curvature_[i] = diff * diff;
+      if (neighborNum < 2 * CURVATURE_RADIUS) picked_[i] = 1;
+    }
+  }
+
+  // Features of the rings [ringStart[i], ringEnd[i]] of cloud, in ring order.
+  // isDiscontinuous(i, j) of two adjacent points stops the marking of
+  // neighbors, isEdge(i) and isFlat(i) select the candidates of each kind
+  template <typename Discontinuity, typename EdgeCandidate,
+            typename FlatCandidate>
+  void extract(const PointCloud& cloud, const std::vector<int>& ringStart,
+               const std::vector<int>& ringEnd, Discontinuity isDiscontinuous,
+               EdgeCandidate isEdge, FlatCandidate isFlat,
+               Features& features) {
+    const int numRings = static_cast<int>(ringStart.size());
+    if (static_cast<int>(rings_.size()) < numRings) rings_.resize(numRings);
+
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < numRings; i++) {
+      rings_[i].features.clear();
+      if (ringEnd[i] - ringStart[i] + 1 < params_.minRingPoints) continue;
+      extractRing(cloud, ringStart[i], ringEnd[i], isDiscontinuous, isEdge,
+                  isFlat, rings_[i]);
+    }
+
+    features.clear();
+    for (int i = 0; i < numRings; i++) {
+      features.cornerPointsSharp += rings_[i].features.cornerPointsSharp;
+      features.cornerPointsLessSharp +=
+          rings_[i].features.cornerPointsLessSharp;
+      features.surfPointsFlat += rings_[i].features.surfPointsFlat;
+      features.surfPointsLessFlat += rings_[i].features.surfPointsLessFlat;
+    }
+  }
+
+ private:
+  struct Ring {
+    Features features;
+    std::vector<int> candidates;
+    typename PointCloud::Ptr surfPointsLessFlat{new PointCloud()};
+  };
+
+  template <typename Discontinuity>
+  void markNeighbors(int ind, int start, int end,
+                     Discontinuity& isDiscontinuous) {
+    picked_[ind] = 1;
+    for (int l = 1; l <= params_.neighborRadius; l++) {
+      if (ind + l > end || isDiscontinuous(ind + l, ind + l - 1)) break;
+      picked_[ind + l] = 1;
+    }
+    for (int l = -1; l >= -params_.neighborRadius; l--) {
+      if (ind + l < start || isDiscontinuous(ind + l, ind + l + 1)) break;
+      picked_[ind + l] = 1;
+    }
+  }
+
+  template <typename Discontinuity, typename EdgeCandidate,
+            typename FlatCandidate>
+  void extractRing(const PointCloud& cloud, int start, int end,
+                   Discontinuity& isDiscontinuous, EdgeCandidate& isEdge,
+                   FlatCandidate& isFlat, Ring& ring) {
+    auto lessCurvature = [this](int i, int j) {
+      return curvature_[i] < curvature_[j];
+    };
+    auto greaterCurvature = [this](int i, int j) {
+      return curvature_[i] > curvature_[j];
+    };
+
+    std::vector<int>& candidates = ring.candidates;
+    ring.surfPointsLessFlat->clear();
+
+    // sectors in order, the marks of one reach into the next
+    for (int j = 0; j < params_.numSectors; j++) {
+      int sp = start + (end - start) * j / params_.numSectors;
+      int ep = start + (end - start) * (j + 1) / params_.numSectors - 1;
+      if (ep - sp + 1 < params_.minSectorPoints) continue;
+
+      // a. max-heap of sharp candidates
+      candidates.clear();
+      for (int k = sp; k <= ep; k++) {
+        if (isEdge(k)) candidates.push_back(k);
+      }
+      std::make_heap(candidates.begin(), candidates.end(), lessCurvature);
+
+      int largestPickedNum = 0;
+      while (!candidates.empty()) {
+        std::pop_heap(candidates.begin(), candidates.end(), lessCurvature);
+        int ind = candidates.back();
+        candidates.pop_back();
+        if (picked_[ind] != 0) continue;
+
+        largestPickedNum++;
+        if (largestPickedNum <= params_.maxSharp) {
+          label_[ind] = LABEL_SHARP;
+          ring.features.cornerPointsSharp.push_back(cloud.points[ind]);
+          ring.features.cornerPointsLessSharp.push_back(cloud.points[ind]);
+        } else if (largestPickedNum <= params_.maxLessSharp) {
+          label_[ind] = LABEL_LESS_SHARP;
+          ring.features.cornerPointsLessSharp.push_back(cloud.points[ind]);
+        } else {
+          break;
+        }
+
+        markNeighbors(ind, start, end, isDiscontinuous);
+      }
+
+      // b. min-heap of flat candidates
+      candidates.clear();
+      for (int k = sp; k <= ep; k++) {
+        if (isFlat(k)) candidates.push_back(k);
+      }
+      std::make_heap(candidates.begin(), candidates.end(), greaterCurvature);
+
+      int smallestPickedNum = 0;
+      while (!candidates.empty()) {
+        std::pop_heap(candidates.begin(), candidates.end(), greaterCurvature);
+        int ind = candidates.back();
+        candidates.pop_back();
+        if (picked_[ind] != 0) continue;
+
+        label_[ind] = LABEL_FLAT;
+        ring.features.surfPointsFlat.push_back(cloud.points[ind]);
+
+        smallestPickedNum++;
+        if (smallestPickedNum >= params_.maxFlat) break;
+
+        markNeighbors(ind, start, end, isDiscontinuous);
+      }
+
+      // c. everything not sharp is less flat
+      for (int k = sp; k <= ep; k++) {
+        if (label_[k] <= 0) ring.surfPointsLessFlat->push_back(cloud.points[k]);
+      }
+    }
+
+    pcl::VoxelGrid<PointT> downSizeFilter;
+    downSizeFilter.setInputCloud(ring.surfPointsLessFlat);
+    downSizeFilter.setLeafSize(params_.leafSize, params_.leafSize,
+                               params_.leafSize);
+    downSizeFilter.filter(ring.features.surfPointsLessFlat);
+  }
+
+ private:
+  Params params_;
+  int size_ = 0;
+  std::vector<float> curvature_;
+  std::vector<char> picked_;
+  std::vector<signed char> label_;
+  std::vector<Ring, Eigen::aligned_allocator<Ring> > rings_;
+};
+
+template <typename PointT>
+const int FeatureExtractor<PointT>::CURVATURE_RADIUS;
+template <typename PointT>
+const int FeatureExtractor<PointT>::LABEL_SHARP;
+template <typename PointT>
+const int FeatureExtractor<PointT>::LABEL_LESS_SHARP;
+template <typename PointT>
+const int FeatureExtractor<PointT>::LABEL_FLAT;
+
+}  // namespace loam
+
+#endif  // INCLUDE_FEATUREEXTRACTOR_H_
@@ -0,0 +1,144 @@
+// This file is part of LINS.
+//
+// Copyright (C) 2020 Chao Qin <cscharlesqin@gmail.com>,
+// Robotics and Multiperception Lab (RAM-LAB <https://ram-lab.com>),
+// The Hong Kong University of Science and Technology
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+
+#ifndef INCLUDE_IMUDECIMATOR_H_
+#define INCLUDE_IMUDECIMATOR_H_
+
+#include <math_utils.h>
+
+namespace filter {
+
+// Delta angle and delta velocity over an interval of several IMU samples. The
+// delta velocity is resolved in the body frame at the start of the interval;
+// acc and gyr are the last raw sample
+struct ImuIncrement {
+  double dt = 0.0;
+  int num = 0;
+  V3D dTheta = V3D::Zero();
+  V3D dVel = V3D::Zero();
+  V3D acc = V3D::Zero();
+  V3D gyr = V3D::Zero();
+};
+
+// Decimation of raw IMU samples into coning and sculling compensated
+// increments, so that StatePredictor propagates at the output rate while
+// keeping the accuracy of the raw rate. Samples are integrated by trapezoid and
+// summed with the recursive corrections of Savage, as the lidar_localization
+// IMUDecimator (models/imu_mechanization/imu_decimator.cpp) does. LINS does not
+// link lidar_localization, so the two must be kept in step. The samples are
+// not bias corrected, the bias is removed from the whole increment by
+// StatePredictor, which is off by the coning and sculling of the bias alone.
+class ImuDecimator {
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  // rate in Hz, 0 disables the decimation
+  void setRate(double rate) { interval_ = rate > 0.0 ? 1.0 / rate : 0.0; }
+  bool enabled() const { return interval_ > 0.0; }
+
+  // The sample the first interval starts from
+  void setLast(const V3D& acc, const V3D& gyr) {
+    accLast_ = acc;
+    gyrLast_ = gyr;
+    hasLast_ = true;
+    clearInterval();
+  }
+  bool hasLast() const { return hasLast_; }
+
+  // Integrates the sample dt after the last one, true once the interval is
+  // complete and getIncrement must be called
+  bool add(double dt, const V3D& acc, const V3D& gyr) {
+    if (!hasLast_) {
+      setLast(acc, gyr);
+      return false;
+    }
+    if (dt <= 0.0) return false;
+
+    // trapezoid deltas of the raw interval
+    const V3D angularDelta = 0.5 * dt * (gyrLast_ + gyr);
+    const V3D velocityDelta = 0.5 * dt * (accLast_ + acc);
+
+    // recursive coning and sculling, with the deltas of the previous raw
+    // interval as the slope
+    const V3D alphaMid = alpha_ + lastAngularDelta_ / 6.0;
+    const V3D nuMid = nu_ + lastVelocityDelta_ / 6.0;
+    beta_ += 0.5 * alphaMid.cross(angularDelta);
+    gamma_ += 0.5 * (alphaMid.cross(velocityDelta) + nuMid.cross(angularDelta));
+
+    alpha_ += angularDelta;
+    nu_ += velocityDelta;
+    lastAngularDelta_ = angularDelta;
+    lastVelocityDelta_ = velocityDelta;
+    accLast_ = acc;
+    gyrLast_ = gyr;
+    duration_ += dt;
+    num_++;
+
+    // the interval ends at the sample closest to its nominal end
+    return duration_ + 0.5 * dt >= interval_;
+  }
+
+  // Time integrated since the last increment
+  double duration() const { return duration_; }
+  bool empty() const { return num_ == 0; }
+
+  // The increment since the last one, the next interval starts
+  void getIncrement(ImuIncrement& increment) {
+    increment.dt = duration_;
+    increment.num = num_;
+    increment.dTheta = alpha_ + beta_;
+    // with the rotation of the body frame during the interval
+    increment.dVel = nu_ + 0.5 * alpha_.cross(nu_) + gamma_;
+    increment.acc = accLast_;
+    increment.gyr = gyrLast_;
+    clearInterval();
+  }
+
+ private:
+  void clearInterval() {
+    duration_ = 0.0;
+    num_ = 0;
+    alpha_.setZero();
+    nu_.setZero();
+    lastAngularDelta_.setZero();
+    lastVelocityDelta_.setZero();
+    beta_.setZero();
+    gamma_.setZero();
+  }
+
+ private:
+  double interval_ = 0.0;
+
+  bool hasLast_ = false;
+  V3D accLast_ = V3D::Zero();
+  V3D gyrLast_ = V3D::Zero();
+  double duration_ = 0.0;
+  int num_ = 0;
+
+  // sums of the trapezoid deltas of the interval, and the last ones
+  V3D alpha_ = V3D::Zero();
+  V3D nu_ = V3D::Zero();
+  V3D lastAngularDelta_ = V3D::Zero();
+  V3D lastVelocityDelta_ = V3D::Zero();
+  // coning and sculling corrections
+  V3D beta_ = V3D::Zero();
+  V3D gamma_ = V3D::Zero();
+};
+
+}  // namespace filter
+
+#endif  // INCLUDE_IMUDECIMATOR_H_
@@ -18,6 +18,7 @@
 #ifndef INCLUDE_KALMANFILTER_HPP_
 #define INCLUDE_KALMANFILTER_HPP_
 
+#include <ImuDecimator.h>
 #include <math_utils.h>
 #include <parameters.h>
 
@@ -145,38 +146,7 @@ class StatePredictor {
     state_tmp.rn_ = state_tmp.rn_ + dt * state_tmp.vn_ + 0.5 * dt * dt * un_acc;
     state_tmp.vn_ = state_tmp.vn_ + dt * un_acc;
 
-    if (update_jacobian_) {
-      MXD Ft =
-          MXD::Zero(GlobalState::DIM_OF_STATE_, GlobalState::DIM_OF_STATE_);
-      Ft.block<3, 3>(GlobalState::pos_, GlobalState::vel_) = M3D::Identity();
-
-      Ft.block<3, 3>(GlobalState::vel_, GlobalState::att_) =
-          -state_tmp.qbn_.toRotationMatrix() * skew(acc - state_tmp.ba_);
-      Ft.block<3, 3>(GlobalState::vel_, GlobalState::acc_) =
-          -state_tmp.qbn_.toRotationMatrix();
-      Ft.block<3, 3>(GlobalState::vel_, GlobalState::gra_) = M3D::Identity();
-
-      Ft.block<3, 3>(GlobalState::att_, GlobalState::att_) =
-          - skew(gyr - state_tmp.bw_);
-      Ft.block<3, 3>(GlobalState::att_, GlobalState::gyr_) = -M3D::Identity();
-
-      MXD Gt =
-          MXD::Zero(GlobalState::DIM_OF_STATE_, GlobalState::DIM_OF_NOISE_);
-      Gt.block<3, 3>(GlobalState::vel_, 0) = -state_tmp.qbn_.toRotationMatrix();
-      Gt.block<3, 3>(GlobalState::att_, 3) = -M3D::Identity();
-      Gt.block<3, 3>(GlobalState::acc_, 6) = M3D::Identity();
-      Gt.block<3, 3>(GlobalState::gyr_, 9) = M3D::Identity();
-      Gt = Gt * dt;
-
-      const MXD I =
-          MXD::Identity(GlobalState::DIM_OF_STATE_, GlobalState::DIM_OF_STATE_);
-      F_ = I + Ft * dt + 0.5 * Ft * Ft * dt * dt;
-
-      // jacobian_ = F * jacobian_;
-      covariance_ =
-          F_ * covariance_ * F_.transpose() + Gt * noise_ * Gt.transpose();
-      covariance_ = 0.5 * (covariance_ + covariance_.transpose()).eval();
-    }
+    if (update_jacobian_) accumulateTransition(dt, state_tmp, acc, gyr, 1);
 
     state_ = state_tmp;
     time_ += dt;
@@ -185,6 +155,127 @@ class StatePredictor {
     return true;
   }
 
+  // Propagation over an interval of several IMU samples, from the coning and
+  // sculling compensated increment of ImuDecimator. The transition is built
+  // from the mean rates of the interval
+  bool predict(const ImuIncrement& increment, bool update_jacobian_ = true) {
+    if (!isInitialized() || increment.num == 0) return false;
+
+    const double dt = increment.dt;
+    GlobalState state_tmp = state_;
+    // the delta velocity is resolved in the attitude at the start
+    V3D dv = state_tmp.qbn_ * (increment.dVel - dt * state_tmp.ba_) +
+             dt * state_tmp.gn_;
+    Q4D dq = axis2Quat(increment.dTheta - dt * state_tmp.bw_);
+    state_tmp.qbn_ = (state_tmp.qbn_ * dq).normalized();
+
+    // State integral
+    state_tmp.rn_ = state_tmp.rn_ + dt * state_tmp.vn_ + 0.5 * dt * dv;
+    state_tmp.vn_ = state_tmp.vn_ + dv;
+
+    if (update_jacobian_)
+      accumulateTransition(dt, state_tmp, increment.dVel / dt,
+                           increment.dTheta / dt, increment.num);
+
+    state_ = state_tmp;
+    time_ += dt;
+    acc_last = increment.acc;
+    gyr_last = increment.gyr;
+    flag_init_imu_ = true;
+    return true;
+  }
+
+  // Accumulates the transition and the discrete noise of dt seconds of num
+  // IMU samples, with the measured acc and gyr, into the ones not yet in
+  // covariance_. state is the propagated one
+  void accumulateTransition(double dt, const GlobalState& state, const V3D& acc,
+                            const V3D& gyr, int num) {
+    // F = I + Ft * dt + 0.5 * Ft * Ft * dt * dt only differs from the
+    // identity in its rows of position, velocity and attitude, built from
+    // the non-zero blocks of Ft: A = Ft(vel, att), B = Ft(vel, acc) and
+    // C = Ft(att, att)
+    const M3D R = state.qbn_.toRotationMatrix();
+    const M3D A = -R * skew(acc - state.ba_);
+    const M3D C = -skew(gyr - state.bw_);
+    const double dt2 = 0.5 * dt * dt;
+
+    TransitionRows F = TransitionRows::Zero();
+    F.block<3, 3>(GlobalState::pos_, GlobalState::pos_) = M3D::Identity();
+    F.block<3, 3>(GlobalState::pos_, GlobalState::vel_) = dt * M3D::Identity();
+    F.block<3, 3>(GlobalState::pos_, GlobalState::att_) = dt2 * A;
+    F.block<3, 3>(GlobalState::pos_, GlobalState::acc_) = -dt2 * R;
+    F.block<3, 3>(GlobalState::pos_, GlobalState::gra_) = dt2 * M3D::Identity();
+
+    F.block<3, 3>(GlobalState::vel_, GlobalState::vel_) = M3D::Identity();
+    F.block<3, 3>(GlobalState::vel_, GlobalState::att_) = dt * A + dt2 * A * C;
+    F.block<3, 3>(GlobalState::vel_, GlobalState::acc_) = -dt * R;
+    F.block<3, 3>(GlobalState::vel_, GlobalState::gyr_) = -dt2 * A;
+    F.block<3, 3>(GlobalState::vel_, GlobalState::gra_) = dt * M3D::Identity();
+
+    F.block<3, 3>(GlobalState::att_, GlobalState::att_) =
+        M3D::Identity() + dt * C + dt2 * C * C;
+    F.block<3, 3>(GlobalState::att_, GlobalState::gyr_) =
+        -dt * M3D::Identity() - dt2 * C;
+
+    // Gt * noise_ * Gt^T, noise_ is block diagonal and Gt maps its blocks to
+    // velocity, attitude and the two biases, summed over the samples
+    const double dtSq = dt * dt / num;
+    predicted_noise_.block<3, 3>(GlobalState::vel_, GlobalState::vel_) +=
+        dtSq * R * noise_.block<3, 3>(0, 0) * R.transpose();
+    predicted_noise_.block<3, 3>(GlobalState::att_, GlobalState::att_) +=
+        dtSq * noise_.block<3, 3>(3, 3);
+    predicted_noise_.block<3, 3>(GlobalState::acc_, GlobalState::acc_) +=
+        dtSq * noise_.block<3, 3>(6, 6);
+    predicted_noise_.block<3, 3>(GlobalState::gyr_, GlobalState::gyr_) +=
+        dtSq * noise_.block<3, 3>(9, 9);
+
+    // accumulate the transition since the last covariance propagation
+    if (num_predicted_ == 0) {
+      transition_ = F;
+    } else {
+      transition_.rightCols<DIM_OF_BLOCK_>() =
+          (F.leftCols<DIM_OF_BLOCK_>() * transition_.rightCols<DIM_OF_BLOCK_>() +
+           F.rightCols<DIM_OF_BLOCK_>()).eval();
+      transition_.leftCols<DIM_OF_BLOCK_>() =
+          (F.leftCols<DIM_OF_BLOCK_>() * transition_.leftCols<DIM_OF_BLOCK_>()).eval();
+    }
+    ++num_predicted_;
+
+    if (num_predicted_ >= COV_PROPAGATION_INTERVAL) propagateCovariance();
+  }
+
+  // covariance_ = Phi * covariance_ * Phi^T + Qd, with the transition Phi and
+  // the discrete noise Qd accumulated by predict since the last propagation.
+  // The noise of each IMU sample is added as is, not carried through the
+  // transition of the samples after it within the same interval
+  void propagateCovariance() {
+    if (num_predicted_ == 0) return;
+
+    // Phi = [T1 T2; 0 I] over the first DIM_OF_BLOCK_ states and the rest
+    const auto T1 = transition_.leftCols<DIM_OF_BLOCK_>();
+    const auto T2 = transition_.rightCols<DIM_OF_BLOCK_>();
+    const auto P11 = covariance_.topLeftCorner<DIM_OF_BLOCK_, DIM_OF_BLOCK_>();
+    const auto P12 = covariance_.topRightCorner<DIM_OF_BLOCK_, DIM_OF_BLOCK_>();
+    const auto P21 = covariance_.bottomLeftCorner<DIM_OF_BLOCK_, DIM_OF_BLOCK_>();
+    const auto P22 = covariance_.bottomRightCorner<DIM_OF_BLOCK_, DIM_OF_BLOCK_>();
+
+    const Eigen::Matrix<double, DIM_OF_BLOCK_, DIM_OF_BLOCK_> M1 =
+        T1 * P11 + T2 * P21;
+    const Eigen::Matrix<double, DIM_OF_BLOCK_, DIM_OF_BLOCK_> M2 =
+        T1 * P12 + T2 * P22;
+    const Eigen::Matrix<double, DIM_OF_BLOCK_, DIM_OF_BLOCK_> P11New =
+        M1 * T1.transpose() + M2 * T2.transpose();
+
+    covariance_.topLeftCorner<DIM_OF_BLOCK_, DIM_OF_BLOCK_>() =
+        0.5 * (P11New + P11New.transpose());
+    covariance_.topRightCorner<DIM_OF_BLOCK_, DIM_OF_BLOCK_>() = M2;
+    covariance_.bottomLeftCorner<DIM_OF_BLOCK_, DIM_OF_BLOCK_>() =
+        M2.transpose();
+    covariance_ += predicted_noise_;
+
+    clearPrediction();
+  }
+
   static void calculateRPfromIMU(const V3D& acc, double& roll, double& pitch) {
     pitch = -sign(acc.z()) * asin(acc.x() / G0);
     roll = sign(acc.z()) * asin(acc.y() / G0);
@@ -197,6 +288,8 @@ class StatePredictor {
                                   GlobalState::DIM_OF_STATE_>& covariance) {
     state_ = state;
     covariance_ = covariance;
+    // the covariance of the update already covers every predicted sample
+    clearPrediction();
   }
 
   void initialization(double time, const V3D& rn, const V3D& vn, const Q4D& qbn,
@@ -304,6 +397,8 @@ class StatePredictor {
       covariance_.block<3, 3>(GlobalState::gra_, GlobalState::gra_) = gra_cov;
     }
 
+    clearPrediction();
+
     noise_.setZero();
     noise_.block<3, 3>(0, 0) = V3D(peba, peba, peba).asDiagonal();
     noise_.block<3, 3>(3, 3) = V3D(pebg, pebg, pebg).asDiagonal();
@@ -318,6 +413,8 @@ class StatePredictor {
       state_.qbn_.setIdentity();
       initializeCovariance();
     } else if (type == 1) {
+      propagateCovariance();
+
       V3D covPos = INIT_POS_STD.array().square();
       double covRoll = pow(deg2rad(INIT_ATT_STD(0)), 2);
       double covPitch = pow(deg2rad(INIT_ATT_STD(1)), 2);
@@ -363,15 +460,30 @@ class StatePredictor {
 
   inline bool isInitialized() { return flag_init_state_; }
 
+  void clearPrediction() {
+    num_predicted_ = 0;
+    predicted_noise_.setZero();
+  }
+
+  // position, velocity and attitude come first, see GlobalState
+  static constexpr unsigned int DIM_OF_BLOCK_ = 9;
+  typedef Eigen::Matrix<double, DIM_OF_BLOCK_, GlobalState::DIM_OF_STATE_>
+      TransitionRows;
+
   GlobalState state_;
   double time_;
-  Eigen::Matrix<double, GlobalState::DIM_OF_STATE_, GlobalState::DIM_OF_STATE_>
-      F_;
   Eigen::Matrix<double, GlobalState::DIM_OF_STATE_, GlobalState::DIM_OF_STATE_>
       jacobian_, covariance_;
   Eigen::Matrix<double, GlobalState::DIM_OF_NOISE_, GlobalState::DIM_OF_NOISE_>
       noise_;
 
+  // rows of position, velocity and attitude of the transition, and the
+  // discrete noise, of the IMU samples not yet in covariance_
+  TransitionRows transition_;
+  Eigen::Matrix<double, GlobalState::DIM_OF_STATE_, GlobalState::DIM_OF_STATE_>
+      predicted_noise_;
+  int num_predicted_ = 0;
+
   V3D acc_last;  // last acceleration measurement
   V3D gyr_last;  // last gyroscope measurement
 
@@ -0,0 +1,283 @@
+// This file is part of LINS.
+//
+// Copyright (C) 2020 Chao Qin <cscharlesqin@gmail.com>,
+// Robotics and Multiperception Lab (RAM-LAB <https://ram-lab.com>),
+// The Hong Kong University of Science and Technology
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+
+#ifndef INCLUDE_KEYFRAMESTORE_H_
+#define INCLUDE_KEYFRAMESTORE_H_
+
+#include <pcl/io/pcd_io.h>
+#include <pcl/point_cloud.h>
+
+#include <boost/filesystem.hpp>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <CompactCloud.h>
+
+// Feature clouds of the key frames within a RAM budget. The least recently
+// used key frames are written once to binary compressed PCD files and reloaded
+// on access. Key frame clouds must not be modified after push_back, which
+// allows returning shared pointers to them from any thread.
+//
+// With a compact resolution, the key frames in RAM are kept as CompactCloud
+// and every get decodes a new copy, so callers keep what they reuse.
+template <typename PointT>
+class KeyFrameStore {
+ public:
+  typedef typename pcl::PointCloud<PointT>::Ptr CloudPtr;
+  typedef typename CompactCloud<PointT>::ConstPtr CompactPtr;
+
+  struct KeyFrame {
+    CloudPtr corner;
+    CloudPtr surf;
+    CloudPtr outlier;
+  };
+
+  KeyFrameStore()
+      : ramBudget_(0),
+        resolution_(0.0f),
+        ramBytes_(0),
+        evictedNum_(0),
+        reloadedNum_(0) {}
+
+  // A resolution of 0 keeps the key frame clouds as they are. Only applies to
+  // the key frames pushed after
+  void setCompactResolution(float resolution) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    resolution_ = std::max(resolution, 0.0f);
+  }
+
+  // A budget of 0 keeps every key frame in RAM
+  void setBudget(const std::string& directory, size_t ramBudget) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    directory_ = directory;
+    ramBudget_ = ramBudget;
+    if (ramBudget_ == 0) return;
+
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(directory_, ec);
+    if (ec) {
+      std::cerr << "ERROR: Cannot create key frame directory " << directory_
+                << ", keep all key frames in RAM" << std::endl;
+      ramBudget_ = 0;
+    }
+  }
+
+  int size() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return entries_.size();
+  }
+
+  void push_back(const CloudPtr& corner, const CloudPtr& surf,
+                 const CloudPtr& outlier) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    Entry entry;
+    entry.frame.corner = corner;
+    entry.frame.surf = surf;
+    entry.frame.outlier = outlier;
+    entry.resolution = resolution_;
+    compact(entry);
+    entry.inRam = true;
+    entry.onDisk = false;
+    entries_.push_back(entry);
+
+    lru_.push_front(entries_.size() - 1);
+    entries_.back().lruIter = lru_.begin();
+    ramBytes_ += entry.bytes;
+    evict();
+  }
+
+  // Reloads an evicted key frame from disk. With keepInRam false it is not
+  // put back into RAM, for one-off reads like the global map.
+  KeyFrame get(int i, bool keepInRam = true) {
+    CompactFrame compactFrame;
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      Entry& entry = entries_[i];
+      if (entry.inRam) {
+        lru_.splice(lru_.begin(), lru_, entry.lruIter);
+        if (entry.resolution <= 0.0f) return entry.frame;
+        compactFrame = entry.compactFrame;
+      }
+    }
+    // compact clouds are immutable, decode them without the lock
+    if (compactFrame.corner) return decode(compactFrame);
+
+    // the files of a key frame are written once, read them without the lock
+    KeyFrame frame;
+    frame.corner = load(i, "corner");
+    frame.surf = load(i, "surf");
+    frame.outlier = load(i, "outlier");
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    ++reloadedNum_;
+    Entry& entry = entries_[i];
+    if (!keepInRam) return frame;
+    if (entry.inRam) {
+      lru_.splice(lru_.begin(), lru_, entry.lruIter);
+      if (entry.resolution <= 0.0f) return entry.frame;
+      return frame;
+    }
+
+    entry.frame = frame;
+    compact(entry);
+    entry.inRam = true;
+    lru_.push_front(i);
+    entry.lruIter = lru_.begin();
+    ramBytes_ += entry.bytes;
+    evict();
+    return frame;
+  }
+
+  // !@Stats
+  size_t ramBytes() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return ramBytes_;
+  }
+  int ramFrameNum() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return lru_.size();
+  }
+  int evictedNum() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return evictedNum_;
+  }
+  int reloadedNum() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return reloadedNum_;
+  }
+
+ private:
+  struct CompactFrame {
+    CompactPtr corner;
+    CompactPtr surf;
+    CompactPtr outlier;
+  };
+
+  struct Entry {
+    // full clouds without a resolution, compact clouds with one
+    KeyFrame frame;
+    CompactFrame compactFrame;
+    float resolution;
+    size_t bytes;
+    bool inRam;
+    bool onDisk;
+    std::list<int>::iterator lruIter;
+  };
+
+  static size_t frameBytes(const KeyFrame& frame) {
+    return (frame.corner->points.size() + frame.surf->points.size() +
+            frame.outlier->points.size()) *
+           sizeof(PointT);
+  }
+
+  // Called with mtx_ held, the full clouds of frame are moved into compactFrame
+  static void compact(Entry& entry) {
+    if (entry.resolution <= 0.0f) {
+      entry.bytes = frameBytes(entry.frame);
+      return;
+    }
+
+    entry.compactFrame.corner = std::make_shared<const CompactCloud<PointT>>(
+        *entry.frame.corner, entry.resolution);
+    entry.compactFrame.surf = std::make_shared<const CompactCloud<PointT>>(
+        *entry.frame.surf, entry.resolution);
+    entry.compactFrame.outlier = std::make_shared<const CompactCloud<PointT>>(
+        *entry.frame.outlier, entry.resolution);
+    entry.frame = KeyFrame();
+    entry.bytes = entry.compactFrame.corner->bytes() +
+                  entry.compactFrame.surf->bytes() +
+                  entry.compactFrame.outlier->bytes();
+  }
+
+  static KeyFrame decode(const CompactFrame& compactFrame) {
+    KeyFrame frame;
+    frame.corner.reset(new pcl::PointCloud<PointT>());
+    frame.surf.reset(new pcl::PointCloud<PointT>());
+    frame.outlier.reset(new pcl::PointCloud<PointT>());
+    compactFrame.corner->decode(*frame.corner);
+    compactFrame.surf->decode(*frame.surf);
+    compactFrame.outlier->decode(*frame.outlier);
+    return frame;
+  }
+
+  std::string fileName(int i, const std::string& type) const {
+    return directory_ + "/" + std::to_string(i) + "_" + type + ".pcd";
+  }
+
+  // empty clouds have no file, the PCD writer rejects them
+  bool save(int i, const std::string& type, const CloudPtr& cloud) {
+    if (cloud->points.empty()) return true;
+    return pcl::io::savePCDFileBinaryCompressed(fileName(i, type), *cloud) ==
+           0;
+  }
+
+  CloudPtr load(int i, const std::string& type) const {
+    CloudPtr cloud(new pcl::PointCloud<PointT>());
+    if (boost::filesystem::exists(fileName(i, type)) &&
+        pcl::io::loadPCDFile(fileName(i, type), *cloud) != 0) {
+      std::cerr << "ERROR: Cannot reload " << fileName(i, type) << std::endl;
+    }
+    return cloud;
+  }
+
+  // Called with mtx_ held
+  void evict() {
+    while (ramBudget_ > 0 && ramBytes_ > ramBudget_ && lru_.size() > 1) {
+      int i = lru_.back();
+      Entry& entry = entries_[i];
+      if (!entry.onDisk) {
+        const KeyFrame frame = entry.resolution > 0.0f
+                                   ? decode(entry.compactFrame)
+                                   : entry.frame;
+        if (!save(i, "corner", frame.corner) ||
+            !save(i, "surf", frame.surf) ||
+            !save(i, "outlier", frame.outlier)) {
+          std::cerr << "ERROR: Cannot write key frame " << i << " to "
+                    << directory_ << ", keep all key frames in RAM"
+                    << std::endl;
+          ramBudget_ = 0;
+          return;
+        }
+        entry.onDisk = true;
+      }
+
+      entry.frame = KeyFrame();
+      entry.compactFrame = CompactFrame();
+      entry.inRam = false;
+      lru_.pop_back();
+      ramBytes_ -= entry.bytes;
+      ++evictedNum_;
+    }
+  }
+
+  std::string directory_;
+  size_t ramBudget_;
+  float resolution_;
+  size_t ramBytes_;
+  int evictedNum_;
+  int reloadedNum_;
+
+  std::vector<Entry> entries_;
+  // key frames in RAM, the most recently used first
+  std::list<int> lru_;
+  std::mutex mtx_;
+};
+
+#endif  // INCLUDE_KEYFRAMESTORE_H_
@@ -30,19 +30,19 @@
 #define INCLUDE_MAPRINGBUFFER_H_
 
 #include <iostream>
-#include <map>
+#include <vector>
 
+// Time-ordered measurement buffer with a fixed capacity. The measurements are
+// stored in a contiguous circular array sorted by time, so adding a new
+// measurement and dropping old ones never allocate, and lookups by time are
+// binary searches. When the buffer is full the oldest measurement is dropped.
 template <typename Meas>
 class MapRingBuffer {
  public:
-  std::map<double, Meas> measMap_;
-  typename std::map<double, Meas>::iterator itMeas_;
-
-  int size;
   double maxWaitTime_;
   double minWaitTime_;
 
-  MapRingBuffer() {
+  MapRingBuffer() : capacity_(0), start_(0), count_(0) {
     maxWaitTime_ = 0.1;
     minWaitTime_ = 0.0;
   }
@@ -53,52 +53,88 @@ class MapRingBuffer {
     if (sizeBuffer <= 0) {
       return false;
     } else {
-      size = sizeBuffer;
+      capacity_ = sizeBuffer;
+      times_.assign(capacity_, 0.0);
+      meas_.assign(capacity_, Meas());
+      start_ = 0;
+      count_ = 0;
       return true;
     }
   }
 
-  int getSize() { return measMap_.size(); }
+  int getSize() { return count_; }
 
+  // Measurements arrive in time order, which is a plain append. Late ones are
+  // moved into place, and duplicated time stamps are ignored like a std::map
   void addMeas(const Meas& meas, const double& t) {
-    measMap_.insert(std::make_pair(t, meas));
+    if (capacity_ == 0) return;
+
+    int pos = upperBound(t);
+    if (pos > 0 && timeAt(pos - 1) == t) return;
 
-    // ensure the size of the map, and remove the last element
-    if (measMap_.size() > size) {
-      measMap_.erase(measMap_.begin());
+    if (count_ == capacity_) {
+      // older than everything in a full buffer, it would be dropped at once
+      if (pos == 0) return;
+      start_ = index(1);
+      count_--;
+      pos--;
     }
+
+    count_++;
+    for (int i = count_ - 1; i > pos; i--) {
+      times_[index(i)] = times_[index(i - 1)];
+      meas_[index(i)] = meas_[index(i - 1)];
+    }
+    times_[index(pos)] = t;
+    meas_[index(pos)] = meas;
   }
 
-  void clear() { measMap_.clear(); }
+  void clear() {
+    start_ = 0;
+    count_ = 0;
+  }
 
+  // Drop all measurements not later than t
   void clean(double t) {
-    while (measMap_.size() >= 1 && measMap_.begin()->first <= t) {
-      measMap_.erase(measMap_.begin());
-    }
+    int num = upperBound(t);
+    start_ = index(num);
+    count_ -= num;
   }
 
   bool getNextTime(double actualTime, double& nextTime) {
-    itMeas_ = measMap_.upper_bound(actualTime);
-    if (itMeas_ != measMap_.end()) {
-      nextTime = itMeas_->first;
+    int pos = upperBound(actualTime);
+    if (pos < count_) {
+      nextTime = timeAt(pos);
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  // First measurement later than actualTime
+  bool getNextMeas(double actualTime, double& nextTime, Meas& nextMeas) {
+    int pos = upperBound(actualTime);
+    if (pos < count_) {
+      nextTime = timeAt(pos);
+      nextMeas = meas_[index(pos)];
       return true;
     } else {
       return false;
     }
   }
+
   void waitTime(double actualTime, double& time) {
     double measurementTime = actualTime - maxWaitTime_;
-    if (!measMap_.empty() &&
-        measMap_.rbegin()->first + minWaitTime_ > measurementTime) {
-      measurementTime = measMap_.rbegin()->first + minWaitTime_;
+    if (count_ > 0 && timeAt(count_ - 1) + minWaitTime_ > measurementTime) {
+      measurementTime = timeAt(count_ - 1) + minWaitTime_;
     }
     if (time > measurementTime) {
       time = measurementTime;
     }
   }
   bool getLastTime(double& lastTime) {
-    if (!measMap_.empty()) {
-      lastTime = measMap_.rbegin()->first;
+    if (count_ > 0) {
+      lastTime = timeAt(count_ - 1);
       return true;
     } else {
       return false;
@@ -106,8 +142,8 @@ class MapRingBuffer {
   }
 
   bool getFirstTime(double& firstTime) {
-    if (!measMap_.empty()) {
-      firstTime = measMap_.begin()->first;
+    if (count_ > 0) {
+      firstTime = timeAt(0);
       return true;
     } else {
       return false;
@@ -115,8 +151,8 @@ class MapRingBuffer {
   }
 
   bool getLastMeas(Meas& lastMeas) {
-    if (!measMap_.empty()) {
-      lastMeas = measMap_.rbegin()->second;
+    if (count_ > 0) {
+      lastMeas = meas_[index(count_ - 1)];
       return true;
     } else {
       return false;
@@ -124,10 +160,8 @@ class MapRingBuffer {
   }
 
   bool getLastLastMeas(Meas& lastlastMeas) {
-    if (measMap_.size() >= 2) {
-      auto itr = measMap_.rbegin();
-      itr++;
-      lastlastMeas = itr->second;
+    if (count_ >= 2) {
+      lastlastMeas = meas_[index(count_ - 2)];
       return true;
     } else {
       return false;
@@ -135,25 +169,56 @@ class MapRingBuffer {
   }
 
   bool getFirstMeas(Meas& firstMeas) {
-    if (!measMap_.empty()) {
-      firstMeas = measMap_.begin()->second;
+    if (count_ > 0) {
+      firstMeas = meas_[index(0)];
       return true;
     } else {
       return false;
     }
   }
 
-  bool hasMeasurementAt(double t) { return measMap_.count(t) > 0; }
+  bool hasMeasurementAt(double t) {
+    int pos = upperBound(t);
+    return pos > 0 && timeAt(pos - 1) == t;
+  }
 
-  bool empty() { return measMap_.empty(); }
+  bool empty() { return count_ == 0; }
 
   void printContainer() {
-    itMeas_ = measMap_.begin();
-    while (measMap_.size() >= 1 && itMeas_ != measMap_.end()) {
-      std::cout << itMeas_->second << " ";
-      itMeas_++;
+    for (int i = 0; i < count_; i++) {
+      std::cout << meas_[index(i)] << " ";
+    }
+  }
+
+ private:
+  // Position in the circular array of the i-th oldest measurement
+  int index(int i) const {
+    int pos = start_ + i;
+    return pos >= capacity_ ? pos - capacity_ : pos;
+  }
+
+  double timeAt(int i) const { return times_[index(i)]; }
+
+  // Number of measurements not later than t
+  int upperBound(double t) const {
+    int first = 0, len = count_;
+    while (len > 0) {
+      int half = len / 2;
+      if (timeAt(first + half) <= t) {
+        first += half + 1;
+        len -= half + 1;
+      } else {
+        len = half;
+      }
     }
+    return first;
   }
+
+  std::vector<double> times_;
+  std::vector<Meas> meas_;
+  int capacity_;
+  int start_;
+  int count_;
 };
 
 #endif  // INCLUDE_MAPRINGBUFFER_H_
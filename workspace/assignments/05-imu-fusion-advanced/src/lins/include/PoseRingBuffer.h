@@ -0,0 +1,173 @@
+// This file is part of LINS.
+//
+// Copyright (C) 2020 Chao Qin <cscharlesqin@gmail.com>,
+// Robotics and Multiperception Lab (RAM-LAB <https://ram-lab.com>),
+// The Hong Kong University of Science and Technology
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+
+#ifndef INCLUDE_POSERINGBUFFER_H_
+#define INCLUDE_POSERINGBUFFER_H_
+
+#include <Eigen/Dense>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+
+// Time-indexed poses written by a single thread and interpolated by any number
+// of reader threads without locks or allocation. Each slot carries a sequence
+// number derived from the index of its pose, odd while the writer is in it, so
+// a reader detects a slot that was overwritten under it and reads again. Poses
+// arrive at a near constant rate, so the slot of a time stamp is predicted
+// from the mean period of the buffer and corrected by a step or two.
+class PoseRingBuffer {
+ public:
+  explicit PoseRingBuffer(int capacity) : count_(0) {
+    // a power of two, at least two poses to interpolate between
+    uint64_t size = 2;
+    while (size < static_cast<uint64_t>(capacity)) size <<= 1;
+    mask_ = size - 1;
+    slots_.reset(new Slot[size]);
+  }
+
+  int capacity() const { return static_cast<int>(mask_ + 1); }
+
+  // Poses are added in time order, an older or duplicated time stamp is
+  // ignored. Only one thread may add poses
+  bool addPose(double t, const Eigen::Vector3d& p, const Eigen::Quaterniond& q) {
+    const uint64_t n = count_.load(std::memory_order_relaxed);
+    if (n > 0 && t <= readTime(n - 1)) return false;
+
+    Slot& slot = slots_[n & mask_];
+    slot.seq.store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.data[0].store(t, std::memory_order_relaxed);
+    slot.data[1].store(p.x(), std::memory_order_relaxed);
+    slot.data[2].store(p.y(), std::memory_order_relaxed);
+    slot.data[3].store(p.z(), std::memory_order_relaxed);
+    slot.data[4].store(q.x(), std::memory_order_relaxed);
+    slot.data[5].store(q.y(), std::memory_order_relaxed);
+    slot.data[6].store(q.z(), std::memory_order_relaxed);
+    slot.data[7].store(q.w(), std::memory_order_relaxed);
+    slot.seq.store(2 * n + 2, std::memory_order_release);
+
+    count_.store(n + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Pose at time t, the position interpolated linearly and the rotation by
+  // slerp between the two poses around it. False outside the buffered time
+  // range, and when the writer keeps overwriting the poses being read
+  bool lookup(double t, Eigen::Vector3d& p, Eigen::Quaterniond& q) const {
+    for (int attempt = 0; attempt < MAX_ATTEMPTS; ++attempt) {
+      const uint64_t n = count_.load(std::memory_order_acquire);
+      if (n < 2) return false;
+      // the oldest slot is the next to be overwritten, it is left out
+      const uint64_t first = n > mask_ + 1 ? n - mask_ : 0;
+      const uint64_t last = n - 1;
+
+      Pose oldest, newest;
+      if (!readPose(first, oldest) || !readPose(last, newest)) continue;
+      if (t < oldest.t || t > newest.t) return false;
+
+      // a. predicted from the mean period, then stepped to prev <= t <= next
+      const double period = (newest.t - oldest.t) / (last - first);
+      uint64_t i = first + static_cast<uint64_t>((t - oldest.t) / period);
+      if (i >= last) i = last - 1;
+
+      Pose prev, next;
+      bool isRead = readPose(i, prev) && readPose(i + 1, next);
+      while (isRead && prev.t > t) {
+        next = prev;
+        isRead = readPose(--i, prev);
+      }
+      while (isRead && next.t < t) {
+        prev = next;
+        isRead = readPose(++i + 1, next);
+      }
+      if (!isRead) continue;
+
+      // b. interpolation:
+      const double s = (t - prev.t) / (next.t - prev.t);
+      p = (1.0 - s) * prev.p + s * next.p;
+      q = prev.q.slerp(s, next.q);
+      return true;
+    }
+
+    return false;
+  }
+
+  // Time range of the poses which can be looked up
+  bool getTimeRange(double& oldest, double& newest) const {
+    for (int attempt = 0; attempt < MAX_ATTEMPTS; ++attempt) {
+      const uint64_t n = count_.load(std::memory_order_acquire);
+      if (n < 2) return false;
+      const uint64_t first = n > mask_ + 1 ? n - mask_ : 0;
+
+      Pose pose;
+      if (!readPose(first, pose)) continue;
+      oldest = pose.t;
+      if (!readPose(n - 1, pose)) continue;
+      newest = pose.t;
+      return true;
+    }
+
+    return false;
+  }
+
+ private:
+  static const int MAX_ATTEMPTS = 4;
+
+  struct Slot {
+    std::atomic<uint64_t> seq{0};
+    // time, position & rotation as x, y, z, w
+    std::atomic<double> data[8];
+  };
+
+  struct Pose {
+    double t;
+    Eigen::Vector3d p;
+    Eigen::Quaterniond q;
+  };
+
+  // by the writer, which is the only one to modify the slot
+  double readTime(uint64_t index) const {
+    return slots_[index & mask_].data[0].load(std::memory_order_relaxed);
+  }
+
+  // false if the slot no longer, or not yet, holds the pose of index
+  bool readPose(uint64_t index, Pose& pose) const {
+    const Slot& slot = slots_[index & mask_];
+
+    const uint64_t seq = slot.seq.load(std::memory_order_acquire);
+    if (seq != 2 * index + 2) return false;
+    pose.t = slot.data[0].load(std::memory_order_relaxed);
+    pose.p.x() = slot.data[1].load(std::memory_order_relaxed);
+    pose.p.y() = slot.data[2].load(std::memory_order_relaxed);
+    pose.p.z() = slot.data[3].load(std::memory_order_relaxed);
+    pose.q.x() = slot.data[4].load(std::memory_order_relaxed);
+    pose.q.y() = slot.data[5].load(std::memory_order_relaxed);
+    pose.q.z() = slot.data[6].load(std::memory_order_relaxed);
+    pose.q.w() = slot.data[7].load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    return slot.seq.load(std::memory_order_relaxed) == seq;
+  }
+
+ private:
+  uint64_t mask_;
+  std::unique_ptr<Slot[]> slots_;
+  std::atomic<uint64_t> count_;
+};
+
+#endif  // INCLUDE_POSERINGBUFFER_H_
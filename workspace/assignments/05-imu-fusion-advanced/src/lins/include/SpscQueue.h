@@ -0,0 +1,89 @@
+// This file is part of LINS.
+//
+// Copyright (C) 2020 Chao Qin <cscharlesqin@gmail.com>,
+// Robotics and Multiperception Lab (RAM-LAB <https://ram-lab.com>),
+// The Hong Kong University of Science and Technology
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+
+#ifndef INCLUDE_SPSCQUEUE_H_
+#define INCLUDE_SPSCQUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Bounded queue between one producer thread and one consumer thread, without
+// locks or allocation once allocated. Measurements are copied into slots of a
+// ring whose capacity is a power of two. A full queue rejects the newest
+// measurement, so the producer is never blocked by a slow consumer.
+template <typename Meas>
+class SpscQueue {
+ public:
+  SpscQueue() : capacity_(0), mask_(0), head_(0), tail_(0) {}
+
+  // Before either thread uses the queue
+  bool allocate(const int sizeQueue) {
+    if (sizeQueue <= 0) return false;
+
+    size_t size = 1;
+    while (size < static_cast<size_t>(sizeQueue)) size <<= 1;
+    capacity_ = size;
+    mask_ = size - 1;
+    slots_.reset(new Meas[size]);
+    head_.store(0, std::memory_order_relaxed);
+    tail_.store(0, std::memory_order_relaxed);
+    return true;
+  }
+
+  // By the producer
+  bool push(const Meas& meas) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) >= capacity_) return false;
+
+    slots_[tail & mask_] = meas;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // By the consumer
+  bool pop(Meas& meas) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) return false;
+
+    meas = slots_[head & mask_];
+    // release what the slot holds, e.g. the last reference to a message
+    slots_[head & mask_] = Meas();
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // By either thread, exact only for the consumer. The head is read first,
+  // it never passes a tail read after it
+  size_t getSize() const {
+    const size_t head = head_.load(std::memory_order_acquire);
+    return tail_.load(std::memory_order_acquire) - head;
+  }
+
+  bool empty() const { return getSize() == 0; }
+
+ private:
+  size_t capacity_;
+  size_t mask_;
+  std::unique_ptr<Meas[]> slots_;
+
+  // the two indices on separate cache lines
+  alignas(64) std::atomic<size_t> head_;
+  alignas(64) std::atomic<size_t> tail_;
+};
+
+#endif  // INCLUDE_SPSCQUEUE_H_
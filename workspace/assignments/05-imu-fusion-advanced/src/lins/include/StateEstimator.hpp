@@ -18,6 +18,10 @@
 #ifndef INCLUDE_STATEESTIMATOR_HPP_
 #define INCLUDE_STATEESTIMATOR_HPP_
 
+#include <CloudAssembler.h>
+#include <DeskewTable.h>
+#include <FeatureExtractor.h>
+#include <ImuDecimator.h>
 #include <integrationBase.h>
 #include <math_utils.h>
 #include <parameters.h>
@@ -51,24 +55,6 @@ using namespace filter;
 
 namespace fusion {
 
-const int LINE_NUM_ = 16;
-const int SCAN_NUM_ = 1800;
-
-struct Smooth {
-  Smooth() {
-    value = 0.0;
-    ind = 0;
-  }
-  double value;
-  size_t ind;
-};
-
-struct byValue {
-  bool operator()(Smooth const& left, Smooth const& right) {
-    return left.value < right.value;
-  }
-};
-
 // Scan Class stores all kinds of information of a point cloud, including
 // the whole point cloud, its smoothness, timestamp, and features.
 class Scan {
@@ -89,9 +75,6 @@ class Scan {
     surfPointsLessFlatYZX_.reset(new pcl::PointCloud<PointType>());
     outlierPointCloudYZX_.reset(new pcl::PointCloud<PointType>());
 
-    cloudCurvature_.resize(LINE_NUM * SCAN_NUM);
-    cloudSmoothness_.resize(LINE_NUM * SCAN_NUM);
-
     reset();
   }
 
@@ -124,9 +107,6 @@ class Scan {
     cornerPointsLessSharpYZX_->clear();
     surfPointsLessFlatYZX_->clear();
     outlierPointCloudYZX_->clear();
-
-    cloudCurvature_.assign(LINE_NUM * SCAN_NUM, 0.0);
-    cloudSmoothness_.assign(LINE_NUM * SCAN_NUM, Smooth());
   }
 
   void setPointCloud(double time,
@@ -152,12 +132,6 @@ class Scan {
   cloud_msgs::cloud_info::Ptr cloudInfo_;
 
   // !@PclFeatures
-  std::vector<double> cloudCurvature_;
-  std::vector<Smooth> cloudSmoothness_;
-
-  int cloudNeighborPicked_[LINE_NUM_ * SCAN_NUM_];
-  int cloudLabel_[LINE_NUM_ * SCAN_NUM_];
-
   pcl::PointCloud<PointType>::Ptr cornerPointsSharp_;
   pcl::PointCloud<PointType>::Ptr cornerPointsLessSharp_;
   pcl::PointCloud<PointType>::Ptr surfPointsFlat_;
@@ -184,9 +158,10 @@ class StateEstimator {
 
   StateEstimator() {
     filter_ = new StatePredictor();
+    imuDecimator_.setRate(IMU_DECIMATION_RATE);
 
-    // Initialize KD tree and downsize filter
-    downSizeFilter_.setLeafSize(0.2, 0.2, 0.2);
+    // Initialize KD tree and feature extractor
+    featureExtractor_.params().minSectorPoints = 2;
     kdtreeCorner_.reset(new pcl::KdTreeFLANN<PointType>());
     kdtreeSurf_.reset(new pcl::KdTreeFLANN<PointType>());
     scan_new_.reset(new Scan());
@@ -199,9 +174,6 @@ class StateEstimator {
     jacobianCoffCorns.reset(new pcl::PointCloud<PointType>());
     jacobianCoffSurfs.reset(new pcl::PointCloud<PointType>());
 
-    surfPointsLessFlatScan.reset(new pcl::PointCloud<PointType>());
-    surfPointsLessFlatScanDS.reset(new pcl::PointCloud<PointType>());
-
     pointSelCornerInd.resize(LINE_NUM * SCAN_NUM);
     pointSearchCornerInd1.resize(LINE_NUM * SCAN_NUM);
     pointSearchCornerInd2.resize(LINE_NUM * SCAN_NUM);
@@ -229,7 +201,10 @@ class StateEstimator {
     delete preintegration_;
   }
 
-  inline const double getTime() const { return filter_->time_; }
+  // Including the IMU samples pending in the decimator
+  inline const double getTime() const {
+    return filter_->time_ + imuDecimator_.duration();
+  }
   inline bool isInitialized() const { return status_ != STATUS_INIT; }
 
   /********Relative Variables*********/
@@ -250,7 +225,13 @@ class StateEstimator {
         gyr_0_ = gyr;
         break;
       case STATUS_RUNNING:
-        filter_->predict(dt, acc, gyr, true);
+        if (!imuDecimator_.enabled()) {
+          filter_->predict(dt, acc, gyr, true);
+          break;
+        }
+        if (!imuDecimator_.hasLast())
+          imuDecimator_.setLast(filter_->acc_last, filter_->gyr_last);
+        if (imuDecimator_.add(dt, acc, gyr)) flushImu();
         break;
       default:
         break;
@@ -269,6 +250,13 @@ class StateEstimator {
     gyr_0_ = gyr;
   }
 
+  // Predicts with the samples integrated by the decimator, if any
+  void flushImu() {
+    if (imuDecimator_.empty()) return;
+    imuDecimator_.getIncrement(imuIncrement_);
+    filter_->predict(imuIncrement_, true);
+  }
+
   /********Relative Variables*********/
   double duration_fea_ = 0;
   double duration_opt_ = 0;
@@ -280,6 +268,9 @@ class StateEstimator {
                   pcl::PointCloud<PointType>::Ptr distortedPointCloud,
                   cloud_msgs::cloud_info cloudInfo,
                   pcl::PointCloud<PointType>::Ptr outlierPointCloud) {
+    // the filter must be at the scan time
+    flushImu();
+
     TicToc ts_fea;  // Calculate the time used in feature extraction
     scan_new_->setPointCloud(time, distortedPointCloud, cloudInfo,
                              outlierPointCloud);
@@ -387,13 +378,11 @@ class StateEstimator {
     // Calculate relative transform, linState_, using ICP method
     V3D pl;
     Q4D ql;
-    V3D v0, v1, ba0, bw0;
-    ba0.setZero();
-    ql = preintegration_->delta_q;
-    pl = preintegration_->delta_p +
-         0.5 * linState_.gn_ * preintegration_->sum_dt *
-             preintegration_->sum_dt -
-         0.5 * ba0 * preintegration_->sum_dt * preintegration_->sum_dt;
+    V3D v0, v1, ba0 = INIT_BA, bw0 = INIT_BW;
+    V3D dp, dv;
+    correctPreintegration(ba0, bw0, dp, ql, dv);
+    pl = dp + 0.5 * linState_.gn_ * preintegration_->sum_dt *
+                  preintegration_->sum_dt;
     estimateTransform(scan_last_, scan_new_, pl, ql);
 
     // Calculate initial state using relative transform calculated by point
@@ -464,6 +453,7 @@ class StateEstimator {
 
   void performIESKF() {
     // Store current state and perform initialization
+    filter_->propagateCovariance();
     Pk_ = filter_->covariance_;
     GlobalState filterState = filter_->state_;
     linState_ = filterState;
@@ -503,17 +493,18 @@ class StateEstimator {
       (*jacobians_) += (*jacobianCoffSurfs);
       (*jacobians_) += (*jacobianCoffCorns);
 
-      // Memery allocation
+      // Accumulate H^T * R^-1 * H and H^T * R^-1 * r row by row instead of
+      // building the M x 18 Jacobian. A row is only non-zero in the attitude
+      // and position columns and R = LIDAR_STD^2 * I, so this is linear in the
+      // number of features M.
       const unsigned int DIM_OF_MEAS = keypoints_->points.size();
       residual_.resize(DIM_OF_MEAS);
-      Hk_.resize(DIM_OF_MEAS, DIM_OF_STATE);
-      Rk_.resize(DIM_OF_MEAS, DIM_OF_MEAS);
-      Kk_.resize(DIM_OF_STATE, DIM_OF_MEAS);
-      Py_.resize(DIM_OF_MEAS, DIM_OF_MEAS);
-      Pyinv_.resize(DIM_OF_MEAS, DIM_OF_MEAS);
 
-      Hk_.setZero();
+      Eigen::Matrix<double, 6, 6> HtH = Eigen::Matrix<double, 6, 6>::Zero();
+      Eigen::Matrix<double, 6, 1> Htr = Eigen::Matrix<double, 6, 1>::Zero();
       V3D axis = Quat2axis(linState_.qbn_);
+      M3D Rbn = linState_.qbn_.toRotationMatrix();
+      M3D Jr = Rinvleft(-axis);
       for (int i = 0; i < DIM_OF_MEAS; ++i) {
         // Point represented in 2-frame (e.g., the end frame) in a
         // xyz-convention
@@ -523,30 +514,38 @@ class StateEstimator {
                      jacobians_->points[i].z);
         residual_(i) = LIDAR_SCALE * jacobians_->points[i].intensity;
 
-        Hk_.block<1, 3>(i, GlobalState::att_) =
-            coff_xyz.transpose() *
-            (-linState_.qbn_.toRotationMatrix() * skew(P2xyz)) *
-            Rinvleft(-axis);
-        Hk_.block<1, 3>(i, GlobalState::pos_) =
-            coff_xyz.transpose() * M3D::Identity();
+        // [attitude, position] part of the i-th row of H
+        Eigen::Matrix<double, 6, 1> h;
+        h.head<3>() = (coff_xyz.transpose() * (-Rbn * skew(P2xyz)) * Jr).transpose();
+        h.tail<3>() = coff_xyz;
+        HtH.noalias() += h * h.transpose();
+        Htr.noalias() += h * residual_(i);
       }
 
-      // Set the measurement covariance matrix
-      VXD cov = VXD::Zero(DIM_OF_MEAS);
-      for (int i = 0; i < DIM_OF_MEAS; ++i) {
-        cov[i] = LIDAR_STD * LIDAR_STD;
+      const double Rinv = 1.0 / (LIDAR_STD * LIDAR_STD);
+      const unsigned int idx[2] = {GlobalState::att_, GlobalState::pos_};
+      HtRinvH_.setZero();
+      HtRinvr_.setZero();
+      for (int r = 0; r < 2; ++r) {
+        HtRinvr_.segment<3>(idx[r]) = Rinv * Htr.segment<3>(3 * r);
+        for (int c = 0; c < 2; ++c) {
+          HtRinvH_.block<3, 3>(idx[r], idx[c]) =
+              Rinv * HtH.block<3, 3>(3 * r, 3 * c);
+        }
       }
-      Rk_ = cov.asDiagonal();
 
-      // Kalman filter update. Details can be referred to ROVIO
-      Py_ =
-          Hk_ * Pk_ * Hk_.transpose() + Rk_;  // S = H * P * H.transpose() + R;
-      Pyinv_.setIdentity();                   // solve Ax=B
-      Py_.llt().solveInPlace(Pyinv_);
-      Kk_ = Pk_ * Hk_.transpose() * Pyinv_;  // K = P*H.transpose()*S.inverse()
+      // Information-form Kalman filter update, only 18 x 18 solves:
+      // K = (H^T * R^-1 * H + P^-1)^-1 * H^T * R^-1. The inverse is computed
+      // as P * (I + H^T * R^-1 * H * P)^-1, which needs no P^-1, so states
+      // with zero variance are fine.
+      Eigen::Matrix<double, 18, 18> infoGain =
+          Eigen::Matrix<double, 18, 18>::Identity() + HtRinvH_ * Pk_;
+      PkInfoInv_ = Pk_ * infoGain.partialPivLu().inverse();
 
       filterState.boxMinus(linState_, difVecLinInv_);
-      updateVec_ = -Kk_ * (residual_ + Hk_ * difVecLinInv_) + difVecLinInv_;
+      // K * (r + H * dx) = (H^T R^-1 H + P^-1)^-1 * (H^T R^-1 r + H^T R^-1 H dx)
+      updateVec_ = -PkInfoInv_ * (HtRinvr_ + HtRinvH_ * difVecLinInv_) +
+                   difVecLinInv_;
 
       // Divergence determination
       bool hasNaN = false;
@@ -591,9 +590,11 @@ class StateEstimator {
       filterState.qbn_ = q;
       filter_->update(filterState, Pk_);
     } else {
-      // Update only one time
-      IKH_ = Eigen::Matrix<double, 18, 18>::Identity() - Kk_ * Hk_;
-      Pk_ = IKH_ * Pk_ * IKH_.transpose() + Kk_ * Rk_ * Kk_.transpose();
+      // Update only one time, Joseph form with K * H = A^-1 * H^T R^-1 H and
+      // K * R * K^T = A^-1 * H^T R^-1 H * A^-1, A^-1 = PkInfoInv_
+      IKH_ = Eigen::Matrix<double, 18, 18>::Identity() - PkInfoInv_ * HtRinvH_;
+      Pk_ = IKH_ * Pk_ * IKH_.transpose() +
+            PkInfoInv_ * HtRinvH_ * PkInfoInv_.transpose();
       enforceSymmetry(Pk_);
       filter_->update(linState_, Pk_);
     }
@@ -622,12 +623,18 @@ class StateEstimator {
     pcl::PointCloud<PointType>::Ptr distPointCloud = scan->distPointCloud_;
     cloud_msgs::cloud_info::Ptr segInfo = scan->cloudInfo_;
     int size = distPointCloud->points.size();
-    PointType point;
-    for (int i = 0; i < size; i++) {
-      // If LiDAR frame does not align with Vehic frame, we transform the point
-      // cloud to the vehicle frame
-      rotatePoint(&distPointCloud->points[i], &point);
 
+    // If LiDAR frame does not align with Vehic frame, we transform the point
+    // cloud to the vehicle frame
+    scan->undistPointCloud_->points.resize(size);
+    CloudAssembler<PointType>::transform(distPointCloud->points.data(), size,
+                                         lidarToVehicle(),
+                                         scan->undistPointCloud_->points.data());
+    scan->undistPointCloud_->width = size;
+    scan->undistPointCloud_->height = 1;
+
+    for (int i = 0; i < size; i++) {
+      PointType& point = scan->undistPointCloud_->points[i];
       double ori = -atan2(point.y, point.x);
       if (!halfPassed) {
         if (ori < segInfo->startOrientation - M_PI / 2)
@@ -648,33 +655,35 @@ class StateEstimator {
           (ori - segInfo->startOrientation) / segInfo->orientationDiff;
       point.intensity =
           int(distPointCloud->points[i].intensity) + SCAN_PERIOD * relTime;
-
-      scan->undistPointCloud_->push_back(point);
     }
   }
 
   void calculateSmoothness(ScanPtr scan) {
-    int cloudSize = scan->undistPointCloud_->points.size();
     cloud_msgs::cloud_info::Ptr segInfo = scan->cloudInfo_;
-    for (int i = 5; i < cloudSize - 5; i++) {
-      double diffRange = segInfo->segmentedCloudRange[i - 5] +
-                         segInfo->segmentedCloudRange[i - 4] +
-                         segInfo->segmentedCloudRange[i - 3] +
-                         segInfo->segmentedCloudRange[i - 2] +
-                         segInfo->segmentedCloudRange[i - 1] -
-                         segInfo->segmentedCloudRange[i] * 10 +
-                         segInfo->segmentedCloudRange[i + 1] +
-                         segInfo->segmentedCloudRange[i + 2] +
-                         segInfo->segmentedCloudRange[i + 3] +
-                         segInfo->segmentedCloudRange[i + 4] +
-                         segInfo->segmentedCloudRange[i + 5];
-      scan->cloudCurvature_[i] = diffRange * diffRange;
-
-      scan->cloudNeighborPicked_[i] = 0;
-      scan->cloudLabel_[i] = 0;
-      scan->cloudSmoothness_[i].value = scan->cloudCurvature_[i];
-      scan->cloudSmoothness_[i].ind = i;
+    int cloudSize = scan->undistPointCloud_->points.size();
+
+    // Range image of the segmented points, in the rows and columns of the
+    // projection. Ring i holds the points from startRingIndex[i] - 4 to
+    // endRingIndex[i] + 5
+    pointCells_.assign(cloudSize, -1);
+    cellRanges_.assign(LINE_NUM * SCAN_NUM, 0.0f);
+    for (int ring = 0; ring < LINE_NUM; ring++) {
+      int begin = std::max(segInfo->startRingIndex[ring] - 4, 0);
+      int end = std::min(segInfo->endRingIndex[ring] + 5, cloudSize - 1);
+      for (int i = begin; i <= end; i++) {
+        int cell = ring * SCAN_NUM + segInfo->segmentedCloudColInd[i];
+        pointCells_[i] = cell;
+        cellRanges_[cell] = segInfo->segmentedCloudRange[i];
+      }
     }
+
+    loam::RangeImageView image;
+    image.numCols = SCAN_NUM;
+    image.pointCells = pointCells_.data();
+    image.cellRanges = cellRanges_.data();
+
+    featureExtractor_.reset(cloudSize);
+    featureExtractor_.computeCurvature(image);
   }
 
   void markOccludedPoints(ScanPtr scan) {
@@ -687,19 +696,9 @@ class StateEstimator {
                                     segInfo->segmentedCloudColInd[i]));
       if (columnDiff < 10) {
         if (depth1 - depth2 > 0.3) {
-          scan->cloudNeighborPicked_[i - 5] = 1;
-          scan->cloudNeighborPicked_[i - 4] = 1;
-          scan->cloudNeighborPicked_[i - 3] = 1;
-          scan->cloudNeighborPicked_[i - 2] = 1;
-          scan->cloudNeighborPicked_[i - 1] = 1;
-          scan->cloudNeighborPicked_[i] = 1;
+          for (int l = -5; l <= 0; l++) featureExtractor_.setPicked(i + l);
         } else if (depth2 - depth1 > 0.3) {
-          scan->cloudNeighborPicked_[i + 1] = 1;
-          scan->cloudNeighborPicked_[i + 2] = 1;
-          scan->cloudNeighborPicked_[i + 3] = 1;
-          scan->cloudNeighborPicked_[i + 4] = 1;
-          scan->cloudNeighborPicked_[i + 5] = 1;
-          scan->cloudNeighborPicked_[i + 6] = 1;
+          for (int l = 1; l <= 6; l++) featureExtractor_.setPicked(i + l);
         }
       }
       float diff1 = std::abs(segInfo->segmentedCloudRange[i - 1] -
@@ -708,122 +707,48 @@ class StateEstimator {
                              segInfo->segmentedCloudRange[i]);
       if (diff1 > 0.02 * segInfo->segmentedCloudRange[i] &&
           diff2 > 0.02 * segInfo->segmentedCloudRange[i])
-        scan->cloudNeighborPicked_[i] = 1;
+        featureExtractor_.setPicked(i);
     }
   }
 
   /********Relative Variables*********/
-  pcl::PointCloud<PointType>::Ptr surfPointsLessFlatScan;
-  pcl::PointCloud<PointType>::Ptr surfPointsLessFlatScanDS;
+  loam::FeatureExtractor<PointType> featureExtractor_;
+  loam::FeatureExtractor<PointType>::Features features_;
+  std::vector<int> pointCells_;
+  std::vector<float> cellRanges_;
+  std::vector<int> ringStart_;
+  std::vector<int> ringEnd_;
   /***********************************/
   void extractFeatures(ScanPtr scan) {
     cloud_msgs::cloud_info::Ptr segInfo = scan->cloudInfo_;
 
-    scan->cornerPointsSharp_->clear();
-    scan->cornerPointsLessSharp_->clear();
-    scan->surfPointsFlat_->clear();
-    scan->surfPointsLessFlat_->clear();
-
-    for (int i = 0; i < LINE_NUM; i++) {
-      surfPointsLessFlatScan->clear();
-
-      for (int j = 0; j < 6; j++) {
-        int sp = (segInfo->startRingIndex[i] * (6 - j) +
-                  segInfo->endRingIndex[i] * j) / 6;
-        int ep = (segInfo->startRingIndex[i] * (5 - j) +
-                  segInfo->endRingIndex[i] * (j + 1)) /
-                     6 - 1;
-
-        if (sp >= ep) continue;
-
-        std::sort(scan->cloudSmoothness_.begin() + sp,
-                  scan->cloudSmoothness_.begin() + ep, byValue());
-
-        int largestPickedNum = 0;
-        for (int k = ep; k >= sp; k--) {
-          int ind = scan->cloudSmoothness_[k].ind;
-          if (scan->cloudNeighborPicked_[ind] == 0 &&
-              scan->cloudCurvature_[ind] > EDGE_THRESHOLD &&
-              segInfo->segmentedCloudGroundFlag[ind] == false) {
-            largestPickedNum++;
-            if (largestPickedNum <= 2) {
-              scan->cloudLabel_[ind] = 2;
-              scan->cornerPointsSharp_->push_back(
-                  scan->undistPointCloud_->points[ind]);
-              scan->cornerPointsLessSharp_->push_back(
-                  scan->undistPointCloud_->points[ind]);
-            } else if (largestPickedNum <= 20) {
-              scan->cloudLabel_[ind] = 1;
-              scan->cornerPointsLessSharp_->push_back(
-                  scan->undistPointCloud_->points[ind]);
-            } else {
-              break;
-            }
-
-            scan->cloudNeighborPicked_[ind] = 1;
-            for (int l = 1; l <= 5; l++) {
-              int columnDiff =
-                  std::abs(int(segInfo->segmentedCloudColInd[ind + l] -
-                               segInfo->segmentedCloudColInd[ind + l - 1]));
-              if (columnDiff > 10) break;
-              scan->cloudNeighborPicked_[ind + l] = 1;
-            }
-            for (int l = -1; l >= -5; l--) {
-              int columnDiff =
-                  std::abs(int(segInfo->segmentedCloudColInd[ind + l] -
-                               segInfo->segmentedCloudColInd[ind + l + 1]));
-              if (columnDiff > 10) break;
-              scan->cloudNeighborPicked_[ind + l] = 1;
-            }
-          }
-        }
-
-        int smallestPickedNum = 0;
-        for (int k = sp; k <= ep; k++) {
-          int ind = scan->cloudSmoothness_[k].ind;
-          if (scan->cloudNeighborPicked_[ind] == 0 &&
-              scan->cloudCurvature_[ind] < SURF_THRESHOLD &&
-              segInfo->segmentedCloudGroundFlag[ind] == true) {
-            scan->cloudLabel_[ind] = -1;
-            scan->surfPointsFlat_->push_back(
-                scan->undistPointCloud_->points[ind]);
-            smallestPickedNum++;
-            if (smallestPickedNum >= 4) {
-              break;
-            }
-
-            scan->cloudNeighborPicked_[ind] = 1;
-            for (int l = 1; l <= 5; l++) {
-              int columnDiff =
-                  std::abs(int(segInfo->segmentedCloudColInd[ind + l] -
-                               segInfo->segmentedCloudColInd[ind + l - 1]));
-              if (columnDiff > 10) break;
-
-              scan->cloudNeighborPicked_[ind + l] = 1;
-            }
-            for (int l = -1; l >= -5; l--) {
-              int columnDiff =
-                  std::abs(int(segInfo->segmentedCloudColInd[ind + l] -
-                               segInfo->segmentedCloudColInd[ind + l + 1]));
-              if (columnDiff > 10) break;
-
-              scan->cloudNeighborPicked_[ind + l] = 1;
-            }
-          }
-        }
-
-        for (int k = sp; k <= ep; k++) {
-          if (scan->cloudLabel_[k] <= 0) {
-            surfPointsLessFlatScan->push_back(
-                scan->undistPointCloud_->points[k]);
-          }
-        }
-      }
-      surfPointsLessFlatScanDS->clear();
-      downSizeFilter_.setInputCloud(surfPointsLessFlatScan);
-      downSizeFilter_.filter(*surfPointsLessFlatScanDS);
-      *(scan->surfPointsLessFlat_) += *surfPointsLessFlatScanDS;
-    }
+    ringStart_.assign(segInfo->startRingIndex.begin(),
+                      segInfo->startRingIndex.begin() + LINE_NUM);
+    ringEnd_.assign(segInfo->endRingIndex.begin(),
+                    segInfo->endRingIndex.begin() + LINE_NUM);
+
+    // neighbors are not marked across a gap of more than 10 columns, ground
+    // points are only flat candidates and the others only edge candidates
+    featureExtractor_.extract(
+        *(scan->undistPointCloud_), ringStart_, ringEnd_,
+        [&segInfo](int i, int j) {
+          return std::abs(int(segInfo->segmentedCloudColInd[i] -
+                              segInfo->segmentedCloudColInd[j])) > 10;
+        },
+        [this, &segInfo](int i) {
+          return featureExtractor_.curvature(i) > EDGE_THRESHOLD &&
+                 segInfo->segmentedCloudGroundFlag[i] == false;
+        },
+        [this, &segInfo](int i) {
+          return featureExtractor_.curvature(i) < SURF_THRESHOLD &&
+                 segInfo->segmentedCloudGroundFlag[i] == true;
+        },
+        features_);
+
+    scan->cornerPointsSharp_->swap(features_.cornerPointsSharp);
+    scan->cornerPointsLessSharp_->swap(features_.cornerPointsLessSharp);
+    scan->surfPointsFlat_->swap(features_.surfPointsFlat);
+    scan->surfPointsLessFlat_->swap(features_.surfPointsLessFlat);
   }
 
   void findCorrespondingSurfFeatures(
@@ -831,19 +756,27 @@ class StateEstimator {
       pcl::PointCloud<PointType>::Ptr keypoints,
       pcl::PointCloud<PointType>::Ptr jacobianCoff, int iterCount) {
     int surfPointsFlatNum = newScan->surfPointsFlat_->points.size();
-
+    const pcl::PointCloud<PointType>::Ptr& laserCloudSurfLast =
+        lastScan->surfPointsLessFlat_;
+
+    // Features are matched in parallel into one output slot each and gathered
+    // in order below, so the result does not depend on the number of threads.
+    // The tripod indices are cached for the iterations without a search.
+    surfCoeffs_.resize(surfPointsFlatNum);
+    hasSurfCoeff_.assign(surfPointsFlatNum, 0);
+    std::vector<int> pointSearchInd;
+    std::vector<float> pointSearchSqDis;
+
+    deskewTable_.setMotion(linState_.qbn_, linState_.rn_, SCAN_PERIOD,
+                           loam::DeskewTable<PointType>::START);
+    deskewTable_.apply(*(newScan->surfPointsFlat_), surfPointsSel_);
+
+#pragma omp parallel for schedule(static) private(pointSearchInd, pointSearchSqDis)
     for (int i = 0; i < surfPointsFlatNum; i++) {
-      PointType pointSel;
+      const PointType& pointSel = surfPointsSel_.points[i];
       PointType coeff, tripod1, tripod2, tripod3;
 
-      transformToStart(&newScan->surfPointsFlat_->points[i], &pointSel);
-
-      pcl::PointCloud<PointType>::Ptr laserCloudSurfLast =
-          lastScan->surfPointsLessFlat_;
-
       if (iterCount % ICP_FREQ == 0) {
-        std::vector<int> pointSearchInd;
-        std::vector<float> pointSearchSqDis;
         kdtreeSurf_->nearestKSearch(pointSel, 1, pointSearchInd,
                                     pointSearchSqDis);
         int closestPointInd = -1, minPointInd2 = -1, minPointInd3 = -1;
@@ -945,11 +878,18 @@ class StateEstimator {
           coeff.z = s * jacxyz(2);
           coeff.intensity = s * res;
 
-          keypoints->push_back(newScan->surfPointsFlat_->points[i]);
-          jacobianCoff->push_back(coeff);
+          surfCoeffs_[i] = coeff;
+          hasSurfCoeff_[i] = 1;
         }
       }
     }
+
+    for (int i = 0; i < surfPointsFlatNum; i++) {
+      if (hasSurfCoeff_[i]) {
+        keypoints->push_back(newScan->surfPointsFlat_->points[i]);
+        jacobianCoff->push_back(surfCoeffs_[i]);
+      }
+    }
   }
 
   void findCorrespondingCornerFeatures(
@@ -957,19 +897,25 @@ class StateEstimator {
       pcl::PointCloud<PointType>::Ptr keypoints,
       pcl::PointCloud<PointType>::Ptr jacobianCoff, int iterCount) {
     int cornerPointsSharpNum = newScan->cornerPointsSharp_->points.size();
+    const pcl::PointCloud<PointType>::Ptr& laserCloudCornerLast =
+        lastScan->cornerPointsLessSharp_;
 
-    for (int i = 0; i < cornerPointsSharpNum; i++) {
-      PointType pointSel;
-      PointType coeff, tripod1, tripod2;
+    // Same output slots and cached indices as the surf features
+    cornerCoeffs_.resize(cornerPointsSharpNum);
+    hasCornerCoeff_.assign(cornerPointsSharpNum, 0);
+    std::vector<int> pointSearchInd;
+    std::vector<float> pointSearchSqDis;
 
-      transformToStart(&newScan->cornerPointsSharp_->points[i], &pointSel);
+    deskewTable_.setMotion(linState_.qbn_, linState_.rn_, SCAN_PERIOD,
+                           loam::DeskewTable<PointType>::START);
+    deskewTable_.apply(*(newScan->cornerPointsSharp_), cornerPointsSel_);
 
-      pcl::PointCloud<PointType>::Ptr laserCloudCornerLast =
-          lastScan->cornerPointsLessSharp_;
+#pragma omp parallel for schedule(static) private(pointSearchInd, pointSearchSqDis)
+    for (int i = 0; i < cornerPointsSharpNum; i++) {
+      const PointType& pointSel = cornerPointsSel_.points[i];
+      PointType coeff, tripod1, tripod2;
 
       if (iterCount % ICP_FREQ == 0) {
-        std::vector<int> pointSearchInd;
-        std::vector<float> pointSearchSqDis;
         kdtreeCorner_->nearestKSearch(pointSel, 1, pointSearchInd,
                                       pointSearchSqDis);
         int closestPointInd = -1, minPointInd2 = -1;
@@ -1055,62 +1001,34 @@ class StateEstimator {
           coeff.z = s * jacxyz(2);
           coeff.intensity = s * res;
 
-          keypoints->push_back(newScan->cornerPointsSharp_->points[i]);
-          jacobianCoff->push_back(coeff);
+          cornerCoeffs_[i] = coeff;
+          hasCornerCoeff_[i] = 1;
         }
       }
     }
-  }
-
-  // Undistort point cloud to the start frame
-  void transformToStart(PointType const* const pi, PointType* const po) {
-    double s = (1.f / SCAN_PERIOD) * (pi->intensity - int(pi->intensity));
-
-    V3D P2xyz(pi->x, pi->y, pi->z);
-    V3D phi = Quat2axis(linState_.qbn_);
-    Q4D R21xyz = axis2Quat(s * phi);
-    R21xyz.normalized();
-    V3D T112xyz = s * linState_.rn_;
-    V3D P1xyz = R21xyz * P2xyz + T112xyz;
-
-    po->x = P1xyz.x();
-    po->y = P1xyz.y();
-    po->z = P1xyz.z();
-    po->intensity = pi->intensity;
-  }
 
-  // Undistort point cloud to the end frame
-  void transformToEnd(PointType const* const pi, PointType* const po) {
-    double s = (1.f / SCAN_PERIOD) * (pi->intensity - int(pi->intensity));
-
-    V3D P2xyz(pi->x, pi->y, pi->z);
-    V3D phi = Quat2axis(linState_.qbn_);
-    Q4D R21xyz = axis2Quat(s * phi);
-    R21xyz.normalized();
-    V3D T112xyz = s * linState_.rn_;
-    V3D P1xyz = R21xyz * P2xyz + T112xyz;
-
-    R21xyz = linState_.qbn_;
-    T112xyz = linState_.rn_;
-    P2xyz = R21xyz.inverse() * (P1xyz - T112xyz);
-
-    po->x = P2xyz.x();
-    po->y = P2xyz.y();
-    po->z = P2xyz.z();
-    po->intensity = pi->intensity;
+    for (int i = 0; i < cornerPointsSharpNum; i++) {
+      if (hasCornerCoeff_[i]) {
+        keypoints->push_back(newScan->cornerPointsSharp_->points[i]);
+        jacobianCoff->push_back(cornerCoeffs_[i]);
+      }
+    }
   }
 
   // Coordinate transformation from LiDAR frame to Vehicle frame
-  void rotatePoint(PointType const* const pi, PointType* const po) {
+  static Eigen::Matrix4f lidarToVehicle() {
     V3D rpy;
     rpy << deg2rad(0.0), deg2rad(0.0), deg2rad(IMU_LIDAR_EXTRINSIC_ANGLE);
-    M3D R = rpy2R(rpy);
-    V3D Pi(pi->x, pi->y, pi->z);
-    V3D Po = R * Pi;
-    po->x = Po.x();
-    po->y = Po.y();
-    po->z = Po.z();
-    po->intensity = pi->intensity;
+    Eigen::Matrix4f T = Eigen::Matrix4f::Identity();
+    T.block<3, 3>(0, 0) = rpy2R(rpy).cast<float>();
+    return T;
+  }
+
+  // Permutation from XYZ-convention to YZX-convention
+  static Eigen::Matrix4f xyzToYzx() {
+    Eigen::Matrix4f T = Eigen::Matrix4f::Zero();
+    T(0, 1) = T(1, 2) = T(2, 0) = T(3, 3) = 1.0f;
+    return T;
   }
 
   void updatePointCloud() {
@@ -1118,34 +1036,22 @@ class StateEstimator {
     scan_new_->surfPointsLessFlatYZX_->clear();
     scan_new_->outlierPointCloudYZX_->clear();
 
-    PointType point;
-    for (int i = 0; i < scan_new_->cornerPointsLessSharp_->points.size(); i++) {
-      transformToEnd(&scan_new_->cornerPointsLessSharp_->points[i],
-                     &scan_new_->cornerPointsLessSharp_->points[i]);
-      point.x = scan_new_->cornerPointsLessSharp_->points[i].y;
-      point.y = scan_new_->cornerPointsLessSharp_->points[i].z;
-      point.z = scan_new_->cornerPointsLessSharp_->points[i].x;
-      point.intensity = scan_new_->cornerPointsLessSharp_->points[i].intensity;
-      scan_new_->cornerPointsLessSharpYZX_->push_back(point);
-    }
-    for (int i = 0; i < scan_new_->surfPointsLessFlat_->points.size(); i++) {
-      transformToEnd(&scan_new_->surfPointsLessFlat_->points[i],
-                     &scan_new_->surfPointsLessFlat_->points[i]);
-      point.x = scan_new_->surfPointsLessFlat_->points[i].y;
-      point.y = scan_new_->surfPointsLessFlat_->points[i].z;
-      point.z = scan_new_->surfPointsLessFlat_->points[i].x;
-      point.intensity = scan_new_->surfPointsLessFlat_->points[i].intensity;
-      scan_new_->surfPointsLessFlatYZX_->push_back(point);
-    }
-    for (int i = 0; i < scan_new_->outlierPointCloud_->points.size(); i++) {
-      // transformToEnd(&scan_new_->outlierPointCloud_->points[i],
-      //                &scan_new_->outlierPointCloud_->points[i]);
-      point.x = scan_new_->outlierPointCloud_->points[i].y;
-      point.y = scan_new_->outlierPointCloud_->points[i].z;
-      point.z = scan_new_->outlierPointCloud_->points[i].x;
-      point.intensity = scan_new_->outlierPointCloud_->points[i].intensity;
-      scan_new_->outlierPointCloudYZX_->push_back(point);
-    }
+    deskewTable_.setMotion(linState_.qbn_, linState_.rn_, SCAN_PERIOD,
+                           loam::DeskewTable<PointType>::END);
+    deskewTable_.apply(*(scan_new_->cornerPointsLessSharp_),
+                       *(scan_new_->cornerPointsLessSharp_));
+    deskewTable_.apply(*(scan_new_->surfPointsLessFlat_),
+                       *(scan_new_->surfPointsLessFlat_));
+
+    // The feature clouds are moved to YZX-convention for the mapping module
+    CloudAssembler<PointType> yzxAssembler;
+    yzxAssembler.add(scan_new_->cornerPointsLessSharp_, xyzToYzx());
+    yzxAssembler.assemble(*(scan_new_->cornerPointsLessSharpYZX_));
+    yzxAssembler.add(scan_new_->surfPointsLessFlat_, xyzToYzx());
+    yzxAssembler.assemble(*(scan_new_->surfPointsLessFlatYZX_));
+    // transformToEnd is not applied to the outliers
+    yzxAssembler.add(scan_new_->outlierPointCloud_, xyzToYzx());
+    yzxAssembler.assemble(*(scan_new_->outlierPointCloudYZX_));
 
     // Transform XYZ-convention to YZX-convention to meet the mapping module's
     // requirement
@@ -1326,11 +1232,14 @@ class StateEstimator {
 
     solveGyroscopeBias(q, bw);
 
+    // The deltas for the calibrated gyroscope bias
+    V3D dp, dv;
+    Q4D dq;
+    correctPreintegration(ba, bw, dp, dq, dv);
+
     double sum_dt = preintegration_->sum_dt;
-    v0 =
-        (p - 0.5 * linState_.gn_ * sum_dt * sum_dt - preintegration_->delta_p) /
-        sum_dt;
-    v1 = v0 + sum_dt * linState_.gn_ + preintegration_->delta_v;
+    v0 = (p - 0.5 * linState_.gn_ * sum_dt * sum_dt - dp) / sum_dt;
+    v1 = v0 + sum_dt * linState_.gn_ + dv;
 
     cout << "v0: " << v0.transpose() << endl;
     cout << "v1: " << v1.transpose() << endl;
@@ -1359,10 +1268,13 @@ class StateEstimator {
     JTb.setZero();
     x.setZero();
 
+    V3D dp, dv;
+    Q4D dq;
+    correctPreintegration(INIT_BA, INIT_BW, dp, dq, dv);
+
     double sum_dt = preintegration_->sum_dt;
-    b.block<3, 1>(0, 0) =
-        (p - preintegration_->delta_p) / sum_dt - 0.5 * sum_dt * linState_.gn_;
-    b.block<3, 1>(3, 0) = sum_dt * linState_.gn_ + preintegration_->delta_v;
+    b.block<3, 1>(0, 0) = (p - dp) / sum_dt - 0.5 * sum_dt * linState_.gn_;
+    b.block<3, 1>(3, 0) = sum_dt * linState_.gn_ + dv;
 
     V3D L(1, 0, 0);
     J.block<3, 1>(0, 0) = L;
@@ -1381,19 +1293,22 @@ class StateEstimator {
     ba = INIT_BA;
     bw = INIT_BW;
 
-    V3D test_ba = linState_.gn_ + preintegration_->delta_v / sum_dt;
+    V3D test_ba = linState_.gn_ + dv / sum_dt;
     cout << "test_ba: " << test_ba.transpose() << endl;
   }
 
   void estimateInitialState3(const V3D& p, const Q4D& q, V3D& v0, V3D& v1,
                              V3D& ba, V3D& bw) {
+    V3D dp, dv;
+    Q4D dq;
+    correctPreintegration(INIT_BA, INIT_BW, dp, dq, dv);
+
     double sum_dt = preintegration_->sum_dt;
     V3D v = p / sum_dt;
     // v * sum_dt = (p - 0.5*linState_.gn_*sum_dt*sum_dt -
-    // preintegration_->delta_p + 0.5*ba*sum_dt*sum_dt);
-    ba = (v * sum_dt - p + 0.5 * linState_.gn_ * sum_dt * sum_dt +
-          preintegration_->delta_p) *
-         2 * (1.0 / sum_dt * sum_dt);
+    // dp + 0.5*ba*sum_dt*sum_dt);
+    ba = (v * sum_dt - p + 0.5 * linState_.gn_ * sum_dt * sum_dt + dp) * 2 *
+         (1.0 / sum_dt * sum_dt);
 
     solveGyroscopeBias(q, bw);
 
@@ -1418,7 +1333,20 @@ class StateEstimator {
     bw = INIT_BW;
   }
 
-  // Estimate gyroscope bias using a similar methoed provided in VINS-Mono
+  // Preintegrated deltas for the biases ba and bw, corrected to first order
+  // from the linearization point of the preintegration. A larger bias change
+  // re-propagates the IMU measurements, which moves the linearization point
+  void correctPreintegration(const V3D& ba, const V3D& bw, V3D& dp, Q4D& dq,
+                             V3D& dv) {
+    if (preintegration_->correctForBias(ba, bw, dp, dq, dv)) {
+      ROS_INFO_STREAM("IMU preintegration re-propagated for ba "
+                      << ba.transpose() << ", bw " << bw.transpose());
+    }
+  }
+
+  // Estimate gyroscope bias using a similar methoed provided in VINS-Mono.
+  // The correction is solved from the linearization point of the
+  // preintegration, which bw must be
   void solveGyroscopeBias(const Q4D& q, V3D& bw) {
     Matrix3d A;
     V3D b;
@@ -1457,12 +1385,23 @@ class StateEstimator {
 
   // !@Feature matching relatives
   std::vector<int> pointSelCornerInd;
-  std::vector<double> pointSearchCornerInd1;
-  std::vector<double> pointSearchCornerInd2;
+  std::vector<int> pointSearchCornerInd1;
+  std::vector<int> pointSearchCornerInd2;
   std::vector<int> pointSelSurfInd;
-  std::vector<double> pointSearchSurfInd1;
-  std::vector<double> pointSearchSurfInd2;
-  std::vector<double> pointSearchSurfInd3;
+  std::vector<int> pointSearchSurfInd1;
+  std::vector<int> pointSearchSurfInd2;
+  std::vector<int> pointSearchSurfInd3;
+
+  // !@Per-feature output slots of the parallel correspondence search
+  std::vector<PointType> cornerCoeffs_;
+  std::vector<char> hasCornerCoeff_;
+  std::vector<PointType> surfCoeffs_;
+  std::vector<char> hasSurfCoeff_;
+
+  // !@Deskew of the features, and those of the new scan at its start
+  loam::DeskewTable<PointType> deskewTable_;
+  pcl::PointCloud<PointType> cornerPointsSel_;
+  pcl::PointCloud<PointType> surfPointsSel_;
 
   // !@Jacobians and keypoints
   pcl::PointCloud<PointType>::Ptr keypoints_;
@@ -1486,18 +1425,24 @@ class StateEstimator {
   MXD Gk_;
   MXD Pk_;
   MXD Qk_;
-  MXD Rk_;
-  MXD Hk_;
   MXD Jk_;
-  MXD Kk_;
   MXD IKH_;
-  MXD Py_;
-  MXD Pyinv_;
+  // !@Information-form update: H^T * R^-1 * H, H^T * R^-1 * r and
+  // (H^T * R^-1 * H + P^-1)^-1
+  Eigen::Matrix<double, GlobalState::DIM_OF_STATE_, GlobalState::DIM_OF_STATE_>
+      HtRinvH_;
+  Eigen::Matrix<double, GlobalState::DIM_OF_STATE_, 1> HtRinvr_;
+  Eigen::Matrix<double, GlobalState::DIM_OF_STATE_, GlobalState::DIM_OF_STATE_>
+      PkInfoInv_;
 
   // !@ IMU preintegration
   integration::IntegrationBase* preintegration_;
   Imu imu_last_;
 
+  // !@ Decimation of the IMU samples of the prediction
+  ImuDecimator imuDecimator_;
+  ImuIncrement imuIncrement_;
+
   // !@Rotation matrices between XYZ-convention and YZX-convention
   Eigen::Matrix3d R_yzx_to_xyz;
   Eigen::Matrix3d R_xyz_to_yzx;
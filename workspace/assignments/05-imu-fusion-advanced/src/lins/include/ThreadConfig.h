@@ -0,0 +1,150 @@
+// This file is part of LINS.
+//
+// Copyright (C) 2020 Chao Qin <cscharlesqin@gmail.com>,
+// Robotics and Multiperception Lab (RAM-LAB <https://ram-lab.com>),
+// The Hong Kong University of Science and Technology
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+
+#ifndef INCLUDE_THREADCONFIG_H_
+#define INCLUDE_THREADCONFIG_H_
+
+#include <pthread.h>
+#include <ros/ros.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// CPU affinity and scheduling class of the calling thread, and memory locking
+// of the whole process, as the main loops of the lidar_localization flow nodes
+// get from their thread_config.yaml. Each failed setting only logs a warning,
+// e.g. without CAP_SYS_NICE, and the thread keeps the default scheduling.
+class ThreadConfig {
+ public:
+  ThreadConfig(const std::string& name, const std::vector<int>& cpus,
+               const std::string& schedPolicy, int priority, bool lockMemory)
+      : name_(name),
+        cpus_(cpus),
+        schedPolicy_(schedPolicy.empty() ? "other" : schedPolicy),
+        priority_(priority),
+        lockMemory_(lockMemory) {}
+
+  bool apply() const {
+    bool applied = setAffinity();
+    applied = setScheduler() && applied;
+    applied = lockMemory() && applied;
+    return applied;
+  }
+
+ private:
+  bool setAffinity() const {
+    if (cpus_.empty()) return true;
+
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (int cpu : cpus_) CPU_SET(cpu, &cpuSet);
+
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet);
+    if (error != 0) {
+      ROS_WARN_STREAM("Failed to pin " << name_ << ": " << std::strerror(error));
+      return false;
+    }
+    return true;
+  }
+
+  bool setScheduler() const {
+    int policy;
+    if (schedPolicy_ == "other") {
+      return true;
+    } else if (schedPolicy_ == "fifo") {
+      policy = SCHED_FIFO;
+    } else if (schedPolicy_ == "rr") {
+      policy = SCHED_RR;
+    } else {
+      ROS_ERROR_STREAM("Unknown scheduling policy " << schedPolicy_);
+      return false;
+    }
+
+    sched_param param;
+    param.sched_priority = priority_;
+    int error = pthread_setschedparam(pthread_self(), policy, &param);
+    if (error != 0) {
+      ROS_WARN_STREAM("Failed to set scheduling policy "
+                      << schedPolicy_ << ", priority " << priority_ << " of "
+                      << name_ << ": " << std::strerror(error));
+      return false;
+    }
+    return true;
+  }
+
+  bool lockMemory() const {
+    if (!lockMemory_) return true;
+
+    // Pages mapped later on, e.g. by new clouds, are locked too
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      ROS_WARN_STREAM("Failed to lock memory of " << name_ << ": "
+                                                  << std::strerror(errno));
+      return false;
+    }
+    return true;
+  }
+
+  std::string name_;
+  std::vector<int> cpus_;
+  std::string schedPolicy_;
+  int priority_;
+  bool lockMemory_;
+};
+
+// Wake-up jitter of an event-driven loop: how late each iteration starts after
+// the wall time it was due, e.g. the arrival of the oldest measurement it
+// drains. Mean and max are logged every reportNum iterations.
+class JitterMonitor {
+ public:
+  JitterMonitor(const std::string& name, bool enabled, int reportNum = 1000)
+      : name_(name),
+        enabled_(enabled),
+        reportNum_(reportNum),
+        counter_(0),
+        sum_(0.0),
+        max_(0.0) {}
+
+  void tick(double dueTime) {
+    if (!enabled_) return;
+
+    double jitter = std::max(ros::WallTime::now().toSec() - dueTime, 0.0);
+    sum_ += jitter;
+    max_ = std::max(max_, jitter);
+    if (++counter_ < reportNum_) return;
+
+    ROS_INFO_STREAM(name_ << " loop jitter: mean " << 1000.0 * sum_ / counter_
+                          << " ms, max " << 1000.0 * max_ << " ms");
+    counter_ = 0;
+    sum_ = 0.0;
+    max_ = 0.0;
+  }
+
+ private:
+  std::string name_;
+  bool enabled_;
+  int reportNum_;
+  int counter_;
+  double sum_;
+  double max_;
+};
+
+#endif  // INCLUDE_THREADCONFIG_H_
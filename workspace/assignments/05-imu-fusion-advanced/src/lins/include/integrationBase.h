@@ -29,6 +29,11 @@ const double GYR_N = 1e-4;
 const double ACC_W = 1e-8;
 const double GYR_W = 1e-8;
 
+// bias changes beyond which the first-order correction is replaced by
+// re-propagating the buffered measurements
+const double BA_REPROPAGATE_THRESHOLD = 0.1;
+const double BG_REPROPAGATE_THRESHOLD = 0.01;
+
 class IntegrationBase {
  public:
   IntegrationBase() = delete;
@@ -187,6 +192,56 @@ class IntegrationBase {
     gyr_0 = gyr_1;
   }
 
+  // integrate the buffered measurements again against the biases ba and bg,
+  // which become the new linearization point
+  void repropagate(const Eigen::Vector3d &_linearized_ba,
+                   const Eigen::Vector3d &_linearized_bg) {
+    sum_dt = 0.0;
+    acc_0 = linearized_acc;
+    gyr_0 = linearized_gyr;
+    delta_p.setZero();
+    delta_q.setIdentity();
+    delta_v.setZero();
+    linearized_ba = _linearized_ba;
+    linearized_bg = _linearized_bg;
+    jacobian.setIdentity();
+    covariance.setZero();
+    for (size_t i = 0; i < dt_buf.size(); ++i)
+      propagate(dt_buf[i], acc_buf[i], gyr_buf[i]);
+  }
+
+  // delta p, q and v for the biases ba and bg, updated to first order with
+  // the bias blocks of the jacobian kept by midPointIntegration. a bias change
+  // beyond the thresholds re-propagates instead, returns true in that case
+  bool correctForBias(const Eigen::Vector3d &ba, const Eigen::Vector3d &bg,
+                      Eigen::Vector3d &corrected_delta_p,
+                      Eigen::Quaterniond &corrected_delta_q,
+                      Eigen::Vector3d &corrected_delta_v) {
+    Vector3d dba = ba - linearized_ba;
+    Vector3d dbg = bg - linearized_bg;
+
+    bool isRepropagated = false;
+    if (dba.norm() > BA_REPROPAGATE_THRESHOLD ||
+        dbg.norm() > BG_REPROPAGATE_THRESHOLD) {
+      repropagate(ba, bg);
+      dba.setZero();
+      dbg.setZero();
+      isRepropagated = true;
+    }
+
+    Matrix3d dp_dba = jacobian.block<3, 3>(GlobalState::pos_, GlobalState::acc_);
+    Matrix3d dp_dbg = jacobian.block<3, 3>(GlobalState::pos_, GlobalState::gyr_);
+    Matrix3d dq_dbg = jacobian.block<3, 3>(GlobalState::att_, GlobalState::gyr_);
+    Matrix3d dv_dba = jacobian.block<3, 3>(GlobalState::vel_, GlobalState::acc_);
+    Matrix3d dv_dbg = jacobian.block<3, 3>(GlobalState::vel_, GlobalState::gyr_);
+
+    corrected_delta_p = delta_p + dp_dba * dba + dp_dbg * dbg;
+    corrected_delta_q = (delta_q * math_utils::deltaQ(dq_dbg * dbg)).normalized();
+    corrected_delta_v = delta_v + dv_dba * dba + dv_dbg * dbg;
+
+    return isRepropagated;
+  }
+
   void setBa(const Eigen::Vector3d &ba) { linearized_ba = ba; }
 
   void setBg(const Eigen::Vector3d &bg) { linearized_bg = bg; }
@@ -113,6 +113,7 @@ extern double IMU_MISALIGN_ANGLE;
 extern int LINE_NUM;
 extern int SCAN_NUM;
 extern double SCAN_PERIOD;
+extern int USE_RING_FIELD;
 extern double EDGE_THRESHOLD;
 extern double SURF_THRESHOLD;
 extern double NEAREST_FEATURE_SEARCH_SQ_DIST;
@@ -125,6 +126,24 @@ extern int NUM_ITER;
 extern double LIDAR_SCALE;
 extern double LIDAR_STD;
 
+// !@KEY_FRAME_STORE
+extern double KEYFRAME_RAM_BUDGET;
+extern std::string KEYFRAME_STORE_DIR;
+extern double KEYFRAME_COMPACT_RESOLUTION;
+
+// !@ISAM2
+extern double ISAM_UPDATE_ERROR_RATIO;
+
+// !@TRANSFORM_FUSION
+extern int POSE_BUFFER_SIZE;
+
+// !@THREAD_CONFIG
+extern std::vector<int> FUSION_CPUS;
+extern std::string FUSION_SCHED_POLICY;
+extern int FUSION_PRIORITY;
+extern int FUSION_LOCK_MEMORY;
+extern int FUSION_MEASURE_JITTER;
+
 // !@SUB_TOPIC_NAME
 extern std::string IMU_TOPIC;
 extern std::string LIDAR_TOPIC;
@@ -143,6 +162,8 @@ extern V3D INIT_VEL_STD;
 extern V3D INIT_ATT_STD;
 extern V3D INIT_ACC_STD;
 extern V3D INIT_GYR_STD;
+extern int COV_PROPAGATION_INTERVAL;
+extern double IMU_DECIMATION_RATE;
 
 // !@INITIAL IMU BIASES
 extern V3D INIT_BA;
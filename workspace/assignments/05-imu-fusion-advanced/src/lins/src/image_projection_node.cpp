@@ -69,13 +69,26 @@ class ImageProjection {
   cloud_msgs::cloud_info segMsg;
   std_msgs::Header cloudHeader;
 
-  std::vector<std::pair<uint8_t, uint8_t> > neighborIterator;
-
-  uint16_t* allPushedIndX;
-  uint16_t* allPushedIndY;
-
-  uint16_t* queueIndX;
-  uint16_t* queueIndY;
+  // !@RowTable
+  // tangents of the lower boundaries of the rows, rowTangent[LINE_NUM] is the
+  // upper boundary of the top row
+  std::vector<float> rowTangent;
+  float rowLowerTangent;
+
+  // !@RingField
+  // rows read from the ring field, in the order of laserCloudIn
+  std::vector<int> ringRow;
+
+  // !@Segmentation
+  std::vector<int> segmentParent;
+  std::vector<int> segmentSize;
+  std::vector<int> segmentLineCount;
+  std::vector<int> segmentLastRow;
+  std::vector<int> segmentLabel;
+  std::vector<uint8_t> neighborConnected;
+  float segmentTanTheta;
+  float sinAlphaX, cosAlphaX;
+  float sinAlphaY, cosAlphaY;
 
  public:
   ImageProjection(ros::NodeHandle& nh, ros::NodeHandle& pnh)
@@ -129,25 +142,30 @@ class ImageProjection {
     segMsg.segmentedCloudColInd.assign(LINE_NUM * SCAN_NUM, 0);
     segMsg.segmentedCloudRange.assign(LINE_NUM * SCAN_NUM, 0);
 
-    std::pair<int8_t, int8_t> neighbor;
-    neighbor.first = -1;
-    neighbor.second = 0;
-    neighborIterator.push_back(neighbor);
-    neighbor.first = 0;
-    neighbor.second = 1;
-    neighborIterator.push_back(neighbor);
-    neighbor.first = 0;
-    neighbor.second = -1;
-    neighborIterator.push_back(neighbor);
-    neighbor.first = 1;
-    neighbor.second = 0;
-    neighborIterator.push_back(neighbor);
-
-    allPushedIndX = new uint16_t[LINE_NUM * SCAN_NUM];
-    allPushedIndY = new uint16_t[LINE_NUM * SCAN_NUM];
-
-    queueIndX = new uint16_t[LINE_NUM * SCAN_NUM];
-    queueIndY = new uint16_t[LINE_NUM * SCAN_NUM];
+    // Row (verticalAngle + ang_bottom) / ang_res_y, truncated, starts where
+    // the tangent of the vertical angle passes rowTangent[row]
+    rowTangent.resize(LINE_NUM + 1);
+    for (int i = 0; i <= LINE_NUM; ++i)
+      rowTangent[i] = rowBoundaryTangent(i * ang_res_y - ang_bottom);
+    rowLowerTangent = rowBoundaryTangent(-ang_res_y - ang_bottom);
+
+    segmentParent.resize(LINE_NUM * SCAN_NUM);
+    segmentSize.resize(LINE_NUM * SCAN_NUM);
+    segmentLineCount.resize(LINE_NUM * SCAN_NUM);
+    segmentLastRow.resize(LINE_NUM * SCAN_NUM);
+    segmentLabel.resize(LINE_NUM * SCAN_NUM);
+    neighborConnected.resize(SCAN_NUM);
+
+    segmentTanTheta = tan(segmentTheta);
+    sinAlphaX = sin(segmentAlphaX);
+    cosAlphaX = cos(segmentAlphaX);
+    sinAlphaY = sin(segmentAlphaY);
+    cosAlphaY = cos(segmentAlphaY);
+  }
+
+  static float rowBoundaryTangent(float angle) {
+    angle = std::max(-89.9f, std::min(89.9f, angle));
+    return tan(angle / 180.0 * M_PI);
   }
 
   void resetParameters() {
@@ -174,6 +192,39 @@ class ImageProjection {
     pcl::fromROSMsg(*laserCloudMsg, *laserCloudIn);
     std::vector<int> indices;
     pcl::removeNaNFromPointCloud(*laserCloudIn, *laserCloudIn, indices);
+
+    ringRow.clear();
+    if (USE_RING_FIELD) readRingField(*laserCloudMsg, indices);
+  }
+
+  // Velodyne and Ouster drivers publish the beam of each point as a ring
+  // field. ring 0 is expected to be the lowest beam.
+  void readRingField(const sensor_msgs::PointCloud2& laserCloudMsg,
+                     const std::vector<int>& indices) {
+    const sensor_msgs::PointField* ringField = NULL;
+    for (size_t i = 0; i < laserCloudMsg.fields.size(); ++i)
+      if (laserCloudMsg.fields[i].name == "ring")
+        ringField = &laserCloudMsg.fields[i];
+    if (ringField == NULL ||
+        (ringField->datatype != sensor_msgs::PointField::UINT8 &&
+         ringField->datatype != sensor_msgs::PointField::UINT16)) {
+      ROS_WARN_ONCE("No uint8/uint16 ring field, rows from vertical angles.");
+      return;
+    }
+
+    ringRow.resize(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i) {
+      const uint8_t* data = &laserCloudMsg.data[indices[i] *
+                                                laserCloudMsg.point_step +
+                                                ringField->offset];
+      if (ringField->datatype == sensor_msgs::PointField::UINT8) {
+        ringRow[i] = *data;
+      } else {
+        uint16_t ring;
+        memcpy(&ring, data, sizeof(ring));
+        ringRow[i] = ring;
+      }
+    }
   }
 
   void cloudHandler(const sensor_msgs::PointCloud2ConstPtr& laserCloudMsg) {
@@ -203,22 +254,32 @@ class ImageProjection {
   }
 
   void projectPointCloud() {
-    float verticalAngle, horizonAngle, range;
+    float verticalTangent, horizonAngle, range;
     size_t rowIdn, columnIdn, index, cloudSize;
     PointType thisPoint;
 
     cloudSize = laserCloudIn->points.size();
+    bool useRingRow = ringRow.size() == cloudSize;
 
     for (size_t i = 0; i < cloudSize; ++i) {
       thisPoint.x = laserCloudIn->points[i].x;
       thisPoint.y = laserCloudIn->points[i].y;
       thisPoint.z = laserCloudIn->points[i].z;
 
-      verticalAngle = atan2(thisPoint.z, sqrt(thisPoint.x * thisPoint.x +
-                                              thisPoint.y * thisPoint.y)) *
-                      180 / M_PI;
-      rowIdn = (verticalAngle + ang_bottom) / ang_res_y;
-      if (rowIdn < 0 || rowIdn >= LINE_NUM) continue;
+      if (useRingRow) {
+        if (ringRow[i] >= LINE_NUM) continue;
+        rowIdn = ringRow[i];
+      } else {
+        verticalTangent = thisPoint.z / sqrt(thisPoint.x * thisPoint.x +
+                                             thisPoint.y * thisPoint.y);
+        if (!(verticalTangent > rowLowerTangent &&
+              verticalTangent < rowTangent[LINE_NUM]))
+          continue;
+        rowIdn = std::upper_bound(rowTangent.begin() + 1,
+                                  rowTangent.begin() + LINE_NUM,
+                                  verticalTangent) -
+                 (rowTangent.begin() + 1);
+      }
 
       horizonAngle = atan2(thisPoint.x, thisPoint.y) * 180 / M_PI;
 
@@ -287,9 +348,7 @@ class ImageProjection {
   }
 
   void cloudSegmentation() {
-    for (size_t i = 0; i < LINE_NUM; ++i)
-      for (size_t j = 0; j < SCAN_NUM; ++j)
-        if (labelMat.at<int>(i, j) == 0) labelComponents(i, j);
+    labelComponents();
 
     int sizeOfSegCloud = 0;
     for (size_t i = 0; i < LINE_NUM; ++i) {
@@ -333,84 +392,109 @@ class ImageProjection {
     }
   }
 
-  void labelComponents(int row, int col) {
-    float d1, d2, alpha, angle;
-    int fromIndX, fromIndY, thisIndX, thisIndY;
-    bool lineCountFlag[LINE_NUM] = {false};
-
-    queueIndX[0] = row;
-    queueIndY[0] = col;
-    int queueSize = 1;
-    int queueStartInd = 0;
-    int queueEndInd = 1;
-
-    allPushedIndX[0] = row;
-    allPushedIndY[0] = col;
-    int allPushedIndSize = 1;
-
-    while (queueSize > 0) {
-      fromIndX = queueIndX[queueStartInd];
-      fromIndY = queueIndY[queueStartInd];
-      --queueSize;
-      ++queueStartInd;
-      labelMat.at<int>(fromIndX, fromIndY) = labelCount;
-
-      for (auto iter = neighborIterator.begin(); iter != neighborIterator.end();
-           ++iter) {
-        thisIndX = fromIndX + (*iter).first;
-        thisIndY = fromIndY + (*iter).second;
-
-        if (thisIndX < 0 || thisIndX >= LINE_NUM) continue;
-
-        if (thisIndY < 0) thisIndY = SCAN_NUM - 1;
-        if (thisIndY >= SCAN_NUM) thisIndY = 0;
-
-        if (labelMat.at<int>(thisIndX, thisIndY) != 0) continue;
-
-        d1 = std::max(rangeMat.at<float>(fromIndX, fromIndY),
-                      rangeMat.at<float>(thisIndX, thisIndY));
-        d2 = std::min(rangeMat.at<float>(fromIndX, fromIndY),
-                      rangeMat.at<float>(thisIndX, thisIndY));
-
-        if ((*iter).first == 0)
-          alpha = segmentAlphaX;
-        else
-          alpha = segmentAlphaY;
+  // atan2(d2 * sin(alpha), d1 - d2 * cos(alpha)) > segmentTheta without the
+  // atan2, segmentTheta is below 90 degrees
+  static inline uint8_t isSameSegment(float range1, float range2,
+                                      float sinAlpha, float cosAlpha,
+                                      float tanTheta) {
+    float d1 = std::max(range1, range2);
+    float d2 = std::min(range1, range2);
+    float x = d1 - d2 * cosAlpha;
+    float y = d2 * sinAlpha;
+    return (x <= 0) | (y > tanTheta * x);
+  }
 
-        angle = atan2(d2 * sin(alpha), (d1 - d2 * cos(alpha)));
+  int findSegmentRoot(int i) {
+    while (segmentParent[i] != i) {
+      segmentParent[i] = segmentParent[segmentParent[i]];
+      i = segmentParent[i];
+    }
+    return i;
+  }
 
-        if (angle > segmentTheta) {
-          queueIndX[queueEndInd] = thisIndX;
-          queueIndY[queueEndInd] = thisIndY;
-          ++queueSize;
-          ++queueEndInd;
+  // the root is the first cell of the segment in row-major order
+  void uniteSegments(int i, int j) {
+    i = findSegmentRoot(i);
+    j = findSegmentRoot(j);
+    if (i < j)
+      segmentParent[j] = i;
+    else if (j < i)
+      segmentParent[i] = j;
+  }
 
-          labelMat.at<int>(thisIndX, thisIndY) = labelCount;
-          lineCountFlag[thisIndX] = true;
+  // Union-find over the unlabeled cells of the range image. Gives the same
+  // segments and labels as a breadth-first search started from every unlabeled
+  // cell in row-major order.
+  void labelComponents() {
+    int cellNum = LINE_NUM * SCAN_NUM;
+    int* label = labelMat.ptr<int>(0);
+    const float* range = rangeMat.ptr<float>(0);
+    for (int i = 0; i < cellNum; ++i) segmentParent[i] = i;
+
+    for (int i = 0; i < LINE_NUM; ++i) {
+      int rowStart = i * SCAN_NUM;
+
+      // horizontal neighbors, the last column wraps around to the first one
+      for (int j = 0; j < SCAN_NUM - 1; ++j)
+        neighborConnected[j] =
+            isSameSegment(range[rowStart + j], range[rowStart + j + 1],
+                          sinAlphaX, cosAlphaX, segmentTanTheta);
+      neighborConnected[SCAN_NUM - 1] =
+          isSameSegment(range[rowStart + SCAN_NUM - 1], range[rowStart],
+                        sinAlphaX, cosAlphaX, segmentTanTheta);
+      for (int j = 0; j < SCAN_NUM; ++j) {
+        int next = (j + 1 < SCAN_NUM) ? rowStart + j + 1 : rowStart;
+        if (neighborConnected[j] && label[rowStart + j] == 0 &&
+            label[next] == 0)
+          uniteSegments(rowStart + j, next);
+      }
 
-          allPushedIndX[allPushedIndSize] = thisIndX;
-          allPushedIndY[allPushedIndSize] = thisIndY;
-          ++allPushedIndSize;
-        }
+      if (i + 1 == LINE_NUM) break;
+
+      // vertical neighbors
+      for (int j = 0; j < SCAN_NUM; ++j)
+        neighborConnected[j] =
+            isSameSegment(range[rowStart + j], range[rowStart + SCAN_NUM + j],
+                          sinAlphaY, cosAlphaY, segmentTanTheta);
+      for (int j = 0; j < SCAN_NUM; ++j) {
+        if (neighborConnected[j] && label[rowStart + j] == 0 &&
+            label[rowStart + SCAN_NUM + j] == 0)
+          uniteSegments(rowStart + j, rowStart + SCAN_NUM + j);
       }
     }
 
-    bool feasibleSegment = false;
-    if (allPushedIndSize >= 30)
-      feasibleSegment = true;
-    else if (allPushedIndSize >= segmentValidPointNum) {
-      int lineCount = 0;
-      for (size_t i = 0; i < LINE_NUM; ++i)
-        if (lineCountFlag[i] == true) ++lineCount;
-      if (lineCount >= segmentValidLineNum) feasibleSegment = true;
+    // Like the search, rows are counted for the cells pushed after the first
+    // one. Cells are visited row by row, so a row is new if it differs from
+    // the last one counted.
+    for (int i = 0; i < cellNum; ++i) {
+      if (label[i] != 0) continue;
+      int root = findSegmentRoot(i);
+      if (root == i) {
+        segmentSize[root] = 1;
+        segmentLineCount[root] = 0;
+        segmentLastRow[root] = -1;
+        continue;
+      }
+      ++segmentSize[root];
+      if (segmentLastRow[root] != i / SCAN_NUM) {
+        segmentLastRow[root] = i / SCAN_NUM;
+        ++segmentLineCount[root];
+      }
     }
 
-    if (feasibleSegment == true) {
-      ++labelCount;
-    } else {
-      for (size_t i = 0; i < allPushedIndSize; ++i) {
-        labelMat.at<int>(allPushedIndX[i], allPushedIndY[i]) = 999999;
+    for (int i = 0; i < cellNum; ++i) {
+      if (label[i] != 0) continue;
+      int root = findSegmentRoot(i);
+      if (root == i) {
+        bool feasibleSegment = false;
+        if (segmentSize[root] >= 30)
+          feasibleSegment = true;
+        else if (segmentSize[root] >= segmentValidPointNum &&
+                 segmentLineCount[root] >= segmentValidLineNum)
+          feasibleSegment = true;
+        segmentLabel[root] = feasibleSegment ? labelCount++ : 999999;
       }
+      label[i] = segmentLabel[root];
     }
   }
 
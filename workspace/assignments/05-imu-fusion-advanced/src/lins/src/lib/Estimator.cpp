@@ -17,16 +17,115 @@
 
 #include <Estimator.h>
 
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
 namespace fusion {
 
 int Scan::scan_counter_ = 0;
 
+namespace {
+// point clouds between two latency reports
+const int LATENCY_REPORT_SCANS = 100;
+// a push may race with the estimation thread going to sleep, which then only
+// waits for this long
+const int MAX_WAIT_MS = 5;
+}  // namespace
+
 LinsFusion::LinsFusion(ros::NodeHandle& nh, ros::NodeHandle& pnh)
-    : nh_(nh), pnh_(pnh) {}
+    : nh_(nh),
+      pnh_(pnh),
+      estimator(nullptr),
+      stop_(false),
+      jitterMonitor_("lins_fusion_node", FUSION_MEASURE_JITTER) {}
+
+LinsFusion::~LinsFusion() {
+  stop_ = true;
+  wakeCondition_.notify_one();
+  if (estimationThread_.joinable()) estimationThread_.join();
+  delete estimator;
+}
 
-LinsFusion::~LinsFusion() { delete estimator; }
+void LinsFusion::run(const ThreadConfig& threadConfig) {
+  initialization();
+
+  // The IESKF runs on its own thread, the callbacks only queue measurements
+  estimationThread_ =
+      std::thread(&LinsFusion::runEstimation, this, threadConfig);
+}
 
-void LinsFusion::run() { initialization(); }
+void LinsFusion::runEstimation(const ThreadConfig& threadConfig) {
+  // Pinning, scheduling class and memory locking of the estimation loop
+  threadConfig.apply();
+
+  while (!stop_ && ros::ok()) {
+    {
+      std::unique_lock<std::mutex> lock(wakeMutex_);
+      wakeCondition_.wait_for(
+          lock, std::chrono::milliseconds(MAX_WAIT_MS), [this] {
+            return stop_ || !imuQueue_.empty() || !pclQueue_.empty() ||
+                   !outlierQueue_.empty() || !cloudInfoQueue_.empty();
+          });
+    }
+
+    if (drainQueues()) performStateEstimation();
+  }
+}
+
+bool LinsFusion::drainQueues() {
+  max_queue_depth_ = std::max(max_queue_depth_, imuQueue_.getSize());
+
+  // The loop was due when the oldest measurement drained arrived
+  bool hasMeas = false;
+  double dueTime = std::numeric_limits<double>::max();
+  QueuedMeas<Imu> imu;
+  while (imuQueue_.pop(imu)) {
+    imuBuf_.addMeas(imu.meas, imu.time);
+    dueTime = std::min(dueTime, imu.arrivalTime);
+    hasMeas = true;
+  }
+  QueuedMeas<sensor_msgs::PointCloud2::ConstPtr> pcl;
+  while (pclQueue_.pop(pcl)) {
+    pclBuf_.addMeas(pcl.meas, pcl.time);
+    pclArrivalBuf_.addMeas(pcl.arrivalTime, pcl.time);
+    dueTime = std::min(dueTime, pcl.arrivalTime);
+    hasMeas = true;
+  }
+  QueuedMeas<sensor_msgs::PointCloud2::ConstPtr> outlier;
+  while (outlierQueue_.pop(outlier)) {
+    outlierBuf_.addMeas(outlier.meas, outlier.time);
+    dueTime = std::min(dueTime, outlier.arrivalTime);
+    hasMeas = true;
+  }
+  QueuedMeas<cloud_msgs::cloud_infoConstPtr> cloudInfo;
+  while (cloudInfoQueue_.pop(cloudInfo)) {
+    cloudInfoBuf_.addMeas(*cloudInfo.meas, cloudInfo.time);
+    dueTime = std::min(dueTime, cloudInfo.arrivalTime);
+    hasMeas = true;
+  }
+
+  if (hasMeas) jitterMonitor_.tick(dueTime);
+  return hasMeas;
+}
+
+void LinsFusion::reportLatency(double arrivalTime) {
+  double latency = ros::WallTime::now().toSec() - arrivalTime;
+  latency_sum_ += latency;
+  latency_max_ = std::max(latency_max_, latency);
+  latency_counter_++;
+
+  if (latency_counter_ == LATENCY_REPORT_SCANS) {
+    ROS_INFO_STREAM("Callback-to-estimate latency: mean "
+                    << 1000.0 * latency_sum_ / latency_counter_ << " ms, max "
+                    << 1000.0 * latency_max_
+                    << " ms, max IMU queue depth: " << max_queue_depth_);
+    latency_counter_ = 0;
+    latency_sum_ = 0.0;
+    latency_max_ = 0.0;
+    max_queue_depth_ = 0;
+  }
+}
 
 void LinsFusion::initialization() {
   // Implement an iterative-ESKF Kalman filter class
@@ -75,6 +174,18 @@ void LinsFusion::initialization() {
   pclBuf_.allocate(3);
   outlierBuf_.allocate(3);
   cloudInfoBuf_.allocate(3);
+  pclArrivalBuf_.allocate(3);
+
+  // Allocate the queues between the callbacks and the estimation thread
+  imuQueue_.allocate(1024);
+  pclQueue_.allocate(4);
+  outlierQueue_.allocate(4);
+  cloudInfoQueue_.allocate(4);
+
+  latency_counter_ = 0;
+  latency_sum_ = 0.0;
+  latency_max_ = 0.0;
+  max_queue_depth_ = 0;
 
   // Initialize IMU propagation parameters
   isImuCalibrated = CALIBARTE_IMU;
@@ -94,17 +205,35 @@ void LinsFusion::initialization() {
 void LinsFusion::laserCloudCallback(
     const sensor_msgs::PointCloud2ConstPtr& laserCloudMsg) {
   // Add a new segmented point cloud
-  pclBuf_.addMeas(laserCloudMsg, laserCloudMsg->header.stamp.toSec());
+  QueuedMeas<sensor_msgs::PointCloud2::ConstPtr> pcl{
+      laserCloudMsg, laserCloudMsg->header.stamp.toSec(),
+      ros::WallTime::now().toSec()};
+  if (!pclQueue_.push(pcl)) {
+    ROS_WARN_THROTTLE(1.0, "Point cloud queue full, dropping a point cloud!");
+  }
+  wakeCondition_.notify_one();
 }
 void LinsFusion::laserCloudInfoCallback(
     const cloud_msgs::cloud_infoConstPtr& cloudInfoMsg) {
   // Add segmentation information of the point cloud
-  cloudInfoBuf_.addMeas(*cloudInfoMsg, cloudInfoMsg->header.stamp.toSec());
+  QueuedMeas<cloud_msgs::cloud_infoConstPtr> cloudInfo{
+      cloudInfoMsg, cloudInfoMsg->header.stamp.toSec(),
+      ros::WallTime::now().toSec()};
+  if (!cloudInfoQueue_.push(cloudInfo)) {
+    ROS_WARN_THROTTLE(1.0, "Cloud info queue full, dropping a cloud info!");
+  }
+  wakeCondition_.notify_one();
 }
 
 void LinsFusion::outlierCloudCallback(
     const sensor_msgs::PointCloud2ConstPtr& laserCloudMsg) {
-  outlierBuf_.addMeas(laserCloudMsg, laserCloudMsg->header.stamp.toSec());
+  QueuedMeas<sensor_msgs::PointCloud2::ConstPtr> outlier{
+      laserCloudMsg, laserCloudMsg->header.stamp.toSec(),
+      ros::WallTime::now().toSec()};
+  if (!outlierQueue_.push(outlier)) {
+    ROS_WARN_THROTTLE(1.0, "Outlier cloud queue full, dropping a cloud!");
+  }
+  wakeCondition_.notify_one();
 }
 
 void LinsFusion::mapOdometryCallback(
@@ -134,12 +263,15 @@ void LinsFusion::imuCallback(const sensor_msgs::Imu::ConstPtr& imuMsg) {
   alignIMUtoVehicle(misalign_euler_angles_, acc_raw_, gyr_raw_, acc_aligned_,
                     gyr_aligned_);
 
-  // Add a new IMU measurement
-  Imu imu(imuMsg->header.stamp.toSec(), acc_aligned_, gyr_aligned_);
-  imuBuf_.addMeas(imu, imuMsg->header.stamp.toSec());
-
-  // Trigger the Kalman filter
-  performStateEstimation();
+  // Add a new IMU measurement, the estimation thread triggers the Kalman
+  // filter
+  QueuedMeas<Imu> imu{
+      Imu(imuMsg->header.stamp.toSec(), acc_aligned_, gyr_aligned_),
+      imuMsg->header.stamp.toSec(), ros::WallTime::now().toSec()};
+  if (!imuQueue_.push(imu)) {
+    ROS_WARN_THROTTLE(1.0, "IMU queue full, dropping an IMU measurement!");
+  }
+  wakeCondition_.notify_one();
 }
 
 void LinsFusion::processFirstPointCloud() {
@@ -172,6 +304,7 @@ void LinsFusion::processFirstPointCloud() {
   pclBuf_.clean(estimator->getTime());
   cloudInfoBuf_.clean(estimator->getTime());
   outlierBuf_.clean(estimator->getTime());
+  pclArrivalBuf_.clean(estimator->getTime());
 }
 
 void LinsFusion::publishTopics() {
@@ -203,21 +336,21 @@ void LinsFusion::publishTopics() {
 
 bool LinsFusion::processPointClouds() {
   // Obtain the next PCL
-  pclBuf_.itMeas_ = pclBuf_.measMap_.upper_bound(estimator->getTime());
-  sensor_msgs::PointCloud2::ConstPtr pclMsg = pclBuf_.itMeas_->second;
-  scan_time_ = pclBuf_.itMeas_->first;
+  double meas_time;
+  sensor_msgs::PointCloud2::ConstPtr pclMsg;
+  sensor_msgs::PointCloud2::ConstPtr outlierMsg;
+  cloud_msgs::cloud_info cloudInfoMsg;
+  if (!pclBuf_.getNextMeas(estimator->getTime(), scan_time_, pclMsg) ||
+      !outlierBuf_.getNextMeas(estimator->getTime(), meas_time, outlierMsg) ||
+      !cloudInfoBuf_.getNextMeas(estimator->getTime(), meas_time,
+                                 cloudInfoMsg)) {
+    return false;
+  }
   distortedPointCloud->clear();
   pcl::fromROSMsg(*pclMsg, *distortedPointCloud);
-
-  outlierBuf_.itMeas_ = outlierBuf_.measMap_.upper_bound(estimator->getTime());
-  sensor_msgs::PointCloud2::ConstPtr outlierMsg = outlierBuf_.itMeas_->second;
   outlierPointCloud->clear();
   pcl::fromROSMsg(*outlierMsg, *outlierPointCloud);
 
-  cloudInfoBuf_.itMeas_ =
-      cloudInfoBuf_.measMap_.upper_bound(estimator->getTime());
-  cloud_msgs::cloud_info cloudInfoMsg = cloudInfoBuf_.itMeas_->second;
-
   imuBuf_.getLastTime(last_imu_time_);
   if (last_imu_time_ < scan_time_) {
     // ROS_WARN("Wait for more IMU measurement!");
@@ -226,16 +359,14 @@ bool LinsFusion::processPointClouds() {
 
   // Propagate IMU measurements between two consecutive scans
   int imu_couter = 0;
+  double imu_time;
+  Imu imu;
   while (estimator->getTime() < scan_time_ &&
-         (imuBuf_.itMeas_ = imuBuf_.measMap_.upper_bound(
-              estimator->getTime())) != imuBuf_.measMap_.end()) {
-    double dt =
-        std::min(imuBuf_.itMeas_->first, scan_time_) - estimator->getTime();
-    Imu imu = imuBuf_.itMeas_->second;
+         imuBuf_.getNextMeas(estimator->getTime(), imu_time, imu)) {
+    double dt = std::min(imu_time, scan_time_) - estimator->getTime();
     estimator->processImu(dt, imu.acc, imu.gyr);
   }
 
-  Imu imu;
   imuBuf_.getLastMeas(imu);
 
   // Update the iterative-ESKF using a new PCL
@@ -265,6 +396,7 @@ void LinsFusion::performStateEstimation() {
   pclBuf_.getLastTime(last_scan_time_);
   while (!pclBuf_.empty() && estimator->getTime() < last_scan_time_) {
     TicToc ts_total;
+    double last_estimate_time = estimator->getTime();
     if (!processPointClouds()) break;
     double time_total = ts_total.toc();
     duration_ = (duration_ * scan_counter_ + time_total) / (scan_counter_ + 1);
@@ -272,6 +404,15 @@ void LinsFusion::performStateEstimation() {
     // ROS_INFO_STREAM("Pure-odometry processing time: " << duration_);
     publishTopics();
 
+    // The arrival of the point cloud is found the way processPointClouds
+    // found the point cloud
+    double meas_time, arrivalTime;
+    if (pclArrivalBuf_.getNextMeas(last_estimate_time, meas_time,
+                                   arrivalTime)) {
+      reportLatency(arrivalTime);
+    }
+    pclArrivalBuf_.clean(estimator->getTime());
+
     // if (VERBOSE) {
     //   cout << "ba: " << estimator->globalState_.ba_.transpose() << endl;
     //   cout << "bw: " << estimator->globalState_.bw_.transpose() << endl;
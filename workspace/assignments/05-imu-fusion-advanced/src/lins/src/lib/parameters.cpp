@@ -32,6 +32,7 @@ double IMU_MISALIGN_ANGLE;
 int LINE_NUM;
 int SCAN_NUM;
 double SCAN_PERIOD;
+int USE_RING_FIELD;
 double EDGE_THRESHOLD;
 double SURF_THRESHOLD;
 double NEAREST_FEATURE_SEARCH_SQ_DIST;
@@ -44,6 +45,24 @@ int NUM_ITER;
 double LIDAR_SCALE;
 double LIDAR_STD;
 
+// !@KEY_FRAME_STORE
+double KEYFRAME_RAM_BUDGET;
+std::string KEYFRAME_STORE_DIR;
+double KEYFRAME_COMPACT_RESOLUTION;
+
+// !@ISAM2
+double ISAM_UPDATE_ERROR_RATIO;
+
+// !@TRANSFORM_FUSION
+int POSE_BUFFER_SIZE;
+
+// !@THREAD_CONFIG
+std::vector<int> FUSION_CPUS;
+std::string FUSION_SCHED_POLICY;
+int FUSION_PRIORITY;
+int FUSION_LOCK_MEMORY;
+int FUSION_MEASURE_JITTER;
+
 // !@SUB_TOPIC_NAME
 std::string IMU_TOPIC;
 std::string LIDAR_TOPIC;
@@ -62,6 +81,8 @@ V3D INIT_VEL_STD;
 V3D INIT_ATT_STD;
 V3D INIT_ACC_STD;
 V3D INIT_GYR_STD;
+int COV_PROPAGATION_INTERVAL;
+double IMU_DECIMATION_RATE;
 
 // !@INITIAL IMU BIASES
 V3D INIT_BA;
@@ -99,6 +120,7 @@ void readParameters(ros::NodeHandle& n) {
   LINE_NUM = fsSettings["line_num"];
   SCAN_NUM = fsSettings["scan_num"];
   SCAN_PERIOD = fsSettings["scan_period"];
+  USE_RING_FIELD = fsSettings["use_ring_field"];
   EDGE_THRESHOLD = fsSettings["edge_threshold"];
   SURF_THRESHOLD = fsSettings["surf_threshold"];
   NEAREST_FEATURE_SEARCH_SQ_DIST = fsSettings["nearest_feature_search_sq_dist"];
@@ -109,6 +131,20 @@ void readParameters(ros::NodeHandle& n) {
   LIDAR_SCALE = fsSettings["lidar_scale"];
   LIDAR_STD = fsSettings["lidar_std"];
 
+  KEYFRAME_RAM_BUDGET = fsSettings["keyframe_ram_budget"];
+  fsSettings["keyframe_store_dir"] >> KEYFRAME_STORE_DIR;
+  KEYFRAME_COMPACT_RESOLUTION = fsSettings["keyframe_compact_resolution"];
+
+  ISAM_UPDATE_ERROR_RATIO = fsSettings["isam_update_error_ratio"];
+
+  POSE_BUFFER_SIZE = fsSettings["pose_buffer_size"];
+
+  fsSettings["fusion_cpus"] >> FUSION_CPUS;
+  fsSettings["fusion_sched_policy"] >> FUSION_SCHED_POLICY;
+  FUSION_PRIORITY = fsSettings["fusion_priority"];
+  FUSION_LOCK_MEMORY = fsSettings["fusion_lock_memory"];
+  FUSION_MEASURE_JITTER = fsSettings["fusion_measure_jitter"];
+
   fsSettings["imu_topic"] >> IMU_TOPIC;
   fsSettings["lidar_topic"] >> LIDAR_TOPIC;
   fsSettings["lidar_odometry_topic"] >> LIDAR_ODOMETRY_TOPIC;
@@ -118,6 +154,8 @@ void readParameters(ros::NodeHandle& n) {
   ACC_W = fsSettings["acc_w"];
   GYR_N = fsSettings["gyr_n"];
   GYR_W = fsSettings["gyr_w"];
+  COV_PROPAGATION_INTERVAL = fsSettings["cov_propagation_interval"];
+  IMU_DECIMATION_RATE = fsSettings["imu_decimation_rate"];
 
   readV3D(&fsSettings, "init_pos_std", INIT_POS_STD);
   readV3D(&fsSettings, "init_vel_std", INIT_VEL_STD);
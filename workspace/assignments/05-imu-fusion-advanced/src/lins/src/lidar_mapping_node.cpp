@@ -34,6 +34,7 @@
 //      IEEE/RSJ International Conference on Intelligent Robots and Systems
 //      (IROS). October 2018.
 
+#include <diagnostic_msgs/DiagnosticArray.h>
 #include <gtsam/geometry/Pose3.h>
 #include <gtsam/geometry/Rot3.h>
 #include <gtsam/nonlinear/ISAM2.h>
@@ -43,6 +44,8 @@
 #include <gtsam/nonlinear/Values.h>
 #include <gtsam/slam/BetweenFactor.h>
 #include <gtsam/slam/PriorFactor.h>
+#include <CloudAssembler.h>
+#include <KeyFrameStore.h>
 #include <math_utils.h>
 #include <parameters.h>
 
@@ -88,6 +91,7 @@ class MappingHandler {
   ros::NodeHandle pnh;
 
   ros::Publisher pubLaserCloudSurround;
+  ros::Publisher pubLaserCloudSurroundDelta;
   ros::Publisher pubOdomAftMapped;
   ros::Publisher pubKeyPoses;
   ros::Publisher pubOdomXYZAftMapped;
@@ -95,6 +99,7 @@ class MappingHandler {
   ros::Publisher pubHistoryKeyFrames;
   ros::Publisher pubIcpKeyFrames;
   ros::Publisher pubRecentKeyFrames;
+  ros::Publisher pubDiagnostics;
 
   ros::Subscriber subLaserCloudCornerLast;
   ros::Subscriber subLaserCloudSurfLast;
@@ -110,9 +115,8 @@ class MappingHandler {
   nav_msgs::Odometry odomXYZAftMapped;
   tf::StampedTransform aftMappedXYZTrans;
 
-  vector<pcl::PointCloud<PointType>::Ptr> cornerCloudKeyFrames;
-  vector<pcl::PointCloud<PointType>::Ptr> surfCloudKeyFrames;
-  vector<pcl::PointCloud<PointType>::Ptr> outlierCloudKeyFrames;
+  // feature clouds of all key frames, older ones are moved to disk
+  KeyFrameStore<PointType> keyFrameStore;
 
   deque<pcl::PointCloud<PointType>::Ptr> recentCornerCloudKeyFrames;
   deque<pcl::PointCloud<PointType>::Ptr> recentSurfCloudKeyFrames;
@@ -144,11 +148,12 @@ class MappingHandler {
   pcl::PointCloud<PointType>::Ptr laserCloudSurfTotalLast;
   pcl::PointCloud<PointType>::Ptr laserCloudSurfTotalLastDS;
 
+  // One slot per downsampled corner, then surf feature. coeffSelFlag marks the
+  // slots matched in the current iteration.
   pcl::PointCloud<PointType>::Ptr laserCloudOri;
   pcl::PointCloud<PointType>::Ptr coeffSel;
+  std::vector<char> coeffSelFlag;
 
-  pcl::PointCloud<PointType>::Ptr laserCloudCornerFromMap;
-  pcl::PointCloud<PointType>::Ptr laserCloudSurfFromMap;
   pcl::PointCloud<PointType>::Ptr laserCloudCornerFromMapDS;
   pcl::PointCloud<PointType>::Ptr laserCloudSurfFromMapDS;
 
@@ -158,9 +163,13 @@ class MappingHandler {
   pcl::KdTreeFLANN<PointType>::Ptr kdtreeSurroundingKeyPoses;
   pcl::KdTreeFLANN<PointType>::Ptr kdtreeHistoryKeyPoses;
 
+  // The surrounding map and its kd-trees are kept until the set of
+  // surrounding key frames changes
+  bool surroundingKeyFramesChanged;
+  int kdtreeSurroundingKeyPosesNum;
+
   pcl::PointCloud<PointType>::Ptr nearHistoryCornerKeyFrameCloud;
   pcl::PointCloud<PointType>::Ptr nearHistoryCornerKeyFrameCloudDS;
-  pcl::PointCloud<PointType>::Ptr nearHistorySurfKeyFrameCloud;
   pcl::PointCloud<PointType>::Ptr nearHistorySurfKeyFrameCloudDS;
 
   pcl::PointCloud<PointType>::Ptr latestCornerKeyFrameCloud;
@@ -170,8 +179,21 @@ class MappingHandler {
   pcl::KdTreeFLANN<PointType>::Ptr kdtreeGlobalMap;
   pcl::PointCloud<PointType>::Ptr globalMapKeyPoses;
   pcl::PointCloud<PointType>::Ptr globalMapKeyPosesDS;
-  pcl::PointCloud<PointType>::Ptr globalMapKeyFrames;
   pcl::PointCloud<PointType>::Ptr globalMapKeyFramesDS;
+  pcl::PointCloud<PointType>::Ptr globalMapDelta;
+
+  // !@GlobalMapTiles
+  // Downsampled clouds of the key frames in the global map. The local cloud is
+  // in the key frame, so a pose corrected by a loop closure only transforms it
+  // again, without reading and downsampling the key frame clouds.
+  struct GlobalMapTile {
+    PointTypePose pose;
+    pcl::PointCloud<PointType>::Ptr localCloud;
+    pcl::PointCloud<PointType>::Ptr cloud;
+  };
+  std::map<int, GlobalMapTile> globalMapTiles;
+  // a new subscriber gets the global map even if it did not change
+  int globalMapSubscriberNum;
 
   std::vector<int> pointSearchInd;
   std::vector<float> pointSearchSqDis;
@@ -179,10 +201,13 @@ class MappingHandler {
   pcl::VoxelGrid<PointType> downSizeFilterCorner;
   pcl::VoxelGrid<PointType> downSizeFilterSurf;
   pcl::VoxelGrid<PointType> downSizeFilterOutlier;
-  pcl::VoxelGrid<PointType> downSizeFilterHistoryKeyFrames;
   pcl::VoxelGrid<PointType> downSizeFilterSurroundingKeyPoses;
   pcl::VoxelGrid<PointType> downSizeFilterGlobalMapKeyPoses;
-  pcl::VoxelGrid<PointType> downSizeFilterGlobalMapKeyFrames;
+
+  // The sub-maps are assembled and downsampled in one pass by CloudAssembler,
+  // with the leaf sizes of the map voxel grids
+  float historyKeyFramesLeafSize;
+  float globalMapKeyFramesLeafSize;
 
   double timeLaserCloudCornerLast;
   double timeLaserCloudSurfLast;
@@ -213,15 +238,9 @@ class MappingHandler {
 
   double timeLastProcessing;
 
-  PointType pointOri, pointSel, pointProj, coeff;
+  PointType pointProj;
 
-  cv::Mat matA0;
   cv::Mat matB0;
-  cv::Mat matX0;
-
-  cv::Mat matA1;
-  cv::Mat matD1;
-  cv::Mat matV1;
 
   bool isDegenerate;
   cv::Mat matP;
@@ -240,20 +259,55 @@ class MappingHandler {
 
   bool aLoopIsClosed;
 
+  // !@ISAM2UpdateSchedule
+  // Loop closure factors wait in loopFactorGraph until the mapping thread
+  // applies them with the factor of the next key frame, or alone if no key
+  // frame comes. The extra relinearization step only runs after a loop
+  // closure, or while a step still reduces the error by more than
+  // ISAM_UPDATE_ERROR_RATIO. Between loop closures only the latest key pose is
+  // estimated, all poses are estimated for correctPoses.
+  NonlinearFactorGraph loopFactorGraph;
+  int isamExtraUpdateNum;
+
+  // memory gauges are published at most once per second, as the
+  // lidar_localization flows do
+  ros::WallTime lastMemoryPublishTime;
+
+  // !@LoopClosureSnapshot
+  // The loop closure thread copies the key poses under mtx. The key frame
+  // clouds are read from keyFrameStore, which has its own lock. The kd-tree,
+  // the sub-map and ICP then run on this snapshot without mtx. The version
+  // changes with every new key frame, the correction number with every loop
+  // closure.
+  int keyPosesVersion;
+  int keyPosesCorrectionNum;
+  int loopKeyPosesVersion;
+  int loopKeyPosesCorrectionNum;
+  pcl::PointCloud<PointType>::Ptr loopKeyPoses3D;
+  pcl::PointCloud<PointTypePose>::Ptr loopKeyPoses6D;
+  PointType loopRobotPosPoint;
+  double loopTimeLaserOdometry;
+  // transformed corner and surf clouds of the last history sub-map
+  std::map<int, pcl::PointCloud<PointType>::Ptr> historyKeyFrameCache;
+
   float cRoll, sRoll, cPitch, sPitch, cYaw, sYaw, tX, tY, tZ;
-  float ctRoll, stRoll, ctPitch, stPitch, ctYaw, stYaw, tInX, tInY, tInZ;
+  PointTypePose tInPose;
 
  public:
   MappingHandler(ros::NodeHandle& nh, ros::NodeHandle& pnh) : nh(nh), pnh(pnh) {
     ISAM2Params parameters;
     parameters.relinearizeThreshold = 0.01;
     parameters.relinearizeSkip = 1;
+    parameters.evaluateNonlinearError = ISAM_UPDATE_ERROR_RATIO > 0.0;
     isam = new ISAM2(parameters);
 
     pubKeyPoses =
         pnh.advertise<sensor_msgs::PointCloud2>("/key_pose_origin", 2);
     pubLaserCloudSurround =
         pnh.advertise<sensor_msgs::PointCloud2>("/laser_cloud_surround", 2);
+    // only the new or moved key frames of each global map update
+    pubLaserCloudSurroundDelta = pnh.advertise<sensor_msgs::PointCloud2>(
+        "/laser_cloud_surround_delta", 2);
     pubOdomAftMapped =
         pnh.advertise<nav_msgs::Odometry>("/aft_mapped_to_init", 5);
     pubOdomXYZAftMapped =
@@ -279,16 +333,18 @@ class MappingHandler {
         pnh.advertise<sensor_msgs::PointCloud2>("/corrected_cloud", 2);
     pubRecentKeyFrames =
         pnh.advertise<sensor_msgs::PointCloud2>("/recent_cloud", 2);
+    pubDiagnostics =
+        nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 10);
 
     downSizeFilterCorner.setLeafSize(0.2, 0.2, 0.2);
     downSizeFilterSurf.setLeafSize(0.4, 0.4, 0.4);
     downSizeFilterOutlier.setLeafSize(0.4, 0.4, 0.4);
 
-    downSizeFilterHistoryKeyFrames.setLeafSize(0.4, 0.4, 0.4);
+    historyKeyFramesLeafSize = 0.4;
     downSizeFilterSurroundingKeyPoses.setLeafSize(1.0, 1.0, 1.0);
 
     downSizeFilterGlobalMapKeyPoses.setLeafSize(1.0, 1.0, 1.0);
-    downSizeFilterGlobalMapKeyFrames.setLeafSize(0.4, 0.4, 0.4);
+    globalMapKeyFramesLeafSize = 0.4;
 
     odomAftMapped.header.frame_id = "/camera_init";
     odomAftMapped.child_frame_id = "/aft_mapped";
@@ -300,6 +356,10 @@ class MappingHandler {
     aftMappedXYZTrans.child_frame_id_ = "/aft_xyz_mapped";
 
     allocateMemory();
+
+    keyFrameStore.setBudget(KEYFRAME_STORE_DIR,
+                            size_t(KEYFRAME_RAM_BUDGET * 1024 * 1024));
+    keyFrameStore.setCompactResolution(KEYFRAME_COMPACT_RESOLUTION);
   }
 
   void allocateMemory() {
@@ -308,6 +368,8 @@ class MappingHandler {
 
     kdtreeSurroundingKeyPoses.reset(new pcl::KdTreeFLANN<PointType>());
     kdtreeHistoryKeyPoses.reset(new pcl::KdTreeFLANN<PointType>());
+    loopKeyPoses3D.reset(new pcl::PointCloud<PointType>());
+    loopKeyPoses6D.reset(new pcl::PointCloud<PointTypePose>());
 
     surroundingKeyPoses.reset(new pcl::PointCloud<PointType>());
     surroundingKeyPosesDS.reset(new pcl::PointCloud<PointType>());
@@ -324,8 +386,6 @@ class MappingHandler {
     laserCloudOri.reset(new pcl::PointCloud<PointType>());
     coeffSel.reset(new pcl::PointCloud<PointType>());
 
-    laserCloudCornerFromMap.reset(new pcl::PointCloud<PointType>());
-    laserCloudSurfFromMap.reset(new pcl::PointCloud<PointType>());
     laserCloudCornerFromMapDS.reset(new pcl::PointCloud<PointType>());
     laserCloudSurfFromMapDS.reset(new pcl::PointCloud<PointType>());
 
@@ -334,7 +394,6 @@ class MappingHandler {
 
     nearHistoryCornerKeyFrameCloud.reset(new pcl::PointCloud<PointType>());
     nearHistoryCornerKeyFrameCloudDS.reset(new pcl::PointCloud<PointType>());
-    nearHistorySurfKeyFrameCloud.reset(new pcl::PointCloud<PointType>());
     nearHistorySurfKeyFrameCloudDS.reset(new pcl::PointCloud<PointType>());
 
     latestCornerKeyFrameCloud.reset(new pcl::PointCloud<PointType>());
@@ -344,8 +403,9 @@ class MappingHandler {
     kdtreeGlobalMap.reset(new pcl::KdTreeFLANN<PointType>());
     globalMapKeyPoses.reset(new pcl::PointCloud<PointType>());
     globalMapKeyPosesDS.reset(new pcl::PointCloud<PointType>());
-    globalMapKeyFrames.reset(new pcl::PointCloud<PointType>());
     globalMapKeyFramesDS.reset(new pcl::PointCloud<PointType>());
+    globalMapDelta.reset(new pcl::PointCloud<PointType>());
+    globalMapSubscriberNum = 0;
 
     timeLaserCloudCornerLast = 0;
     timeLaserCloudSurfLast = 0;
@@ -384,13 +444,7 @@ class MappingHandler {
     priorNoise = noiseModel::Diagonal::Variances(Vector6);
     odometryNoise = noiseModel::Diagonal::Variances(Vector6);
 
-    matA0 = cv::Mat(5, 3, CV_32F, cv::Scalar::all(0));
     matB0 = cv::Mat(5, 1, CV_32F, cv::Scalar::all(-1));
-    matX0 = cv::Mat(3, 1, CV_32F, cv::Scalar::all(0));
-
-    matA1 = cv::Mat(3, 3, CV_32F, cv::Scalar::all(0));
-    matD1 = cv::Mat(1, 3, CV_32F, cv::Scalar::all(0));
-    matV1 = cv::Mat(3, 3, CV_32F, cv::Scalar::all(0));
 
     isDegenerate = false;
     matP = cv::Mat(6, 6, CV_32F, cv::Scalar::all(0));
@@ -404,8 +458,17 @@ class MappingHandler {
 
     potentialLoopFlag = false;
     aLoopIsClosed = false;
+    isamExtraUpdateNum = 0;
+
+    keyPosesVersion = 0;
+    keyPosesCorrectionNum = 0;
+    loopKeyPosesVersion = -1;
+    loopKeyPosesCorrectionNum = 0;
 
     latestFrameID = 0;
+
+    surroundingKeyFramesChanged = true;
+    kdtreeSurroundingKeyPosesNum = 0;
   }
 
   void transformAssociateToMap() {
@@ -606,82 +669,34 @@ class MappingHandler {
     po->intensity = pi->intensity;
   }
 
-  void updateTransformPointCloudSinCos(PointTypePose* tIn) {
-    ctRoll = cos(tIn->roll);
-    stRoll = sin(tIn->roll);
-
-    ctPitch = cos(tIn->pitch);
-    stPitch = sin(tIn->pitch);
-
-    ctYaw = cos(tIn->yaw);
-    stYaw = sin(tIn->yaw);
-
-    tInX = tIn->x;
-    tInY = tIn->y;
-    tInZ = tIn->z;
+  void updateTransformPointCloudSinCos(PointTypePose* tIn) { tInPose = *tIn; }
+
+  // Rotation by yaw about z, then by roll about x and by pitch about y, then
+  // translation
+  static Eigen::Matrix4f poseToMatrix(const PointTypePose& pose) {
+    Eigen::Matrix4f T = Eigen::Matrix4f::Identity();
+    T.block<3, 3>(0, 0) =
+        (Eigen::AngleAxisf(pose.pitch, Eigen::Vector3f::UnitY()) *
+         Eigen::AngleAxisf(pose.roll, Eigen::Vector3f::UnitX()) *
+         Eigen::AngleAxisf(pose.yaw, Eigen::Vector3f::UnitZ()))
+            .toRotationMatrix();
+    T(0, 3) = pose.x;
+    T(1, 3) = pose.y;
+    T(2, 3) = pose.z;
+    return T;
   }
 
   pcl::PointCloud<PointType>::Ptr transformPointCloud(
       pcl::PointCloud<PointType>::Ptr cloudIn) {
-    pcl::PointCloud<PointType>::Ptr cloudOut(new pcl::PointCloud<PointType>());
-
-    PointType* pointFrom;
-    PointType pointTo;
-
-    int cloudSize = cloudIn->points.size();
-    cloudOut->resize(cloudSize);
-
-    for (int i = 0; i < cloudSize; ++i) {
-      pointFrom = &cloudIn->points[i];
-      float x1 = ctYaw * pointFrom->x - stYaw * pointFrom->y;
-      float y1 = stYaw * pointFrom->x + ctYaw * pointFrom->y;
-      float z1 = pointFrom->z;
-
-      float x2 = x1;
-      float y2 = ctRoll * y1 - stRoll * z1;
-      float z2 = stRoll * y1 + ctRoll * z1;
-
-      pointTo.x = ctPitch * x2 + stPitch * z2 + tInX;
-      pointTo.y = y2 + tInY;
-      pointTo.z = -stPitch * x2 + ctPitch * z2 + tInZ;
-      pointTo.intensity = pointFrom->intensity;
-
-      cloudOut->points[i] = pointTo;
-    }
-    return cloudOut;
+    return transformPointCloud(cloudIn, &tInPose);
   }
 
   pcl::PointCloud<PointType>::Ptr transformPointCloud(
       pcl::PointCloud<PointType>::Ptr cloudIn, PointTypePose* transformIn) {
     pcl::PointCloud<PointType>::Ptr cloudOut(new pcl::PointCloud<PointType>());
-
-    PointType* pointFrom;
-    PointType pointTo;
-
-    int cloudSize = cloudIn->points.size();
-    cloudOut->resize(cloudSize);
-
-    for (int i = 0; i < cloudSize; ++i) {
-      pointFrom = &cloudIn->points[i];
-      float x1 = cos(transformIn->yaw) * pointFrom->x -
-                 sin(transformIn->yaw) * pointFrom->y;
-      float y1 = sin(transformIn->yaw) * pointFrom->x +
-                 cos(transformIn->yaw) * pointFrom->y;
-      float z1 = pointFrom->z;
-
-      float x2 = x1;
-      float y2 = cos(transformIn->roll) * y1 - sin(transformIn->roll) * z1;
-      float z2 = sin(transformIn->roll) * y1 + cos(transformIn->roll) * z1;
-
-      pointTo.x = cos(transformIn->pitch) * x2 + sin(transformIn->pitch) * z2 +
-                  transformIn->x;
-      pointTo.y = y2 + transformIn->y;
-      pointTo.z = -sin(transformIn->pitch) * x2 + cos(transformIn->pitch) * z2 +
-                  transformIn->z;
-      pointTo.intensity = pointFrom->intensity;
-
-      cloudOut->points[i] = pointTo;
-    }
+    CloudAssembler<PointType> assembler;
+    assembler.add(cloudIn, poseToMatrix(*transformIn));
+    assembler.assemble(*cloudOut);
     return cloudOut;
   }
 
@@ -973,6 +988,71 @@ class MappingHandler {
     }
   }
 
+  static size_t cloudBytes(
+      const deque<pcl::PointCloud<PointType>::Ptr>& clouds) {
+    size_t bytes = 0;
+    for (const auto& cloud : clouds) {
+      if (cloud) bytes += cloud->points.capacity() * sizeof(PointType);
+    }
+    return bytes;
+  }
+
+  static diagnostic_msgs::KeyValue memoryKeyValue(const std::string& key,
+                                                  size_t value) {
+    diagnostic_msgs::KeyValue keyValue;
+    keyValue.key = key;
+    keyValue.value = std::to_string(value);
+    return keyValue;
+  }
+
+  // Approx. bytes of the key frame buffers, as lidar_mapping.memory.<buffer>
+  // gauges on /diagnostics. Called under mtx by the mapping thread, so only
+  // the buffers it owns and the key frame store, which has its own lock, are
+  // counted; the global map and loop closure caches belong to other threads
+  void publishMemoryUsage() {
+    const ros::WallTime now = ros::WallTime::now();
+    if ((now - lastMemoryPublishTime).toSec() < 1.0 ||
+        pubDiagnostics.getNumSubscribers() == 0)
+      return;
+    lastMemoryPublishTime = now;
+
+    diagnostic_msgs::DiagnosticStatus status;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = ros::this_node::getName() + ": lidar_mapping";
+    status.hardware_id = ros::this_node::getName();
+
+    // key frames in RAM, the evicted ones are on disk
+    status.values.push_back(
+        memoryKeyValue("memory.key_frames", keyFrameStore.ramBytes()));
+    status.values.push_back(memoryKeyValue(
+        "memory.recent_key_frames", cloudBytes(recentCornerCloudKeyFrames) +
+                                        cloudBytes(recentSurfCloudKeyFrames) +
+                                        cloudBytes(recentOutlierCloudKeyFrames)));
+    status.values.push_back(memoryKeyValue(
+        "memory.surrounding_key_frames",
+        cloudBytes(surroundingCornerCloudKeyFrames) +
+            cloudBytes(surroundingSurfCloudKeyFrames) +
+            cloudBytes(surroundingOutlierCloudKeyFrames)));
+    status.values.push_back(memoryKeyValue(
+        "memory.key_poses",
+        cloudKeyPoses3D->points.capacity() * sizeof(PointType) +
+            cloudKeyPoses6D->points.capacity() * sizeof(PointTypePose)));
+    status.values.push_back(memoryKeyValue(
+        "memory.local_map",
+        (laserCloudCornerFromMapDS->points.capacity() +
+         laserCloudSurfFromMapDS->points.capacity()) *
+            sizeof(PointType)));
+    status.values.push_back(
+        memoryKeyValue("key_frames.num", keyFrameStore.size()));
+    status.values.push_back(
+        memoryKeyValue("key_frames.in_ram", keyFrameStore.ramFrameNum()));
+
+    diagnostic_msgs::DiagnosticArray diagnosticArray;
+    diagnosticArray.header.stamp = ros::Time::now();
+    diagnosticArray.status.push_back(status);
+    pubDiagnostics.publish(diagnosticArray);
+  }
+
   void visualizeGlobalMapThread() {
     ros::Rate rate(0.2);
     while (ros::ok()) {
@@ -981,20 +1061,30 @@ class MappingHandler {
     }
   }
 
-  void publishGlobalMap() {
-    if (pubLaserCloudSurround.getNumSubscribers() == 0) return;
+  static bool isSamePose(const PointTypePose& a, const PointTypePose& b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z && a.roll == b.roll &&
+           a.pitch == b.pitch && a.yaw == b.yaw;
+  }
 
-    if (cloudKeyPoses3D->points.empty() == true) return;
+  void publishGlobalMap() {
+    if (pubLaserCloudSurround.getNumSubscribers() == 0 &&
+        pubLaserCloudSurroundDelta.getNumSubscribers() == 0)
+      return;
 
     std::vector<int> pointSearchIndGlobalMap;
     std::vector<float> pointSearchSqDisGlobalMap;
 
+    // the key poses are copied under mtx, the mapping thread appends to and
+    // corrects them
     mtx.lock();
+    if (cloudKeyPoses3D->points.empty() == true) {
+      mtx.unlock();
+      return;
+    }
     kdtreeGlobalMap->setInputCloud(cloudKeyPoses3D);
     kdtreeGlobalMap->radiusSearch(
         currentRobotPosPoint, globalMapVisualizationSearchRadius,
         pointSearchIndGlobalMap, pointSearchSqDisGlobalMap, 0);
-    mtx.unlock();
 
     for (int i = 0; i < pointSearchIndGlobalMap.size(); ++i)
       globalMapKeyPoses->points.push_back(
@@ -1003,30 +1093,93 @@ class MappingHandler {
     downSizeFilterGlobalMapKeyPoses.setInputCloud(globalMapKeyPoses);
     downSizeFilterGlobalMapKeyPoses.filter(*globalMapKeyPosesDS);
 
+    std::map<int, PointTypePose> globalMapPoses;
     for (int i = 0; i < globalMapKeyPosesDS->points.size(); ++i) {
       int thisKeyInd = (int)globalMapKeyPosesDS->points[i].intensity;
-      *globalMapKeyFrames +=
-          *transformPointCloud(cornerCloudKeyFrames[thisKeyInd],
-                               &cloudKeyPoses6D->points[thisKeyInd]);
-      *globalMapKeyFrames += *transformPointCloud(
-          surfCloudKeyFrames[thisKeyInd], &cloudKeyPoses6D->points[thisKeyInd]);
-      *globalMapKeyFrames +=
-          *transformPointCloud(outlierCloudKeyFrames[thisKeyInd],
-                               &cloudKeyPoses6D->points[thisKeyInd]);
+      globalMapPoses[thisKeyInd] = cloudKeyPoses6D->points[thisKeyInd];
     }
+    double timeGlobalMap = timeLaserOdometry;
+    const Eigen::Vector3f globalMapCenter(currentRobotPosPoint.x,
+                                          currentRobotPosPoint.y,
+                                          currentRobotPosPoint.z);
+    mtx.unlock();
 
-    downSizeFilterGlobalMapKeyFrames.setInputCloud(globalMapKeyFrames);
-    downSizeFilterGlobalMapKeyFrames.filter(*globalMapKeyFramesDS);
+    globalMapKeyPoses->clear();
+    globalMapKeyPosesDS->clear();
+
+    // drop the key frames which left the global map
+    bool globalMapChanged = false;
+    for (auto it = globalMapTiles.begin(); it != globalMapTiles.end();) {
+      if (globalMapPoses.count(it->first) == 0) {
+        it = globalMapTiles.erase(it);
+        globalMapChanged = true;
+      } else {
+        ++it;
+      }
+    }
+
+    CloudAssembler<PointType> assembler;
+    for (const auto& keyPose : globalMapPoses) {
+      int thisKeyInd = keyPose.first;
+      PointTypePose thisPose = keyPose.second;
+      GlobalMapTile& tile = globalMapTiles[thisKeyInd];
+      if (tile.cloud && isSamePose(tile.pose, thisPose)) continue;
+
+      if (!tile.localCloud) {
+        KeyFrameStore<PointType>::KeyFrame thisKeyFrame =
+            keyFrameStore.get(thisKeyInd, false);
+        CloudAssembler<PointType> tileAssembler;
+        tileAssembler.add(thisKeyFrame.corner);
+        tileAssembler.add(thisKeyFrame.surf);
+        tileAssembler.add(thisKeyFrame.outlier);
+
+        tile.localCloud.reset(new pcl::PointCloud<PointType>());
+        tileAssembler.assembleFiltered(*tile.localCloud,
+                                       globalMapKeyFramesLeafSize);
+      }
+
+      tile.pose = thisPose;
+      tile.cloud = transformPointCloud(tile.localCloud, &thisPose);
+
+      assembler.add(tile.cloud);
+      globalMapChanged = true;
+    }
+    assembler.assemble(*globalMapDelta);
+
+    // nothing is published while the global map stays the same, except the
+    // whole map to a new subscriber
+    int subscriberNum = pubLaserCloudSurround.getNumSubscribers();
+    bool newSubscriber = subscriberNum > globalMapSubscriberNum;
+    globalMapSubscriberNum = subscriberNum;
+    if (!globalMapChanged && !newSubscriber) return;
 
     sensor_msgs::PointCloud2 cloudMsgTemp;
-    pcl::toROSMsg(*globalMapKeyFramesDS, cloudMsgTemp);
-    cloudMsgTemp.header.stamp = ros::Time().fromSec(timeLaserOdometry);
-    cloudMsgTemp.header.frame_id = "/camera_init";
-    pubLaserCloudSurround.publish(cloudMsgTemp);
+    if (pubLaserCloudSurroundDelta.getNumSubscribers() != 0 &&
+        !globalMapDelta->points.empty()) {
+      pcl::toROSMsg(*globalMapDelta, cloudMsgTemp);
+      cloudMsgTemp.header.stamp = ros::Time().fromSec(timeGlobalMap);
+      cloudMsgTemp.header.frame_id = "/camera_init";
+      pubLaserCloudSurroundDelta.publish(cloudMsgTemp);
+    }
+    globalMapDelta->clear();
+
+    if (subscriberNum != 0) {
+      // the key frames are picked within the visualization radius, and so are
+      // their points
+      for (const auto& tile : globalMapTiles) assembler.add(tile.second.cloud);
+      const Eigen::Vector3f halfSize = Eigen::Vector3f::Constant(
+          static_cast<float>(globalMapVisualizationSearchRadius));
+      assembler.setCropBox(globalMapCenter - halfSize,
+                           globalMapCenter + halfSize);
+      assembler.assembleFiltered(*globalMapKeyFramesDS,
+                                 globalMapKeyFramesLeafSize);
+
+      pcl::toROSMsg(*globalMapKeyFramesDS, cloudMsgTemp);
+      cloudMsgTemp.header.stamp = ros::Time().fromSec(timeGlobalMap);
+      cloudMsgTemp.header.frame_id = "/camera_init";
+      pubLaserCloudSurround.publish(cloudMsgTemp);
+    }
 
-    globalMapKeyPoses->clear();
-    globalMapKeyPosesDS->clear();
-    globalMapKeyFrames->clear();
     globalMapKeyFramesDS->clear();
   }
 
@@ -1040,24 +1193,44 @@ class MappingHandler {
     }
   }
 
+  // Takes a new snapshot if the key poses changed, returns whether they did
+  bool takeLoopClosureSnapshot() {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    loopRobotPosPoint = currentRobotPosPoint;
+    loopTimeLaserOdometry = timeLaserOdometry;
+    if (loopKeyPosesVersion == keyPosesVersion) return false;
+
+    *loopKeyPoses3D = *cloudKeyPoses3D;
+    *loopKeyPoses6D = *cloudKeyPoses6D;
+    loopKeyPosesVersion = keyPosesVersion;
+    if (loopKeyPosesCorrectionNum != keyPosesCorrectionNum) {
+      loopKeyPosesCorrectionNum = keyPosesCorrectionNum;
+      historyKeyFrameCache.clear();
+    }
+    return true;
+  }
+
+  // Runs on the snapshot, without mtx
   bool detectLoopClosure() {
     latestSurfKeyFrameCloud->clear();
-    nearHistorySurfKeyFrameCloud->clear();
     nearHistorySurfKeyFrameCloudDS->clear();
 
-    std::lock_guard<std::mutex> lock(mtx);
+    bool keyPosesChanged = takeLoopClosureSnapshot();
+    if (loopKeyPoses3D->points.empty()) return false;
+    if (keyPosesChanged) kdtreeHistoryKeyPoses->setInputCloud(loopKeyPoses3D);
 
     std::vector<int> pointSearchIndLoop;
     std::vector<float> pointSearchSqDisLoop;
-    kdtreeHistoryKeyPoses->setInputCloud(cloudKeyPoses3D);
     kdtreeHistoryKeyPoses->radiusSearch(
-        currentRobotPosPoint, historyKeyframeSearchRadius, pointSearchIndLoop,
+        loopRobotPosPoint, historyKeyframeSearchRadius, pointSearchIndLoop,
         pointSearchSqDisLoop, 0);
 
     closestHistoryFrameID = -1;
     for (int i = 0; i < pointSearchIndLoop.size(); ++i) {
       int id = pointSearchIndLoop[i];
-      if (abs(cloudKeyPoses6D->points[id].time - timeLaserOdometry) > 30.0) {
+      if (abs(loopKeyPoses6D->points[id].time - loopTimeLaserOdometry) >
+          30.0) {
         closestHistoryFrameID = id;
         break;
       }
@@ -1066,13 +1239,15 @@ class MappingHandler {
       return false;
     }
 
-    latestFrameIDLoopCloure = cloudKeyPoses3D->points.size() - 1;
-    *latestSurfKeyFrameCloud +=
-        *transformPointCloud(cornerCloudKeyFrames[latestFrameIDLoopCloure],
-                             &cloudKeyPoses6D->points[latestFrameIDLoopCloure]);
-    *latestSurfKeyFrameCloud +=
-        *transformPointCloud(surfCloudKeyFrames[latestFrameIDLoopCloure],
-                             &cloudKeyPoses6D->points[latestFrameIDLoopCloure]);
+    latestFrameIDLoopCloure = loopKeyPoses3D->points.size() - 1;
+    KeyFrameStore<PointType>::KeyFrame latestKeyFrame =
+        keyFrameStore.get(latestFrameIDLoopCloure);
+    CloudAssembler<PointType> assembler;
+    const Eigen::Matrix4f latestPose =
+        poseToMatrix(loopKeyPoses6D->points[latestFrameIDLoopCloure]);
+    assembler.add(latestKeyFrame.corner, latestPose);
+    assembler.add(latestKeyFrame.surf, latestPose);
+    assembler.assemble(*latestSurfKeyFrameCloud);
 
     pcl::PointCloud<PointType>::Ptr hahaCloud(new pcl::PointCloud<PointType>());
     int cloudSize = latestSurfKeyFrameCloud->points.size();
@@ -1084,26 +1259,40 @@ class MappingHandler {
     latestSurfKeyFrameCloud->clear();
     *latestSurfKeyFrameCloud = *hahaCloud;
 
+    // key frames outside of the new window are dropped from the cache
+    std::map<int, pcl::PointCloud<PointType>::Ptr> nearHistoryKeyFrames;
     for (int j = -historyKeyframeSearchNum; j <= historyKeyframeSearchNum;
          ++j) {
-      if (closestHistoryFrameID + j < 0 ||
-          closestHistoryFrameID + j > latestFrameIDLoopCloure)
-        continue;
-      *nearHistorySurfKeyFrameCloud += *transformPointCloud(
-          cornerCloudKeyFrames[closestHistoryFrameID + j],
-          &cloudKeyPoses6D->points[closestHistoryFrameID + j]);
-      *nearHistorySurfKeyFrameCloud += *transformPointCloud(
-          surfCloudKeyFrames[closestHistoryFrameID + j],
-          &cloudKeyPoses6D->points[closestHistoryFrameID + j]);
+      int thisKeyInd = closestHistoryFrameID + j;
+      if (thisKeyInd < 0 || thisKeyInd > latestFrameIDLoopCloure) continue;
+
+      auto iter = historyKeyFrameCache.find(thisKeyInd);
+      pcl::PointCloud<PointType>::Ptr thisKeyFrame;
+      if (iter != historyKeyFrameCache.end()) {
+        thisKeyFrame = iter->second;
+      } else {
+        KeyFrameStore<PointType>::KeyFrame historyKeyFrame =
+            keyFrameStore.get(thisKeyInd);
+        const Eigen::Matrix4f historyPose =
+            poseToMatrix(loopKeyPoses6D->points[thisKeyInd]);
+        thisKeyFrame.reset(new pcl::PointCloud<PointType>());
+        CloudAssembler<PointType> keyFrameAssembler;
+        keyFrameAssembler.add(historyKeyFrame.corner, historyPose);
+        keyFrameAssembler.add(historyKeyFrame.surf, historyPose);
+        keyFrameAssembler.assemble(*thisKeyFrame);
+      }
+      nearHistoryKeyFrames[thisKeyInd] = thisKeyFrame;
+      assembler.add(thisKeyFrame);
     }
+    historyKeyFrameCache.swap(nearHistoryKeyFrames);
 
-    downSizeFilterHistoryKeyFrames.setInputCloud(nearHistorySurfKeyFrameCloud);
-    downSizeFilterHistoryKeyFrames.filter(*nearHistorySurfKeyFrameCloudDS);
+    assembler.assembleFiltered(*nearHistorySurfKeyFrameCloudDS,
+                               historyKeyFramesLeafSize);
 
     if (pubHistoryKeyFrames.getNumSubscribers() != 0) {
       sensor_msgs::PointCloud2 cloudMsgTemp;
       pcl::toROSMsg(*nearHistorySurfKeyFrameCloudDS, cloudMsgTemp);
-      cloudMsgTemp.header.stamp = ros::Time().fromSec(timeLaserOdometry);
+      cloudMsgTemp.header.stamp = ros::Time().fromSec(loopTimeLaserOdometry);
       cloudMsgTemp.header.frame_id = "/camera_init";
       pubHistoryKeyFrames.publish(cloudMsgTemp);
     }
@@ -1112,12 +1301,10 @@ class MappingHandler {
   }
 
   void performLoopClosure() {
-    if (cloudKeyPoses3D->points.empty() == true) return;
-
     if (potentialLoopFlag == false) {
       if (detectLoopClosure() == true) {
         potentialLoopFlag = true;
-        timeSaveFirstCurrentScanForLoopClosure = timeLaserOdometry;
+        timeSaveFirstCurrentScanForLoopClosure = loopTimeLaserOdometry;
       }
       if (potentialLoopFlag == false) return;
     }
@@ -1144,11 +1331,12 @@ class MappingHandler {
     if (pubIcpKeyFrames.getNumSubscribers() != 0) {
       pcl::PointCloud<PointType>::Ptr closed_cloud(
           new pcl::PointCloud<PointType>());
-      pcl::transformPointCloud(*latestSurfKeyFrameCloud, *closed_cloud,
-                               icp.getFinalTransformation());
+      CloudAssembler<PointType> assembler;
+      assembler.add(latestSurfKeyFrameCloud, icp.getFinalTransformation());
+      assembler.assemble(*closed_cloud);
       sensor_msgs::PointCloud2 cloudMsgTemp;
       pcl::toROSMsg(*closed_cloud, cloudMsgTemp);
-      cloudMsgTemp.header.stamp = ros::Time().fromSec(timeLaserOdometry);
+      cloudMsgTemp.header.stamp = ros::Time().fromSec(loopTimeLaserOdometry);
       cloudMsgTemp.header.frame_id = "/camera_init";
       pubIcpKeyFrames.publish(cloudMsgTemp);
     }
@@ -1161,13 +1349,13 @@ class MappingHandler {
     Eigen::Affine3f correctionLidarFrame =
         pcl::getTransformation(z, x, y, yaw, roll, pitch);
     Eigen::Affine3f tWrong = pclPointToAffine3fCameraToLidar(
-        cloudKeyPoses6D->points[latestFrameIDLoopCloure]);
+        loopKeyPoses6D->points[latestFrameIDLoopCloure]);
     Eigen::Affine3f tCorrect = correctionLidarFrame * tWrong;
     pcl::getTranslationAndEulerAngles(tCorrect, x, y, z, roll, pitch, yaw);
     gtsam::Pose3 poseFrom =
         Pose3(Rot3::RzRyRx(roll, pitch, yaw), Point3(x, y, z));
     gtsam::Pose3 poseTo =
-        pclPointTogtsamPose3(cloudKeyPoses6D->points[closestHistoryFrameID]);
+        pclPointTogtsamPose3(loopKeyPoses6D->points[closestHistoryFrameID]);
     gtsam::Vector Vector6(6);
     float noiseScore = icp.getFitnessScore();
     Vector6 << noiseScore, noiseScore, noiseScore, noiseScore, noiseScore,
@@ -1175,14 +1363,9 @@ class MappingHandler {
     constraintNoise = noiseModel::Diagonal::Variances(Vector6);
 
     std::lock_guard<std::mutex> lock(mtx);
-    gtSAMgraph.add(
+    loopFactorGraph.add(
         BetweenFactor<Pose3>(latestFrameIDLoopCloure, closestHistoryFrameID,
                              poseFrom.between(poseTo), constraintNoise));
-    isam->update(gtSAMgraph);
-    isam->update();
-    gtSAMgraph.resize(0);
-
-    aLoopIsClosed = true;
   }
 
   Pose3 pclPointTogtsamPose3(PointTypePose thisPoint) {
@@ -1201,28 +1384,40 @@ class MappingHandler {
   void extractSurroundingKeyFrames() {
     if (cloudKeyPoses3D->points.empty() == true) return;
 
+    CloudAssembler<PointType> cornerAssembler;
+    CloudAssembler<PointType> surfAssembler;
+
     if (loopClosureEnableFlag == true) {
       if (recentCornerCloudKeyFrames.size() < surroundingKeyframeSearchNum) {
-        recentCornerCloudKeyFrames.clear();
-        recentSurfCloudKeyFrames.clear();
-        recentOutlierCloudKeyFrames.clear();
-        int numPoses = cloudKeyPoses3D->points.size();
-        for (int i = numPoses - 1; i >= 0; --i) {
-          int thisKeyInd = (int)cloudKeyPoses3D->points[i].intensity;
-          PointTypePose thisTransformation =
-              cloudKeyPoses6D->points[thisKeyInd];
-          updateTransformPointCloudSinCos(&thisTransformation);
-          recentCornerCloudKeyFrames.push_front(
-              transformPointCloud(cornerCloudKeyFrames[thisKeyInd]));
-          recentSurfCloudKeyFrames.push_front(
-              transformPointCloud(surfCloudKeyFrames[thisKeyInd]));
-          recentOutlierCloudKeyFrames.push_front(
-              transformPointCloud(outlierCloudKeyFrames[thisKeyInd]));
-          if (recentCornerCloudKeyFrames.size() >= surroundingKeyframeSearchNum)
-            break;
+        // nothing to rebuild until a new key frame or a loop closure
+        if (recentCornerCloudKeyFrames.size() !=
+            cloudKeyPoses3D->points.size()) {
+          surroundingKeyFramesChanged = true;
+          recentCornerCloudKeyFrames.clear();
+          recentSurfCloudKeyFrames.clear();
+          recentOutlierCloudKeyFrames.clear();
+          int numPoses = cloudKeyPoses3D->points.size();
+          for (int i = numPoses - 1; i >= 0; --i) {
+            int thisKeyInd = (int)cloudKeyPoses3D->points[i].intensity;
+            PointTypePose thisTransformation =
+                cloudKeyPoses6D->points[thisKeyInd];
+            updateTransformPointCloudSinCos(&thisTransformation);
+            KeyFrameStore<PointType>::KeyFrame thisKeyFrame =
+                keyFrameStore.get(thisKeyInd);
+            recentCornerCloudKeyFrames.push_front(
+                transformPointCloud(thisKeyFrame.corner));
+            recentSurfCloudKeyFrames.push_front(
+                transformPointCloud(thisKeyFrame.surf));
+            recentOutlierCloudKeyFrames.push_front(
+                transformPointCloud(thisKeyFrame.outlier));
+            if (recentCornerCloudKeyFrames.size() >=
+                surroundingKeyframeSearchNum)
+              break;
+          }
         }
       } else {
         if (latestFrameID != cloudKeyPoses3D->points.size() - 1) {
+          surroundingKeyFramesChanged = true;
           recentCornerCloudKeyFrames.pop_front();
           recentSurfCloudKeyFrames.pop_front();
           recentOutlierCloudKeyFrames.pop_front();
@@ -1230,25 +1425,33 @@ class MappingHandler {
           PointTypePose thisTransformation =
               cloudKeyPoses6D->points[latestFrameID];
           updateTransformPointCloudSinCos(&thisTransformation);
+          KeyFrameStore<PointType>::KeyFrame thisKeyFrame =
+              keyFrameStore.get(latestFrameID);
           recentCornerCloudKeyFrames.push_back(
-              transformPointCloud(cornerCloudKeyFrames[latestFrameID]));
+              transformPointCloud(thisKeyFrame.corner));
           recentSurfCloudKeyFrames.push_back(
-              transformPointCloud(surfCloudKeyFrames[latestFrameID]));
+              transformPointCloud(thisKeyFrame.surf));
           recentOutlierCloudKeyFrames.push_back(
-              transformPointCloud(outlierCloudKeyFrames[latestFrameID]));
+              transformPointCloud(thisKeyFrame.outlier));
         }
       }
 
-      for (int i = 0; i < recentCornerCloudKeyFrames.size(); ++i) {
-        *laserCloudCornerFromMap += *recentCornerCloudKeyFrames[i];
-        *laserCloudSurfFromMap += *recentSurfCloudKeyFrames[i];
-        *laserCloudSurfFromMap += *recentOutlierCloudKeyFrames[i];
+      if (surroundingKeyFramesChanged) {
+        for (int i = 0; i < recentCornerCloudKeyFrames.size(); ++i) {
+          cornerAssembler.add(recentCornerCloudKeyFrames[i]);
+          surfAssembler.add(recentSurfCloudKeyFrames[i]);
+          surfAssembler.add(recentOutlierCloudKeyFrames[i]);
+        }
       }
     } else {
       surroundingKeyPoses->clear();
       surroundingKeyPosesDS->clear();
 
-      kdtreeSurroundingKeyPoses->setInputCloud(cloudKeyPoses3D);
+      // the key poses only change when a new key frame is saved
+      if (kdtreeSurroundingKeyPosesNum != cloudKeyPoses3D->points.size()) {
+        kdtreeSurroundingKeyPoses->setInputCloud(cloudKeyPoses3D);
+        kdtreeSurroundingKeyPosesNum = cloudKeyPoses3D->points.size();
+      }
       kdtreeSurroundingKeyPoses->radiusSearch(
           currentRobotPosPoint, (double)surroundingKeyframeSearchRadius,
           pointSearchInd, pointSearchSqDis, 0);
@@ -1269,6 +1472,7 @@ class MappingHandler {
           }
         }
         if (existingFlag == false) {
+          surroundingKeyFramesChanged = true;
           surroundingExistingKeyPosesID.erase(
               surroundingExistingKeyPosesID.begin() + i);
           surroundingCornerCloudKeyFrames.erase(
@@ -1293,34 +1497,50 @@ class MappingHandler {
         if (existingFlag == true) {
           continue;
         } else {
+          surroundingKeyFramesChanged = true;
           int thisKeyInd = (int)surroundingKeyPosesDS->points[i].intensity;
           PointTypePose thisTransformation =
               cloudKeyPoses6D->points[thisKeyInd];
           updateTransformPointCloudSinCos(&thisTransformation);
           surroundingExistingKeyPosesID.push_back(thisKeyInd);
+          KeyFrameStore<PointType>::KeyFrame thisKeyFrame =
+              keyFrameStore.get(thisKeyInd);
           surroundingCornerCloudKeyFrames.push_back(
-              transformPointCloud(cornerCloudKeyFrames[thisKeyInd]));
+              transformPointCloud(thisKeyFrame.corner));
           surroundingSurfCloudKeyFrames.push_back(
-              transformPointCloud(surfCloudKeyFrames[thisKeyInd]));
+              transformPointCloud(thisKeyFrame.surf));
           surroundingOutlierCloudKeyFrames.push_back(
-              transformPointCloud(outlierCloudKeyFrames[thisKeyInd]));
+              transformPointCloud(thisKeyFrame.outlier));
         }
       }
 
-      for (int i = 0; i < surroundingExistingKeyPosesID.size(); ++i) {
-        *laserCloudCornerFromMap += *surroundingCornerCloudKeyFrames[i];
-        *laserCloudSurfFromMap += *surroundingSurfCloudKeyFrames[i];
-        *laserCloudSurfFromMap += *surroundingOutlierCloudKeyFrames[i];
+      if (surroundingKeyFramesChanged) {
+        for (int i = 0; i < surroundingExistingKeyPosesID.size(); ++i) {
+          cornerAssembler.add(surroundingCornerCloudKeyFrames[i]);
+          surfAssembler.add(surroundingSurfCloudKeyFrames[i]);
+          surfAssembler.add(surroundingOutlierCloudKeyFrames[i]);
+        }
       }
     }
 
-    downSizeFilterCorner.setInputCloud(laserCloudCornerFromMap);
-    downSizeFilterCorner.filter(*laserCloudCornerFromMapDS);
+    // same key frames as the last scan, keep its map and kd-trees
+    if (!surroundingKeyFramesChanged) return;
+    surroundingKeyFramesChanged = false;
+
+    // the key frame clouds are merged and downsampled in one pass, with the
+    // leaf sizes of the scan voxel grids
+    cornerAssembler.assembleFiltered(*laserCloudCornerFromMapDS,
+                                     downSizeFilterCorner.getLeafSize()(0));
     laserCloudCornerFromMapDSNum = laserCloudCornerFromMapDS->points.size();
 
-    downSizeFilterSurf.setInputCloud(laserCloudSurfFromMap);
-    downSizeFilterSurf.filter(*laserCloudSurfFromMapDS);
+    surfAssembler.assembleFiltered(*laserCloudSurfFromMapDS,
+                                   downSizeFilterSurf.getLeafSize()(0));
     laserCloudSurfFromMapDSNum = laserCloudSurfFromMapDS->points.size();
+
+    if (laserCloudCornerFromMapDSNum > 10 && laserCloudSurfFromMapDSNum > 100) {
+      kdtreeCornerFromMap->setInputCloud(laserCloudCornerFromMapDS);
+      kdtreeSurfFromMap->setInputCloud(laserCloudSurfFromMapDS);
+    }
   }
 
   void downsampleCurrentScan() {
@@ -1350,173 +1570,199 @@ class MappingHandler {
 
   void cornerOptimization(int iterCount) {
     updatePointAssociateToMapSinCos();
-    for (int i = 0; i < laserCloudCornerLastDSNum; i++) {
-      pointOri = laserCloudCornerLastDS->points[i];
-      pointAssociateToMap(&pointOri, &pointSel);
-      kdtreeCornerFromMap->nearestKSearch(pointSel, 5, pointSearchInd,
-                                          pointSearchSqDis);
-
-      if (pointSearchSqDis[4] < 1.0) {
-        float cx = 0, cy = 0, cz = 0;
-        for (int j = 0; j < 5; j++) {
-          cx += laserCloudCornerFromMapDS->points[pointSearchInd[j]].x;
-          cy += laserCloudCornerFromMapDS->points[pointSearchInd[j]].y;
-          cz += laserCloudCornerFromMapDS->points[pointSearchInd[j]].z;
-        }
-        cx /= 5;
-        cy /= 5;
-        cz /= 5;
-
-        float a11 = 0, a12 = 0, a13 = 0, a22 = 0, a23 = 0, a33 = 0;
-        for (int j = 0; j < 5; j++) {
-          float ax =
-              laserCloudCornerFromMapDS->points[pointSearchInd[j]].x - cx;
-          float ay =
-              laserCloudCornerFromMapDS->points[pointSearchInd[j]].y - cy;
-          float az =
-              laserCloudCornerFromMapDS->points[pointSearchInd[j]].z - cz;
-
-          a11 += ax * ax;
-          a12 += ax * ay;
-          a13 += ax * az;
-          a22 += ay * ay;
-          a23 += ay * az;
-          a33 += az * az;
-        }
-        a11 /= 5;
-        a12 /= 5;
-        a13 /= 5;
-        a22 /= 5;
-        a23 /= 5;
-        a33 /= 5;
-
-        matA1.at<float>(0, 0) = a11;
-        matA1.at<float>(0, 1) = a12;
-        matA1.at<float>(0, 2) = a13;
-        matA1.at<float>(1, 0) = a12;
-        matA1.at<float>(1, 1) = a22;
-        matA1.at<float>(1, 2) = a23;
-        matA1.at<float>(2, 0) = a13;
-        matA1.at<float>(2, 1) = a23;
-        matA1.at<float>(2, 2) = a33;
-
-        cv::eigen(matA1, matD1, matV1);
-
-        if (matD1.at<float>(0, 0) > 3 * matD1.at<float>(0, 1)) {
-          float x0 = pointSel.x;
-          float y0 = pointSel.y;
-          float z0 = pointSel.z;
-          float x1 = cx + 0.1 * matV1.at<float>(0, 0);
-          float y1 = cy + 0.1 * matV1.at<float>(0, 1);
-          float z1 = cz + 0.1 * matV1.at<float>(0, 2);
-          float x2 = cx - 0.1 * matV1.at<float>(0, 0);
-          float y2 = cy - 0.1 * matV1.at<float>(0, 1);
-          float z2 = cz - 0.1 * matV1.at<float>(0, 2);
-
-          float a012 =
-              sqrt(((x0 - x1) * (y0 - y2) - (x0 - x2) * (y0 - y1)) *
-                       ((x0 - x1) * (y0 - y2) - (x0 - x2) * (y0 - y1)) +
-                   ((x0 - x1) * (z0 - z2) - (x0 - x2) * (z0 - z1)) *
-                       ((x0 - x1) * (z0 - z2) - (x0 - x2) * (z0 - z1)) +
-                   ((y0 - y1) * (z0 - z2) - (y0 - y2) * (z0 - z1)) *
-                       ((y0 - y1) * (z0 - z2) - (y0 - y2) * (z0 - z1)));
-
-          float l12 = sqrt((x1 - x2) * (x1 - x2) + (y1 - y2) * (y1 - y2) +
-                           (z1 - z2) * (z1 - z2));
-
-          float la =
-              ((y1 - y2) * ((x0 - x1) * (y0 - y2) - (x0 - x2) * (y0 - y1)) +
-               (z1 - z2) * ((x0 - x1) * (z0 - z2) - (x0 - x2) * (z0 - z1))) /
-              a012 / l12;
-
-          float lb =
-              -((x1 - x2) * ((x0 - x1) * (y0 - y2) - (x0 - x2) * (y0 - y1)) -
-                (z1 - z2) * ((y0 - y1) * (z0 - z2) - (y0 - y2) * (z0 - z1))) /
-              a012 / l12;
-
-          float lc =
-              -((x1 - x2) * ((x0 - x1) * (z0 - z2) - (x0 - x2) * (z0 - z1)) +
-                (y1 - y2) * ((y0 - y1) * (z0 - z2) - (y0 - y2) * (z0 - z1))) /
-              a012 / l12;
-
-          float ld2 = a012 / l12;
-
-          float s = 1 - 0.9 * fabs(ld2);
-
-          coeff.x = s * la;
-          coeff.y = s * lb;
-          coeff.z = s * lc;
-          coeff.intensity = s * ld2;
-
-          if (s > 0.1) {
-            laserCloudOri->push_back(pointOri);
-            coeffSel->push_back(coeff);
+#pragma omp parallel
+    {
+      PointType pointOri, pointSel, coeff;
+      std::vector<int> pointSearchInd;
+      std::vector<float> pointSearchSqDis;
+      cv::Mat matA1(3, 3, CV_32F, cv::Scalar::all(0));
+      cv::Mat matD1(1, 3, CV_32F, cv::Scalar::all(0));
+      cv::Mat matV1(3, 3, CV_32F, cv::Scalar::all(0));
+
+#pragma omp for schedule(static)
+      for (int i = 0; i < laserCloudCornerLastDSNum; i++) {
+        pointOri = laserCloudCornerLastDS->points[i];
+        pointAssociateToMap(&pointOri, &pointSel);
+        kdtreeCornerFromMap->nearestKSearch(pointSel, 5, pointSearchInd,
+                                            pointSearchSqDis);
+
+        if (pointSearchSqDis[4] < 1.0) {
+          float cx = 0, cy = 0, cz = 0;
+          for (int j = 0; j < 5; j++) {
+            cx += laserCloudCornerFromMapDS->points[pointSearchInd[j]].x;
+            cy += laserCloudCornerFromMapDS->points[pointSearchInd[j]].y;
+            cz += laserCloudCornerFromMapDS->points[pointSearchInd[j]].z;
+          }
+          cx /= 5;
+          cy /= 5;
+          cz /= 5;
+
+          float a11 = 0, a12 = 0, a13 = 0, a22 = 0, a23 = 0, a33 = 0;
+          for (int j = 0; j < 5; j++) {
+            float ax =
+                laserCloudCornerFromMapDS->points[pointSearchInd[j]].x - cx;
+            float ay =
+                laserCloudCornerFromMapDS->points[pointSearchInd[j]].y - cy;
+            float az =
+                laserCloudCornerFromMapDS->points[pointSearchInd[j]].z - cz;
+
+            a11 += ax * ax;
+            a12 += ax * ay;
+            a13 += ax * az;
+            a22 += ay * ay;
+            a23 += ay * az;
+            a33 += az * az;
+          }
+          a11 /= 5;
+          a12 /= 5;
+          a13 /= 5;
+          a22 /= 5;
+          a23 /= 5;
+          a33 /= 5;
+
+          matA1.at<float>(0, 0) = a11;
+          matA1.at<float>(0, 1) = a12;
+          matA1.at<float>(0, 2) = a13;
+          matA1.at<float>(1, 0) = a12;
+          matA1.at<float>(1, 1) = a22;
+          matA1.at<float>(1, 2) = a23;
+          matA1.at<float>(2, 0) = a13;
+          matA1.at<float>(2, 1) = a23;
+          matA1.at<float>(2, 2) = a33;
+
+          cv::eigen(matA1, matD1, matV1);
+
+          if (matD1.at<float>(0, 0) > 3 * matD1.at<float>(0, 1)) {
+            float x0 = pointSel.x;
+            float y0 = pointSel.y;
+            float z0 = pointSel.z;
+            float x1 = cx + 0.1 * matV1.at<float>(0, 0);
+            float y1 = cy + 0.1 * matV1.at<float>(0, 1);
+            float z1 = cz + 0.1 * matV1.at<float>(0, 2);
+            float x2 = cx - 0.1 * matV1.at<float>(0, 0);
+            float y2 = cy - 0.1 * matV1.at<float>(0, 1);
+            float z2 = cz - 0.1 * matV1.at<float>(0, 2);
+
+            float a012 =
+                sqrt(((x0 - x1) * (y0 - y2) - (x0 - x2) * (y0 - y1)) *
+                         ((x0 - x1) * (y0 - y2) - (x0 - x2) * (y0 - y1)) +
+                     ((x0 - x1) * (z0 - z2) - (x0 - x2) * (z0 - z1)) *
+                         ((x0 - x1) * (z0 - z2) - (x0 - x2) * (z0 - z1)) +
+                     ((y0 - y1) * (z0 - z2) - (y0 - y2) * (z0 - z1)) *
+                         ((y0 - y1) * (z0 - z2) - (y0 - y2) * (z0 - z1)));
+
+            float l12 = sqrt((x1 - x2) * (x1 - x2) + (y1 - y2) * (y1 - y2) +
+                             (z1 - z2) * (z1 - z2));
+
+            float la =
+                ((y1 - y2) * ((x0 - x1) * (y0 - y2) - (x0 - x2) * (y0 - y1)) +
+                 (z1 - z2) * ((x0 - x1) * (z0 - z2) - (x0 - x2) * (z0 - z1))) /
+                a012 / l12;
+
+            float lb =
+                -((x1 - x2) * ((x0 - x1) * (y0 - y2) - (x0 - x2) * (y0 - y1)) -
+                  (z1 - z2) * ((y0 - y1) * (z0 - z2) - (y0 - y2) * (z0 - z1))) /
+                a012 / l12;
+
+            float lc =
+                -((x1 - x2) * ((x0 - x1) * (z0 - z2) - (x0 - x2) * (z0 - z1)) +
+                  (y1 - y2) * ((y0 - y1) * (z0 - z2) - (y0 - y2) * (z0 - z1))) /
+                a012 / l12;
+
+            float ld2 = a012 / l12;
+
+            float s = 1 - 0.9 * fabs(ld2);
+
+            coeff.x = s * la;
+            coeff.y = s * lb;
+            coeff.z = s * lc;
+            coeff.intensity = s * ld2;
+
+            if (s > 0.1) {
+              laserCloudOri->points[i] = pointOri;
+              coeffSel->points[i] = coeff;
+              coeffSelFlag[i] = 1;
+            }
           }
         }
-      }
+    }
     }
   }
 
+  // the surf slots follow the corner slots
   void surfOptimization(int iterCount) {
     updatePointAssociateToMapSinCos();
-    for (int i = 0; i < laserCloudSurfTotalLastDSNum; i++) {
-      pointOri = laserCloudSurfTotalLastDS->points[i];
-      pointAssociateToMap(&pointOri, &pointSel);
-      kdtreeSurfFromMap->nearestKSearch(pointSel, 5, pointSearchInd,
-                                        pointSearchSqDis);
-
-      if (pointSearchSqDis[4] < 1.0) {
-        for (int j = 0; j < 5; j++) {
-          matA0.at<float>(j, 0) =
-              laserCloudSurfFromMapDS->points[pointSearchInd[j]].x;
-          matA0.at<float>(j, 1) =
-              laserCloudSurfFromMapDS->points[pointSearchInd[j]].y;
-          matA0.at<float>(j, 2) =
-              laserCloudSurfFromMapDS->points[pointSearchInd[j]].z;
-        }
-        cv::solve(matA0, matB0, matX0, cv::DECOMP_QR);
-
-        float pa = matX0.at<float>(0, 0);
-        float pb = matX0.at<float>(1, 0);
-        float pc = matX0.at<float>(2, 0);
-        float pd = 1;
-
-        float ps = sqrt(pa * pa + pb * pb + pc * pc);
-        pa /= ps;
-        pb /= ps;
-        pc /= ps;
-        pd /= ps;
-
-        bool planeValid = true;
-        for (int j = 0; j < 5; j++) {
-          if (fabs(pa * laserCloudSurfFromMapDS->points[pointSearchInd[j]].x +
-                   pb * laserCloudSurfFromMapDS->points[pointSearchInd[j]].y +
-                   pc * laserCloudSurfFromMapDS->points[pointSearchInd[j]].z +
-                   pd) > 0.2) {
-            planeValid = false;
-            break;
-          }
-        }
-
-        if (planeValid) {
-          float pd2 = pa * pointSel.x + pb * pointSel.y + pc * pointSel.z + pd;
-
-          float s = 1 - 0.9 * fabs(pd2) /
-                            sqrt(sqrt(pointSel.x * pointSel.x +
-                                      pointSel.y * pointSel.y +
-                                      pointSel.z * pointSel.z));
+#pragma omp parallel
+    {
+      PointType pointOri, pointSel, coeff;
+      std::vector<int> pointSearchInd;
+      std::vector<float> pointSearchSqDis;
+      cv::Mat matA0(5, 3, CV_32F, cv::Scalar::all(0));
+      cv::Mat matX0(3, 1, CV_32F, cv::Scalar::all(0));
+
+#pragma omp for schedule(static)
+      for (int i = 0; i < laserCloudSurfTotalLastDSNum; i++) {
+        pointOri = laserCloudSurfTotalLastDS->points[i];
+        pointAssociateToMap(&pointOri, &pointSel);
+        kdtreeSurfFromMap->nearestKSearch(pointSel, 5, pointSearchInd,
+                                          pointSearchSqDis);
 
-          coeff.x = s * pa;
-          coeff.y = s * pb;
-          coeff.z = s * pc;
-          coeff.intensity = s * pd2;
+        if (pointSearchSqDis[4] < 1.0) {
+          for (int j = 0; j < 5; j++) {
+            matA0.at<float>(j, 0) =
+                laserCloudSurfFromMapDS->points[pointSearchInd[j]].x;
+            matA0.at<float>(j, 1) =
+                laserCloudSurfFromMapDS->points[pointSearchInd[j]].y;
+            matA0.at<float>(j, 2) =
+                laserCloudSurfFromMapDS->points[pointSearchInd[j]].z;
+          }
+          cv::solve(matA0, matB0, matX0, cv::DECOMP_QR);
+
+          float pa = matX0.at<float>(0, 0);
+          float pb = matX0.at<float>(1, 0);
+          float pc = matX0.at<float>(2, 0);
+          float pd = 1;
+
+          float ps = sqrt(pa * pa + pb * pb + pc * pc);
+          pa /= ps;
+          pb /= ps;
+          pc /= ps;
+          pd /= ps;
+
+          bool planeValid = true;
+          for (int j = 0; j < 5; j++) {
+            if (fabs(pa * laserCloudSurfFromMapDS->points[pointSearchInd[j]].x +
+                     pb * laserCloudSurfFromMapDS->points[pointSearchInd[j]].y +
+                     pc * laserCloudSurfFromMapDS->points[pointSearchInd[j]].z +
+                     pd) > 0.2) {
+              planeValid = false;
+              break;
+            }
+          }
 
-          if (s > 0.1) {
-            laserCloudOri->push_back(pointOri);
-            coeffSel->push_back(coeff);
+          if (planeValid) {
+            float pd2 =
+                pa * pointSel.x + pb * pointSel.y + pc * pointSel.z + pd;
+
+            float s = 1 - 0.9 * fabs(pd2) /
+                              sqrt(sqrt(pointSel.x * pointSel.x +
+                                        pointSel.y * pointSel.y +
+                                        pointSel.z * pointSel.z));
+
+            coeff.x = s * pa;
+            coeff.y = s * pb;
+            coeff.z = s * pc;
+            coeff.intensity = s * pd2;
+
+            if (s > 0.1) {
+              int slot = laserCloudCornerLastDSNum + i;
+              laserCloudOri->points[slot] = pointOri;
+              coeffSel->points[slot] = coeff;
+              coeffSelFlag[slot] = 1;
+            }
           }
         }
-      }
+    }
     }
   }
 
@@ -1528,20 +1774,18 @@ class MappingHandler {
     float srz = sin(transformTobeMapped[2]);
     float crz = cos(transformTobeMapped[2]);
 
-    int laserCloudSelNum = laserCloudOri->points.size();
-    if (laserCloudSelNum < 50) {
-      return false;
-    }
-
-    cv::Mat matA(laserCloudSelNum, 6, CV_32F, cv::Scalar::all(0));
-    cv::Mat matAt(6, laserCloudSelNum, CV_32F, cv::Scalar::all(0));
-    cv::Mat matAtA(6, 6, CV_32F, cv::Scalar::all(0));
-    cv::Mat matB(laserCloudSelNum, 1, CV_32F, cv::Scalar::all(0));
-    cv::Mat matAtB(6, 1, CV_32F, cv::Scalar::all(0));
-    cv::Mat matX(6, 1, CV_32F, cv::Scalar::all(0));
-    for (int i = 0; i < laserCloudSelNum; i++) {
-      pointOri = laserCloudOri->points[i];
-      coeff = coeffSel->points[i];
+    // J^T J and J^T r are summed over the matched slots directly, without the
+    // dense Jacobian
+    int slotNum = laserCloudOri->points.size();
+    int laserCloudSelNum = 0;
+    double AtA[36] = {0};
+    double AtB[6] = {0};
+#pragma omp parallel for schedule(static) \
+    reduction(+ : laserCloudSelNum, AtA[:36], AtB[:6])
+    for (int i = 0; i < slotNum; i++) {
+      if (!coeffSelFlag[i]) continue;
+      const PointType& pointOri = laserCloudOri->points[i];
+      const PointType& coeff = coeffSel->points[i];
 
       float arx = (crx * sry * srz * pointOri.x + crx * crz * sry * pointOri.y -
                    srx * sry * pointOri.z) *
@@ -1570,17 +1814,29 @@ class MappingHandler {
                    (crz * sry - cry * srx * srz) * pointOri.y) *
                       coeff.z;
 
-      matA.at<float>(i, 0) = arx;
-      matA.at<float>(i, 1) = ary;
-      matA.at<float>(i, 2) = arz;
-      matA.at<float>(i, 3) = coeff.x;
-      matA.at<float>(i, 4) = coeff.y;
-      matA.at<float>(i, 5) = coeff.z;
-      matB.at<float>(i, 0) = -coeff.intensity;
+      float a[6] = {arx, ary, arz, coeff.x, coeff.y, coeff.z};
+      for (int j = 0; j < 6; j++) {
+        for (int k = j; k < 6; k++) {
+          AtA[j * 6 + k] += a[j] * a[k];
+        }
+        AtB[j] -= a[j] * coeff.intensity;
+      }
+      laserCloudSelNum++;
+    }
+    if (laserCloudSelNum < 50) {
+      return false;
+    }
+
+    cv::Mat matAtA(6, 6, CV_32F, cv::Scalar::all(0));
+    cv::Mat matAtB(6, 1, CV_32F, cv::Scalar::all(0));
+    cv::Mat matX(6, 1, CV_32F, cv::Scalar::all(0));
+    for (int j = 0; j < 6; j++) {
+      for (int k = j; k < 6; k++) {
+        matAtA.at<float>(j, k) = AtA[j * 6 + k];
+        matAtA.at<float>(k, j) = AtA[j * 6 + k];
+      }
+      matAtB.at<float>(j, 0) = AtB[j];
     }
-    cv::transpose(matA, matAt);
-    matAtA = matAt * matA;
-    matAtB = matAt * matB;
     cv::solve(matAtA, matAtB, matX, cv::DECOMP_QR);
 
     if (iterCount == 0) {
@@ -1634,12 +1890,12 @@ class MappingHandler {
 
   void scan2MapOptimization() {
     if (laserCloudCornerFromMapDSNum > 10 && laserCloudSurfFromMapDSNum > 100) {
-      kdtreeCornerFromMap->setInputCloud(laserCloudCornerFromMapDS);
-      kdtreeSurfFromMap->setInputCloud(laserCloudSurfFromMapDS);
+      int slotNum = laserCloudCornerLastDSNum + laserCloudSurfTotalLastDSNum;
+      laserCloudOri->resize(slotNum);
+      coeffSel->resize(slotNum);
 
       for (int iterCount = 0; iterCount < 10; iterCount++) {
-        laserCloudOri->clear();
-        coeffSel->clear();
+        coeffSelFlag.assign(slotNum, 0);
 
         cornerOptimization(iterCount);
         surfOptimization(iterCount);
@@ -1666,7 +1922,10 @@ class MappingHandler {
       saveThisKeyFrame = false;
     }
 
-    if (saveThisKeyFrame == false && !cloudKeyPoses3D->points.empty()) return;
+    if (saveThisKeyFrame == false && !cloudKeyPoses3D->points.empty()) {
+      if (!loopFactorGraph.empty()) updateISAM();
+      return;
+    }
 
     previousRobotPosPoint = currentRobotPosPoint;
 
@@ -1704,19 +1963,14 @@ class MappingHandler {
                        transformAftMapped[4])));
     }
 
-    isam->update(gtSAMgraph, initialEstimate);
-    isam->update();
-
-    gtSAMgraph.resize(0);
-    initialEstimate.clear();
+    updateISAM();
 
     PointType thisPose3D;
     PointTypePose thisPose6D;
     Pose3 latestEstimate;
 
-    isamCurrentEstimate = isam->calculateEstimate();
     latestEstimate =
-        isamCurrentEstimate.at<Pose3>(isamCurrentEstimate.size() - 1);
+        isam->calculateEstimate<Pose3>(cloudKeyPoses3D->points.size());
 
     thisPose3D.x = latestEstimate.translation().y();
     thisPose3D.y = latestEstimate.translation().z();
@@ -1759,9 +2013,39 @@ class MappingHandler {
     pcl::copyPointCloud(*laserCloudSurfLastDS, *thisSurfKeyFrame);
     pcl::copyPointCloud(*laserCloudOutlierLastDS, *thisOutlierKeyFrame);
 
-    cornerCloudKeyFrames.push_back(thisCornerKeyFrame);
-    surfCloudKeyFrames.push_back(thisSurfKeyFrame);
-    outlierCloudKeyFrames.push_back(thisOutlierKeyFrame);
+    keyFrameStore.push_back(thisCornerKeyFrame, thisSurfKeyFrame,
+                            thisOutlierKeyFrame);
+    ++keyPosesVersion;
+  }
+
+  // applies the factors of gtSAMgraph and the pending loop closure factors
+  void updateISAM() {
+    bool loopFactorsAdded = !loopFactorGraph.empty();
+    if (loopFactorsAdded) {
+      gtSAMgraph.push_back(loopFactorGraph);
+      loopFactorGraph.resize(0);
+    }
+
+    ISAM2Result result = isam->update(gtSAMgraph, initialEstimate);
+
+    gtSAMgraph.resize(0);
+    initialEstimate.clear();
+
+    bool extraUpdate = loopFactorsAdded || ISAM_UPDATE_ERROR_RATIO <= 0.0;
+    if (!extraUpdate && result.errorBefore && result.errorAfter) {
+      double errorBefore = *result.errorBefore;
+      extraUpdate = errorBefore - *result.errorAfter >
+                    ISAM_UPDATE_ERROR_RATIO * errorBefore;
+    }
+    if (extraUpdate) {
+      isam->update();
+      ++isamExtraUpdateNum;
+    }
+
+    if (loopFactorsAdded) {
+      isamCurrentEstimate = isam->calculateEstimate();
+      aLoopIsClosed = true;
+    }
   }
 
   void correctPoses() {
@@ -1790,17 +2074,12 @@ class MappingHandler {
             isamCurrentEstimate.at<Pose3>(i).rotation().roll();
       }
 
+      ++keyPosesVersion;
+      ++keyPosesCorrectionNum;
       aLoopIsClosed = false;
     }
   }
 
-  void clearCloud() {
-    laserCloudCornerFromMap->clear();
-    laserCloudSurfFromMap->clear();
-    laserCloudCornerFromMapDS->clear();
-    laserCloudSurfFromMapDS->clear();
-  }
-
   int lidarCounter = 0;
   double duration_ = 0;
   void run() {
@@ -1841,7 +2120,7 @@ class MappingHandler {
 
         publishKeyPosesAndFrames();
 
-        clearCloud();
+        publishMemoryUsage();
 
         double time_total = ts_total.toc();
         if (VERBOSE) {
@@ -1849,6 +2128,15 @@ class MappingHandler {
               (duration_ * lidarCounter + time_total) / (lidarCounter + 1);
           lidarCounter++;
           // std::cout << "Mapping: time: " << duration_ << std::endl;
+          ROS_INFO_STREAM_THROTTLE(
+              10, "Key frames: " << keyFrameStore.size() << ", in RAM "
+                                 << keyFrameStore.ramFrameNum() << " ("
+                                 << keyFrameStore.ramBytes() / 1024 / 1024
+                                 << " MB), evicted "
+                                 << keyFrameStore.evictedNum() << ", reloaded "
+                                 << keyFrameStore.reloadedNum()
+                                 << ", iSAM2 extra updates "
+                                 << isamExtraUpdateNum);
         }
       }
     }
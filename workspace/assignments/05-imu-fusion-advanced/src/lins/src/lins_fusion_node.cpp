@@ -19,6 +19,7 @@
 
 #include <parameters.h>
 #include <Estimator.h>
+#include <ThreadConfig.h>
 
 int main(int argc, char** argv) {
   ros::init(argc, argv, "lins_fusion_node");
@@ -29,8 +30,15 @@ int main(int argc, char** argv) {
 
   parameter::readParameters(pnh);
 
+  // Pinning, scheduling class and memory locking of the estimation loop, see
+  // the fusion_* settings of the config file
+  ThreadConfig threadConfig("lins_fusion_node", parameter::FUSION_CPUS,
+                            parameter::FUSION_SCHED_POLICY,
+                            parameter::FUSION_PRIORITY,
+                            parameter::FUSION_LOCK_MEMORY);
+
   fusion::LinsFusion lins(nh, pnh);
-  lins.run();
+  lins.run(threadConfig);
 
   ros::spin();
   return 0;
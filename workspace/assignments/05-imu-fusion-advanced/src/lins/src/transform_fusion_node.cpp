@@ -30,6 +30,11 @@
 //   J. Zhang and S. Singh. LOAM: Lidar Odometry and Mapping in Real-time.
 //     Robotics: Science and Systems Conference (RSS). Berkeley, CA, July 2014.
 
+#include <ros/callback_queue.h>
+
+#include "PoseRingBuffer.h"
+#include "cloud_msgs/query_pose.h"
+#include "parameters.h"
 #include "utility.h"
 
 class TransformFusion {
@@ -58,8 +63,18 @@ class TransformFusion {
 
   std_msgs::Header currentHeader;
 
+  // poses at arbitrary time stamps, queried from a thread of their own so
+  // that they never wait behind the odometry callbacks
+  PoseRingBuffer poseBuffer;
+  ros::NodeHandle nhQuery;
+  ros::CallbackQueue queryQueue;
+  ros::AsyncSpinner querySpinner;
+  ros::ServiceServer srvQueryPose;
+
  public:
-  TransformFusion() {
+  TransformFusion()
+      : poseBuffer(parameter::POSE_BUFFER_SIZE),
+        querySpinner(1, &queryQueue) {
     pubLaserOdometry2 =
         nh.advertise<nav_msgs::Odometry>("/integrated_to_init", 5);
     subLaserOdometry = nh.subscribe<nav_msgs::Odometry>(
@@ -86,6 +101,11 @@ class TransformFusion {
       transformBefMapped[i] = 0;
       transformAftMapped[i] = 0;
     }
+
+    nhQuery.setCallbackQueue(&queryQueue);
+    srvQueryPose = nhQuery.advertiseService(
+        "/query_pose", &TransformFusion::queryPoseHandler, this);
+    querySpinner.start();
   }
 
   void transformAssociateToMap() {
@@ -251,6 +271,34 @@ class TransformFusion {
     laserOdometryTrans2.setOrigin(tf::Vector3(
         transformMapped[3], transformMapped[4], transformMapped[5]));
     tfBroadcaster2.sendTransform(laserOdometryTrans2);
+
+    const geometry_msgs::Pose& pose = laserOdometry2.pose.pose;
+    poseBuffer.addPose(
+        laserOdometry->header.stamp.toSec(),
+        Eigen::Vector3d(pose.position.x, pose.position.y, pose.position.z),
+        Eigen::Quaterniond(pose.orientation.w, pose.orientation.x,
+                           pose.orientation.y, pose.orientation.z));
+  }
+
+  // Fused pose of /camera in /camera_init at an arbitrary time stamp within
+  // the latest pose_buffer_size odometry outputs
+  bool queryPoseHandler(cloud_msgs::query_pose::Request& req,
+                        cloud_msgs::query_pose::Response& res) {
+    Eigen::Vector3d p;
+    Eigen::Quaterniond q;
+    res.success = poseBuffer.lookup(req.stamp.toSec(), p, q);
+    if (!res.success) return true;
+
+    res.pose.header.stamp = req.stamp;
+    res.pose.header.frame_id = "/camera_init";
+    res.pose.pose.position.x = p.x();
+    res.pose.pose.position.y = p.y();
+    res.pose.pose.position.z = p.z();
+    res.pose.pose.orientation.x = q.x();
+    res.pose.pose.orientation.y = q.y();
+    res.pose.pose.orientation.z = q.z();
+    res.pose.pose.orientation.w = q.w();
+    return true;
   }
 
   void odomAftMappedHandler(const nav_msgs::Odometry::ConstPtr& odomAftMapped) {
@@ -279,6 +327,9 @@ class TransformFusion {
 
 int main(int argc, char** argv) {
   ros::init(argc, argv, "lego_loam");
+  ros::NodeHandle pnh("~");
+
+  parameter::readParameters(pnh);
 
   TransformFusion TFusion;
 